@@ -21,12 +21,16 @@ LOCAL_SRC_FILES:= \
 	driver/rsdFrameBuffer.cpp \
 	driver/rsdFrameBufferObj.cpp \
 	driver/rsdGL.cpp \
+	driver/rsdGLWorker.cpp \
+	driver/rsdGLTimer.cpp \
 	driver/rsdMesh.cpp \
 	driver/rsdMeshObj.cpp \
 	driver/rsdPath.cpp \
+	driver/rsdPlacement.cpp \
 	driver/rsdProgram.cpp \
 	driver/rsdProgramRaster.cpp \
 	driver/rsdProgramStore.cpp \
+	driver/rsdQuadBatch.cpp \
 	driver/rsdRuntimeStubs.cpp \
 	driver/rsdSampler.cpp \
 	driver/rsdScriptGroup.cpp \
@@ -116,17 +120,21 @@ LOCAL_SRC_FILES:= \
 	rsAdapter.cpp \
 	rsAllocation.cpp \
 	rsAnimation.cpp \
+	rsCommandBuffer.cpp \
 	rsComponent.cpp \
+	rsCompress.cpp \
 	rsContext.cpp \
 	rsCppUtils.cpp \
 	rsDevice.cpp \
 	rsElement.cpp \
 	rsFBOCache.cpp \
+	rsFifoRing.cpp \
 	rsFifoSocket.cpp \
 	rsFileA3D.cpp \
 	rsFont.cpp \
 	rsGrallocConsumer.cpp \
 	rsObjectBase.cpp \
+	rsObjectSlab.cpp \
 	rsMatrix2x2.cpp \
 	rsMatrix3x3.cpp \
 	rsMatrix4x4.cpp \
@@ -148,6 +156,7 @@ LOCAL_SRC_FILES:= \
 	rsSignal.cpp \
 	rsStream.cpp \
 	rsThreadIO.cpp \
+	rsTrace.cpp \
 	rsType.cpp
 
 LOCAL_SHARED_LIBRARIES += liblog libcutils libutils libEGL libGLESv1_CM libGLESv2 libbcc
@@ -209,15 +218,19 @@ LOCAL_SRC_FILES:= \
 	rsAdapter.cpp \
 	rsAllocation.cpp \
 	rsAnimation.cpp \
+	rsCommandBuffer.cpp \
 	rsComponent.cpp \
+	rsCompress.cpp \
 	rsContext.cpp \
 	rsDevice.cpp \
 	rsElement.cpp \
 	rsFBOCache.cpp \
+	rsFifoRing.cpp \
 	rsFifoSocket.cpp \
 	rsFileA3D.cpp \
 	rsFont.cpp \
 	rsObjectBase.cpp \
+	rsObjectSlab.cpp \
 	rsMatrix2x2.cpp \
 	rsMatrix3x3.cpp \
 	rsMatrix4x4.cpp \
@@ -239,6 +252,7 @@ LOCAL_SRC_FILES:= \
 	rsSignal.cpp \
 	rsStream.cpp \
 	rsThreadIO.cpp \
+	rsTrace.cpp \
 	rsType.cpp
 
 LOCAL_STATIC_LIBRARIES := libcutils libutils liblog
@@ -261,6 +275,7 @@ rsloader_SRC_FILES := \
   cpu_ref/linkloader/lib/ELFSectionHeader.cpp \
   cpu_ref/linkloader/lib/ELFTypes.cpp \
   cpu_ref/linkloader/lib/GOT.cpp \
+  cpu_ref/linkloader/lib/MemArena.cpp \
   cpu_ref/linkloader/lib/MemChunk.cpp \
   cpu_ref/linkloader/lib/StubLayout.cpp \
   cpu_ref/linkloader/utils/helper.cpp \
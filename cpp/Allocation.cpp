@@ -48,7 +48,9 @@ Allocation::Allocation(void *id, sp<RS> rs, sp<const Type> t, uint32_t usage) :
                    RS_ALLOCATION_USAGE_GRAPHICS_RENDER_TARGET |
                    RS_ALLOCATION_USAGE_IO_INPUT |
                    RS_ALLOCATION_USAGE_IO_OUTPUT |
-                   RS_ALLOCATION_USAGE_SHARED)) != 0) {
+                   RS_ALLOCATION_USAGE_SHARED |
+                   RS_ALLOCATION_USAGE_FIELD_PLANES |
+                   RS_ALLOCATION_USAGE_TILED)) != 0) {
         ALOGE("Unknown usage specified.");
     }
 
@@ -169,10 +171,67 @@ void Allocation::ioGetInput() {
 #endif
 }
 
+void Allocation::setIoInputQueue(uint32_t depth, bool latest) {
+#ifndef RS_COMPATIBILITY_LIB
+    if ((mUsage & RS_ALLOCATION_USAGE_IO_INPUT) == 0) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Can only queue buffers if IO_INPUT usage specified.");
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->AllocationSetIoInputQueue(mRS->getContext(), getID(),
+                                                             depth, latest));
+#endif
+}
+
 void Allocation::generateMipmaps() {
     tryDispatch(mRS, RS::dispatch->AllocationGenerateMipmaps(mRS->getContext(), getID()));
 }
 
+void Allocation::resize(uint32_t dimX) {
+    if ((mType->getY() > 0) || (mType->getZ() > 0) || mType->hasFaces() || mType->hasMipmaps()) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Resize only supported for 1D allocations.");
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->AllocationResize1D(mRS->getContext(), getID(), dimX));
+    updateFromNative();
+}
+
+void Allocation::reserve(uint32_t dimX) {
+    if ((mType->getY() > 0) || (mType->getZ() > 0) || mType->hasFaces() || mType->hasMipmaps()) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Reserve only supported for 1D allocations.");
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->AllocationReserve1D(mRS->getContext(), getID(), dimX));
+}
+
+void Allocation::shrinkToFit() {
+    reserve(0);
+}
+
+void Allocation::sort() {
+    tryDispatch(mRS, RS::dispatch->AllocationSort(mRS->getContext(), getID(), NULL));
+}
+
+void Allocation::sortByKey(sp<Allocation> values) {
+    if (values == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "sortByKey needs values.");
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->AllocationSort(mRS->getContext(), getID(), values->getID()));
+}
+
+uint32_t Allocation::compact(sp<Allocation> src, sp<Allocation> flags) {
+    if ((src == NULL) || (flags == NULL)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "compact needs a source and flags.");
+        return 0;
+    }
+    uint32_t count = 0;
+    if (mRS->getError() == RS_SUCCESS) {
+        count = RS::dispatch->AllocationCompact(mRS->getContext(), getID(), src->getID(),
+                                                flags->getID());
+    }
+    return count;
+}
+
 void Allocation::copy1DRangeFrom(uint32_t off, size_t count, const void *data) {
 
     if(count < 1) {
@@ -204,6 +263,24 @@ void Allocation::copy1DRangeTo(uint32_t off, size_t count, void *data) {
                                                     count, data, count * mType->getElement()->getSizeBytes()));
 }
 
+sp<Fence> Allocation::copy1DRangeToAsync(uint32_t off, size_t count, void *data,
+                                         FenceCallback_t callback, void *usr) {
+    if(count < 1) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Count must be >= 1.");
+        return NULL;
+    }
+    if((off + count) > mCurrentCount) {
+        ALOGE("Overflow, Available count %zu, got %zu at offset %zu.", mCurrentCount, count, off);
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid copy specified");
+        return NULL;
+    }
+
+    tryDispatch(mRS, RS::dispatch->Allocation1DReadAsync(mRS->getContext(), getIDSafe(), off,
+                                                         mSelectedLOD, count, (uintptr_t)data,
+                                                         count * mType->getElement()->getSizeBytes()));
+    return mRS->fence(callback, usr);
+}
+
 void Allocation::copy1DRangeFrom(uint32_t off, size_t count, sp<const Allocation> data,
                                  uint32_t dataOff) {
 
@@ -259,6 +336,17 @@ void Allocation::copy2DRangeTo(uint32_t xoff, uint32_t yoff, uint32_t w, uint32_
                                                     w * mType->getElement()->getSizeBytes()));
 }
 
+sp<Fence> Allocation::copy2DRangeToAsync(uint32_t xoff, uint32_t yoff, uint32_t w, uint32_t h,
+                                         void *data, FenceCallback_t callback, void *usr) {
+    validate2DRange(xoff, yoff, w, h);
+    tryDispatch(mRS, RS::dispatch->Allocation2DReadAsync(mRS->getContext(), getIDSafe(), xoff, yoff,
+                                                         mSelectedLOD, mSelectedFace, w, h,
+                                                         (uintptr_t)data,
+                                                         w * h * mType->getElement()->getSizeBytes(),
+                                                         w * mType->getElement()->getSizeBytes()));
+    return mRS->fence(callback, usr);
+}
+
 void Allocation::copy2DStridedFrom(uint32_t xoff, uint32_t yoff, uint32_t w, uint32_t h,
                                    const void *data, size_t stride) {
     validate2DRange(xoff, yoff, w, h);
@@ -311,6 +399,22 @@ void Allocation::copy3DRangeFrom(uint32_t xoff, uint32_t yoff, uint32_t zoff, ui
                                                          dataXoff, dataYoff, dataZoff, data->mSelectedLOD));
 }
 
+void Allocation::copy3DRangeFrom(uint32_t xoff, uint32_t yoff, uint32_t zoff, uint32_t w,
+                                 uint32_t h, uint32_t d, sp<const Allocation> data,
+                                 uint32_t dataXoff, uint32_t dataYoff, uint32_t dataZoff,
+                                 RsAllocationConversion conversion) {
+    if (data == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Converting copies need a source.");
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->AllocationCopyConvert(mRS->getContext(), getIDSafe(),
+                                                         xoff, yoff, zoff, mSelectedLOD,
+                                                         mSelectedFace, w, h, d,
+                                                         data->getIDSafe(), dataXoff, dataYoff,
+                                                         dataZoff, data->mSelectedLOD,
+                                                         data->mSelectedFace, conversion));
+}
+
 
 sp<Allocation> Allocation::createTyped(sp<RS> rs, sp<const Type> type,
                                     RsAllocationMipmapControl mips, uint32_t usage) {
@@ -345,6 +449,89 @@ sp<Allocation> Allocation::createTyped(sp<RS> rs, sp<const Type> type,
     return createTyped(rs, type, RS_ALLOCATION_MIPMAP_NONE, usage);
 }
 
+sp<Allocation> Allocation::createAdapter(sp<RS> rs, sp<Allocation> base, sp<const Type> type) {
+    void *id = 0;
+    if (rs->getError() == RS_SUCCESS) {
+        id = RS::dispatch->AllocationAdapterCreate(rs->getContext(), type->getID(), base->getID());
+    }
+    if (id == 0) {
+        rs->throwError(RS_ERROR_RUNTIME_ERROR, "Allocation adapter creation failed");
+        return NULL;
+    }
+    sp<Allocation> a = new Allocation(id, rs, type, RS_ALLOCATION_USAGE_SCRIPT);
+    a->mAdaptedAllocation = base;
+    memset(a->mAdapterOffsets, 0, sizeof(a->mAdapterOffsets));
+    return a;
+}
+
+void Allocation::setAdapterOffset(uint32_t x, uint32_t y, uint32_t z, uint32_t lod,
+                                  RsAllocationCubemapFace face) {
+    if (mAdaptedAllocation == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Only adapters can be offset.");
+        return;
+    }
+    mAdapterOffsets[0] = x;
+    mAdapterOffsets[1] = y;
+    mAdapterOffsets[2] = z;
+    mAdapterOffsets[3] = lod;
+    mAdapterOffsets[4] = (uint32_t)face;
+    tryDispatch(mRS, RS::dispatch->AllocationAdapterOffset(mRS->getContext(), getID(),
+                                                           mAdapterOffsets,
+                                                           sizeof(mAdapterOffsets)));
+}
+
+void Allocation::setAdapterField(uint32_t field) {
+    if (mAdaptedAllocation == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Only adapters can be offset.");
+        return;
+    }
+    uint32_t offsets[6];
+    memcpy(offsets, mAdapterOffsets, sizeof(mAdapterOffsets));
+    offsets[5] = field;
+    tryDispatch(mRS, RS::dispatch->AllocationAdapterOffset(mRS->getContext(), getID(),
+                                                           offsets, sizeof(offsets)));
+}
+
+int Allocation::exportShared() {
+    int fd = -1;
+    if (mRS->getError() == RS_SUCCESS) {
+        fd = RS::dispatch->AllocationExport(mRS->getContext(), getID());
+    }
+    if (fd < 0) {
+        mRS->throwError(RS_ERROR_RUNTIME_ERROR, "Allocation export failed");
+    }
+    return fd;
+}
+
+sp<Allocation> Allocation::createFromShared(sp<RS> rs, sp<const Type> type, int fd,
+                                            uint32_t usage) {
+    void *id = 0;
+    if (rs->getError() == RS_SUCCESS) {
+        id = RS::dispatch->AllocationImport(rs->getContext(), type->getID(), usage, fd);
+    }
+    if (id == 0) {
+        rs->throwError(RS_ERROR_RUNTIME_ERROR, "Shared allocation import failed");
+        return NULL;
+    }
+    return new Allocation(id, rs, type, usage);
+}
+
+void * Allocation::getPointer(size_t *stride) {
+    if (!(mUsage & RS_ALLOCATION_USAGE_SCRIPT)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Allocation does not support USAGE_SCRIPT.");
+        return NULL;
+    }
+    void *p = NULL;
+    if (mRS->getError() == RS_SUCCESS) {
+        p = RS::dispatch->AllocationGetPointer(mRS->getContext(), getIDSafe(), mSelectedLOD,
+                                               mSelectedFace, mSelectedZ, stride, sizeof(size_t));
+    }
+    if (p == NULL) {
+        mRS->throwError(RS_ERROR_RUNTIME_ERROR, "Allocation can't be mapped");
+    }
+    return p;
+}
+
 sp<Allocation> Allocation::createSized(sp<RS> rs, sp<const Element> e,
                                     size_t count, uint32_t usage) {
     Type::Builder b(rs, e);
@@ -7,6 +7,8 @@ rs_cpp_SRC_FILES := \
 	Script.cpp \
 	ScriptC.cpp \
 	ScriptIntrinsics.cpp \
+	ScriptGroup.cpp \
+	CommandBuffer.cpp \
 	Sampler.cpp
 
 LOCAL_PATH:= $(call my-dir)
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RenderScript.h"
+#include "rsCppInternal.h"
+
+using namespace android;
+using namespace RSC;
+
+CommandBuffer::CommandBuffer(void *id, sp<RS> rs) : BaseObj(id, rs) {
+}
+
+sp<CommandBuffer> CommandBuffer::create(sp<RS> rs) {
+    void *id = createDispatch(rs, RS::dispatch->CommandBufferCreate(rs->getContext()));
+    if (id == NULL) {
+        return NULL;
+    }
+    return new CommandBuffer(id, rs);
+}
+
+void CommandBuffer::beginRecording() {
+    tryDispatch(mRS, RS::dispatch->CommandBufferBegin(mRS->getContext(), getID()));
+}
+
+void CommandBuffer::markParam() {
+    tryDispatch(mRS, RS::dispatch->CommandBufferMarkParam(mRS->getContext(), getID()));
+}
+
+void CommandBuffer::endRecording() {
+    tryDispatch(mRS, RS::dispatch->CommandBufferEnd(mRS->getContext(), getID()));
+}
+
+void CommandBuffer::submit() {
+    submit(NULL, 0);
+}
+
+void CommandBuffer::submit(const void *params, size_t sizeBytes) {
+    tryDispatch(mRS, RS::dispatch->CommandBufferSubmit(mRS->getContext(), getID(),
+                                                       params, sizeBytes));
+}
@@ -286,6 +286,18 @@ android::RSC::sp<const Element> Element::createVector(android::RSC::sp<RS> rs, R
 }
 
 android::RSC::sp<const Element> Element::createPixel(android::RSC::sp<RS> rs, RsDataType dt, RsDataKind dk) {
+    if (dk == RS_KIND_PIXEL_ETC1 ||
+        dk == RS_KIND_PIXEL_ETC2_RGB ||
+        dk == RS_KIND_PIXEL_ETC2_RGBA) {
+        // One cell per compressed 4x4 block.
+        if (dt != RS_TYPE_UNSIGNED_32) {
+            rs->throwError(RS_ERROR_INVALID_PARAMETER, "Bad kind and type combo");
+            return NULL;
+        }
+        int size = (dk == RS_KIND_PIXEL_ETC2_RGBA) ? 4 : 2;
+        void * id = RS::dispatch->ElementCreate(rs->getContext(), dt, dk, true, size);
+        return new Element(id, rs, dt, dk, true, size);
+    }
     if (!(dk == RS_KIND_PIXEL_L ||
           dk == RS_KIND_PIXEL_A ||
           dk == RS_KIND_PIXEL_LA ||
@@ -390,6 +402,15 @@ void Element::Builder::add(android::RSC::sp</*const*/ Element>e, std::string &na
 
 android::RSC::sp<const Element> Element::Builder::create() {
     size_t fieldCount = mElements.size();
+    std::vector<void *> ids(fieldCount);
+    for (size_t ct = 0; ct < fieldCount; ct++) {
+        ids[ct] = mElements[ct]->getID();
+    }
+    sp<const Element> cached = mRS->findElement(ids, mElementNames, mArraySizes);
+    if (cached.get()) {
+        return cached;
+    }
+
     const char ** nameArray = (const char **)calloc(fieldCount, sizeof(char *));
     const Element ** elementArray = (const Element **)calloc(fieldCount, sizeof(Element *));
     size_t* sizeArray = (size_t*)calloc(fieldCount, sizeof(size_t));
@@ -409,6 +430,8 @@ android::RSC::sp<const Element> Element::Builder::create() {
     free(nameArray);
     free(sizeArray);
     free(elementArray);
-    return new Element(id, mRS, mElements, mElementNames, mArraySizes);
+    sp<const Element> e = new Element(id, mRS, mElements, mElementNames, mArraySizes);
+    mRS->addElement(ids, mElementNames, mArraySizes, e);
+    return e;
 }
 
@@ -45,6 +45,12 @@ RS::RS() {
     mMessageRun = false;
     mInit = false;
     mCurrentError = RS_SUCCESS;
+    mFenceSent = 0;
+    mFenceSignaled = 0;
+    pthread_mutex_init(&mFenceMutex, NULL);
+    pthread_cond_init(&mFenceCond, NULL);
+    pthread_mutex_init(&mCacheMutex, NULL);
+    mCacheStamp = 0;
 
     memset(&mElements, 0, sizeof(mElements));
     memset(&mSamplers, 0, sizeof(mSamplers));
@@ -64,6 +70,9 @@ RS::~RS() {
         RS::dispatch->DeviceDestroy(mDev);
         mDev = NULL;
     }
+    pthread_cond_destroy(&mFenceCond);
+    pthread_mutex_destroy(&mFenceMutex);
+    pthread_mutex_destroy(&mCacheMutex);
 }
 
 bool RS::init(std::string name, uint32_t flags) {
@@ -182,6 +191,11 @@ static bool loadSymbols(void* handle) {
         ALOGV("Couldn't initialize RS::dispatch->ContextFinish");
         return false;
     }
+    RS::dispatch->ContextFlush = (ContextFlushFnPtr)dlsym(handle, "rsContextFlush");
+    if (RS::dispatch->ContextFlush == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ContextFlush");
+        return false;
+    }
     RS::dispatch->ContextDump = (ContextDumpFnPtr)dlsym(handle, "rsContextDump");
     if (RS::dispatch->ContextDump == NULL) {
         ALOGV("Couldn't initialize RS::dispatch->ContextDump");
@@ -227,6 +241,11 @@ static bool loadSymbols(void* handle) {
         ALOGV("Couldn't initialize RS::dispatch->Allocation1DElementData");
         return false;
     }
+    RS::dispatch->AllocationElementDataBatch = (AllocationElementDataBatchFnPtr)dlsym(handle, "rsAllocationElementDataBatch");
+    if (RS::dispatch->AllocationElementDataBatch == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationElementDataBatch");
+        return false;
+    }
     RS::dispatch->Allocation2DData = (Allocation2DDataFnPtr)dlsym(handle, "rsAllocation2DData");
     if (RS::dispatch->Allocation2DData == NULL) {
         ALOGV("Couldn't initialize RS::dispatch->Allocation2DData");
@@ -267,6 +286,11 @@ static bool loadSymbols(void* handle) {
         ALOGV("Couldn't initialize RS::dispatch->AllocationResize1D");
         return false;
     }
+    RS::dispatch->AllocationReserve1D = (AllocationReserve1DFnPtr)dlsym(handle, "rsAllocationReserve1D");
+    if (RS::dispatch->AllocationReserve1D == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationReserve1D");
+        return false;
+    }
     RS::dispatch->AllocationCopy2DRange = (AllocationCopy2DRangeFnPtr)dlsym(handle, "rsAllocationCopy2DRange");
     if (RS::dispatch->AllocationCopy2DRange == NULL) {
         ALOGV("Couldn't initialize RS::dispatch->AllocationCopy2DRange");
@@ -277,6 +301,11 @@ static bool loadSymbols(void* handle) {
         ALOGV("Couldn't initialize RS::dispatch->AllocationCopy3DRange");
         return false;
     }
+    RS::dispatch->AllocationCopyConvert = (AllocationCopyConvertFnPtr)dlsym(handle, "rsAllocationCopyConvert");
+    if (RS::dispatch->AllocationCopyConvert == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationCopyConvert");
+        return false;
+    }
     RS::dispatch->SamplerCreate = (SamplerCreateFnPtr)dlsym(handle, "rsSamplerCreate");
     if (RS::dispatch->SamplerCreate == NULL) {
         ALOGV("Couldn't initialize RS::dispatch->SamplerCreate");
@@ -307,6 +336,16 @@ static bool loadSymbols(void* handle) {
         ALOGV("Couldn't initialize RS::dispatch->ScriptForEach");
         return false;
     }
+    RS::dispatch->ScriptForEachMulti = (ScriptForEachMultiFnPtr)dlsym(handle, "rsScriptForEachMulti");
+    if (RS::dispatch->ScriptForEachMulti == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ScriptForEachMulti");
+        return false;
+    }
+    RS::dispatch->ScriptReduce = (ScriptReduceFnPtr)dlsym(handle, "rsScriptReduce");
+    if (RS::dispatch->ScriptReduce == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ScriptReduce");
+        return false;
+    }
     RS::dispatch->ScriptSetVarI = (ScriptSetVarIFnPtr)dlsym(handle, "rsScriptSetVarI");
     if (RS::dispatch->ScriptSetVarI == NULL) {
         ALOGV("Couldn't initialize RS::dispatch->ScriptSetVarI");
@@ -337,6 +376,11 @@ static bool loadSymbols(void* handle) {
         ALOGV("Couldn't initialize RS::dispatch->ScriptSetVarV");
         return false;
     }
+    RS::dispatch->ScriptSetVars = (ScriptSetVarsFnPtr)dlsym(handle, "rsScriptSetVars");
+    if (RS::dispatch->ScriptSetVars == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ScriptSetVars");
+        return false;
+    }
     RS::dispatch->ScriptGetVarV = (ScriptGetVarVFnPtr)dlsym(handle, "rsScriptGetVarV");
     if (RS::dispatch->ScriptGetVarV == NULL) {
         ALOGV("Couldn't initialize RS::dispatch->ScriptGetVarV");
@@ -397,6 +441,111 @@ static bool loadSymbols(void* handle) {
         ALOGV("Couldn't initialize RS::dispatch->AllocationIoReceive");
         return false;
     }
+    RS::dispatch->AllocationSetIoInputQueue = (AllocationSetIoInputQueueFnPtr)dlsym(handle, "rsAllocationSetIoInputQueue");
+    if (RS::dispatch->AllocationSetIoInputQueue == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationSetIoInputQueue");
+        return false;
+    }
+    RS::dispatch->ContextFence = (ContextFenceFnPtr)dlsym(handle, "rsContextFence");
+    if (RS::dispatch->ContextFence == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ContextFence");
+        return false;
+    }
+    RS::dispatch->Allocation1DReadAsync = (Allocation1DReadAsyncFnPtr)dlsym(handle, "rsAllocation1DReadAsync");
+    if (RS::dispatch->Allocation1DReadAsync == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->Allocation1DReadAsync");
+        return false;
+    }
+    RS::dispatch->Allocation2DReadAsync = (Allocation2DReadAsyncFnPtr)dlsym(handle, "rsAllocation2DReadAsync");
+    if (RS::dispatch->Allocation2DReadAsync == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->Allocation2DReadAsync");
+        return false;
+    }
+    RS::dispatch->AllocationAdapterCreate = (AllocationAdapterCreateFnPtr)dlsym(handle, "rsAllocationAdapterCreate");
+    if (RS::dispatch->AllocationAdapterCreate == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationAdapterCreate");
+        return false;
+    }
+    RS::dispatch->AllocationAdapterOffset = (AllocationAdapterOffsetFnPtr)dlsym(handle, "rsAllocationAdapterOffset");
+    if (RS::dispatch->AllocationAdapterOffset == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationAdapterOffset");
+        return false;
+    }
+    RS::dispatch->AllocationExport = (AllocationExportFnPtr)dlsym(handle, "rsAllocationExport");
+    if (RS::dispatch->AllocationExport == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationExport");
+        return false;
+    }
+    RS::dispatch->AllocationImport = (AllocationImportFnPtr)dlsym(handle, "rsAllocationImport");
+    if (RS::dispatch->AllocationImport == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationImport");
+        return false;
+    }
+    RS::dispatch->AllocationGetPointer = (AllocationGetPointerFnPtr)dlsym(handle, "rsAllocationGetPointer");
+    if (RS::dispatch->AllocationGetPointer == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationGetPointer");
+        return false;
+    }
+    RS::dispatch->AllocationSort = (AllocationSortFnPtr)dlsym(handle, "rsAllocationSort");
+    if (RS::dispatch->AllocationSort == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationSort");
+        return false;
+    }
+    RS::dispatch->AllocationCompact = (AllocationCompactFnPtr)dlsym(handle, "rsAllocationCompact");
+    if (RS::dispatch->AllocationCompact == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->AllocationCompact");
+        return false;
+    }
+    RS::dispatch->ContextGetMemoryUsage = (ContextGetMemoryUsageFnPtr)dlsym(handle, "rsContextGetMemoryUsage");
+    if (RS::dispatch->ContextGetMemoryUsage == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ContextGetMemoryUsage");
+        return false;
+    }
+    RS::dispatch->ScriptForEachRegions = (ScriptForEachRegionsFnPtr)dlsym(handle, "rsScriptForEachRegions");
+    if (RS::dispatch->ScriptForEachRegions == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ScriptForEachRegions");
+        return false;
+    }
+    RS::dispatch->ScriptInvokeBatch = (ScriptInvokeBatchFnPtr)dlsym(handle, "rsScriptInvokeBatch");
+    if (RS::dispatch->ScriptInvokeBatch == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ScriptInvokeBatch");
+        return false;
+    }
+    RS::dispatch->ContextTrimMemory = (ContextTrimMemoryFnPtr)dlsym(handle, "rsContextTrimMemory");
+    if (RS::dispatch->ContextTrimMemory == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ContextTrimMemory");
+        return false;
+    }
+    RS::dispatch->CommandBufferCreate = (CommandBufferCreateFnPtr)dlsym(handle, "rsCommandBufferCreate");
+    if (RS::dispatch->CommandBufferCreate == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->CommandBufferCreate");
+        return false;
+    }
+    RS::dispatch->CommandBufferBegin = (CommandBufferBeginFnPtr)dlsym(handle, "rsCommandBufferBegin");
+    if (RS::dispatch->CommandBufferBegin == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->CommandBufferBegin");
+        return false;
+    }
+    RS::dispatch->CommandBufferMarkParam = (CommandBufferMarkParamFnPtr)dlsym(handle, "rsCommandBufferMarkParam");
+    if (RS::dispatch->CommandBufferMarkParam == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->CommandBufferMarkParam");
+        return false;
+    }
+    RS::dispatch->CommandBufferEnd = (CommandBufferEndFnPtr)dlsym(handle, "rsCommandBufferEnd");
+    if (RS::dispatch->CommandBufferEnd == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->CommandBufferEnd");
+        return false;
+    }
+    RS::dispatch->CommandBufferSubmit = (CommandBufferSubmitFnPtr)dlsym(handle, "rsCommandBufferSubmit");
+    if (RS::dispatch->CommandBufferSubmit == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->CommandBufferSubmit");
+        return false;
+    }
+    RS::dispatch->ScriptGroupSetPipelined = (ScriptGroupSetPipelinedFnPtr)dlsym(handle, "rsScriptGroupSetPipelined");
+    if (RS::dispatch->ScriptGroupSetPipelined == NULL) {
+        ALOGV("Couldn't initialize RS::dispatch->ScriptGroupSetPipelined");
+        return false;
+    }
 
     return true;
 }
@@ -410,6 +559,12 @@ static bool loadSO(const char* filename) {
         return false;
     }
 
+    // Newer libraries hand over the whole table at once; older ones are
+    // searched entry by entry.
+    GetDispatchTableFnPtr getTable = (GetDispatchTableFnPtr)dlsym(handle, "rsGetDispatchTable");
+    if ((getTable != NULL) && getTable(RS::dispatch, sizeof(dispatchTable))) {
+        return true;
+    }
     if (loadSymbols(handle) == false) {
         ALOGV("%s init failed!", filename);
         return false;
@@ -429,6 +584,11 @@ static uint32_t getProp(const char *str) {
 }
 
 bool RS::initDispatch(int targetApi) {
+    // The table never changes once published, so later contexts skip the lock.
+    if (gInitialized) {
+        __sync_synchronize();
+        return true;
+    }
     pthread_mutex_lock(&gInitMutex);
     if (gInitError) {
         goto error;
@@ -451,6 +611,7 @@ bool RS::initDispatch(int targetApi) {
         }
     }
 
+    __sync_synchronize();
     gInitialized = true;
 
     pthread_mutex_unlock(&gInitMutex);
@@ -574,6 +735,9 @@ void * RS::threadProc(void *vrsc) {
                 ALOGE("Received a message from the script with no message handler installed.");
             }
             break;
+        case RS_MESSAGE_TO_CLIENT_FENCE:
+            rs->signalFence(usrID);
+            break;
 
         default:
             ALOGE("RS unknown message type %i", r);
@@ -598,3 +762,169 @@ void RS::setMessageHandler(MessageHandlerFunc_t func) {
 void RS::finish() {
     RS::dispatch->ContextFinish(mContext);
 }
+
+void RS::flush() {
+    RS::dispatch->ContextFlush(mContext);
+}
+
+uint32_t RS::getMemoryUsage(RsMemoryUsage *usage, uint32_t count) {
+    return RS::dispatch->ContextGetMemoryUsage(mContext, usage, count * sizeof(RsMemoryUsage));
+}
+
+uint64_t RS::trimMemory(RsTrimMemoryLevel level) {
+    return RS::dispatch->ContextTrimMemory(mContext, level);
+}
+
+sp<Fence> RS::fence(FenceCallback_t callback, void *usr) {
+    if (mCurrentError != RS_SUCCESS) {
+        return NULL;
+    }
+    pthread_mutex_lock(&mFenceMutex);
+    uint32_t id = ++mFenceSent;
+    if (callback != NULL) {
+        FenceCallback cb;
+        cb.mID = id;
+        cb.mFunc = callback;
+        cb.mUsr = usr;
+        mFenceCallbacks.push_back(cb);
+    }
+    pthread_mutex_unlock(&mFenceMutex);
+
+    // Racing threads may send their fences out of id order, but whatever
+    // was called before a fence's id was taken also precedes every later
+    // fence, so a later one being signaled covers it.
+    RS::dispatch->ContextFence(mContext, id);
+    // A fence nobody can see would never be signaled.
+    RS::dispatch->ContextFlush(mContext);
+    return new Fence(this, id);
+}
+
+// Ids wrap, so compare them by distance.
+bool RS::isFenceSignaled(uint32_t id) {
+    return (int32_t)(mFenceSignaled - id) >= 0;
+}
+
+void RS::waitFence(uint32_t id) {
+    pthread_mutex_lock(&mFenceMutex);
+    while (!isFenceSignaled(id)) {
+        pthread_cond_wait(&mFenceCond, &mFenceMutex);
+    }
+    pthread_mutex_unlock(&mFenceMutex);
+}
+
+void RS::signalFence(uint32_t id) {
+    std::vector<FenceCallback> ready;
+    pthread_mutex_lock(&mFenceMutex);
+    if (!isFenceSignaled(id)) {
+        mFenceSignaled = id;
+    }
+    for (size_t ct = 0; ct < mFenceCallbacks.size(); ) {
+        if (isFenceSignaled(mFenceCallbacks[ct].mID)) {
+            ready.push_back(mFenceCallbacks[ct]);
+            mFenceCallbacks.erase(mFenceCallbacks.begin() + ct);
+        } else {
+            ct++;
+        }
+    }
+    pthread_cond_broadcast(&mFenceCond);
+    pthread_mutex_unlock(&mFenceMutex);
+
+    // Run without the lock so callbacks can issue more work.
+    for (size_t ct = 0; ct < ready.size(); ct++) {
+        ready[ct].mFunc(ready[ct].mUsr);
+    }
+}
+
+sp<const Type> RS::findType(const TypeKey &key) {
+    sp<const Type> t;
+    pthread_mutex_lock(&mCacheMutex);
+    for (size_t ct = 0; ct < mTypeCache.size(); ct++) {
+        const TypeKey &k = mTypeCache[ct].mKey;
+        if ((k.mElement == key.mElement) && (k.mDimX == key.mDimX) &&
+            (k.mDimY == key.mDimY) && (k.mDimZ == key.mDimZ) &&
+            (k.mDimMipmaps == key.mDimMipmaps) && (k.mDimFaces == key.mDimFaces) &&
+            (k.mYuv == key.mYuv)) {
+            mTypeCache[ct].mStamp = ++mCacheStamp;
+            t = mTypeCache[ct].mType;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mCacheMutex);
+    return t;
+}
+
+void RS::addType(const TypeKey &key, sp<const Type> t) {
+    pthread_mutex_lock(&mCacheMutex);
+    CachedType c;
+    c.mKey = key;
+    c.mType = t;
+    c.mStamp = ++mCacheStamp;
+    if (mTypeCache.size() < kMaxCachedObjects) {
+        mTypeCache.push_back(c);
+    } else {
+        size_t oldest = 0;
+        for (size_t ct = 1; ct < mTypeCache.size(); ct++) {
+            if ((int32_t)(mTypeCache[ct].mStamp - mTypeCache[oldest].mStamp) < 0) {
+                oldest = ct;
+            }
+        }
+        mTypeCache[oldest] = c;
+    }
+    pthread_mutex_unlock(&mCacheMutex);
+}
+
+sp<const Element> RS::findElement(const std::vector<void *> &elements,
+                                  const std::vector<std::string> &names,
+                                  const std::vector<uint32_t> &arraySizes) {
+    sp<const Element> e;
+    pthread_mutex_lock(&mCacheMutex);
+    for (size_t ct = 0; ct < mElementCache.size(); ct++) {
+        CachedElement &c = mElementCache[ct];
+        if ((c.mElements == elements) && (c.mElementNames == names) &&
+            (c.mArraySizes == arraySizes)) {
+            c.mStamp = ++mCacheStamp;
+            e = c.mElement;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mCacheMutex);
+    return e;
+}
+
+void RS::addElement(const std::vector<void *> &elements,
+                    const std::vector<std::string> &names,
+                    const std::vector<uint32_t> &arraySizes, sp<const Element> e) {
+    pthread_mutex_lock(&mCacheMutex);
+    CachedElement c;
+    c.mElements = elements;
+    c.mElementNames = names;
+    c.mArraySizes = arraySizes;
+    c.mElement = e;
+    c.mStamp = ++mCacheStamp;
+    if (mElementCache.size() < kMaxCachedObjects) {
+        mElementCache.push_back(c);
+    } else {
+        size_t oldest = 0;
+        for (size_t ct = 1; ct < mElementCache.size(); ct++) {
+            if ((int32_t)(mElementCache[ct].mStamp - mElementCache[oldest].mStamp) < 0) {
+                oldest = ct;
+            }
+        }
+        mElementCache[oldest] = c;
+    }
+    pthread_mutex_unlock(&mCacheMutex);
+}
+
+Fence::Fence(sp<RS> rs, uint32_t id) : mRS(rs), mID(id) {
+}
+
+bool Fence::isSignaled() const {
+    pthread_mutex_lock(&mRS->mFenceMutex);
+    bool signaled = mRS->isFenceSignaled(mID);
+    pthread_mutex_unlock(&mRS->mFenceMutex);
+    return signaled;
+}
+
+void Fence::wait() const {
+    mRS->waitFence(mID);
+}
@@ -15,6 +15,7 @@
  */
 
 #include <malloc.h>
+#include <string.h>
 
 #include "RenderScript.h"
 #include "rsCppInternal.h"
@@ -26,6 +27,15 @@ void Script::invoke(uint32_t slot, const void *v, size_t len) const {
     tryDispatch(mRS, RS::dispatch->ScriptInvokeV(mRS->getContext(), getID(), slot, v, len));
 }
 
+void Script::invokeBatch(uint32_t slot, sp<const Allocation> params) const {
+    if (params == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Batched invokes need parameters.");
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->ScriptInvokeBatch(mRS->getContext(), getID(), slot,
+                                                     BaseObj::getObjID(params)));
+}
+
 void Script::forEach(uint32_t slot, sp<const Allocation> ain, sp<const Allocation> aout,
                        const void *usr, size_t usrLen) const {
     if ((ain == NULL) && (aout == NULL)) {
@@ -33,11 +43,158 @@ void Script::forEach(uint32_t slot, sp<const Allocation> ain, sp<const Allocatio
     }
     void *in_id = BaseObj::getObjID(ain);
     void *out_id = BaseObj::getObjID(aout);
+    if (mMaxThreads || (mPriority != RS_FOR_EACH_PRIORITY_DEFAULT)) {
+        RsScriptCall sc;
+        memset(&sc, 0, sizeof(sc));
+        sc.strategy = RS_FOR_EACH_STRATEGY_DONT_CARE;
+        sc.maxThreads = mMaxThreads;
+        sc.priority = mPriority;
+        tryDispatch(mRS, RS::dispatch->ScriptForEach(mRS->getContext(), getID(), slot, in_id, out_id, usr, usrLen, &sc, sizeof(sc)));
+        return;
+    }
     tryDispatch(mRS, RS::dispatch->ScriptForEach(mRS->getContext(), getID(), slot, in_id, out_id, usr, usrLen, NULL, 0));
 }
 
+void Script::forEachRegions(uint32_t slot, sp<const Allocation> ain, sp<const Allocation> aout,
+                            const std::vector<RsScriptRect> &regions, const void *usr,
+                            size_t usrLen) const {
+    if ((ain == NULL) && (aout == NULL)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "At least one of ain or aout is required to be non-null.");
+        return;
+    }
+    if (regions.empty()) {
+        return;
+    }
+    RsScriptCall sc;
+    memset(&sc, 0, sizeof(sc));
+    sc.strategy = RS_FOR_EACH_STRATEGY_DONT_CARE;
+    sc.maxThreads = mMaxThreads;
+    sc.priority = mPriority;
+    tryDispatch(mRS, RS::dispatch->ScriptForEachRegions(mRS->getContext(), getID(), slot,
+                                                        BaseObj::getObjID(ain),
+                                                        BaseObj::getObjID(aout), usr, usrLen,
+                                                        &sc, sizeof(sc), &regions[0],
+                                                        regions.size() * sizeof(RsScriptRect)));
+}
+
+void Script::appendTileRegions(const uint8_t *mask, uint32_t tilesX, uint32_t tilesY,
+                               uint32_t tileSize, uint32_t dimX, uint32_t dimY,
+                               std::vector<RsScriptRect> *regions) {
+    for (uint32_t ty = 0; ty < tilesY; ty++) {
+        const uint8_t *row = mask + ty * tilesX;
+        uint32_t tx = 0;
+        while (tx < tilesX) {
+            if (!row[tx]) {
+                tx++;
+                continue;
+            }
+            uint32_t end = tx + 1;
+            while ((end < tilesX) && row[end]) {
+                end++;
+            }
+            RsScriptRect r;
+            r.xStart = tx * tileSize;
+            r.xEnd = (end * tileSize < dimX) ? end * tileSize : dimX;
+            r.yStart = ty * tileSize;
+            r.yEnd = ((ty + 1) * tileSize < dimY) ? (ty + 1) * tileSize : dimY;
+            if ((r.xStart < r.xEnd) && (r.yStart < r.yEnd)) {
+                regions->push_back(r);
+            }
+            tx = end;
+        }
+    }
+}
+
+sp<Fence> Script::forEachAsync(uint32_t slot, sp<const Allocation> ain, sp<const Allocation> aout,
+                               const void *usr, size_t usrLen, FenceCallback_t callback,
+                               void *cbUsr) const {
+    forEach(slot, ain, aout, usr, usrLen);
+    return mRS->fence(callback, cbUsr);
+}
+
+void Script::forEach(uint32_t slot, const std::vector<sp<const Allocation> > &ains,
+                     sp<const Allocation> aout, const void *usr, size_t usrLen) const {
+    if (ains.empty()) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "At least one input is required.");
+        return;
+    }
+    std::vector<void *> in_ids;
+    for (size_t ct = 0; ct < ains.size(); ct++) {
+        in_ids.push_back(BaseObj::getObjID(ains[ct]));
+    }
+    void *out_id = BaseObj::getObjID(aout);
+    if (mMaxThreads || (mPriority != RS_FOR_EACH_PRIORITY_DEFAULT)) {
+        RsScriptCall sc;
+        memset(&sc, 0, sizeof(sc));
+        sc.strategy = RS_FOR_EACH_STRATEGY_DONT_CARE;
+        sc.maxThreads = mMaxThreads;
+        sc.priority = mPriority;
+        tryDispatch(mRS, RS::dispatch->ScriptForEachMulti(mRS->getContext(), getID(), slot,
+                                                          &in_ids[0],
+                                                          in_ids.size() * sizeof(void *),
+                                                          out_id, usr, usrLen,
+                                                          &sc, sizeof(sc)));
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->ScriptForEachMulti(mRS->getContext(), getID(), slot,
+                                                      &in_ids[0],
+                                                      in_ids.size() * sizeof(void *),
+                                                      out_id, usr, usrLen, NULL, 0));
+}
+
+void Script::reduce(uint32_t accumSlot, uint32_t combineSlot, int32_t finalizeSlot,
+                    sp<const Allocation> ain, sp<const Allocation> aout) const {
+    if ((ain == NULL) || (aout == NULL)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Reductions need both ain and aout.");
+        return;
+    }
+    void *in_id = BaseObj::getObjID(ain);
+    void *out_id = BaseObj::getObjID(aout);
+    if (mMaxThreads || (mPriority != RS_FOR_EACH_PRIORITY_DEFAULT)) {
+        RsScriptCall sc;
+        memset(&sc, 0, sizeof(sc));
+        sc.strategy = RS_FOR_EACH_STRATEGY_DONT_CARE;
+        sc.maxThreads = mMaxThreads;
+        sc.priority = mPriority;
+        tryDispatch(mRS, RS::dispatch->ScriptReduce(mRS->getContext(), getID(), accumSlot,
+                                                    combineSlot, finalizeSlot, in_id, out_id,
+                                                    &sc, sizeof(sc)));
+        return;
+    }
+    tryDispatch(mRS, RS::dispatch->ScriptReduce(mRS->getContext(), getID(), accumSlot,
+                                                combineSlot, finalizeSlot, in_id, out_id,
+                                                NULL, 0));
+}
+
+bool Script::checkKernelAllocations(sp<const Allocation> ain, sp<const Allocation> aout,
+                                    sp<const Element> inElement,
+                                    sp<const Element> outElement) const {
+    if ((ain == NULL) && (aout == NULL)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "At least one of ain or aout is required to be non-null.");
+        return false;
+    }
+    if ((ain != NULL) && (inElement != NULL) &&
+        !ain->getType()->getElement()->isCompatible(inElement)) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Kernel input element mismatch");
+        return false;
+    }
+    if ((aout != NULL) && (outElement != NULL) &&
+        !aout->getType()->getElement()->isCompatible(outElement)) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Kernel output element mismatch");
+        return false;
+    }
+    return true;
+}
+
+void Script::setLaunchHints(uint32_t maxThreads, RsForEachPriority priority) {
+    mMaxThreads = maxThreads;
+    mPriority = priority;
+}
+
 
 Script::Script(void *id, sp<RS> rs) : BaseObj(id, rs) {
+    mMaxThreads = 0;
+    mPriority = RS_FOR_EACH_PRIORITY_DEFAULT;
 }
 
 
@@ -54,7 +211,35 @@ void Script::setVar(uint32_t index, const void *v, size_t len) const {
     tryDispatch(mRS, RS::dispatch->ScriptSetVarV(mRS->getContext(), getID(), index, v, len));
 }
 
+void Script::setVars(const void *records, size_t sizeBytes) const {
+    tryDispatch(mRS, RS::dispatch->ScriptSetVars(mRS->getContext(), getID(), records, sizeBytes));
+}
+
 void Script::FieldBase::init(sp<RS> rs, uint32_t dimx, uint32_t usages) {
     mAllocation = Allocation::createSized(rs, mElement, dimx, RS_ALLOCATION_USAGE_SCRIPT | usages);
 }
 
+
+Script::KernelID::KernelID(void *id, sp<RS> rs, sp<const Script> s, uint32_t slot, uint32_t sig)
+    : BaseObj(id, rs), mScript(s), mSlot(slot), mSig(sig) {
+}
+
+Script::FieldID::FieldID(void *id, sp<RS> rs, sp<const Script> s, uint32_t slot)
+    : BaseObj(id, rs), mScript(s), mSlot(slot) {
+}
+
+sp<const Script::KernelID> Script::createKernelID(uint32_t slot, uint32_t sig) const {
+    void *id = createDispatch(mRS, RS::dispatch->ScriptKernelIDCreate(mRS->getContext(), getID(), slot, sig));
+    if (id == NULL) {
+        return NULL;
+    }
+    return new KernelID(id, mRS, this, slot, sig);
+}
+
+sp<const Script::FieldID> Script::createFieldID(uint32_t slot) const {
+    void *id = createDispatch(mRS, RS::dispatch->ScriptFieldIDCreate(mRS->getContext(), getID(), slot));
+    if (id == NULL) {
+        return NULL;
+    }
+    return new FieldID(id, mRS, this, slot);
+}
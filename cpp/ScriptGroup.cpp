@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RenderScript.h"
+#include "rsCppInternal.h"
+
+using namespace android;
+using namespace RSC;
+
+ScriptGroup::ScriptGroup(void *id, sp<RS> rs) : BaseObj(id, rs) {
+}
+
+void ScriptGroup::setInput(sp<const Script::KernelID> kid, sp<Allocation> a) {
+    tryDispatch(mRS, RS::dispatch->ScriptGroupSetInput(mRS->getContext(), getID(),
+                                                       BaseObj::getObjID(kid),
+                                                       BaseObj::getObjID(a)));
+}
+
+void ScriptGroup::setOutput(sp<const Script::KernelID> kid, sp<Allocation> a) {
+    tryDispatch(mRS, RS::dispatch->ScriptGroupSetOutput(mRS->getContext(), getID(),
+                                                        BaseObj::getObjID(kid),
+                                                        BaseObj::getObjID(a)));
+}
+
+void ScriptGroup::execute() {
+    tryDispatch(mRS, RS::dispatch->ScriptGroupExecute(mRS->getContext(), getID()));
+}
+
+void ScriptGroup::setPipelined(bool pipelined) {
+    tryDispatch(mRS, RS::dispatch->ScriptGroupSetPipelined(mRS->getContext(), getID(),
+                                                           pipelined));
+}
+
+
+ScriptGroup::Builder::Builder(sp<RS> rs) {
+    mRS = rs.get();
+}
+
+bool ScriptGroup::Builder::hasKernel(sp<const Script::KernelID> k) const {
+    for (size_t ct = 0; ct < mKernels.size(); ct++) {
+        if (mKernels[ct].get() == k.get()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether a chain of connections leads from script from to script to.  Any
+// loop among the scripts is at most as long as the connection list.
+bool ScriptGroup::Builder::reaches(const Script *from, const Script *to, size_t depth) const {
+    if (depth > mConnections.size()) {
+        return true;
+    }
+    for (size_t ct = 0; ct < mConnections.size(); ct++) {
+        const Connection &c = mConnections[ct];
+        if (c.mFrom->getScript().get() != from) {
+            continue;
+        }
+        const Script *next = (c.mToKernel != NULL) ? c.mToKernel->getScript().get() :
+                                                     c.mToField->getScript().get();
+        if ((next == to) || reaches(next, to, depth + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScriptGroup::Builder::addKernel(sp<const Script::KernelID> k) {
+    if (k == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "ScriptGroup kernel may not be null.");
+        return;
+    }
+    if (mConnections.size() != 0) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Kernels may not be added once connections exist.");
+        return;
+    }
+    if (!hasKernel(k)) {
+        mKernels.push_back(k);
+    }
+}
+
+void ScriptGroup::Builder::addConnection(sp<const Type> t, sp<const Script::KernelID> from,
+                                         sp<const Script::KernelID> toK,
+                                         sp<const Script::FieldID> toF) {
+    if ((t == NULL) || (from == NULL)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "ScriptGroup connections need a type and a source.");
+        return;
+    }
+    if (!hasKernel(from)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "From script not found.");
+        return;
+    }
+    if ((toK != NULL) && !hasKernel(toK)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "To script not found.");
+        return;
+    }
+
+    Connection c;
+    c.mType = t;
+    c.mFrom = from;
+    c.mToKernel = toK;
+    c.mToField = toF;
+    mConnections.push_back(c);
+}
+
+void ScriptGroup::Builder::addConnection(sp<const Type> t, sp<const Script::KernelID> from,
+                                         sp<const Script::KernelID> to) {
+    if (to == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "ScriptGroup connection target may not be null.");
+        return;
+    }
+    addConnection(t, from, to, NULL);
+}
+
+void ScriptGroup::Builder::addConnection(sp<const Type> t, sp<const Script::KernelID> from,
+                                         sp<const Script::FieldID> to) {
+    if (to == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "ScriptGroup connection target may not be null.");
+        return;
+    }
+    addConnection(t, from, NULL, to);
+}
+
+sp<ScriptGroup> ScriptGroup::Builder::create() {
+    if (mKernels.empty()) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "ScriptGroup needs at least one kernel.");
+        return NULL;
+    }
+    for (size_t ct = 0; ct < mKernels.size(); ct++) {
+        const Script *s = mKernels[ct]->getScript().get();
+        if (reaches(s, s, 0)) {
+            mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Loops in group not allowed.");
+            return NULL;
+        }
+    }
+
+    std::vector<void *> kernels;
+    for (size_t ct = 0; ct < mKernels.size(); ct++) {
+        kernels.push_back(mKernels[ct]->getID());
+    }
+
+    // The connection arrays are parallel; the unused target of each
+    // connection is passed as NULL.
+    size_t count = mConnections.size();
+    std::vector<void *> src(count + 1);
+    std::vector<void *> dstK(count + 1);
+    std::vector<void *> dstF(count + 1);
+    std::vector<void *> types(count + 1);
+    for (size_t ct = 0; ct < count; ct++) {
+        const Connection &c = mConnections[ct];
+        src[ct] = c.mFrom->getID();
+        dstK[ct] = BaseObj::getObjID(c.mToKernel);
+        dstF[ct] = BaseObj::getObjID(c.mToField);
+        types[ct] = c.mType->getID();
+    }
+
+    // The spec passes the size of the arrays in bytes.
+    void *id = createDispatch(mRS, RS::dispatch->ScriptGroupCreate(mRS->getContext(),
+                                  (RsScriptKernelID *)&kernels[0], kernels.size() * sizeof(void *),
+                                  (RsScriptKernelID *)&src[0], count * sizeof(void *),
+                                  (RsScriptKernelID *)&dstK[0], count * sizeof(void *),
+                                  (RsScriptFieldID *)&dstF[0], count * sizeof(void *),
+                                  (const RsType *)&types[0], count * sizeof(void *)));
+    if (id == NULL) {
+        return NULL;
+    }
+    return new ScriptGroup(id, mRS);
+}
@@ -22,6 +22,13 @@
 using namespace android;
 using namespace RSC;
 
+// There are no predefined FLOAT_16 elements, so they are matched by data
+// type and vector size.
+static bool isHalfElement(sp<const Element> e, uint32_t minVec, uint32_t maxVec) {
+    return (e->getDataType() == RS_TYPE_FLOAT_16) &&
+           (e->getVectorSize() >= minVec) && (e->getVectorSize() <= maxVec);
+}
+
 ScriptIntrinsic::ScriptIntrinsic(sp<RS> rs, int id, sp<const Element> e)
     : Script(NULL, rs) {
     mID = createDispatch(rs, RS::dispatch->ScriptIntrinsicCreate(rs->getContext(), id, e->getID()));
@@ -54,7 +61,11 @@ void ScriptIntrinsic3DLUT::forEach(sp<Allocation> ain, sp<Allocation> aout) {
 }
 void ScriptIntrinsic3DLUT::setLUT(sp<Allocation> lut) {
     sp<const Type> t = lut->getType();
-    if (!t->getElement()->isCompatible(mElement)) {
+    sp<const Element> e = t->getElement();
+    bool floatLUT = (e->getVectorSize() == 4) &&
+                    ((e->getDataType() == RS_TYPE_FLOAT_32) ||
+                     (e->getDataType() == RS_TYPE_FLOAT_16));
+    if (!e->isCompatible(mElement) && !floatLUT) {
         mRS->throwError(RS_ERROR_INVALID_ELEMENT, "setLUT element does not match");
         return;
     }
@@ -66,8 +77,17 @@ void ScriptIntrinsic3DLUT::setLUT(sp<Allocation> lut) {
     Script::setVar(0, lut);
 }
 
+void ScriptIntrinsic3DLUT::setInterpolation(RsScriptIntrinsic3DLUTInterpolation mode) {
+    if ((mode != RS_3DLUT_INTERPOLATION_TRILINEAR) &&
+        (mode != RS_3DLUT_INTERPOLATION_TETRAHEDRAL)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid 3DLUT interpolation mode");
+        return;
+    }
+    Script::setVar(1, (int32_t)mode);
+}
+
 sp<ScriptIntrinsicBlend> ScriptIntrinsicBlend::create(sp<RS> rs, sp<const Element> e) {
-    if (e->isCompatible(Element::U8_4(rs)) == false) {
+    if ((e->isCompatible(Element::U8_4(rs)) == false) && !isHalfElement(e, 4, 4)) {
         rs->throwError(RS_ERROR_INVALID_ELEMENT, "Element not supported for intrinsic");
         return NULL;
     }
@@ -78,6 +98,22 @@ ScriptIntrinsicBlend::ScriptIntrinsicBlend(sp<RS> rs, sp<const Element> e)
     : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_BLEND, e) {
 }
 
+void ScriptIntrinsicBlend::setGlobalAlpha(float alpha) {
+    if (!(alpha >= 0.f) || (alpha > 1.f)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Blend global alpha must be in [0, 1]");
+        return;
+    }
+    Script::setVar(0, (int32_t)(alpha * 255.f + 0.5f));
+}
+
+void ScriptIntrinsicBlend::setMask(sp<Allocation> mask) {
+    if ((mask != NULL) && !(mask->getType()->getElement()->isCompatible(Element::U8(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Blend mask must be U8");
+        return;
+    }
+    Script::setVar(1, mask);
+}
+
 void ScriptIntrinsicBlend::forEachClear(sp<Allocation> in, sp<Allocation> out) {
     if (in->getType()->getElement()->isCompatible(mElement) == false ||
         out->getType()->getElement()->isCompatible(mElement) == false) {
@@ -205,7 +241,8 @@ void ScriptIntrinsicBlend::forEachSubtract(sp<Allocation> in, sp<Allocation> out
 
 sp<ScriptIntrinsicBlur> ScriptIntrinsicBlur::create(sp<RS> rs, sp<const Element> e) {
     if ((e->isCompatible(Element::U8_4(rs)) == false) &&
-        (e->isCompatible(Element::U8(rs)) == false)) {
+        (e->isCompatible(Element::U8(rs)) == false) &&
+        !isHalfElement(e, 4, 4) && !isHalfElement(e, 1, 1)) {
         rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element in blur");
         return NULL;
     }
@@ -234,13 +271,21 @@ void ScriptIntrinsicBlur::forEach(sp<Allocation> out) {
 }
 
 void ScriptIntrinsicBlur::setRadius(float radius) {
-    if (radius > 0.f && radius <= 25.f) {
+    if (radius > 0.f && radius <= 200.f) {
         Script::setVar(0, &radius, sizeof(float));
     } else {
-        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Blur radius out of 0-25 pixel bound");
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Blur radius out of 0-200 pixel bound");
     }
 }
 
+sp<const Script::KernelID> ScriptIntrinsicBlur::getKernelID() {
+    return createKernelID(0, 2);
+}
+
+sp<const Script::FieldID> ScriptIntrinsicBlur::getFieldID_Input() {
+    return createFieldID(1);
+}
+
 
 
 sp<ScriptIntrinsicColorMatrix> ScriptIntrinsicColorMatrix::create(sp<RS> rs) {
@@ -254,38 +299,61 @@ ScriptIntrinsicColorMatrix::ScriptIntrinsicColorMatrix(sp<RS> rs, sp<const Eleme
 
 }
 
+bool ScriptIntrinsicColorMatrix::isValidElement(sp<const Element> e) {
+    return e->isCompatible(Element::U8(mRS)) ||
+           e->isCompatible(Element::U8_2(mRS)) ||
+           e->isCompatible(Element::U8_3(mRS)) ||
+           e->isCompatible(Element::U8_4(mRS)) ||
+           e->isCompatible(Element::F32(mRS)) ||
+           e->isCompatible(Element::F32_2(mRS)) ||
+           e->isCompatible(Element::F32_3(mRS)) ||
+           e->isCompatible(Element::F32_4(mRS)) ||
+           isHalfElement(e, 1, 4);
+}
+
 void ScriptIntrinsicColorMatrix::forEach(sp<Allocation> in, sp<Allocation> out) {
-    if (!(in->getType()->getElement()->isCompatible(Element::U8(mRS))) &&
-        !(in->getType()->getElement()->isCompatible(Element::U8_2(mRS))) &&
-        !(in->getType()->getElement()->isCompatible(Element::U8_3(mRS))) &&
-        !(in->getType()->getElement()->isCompatible(Element::U8_4(mRS))) &&
-        !(in->getType()->getElement()->isCompatible(Element::F32(mRS))) &&
-        !(in->getType()->getElement()->isCompatible(Element::F32_2(mRS))) &&
-        !(in->getType()->getElement()->isCompatible(Element::F32_3(mRS))) &&
-        !(in->getType()->getElement()->isCompatible(Element::F32_4(mRS)))) {
+    sp<const Element> ein = in->getType()->getElement();
+    if ((ein != mCheckedIn) && !isValidElement(ein)) {
         mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for ColorMatrix");
         return;
     }
+    mCheckedIn = ein;
 
-    if (!(out->getType()->getElement()->isCompatible(Element::U8(mRS))) &&
-        !(out->getType()->getElement()->isCompatible(Element::U8_2(mRS))) &&
-        !(out->getType()->getElement()->isCompatible(Element::U8_3(mRS))) &&
-        !(out->getType()->getElement()->isCompatible(Element::U8_4(mRS))) &&
-        !(out->getType()->getElement()->isCompatible(Element::F32(mRS))) &&
-        !(out->getType()->getElement()->isCompatible(Element::F32_2(mRS))) &&
-        !(out->getType()->getElement()->isCompatible(Element::F32_3(mRS))) &&
-        !(out->getType()->getElement()->isCompatible(Element::F32_4(mRS)))) {
+    sp<const Element> eout = out->getType()->getElement();
+    if ((eout != mCheckedOut) && !isValidElement(eout)) {
         mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for ColorMatrix");
         return;
     }
-
+    mCheckedOut = eout;
+
+    if (mLUT != NULL) {
+        if (eout->getDataType() != RS_TYPE_UNSIGNED_8) {
+            mRS->throwError(RS_ERROR_INVALID_ELEMENT, "ColorMatrix with a LUT needs U8 output");
+            return;
+        }
+        mLUT->flush();
+    }
     Script::forEach(0, in, out, NULL, 0);
 }
 
+void ScriptIntrinsicColorMatrix::setLUT(sp<ScriptIntrinsicLUT> lut) {
+    mLUT = lut;
+    if (lut == NULL) {
+        Script::setVar(2, sp<const BaseObj>());
+        return;
+    }
+    lut->flush();
+    Script::setVar(2, lut->LUT);
+}
+
 void ScriptIntrinsicColorMatrix::setAdd(float* add) {
     Script::setVar(1, (void*)add, sizeof(float) * 4);
 }
 
+sp<const Script::KernelID> ScriptIntrinsicColorMatrix::getKernelID() {
+    return createKernelID(0, 3);
+}
+
 void ScriptIntrinsicColorMatrix::setColorMatrix3(float* m) {
     float temp[16];
     temp[0] = m[0];
@@ -344,7 +412,8 @@ sp<ScriptIntrinsicConvolve3x3> ScriptIntrinsicConvolve3x3::create(sp<RS> rs, sp<
         !(e->isCompatible(Element::F32(rs))) &&
         !(e->isCompatible(Element::F32_2(rs))) &&
         !(e->isCompatible(Element::F32_3(rs))) &&
-        !(e->isCompatible(Element::F32_4(rs)))) {
+        !(e->isCompatible(Element::F32_4(rs))) &&
+        !isHalfElement(e, 1, 4)) {
         rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Convolve3x3");
         return NULL;
     }
@@ -377,6 +446,14 @@ void ScriptIntrinsicConvolve3x3::setCoefficients(float* v) {
     Script::setVar(0, (void*)v, sizeof(float) * 9);
 }
 
+sp<const Script::KernelID> ScriptIntrinsicConvolve3x3::getKernelID() {
+    return createKernelID(0, 2);
+}
+
+sp<const Script::FieldID> ScriptIntrinsicConvolve3x3::getFieldID_Input() {
+    return createFieldID(1);
+}
+
 sp<ScriptIntrinsicConvolve5x5> ScriptIntrinsicConvolve5x5::create(sp<RS> rs, sp<const Element> e) {
     if (!(e->isCompatible(Element::U8(rs))) &&
         !(e->isCompatible(Element::U8_2(rs))) &&
@@ -385,7 +462,8 @@ sp<ScriptIntrinsicConvolve5x5> ScriptIntrinsicConvolve5x5::create(sp<RS> rs, sp<
         !(e->isCompatible(Element::F32(rs))) &&
         !(e->isCompatible(Element::F32_2(rs))) &&
         !(e->isCompatible(Element::F32_3(rs))) &&
-        !(e->isCompatible(Element::F32_4(rs)))) {
+        !(e->isCompatible(Element::F32_4(rs))) &&
+        !isHalfElement(e, 1, 4)) {
         rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Convolve5x5");
         return NULL;
     }
@@ -419,6 +497,62 @@ void ScriptIntrinsicConvolve5x5::setCoefficients(float* v) {
     Script::setVar(0, (void*)v, sizeof(float) * 25);
 }
 
+sp<const Script::KernelID> ScriptIntrinsicConvolve5x5::getKernelID() {
+    return createKernelID(0, 2);
+}
+
+sp<const Script::FieldID> ScriptIntrinsicConvolve5x5::getFieldID_Input() {
+    return createFieldID(1);
+}
+
+sp<ScriptIntrinsicConvolve> ScriptIntrinsicConvolve::create(sp<RS> rs, sp<const Element> e,
+                                                             uint32_t size) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs))) &&
+        !(e->isCompatible(Element::F32(rs))) &&
+        !(e->isCompatible(Element::F32_2(rs))) &&
+        !(e->isCompatible(Element::F32_3(rs))) &&
+        !(e->isCompatible(Element::F32_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Convolve");
+        return NULL;
+    }
+    if (!(size & 1) || (size > 25)) {
+        rs->throwError(RS_ERROR_INVALID_PARAMETER, "Convolve size must be odd and at most 25");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicConvolve(rs, e, size);
+}
+
+ScriptIntrinsicConvolve::ScriptIntrinsicConvolve(sp<RS> rs, sp<const Element> e,
+                                                 uint32_t size)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_CONVOLVE, e), mSize(size) {
+
+}
+
+void ScriptIntrinsicConvolve::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Convolve input");
+        return;
+    }
+    Script::setVar(1, in);
+}
+
+void ScriptIntrinsicConvolve::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Convolve output");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicConvolve::setCoefficients(float* v) {
+    Script::setVar(0, (void*)v, sizeof(float) * mSize * mSize);
+}
+
 sp<ScriptIntrinsicHistogram> ScriptIntrinsicHistogram::create(sp<RS> rs) {
     return new ScriptIntrinsicHistogram(rs, NULL);
 }
@@ -441,7 +575,7 @@ void ScriptIntrinsicHistogram::setOutput(sp<Allocation> out) {
         return;
     }
 
-    if (out->getType()->getX() != 256 ||
+    if (out->getType()->getX() < 1 || out->getType()->getX() > 65536 ||
         out->getType()->getY() != 0 ||
         out->getType()->hasMipmaps()) {
         mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Allocation type for Histogram output");
@@ -459,15 +593,44 @@ void ScriptIntrinsicHistogram::setDotCoefficients(float r, float g, float b, flo
         return;
     }
 
-    FieldPacker fp(16);
-    fp.add(r);
-    fp.add(g);
-    fp.add(b);
-    fp.add(a);
-    Script::setVar(0, fp.getData(), fp.getLength());
+    float dot[4] = {r, g, b, a};
+    Script::setVar(0, dot, sizeof(dot));
 
 }
 
+void ScriptIntrinsicHistogram::setRange(float min, float max) {
+    if (!(max > min)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Histogram range must not be empty");
+        return;
+    }
+    float range[2] = {min, max};
+    Script::setVar(2, range, sizeof(range));
+}
+
+void ScriptIntrinsicHistogram::setEqualizationTarget(sp<ScriptIntrinsicLUT> lut) {
+    if (lut == NULL) {
+        Script::setVar(3, sp<const BaseObj>());
+        return;
+    }
+    // The tables belong to the histogram from now on, so the LUT mustn't
+    // upload its own over them.
+    lut->mDirty = false;
+    Script::setVar(3, lut->LUT);
+}
+
+// The data types the histogram can bin.
+static bool isHistogramInput(sp<const Element> e) {
+    switch (e->getDataType()) {
+    case RS_TYPE_UNSIGNED_8:
+    case RS_TYPE_UNSIGNED_16:
+    case RS_TYPE_FLOAT_16:
+    case RS_TYPE_FLOAT_32:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void ScriptIntrinsicHistogram::forEach(sp<Allocation> ain) {
     if (ain->getType()->getElement()->getVectorSize() <
         mOut->getType()->getElement()->getVectorSize()) {
@@ -476,10 +639,9 @@ void ScriptIntrinsicHistogram::forEach(sp<Allocation> ain) {
         return;
     }
 
-    if (!(ain->getType()->getElement()->isCompatible(Element::U8(mRS))) ||
-        !(ain->getType()->getElement()->isCompatible(Element::U8_4(mRS)))) {
+    if (!isHistogramInput(ain->getType()->getElement())) {
         mRS->throwError(RS_ERROR_INVALID_ELEMENT,
-                        "Input allocation to Histogram must be U8 or U8_4");
+                        "Input allocation to Histogram must be U8, U16, F16 or F32");
         return;
     }
 
@@ -494,10 +656,9 @@ void ScriptIntrinsicHistogram::forEach_dot(sp<Allocation> ain) {
                         "when used with forEach_dot");
         return;
     }
-    if (!(ain->getType()->getElement()->isCompatible(Element::U8(mRS))) ||
-        !(ain->getType()->getElement()->isCompatible(Element::U8_4(mRS)))) {
+    if (!isHistogramInput(ain->getType()->getElement())) {
         mRS->throwError(RS_ERROR_INVALID_ELEMENT,
-                        "Input allocation to Histogram must be U8 or U8_4");
+                        "Input allocation to Histogram must be U8, U16, F16 or F32");
         return;
     }
 
@@ -524,11 +685,15 @@ ScriptIntrinsicLUT::ScriptIntrinsicLUT(sp<RS> rs, sp<const Element> e)
     setVar(0, LUT);
 }
 
-void ScriptIntrinsicLUT::forEach(sp<Allocation> ain, sp<Allocation> aout) {
+void ScriptIntrinsicLUT::flush() {
     if (mDirty) {
         LUT->copy1DFrom((void*)mCache);
         mDirty = false;
     }
+}
+
+void ScriptIntrinsicLUT::forEach(sp<Allocation> ain, sp<Allocation> aout) {
+    flush();
     if (!(ain->getType()->getElement()->isCompatible(Element::U8_4(mRS))) ||
         !(aout->getType()->getElement()->isCompatible(Element::U8_4(mRS)))) {
         mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for LUT");
@@ -598,3 +763,791 @@ void ScriptIntrinsicYuvToRGB::forEach(sp<Allocation> out) {
 
     Script::forEach(0, NULL, out, NULL, 0);
 }
+
+void ScriptIntrinsicYuvToRGB::setTransform(RsScriptIntrinsicYuvRotation rotation, bool mirror,
+                                           uint32_t cropX, uint32_t cropY,
+                                           uint32_t cropW, uint32_t cropH,
+                                           RsScriptIntrinsicYuvScale scale) {
+    if ((rotation < RS_YUV_ROTATE_0) || (rotation > RS_YUV_ROTATE_270)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid YuvToRGB rotation");
+        return;
+    }
+    if ((scale != RS_YUV_SCALE_BOX) && (scale != RS_YUV_SCALE_BILINEAR)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid YuvToRGB scale");
+        return;
+    }
+    int32_t transform[7] = {rotation, mirror, (int32_t)cropX, (int32_t)cropY,
+                            (int32_t)cropW, (int32_t)cropH, scale};
+    Script::setVar(1, transform, sizeof(transform));
+}
+
+sp<ScriptIntrinsicResize> ScriptIntrinsicResize::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs))) &&
+        !(e->isCompatible(Element::F32(rs))) &&
+        !(e->isCompatible(Element::F32_2(rs))) &&
+        !(e->isCompatible(Element::F32_3(rs))) &&
+        !(e->isCompatible(Element::F32_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Resize");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicResize(rs, e);
+}
+
+ScriptIntrinsicResize::ScriptIntrinsicResize(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_RESIZE, e) {
+
+}
+
+void ScriptIntrinsicResize::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Resize input");
+        return;
+    }
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicResize::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Resize output");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicResize::setMode(RsScriptIntrinsicResizeMode mode) {
+    if ((mode != RS_RESIZE_BILINEAR) &&
+        (mode != RS_RESIZE_BICUBIC) &&
+        (mode != RS_RESIZE_AREA)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Resize mode");
+        return;
+    }
+    Script::setVar(1, (int32_t)mode);
+}
+
+sp<ScriptIntrinsicPyramid> ScriptIntrinsicPyramid::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs))) &&
+        !(e->isCompatible(Element::F32(rs))) &&
+        !(e->isCompatible(Element::F32_2(rs))) &&
+        !(e->isCompatible(Element::F32_3(rs))) &&
+        !(e->isCompatible(Element::F32_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Pyramid");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicPyramid(rs, e);
+}
+
+ScriptIntrinsicPyramid::ScriptIntrinsicPyramid(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_PYRAMID, e) {
+
+}
+
+void ScriptIntrinsicPyramid::setInput(sp<Allocation> in) {
+    sp<const Element> e = in->getType()->getElement();
+    if (((e->getDataType() != RS_TYPE_UNSIGNED_8) && (e->getDataType() != RS_TYPE_FLOAT_32)) ||
+        (e->getVectorSize() != mElement->getVectorSize())) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Pyramid input");
+        return;
+    }
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicPyramid::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Pyramid output");
+        return;
+    }
+    if (!out->getType()->hasMipmaps()) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Pyramid output needs mipmaps");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicPyramid::setMode(RsScriptIntrinsicPyramidMode mode) {
+    if ((mode != RS_PYRAMID_GAUSSIAN) && (mode != RS_PYRAMID_LAPLACIAN)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Pyramid mode");
+        return;
+    }
+    if ((mode == RS_PYRAMID_LAPLACIAN) && (mElement->getDataType() != RS_TYPE_FLOAT_32)) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Laplacian pyramids need F32 elements");
+        return;
+    }
+    Script::setVar(1, (int32_t)mode);
+}
+
+void ScriptIntrinsicPyramid::setLevels(uint32_t levels) {
+    Script::setVar(2, (int32_t)levels);
+}
+
+sp<ScriptIntrinsicRotate> ScriptIntrinsicRotate::create(sp<RS> rs, sp<const Element> e) {
+    RsDataType dt = e->getDataType();
+    if (((dt != RS_TYPE_UNSIGNED_8) && (dt != RS_TYPE_UNSIGNED_16) &&
+         (dt != RS_TYPE_UNSIGNED_32) && (dt != RS_TYPE_FLOAT_32)) ||
+        (e->getVectorSize() < 1) || (e->getVectorSize() > 4)) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Rotate");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicRotate(rs, e);
+}
+
+ScriptIntrinsicRotate::ScriptIntrinsicRotate(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_ROTATE, e) {
+    mMode = RS_ROTATE_TRANSPOSE;
+}
+
+void ScriptIntrinsicRotate::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Rotate input");
+        return;
+    }
+    mInput = in;
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicRotate::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Rotate output");
+        return;
+    }
+    if (mInput == NULL) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Rotate needs an input");
+        return;
+    }
+
+    sp<const Type> it = mInput->getType();
+    sp<const Type> ot = out->getType();
+    uint32_t inX = it->getX();
+    uint32_t inY = it->getY() ? it->getY() : 1;
+    uint32_t outX = ot->getX();
+    uint32_t outY = ot->getY() ? ot->getY() : 1;
+    bool swaps = (mMode == RS_ROTATE_TRANSPOSE) || (mMode == RS_ROTATE_90) ||
+                 (mMode == RS_ROTATE_270);
+    if ((swaps && ((outX != inY) || (outY != inX))) ||
+        (!swaps && ((outX != inX) || (outY != inY)))) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Rotate output size does not match the input");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicRotate::setMode(RsScriptIntrinsicRotateMode mode) {
+    if ((mode < RS_ROTATE_TRANSPOSE) || (mode > RS_ROTATE_FLIP_VERTICAL)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Rotate mode");
+        return;
+    }
+    mMode = mode;
+    Script::setVar(1, (int32_t)mode);
+}
+
+sp<ScriptIntrinsicWarp> ScriptIntrinsicWarp::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Warp");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicWarp(rs, e);
+}
+
+ScriptIntrinsicWarp::ScriptIntrinsicWarp(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_WARP, e) {
+
+}
+
+void ScriptIntrinsicWarp::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Warp input");
+        return;
+    }
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicWarp::setMatrix(const float *m) {
+    Script::setVar(1, (void*)m, sizeof(float) * 9);
+}
+
+void ScriptIntrinsicWarp::setMesh(sp<Allocation> mesh) {
+    if (mesh == NULL) {
+        Script::setVar(2, sp<const BaseObj>());
+        return;
+    }
+    sp<const Type> t = mesh->getType();
+    if (!(t->getElement()->isCompatible(Element::F32_2(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Warp mesh must be F32_2");
+        return;
+    }
+    if ((t->getX() < 2) || (t->getY() < 2)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Warp mesh needs at least 2x2 nodes");
+        return;
+    }
+    Script::setVar(2, mesh);
+}
+
+void ScriptIntrinsicWarp::setFilter(RsScriptIntrinsicWarpFilter filter) {
+    if ((filter != RS_WARP_BILINEAR) && (filter != RS_WARP_BICUBIC)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Warp filter");
+        return;
+    }
+    Script::setVar(3, (int32_t)filter);
+}
+
+void ScriptIntrinsicWarp::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Warp output");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+sp<ScriptIntrinsicMorphology> ScriptIntrinsicMorphology::create(sp<RS> rs,
+                                                                sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Morphology");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicMorphology(rs, e);
+}
+
+ScriptIntrinsicMorphology::ScriptIntrinsicMorphology(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, e) {
+
+}
+
+void ScriptIntrinsicMorphology::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Morphology input");
+        return;
+    }
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicMorphology::setRadius(int32_t radiusX, int32_t radiusY) {
+    if ((radiusX < 0) || (radiusY < 0)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Morphology radii must not be negative");
+        return;
+    }
+    int32_t radius[2] = {radiusX, radiusY};
+    Script::setVar(1, radius, sizeof(radius));
+}
+
+void ScriptIntrinsicMorphology::setOperation(RsScriptIntrinsicMorphologyOp op) {
+    if ((op != RS_MORPHOLOGY_ERODE) && (op != RS_MORPHOLOGY_DILATE)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Morphology operation");
+        return;
+    }
+    Script::setVar(2, (int32_t)op);
+}
+
+void ScriptIntrinsicMorphology::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Morphology output");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+sp<ScriptIntrinsicMedian> ScriptIntrinsicMedian::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Median");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicMedian(rs, e);
+}
+
+ScriptIntrinsicMedian::ScriptIntrinsicMedian(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_MEDIAN, e) {
+
+}
+
+void ScriptIntrinsicMedian::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Median input");
+        return;
+    }
+    Script::setVar(1, in);
+}
+
+void ScriptIntrinsicMedian::setSize(uint32_t size) {
+    if ((size != 3) && (size != 5)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Median size must be 3 or 5");
+        return;
+    }
+    Script::setVar(0, (int32_t)size);
+}
+
+void ScriptIntrinsicMedian::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Median output");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+sp<ScriptIntrinsicBilateral> ScriptIntrinsicBilateral::create(sp<RS> rs,
+                                                              sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Bilateral");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicBilateral(rs, e);
+}
+
+ScriptIntrinsicBilateral::ScriptIntrinsicBilateral(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_BILATERAL, e) {
+
+}
+
+void ScriptIntrinsicBilateral::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Bilateral input");
+        return;
+    }
+    Script::setVar(1, in);
+}
+
+void ScriptIntrinsicBilateral::setSigmas(float spatial, float range) {
+    if ((spatial <= 0.f) || (spatial > 100.f) || (range <= 0.f)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Bilateral sigmas out of range");
+        return;
+    }
+    float sigmas[2] = {spatial, range};
+    Script::setVar(0, sigmas, sizeof(sigmas));
+}
+
+void ScriptIntrinsicBilateral::setMode(RsScriptIntrinsicBilateralMode mode) {
+    if ((mode != RS_BILATERAL_AUTO) && (mode != RS_BILATERAL_DIRECT) &&
+        (mode != RS_BILATERAL_GRID)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Bilateral mode");
+        return;
+    }
+    Script::setVar(2, (int32_t)mode);
+}
+
+void ScriptIntrinsicBilateral::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Bilateral output");
+        return;
+    }
+
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+sp<ScriptIntrinsicIntegral> ScriptIntrinsicIntegral::create(sp<RS> rs,
+                                                            sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) &&
+        !(e->isCompatible(Element::U8_2(rs))) &&
+        !(e->isCompatible(Element::U8_3(rs))) &&
+        !(e->isCompatible(Element::U8_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Integral");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicIntegral(rs, e);
+}
+
+ScriptIntrinsicIntegral::ScriptIntrinsicIntegral(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_INTEGRAL, e) {
+
+}
+
+void ScriptIntrinsicIntegral::forEach(sp<Allocation> ain, sp<Allocation> aout) {
+    if (!(ain->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Integral input");
+        return;
+    }
+    sp<const Element> eout = aout->getType()->getElement();
+    if (((eout->getDataType() != RS_TYPE_SIGNED_32) &&
+         (eout->getDataType() != RS_TYPE_UNSIGNED_32)) ||
+        (eout->getVectorSize() != mElement->getVectorSize())) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Integral output must be I32 or U32");
+        return;
+    }
+    if ((ain->getType()->getX() != aout->getType()->getX()) ||
+        (ain->getType()->getY() != aout->getType()->getY())) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Integral input and output sizes differ");
+        return;
+    }
+
+    Script::forEach(0, ain, aout, NULL, 0);
+}
+
+sp<ScriptIntrinsicScan> ScriptIntrinsicScan::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::I32(rs))) &&
+        !(e->isCompatible(Element::U32(rs))) &&
+        !(e->isCompatible(Element::F32(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Scan");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicScan(rs, e);
+}
+
+ScriptIntrinsicScan::ScriptIntrinsicScan(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_SCAN, e) {
+
+}
+
+void ScriptIntrinsicScan::setMode(RsScriptIntrinsicScanMode mode) {
+    if ((mode != RS_SCAN_INCLUSIVE) && (mode != RS_SCAN_EXCLUSIVE)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Scan mode");
+        return;
+    }
+    Script::setVar(0, (int32_t)mode);
+}
+
+void ScriptIntrinsicScan::forEach(sp<Allocation> ain, sp<Allocation> aout) {
+    if (!(ain->getType()->getElement()->isCompatible(mElement)) ||
+        !(aout->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Scan");
+        return;
+    }
+    if ((ain->getType()->getY() != 0) || (aout->getType()->getY() != 0) ||
+        (ain->getType()->getX() != aout->getType()->getX())) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER,
+                        "Scan needs 1D input and output of the same size");
+        return;
+    }
+
+    Script::forEach(0, ain, aout, NULL, 0);
+}
+
+sp<ScriptIntrinsicGemm> ScriptIntrinsicGemm::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::F32(rs))) &&
+        !(e->isCompatible(Element::U8(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Gemm");
+        return NULL;
+    }
+
+    return new ScriptIntrinsicGemm(rs, e);
+}
+
+ScriptIntrinsicGemm::ScriptIntrinsicGemm(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_GEMM, e) {
+
+}
+
+void ScriptIntrinsicGemm::setTranspose(bool transA, bool transB) {
+    int32_t trans[2] = {transA, transB};
+    Script::setVar(1, trans, sizeof(trans));
+}
+
+void ScriptIntrinsicGemm::setScale(float alpha, float beta) {
+    float scale[2] = {alpha, beta};
+    Script::setVar(0, scale, sizeof(scale));
+}
+
+void ScriptIntrinsicGemm::setOffsets(int32_t aOffset, int32_t bOffset) {
+    if ((aOffset < 0) || (aOffset > 255) || (bOffset < 0) || (bOffset > 255)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Gemm offsets out of range");
+        return;
+    }
+    int32_t offsets[2] = {aOffset, bOffset};
+    Script::setVar(2, offsets, sizeof(offsets));
+}
+
+void ScriptIntrinsicGemm::multiply(sp<Allocation> a, sp<Allocation> b, sp<Allocation> c) {
+    if (!(a->getType()->getElement()->isCompatible(mElement)) ||
+        !(b->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Gemm input");
+        return;
+    }
+    sp<const Element> ec = c->getType()->getElement();
+    if (mElement->getDataType() == RS_TYPE_UNSIGNED_8 ?
+        !ec->isCompatible(Element::I32(mRS)) : !ec->isCompatible(Element::F32(mRS))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Gemm output must be F32, or I32 for U8");
+        return;
+    }
+    if ((a->getType()->getZ() > 0) || (b->getType()->getZ() > 0) ||
+        (c->getType()->getZ() > 0)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Gemm matrices must be 2D");
+        return;
+    }
+
+    Script::setVar(3, a);
+    Script::setVar(4, b);
+    Script::forEach(0, NULL, c, NULL, 0);
+}
+
+sp<ScriptIntrinsicETC1Encode> ScriptIntrinsicETC1Encode::create(sp<RS> rs) {
+    return new ScriptIntrinsicETC1Encode(rs,
+        Element::createPixel(rs, RS_TYPE_UNSIGNED_32, RS_KIND_PIXEL_ETC1));
+}
+
+ScriptIntrinsicETC1Encode::ScriptIntrinsicETC1Encode(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_ETC1_ENCODE, e) {
+
+}
+
+void ScriptIntrinsicETC1Encode::setInput(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(Element::RGBA_8888(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "ETC1 encode input must be RGBA_8888");
+        return;
+    }
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicETC1Encode::forEach(sp<Allocation> out) {
+    sp<const Element> e = out->getType()->getElement();
+    if (!(e->isCompatible(mElement)) ||
+        !((e->getDataKind() == RS_KIND_PIXEL_ETC1) ||
+          (e->getDataKind() == RS_KIND_PIXEL_ETC2_RGB))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "ETC1 encode output must be ETC1 blocks");
+        return;
+    }
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+sp<ScriptIntrinsicDemosaic> ScriptIntrinsicDemosaic::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8_4(rs))) &&
+        !(e->isCompatible(Element::F32_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Demosaic");
+        return NULL;
+    }
+    return new ScriptIntrinsicDemosaic(rs, e);
+}
+
+ScriptIntrinsicDemosaic::ScriptIntrinsicDemosaic(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_DEMOSAIC, e) {
+    mParams[0] = RS_DEMOSAIC_RGGB;
+    mParams[1] = RS_DEMOSAIC_BILINEAR;
+    mParams[2] = 0;
+}
+
+void ScriptIntrinsicDemosaic::setInput(sp<Allocation> in) {
+    sp<const Element> e = in->getType()->getElement();
+    if (!(e->isCompatible(Element::U8(mRS))) && !(e->isCompatible(Element::U16(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Demosaic input must be U8 or U16");
+        return;
+    }
+    Script::setVar(1, in);
+}
+
+void ScriptIntrinsicDemosaic::setPattern(RsScriptIntrinsicDemosaicPattern pattern) {
+    if ((uint32_t)pattern > RS_DEMOSAIC_GBRG) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Demosaic pattern");
+        return;
+    }
+    mParams[0] = pattern;
+    Script::setVar(0, mParams, sizeof(mParams));
+}
+
+void ScriptIntrinsicDemosaic::setInterpolation(RsScriptIntrinsicDemosaicInterpolation mode) {
+    if ((uint32_t)mode > RS_DEMOSAIC_EDGE_AWARE) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid Demosaic interpolation");
+        return;
+    }
+    mParams[1] = mode;
+    Script::setVar(0, mParams, sizeof(mParams));
+}
+
+void ScriptIntrinsicDemosaic::setBitDepth(uint32_t bits) {
+    if ((bits < 8) || (bits > 16)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Demosaic bit depth must be 8 to 16");
+        return;
+    }
+    mParams[2] = bits;
+    Script::setVar(0, mParams, sizeof(mParams));
+}
+
+void ScriptIntrinsicDemosaic::forEach(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in Demosaic");
+        return;
+    }
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+sp<const Script::KernelID> ScriptIntrinsicDemosaic::getKernelID() {
+    return createKernelID(0, 2);
+}
+
+sp<const Script::FieldID> ScriptIntrinsicDemosaic::getFieldID_Input() {
+    return createFieldID(1);
+}
+
+sp<ScriptIntrinsicConvolveQ8> ScriptIntrinsicConvolveQ8::create(sp<RS> rs,
+                                                                sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8(rs))) && !(e->isCompatible(Element::I32(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for ConvolveQ8");
+        return NULL;
+    }
+    return new ScriptIntrinsicConvolveQ8(rs, e);
+}
+
+ScriptIntrinsicConvolveQ8::ScriptIntrinsicConvolveQ8(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_CONVOLVE_Q8, e) {
+    mQuant[0] = 0;
+    mQuant[1] = 0;
+    mQuant[2] = 0;
+    mQuant[3] = 0x7fffffff;
+    mQuant[4] = 0;
+}
+
+void ScriptIntrinsicConvolveQ8::setOffsets(int32_t inputOffset, int32_t filterOffset,
+                                           int32_t outputOffset) {
+    if ((inputOffset < 0) || (inputOffset > 255) || (filterOffset < 0) ||
+        (filterOffset > 255) || (outputOffset < 0) || (outputOffset > 255)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "ConvolveQ8 offsets out of range");
+        return;
+    }
+    mQuant[0] = inputOffset;
+    mQuant[1] = filterOffset;
+    mQuant[2] = outputOffset;
+    Script::setVar(0, mQuant, sizeof(mQuant));
+}
+
+void ScriptIntrinsicConvolveQ8::setRequantize(int32_t multiplier, int32_t shift) {
+    if ((multiplier <= 0) || (shift < 0) || (shift > 31)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "ConvolveQ8 requantization out of range");
+        return;
+    }
+    mQuant[3] = multiplier;
+    mQuant[4] = shift;
+    Script::setVar(0, mQuant, sizeof(mQuant));
+}
+
+void ScriptIntrinsicConvolveQ8::setGeometry(uint32_t strideX, uint32_t strideY,
+                                            uint32_t padX, uint32_t padY) {
+    if (!strideX || !strideY || (padX > 0xffff) || (padY > 0xffff)) {
+        mRS->throwError(RS_ERROR_INVALID_PARAMETER, "Invalid ConvolveQ8 geometry");
+        return;
+    }
+    int32_t geometry[4] = {(int32_t)strideX, (int32_t)strideY, (int32_t)padX, (int32_t)padY};
+    Script::setVar(1, geometry, sizeof(geometry));
+}
+
+void ScriptIntrinsicConvolveQ8::setFilter(sp<Allocation> filter, sp<Allocation> bias) {
+    if (!(filter->getType()->getElement()->isCompatible(Element::U8(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "ConvolveQ8 filter must be U8");
+        return;
+    }
+    if ((bias != NULL) && !(bias->getType()->getElement()->isCompatible(Element::I32(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "ConvolveQ8 bias must be I32");
+        return;
+    }
+    Script::setVar(3, filter);
+    Script::setVar(4, bias);
+}
+
+void ScriptIntrinsicConvolveQ8::forEach(sp<Allocation> in, sp<Allocation> out) {
+    if (!(in->getType()->getElement()->isCompatible(Element::U8(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "ConvolveQ8 input must be U8");
+        return;
+    }
+    if (!(out->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Element mismatch in ConvolveQ8");
+        return;
+    }
+    Script::setVar(2, in);
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+sp<ScriptIntrinsicConvert> ScriptIntrinsicConvert::create(sp<RS> rs) {
+    return new ScriptIntrinsicConvert(rs, Element::RGBA_8888(rs));
+}
+
+ScriptIntrinsicConvert::ScriptIntrinsicConvert(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_CONVERT, e) {
+
+}
+
+bool ScriptIntrinsicConvert::isValidElement(sp<const Element> e) {
+    return e->isCompatible(Element::U8(mRS)) ||
+           e->isCompatible(Element::U8_2(mRS)) ||
+           e->isCompatible(Element::U8_3(mRS)) ||
+           e->isCompatible(Element::U8_4(mRS)) ||
+           e->isCompatible(Element::U16(mRS)) ||
+           e->isCompatible(Element::U16_2(mRS)) ||
+           e->isCompatible(Element::U16_3(mRS)) ||
+           e->isCompatible(Element::U16_4(mRS)) ||
+           e->isCompatible(Element::F32(mRS)) ||
+           e->isCompatible(Element::F32_2(mRS)) ||
+           e->isCompatible(Element::F32_3(mRS)) ||
+           e->isCompatible(Element::F32_4(mRS)) ||
+           isHalfElement(e, 1, 4);
+}
+
+void ScriptIntrinsicConvert::forEach(sp<Allocation> in, sp<Allocation> out) {
+    sp<const Element> ein = in->getType()->getElement();
+    if ((ein != mCheckedIn) && !isValidElement(ein)) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Convert");
+        return;
+    }
+    mCheckedIn = ein;
+
+    sp<const Element> eout = out->getType()->getElement();
+    if ((eout != mCheckedOut) && !isValidElement(eout)) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for Convert");
+        return;
+    }
+    mCheckedOut = eout;
+
+    Script::forEach(0, in, out, NULL, 0);
+}
+
+void ScriptIntrinsicConvert::setNormalized(bool normalized) {
+    Script::setVar(0, (int32_t)normalized);
+}
+
+sp<const Script::KernelID> ScriptIntrinsicConvert::getKernelID() {
+    return createKernelID(0, 3);
+}
+
+sp<ScriptIntrinsicRGBToYuv> ScriptIntrinsicRGBToYuv::create(sp<RS> rs, sp<const Element> e) {
+    if (!(e->isCompatible(Element::U8_4(rs)))) {
+        rs->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for RGBToYuv");
+        return NULL;
+    }
+    return new ScriptIntrinsicRGBToYuv(rs, e);
+}
+
+ScriptIntrinsicRGBToYuv::ScriptIntrinsicRGBToYuv(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV, e) {
+
+}
+
+void ScriptIntrinsicRGBToYuv::setOutput(sp<Allocation> out) {
+    if (!(out->getType()->getElement()->isCompatible(Element::YUV(mRS)))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for output in RGBToYuv");
+        return;
+    }
+    Script::setVar(0, out);
+}
+
+void ScriptIntrinsicRGBToYuv::forEach(sp<Allocation> in) {
+    if (!(in->getType()->getElement()->isCompatible(mElement))) {
+        mRS->throwError(RS_ERROR_INVALID_ELEMENT, "Invalid element for input in RGBToYuv");
+        return;
+    }
+
+    Script::forEach(0, in, NULL, NULL, 0);
+}
@@ -100,6 +100,19 @@ void Type::updateFromNative() {
 }
 
 sp<const Type> Type::create(sp<RS> rs, sp<const Element> e, uint32_t dimX, uint32_t dimY, uint32_t dimZ) {
+    RS::TypeKey key;
+    key.mElement = e->getID();
+    key.mDimX = dimX;
+    key.mDimY = dimY;
+    key.mDimZ = dimZ;
+    key.mDimMipmaps = false;
+    key.mDimFaces = false;
+    key.mYuv = 0;
+    sp<const Type> cached = rs->findType(key);
+    if (cached.get()) {
+        return cached;
+    }
+
     void * id = RS::dispatch->TypeCreate(rs->getContext(), e->getID(), dimX, dimY, dimZ, false, false, 0);
     Type *t = new Type(id, rs);
 
@@ -112,6 +125,7 @@ sp<const Type> Type::create(sp<RS> rs, sp<const Element> e, uint32_t dimX, uint3
 
     t->calcElementCount();
 
+    rs->addType(key, t);
     return t;
 }
 
@@ -200,6 +214,19 @@ sp<const Type> Type::Builder::create() {
         nativeYuv = 0;
     }
 
+    RS::TypeKey key;
+    key.mElement = mElement->getID();
+    key.mDimX = mDimX;
+    key.mDimY = mDimY;
+    key.mDimZ = mDimZ;
+    key.mDimMipmaps = mDimMipmaps;
+    key.mDimFaces = mDimFaces;
+    key.mYuv = mYuvFormat;
+    sp<const Type> cached = mRS->findType(key);
+    if (cached.get()) {
+        return cached;
+    }
+
     void * id = RS::dispatch->TypeCreate(mRS->getContext(), mElement->getID(), mDimX, mDimY, mDimZ,
                                          mDimMipmaps, mDimFaces, 0);
     Type *t = new Type(id, mRS);
@@ -211,6 +238,7 @@ sp<const Type> Type::Builder::create() {
     t->mDimFaces = mDimFaces;
 
     t->calcElementCount();
+    mRS->addType(key, t);
     return t;
 }
 
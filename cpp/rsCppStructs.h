@@ -35,6 +35,7 @@ namespace RSC {
 
 typedef void (*ErrorHandlerFunc_t)(uint32_t errorNum, const char *errorText);
 typedef void (*MessageHandlerFunc_t)(uint32_t msgNum, const void *msgData, size_t msgLen);
+typedef void (*FenceCallback_t)(void *usr);
 
 class RS;
 class BaseObj;
@@ -43,7 +44,10 @@ class Type;
 class Allocation;
 class Script;
 class ScriptC;
+class ScriptGroup;
 class Sampler;
+class Fence;
+class ScriptIntrinsicLUT;
 
 /**
  * Possible error codes used by RenderScript. Once a status other than RS_SUCCESS
@@ -76,7 +80,11 @@ class Sampler;
  enum RSInitFlags {
      RS_INIT_SYNCHRONOUS = 1, ///< All RenderScript calls will be synchronous. May reduce latency.
      RS_INIT_LOW_LATENCY = 2, ///< Prefer low latency devices over potentially higher throughput devices.
-     RS_INIT_MAX = 4
+     RS_INIT_BIG_CORES = 4, ///< Only run kernels on the fastest cores of a heterogeneous CPU.
+     RS_INIT_BATCH_COMMANDS = 8, ///< Hold asynchronous calls back until flush() or a synchronous call.
+     RS_INIT_DEFER_DESTROY = 16, ///< Release the memory of destroyed objects once the context is idle.
+     RS_INIT_PERF_HINTS = 32, ///< Ask the platform to raise CPU clocks for large kernel launches.
+     RS_INIT_MAX = 64
  };
 
  /**
@@ -140,6 +148,42 @@ class Sampler;
      */
     void finish();
 
+    /**
+     * Sends any calls held back by RS_INIT_BATCH_COMMANDS to be run. Must
+     * be called before waiting on messages from those calls.
+     */
+    void flush();
+
+    /**
+     * Reports the memory the context holds, current and peak bytes for
+     * each RsMemoryCategory. Runs on the calling thread without waiting for
+     * queued calls, so it is cheap enough to check a budget before each
+     * allocation.
+     * @param[out] usage entries to fill, indexed by RsMemoryCategory
+     * @param[in] count number of entries in usage
+     * @return number of categories the context reports
+     */
+    uint32_t getMemoryUsage(RsMemoryUsage *usage, uint32_t count);
+
+    /**
+     * Releases memory the context keeps cached but is not using, more of
+     * it at higher levels. Meant to be called from the app's onTrimMemory
+     * with the level it was given; waits for queued calls first.
+     * @param[in] level how much to release
+     * @return number of bytes freed
+     */
+    uint64_t trimMemory(RsTrimMemoryLevel level);
+
+    /**
+     * Returns a Fence signaled once every call made so far has finished,
+     * without waiting for them. The callback, if any, runs on the message
+     * thread when the fence is signaled.
+     * @param[in] callback function to run once the calls are done
+     * @param[in] usr value passed to callback
+     * @return new Fence, or NULL if the context has failed
+     */
+    sp<Fence> fence(FenceCallback_t callback = NULL, void *usr = NULL);
+
     RsContext getContext() { return mContext; }
     void throwError(RSError error, const char *errMsg);
 
@@ -152,6 +196,60 @@ class Sampler;
     bool init(std::string &name, int targetApi, uint32_t flags);
     static void * threadProc(void *);
 
+    struct FenceCallback {
+        uint32_t mID;
+        FenceCallback_t mFunc;
+        void *mUsr;
+    };
+    // Fences are run in the order they were sent, so everything up to
+    // mFenceSignaled is done.
+    pthread_mutex_t mFenceMutex;
+    pthread_cond_t mFenceCond;
+    uint32_t mFenceSent;
+    uint32_t mFenceSignaled;
+    std::vector<FenceCallback> mFenceCallbacks;
+    bool isFenceSignaled(uint32_t id);
+    void waitFence(uint32_t id);
+    void signalFence(uint32_t id);
+
+    // Types and composite Elements already made, so that asking for the
+    // same one again returns it instead of waiting on the RS thread.  The
+    // least recently used is dropped once a cache is full.
+    struct TypeKey {
+        void *mElement;
+        uint32_t mDimX;
+        uint32_t mDimY;
+        uint32_t mDimZ;
+        bool mDimMipmaps;
+        bool mDimFaces;
+        uint32_t mYuv;
+    };
+    struct CachedType {
+        TypeKey mKey;
+        sp<const Type> mType;
+        uint32_t mStamp;
+    };
+    struct CachedElement {
+        std::vector<void *> mElements;
+        std::vector<std::string> mElementNames;
+        std::vector<uint32_t> mArraySizes;
+        sp<const Element> mElement;
+        uint32_t mStamp;
+    };
+    static const size_t kMaxCachedObjects = 64;
+    pthread_mutex_t mCacheMutex;
+    uint32_t mCacheStamp;
+    std::vector<CachedType> mTypeCache;
+    std::vector<CachedElement> mElementCache;
+    sp<const Type> findType(const TypeKey &key);
+    void addType(const TypeKey &key, sp<const Type> t);
+    sp<const Element> findElement(const std::vector<void *> &elements,
+                                  const std::vector<std::string> &names,
+                                  const std::vector<uint32_t> &arraySizes);
+    void addElement(const std::vector<void *> &elements,
+                    const std::vector<std::string> &names,
+                    const std::vector<uint32_t> &arraySizes, sp<const Element> e);
+
     static bool gInitialized;
     static pthread_mutex_t gInitMutex;
 
@@ -250,7 +348,32 @@ class Sampler;
     } mSamplers;
     friend class Sampler;
     friend class Element;
+    friend class Type;
     friend class ScriptC;
+    friend class Fence;
+};
+
+/**
+ * Marks a point in the calls made to a context. Fences are returned by the
+ * asynchronous calls and by RS::fence().
+ */
+class Fence : public android::RSC::LightRefBase<Fence> {
+ private:
+    sp<RS> mRS;
+    uint32_t mID;
+
+    Fence(sp<RS> rs, uint32_t id);
+    friend class RS;
+
+ public:
+    /**
+     * @return true once every call made before the fence has finished
+     */
+    bool isSignaled() const;
+    /**
+     * Blocks until every call made before the fence has finished.
+     */
+    void wait() const;
 };
 
  /**
@@ -295,6 +418,8 @@ protected:
     sp<const Type> mType;
     uint32_t mUsage;
     sp<Allocation> mAdaptedAllocation;
+    // Where setAdapterOffset() last moved the view, as x, y, z, lod, face.
+    uint32_t mAdapterOffsets[5];
 
     bool mConstrainedLOD;
     bool mConstrainedFace;
@@ -347,6 +472,17 @@ public:
     void ioSendOutput();
     void ioGetInput();
 
+    /**
+     * Configure how frames delivered to an IO_INPUT Allocation are queued.
+     * Up to depth frames may wait behind the one ioGetInput() last made
+     * current, without being copied. Must be called before the surface is
+     * retrieved if depth changes.
+     * @param[in] depth number of frames that may wait, from 1 to 8
+     * @param[in] latest if true, ioGetInput() releases waiting frames and
+     *            moves to the newest; otherwise frames are taken in order
+     */
+    void setIoInputQueue(uint32_t depth, bool latest);
+
     /**
      * Generate a mipmap chain. This is only valid if the Type of the Allocation
      * includes mipmaps. This function will generate a complete set of mipmaps
@@ -356,6 +492,48 @@ public:
      */
     void generateMipmaps();
 
+    /**
+     * Resize a 1D Allocation. The contents of the Allocation are preserved.
+     * New cells are zeroed. Growing keeps spare capacity so that repeated
+     * small resizes don't copy the whole Allocation each time.
+     * @param[in] dimX new number of Elements
+     */
+    void resize(uint32_t dimX);
+
+    /**
+     * Reserve capacity in a 1D Allocation for later resizes.
+     * @param[in] dimX number of Elements to hold without reallocating
+     */
+    void reserve(uint32_t dimX);
+
+    /**
+     * Release any spare capacity of a 1D Allocation kept by resize.
+     */
+    void shrinkToFit();
+
+    /**
+     * Sort a 1D Allocation of I32, U32, I64, U64, F32 or F64 scalars
+     * ascending, in place.  Equal keys keep their order.
+     */
+    void sort();
+
+    /**
+     * Sort this Allocation as sort() does, moving the cells of values
+     * along with their keys.
+     * @param[in] values 1D Allocation with as many cells as this one
+     */
+    void sortByKey(sp<Allocation> values);
+
+    /**
+     * Copy the cells of src whose flag is nonzero, in order, to the start
+     * of this Allocation, as many as fit.
+     * @param[in] src 1D Allocation with the Element size of this one
+     * @param[in] flags 1D Allocation of 8, 16 or 32 bit scalars, one per
+     *                  cell of src
+     * @return number of cells copied
+     */
+    uint32_t compact(sp<Allocation> src, sp<Allocation> flags);
+
     /**
      * Copy an array into part of this Allocation.
      * @param[in] off offset of first Element to be overwritten
@@ -381,6 +559,20 @@ public:
      */
     void copy1DRangeTo(uint32_t off, size_t count, void *data);
 
+    /**
+     * Starts copying part of this Allocation into an array without waiting
+     * for calls made before it. data must stay valid until the returned
+     * Fence is signaled.
+     * @param[in] off offset of first Element to be copied
+     * @param[in] count number of Elements to copy
+     * @param[in] data array to copy into
+     * @param[in] callback function to run once the copy is done
+     * @param[in] usr value passed to callback
+     * @return Fence signaled when data holds the copy
+     */
+    sp<Fence> copy1DRangeToAsync(uint32_t off, size_t count, void *data,
+                                 FenceCallback_t callback = NULL, void *usr = NULL);
+
     /**
      * Copy entire array to an Allocation.
      * @param[in] data array from which to copy
@@ -417,6 +609,23 @@ public:
     void copy2DRangeTo(uint32_t xoff, uint32_t yoff, uint32_t w, uint32_t h,
                        void *data);
 
+    /**
+     * Starts copying a rectangular region of this Allocation into a tightly
+     * packed array without waiting for calls made before it. data must stay
+     * valid until the returned Fence is signaled.
+     * @param[in] xoff X offset of region to copy from this Allocation
+     * @param[in] yoff Y offset of region to copy from this Allocation
+     * @param[in] w Width of region to copy
+     * @param[in] h Height of region to copy
+     * @param[in] data destination array
+     * @param[in] callback function to run once the copy is done
+     * @param[in] usr value passed to callback
+     * @return Fence signaled when data holds the copy
+     */
+    sp<Fence> copy2DRangeToAsync(uint32_t xoff, uint32_t yoff, uint32_t w, uint32_t h,
+                                 void *data, FenceCallback_t callback = NULL,
+                                 void *usr = NULL);
+
     /**
      * Copy from an Allocation into a rectangular region in this Allocation.
      * @param[in] xoff X offset of region to update in this Allocation
@@ -501,6 +710,31 @@ public:
                          sp<const Allocation> data,
                          uint32_t dataXoff, uint32_t dataYoff, uint32_t dataZoff);
 
+    /**
+     * Copy from an Allocation into a region of this Allocation, converting
+     * each component to this Allocation's Element type.  The Elements must
+     * be float or 8 to 32 bit integer vectors of the same size.  1D and 2D
+     * regions have a depth, and height, of 1.
+     * @param[in] xoff X offset of region to update in this Allocation
+     * @param[in] yoff Y offset of region to update in this Allocation
+     * @param[in] zoff Z offset of region to update in this Allocation
+     * @param[in] w Width of region to update
+     * @param[in] h Height of region to update
+     * @param[in] d Depth of region to update
+     * @param[in] data Allocation from which to copy
+     * @param[in] dataXoff X offset of region in data to copy from
+     * @param[in] dataYoff Y offset of region in data to copy from
+     * @param[in] dataZoff Z offset of region in data to copy from
+     * @param[in] conversion RS_ALLOCATION_CONVERSION_CLAMP to keep values,
+     *                       or RS_ALLOCATION_CONVERSION_NORMALIZE to map
+     *                       integers to and from [0, 1] or [-1, 1] floats
+     */
+    void copy3DRangeFrom(uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                         uint32_t w, uint32_t h, uint32_t d,
+                         sp<const Allocation> data,
+                         uint32_t dataXoff, uint32_t dataYoff, uint32_t dataZoff,
+                         RsAllocationConversion conversion);
+
     /**
      * Creates an Allocation for use by scripts with a given Type.
      * @param[in] rs Context to which the Allocation will belong
@@ -558,6 +792,85 @@ public:
                                         size_t x, size_t y,
                                         uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT);
 
+    /**
+     * Creates a view onto part of another Allocation, sharing its memory.
+     * Kernels accept the view as input or output like any other
+     * Allocation and walk it with the rows of its base. The view starts at
+     * the first cell of the base until setAdapterOffset() moves it.
+     * When the base has USAGE_FIELD_PLANES, the view covers a single field
+     * of it instead, the first of the view's Element until
+     * setAdapterField() picks another.
+     * @param[in] rs Context to which the Allocation will belong
+     * @param[in] base Allocation to view, with USAGE_SCRIPT
+     * @param[in] type Type of the view, of the base's Element, or of one of
+     *            its fields for field planes, and without LODs or faces
+     * @return new Allocation
+     */
+    static sp<Allocation> createAdapter(sp<RS> rs, sp<Allocation> base, sp<const Type> type);
+
+    /**
+     * Moves a view made by createAdapter() within its base.
+     * @param[in] x X offset of the view's first cell
+     * @param[in] y Y offset of the view's first cell
+     * @param[in] z Z offset of the view's first cell
+     * @param[in] lod LOD of the base to view
+     * @param[in] face face of the base to view
+     */
+    void setAdapterOffset(uint32_t x, uint32_t y, uint32_t z = 0, uint32_t lod = 0,
+                          RsAllocationCubemapFace face = RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+
+    /**
+     * Moves a view made by createAdapter() of a USAGE_FIELD_PLANES base to
+     * another of its fields, which must be of the view's Element and not
+     * an array.
+     * @param[in] field index of the field in the base's Element
+     */
+    void setAdapterField(uint32_t field);
+
+    /**
+     * Returns a descriptor for the memory of this Allocation that another
+     * context can pass to createFromShared() to work on the same pages.
+     * Only Allocations with USAGE_SCRIPT and USAGE_SHARED can be exported.
+     * Neither context orders its work against the other's, so the producer
+     * should wait for an RS::fence() covering its writes before the
+     * consumer launches on the memory.
+     * @return descriptor, owned by the caller, or -1 on failure
+     */
+    int exportShared();
+
+    /**
+     * Creates an Allocation on memory another context exported with
+     * exportShared(), or on a regular file opened for reading and writing,
+     * which is grown to the size of the Type if it is shorter. Files are
+     * mapped rather than read in, and launches over large ones run in
+     * strips of rows, paging each strip in ahead and dropping it once it
+     * is done, so images much larger than memory can be processed.
+     * @param[in] rs Context to which the Allocation will belong
+     * @param[in] type Type matching that of the exported Allocation
+     * @param[in] fd descriptor from exportShared() or of a file, still owned
+     *               by the caller
+     * @param[in] usage usage, which must include USAGE_SHARED
+     * @return new Allocation
+     */
+    static sp<Allocation> createFromShared(sp<RS> rs, sp<const Type> type, int fd,
+                                           uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT |
+                                                            RS_ALLOCATION_USAGE_SHARED);
+
+    /**
+     * Returns the memory of the selected LOD, face and Z slice for direct
+     * access, without copies. Kernels launched before the call have finished
+     * with it when it returns. The pointer stays valid for the life of the
+     * Allocation, which can no longer be resized.
+     *
+     * Writes must be followed by syncAll(RS_ALLOCATION_USAGE_SCRIPT) before
+     * launching the kernels that read them. Memory that kernels launched
+     * since may use must not be touched until RS::finish() returns.
+     * Only USAGE_SCRIPT Allocations without IO, tiling, field planes or
+     * object Elements can be mapped, and adapters can't be.
+     * @param[out] stride size of a row in bytes
+     * @return pointer to the first cell, or NULL on failure
+     */
+    void * getPointer(size_t *stride);
 
 };
 
@@ -1318,15 +1631,46 @@ public:
  */
 class Script : public BaseObj {
 private:
+    uint32_t mMaxThreads;
+    RsForEachPriority mPriority;
 
 protected:
     Script(void *id, sp<RS> rs);
     void forEach(uint32_t slot, sp<const Allocation> in, sp<const Allocation> out,
             const void *v, size_t) const;
+    // Launches a kernel reading every allocation of ins together.
+    void forEach(uint32_t slot, const std::vector<sp<const Allocation> > &ins,
+                 sp<const Allocation> out, const void *v, size_t) const;
+    // Launches a kernel taking its parameters as the struct T, which must be
+    // laid out as the script declares them; nothing is packed per call.
+    template <typename T>
+    void forEach(uint32_t slot, sp<const Allocation> in, sp<const Allocation> out,
+                 const T &params) const {
+        forEach(slot, in, out, &params, sizeof(T));
+    }
+    // Launches a kernel over each of regions, which are scheduled together
+    // as a single launch.
+    void forEachRegions(uint32_t slot, sp<const Allocation> in, sp<const Allocation> out,
+                        const std::vector<RsScriptRect> &regions, const void *v,
+                        size_t len) const;
+    // Launches a kernel and returns a Fence signaled once it has finished.
+    sp<Fence> forEachAsync(uint32_t slot, sp<const Allocation> in, sp<const Allocation> out,
+                           const void *v, size_t len, FenceCallback_t callback = NULL,
+                           void *usr = NULL) const;
+    // Reduces in to the single cell of out, which holds the identity of
+    // combineSlot beforehand.  finalizeSlot is -1 when there is none.
+    void reduce(uint32_t accumSlot, uint32_t combineSlot, int32_t finalizeSlot,
+                sp<const Allocation> in, sp<const Allocation> out) const;
     void bindAllocation(sp<Allocation> va, uint32_t slot) const;
     void setVar(uint32_t index, const void *, size_t len) const;
     void setVar(uint32_t index, sp<const BaseObj> o) const;
+    // Applies a packed list of RsScriptVarRecord updates in one command.
+    void setVars(const void *records, size_t sizeBytes) const;
     void invoke(uint32_t slot, const void *v, size_t len) const;
+    // Invokes slot once per cell of the 1D allocation params, each cell
+    // being its parameter struct, in a single command.  Threadable scripts
+    // run the invokes concurrently and in no particular order.
+    void invokeBatch(uint32_t slot, sp<const Allocation> params) const;
 
 
     void invoke(uint32_t slot) const {
@@ -1349,6 +1693,132 @@ protected:
     }
 
 public:
+    /**
+     * Appends the regions covering the tiles set in a mask, each run of
+     * tiles along a row of the mask becoming one region, for launches
+     * over the tiles of a segmentation.
+     * @param[in] mask tilesX by tilesY bytes, row by row, non-zero for
+     *            tiles to cover
+     * @param[in] tileSize width and height of the tiles in cells; tiles
+     *            at the right and bottom are cut to dimX by dimY
+     * @param[out] regions vector the regions are appended to
+     */
+    static void appendTileRegions(const uint8_t *mask, uint32_t tilesX, uint32_t tilesY,
+                                  uint32_t tileSize, uint32_t dimX, uint32_t dimY,
+                                  std::vector<RsScriptRect> *regions);
+
+    /**
+     * A kernel bound to its Allocations, with parameters of type T. The
+     * Elements are checked once when binding, so each run only sends the
+     * launch.
+     */
+    template <typename T>
+    class Launch {
+        friend class Script;
+    private:
+        sp<const Script> mScript;
+        uint32_t mSlot;
+        sp<const Allocation> mIn;
+        sp<const Allocation> mOut;
+
+        Launch(sp<const Script> s, uint32_t slot, sp<const Allocation> in,
+               sp<const Allocation> out)
+            : mScript(s), mSlot(slot), mIn(in), mOut(out) {
+        }
+
+    public:
+        Launch() : mSlot(0) {
+        }
+
+        /**
+         * @return false if binding failed, in which case runs do nothing
+         */
+        bool isValid() const {
+            return mScript != NULL;
+        }
+
+        /**
+         * Runs the kernel with the given parameters.
+         * @param[in] params parameters, laid out as the script declares them
+         */
+        void run(const T &params) const {
+            if (mScript != NULL) {
+                mScript->forEach(mSlot, mIn, mOut, &params, sizeof(T));
+            }
+        }
+
+        /**
+         * Runs a kernel that takes no parameters.
+         */
+        void run() const {
+            if (mScript != NULL) {
+                mScript->forEach(mSlot, mIn, mOut, NULL, 0);
+            }
+        }
+    };
+
+    /**
+     * Identifies a kernel of a script so it can be placed in a ScriptGroup.
+     */
+    class KernelID : public BaseObj {
+        friend class Script;
+    private:
+        sp<const Script> mScript;
+        uint32_t mSlot;
+        uint32_t mSig;
+        KernelID(void *id, sp<RS> rs, sp<const Script> s, uint32_t slot, uint32_t sig);
+    public:
+        sp<const Script> getScript() const {
+            return mScript;
+        }
+    };
+
+    /**
+     * Identifies a global of a script so a ScriptGroup can bind the output
+     * of a kernel to it.
+     */
+    class FieldID : public BaseObj {
+        friend class Script;
+    private:
+        sp<const Script> mScript;
+        uint32_t mSlot;
+        FieldID(void *id, sp<RS> rs, sp<const Script> s, uint32_t slot);
+    public:
+        sp<const Script> getScript() const {
+            return mScript;
+        }
+    };
+
+protected:
+    // Binds kernel slot to in and out after checking them against the
+    // Elements the kernel was declared with; a NULL Element is not checked.
+    template <typename T>
+    Launch<T> bindKernel(uint32_t slot, sp<const Allocation> in, sp<const Allocation> out,
+                         sp<const Element> inElement, sp<const Element> outElement) const {
+        if (!checkKernelAllocations(in, out, inElement, outElement)) {
+            return Launch<T>();
+        }
+        return Launch<T>(this, slot, in, out);
+    }
+    bool checkKernelAllocations(sp<const Allocation> in, sp<const Allocation> out,
+                                sp<const Element> inElement,
+                                sp<const Element> outElement) const;
+
+    // sig has bit 0 set when the kernel has an input and bit 1 for an output.
+    sp<const KernelID> createKernelID(uint32_t slot, uint32_t sig) const;
+    sp<const FieldID> createFieldID(uint32_t slot) const;
+
+public:
+    /**
+     * Limit the threads used by this script's kernel launches. Useful for
+     * background work that runs next to a latency-sensitive context.
+     * @param[in] maxThreads maximum number of threads per launch, 0 for no limit
+     * @param[in] priority RS_FOR_EACH_PRIORITY_BACKGROUND to use at most half
+     *            of the threads, and the slowest cores when they differ
+     */
+    void setLaunchHints(uint32_t maxThreads,
+                        RsForEachPriority priority = RS_FOR_EACH_PRIORITY_DEFAULT);
+
     class FieldBase {
     protected:
         sp<const Element> mElement;
@@ -1373,6 +1843,143 @@ public:
     };
 };
 
+/**
+ * A group of kernels run as one launch. Kernels are connected by passing the
+ * output of one to the input or a field of another; the allocations behind
+ * those connections are owned by the group, which may fuse the kernels and
+ * never materialize them. Build groups with ScriptGroup::Builder.
+ */
+class ScriptGroup : public BaseObj {
+private:
+    ScriptGroup(void *id, sp<RS> rs);
+
+public:
+    /**
+     * Sets the input of a kernel whose input is not connected in the group.
+     * @param[in] kid kernel of the group
+     * @param[in] a input Allocation
+     */
+    void setInput(sp<const Script::KernelID> kid, sp<Allocation> a);
+    /**
+     * Sets the output of a kernel whose output is not connected in the group.
+     * @param[in] kid kernel of the group
+     * @param[in] a output Allocation
+     */
+    void setOutput(sp<const Script::KernelID> kid, sp<Allocation> a);
+    /**
+     * Runs every kernel of the group.
+     */
+    void execute();
+    /**
+     * Lets each execute return once its kernels are queued, so a frame
+     * starts while the one before it is still running. A kernel of the
+     * next frame overlaps the kernels after it in the previous one, with
+     * the group alternating between two sets of connection allocations.
+     * Inputs and outputs are only safe to touch once a call outside the
+     * group, like a copy, has waited for the frames in flight.
+     * @param[in] pipelined whether executes overlap
+     */
+    void setPipelined(bool pipelined);
+
+    /**
+     * Collects kernels and the connections between them. The connections
+     * must not form a loop.
+     */
+    class Builder {
+    private:
+        struct Connection {
+            sp<const Type> mType;
+            sp<const Script::KernelID> mFrom;
+            sp<const Script::KernelID> mToKernel;
+            sp<const Script::FieldID> mToField;
+        };
+
+        RS* mRS;
+        std::vector<sp<const Script::KernelID> > mKernels;
+        std::vector<Connection> mConnections;
+
+        bool hasKernel(sp<const Script::KernelID> k) const;
+        bool reaches(const Script *from, const Script *to, size_t depth) const;
+        void addConnection(sp<const Type> t, sp<const Script::KernelID> from,
+                           sp<const Script::KernelID> toK, sp<const Script::FieldID> toF);
+
+    public:
+        Builder(sp<RS> rs);
+
+        /**
+         * Adds a kernel to the group. All kernels must be added before any
+         * connection.
+         * @param[in] k kernel to add
+         */
+        void addKernel(sp<const Script::KernelID> k);
+        /**
+         * Connects the output of a kernel to the input of another.
+         * @param[in] t Type of the intermediate Allocation
+         * @param[in] from kernel whose output is passed on
+         * @param[in] to kernel reading it as its input
+         */
+        void addConnection(sp<const Type> t, sp<const Script::KernelID> from,
+                           sp<const Script::KernelID> to);
+        /**
+         * Connects the output of a kernel to a global of another script.
+         * @param[in] t Type of the intermediate Allocation
+         * @param[in] from kernel whose output is passed on
+         * @param[in] to global the Allocation is bound to
+         */
+        void addConnection(sp<const Type> t, sp<const Script::KernelID> from,
+                           sp<const Script::FieldID> to);
+        /**
+         * @return new ScriptGroup, or NULL if the group is invalid
+         */
+        sp<ScriptGroup> create();
+    };
+};
+
+/**
+ * A recorded sequence of commands that can be replayed in one call. The
+ * commands sent between beginRecording and endRecording run as usual and
+ * are captured as well. Global updates, invokes, kernel launches, ScriptGroup
+ * executions, Allocation copies and IO can be recorded. The values of some
+ * of them can be changed on each submit.
+ */
+class CommandBuffer : public BaseObj {
+private:
+    CommandBuffer(void *id, sp<RS> rs);
+
+public:
+    /**
+     * @param[in] rs RenderScript context
+     * @return new CommandBuffer
+     */
+    static sp<CommandBuffer> create(sp<RS> rs);
+    /**
+     * Starts capturing the commands sent to the context, dropping any
+     * earlier recording. Only one buffer can record at a time.
+     */
+    void beginRecording();
+    /**
+     * Makes the value of the next recorded command a parameter of submit:
+     * the value of a setVar, the arguments of an invoke or the user data
+     * of a kernel launch.
+     */
+    void markParam();
+    /**
+     * Stops capturing commands.
+     */
+    void endRecording();
+    /**
+     * Replays the recording with the parameters it was last run with.
+     */
+    void submit();
+    /**
+     * Replays the recording with new parameters.
+     * @param[in] params values of the marked commands, packed in the order
+     *                   they were recorded, each the size it was recorded with
+     * @param[in] sizeBytes size of params
+     */
+    void submit(const void *params, size_t sizeBytes);
+};
+
 /**
  * The parent class for all user-defined scripts. This is intended to be used by auto-generated code only.
  */
@@ -1422,11 +2029,20 @@ class ScriptIntrinsic3DLUT : public ScriptIntrinsic {
     void forEach(sp<Allocation> ain, sp<Allocation> aout);
 
     /**
-     * Sets the lookup table. The lookup table must use the same Element as the
-     * intrinsic.
+     * Sets the lookup table. The lookup table must be a 3D Allocation of
+     * U8_4, F32_4 or four-component FLOAT_16 Elements; float tables hold
+     * colours in the range [0, 1].
      * @param[in] lut new lookup table
      */
     void setLUT(sp<Allocation> lut);
+
+    /**
+     * Sets how colours between lattice points are interpolated. Tetrahedral
+     * interpolation reads four lattice points per pixel instead of eight.
+     * @param[in] mode RS_3DLUT_INTERPOLATION_TRILINEAR (default) or
+     *            RS_3DLUT_INTERPOLATION_TETRAHEDRAL
+     */
+    void setInterpolation(RsScriptIntrinsic3DLUTInterpolation mode);
 };
 
 /**
@@ -1437,12 +2053,24 @@ class ScriptIntrinsicBlend : public ScriptIntrinsic {
     ScriptIntrinsicBlend(sp<RS> rs, sp<const Element> e);
  public:
     /**
-     * Supported Element types are U8_4.
+     * Supported Element types are U8_4 and four-component FLOAT_16.
      * @param[in] rs RenderScript context
      * @param[in] e Element
      * @return new ScriptIntrinsicBlend
      */
     static sp<ScriptIntrinsicBlend> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the opacity the source is blended at, the source being
+     * scaled by it first.  Defaults to 1.
+     * @param[in] alpha opacity in [0, 1]
+     */
+    void setGlobalAlpha(float alpha);
+    /**
+     * Sets a U8 Allocation, the size of the output, whose values scale the
+     * source pixel by pixel, along with the global alpha.  NULL removes it.
+     * @param[in] mask mask Allocation
+     */
+    void setMask(sp<Allocation> mask);
     /**
      * sets dst = {0, 0, 0, 0}
      * @param[in] in input Allocation
@@ -1544,7 +2172,8 @@ class ScriptIntrinsicBlur : public ScriptIntrinsic {
     ScriptIntrinsicBlur(sp<RS> rs, sp<const Element> e);
  public:
     /**
-     * Supported Element types are U8 and U8_4.
+     * Supported Element types are U8, U8_4 and one or four-component
+     * FLOAT_16.  FLOAT_16 radii above 25 are clamped to 25.
      * @param[in] rs RenderScript context
      * @param[in] e Element
      * @return new ScriptIntrinsicBlur
@@ -1561,10 +2190,20 @@ class ScriptIntrinsicBlur : public ScriptIntrinsic {
      */
     void forEach(sp<Allocation> out);
     /**
-     * Sets the radius of the blur. The supported range is 0 < radius <= 25.
+     * Sets the radius of the blur. The supported range is 0 < radius <= 200.
+     * Radii above 25 approximate the gaussian with a cascade of box
+     * filters, whose cost does not grow with the radius.
      * @param[in] radius radius of the blur
      */
     void setRadius(float radius);
+    /**
+     * @return KernelID of the blur kernel, for use in a ScriptGroup
+     */
+    sp<const KernelID> getKernelID();
+    /**
+     * @return FieldID of the input, for use in a ScriptGroup
+     */
+    sp<const FieldID> getFieldID_Input();
 };
 
 /**
@@ -1576,7 +2215,13 @@ class ScriptIntrinsicBlur : public ScriptIntrinsic {
  */
 class ScriptIntrinsicColorMatrix : public ScriptIntrinsic {
  private:
+    // Elements last found valid, so relaunching on them skips the checks.
+    sp<const Element> mCheckedIn;
+    sp<const Element> mCheckedOut;
+    sp<ScriptIntrinsicLUT> mLUT;
+
     ScriptIntrinsicColorMatrix(sp<RS> rs, sp<const Element> e);
+    bool isValidElement(sp<const Element> e);
  public:
     /**
      * Creates a new intrinsic.
@@ -1585,8 +2230,8 @@ class ScriptIntrinsicColorMatrix : public ScriptIntrinsic {
      */
     static sp<ScriptIntrinsicColorMatrix> create(sp<RS> rs);
     /**
-     * Applies the color matrix. Supported types are U8 and F32 with
-     * vector lengths between 1 and 4.
+     * Applies the color matrix. Supported types are U8, F32 and
+     * FLOAT_16 with vector lengths between 1 and 4.
      * @param[in] in input Allocation
      * @param[out] out output Allocation
      */
@@ -1597,6 +2242,10 @@ class ScriptIntrinsicColorMatrix : public ScriptIntrinsic {
      * @param[in] add float[4] of values
      */
     void setAdd(float* add);
+    /**
+     * @return KernelID of the color matrix kernel, for use in a ScriptGroup
+     */
+    sp<const KernelID> getKernelID();
 
     /**
      * Set the color matrix which will be applied to each cell of the
@@ -1627,6 +2276,15 @@ class ScriptIntrinsicColorMatrix : public ScriptIntrinsic {
      * the 4th channel.
      */
     void setYUVtoRGB();
+    /**
+     * Look each channel of U8 outputs up in the tables of a LUT
+     * intrinsic after the matrix, as a LUT forEach over the output would,
+     * without a second pass over the image.  Later changes to the LUT's
+     * tables are picked up by the next forEach.
+     *
+     * @param[in] lut The LUT intrinsic, NULL for none
+     */
+    void setLUT(sp<ScriptIntrinsicLUT> lut);
 };
 
 /**
@@ -1637,8 +2295,8 @@ class ScriptIntrinsicConvolve3x3 : public ScriptIntrinsic {
     ScriptIntrinsicConvolve3x3(sp<RS> rs, sp<const Element> e);
  public:
     /**
-     * Supported types U8 and F32 with vector lengths between 1 and
-     * 4. The default convolution kernel is the identity.
+     * Supported types U8, F32 and FLOAT_16 with vector lengths between
+     * 1 and 4. The default convolution kernel is the identity.
      * @param[in] rs RenderScript context
      * @param[in] e Element
      * @return new ScriptIntrinsicConvolve3x3
@@ -1659,6 +2317,14 @@ class ScriptIntrinsicConvolve3x3 : public ScriptIntrinsic {
      * @param[in] v float[9] of values
      */
     void setCoefficients(float* v);
+    /**
+     * @return KernelID of the convolution kernel, for use in a ScriptGroup
+     */
+    sp<const KernelID> getKernelID();
+    /**
+     * @return FieldID of the input, for use in a ScriptGroup
+     */
+    sp<const FieldID> getFieldID_Input();
 };
 
 /**
@@ -1669,8 +2335,8 @@ class ScriptIntrinsicConvolve5x5 : public ScriptIntrinsic {
     ScriptIntrinsicConvolve5x5(sp<RS> rs, sp<const Element> e);
  public:
     /**
-     * Supported types U8 and F32 with vector lengths between 1 and
-     * 4. The default convolution kernel is the identity.
+     * Supported types U8, F32 and FLOAT_16 with vector lengths between
+     * 1 and 4. The default convolution kernel is the identity.
      * @param[in] rs RenderScript context
      * @param[in] e Element
      * @return new ScriptIntrinsicConvolve5x5
@@ -1691,6 +2357,51 @@ class ScriptIntrinsicConvolve5x5 : public ScriptIntrinsic {
      * @param[in] v float[25] of values
      */
     void setCoefficients(float* v);
+    /**
+     * @return KernelID of the convolution kernel, for use in a ScriptGroup
+     */
+    sp<const KernelID> getKernelID();
+    /**
+     * @return FieldID of the input, for use in a ScriptGroup
+     */
+    sp<const FieldID> getFieldID_Input();
+};
+
+/**
+ * Intrinsic for applying an NxN convolve to an allocation, for any odd N
+ * up to 25.  Kernels that are the outer product of a row and a column
+ * vector are detected and applied as two 1D passes.
+ */
+class ScriptIntrinsicConvolve : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicConvolve(sp<RS> rs, sp<const Element> e, uint32_t size);
+    uint32_t mSize;
+ public:
+    /**
+     * Supported types U8 and F32 with vector lengths between 1 and
+     * 4. The default convolution kernel is the identity.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element
+     * @param[in] size width and height of the kernel, odd and at most 25
+     * @return new ScriptIntrinsicConvolve
+     */
+    static sp<ScriptIntrinsicConvolve> create(sp<RS> rs, sp<const Element> e,
+                                              uint32_t size);
+    /**
+     * Sets input for intrinsic.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Launches the intrinsic.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+    /**
+     * Sets convolution kernel.
+     * @param[in] v float[size * size] of values, row by row
+     */
+    void setCoefficients(float* v);
 };
 
 /**
@@ -1702,10 +2413,10 @@ class ScriptIntrinsicHistogram : public ScriptIntrinsic {
     sp<Allocation> mOut;
  public:
     /**
-     * Create an intrinsic for calculating the histogram of an uchar
-     * or uchar4 image.
+     * Create an intrinsic for calculating the histogram of an image.
      *
-     * Supported elements types are U8_4, U8_3, U8_2, and U8.
+     * Supported input data types are U8, U16, F16 and F32, of any
+     * vector size.
      *
      * @param[in] rs The RenderScript context
      * @param[in] e Element type for inputs
@@ -1715,13 +2426,36 @@ class ScriptIntrinsicHistogram : public ScriptIntrinsic {
     static sp<ScriptIntrinsicHistogram> create(sp<RS> rs);
     /**
      * Set the output of the histogram.  32 bit integer types are
-     * supported.
+     * supported.  The histogram has as many bins as the output has cells,
+     * up to 65536.
      *
      * @param[in] aout The output allocation
      */
     void setOutput(sp<Allocation> aout);
     /**
-     * Set the coefficients used for the dot product calculation. The
+     * Set the range of values divided evenly between the bins.  Values
+     * outside it are counted in the first or last bin.  By default U8
+     * input covers [0, 256), U16 [0, 65536) and floats [0, 1].  U8 input
+     * with the default range and 256 bins gets a bin per value.
+     *
+     * @param[in] min Bottom of the first bin
+     * @param[in] max Top of the last bin
+     */
+    void setRange(float min, float max);
+    /**
+     * Equalize each histogram into the tables of a LUT intrinsic.  After
+     * every forEach the tables map each channel through its cumulative
+     * distribution, or red, green and blue through that of the dot
+     * product for forEach_dot, so a ScriptGroup running this intrinsic
+     * then the LUT auto-contrasts an image without reading the histogram
+     * back.  Needs 256 bins of U8 input.  Setting the LUT's tables
+     * afterwards takes them back.
+     *
+     * @param[in] lut The LUT intrinsic whose tables to fill, NULL to stop
+     */
+    void setEqualizationTarget(sp<ScriptIntrinsicLUT> lut);
+    /**
+     * Set the coefficients used for the dot product calculation. The
      * default is {0.299f, 0.587f, 0.114f, 0.f}.
      *
      * Coefficients must be >= 0 and sum to 1.0 or less.
@@ -1767,6 +2501,12 @@ class ScriptIntrinsicLUT : public ScriptIntrinsic {
  private:
     sp<Allocation> LUT;
     bool mDirty;
+    // Fills the tables from its histograms.
+    friend class ScriptIntrinsicHistogram;
+    // Looks its output up in the tables.
+    friend class ScriptIntrinsicColorMatrix;
+    // Uploads tables set since the last launch.
+    void flush();
     unsigned char mCache[1024];
     void setTable(unsigned int offset, unsigned char base, unsigned int length, unsigned char* lutValues);
     ScriptIntrinsicLUT(sp<RS> rs, sp<const Element> e);
@@ -1859,6 +2599,646 @@ class ScriptIntrinsicYuvToRGB : public ScriptIntrinsic {
      */
     void forEach(sp<Allocation> out);
 
+    /**
+     * Sets a transform applied to the image as it is converted.  The crop
+     * is taken from the input, rotated clockwise, mirrored horizontally
+     * and scaled down to the dimensions of the output.  The crop and the
+     * output are the input's size by default.
+     *
+     * @param[in] rotation RS_YUV_ROTATE_0, 90, 180 or 270
+     * @param[in] mirror flip the output left to right
+     * @param[in] cropX, cropY origin of the crop in the input
+     * @param[in] cropW, cropH size of the crop, 0 to reach the input's
+     *            edge
+     * @param[in] scale RS_YUV_SCALE_BOX averages whole blocks of the crop
+     *            and needs it to be a multiple of the output;
+     *            RS_YUV_SCALE_BILINEAR takes any ratio.
+     */
+    void setTransform(RsScriptIntrinsicYuvRotation rotation, bool mirror,
+                      uint32_t cropX, uint32_t cropY, uint32_t cropW, uint32_t cropH,
+                      RsScriptIntrinsicYuvScale scale);
+
+};
+
+/**
+ * Intrinsic for converting allocations between element types. Each cell
+ * of the input is converted to the data type and vector size of the
+ * output. Channels the output lacks are dropped, missing ones are set to
+ * 0 and a missing fourth channel is opaque.
+ */
+class ScriptIntrinsicConvert : public ScriptIntrinsic {
+ private:
+    // Elements last found valid, so relaunching on them skips the checks.
+    sp<const Element> mCheckedIn;
+    sp<const Element> mCheckedOut;
+
+    ScriptIntrinsicConvert(sp<RS> rs, sp<const Element> e);
+    bool isValidElement(sp<const Element> e);
+ public:
+    /**
+     * Creates a new intrinsic.
+     * @param[in] rs RenderScript context
+     * @return new ScriptIntrinsicConvert
+     */
+    static sp<ScriptIntrinsicConvert> create(sp<RS> rs);
+    /**
+     * Converts in to the element of out. Supported types are U8, U16,
+     * F32 and FLOAT_16 with vector lengths between 1 and 4; both
+     * allocations must have the same dimensions.
+     * @param[in] in input Allocation
+     * @param[out] out output Allocation
+     */
+    void forEach(sp<Allocation> in, sp<Allocation> out);
+    /**
+     * Sets whether unsigned values are mapped to [0, 1] when converted to
+     * floating point, and rounded and saturated back from it, which is the
+     * default. Otherwise values are kept and only saturated.
+     * @param[in] normalized whether to normalize
+     */
+    void setNormalized(bool normalized);
+    /**
+     * @return KernelID of the conversion kernel, for use in a ScriptGroup
+     */
+    sp<const KernelID> getKernelID();
+};
+
+/**
+ * Intrinsic for scaling an allocation to the size of another.
+ */
+class ScriptIntrinsicResize : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicResize(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types U8 and F32 with vector lengths between 1 and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element
+     * @return new ScriptIntrinsicResize
+     */
+    static sp<ScriptIntrinsicResize> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the allocation to scale from.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Scales the input to the dimensions of out.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+    /**
+     * Sets the filter used for scaling.
+     * @param[in] mode RS_RESIZE_BILINEAR (default), RS_RESIZE_BICUBIC or
+     *            RS_RESIZE_AREA.  Bicubic widens its kernel when shrinking;
+     *            area averages every covered source pixel and suits large
+     *            downscales.
+     */
+    void setMode(RsScriptIntrinsicResizeMode mode);
+};
+
+/**
+ * Intrinsic for building an image pyramid into the mipmap levels of an
+ * allocation. Each Gaussian level is the one below it filtered with a 5
+ * tap binomial kernel and halved; a Laplacian level is the difference
+ * between a Gaussian level and the next one expanded by linear
+ * interpolation, the last level staying Gaussian. Adding each Laplacian
+ * level to the expansion of the level above it gives the image back.
+ */
+class ScriptIntrinsicPyramid : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicPyramid(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types U8 and F32 with vector lengths between 1 and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the output levels
+     * @return new ScriptIntrinsicPyramid
+     */
+    static sp<ScriptIntrinsicPyramid> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the image the pyramid is built from. Its element may be U8 or
+     * F32 and must have the vector length of the intrinsic's.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Writes the levels of the pyramid to the mipmap levels of out, whose
+     * first level has the dimensions of the input.
+     * @param[in] out output Allocation with mipmaps
+     */
+    void forEach(sp<Allocation> out);
+    /**
+     * Sets the kind of pyramid.
+     * @param[in] mode RS_PYRAMID_GAUSSIAN (default) or RS_PYRAMID_LAPLACIAN.
+     *            Laplacian levels are signed and need an F32 element.
+     */
+    void setMode(RsScriptIntrinsicPyramidMode mode);
+    /**
+     * Limits the number of levels written, counting the first.  Levels
+     * above are left alone.
+     * @param[in] levels levels to write, 0 (default) for all of them
+     */
+    void setLevels(uint32_t levels);
+};
+
+/**
+ * Intrinsic for transposing, rotating by a multiple of 90 degrees or
+ * flipping an image. The work is split into square tiles so the input of a
+ * transposing mode is read a few rows at a time rather than a column at a
+ * time.
+ */
+class ScriptIntrinsicRotate : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicRotate(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types U8, U16, U32 and F32 with vector lengths between 1
+     * and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the input and output
+     * @return new ScriptIntrinsicRotate
+     */
+    static sp<ScriptIntrinsicRotate> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the image to rotate.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Writes the rotated input to out. Transposing and rotating by 90 or
+     * 270 degrees need out to have the input's dimensions swapped, and
+     * the other modes need them the same.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+    /**
+     * Sets what is done to the input.
+     * @param[in] mode RS_ROTATE_TRANSPOSE (default), RS_ROTATE_90,
+     *            RS_ROTATE_180 or RS_ROTATE_270 for clockwise rotations,
+     *            RS_ROTATE_FLIP_HORIZONTAL to mirror the columns or
+     *            RS_ROTATE_FLIP_VERTICAL to mirror the rows
+     */
+    void setMode(RsScriptIntrinsicRotateMode mode);
+
+ private:
+    RsScriptIntrinsicRotateMode mMode;
+    sp<Allocation> mInput;
+};
+
+/**
+ * Intrinsic for warping an image, as for lens distortion or perspective
+ * correction. Each output pixel samples the input at a position given by a
+ * 3x3 matrix or by a coarse mesh of positions interpolated across the
+ * output.
+ */
+class ScriptIntrinsicWarp : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicWarp(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types U8 with vector lengths between 1 and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the input and output
+     * @return new ScriptIntrinsicWarp
+     */
+    static sp<ScriptIntrinsicWarp> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the image to sample.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Sets the matrix taking output positions (x, y, 1) to input positions
+     * (u * w, v * w, w), pixel centers being at whole numbers. The default
+     * is the identity. Positions outside the input are clamped to its
+     * edge.
+     * @param[in] m float[9] of values, a row at a time
+     */
+    void setMatrix(const float *m);
+    /**
+     * Replaces the matrix with a mesh of input positions. Node (i, j) of a
+     * mesh of W x H nodes is the position for the output pixel at
+     * (i * (outX - 1) / (W - 1), j * (outY - 1) / (H - 1)) and the others
+     * are interpolated bilinearly.
+     * @param[in] mesh Allocation of F32_2 with at least 2x2 nodes, or NULL
+     *            to go back to the matrix
+     */
+    void setMesh(sp<Allocation> mesh);
+    /**
+     * Sets the filter used for sampling.
+     * @param[in] filter RS_WARP_BILINEAR (default) or RS_WARP_BICUBIC
+     */
+    void setFilter(RsScriptIntrinsicWarpFilter filter);
+    /**
+     * Writes the warped input to out.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+};
+
+/**
+ * Intrinsic for eroding or dilating an image with a rectangle, each
+ * channel of an output pixel being the minimum or maximum of that channel
+ * over the rectangle around it. Pixels past the edges repeat the edge. The
+ * cost does not grow with the size of the rectangle.
+ */
+class ScriptIntrinsicMorphology : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicMorphology(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types U8 with vector lengths between 1 and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the input and output
+     * @return new ScriptIntrinsicMorphology
+     */
+    static sp<ScriptIntrinsicMorphology> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the image to filter.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Sets the rectangle, which is (2 * radiusX + 1) x (2 * radiusY + 1)
+     * pixels. The default radii are 1.
+     * @param[in] radiusX horizontal radius, 0 or more
+     * @param[in] radiusY vertical radius, 0 or more
+     */
+    void setRadius(int32_t radiusX, int32_t radiusY);
+    /**
+     * Sets whether the rectangle's minimum or maximum is taken.
+     * @param[in] op RS_MORPHOLOGY_ERODE (default) or RS_MORPHOLOGY_DILATE
+     */
+    void setOperation(RsScriptIntrinsicMorphologyOp op);
+    /**
+     * Writes the filtered input to out, which must be the same size.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+};
+
+/**
+ * Intrinsic for a median filter, each channel of an output pixel being the
+ * median of that channel over the 3x3 or 5x5 square around it. Pixels past
+ * the edges repeat the edge.
+ */
+class ScriptIntrinsicMedian : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicMedian(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types U8 with vector lengths between 1 and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the input and output
+     * @return new ScriptIntrinsicMedian
+     */
+    static sp<ScriptIntrinsicMedian> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the image to filter.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Sets the width of the square.
+     * @param[in] size 3 (default) or 5
+     */
+    void setSize(uint32_t size);
+    /**
+     * Writes the filtered input to out, which must be the same size.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+};
+
+/**
+ * Intrinsic for a bilateral filter, which blurs an image while keeping its
+ * edges. Each pixel around an output pixel is weighted by a Gaussian of its
+ * distance and another of how much its colour differs, the mean absolute
+ * difference of the colour channels. Large spatial sigmas are approximated
+ * with a bilateral grid, which costs the same whatever the sigma.
+ */
+class ScriptIntrinsicBilateral : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicBilateral(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types U8 with vector lengths between 1 and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the input and output
+     * @return new ScriptIntrinsicBilateral
+     */
+    static sp<ScriptIntrinsicBilateral> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the image to filter.
+     * @param[in] in input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Sets the sigmas of the two Gaussians. The defaults are 1 and 25.
+     * @param[in] spatial sigma in pixels, between 0 and 100
+     * @param[in] range sigma in levels of 0 to 255, more than 0
+     */
+    void setSigmas(float spatial, float range);
+    /**
+     * Sets how the filter is run. RS_BILATERAL_AUTO (default) uses the grid
+     * once the radius, twice the spatial sigma, passes 5 pixels.
+     * RS_BILATERAL_DIRECT filters directly up to a radius of 25.
+     * @param[in] mode RS_BILATERAL_AUTO, RS_BILATERAL_DIRECT or RS_BILATERAL_GRID
+     */
+    void setMode(RsScriptIntrinsicBilateralMode mode);
+    /**
+     * Writes the filtered input to out, which must be the same size.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+};
+
+/**
+ * Intrinsic for the summed-area table of an image, each output being the
+ * sum of the input pixels above and to the left of it, itself included.
+ * Sums wrap at 2^32.
+ */
+class ScriptIntrinsicIntegral : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicIntegral(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported input types U8 with vector lengths between 1 and 4.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the input
+     * @return new ScriptIntrinsicIntegral
+     */
+    static sp<ScriptIntrinsicIntegral> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Writes the table of ain to aout, which must be the same size with an
+     * I32 or U32 Element of the same vector length.
+     * @param[in] ain input Allocation
+     * @param[in] aout output Allocation
+     */
+    void forEach(sp<Allocation> ain, sp<Allocation> aout);
+};
+
+/**
+ * Intrinsic for the prefix sums of a 1D Allocation.
+ */
+class ScriptIntrinsicScan : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicScan(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types I32, U32 and F32. Integer sums wrap.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the input and output
+     * @return new ScriptIntrinsicScan
+     */
+    static sp<ScriptIntrinsicScan> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets whether each output includes the input at its own index.
+     * @param[in] mode RS_SCAN_INCLUSIVE (default) or RS_SCAN_EXCLUSIVE
+     */
+    void setMode(RsScriptIntrinsicScanMode mode);
+    /**
+     * Writes the prefix sums of ain to aout, both 1D and the same size.
+     * @param[in] ain input Allocation
+     * @param[in] aout output Allocation
+     */
+    void forEach(sp<Allocation> ain, sp<Allocation> aout);
+};
+
+/**
+ * Intrinsic for dense matrix products, C = alpha * op(A) * op(B) + beta * C
+ * on F32 matrices, or C = (A - aOffset) * (B - bOffset) from U8 matrices
+ * into I32, wrapping at 2^32. op() optionally transposes its matrix.
+ * Matrices are 2D Allocations with a row per Y; C is M by N (Y by X),
+ * op(A) M by K and op(B) K by N.
+ */
+class ScriptIntrinsicGemm : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicGemm(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported types F32 and U8.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of A and B
+     * @return new ScriptIntrinsicGemm
+     */
+    static sp<ScriptIntrinsicGemm> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets whether A and B are transposed before multiplying. Neither is
+     * by default.
+     * @param[in] transA transpose A
+     * @param[in] transB transpose B
+     */
+    void setTranspose(bool transA, bool transB);
+    /**
+     * Sets the scales of an F32 product. The defaults are 1 and 0, and a
+     * beta of 0 leaves the old contents of C unread.
+     * @param[in] alpha scale of the product
+     * @param[in] beta scale of C
+     */
+    void setScale(float alpha, float beta);
+    /**
+     * Sets the values subtracted from U8 inputs. Both default to 0.
+     * @param[in] aOffset offset of A, 0 to 255
+     * @param[in] bOffset offset of B, 0 to 255
+     */
+    void setOffsets(int32_t aOffset, int32_t bOffset);
+    /**
+     * Multiplies a by b into c, an F32 Allocation for F32 inputs and I32
+     * for U8.
+     * @param[in] a left matrix
+     * @param[in] b right matrix
+     * @param[in] c output matrix
+     */
+    void multiply(sp<Allocation> a, sp<Allocation> b, sp<Allocation> c);
+};
+
+/**
+ * Intrinsic for compressing an RGBA image to ETC1, which is also valid
+ * ETC2 RGB. Alpha is dropped. The output has one cell per 4x4 block of
+ * the input, so its Type is the input size divided by 4, rounded up.
+ */
+class ScriptIntrinsicETC1Encode : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicETC1Encode(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Supported Element types are defined by the output.
+     * @param[in] rs RenderScript context
+     * @return new ScriptIntrinsicETC1Encode
+     */
+    static sp<ScriptIntrinsicETC1Encode> create(sp<RS> rs);
+    /**
+     * Sets the image to compress.
+     * @param[in] in RGBA_8888 input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Compresses the input into an Allocation of PIXEL_ETC1 or
+     * PIXEL_ETC2_RGB blocks.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+};
+
+/**
+ * Intrinsic for interpolating a Bayer mosaic, such as a RAW16 camera
+ * image, into an RGBA image of the same size. The output can be linked
+ * straight into a ColorMatrix in a ScriptGroup.
+ */
+class ScriptIntrinsicDemosaic : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicDemosaic(sp<RS> rs, sp<const Element> e);
+    // Pattern, interpolation and bit depth, sent together.
+    int32_t mParams[3];
+ public:
+    /**
+     * Supported output elements are U8_4 and F32_4, the latter scaled to
+     * [0, 1] by the bit depth. Alpha is opaque.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the output
+     * @return new ScriptIntrinsicDemosaic
+     */
+    static sp<ScriptIntrinsicDemosaic> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the mosaic to interpolate.
+     * @param[in] in U8 or U16 input Allocation
+     */
+    void setInput(sp<Allocation> in);
+    /**
+     * Sets the colours of the top left 2x2 quad. The default is RGGB.
+     * @param[in] pattern pattern of the mosaic
+     */
+    void setPattern(RsScriptIntrinsicDemosaicPattern pattern);
+    /**
+     * Sets how missing colours are found. Bilinear, the default, averages
+     * the nearest samples; edge aware follows the gradients of a 5x5
+     * window and resists colour fringes.
+     * @param[in] mode interpolation
+     */
+    void setInterpolation(RsScriptIntrinsicDemosaicInterpolation mode);
+    /**
+     * Sets how many of the low bits of U16 inputs are used, such as 10 or
+     * 12 for RAW16 images of those sensors. The default uses all of them.
+     * @param[in] bits bit depth, 8 to 16
+     */
+    void setBitDepth(uint32_t bits);
+    /**
+     * Interpolates the input into out, which has its size.
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> out);
+    /**
+     * @return KernelID of the demosaic kernel, for use in a ScriptGroup
+     */
+    sp<const KernelID> getKernelID();
+    /**
+     * @return FieldID of the input, for use in a ScriptGroup
+     */
+    sp<const FieldID> getFieldID_Input();
+};
+
+/**
+ * Intrinsic for multi-channel 2D convolution of quantized U8 activations,
+ * as in the layers of inference models. Activations are 3D Allocations in
+ * NHWC order for one image: channels along X, the pixels of a row along Y
+ * and the rows along Z. The filter is a U8 Allocation with the input
+ * channels along X and the kernel columns along Y, the kernel rows of each
+ * output channel following one another along Z.
+ *
+ * Each output is the sum of (in - inputOffset) * (filter - filterOffset)
+ * over the kernel, plus the bias, requantized to U8 as
+ * outputOffset + sum * multiplier / 2^31 / 2^shift and clamped, or left
+ * as is for I32 outputs. Padding reads as the input offset.
+ */
+class ScriptIntrinsicConvolveQ8 : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicConvolveQ8(sp<RS> rs, sp<const Element> e);
+    // Offsets, multiplier and shift, sent together.
+    int32_t mQuant[5];
+ public:
+    /**
+     * Supported output elements are U8, requantized, and I32.
+     * @param[in] rs RenderScript context
+     * @param[in] e Element of the output
+     * @return new ScriptIntrinsicConvolveQ8
+     */
+    static sp<ScriptIntrinsicConvolveQ8> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Sets the zero points of the input, filter and output. All default
+     * to 0.
+     * @param[in] inputOffset input offset, 0 to 255
+     * @param[in] filterOffset filter offset, 0 to 255
+     * @param[in] outputOffset output offset, 0 to 255
+     */
+    void setOffsets(int32_t inputOffset, int32_t filterOffset, int32_t outputOffset);
+    /**
+     * Sets the scale of U8 outputs, multiplier / 2^31 / 2^shift. The
+     * default is a scale of 1.
+     * @param[in] multiplier multiplier, at least 2^30 for full precision
+     * @param[in] shift right shift, 0 to 31
+     */
+    void setRequantize(int32_t multiplier, int32_t shift);
+    /**
+     * Sets the step between the windows of neighbouring outputs and the
+     * padding on each side of the input, which must be less than the
+     * kernel. The defaults are steps of 1 without padding.
+     * @param[in] strideX step along a row
+     * @param[in] strideY step between rows
+     * @param[in] padX padding left and right
+     * @param[in] padY padding above and below
+     */
+    void setGeometry(uint32_t strideX, uint32_t strideY, uint32_t padX, uint32_t padY);
+    /**
+     * Sets the weights, at most 64 taps per kernel, and an optional I32
+     * bias with one cell per output channel.
+     * @param[in] filter U8 filter Allocation
+     * @param[in] bias I32 bias Allocation, or NULL
+     */
+    void setFilter(sp<Allocation> filter, sp<Allocation> bias);
+    /**
+     * Convolves in into out, whose X is the number of output channels and
+     * whose Y and Z follow from the input size, kernel and geometry.
+     * @param[in] in U8 input Allocation
+     * @param[in] out output Allocation
+     */
+    void forEach(sp<Allocation> in, sp<Allocation> out);
+};
+
+/**
+ * Intrinsic for converting an RGBA image to YUV.
+ */
+class ScriptIntrinsicRGBToYuv : public ScriptIntrinsic {
+ private:
+    ScriptIntrinsicRGBToYuv(sp<RS> rs, sp<const Element> e);
+ public:
+    /**
+     * Create an intrinsic for converting RGB to YUV.
+     *
+     * Supported elements types are U8_4.
+     *
+     * @param[in] rs The RenderScript context
+     * @param[in] e Element type for input
+     *
+     * @return ScriptIntrinsicRGBToYuv
+     */
+    static sp<ScriptIntrinsicRGBToYuv> create(sp<RS> rs, sp<const Element> e);
+    /**
+     * Set the output YUV allocation.  Every plane layout the allocation
+     * describes is written in place, including its plane strides.
+     *
+     * @param[in] out The output allocation.
+     */
+    void setOutput(sp<Allocation> out);
+
+    /**
+     * Convert the image to YUV.  Chroma is the average of each 2x2 block.
+     *
+     * @param[in] ain Input allocation. Must match creation element
+     *                type.
+     */
+    void forEach(sp<Allocation> in);
+
 };
 
 /**
@@ -42,6 +42,7 @@ typedef RsAllocation (*AllocationCubeCreateFromBitmapFnPtr) (RsContext, RsType,
 typedef RsNativeWindow (*AllocationGetSurfaceFnPtr) (RsContext, RsAllocation);
 typedef void (*AllocationSetSurfaceFnPtr) (RsContext, RsAllocation, RsNativeWindow);
 typedef void (*ContextFinishFnPtr) (RsContext);
+typedef void (*ContextFlushFnPtr) (RsContext);
 typedef void (*ContextDumpFnPtr) (RsContext, int32_t);
 typedef void (*ContextSetPriorityFnPtr) (RsContext, int32_t);
 typedef void (*AssignNameFnPtr) (RsContext, RsObjectBase, const char*, size_t);
@@ -51,6 +52,7 @@ typedef RsElement (*ElementCreate2FnPtr) (RsContext, const RsElement*, size_t, c
 typedef void (*AllocationCopyToBitmapFnPtr) (RsContext, RsAllocation, void*, size_t);
 typedef void (*Allocation1DDataFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, const void*, size_t);
 typedef void (*Allocation1DElementDataFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, const void*, size_t, size_t);
+typedef void (*AllocationElementDataBatchFnPtr) (RsContext, RsAllocation, const void*, size_t);
 typedef void (*Allocation2DDataFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, RsAllocationCubemapFace, uint32_t, uint32_t, const void*, size_t, size_t);
 typedef void (*Allocation3DDataFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, const void*, size_t, size_t);
 typedef void (*AllocationGenerateMipmapsFnPtr) (RsContext, RsAllocation);
@@ -59,20 +61,25 @@ typedef void (*Allocation1DReadFnPtr) (RsContext, RsAllocation, uint32_t, uint32
 typedef void (*Allocation2DReadFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, RsAllocationCubemapFace, uint32_t, uint32_t, void*, size_t, size_t);
 typedef void (*AllocationSyncAllFnPtr) (RsContext, RsAllocation, RsAllocationUsageType);
 typedef void (*AllocationResize1DFnPtr) (RsContext, RsAllocation, uint32_t);
+typedef void (*AllocationReserve1DFnPtr) (RsContext, RsAllocation, uint32_t);
 typedef void (*AllocationCopy2DRangeFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, RsAllocation, uint32_t, uint32_t, uint32_t, uint32_t);
 typedef void (*AllocationCopy3DRangeFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, RsAllocation, uint32_t, uint32_t, uint32_t, uint32_t);
+typedef void (*AllocationCopyConvertFnPtr) (RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, RsAllocation, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, RsAllocationConversion);
 typedef RsSampler (*SamplerCreateFnPtr) (RsContext, RsSamplerValue, RsSamplerValue, RsSamplerValue, RsSamplerValue, RsSamplerValue, float);
 typedef void (*ScriptBindAllocationFnPtr) (RsContext, RsScript, RsAllocation, uint32_t);
 typedef void (*ScriptSetTimeZoneFnPtr) (RsContext, RsScript, const char*, size_t);
 typedef void (*ScriptInvokeFnPtr) (RsContext, RsScript, uint32_t);
 typedef void (*ScriptInvokeVFnPtr) (RsContext, RsScript, uint32_t, const void*, size_t);
 typedef void (*ScriptForEachFnPtr) (RsContext, RsScript, uint32_t, RsAllocation, RsAllocation, const void*, size_t, const RsScriptCall*, size_t);
+typedef void (*ScriptForEachMultiFnPtr) (RsContext, RsScript, uint32_t, RsAllocation*, size_t, RsAllocation, const void*, size_t, const RsScriptCall*, size_t);
+typedef void (*ScriptReduceFnPtr) (RsContext, RsScript, uint32_t, uint32_t, int32_t, RsAllocation, RsAllocation, const RsScriptCall*, size_t);
 typedef void (*ScriptSetVarIFnPtr) (RsContext, RsScript, uint32_t, int);
 typedef void (*ScriptSetVarObjFnPtr) (RsContext, RsScript, uint32_t, RsObjectBase);
 typedef void (*ScriptSetVarJFnPtr) (RsContext, RsScript, uint32_t, int64_t);
 typedef void (*ScriptSetVarFFnPtr) (RsContext, RsScript, uint32_t, float);
 typedef void (*ScriptSetVarDFnPtr) (RsContext, RsScript, uint32_t, double);
 typedef void (*ScriptSetVarVFnPtr) (RsContext, RsScript, uint32_t, const void*, size_t);
+typedef void (*ScriptSetVarsFnPtr) (RsContext, RsScript, const void*, size_t);
 typedef void (*ScriptGetVarVFnPtr) (RsContext, RsScript, uint32_t, void*, size_t);
 typedef void (*ScriptSetVarVEFnPtr) (RsContext, RsScript, uint32_t, const void*, size_t, RsElement, const size_t*, size_t);
 typedef RsScript (*ScriptCCreateFnPtr) (RsContext, const char*, size_t, const char*, size_t, const char*, size_t);
@@ -85,6 +92,29 @@ typedef void (*ScriptGroupSetInputFnPtr) (RsContext, RsScriptGroup, RsScriptKern
 typedef void (*ScriptGroupExecuteFnPtr) (RsContext, RsScriptGroup);
 typedef void (*AllocationIoSendFnPtr) (RsContext, RsAllocation);
 typedef void (*AllocationIoReceiveFnPtr) (RsContext, RsAllocation);
+typedef void (*AllocationSetIoInputQueueFnPtr) (RsContext, RsAllocation, uint32_t, bool);
+typedef void (*ContextFenceFnPtr) (RsContext, uint32_t);
+typedef void (*Allocation1DReadAsyncFnPtr)(RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, uintptr_t, size_t);
+typedef RsAllocation (*AllocationAdapterCreateFnPtr) (RsContext, RsType, RsAllocation);
+typedef void (*AllocationAdapterOffsetFnPtr) (RsContext, RsAllocation, const uint32_t *, size_t);
+typedef int32_t (*AllocationExportFnPtr) (RsContext, RsAllocation);
+typedef RsAllocation (*AllocationImportFnPtr) (RsContext, RsType, uint32_t, int32_t);
+typedef void * (*AllocationGetPointerFnPtr) (RsContext, RsAllocation, uint32_t, RsAllocationCubemapFace, uint32_t, size_t *, size_t);
+typedef void (*AllocationSortFnPtr) (RsContext, RsAllocation, RsAllocation);
+typedef uint32_t (*AllocationCompactFnPtr) (RsContext, RsAllocation, RsAllocation, RsAllocation);
+typedef uint32_t (*ContextGetMemoryUsageFnPtr) (RsContext, RsMemoryUsage *, size_t);
+typedef void (*ScriptInvokeBatchFnPtr) (RsContext, RsScript, uint32_t, RsAllocation);
+typedef uint64_t (*ContextTrimMemoryFnPtr) (RsContext, int32_t);
+typedef void (*ScriptForEachRegionsFnPtr) (RsContext, RsScript, uint32_t, RsAllocation, RsAllocation, const void*, size_t, const RsScriptCall*, size_t, const RsScriptRect*, size_t);
+typedef RsCommandBuffer (*CommandBufferCreateFnPtr) (RsContext);
+typedef void (*CommandBufferBeginFnPtr) (RsContext, RsCommandBuffer);
+typedef void (*CommandBufferMarkParamFnPtr) (RsContext, RsCommandBuffer);
+typedef void (*CommandBufferEndFnPtr) (RsContext, RsCommandBuffer);
+typedef void (*CommandBufferSubmitFnPtr) (RsContext, RsCommandBuffer, const void *, size_t);
+typedef void (*ScriptGroupSetPipelinedFnPtr) (RsContext, RsScriptGroup, bool);
+typedef void (*Allocation2DReadAsyncFnPtr)(RsContext, RsAllocation, uint32_t, uint32_t, uint32_t, RsAllocationCubemapFace, uint32_t, uint32_t, uintptr_t, size_t, size_t);
+
+typedef bool (*GetDispatchTableFnPtr) (void *table, size_t tableSize);
 
 typedef struct {
     // inserted by hand from rs.h
@@ -113,6 +143,7 @@ typedef struct {
     AllocationGetSurfaceFnPtr AllocationGetSurface;
     AllocationSetSurfaceFnPtr AllocationSetSurface;
     ContextFinishFnPtr ContextFinish;
+    ContextFlushFnPtr ContextFlush;
     ContextDumpFnPtr ContextDump;
     ContextSetPriorityFnPtr ContextSetPriority;
     AssignNameFnPtr AssignName;
@@ -122,6 +153,7 @@ typedef struct {
     AllocationCopyToBitmapFnPtr AllocationCopyToBitmap;
     Allocation1DDataFnPtr Allocation1DData;
     Allocation1DElementDataFnPtr Allocation1DElementData;
+    AllocationElementDataBatchFnPtr AllocationElementDataBatch;
     Allocation2DDataFnPtr Allocation2DData;
     Allocation3DDataFnPtr Allocation3DData;
     AllocationGenerateMipmapsFnPtr AllocationGenerateMipmaps;
@@ -130,20 +162,25 @@ typedef struct {
     Allocation2DReadFnPtr Allocation2DRead;
     AllocationSyncAllFnPtr AllocationSyncAll;
     AllocationResize1DFnPtr AllocationResize1D;
+    AllocationReserve1DFnPtr AllocationReserve1D;
     AllocationCopy2DRangeFnPtr AllocationCopy2DRange;
     AllocationCopy3DRangeFnPtr AllocationCopy3DRange;
+    AllocationCopyConvertFnPtr AllocationCopyConvert;
     SamplerCreateFnPtr SamplerCreate;
     ScriptBindAllocationFnPtr ScriptBindAllocation;
     ScriptSetTimeZoneFnPtr ScriptSetTimeZone;
     ScriptInvokeFnPtr ScriptInvoke;
     ScriptInvokeVFnPtr ScriptInvokeV;
     ScriptForEachFnPtr ScriptForEach;
+    ScriptForEachMultiFnPtr ScriptForEachMulti;
+    ScriptReduceFnPtr ScriptReduce;
     ScriptSetVarIFnPtr ScriptSetVarI;
     ScriptSetVarObjFnPtr ScriptSetVarObj;
     ScriptSetVarJFnPtr ScriptSetVarJ;
     ScriptSetVarFFnPtr ScriptSetVarF;
     ScriptSetVarDFnPtr ScriptSetVarD;
     ScriptSetVarVFnPtr ScriptSetVarV;
+    ScriptSetVarsFnPtr ScriptSetVars;
     ScriptGetVarVFnPtr ScriptGetVarV;
     ScriptSetVarVEFnPtr ScriptSetVarVE;
     ScriptCCreateFnPtr ScriptCCreate;
@@ -156,6 +193,27 @@ typedef struct {
     ScriptGroupExecuteFnPtr ScriptGroupExecute;
     AllocationIoSendFnPtr AllocationIoSend;
     AllocationIoReceiveFnPtr AllocationIoReceive;
+    AllocationSetIoInputQueueFnPtr AllocationSetIoInputQueue;
+    ContextFenceFnPtr ContextFence;
+    Allocation1DReadAsyncFnPtr Allocation1DReadAsync;
+    Allocation2DReadAsyncFnPtr Allocation2DReadAsync;
+    AllocationAdapterCreateFnPtr AllocationAdapterCreate;
+    AllocationAdapterOffsetFnPtr AllocationAdapterOffset;
+    AllocationExportFnPtr AllocationExport;
+    AllocationImportFnPtr AllocationImport;
+    AllocationGetPointerFnPtr AllocationGetPointer;
+    AllocationSortFnPtr AllocationSort;
+    AllocationCompactFnPtr AllocationCompact;
+    ContextGetMemoryUsageFnPtr ContextGetMemoryUsage;
+    ScriptForEachRegionsFnPtr ScriptForEachRegions;
+    ScriptInvokeBatchFnPtr ScriptInvokeBatch;
+    ContextTrimMemoryFnPtr ContextTrimMemory;
+    CommandBufferCreateFnPtr CommandBufferCreate;
+    CommandBufferBeginFnPtr CommandBufferBegin;
+    CommandBufferMarkParamFnPtr CommandBufferMarkParam;
+    CommandBufferEndFnPtr CommandBufferEnd;
+    CommandBufferSubmitFnPtr CommandBufferSubmit;
+    ScriptGroupSetPipelinedFnPtr ScriptGroupSetPipelined;
 } dispatchTable;
 
 #endif
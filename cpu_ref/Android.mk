@@ -20,16 +20,35 @@ LOCAL_SRC_FILES:= \
 	rsCpuRuntimeMath.cpp \
 	rsCpuRuntimeStubs.cpp \
 	rsCpuScriptGroup.cpp \
+	rsCpuSort.cpp \
 	rsCpuIntrinsic.cpp \
 	rsCpuIntrinsic3DLUT.cpp \
+	rsCpuIntrinsicBilateral.cpp \
 	rsCpuIntrinsicBlend.cpp \
 	rsCpuIntrinsicBlur.cpp \
 	rsCpuIntrinsicColorMatrix.cpp \
+	rsCpuIntrinsicConvert.cpp \
+	rsCpuIntrinsicPyramid.cpp \
+	rsCpuIntrinsicRotate.cpp \
+	rsCpuIntrinsicWarp.cpp \
+	rsCpuIntrinsicConvolve.cpp \
 	rsCpuIntrinsicConvolve3x3.cpp \
 	rsCpuIntrinsicConvolve5x5.cpp \
+	rsCpuIntrinsicConvolveQ8.cpp \
+	rsCpuIntrinsicDemosaic.cpp \
+	rsCpuIntrinsicETC1.cpp \
+	rsCpuIntrinsicGemm.cpp \
 	rsCpuIntrinsicHistogram.cpp \
+	rsCpuIntrinsicIntegral.cpp \
 	rsCpuIntrinsicLUT.cpp \
-	rsCpuIntrinsicYuvToRGB.cpp
+	rsCpuIntrinsicMedian.cpp \
+	rsCpuIntrinsicMorphology.cpp \
+	rsCpuIntrinsicResize.cpp \
+	rsCpuIntrinsicRGBToYuv.cpp \
+	rsCpuIntrinsicScan.cpp \
+	rsCpuIntrinsicYuvToRGB.cpp \
+	rsCpuIntrinsicTuning.cpp \
+	rsCpuPerfBoost.cpp
 
 ifeq ($(ARCH_ARM_HAVE_NEON),true)
     LOCAL_CFLAGS += -DARCH_ARM_HAVE_NEON
@@ -43,7 +62,20 @@ ifeq ($(ARCH_ARM_HAVE_VFP),true)
     LOCAL_ASFLAGS := -mfpu=neon
 endif
 
-LOCAL_SHARED_LIBRARIES += libRS libcutils libutils liblog libsync
+ifeq ($(TARGET_ARCH),arm64)
+    LOCAL_CFLAGS += -DARCH_ARM64_HAVE_NEON
+    LOCAL_SRC_FILES+= \
+        rsCpuIntrinsics_advsimd.S \
+        rsCpuIntrinsics_advsimd_ColorMatrix.S
+endif
+
+ifeq ($(ARCH_X86_HAVE_SSSE3),true)
+    LOCAL_CFLAGS += -DARCH_X86_HAVE_SSSE3 -mssse3
+    LOCAL_SRC_FILES+= \
+        rsCpuIntrinsics_x86.cpp
+endif
+
+LOCAL_SHARED_LIBRARIES += libRS libcutils libutils liblog libsync libhardware
 LOCAL_SHARED_LIBRARIES += libbcc libbcinfo
 
 LOCAL_C_INCLUDES += frameworks/compile/libbcc/include
@@ -28,6 +28,12 @@
 #include <llvm/ADT/OwningPtr.h>
 #include <llvm/Support/ELF.h>
 
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
 static inline RSExecRef wrap(ELFObject<32> *object) {
   return reinterpret_cast<RSExecRef>(object);
 }
@@ -36,6 +42,19 @@ static inline ELFObject<32> *unwrap(RSExecRef object) {
   return reinterpret_cast<ELFObject<32> *>(object);
 }
 
+static RSExecRef loadExecutable(unsigned char const *buf, size_t buf_size,
+                                bool packed) {
+  ArchiveReaderLE AR(buf, buf_size);
+
+  llvm::OwningPtr<ELFObject<32> > object(ELFObject<32>::read(AR, packed));
+  if (!object) {
+    ALOGE("Unable to load the ELF object.");
+    return NULL;
+  }
+
+  return wrap(object.take());
+}
+
 extern "C" RSExecRef rsloaderCreateExec(unsigned char const *buf,
                                         size_t buf_size,
                                         RSFindSymbolFn find_symbol,
@@ -53,17 +72,66 @@ extern "C" RSExecRef rsloaderCreateExec(unsigned char const *buf,
   return object;
 }
 
-extern "C" RSExecRef rsloaderLoadExecutable(unsigned char const *buf,
-                                            size_t buf_size) {
-  ArchiveReaderLE AR(buf, buf_size);
+static uint32_t hashInput(unsigned char const *buf, size_t buf_size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < buf_size; ++i) {
+    hash = (hash ^ buf[i]) * 16777619u;
+  }
+  return hash ^ (uint32_t)buf_size;
+}
 
-  llvm::OwningPtr<ELFObject<32> > object(ELFObject<32>::read(AR));
+extern "C" RSExecRef rsloaderCreateExecCached(unsigned char const *buf,
+                                              size_t buf_size,
+                                              RSFindSymbolFn find_symbol,
+                                              void *find_symbol_context,
+                                              char const *image_path) {
+  // Images are mapped a section at a time, so each needs its own pages.
+  RSExecRef object = loadExecutable(buf, buf_size, false);
   if (!object) {
-    ALOGE("Unable to load the ELF object.");
     return NULL;
   }
 
-  return wrap(object.take());
+  uint32_t hash = hashInput(buf, buf_size);
+  int fd = open(image_path, O_RDONLY);
+  if (fd >= 0) {
+    bool loaded = unwrap(object)->loadImage(fd, hash, find_symbol,
+                                            find_symbol_context);
+    close(fd);
+    if (loaded) {
+      return object;
+    }
+  }
+
+  if (!rsloaderRelocateExecutable(object, find_symbol, find_symbol_context)) {
+    rsloaderDisposeExec(object);
+    return NULL;
+  }
+
+  // Write a new image next to the old one and swap it in, so other
+  // processes mapping the old one are unaffected.
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+  std::string tmp_path(image_path);
+  tmp_path.append(suffix);
+  fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd >= 0) {
+    bool saved = unwrap(object)->saveImage(fd, hash);
+    close(fd);
+    if (saved && rename(tmp_path.c_str(), image_path) != 0) {
+      ALOGW("Unable to save the relocated image to %s", image_path);
+      saved = false;
+    }
+    if (!saved) {
+      unlink(tmp_path.c_str());
+    }
+  }
+
+  return object;
+}
+
+extern "C" RSExecRef rsloaderLoadExecutable(unsigned char const *buf,
+                                            size_t buf_size) {
+  return loadExecutable(buf, buf_size, true);
 }
 
 extern "C" int rsloaderRelocateExecutable(RSExecRef object_,
@@ -32,6 +32,15 @@ RSExecRef rsloaderCreateExec(unsigned char const *buf,
                              RSFindSymbolFn find_symbol,
                              void *find_symbol_context);
 
+/* Like rsloaderCreateExec, but keeps the relocated image in image_path.
+ * When the image matches buf and can be mapped back at the addresses it
+ * was relocated for, later loads use it instead of relocating. */
+RSExecRef rsloaderCreateExecCached(unsigned char const *buf,
+                                   size_t buf_size,
+                                   RSFindSymbolFn find_symbol,
+                                   void *find_symbol_context,
+                                   char const *image_path);
+
 RSExecRef rsloaderLoadExecutable(unsigned char const *buf,
                                  size_t buf_size);
 
@@ -18,6 +18,7 @@
 #define ELF_OBJECT_H
 
 #include "ELFTypes.h"
+#include "MemArena.h"
 #include "MemChunk.h"
 
 #include "utils/rsl_assert.h"
@@ -41,12 +42,22 @@ private:
   unsigned char *SHNCommonDataPtr;
   size_t SHNCommonDataFreeSize;
 
+  // With packed sections, code and read-only data share one run of pages
+  // from the code arena, protected in one go after relocation, and
+  // writable sections come from the data arena.
+  bool packed;
+  MemChunk CodeSpan;
+  size_t CodeSpanUsed;
+
   bool missingSymbols;
 
   // TODO: Need refactor!
   bool initSHNCommonDataSize(size_t SHNCommonDataSize) {
     rsl_assert(!SHNCommonDataPtr && "Can't init twice.");
-    if (!SHNCommonData.allocate(SHNCommonDataSize)) {
+    bool allocated = packed ?
+      SHNCommonData.allocate(MemArena::getData(), SHNCommonDataSize, 16) :
+      SHNCommonData.allocate(SHNCommonDataSize);
+    if (!allocated) {
       return false;
     }
 
@@ -56,11 +67,17 @@ private:
   }
 
 private:
-  ELFObject() : SHNCommonDataPtr(NULL), missingSymbols(false) { }
+  ELFObject() : SHNCommonDataPtr(NULL), packed(false), CodeSpanUsed(0),
+                missingSymbols(false) { }
+
+  static bool isCodeSection(ELFSectionHeaderTy const *sh);
 
 public:
+  // Sections are packed into the shared arenas unless packed is false or
+  // a vendor allocator is registered.  Images can only be saved and
+  // loaded for objects that aren't packed.
   template <typename Archiver>
-  static ELFObject *read(Archiver &AR);
+  static ELFObject *read(Archiver &AR, bool packed = true);
 
   ELFHeaderTy const *getHeader() const {
     return header.get();
@@ -80,6 +97,10 @@ public:
     return missingSymbols;
   }
 
+  // Gets the memory for section sh, size bytes of which are used.
+  bool allocateSection(MemChunk &chunk, ELFSectionHeaderTy const *sh,
+                       size_t size);
+
   void *allocateSHNCommonData(size_t size, size_t align = 1) {
     rsl_assert(size > 0 && align != 0);
 
@@ -108,6 +129,18 @@ public:
   void relocate(void *(*find_sym)(void *context, char const *name),
                 void *context);
 
+  // Saves the relocated sections to fd, laid out so loadImage can map them
+  // back in.  input_hash identifies the object the image was made from.
+  bool saveImage(int fd, uint32_t input_hash);
+
+  // Maps an image saved by saveImage over the sections instead of
+  // relocating them.  That only works if every section can go back at the
+  // address it was relocated for and no external symbol has moved; when
+  // it returns false nothing has changed and relocate() is still needed.
+  bool loadImage(int fd, uint32_t input_hash,
+                 void *(*find_sym)(void *context, char const *name),
+                 void *context);
+
   void print() const;
 
   ~ELFObject() {
@@ -118,6 +151,26 @@ public:
   }
 
 private:
+  struct ImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t inputHash;
+    uint32_t machine;
+    uint32_t chunkCount;
+    uint32_t symbolCount;
+    uint32_t commonUsed;
+  };
+
+  // A section's memory in the image.  Index stab.size() is the common data.
+  struct ImageChunk {
+    uint32_t index;
+    uint32_t size;
+    uint64_t addr;
+    uint64_t offset;
+  };
+
+  MemChunk *getImageChunk(size_t index);
+
   void relocateARM(void *(*find_sym)(void *context, char const *name),
                    void *context,
                    ELFSectionRelTableTy *reltab,
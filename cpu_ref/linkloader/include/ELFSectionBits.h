@@ -57,6 +57,10 @@ public:
     return chunk.size();
   }
 
+  MemChunk &getChunk() {
+    return chunk;
+  }
+
 };
 
 #include "impl/ELFSectionBits.hxx"
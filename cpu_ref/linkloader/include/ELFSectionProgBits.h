@@ -37,6 +37,10 @@ public:
                                   ELFObjectTy *owner,
                                   ELFSectionHeaderTy const *sh);
 
+  // Bytes read() allocates for sh, the section and its stub table.
+  static size_t calcAllocSize(ELFObjectTy *owner,
+                              ELFSectionHeaderTy const *sh);
+
   StubLayout *getStubLayout() {
     return stubs;
   }
@@ -62,6 +66,9 @@ public:
   }
 
 private:
+  static size_t getMaxNumStubs(ELFObjectTy *owner,
+                               ELFSectionHeaderTy const *sh);
+
   template <typename Archiver>
   bool serialize(Archiver &AR) {
     ELFSectionHeaderTy const *sh = this->sh;
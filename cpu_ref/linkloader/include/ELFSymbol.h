@@ -117,6 +117,11 @@ public:
     my_addr = addr;
   }
 
+  // The address if it has been computed or resolved already, else NULL.
+  void *getResolvedAddress() const {
+    return my_addr;
+  }
+
   bool isValid() const {
     // FIXME: Should check the correctness of the section header.
     return true;
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEM_ARENA_H
+#define MEM_ARENA_H
+
+#include <llvm/Support/Mutex.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Process wide memory the sections of every loaded object are packed
+// into, so scripts don't each cost a mapping per section.  Memory is
+// handed out from large regions front to back and a region is unmapped
+// once everything in it has been released.
+class MemArena {
+private:
+  struct Region {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    size_t live;
+  };
+
+  llvm::sys::Mutex lock;
+  std::vector<Region> regions;
+  bool pageGranular;
+
+  MemArena(bool pageGranular);
+
+  bool addRegion(size_t size);
+
+public:
+  // Where code goes.  Allocations take whole pages, since each object
+  // protects its own once it has been relocated.
+  static MemArena *getCode();
+
+  // Where writable data goes.  It stays read-write, so allocations are
+  // packed next to each other.
+  static MemArena *getData();
+
+  unsigned char *allocate(size_t size, size_t align);
+  void release(unsigned char *buf, size_t size);
+
+  // Allocations may share pages, so can't be protected on their own.
+  bool sharesPages() const {
+    return !pageGranular;
+  }
+};
+
+#endif // MEM_ARENA_H
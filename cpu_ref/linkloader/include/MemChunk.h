@@ -20,6 +20,9 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
+
+class MemArena;
 
 typedef void *(*AllocFunc) (size_t, uint32_t);
 typedef void (*FreeFunc) (void *);
@@ -29,11 +32,14 @@ private:
   unsigned char *buf;
   size_t buf_size;
   bool bVendorBuf;
+  MemArena *arena;
+  bool bBorrowed;
 
   static AllocFunc VendorAlloc;
   static FreeFunc VendorFree;
 
   bool invalidBuf() const;
+  void release();
 
 public:
   MemChunk();
@@ -42,8 +48,23 @@ public:
 
   bool allocate(size_t size);
 
+  // Takes size bytes from arena instead of mapping pages of our own.
+  bool allocate(MemArena *arena, size_t size, size_t align);
+
+  // Uses size bytes of memory owned by someone else, who outlives us.
+  void borrow(unsigned char *buf, size_t size);
+
+  // Replaces the buffer with size bytes of fd from offset, mapped
+  // copy-on-write at exactly addr.  Fails and keeps the old buffer if addr
+  // is taken.
+  bool mapAt(void *addr, size_t size, int fd, off_t offset);
+
+  void swap(MemChunk &other);
+
   void print() const;
 
+  // Does nothing for memory sharing its pages, whoever owns those
+  // protects them.
   bool protect(int prot);
 
   unsigned char const *getBuffer() const {
@@ -72,6 +93,10 @@ public:
     VendorAlloc = a;
     VendorFree = f;
   }
+
+  static bool hasVendorAlloc() {
+    return VendorAlloc != NULL;
+  }
 };
 
 #endif // MEM_CHUNK_H
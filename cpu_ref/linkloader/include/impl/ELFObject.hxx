@@ -25,15 +25,29 @@
 #include "GOT.h"
 #include "ELF.h"
 
+#include <llvm/ADT/OwningPtr.h>
 #include <llvm/ADT/SmallVector.h>
 
+#ifndef USE_MINGW       /* TODO create a proper HAVE_MMAN_H */
+#include <sys/mman.h>
+#else
+#include "mmanWindows.h"
+#endif
+
+#include <algorithm>
+
+#include "utils/helper.h"
 #include "utils/rsl_assert.h"
 
+#define ELF_IMAGE_MAGIC 0x494c5352  // "RSLI"
+#define ELF_IMAGE_VERSION 1
+
 template <unsigned Bitwidth>
 template <typename Archiver>
 inline ELFObject<Bitwidth> *
-ELFObject<Bitwidth>::read(Archiver &AR) {
+ELFObject<Bitwidth>::read(Archiver &AR, bool packed) {
   llvm::OwningPtr<ELFObjectTy> object(new ELFObjectTy());
+  object->packed = packed && !MemChunk::hasVendorAlloc();
 
   // Read header
   object->header.reset(ELFHeaderTy::read(AR));
@@ -66,6 +80,24 @@ ELFObject<Bitwidth>::read(Archiver &AR) {
   rsl_assert(symtab && "Symtab is required.");
   symtab->buildNameMap();
 
+  if (object->packed) {
+    // Reserve the pages for all code up front, so each object protects
+    // only its own.
+    size_t code_size = 0;
+    for (size_t i = 0; i < progbits_ndx.size(); ++i) {
+      ELFSectionHeaderTy const *sh = (*object->shtab)[progbits_ndx[i]];
+      if (isCodeSection(sh)) {
+        size_t align = std::max((size_t)sh->getAddressAlign(), (size_t)16);
+        code_size = (code_size + align - 1) / align * align;
+        code_size += ELFSectionProgBitsTy::calcAllocSize(object.get(), sh);
+      }
+    }
+    if (code_size &&
+        !object->CodeSpan.allocate(MemArena::getCode(), code_size, 0)) {
+      return 0;
+    }
+  }
+
   for (size_t i = 0; i < progbits_ndx.size(); ++i) {
     size_t index = progbits_ndx[i];
 
@@ -77,6 +109,36 @@ ELFObject<Bitwidth>::read(Archiver &AR) {
   return object.take();
 }
 
+template <unsigned Bitwidth>
+inline bool
+ELFObject<Bitwidth>::isCodeSection(ELFSectionHeaderTy const *sh) {
+  // Read-only data goes with the code, it's fine with being executable.
+  return sh->getType() == SHT_PROGBITS && !(sh->getFlags() & SHF_WRITE);
+}
+
+template <unsigned Bitwidth>
+inline bool ELFObject<Bitwidth>::allocateSection(MemChunk &chunk,
+                                                 ELFSectionHeaderTy const *sh,
+                                                 size_t size) {
+  // The data arena isn't executable, so writable code keeps its own pages.
+  if (!packed || size == 0 ||
+      ((sh->getFlags() & SHF_EXECINSTR) && (sh->getFlags() & SHF_WRITE))) {
+    return chunk.allocate(size);
+  }
+
+  if (isCodeSection(sh)) {
+    size_t align = std::max((size_t)sh->getAddressAlign(), (size_t)16);
+    size_t offset = (CodeSpanUsed + align - 1) / align * align;
+    rsl_assert(offset + size <= CodeSpan.size() && "Code span too small.");
+    chunk.borrow(CodeSpan.getBuffer() + offset, size);
+    CodeSpanUsed = offset + size;
+    return true;
+  }
+
+  return chunk.allocate(MemArena::getData(), size,
+                        (size_t)sh->getAddressAlign());
+}
+
 template <unsigned Bitwidth>
 inline char const *ELFObject<Bitwidth>::getSectionName(size_t i) const {
   ELFSectionTy const *sec = stab[header->getStringSectionIndex()];
@@ -722,6 +784,195 @@ relocate(void *(*find_sym)(void *context, char const *name), void *context) {
       }
     }
   }
+  // Packed code sections are protected, and the cache flushed, together.
+  CodeSpan.protect(PROT_READ | PROT_EXEC);
+}
+
+template <unsigned Bitwidth>
+inline MemChunk *ELFObject<Bitwidth>::getImageChunk(size_t index) {
+  ELFSectionHeaderTy *sh = (*shtab)[index];
+  if (!stab[index] ||
+      (sh->getType() != SHT_PROGBITS && sh->getType() != SHT_NOBITS)) {
+    return NULL;
+  }
+  MemChunk *chunk = &static_cast<ELFSectionBitsTy *>(stab[index])->getChunk();
+  return chunk->size() ? chunk : NULL;
+}
+
+template <unsigned Bitwidth>
+inline bool ELFObject<Bitwidth>::saveImage(int fd, uint32_t input_hash) {
+  // MIPS relocations point into a GOT that isn't part of the object,
+  // vendor allocators decide where sections go themselves and packed
+  // sections don't have pages of their own to map.
+  if (getHeader()->getMachine() == EM_MIPS || MemChunk::hasVendorAlloc() ||
+      packed) {
+    return false;
+  }
+
+  ELFSectionSymTabTy *symtab =
+    static_cast<ELFSectionSymTabTy *>(getSectionByName(".symtab"));
+  rsl_assert(symtab && "Symtab is required.");
+
+  std::vector<ImageChunk> chunks;
+  for (size_t i = 0; i <= stab.size(); ++i) {
+    MemChunk *chunk = (i < stab.size()) ? getImageChunk(i) : &SHNCommonData;
+    if (!chunk || !chunk->size()) {
+      continue;
+    }
+    ImageChunk c;
+    c.index = i;
+    c.size = chunk->size();
+    c.addr = (uintptr_t)chunk->getBuffer();
+    c.offset = 0;
+    chunks.push_back(c);
+  }
+
+  std::vector<uint64_t> addrs(symtab->size());
+  for (size_t i = 0; i < symtab->size(); ++i) {
+    addrs[i] = (uintptr_t)(*symtab)[i]->getResolvedAddress();
+  }
+
+  // Chunks start on page boundaries so they can be mapped from the file.
+  size_t const page = page_size();
+  size_t offset = sizeof(ImageHeader) + chunks.size() * sizeof(ImageChunk) +
+                  addrs.size() * sizeof(uint64_t);
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    offset = (offset + page - 1) / page * page;
+    chunks[i].offset = offset;
+    offset += chunks[i].size;
+  }
+
+  ImageHeader h;
+  h.magic = ELF_IMAGE_MAGIC;
+  h.version = ELF_IMAGE_VERSION;
+  h.inputHash = input_hash;
+  h.machine = getHeader()->getMachine();
+  h.chunkCount = chunks.size();
+  h.symbolCount = addrs.size();
+  h.commonUsed = SHNCommonDataPtr ? SHNCommonDataPtr - SHNCommonData.getBuffer() : 0;
+
+  offset = 0;
+  if (!write_at(fd, offset, &h, sizeof(h))) {
+    return false;
+  }
+  offset += sizeof(h);
+  if (chunks.size() &&
+      !write_at(fd, offset, &chunks[0], chunks.size() * sizeof(ImageChunk))) {
+    return false;
+  }
+  offset += chunks.size() * sizeof(ImageChunk);
+  if (addrs.size() &&
+      !write_at(fd, offset, &addrs[0], addrs.size() * sizeof(uint64_t))) {
+    return false;
+  }
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    MemChunk *chunk = (chunks[i].index < stab.size()) ?
+                      getImageChunk(chunks[i].index) : &SHNCommonData;
+    if (!write_at(fd, chunks[i].offset, chunk->getBuffer(), chunks[i].size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <unsigned Bitwidth>
+inline bool ELFObject<Bitwidth>::
+loadImage(int fd, uint32_t input_hash,
+          void *(*find_sym)(void *context, char const *name), void *context) {
+  if (getHeader()->getMachine() == EM_MIPS || MemChunk::hasVendorAlloc() ||
+      packed) {
+    return false;
+  }
+
+  ELFSectionSymTabTy *symtab =
+    static_cast<ELFSectionSymTabTy *>(getSectionByName(".symtab"));
+  rsl_assert(symtab && "Symtab is required.");
+
+  ImageHeader h;
+  if (!read_at(fd, 0, &h, sizeof(h)) ||
+      h.magic != ELF_IMAGE_MAGIC || h.version != ELF_IMAGE_VERSION ||
+      h.inputHash != input_hash || h.machine != getHeader()->getMachine() ||
+      h.symbolCount != symtab->size() || h.chunkCount > stab.size() + 1) {
+    return false;
+  }
+
+  std::vector<ImageChunk> chunks(h.chunkCount);
+  std::vector<uint64_t> addrs(h.symbolCount);
+  size_t offset = sizeof(h);
+  if (chunks.size() &&
+      !read_at(fd, offset, &chunks[0], chunks.size() * sizeof(ImageChunk))) {
+    return false;
+  }
+  offset += chunks.size() * sizeof(ImageChunk);
+  if (addrs.size() &&
+      !read_at(fd, offset, &addrs[0], addrs.size() * sizeof(uint64_t))) {
+    return false;
+  }
+
+  // The image has to cover exactly the sections we loaded.
+  size_t sections = 0;
+  for (size_t i = 0; i < stab.size(); ++i) {
+    if (getImageChunk(i)) {
+      sections++;
+    }
+  }
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (chunks[i].index == stab.size()) {
+      continue;
+    }
+    MemChunk *chunk = (chunks[i].index < stab.size()) ?
+                      getImageChunk(chunks[i].index) : NULL;
+    if (!chunk || chunk->size() != chunks[i].size) {
+      return false;
+    }
+    sections--;
+  }
+  if (sections != 0) {
+    return false;
+  }
+
+  // Relocations against external symbols are only still right if they
+  // resolve to the same place.
+  for (size_t i = 0; i < symtab->size(); ++i) {
+    ELFSymbolTy *sym = (*symtab)[i];
+    if (sym->getSectionIndex() == SHN_UNDEF && sym->getType() == STT_NOTYPE &&
+        addrs[i] != 0 &&
+        (uintptr_t)find_sym(context, sym->getName()) != addrs[i]) {
+      return false;
+    }
+  }
+
+  // Map everything before touching the sections, so a failure leaves the
+  // object as it was.
+  llvm::OwningArrayPtr<MemChunk> mapped(new MemChunk[chunks.size()]);
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (!mapped[i].mapAt((void *)(uintptr_t)chunks[i].addr, chunks[i].size,
+                         fd, (off_t)chunks[i].offset)) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (chunks[i].index == stab.size()) {
+      rsl_assert(!SHNCommonDataPtr && "Can't init twice.");
+      SHNCommonData.swap(mapped[i]);
+      SHNCommonDataPtr = SHNCommonData.getBuffer() + h.commonUsed;
+      SHNCommonDataFreeSize = SHNCommonData.size() - h.commonUsed;
+    } else {
+      getImageChunk(chunks[i].index)->swap(mapped[i]);
+    }
+  }
+  // Addresses worked out while reading refer to the old buffers.
+  for (size_t i = 0; i < symtab->size(); ++i) {
+    (*symtab)[i]->setAddress((void *)(uintptr_t)addrs[i]);
+  }
+
+  for (size_t i = 0; i < stab.size(); ++i) {
+    if (getImageChunk(i)) {
+      static_cast<ELFSectionBitsTy *>(stab[i])->protect();
+    }
+  }
+  return true;
 }
 
 template <unsigned Bitwidth>
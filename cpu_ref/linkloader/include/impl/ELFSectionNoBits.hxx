@@ -27,10 +27,12 @@
 template <unsigned Bitwidth>
 template <typename Archiver>
 inline ELFSectionNoBits<Bitwidth> *
-ELFSectionNoBits<Bitwidth>::read(Archiver &AR, ELFSectionHeaderTy const *sh) {
+ELFSectionNoBits<Bitwidth>::read(Archiver &AR,
+                                 ELFObjectTy *owner,
+                                 ELFSectionHeaderTy const *sh) {
   llvm::OwningPtr<ELFSectionNoBits> result(new ELFSectionNoBits());
 
-  if (!result->chunk.allocate(sh->getSize())) {
+  if (!owner->allocateSection(result->chunk, sh, sh->getSize())) {
     return NULL;
   }
 
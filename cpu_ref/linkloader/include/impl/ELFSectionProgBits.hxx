@@ -36,34 +36,20 @@ ELFSectionProgBits<Bitwidth>::read(Archiver &AR,
   int machine = owner->getHeader()->getMachine();
   ELFSectionProgBits *secp = new ELFSectionProgBits(machine);
   llvm::OwningPtr<ELFSectionProgBits> result(secp);
-  size_t max_num_stubs = 0;
   // Align section boundary to 4 bytes.
   size_t section_size = (sh->getSize() + 3) / 4 * 4;
   size_t alloc_size = section_size;
+  size_t max_num_stubs = 0;
   StubLayout *stubs = result->getStubLayout();
   if (stubs) {
-    // Compute the maximal possible numbers of stubs
-    std::string reltab_name(".rel" + std::string(sh->getName()));
-
-    ELFSectionRelTableTy const *reltab =
-      static_cast<ELFSectionRelTableTy *>(
-        owner->getSectionByName(reltab_name.c_str()));
-
-    if (reltab) {
-      // If we have relocation table, then get the approximation of
-      // maximum numbers of stubs.
-      max_num_stubs = reltab->getMaxNumStubs(owner);
-    }
-
-    // Compute the stub table size
-    size_t stub_table_size = stubs->calcStubTableSize(max_num_stubs);
+    max_num_stubs = getMaxNumStubs(owner, sh);
 
     // Allocate PROGBITS section with stubs table
-    alloc_size += stub_table_size;
+    alloc_size += stubs->calcStubTableSize(max_num_stubs);
   }
 
   // Allocate text section
-  if (!result->chunk.allocate(alloc_size)) {
+  if (!owner->allocateSection(result->chunk, sh, alloc_size)) {
     return NULL;
   }
 
@@ -82,4 +68,32 @@ ELFSectionProgBits<Bitwidth>::read(Archiver &AR,
   return result.take();
 }
 
+template <unsigned Bitwidth>
+inline size_t
+ELFSectionProgBits<Bitwidth>::getMaxNumStubs(ELFObjectTy *owner,
+                                             ELFSectionHeaderTy const *sh) {
+  // Compute the maximal possible numbers of stubs
+  std::string reltab_name(".rel" + std::string(sh->getName()));
+
+  ELFSectionRelTableTy const *reltab =
+    static_cast<ELFSectionRelTableTy *>(
+      owner->getSectionByName(reltab_name.c_str()));
+
+  // If we have relocation table, then get the approximation of
+  // maximum numbers of stubs.
+  return reltab ? reltab->getMaxNumStubs(owner) : 0;
+}
+
+template <unsigned Bitwidth>
+inline size_t
+ELFSectionProgBits<Bitwidth>::calcAllocSize(ELFObjectTy *owner,
+                                            ELFSectionHeaderTy const *sh) {
+  ELFSectionProgBits probe(owner->getHeader()->getMachine());
+  size_t alloc_size = (sh->getSize() + 3) / 4 * 4;
+  if (probe.stubs) {
+    alloc_size += probe.stubs->calcStubTableSize(getMaxNumStubs(owner, sh));
+  }
+  return alloc_size;
+}
+
 #endif // ELF_SECTION_PROGBITS_HXX
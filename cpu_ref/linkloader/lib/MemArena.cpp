@@ -0,0 +1,127 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MemArena.h"
+
+#include "utils/helper.h"
+
+#include <llvm/Support/MutexGuard.h>
+
+#ifndef USE_MINGW       /* TODO create a proper HAVE_MMAN_H */
+#include <sys/mman.h>
+#else
+#include "mmanWindows.h"
+#endif
+
+#include <algorithm>
+
+#ifndef MAP_32BIT
+#define MAP_32BIT 0
+// Note: If the <sys/mman.h> does not come with MAP_32BIT, then we
+// define it as zero, so that it won't manipulate the flags.
+#endif
+
+// Untouched pages cost nothing, so regions are made large enough to hold
+// the sections of many scripts.
+static size_t const RegionSize = 1024 * 1024;
+
+static inline size_t alignUp(size_t v, size_t align) {
+  return (v + align - 1) & ~(align - 1);
+}
+
+MemArena::MemArena(bool pageGranular_) : pageGranular(pageGranular_) {
+}
+
+MemArena *MemArena::getCode() {
+  // Never destroyed, objects may still be released during exit.
+  static MemArena *arena = new MemArena(true);
+  return arena;
+}
+
+MemArena *MemArena::getData() {
+  static MemArena *arena = new MemArena(false);
+  return arena;
+}
+
+bool MemArena::addRegion(size_t size) {
+  size = alignUp(std::max(size, RegionSize), page_size());
+  unsigned char *base = (unsigned char *)mmap(0, size,
+                                              PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANON | MAP_32BIT,
+                                              -1, 0);
+  if (base == (unsigned char *)MAP_FAILED) {
+    return false;
+  }
+
+  Region r;
+  r.base = base;
+  r.size = size;
+  r.used = 0;
+  r.live = 0;
+  regions.push_back(r);
+  return true;
+}
+
+unsigned char *MemArena::allocate(size_t size, size_t align) {
+  if (size == 0) {
+    return NULL;
+  }
+  if (pageGranular) {
+    size = alignUp(size, page_size());
+    align = page_size();
+  } else {
+    align = std::max(align, (size_t)16);
+  }
+
+  llvm::MutexGuard guard(lock);
+  // Only the newest region is allocated from; space freed in older ones
+  // comes back when the whole region does.
+  if (regions.empty() ||
+      alignUp(regions.back().used, align) + size > regions.back().size) {
+    if (!addRegion(size)) {
+      return NULL;
+    }
+  }
+
+  Region &r = regions.back();
+  size_t offset = alignUp(r.used, align);
+  r.used = offset + size;
+  r.live += size;
+  return r.base + offset;
+}
+
+void MemArena::release(unsigned char *buf, size_t size) {
+  if (!buf) {
+    return;
+  }
+  if (pageGranular) {
+    size = alignUp(size, page_size());
+  }
+
+  llvm::MutexGuard guard(lock);
+  for (size_t i = 0; i < regions.size(); ++i) {
+    Region &r = regions[i];
+    if (buf < r.base || buf >= r.base + r.size) {
+      continue;
+    }
+    r.live -= size;
+    if (r.live == 0) {
+      munmap(r.base, r.size);
+      regions.erase(regions.begin() + i);
+    }
+    return;
+  }
+}
@@ -15,6 +15,7 @@
  */
 
 #include "MemChunk.h"
+#include "MemArena.h"
 
 #include "utils/flush_cpu_cache.h"
 #include "utils/helper.h"
@@ -29,6 +30,8 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
+
 #ifndef MAP_32BIT
 #define MAP_32BIT 0
 // Note: If the <sys/mman.h> does not come with MAP_32BIT, then we
@@ -44,17 +47,28 @@ static uintptr_t StartAddr = 0x7e000000UL;
 AllocFunc MemChunk::VendorAlloc = NULL;
 FreeFunc MemChunk::VendorFree = NULL;
 
-MemChunk::MemChunk() : buf(NULL), buf_size(0), bVendorBuf(true) {
+MemChunk::MemChunk() : buf(NULL), buf_size(0), bVendorBuf(true), arena(NULL),
+                       bBorrowed(false) {
 }
 
 MemChunk::~MemChunk() {
-  if (!invalidBuf() && bVendorBuf && VendorFree) {
+  release();
+}
+
+void MemChunk::release() {
+  if (bBorrowed) {
+    // Not ours to free.
+  } else if (arena) {
+    arena->release(buf, buf_size);
+  } else if (!invalidBuf() && bVendorBuf && VendorFree) {
     (*VendorFree)(buf);
-    return;
-  }
-  if (!invalidBuf()) {
+  } else if (!invalidBuf()) {
     munmap(buf, buf_size);
   }
+  buf = NULL;
+  buf_size = 0;
+  arena = NULL;
+  bBorrowed = false;
 }
 
 bool MemChunk::invalidBuf() const {
@@ -95,6 +109,56 @@ bool MemChunk::allocate(size_t size) {
   return true;
 }
 
+bool MemChunk::allocate(MemArena *arena_, size_t size, size_t align) {
+  if (size == 0) {
+    return true;
+  }
+  unsigned char *p = arena_->allocate(size, align);
+  if (!p) {
+    return false;
+  }
+
+  release();
+  buf = p;
+  buf_size = size;
+  arena = arena_;
+  return true;
+}
+
+void MemChunk::borrow(unsigned char *buf_, size_t size) {
+  release();
+  buf = buf_;
+  buf_size = size;
+  bBorrowed = true;
+}
+
+bool MemChunk::mapAt(void *addr, size_t size, int fd, off_t offset) {
+  unsigned char *p = (unsigned char *)mmap(addr, size,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE, fd, offset);
+  if (p == (unsigned char *)MAP_FAILED) {
+    return false;
+  }
+  if (p != addr) {
+    munmap(p, size);
+    return false;
+  }
+
+  release();
+  buf = p;
+  buf_size = size;
+  bVendorBuf = false;
+  return true;
+}
+
+void MemChunk::swap(MemChunk &other) {
+  std::swap(buf, other.buf);
+  std::swap(buf_size, other.buf_size);
+  std::swap(bVendorBuf, other.bVendorBuf);
+  std::swap(arena, other.arena);
+  std::swap(bBorrowed, other.bBorrowed);
+}
+
 void MemChunk::print() const {
   if (!invalidBuf()) {
     dump_hex(buf, buf_size, 0, buf_size);
@@ -102,6 +166,10 @@ void MemChunk::print() const {
 }
 
 bool MemChunk::protect(int prot) {
+  if (bBorrowed || (arena && arena->sharesPages())) {
+    return true;
+  }
+
   if (buf_size > 0) {
     int ret = mprotect((void *)buf, buf_size, prot);
     if (ret == -1) {
@@ -19,6 +19,8 @@
 
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
 
 using namespace llvm;
 
@@ -67,3 +69,49 @@ void dump_hex(unsigned char const *data,
     out() << '\n';
   }
 }
+
+size_t page_size() {
+#ifndef USE_MINGW
+  return (size_t)sysconf(_SC_PAGESIZE);
+#else
+  return 4096;
+#endif
+}
+
+bool read_at(int fd, size_t offset, void *data, size_t size) {
+  if (lseek(fd, (off_t)offset, SEEK_SET) == (off_t)-1) {
+    return false;
+  }
+  unsigned char *p = (unsigned char *)data;
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool write_at(int fd, size_t offset, void const *data, size_t size) {
+  if (lseek(fd, (off_t)offset, SEEK_SET) == (off_t)-1) {
+    return false;
+  }
+  unsigned char const *p = (unsigned char const *)data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
@@ -22,4 +22,10 @@
 extern void dump_hex(unsigned char const *data,
                      size_t size, size_t begin, size_t end);
 
+extern size_t page_size();
+
+// Read or write exactly size bytes at offset in fd.
+extern bool read_at(int fd, size_t offset, void *data, size_t size);
+extern bool write_at(int fd, size_t offset, void const *data, size_t size);
+
 #endif // HELPER_H
@@ -17,11 +17,15 @@
 #include "rsCpuCore.h"
 #include "rsCpuScript.h"
 #include "rsCpuScriptGroup.h"
+#include "rsCpuIntrinsicTuning.h"
+#include "rsCpuPerfBoost.h"
 
 #include <malloc.h>
+#include <new>
 #include "rsContext.h"
 
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sched.h>
 #include <sys/syscall.h>
@@ -31,6 +35,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <errno.h>
+
+#if defined(ARCH_X86_HAVE_SSSE3)
+#include <cpuid.h>
+#endif
 
 #if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
 #include <cutils/properties.h>
@@ -58,6 +67,7 @@ static uint32_t gThreadTLSKeyCount = 0;
 static pthread_mutex_t gInitMutex = PTHREAD_MUTEX_INITIALIZER;
 
 bool android::renderscript::gArchUseSIMD = false;
+uint32_t android::renderscript::gArchVersion = 0;
 
 RsdCpuReference::~RsdCpuReference() {
 }
@@ -100,6 +110,40 @@ const Script * RsdCpuReference::getTlsScript() {
 
 pthread_key_t RsdCpuReference::getThreadTLSKey(){ return gThreadTLSKey; }
 
+static int compareSymbols(const void *a, const void *b) {
+    return strcmp(((const RsdCpuReference::CpuSymbol *)a)->name,
+                  ((const RsdCpuReference::CpuSymbol *)b)->name);
+}
+
+size_t RsdCpuReference::sortSymbols(CpuSymbol *syms) {
+    size_t count = 0;
+    while (syms[count].fnPtr) {
+        count++;
+    }
+    qsort(syms, count, sizeof(CpuSymbol), compareSymbols);
+    return count;
+}
+
+const RsdCpuReference::CpuSymbol * RsdCpuReference::findSymbol(const CpuSymbol *syms,
+                                                               size_t count,
+                                                               const char *name) {
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = strcmp(syms[mid].name, name);
+        if (!cmp) {
+            return &syms[mid];
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
 ////////////////////////////////////////////////////////////
 ///
 
@@ -108,10 +152,23 @@ RsdCpuReferenceImpl::RsdCpuReferenceImpl(Context *rsc) {
 
     version_major = 0;
     version_minor = 0;
-    mInForEach = false;
-    memset(&mWorkers, 0, sizeof(mWorkers));
-    memset(&mTlsStruct, 0, sizeof(mTlsStruct));
-    mExit = false;
+    mPool = NULL;
+    mWorkerLimit = 1;
+    mPriority = 0;
+    mPrefetchRows = 0;
+    mIntrinsicTuning = new RsdCpuIntrinsicTuning();
+    mPerfBoost = new RsdCpuPerfBoost();
+    memset(mLanes, 0, sizeof(mLanes));
+    for (uint32_t ct = 0; ct < kMaxLanes; ct++) {
+        mLanes[ct].mWaiter = -1;
+    }
+    mLanes[0].mUsed = 1;
+    memset(mAsyncLaunches, 0, sizeof(mAsyncLaunches));
+    mAsyncCount = 0;
+    memset(&mSliceStats, 0, sizeof(mSliceStats));
+    mProfile = NULL;
+    mProfileCount = 0;
+    pthread_mutex_init(&mProfileLock, NULL);
 #ifndef RS_COMPATIBILITY_LIB
     mLinkRuntimeCallback = NULL;
     mSelectRTCallback = NULL;
@@ -120,355 +177,2144 @@ RsdCpuReferenceImpl::RsdCpuReferenceImpl(Context *rsc) {
 }
 
 
-void * RsdCpuReferenceImpl::helperThreadProc(void *vrsc) {
-    RsdCpuReferenceImpl *dc = (RsdCpuReferenceImpl *)vrsc;
+static inline uint64_t getSpinTime() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_nsec + ((uint64_t)t.tv_sec * 1000 * 1000 * 1000);
+}
 
-    uint32_t idx = __sync_fetch_and_add(&dc->mWorkers.mLaunchCount, 1);
+static inline void cpuRelax() {
+#if defined(__arm__) || defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#elif defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+}
 
-    //ALOGV("RS helperThread starting %p idx=%i", dc, idx);
+// Spin for up to spinNs until (*addr == value) matches wantEqual.  Returns
+// true if the condition was met before the spin window ran out.  If wake is
+// given the spin also ends early, returning false, once *wake is non-zero.
+static bool spinWait(volatile int *addr, int value, bool wantEqual, uint64_t spinNs,
+                     volatile int *wake = NULL) {
+    uint64_t end = getSpinTime() + spinNs;
+    while (1) {
+        // Only read the clock every few iterations; it is far more
+        // expensive than the load we are polling.
+        for (int ct = 0; ct < 64; ct++) {
+            if ((*addr == value) == wantEqual) {
+                return true;
+            }
+            if (wake && *wake) {
+                return false;
+            }
+            cpuRelax();
+        }
+        if (getSpinTime() >= end) {
+            return (*addr == value) == wantEqual;
+        }
+    }
+}
 
-    dc->mWorkers.mLaunchSignals[idx].init();
-    dc->mWorkers.mNativeThreadId[idx] = gettid();
+////////////////////////////////////////////////////////////
+///
 
-    memset(&dc->mTlsStruct, 0, sizeof(dc->mTlsStruct));
-    int status = pthread_setspecific(gThreadTLSKey, &dc->mTlsStruct);
-    if (status) {
-        ALOGE("pthread_setspecific %i", status);
+// The pool is created by the first context and torn down with the last;
+// both happen under gInitMutex.
+static RsdCpuWorkerPool *gWorkerPool = NULL;
+
+RsdCpuWorkerPool::RsdCpuWorkerPool() {
+    mRefCount = 0;
+    mExit = false;
+    mStarted = 0;
+    mStartFailed = 0;
+    mSubmitters = 0;
+    mLastSubmitNs = 0;
+    mSpinWaitNs = 0;
+    memset(&mWorkers, 0, sizeof(mWorkers));
+    mWaiters.mParkedCount = 0;
+    for (uint32_t ct = 0; ct < kMaxWaiters; ct++) {
+        mWaiters.mUsed[ct] = 0;
+        mWaiters.mParked[ct].mValue = 0;
+        mWaiters.mPriority[ct] = 0;
+    }
+    memset(&mNested, 0, sizeof(mNested));
+    memset(mCores, 0, sizeof(mCores));
+    mCoreCount = 0;
+    mWorkerWeights = NULL;
+}
+
+RsdCpuWorkerPool * RsdCpuWorkerPool::acquire(Context *rsc) {
+    pthread_mutex_lock(&gInitMutex);
+    if (!gWorkerPool) {
+        // The pool's hot counters are laid out by cache line, which only
+        // holds if the pool itself starts on one.
+        void *mem = memalign(RS_CACHE_LINE_SIZE, sizeof(RsdCpuWorkerPool));
+        if (!mem) {
+            pthread_mutex_unlock(&gInitMutex);
+            return NULL;
+        }
+        RsdCpuWorkerPool *pool = new (mem) RsdCpuWorkerPool();
+        if (!pool->init(rsc)) {
+            pool->~RsdCpuWorkerPool();
+            free(mem);
+            pthread_mutex_unlock(&gInitMutex);
+            return NULL;
+        }
+        gWorkerPool = pool;
+    }
+    RsdCpuWorkerPool *pool = gWorkerPool;
+    pool->mRefCount++;
+    pthread_mutex_unlock(&gInitMutex);
+    return pool;
+}
+
+void RsdCpuWorkerPool::release() {
+    pthread_mutex_lock(&gInitMutex);
+    if (--mRefCount == 0) {
+        gWorkerPool = NULL;
+        this->~RsdCpuWorkerPool();
+        free(this);
+    }
+    pthread_mutex_unlock(&gInitMutex);
+}
+
+// Wait for the launch generation to move past lastGen.  Workers spin for
+// mSpinWaitNs first so that back-to-back launches never go through the
+// kernel scheduler, then park on their launch signal.  A worker advertises
+// that it is parked through mParked so the launching thread only pays for
+// a signal when somebody is actually asleep.  While waiting, workers help
+// with launches nested inside kernels that are still running.
+int RsdCpuWorkerPool::waitForLaunch(uint32_t idx, int lastGen) {
+    volatile int *gen = &mWorkers.mLaunchGeneration;
+    while (*gen == lastGen) {
+        if (mNested.mActive) {
+            helpNestedLaunches(idx + 1, NULL);
+            cpuRelax();
+            continue;
+        }
+        if (spinWait(gen, lastGen, false, mSpinWaitNs, &mNested.mActive) ||
+            mNested.mActive) {
+            continue;
+        }
+
+        __sync_lock_test_and_set(&mWorkers.mParked[idx].mValue, 1);
+        // Stale sets of the signal only cause an extra trip round the loop.
+        while ((*gen == lastGen) && !mNested.mActive) {
+            mWorkers.mLaunchSignals[idx].wait();
+        }
+        __sync_lock_test_and_set(&mWorkers.mParked[idx].mValue, 0);
+    }
+    return *gen;
+}
+
+// Wake every thread parked waiting for a launch to complete.  Waiters of
+// other launches just recheck and park again.
+void RsdCpuWorkerPool::wakeWaiters() {
+    __sync_synchronize();
+    if (!mWaiters.mParkedCount) {
+        return;
+    }
+    for (uint32_t ct = 0; ct < kMaxWaiters; ct++) {
+        if (__sync_bool_compare_and_swap(&mWaiters.mParked[ct].mValue, 1, 0)) {
+            mWaiters.mSignals[ct].set();
+        }
+    }
+}
+
+// Wait for launch gen to complete, using the same spin-then-park scheme as
+// waitForLaunch.  Contexts without a waiter slot of their own yield instead
+// of parking.
+void RsdCpuWorkerPool::waitForCompletion(int gen, int waiter, const ScriptTLSStruct *owner) {
+    uint64_t end = getSpinTime() + mSpinWaitNs;
+    uint32_t spins = 0;
+    while (!hasCompleted(gen)) {
+        // The launch we wait for may itself be waiting on a nested launch.
+        if (mNested.mActive && helpNestedLaunches(0, owner)) {
+            continue;
+        }
+        cpuRelax();
+        if (!(++spins & 63) && (getSpinTime() >= end)) {
+            break;
+        }
+    }
+    if (hasCompleted(gen)) {
+        return;
+    }
+    if (waiter < 0) {
+        while (!hasCompleted(gen)) {
+            sched_yield();
+        }
+        return;
+    }
+
+    __sync_fetch_and_add(&mWaiters.mParkedCount, 1);
+    while (1) {
+        __sync_lock_test_and_set(&mWaiters.mParked[waiter].mValue, 1);
+        __sync_synchronize();
+        if (hasCompleted(gen)) {
+            break;
+        }
+        mWaiters.mSignals[waiter].wait();
+    }
+    __sync_lock_test_and_set(&mWaiters.mParked[waiter].mValue, 0);
+    __sync_fetch_and_sub(&mWaiters.mParkedCount, 1);
+}
+
+void * RsdCpuWorkerPool::helperThreadProc(void *vpool) {
+    RsdCpuWorkerPool *pool = (RsdCpuWorkerPool *)vpool;
+
+    uint32_t idx = __sync_fetch_and_add(&pool->mWorkers.mLaunchCount, 1);
+
+    //ALOGV("RS helperThread starting %p idx=%i", pool, idx);
+
+    pool->mWorkers.mNativeThreadId[idx] = gettid();
+
+    // idx +1 since the calling thread is worker 0.
+    pool->pinToCluster(pool->mWorkers.mNativeThreadId[idx], idx + 1);
+
+    // Report that we are up before waiting for the first launch.
+    int done = pool->mWorkers.mLaunchGeneration;
+    __sync_fetch_and_sub(&pool->mWorkers.mRunningCount, 1);
+
+    while (!pool->mExit) {
+        int gen = pool->waitForLaunch(idx, done);
+
+        // Take part in every launch published since the last one, in order.
+        // A slot is only reused once all workers are done with it, so the
+        // ring can't wrap underneath us.
+        while (done != gen) {
+            done++;
+            MTLaunchSlot *slot = &pool->mWorkers.mLaunches[(uint32_t)done % kMaxLaunches];
+            if (slot->mCallback) {
+                // Kernels look their context up through the TLS.
+                pthread_setspecific(gThreadTLSKey, slot->mTls);
+                // idx +1 is used because the calling thread is always worker 0.
+                slot->mCallback(slot->mData, idx+1);
+            }
+            pool->releaseLaunch(slot);
+        }
+    }
+
+    //ALOGV("RS helperThread exited %p idx=%i", pool, idx);
+    return NULL;
+}
+
+// Take the next launch generation and return its ring slot, waiting for
+// the launch that last used the slot if that one is still running.
+MTLaunchSlot * RsdCpuWorkerPool::acquireLaunchSlot(int waiter, const ScriptTLSStruct *owner,
+                                                   int *gen) {
+    *gen = __sync_add_and_fetch(&mWorkers.mReservedGeneration, 1);
+    waitForCompletion(*gen - (int)kMaxLaunches, waiter, owner);
+    return &mWorkers.mLaunches[(uint32_t)*gen % kMaxLaunches];
+}
+
+// Hand a filled slot to the helper threads.  Generations are published in
+// ticket order, so a submitter that got its slot early waits here for the
+// ones ahead of it; they are already past their own slot wait and only
+// need to fill it in.
+void RsdCpuWorkerPool::publishLaunch(MTLaunchSlot *slot, int gen) {
+    // The submitting thread takes part as worker 0.
+    slot->mRunning = mWorkers.mCount + 1;
+    slot->mGeneration = gen;
+    __sync_synchronize();
+    while (mWorkers.mLaunchGeneration != (gen - 1)) {
+        cpuRelax();
+    }
+    __sync_lock_test_and_set(&mWorkers.mLaunchGeneration, gen);
+
+    // Spinning workers pick the new generation up by themselves; only the
+    // ones that have parked need a wakeup.
+    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
+        if (__sync_bool_compare_and_swap(&mWorkers.mParked[ct].mValue, 1, 0)) {
+            mWorkers.mLaunchSignals[ct].set();
+        }
+    }
+}
+
+// Called by each participant once done with its part of the launch.  The
+// last one out accounts for the launch and frees the slot.
+void RsdCpuWorkerPool::releaseLaunch(MTLaunchSlot *slot) {
+    if (__sync_sub_and_fetch(&slot->mRunning, 1) != 0) {
+        return;
+    }
+    if (slot->mStats) {
+        slot->mOwner->gatherSliceStats(slot->mStats);
+    }
+    __sync_synchronize();
+    slot->mCompleted = slot->mGeneration;
+    wakeWaiters();
+}
+
+// Register a thread that waits for launches to complete.  Returns -1 once
+// every waiter slot is taken.
+int RsdCpuWorkerPool::addWaiter() {
+    for (uint32_t ct = 0; ct < kMaxWaiters; ct++) {
+        if (__sync_bool_compare_and_swap(&mWaiters.mUsed[ct], 0, 1)) {
+            mWaiters.mPriority[ct] = 0;
+            return ct;
+        }
+    }
+    return -1;
+}
+
+void RsdCpuWorkerPool::removeWaiter(int waiter) {
+    if (waiter >= 0) {
+        __sync_lock_release(&mWaiters.mUsed[waiter]);
+    }
+}
+
+// Worker index of the calling thread; the thread submitting a launch is
+// worker 0.
+uint32_t RsdCpuWorkerPool::getWorkerIndex() const {
+    pthread_t self = pthread_self();
+    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
+        if (pthread_equal(self, mWorkers.mThreadId[ct])) {
+            return ct + 1;
+        }
+    }
+    return 0;
+}
+
+uint32_t RsdCpuWorkerPool::getBigWorkerCount() const {
+    const uint32_t workers = mWorkers.mCount + 1;
+    if (!mWorkerWeights) {
+        return workers;
+    }
+    uint32_t big = 1;
+    while ((big < workers) && (mWorkerWeights[big] == mCores[0].mCapacity)) {
+        big++;
+    }
+    return big;
+}
+
+// Claim one of the nested launch entries, or return -1 if all are in use.
+int RsdCpuWorkerPool::reserveNestedLaunch() {
+    for (uint32_t ct = 0; ct < kMaxNestedLaunches; ct++) {
+        if (__sync_bool_compare_and_swap(&mNested.mOwned[ct], 0, 1)) {
+            return ct;
+        }
+    }
+    return -1;
+}
+
+// Run a launch issued from inside a running kernel.  The issuing worker
+// publishes it and works on it; idle workers waiting for their next launch
+// claim slices from it too.  Helpers register before looking at the entry
+// so that once it is withdrawn we only need to wait for the count to drain.
+void RsdCpuWorkerPool::runNestedLaunch(int entry, ScriptTLSStruct *owner,
+                                       WorkerCallback_t cbk, MTLaunchStruct *mtls,
+                                       uint32_t idx) {
+    mNested.mOwner[entry] = owner;
+    mNested.mCallback[entry] = cbk;
+    __sync_synchronize();
+    mNested.mLaunch[entry] = mtls;
+    __sync_fetch_and_add(&mNested.mActive, 1);
+
+    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
+        if (__sync_bool_compare_and_swap(&mWorkers.mParked[ct].mValue, 1, 0)) {
+            mWorkers.mLaunchSignals[ct].set();
+        }
+    }
+
+    cbk(mtls, idx);
+
+    // Every slice has been claimed by now; wait for the ones still running.
+    mNested.mLaunch[entry] = NULL;
+    __sync_synchronize();
+    while (__sync_fetch_and_or(&mNested.mHelpers[entry].mValue, 0) != 0) {
+        cpuRelax();
+    }
+    __sync_fetch_and_sub(&mNested.mActive, 1);
+    __sync_lock_release(&mNested.mOwned[entry]);
+}
+
+// Claim and run slices of any published nested launch.  Submitting threads
+// pass their TLS as owner: they are worker 0 of every launch of their own,
+// so they may only help launches issued from those.  Returns true if we
+// took part in at least one.
+bool RsdCpuWorkerPool::helpNestedLaunches(uint32_t idx, const ScriptTLSStruct *owner) {
+    bool helped = false;
+    for (uint32_t ct = 0; ct < kMaxNestedLaunches; ct++) {
+        if (!mNested.mLaunch[ct] || (owner && (mNested.mOwner[ct] != owner))) {
+            continue;
+        }
+        __sync_fetch_and_add(&mNested.mHelpers[ct].mValue, 1);
+        MTLaunchStruct *mtls = mNested.mLaunch[ct];
+        __sync_synchronize();
+        if (mtls && (!owner || (mNested.mOwner[ct] == owner))) {
+            if (!owner) {
+                pthread_setspecific(gThreadTLSKey, mNested.mOwner[ct]);
+            }
+            mNested.mCallback[ct](mtls, idx);
+            helped = true;
+        }
+        __sync_fetch_and_sub(&mNested.mHelpers[ct].mValue, 1);
+    }
+    return helped;
+}
+
+// Helper threads are shared, so they run at the most favourable priority
+// any context has asked for.
+void RsdCpuWorkerPool::setPriority(int waiter, int32_t priority) {
+    pthread_mutex_lock(&gInitMutex);
+    if (waiter >= 0) {
+        mWaiters.mPriority[waiter] = priority;
+    }
+    priority = getWorkerPriority();
+    for (uint32_t ct=0; mStarted && (ct < mWorkers.mCount); ct++) {
+        setpriority(PRIO_PROCESS, mWorkers.mNativeThreadId[ct], priority);
+    }
+    pthread_mutex_unlock(&gInitMutex);
+}
+
+int32_t RsdCpuWorkerPool::getWorkerPriority() const {
+    bool found = false;
+    int32_t priority = 0;
+    for (uint32_t ct = 0; ct < kMaxWaiters; ct++) {
+        if (mWaiters.mUsed[ct]) {
+            priority = found ? rsMin(priority, mWaiters.mPriority[ct]) : mWaiters.mPriority[ct];
+            found = true;
+        }
+    }
+    return priority;
+}
+
+////////////////////////////////////////////////////////////
+///
+
+// Public entry for callers outside the driver; always synchronous.
+void RsdCpuReferenceImpl::launchThreads(WorkerCallback_t cbk, void *data) {
+    // Workers are busy with the running kernel, so a nested launch just
+    // runs on the caller.
+    const uint32_t workerIdx = mPool->getWorkerIndex();
+    LaunchLane *entered = (workerIdx == 0) ? enterLane() : NULL;
+    LaunchLane *lane = getLane();
+    if (!mPool->hasWorkers() || lane->mInForEach || (workerIdx != 0)) {
+        if (cbk) {
+            cbk(data, workerIdx);
+        }
+    } else {
+        // Callbacks running script code may launch kernels of their own,
+        // which have to be nested in this launch.
+        lane->mInForEach = true;
+        runLaunch(lane, cbk, data, NULL);
+        lane->mInForEach = false;
+    }
+    leaveLane(entered);
+}
+
+// Publish a synchronous launch to the pool, run our share of it as worker 0
+// and wait for it to complete.  Returns the fence of the launch.
+int RsdCpuReferenceImpl::runLaunch(LaunchLane *lane, WorkerCallback_t cbk, void *data,
+                                   const MTLaunchStruct *stats) {
+    if (!mPool->beginSubmit()) {
+        // The helpers couldn't be started, so we run all of it.
+        if (cbk) {
+            cbk(data, 0);
+        }
+        if (stats) {
+            gatherSliceStats(stats);
+        }
+        return 0;
+    }
+    int gen;
+    MTLaunchSlot *slot = mPool->acquireLaunchSlot(lane->mWaiter, &lane->mTls, &gen);
+    slot->mCallback = cbk;
+    slot->mData = data;
+    slot->mOwner = this;
+    slot->mTls = &lane->mTls;
+    slot->mStats = stats;
+    mPool->publishLaunch(slot, gen);
+    mPool->endSubmit();
+
+    // We use the calling thread as one of the workers so we can start without
+    // the delay of the thread wakeup.
+    if (cbk) {
+        cbk(data, 0);
+    }
+    mPool->releaseLaunch(slot);
+    mPool->waitForCompletion(gen, lane->mWaiter, &lane->mTls);
+    return gen;
+}
+
+RsdCpuReferenceImpl::LaunchLane * RsdCpuReferenceImpl::getLane() {
+    ScriptTLSStruct *tls = (ScriptTLSStruct *)pthread_getspecific(gThreadTLSKey);
+    for (uint32_t ct = 1; ct < kMaxLanes; ct++) {
+        if (tls == &mLanes[ct].mTls) {
+            return &mLanes[ct];
+        }
+    }
+    return &mLanes[0];
+}
+
+// Lanes keep their waiter and slice queues once set up, so only the first
+// thread to borrow one pays for them.
+bool RsdCpuReferenceImpl::initLane(LaunchLane *lane) {
+    if (lane->mWaiter < 0) {
+        lane->mWaiter = mPool->addWaiter();
+        if (lane->mWaiter >= 0) {
+            mPool->setPriority(lane->mWaiter, mPriority);
+        }
+    }
+    if (!lane->mSliceQueues && mPool->getWorkerCount()) {
+        const uint32_t queueCount = mPool->getWorkerCount() + 1;
+        lane->mSliceQueues = (MTSliceQueue *)memalign(sizeof(MTSliceQueue),
+                                                      queueCount * sizeof(MTSliceQueue));
+        if (!lane->mSliceQueues) {
+            ALOGE("Failed to allocate slice queues.");
+            return false;
+        }
+        memset(lane->mSliceQueues, 0, queueCount * sizeof(MTSliceQueue));
+    }
+    if (!lane->mAccumulators && mPool->getWorkerCount()) {
+        const uint32_t setCount = mPool->getWorkerCount() + 1;
+        lane->mAccumulators = (MTAccumulatorSet *)memalign(sizeof(MTAccumulatorSet),
+                                                           setCount * sizeof(MTAccumulatorSet));
+        if (!lane->mAccumulators) {
+            ALOGE("Failed to allocate accumulators.");
+            return false;
+        }
+        memset(lane->mAccumulators, 0, setCount * sizeof(MTAccumulatorSet));
+    }
+    return true;
+}
+
+void * RsdCpuReferenceImpl::getAccumulator(Allocation *a, size_t sizeBytes) {
+    const uint32_t workerIdx = mPool ? mPool->getWorkerIndex() : 0;
+    LaunchLane *lane = getLane();
+    if (!lane->mAccumulators || (!lane->mInForEach && (workerIdx == 0))) {
+        return NULL;
+    }
+
+    MTAccumulatorSet *set = &lane->mAccumulators[workerIdx];
+    for (uint32_t ct = 0; ct < set->mCount; ct++) {
+        if (set->mList[ct].mAlloc == a) {
+            return set->mList[ct].mData;
+        }
+    }
+    const uint32_t maxCount = sizeof(set->mList) / sizeof(set->mList[0]);
+    if (set->mCount == maxCount) {
+        return NULL;
+    }
+
+    // Buffers stay with the worker between launches for reuse.
+    MTAccumulator *acc = &set->mList[set->mCount];
+    if (acc->mCapacity < sizeBytes) {
+        uint8_t *data = (uint8_t *)realloc(acc->mData, sizeBytes);
+        if (!data) {
+            return NULL;
+        }
+        acc->mData = data;
+        acc->mCapacity = sizeBytes;
+    }
+    memset(acc->mData, 0, sizeBytes);
+    acc->mAlloc = a;
+    set->mCount++;
+    return acc->mData;
+}
+
+// Folds what the workers summed privately during the lane's launch into the
+// allocations.  The workers are done by now, so no atomics are needed.
+void RsdCpuReferenceImpl::mergeAccumulators(LaunchLane *lane) {
+    if (!lane->mAccumulators) {
+        return;
+    }
+    const uint32_t setCount = mPool->getWorkerCount() + 1;
+    for (uint32_t w = 0; w < setCount; w++) {
+        MTAccumulatorSet *set = &lane->mAccumulators[w];
+        for (uint32_t ct = 0; ct < set->mCount; ct++) {
+            MTAccumulator *acc = &set->mList[ct];
+            Allocation *a = acc->mAlloc;
+            const uint32_t cells = a->getType()->getDimX();
+            void *dst = a->mHal.drvState.lod[0].mallocPtr;
+            if (a->getType()->getElement()->getType() == RS_TYPE_FLOAT_32) {
+                float *d = (float *)dst;
+                const float *src = (const float *)acc->mData;
+                for (uint32_t i = 0; i < cells; i++) {
+                    d[i] += src[i];
+                }
+            } else {
+                // Signed and unsigned sums wrap the same way.
+                uint32_t *d = (uint32_t *)dst;
+                const uint32_t *src = (const uint32_t *)acc->mData;
+                for (uint32_t i = 0; i < cells; i++) {
+                    d[i] += src[i];
+                }
+            }
+            acc->mAlloc = NULL;
+        }
+        set->mCount = 0;
+    }
+}
+
+RsdCpuReferenceImpl::LaunchLane * RsdCpuReferenceImpl::enterLane() {
+    ScriptTLSStruct *tls = (ScriptTLSStruct *)pthread_getspecific(gThreadTLSKey);
+    if (!mRSC->isSynchronous() || (tls == &mLanes[0].mTls) || (getLane() != &mLanes[0])) {
+        return NULL;
+    }
+
+    // Lanes are only held for the length of a call, so when all are taken
+    // one will be back shortly.
+    while (1) {
+        for (uint32_t ct = 1; ct < kMaxLanes; ct++) {
+            LaunchLane *lane = &mLanes[ct];
+            if (!__sync_bool_compare_and_swap(&lane->mUsed, 0, 1)) {
+                continue;
+            }
+            if (!initLane(lane)) {
+                __sync_lock_release(&lane->mUsed);
+                continue;
+            }
+            lane->mTls.mContext = mRSC;
+            lane->mTls.mScript = NULL;
+            lane->mTls.mImpl = NULL;
+            lane->mInForEach = false;
+            lane->mPrevTls = tls;
+            pthread_setspecific(gThreadTLSKey, &lane->mTls);
+            return lane;
+        }
+        sched_yield();
+    }
+}
+
+void RsdCpuReferenceImpl::leaveLane(LaunchLane *lane) {
+    if (lane) {
+        pthread_setspecific(gThreadTLSKey, lane->mPrevTls);
+        __sync_lock_release(&lane->mUsed);
+    }
+}
+
+// Forget asynchronous launches that have completed.  Globals set while
+// they ran can go in now; a script has at most one launch in flight.
+void RsdCpuReferenceImpl::retireLaunches() {
+    uint32_t count = 0;
+    for (uint32_t ct = 0; ct < mAsyncCount; ct++) {
+        if (!mPool->hasCompleted(mAsyncLaunches[ct].mFence)) {
+            mAsyncLaunches[count++] = mAsyncLaunches[ct];
+        } else if (mAsyncLaunches[ct].mScript) {
+            mAsyncLaunches[ct].mScript->applyStagedGlobals();
+        }
+    }
+    mAsyncCount = count;
+}
+
+bool RsdCpuReferenceImpl::hasPendingLaunch(const RsdCpuScriptImpl *script) const {
+    for (uint32_t ct = 0; ct < mAsyncCount; ct++) {
+        if ((mAsyncLaunches[ct].mScript == script) &&
+            !mPool->hasCompleted(mAsyncLaunches[ct].mFence)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RsdCpuReferenceImpl::waitForFence(int fence) {
+    if (fence) {
+        LaunchLane *lane = getLane();
+        mPool->waitForCompletion(fence, lane->mWaiter, &lane->mTls);
+    }
+}
+
+void RsdCpuReferenceImpl::finishLaunches() {
+    for (uint32_t ct = 0; ct < mAsyncCount; ct++) {
+        waitForFence(mAsyncLaunches[ct].mFence);
+        if (mAsyncLaunches[ct].mScript) {
+            mAsyncLaunches[ct].mScript->applyStagedGlobals();
+        }
+    }
+    mAsyncCount = 0;
+    mRSC->mPendingAsyncWork = false;
+}
+
+// Wait for any asynchronous launch the new one must be ordered after.
+// Launches of the same script may share globals; otherwise only a write to
+// an allocation the other launch touches, or a read of one it writes,
+// creates a dependency.
+void RsdCpuReferenceImpl::waitForConflicts(const RsdCpuScriptImpl *script,
+                                           const Allocation *ain,
+                                           const Allocation *aout) {
+    for (uint32_t ct = 0; ct < mAsyncCount; ct++) {
+        const AsyncLaunch *pending = &mAsyncLaunches[ct];
+        if ((pending->mScript == script) ||
+            (aout && ((aout == pending->mOut) || (aout == pending->mIn))) ||
+            (ain && (ain == pending->mOut))) {
+            waitForFence(pending->mFence);
+        }
+    }
+    retireLaunches();
+}
+
+
+void RsdCpuReferenceImpl::lockMutex() {
+    pthread_mutex_lock(&gInitMutex);
+}
+
+void RsdCpuReferenceImpl::unlockMutex() {
+    pthread_mutex_unlock(&gInitMutex);
+}
+
+static int
+read_file(const char*  pathname, char*  buffer, size_t  buffsize)
+{
+    int  fd, len;
+
+    fd = open(pathname, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    do {
+        len = read(fd, buffer, buffsize);
+    } while (len < 0 && errno == EINTR);
+
+    close(fd);
+
+    return len;
+}
+
+// Relative speed of a core: the scheduler's cpu_capacity when the kernel
+// exports it, otherwise the highest cpufreq frequency.  Returns 0 when
+// neither is available.
+static uint32_t GetCpuCapacity(uint32_t cpu) {
+    char path[128];
+    char buf[32];
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpu_capacity", cpu);
+    int len = read_file(path, buf, sizeof(buf) - 1);
+    if (len <= 0) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", cpu);
+        len = read_file(path, buf, sizeof(buf) - 1);
+    }
+    if (len <= 0) {
+        return 0;
+    }
+    buf[len] = 0;
+    return (uint32_t)strtoul(buf, NULL, 10);
+}
+
+#if defined(ARCH_ARM_HAVE_VFP)
+static void GetCpuInfo() {
+    char cpuinfo[4096];
+    int  cpuinfo_len;
+
+    cpuinfo_len = read_file("/proc/cpuinfo", cpuinfo, sizeof cpuinfo);
+    if (cpuinfo_len < 0)  /* should not happen */ {
+        return;
+    }
+
+    gArchUseSIMD = !!strstr(cpuinfo, " neon");
+
+    // 32 bit processes on ARMv8 see "CPU architecture: 8", older arm64
+    // kernels say "AArch64" instead.
+    const char *arch = strstr(cpuinfo, "CPU architecture:");
+    if (arch) {
+        arch += strlen("CPU architecture:");
+        gArchVersion = (uint32_t)strtoul(arch, NULL, 10);
+        if (!gArchVersion && strstr(arch, "AArch64")) {
+            gArchVersion = 8;
+        }
+    }
+}
+#endif // ARCH_ARM_HAVE_VFP
+
+#if defined(ARCH_ARM64_HAVE_NEON)
+static void GetCpuInfo() {
+    // Advanced SIMD is a mandatory part of AArch64.
+    gArchUseSIMD = true;
+    gArchVersion = 8;
+}
+#endif // ARCH_ARM64_HAVE_NEON
+
+#if defined(ARCH_X86_HAVE_SSSE3)
+static void GetCpuInfo() {
+    // The x86 kernels only need SSSE3, reported in ecx of cpuid leaf 1.
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        gArchUseSIMD = !!(ecx & bit_SSSE3);
+    }
+}
+#endif // ARCH_X86_HAVE_SSSE3
+
+// Read the capacity of every core and sort them fastest first.  Worker i
+// runs near mCores[i], so the submitting thread and the first helpers land
+// on the big cluster.  On heterogeneous parts each of the cpu workers is
+// given a share of every launch in proportion to its core's capacity.
+void RsdCpuWorkerPool::initCoreTopology(uint32_t cpu) {
+    long conf = sysconf(_SC_NPROCESSORS_CONF);
+    if (conf < 1) {
+        return;
+    }
+    mCoreCount = rsMin((uint32_t)conf, (uint32_t)kMaxCores);
+    uint32_t minCap = 0xffffffff;
+    uint32_t maxCap = 0;
+    for (uint32_t ct = 0; ct < mCoreCount; ct++) {
+        uint32_t cap = GetCpuCapacity(ct);
+        uint32_t pos = ct;
+        while (pos && (mCores[pos - 1].mCapacity < cap)) {
+            mCores[pos] = mCores[pos - 1];
+            pos--;
+        }
+        mCores[pos].mCpu = ct;
+        mCores[pos].mCapacity = cap;
+        minCap = rsMin(minCap, cap);
+        maxCap = rsMax(maxCap, cap);
+    }
+
+    if (!minCap || (minCap == maxCap)) {
+        // Unknown or uniform; keep the even split and leave placement to
+        // the scheduler.
+        return;
+    }
+
+    mWorkerWeights = (uint32_t *)calloc(cpu, sizeof(uint32_t));
+    for (uint32_t ct = 0; ct < cpu; ct++) {
+        mWorkerWeights[ct] = mCores[ct % mCoreCount].mCapacity;
+    }
+    ALOGV("heterogeneous cpu, capacity %u to %u", minCap, maxCap);
+}
+
+// Restrict thread tid to the cluster of cores that share the capacity of
+// the core worker runs near.
+void RsdCpuWorkerPool::pinToCluster(pid_t tid, uint32_t worker) {
+    if (!mWorkerWeights) {
+        return;
+    }
+
+    typedef struct {uint64_t bits[kMaxCores / 64]; } cpu_mask_t;
+    cpu_mask_t mask;
+    memset(&mask, 0, sizeof(mask));
+    const uint32_t cap = mCores[worker % mCoreCount].mCapacity;
+    for (uint32_t ct = 0; ct < mCoreCount; ct++) {
+        if (mCores[ct].mCapacity == cap) {
+            mask.bits[mCores[ct].mCpu / 64] |= 1ULL << (mCores[ct].mCpu % 64);
+        }
+    }
+    int ret = syscall(__NR_sched_setaffinity, tid, sizeof(mask), &mask);
+    if (ret) {
+        ALOGV("Failed to set affinity of tid %i, %i", tid, ret);
+    }
+}
+
+// Size the pool and start its helper threads.  The first context to be
+// created decides the thread count and spin time for the whole process.
+bool RsdCpuWorkerPool::init(Context *rsc) {
+    int cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if(rsc->props.mDebugMaxThreads) {
+        cpu = rsc->props.mDebugMaxThreads;
+    }
+    initCoreTopology(cpu);
+
+    // Before any launch, the slot of generation g must look as if launch
+    // g - kMaxLaunches had completed in it.
+    for (uint32_t ct = 1; ct <= kMaxLaunches; ct++) {
+        MTLaunchSlot *slot = &mWorkers.mLaunches[ct % kMaxLaunches];
+        slot->mGeneration = (int)ct - (int)kMaxLaunches;
+        slot->mCompleted = slot->mGeneration;
+    }
+    for (uint32_t ct = 0; ct < kMaxWaiters; ct++) {
+        mWaiters.mSignals[ct].init();
+    }
+
+    if (cpu < 2) {
+        mWorkers.mCount = 0;
+        return true;
+    }
+
+    mSpinWaitNs = (uint64_t)(rsc->props.mDebugSpinWait ? rsc->props.mDebugSpinWait :
+                             kDefaultSpinWaitUs) * 1000;
+
+    // Subtract one from the cpu count because we also use the submitting
+    // thread as a worker.
+    mWorkers.mCount = (uint32_t)(cpu - 1);
+
+    ALOGV("Launching thread(s), CPUs %i", mWorkers.mCount + 1);
+
+    mWorkers.mThreadId = (pthread_t *) calloc(mWorkers.mCount, sizeof(pthread_t));
+    mWorkers.mNativeThreadId = (pid_t *) calloc(mWorkers.mCount, sizeof(pid_t));
+    mWorkers.mLaunchSignals = new Signal[mWorkers.mCount];
+    mWorkers.mParked = (MTPaddedInt *) memalign(sizeof(MTPaddedInt),
+                                                mWorkers.mCount * sizeof(MTPaddedInt));
+    memset(mWorkers.mParked, 0, mWorkers.mCount * sizeof(MTPaddedInt));
+
+    // Each launch slot gets one slice queue per worker, including the
+    // calling thread.  Each queue sits on its own cache line so claims by
+    // different workers never contend.
+    const uint32_t queueCount = mWorkers.mCount + 1;
+    MTSliceQueue *queues = (MTSliceQueue *)memalign(sizeof(MTSliceQueue),
+            kMaxLaunches * queueCount * sizeof(MTSliceQueue));
+    if (!queues) {
+        ALOGE("Failed to allocate slice queues.");
+        mWorkers.mCount = 0;
+        return false;
+    }
+    memset(queues, 0, kMaxLaunches * queueCount * sizeof(MTSliceQueue));
+    for (uint32_t ct = 0; ct < kMaxLaunches; ct++) {
+        mWorkers.mLaunches[ct].mSliceQueues = &queues[ct * queueCount];
+    }
+    mNested.mSliceQueues = (MTSliceQueue *)memalign(sizeof(MTSliceQueue),
+            kMaxNestedLaunches * queueCount * sizeof(MTSliceQueue));
+    if (!mNested.mSliceQueues) {
+        ALOGE("Failed to allocate slice queues.");
+        mWorkers.mCount = 0;
+        return false;
+    }
+    memset(mNested.mSliceQueues, 0, kMaxNestedLaunches * queueCount * sizeof(MTSliceQueue));
+
+    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
+        mWorkers.mLaunchSignals[ct].init();
+    }
+    return true;
+}
+
+bool RsdCpuWorkerPool::startWorkers() {
+    mWorkers.mRunningCount = mWorkers.mCount;
+    mWorkers.mLaunchCount = 0;
+    __sync_synchronize();
+
+    // Launches are published to every one of mCount helpers, and contexts
+    // have been sized from it, so a partial set can't be used.  Failing
+    // leaves the pool single threaded for good.
+    pthread_attr_t threadAttr;
+    int status = pthread_attr_init(&threadAttr);
+    if (status) {
+        ALOGE("Failed to init thread attribute.");
+        __sync_lock_test_and_set(&mStartFailed, 1);
+        return false;
+    }
+
+    uint32_t started = 0;
+    for (; started < mWorkers.mCount; started++) {
+        status = pthread_create(&mWorkers.mThreadId[started], &threadAttr,
+                                helperThreadProc, this);
+        if (status) {
+            // Threads that didn't start would never report they are up.
+            __sync_fetch_and_sub(&mWorkers.mRunningCount, mWorkers.mCount - started);
+            break;
+        }
+    }
+    while (__sync_fetch_and_or(&mWorkers.mRunningCount, 0) != 0) {
+        usleep(100);
+    }
+    pthread_attr_destroy(&threadAttr);
+    if (started < mWorkers.mCount) {
+        ALOGE("Created fewer than expected number of RS threads, running single threaded.");
+        stopWorkers(started);
+        __sync_lock_test_and_set(&mStartFailed, 1);
+        return false;
+    }
+
+    int32_t priority = getWorkerPriority();
+    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
+        setpriority(PRIO_PROCESS, mWorkers.mNativeThreadId[ct], priority);
+    }
+    __sync_lock_test_and_set(&mStarted, 1);
+    return true;
+}
+
+// Runs an empty launch that every helper wakes up for, sees mExit and
+// leaves, then takes the submitter's part in it so its slot can be reused.
+void RsdCpuWorkerPool::stopWorkers(uint32_t started) {
+    mExit = true;
+    int gen;
+    MTLaunchSlot *slot = acquireLaunchSlot(-1, NULL, &gen);
+    slot->mCallback = NULL;
+    slot->mData = NULL;
+    slot->mOwner = NULL;
+    slot->mTls = NULL;
+    slot->mStats = NULL;
+    publishLaunch(slot, gen);
+    // Helpers that never started take no part in it.
+    for (uint32_t ct = started; ct < mWorkers.mCount; ct++) {
+        releaseLaunch(slot);
+    }
+
+    for (uint32_t ct = 0; ct < started; ct++) {
+        mWorkers.mLaunchSignals[ct].set();
+    }
+    void *res;
+    for (uint32_t ct = 0; ct < started; ct++) {
+        pthread_join(mWorkers.mThreadId[ct], &res);
+    }
+    releaseLaunch(slot);
+
+    // getWorkerIndex must not match a later thread given a stale id.
+    memset(mWorkers.mThreadId, 0, mWorkers.mCount * sizeof(pthread_t));
+    memset(mWorkers.mNativeThreadId, 0, mWorkers.mCount * sizeof(pid_t));
+    memset(mWorkers.mParked, 0, mWorkers.mCount * sizeof(MTPaddedInt));
+    mExit = false;
+}
+
+bool RsdCpuWorkerPool::beginSubmit() {
+    if (mStartFailed) {
+        return false;
+    }
+    __sync_fetch_and_add(&mSubmitters, 1);
+    if (!mStarted) {
+        pthread_mutex_lock(&gInitMutex);
+        bool started = mStarted;
+        if (!started && !mStartFailed) {
+            ALOGV("Starting RS helper threads");
+            started = startWorkers();
+        }
+        pthread_mutex_unlock(&gInitMutex);
+        if (!started) {
+            __sync_fetch_and_sub(&mSubmitters, 1);
+            return false;
+        }
+    }
+    return true;
+}
+
+void RsdCpuWorkerPool::endSubmit() {
+    mLastSubmitNs = getSpinTime();
+    __sync_fetch_and_sub(&mSubmitters, 1);
+}
+
+int32_t RsdCpuWorkerPool::idle(uint64_t now) {
+    if (!mStarted) {
+        return -1;
+    }
+    const uint64_t stopNs = mLastSubmitNs + (uint64_t)kIdleStopMs * 1000000;
+    if (now < stopNs) {
+        return (int32_t)((stopNs - now) / 1000000) + 1;
+    }
+
+    pthread_mutex_lock(&gInitMutex);
+    int32_t wait = -1;
+    if (mStarted) {
+        // A submitter counts itself before looking at mStarted, and we
+        // clear mStarted before looking at the count, so either it sees
+        // the helpers are stopping and waits for gInitMutex to restart
+        // them, or we see it and leave them be.
+        __sync_lock_test_and_set(&mStarted, 0);
+        __sync_synchronize();
+        if (mSubmitters || !hasCompleted(mWorkers.mLaunchGeneration) || mNested.mActive) {
+            __sync_lock_test_and_set(&mStarted, 1);
+            wait = kIdleStopMs;
+        } else {
+            ALOGV("Stopping idle RS helper threads");
+            stopWorkers(mWorkers.mCount);
+        }
+    }
+    pthread_mutex_unlock(&gInitMutex);
+    return wait;
+}
+
+RsdCpuWorkerPool::~RsdCpuWorkerPool() {
+    // Every context is gone, so nothing else can be in the ring.
+    if (mStarted && mWorkers.mCount) {
+        stopWorkers(mWorkers.mCount);
+    }
+    free(mWorkers.mLaunches[0].mSliceQueues);
+    free(mNested.mSliceQueues);
+    free(mWorkerWeights);
+    free(mWorkers.mParked);
+    free(mWorkers.mThreadId);
+    free(mWorkers.mNativeThreadId);
+    delete[] mWorkers.mLaunchSignals;
+}
+
+bool RsdCpuReferenceImpl::init(uint32_t version_major, uint32_t version_minor,
+                               sym_lookup_t lfn, script_lookup_t slfn) {
+
+    mSymLookupFn = lfn;
+    mScriptLookupFn = slfn;
+
+    lockMutex();
+    if (!gThreadTLSKeyCount) {
+        int status = pthread_key_create(&gThreadTLSKey, NULL);
+        if (status) {
+            ALOGE("Failed to init thread tls key.");
+            unlockMutex();
+            return false;
+        }
+    }
+    gThreadTLSKeyCount++;
+    unlockMutex();
+
+    mLanes[0].mTls.mContext = mRSC;
+    mLanes[0].mTls.mScript = NULL;
+    int status = pthread_setspecific(gThreadTLSKey, &mLanes[0].mTls);
+    if (status) {
+        ALOGE("pthread_setspecific %i", status);
+    }
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    GetCpuInfo();
+#endif
+
+    mPool = RsdCpuWorkerPool::acquire(mRSC);
+    if (!mPool) {
+        ALOGE("Failed to start the RS worker pool.");
+        return false;
+    }
+    mLanes[0].mWaiter = mPool->addWaiter();
+    mWorkerLimit = mPool->getWorkerCount() + 1;
+    mPrefetchRows = mRSC->props.mDebugPrefetchRows ? mRSC->props.mDebugPrefetchRows :
+                    kDefaultPrefetchRows;
+    mIntrinsicTuning->init(mPool->getWorkerCount() + 1);
+    if (!mPool->getWorkerCount()) {
+        return true;
+    }
+    // Only threaded launches are hinted.
+    mPerfBoost->init(mRSC->getPerfHints());
+
+    // When limited to the big cores keep the command thread there too;
+    // synchronous contexts run on the application's thread, leave it be.
+    if (mRSC->getBigCoresOnly()) {
+        mWorkerLimit = mPool->getBigWorkerCount();
+        if (!mRSC->isSynchronous()) {
+            mPool->pinToCluster(gettid(), 0);
+        }
+    }
+
+    return initLane(&mLanes[0]);
+}
+
+
+void RsdCpuReferenceImpl::setPriority(int32_t priority) {
+    mPriority = priority;
+    for (uint32_t ct = 0; ct < kMaxLanes; ct++) {
+        if (mLanes[ct].mWaiter >= 0) {
+            mPool->setPriority(mLanes[ct].mWaiter, priority);
+        }
+    }
+}
+
+RsdCpuReferenceImpl::~RsdCpuReferenceImpl() {
+    if (mPool) {
+        finishLaunches();
+        for (uint32_t ct = 0; ct < kMaxLanes; ct++) {
+            mPool->removeWaiter(mLanes[ct].mWaiter);
+            if (mLanes[ct].mAccumulators) {
+                for (uint32_t w = 0; w <= mPool->getWorkerCount(); w++) {
+                    MTAccumulatorSet *set = &mLanes[ct].mAccumulators[w];
+                    for (uint32_t i = 0; i < sizeof(set->mList) / sizeof(set->mList[0]); i++) {
+                        free(set->mList[i].mData);
+                    }
+                }
+                free(mLanes[ct].mAccumulators);
+            }
+        }
+        mPool->release();
+    }
+    for (uint32_t ct = 0; ct < kMaxLanes; ct++) {
+        free(mLanes[ct].mSliceQueues);
+    }
+    free(mProfile);
+    pthread_mutex_destroy(&mProfileLock);
+    delete mIntrinsicTuning;
+    delete mPerfBoost;
+
+    // Global structure cleanup.
+    lockMutex();
+    --gThreadTLSKeyCount;
+    if (!gThreadTLSKeyCount) {
+        pthread_key_delete(gThreadTLSKey);
+    }
+    unlockMutex();
+
+}
+
+typedef void (*rs_t)(const void *, void *, const void *, uint32_t, uint32_t, uint32_t, uint32_t);
+
+static inline uint64_t packSliceRange(uint32_t next, uint32_t end) {
+    return ((uint64_t)end << 32) | next;
+}
+
+static inline uint32_t sliceRangeNext(uint64_t range) {
+    return (uint32_t)range;
+}
+
+static inline uint32_t sliceRangeEnd(uint64_t range) {
+    return (uint32_t)(range >> 32);
+}
+
+static inline bool isLaunchWorker(const MTLaunchStruct *mtls, uint32_t idx) {
+    if (idx >= 64) {
+        return mtls->mWorkerMask == ~0ULL;
+    }
+    return (mtls->mWorkerMask >> idx) & 1;
+}
+
+// Split the slices of a launch into one contiguous range per worker taking
+// part in it.  With weights each worker's range is proportional to its
+// weight, otherwise the split is even.
+static void initSliceQueues(MTLaunchStruct *mtls, uint32_t sliceCount,
+                            const uint32_t *weights) {
+    const uint32_t workers = mtls->mSliceQueueCount;
+    uint64_t total = 0;
+    for (uint32_t ct = 0; ct < workers; ct++) {
+        if (isLaunchWorker(mtls, ct)) {
+            total += weights ? weights[ct] : 1;
+        }
+    }
+    uint64_t acc = 0;
+    mtls->mSliceCount = sliceCount;
+    for (uint32_t ct = 0; ct < workers; ct++) {
+        MTSliceQueue *q = &mtls->mSliceQueues[ct];
+        uint32_t start = (uint32_t)((sliceCount * acc) / total);
+        if (isLaunchWorker(mtls, ct)) {
+            acc += weights ? weights[ct] : 1;
+        }
+        uint32_t end = (uint32_t)((sliceCount * acc) / total);
+        q->mRange = packSliceRange(start, end);
+        q->mClaimed = 0;
+        q->mStolen = 0;
+        q->mRetries = 0;
+        q->mCostPs = 0;
+        q->mBusyNs = 0;
+    }
+    __sync_synchronize();
+}
+
+// Claim the next slice for worker idx.  The worker drains its own range
+// from the front first.  Once empty it takes the back half of the first
+// neighbour that still has work, keeps one slice and moves the rest into
+// its own queue.  Returns false once every queue is empty.
+static bool claimSlice(MTLaunchStruct *mtls, uint32_t idx, uint32_t *slice) {
+    MTSliceQueue *own = &mtls->mSliceQueues[idx];
+    if (!isLaunchWorker(mtls, idx)) {
+        return false;
+    }
+
+    while (1) {
+        uint64_t r = own->mRange;
+        uint32_t next = sliceRangeNext(r);
+        uint32_t end = sliceRangeEnd(r);
+        if (next >= end) {
+            break;
+        }
+        if (__sync_bool_compare_and_swap(&own->mRange, r, packSliceRange(next + 1, end))) {
+            own->mClaimed++;
+            *slice = next;
+            return true;
+        }
+        own->mRetries++;
+    }
+
+    const uint32_t workers = mtls->mSliceQueueCount;
+    for (uint32_t ct = 1; ct < workers; ct++) {
+        MTSliceQueue *victim = &mtls->mSliceQueues[(idx + ct) % workers];
+        while (1) {
+            uint64_t r = victim->mRange;
+            uint32_t next = sliceRangeNext(r);
+            uint32_t end = sliceRangeEnd(r);
+            if (next >= end) {
+                break;
+            }
+            uint32_t take = (end - next + 1) >> 1;
+            uint32_t split = end - take;
+            if (!__sync_bool_compare_and_swap(&victim->mRange, r,
+                                              packSliceRange(next, split))) {
+                own->mRetries++;
+                continue;
+            }
+
+            // Our own queue is empty so no thief will touch it; publish
+            // the remainder of the stolen range for later claims and for
+            // other thieves.
+            uint64_t empty = own->mRange;
+            while (!__sync_bool_compare_and_swap(&own->mRange, empty,
+                                                 packSliceRange(split + 1, end))) {
+                empty = own->mRange;
+            }
+            own->mClaimed++;
+            own->mStolen++;
+            *slice = split;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Points p at element x of row y of layer (z, ar).
+static inline void setupCell(const MTLaunchStruct *mtls, RsForEachStubParamStruct *p,
+                             uint32_t y, uint32_t z, uint32_t ar, uint32_t x) {
+    p->y = y;
+    p->z = z;
+    p->ar[0] = ar;
+    uint32_t offset = mtls->fep.dimY * mtls->fep.dimZ * p->ar[0] +
+                      mtls->fep.dimY * p->z + p->y;
+    p->out = mtls->fep.ptrOut + (mtls->fep.yStrideOut * offset) +
+             (mtls->fep.eStrideOut * x) + (mtls->mAccumStride * p->lid);
+    p->in = mtls->fep.ptrIn + (mtls->fep.yStrideIn * offset) +
+            (mtls->fep.eStrideIn * x);
+    for (uint32_t ct = 0; ct < mtls->fep.inLen; ct++) {
+        p->ins[ct] = mtls->ptrIns[ct] + (mtls->yStrideIns[ct] * offset) +
+                     (mtls->eStrideIns[ct] * x);
+    }
+}
+
+// Rows of a launch are numbered over the flattened (array, z, y) space so
+// that 3D and arrayed allocations are split across workers the same way as
+// plain 2D ones.  setupRow points p at element x of the given row.
+static inline void setupRow(const MTLaunchStruct *mtls, RsForEachStubParamStruct *p,
+                            uint32_t row, uint32_t x) {
+    const uint32_t dimY = mtls->yEnd - mtls->yStart;
+    const uint32_t dimYZ = dimY * (mtls->zEnd - mtls->zStart);
+    setupCell(mtls, p, mtls->yStart + row % dimY,
+              mtls->zStart + (row / dimY) % (mtls->zEnd - mtls->zStart),
+              mtls->arrayStart + row / dimYZ, x);
+}
+
+// Runs the kernel over cells x1 to x2 of the row p points at, giving the
+// wide expansion, where there is one, all the whole groups of cells.
+static inline void runKernel(const MTLaunchStruct *mtls, RsForEachStubParamStruct *p,
+                             uint32_t x1, uint32_t x2) {
+    const uint32_t instep = mtls->fep.eStrideIn;
+    const uint32_t outstep = mtls->fep.eStrideOut;
+    if (mtls->kernelWide && (x2 - x1 >= mtls->kernelWidth)) {
+        const uint32_t n = (x2 - x1) / mtls->kernelWidth * mtls->kernelWidth;
+        ((outer_foreach_t)mtls->kernelWide)(p, x1, x1 + n, instep, outstep);
+        x1 += n;
+        if (x1 == x2) {
+            return;
+        }
+        p->in = (const uint8_t *)p->in + instep * n;
+        p->out = (uint8_t *)p->out + outstep * n;
+        for (uint32_t ct = 0; ct < mtls->fep.inLen; ct++) {
+            p->ins[ct] = (const uint8_t *)p->ins[ct] + mtls->eStrideIns[ct] * n;
+        }
+    }
+    ((outer_foreach_t)mtls->kernel)(p, x1, x2, instep, outstep);
+}
+
+static inline uint32_t getRowCount(const MTLaunchStruct *mtls) {
+    return (mtls->yEnd - mtls->yStart) * (mtls->zEnd - mtls->zStart) *
+           (mtls->arrayEnd - mtls->arrayStart);
+}
+
+// Starts loading the first lines of each input of a row the worker gets to
+// later.  The hardware follows a row once it is being read, but each new
+// row otherwise begins with a miss.
+static inline void prefetchRow(const MTLaunchStruct *mtls, uint32_t row, uint32_t x) {
+    if (row >= getRowCount(mtls)) {
+        return;
+    }
+    const uint32_t dimY = mtls->yEnd - mtls->yStart;
+    const uint32_t dimYZ = dimY * (mtls->zEnd - mtls->zStart);
+    const uint32_t y = mtls->yStart + row % dimY;
+    const uint32_t z = mtls->zStart + (row / dimY) % (mtls->zEnd - mtls->zStart);
+    const uint32_t ar = mtls->arrayStart + row / dimYZ;
+    const uint32_t offset = mtls->fep.dimY * mtls->fep.dimZ * ar + mtls->fep.dimY * z + y;
+    for (uint32_t ct = 0; ct < mtls->fep.inLen; ct++) {
+        const uint8_t *ptr = mtls->ptrIns[ct] + (mtls->yStrideIns[ct] * offset) +
+                             (mtls->eStrideIns[ct] * x);
+        for (uint32_t line = 0; line < 4; line++) {
+            __builtin_prefetch(ptr + line * RS_CACHE_LINE_SIZE, 0, 3);
+        }
+    }
+}
+
+// Worker 0 times the first slice it runs so later launches of the kernel
+// can size their slices by cost instead of by bytes.
+static inline void recordSliceCost(MTLaunchStruct *mtls, uint64_t ns, uint32_t elements) {
+    if (elements) {
+        mtls->mSliceQueues[0].mCostPs = (uint32_t)rsMin((ns * 1000) / elements,
+                                                        (uint64_t)0xffffffff);
+    }
+}
+
+static void wc_xy(void *usr, uint32_t idx) {
+    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
+    RsForEachStubParamStruct p;
+    memcpy(&p, &mtls->fep, sizeof(p));
+    p.lid = idx;
+    const void *ins[RS_KERNEL_INPUT_LIMIT];
+    p.ins = ins;
+    p.eStrideIns = mtls->eStrideIns;
+    uint32_t sig = mtls->sig;
+    const uint32_t rowCount = getRowCount(mtls);
+
+    bool timeSlice = (idx == 0);
+    const uint64_t busyStart = getSpinTime();
+    ATRACE_BEGIN("RS worker slices");
+    uint32_t slice;
+    while (claimSlice(mtls, idx, &slice)) {
+        uint32_t rowStart = slice * mtls->mSliceSize;
+        uint32_t rowEnd = rowStart + mtls->mSliceSize;
+        rowEnd = rsMin(rowEnd, rowCount);
+        if (rowEnd <= rowStart) {
+            continue;
+        }
+
+        //ALOGE("usr idx %i, x %i,%i  rows %i,%i", idx, mtls->xStart, mtls->xEnd, rowStart, rowEnd);
+        //ALOGE("usr ptr in %p,  out %p", mtls->fep.ptrIn, mtls->fep.ptrOut);
+
+        uint64_t t0 = timeSlice ? getSpinTime() : 0;
+        for (uint32_t row = rowStart; row < rowEnd; row++) {
+            setupRow(mtls, &p, row, mtls->xStart);
+            if (p.prefetchRows) {
+                prefetchRow(mtls, row + p.prefetchRows, mtls->xStart);
+            }
+            runKernel(mtls, &p, mtls->xStart, mtls->xEnd);
+        }
+        if (timeSlice) {
+            recordSliceCost(mtls, getSpinTime() - t0,
+                            (rowEnd - rowStart) * (mtls->xEnd - mtls->xStart));
+            timeSlice = false;
+        }
+    }
+    mtls->mSliceQueues[idx].mBusyNs = getSpinTime() - busyStart;
+    ATRACE_END();
+}
+
+// Tiled launches hand out mTileSizeX by mTileSizeY blocks instead of full
+// rows so that kernels reading a neighbourhood keep their window in cache.
+// Tiles are numbered row-major, so a worker's contiguous range of slices
+// walks across a band of the image.
+static void wc_tile(void *usr, uint32_t idx) {
+    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
+    RsForEachStubParamStruct p;
+    memcpy(&p, &mtls->fep, sizeof(p));
+    p.lid = idx;
+    const void *ins[RS_KERNEL_INPUT_LIMIT];
+    p.ins = ins;
+    p.eStrideIns = mtls->eStrideIns;
+    uint32_t sig = mtls->sig;
+    const uint32_t rowCount = getRowCount(mtls);
+    const uint32_t tilesX = (mtls->xEnd - mtls->xStart + mtls->mTileSizeX - 1) /
+                            mtls->mTileSizeX;
+
+    bool timeSlice = (idx == 0);
+    const uint64_t busyStart = getSpinTime();
+    ATRACE_BEGIN("RS worker slices");
+    uint32_t slice;
+    while (claimSlice(mtls, idx, &slice)) {
+        uint32_t xStart = mtls->xStart + (slice % tilesX) * mtls->mTileSizeX;
+        uint32_t xEnd = rsMin(xStart + mtls->mTileSizeX, mtls->xEnd);
+        uint32_t rowStart = (slice / tilesX) * mtls->mTileSizeY;
+        uint32_t rowEnd = rsMin(rowStart + mtls->mTileSizeY, rowCount);
+
+        //ALOGE("usr idx %i, tile x %i,%i  rows %i,%i", idx, xStart, xEnd, rowStart, rowEnd);
+
+        uint64_t t0 = timeSlice ? getSpinTime() : 0;
+        for (uint32_t row = rowStart; row < rowEnd; row++) {
+            setupRow(mtls, &p, row, xStart);
+            if (p.prefetchRows) {
+                prefetchRow(mtls, row + p.prefetchRows, xStart);
+            }
+            runKernel(mtls, &p, xStart, xEnd);
+        }
+        if (timeSlice) {
+            recordSliceCost(mtls, getSpinTime() - t0, (rowEnd - rowStart) * (xEnd - xStart));
+            timeSlice = false;
+        }
     }
+    mtls->mSliceQueues[idx].mBusyNs = getSpinTime() - busyStart;
+    ATRACE_END();
+}
 
-#if 0
-    typedef struct {uint64_t bits[1024 / 64]; } cpu_set_t;
-    cpu_set_t cpuset;
-    memset(&cpuset, 0, sizeof(cpuset));
-    cpuset.bits[idx / 64] |= 1ULL << (idx % 64);
-    int ret = syscall(241, rsc->mWorkers.mNativeThreadId[idx],
-              sizeof(cpuset), &cpuset);
-    ALOGE("SETAFFINITY ret = %i %s", ret, EGLUtils::strerror(ret));
-#endif
+// Region launches number the slices of each region after those of the
+// regions before it, a region's rows being flattened as a launch's are.
+// Workers mostly claim the slice after their last one, so the search for
+// its region starts from the last region.
+static void wc_regions(void *usr, uint32_t idx) {
+    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
+    RsForEachStubParamStruct p;
+    memcpy(&p, &mtls->fep, sizeof(p));
+    p.lid = idx;
+    const void *ins[RS_KERNEL_INPUT_LIMIT];
+    p.ins = ins;
+    p.eStrideIns = mtls->eStrideIns;
+    uint32_t sig = mtls->sig;
+    const uint32_t dimZ = mtls->zEnd - mtls->zStart;
+    const uint32_t layers = dimZ * (mtls->arrayEnd - mtls->arrayStart);
+
+    bool timeSlice = (idx == 0);
+    const uint64_t busyStart = getSpinTime();
+    ATRACE_BEGIN("RS worker slices");
+    uint32_t region = 0;
+    uint32_t regionSlice = 0;
+    uint32_t slice;
+    while (claimSlice(mtls, idx, &slice)) {
+        if (slice < regionSlice) {
+            region = 0;
+            regionSlice = 0;
+        }
+        while (true) {
+            const RsScriptRect &r = mtls->mRegions[region];
+            uint32_t slices = ((r.yEnd - r.yStart) * layers + mtls->mSliceSize - 1) /
+                              mtls->mSliceSize;
+            if (slice < regionSlice + slices) {
+                break;
+            }
+            regionSlice += slices;
+            region++;
+        }
 
-    while (!dc->mExit) {
-        dc->mWorkers.mLaunchSignals[idx].wait();
-        if (dc->mWorkers.mLaunchCallback) {
-           // idx +1 is used because the calling thread is always worker 0.
-           dc->mWorkers.mLaunchCallback(dc->mWorkers.mLaunchData, idx+1);
+        const RsScriptRect &r = mtls->mRegions[region];
+        const uint32_t dimY = r.yEnd - r.yStart;
+        uint32_t rowStart = (slice - regionSlice) * mtls->mSliceSize;
+        uint32_t rowEnd = rsMin(rowStart + mtls->mSliceSize, dimY * layers);
+
+        uint64_t t0 = timeSlice ? getSpinTime() : 0;
+        for (uint32_t row = rowStart; row < rowEnd; row++) {
+            const uint32_t layer = row / dimY;
+            setupCell(mtls, &p, r.yStart + row % dimY, mtls->zStart + layer % dimZ,
+                      mtls->arrayStart + layer / dimZ, r.xStart);
+            runKernel(mtls, &p, r.xStart, r.xEnd);
+        }
+        if (timeSlice) {
+            recordSliceCost(mtls, getSpinTime() - t0, (rowEnd - rowStart) * (r.xEnd - r.xStart));
+            timeSlice = false;
         }
-        __sync_fetch_and_sub(&dc->mWorkers.mRunningCount, 1);
-        dc->mWorkers.mCompleteSignal.set();
     }
-
-    //ALOGV("RS helperThread exited %p idx=%i", dc, idx);
-    return NULL;
+    mtls->mSliceQueues[idx].mBusyNs = getSpinTime() - busyStart;
+    ATRACE_END();
 }
 
-void RsdCpuReferenceImpl::launchThreads(WorkerCallback_t cbk, void *data) {
-    mWorkers.mLaunchData = data;
-    mWorkers.mLaunchCallback = cbk;
+static void wc_x(void *usr, uint32_t idx) {
+    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
+    RsForEachStubParamStruct p;
+    memcpy(&p, &mtls->fep, sizeof(p));
+    p.lid = idx;
+    const void *ins[RS_KERNEL_INPUT_LIMIT];
+    p.ins = ins;
+    p.eStrideIns = mtls->eStrideIns;
+    uint32_t sig = mtls->sig;
 
-    // fast path for very small launches
-    MTLaunchStruct *mtls = (MTLaunchStruct *)data;
-    if (mtls && mtls->fep.dimY <= 1 && mtls->xEnd <= mtls->xStart + mtls->mSliceSize) {
-        if (mWorkers.mLaunchCallback) {
-            mWorkers.mLaunchCallback(mWorkers.mLaunchData, 0);
+    bool timeSlice = (idx == 0);
+    const uint64_t busyStart = getSpinTime();
+    ATRACE_BEGIN("RS worker slices");
+    uint32_t slice;
+    while (claimSlice(mtls, idx, &slice)) {
+        uint32_t xStart = mtls->xStart + slice * mtls->mSliceSize;
+        uint32_t xEnd = xStart + mtls->mSliceSize;
+        xEnd = rsMin(xEnd, mtls->xEnd);
+        if (xEnd <= xStart) {
+            continue;
         }
-        return;
-    }
 
-    mWorkers.mRunningCount = mWorkers.mCount;
-    __sync_synchronize();
+        //ALOGE("usr slice %i idx %i, x %i,%i", slice, idx, xStart, xEnd);
+        //ALOGE("usr ptr in %p,  out %p", mtls->fep.ptrIn, mtls->fep.ptrOut);
 
-    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
-        mWorkers.mLaunchSignals[ct].set();
+        setupRow(mtls, &p, 0, xStart);
+        uint64_t t0 = timeSlice ? getSpinTime() : 0;
+        runKernel(mtls, &p, xStart, xEnd);
+        if (timeSlice) {
+            recordSliceCost(mtls, getSpinTime() - t0, xEnd - xStart);
+            timeSlice = false;
+        }
     }
+    mtls->mSliceQueues[idx].mBusyNs = getSpinTime() - busyStart;
+    ATRACE_END();
+}
 
-    // We use the calling thread as one of the workers so we can start without
-    // the delay of the thread wakeup.
-    if (mWorkers.mLaunchCallback) {
-        mWorkers.mLaunchCallback(mWorkers.mLaunchData, 0);
+void RsdCpuReferenceImpl::gatherSliceStats(const MTLaunchStruct *mtls) {
+    uint32_t slices = 0;
+    uint32_t steals = 0;
+    uint32_t retries = 0;
+    for (uint32_t ct = 0; ct < mtls->mSliceQueueCount; ct++) {
+        slices += mtls->mSliceQueues[ct].mClaimed;
+        steals += mtls->mSliceQueues[ct].mStolen;
+        retries += mtls->mSliceQueues[ct].mRetries;
     }
-
-    while (__sync_fetch_and_or(&mWorkers.mRunningCount, 0) != 0) {
-        mWorkers.mCompleteSignal.wait();
+    // Launches of this context may complete on any pool thread.
+    __sync_fetch_and_add(&mSliceStats.mLaunches, 1);
+    __sync_fetch_and_add(&mSliceStats.mSlices, slices);
+    __sync_fetch_and_add(&mSliceStats.mSteals, steals);
+    __sync_fetch_and_add(&mSliceStats.mRetries, retries);
+
+    if (mRSC->props.mLogTimes) {
+        ALOGV("RS launch: %u slices of %u, %u stolen, %u CAS retries",
+              slices, mtls->mSliceSize, steals, retries);
     }
+    recordLaunch(mtls->script, &mtls->fep, getSpinTime() - mtls->mStartNs,
+                 mtls->mSliceQueues, mtls->mSliceQueueCount);
 }
 
-
-void RsdCpuReferenceImpl::lockMutex() {
-    pthread_mutex_lock(&gInitMutex);
+static uint32_t hashProfileKey(const RsdCpuScriptImpl *script,
+                               const RsForEachStubParamStruct *fep) {
+    uint64_t ptr = (uintptr_t)script;
+    uint32_t h = rsHashWord(RS_HASH_SEED, (uint32_t)ptr);
+    h = rsHashWord(h, (uint32_t)(ptr >> 32));
+    h = rsHashWord(h, fep->slot);
+    h = rsHashWord(h, fep->dimX);
+    h = rsHashWord(h, fep->dimY);
+    return rsHashWord(h, fep->dimZ);
 }
 
-void RsdCpuReferenceImpl::unlockMutex() {
-    pthread_mutex_unlock(&gInitMutex);
+// Returns the entry for the key, claiming a free one if there is none yet,
+// or NULL once the table is full.  Called with mProfileLock held.
+RsdCpuReferenceImpl::ProfileEntry * RsdCpuReferenceImpl::findProfile(
+        const RsdCpuScriptImpl *script, const RsForEachStubParamStruct *fep) {
+    if (!mProfile) {
+        mProfile = (ProfileEntry *)calloc(kProfileEntries, sizeof(ProfileEntry));
+        if (!mProfile) {
+            return NULL;
+        }
+    }
+    uint32_t idx = hashProfileKey(script, fep);
+    for (uint32_t probe = 0; probe < kProfileEntries; probe++) {
+        ProfileEntry *e = &mProfile[(idx + probe) & (kProfileEntries - 1)];
+        if (!e->mUsed) {
+            e->mUsed = true;
+            e->mScript = script;
+            e->mProfile.script = script ? (RsScript)((RsdCpuScriptImpl *)script)->getScript()
+                                        : NULL;
+            e->mProfile.slot = fep->slot;
+            e->mProfile.dimX = fep->dimX;
+            e->mProfile.dimY = fep->dimY;
+            e->mProfile.dimZ = fep->dimZ;
+            mProfileCount++;
+            return e;
+        }
+        if ((e->mScript == script) && (e->mProfile.slot == fep->slot) &&
+            (e->mProfile.dimX == fep->dimX) && (e->mProfile.dimY == fep->dimY) &&
+            (e->mProfile.dimZ == fep->dimZ)) {
+            return e;
+        }
+    }
+    return NULL;
 }
 
-#if defined(ARCH_ARM_HAVE_VFP)
-static int
-read_file(const char*  pathname, char*  buffer, size_t  buffsize)
-{
-    int  fd, len;
-
-    fd = open(pathname, O_RDONLY);
-    if (fd < 0)
-        return -1;
-
-    do {
-        len = read(fd, buffer, buffsize);
-    } while (len < 0 && errno == EINTR);
+void RsdCpuReferenceImpl::recordLaunch(const RsdCpuScriptImpl *script,
+                                       const RsForEachStubParamStruct *fep, uint64_t wallNs,
+                                       const MTSliceQueue *queues, uint32_t queueCount) {
+    pthread_mutex_lock(&mProfileLock);
+    ProfileEntry *e = findProfile(script, fep);
+    if (e) {
+        RsKernelProfile *p = &e->mProfile;
+        p->launches++;
+        p->wallNs += wallNs;
+        for (uint32_t ct = 0; ct < queueCount; ct++) {
+            p->slices += queues[ct].mClaimed;
+            p->steals += queues[ct].mStolen;
+            p->busyNs[rsMin(ct, (uint32_t)RS_KERNEL_PROFILE_WORKERS - 1)] += queues[ct].mBusyNs;
+        }
+    }
+    pthread_mutex_unlock(&mProfileLock);
+}
 
-    close(fd);
+extern size_t rsdIntrinsicColorMatrixTrimCode();
 
-    return len;
+size_t RsdCpuReferenceImpl::trimMemory() {
+    return rsdIntrinsicColorMatrixTrimCode();
 }
 
-static void GetCpuInfo() {
-    char cpuinfo[4096];
-    int  cpuinfo_len;
-
-    cpuinfo_len = read_file("/proc/cpuinfo", cpuinfo, sizeof cpuinfo);
-    if (cpuinfo_len < 0)  /* should not happen */ {
-        return;
+int32_t RsdCpuReferenceImpl::idle() {
+    const uint64_t now = getSpinTime();
+    int32_t wait = mPerfBoost->idle(now);
+    int32_t poolWait = mPool ? mPool->idle(now) : -1;
+    if ((wait < 0) || ((poolWait >= 0) && (poolWait < wait))) {
+        wait = poolWait;
     }
-
-    gArchUseSIMD = !!strstr(cpuinfo, " neon");
+    return wait;
 }
-#endif // ARCH_ARM_HAVE_VFP
-
-bool RsdCpuReferenceImpl::init(uint32_t version_major, uint32_t version_minor,
-                               sym_lookup_t lfn, script_lookup_t slfn) {
-
-    mSymLookupFn = lfn;
-    mScriptLookupFn = slfn;
 
-    lockMutex();
-    if (!gThreadTLSKeyCount) {
-        int status = pthread_key_create(&gThreadTLSKey, NULL);
-        if (status) {
-            ALOGE("Failed to init thread tls key.");
-            unlockMutex();
-            return false;
+uint32_t RsdCpuReferenceImpl::getProfile(RsKernelProfile *profiles, uint32_t count) const {
+    pthread_mutex_lock(&mProfileLock);
+    uint32_t copied = 0;
+    for (uint32_t ct = 0; mProfile && (ct < kProfileEntries) && (copied < count); ct++) {
+        if (mProfile[ct].mUsed) {
+            profiles[copied++] = mProfile[ct].mProfile;
         }
     }
-    gThreadTLSKeyCount++;
-    unlockMutex();
+    uint32_t total = mProfileCount;
+    pthread_mutex_unlock(&mProfileLock);
+    return total;
+}
 
-    mTlsStruct.mContext = mRSC;
-    mTlsStruct.mScript = NULL;
-    int status = pthread_setspecific(gThreadTLSKey, &mTlsStruct);
-    if (status) {
-        ALOGE("pthread_setspecific %i", status);
+void RsdCpuReferenceImpl::dropProfile(const RsdCpuScriptImpl *script) {
+    pthread_mutex_lock(&mProfileLock);
+    if (mProfile) {
+        // Removing entries would break the probe chains of the ones after
+        // them, so the survivors are put back into an empty table.
+        ProfileEntry *old = mProfile;
+        mProfile = (ProfileEntry *)calloc(kProfileEntries, sizeof(ProfileEntry));
+        mProfileCount = 0;
+        for (uint32_t ct = 0; mProfile && (ct < kProfileEntries); ct++) {
+            if (!old[ct].mUsed || (old[ct].mScript == script)) {
+                continue;
+            }
+            RsForEachStubParamStruct fep;
+            fep.slot = old[ct].mProfile.slot;
+            fep.dimX = old[ct].mProfile.dimX;
+            fep.dimY = old[ct].mProfile.dimY;
+            fep.dimZ = old[ct].mProfile.dimZ;
+            ProfileEntry *e = findProfile(old[ct].mScript, &fep);
+            e->mProfile = old[ct].mProfile;
+        }
+        free(old);
     }
+    pthread_mutex_unlock(&mProfileLock);
+}
 
-#if defined(ARCH_ARM_HAVE_VFP)
-    GetCpuInfo();
-#endif
+// Choose the workers taking part in a launch from its hints, out of the
+// first workerLimit workers of the pool.  The submitting thread always
+// does.  Background launches use at most half of those and take the last
+// ones, which sit on the slowest cores.
+void RsdCpuReferenceImpl::setupLaunchWorkers(MTLaunchStruct *mtls, uint32_t workerLimit) {
+    const uint32_t poolWorkers = mPool->getWorkerCount() + 1;
+    uint32_t workers = rsMin(workerLimit, poolWorkers);
+    if (workers < poolWorkers) {
+        // Only the first 64 workers can be named in the mask.
+        workers = rsMin(workers, (uint32_t)64);
+    }
+    uint32_t limit = workers;
+    if (mtls->mMaxThreads) {
+        limit = rsMin(limit, mtls->mMaxThreads);
+    }
+    if (mtls->mBackground) {
+        limit = rsMin(limit, rsMax(workers / 2, (uint32_t)1));
+    }
+    mtls->mWorkerCount = limit;
 
-    int cpu = sysconf(_SC_NPROCESSORS_ONLN);
-    if(mRSC->props.mDebugMaxThreads) {
-        cpu = mRSC->props.mDebugMaxThreads;
+    if (limit == poolWorkers) {
+        mtls->mWorkerMask = ~0ULL;
+        return;
     }
-    if (cpu < 2) {
-        mWorkers.mCount = 0;
-        return true;
+    mtls->mWorkerMask = 1;
+    uint32_t first = mtls->mBackground ? (workers - limit + 1) : 1;
+    for (uint32_t ct = first; ct < first + limit - 1; ct++) {
+        mtls->mWorkerMask |= 1ULL << ct;
     }
+}
 
-    // Subtract one from the cpu count because we also use the command thread as a worker.
-    mWorkers.mCount = (uint32_t)(cpu - 1);
+// Pick the launch mode and slice size for mtls and split its slices over
+// queues, one per worker.  costPs is the measured cost of the kernel, or 0
+// if unknown.  Returns the worker callback for the launch.
+WorkerCallback_t RsdCpuReferenceImpl::setupSlices(MTLaunchStruct *mtls, MTSliceQueue *queues,
+                                                  uint32_t costPs, uint32_t workerLimit) {
+    const size_t targetByteChunk = 16 * 1024;
+    const uint32_t *weights = mPool->getWorkerWeights();
+    mtls->mSliceQueues = queues;
+    mtls->mSliceQueueCount = mPool->getWorkerCount() + 1;
+    setupLaunchWorkers(mtls, workerLimit);
+
+    // Once a kernel slot has been timed, size slices to take about
+    // kTargetSliceNs each; that keeps claims rare for cheap kernels and
+    // slices short for expensive ones.  The byte heuristic is only a
+    // starting point for kernels we haven't timed yet.
+    const uint32_t xCount = mtls->xEnd - mtls->xStart;
+
+    WorkerCallback_t cbk;
+    const uint32_t rowCount = getRowCount(mtls);
+    if (mtls->mRegionCount) {
+        // Rows are sized as for a launch as wide as the average region, and
+        // each region is split into slices of them.
+        uint64_t cells = 0;
+        for (uint32_t ct = 0; ct < mtls->mRegionCount; ct++) {
+            const RsScriptRect &r = mtls->mRegions[ct];
+            cells += (uint64_t)(r.xEnd - r.xStart) * (r.yEnd - r.yStart);
+        }
+        const uint32_t layers = (mtls->zEnd - mtls->zStart) *
+                                (mtls->arrayEnd - mtls->arrayStart);
+        const uint32_t width = (uint32_t)rsMax(cells * layers / mtls->mRegionRows,
+                                               (uint64_t)1);
+        uint32_t s1 = mtls->mRegionRows / (mtls->mWorkerCount * 4);
+        uint32_t s2 = 0;
+        if (costPs) {
+            s2 = (uint32_t)((kTargetSliceNs * 1000) / ((uint64_t)costPs * width));
+        } else {
+            uint32_t eStride = rsMax(rsMax(mtls->fep.eStrideIn, mtls->fep.eStrideOut),
+                                     (uint32_t)1);
+            s2 = targetByteChunk / (width * eStride);
+        }
+        mtls->mSliceSize = rsMax(rsMin(s1, s2), (uint32_t)1);
 
-    ALOGV("%p Launching thread(s), CPUs %i", mRSC, mWorkers.mCount + 1);
+        uint32_t slices = 0;
+        for (uint32_t ct = 0; ct < mtls->mRegionCount; ct++) {
+            const RsScriptRect &r = mtls->mRegions[ct];
+            slices += ((r.yEnd - r.yStart) * layers + mtls->mSliceSize - 1) / mtls->mSliceSize;
+        }
+        initSliceQueues(mtls, slices, weights);
+        cbk = wc_regions;
+    } else if (mtls->mTileBytes && rowCount > 1) {
+        // Pick a roughly square tile of mTileBytes.  The width is kept a
+        // multiple of 16 elements so SIMD kernels see full vectors.
+        uint32_t eStride = rsMax(rsMax(mtls->fep.eStrideIn, mtls->fep.eStrideOut),
+                                 (uint32_t)1);
+        uint32_t side = (uint32_t)sqrtf((float)(mtls->mTileBytes / eStride));
+        mtls->mTileSizeX = rsMin(rsMax((side + 15) & ~15, (uint32_t)16),
+                                 mtls->xEnd - mtls->xStart);
+        mtls->mTileSizeY = rsMin(rsMax(mtls->mTileBytes / (mtls->mTileSizeX * eStride),
+                                       (uint32_t)1), rowCount);
+        mtls->mSliceSize = 1;
+
+        uint32_t tilesX = (mtls->xEnd - mtls->xStart + mtls->mTileSizeX - 1) /
+                          mtls->mTileSizeX;
+        uint32_t tilesY = (rowCount + mtls->mTileSizeY - 1) / mtls->mTileSizeY;
+        initSliceQueues(mtls, tilesX * tilesY, weights);
+        cbk = wc_tile;
+    } else if (rowCount > 1) {
+        uint32_t s1 = rowCount / (mtls->mWorkerCount * 4);
+        uint32_t s2 = 0;
+
+        // This chooses our slice size to rate limit atomic ops to
+        // one per 16k bytes of reads/writes.
+        if (costPs) {
+            s2 = (uint32_t)((kTargetSliceNs * 1000) / ((uint64_t)costPs * rsMax(xCount, (uint32_t)1)));
+        } else if (mtls->fep.yStrideOut) {
+            s2 = targetByteChunk / mtls->fep.yStrideOut;
+        } else {
+            s2 = targetByteChunk / mtls->fep.yStrideIn;
+        }
+        mtls->mSliceSize = rsMin(s1, s2);
 
-    mWorkers.mThreadId = (pthread_t *) calloc(mWorkers.mCount, sizeof(pthread_t));
-    mWorkers.mNativeThreadId = (pid_t *) calloc(mWorkers.mCount, sizeof(pid_t));
-    mWorkers.mLaunchSignals = new Signal[mWorkers.mCount];
-    mWorkers.mLaunchCallback = NULL;
+        if(mtls->mSliceSize < 1) {
+            mtls->mSliceSize = 1;
+        }
 
-    mWorkers.mCompleteSignal.init();
+     //   mtls->mSliceSize = 2;
+        initSliceQueues(mtls, (rowCount + mtls->mSliceSize - 1) / mtls->mSliceSize,
+                        weights);
+        cbk = wc_xy;
+    } else {
+        uint32_t s1 = xCount / (mtls->mWorkerCount * 4);
+        uint32_t s2 = 0;
+
+        // This chooses our slice size to rate limit atomic ops to
+        // one per 16k bytes of reads/writes.
+        if (costPs) {
+            s2 = (uint32_t)rsMin((kTargetSliceNs * 1000) / costPs, (uint64_t)0xffffffff);
+        } else if (mtls->fep.eStrideOut) {
+            s2 = targetByteChunk / mtls->fep.eStrideOut;
+        } else {
+            s2 = targetByteChunk / mtls->fep.eStrideIn;
+        }
+        mtls->mSliceSize = rsMin(s1, s2);
 
-    mWorkers.mRunningCount = mWorkers.mCount;
-    mWorkers.mLaunchCount = 0;
-    __sync_synchronize();
+        if(mtls->mSliceSize < 1) {
+            mtls->mSliceSize = 1;
+        }
 
-    pthread_attr_t threadAttr;
-    status = pthread_attr_init(&threadAttr);
-    if (status) {
-        ALOGE("Failed to init thread attribute.");
-        return false;
+        initSliceQueues(mtls, (mtls->xEnd - mtls->xStart + mtls->mSliceSize - 1) /
+                              mtls->mSliceSize, weights);
+        cbk = wc_x;
     }
+    return cbk;
+}
 
-    for (uint32_t ct=0; ct < mWorkers.mCount; ct++) {
-        status = pthread_create(&mWorkers.mThreadId[ct], &threadAttr, helperThreadProc, this);
-        if (status) {
-            mWorkers.mCount = ct;
-            ALOGE("Created fewer than expected number of RS threads.");
-            break;
-        }
+// The cells a launch covers, over all its regions and layers.
+static uint64_t getLaunchCells(const MTLaunchStruct *mtls) {
+    if (!mtls->mRegionCount) {
+        return (uint64_t)(mtls->xEnd - mtls->xStart) * getRowCount(mtls);
     }
-    while (__sync_fetch_and_or(&mWorkers.mRunningCount, 0) != 0) {
-        usleep(100);
+    uint64_t cells = 0;
+    for (uint32_t ct = 0; ct < mtls->mRegionCount; ct++) {
+        const RsScriptRect &r = mtls->mRegions[ct];
+        cells += (uint64_t)(r.xEnd - r.xStart) * (r.yEnd - r.yStart);
     }
-
-    pthread_attr_destroy(&threadAttr);
-    return true;
+    return cells * (mtls->zEnd - mtls->zStart) * (mtls->arrayEnd - mtls->arrayStart);
 }
 
+static const uint32_t kUntimedCostPs = 1000;
 
-void RsdCpuReferenceImpl::setPriority(int32_t priority) {
-    for (uint32_t ct=0; ct < mWorkers.mCount; ct++) {
-        setpriority(PRIO_PROCESS, mWorkers.mNativeThreadId[ct], priority);
-    }
+// Launches only run in strips once the files they walk add up to this
+// much, and strips cover about kStripBytes of them.
+static const size_t kStripMinBytes = 32 * 1024 * 1024;
+static const size_t kStripBytes = 4 * 1024 * 1024;
+
+RsdCpuStripSet::RsdCpuStripSet() {
+    mCount = 0;
+    mRowBytes = 0;
+    mBytes = 0;
 }
 
-RsdCpuReferenceImpl::~RsdCpuReferenceImpl() {
-    mExit = true;
-    mWorkers.mLaunchData = NULL;
-    mWorkers.mLaunchCallback = NULL;
-    mWorkers.mRunningCount = mWorkers.mCount;
-    __sync_synchronize();
-    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
-        mWorkers.mLaunchSignals[ct].set();
+void RsdCpuStripSet::add(const Allocation *a, bool written) {
+    if (!a || !a->mHal.drvState.fileBacked || (mCount == kMaxAllocs) ||
+        (a->mHal.drvState.lodCount > 1) || a->mHal.drvState.faceCount ||
+        (a->mHal.drvState.lod[0].dimZ > 1)) {
+        return;
     }
-    void *res;
-    for (uint32_t ct = 0; ct < mWorkers.mCount; ct++) {
-        pthread_join(mWorkers.mThreadId[ct], &res);
+    for (uint32_t ct = 0; ct < mCount; ct++) {
+        if (mAllocs[ct] == a) {
+            mWritten[ct] |= written;
+            return;
+        }
     }
-    rsAssert(__sync_fetch_and_or(&mWorkers.mRunningCount, 0) == 0);
+    mAllocs[mCount] = a;
+    mWritten[mCount] = written;
+    mCount++;
+    mRowBytes += a->mHal.drvState.lod[0].stride;
+    mBytes += a->mHal.drvState.lod[0].stride * rsMax(a->mHal.drvState.lod[0].dimY, 1u);
+}
 
-    // Global structure cleanup.
-    lockMutex();
-    --gThreadTLSKeyCount;
-    if (!gThreadTLSKeyCount) {
-        pthread_key_delete(gThreadTLSKey);
+uint32_t RsdCpuStripSet::getStripRows(uint32_t yStart, uint32_t yEnd, uint32_t threads) const {
+    if (!mCount || (mBytes < kStripMinBytes)) {
+        return 0;
     }
-    unlockMutex();
-
+    // Enough rows for every thread to get a few slices.
+    const uint32_t rows = rsMax((uint32_t)(kStripBytes / mRowBytes), threads * 4);
+    return (rows < yEnd - yStart) ? rows : 0;
 }
 
-typedef void (*rs_t)(const void *, void *, const void *, uint32_t, uint32_t, uint32_t, uint32_t);
-
-static void wc_xy(void *usr, uint32_t idx) {
-    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
-    RsForEachStubParamStruct p;
-    memcpy(&p, &mtls->fep, sizeof(p));
-    p.lid = idx;
-    uint32_t sig = mtls->sig;
-
-    outer_foreach_t fn = (outer_foreach_t) mtls->kernel;
-    while (1) {
-        uint32_t slice = (uint32_t)__sync_fetch_and_add(&mtls->mSliceNum, 1);
-        uint32_t yStart = mtls->yStart + slice * mtls->mSliceSize;
-        uint32_t yEnd = yStart + mtls->mSliceSize;
-        yEnd = rsMin(yEnd, mtls->yEnd);
-        if (yEnd <= yStart) {
-            return;
-        }
-
-        //ALOGE("usr idx %i, x %i,%i  y %i,%i", idx, mtls->xStart, mtls->xEnd, yStart, yEnd);
-        //ALOGE("usr ptr in %p,  out %p", mtls->fep.ptrIn, mtls->fep.ptrOut);
+// The pages holding rows [y1, y2) of a, clipped to the allocation.
+static bool getStripPages(const Allocation *a, uint32_t y1, uint32_t y2,
+                          uint8_t **start, size_t *bytes) {
+    const Allocation::Hal::DrvState::LodState &lod = a->mHal.drvState.lod[0];
+    y2 = rsMin(y2, rsMax(lod.dimY, 1u));
+    if (y1 >= y2) {
+        return false;
+    }
+    const uintptr_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+    const uintptr_t begin = ((uintptr_t)lod.mallocPtr + y1 * lod.stride) & ~pageMask;
+    const uintptr_t end = ((uintptr_t)lod.mallocPtr + y2 * lod.stride + pageMask) & ~pageMask;
+    *start = (uint8_t *)begin;
+    *bytes = end - begin;
+    return true;
+}
 
-        for (p.y = yStart; p.y < yEnd; p.y++) {
-            p.out = mtls->fep.ptrOut + (mtls->fep.yStrideOut * p.y) +
-                    (mtls->fep.eStrideOut * mtls->xStart);
-            p.in = mtls->fep.ptrIn + (mtls->fep.yStrideIn * p.y) +
-                   (mtls->fep.eStrideIn * mtls->xStart);
-            fn(&p, mtls->xStart, mtls->xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
+void RsdCpuStripSet::prefetch(uint32_t y1, uint32_t y2) const {
+    for (uint32_t ct = 0; ct < mCount; ct++) {
+        uint8_t *start;
+        size_t bytes;
+        if (getStripPages(mAllocs[ct], y1, y2, &start, &bytes)) {
+            madvise(start, bytes, MADV_WILLNEED);
         }
     }
 }
 
-static void wc_x(void *usr, uint32_t idx) {
-    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
-    RsForEachStubParamStruct p;
-    memcpy(&p, &mtls->fep, sizeof(p));
-    p.lid = idx;
-    uint32_t sig = mtls->sig;
-
-    outer_foreach_t fn = (outer_foreach_t) mtls->kernel;
-    while (1) {
-        uint32_t slice = (uint32_t)__sync_fetch_and_add(&mtls->mSliceNum, 1);
-        uint32_t xStart = mtls->xStart + slice * mtls->mSliceSize;
-        uint32_t xEnd = xStart + mtls->mSliceSize;
-        xEnd = rsMin(xEnd, mtls->xEnd);
-        if (xEnd <= xStart) {
-            return;
+// Pages shared with the next strip are dropped too; they are only read
+// back in from the file.
+void RsdCpuStripSet::release(uint32_t y1, uint32_t y2) const {
+    for (uint32_t ct = 0; ct < mCount; ct++) {
+        uint8_t *start;
+        size_t bytes;
+        if (getStripPages(mAllocs[ct], y1, y2, &start, &bytes)) {
+            if (mWritten[ct]) {
+                msync(start, bytes, MS_ASYNC);
+            }
+            madvise(start, bytes, MADV_DONTNEED);
         }
+    }
+}
 
-        //ALOGE("usr slice %i idx %i, x %i,%i", slice, idx, xStart, xEnd);
-        //ALOGE("usr ptr in %p,  out %p", mtls->fep.ptrIn, mtls->fep.ptrOut);
+RsdCpuScratch::RsdCpuScratch(uint32_t threads) {
+    mThreads = threads;
+    mBuffers = new void *[threads];
+    mSizes = new size_t[threads];
+    memset(mBuffers, 0, sizeof(void *) * threads);
+    memset(mSizes, 0, sizeof(size_t) * threads);
+}
 
-        p.out = mtls->fep.ptrOut + (mtls->fep.eStrideOut * xStart);
-        p.in = mtls->fep.ptrIn + (mtls->fep.eStrideIn * xStart);
-        fn(&p, xStart, xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
+RsdCpuScratch::~RsdCpuScratch() {
+    for (uint32_t ct = 0; ct < mThreads; ct++) {
+        free(mBuffers[ct]);
     }
+    delete []mBuffers;
+    delete []mSizes;
 }
 
-void RsdCpuReferenceImpl::launchThreads(const Allocation * ain, Allocation * aout,
-                                     const RsScriptCall *sc, MTLaunchStruct *mtls) {
+void * RsdCpuScratch::get(uint32_t lid, size_t bytes, size_t align) {
+    // malloc only aligns to 8 bytes, so the buffer is padded to align it.
+    const size_t size = bytes + align;
+    if (size > mSizes[lid]) {
+        free(mBuffers[lid]);
+        mBuffers[lid] = malloc(size);
+        mSizes[lid] = mBuffers[lid] ? size : 0;
+        if (!mBuffers[lid]) {
+            return NULL;
+        }
+    }
+    return (void *)(((uintptr_t)mBuffers[lid] + align - 1) & ~(uintptr_t)(align - 1));
+}
 
-    //android::StopWatch kernel_time("kernel time");
+void RsdCpuReferenceImpl::launchStrips(const Allocation * ain, Allocation * aout,
+                                       const RsScriptCall *sc, MTLaunchStruct *mtls,
+                                       const RsdCpuStripSet &strips, uint32_t rows) {
+    ATRACE_CALL();
+    const uint32_t yStart = mtls->yStart;
+    const uint32_t yEnd = mtls->yEnd;
+    // Strips are dropped as soon as they are done, so they can't be left
+    // running.
+    mtls->mAsync = false;
+    mtls->mStripped = true;
+
+    strips.prefetch(yStart, rsMin(yStart + rows, yEnd));
+    for (uint32_t y1 = yStart; y1 < yEnd; y1 += rows) {
+        const uint32_t y2 = rsMin(y1 + rows, yEnd);
+        strips.prefetch(y2, rsMin(y2 + rows, yEnd));
+        mtls->yStart = y1;
+        mtls->yEnd = y2;
+        launchThreads(ain, aout, sc, mtls);
+        strips.release(y1, y2);
+    }
 
-    if ((mWorkers.mCount >= 1) && mtls->isThreadable && !mInForEach) {
-        const size_t targetByteChunk = 16 * 1024;
-        mInForEach = true;
-        if (mtls->fep.dimY > 1) {
-            uint32_t s1 = mtls->fep.dimY / ((mWorkers.mCount + 1) * 4);
-            uint32_t s2 = 0;
+    mtls->yStart = yStart;
+    mtls->yEnd = yEnd;
+    mtls->mStripped = false;
+}
 
-            // This chooses our slice size to rate limit atomic ops to
-            // one per 16k bytes of reads/writes.
-            if (mtls->fep.yStrideOut) {
-                s2 = targetByteChunk / mtls->fep.yStrideOut;
-            } else {
-                s2 = targetByteChunk / mtls->fep.yStrideIn;
-            }
-            mtls->mSliceSize = rsMin(s1, s2);
+int RsdCpuReferenceImpl::launchThreads(const Allocation * ain, Allocation * aout,
+                                    const RsScriptCall *sc, MTLaunchStruct *mtls) {
+    char traceName[128];
+    if (ATRACE_ENABLED()) {
+        const char *kernel = mtls->script ? mtls->script->getKernelName(mtls->fep.slot) : NULL;
+        snprintf(traceName, sizeof(traceName), "RS launch %s slot %u %ux%ux%u",
+                 kernel ? kernel : "", mtls->fep.slot, mtls->fep.dimX, mtls->fep.dimY,
+                 mtls->fep.dimZ);
+    } else {
+        traceName[0] = 0;
+    }
+    ATRACE_NAME(traceName);
+
+    // Launches made from inside a running kernel can't go through the launch
+    // ring, since the worker issuing them is itself part of a launch.
+    const uint32_t workerIdx = mPool->getWorkerIndex();
+    LaunchLane *entered = (workerIdx == 0) ? enterLane() : NULL;
+    LaunchLane *lane = getLane();
+    const bool nested = lane->mInForEach || (workerIdx != 0);
+    if (!nested) {
+        waitForConflicts(mtls->script, ain, aout);
+        for (uint32_t ct = 1; ct < mtls->fep.inLen; ct++) {
+            waitForConflicts(mtls->script, mtls->ains[ct], NULL);
+        }
+    }
 
-            if(mtls->mSliceSize < 1) {
-                mtls->mSliceSize = 1;
-            }
+    // Group launches run over allocations they don't name here, and split
+    // themselves.  Reductions keep per launch accumulators.
+    if (!nested && mtls->script && !mtls->mStripped && !mtls->mRegionCount &&
+        !mtls->mAccumStride && ((mtls->zEnd - mtls->zStart) <= 1) &&
+        ((mtls->arrayEnd - mtls->arrayStart) <= 1)) {
+        RsdCpuStripSet strips;
+        strips.add(ain, false);
+        for (uint32_t ct = 1; ct < mtls->fep.inLen; ct++) {
+            strips.add(mtls->ains[ct], false);
+        }
+        strips.add(aout, true);
+        const uint32_t rows = strips.getStripRows(mtls->yStart, mtls->yEnd, getThreadCount());
+        if (rows) {
+            leaveLane(entered);
+            launchStrips(ain, aout, sc, mtls, strips, rows);
+            return 0;
+        }
+    }
 
-         //   mtls->mSliceSize = 2;
-            launchThreads(wc_xy, mtls);
-        } else {
-            uint32_t s1 = mtls->fep.dimX / ((mWorkers.mCount + 1) * 4);
-            uint32_t s2 = 0;
+    int fence = 0;
+    int entry = -1;
+    const uint32_t poolWorkers = mPool->hasWorkers() ? mPool->getWorkerCount() : 0;
+    mtls->mStartNs = getSpinTime();
+    if ((poolWorkers >= 1) && mtls->isThreadable && !nested) {
+        lane->mInForEach = true;
+        // Cost estimates are only read and updated here, by the thread
+        // submitting the launch.
+        uint32_t costPs = mtls->script ? mtls->script->getKernelCost(mtls->fep.slot) : 0;
+        if (!mtls->mTuned && mtls->script && mtls->script->usePrefetch(mtls->fep.slot)) {
+            mtls->fep.prefetchRows = mPrefetchRows;
+        }
+        WorkerCallback_t cbk = setupSlices(mtls, lane->mSliceQueues, costPs, mWorkerLimit);
+        uint32_t sliceCostPs = 0;
+        if (mPerfBoost->isEnabled() && (mtls->mSliceCount > 1) && (mtls->mWorkerCount > 1)) {
+            // Kernels not timed yet are taken to be cheap, so only their
+            // largest launches are hinted.
+            uint64_t workNs = getLaunchCells(mtls) * (costPs ? costPs : kUntimedCostPs) / 1000;
+            mPerfBoost->launch(workNs, mtls->mWorkerCount, mtls->mStartNs);
+        }
 
-            // This chooses our slice size to rate limit atomic ops to
-            // one per 16k bytes of reads/writes.
-            if (mtls->fep.eStrideOut) {
-                s2 = targetByteChunk / mtls->fep.eStrideOut;
-            } else {
-                s2 = targetByteChunk / mtls->fep.eStrideIn;
+        if ((mtls->mSliceCount <= 1) || (mtls->mWorkerCount <= 1)) {
+            // fast path for very small launches
+            cbk(mtls, 0);
+            gatherSliceStats(mtls);
+            sliceCostPs = lane->mSliceQueues[0].mCostPs;
+            mergeAccumulators(lane);
+        } else if (mtls->mAsync && !mtls->mRegionCount &&
+                   (mtls->fep.usrLen <= RS_ASYNC_LAUNCH_USR_BYTES) &&
+                   mPool->beginSubmit()) {
+            if (mAsyncCount == kMaxAsyncLaunches) {
+                waitForFence(mAsyncLaunches[0].mFence);
+                retireLaunches();
             }
-            mtls->mSliceSize = rsMin(s1, s2);
 
-            if(mtls->mSliceSize < 1) {
-                mtls->mSliceSize = 1;
+            // The launch outlives the caller's state, so hand the workers a
+            // copy.  Its stats are gathered by whichever worker finishes it.
+            MTLaunchSlot *slot = mPool->acquireLaunchSlot(lane->mWaiter, &lane->mTls, &fence);
+            memcpy(&slot->mMtls, mtls, sizeof(MTLaunchStruct));
+            memcpy(slot->mSliceQueues, lane->mSliceQueues,
+                   mtls->mSliceQueueCount * sizeof(MTSliceQueue));
+            slot->mMtls.mSliceQueues = slot->mSliceQueues;
+            if (mtls->fep.usrLen) {
+                memcpy(slot->mUsr, mtls->fep.usr, mtls->fep.usrLen);
+                slot->mMtls.fep.usr = slot->mUsr;
             }
-
-            launchThreads(wc_x, mtls);
+            slot->mCallback = cbk;
+            slot->mData = &slot->mMtls;
+            slot->mOwner = this;
+            slot->mTls = &lane->mTls;
+            slot->mStats = &slot->mMtls;
+            mPool->publishLaunch(slot, fence);
+            mPool->endSubmit();
+            cbk(&slot->mMtls, 0);
+            // Once we let go of the slot it may be handed to another launch.
+            sliceCostPs = slot->mSliceQueues[0].mCostPs;
+            mPool->releaseLaunch(slot);
+
+            AsyncLaunch *pending = &mAsyncLaunches[mAsyncCount++];
+            pending->mFence = fence;
+            pending->mScript = mtls->script;
+            pending->mIn = ain;
+            pending->mOut = aout;
+            mRSC->mPendingAsyncWork = true;
+        } else {
+            // Also taken by async launches once the helpers failed to
+            // start, and then runs all of the launch here.
+            fence = runLaunch(lane, cbk, mtls, mtls);
+            sliceCostPs = lane->mSliceQueues[0].mCostPs;
+            mergeAccumulators(lane);
+        }
+        if (mtls->script && sliceCostPs) {
+            mtls->script->updateKernelCost(mtls->fep.slot, sliceCostPs);
         }
-        mInForEach = false;
+        lane->mInForEach = false;
 
         //ALOGE("launch 1");
+    } else if ((poolWorkers >= 1) && mtls->isThreadable && nested &&
+               ((entry = mPool->reserveNestedLaunch()) >= 0)) {
+        MTSliceQueue *queues = mPool->getNestedSliceQueues(entry);
+        // The issuing worker must be able to drain the launch by itself, so
+        // nested launches ignore the launch hints and worker limit.
+        mtls->mMaxThreads = 0;
+        mtls->mBackground = false;
+        WorkerCallback_t cbk = setupSlices(mtls, queues, 0, poolWorkers + 1);
+        if ((mtls->mSliceCount <= 1) || (mtls->mWorkerCount <= 1)) {
+            cbk(mtls, workerIdx);
+            mPool->releaseNestedLaunch(entry);
+        } else {
+            mPool->runNestedLaunch(entry, (ScriptTLSStruct *)pthread_getspecific(gThreadTLSKey),
+                                   cbk, mtls, workerIdx);
+        }
+
+        //ALOGE("launch 2");
     } else {
         RsForEachStubParamStruct p;
         memcpy(&p, &mtls->fep, sizeof(p));
+        p.lid = workerIdx;
+        const void *ins[RS_KERNEL_INPUT_LIMIT];
+        p.ins = ins;
+        p.eStrideIns = mtls->eStrideIns;
         uint32_t sig = mtls->sig;
 
         //ALOGE("launch 3");
-        outer_foreach_t fn = (outer_foreach_t) mtls->kernel;
-        for (p.ar[0] = mtls->arrayStart; p.ar[0] < mtls->arrayEnd; p.ar[0]++) {
-            for (p.z = mtls->zStart; p.z < mtls->zEnd; p.z++) {
-                for (p.y = mtls->yStart; p.y < mtls->yEnd; p.y++) {
-                    uint32_t offset = mtls->fep.dimY * mtls->fep.dimZ * p.ar[0] +
-                                      mtls->fep.dimY * p.z + p.y;
-                    p.out = mtls->fep.ptrOut + (mtls->fep.yStrideOut * offset) +
-                            (mtls->fep.eStrideOut * mtls->xStart);
-                    p.in = mtls->fep.ptrIn + (mtls->fep.yStrideIn * offset) +
-                           (mtls->fep.eStrideIn * mtls->xStart);
-                    fn(&p, mtls->xStart, mtls->xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
+        // A launch without regions runs as one covering its ranges.
+        const RsScriptRect whole = {mtls->xStart, mtls->xEnd, mtls->yStart, mtls->yEnd};
+        const RsScriptRect *regions = mtls->mRegionCount ? mtls->mRegions : &whole;
+        const uint32_t regionCount = rsMax(mtls->mRegionCount, (uint32_t)1);
+        for (uint32_t ct = 0; ct < regionCount; ct++) {
+            const RsScriptRect &r = regions[ct];
+            for (uint32_t ar = mtls->arrayStart; ar < mtls->arrayEnd; ar++) {
+                for (uint32_t z = mtls->zStart; z < mtls->zEnd; z++) {
+                    for (uint32_t y = r.yStart; y < r.yEnd; y++) {
+                        setupCell(mtls, &p, y, z, ar, r.xStart);
+                        runKernel(mtls, &p, r.xStart, r.xEnd);
+                    }
                 }
             }
         }
+        if (!nested) {
+            MTSliceQueue serial;
+            memset(&serial, 0, sizeof(serial));
+            serial.mClaimed = 1;
+            serial.mBusyNs = getSpinTime() - mtls->mStartNs;
+            recordLaunch(mtls->script, &mtls->fep, serial.mBusyNs, &serial, 1);
+        }
     }
+    leaveLane(entered);
+    return fence;
 }
 
 RsdCpuScriptImpl * RsdCpuReferenceImpl::setTLS(RsdCpuScriptImpl *sc) {
@@ -496,6 +2342,9 @@ RsdCpuReference::CpuScript * RsdCpuReferenceImpl::createScript(const ScriptC *s,
                                     uint8_t const *bitcode, size_t bitcodeSize,
                                     uint32_t flags) {
 
+    // Intrinsic schedules are kept with the app's compiled scripts.
+    mIntrinsicTuning->setCacheDir(cacheDir);
+
     RsdCpuScriptImpl *i = new RsdCpuScriptImpl(this, s);
     if (!i->init(resName, cacheDir, bitcode, bitcodeSize, flags)) {
         delete i;
@@ -514,10 +2363,42 @@ extern RsdCpuScriptImpl * rsdIntrinsic_LUT(RsdCpuReferenceImpl *ctx,
                                            const Script *s, const Element *e);
 extern RsdCpuScriptImpl * rsdIntrinsic_Convolve5x5(RsdCpuReferenceImpl *ctx,
                                                    const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Convolve(RsdCpuReferenceImpl *ctx,
+                                                const Script *s, const Element *e);
 extern RsdCpuScriptImpl * rsdIntrinsic_Blur(RsdCpuReferenceImpl *ctx,
                                             const Script *s, const Element *e);
 extern RsdCpuScriptImpl * rsdIntrinsic_YuvToRGB(RsdCpuReferenceImpl *ctx,
                                                 const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_RGBToYuv(RsdCpuReferenceImpl *ctx,
+                                                const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Resize(RsdCpuReferenceImpl *ctx,
+                                              const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Convert(RsdCpuReferenceImpl *ctx,
+                                               const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Pyramid(RsdCpuReferenceImpl *ctx,
+                                               const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Rotate(RsdCpuReferenceImpl *ctx,
+                                              const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Warp(RsdCpuReferenceImpl *ctx,
+                                            const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Morphology(RsdCpuReferenceImpl *ctx,
+                                                  const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Median(RsdCpuReferenceImpl *ctx,
+                                              const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Bilateral(RsdCpuReferenceImpl *ctx,
+                                                 const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Integral(RsdCpuReferenceImpl *ctx,
+                                                const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Scan(RsdCpuReferenceImpl *ctx,
+                                            const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Gemm(RsdCpuReferenceImpl *ctx,
+                                            const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_ETC1(RsdCpuReferenceImpl *ctx,
+                                            const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Demosaic(RsdCpuReferenceImpl *ctx,
+                                                const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_ConvolveQ8(RsdCpuReferenceImpl *ctx,
+                                                  const Script *s, const Element *e);
 extern RsdCpuScriptImpl * rsdIntrinsic_Blend(RsdCpuReferenceImpl *ctx,
                                              const Script *s, const Element *e);
 extern RsdCpuScriptImpl * rsdIntrinsic_Histogram(RsdCpuReferenceImpl *ctx,
@@ -543,12 +2424,60 @@ RsdCpuReference::CpuScript * RsdCpuReferenceImpl::createIntrinsic(const Script *
     case RS_SCRIPT_INTRINSIC_ID_CONVOLVE_5x5:
         i = rsdIntrinsic_Convolve5x5(this, s, e);
         break;
+    case RS_SCRIPT_INTRINSIC_ID_CONVOLVE:
+        i = rsdIntrinsic_Convolve(this, s, e);
+        break;
     case RS_SCRIPT_INTRINSIC_ID_BLUR:
         i = rsdIntrinsic_Blur(this, s, e);
         break;
     case RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB:
         i = rsdIntrinsic_YuvToRGB(this, s, e);
         break;
+    case RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV:
+        i = rsdIntrinsic_RGBToYuv(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_RESIZE:
+        i = rsdIntrinsic_Resize(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_CONVERT:
+        i = rsdIntrinsic_Convert(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_PYRAMID:
+        i = rsdIntrinsic_Pyramid(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_ROTATE:
+        i = rsdIntrinsic_Rotate(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_WARP:
+        i = rsdIntrinsic_Warp(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY:
+        i = rsdIntrinsic_Morphology(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_MEDIAN:
+        i = rsdIntrinsic_Median(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_BILATERAL:
+        i = rsdIntrinsic_Bilateral(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_INTEGRAL:
+        i = rsdIntrinsic_Integral(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_SCAN:
+        i = rsdIntrinsic_Scan(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_GEMM:
+        i = rsdIntrinsic_Gemm(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_ETC1_ENCODE:
+        i = rsdIntrinsic_ETC1(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_DEMOSAIC:
+        i = rsdIntrinsic_Demosaic(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_CONVOLVE_Q8:
+        i = rsdIntrinsic_ConvolveQ8(this, s, e);
+        break;
     case RS_SCRIPT_INTRINSIC_ID_BLEND:
         i = rsdIntrinsic_Blend(this, s, e);
         break;
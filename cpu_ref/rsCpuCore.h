@@ -23,6 +23,12 @@
 #include "rsElement.h"
 #include "rsScriptC.h"
 
+// The hand written intrinsic kernels exist for ARMv7 NEON and for the
+// AArch64 Advanced SIMD instruction set; both export the same _K symbols.
+#if defined(ARCH_ARM_HAVE_VFP) || defined(ARCH_ARM64_HAVE_NEON)
+#define ARCH_ARM_USE_INTRINSICS
+#endif
+
 namespace bcc {
     class BCCContext;
     class RSCompilerDriver;
@@ -33,20 +39,69 @@ namespace android {
 namespace renderscript {
 
 extern bool gArchUseSIMD;
+// The ARM architecture version the cpu implements, 0 elsewhere.
+extern uint32_t gArchVersion;
 
 typedef void (* InvokeFunc_t)(void);
 typedef void (* ForEachFunc_t)(void);
 typedef void (*WorkerCallback_t)(void *usr, uint32_t idx);
 
 class RsdCpuScriptImpl;
+class RsdCpuIntrinsicTuning;
+class RsdCpuPerfBoost;
 class RsdCpuReferenceImpl;
 
+// State written by one thread while others read their neighbours is kept on
+// lines of its own so workers don't invalidate each other's cache lines.
+#define RS_CACHE_LINE_SIZE 64
+#define RS_CACHE_ALIGNED __attribute__((aligned(RS_CACHE_LINE_SIZE)))
+
+// Most inputs a kernel launch can take.
+#define RS_KERNEL_INPUT_LIMIT 8
+
+// Per-worker slice queue for the work-stealing launch scheduler.  Each
+// worker is handed a contiguous range of slices up front and claims from
+// the front of it; workers that run dry steal from the back of a
+// neighbour's range.  mRange packs the [next, end) pair into one word so
+// both ends can be moved with a single compare-and-swap.  The counters are
+// only written by the owning worker.
+typedef struct {
+    volatile uint64_t mRange;
+    uint32_t mClaimed;
+    uint32_t mStolen;
+    uint32_t mRetries;
+    // Cost of the first slice worker 0 ran, in picoseconds per element.
+    uint32_t mCostPs;
+    // Time the owning worker spent in the launch.
+    uint64_t mBusyNs;
+} RS_CACHE_ALIGNED MTSliceQueue;
+
+// A flag or counter with a cache line to itself.
+typedef struct {
+    volatile int mValue;
+} RS_CACHE_ALIGNED MTPaddedInt;
+
+// Private sums one worker keeps for an allocation scripts rsAccumulate into.
+typedef struct {
+    android::renderscript::Allocation *mAlloc;
+    uint8_t *mData;
+    size_t mCapacity;
+} MTAccumulator;
+
+typedef struct {
+    MTAccumulator mList[8];
+    uint32_t mCount;
+} RS_CACHE_ALIGNED MTAccumulatorSet;
+
 typedef struct ScriptTLSStructRec {
     android::renderscript::Context * mContext;
     const android::renderscript::Script * mScript;
     RsdCpuScriptImpl *mImpl;
 } ScriptTLSStruct;
 
+// Describes one launch.  It is set up before the launch is published and
+// only read while it runs; everything the workers write goes to their slice
+// queues.
 typedef struct {
     RsForEachStubParamStruct fep;
 
@@ -54,13 +109,41 @@ typedef struct {
     RsdCpuScriptImpl *script;
 
     ForEachFunc_t kernel;
+    // Expansion taking kernelWidth cells at a time with vector types, or
+    // NULL; kernel handles what is left of each row.
+    ForEachFunc_t kernelWide;
+    uint32_t kernelWidth;
     uint32_t sig;
     const Allocation * ain;
     Allocation * aout;
+    // All fep.inLen inputs, the first being ain.
+    const Allocation * ains[RS_KERNEL_INPUT_LIMIT];
+    const uint8_t * ptrIns[RS_KERNEL_INPUT_LIMIT];
+    uint32_t eStrideIns[RS_KERNEL_INPUT_LIMIT];
+    uint32_t yStrideIns[RS_KERNEL_INPUT_LIMIT];
+    // Non-zero for reductions, where fep.ptrOut holds one accumulator per
+    // worker this many bytes apart and each worker only writes its own.
+    size_t mAccumStride;
 
     uint32_t mSliceSize;
-    volatile int mSliceNum;
+    uint32_t mSliceCount;
+    // Non-zero requests a tiled launch with tiles of about this many bytes.
+    uint32_t mTileBytes;
+    uint32_t mTileSizeX;
+    uint32_t mTileSizeY;
+    // The schedule came from intrinsic tuning, which also picked
+    // fep.prefetchRows.
+    bool mTuned;
+    MTSliceQueue *mSliceQueues;
+    uint32_t mSliceQueueCount;
     bool isThreadable;
+    // The launch may return before the helper threads are done with it.
+    bool mAsync;
+    // Launch hints from RsScriptCall, and the workers they select.
+    uint32_t mMaxThreads;
+    bool mBackground;
+    uint64_t mWorkerMask;
+    uint32_t mWorkerCount;
 
     uint32_t xStart;
     uint32_t xEnd;
@@ -70,9 +153,248 @@ typedef struct {
     uint32_t zEnd;
     uint32_t arrayStart;
     uint32_t arrayEnd;
+
+    // Rectangles covered instead of the x and y ranges, which are then
+    // their bounds; the caller's memory, so these launches run
+    // synchronously.  mRegionRows counts the rows of all of them.
+    const RsScriptRect *mRegions;
+    uint32_t mRegionCount;
+    uint32_t mRegionRows;
+
+    // When the launch was submitted, for the profile.
+    uint64_t mStartNs;
+
+    // Set while the launch runs one strip of rows at a time.
+    bool mStripped;
 } MTLaunchStruct;
 
+// Largest usr block an asynchronous launch will copy; bigger ones run
+// synchronously.
+#define RS_ASYNC_LAUNCH_USR_BYTES 256
+
+// One launch published to the helper threads.  Launches are numbered by
+// generation and live in a small ring, so a worker that is done with its
+// part of one launch can move on to the next while stragglers finish the
+// first.  Asynchronous launches keep their own copy of the launch state
+// since the caller's MTLaunchStruct is gone by the time they complete.
+typedef struct {
+    WorkerCallback_t mCallback;
+    void *mData;
+    RsdCpuReferenceImpl *mOwner;
+    // TLS of the submitting thread, for kernels looking up their context.
+    ScriptTLSStruct *mTls;
+    // Launch whose slice counters are gathered once it completes, if any.
+    const MTLaunchStruct *mStats;
+    // Generation of the launch in the slot; the slot is free again once
+    // mCompleted catches up with it.
+    volatile int mGeneration;
+    MTSliceQueue *mSliceQueues;
+    // Counted down by each participant as it finishes.
+    volatile int mRunning RS_CACHE_ALIGNED;
+    // Polled by threads waiting for the launch.
+    volatile int mCompleted RS_CACHE_ALIGNED;
+    MTLaunchStruct mMtls RS_CACHE_ALIGNED;
+    uint8_t mUsr[RS_ASYNC_LAUNCH_USR_BYTES];
+} RS_CACHE_ALIGNED MTLaunchSlot;
+
+// Helper threads shared by every context in the process.  Launches from all
+// contexts go through one ring in the order they are submitted, so contexts
+// take turns on the pool instead of each oversubscribing the CPU with a
+// full set of threads of its own.
+class RsdCpuWorkerPool {
+public:
+    static RsdCpuWorkerPool * acquire(Context *rsc);
+    void release();
+
+    // Number of helper threads; the submitting thread is always worker 0.
+    uint32_t getWorkerCount() const { return mWorkers.mCount; }
+    // Whether launches can be spread over the helpers.  Once they have
+    // failed to start every launch runs on its submitter, though
+    // getWorkerCount stays what contexts were sized for.
+    bool hasWorkers() const { return mWorkers.mCount && !mStartFailed; }
+    uint32_t getWorkerIndex() const;
+    // Workers running on the fastest cluster, counting worker 0.
+    uint32_t getBigWorkerCount() const;
+    const uint32_t * getWorkerWeights() const { return mWorkerWeights; }
+    void pinToCluster(pid_t tid, uint32_t worker);
+
+    int addWaiter();
+    void removeWaiter(int waiter);
+    void setPriority(int waiter, int32_t priority);
+
+    // The helper threads are only started by the first launch that needs
+    // them.  Submitters bracket acquireLaunchSlot and publishLaunch with
+    // beginSubmit and endSubmit, which starts them if needed and keeps
+    // idle from stopping them meanwhile.  beginSubmit returns false, and
+    // needs no endSubmit, when they could not be started; the submitter
+    // then runs the whole launch itself.
+    bool beginSubmit();
+    void endSubmit();
+    // Stops the helpers once they have gone kIdleStopMs without a launch.
+    // Returns the ms until that is due, or -1 if they aren't running.
+    int32_t idle(uint64_t now);
+
+    // Launches are taken in ticket order: acquireLaunchSlot hands out the
+    // next generation and waits for its slot to be free, publishLaunch
+    // passes it to the helpers once every earlier launch has been, and each
+    // participant calls releaseLaunch when done with its part.
+    // Submitting threads are identified by their TLS, owner below.
+    MTLaunchSlot * acquireLaunchSlot(int waiter, const ScriptTLSStruct *owner, int *gen);
+    void publishLaunch(MTLaunchSlot *slot, int gen);
+    void releaseLaunch(MTLaunchSlot *slot);
+    bool hasCompleted(int gen) const {
+        const MTLaunchSlot *slot = &mWorkers.mLaunches[(uint32_t)gen % kMaxLaunches];
+        return (slot->mCompleted - gen) >= 0;
+    }
+    void waitForCompletion(int gen, int waiter, const ScriptTLSStruct *owner);
+
+    int reserveNestedLaunch();
+    MTSliceQueue * getNestedSliceQueues(int entry) {
+        return &mNested.mSliceQueues[entry * (mWorkers.mCount + 1)];
+    }
+    void releaseNestedLaunch(int entry) {
+        __sync_lock_release(&mNested.mOwned[entry]);
+    }
+    void runNestedLaunch(int entry, ScriptTLSStruct *owner, WorkerCallback_t cbk,
+                         MTLaunchStruct *mtls, uint32_t idx);
+    bool helpNestedLaunches(uint32_t idx, const ScriptTLSStruct *owner);
 
+    static const uint32_t kMaxLaunches = 8;
+    static const uint32_t kMaxNestedLaunches = 8;
+    // Contexts that can park while waiting for a launch; any beyond this
+    // spin and yield instead.
+    static const uint32_t kMaxWaiters = 16;
+    static const uint32_t kIdleStopMs = 10000;
+
+protected:
+    RsdCpuWorkerPool();
+    ~RsdCpuWorkerPool();
+    bool init(Context *rsc);
+
+    static void * helperThreadProc(void *vpool);
+    int waitForLaunch(uint32_t idx, int lastGen);
+    void wakeWaiters();
+    // Both called with gInitMutex held.
+    bool startWorkers();
+    // Stops the first started helpers, which have all reported they are up.
+    void stopWorkers(uint32_t started);
+    int32_t getWorkerPriority() const;
+
+    int mRefCount;
+    bool mExit;
+    // Whether the helper threads are running, how many threads are between
+    // beginSubmit and endSubmit, and when the last of them left.
+    volatile int mStarted;
+    // Set for good once the helpers failed to start.
+    volatile int mStartFailed;
+    volatile int mSubmitters;
+    volatile uint64_t mLastSubmitNs;
+
+    // Default time helper threads and the launching thread spin before
+    // parking; override with debug.rs.spin-wait (microseconds).
+    static const uint32_t kDefaultSpinWaitUs = 200;
+    uint64_t mSpinWaitNs;
+
+    struct Workers {
+        volatile int mRunningCount;
+        volatile int mLaunchCount;
+        // Last generation handed out to a submitter, and last one published.
+        // Every idle worker polls the latter.
+        volatile int mReservedGeneration RS_CACHE_ALIGNED;
+        volatile int mLaunchGeneration RS_CACHE_ALIGNED;
+        MTPaddedInt *mParked RS_CACHE_ALIGNED;
+        uint32_t mCount;
+        pthread_t *mThreadId;
+        pid_t *mNativeThreadId;
+        Signal *mLaunchSignals;
+        MTLaunchSlot mLaunches[kMaxLaunches];
+    };
+    Workers mWorkers;
+
+    // Threads waiting for a launch to complete park on their context's
+    // waiter signal.  The signals belong to the pool, so a worker finishing
+    // a launch can always wake them safely.
+    struct Waiters {
+        volatile int mParkedCount RS_CACHE_ALIGNED;
+        volatile int mUsed[kMaxWaiters] RS_CACHE_ALIGNED;
+        MTPaddedInt mParked[kMaxWaiters];
+        int32_t mPriority[kMaxWaiters];
+        Signal mSignals[kMaxWaiters];
+    };
+    Waiters mWaiters;
+
+    // Launches issued from inside a running kernel.  They bypass the launch
+    // ring and are picked up by workers waiting for their next launch.
+    struct NestedLaunches {
+        volatile int mActive RS_CACHE_ALIGNED;
+        MTPaddedInt mHelpers[kMaxNestedLaunches];
+        volatile int mOwned[kMaxNestedLaunches] RS_CACHE_ALIGNED;
+        MTLaunchStruct * volatile mLaunch[kMaxNestedLaunches];
+        ScriptTLSStruct *mOwner[kMaxNestedLaunches];
+        WorkerCallback_t mCallback[kMaxNestedLaunches];
+        MTSliceQueue *mSliceQueues;
+    };
+    NestedLaunches mNested;
+
+    // Cores sorted fastest first.  mWorkerWeights holds each worker's share
+    // of a launch and is NULL unless the cores differ in capacity.
+    static const uint32_t kMaxCores = 64;
+    struct CoreInfo {
+        uint32_t mCpu;
+        uint32_t mCapacity;
+    };
+    CoreInfo mCores[kMaxCores];
+    uint32_t mCoreCount;
+    uint32_t *mWorkerWeights;
+    void initCoreTopology(uint32_t cpu);
+};
+
+
+// The file backed allocations a launch walks by rows.  Large ones make the
+// launch run in strips of rows: the next strip is paged in while one runs,
+// and a finished strip is written back and dropped, so only a few strips
+// of each file are resident at a time.
+class RsdCpuStripSet {
+public:
+    RsdCpuStripSet();
+
+    // Adds an allocation whose rows are the rows of the launch; others are
+    // ignored.
+    void add(const Allocation *a, bool written);
+    // Rows per strip for a launch over rows [yStart, yEnd), or 0 to run it
+    // as a whole.
+    uint32_t getStripRows(uint32_t yStart, uint32_t yEnd, uint32_t threads) const;
+
+    void prefetch(uint32_t y1, uint32_t y2) const;
+    void release(uint32_t y1, uint32_t y2) const;
+
+private:
+    static const uint32_t kMaxAllocs = 8;
+    const Allocation *mAllocs[kMaxAllocs];
+    bool mWritten[kMaxAllocs];
+    uint32_t mCount;
+    size_t mRowBytes;
+    size_t mBytes;
+};
+
+
+// Working memory for each thread of a launch, kept from one launch to the
+// next and grown when a launch needs more.
+class RsdCpuScratch {
+public:
+    explicit RsdCpuScratch(uint32_t threads);
+    ~RsdCpuScratch();
+
+    // Returns at least bytes for thread lid, aligned to align, a power of
+    // two, or NULL when out of memory.  What the memory held is kept
+    // unless it had to grow.
+    void * get(uint32_t lid, size_t bytes, size_t align = 16);
+
+private:
+    void **mBuffers;
+    size_t *mSizes;
+    uint32_t mThreads;
+};
 
 
 class RsdCpuReferenceImpl : public RsdCpuReference {
@@ -86,16 +408,63 @@ public:
     bool init(uint32_t version_major, uint32_t version_minor, sym_lookup_t, script_lookup_t);
     virtual void setPriority(int32_t priority);
     virtual void launchThreads(WorkerCallback_t cbk, void *data);
-    static void * helperThreadProc(void *vrsc);
+    virtual void finishLaunches();
+    virtual uint32_t getProfile(RsKernelProfile *profiles, uint32_t count) const;
+    virtual size_t trimMemory();
+    virtual int32_t idle();
+    virtual bool sort(const Allocation *keys, const Allocation *values);
+    virtual uint32_t compact(const Allocation *dst, const Allocation *src,
+                             const Allocation *flags);
+    // Forgets the statistics of a script that is going away.
+    void dropProfile(const RsdCpuScriptImpl *script);
+    void waitForFence(int fence);
+    // True while an asynchronous launch of script may still be running.
+    bool hasPendingLaunch(const RsdCpuScriptImpl *script) const;
     RsdCpuScriptImpl * setTLS(RsdCpuScriptImpl *sc);
 
+    // The state of one thread submitting launches.  The context's own
+    // thread always has mLanes[0]; synchronous contexts can be entered from
+    // several application threads at once and lend each of them a lane
+    // for the length of its call.
+    struct LaunchLane {
+        // First, so the TLS of a thread finds its lane.
+        ScriptTLSStruct mTls;
+        MTSliceQueue *mSliceQueues;
+        // One set per worker, merged into the allocations as launches end.
+        MTAccumulatorSet *mAccumulators;
+        int mWaiter;
+        bool mInForEach;
+        ScriptTLSStruct *mPrevTls;
+        volatile int mUsed;
+    };
+    // Lends the calling thread a lane unless it is in one already.  The
+    // result goes back to leaveLane, which is a no-op for NULL.
+    LaunchLane * enterLane();
+    void leaveLane(LaunchLane *lane);
+
     Context * getContext() {return mRSC;}
-    uint32_t getThreadCount() const {
-        return mWorkers.mCount + 1;
+    virtual uint32_t getThreadCount() const {
+        return mPool ? mPool->getWorkerCount() + 1 : 1;
+    }
+    bool onWorkerThread() const {
+        return mPool && (mPool->getWorkerIndex() != 0);
     }
 
-    void launchThreads(const Allocation * ain, Allocation * aout,
-                       const RsScriptCall *sc, MTLaunchStruct *mtls);
+    // Returns the calling worker's zeroed copy of a, sizeBytes long, to sum
+    // into for the rest of the launch.  NULL means the caller must add to a
+    // itself, atomically: outside a threaded launch, or once the worker has
+    // no copies left.
+    void * getAccumulator(Allocation *a, size_t sizeBytes);
+
+    // Returns a fence for the launch; pass it to waitForFence to wait for
+    // an asynchronous launch to complete.
+    int launchThreads(const Allocation * ain, Allocation * aout,
+                      const RsScriptCall *sc, MTLaunchStruct *mtls);
+    // Runs a launch synchronously in strips of rows over the allocations
+    // of strips.  Launches of scripts do this themselves; ScriptGroups,
+    // whose kernels reach allocations the launch doesn't name, call it.
+    void launchStrips(const Allocation * ain, Allocation * aout, const RsScriptCall *sc,
+                      MTLaunchStruct *mtls, const RsdCpuStripSet &strips, uint32_t rows);
 
     virtual CpuScript * createScript(const ScriptC *s,
                                      char const *resName, char const *cacheDir,
@@ -135,33 +504,96 @@ public:
         return mSetupCompilerCallback;
     }
 #endif
-    virtual bool getInForEach() { return mInForEach; }
+    virtual bool getInForEach() { return getLane()->mInForEach; }
+    RsdCpuIntrinsicTuning * getIntrinsicTuning() const { return mIntrinsicTuning; }
+
+    // Slice-claim counters accumulated across threaded launches, used to
+    // gauge scheduler contention.
+    struct SliceStats {
+        uint64_t mLaunches;
+        uint64_t mSlices;
+        uint64_t mSteals;
+        uint64_t mRetries;
+    };
+    void getSliceStats(SliceStats *stats) const { *stats = mSliceStats; }
+    void resetSliceStats() { memset(&mSliceStats, 0, sizeof(mSliceStats)); }
+    void gatherSliceStats(const MTLaunchStruct *mtls);
 
 protected:
     Context *mRSC;
     uint32_t version_major;
     uint32_t version_minor;
     //bool mHasGraphics;
-    bool mInForEach;
 
-    struct Workers {
-        volatile int mRunningCount;
-        volatile int mLaunchCount;
-        uint32_t mCount;
-        pthread_t *mThreadId;
-        pid_t *mNativeThreadId;
-        Signal mCompleteSignal;
-        Signal *mLaunchSignals;
-        WorkerCallback_t mLaunchCallback;
-        void *mLaunchData;
+    RsdCpuWorkerPool *mPool;
+    // Workers this context may use; less than the pool when it is limited
+    // to the big cores.
+    uint32_t mWorkerLimit;
+    int32_t mPriority;
+    // How far ahead launches that prefetch load rows, from
+    // debug.rs.prefetch-rows.
+    static const uint32_t kDefaultPrefetchRows = 2;
+    uint32_t mPrefetchRows;
+
+    // Schedules chosen for the intrinsics on this device.
+    RsdCpuIntrinsicTuning *mIntrinsicTuning;
+    // Clock hints for launches long enough to outrun the governor.
+    RsdCpuPerfBoost *mPerfBoost;
+
+    static const uint32_t kMaxLanes = 8;
+    LaunchLane mLanes[kMaxLanes];
+    LaunchLane * getLane();
+    bool initLane(LaunchLane *lane);
+    void mergeAccumulators(LaunchLane *lane);
+
+    int runLaunch(LaunchLane *lane, WorkerCallback_t cbk, void *data,
+                  const MTLaunchStruct *stats);
+
+    // Asynchronous launches of this context that may still be running.
+    // Capping them keeps one context from filling the shared ring.
+    static const uint32_t kMaxAsyncLaunches = 2;
+    struct AsyncLaunch {
+        int mFence;
+        RsdCpuScriptImpl *mScript;
+        const Allocation *mIn;
+        const Allocation *mOut;
     };
-    Workers mWorkers;
-    bool mExit;
+    AsyncLaunch mAsyncLaunches[kMaxAsyncLaunches];
+    uint32_t mAsyncCount;
+    void retireLaunches();
+    void waitForConflicts(const RsdCpuScriptImpl *script, const Allocation *ain,
+                          const Allocation *aout);
+
+    // Time a slice should take once the cost of its kernel is known.
+    static const uint64_t kTargetSliceNs = 50 * 1000;
+    void setupLaunchWorkers(MTLaunchStruct *mtls, uint32_t workerLimit);
+    WorkerCallback_t setupSlices(MTLaunchStruct *mtls, MTSliceQueue *queues, uint32_t costPs,
+                                 uint32_t workerLimit);
+
+    SliceStats mSliceStats;
+
+    // Launch statistics by script, kernel slot and launch shape.  Only
+    // launches made from outside kernels are counted.  Entries live in an
+    // open-addressed table allocated on the first launch; shapes beyond
+    // its size aren't recorded.
+    static const uint32_t kProfileEntries = 256;
+    struct ProfileEntry {
+        const RsdCpuScriptImpl *mScript;
+        bool mUsed;
+        RsKernelProfile mProfile;
+    };
+    ProfileEntry *mProfile;
+    uint32_t mProfileCount;
+    // Launches can complete on any pool thread.
+    mutable pthread_mutex_t mProfileLock;
+    ProfileEntry * findProfile(const RsdCpuScriptImpl *script,
+                               const RsForEachStubParamStruct *fep);
+    void recordLaunch(const RsdCpuScriptImpl *script, const RsForEachStubParamStruct *fep,
+                      uint64_t wallNs, const MTSliceQueue *queues, uint32_t queueCount);
+
     sym_lookup_t mSymLookupFn;
     script_lookup_t mScriptLookupFn;
 
-    ScriptTLSStruct mTlsStruct;
-
 #ifndef RS_COMPATIBILITY_LIB
     bcc::RSLinkRuntimeCallback mLinkRuntimeCallback;
     RSSelectRTCallback mSelectRTCallback;
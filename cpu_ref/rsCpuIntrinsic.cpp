@@ -16,6 +16,9 @@
 
 
 #include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicTuning.h"
+
+#include <time.h>
 
 using namespace android;
 using namespace android::renderscript;
@@ -26,9 +29,13 @@ RsdCpuScriptIntrinsic::RsdCpuScriptIntrinsic(RsdCpuReferenceImpl *ctx, const Scr
 
     mID = iid;
     mElement.set(e);
+
+    mFieldTiles = new FieldTile[mCtx->getThreadCount()];
+    memset(mFieldTiles, 0, sizeof(FieldTile) * mCtx->getThreadCount());
 }
 
 RsdCpuScriptIntrinsic::~RsdCpuScriptIntrinsic() {
+    delete []mFieldTiles;
 }
 
 void RsdCpuScriptIntrinsic::invokeFunction(uint32_t slot, const void *params, size_t paramLength) {
@@ -69,6 +76,32 @@ void RsdCpuScriptIntrinsic::setGlobalObj(uint32_t slot, ObjectBase *data) {
                                  "Unexpected RsdCpuScriptIntrinsic::setGlobalObj");
 }
 
+void RsdCpuScriptIntrinsic::setGlobalVars(const void *records, size_t sizeBytes,
+                                          uint32_t count) {
+    // Intrinsics keep their parameters in their own state, so each update
+    // goes through the per-slot setters.
+    const uint8_t *p = (const uint8_t *)records;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        RsScriptVarRecord r;
+        memcpy(&r, p, sizeof(r));
+        if (r.isObject) {
+            ObjectBase *o;
+            memcpy(&o, p + sizeof(r), sizeof(o));
+            setGlobalObj(r.slot, o);
+        } else {
+            setGlobalVar(r.slot, p + sizeof(r), r.sizeBytes);
+        }
+        p += sizeof(r) + rsRound(r.sizeBytes, 4);
+    }
+}
+
+void RsdCpuScriptIntrinsic::setFieldTile(uint32_t lid, uint32_t fieldSlot,
+                                         const uint8_t *base, size_t stride) {
+    mFieldTiles[lid].fieldSlot = fieldSlot;
+    mFieldTiles[lid].base = base;
+    mFieldTiles[lid].stride = stride;
+}
+
 void RsdCpuScriptIntrinsic::invokeFreeChildren() {
 }
 
@@ -83,12 +116,24 @@ void RsdCpuScriptIntrinsic::postLaunch(uint32_t slot, const Allocation * ain,
                                        uint32_t usrLen, const RsScriptCall *sc) {
 }
 
+static uint64_t nowNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_nsec + ((uint64_t)t.tv_sec * 1000 * 1000 * 1000);
+}
+
+static uint64_t launchCells(const MTLaunchStruct *mtls) {
+    return (uint64_t)(mtls->xEnd - mtls->xStart) * (mtls->yEnd - mtls->yStart) *
+           (mtls->zEnd - mtls->zStart) * (mtls->arrayEnd - mtls->arrayStart);
+}
+
 void RsdCpuScriptIntrinsic::invokeForEach(uint32_t slot,
                                           const Allocation * ain,
                                           Allocation * aout,
                                           const void * usr,
                                           uint32_t usrLen,
                                           const RsScriptCall *sc) {
+    ATRACE_CALL();
 
     MTLaunchStruct mtls;
     preLaunch(slot, ain, aout, usr, usrLen, sc);
@@ -100,9 +145,19 @@ void RsdCpuScriptIntrinsic::invokeForEach(uint32_t slot,
     mtls.kernel = (void (*)())mRootPtr;
     mtls.fep.usr = this;
 
+    // Launches made from kernels share the CPU with them and can't be timed.
+    bool timed = false;
+    applyTuning(slot, &mtls, mCtx->getInForEach() ? NULL : &timed);
+
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
     RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    uint64_t start = timed ? nowNs() : 0;
     mCtx->launchThreads(ain, aout, sc, &mtls);
+    if (timed) {
+        finishTuning(slot, &mtls, nowNs() - start);
+    }
     mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
 
     postLaunch(slot, ain, aout, usr, usrLen, sc);
 }
@@ -115,5 +170,30 @@ void RsdCpuScriptIntrinsic::forEachKernelSetup(uint32_t slot, MTLaunchStruct *mt
     mtls->fep.usr = this;
 }
 
+bool RsdCpuScriptIntrinsic::applyTuning(uint32_t slot, MTLaunchStruct *mtls, bool *timed) {
+    if (mtls->mTileBytes || mtls->mRegionCount || !mElement.get()) {
+        return false;
+    }
+    if (timed && (launchCells(mtls) < RsdCpuIntrinsicTuning::kMinTrialCells)) {
+        timed = NULL;
+    }
+    RsdCpuIntrinsicTuning::Variant v;
+    if (!mCtx->getIntrinsicTuning()->getVariant(mID, mElement->getSizeBytes(), slot,
+                                                &v, timed)) {
+        return false;
+    }
+    mtls->mTileBytes = v.tileBytes;
+    mtls->fep.prefetchRows = v.prefetchRows;
+    mtls->mTuned = true;
+    return true;
+}
+
+void RsdCpuScriptIntrinsic::finishTuning(uint32_t slot, const MTLaunchStruct *mtls,
+                                         uint64_t ns) {
+    uint64_t cells = launchCells(mtls);
+    mCtx->getIntrinsicTuning()->recordTrial(mID, mElement->getSizeBytes(), slot,
+                                            cells ? (ns * 1000) / cells : 0);
+}
+
 
 
@@ -52,6 +52,11 @@ public:
                                   const Element *e, const size_t *dims, size_t dimLength);
     virtual void setGlobalBind(uint32_t slot, Allocation *data);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual void setGlobalVars(const void *records, size_t sizeBytes, uint32_t count);
+
+    virtual void setFieldTile(uint32_t lid, uint32_t fieldSlot,
+                              const uint8_t *base, size_t stride);
+    virtual bool writesObjects() const { return false; }
 
     virtual ~RsdCpuScriptIntrinsic();
     RsdCpuScriptIntrinsic(RsdCpuReferenceImpl *ctx, const Script *s, const Element *,
@@ -62,6 +67,46 @@ protected:
     outer_foreach_t mRootPtr;
     ObjectBaseRef<const Element> mElement;
 
+    // Per-thread field tiles set by ScriptGroup launches.
+    struct FieldTile {
+        uint32_t fieldSlot;
+        const uint8_t *base;
+        size_t stride;
+    };
+    FieldTile *mFieldTiles;
+
+    // Schedules a direct launch of slot as tuning chose on this device.
+    // Launches asking for a strategy of their own keep it.  With timed the
+    // launch may be made a trial, to be timed and passed to finishTuning().
+    bool applyTuning(uint32_t slot, MTLaunchStruct *mtls, bool *timed);
+    void finishTuning(uint32_t slot, const MTLaunchStruct *mtls, uint64_t ns);
+
+    // Returns the memory to read the allocation bound to fieldSlot from on
+    // thread lid, with its row stride.
+    const uint8_t * getFieldInput(uint32_t lid, uint32_t fieldSlot, const Allocation *a,
+                                  size_t *stride) const {
+        const FieldTile *t = &mFieldTiles[lid];
+        if (t->base && (t->fieldSlot == fieldSlot)) {
+            *stride = t->stride;
+            return t->base;
+        }
+        *stride = a->mHal.drvState.lod[0].stride;
+        return (const uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
+    }
+
+    // Starts loading bytes [x1, x2) of row y of an input read through base,
+    // for kernels whose window of rows will reach it in the rows ahead.
+    static void prefetchInputRow(const RsForEachStubParamStruct *p, const uint8_t *base,
+                                 size_t stride, uint32_t y, size_t x1, size_t x2) {
+        if (y >= p->dimY) {
+            return;
+        }
+        const uint8_t *row = base + y * stride;
+        for (size_t x = x1; x < x2; x += RS_CACHE_LINE_SIZE) {
+            __builtin_prefetch(row + x, 0, 3);
+        }
+    }
+
 };
 
 
@@ -30,6 +30,7 @@ public:
     virtual void populateScript(Script *);
     virtual void invokeFreeChildren();
 
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
 
     virtual ~RsdCpuScriptIntrinsic3DLUT();
@@ -37,10 +38,25 @@ public:
 
 protected:
     ObjectBaseRef<Allocation> mLUT;
+    int32_t mInterpolation;
+    bool mHalfLUT;
+
+    void preLaunch(uint32_t slot, const Allocation * ain,
+                   Allocation * aout, const void * usr,
+                   uint32_t usrLen, const RsScriptCall *sc);
 
     static void kernel(const RsForEachStubParamStruct *p,
                        uint32_t xstart, uint32_t xend,
                        uint32_t instep, uint32_t outstep);
+    static void kernelTetrahedral(const RsForEachStubParamStruct *p,
+                                  uint32_t xstart, uint32_t xend,
+                                  uint32_t instep, uint32_t outstep);
+    static void kernelFloat(const RsForEachStubParamStruct *p,
+                            uint32_t xstart, uint32_t xend,
+                            uint32_t instep, uint32_t outstep);
+    static void kernelFloatTetrahedral(const RsForEachStubParamStruct *p,
+                                       uint32_t xstart, uint32_t xend,
+                                       uint32_t instep, uint32_t outstep);
 };
 
 }
@@ -52,6 +68,30 @@ void RsdCpuScriptIntrinsic3DLUT::setGlobalObj(uint32_t slot, ObjectBase *data) {
     mLUT.set(static_cast<Allocation *>(data));
 }
 
+void RsdCpuScriptIntrinsic3DLUT::setGlobalVar(uint32_t slot, const void *data,
+                                              size_t dataLength) {
+    rsAssert(slot == 1);
+    rsAssert(dataLength == 4);
+    mInterpolation = ((const int32_t *)data)[0];
+}
+
+void RsdCpuScriptIntrinsic3DLUT::preLaunch(uint32_t slot, const Allocation * ain,
+                                           Allocation * aout, const void * usr,
+                                           uint32_t usrLen, const RsScriptCall *sc) {
+    const bool tetrahedral = (mInterpolation == RS_3DLUT_INTERPOLATION_TETRAHEDRAL);
+    RsDataType dt = RS_TYPE_UNSIGNED_8;
+    if (mLUT.get()) {
+        dt = mLUT->getType()->getElement()->getType();
+    }
+
+    if ((dt == RS_TYPE_FLOAT_32) || (dt == RS_TYPE_FLOAT_16)) {
+        mHalfLUT = (dt == RS_TYPE_FLOAT_16);
+        mRootPtr = tetrahedral ? &kernelFloatTetrahedral : &kernelFloat;
+    } else {
+        mRootPtr = tetrahedral ? &kernelTetrahedral : &kernel;
+    }
+}
+
 extern "C" void rsdIntrinsic3DLUT_K(void *dst, const void *src, const void *lut,
                                     size_t lut_stride_y, size_t lut_stride_z,
                                     uint32_t count, const void *constants);
@@ -83,7 +123,7 @@ void RsdCpuScriptIntrinsic3DLUT::kernel(const RsForEachStubParamStruct *p,
     //ALOGE("strides %zu %zu", stride_y, stride_z);
 
     while (x1 < x2) {
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
             int32_t len = (x2 - x1 - 1) >> 1;
             if(len > 0) {
@@ -165,18 +205,271 @@ void RsdCpuScriptIntrinsic3DLUT::kernel(const RsForEachStubParamStruct *p,
     }
 }
 
+// Tetrahedral interpolation splits each lattice cell into six tetrahedra
+// along its main diagonal and blends only the four corners of the one the
+// colour falls in.  Sorting the fractional coordinates picks it: walking
+// from the low corner along the axes in order of decreasing fraction visits
+// its corners, and each corner is weighted by the drop in fraction at that
+// step.  o1 and o2 are the offsets of the second and third corners.
+static inline void sortTetrahedron(int3 f, int3 step, int *f1, int *f2, int *f3,
+                                   int *o1, int *o2) {
+    if (f.x >= f.y) {
+        if (f.y >= f.z) {
+            *f1 = f.x; *f2 = f.y; *f3 = f.z; *o1 = step.x; *o2 = step.x + step.y;
+        } else if (f.x >= f.z) {
+            *f1 = f.x; *f2 = f.z; *f3 = f.y; *o1 = step.x; *o2 = step.x + step.z;
+        } else {
+            *f1 = f.z; *f2 = f.x; *f3 = f.y; *o1 = step.z; *o2 = step.z + step.x;
+        }
+    } else {
+        if (f.x >= f.z) {
+            *f1 = f.y; *f2 = f.x; *f3 = f.z; *o1 = step.y; *o2 = step.y + step.x;
+        } else if (f.y >= f.z) {
+            *f1 = f.y; *f2 = f.z; *f3 = f.x; *o1 = step.y; *o2 = step.y + step.z;
+        } else {
+            *f1 = f.z; *f2 = f.y; *f3 = f.x; *o1 = step.z; *o2 = step.z + step.y;
+        }
+    }
+}
+
+static inline void sortTetrahedron(float3 f, int3 step, float *f1, float *f2, float *f3,
+                                   int *o1, int *o2) {
+    if (f.x >= f.y) {
+        if (f.y >= f.z) {
+            *f1 = f.x; *f2 = f.y; *f3 = f.z; *o1 = step.x; *o2 = step.x + step.y;
+        } else if (f.x >= f.z) {
+            *f1 = f.x; *f2 = f.z; *f3 = f.y; *o1 = step.x; *o2 = step.x + step.z;
+        } else {
+            *f1 = f.z; *f2 = f.x; *f3 = f.y; *o1 = step.z; *o2 = step.z + step.x;
+        }
+    } else {
+        if (f.x >= f.z) {
+            *f1 = f.y; *f2 = f.x; *f3 = f.z; *o1 = step.y; *o2 = step.y + step.x;
+        } else if (f.y >= f.z) {
+            *f1 = f.y; *f2 = f.z; *f3 = f.x; *o1 = step.y; *o2 = step.y + step.z;
+        } else {
+            *f1 = f.z; *f2 = f.y; *f3 = f.x; *o1 = step.z; *o2 = step.z + step.y;
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsic3DLUT::kernelTetrahedral(const RsForEachStubParamStruct *p,
+                                                   uint32_t xstart, uint32_t xend,
+                                                   uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsic3DLUT *cp = (RsdCpuScriptIntrinsic3DLUT *)p->usr;
+
+    uchar4 *out = (uchar4 *)p->out;
+    uchar4 *in = (uchar4 *)p->in;
+    uint32_t x1 = xstart;
+    uint32_t x2 = xend;
+
+    const uchar *bp = (const uchar *)cp->mLUT->mHal.drvState.lod[0].mallocPtr;
+
+    int4 dims = {
+        cp->mLUT->mHal.drvState.lod[0].dimX - 1,
+        cp->mLUT->mHal.drvState.lod[0].dimY - 1,
+        cp->mLUT->mHal.drvState.lod[0].dimZ - 1,
+        -1
+    };
+    const float4 m = (float4)(1.f / 255.f) * convert_float4(dims);
+    const int4 coordMul = convert_int4(m * (float4)0x8000);
+    const size_t stride_y = cp->mLUT->mHal.drvState.lod[0].stride;
+    const size_t stride_z = stride_y * cp->mLUT->mHal.drvState.lod[0].dimY;
+    const int3 step = {4, (int)stride_y, (int)stride_z};
+
+    while (x1 < x2) {
+        int4 baseCoord = convert_int4(*in) * coordMul;
+        int4 coord1 = baseCoord >> (int4)15;
+        int4 weight = baseCoord & 0x7fff;
+
+        int f1, f2, f3, o1, o2;
+        sortTetrahedron(weight.xyz, step, &f1, &f2, &f3, &o1, &o2);
+
+        const uchar *bp2 = bp + (coord1.x * 4) + (coord1.y * stride_y) + (coord1.z * stride_z);
+        uint4 v0 = convert_uint4(*(const uchar4 *)&bp2[0]);
+        uint4 v1 = convert_uint4(*(const uchar4 *)&bp2[o1]);
+        uint4 v2 = convert_uint4(*(const uchar4 *)&bp2[o2]);
+        uint4 v3 = convert_uint4(*(const uchar4 *)&bp2[4 + stride_y + stride_z]);
+
+        // Same rounding as the trilinear kernel: 8 fraction bits, then round.
+        uint4 v = ((v0 * (uint)(0x8000 - f1)) + (v1 * (uint)(f1 - f2)) +
+                   (v2 * (uint)(f2 - f3)) + (v3 * (uint)f3)) >> (uint4)7;
+        uint4 v2r = (v + 0x7f) >> (uint4)8;
+
+        uchar4 ret = convert_uchar4(v2r);
+        ret.w = in->w;
+        *out = ret;
+
+        in++;
+        out++;
+        x1++;
+    }
+}
+
+static inline float halfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if (exp == 0x1f) {
+        bits = sign | 0x7f800000 | (mant << 13);
+    } else if (exp) {
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    } else if (mant) {
+        // Denormal; renormalize it for the wider exponent.
+        exp = 113;
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    } else {
+        bits = sign;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline float4 loadLutPoint(const uchar *p, bool half) {
+    if (half) {
+        const uint16_t *h = (const uint16_t *)p;
+        float4 f = {halfToFloat(h[0]), halfToFloat(h[1]), halfToFloat(h[2]), halfToFloat(h[3])};
+        return f;
+    }
+    float4 f;
+    memcpy(&f, p, sizeof(f));
+    return f;
+}
+
+// Float lattices hold colours in [0, 1].  Unlike the fixed point kernels,
+// cells are clamped so single-entry axes stay in bounds.
+struct FloatLutCell {
+    const uchar *mBase;
+    float3 mFrac;
+};
+
+static inline FloatLutCell findFloatLutCell(const uchar *bp, uchar4 in, int3 dims,
+                                            float3 scale, int3 step) {
+    float3 c = convert_float3(in.xyz) * scale;
+    int3 ic = convert_int3(c);
+    ic.x = rsMin(ic.x, rsMax(dims.x - 1, 0));
+    ic.y = rsMin(ic.y, rsMax(dims.y - 1, 0));
+    ic.z = rsMin(ic.z, rsMax(dims.z - 1, 0));
+    FloatLutCell cell;
+    cell.mBase = bp + (ic.x * step.x) + (ic.y * step.y) + (ic.z * step.z);
+    cell.mFrac = c - convert_float3(ic);
+    return cell;
+}
+
+static inline uchar4 packLutResult(float4 v, uchar alpha) {
+    uchar4 ret = convert_uchar4(clamp(v * 255.f + 0.5f, 0.f, 255.f));
+    ret.w = alpha;
+    return ret;
+}
+
+void RsdCpuScriptIntrinsic3DLUT::kernelFloat(const RsForEachStubParamStruct *p,
+                                             uint32_t xstart, uint32_t xend,
+                                             uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsic3DLUT *cp = (RsdCpuScriptIntrinsic3DLUT *)p->usr;
+
+    uchar4 *out = (uchar4 *)p->out;
+    uchar4 *in = (uchar4 *)p->in;
+    const bool half = cp->mHalfLUT;
+
+    const uchar *bp = (const uchar *)cp->mLUT->mHal.drvState.lod[0].mallocPtr;
+    const int3 dims = {
+        (int)cp->mLUT->mHal.drvState.lod[0].dimX - 1,
+        (int)cp->mLUT->mHal.drvState.lod[0].dimY - 1,
+        (int)cp->mLUT->mHal.drvState.lod[0].dimZ - 1
+    };
+    const float3 scale = convert_float3(dims) * (1.f / 255.f);
+    const int esize = half ? 8 : 16;
+    const int stride_y = (int)cp->mLUT->mHal.drvState.lod[0].stride;
+    const int stride_z = stride_y * cp->mLUT->mHal.drvState.lod[0].dimY;
+    const int3 cellStep = {esize, stride_y, stride_z};
+    // Step to the next lattice point; zero along single entry axes.
+    const int3 step = {dims.x ? esize : 0, dims.y ? stride_y : 0, dims.z ? stride_z : 0};
+
+    for (uint32_t x1 = xstart; x1 < xend; x1++, in++, out++) {
+        FloatLutCell cell = findFloatLutCell(bp, *in, dims, scale, cellStep);
+        const uchar *b = cell.mBase;
+        const float3 f = cell.mFrac;
+
+        float4 v000 = loadLutPoint(b, half);
+        float4 v100 = loadLutPoint(b + step.x, half);
+        float4 v010 = loadLutPoint(b + step.y, half);
+        float4 v110 = loadLutPoint(b + step.x + step.y, half);
+        float4 v001 = loadLutPoint(b + step.z, half);
+        float4 v101 = loadLutPoint(b + step.x + step.z, half);
+        float4 v011 = loadLutPoint(b + step.y + step.z, half);
+        float4 v111 = loadLutPoint(b + step.x + step.y + step.z, half);
+
+        float4 yz00 = v000 + (v100 - v000) * f.x;
+        float4 yz10 = v010 + (v110 - v010) * f.x;
+        float4 yz01 = v001 + (v101 - v001) * f.x;
+        float4 yz11 = v011 + (v111 - v011) * f.x;
+        float4 z0 = yz00 + (yz10 - yz00) * f.y;
+        float4 z1 = yz01 + (yz11 - yz01) * f.y;
+
+        *out = packLutResult(z0 + (z1 - z0) * f.z, in->w);
+    }
+}
+
+void RsdCpuScriptIntrinsic3DLUT::kernelFloatTetrahedral(const RsForEachStubParamStruct *p,
+                                                        uint32_t xstart, uint32_t xend,
+                                                        uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsic3DLUT *cp = (RsdCpuScriptIntrinsic3DLUT *)p->usr;
+
+    uchar4 *out = (uchar4 *)p->out;
+    uchar4 *in = (uchar4 *)p->in;
+    const bool half = cp->mHalfLUT;
+
+    const uchar *bp = (const uchar *)cp->mLUT->mHal.drvState.lod[0].mallocPtr;
+    const int3 dims = {
+        (int)cp->mLUT->mHal.drvState.lod[0].dimX - 1,
+        (int)cp->mLUT->mHal.drvState.lod[0].dimY - 1,
+        (int)cp->mLUT->mHal.drvState.lod[0].dimZ - 1
+    };
+    const float3 scale = convert_float3(dims) * (1.f / 255.f);
+    const int esize = half ? 8 : 16;
+    const int stride_y = (int)cp->mLUT->mHal.drvState.lod[0].stride;
+    const int stride_z = stride_y * cp->mLUT->mHal.drvState.lod[0].dimY;
+    const int3 cellStep = {esize, stride_y, stride_z};
+    const int3 step = {dims.x ? esize : 0, dims.y ? stride_y : 0, dims.z ? stride_z : 0};
+
+    for (uint32_t x1 = xstart; x1 < xend; x1++, in++, out++) {
+        FloatLutCell cell = findFloatLutCell(bp, *in, dims, scale, cellStep);
+        const uchar *b = cell.mBase;
+
+        float f1, f2, f3;
+        int o1, o2;
+        sortTetrahedron(cell.mFrac, step, &f1, &f2, &f3, &o1, &o2);
+
+        float4 v0 = loadLutPoint(b, half);
+        float4 v1 = loadLutPoint(b + o1, half);
+        float4 v2 = loadLutPoint(b + o2, half);
+        float4 v3 = loadLutPoint(b + step.x + step.y + step.z, half);
+
+        *out = packLutResult(v0 * (1.f - f1) + v1 * (f1 - f2) + v2 * (f2 - f3) + v3 * f3,
+                             in->w);
+    }
+}
+
 RsdCpuScriptIntrinsic3DLUT::RsdCpuScriptIntrinsic3DLUT(RsdCpuReferenceImpl *ctx,
                                                      const Script *s, const Element *e)
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_3DLUT) {
 
     mRootPtr = &kernel;
+    mInterpolation = RS_3DLUT_INTERPOLATION_TRILINEAR;
+    mHalfLUT = false;
 }
 
 RsdCpuScriptIntrinsic3DLUT::~RsdCpuScriptIntrinsic3DLUT() {
 }
 
 void RsdCpuScriptIntrinsic3DLUT::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 1;
+    s->mHal.info.exportedVariableCount = 2;
 }
 
 void RsdCpuScriptIntrinsic3DLUT::invokeFreeChildren() {
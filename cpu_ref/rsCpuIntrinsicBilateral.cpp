@@ -0,0 +1,529 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+#include <math.h>
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// An edge preserving blur.  Each tap is weighted by its distance from the
+// centre and by how far its colour is from the centre's, the mean absolute
+// difference of the colour channels (alpha is filtered but not compared).
+//
+// Small radii are filtered directly, with a table of spatial weights and
+// one of range weights indexed by the summed difference.  Large ones use
+// a bilateral grid: pixels are splatted into cells sigmaSpatial wide and
+// sigmaRange deep on their intensity, the grid is blurred along its three
+// axes and the output is read back out of it with trilinear interpolation.
+class RsdCpuScriptIntrinsicBilateral : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return ((fieldSlot == 1) && !mUseGrid) ? mRadius : -1;
+    }
+
+    virtual void preLaunch(uint32_t slot, const Allocation * ain,
+                           Allocation * aout, const void * usr,
+                           uint32_t usrLen, const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicBilateral();
+    RsdCpuScriptIntrinsicBilateral(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    // In auto mode, radii past this are left to the grid.
+    static const int kMaxDirectRadius = 5;
+    static const int kMaxRadius = 25;
+    // Cells of padding around the grid, for its [1 4 6 4 1] blur.
+    static const int kGridPad = 2;
+
+    ObjectBaseRef<const Allocation> mAlloc;
+    float mSigmaSpatial;
+    float mSigmaRange;
+    int32_t mMode;
+    uint32_t mCellSize;
+    uint32_t mChannels;
+    // The channels compared for the range weight.
+    uint32_t mColors;
+
+    int mRadius;
+    bool mUseGrid;
+    float mSpatial[(kMaxRadius * 2 + 1) * (kMaxRadius * 2 + 1)];
+    float mRange[255 * 3 + 1];
+
+    // The grid is indexed [y][x][z][channel], each cell holding the sums
+    // of the channels and then of the weight.  Cells are mGridCell pixels
+    // across and mGridDepth levels of intensity deep.
+    float mGridCell;
+    float mGridDepth;
+    uint32_t mGridX;
+    uint32_t mGridY;
+    uint32_t mGridZ;
+    uint32_t mGridStride;
+    float *mGrid;
+    float *mGridBlur;
+    size_t mGridSize;
+    RsdCpuScratch mScratch;
+    // Set by grid planes that couldn't get scratch and were left unblurred.
+    volatile int32_t mScratchFailed;
+
+    void update();
+    // Returns false if some planes couldn't be run for lack of memory.
+    bool launch(uint32_t slot, const Allocation *in, Allocation *aout, const void *usr,
+                uint32_t usrLen, const RsScriptCall *sc, void (*kernel)());
+
+    static void kernelDirect(const RsForEachStubParamStruct *p,
+                             uint32_t xstart, uint32_t xend,
+                             uint32_t instep, uint32_t outstep);
+    static void kernelSplat(const RsForEachStubParamStruct *p,
+                            uint32_t xstart, uint32_t xend,
+                            uint32_t instep, uint32_t outstep);
+    static void kernelBlurY(const RsForEachStubParamStruct *p,
+                            uint32_t xstart, uint32_t xend,
+                            uint32_t instep, uint32_t outstep);
+    static void kernelSlice(const RsForEachStubParamStruct *p,
+                            uint32_t xstart, uint32_t xend,
+                            uint32_t instep, uint32_t outstep);
+
+    template <bool clampX>
+    void oneDirect(uchar *out, const uchar * const *rows, int32_t x, int32_t dimX) const;
+    float intensity(const uchar *px) const;
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicBilateral::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 1);
+    mAlloc.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicBilateral::setGlobalVar(uint32_t slot, const void *data,
+                                                  size_t dataLength) {
+    switch (slot) {
+    case 0:
+        rsAssert(dataLength == sizeof(float) * 2);
+        mSigmaSpatial = ((const float *)data)[0];
+        mSigmaRange = ((const float *)data)[1];
+        break;
+    case 2:
+        rsAssert(dataLength == sizeof(int32_t));
+        mMode = ((const int32_t *)data)[0];
+        break;
+    default:
+        rsAssert(0);
+        break;
+    }
+    update();
+}
+
+// Picks the path for the current parameters and fills the weight tables.
+void RsdCpuScriptIntrinsicBilateral::update() {
+    int r = (int)ceilf(mSigmaSpatial * 2.f);
+    mUseGrid = (mMode == RS_BILATERAL_GRID) ||
+               ((mMode == RS_BILATERAL_AUTO) && (r > kMaxDirectRadius));
+    mRadius = rsMin(rsMax(r, 1), (int)kMaxRadius);
+    mGridCell = rsMax(mSigmaSpatial, 1.f);
+    mGridDepth = rsMax(mSigmaRange, 1.f);
+    mRootPtr = mUseGrid ? &kernelSlice : &kernelDirect;
+
+    const float ss = -0.5f / (mSigmaSpatial * mSigmaSpatial);
+    float *sw = mSpatial;
+    for (int dy = -mRadius; dy <= mRadius; dy++) {
+        for (int dx = -mRadius; dx <= mRadius; dx++) {
+            *(sw++) = expf((float)(dx * dx + dy * dy) * ss);
+        }
+    }
+    // Indexed by the summed difference, so the mean is taken here.
+    const float sr = -0.5f / (mSigmaRange * mSigmaRange * mColors * mColors);
+    for (uint32_t ct = 0; ct <= 255 * mColors; ct++) {
+        mRange[ct] = expf((float)(ct * ct) * sr);
+    }
+}
+
+template <bool clampX>
+void RsdCpuScriptIntrinsicBilateral::oneDirect(uchar *out, const uchar * const *rows,
+                                               int32_t x, int32_t dimX) const {
+    const int r = mRadius;
+    const uint32_t cs = mCellSize;
+    const uchar *c = rows[r] + x * cs;
+    const float *sw = mSpatial;
+    float sum[4] = {0.f, 0.f, 0.f, 0.f};
+    float wsum = 0.f;
+
+    for (int dy = 0; dy <= r * 2; dy++) {
+        for (int32_t dx = -r; dx <= r; dx++) {
+            int32_t xi = x + dx;
+            if (clampX) {
+                xi = rsMin(rsMax(xi, 0), dimX - 1);
+            }
+            const uchar *q = rows[dy] + xi * cs;
+            uint32_t d = 0;
+            for (uint32_t k = 0; k < mColors; k++) {
+                d += abs((int)q[k] - (int)c[k]);
+            }
+            const float w = *(sw++) * mRange[d];
+            for (uint32_t k = 0; k < mChannels; k++) {
+                sum[k] += w * q[k];
+            }
+            wsum += w;
+        }
+    }
+
+    // The centre weighs 1, so wsum is never 0.
+    const float inv = 1.f / wsum;
+    for (uint32_t k = 0; k < mChannels; k++) {
+        out[k] = (uchar)rsMin(sum[k] * inv + 0.5f, 255.f);
+    }
+}
+
+void RsdCpuScriptIntrinsicBilateral::kernelDirect(const RsForEachStubParamStruct *p,
+                                                  uint32_t xstart, uint32_t xend,
+                                                  uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBilateral *cp = (RsdCpuScriptIntrinsicBilateral *)p->usr;
+    if (!cp->mAlloc.get()) {
+        ALOGE("Bilateral executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
+    const int r = cp->mRadius;
+    const uint32_t cs = cp->mCellSize;
+
+    const uchar *rows[kMaxRadius * 2 + 1];
+    for (int k = 0; k <= r * 2; k++) {
+        rows[k] = pin + stride * rsMin(rsMax((int32_t)p->y + k - r, 0), (int32_t)p->dimY - 1);
+    }
+
+    uchar *out = (uchar *)p->out;
+    uint32_t x1 = xstart;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, r, &ix1, &ix2);
+    while (x1 < ix1) {
+        cp->oneDirect<true>(out, rows, x1, p->dimX);
+        out += cs;
+        x1++;
+    }
+    while (x1 < ix2) {
+        cp->oneDirect<false>(out, rows, x1, p->dimX);
+        out += cs;
+        x1++;
+    }
+    while (x1 < xend) {
+        cp->oneDirect<true>(out, rows, x1, p->dimX);
+        out += cs;
+        x1++;
+    }
+}
+
+float RsdCpuScriptIntrinsicBilateral::intensity(const uchar *px) const {
+    uint32_t s = 0;
+    for (uint32_t k = 0; k < mColors; k++) {
+        s += px[k];
+    }
+    return (float)s / mColors;
+}
+
+// [1 4 6 4 1] / 16 along count cells of line, stride floats apart.  The
+// cells past either end are taken as empty.
+static void BlurLine(float *line, uint32_t count, uint32_t stride, uint32_t cw, float *tmp) {
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(tmp + i * cw, line + i * stride, cw * sizeof(float));
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        float *o = line + i * stride;
+        for (uint32_t k = 0; k < cw; k++) {
+            float v = tmp[i * cw + k] * 6.f;
+            if (i >= 1) v += tmp[(i - 1) * cw + k] * 4.f;
+            if (i >= 2) v += tmp[(i - 2) * cw + k];
+            if (i + 1 < count) v += tmp[(i + 1) * cw + k] * 4.f;
+            if (i + 2 < count) v += tmp[(i + 2) * cw + k];
+            o[k] = v * (1.f / 16.f);
+        }
+    }
+}
+
+// Fills plane p->y of the grid from the image rows nearest it, then
+// blurs the plane along x and z.  Planes are disjoint, so they can be
+// built in parallel.
+void RsdCpuScriptIntrinsicBilateral::kernelSplat(const RsForEachStubParamStruct *p,
+                                                 uint32_t xstart, uint32_t xend,
+                                                 uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBilateral *cp = (RsdCpuScriptIntrinsicBilateral *)p->usr;
+    const Allocation *in = cp->mAlloc.get();
+    const uchar *pin = (const uchar *)in->mHal.drvState.lod[0].mallocPtr;
+    const size_t stride = in->mHal.drvState.lod[0].stride;
+    const uint32_t dimX = in->mHal.drvState.lod[0].dimX;
+    const uint32_t dimY = rsMax(in->mHal.drvState.lod[0].dimY, 1u);
+    const uint32_t cw = cp->mChannels + 1;
+    const uint32_t gz = cp->mGridZ;
+    const float invCell = 1.f / cp->mGridCell;
+    const float invRange = 1.f / cp->mGridDepth;
+    const int32_t j = p->y;
+
+    float *plane = cp->mGrid + (size_t)j * cp->mGridStride;
+    memset(plane, 0, cp->mGridStride * sizeof(float));
+
+    int32_t y = rsMax((int32_t)((j - kGridPad - 1) * cp->mGridCell), 0);
+    for (; y < (int32_t)dimY; y++) {
+        int32_t yj = (int32_t)(y * invCell + 0.5f) + kGridPad;
+        if (yj < j) {
+            continue;
+        }
+        if (yj > j) {
+            break;
+        }
+        const uchar *row = pin + y * stride;
+        for (uint32_t x = 0; x < dimX; x++) {
+            const uchar *px = row + x * cp->mCellSize;
+            uint32_t xi = (uint32_t)(x * invCell + 0.5f) + kGridPad;
+            uint32_t zi = (uint32_t)(cp->intensity(px) * invRange + 0.5f) + kGridPad;
+            float *cell = plane + (xi * gz + zi) * cw;
+            for (uint32_t k = 0; k < cp->mChannels; k++) {
+                cell[k] += px[k];
+            }
+            cell[cp->mChannels] += 1.f;
+        }
+    }
+
+    float *tmp = (float *)cp->mScratch.get(p->lid,
+                                           rsMax(cp->mGridX, gz) * cw * sizeof(float));
+    if (!tmp) {
+        cp->mScratchFailed = 1;
+        return;
+    }
+    for (uint32_t x = 0; x < cp->mGridX; x++) {
+        BlurLine(plane + x * gz * cw, gz, cw, cw, tmp);
+    }
+    for (uint32_t z = 0; z < gz; z++) {
+        BlurLine(plane + z * cw, cp->mGridX, gz * cw, cw, tmp);
+    }
+}
+
+// Blurs the grid along y, plane p->y being written to mGridBlur.
+void RsdCpuScriptIntrinsicBilateral::kernelBlurY(const RsForEachStubParamStruct *p,
+                                                 uint32_t xstart, uint32_t xend,
+                                                 uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBilateral *cp = (RsdCpuScriptIntrinsicBilateral *)p->usr;
+    static const float w[5] = {1.f / 16.f, 4.f / 16.f, 6.f / 16.f, 4.f / 16.f, 1.f / 16.f};
+    const int32_t j = p->y;
+    const size_t n = cp->mGridStride;
+
+    float *o = cp->mGridBlur + (size_t)j * n;
+    memset(o, 0, n * sizeof(float));
+    for (int32_t k = -2; k <= 2; k++) {
+        if ((j + k < 0) || (j + k >= (int32_t)cp->mGridY)) {
+            continue;
+        }
+        const float *s = cp->mGrid + (size_t)(j + k) * n;
+        const float wk = w[k + 2];
+        for (size_t i = 0; i < n; i++) {
+            o[i] += s[i] * wk;
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicBilateral::kernelSlice(const RsForEachStubParamStruct *p,
+                                                 uint32_t xstart, uint32_t xend,
+                                                 uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBilateral *cp = (RsdCpuScriptIntrinsicBilateral *)p->usr;
+    if (!cp->mAlloc.get() || !cp->mGrid) {
+        ALOGE("Bilateral executed without input, skipping");
+        return;
+    }
+    if (!cp->mGridBlur) {
+        // Building the grid ran out of memory, which preLaunch reported.
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
+    const uint32_t cs = cp->mCellSize;
+    const uint32_t ch = cp->mChannels;
+    const uint32_t cw = ch + 1;
+    const uint32_t gz = cp->mGridZ;
+    const float invCell = 1.f / cp->mGridCell;
+    const float invRange = 1.f / cp->mGridDepth;
+
+    const float gy = p->y * invCell + kGridPad;
+    const uint32_t j0 = (uint32_t)gy;
+    const float fy = gy - j0;
+    const float *planes[2] = {cp->mGridBlur + (size_t)j0 * cp->mGridStride,
+                              cp->mGridBlur + (size_t)(j0 + 1) * cp->mGridStride};
+
+    const uchar *row = pin + p->y * stride;
+    uchar *out = (uchar *)p->out;
+    for (uint32_t x = xstart; x < xend; x++) {
+        const uchar *px = row + x * cs;
+        const float gx = x * invCell + kGridPad;
+        const float gzf = cp->intensity(px) * invRange + kGridPad;
+        const uint32_t i0 = (uint32_t)gx;
+        const uint32_t k0 = (uint32_t)gzf;
+        const float fx = gx - i0;
+        const float fz = gzf - k0;
+
+        float v[5] = {0.f, 0.f, 0.f, 0.f, 0.f};
+        for (int b = 0; b < 8; b++) {
+            const float w = ((b & 1) ? fx : 1.f - fx) *
+                            ((b & 2) ? fy : 1.f - fy) *
+                            ((b & 4) ? fz : 1.f - fz);
+            const float *cell = planes[(b >> 1) & 1] +
+                                ((i0 + (b & 1)) * gz + k0 + (b >> 2)) * cw;
+            for (uint32_t k = 0; k < cw; k++) {
+                v[k] += cell[k] * w;
+            }
+        }
+
+        if (v[ch] > 0.f) {
+            const float inv = 1.f / v[ch];
+            for (uint32_t k = 0; k < ch; k++) {
+                out[k] = (uchar)rsMin(v[k] * inv + 0.5f, 255.f);
+            }
+        } else {
+            memcpy(out, px, ch);
+        }
+        out += cs;
+    }
+}
+
+bool RsdCpuScriptIntrinsicBilateral::launch(uint32_t slot, const Allocation *in,
+                                            Allocation *aout, const void *usr,
+                                            uint32_t usrLen, const RsScriptCall *sc,
+                                            void (*kernel)()) {
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(in, aout, usr, usrLen, sc, &mtls);
+    mtls.script = this;
+    mtls.fep.slot = slot;
+    mtls.kernel = kernel;
+    mtls.fep.usr = this;
+
+    // One cell per plane of the grid.
+    mtls.mTileBytes = 0;
+    mtls.fep.dimX = 1;
+    mtls.fep.dimY = mGridY;
+    mtls.xStart = 0;
+    mtls.xEnd = 1;
+    mtls.yStart = 0;
+    mtls.yEnd = mGridY;
+
+    mScratchFailed = 0;
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    mCtx->launchThreads(in, aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    return !mScratchFailed;
+}
+
+// In grid mode, builds and blurs the grid the launch will slice.
+void RsdCpuScriptIntrinsicBilateral::preLaunch(uint32_t slot, const Allocation * ain,
+                                               Allocation * aout, const void * usr,
+                                               uint32_t usrLen, const RsScriptCall *sc) {
+    if (!mUseGrid) {
+        return;
+    }
+    const Allocation *in = mAlloc.get();
+    if (!in || !in->mHal.drvState.lod[0].mallocPtr) {
+        return;
+    }
+
+    const uint32_t dimX = in->mHal.drvState.lod[0].dimX;
+    const uint32_t dimY = rsMax(in->mHal.drvState.lod[0].dimY, 1u);
+    const float invCell = 1.f / mGridCell;
+    mGridX = (uint32_t)((dimX - 1) * invCell) + 2 + kGridPad * 2;
+    mGridY = (uint32_t)((dimY - 1) * invCell) + 2 + kGridPad * 2;
+    mGridZ = (uint32_t)(255.f / mGridDepth) + 2 + kGridPad * 2;
+    mGridStride = mGridX * mGridZ * (mChannels + 1);
+
+    size_t count = (size_t)mGridStride * mGridY;
+    if (count > mGridSize) {
+        float *g = (float *)realloc(mGrid, count * sizeof(float) * 2);
+        if (!g) {
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                         "Out of memory for bilateral grid");
+            free(mGrid);
+            mGrid = NULL;
+            mGridBlur = NULL;
+            mGridSize = 0;
+            return;
+        }
+        mGrid = g;
+        mGridSize = count;
+    }
+    mGridBlur = mGrid + count;
+
+    if (!launch(slot, in, aout, usr, usrLen, sc, (void (*)())&kernelSplat)) {
+        mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                     "Out of memory for bilateral grid");
+        mGridBlur = NULL;
+        return;
+    }
+    launch(slot, in, aout, usr, usrLen, sc, (void (*)())&kernelBlurY);
+}
+
+RsdCpuScriptIntrinsicBilateral::RsdCpuScriptIntrinsicBilateral(RsdCpuReferenceImpl *ctx,
+                                                               const Script *s,
+                                                               const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_BILATERAL),
+              mScratch(ctx->getThreadCount()) {
+
+    mRootPtr = &kernelDirect;
+    mCellSize = e->getSizeBytes();
+    mChannels = e->getVectorSize();
+    mColors = (mChannels == 4) ? 3 : mChannels;
+    mSigmaSpatial = 1.f;
+    mSigmaRange = 25.f;
+    mMode = RS_BILATERAL_AUTO;
+    mGridX = 0;
+    mGridY = 0;
+    mGridZ = 0;
+    mGridStride = 0;
+    mGrid = NULL;
+    mGridBlur = NULL;
+    mGridSize = 0;
+    mScratchFailed = 0;
+    update();
+}
+
+RsdCpuScriptIntrinsicBilateral::~RsdCpuScriptIntrinsicBilateral() {
+    free(mGrid);
+}
+
+void RsdCpuScriptIntrinsicBilateral::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 3;
+}
+
+void RsdCpuScriptIntrinsicBilateral::invokeFreeChildren() {
+    mAlloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Bilateral(RsdCpuReferenceImpl *ctx,
+                                          const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicBilateral(ctx, s, e);
+}
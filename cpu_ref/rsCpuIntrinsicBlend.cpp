@@ -18,6 +18,11 @@
 #include "rsCpuIntrinsic.h"
 #include "rsCpuIntrinsicInlines.h"
 
+#if defined(ARCH_ARM_USE_INTRINSICS) && defined(__ARM_NEON)
+#define RS_BLEND_NEON 1
+#include <arm_neon.h>
+#endif
+
 using namespace android;
 using namespace android::renderscript;
 
@@ -28,6 +33,13 @@ namespace renderscript {
 class RsdCpuScriptIntrinsicBlend : public RsdCpuScriptIntrinsic {
 public:
     virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return (fieldSlot == 1) ? 0 : -1;
+    }
 
     virtual ~RsdCpuScriptIntrinsicBlend();
     RsdCpuScriptIntrinsicBlend(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
@@ -36,6 +48,16 @@ protected:
     static void kernel(const RsForEachStubParamStruct *p,
                           uint32_t xstart, uint32_t xend,
                           uint32_t instep, uint32_t outstep);
+    static void kernelH(const RsForEachStubParamStruct *p,
+                        uint32_t xstart, uint32_t xend,
+                        uint32_t instep, uint32_t outstep);
+
+    // Coverage the source is scaled by before it is blended: a uchar1
+    // mask the size of the output, times a global alpha, 255 being opaque.
+    ObjectBaseRef<const Allocation> mMask;
+    int32_t mAlpha;
+
+    const uchar * getMaskRow(const RsForEachStubParamStruct *p, uint32_t xend) const;
 };
 
 }
@@ -103,35 +125,26 @@ extern "C" void rsdIntrinsicBlendMultiply_K(void *dst, const void *src, uint32_t
 extern "C" void rsdIntrinsicBlendAdd_K(void *dst, const void *src, uint32_t count8);
 extern "C" void rsdIntrinsicBlendSub_K(void *dst, const void *src, uint32_t count8);
 
-void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
-                                        uint32_t xstart, uint32_t xend,
-                                        uint32_t instep, uint32_t outstep) {
-    RsdCpuScriptIntrinsicBlend *cp = (RsdCpuScriptIntrinsicBlend *)p->usr;
-
-    // instep/outstep can be ignored--sizeof(uchar4) known at compile time
-    uchar4 *out = (uchar4 *)p->out;
-    uchar4 *in = (uchar4 *)p->in;
-    uint32_t x1 = xstart;
-    uint32_t x2 = xend;
+static void BlendRow(uint32_t slot, uchar4 *out, const uchar4 *in, uint32_t count) {
+    uint32_t x1 = 0;
+    uint32_t x2 = count;
 
-    switch (p->slot) {
+    switch (slot) {
+    // Clear and Src touch every byte the same way, so the library versions
+    // of the fills and copies beat any per-pixel loop.
     case BLEND_CLEAR:
-        for (;x1 < x2; x1++, out++) {
-            *out = 0;
-        }
+        memset(out, 0, (x2 - x1) * sizeof(uchar4));
         break;
     case BLEND_SRC:
-        for (;x1 < x2; x1++, out++, in++) {
-          *out = *in;
-        }
+        memcpy(out, in, (x2 - x1) * sizeof(uchar4));
         break;
     //BLEND_DST is a NOP
     case BLEND_DST:
         break;
     case BLEND_SRC_OVER:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendSrcOver_K(out, in, len);
                 x1 += len << 3;
@@ -148,9 +161,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_DST_OVER:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendDstOver_K(out, in, len);
                 x1 += len << 3;
@@ -167,9 +180,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_SRC_IN:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendSrcIn_K(out, in, len);
                 x1 += len << 3;
@@ -185,9 +198,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_DST_IN:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendDstIn_K(out, in, len);
                 x1 += len << 3;
@@ -203,9 +216,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_SRC_OUT:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendSrcOut_K(out, in, len);
                 x1 += len << 3;
@@ -221,9 +234,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_DST_OUT:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendDstOut_K(out, in, len);
                 x1 += len << 3;
@@ -239,9 +252,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_SRC_ATOP:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendSrcAtop_K(out, in, len);
                 x1 += len << 3;
@@ -259,9 +272,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_DST_ATOP:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendDstAtop_K(out, in, len);
                 x1 += len << 3;
@@ -279,9 +292,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_XOR:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendXor_K(out, in, len);
                 x1 += len << 3;
@@ -303,9 +316,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         rsAssert(false);
         break;
     case BLEND_MULTIPLY:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendMultiply_K(out, in, len);
                 x1 += len << 3;
@@ -396,9 +409,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         rsAssert(false);
         break;
     case BLEND_ADD:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendAdd_K(out, in, len);
                 x1 += len << 3;
@@ -417,9 +430,9 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         }
         break;
     case BLEND_SUBTRACT:
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
         if (gArchUseSIMD) {
-            if((x1 + 8) < x2) {
+            if((x1 + 8) <= x2) {
                 uint32_t len = (x2 - x1) >> 3;
                 rsdIntrinsicBlendSub_K(out, in, len);
                 x1 += len << 3;
@@ -471,25 +484,280 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
         break;
 
     default:
-        ALOGE("Called unimplemented value %d", p->slot);
+        ALOGE("Called unimplemented value %d", slot);
         rsAssert(false);
 
     }
 }
 
+static inline uchar mul255(uint32_t a, uint32_t b) {
+    const uint32_t t = a * b;
+    return (uchar)((t + ((t + 128) >> 8) + 128) >> 8);
+}
+
+#if defined(RS_BLEND_NEON)
+static inline uint8x8_t mul255N(uint8x8_t a, uint8x8_t b) {
+    const uint16x8_t t = vmull_u8(a, b);
+    return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+#endif
+
+// Scales count premultiplied source pixels by mask times alpha into dst,
+// the mask being optional.  Both rounding paths give the same results.
+static void ScaleSource(uchar4 *dst, const uchar4 *src, const uchar *mask,
+                        uint32_t alpha, uint32_t count) {
+    uint32_t x = 0;
+#if defined(RS_BLEND_NEON)
+    if (gArchUseSIMD) {
+        const uint8x8_t va = vdup_n_u8((uint8_t)alpha);
+        for (; (x + 8) <= count; x += 8) {
+            uint8x8x4_t s = vld4_u8((const uint8_t *)(src + x));
+            uint8x8_t m = va;
+            if (mask) {
+                m = vld1_u8(mask + x);
+                if (alpha != 255) {
+                    m = mul255N(m, va);
+                }
+            }
+            s.val[0] = mul255N(s.val[0], m);
+            s.val[1] = mul255N(s.val[1], m);
+            s.val[2] = mul255N(s.val[2], m);
+            s.val[3] = mul255N(s.val[3], m);
+            vst4_u8((uint8_t *)(dst + x), s);
+        }
+    }
+#endif
+    for (; x < count; x++) {
+        const uint32_t m = mask ? mul255(mask[x], alpha) : alpha;
+        dst[x].x = mul255(src[x].x, m);
+        dst[x].y = mul255(src[x].y, m);
+        dst[x].z = mul255(src[x].z, m);
+        dst[x].w = mul255(src[x].w, m);
+    }
+}
+
+// Pixels scaled per pass, few enough for the copy to stay in L1 between
+// the scaling and the blend.
+static const uint32_t kScaleChunk = 64;
+
+const uchar * RsdCpuScriptIntrinsicBlend::getMaskRow(const RsForEachStubParamStruct *p,
+                                                     uint32_t xend) const {
+    const Allocation *mask = mMask.get();
+    if (!mask) {
+        return NULL;
+    }
+    if ((xend > mask->mHal.drvState.lod[0].dimX) ||
+        (p->y >= rsMax(mask->mHal.drvState.lod[0].dimY, 1u))) {
+        return NULL;
+    }
+    size_t stride;
+    const uint8_t *base = getFieldInput(p->lid, 1, mask, &stride);
+    return base + p->y * stride;
+}
+
+void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
+                                        uint32_t xstart, uint32_t xend,
+                                        uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBlend *cp = (RsdCpuScriptIntrinsicBlend *)p->usr;
+
+    // instep/outstep can be ignored--sizeof(uchar4) known at compile time
+    uchar4 *out = (uchar4 *)p->out;
+    const uchar4 *in = (const uchar4 *)p->in;
+
+    if ((p->slot == BLEND_CLEAR) || (p->slot == BLEND_DST)) {
+        BlendRow(p->slot, out, in, xend - xstart);
+        return;
+    }
+    const uchar *mask = cp->getMaskRow(p, xend);
+    if (cp->mMask.get() && !mask) {
+        ALOGE("Blend mask smaller than the output, skipping");
+        return;
+    }
+    const uint32_t alpha = (uint32_t)rsMin(rsMax(cp->mAlpha, 0), 255);
+    if (!mask && (alpha == 255)) {
+        BlendRow(p->slot, out, in, xend - xstart);
+        return;
+    }
+
+    // Scaling a chunk at a time lets the existing kernels, SIMD ones
+    // included, blend the scaled source without a pass over the image.
+    uchar4 scaled[kScaleChunk];
+    mask = mask ? mask + xstart : NULL;
+    for (uint32_t x = xstart; x < xend;) {
+        const uint32_t n = rsMin(xend - x, kScaleChunk);
+        ScaleSource(scaled, in, mask, alpha, n);
+        BlendRow(p->slot, out, scaled, n);
+        in += n;
+        out += n;
+        mask = mask ? mask + n : NULL;
+        x += n;
+    }
+}
+
+
+// Half pixels are blended as floats with alpha in [0, 1].  Xor is the
+// Porter-Duff operator rather than the bitwise one used for uchar4, and
+// Add does not clamp so values above 1 survive.
+static bool OneBlendH(uint32_t slot, float4 *out, const float4 *in, uint32_t count) {
+    switch (slot) {
+    case BLEND_SRC_OVER:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = in[i] + out[i] * (1.f - in[i].w);
+        }
+        break;
+    case BLEND_DST_OVER:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = out[i] + in[i] * (1.f - out[i].w);
+        }
+        break;
+    case BLEND_SRC_IN:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = in[i] * out[i].w;
+        }
+        break;
+    case BLEND_DST_IN:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = out[i] * in[i].w;
+        }
+        break;
+    case BLEND_SRC_OUT:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = in[i] * (1.f - out[i].w);
+        }
+        break;
+    case BLEND_DST_OUT:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = out[i] * (1.f - in[i].w);
+        }
+        break;
+    case BLEND_SRC_ATOP:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i].xyz = in[i].xyz * out[i].w + out[i].xyz * (1.f - in[i].w);
+        }
+        break;
+    case BLEND_DST_ATOP:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i].xyz = out[i].xyz * in[i].w + in[i].xyz * (1.f - out[i].w);
+        }
+        break;
+    case BLEND_XOR:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = in[i] * (1.f - out[i].w) + out[i] * (1.f - in[i].w);
+        }
+        break;
+    case BLEND_MULTIPLY:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = in[i] * out[i];
+        }
+        break;
+    case BLEND_ADD:
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = out[i] + in[i];
+        }
+        break;
+    case BLEND_SUBTRACT:
+        for (uint32_t i = 0; i < count; i++) {
+            float4 d = out[i] - in[i];
+            out[i].x = d.x < 0.f ? 0.f : d.x;
+            out[i].y = d.y < 0.f ? 0.f : d.y;
+            out[i].z = d.z < 0.f ? 0.f : d.z;
+            out[i].w = d.w < 0.f ? 0.f : d.w;
+        }
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+static const uint32_t kHalfChunk = 64;
+
+void RsdCpuScriptIntrinsicBlend::kernelH(const RsForEachStubParamStruct *p,
+                                         uint32_t xstart, uint32_t xend,
+                                         uint32_t instep, uint32_t outstep) {
+    // Both allocations are half4, four ushorts per pixel.
+    ushort *out = (ushort *)p->out;
+    const ushort *in = (const ushort *)p->in;
+    uint32_t x1 = xstart;
+    uint32_t x2 = xend;
+
+    switch (p->slot) {
+    case BLEND_CLEAR:
+        memset(out, 0, (x2 - x1) * 4 * sizeof(ushort));
+        return;
+    case BLEND_SRC:
+        memcpy(out, in, (x2 - x1) * 4 * sizeof(ushort));
+        return;
+    case BLEND_DST:
+        return;
+    }
+
+    RsdCpuScriptIntrinsicBlend *cp = (RsdCpuScriptIntrinsicBlend *)p->usr;
+    const uchar *mask = cp->getMaskRow(p, xend);
+    if (cp->mMask.get() && !mask) {
+        ALOGE("Blend mask smaller than the output, skipping");
+        return;
+    }
+    mask = mask ? mask + xstart : NULL;
+    const float alpha = rsMin(rsMax(cp->mAlpha, 0), 255) * (1.f / 255.f);
+
+    float4 fin[kHalfChunk];
+    float4 fout[kHalfChunk];
+    while (x1 < x2) {
+        uint32_t n = rsMin(x2 - x1, kHalfChunk);
+        rsHalfToFloatRow((float *)fin, in, n * 4);
+        rsHalfToFloatRow((float *)fout, out, n * 4);
+        if (mask) {
+            for (uint32_t i = 0; i < n; i++) {
+                fin[i] *= mask[i] * (alpha * (1.f / 255.f));
+            }
+            mask += n;
+        } else if (alpha != 1.f) {
+            for (uint32_t i = 0; i < n; i++) {
+                fin[i] *= alpha;
+            }
+        }
+        if (!OneBlendH(p->slot, fout, fin, n)) {
+            ALOGE("Called unimplemented blend intrinsic %d for half4", p->slot);
+            rsAssert(false);
+            return;
+        }
+        rsFloatToHalfRow(out, (const float *)fout, n * 4);
+        in += n * 4;
+        out += n * 4;
+        x1 += n;
+    }
+}
+
 
 RsdCpuScriptIntrinsicBlend::RsdCpuScriptIntrinsicBlend(RsdCpuReferenceImpl *ctx,
                                                        const Script *s, const Element *e)
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_BLEND) {
 
-    mRootPtr = &kernel;
+    mRootPtr = (e->getType() == RS_TYPE_FLOAT_16) ? &kernelH : &kernel;
+    mAlpha = 255;
 }
 
 RsdCpuScriptIntrinsicBlend::~RsdCpuScriptIntrinsicBlend() {
 }
 
+void RsdCpuScriptIntrinsicBlend::setGlobalVar(uint32_t slot, const void *data,
+                                             size_t dataLength) {
+    rsAssert(slot == 0);
+    memcpy(&mAlpha, data, rsMin(dataLength, sizeof(mAlpha)));
+}
+
+void RsdCpuScriptIntrinsicBlend::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 1);
+    mMask.set(static_cast<Allocation *>(data));
+}
+
 void RsdCpuScriptIntrinsicBlend::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 0;
+    s->mHal.info.exportedVariableCount = 2;
+}
+
+void RsdCpuScriptIntrinsicBlend::invokeFreeChildren() {
+    mMask.clear();
 }
 
 RsdCpuScriptImpl * rsdIntrinsic_Blend(RsdCpuReferenceImpl *ctx,
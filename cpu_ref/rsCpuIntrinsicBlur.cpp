@@ -31,26 +31,73 @@ public:
 
     virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    // The box path carries running sums from row to row, so it needs the
+    // whole input.
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return ((fieldSlot == 1) && (mRootPtr != &kernelBox)) ? mIradius : -1;
+    }
+
+    virtual void preLaunch(uint32_t slot, const Allocation * ain,
+                           Allocation * aout, const void * usr,
+                           uint32_t usrLen, const RsScriptCall *sc);
 
     virtual ~RsdCpuScriptIntrinsicBlur();
     RsdCpuScriptIntrinsicBlur(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
 
 protected:
+    // Radii up to kMaxGaussianRadius walk the gaussian kernel tap by tap.
+    // Larger ones approximate it with three cascaded box filters whose
+    // cost per pixel does not depend on the radius.
+    static const int kMaxGaussianRadius = 25;
+    static const int kMaxBoxRadius = 200;
+    static const int kMaxBoxHalfWidth = 81;
+
+    // Each thread keeps the vertical state of the last row it produced:
+    // the cascade sums of the box path, or the ring of input rows of the
+    // gaussian one.  When its next row is the one below, the state is
+    // advanced by one row instead of being rebuilt.
+    struct RowState {
+        int32_t mNextY;
+        uint32_t mX1;
+        uint32_t mX2;
+        uint32_t mPhase;
+    };
+
+    // uchar4 radii from kMinRingRadius convert each input row to floats
+    // once, into a ring of the 2 * radius + 1 rows around the current one,
+    // rather than once for every output row it contributes to.  Rows too
+    // wide for the ring to stay in cache take the direct path.
+    static const int kMinRingRadius = 8;
+    static const size_t kMaxRingBytes = 1024 * 1024;
+
     float mFp[104];
     short mIp[104];
-    void **mScratch;
-    size_t *mScratchSize;
+    RsdCpuScratch mScratch;
     float mRadius;
     int mIradius;
     ObjectBaseRef<Allocation> mAlloc;
 
+    uint32_t mBoxKernel[6 * kMaxBoxHalfWidth + 1];
+    float mBoxScale;
+    int mBoxRadius;
+    int mVectorSize;
+    bool mHalf;
+    RowState *mRowState;
+
     static void kernelU4(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
                          uint32_t instep, uint32_t outstep);
     static void kernelU1(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
                          uint32_t instep, uint32_t outstep);
+    static void kernelH(const RsForEachStubParamStruct *p,
+                        uint32_t xstart, uint32_t xend,
+                        uint32_t instep, uint32_t outstep);
+    static void kernelBox(const RsForEachStubParamStruct *p,
+                          uint32_t xstart, uint32_t xend,
+                          uint32_t instep, uint32_t outstep);
     void ComputeGaussianWeights();
+    void ComputeBoxWeights();
 };
 
 }
@@ -99,6 +146,33 @@ void RsdCpuScriptIntrinsicBlur::ComputeGaussianWeights() {
     }
 }
 
+// Three box filters of width w in a row have the variance of a gaussian
+// with sigma^2 = (w^2 - 1) / 4.  The cascade is stored as one integer
+// kernel of 6 * mBoxRadius + 1 taps, used when a thread has to start the
+// running sums from scratch.
+void RsdCpuScriptIntrinsicBlur::ComputeBoxWeights() {
+    float sigma = 0.4f * mRadius + 0.6f;
+    float w = sqrtf(4.0f * sigma * sigma + 1.0f);
+    mBoxRadius = rsMin(rsMax((int)((w - 1.0f) * 0.5f + 0.5f), 1), kMaxBoxHalfWidth);
+
+    const int width = mBoxRadius * 2 + 1;
+    const int taps = width * 3 - 2;
+    uint32_t tmp[6 * kMaxBoxHalfWidth + 1];
+    for (int i = 0; i < taps; i++) {
+        tmp[i] = i < width ? 1 : 0;
+    }
+    for (int pass = 1; pass < 3; pass++) {
+        memset(mBoxKernel, 0, sizeof(mBoxKernel));
+        for (int i = 0; i < taps; i++) {
+            for (int j = 0; (j < width) && (i + j < taps); j++) {
+                mBoxKernel[i + j] += tmp[i];
+            }
+        }
+        memcpy(tmp, mBoxKernel, sizeof(uint32_t) * taps);
+    }
+    mBoxScale = 1.0f / ((float)width * width * width);
+}
+
 void RsdCpuScriptIntrinsicBlur::setGlobalObj(uint32_t slot, ObjectBase *data) {
     rsAssert(slot == 1);
     mAlloc.set(static_cast<Allocation *>(data));
@@ -106,8 +180,30 @@ void RsdCpuScriptIntrinsicBlur::setGlobalObj(uint32_t slot, ObjectBase *data) {
 
 void RsdCpuScriptIntrinsicBlur::setGlobalVar(uint32_t slot, const void *data, size_t dataLength) {
     rsAssert(slot == 0);
-    mRadius = ((const float *)data)[0];
-    ComputeGaussianWeights();
+    mRadius = rsMin(((const float *)data)[0], (float)kMaxBoxRadius);
+    if (mHalf) {
+        // The box cascade runs on exact integer sums of uchar pixels, so
+        // half elements stay on the gaussian path.
+        mRadius = rsMin(mRadius, (float)kMaxGaussianRadius);
+        ComputeGaussianWeights();
+        mRootPtr = &kernelH;
+    } else if (mRadius > kMaxGaussianRadius) {
+        ComputeBoxWeights();
+        mRootPtr = &kernelBox;
+    } else {
+        ComputeGaussianWeights();
+        mRootPtr = (mVectorSize == 1) ? &kernelU1 : &kernelU4;
+    }
+}
+
+void RsdCpuScriptIntrinsicBlur::preLaunch(uint32_t slot, const Allocation * ain,
+                                          Allocation * aout, const void * usr,
+                                          uint32_t usrLen, const RsScriptCall *sc) {
+    // The input may have changed since the last launch, so no thread can
+    // carry its running sums over.
+    for (uint32_t ct = 0; ct < mCtx->getThreadCount(); ct++) {
+        mRowState[ct].mNextY = -1;
+    }
 }
 
 
@@ -155,21 +251,20 @@ static void OneVFU4(float4 *out,
                     const uchar *ptrIn, int iStride, const float* gPtr, int ct,
                     int x1, int x2) {
 
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
     if (gArchUseSIMD) {
         int t = (x2 - x1);
         t &= ~1;
         if(t) {
             rsdIntrinsicBlurVFU4_K(out, ptrIn, iStride, gPtr, ct, x1, x1 + t);
             x1 += t;
-            ptrIn += t << 2;
             out += t;
         }
     }
 #endif
 
     while(x2 > x1) {
-        const uchar *pi = ptrIn;
+        const uchar *pi = ptrIn + x1 * 4;
         float4 blurredPixel = 0;
         const float* gp = gPtr;
 
@@ -182,7 +277,6 @@ static void OneVFU4(float4 *out,
         out->xyzw = blurredPixel;
         x1++;
         out++;
-        ptrIn+=4;
     }
 }
 
@@ -209,7 +303,7 @@ static void OneVFU1(float *out,
         len--;
     }
 
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
     if (gArchUseSIMD && (x2 > x1)) {
         int t = (x2 - x1) >> 2;
         t &= ~1;
@@ -240,10 +334,50 @@ static void OneVFU1(float *out,
     }
 }
 
-static void OneHU4(const RsForEachStubParamStruct *p, uchar4 *out, int32_t x,
-                   const float4 *ptrIn, const float* gPtr, int iradius) {
+static inline int clampIndex(int i, int count) {
+    return rsMin(rsMax(i, 0), count - 1);
+}
+
+static void ConvertRowU4(float4 *dst, const uchar4 *src, uint32_t count) {
+    for (uint32_t x = 0; x < count; x++) {
+        dst[x] = convert_float4(src[x]);
+    }
+}
+
+// Sums the rows of the ring into out.  Columns are taken a chunk at a time
+// so the partial sums stay in L1 while every row is added to them.
+static void OneRingVFU4(float4 *out, const float4 * const *rows, const float *gPtr,
+                        int ct, uint32_t count) {
+    const uint32_t kChunk = 64;
+    for (uint32_t x1 = 0; x1 < count; x1 += kChunk) {
+        const uint32_t x2 = rsMin(x1 + kChunk, count);
+        for (uint32_t x = x1; x < x2; x++) {
+            out[x] = rows[0][x] * gPtr[0];
+        }
+        for (int r = 1; r < ct; r++) {
+            const float4 *pr = rows[r];
+            const float g = gPtr[r];
+            for (uint32_t x = x1; x < x2; x++) {
+                out[x] += pr[x] * g;
+            }
+        }
+    }
+}
+
+// The horizontal taps only need clampX for the columns within the radius
+// of either end of the row.
+static inline void OneHU4(const RsForEachStubParamStruct *p, uchar4 *out, int32_t x,
+                          const float4 *ptrIn, const float* gPtr, int iradius, bool clampX) {
 
     float4 blurredPixel = 0;
+    if (!clampX) {
+        const float4 *pi = ptrIn + x - iradius;
+        for (int r = 0; r <= iradius * 2; r++) {
+            blurredPixel += pi[r] * gPtr[r];
+        }
+        out->xyzw = convert_uchar4(blurredPixel);
+        return;
+    }
     for (int r = -iradius; r <= iradius; r ++) {
         int validX = rsMax((x + r), 0);
         validX = rsMin(validX, (int)(p->dimX - 1));
@@ -255,10 +389,18 @@ static void OneHU4(const RsForEachStubParamStruct *p, uchar4 *out, int32_t x,
     out->xyzw = convert_uchar4(blurredPixel);
 }
 
-static void OneHU1(const RsForEachStubParamStruct *p, uchar *out, int32_t x,
-                   const float *ptrIn, const float* gPtr, int iradius) {
+static inline void OneHU1(const RsForEachStubParamStruct *p, uchar *out, int32_t x,
+                          const float *ptrIn, const float* gPtr, int iradius, bool clampX) {
 
     float blurredPixel = 0;
+    if (!clampX) {
+        const float *pi = ptrIn + x - iradius;
+        for (int r = 0; r <= iradius * 2; r++) {
+            blurredPixel += pi[r] * gPtr[r];
+        }
+        out[0] = (uchar)blurredPixel;
+        return;
+    }
     for (int r = -iradius; r <= iradius; r ++) {
         int validX = rsMax((x + r), 0);
         validX = rsMin(validX, (int)(p->dimX - 1));
@@ -282,53 +424,100 @@ void RsdCpuScriptIntrinsicBlur::kernelU4(const RsForEachStubParamStruct *p,
         ALOGE("Blur executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uchar4 *out = (uchar4 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
 
-    if (p->dimX > 2048) {
-        if ((p->dimX > cp->mScratchSize[p->lid]) || !cp->mScratch[p->lid]) {
-            // Pad the side of the allocation by one unit to allow alignment later
-            cp->mScratch[p->lid] = realloc(cp->mScratch[p->lid], (p->dimX + 1) * 16);
-            cp->mScratchSize[p->lid] = p->dimX;
+    // The vertical pass fills buf at absolute x positions.  When only part
+    // of a row is launched (tiled or clipped launches) it also has to cover
+    // the horizontal window on either side of [xstart, xend).
+    uint32_t vx1 = rsMax((int32_t)x1 - cp->mIradius, 0);
+    uint32_t vx2 = rsMin(x2 + cp->mIradius, p->dimX);
+    const int ct = cp->mIradius * 2 + 1;
+    const uint32_t cols = vx2 - vx1;
+    const size_t ringBytes = (size_t)ct * cols * sizeof(float4);
+    const bool useRing = (cp->mIradius >= kMinRingRadius) && (ringBytes <= kMaxRingBytes);
+    // Both the ring and a wide buf live in scratch, the ring first so its
+    // rows keep their place from one call to the next.
+    uchar *scratch = NULL;
+    if (useRing || (p->dimX > 2048)) {
+        scratch = (uchar *)cp->mScratch.get(p->lid, (useRing ? ringBytes : 0) +
+                                            ((p->dimX > 2048) ? p->dimX * 16 : 0));
+        if (!scratch) {
+            ALOGE("Blur out of memory for its rows, skipping a row");
+            return;
         }
-        // realloc only aligns to 8 bytes so we manually align to 16.
-        buf = (float4 *) ((((intptr_t)cp->mScratch[p->lid]) + 15) & ~0xf);
     }
-    float4 *fout = (float4 *)buf;
+    if (p->dimX > 2048) {
+        buf = (float4 *)(scratch + (useRing ? ringBytes : 0));
+    }
+    float4 *fout = buf + vx1;
     int y = p->y;
-    if ((y > cp->mIradius) && (y < ((int)p->dimY - cp->mIradius))) {
+    // Each row further down adds one row at the bottom of the window.
+    if (p->prefetchRows) {
+        prefetchInputRow(p, pin, stride, y + cp->mIradius + p->prefetchRows, vx1 * 4, vx2 * 4);
+    }
+    if (useRing) {
+        // Row v of the window is kept in slot v mod ct, clamped rows past
+        // either edge included, so moving down a row converts just one.
+        float4 *ring = (float4 *)scratch;
+        RowState *rs = &cp->mRowState[p->lid];
+        int v = y + cp->mIradius;
+        if ((rs->mNextY != y) || (rs->mX1 != vx1) || (rs->mX2 != vx2)) {
+            v = y - cp->mIradius;
+            rs->mX1 = vx1;
+            rs->mX2 = vx2;
+        }
+        for (; v <= y + cp->mIradius; v++) {
+            const uchar *pi = pin + clampIndex(v, p->dimY) * stride + vx1 * 4;
+            ConvertRowU4(ring + ((v + ct) % ct) * cols, (const uchar4 *)pi, cols);
+        }
+        rs->mNextY = y + 1;
+
+        const float4 *rows[kMaxGaussianRadius * 2 + 1];
+        for (int r = 0; r < ct; r++) {
+            rows[r] = ring + ((y - cp->mIradius + r + ct) % ct) * cols;
+        }
+        OneRingVFU4(fout, rows, cp->mFp, ct, cols);
+    } else if ((y > cp->mIradius) && (y < ((int)p->dimY - cp->mIradius))) {
         const uchar *pi = pin + (y - cp->mIradius) * stride;
-        OneVFU4(fout, pi, stride, cp->mFp, cp->mIradius * 2 + 1, x1, x2);
+        OneVFU4(fout, pi, stride, cp->mFp, cp->mIradius * 2 + 1, vx1, vx2);
     } else {
-        while(x2 > x1) {
-            OneVU4(p, fout, x1, y, pin, stride, cp->mFp, cp->mIradius);
+        while(vx2 > vx1) {
+            OneVU4(p, fout, vx1, y, pin, stride, cp->mFp, cp->mIradius);
             fout++;
-            x1++;
+            vx1++;
         }
     }
 
     x1 = xstart;
-    while ((x1 < (uint32_t)cp->mIradius) && (x1 < x2)) {
-        OneHU4(p, out, x1, buf, cp->mFp, cp->mIradius);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, cp->mIradius, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneHU4(p, out, x1, buf, cp->mFp, cp->mIradius, true);
         out++;
         x1++;
     }
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
     if (gArchUseSIMD) {
-        if ((x1 + cp->mIradius) < x2) {
+        if (x1 < ix2) {
             rsdIntrinsicBlurHFU4_K(out, buf - cp->mIradius, cp->mFp,
-                                   cp->mIradius * 2 + 1, x1, x2 - cp->mIradius);
-            out += (x2 - cp->mIradius) - x1;
-            x1 = x2 - cp->mIradius;
+                                   cp->mIradius * 2 + 1, x1, ix2);
+            out += ix2 - x1;
+            x1 = ix2;
         }
     }
 #endif
+    while (x1 < ix2) {
+        OneHU4(p, out, x1, buf, cp->mFp, cp->mIradius, false);
+        out++;
+        x1++;
+    }
     while(x2 > x1) {
-        OneHU4(p, out, x1, buf, cp->mFp, cp->mIradius);
+        OneHU4(p, out, x1, buf, cp->mFp, cp->mIradius, true);
         out++;
         x1++;
     }
@@ -343,37 +532,50 @@ void RsdCpuScriptIntrinsicBlur::kernelU1(const RsForEachStubParamStruct *p,
         ALOGE("Blur executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uchar *out = (uchar *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
 
-    float *fout = (float *)buf;
+    // See kernelU4: the vertical pass covers the horizontal window around
+    // [xstart, xend) at absolute x positions in buf.
+    uint32_t vx1 = rsMax((int32_t)x1 - cp->mIradius, 0);
+    uint32_t vx2 = rsMin(x2 + cp->mIradius, p->dimX);
+    float *fout = buf + vx1;
     int y = p->y;
+    if (p->prefetchRows) {
+        prefetchInputRow(p, pin, stride, y + cp->mIradius + p->prefetchRows, vx1, vx2);
+    }
     if ((y > cp->mIradius) && (y < ((int)p->dimY - cp->mIradius -1))) {
-        const uchar *pi = pin + (y - cp->mIradius) * stride;
-        OneVFU1(fout, pi, stride, cp->mFp, cp->mIradius * 2 + 1, x1, x2);
+        const uchar *pi = pin + (y - cp->mIradius) * stride + vx1;
+        OneVFU1(fout, pi, stride, cp->mFp, cp->mIradius * 2 + 1, vx1, vx2);
     } else {
-        while(x2 > x1) {
-            OneVU1(p, fout, x1, y, pin, stride, cp->mFp, cp->mIradius);
+        while(vx2 > vx1) {
+            OneVU1(p, fout, vx1, y, pin, stride, cp->mFp, cp->mIradius);
             fout++;
-            x1++;
+            vx1++;
         }
     }
 
     x1 = xstart;
-    while ((x1 < x2) &&
-           ((x1 < (uint32_t)cp->mIradius) || (((uintptr_t)out) & 0x3))) {
-        OneHU1(p, out, x1, buf, cp->mFp, cp->mIradius);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, cp->mIradius, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneHU1(p, out, x1, buf, cp->mFp, cp->mIradius, true);
+        out++;
+        x1++;
+    }
+    while ((x1 < ix2) && (((uintptr_t)out) & 0x3)) {
+        OneHU1(p, out, x1, buf, cp->mFp, cp->mIradius, false);
         out++;
         x1++;
     }
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
     if (gArchUseSIMD) {
-        if ((x1 + cp->mIradius) < x2) {
-            uint32_t len = x2 - (x1 + cp->mIradius);
+        if (x1 < ix2) {
+            uint32_t len = ix2 - x1;
             len &= ~3;
             if (len > 0) {
                 rsdIntrinsicBlurHFU1_K(out, ((float *)buf) - cp->mIradius, cp->mFp,
@@ -384,19 +586,257 @@ void RsdCpuScriptIntrinsicBlur::kernelU1(const RsForEachStubParamStruct *p,
         }
     }
 #endif
+    while (x1 < ix2) {
+        OneHU1(p, out, x1, buf, cp->mFp, cp->mIradius, false);
+        out++;
+        x1++;
+    }
     while(x2 > x1) {
-        OneHU1(p, out, x1, buf, cp->mFp, cp->mIradius);
+        OneHU1(p, out, x1, buf, cp->mFp, cp->mIradius, true);
         out++;
         x1++;
     }
 }
 
+// Half elements are converted to floats one row at a time.  The vertical
+// pass accumulates into a row padded by the radius on either side, with
+// the edge pixels repeated, so the horizontal pass needs no clamping.
+void RsdCpuScriptIntrinsicBlur::kernelH(const RsForEachStubParamStruct *p,
+                                        uint32_t xstart, uint32_t xend,
+                                        uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBlur *cp = (RsdCpuScriptIntrinsicBlur *)p->usr;
+    if (!cp->mAlloc.get()) {
+        ALOGE("Blur executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
+    const int ch = cp->mVectorSize;
+    const int r = cp->mIradius;
+    const int ct = r * 2 + 1;
+
+    int32_t vx1 = rsMax((int32_t)xstart - r, 0);
+    int32_t vx2 = rsMin((int32_t)(xend + r), (int32_t)p->dimX);
+    const uint32_t cols = (xend - xstart) * ch;
+    const uint32_t padCols = cols + r * 2 * ch;
+    const uint32_t vcols = (vx2 - vx1) * ch;
+    size_t padBytes = (padCols * sizeof(float) + 15) & ~15;
+    uchar *scratch = (uchar *)cp->mScratch.get(p->lid, padBytes * 2 + cols * sizeof(float));
+    if (!scratch) {
+        ALOGE("Blur out of memory for its rows, skipping a row");
+        return;
+    }
+    float *rowf = (float *)scratch;
+    float *vacc = (float *)(scratch + padBytes);
+    float *hacc = (float *)(scratch + padBytes * 2);
+
+    float *vout = vacc + ((int32_t)vx1 - ((int32_t)xstart - r)) * ch;
+    memset(vout, 0, vcols * sizeof(float));
+    for (int i = 0; i < ct; i++) {
+        int y = rsMin(rsMax((int)p->y + i - r, 0), (int)p->dimY - 1);
+        const ushort *row = (const ushort *)(pin + stride * y);
+        rsHalfToFloatRow(rowf, row + vx1 * ch, vcols);
+        const float w = cp->mFp[i];
+        for (uint32_t j = 0; j < vcols; j++) {
+            vout[j] += w * rowf[j];
+        }
+    }
+    for (float *d = vacc; d < vout; d += ch) {
+        memcpy(d, vout, ch * sizeof(float));
+    }
+    for (float *d = vout + vcols; d < vacc + padCols; d += ch) {
+        memcpy(d, vout + vcols - ch, ch * sizeof(float));
+    }
+
+    for (uint32_t j = 0; j < cols; j++) {
+        float sum = 0.f;
+        for (int i = 0; i < ct; i++) {
+            sum += cp->mFp[i] * vacc[j + i * ch];
+        }
+        hacc[j] = sum;
+    }
+    rsFloatToHalfRow((ushort *)p->out, hacc, cols);
+}
+
+// The box cascade is run as a recurrence.  Three boxes of width w have the
+// transfer function ((1 - z^-w) / (1 - z^-1))^3, so the causal sum
+//   Y[m] = 3 * (Y[m-1] - Y[m-2]) + Y[m-3] + x[m] - 3 * x[m-w] + 3 * x[m-2w] - x[m-3w]
+// gives the blurred value centred on m - 3h.  The sums are at most
+// 255 * w^3 and every step is exact in 32 bit unsigned arithmetic, so the
+// recurrence never drifts however long the row or column is.
+
+extern "C" void rsdIntrinsicBlurBoxV_K(uchar *dst, uint32_t *oldest, const uint32_t *newest,
+                                       const uint32_t *second, const uchar * const *rows,
+                                       const float *scale, uint32_t count8);
+extern "C" void rsdIntrinsicBlurBoxHU4_K(void *dst, const uchar *src, uint32_t *state,
+                                         uint32_t count, uint32_t wBytes, const float *scale);
+
+// Starts the vertical sums of every column for the row whose newest input
+// row is m.  rows[2] receives Y[m-1], rows[1] Y[m-2] and rows[0] Y[m-3].
+static void OneBoxInitV(uint32_t **rows, const uchar *pin, size_t stride, int dimY,
+                        int m, const uint32_t *kernel, int taps, uint32_t cols) {
+    for (int j = 0; j < 3; j++) {
+        memset(rows[j], 0, cols * sizeof(uint32_t));
+    }
+    for (int t = m - 2 - taps; t < m; t++) {
+        const uchar *pi = pin + clampIndex(t, dimY) * stride;
+        for (int j = 1; j <= 3; j++) {
+            int k = m - j - t;
+            if ((k < 0) || (k >= taps)) {
+                continue;
+            }
+            const uint32_t wt = kernel[k];
+            uint32_t *acc = rows[3 - j];
+            for (uint32_t i = 0; i < cols; i++) {
+                acc[i] += wt * pi[i];
+            }
+        }
+    }
+}
+
+// Advances every column by one row.  The new sums replace the oldest ones
+// and their normalised value is written to out.
+static void OneBoxV(uchar *out, uint32_t *oldest, const uint32_t *newest,
+                    const uint32_t *second, const uchar * const *rows,
+                    float scale, uint32_t cols) {
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS)
+    if (gArchUseSIMD && (cols >= 8)) {
+        rsdIntrinsicBlurBoxV_K(out, oldest, newest, second, rows, &scale, cols >> 3);
+        i = cols & ~7;
+    }
+#endif
+    for (; i < cols; i++) {
+        uint32_t v = 3 * (newest[i] - second[i]) + oldest[i] +
+                     rows[0][i] - 3 * rows[1][i] + 3 * rows[2][i] - rows[3][i];
+        oldest[i] = v;
+        out[i] = (uchar)(v * scale + 0.5f);
+    }
+}
+
+// Blurs [x1, x2) of one row of vertical results.  in is indexed by
+// absolute x and holds vs channels per pixel.
+static void OneBoxH(uchar *out, const uchar *in, uint32_t x1, uint32_t x2, int vs,
+                    int dimX, int h, const uint32_t *kernel, float scale) {
+    const int w = h * 2 + 1;
+    const int taps = w * 3 - 2;
+
+    // state[0] holds Y[m-1], state[1] Y[m-2] and state[2] Y[m-3] for each
+    // channel, which is also the layout the NEON kernel works on.
+    uint32_t state[3][4];
+    memset(state, 0, sizeof(state));
+    int m = x1 + h * 3;
+    for (int t = m - 2 - taps; t < m; t++) {
+        const uchar *pi = in + clampIndex(t, dimX) * vs;
+        for (int j = 1; j <= 3; j++) {
+            int k = m - j - t;
+            if ((k >= 0) && (k < taps)) {
+                for (int c = 0; c < vs; c++) {
+                    state[j - 1][c] += kernel[k] * pi[c];
+                }
+            }
+        }
+    }
+
+    uint32_t x = x1;
+    while (x < x2) {
+#if defined(ARCH_ARM_USE_INTRINSICS)
+        // Away from the edges no index needs clamping.
+        if (gArchUseSIMD && (vs == 4) && (m >= w * 3) && (m < dimX)) {
+            uint32_t count = rsMin(x2, (uint32_t)(dimX - h * 3)) - x;
+            rsdIntrinsicBlurBoxHU4_K(out, in + m * 4, &state[0][0], count, w * 4, &scale);
+            out += count * 4;
+            x += count;
+            m += count;
+            continue;
+        }
+#endif
+        const uchar *pa = in + clampIndex(m, dimX) * vs;
+        const uchar *pb = in + clampIndex(m - w, dimX) * vs;
+        const uchar *pc = in + clampIndex(m - w * 2, dimX) * vs;
+        const uchar *pd = in + clampIndex(m - w * 3, dimX) * vs;
+        for (int c = 0; c < vs; c++) {
+            uint32_t v = 3 * (state[0][c] - state[1][c]) + state[2][c] +
+                         pa[c] - 3 * pb[c] + 3 * pc[c] - pd[c];
+            state[2][c] = state[1][c];
+            state[1][c] = state[0][c];
+            state[0][c] = v;
+            out[c] = (uchar)(v * scale + 0.5f);
+        }
+        out += vs;
+        x++;
+        m++;
+    }
+}
+
+void RsdCpuScriptIntrinsicBlur::kernelBox(const RsForEachStubParamStruct *p,
+                                          uint32_t xstart, uint32_t xend,
+                                          uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBlur *cp = (RsdCpuScriptIntrinsicBlur *)p->usr;
+    if (!cp->mAlloc.get()) {
+        ALOGE("Blur executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
+    const int vs = cp->mVectorSize;
+    const int h = cp->mBoxRadius;
+    const int w = h * 2 + 1;
+
+    // The horizontal pass reads up to 3h + 3 pixels to the left of the
+    // first output and 3h - 1 to the right of the last one.
+    uint32_t vx1 = rsMax((int32_t)xstart - h * 3 - 3, 0);
+    uint32_t vx2 = rsMin(xend + h * 3, p->dimX);
+    uint32_t cols = (vx2 - vx1) * vs;
+    size_t rowBytes = (cols * sizeof(uint32_t) + 15) & ~15;
+
+    uchar *scratch = (uchar *)cp->mScratch.get(p->lid, rowBytes * 3 + cols);
+    if (!scratch) {
+        ALOGE("Blur out of memory for its rows, skipping a row");
+        return;
+    }
+    uint32_t *rows[3];
+    for (int j = 0; j < 3; j++) {
+        rows[j] = (uint32_t *)(scratch + rowBytes * j);
+    }
+    uchar *vout = scratch + rowBytes * 3;
+
+    const uchar *pcol = pin + vx1 * vs;
+    RowState *bs = &cp->mRowState[p->lid];
+    int y = p->y;
+    int m = y + h * 3;
+    if ((bs->mNextY != y) || (bs->mX1 != vx1) || (bs->mX2 != vx2)) {
+        OneBoxInitV(rows, pcol, stride, p->dimY, m, cp->mBoxKernel, w * 3 - 2, cols);
+        bs->mPhase = 2;
+        bs->mX1 = vx1;
+        bs->mX2 = vx2;
+    }
+
+    const uchar *in[4];
+    for (int j = 0; j < 4; j++) {
+        in[j] = pcol + clampIndex(m - w * j, p->dimY) * stride;
+    }
+    OneBoxV(vout, rows[(bs->mPhase + 1) % 3], rows[bs->mPhase], rows[(bs->mPhase + 2) % 3],
+            in, cp->mBoxScale, cols);
+    bs->mPhase = (bs->mPhase + 1) % 3;
+    bs->mNextY = y + 1;
+
+    OneBoxH((uchar *)p->out, vout - vx1 * vs, xstart, xend, vs, p->dimX, h,
+            cp->mBoxKernel, cp->mBoxScale);
+}
+
 RsdCpuScriptIntrinsicBlur::RsdCpuScriptIntrinsicBlur(RsdCpuReferenceImpl *ctx,
                                                      const Script *s, const Element *e)
-            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_BLUR) {
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_BLUR),
+              mScratch(ctx->getThreadCount()) {
 
     mRootPtr = NULL;
-    if (e->getType() == RS_TYPE_UNSIGNED_8) {
+    mHalf = (e->getType() == RS_TYPE_FLOAT_16);
+    if (mHalf) {
+        if ((e->getVectorSize() == 1) || (e->getVectorSize() == 4)) {
+            mRootPtr = &kernelH;
+        }
+    } else if (e->getType() == RS_TYPE_UNSIGNED_8) {
         switch (e->getVectorSize()) {
         case 1:
             mRootPtr = &kernelU1;
@@ -408,28 +848,17 @@ RsdCpuScriptIntrinsicBlur::RsdCpuScriptIntrinsicBlur(RsdCpuReferenceImpl *ctx,
     }
     rsAssert(mRootPtr);
     mRadius = 5;
+    mVectorSize = e->getVectorSize();
+    mBoxRadius = 1;
 
-    mScratch = new void *[mCtx->getThreadCount()];
-    mScratchSize = new size_t[mCtx->getThreadCount()];
-    memset(mScratch, 0, sizeof(void *) * mCtx->getThreadCount());
-    memset(mScratchSize, 0, sizeof(size_t) * mCtx->getThreadCount());
+    mRowState = new RowState[mCtx->getThreadCount()];
+    memset(mRowState, 0, sizeof(RowState) * mCtx->getThreadCount());
 
     ComputeGaussianWeights();
 }
 
 RsdCpuScriptIntrinsicBlur::~RsdCpuScriptIntrinsicBlur() {
-    uint32_t threads = mCtx->getThreadCount();
-    if (mScratch) {
-        for (size_t i = 0; i < threads; i++) {
-            if (mScratch[i]) {
-                free(mScratch[i]);
-            }
-        }
-        delete []mScratch;
-    }
-    if (mScratchSize) {
-        delete []mScratchSize;
-    }
+    delete []mRowState;
 }
 
 void RsdCpuScriptIntrinsicBlur::populateScript(Script *s) {
@@ -15,6 +15,7 @@
  */
 
 #include <sys/mman.h>
+#include <errno.h>
 #include <unistd.h>
 
 #include "rsCpuIntrinsic.h"
@@ -129,6 +130,8 @@ public:
     virtual void populateScript(Script *);
 
     virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual void invokeFreeChildren();
 
     virtual ~RsdCpuScriptIntrinsicColorMatrix();
     RsdCpuScriptIntrinsicColorMatrix(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
@@ -155,15 +158,26 @@ protected:
     void updateCoeffCache(float fpMul, float addMul);
 
     Key_t mLastKey;
-    unsigned char *mBuf;
-    size_t mBufSize;
+    // Set once mOptKernel has been looked up for mLastKey.  Keys without
+    // generated code then keep to the C path rather than retrying the code
+    // cache every launch.
+    bool mHaveKey;
 
     Key_t computeKey(const Element *ein, const Element *eout);
 
-    bool build(Key_t key);
+    static bool build(Key_t key, uint8_t *buf);
+    static uint8_t * acquireCode(Key_t key);
+    static void releaseCode(uint8_t *code);
 
     void (*mOptKernel)(void *dst, const void *src, const short *coef, uint32_t count);
 
+    // The four 256 entry tables of a LUT intrinsic, looked up after the
+    // matrix for uchar outputs when set.  Chunks of the output go through
+    // the tables while still in cache, so the pair touches the image once.
+    ObjectBaseRef<Allocation> mLut;
+    static void applyLut(uchar *out, const uchar *tables, uint32_t count,
+                         uint32_t outstep, uint32_t channels);
+
 };
 
 }
@@ -180,15 +194,15 @@ Key_t RsdCpuScriptIntrinsicColorMatrix::computeKey(
 
     // Add to the key the input and output types
     bool hasFloat = false;
-    if (ein->getType() == RS_TYPE_FLOAT_32) {
+    if ((ein->getType() == RS_TYPE_FLOAT_32) || (ein->getType() == RS_TYPE_FLOAT_16)) {
         hasFloat = true;
-        key.u.inType = RS_TYPE_FLOAT_32;
-        rsAssert(key.u.inType == RS_TYPE_FLOAT_32);
+        key.u.inType = ein->getType();
+        rsAssert(key.u.inType == ein->getType());
     }
-    if (eout->getType() == RS_TYPE_FLOAT_32) {
+    if ((eout->getType() == RS_TYPE_FLOAT_32) || (eout->getType() == RS_TYPE_FLOAT_16)) {
         hasFloat = true;
-        key.u.outType = RS_TYPE_FLOAT_32;
-        rsAssert(key.u.outType == RS_TYPE_FLOAT_32);
+        key.u.outType = eout->getType();
+        rsAssert(key.u.outType == eout->getType());
     }
 
     // Mask in the bits indicating which coefficients in the
@@ -277,7 +291,7 @@ Key_t RsdCpuScriptIntrinsicColorMatrix::computeKey(
     return key;
 }
 
-#if defined(ARCH_ARM_HAVE_NEON)
+#if defined(ARCH_ARM_HAVE_NEON) || defined(ARCH_ARM64_HAVE_NEON)
 
 #define DEF_SYM(x)                                  \
     extern "C" uint32_t _N_ColorMatrix_##x;      \
@@ -331,6 +345,9 @@ DEF_SYM(add_3_u8)
     memcpy(buf, &_N_ColorMatrix_##x, _N_ColorMatrix_##x##_len); \
     buf += _N_ColorMatrix_##x##_len
 
+#endif
+
+#if defined(ARCH_ARM_HAVE_NEON)
 
 static uint8_t * addBranch(uint8_t *buf, const uint8_t *target, uint32_t condition) {
     size_t off = (target - buf - 8) >> 2;
@@ -403,20 +420,108 @@ static uint8_t * addVADD_F32(uint8_t *buf, uint32_t dest_q, uint32_t src_q1, uin
     ((uint32_t *)buf)[0] = op;
     return buf + 4;
 }
+#elif defined(ARCH_ARM64_HAVE_NEON)
+
+// The emitters below take the ARMv7 register numbers used by build() and
+// place them where the A64 snippets keep them: q0-q3 stay in v0-v3, q4-q15
+// move to v16-v27, and the integer multipliers d4-d7 pack into v4 and v5.
+static uint32_t a64Reg(uint32_t q) {
+    rsAssert(q < 16);
+    return (q < 4) ? q : q + 12;
+}
+
+static uint8_t * addBranch(uint8_t *buf, const uint8_t *target, uint32_t condition) {
+    ptrdiff_t off = (target - buf) >> 2;
+    rsAssert((off >= -(1 << 18)) && (off < (1 << 18)));
+
+    //b.cond
+    uint32_t op = 0x54000000 | ((off & 0x7ffff) << 5) | condition;
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
+
+// By element forms of smull and smlal, D#2[#] of the ARMv7 encoding being
+// lane #2 * 4 + # of the halfword pairs in v4 and v5.
+static uint32_t encodeS16Element(uint32_t dest_q, uint32_t src_d1, uint32_t src_d2,
+                                 uint32_t src_d2_s) {
+    rsAssert((src_d2 >= 4) && (src_d2 < 8));
+    uint32_t vm = 4 + ((src_d2 - 4) >> 1);
+    uint32_t index = ((src_d2 & 1) << 2) | src_d2_s;
+
+    uint32_t op = a64Reg(dest_q) | (a64Reg(src_d1 >> 1) << 5) | (vm << 16);
+    op |= ((index >> 2) << 11) | (((index >> 1) & 1) << 21) | ((index & 1) << 20);
+    return op;
+}
+
+static uint32_t encodeF32Element(uint32_t dest_q, uint32_t src_d1, uint32_t src_d2,
+                                 uint32_t src_d2_s) {
+    uint32_t index = ((src_d2 & 1) << 1) | src_d2_s;
+
+    uint32_t op = a64Reg(dest_q) | (a64Reg(src_d1 >> 1) << 5) | (a64Reg(src_d2 >> 1) << 16);
+    op |= ((index >> 1) << 11) | ((index & 1) << 21);
+    return op;
+}
+
+static uint32_t encodeSIMDRegs(uint32_t dest_q, uint32_t src_q1, uint32_t src_q2) {
+    return a64Reg(dest_q) | (a64Reg(src_q1) << 5) | (a64Reg(src_q2) << 16);
+}
+
+static uint8_t * addVMLAL_S16(uint8_t *buf, uint32_t dest_q, uint32_t src_d1, uint32_t src_d2, uint32_t src_d2_s) {
+    //smlal Vd.4s, Vn.4h, Vm.h[#]
+    uint32_t op = 0x0f402000 | encodeS16Element(dest_q, src_d1, src_d2, src_d2_s);
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
+
+static uint8_t * addVMULL_S16(uint8_t *buf, uint32_t dest_q, uint32_t src_d1, uint32_t src_d2, uint32_t src_d2_s) {
+    //smull Vd.4s, Vn.4h, Vm.h[#]
+    uint32_t op = 0x0f40a000 | encodeS16Element(dest_q, src_d1, src_d2, src_d2_s);
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
+
+static uint8_t * addVQADD_S32(uint8_t *buf, uint32_t dest_q, uint32_t src_q1, uint32_t src_q2) {
+    //sqadd Vd.4s, Vn.4s, Vm.4s
+    uint32_t op = 0x4ea00c00 | encodeSIMDRegs(dest_q, src_q1, src_q2);
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
+
+static uint8_t * addVMLAL_F32(uint8_t *buf, uint32_t dest_q, uint32_t src_d1, uint32_t src_d2, uint32_t src_d2_s) {
+    //fmla Vd.4s, Vn.4s, Vm.s[#]
+    uint32_t op = 0x4f801000 | encodeF32Element(dest_q, src_d1, src_d2, src_d2_s);
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
+
+static uint8_t * addVMULL_F32(uint8_t *buf, uint32_t dest_q, uint32_t src_d1, uint32_t src_d2, uint32_t src_d2_s) {
+    //fmul Vd.4s, Vn.4s, Vm.s[#]
+    uint32_t op = 0x4f809000 | encodeF32Element(dest_q, src_d1, src_d2, src_d2_s);
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
+
+static uint8_t * addVORR_32(uint8_t *buf, uint32_t dest_q, uint32_t src_q1, uint32_t src_q2) {
+    //orr Vd.16b, Vn.16b, Vm.16b
+    uint32_t op = 0x4ea01c00 | encodeSIMDRegs(dest_q, src_q1, src_q2);
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
+
+static uint8_t * addVADD_F32(uint8_t *buf, uint32_t dest_q, uint32_t src_q1, uint32_t src_q2) {
+    //fadd Vd.4s, Vn.4s, Vm.4s
+    uint32_t op = 0x4e20d400 | encodeSIMDRegs(dest_q, src_q1, src_q2);
+    ((uint32_t *)buf)[0] = op;
+    return buf + 4;
+}
 #endif
 
 
-bool RsdCpuScriptIntrinsicColorMatrix::build(Key_t key) {
-#if defined(ARCH_ARM_HAVE_NEON)
-    mBufSize = 4096;
+// Writes the kernel for key into buf, which must be writable and
+// kCodeBufSize bytes long.
+bool RsdCpuScriptIntrinsicColorMatrix::build(Key_t key, uint8_t *buf) {
+#if defined(ARCH_ARM_HAVE_NEON) || defined(ARCH_ARM64_HAVE_NEON)
     //StopWatch build_time("rs cm: build time");
-    mBuf = (uint8_t *)mmap(0, mBufSize, PROT_READ | PROT_WRITE,
-                                  MAP_PRIVATE | MAP_ANON, -1, 0);
-    if (!mBuf) {
-        return false;
-    }
-
-    uint8_t *buf = mBuf;
     uint8_t *buf2 = NULL;
 
     int ops[5][4];  // 0=unused, 1 = set, 2 = accumulate, 3 = final
@@ -651,18 +756,130 @@ bool RsdCpuScriptIntrinsicColorMatrix::build(Key_t key) {
     ADD_CHUNK(postfix1);
     buf = addBranch(buf, buf2, 0x01);
     ADD_CHUNK(postfix2);
+    return true;
+#else
+    return false;
+#endif
+}
 
-    int ret = mprotect(mBuf, mBufSize, PROT_READ | PROT_EXEC);
-    if (ret == -1) {
-        ALOGE("mprotect error %i", ret);
-        return false;
+// The generated code depends only on the key, so kernels are shared by
+// every ColorMatrix script in the process.  Entries stay cached after
+// their last user goes away, and the page of the least recently used idle
+// entry is rewritten when a new key needs a slot.
+static const uint32_t kCodeCacheSize = 16;
+static const size_t kCodeBufSize = 4096;
+
+typedef struct {
+    uint64_t mKey;
+    uint8_t *mBuf;
+    int32_t mRefs;
+    uint32_t mLastUse;
+    bool mValid;
+} CodeCacheEntry;
+
+static CodeCacheEntry gCodeCache[kCodeCacheSize];
+static uint32_t gCodeCacheClock = 0;
+static pthread_mutex_t gCodeCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Returns executable code for key with a reference held, or NULL when no
+// kernel can be built.  Release it with releaseCode.
+uint8_t * RsdCpuScriptIntrinsicColorMatrix::acquireCode(Key_t key) {
+#if defined(ARCH_ARM_HAVE_NEON) || defined(ARCH_ARM64_HAVE_NEON)
+    pthread_mutex_lock(&gCodeCacheMutex);
+    CodeCacheEntry *victim = NULL;
+    for (uint32_t ct = 0; ct < kCodeCacheSize; ct++) {
+        CodeCacheEntry *e = &gCodeCache[ct];
+        if (e->mValid && (e->mKey == key.key)) {
+            e->mRefs++;
+            e->mLastUse = ++gCodeCacheClock;
+            pthread_mutex_unlock(&gCodeCacheMutex);
+            return e->mBuf;
+        }
+        if (e->mRefs == 0) {
+            if (!victim || !e->mValid ||
+                (victim->mValid && (e->mLastUse < victim->mLastUse))) {
+                victim = e;
+            }
+        }
     }
 
-    cacheflush((long)mBuf, (long)mBuf + mBufSize, 0);
-    return true;
+    if (!victim) {
+        pthread_mutex_unlock(&gCodeCacheMutex);
+        ALOGV("ColorMatrix code cache full, using the C path");
+        return NULL;
+    }
+
+    victim->mValid = false;
+    if (victim->mBuf) {
+        if (mprotect(victim->mBuf, kCodeBufSize, PROT_READ | PROT_WRITE) == -1) {
+            ALOGE("mprotect error %i", errno);
+            pthread_mutex_unlock(&gCodeCacheMutex);
+            return NULL;
+        }
+    } else {
+        void *buf = mmap(0, kCodeBufSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (buf == MAP_FAILED) {
+            pthread_mutex_unlock(&gCodeCacheMutex);
+            return NULL;
+        }
+        victim->mBuf = (uint8_t *)buf;
+    }
+
+    if (!build(key, victim->mBuf)) {
+        pthread_mutex_unlock(&gCodeCacheMutex);
+        return NULL;
+    }
+    if (mprotect(victim->mBuf, kCodeBufSize, PROT_READ | PROT_EXEC) == -1) {
+        ALOGE("mprotect error %i", errno);
+        pthread_mutex_unlock(&gCodeCacheMutex);
+        return NULL;
+    }
+#if defined(ARCH_ARM64_HAVE_NEON)
+    __builtin___clear_cache((char *)victim->mBuf, (char *)victim->mBuf + kCodeBufSize);
 #else
-    return false;
+    cacheflush((long)victim->mBuf, (long)victim->mBuf + kCodeBufSize, 0);
 #endif
+
+    victim->mKey = key.key;
+    victim->mValid = true;
+    victim->mRefs = 1;
+    victim->mLastUse = ++gCodeCacheClock;
+    pthread_mutex_unlock(&gCodeCacheMutex);
+    return victim->mBuf;
+#else
+    return NULL;
+#endif
+}
+
+void RsdCpuScriptIntrinsicColorMatrix::releaseCode(uint8_t *code) {
+    pthread_mutex_lock(&gCodeCacheMutex);
+    for (uint32_t ct = 0; ct < kCodeCacheSize; ct++) {
+        if (gCodeCache[ct].mBuf == code) {
+            rsAssert(gCodeCache[ct].mRefs > 0);
+            gCodeCache[ct].mRefs--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gCodeCacheMutex);
+}
+
+// Unmaps the pages of kernels no script is using.  The cache is shared by
+// the process, so this also trims for the other contexts.
+size_t rsdIntrinsicColorMatrixTrimCode() {
+    size_t freed = 0;
+    pthread_mutex_lock(&gCodeCacheMutex);
+    for (uint32_t ct = 0; ct < kCodeCacheSize; ct++) {
+        CodeCacheEntry *e = &gCodeCache[ct];
+        if (e->mBuf && (e->mRefs == 0)) {
+            munmap(e->mBuf, kCodeBufSize);
+            e->mBuf = NULL;
+            e->mValid = false;
+            freed += kCodeBufSize;
+        }
+    }
+    pthread_mutex_unlock(&gCodeCacheMutex);
+    return freed;
 }
 
 void RsdCpuScriptIntrinsicColorMatrix::updateCoeffCache(float fpMul, float addMul) {
@@ -707,6 +924,20 @@ void RsdCpuScriptIntrinsicColorMatrix::setGlobalVar(uint32_t slot, const void *d
 }
 
 
+void RsdCpuScriptIntrinsicColorMatrix::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 2);
+    mLut.set(static_cast<Allocation *>(data));
+}
+
+#if defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicColorMatrix4x4_K(void *dst, const void *src,
+                                             const short *coef, uint32_t count);
+#endif
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicLUT_K(void *dst, const void *src, uint32_t count4,
+                                  const uchar *tables);
+#endif
+
 static void One(const RsForEachStubParamStruct *p, void *out,
                 const void *py, const float* coeff, const float *add,
                 uint32_t vsin, uint32_t vsout, bool fin, bool fout) {
@@ -808,6 +1039,29 @@ static void One(const RsForEachStubParamStruct *p, void *out,
     //ALOGE("out %p %f %f %f %f", out, ((float *)out)[0], ((float *)out)[1], ((float *)out)[2], ((float *)out)[3]);
 }
 
+static const uint32_t kHalfChunk = 64;
+// Pixels the matrix writes before the LUT goes over them.
+static const uint32_t kLutChunk = 256;
+
+void RsdCpuScriptIntrinsicColorMatrix::applyLut(uchar *out, const uchar *tables,
+                                                uint32_t count, uint32_t outstep,
+                                                uint32_t channels) {
+    uint32_t x = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (outstep == 4) && (channels == 4) && (count >= 4)) {
+        rsdIntrinsicLUT_K(out, out, count >> 2, tables);
+        x = count & ~3;
+        out += x * 4;
+    }
+#endif
+    for (; x < count; x++) {
+        for (uint32_t c = 0; c < channels; c++) {
+            out[c] = tables[c * 256 + out[c]];
+        }
+        out += outstep;
+    }
+}
+
 void RsdCpuScriptIntrinsicColorMatrix::kernel(const RsForEachStubParamStruct *p,
                                               uint32_t xstart, uint32_t xend,
                                               uint32_t instep, uint32_t outstep) {
@@ -821,9 +1075,70 @@ void RsdCpuScriptIntrinsicColorMatrix::kernel(const RsForEachStubParamStruct *p,
     uint32_t vsout = cp->mLastKey.u.outVecSize;
     bool floatIn = !!cp->mLastKey.u.inType;
     bool floatOut = !!cp->mLastKey.u.outType;
+    bool halfIn = cp->mLastKey.u.inType == RS_TYPE_FLOAT_16;
+    bool halfOut = cp->mLastKey.u.outType == RS_TYPE_FLOAT_16;
 
     //if (!p->y) ALOGE("steps %i %i   %i %i", instep, outstep, vsin, vsout);
 
+    if (halfIn || halfOut) {
+        // Half pixels are converted to and from floats a chunk at a time
+        // and run through the float path.  There is no code generated
+        // kernel for them.
+        float fin[kHalfChunk * 4];
+        float fout[kHalfChunk * 4];
+        const uint32_t finStep = halfIn ? instep * 2 : instep;
+        const uint32_t foutStep = halfOut ? outstep * 2 : outstep;
+        while (x1 < x2) {
+            uint32_t n = rsMin(x2 - x1, (uint32_t)kHalfChunk);
+            const uchar *src = in;
+            uchar *dst = halfOut ? (uchar *)fout : out;
+            if (halfIn) {
+                rsHalfToFloatRow(fin, (const ushort *)in, n * instep / sizeof(ushort));
+                src = (const uchar *)fin;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                One(p, dst + i * foutStep, src + i * finStep, cp->tmpFp, cp->tmpFpa,
+                    vsin, vsout, floatIn, floatOut);
+            }
+            if (halfOut) {
+                rsFloatToHalfRow((ushort *)out, fout, n * outstep / sizeof(ushort));
+            } else if (cp->mLut.get() && !floatOut) {
+                applyLut(out, (const uchar *)cp->mLut->mHal.drvState.lod[0].mallocPtr, n,
+                         outstep, (vsout == 2) ? 3 : vsout + 1);
+            }
+            in += instep * n;
+            out += outstep * n;
+            x1 += n;
+        }
+        return;
+    }
+
+    if (cp->mLut.get() && !floatOut) {
+        const uchar *tables = (const uchar *)cp->mLut->mHal.drvState.lod[0].mallocPtr;
+        // uchar3 is padded to four bytes, the pad left alone.
+        const uint32_t channels = (vsout == 2) ? 3 : vsout + 1;
+        while (x1 < x2) {
+            uint32_t n = rsMin(x2 - x1, kLutChunk);
+            uchar *chunk = out;
+            uint32_t len = n >> 2;
+            if ((cp->mOptKernel != NULL) && (len > 0)) {
+                cp->mOptKernel(out, in, cp->ip, len);
+                out += outstep * (len << 2);
+                in += instep * (len << 2);
+            } else {
+                len = 0;
+            }
+            for (uint32_t i = len << 2; i < n; i++) {
+                One(p, out, in, cp->tmpFp, cp->tmpFpa, vsin, vsout, floatIn, floatOut);
+                out += outstep;
+                in += instep;
+            }
+            applyLut(chunk, tables, n, outstep, channels);
+            x1 += n;
+        }
+        return;
+    }
+
     if(x2 > x1) {
         int32_t len = (x2 - x1) >> 2;
         if((cp->mOptKernel != NULL) && (len > 0)) {
@@ -849,14 +1164,17 @@ void RsdCpuScriptIntrinsicColorMatrix::preLaunch(
     const Element *ein = ain->mHal.state.type->getElement();
     const Element *eout = aout->mHal.state.type->getElement();
 
-    if (ein->getType() == eout->getType()) {
-        if (eout->getType() == RS_TYPE_UNSIGNED_8) {
+    // Half and float elements share the [0, 1] range.
+    bool inU8 = ein->getType() == RS_TYPE_UNSIGNED_8;
+    bool outU8 = eout->getType() == RS_TYPE_UNSIGNED_8;
+    if (inU8 == outU8) {
+        if (outU8) {
             updateCoeffCache(1.f, 255.f);
         } else {
             updateCoeffCache(1.f, 1.f);
         }
     } else {
-        if (eout->getType() == RS_TYPE_UNSIGNED_8) {
+        if (outU8) {
             updateCoeffCache(255.f, 255.f);
         } else {
             updateCoeffCache(1.f / 255.f, 1.f);
@@ -865,14 +1183,26 @@ void RsdCpuScriptIntrinsicColorMatrix::preLaunch(
 
     Key_t key = computeKey(ain->mHal.state.type->getElement(),
                            aout->mHal.state.type->getElement());
-    if ((mOptKernel == NULL) || (mLastKey.key != key.key)) {
-        if (mBuf) munmap(mBuf, mBufSize);
-        mBuf = NULL;
+    if (!mHaveKey || (mLastKey.key != key.key)) {
+        if (mOptKernel) {
+            releaseCode((uint8_t *)mOptKernel);
+        }
         mOptKernel = NULL;
-        if (build(key)) {
-            mOptKernel = (void (*)(void *, const void *, const short *, uint32_t)) mBuf;
-            mLastKey = key;
+        if ((key.u.inType != RS_TYPE_FLOAT_16) && (key.u.outType != RS_TYPE_FLOAT_16)) {
+            mOptKernel = (void (*)(void *, const void *, const short *, uint32_t))
+                    acquireCode(key);
         }
+#if defined(ARCH_X86_HAVE_SSSE3)
+        // Without a code generator the common uchar4 to uchar4 case uses a
+        // fixed kernel.  The copyAlpha and dot keys are special cases of it.
+        if (!mOptKernel && gArchUseSIMD && !key.u.inType && !key.u.outType &&
+            (key.u.inVecSize == 3) && (key.u.outVecSize == 3)) {
+            mOptKernel = &rsdIntrinsicColorMatrix4x4_K;
+        }
+#endif
+        // The C path reads the vector sizes from the key as well.
+        mLastKey = key;
+        mHaveKey = true;
     }
 }
 
@@ -887,8 +1217,7 @@ RsdCpuScriptIntrinsicColorMatrix::RsdCpuScriptIntrinsicColorMatrix(
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_COLOR_MATRIX) {
 
     mLastKey.key = 0;
-    mBuf = NULL;
-    mBufSize = 0;
+    mHaveKey = false;
     mOptKernel = NULL;
     const static float defaultMatrix[] = {
         1.f, 0.f, 0.f, 0.f,
@@ -902,13 +1231,18 @@ RsdCpuScriptIntrinsicColorMatrix::RsdCpuScriptIntrinsicColorMatrix(
 }
 
 RsdCpuScriptIntrinsicColorMatrix::~RsdCpuScriptIntrinsicColorMatrix() {
-    if (mBuf) munmap(mBuf, mBufSize);
-    mBuf = NULL;
+    if (mOptKernel) {
+        releaseCode((uint8_t *)mOptKernel);
+    }
     mOptKernel = NULL;
 }
 
 void RsdCpuScriptIntrinsicColorMatrix::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 2;
+    s->mHal.info.exportedVariableCount = 3;
+}
+
+void RsdCpuScriptIntrinsicColorMatrix::invokeFreeChildren() {
+    mLut.clear();
 }
 
 RsdCpuScriptImpl * rsdIntrinsic_ColorMatrix(RsdCpuReferenceImpl *ctx,
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Converts each cell of the input to the data type and vector size of the
+// output.  Normalized conversions map the range of unsigned types to
+// [0, 1] and round and saturate on the way back; otherwise values are
+// kept and only saturated.  Channels the output lacks are dropped, missing
+// ones become 0 and a missing fourth channel is opaque.
+//
+// Conversions that keep the channels run over each row as a flat array of
+// values, with SIMD kernels between U8 and F32; the others go through a
+// float4 per cell.
+class RsdCpuScriptIntrinsicConvert : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+
+    virtual void preLaunch(uint32_t slot, const Allocation * ain,
+                           Allocation * aout, const void * usr,
+                           uint32_t usrLen, const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicConvert();
+    RsdCpuScriptIntrinsicConvert(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    enum {
+        kPathGeneric,
+        kPathCopy,
+        kPathU8ToF32,
+        kPathF32ToU8,
+        kPathHalfToF32,
+        kPathF32ToHalf,
+        // uchar3 to uchar4, both four bytes a cell.
+        kPathU8AddAlpha
+    };
+
+    struct Format {
+        RsDataType type;
+        uint32_t vecSize;
+        // Values a cell takes up; three component vectors are padded.
+        uint32_t slots;
+        // The float a value of 1 becomes, and the value 1.f becomes.
+        float toFloat;
+        float fromFloat;
+        // The largest value of unsigned types, 0 for floats.
+        float max;
+    };
+
+    bool mNormalized;
+    Format mIn;
+    Format mOut;
+    int mPath;
+
+    void setFormat(Format *f, const Element *e) const;
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicConvert::setGlobalVar(uint32_t slot, const void *data,
+                                                size_t dataLength) {
+    rsAssert(slot == 0);
+    rsAssert(dataLength == 4);
+    mNormalized = ((const int32_t *)data)[0] != 0;
+}
+
+void RsdCpuScriptIntrinsicConvert::setFormat(Format *f, const Element *e) const {
+    f->type = e->getType();
+    f->vecSize = e->getVectorSize();
+    f->slots = (f->vecSize == 3) ? 4 : f->vecSize;
+    switch (f->type) {
+    case RS_TYPE_UNSIGNED_8:
+        f->max = 255.f;
+        break;
+    case RS_TYPE_UNSIGNED_16:
+        f->max = 65535.f;
+        break;
+    default:
+        f->max = 0.f;
+        break;
+    }
+    f->toFloat = (mNormalized && f->max) ? (1.f / f->max) : 1.f;
+    f->fromFloat = (mNormalized && f->max) ? f->max : 1.f;
+}
+
+void RsdCpuScriptIntrinsicConvert::preLaunch(uint32_t slot, const Allocation * ain,
+                                             Allocation * aout, const void * usr,
+                                             uint32_t usrLen, const RsScriptCall *sc) {
+    if (!ain || !aout) {
+        return;
+    }
+    setFormat(&mIn, ain->mHal.state.type->getElement());
+    setFormat(&mOut, aout->mHal.state.type->getElement());
+
+    mPath = kPathGeneric;
+    if (mIn.slots == mOut.slots) {
+        const bool u8In = mIn.type == RS_TYPE_UNSIGNED_8;
+        const bool u8Out = mOut.type == RS_TYPE_UNSIGNED_8;
+        if ((mIn.type == mOut.type) && (mIn.vecSize == mOut.vecSize)) {
+            mPath = kPathCopy;
+        } else if (u8In && u8Out && (mIn.vecSize == 3)) {
+            mPath = kPathU8AddAlpha;
+        } else if (mIn.vecSize != mOut.vecSize) {
+            // uchar4 to uchar3 keeps its layout, other types do not.
+            mPath = (u8In && u8Out) ? kPathCopy : kPathGeneric;
+        } else if (u8In && (mOut.type == RS_TYPE_FLOAT_32)) {
+            mPath = kPathU8ToF32;
+        } else if ((mIn.type == RS_TYPE_FLOAT_32) && u8Out) {
+            mPath = kPathF32ToU8;
+        } else if ((mIn.type == RS_TYPE_FLOAT_16) && (mOut.type == RS_TYPE_FLOAT_32)) {
+            mPath = kPathHalfToF32;
+        } else if ((mIn.type == RS_TYPE_FLOAT_32) && (mOut.type == RS_TYPE_FLOAT_16)) {
+            mPath = kPathF32ToHalf;
+        }
+    }
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicConvertU8ToF32_K(float *dst, const uchar *src, const float *scale,
+                                             uint32_t count8);
+extern "C" void rsdIntrinsicConvertF32ToU8_K(uchar *dst, const float *src, const float *scale,
+                                             uint32_t count8);
+#endif
+
+// Rounds to nearest and saturates to [0, max], NaN becoming 0, as the
+// SIMD kernels do.
+static inline float saturate(float f, float max) {
+    f += 0.5f;
+    return (f >= max) ? max : ((f > 0.f) ? f : 0.f);
+}
+
+static void OneU8ToF32(float *dst, const uchar *src, float scale, uint32_t count) {
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >= 8)) {
+        rsdIntrinsicConvertU8ToF32_K(dst, src, &scale, count >> 3);
+        i = count & ~7;
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = (float)src[i] * scale;
+    }
+}
+
+static void OneF32ToU8(uchar *dst, const float *src, float scale, uint32_t count) {
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >= 8)) {
+        rsdIntrinsicConvertF32ToU8_K(dst, src, &scale, count >> 3);
+        i = count & ~7;
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = (uchar)saturate(src[i] * scale, 255.f);
+    }
+}
+
+static inline float loadValue(const uchar *src, RsDataType type, uint32_t i) {
+    switch (type) {
+    case RS_TYPE_UNSIGNED_8:
+        return (float)src[i];
+    case RS_TYPE_UNSIGNED_16:
+        return (float)((const ushort *)src)[i];
+    case RS_TYPE_FLOAT_16:
+        return rsHalfToFloat(((const ushort *)src)[i]);
+    default:
+        return ((const float *)src)[i];
+    }
+}
+
+static inline void storeValue(uchar *dst, RsDataType type, float max, uint32_t i, float f) {
+    switch (type) {
+    case RS_TYPE_UNSIGNED_8:
+        dst[i] = (uchar)saturate(f, max);
+        break;
+    case RS_TYPE_UNSIGNED_16:
+        ((ushort *)dst)[i] = (ushort)saturate(f, max);
+        break;
+    case RS_TYPE_FLOAT_16:
+        ((ushort *)dst)[i] = rsFloatToHalf(f);
+        break;
+    default:
+        ((float *)dst)[i] = f;
+        break;
+    }
+}
+
+void RsdCpuScriptIntrinsicConvert::kernel(const RsForEachStubParamStruct *p,
+                                          uint32_t xstart, uint32_t xend,
+                                          uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicConvert *cp = (RsdCpuScriptIntrinsicConvert *)p->usr;
+    const Format &fi = cp->mIn;
+    const Format &fo = cp->mOut;
+    const uchar *in = (const uchar *)p->in;
+    uchar *out = (uchar *)p->out;
+    const uint32_t cells = xend - xstart;
+    const uint32_t values = cells * fi.slots;
+
+    switch (cp->mPath) {
+    case kPathCopy:
+        memcpy(out, in, cells * instep);
+        return;
+    case kPathU8AddAlpha:
+        memcpy(out, in, cells * 4);
+        for (uint32_t x = 0; x < cells; x++) {
+            out[x * 4 + 3] = 255;
+        }
+        return;
+    case kPathU8ToF32:
+        OneU8ToF32((float *)out, in, fi.toFloat, values);
+        return;
+    case kPathF32ToU8:
+        OneF32ToU8(out, (const float *)in, fo.fromFloat, values);
+        return;
+    case kPathHalfToF32:
+        rsHalfToFloatRow((float *)out, (const ushort *)in, values);
+        return;
+    case kPathF32ToHalf:
+        rsFloatToHalfRow((ushort *)out, (const float *)in, values);
+        return;
+    default:
+        break;
+    }
+
+    // The fourth channel of inputs without one, in input units.
+    const float opaque = fi.max ? fi.max : 1.f;
+    const float scale = fi.toFloat * fo.fromFloat;
+    for (uint32_t x = 0; x < cells; x++) {
+        float f[4] = {0.f, 0.f, 0.f, opaque};
+        for (uint32_t c = 0; c < fi.vecSize; c++) {
+            f[c] = loadValue(in, fi.type, c);
+        }
+        for (uint32_t c = 0; c < fo.vecSize; c++) {
+            storeValue(out, fo.type, fo.max, c, f[c] * scale);
+        }
+        in += instep;
+        out += outstep;
+    }
+}
+
+RsdCpuScriptIntrinsicConvert::RsdCpuScriptIntrinsicConvert(RsdCpuReferenceImpl *ctx,
+                                                           const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_CONVERT) {
+
+    mRootPtr = &kernel;
+    mNormalized = true;
+    setFormat(&mIn, e);
+    setFormat(&mOut, e);
+    mPath = kPathCopy;
+}
+
+RsdCpuScriptIntrinsicConvert::~RsdCpuScriptIntrinsicConvert() {
+}
+
+void RsdCpuScriptIntrinsicConvert::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 1;
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Convert(RsdCpuReferenceImpl *ctx,
+                                        const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicConvert(ctx, s, e);
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Convolution with any odd square kernel up to kMaxSize wide.  Kernels
+// that are the outer product of a column and a row vector are detected
+// when the coefficients are set and run as a vertical and a horizontal
+// 1D pass, costing 2N instead of N^2 multiplies per channel.
+class RsdCpuScriptIntrinsicConvolve : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return (fieldSlot == 1) ? (mSize >> 1) : -1;
+    }
+
+    virtual ~RsdCpuScriptIntrinsicConvolve();
+    RsdCpuScriptIntrinsicConvolve(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    static const int kMaxSize = 25;
+
+    float mFp[kMaxSize * kMaxSize];
+    float mColumn[kMaxSize];
+    float mRow[kMaxSize];
+    int mSize;
+    bool mSeparable;
+    bool mFloat;
+    int mChannels;
+    RsdCpuScratch mScratch;
+    ObjectBaseRef<Allocation> alloc;
+
+    void updateSeparable();
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicConvolve::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 1);
+    alloc.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicConvolve::setGlobalVar(uint32_t slot,
+                                                 const void *data, size_t dataLength) {
+    rsAssert(slot == 0);
+    int size = (int)(sqrtf((float)(dataLength / sizeof(float))) + 0.5f);
+    if ((size < 1) || (size > kMaxSize) || !(size & 1) ||
+        ((size_t)(size * size) * sizeof(float) != dataLength)) {
+        ALOGE("Convolve needs an odd square kernel of at most %i x %i, got %i bytes",
+              kMaxSize, kMaxSize, (int)dataLength);
+        return;
+    }
+    mSize = size;
+    memcpy(mFp, data, dataLength);
+    updateSeparable();
+}
+
+// A kernel is separable when it has rank one.  The largest coefficient
+// picks the row and column that become the 1D passes, which keeps the
+// division well conditioned.
+void RsdCpuScriptIntrinsicConvolve::updateSeparable() {
+    const int n = mSize;
+    int pr = 0;
+    int pc = 0;
+    float maxAbs = 0.f;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (fabsf(mFp[i * n + j]) > maxAbs) {
+                maxAbs = fabsf(mFp[i * n + j]);
+                pr = i;
+                pc = j;
+            }
+        }
+    }
+
+    mSeparable = false;
+    if (maxAbs == 0.f) {
+        return;
+    }
+    const float pivot = mFp[pr * n + pc];
+    for (int i = 0; i < n; i++) {
+        mColumn[i] = mFp[i * n + pc];
+        mRow[i] = mFp[pr * n + i] / pivot;
+    }
+    const float tolerance = maxAbs * 1e-5f;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (fabsf(mColumn[i] * mRow[j] - mFp[i * n + j]) > tolerance) {
+                return;
+            }
+        }
+    }
+    mSeparable = true;
+}
+
+extern "C" void rsdIntrinsicConvolveAxpy_K(float *dst, const float *src, const float *w,
+                                           uint32_t count8);
+
+// dst[i] += w * src[i].  Every tap of both paths comes down to this over a
+// whole row of channels, which keeps the inner loop free of edge handling.
+static void OneAxpy(float *dst, const float *src, float w, uint32_t count) {
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >= 8)) {
+        rsdIntrinsicConvolveAxpy_K(dst, src, &w, count >> 3);
+        i = count & ~7;
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] += w * src[i];
+    }
+}
+
+// Converts input row y to floats for x in [x1 - r, x2 + r), repeating the
+// edge pixels past either side of the allocation.
+static void OneLoadRow(float *dst, const uchar *pin, size_t stride, bool isFloat, int ch,
+                       int y, int x1, int x2, int r, int dimX) {
+    const uchar *row = pin + stride * y;
+    for (int x = x1 - r; x < x2 + r; x++) {
+        int vx = rsMin(rsMax(x, 0), dimX - 1);
+        if (isFloat) {
+            const float *px = ((const float *)row) + vx * ch;
+            for (int c = 0; c < ch; c++) {
+                dst[c] = px[c];
+            }
+        } else {
+            const uchar *px = row + vx * ch;
+            for (int c = 0; c < ch; c++) {
+                dst[c] = (float)px[c];
+            }
+        }
+        dst += ch;
+    }
+}
+
+void RsdCpuScriptIntrinsicConvolve::kernel(const RsForEachStubParamStruct *p,
+                                           uint32_t xstart, uint32_t xend,
+                                           uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicConvolve *cp = (RsdCpuScriptIntrinsicConvolve *)p->usr;
+    if (!cp->alloc.get()) {
+        ALOGE("Convolve executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
+    const int n = cp->mSize;
+    const int r = n >> 1;
+    const int ch = cp->mChannels;
+
+    // Output channels for [xstart, xend) and input channels for the same
+    // range widened by the kernel radius on either side.
+    const uint32_t cols = (xend - xstart) * ch;
+    const uint32_t padCols = cols + r * 2 * ch;
+    size_t padBytes = (padCols * sizeof(float) + 15) & ~15;
+    uchar *scratch = (uchar *)cp->mScratch.get(p->lid, padBytes * 2 + cols * sizeof(float));
+    if (!scratch) {
+        ALOGE("Convolve out of memory for its rows, skipping a row");
+        return;
+    }
+    float *rowf = (float *)scratch;
+    float *tmp = (float *)(scratch + padBytes);
+    float *acc = (float *)(scratch + padBytes * 2);
+
+    memset(acc, 0, cols * sizeof(float));
+    if (cp->mSeparable) {
+        memset(tmp, 0, padCols * sizeof(float));
+        for (int i = 0; i < n; i++) {
+            int y = rsMin(rsMax((int)p->y + i - r, 0), (int)p->dimY - 1);
+            OneLoadRow(rowf, pin, stride, cp->mFloat, ch, y, xstart, xend, r, p->dimX);
+            OneAxpy(tmp, rowf, cp->mColumn[i], padCols);
+        }
+        for (int j = 0; j < n; j++) {
+            OneAxpy(acc, tmp + j * ch, cp->mRow[j], cols);
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            int y = rsMin(rsMax((int)p->y + i - r, 0), (int)p->dimY - 1);
+            OneLoadRow(rowf, pin, stride, cp->mFloat, ch, y, xstart, xend, r, p->dimX);
+            const float *coeff = &cp->mFp[i * n];
+            for (int j = 0; j < n; j++) {
+                if (coeff[j] != 0.f) {
+                    OneAxpy(acc, rowf + j * ch, coeff[j], cols);
+                }
+            }
+        }
+    }
+
+    if (cp->mFloat) {
+        memcpy(p->out, acc, cols * sizeof(float));
+    } else {
+        uchar *out = (uchar *)p->out;
+        for (uint32_t i = 0; i < cols; i++) {
+            out[i] = (uchar)rsMin(rsMax(acc[i], 0.f), 255.f);
+        }
+    }
+}
+
+RsdCpuScriptIntrinsicConvolve::RsdCpuScriptIntrinsicConvolve(
+            RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_CONVOLVE),
+              mScratch(ctx->getThreadCount()) {
+
+    mRootPtr = &kernel;
+    mFloat = (e->getType() == RS_TYPE_FLOAT_32);
+    // Three component elements are padded to four.
+    mChannels = (e->getVectorSize() == 3) ? 4 : e->getVectorSize();
+
+    // The default kernel is the identity.
+    mSize = 3;
+    memset(mFp, 0, sizeof(mFp));
+    mFp[4] = 1.f;
+    updateSeparable();
+}
+
+RsdCpuScriptIntrinsicConvolve::~RsdCpuScriptIntrinsicConvolve() {
+}
+
+void RsdCpuScriptIntrinsicConvolve::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 2;
+}
+
+void RsdCpuScriptIntrinsicConvolve::invokeFreeChildren() {
+    alloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Convolve(RsdCpuReferenceImpl *ctx,
+                                         const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicConvolve(ctx, s, e);
+}
@@ -32,6 +32,9 @@ public:
 
     virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return (fieldSlot == 1) ? 1 : -1;
+    }
 
     virtual ~RsdCpuScriptIntrinsicConvolve3x3();
     RsdCpuScriptIntrinsicConvolve3x3(RsdCpuReferenceImpl *ctx, const Script *s, const Element *);
@@ -41,6 +44,7 @@ protected:
     short mIp[16];
     ObjectBaseRef<const Allocation> mAlloc;
     ObjectBaseRef<const Element> mElement;
+    int mChannels;
 
     static void kernelU1(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
@@ -60,6 +64,9 @@ protected:
     static void kernelF4(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
                          uint32_t instep, uint32_t outstep);
+    static void kernelH(const RsForEachStubParamStruct *p,
+                        uint32_t xstart, uint32_t xend,
+                        uint32_t instep, uint32_t outstep);
 };
 
 }
@@ -88,12 +95,18 @@ extern "C" void rsdIntrinsicConvolve3x3_K(void *dst, const void *y0, const void
                                           const void *y2, const short *coef, uint32_t count);
 
 
-static void ConvolveOneU4(const RsForEachStubParamStruct *p, uint32_t x, uchar4 *out,
-                          const uchar4 *py0, const uchar4 *py1, const uchar4 *py2,
-                          const float* coeff) {
+// Only the columns at either end of a row need clampX, the kernels run
+// the interior without it.
+static inline void ConvolveOneU4(const RsForEachStubParamStruct *p, uint32_t x, uchar4 *out,
+                                 const uchar4 *py0, const uchar4 *py1, const uchar4 *py2,
+                                 const float* coeff, bool clampX) {
 
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
-    uint32_t x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    uint32_t x1 = x - 1;
+    uint32_t x2 = x + 1;
+    if (clampX) {
+        x1 = rsMax((int32_t)x-1, 0);
+        x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    }
 
     float4 px = convert_float4(py0[x1]) * coeff[0] +
                 convert_float4(py0[x]) * coeff[1] +
@@ -110,12 +123,16 @@ static void ConvolveOneU4(const RsForEachStubParamStruct *p, uint32_t x, uchar4
     *out = o;
 }
 
-static void ConvolveOneU2(const RsForEachStubParamStruct *p, uint32_t x, uchar2 *out,
-                          const uchar2 *py0, const uchar2 *py1, const uchar2 *py2,
-                          const float* coeff) {
+static inline void ConvolveOneU2(const RsForEachStubParamStruct *p, uint32_t x, uchar2 *out,
+                                 const uchar2 *py0, const uchar2 *py1, const uchar2 *py2,
+                                 const float* coeff, bool clampX) {
 
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
-    uint32_t x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    uint32_t x1 = x - 1;
+    uint32_t x2 = x + 1;
+    if (clampX) {
+        x1 = rsMax((int32_t)x-1, 0);
+        x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    }
 
     float2 px = convert_float2(py0[x1]) * coeff[0] +
                 convert_float2(py0[x]) * coeff[1] +
@@ -131,12 +148,16 @@ static void ConvolveOneU2(const RsForEachStubParamStruct *p, uint32_t x, uchar2
     *out = convert_uchar2(px);
 }
 
-static void ConvolveOneU1(const RsForEachStubParamStruct *p, uint32_t x, uchar *out,
-                          const uchar *py0, const uchar *py1, const uchar *py2,
-                          const float* coeff) {
+static inline void ConvolveOneU1(const RsForEachStubParamStruct *p, uint32_t x, uchar *out,
+                                 const uchar *py0, const uchar *py1, const uchar *py2,
+                                 const float* coeff, bool clampX) {
 
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
-    uint32_t x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    uint32_t x1 = x - 1;
+    uint32_t x2 = x + 1;
+    if (clampX) {
+        x1 = rsMax((int32_t)x-1, 0);
+        x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    }
 
     float px = ((float)py0[x1]) * coeff[0] +
                ((float)py0[x]) * coeff[1] +
@@ -150,34 +171,46 @@ static void ConvolveOneU1(const RsForEachStubParamStruct *p, uint32_t x, uchar *
     *out = clamp(px, 0.f, 255.f);
 }
 
-static void ConvolveOneF4(const RsForEachStubParamStruct *p, uint32_t x, float4 *out,
-                          const float4 *py0, const float4 *py1, const float4 *py2,
-                          const float* coeff) {
+static inline void ConvolveOneF4(const RsForEachStubParamStruct *p, uint32_t x, float4 *out,
+                                 const float4 *py0, const float4 *py1, const float4 *py2,
+                                 const float* coeff, bool clampX) {
 
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
-    uint32_t x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    uint32_t x1 = x - 1;
+    uint32_t x2 = x + 1;
+    if (clampX) {
+        x1 = rsMax((int32_t)x-1, 0);
+        x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    }
     *out = (py0[x1] * coeff[0]) + (py0[x] * coeff[1]) + (py0[x2] * coeff[2]) +
            (py1[x1] * coeff[3]) + (py1[x] * coeff[4]) + (py1[x2] * coeff[5]) +
            (py2[x1] * coeff[6]) + (py2[x] * coeff[7]) + (py2[x2] * coeff[8]);
 }
 
-static void ConvolveOneF2(const RsForEachStubParamStruct *p, uint32_t x, float2 *out,
-                          const float2 *py0, const float2 *py1, const float2 *py2,
-                          const float* coeff) {
+static inline void ConvolveOneF2(const RsForEachStubParamStruct *p, uint32_t x, float2 *out,
+                                 const float2 *py0, const float2 *py1, const float2 *py2,
+                                 const float* coeff, bool clampX) {
 
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
-    uint32_t x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    uint32_t x1 = x - 1;
+    uint32_t x2 = x + 1;
+    if (clampX) {
+        x1 = rsMax((int32_t)x-1, 0);
+        x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    }
     *out = (py0[x1] * coeff[0]) + (py0[x] * coeff[1]) + (py0[x2] * coeff[2]) +
            (py1[x1] * coeff[3]) + (py1[x] * coeff[4]) + (py1[x2] * coeff[5]) +
            (py2[x1] * coeff[6]) + (py2[x] * coeff[7]) + (py2[x2] * coeff[8]);
 }
 
-static void ConvolveOneF1(const RsForEachStubParamStruct *p, uint32_t x, float *out,
-                          const float *py0, const float *py1, const float *py2,
-                          const float* coeff) {
+static inline void ConvolveOneF1(const RsForEachStubParamStruct *p, uint32_t x, float *out,
+                                 const float *py0, const float *py1, const float *py2,
+                                 const float* coeff, bool clampX) {
 
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
-    uint32_t x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    uint32_t x1 = x - 1;
+    uint32_t x2 = x + 1;
+    if (clampX) {
+        x1 = rsMax((int32_t)x-1, 0);
+        x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    }
     *out = (py0[x1] * coeff[0]) + (py0[x] * coeff[1]) + (py0[x2] * coeff[2]) +
            (py1[x1] * coeff[3]) + (py1[x] * coeff[4]) + (py1[x2] * coeff[5]) +
            (py2[x1] * coeff[6]) + (py2[x] * coeff[7]) + (py2[x2] * coeff[8]);
@@ -192,8 +225,8 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelU4(const RsForEachStubParamStruct *
         ALOGE("Convolve3x3 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
     uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
@@ -204,29 +237,32 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelU4(const RsForEachStubParamStruct *
     uchar4 *out = (uchar4 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-    if(x1 == 0) {
-        ConvolveOneU4(p, 0, out, py0, py1, py2, cp->mFp);
-        x1 ++;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 1, &ix1, &ix2);
+    while (x1 < ix1) {
+        ConvolveOneU4(p, x1, out, py0, py1, py2, cp->mFp, true);
         out++;
+        x1++;
     }
-
-    if(x2 > x1) {
-#if defined(ARCH_ARM_HAVE_VFP)
-        if (gArchUseSIMD) {
-            int32_t len = (x2 - x1 - 1) >> 1;
-            if(len > 0) {
-                rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
-                x1 += len << 1;
-                out += len << 1;
-            }
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        uint32_t len = (ix2 - x1) >> 1;
+        if (len > 0) {
+            rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
+            x1 += len << 1;
+            out += len << 1;
         }
+    }
 #endif
-
-        while(x1 != x2) {
-            ConvolveOneU4(p, x1, out, py0, py1, py2, cp->mFp);
-            out++;
-            x1++;
-        }
+    while (x1 < ix2) {
+        ConvolveOneU4(p, x1, out, py0, py1, py2, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        ConvolveOneU4(p, x1, out, py0, py1, py2, cp->mFp, true);
+        out++;
+        x1++;
     }
 }
 
@@ -239,8 +275,8 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelU2(const RsForEachStubParamStruct *
         ALOGE("Convolve3x3 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
     uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
@@ -251,27 +287,30 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelU2(const RsForEachStubParamStruct *
     uchar2 *out = (uchar2 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-    if(x1 == 0) {
-        ConvolveOneU2(p, 0, out, py0, py1, py2, cp->mFp);
-        x1 ++;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 1, &ix1, &ix2);
+    while (x1 < ix1) {
+        ConvolveOneU2(p, x1, out, py0, py1, py2, cp->mFp, true);
         out++;
+        x1++;
+    }
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const uchar *rows[3] = {(const uchar *)py0, (const uchar *)py1, (const uchar *)py2};
+        uint32_t len = rsConvolveInteriorU8((uchar *)out, rows, cp->mIp, 3, 2, x1, ix2);
+        out += len;
+        x1 += len;
     }
-
-    if(x2 > x1) {
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-        int32_t len = (x2 - x1 - 1) >> 1;
-        if(len > 0) {
-            rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
-            x1 += len << 1;
-            out += len << 1;
-        }
 #endif
-
-        while(x1 != x2) {
-            ConvolveOneU2(p, x1, out, py0, py1, py2, cp->mFp);
-            out++;
-            x1++;
-        }
+    while (x1 < ix2) {
+        ConvolveOneU2(p, x1, out, py0, py1, py2, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        ConvolveOneU2(p, x1, out, py0, py1, py2, cp->mFp, true);
+        out++;
+        x1++;
     }
 }
 
@@ -284,8 +323,8 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelU1(const RsForEachStubParamStruct *
         ALOGE("Convolve3x3 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
     uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
@@ -296,27 +335,30 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelU1(const RsForEachStubParamStruct *
     uchar *out = (uchar *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-    if(x1 == 0) {
-        ConvolveOneU1(p, 0, out, py0, py1, py2, cp->mFp);
-        x1 ++;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 1, &ix1, &ix2);
+    while (x1 < ix1) {
+        ConvolveOneU1(p, x1, out, py0, py1, py2, cp->mFp, true);
         out++;
+        x1++;
+    }
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const uchar *rows[3] = {py0, py1, py2};
+        uint32_t len = rsConvolveInteriorU8(out, rows, cp->mIp, 3, 1, x1, ix2);
+        out += len;
+        x1 += len;
     }
-
-    if(x2 > x1) {
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-        int32_t len = (x2 - x1 - 1) >> 1;
-        if(len > 0) {
-            rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
-            x1 += len << 1;
-            out += len << 1;
-        }
 #endif
-
-        while(x1 != x2) {
-            ConvolveOneU1(p, x1, out, py0, py1, py2, cp->mFp);
-            out++;
-            x1++;
-        }
+    while (x1 < ix2) {
+        ConvolveOneU1(p, x1, out, py0, py1, py2, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        ConvolveOneU1(p, x1, out, py0, py1, py2, cp->mFp, true);
+        out++;
+        x1++;
     }
 }
 
@@ -329,8 +371,8 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelF4(const RsForEachStubParamStruct *
         ALOGE("Convolve3x3 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
     uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
@@ -341,27 +383,30 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelF4(const RsForEachStubParamStruct *
     float4 *out = (float4 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-    if(x1 == 0) {
-        ConvolveOneF4(p, 0, out, py0, py1, py2, cp->mFp);
-        x1 ++;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 1, &ix1, &ix2);
+    while (x1 < ix1) {
+        ConvolveOneF4(p, x1, out, py0, py1, py2, cp->mFp, true);
         out++;
+        x1++;
+    }
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const float *rows[3] = {(const float *)py0, (const float *)py1, (const float *)py2};
+        uint32_t len = rsConvolveInteriorF32((float *)out, rows, cp->mFp, 3, 4, x1, ix2);
+        out += len;
+        x1 += len;
     }
-
-    if(x2 > x1) {
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-        int32_t len = (x2 - x1 - 1) >> 1;
-        if(len > 0) {
-            rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
-            x1 += len << 1;
-            out += len << 1;
-        }
 #endif
-
-        while(x1 != x2) {
-            ConvolveOneF4(p, x1, out, py0, py1, py2, cp->mFp);
-            out++;
-            x1++;
-        }
+    while (x1 < ix2) {
+        ConvolveOneF4(p, x1, out, py0, py1, py2, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        ConvolveOneF4(p, x1, out, py0, py1, py2, cp->mFp, true);
+        out++;
+        x1++;
     }
 }
 
@@ -374,8 +419,8 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelF2(const RsForEachStubParamStruct *
         ALOGE("Convolve3x3 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
     uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
@@ -386,27 +431,30 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelF2(const RsForEachStubParamStruct *
     float2 *out = (float2 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-    if(x1 == 0) {
-        ConvolveOneF2(p, 0, out, py0, py1, py2, cp->mFp);
-        x1 ++;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 1, &ix1, &ix2);
+    while (x1 < ix1) {
+        ConvolveOneF2(p, x1, out, py0, py1, py2, cp->mFp, true);
         out++;
+        x1++;
+    }
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const float *rows[3] = {(const float *)py0, (const float *)py1, (const float *)py2};
+        uint32_t len = rsConvolveInteriorF32((float *)out, rows, cp->mFp, 3, 2, x1, ix2);
+        out += len;
+        x1 += len;
     }
-
-    if(x2 > x1) {
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-        int32_t len = (x2 - x1 - 1) >> 1;
-        if(len > 0) {
-            rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
-            x1 += len << 1;
-            out += len << 1;
-        }
 #endif
-
-        while(x1 != x2) {
-            ConvolveOneF2(p, x1, out, py0, py1, py2, cp->mFp);
-            out++;
-            x1++;
-        }
+    while (x1 < ix2) {
+        ConvolveOneF2(p, x1, out, py0, py1, py2, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        ConvolveOneF2(p, x1, out, py0, py1, py2, cp->mFp, true);
+        out++;
+        x1++;
     }
 }
 void RsdCpuScriptIntrinsicConvolve3x3::kernelF1(const RsForEachStubParamStruct *p,
@@ -418,8 +466,8 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelF1(const RsForEachStubParamStruct *
         ALOGE("Convolve3x3 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
 
     uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
     uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
@@ -430,27 +478,77 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernelF1(const RsForEachStubParamStruct *
     float *out = (float *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-    if(x1 == 0) {
-        ConvolveOneF1(p, 0, out, py0, py1, py2, cp->mFp);
-        x1 ++;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 1, &ix1, &ix2);
+    while (x1 < ix1) {
+        ConvolveOneF1(p, x1, out, py0, py1, py2, cp->mFp, true);
         out++;
+        x1++;
+    }
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const float *rows[3] = {py0, py1, py2};
+        uint32_t len = rsConvolveInteriorF32(out, rows, cp->mFp, 3, 1, x1, ix2);
+        out += len;
+        x1 += len;
     }
-
-    if(x2 > x1) {
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-        int32_t len = (x2 - x1 - 1) >> 1;
-        if(len > 0) {
-            rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
-            x1 += len << 1;
-            out += len << 1;
-        }
 #endif
+    while (x1 < ix2) {
+        ConvolveOneF1(p, x1, out, py0, py1, py2, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        ConvolveOneF1(p, x1, out, py0, py1, py2, cp->mFp, true);
+        out++;
+        x1++;
+    }
+}
 
-        while(x1 != x2) {
-            ConvolveOneF1(p, x1, out, py0, py1, py2, cp->mFp);
-            out++;
-            x1++;
+// Half elements are converted to floats a chunk of pixels at a time, so
+// the rows never need a float copy of the whole allocation.
+static const int kHalfChunk = 64;
+
+void RsdCpuScriptIntrinsicConvolve3x3::kernelH(const RsForEachStubParamStruct *p,
+                                               uint32_t xstart, uint32_t xend,
+                                               uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicConvolve3x3 *cp = (RsdCpuScriptIntrinsicConvolve3x3 *)p->usr;
+
+    if (!cp->mAlloc.get()) {
+        ALOGE("Convolve3x3 executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
+    const int ch = cp->mChannels;
+
+    uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
+    uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
+    const ushort *py[3];
+    py[0] = (const ushort *)(pin + stride * y2);
+    py[1] = (const ushort *)(pin + stride * p->y);
+    py[2] = (const ushort *)(pin + stride * y1);
+
+    float rows[3][(kHalfChunk + 2) * 4];
+    float acc[kHalfChunk * 4];
+    ushort *out = (ushort *)p->out;
+    for (uint32_t x = xstart; x < xend; x += kHalfChunk) {
+        const int n = rsMin(xend - x, (uint32_t)kHalfChunk);
+        for (int r = 0; r < 3; r++) {
+            rsHalfLoadRow(rows[r], py[r], x, n, 1, ch, p->dimX);
+        }
+        for (int i = 0; i < n * ch; i++) {
+            float sum = 0.f;
+            for (int r = 0; r < 3; r++) {
+                const float *coeff = &cp->mFp[r * 3];
+                sum += rows[r][i] * coeff[0] +
+                       rows[r][i + ch] * coeff[1] +
+                       rows[r][i + ch * 2] * coeff[2];
+            }
+            acc[i] = sum;
         }
+        rsFloatToHalfRow(out, acc, n * ch);
+        out += n * ch;
     }
 }
 
@@ -458,7 +556,11 @@ RsdCpuScriptIntrinsicConvolve3x3::RsdCpuScriptIntrinsicConvolve3x3(
             RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_CONVOLVE_3x3) {
 
-    if (e->getType() == RS_TYPE_FLOAT_32) {
+    // Three component elements are padded to four.
+    mChannels = (e->getVectorSize() == 3) ? 4 : e->getVectorSize();
+    if (e->getType() == RS_TYPE_FLOAT_16) {
+        mRootPtr = &kernelH;
+    } else if (e->getType() == RS_TYPE_FLOAT_32) {
         switch(e->getVectorSize()) {
         case 1:
             mRootPtr = &kernelF1;
@@ -32,6 +32,9 @@ public:
 
     virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return (fieldSlot == 1) ? 2 : -1;
+    }
 
     virtual ~RsdCpuScriptIntrinsicConvolve5x5();
     RsdCpuScriptIntrinsicConvolve5x5(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
@@ -40,7 +43,7 @@ protected:
     float mFp[28];
     short mIp[28];
     ObjectBaseRef<Allocation> alloc;
-
+    int mChannels;
 
     static void kernelU1(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
@@ -60,6 +63,9 @@ protected:
     static void kernelF4(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
                          uint32_t instep, uint32_t outstep);
+    static void kernelH(const RsForEachStubParamStruct *p,
+                        uint32_t xstart, uint32_t xend,
+                        uint32_t instep, uint32_t outstep);
 
 
 };
@@ -86,15 +92,23 @@ void RsdCpuScriptIntrinsicConvolve5x5::setGlobalVar(uint32_t slot,
 }
 
 
-static void OneU4(const RsForEachStubParamStruct *p, uint32_t x, uchar4 *out,
-                  const uchar4 *py0, const uchar4 *py1, const uchar4 *py2, const uchar4 *py3, const uchar4 *py4,
-                  const float* coeff) {
+// Only the columns at either end of a row need clampX, the kernels run
+// the interior without it.
+static inline void OneU4(const RsForEachStubParamStruct *p, uint32_t x, uchar4 *out,
+                         const uchar4 *py0, const uchar4 *py1, const uchar4 *py2, const uchar4 *py3, const uchar4 *py4,
+                         const float* coeff, bool clampX) {
 
-    uint32_t x0 = rsMax((int32_t)x-2, 0);
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
+    uint32_t x0 = x - 2;
+    uint32_t x1 = x - 1;
     uint32_t x2 = x;
-    uint32_t x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
-    uint32_t x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    uint32_t x3 = x + 1;
+    uint32_t x4 = x + 2;
+    if (clampX) {
+        x0 = rsMax((int32_t)x-2, 0);
+        x1 = rsMax((int32_t)x-1, 0);
+        x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
+        x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    }
 
     float4 px = convert_float4(py0[x0]) * coeff[0] +
                 convert_float4(py0[x1]) * coeff[1] +
@@ -129,15 +143,21 @@ static void OneU4(const RsForEachStubParamStruct *p, uint32_t x, uchar4 *out,
     *out = convert_uchar4(px);
 }
 
-static void OneU2(const RsForEachStubParamStruct *p, uint32_t x, uchar2 *out,
-                  const uchar2 *py0, const uchar2 *py1, const uchar2 *py2, const uchar2 *py3, const uchar2 *py4,
-                  const float* coeff) {
+static inline void OneU2(const RsForEachStubParamStruct *p, uint32_t x, uchar2 *out,
+                         const uchar2 *py0, const uchar2 *py1, const uchar2 *py2, const uchar2 *py3, const uchar2 *py4,
+                         const float* coeff, bool clampX) {
 
-    uint32_t x0 = rsMax((int32_t)x-2, 0);
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
+    uint32_t x0 = x - 2;
+    uint32_t x1 = x - 1;
     uint32_t x2 = x;
-    uint32_t x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
-    uint32_t x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    uint32_t x3 = x + 1;
+    uint32_t x4 = x + 2;
+    if (clampX) {
+        x0 = rsMax((int32_t)x-2, 0);
+        x1 = rsMax((int32_t)x-1, 0);
+        x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
+        x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    }
 
     float2 px = convert_float2(py0[x0]) * coeff[0] +
                 convert_float2(py0[x1]) * coeff[1] +
@@ -172,15 +192,21 @@ static void OneU2(const RsForEachStubParamStruct *p, uint32_t x, uchar2 *out,
     *out = convert_uchar2(px);
 }
 
-static void OneU1(const RsForEachStubParamStruct *p, uint32_t x, uchar *out,
-                  const uchar *py0, const uchar *py1, const uchar *py2, const uchar *py3, const uchar *py4,
-                  const float* coeff) {
+static inline void OneU1(const RsForEachStubParamStruct *p, uint32_t x, uchar *out,
+                         const uchar *py0, const uchar *py1, const uchar *py2, const uchar *py3, const uchar *py4,
+                         const float* coeff, bool clampX) {
 
-    uint32_t x0 = rsMax((int32_t)x-2, 0);
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
+    uint32_t x0 = x - 2;
+    uint32_t x1 = x - 1;
     uint32_t x2 = x;
-    uint32_t x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
-    uint32_t x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    uint32_t x3 = x + 1;
+    uint32_t x4 = x + 2;
+    if (clampX) {
+        x0 = rsMax((int32_t)x-2, 0);
+        x1 = rsMax((int32_t)x-1, 0);
+        x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
+        x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    }
 
     float px = (float)(py0[x0]) * coeff[0] +
                (float)(py0[x1]) * coeff[1] +
@@ -215,15 +241,21 @@ static void OneU1(const RsForEachStubParamStruct *p, uint32_t x, uchar *out,
     *out = px;
 }
 
-static void OneF4(const RsForEachStubParamStruct *p, uint32_t x, float4 *out,
-                  const float4 *py0, const float4 *py1, const float4 *py2, const float4 *py3, const float4 *py4,
-                  const float* coeff) {
+static inline void OneF4(const RsForEachStubParamStruct *p, uint32_t x, float4 *out,
+                         const float4 *py0, const float4 *py1, const float4 *py2, const float4 *py3, const float4 *py4,
+                         const float* coeff, bool clampX) {
 
-    uint32_t x0 = rsMax((int32_t)x-2, 0);
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
+    uint32_t x0 = x - 2;
+    uint32_t x1 = x - 1;
     uint32_t x2 = x;
-    uint32_t x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
-    uint32_t x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    uint32_t x3 = x + 1;
+    uint32_t x4 = x + 2;
+    if (clampX) {
+        x0 = rsMax((int32_t)x-2, 0);
+        x1 = rsMax((int32_t)x-1, 0);
+        x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
+        x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    }
 
     float4 px = py0[x0] * coeff[0] +
                 py0[x1] * coeff[1] +
@@ -257,15 +289,21 @@ static void OneF4(const RsForEachStubParamStruct *p, uint32_t x, float4 *out,
     *out = px;
 }
 
-static void OneF2(const RsForEachStubParamStruct *p, uint32_t x, float2 *out,
-                  const float2 *py0, const float2 *py1, const float2 *py2, const float2 *py3, const float2 *py4,
-                  const float* coeff) {
+static inline void OneF2(const RsForEachStubParamStruct *p, uint32_t x, float2 *out,
+                         const float2 *py0, const float2 *py1, const float2 *py2, const float2 *py3, const float2 *py4,
+                         const float* coeff, bool clampX) {
 
-    uint32_t x0 = rsMax((int32_t)x-2, 0);
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
+    uint32_t x0 = x - 2;
+    uint32_t x1 = x - 1;
     uint32_t x2 = x;
-    uint32_t x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
-    uint32_t x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    uint32_t x3 = x + 1;
+    uint32_t x4 = x + 2;
+    if (clampX) {
+        x0 = rsMax((int32_t)x-2, 0);
+        x1 = rsMax((int32_t)x-1, 0);
+        x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
+        x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    }
 
     float2 px = py0[x0] * coeff[0] +
                 py0[x1] * coeff[1] +
@@ -299,15 +337,21 @@ static void OneF2(const RsForEachStubParamStruct *p, uint32_t x, float2 *out,
     *out = px;
 }
 
-static void OneF1(const RsForEachStubParamStruct *p, uint32_t x, float *out,
-                  const float *py0, const float *py1, const float *py2, const float *py3, const float *py4,
-                  const float* coeff) {
+static inline void OneF1(const RsForEachStubParamStruct *p, uint32_t x, float *out,
+                         const float *py0, const float *py1, const float *py2, const float *py3, const float *py4,
+                         const float* coeff, bool clampX) {
 
-    uint32_t x0 = rsMax((int32_t)x-2, 0);
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
+    uint32_t x0 = x - 2;
+    uint32_t x1 = x - 1;
     uint32_t x2 = x;
-    uint32_t x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
-    uint32_t x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    uint32_t x3 = x + 1;
+    uint32_t x4 = x + 2;
+    if (clampX) {
+        x0 = rsMax((int32_t)x-2, 0);
+        x1 = rsMax((int32_t)x-1, 0);
+        x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
+        x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    }
 
     float px = py0[x0] * coeff[0] +
                py0[x1] * coeff[1] +
@@ -354,8 +398,8 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelU4(const RsForEachStubParamStruct *
         ALOGE("Convolve5x5 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
 
     uint32_t y0 = rsMax((int32_t)p->y-2, 0);
     uint32_t y1 = rsMax((int32_t)p->y-1, 0);
@@ -369,27 +413,41 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelU4(const RsForEachStubParamStruct *
     const uchar4 *py3 = (const uchar4 *)(pin + stride * y3);
     const uchar4 *py4 = (const uchar4 *)(pin + stride * y4);
 
+    // The row entering the window prefetchRows rows from now.
+    if (p->prefetchRows) {
+        prefetchInputRow(p, pin, stride, p->y + 2 + p->prefetchRows,
+                         rsMax((int32_t)xstart - 2, 0) * 4, rsMin(xend + 2, p->dimX) * 4);
+    }
+
     uchar4 *out = (uchar4 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-
-    while((x1 < x2) && (x1 < 2)) {
-        OneU4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 2, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneU4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
-
-#if defined(ARCH_ARM_HAVE_VFP)
-    if(gArchUseSIMD && ((x1 + 3) < x2)) {
-        uint32_t len = (x2 - x1 - 3) >> 1;
-        rsdIntrinsicConvolve5x5_K(out, py0, py1, py2, py3, py4, cp->mIp, len);
-        out += len << 1;
-        x1 += len << 1;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    // The SIMD kernel loads eight pixels for each pair it writes, two more
+    // than its taps need.
+    if (gArchUseSIMD && ((x1 + 4) <= p->dimX)) {
+        uint32_t len = (rsMin(ix2, p->dimX - 4) - x1) >> 1;
+        if (len > 0) {
+            rsdIntrinsicConvolve5x5_K(out, &py0[x1-2], &py1[x1-2], &py2[x1-2], &py3[x1-2], &py4[x1-2], cp->mIp, len);
+            out += len << 1;
+            x1 += len << 1;
+        }
     }
 #endif
-
-    while(x1 < x2) {
-        OneU4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    while (x1 < ix2) {
+        OneU4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        OneU4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
@@ -403,8 +461,8 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelU2(const RsForEachStubParamStruct *
         ALOGE("Convolve5x5 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
 
     uint32_t y0 = rsMax((int32_t)p->y-2, 0);
     uint32_t y1 = rsMax((int32_t)p->y-1, 0);
@@ -421,24 +479,29 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelU2(const RsForEachStubParamStruct *
     uchar2 *out = (uchar2 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-
-    while((x1 < x2) && (x1 < 2)) {
-        OneU2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 2, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneU2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
-
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-    if((x1 + 3) < x2) {
-        uint32_t len = (x2 - x1 - 3) >> 1;
-        rsdIntrinsicConvolve5x5_K(out, py0, py1, py2, py3, py4, cp->ip, len);
-        out += len << 1;
-        x1 += len << 1;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const uchar *rows[5] = {(const uchar *)py0, (const uchar *)py1, (const uchar *)py2,
+                                (const uchar *)py3, (const uchar *)py4};
+        uint32_t len = rsConvolveInteriorU8((uchar *)out, rows, cp->mIp, 5, 2, x1, ix2);
+        out += len;
+        x1 += len;
     }
 #endif
-
-    while(x1 < x2) {
-        OneU2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    while (x1 < ix2) {
+        OneU2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        OneU2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
@@ -452,8 +515,8 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelU1(const RsForEachStubParamStruct *
         ALOGE("Convolve5x5 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
 
     uint32_t y0 = rsMax((int32_t)p->y-2, 0);
     uint32_t y1 = rsMax((int32_t)p->y-1, 0);
@@ -470,24 +533,28 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelU1(const RsForEachStubParamStruct *
     uchar *out = (uchar *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-
-    while((x1 < x2) && (x1 < 2)) {
-        OneU1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 2, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneU1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
-
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-    if((x1 + 3) < x2) {
-        uint32_t len = (x2 - x1 - 3) >> 1;
-        rsdIntrinsicConvolve5x5_K(out, py0, py1, py2, py3, py4, cp->ip, len);
-        out += len << 1;
-        x1 += len << 1;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const uchar *rows[5] = {py0, py1, py2, py3, py4};
+        uint32_t len = rsConvolveInteriorU8(out, rows, cp->mIp, 5, 1, x1, ix2);
+        out += len;
+        x1 += len;
     }
 #endif
-
-    while(x1 < x2) {
-        OneU1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    while (x1 < ix2) {
+        OneU1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        OneU1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
@@ -501,8 +568,8 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelF4(const RsForEachStubParamStruct *
         ALOGE("Convolve5x5 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
 
     uint32_t y0 = rsMax((int32_t)p->y-2, 0);
     uint32_t y1 = rsMax((int32_t)p->y-1, 0);
@@ -519,24 +586,29 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelF4(const RsForEachStubParamStruct *
     float4 *out = (float4 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-
-    while((x1 < x2) && (x1 < 2)) {
-        OneF4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 2, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneF4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
-
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-    if((x1 + 3) < x2) {
-        uint32_t len = (x2 - x1 - 3) >> 1;
-        rsdIntrinsicConvolve5x5_K(out, py0, py1, py2, py3, py4, cp->ip, len);
-        out += len << 1;
-        x1 += len << 1;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const float *rows[5] = {(const float *)py0, (const float *)py1, (const float *)py2,
+                                (const float *)py3, (const float *)py4};
+        uint32_t len = rsConvolveInteriorF32((float *)out, rows, cp->mFp, 5, 4, x1, ix2);
+        out += len;
+        x1 += len;
     }
 #endif
-
-    while(x1 < x2) {
-        OneF4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    while (x1 < ix2) {
+        OneF4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        OneF4(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
@@ -550,8 +622,8 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelF2(const RsForEachStubParamStruct *
         ALOGE("Convolve5x5 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
 
     uint32_t y0 = rsMax((int32_t)p->y-2, 0);
     uint32_t y1 = rsMax((int32_t)p->y-1, 0);
@@ -568,24 +640,29 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelF2(const RsForEachStubParamStruct *
     float2 *out = (float2 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-
-    while((x1 < x2) && (x1 < 2)) {
-        OneF2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 2, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneF2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
-
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-    if((x1 + 3) < x2) {
-        uint32_t len = (x2 - x1 - 3) >> 1;
-        rsdIntrinsicConvolve5x5_K(out, py0, py1, py2, py3, py4, cp->ip, len);
-        out += len << 1;
-        x1 += len << 1;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const float *rows[5] = {(const float *)py0, (const float *)py1, (const float *)py2,
+                                (const float *)py3, (const float *)py4};
+        uint32_t len = rsConvolveInteriorF32((float *)out, rows, cp->mFp, 5, 2, x1, ix2);
+        out += len;
+        x1 += len;
     }
 #endif
-
-    while(x1 < x2) {
-        OneF2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    while (x1 < ix2) {
+        OneF2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        OneF2(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
@@ -599,8 +676,8 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelF1(const RsForEachStubParamStruct *
         ALOGE("Convolve5x5 executed without input, skipping");
         return;
     }
-    const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
-    const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
 
     uint32_t y0 = rsMax((int32_t)p->y-2, 0);
     uint32_t y1 = rsMax((int32_t)p->y-1, 0);
@@ -617,34 +694,89 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernelF1(const RsForEachStubParamStruct *
     float *out = (float *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-
-    while((x1 < x2) && (x1 < 2)) {
-        OneF1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, 2, &ix1, &ix2);
+    while (x1 < ix1) {
+        OneF1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
-
-#if 0//defined(ARCH_ARM_HAVE_NEON)
-    if((x1 + 3) < x2) {
-        uint32_t len = (x2 - x1 - 3) >> 1;
-        rsdIntrinsicConvolve5x5_K(out, py0, py1, py2, py3, py4, cp->ip, len);
-        out += len << 1;
-        x1 += len << 1;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        const float *rows[5] = {py0, py1, py2, py3, py4};
+        uint32_t len = rsConvolveInteriorF32(out, rows, cp->mFp, 5, 1, x1, ix2);
+        out += len;
+        x1 += len;
     }
 #endif
-
-    while(x1 < x2) {
-        OneF1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp);
+    while (x1 < ix2) {
+        OneF1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, false);
+        out++;
+        x1++;
+    }
+    while (x1 < x2) {
+        OneF1(p, x1, out, py0, py1, py2, py3, py4, cp->mFp, true);
         out++;
         x1++;
     }
 }
 
+// Half elements are converted to floats a chunk of pixels at a time, so
+// the rows never need a float copy of the whole allocation.
+static const int kHalfChunk = 64;
+
+void RsdCpuScriptIntrinsicConvolve5x5::kernelH(const RsForEachStubParamStruct *p,
+                                               uint32_t xstart, uint32_t xend,
+                                               uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicConvolve5x5 *cp = (RsdCpuScriptIntrinsicConvolve5x5 *)p->usr;
+    if (!cp->alloc.get()) {
+        ALOGE("Convolve5x5 executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->alloc.get(), &stride);
+    const int ch = cp->mChannels;
+
+    const ushort *py[5];
+    for (int r = 0; r < 5; r++) {
+        int y = rsMin(rsMax((int32_t)p->y + r - 2, 0), (int32_t)(p->dimY-1));
+        py[r] = (const ushort *)(pin + stride * y);
+    }
+
+    float rows[5][(kHalfChunk + 4) * 4];
+    float acc[kHalfChunk * 4];
+    ushort *out = (ushort *)p->out;
+    for (uint32_t x = xstart; x < xend; x += kHalfChunk) {
+        const int n = rsMin(xend - x, (uint32_t)kHalfChunk);
+        for (int r = 0; r < 5; r++) {
+            rsHalfLoadRow(rows[r], py[r], x, n, 2, ch, p->dimX);
+        }
+        for (int i = 0; i < n * ch; i++) {
+            float sum = 0.f;
+            for (int r = 0; r < 5; r++) {
+                const float *coeff = &cp->mFp[r * 5];
+                sum += rows[r][i] * coeff[0] +
+                       rows[r][i + ch] * coeff[1] +
+                       rows[r][i + ch * 2] * coeff[2] +
+                       rows[r][i + ch * 3] * coeff[3] +
+                       rows[r][i + ch * 4] * coeff[4];
+            }
+            acc[i] = sum;
+        }
+        rsFloatToHalfRow(out, acc, n * ch);
+        out += n * ch;
+    }
+}
+
 RsdCpuScriptIntrinsicConvolve5x5::RsdCpuScriptIntrinsicConvolve5x5(
             RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_CONVOLVE_5x5) {
 
-    if (e->getType() == RS_TYPE_FLOAT_32) {
+    // Three component elements are padded to four.
+    mChannels = (e->getVectorSize() == 3) ? 4 : e->getVectorSize();
+    if (e->getType() == RS_TYPE_FLOAT_16) {
+        mRootPtr = &kernelH;
+    } else if (e->getType() == RS_TYPE_FLOAT_32) {
         switch(e->getVectorSize()) {
         case 1:
             mRootPtr = &kernelF1;
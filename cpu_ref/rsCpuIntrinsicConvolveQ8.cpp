@@ -0,0 +1,560 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+#if defined(ARCH_ARM_USE_INTRINSICS) && defined(__ARM_NEON)
+#define RS_CONVOLVEQ8_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Multi-channel 2D convolution of U8 activations with U8 weights, summed
+// in I32 and requantized to U8, or left as I32.  Activations are 3D
+// Allocations with the channels along X, a row of pixels along Y and the
+// rows along Z, each pixel's channels being contiguous.  The filter has the
+// input channels along X, kernel columns along Y, and the kernel rows of
+// each output channel in turn along Z.
+//
+// The convolution is direct: each output pixel reads the input cells under
+// its taps where they are, without copying them out.  Sums are formed
+// from the raw U8 products, and the offsets applied afterwards from the
+// sums of the inputs and weights under the taps, padding adding nothing.
+// Launches are tiled by output row and block of output channels.
+class RsdCpuScriptIntrinsicConvolveQ8 : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                               const Allocation * ain,
+                               Allocation * aout,
+                               const void * usr,
+                               uint32_t usrLen,
+                               const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicConvolveQ8();
+    RsdCpuScriptIntrinsicConvolveQ8(RsdCpuReferenceImpl *ctx, const Script *s,
+                                    const Element *e);
+
+protected:
+    // Output channels per microkernel call, and the most per tile.
+    static const uint32_t kCR = 4;
+    static const uint32_t kCC = 64;
+    static const uint32_t kMaxTaps = 64;
+
+    ObjectBaseRef<const Allocation> mIn;
+    ObjectBaseRef<const Allocation> mFilter;
+    ObjectBaseRef<const Allocation> mBias;
+    // Input, filter and output offsets, then the multiplier and right
+    // shift of the requantization.
+    int32_t mQuant[5];
+    // Stride and padding, X first.
+    int32_t mGeometry[4];
+
+    // The launch being run.
+    uint32_t mCin;
+    uint32_t mInW;
+    uint32_t mInH;
+    size_t mInStride;
+    const uchar *mInPtr;
+    uint32_t mCout;
+    uint32_t mOutW;
+    uint32_t mKW;
+    uint32_t mKH;
+    size_t mFilterStride;
+    const uchar *mFilterPtr;
+    const int32_t *mBiasPtr;
+    uchar *mOutPtr;
+    size_t mOutStride;
+    bool mOutI32;
+    uint32_t mTilesC;
+    uint32_t mCC;
+    // Per output channel, the weight sums of each tap and then of all.
+    uint32_t *mSums;
+    size_t mSumsSize;
+
+    void launch(uint32_t slot, Allocation *aout, const void *usr, uint32_t usrLen,
+                const RsScriptCall *sc, uint32_t cells);
+    void computeSums();
+
+    static void kernelTile(const RsForEachStubParamStruct *p,
+                           uint32_t xstart, uint32_t xend,
+                           uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicConvolveQ8::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    switch (slot) {
+    case 2:
+        mIn.set(static_cast<Allocation *>(data));
+        break;
+    case 3:
+        mFilter.set(static_cast<Allocation *>(data));
+        break;
+    case 4:
+        mBias.set(static_cast<Allocation *>(data));
+        break;
+    default:
+        rsAssert(0);
+        break;
+    }
+}
+
+void RsdCpuScriptIntrinsicConvolveQ8::setGlobalVar(uint32_t slot, const void *data,
+                                                   size_t dataLength) {
+    switch (slot) {
+    case 0:
+        memcpy(mQuant, data, rsMin(dataLength, sizeof(mQuant)));
+        break;
+    case 1:
+        memcpy(mGeometry, data, rsMin(dataLength, sizeof(mGeometry)));
+        break;
+    default:
+        rsAssert(0);
+        break;
+    }
+}
+
+// Writes to sums the products, summed over count taps, of the cin input
+// channels under each tap with the weights of chans output channels, up
+// to kCR of them.  The weights of tap t of channel j are at
+// w + j * wChan + tapIdx[t] * wTap.  The sums wrap at 2^32.
+static void DotQ8(uint32_t *sums, const uchar * const *taps, const uint32_t *tapIdx,
+                  uint32_t count, const uchar *w, size_t wTap, size_t wChan,
+                  uint32_t cin, uint32_t chans) {
+    const uchar *wj[4];
+    for (uint32_t j = 0; j < 4; j++) {
+        // Missing channels repeat the first rather than branch.
+        wj[j] = w + ((j < chans) ? j : 0) * wChan;
+        sums[j] = 0;
+    }
+    uint32_t cStart = 0;
+
+#if defined(RS_CONVOLVEQ8_NEON)
+    if (gArchUseSIMD && (cin >= 8)) {
+        uint32x4_t a0 = vdupq_n_u32(0);
+        uint32x4_t a1 = vdupq_n_u32(0);
+        uint32x4_t a2 = vdupq_n_u32(0);
+        uint32x4_t a3 = vdupq_n_u32(0);
+        for (uint32_t t = 0; t < count; t++) {
+            const uchar *in = taps[t];
+            const size_t o = tapIdx[t] * wTap;
+            const uchar *w0 = wj[0] + o;
+            const uchar *w1 = wj[1] + o;
+            const uchar *w2 = wj[2] + o;
+            const uchar *w3 = wj[3] + o;
+            uint32_t c = 0;
+            for (; (c + 16) <= cin; c += 16) {
+                const uint8x16_t v = vld1q_u8(in + c);
+                const uint8x8_t vl = vget_low_u8(v);
+                const uint8x8_t vh = vget_high_u8(v);
+                const uint8x16_t k0 = vld1q_u8(w0 + c);
+                const uint8x16_t k1 = vld1q_u8(w1 + c);
+                const uint8x16_t k2 = vld1q_u8(w2 + c);
+                const uint8x16_t k3 = vld1q_u8(w3 + c);
+                a0 = vpadalq_u16(a0, vmull_u8(vl, vget_low_u8(k0)));
+                a1 = vpadalq_u16(a1, vmull_u8(vl, vget_low_u8(k1)));
+                a2 = vpadalq_u16(a2, vmull_u8(vl, vget_low_u8(k2)));
+                a3 = vpadalq_u16(a3, vmull_u8(vl, vget_low_u8(k3)));
+                a0 = vpadalq_u16(a0, vmull_u8(vh, vget_high_u8(k0)));
+                a1 = vpadalq_u16(a1, vmull_u8(vh, vget_high_u8(k1)));
+                a2 = vpadalq_u16(a2, vmull_u8(vh, vget_high_u8(k2)));
+                a3 = vpadalq_u16(a3, vmull_u8(vh, vget_high_u8(k3)));
+            }
+            for (; (c + 8) <= cin; c += 8) {
+                const uint8x8_t v = vld1_u8(in + c);
+                a0 = vpadalq_u16(a0, vmull_u8(v, vld1_u8(w0 + c)));
+                a1 = vpadalq_u16(a1, vmull_u8(v, vld1_u8(w1 + c)));
+                a2 = vpadalq_u16(a2, vmull_u8(v, vld1_u8(w2 + c)));
+                a3 = vpadalq_u16(a3, vmull_u8(v, vld1_u8(w3 + c)));
+            }
+        }
+        const uint32x4_t acc[4] = {a0, a1, a2, a3};
+        for (uint32_t j = 0; j < 4; j++) {
+            uint32x2_t s = vadd_u32(vget_low_u32(acc[j]), vget_high_u32(acc[j]));
+            s = vpadd_u32(s, s);
+            sums[j] = vget_lane_u32(s, 0);
+        }
+        cStart = cin & ~7;
+    }
+#endif
+
+    if (cStart == cin) {
+        return;
+    }
+    for (uint32_t t = 0; t < count; t++) {
+        const uchar *in = taps[t];
+        const size_t o = tapIdx[t] * wTap;
+        for (uint32_t j = 0; j < 4; j++) {
+            const uchar *wt = wj[j] + o;
+            uint32_t s = 0;
+            for (uint32_t c = cStart; c < cin; c++) {
+                s += in[c] * wt[c];
+            }
+            sums[j] += s;
+        }
+    }
+}
+
+// The sum of the cin inputs under each of count taps.
+static uint32_t SumQ8(const uchar * const *taps, uint32_t count, uint32_t cin) {
+    uint32_t sum = 0;
+    for (uint32_t t = 0; t < count; t++) {
+        const uchar *in = taps[t];
+        uint32_t c = 0;
+#if defined(RS_CONVOLVEQ8_NEON)
+        if (gArchUseSIMD && (cin >= 16)) {
+            uint32x4_t s32 = vdupq_n_u32(0);
+            while ((c + 16) <= cin) {
+                // 128 blocks of 16 is as many as the 16 bit lanes hold.
+                const uint32_t end = c + rsMin((cin - c) & ~15u, 128u * 16);
+                uint16x8_t s16 = vdupq_n_u16(0);
+                for (; c < end; c += 16) {
+                    s16 = vpadalq_u8(s16, vld1q_u8(in + c));
+                }
+                s32 = vpadalq_u16(s32, s16);
+            }
+            uint32x2_t s = vadd_u32(vget_low_u32(s32), vget_high_u32(s32));
+            s = vpadd_u32(s, s);
+            sum += vget_lane_u32(s, 0);
+        }
+#endif
+        for (; c < cin; c++) {
+            sum += in[c];
+        }
+    }
+    return sum;
+}
+
+// acc * multiplier / 2^31, rounded, then divided by 2^shift, rounding
+// halves away from zero, as gemmlowp does.
+static inline int32_t Requantize(int32_t acc, int32_t multiplier, int32_t shift) {
+    const int32_t kMin = (int32_t)0x80000000;
+    int32_t v;
+    if ((acc == kMin) && (multiplier == kMin)) {
+        v = 0x7fffffff;
+    } else {
+        const int64_t ab = (int64_t)acc * multiplier;
+        const int64_t nudge = (ab >= 0) ? (1 << 30) : (1 - (1 << 30));
+        v = (int32_t)((ab + nudge) / (1ll << 31));
+    }
+    if (shift > 0) {
+        const int32_t mask = (1 << shift) - 1;
+        const int32_t threshold = (mask >> 1) + (v < 0);
+        v = (v >> shift) + ((v & mask) > threshold);
+    }
+    return v;
+}
+
+void RsdCpuScriptIntrinsicConvolveQ8::computeSums() {
+    const uint32_t taps = mKW * mKH;
+    for (uint32_t co = 0; co < mCout; co++) {
+        uint32_t *s = mSums + co * (taps + 1);
+        uint32_t all = 0;
+        for (uint32_t t = 0; t < taps; t++) {
+            const uchar *w = mFilterPtr + ((size_t)co * taps + t) * mFilterStride;
+            uint32_t sum = 0;
+            for (uint32_t c = 0; c < mCin; c++) {
+                sum += w[c];
+            }
+            s[t] = sum;
+            all += sum;
+        }
+        s[taps] = all;
+    }
+}
+
+void RsdCpuScriptIntrinsicConvolveQ8::kernelTile(const RsForEachStubParamStruct *p,
+                                                 uint32_t xstart, uint32_t xend,
+                                                 uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicConvolveQ8 *cp = (RsdCpuScriptIntrinsicConvolveQ8 *)p->usr;
+    const uint32_t oy = p->y / cp->mTilesC;
+    const uint32_t c0 = (p->y % cp->mTilesC) * cp->mCC;
+    const uint32_t c1 = rsMin(c0 + cp->mCC, cp->mCout);
+
+    const int32_t zi = cp->mQuant[0];
+    const int32_t zw = cp->mQuant[1];
+    const int32_t zo = cp->mQuant[2];
+    const int32_t multiplier = cp->mQuant[3];
+    const int32_t shift = cp->mQuant[4];
+    const int32_t sx = cp->mGeometry[0];
+    const int32_t sy = cp->mGeometry[1];
+    const int32_t px = cp->mGeometry[2];
+    const int32_t py = cp->mGeometry[3];
+
+    const uint32_t kw = cp->mKW;
+    const uint32_t kh = cp->mKH;
+    const uint32_t taps = kw * kh;
+    const uint32_t cin = cp->mCin;
+    const size_t wTap = cp->mFilterStride;
+    const size_t wChan = taps * wTap;
+    const size_t outCell = cp->mOutI32 ? sizeof(int32_t) : sizeof(uchar);
+
+    const int32_t iy0 = (int32_t)oy * sy - py;
+    const uint32_t ky0 = (uint32_t)rsMax(-iy0, 0);
+    const uint32_t ky1 = (uint32_t)rsMin((int32_t)cp->mInH - iy0, (int32_t)kh);
+    uchar *outRow = cp->mOutPtr + (size_t)oy * cp->mOutW * cp->mOutStride;
+
+    const uchar *tapPtr[kMaxTaps];
+    uint32_t tapIdx[kMaxTaps];
+
+    for (uint32_t c = c0; c < c1; c += kCR) {
+        const uint32_t chans = rsMin(c1 - c, kCR);
+        const uchar *w = cp->mFilterPtr + c * wChan;
+
+        for (uint32_t ox = 0; ox < cp->mOutW; ox++) {
+            const int32_t ix0 = (int32_t)ox * sx - px;
+            const uint32_t kx0 = (uint32_t)rsMax(-ix0, 0);
+            const uint32_t kx1 = (uint32_t)rsMin((int32_t)cp->mInW - ix0, (int32_t)kw);
+            uint32_t count = 0;
+            for (uint32_t ky = ky0; ky < ky1; ky++) {
+                const uchar *row = cp->mInPtr + ((size_t)(iy0 + (int32_t)ky) * cp->mInW +
+                                                 (ix0 + (int32_t)kx0)) * cp->mInStride;
+                for (uint32_t kx = kx0; kx < kx1; kx++) {
+                    tapPtr[count] = row;
+                    tapIdx[count] = ky * kw + kx;
+                    row += cp->mInStride;
+                    count++;
+                }
+            }
+
+            uint32_t sums[kCR];
+            DotQ8(sums, tapPtr, tapIdx, count, w, wTap, wChan, cin, chans);
+            const uint32_t inSum = zw ? SumQ8(tapPtr, count, cin) : 0;
+            // Padding is the input offset, which contributes nothing.
+            const uint32_t n = count * cin;
+
+            uchar *out = outRow + ox * cp->mOutStride + c * outCell;
+            for (uint32_t j = 0; j < chans; j++) {
+                uint32_t wSum = 0;
+                if (zi) {
+                    const uint32_t *s = cp->mSums + (c + j) * (taps + 1);
+                    if (count == taps) {
+                        wSum = s[taps];
+                    } else {
+                        for (uint32_t t = 0; t < count; t++) {
+                            wSum += s[tapIdx[t]];
+                        }
+                    }
+                }
+                // The sum of (in - zi) * (w - zw), wrapping.
+                uint32_t acc = sums[j] - (uint32_t)zw * inSum - (uint32_t)zi * wSum +
+                               n * (uint32_t)(zi * zw);
+                if (cp->mBiasPtr) {
+                    acc += (uint32_t)cp->mBiasPtr[c + j];
+                }
+                if (cp->mOutI32) {
+                    ((int32_t *)out)[j] = (int32_t)acc;
+                } else {
+                    const int32_t v = zo + Requantize((int32_t)acc, multiplier, shift);
+                    out[j] = (uchar)rsMin(rsMax(v, 0), 255);
+                }
+            }
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicConvolveQ8::launch(uint32_t slot, Allocation *aout, const void *usr,
+                                             uint32_t usrLen, const RsScriptCall *sc,
+                                             uint32_t cells) {
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(NULL, aout, usr, usrLen, sc, &mtls);
+    mtls.script = this;
+    mtls.fep.slot = slot;
+    mtls.kernel = (void (*)())&kernelTile;
+    mtls.fep.usr = this;
+
+    // One cell per tile.
+    mtls.mTileBytes = 0;
+    mtls.fep.dimX = 1;
+    mtls.fep.dimY = cells;
+    mtls.xStart = 0;
+    mtls.xEnd = 1;
+    mtls.yStart = 0;
+    mtls.yEnd = cells;
+
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    mCtx->launchThreads(NULL, aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+}
+
+void RsdCpuScriptIntrinsicConvolveQ8::invokeForEach(uint32_t slot,
+                                                    const Allocation * ain,
+                                                    Allocation * aout,
+                                                    const void * usr,
+                                                    uint32_t usrLen,
+                                                    const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    Context *rsc = mCtx->getContext();
+    const Allocation *in = mIn.get();
+    const Allocation *f = mFilter.get();
+    const Allocation *bias = mBias.get();
+    if (!in || !f || !aout || !in->mHal.drvState.lod[0].mallocPtr ||
+        !f->mHal.drvState.lod[0].mallocPtr || !aout->mHal.drvState.lod[0].mallocPtr) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "ConvolveQ8 called without input, filter or output");
+        return;
+    }
+    if ((in->mHal.state.elementSizeBytes != 1) || (f->mHal.state.elementSizeBytes != 1) ||
+        in->hasTiles() || f->hasTiles() || aout->hasTiles()) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "ConvolveQ8 input and filter must be untiled U8");
+        return;
+    }
+
+    mCin = in->mHal.drvState.lod[0].dimX;
+    mInW = rsMax(in->mHal.drvState.lod[0].dimY, 1u);
+    mInH = rsMax(in->mHal.drvState.lod[0].dimZ, 1u);
+    mCout = aout->mHal.drvState.lod[0].dimX;
+    mKW = rsMax(f->mHal.drvState.lod[0].dimY, 1u);
+    const uint32_t fz = rsMax(f->mHal.drvState.lod[0].dimZ, 1u);
+    mKH = mCout ? fz / mCout : 0;
+    const int32_t sx = mGeometry[0];
+    const int32_t sy = mGeometry[1];
+    const int32_t px = mGeometry[2];
+    const int32_t py = mGeometry[3];
+    const int32_t spanX = (int32_t)mInW + 2 * px - (int32_t)mKW;
+    const int32_t spanY = (int32_t)mInH + 2 * py - (int32_t)mKH;
+    if ((sx < 1) || (sy < 1) || (px < 0) || (py < 0) || (px >= (int32_t)mKW) ||
+        (py >= (int32_t)mKH) || (spanX < 0) || (spanY < 0)) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "ConvolveQ8 stride or padding is invalid");
+        return;
+    }
+    mOutW = spanX / sx + 1;
+    const uint32_t outH = spanY / sy + 1;
+    mOutI32 = aout->mHal.state.elementSizeBytes == sizeof(int32_t);
+    if (!mCout || !mKH || (mKH * mCout != fz) || (mKW * mKH > kMaxTaps) ||
+        (f->mHal.drvState.lod[0].dimX != mCin) ||
+        (rsMax(aout->mHal.drvState.lod[0].dimY, 1u) != mOutW) ||
+        (rsMax(aout->mHal.drvState.lod[0].dimZ, 1u) != outH) ||
+        (!mOutI32 && (aout->mHal.state.elementSizeBytes != 1))) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "ConvolveQ8 input, filter and output sizes do not match");
+        return;
+    }
+    if (bias && ((bias->mHal.state.elementSizeBytes != sizeof(int32_t)) ||
+                 (bias->mHal.drvState.lod[0].dimX < mCout) ||
+                 !bias->mHal.drvState.lod[0].mallocPtr)) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "ConvolveQ8 bias must be I32, one per output channel");
+        return;
+    }
+
+    mInPtr = (const uchar *)in->mHal.drvState.lod[0].mallocPtr;
+    mInStride = in->mHal.drvState.lod[0].stride;
+    mFilterPtr = (const uchar *)f->mHal.drvState.lod[0].mallocPtr;
+    mFilterStride = f->mHal.drvState.lod[0].stride;
+    mBiasPtr = bias ? (const int32_t *)bias->mHal.drvState.lod[0].mallocPtr : NULL;
+    mOutPtr = (uchar *)aout->mHal.drvState.lod[0].mallocPtr;
+    mOutStride = aout->mHal.drvState.lod[0].stride;
+
+    if (mQuant[0]) {
+        const size_t count = (size_t)mCout * (mKW * mKH + 1);
+        if (count > mSumsSize) {
+            uint32_t *sums = (uint32_t *)realloc(mSums, count * sizeof(uint32_t));
+            if (!sums) {
+                rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Out of memory for ConvolveQ8");
+                return;
+            }
+            mSums = sums;
+            mSumsSize = count;
+        }
+        computeSums();
+    }
+
+    // Halve the channel blocks until every thread has a few tiles.
+    mCC = kCC;
+    const uint32_t want = mCtx->getThreadCount() * 2;
+    while ((outH * ((mCout + mCC - 1) / mCC) < want) && (mCC > kCR)) {
+        mCC >>= 1;
+    }
+    mTilesC = (mCout + mCC - 1) / mCC;
+
+    launch(slot, aout, usr, usrLen, sc, outH * mTilesC);
+}
+
+RsdCpuScriptIntrinsicConvolveQ8::RsdCpuScriptIntrinsicConvolveQ8(RsdCpuReferenceImpl *ctx,
+                                                                 const Script *s,
+                                                                 const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_CONVOLVE_Q8) {
+
+    mRootPtr = &kernelTile;
+    mQuant[0] = 0;
+    mQuant[1] = 0;
+    mQuant[2] = 0;
+    // Almost exactly 1.
+    mQuant[3] = 0x7fffffff;
+    mQuant[4] = 0;
+    mGeometry[0] = 1;
+    mGeometry[1] = 1;
+    mGeometry[2] = 0;
+    mGeometry[3] = 0;
+
+    mCin = 0;
+    mInW = 0;
+    mInH = 0;
+    mInStride = 0;
+    mInPtr = NULL;
+    mCout = 0;
+    mOutW = 0;
+    mKW = 0;
+    mKH = 0;
+    mFilterStride = 0;
+    mFilterPtr = NULL;
+    mBiasPtr = NULL;
+    mOutPtr = NULL;
+    mOutStride = 0;
+    mOutI32 = false;
+    mTilesC = 1;
+    mCC = kCC;
+    mSums = NULL;
+    mSumsSize = 0;
+}
+
+RsdCpuScriptIntrinsicConvolveQ8::~RsdCpuScriptIntrinsicConvolveQ8() {
+    free(mSums);
+}
+
+void RsdCpuScriptIntrinsicConvolveQ8::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 5;
+}
+
+void RsdCpuScriptIntrinsicConvolveQ8::invokeFreeChildren() {
+    mIn.clear();
+    mFilter.clear();
+    mBias.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_ConvolveQ8(RsdCpuReferenceImpl *ctx,
+                                           const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicConvolveQ8(ctx, s, e);
+}
@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+#if defined(ARCH_ARM_USE_INTRINSICS) && defined(__ARM_NEON)
+#define RS_DEMOSAIC_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Interpolates a Bayer mosaic, U8 or U16 with bits significant bits, into
+// RGBA.  Each output cell is the pixel at the same position of the input,
+// which is read with its edges reflected so the CFA phase is kept.
+class RsdCpuScriptIntrinsicDemosaic : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return (fieldSlot == 1) ? 2 : -1;
+    }
+
+    virtual ~RsdCpuScriptIntrinsicDemosaic();
+    RsdCpuScriptIntrinsicDemosaic(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    ObjectBaseRef<const Allocation> mAlloc;
+    // Pattern, interpolation and bit depth, 0 being every bit of the input.
+    int32_t mParams[3];
+    bool mFloatOut;
+
+    template <typename T>
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicDemosaic::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 1);
+    const Allocation *a = static_cast<Allocation *>(data);
+    mAlloc.set(a);
+    if (a && (a->getType()->getElement()->getType() == RS_TYPE_UNSIGNED_8)) {
+        mRootPtr = &kernel<uchar>;
+    } else {
+        mRootPtr = &kernel<ushort>;
+    }
+}
+
+void RsdCpuScriptIntrinsicDemosaic::setGlobalVar(uint32_t slot, const void *data,
+                                                 size_t dataLength) {
+    rsAssert(slot == 0);
+    memcpy(mParams, data, rsMin(dataLength, sizeof(mParams)));
+}
+
+// Sites of the 2x2 quad: the low bit is the column, the high one the row,
+// with the red pixel at 0.
+enum {
+    kSiteRed = 0,
+    kSiteGreenRedRow = 1,
+    kSiteGreenBlueRow = 2,
+    kSiteBlue = 3
+};
+
+// Where the red pixel of each RsScriptIntrinsicDemosaicPattern sits in the
+// quad, as a site offset.
+static const uint32_t gRedSite[4] = { 0, 3, 1, 2 };
+
+// Cells processed between conversions to the output element.
+static const uint32_t kChunk = 64;
+
+static inline int32_t reflectCFA(int32_t v, int32_t dim) {
+    if (v < 0) {
+        v = -v;
+    }
+    if (v >= dim) {
+        v = 2 * (dim - 1) - v;
+    }
+    return rsMin(rsMax(v, 0), dim - 1);
+}
+
+static inline int32_t avg2(int32_t a, int32_t b) {
+    return (a + b + 1) >> 1;
+}
+
+// Matches the halving adds the NEON path makes.
+static inline int32_t avg4(int32_t a, int32_t b, int32_t c, int32_t d) {
+    return (((a + b) >> 1) + ((c + d) >> 1) + 1) >> 1;
+}
+
+static inline int32_t clampCFA(int32_t v, int32_t shift, int32_t max) {
+    return rsMin(rsMax(v, 0) >> shift, max);
+}
+
+// rows are the input rows y - 2 to y + 2 and cx the columns x - 2 to
+// x + 2, both reflected at the edges.
+#define P(dy, dx) ((int32_t)rows[2 + (dy)][cx[2 + (dx)]])
+
+template <typename T>
+static inline void bilinearPixel(const T * const *rows, const int32_t *cx, uint32_t site,
+                                 int32_t *rgb) {
+    const int32_t c = P(0, 0);
+    switch (site) {
+    case kSiteRed:
+        rgb[0] = c;
+        rgb[1] = avg4(P(0, -1), P(0, 1), P(-1, 0), P(1, 0));
+        rgb[2] = avg4(P(-1, -1), P(-1, 1), P(1, -1), P(1, 1));
+        break;
+    case kSiteGreenRedRow:
+        rgb[0] = avg2(P(0, -1), P(0, 1));
+        rgb[1] = c;
+        rgb[2] = avg2(P(-1, 0), P(1, 0));
+        break;
+    case kSiteGreenBlueRow:
+        rgb[0] = avg2(P(-1, 0), P(1, 0));
+        rgb[1] = c;
+        rgb[2] = avg2(P(0, -1), P(0, 1));
+        break;
+    default:
+        rgb[0] = avg4(P(-1, -1), P(-1, 1), P(1, -1), P(1, 1));
+        rgb[1] = avg4(P(0, -1), P(0, 1), P(-1, 0), P(1, 0));
+        rgb[2] = c;
+        break;
+    }
+}
+
+// Green is interpolated along the direction with the smaller gradient,
+// Hamilton-Adams style, and red and blue with the gradient corrected
+// filters of Malvar, He and Cutler.  Sums are kept at 16 times scale.
+template <typename T>
+static inline void edgeAwarePixel(const T * const *rows, const int32_t *cx, uint32_t site,
+                                  int32_t max, int32_t *rgb) {
+    const int32_t c = P(0, 0);
+    const int32_t h1 = P(0, -1) + P(0, 1);
+    const int32_t v1 = P(-1, 0) + P(1, 0);
+    const int32_t h2 = P(0, -2) + P(0, 2);
+    const int32_t v2 = P(-2, 0) + P(2, 0);
+    const int32_t diag = P(-1, -1) + P(-1, 1) + P(1, -1) + P(1, 1);
+
+    if ((site == kSiteRed) || (site == kSiteBlue)) {
+        const int32_t lh = 2 * c - h2;
+        const int32_t lv = 2 * c - v2;
+        const int32_t dh = abs(P(0, -1) - P(0, 1)) + abs(lh);
+        const int32_t dv = abs(P(-1, 0) - P(1, 0)) + abs(lv);
+        int32_t g;
+        if (dh < dv) {
+            g = 8 * h1 + 4 * lh;
+        } else if (dv < dh) {
+            g = 8 * v1 + 4 * lv;
+        } else {
+            g = 4 * (h1 + v1) + 2 * (lh + lv);
+        }
+        const int32_t other = 12 * c + 4 * diag - 3 * (h2 + v2);
+        rgb[0] = (site == kSiteRed) ? c : clampCFA(other + 8, 4, max);
+        rgb[1] = clampCFA(g + 8, 4, max);
+        rgb[2] = (site == kSiteRed) ? clampCFA(other + 8, 4, max) : c;
+        return;
+    }
+
+    const int32_t horiz = clampCFA(10 * c + 8 * h1 - 2 * h2 - 2 * diag + v2 + 8, 4, max);
+    const int32_t vert = clampCFA(10 * c + 8 * v1 - 2 * v2 - 2 * diag + h2 + 8, 4, max);
+    rgb[0] = (site == kSiteGreenRedRow) ? horiz : vert;
+    rgb[1] = c;
+    rgb[2] = (site == kSiteGreenRedRow) ? vert : horiz;
+}
+
+#undef P
+
+static void storeChunk(bool floatOut, const int32_t (*rgb)[3], uint32_t n,
+                       uint32_t bits, uint8_t *out) {
+    if (floatOut) {
+        const float scale = 1.f / (float)((1u << bits) - 1);
+        float4 *o = (float4 *)out;
+        for (uint32_t i = 0; i < n; i++) {
+            o[i].x = rsMin(rgb[i][0] * scale, 1.f);
+            o[i].y = rsMin(rgb[i][1] * scale, 1.f);
+            o[i].z = rsMin(rgb[i][2] * scale, 1.f);
+            o[i].w = 1.f;
+        }
+        return;
+    }
+    const uint32_t shift = bits - 8;
+    uchar4 *o = (uchar4 *)out;
+    for (uint32_t i = 0; i < n; i++) {
+        o[i].x = (uchar)rsMin(rgb[i][0] >> shift, 255);
+        o[i].y = (uchar)rsMin(rgb[i][1] >> shift, 255);
+        o[i].z = (uchar)rsMin(rgb[i][2] >> shift, 255);
+        o[i].w = 255;
+    }
+}
+
+#if defined(RS_DEMOSAIC_NEON)
+static inline uint16x8_t avg4N(uint16x8_t a, uint16x8_t b, uint16x8_t c, uint16x8_t d) {
+    return vrhaddq_u16(vhaddq_u16(a, b), vhaddq_u16(c, d));
+}
+
+// One lane of eight pixels of the same site: c the centres, h and v
+// their horizontal and vertical neighbours and d the diagonal ones.
+static inline void bilinearSiteN(uint32_t site, uint16x8_t c, uint16x8_t h0, uint16x8_t h1,
+                                 uint16x8_t v0, uint16x8_t v1, uint16x8_t d0, uint16x8_t d1,
+                                 uint16x8_t d2, uint16x8_t d3, uint16x8_t *rgb) {
+    switch (site) {
+    case kSiteRed:
+        rgb[0] = c;
+        rgb[1] = avg4N(h0, h1, v0, v1);
+        rgb[2] = avg4N(d0, d1, d2, d3);
+        break;
+    case kSiteGreenRedRow:
+        rgb[0] = vrhaddq_u16(h0, h1);
+        rgb[1] = c;
+        rgb[2] = vrhaddq_u16(v0, v1);
+        break;
+    case kSiteGreenBlueRow:
+        rgb[0] = vrhaddq_u16(v0, v1);
+        rgb[1] = c;
+        rgb[2] = vrhaddq_u16(h0, h1);
+        break;
+    default:
+        rgb[0] = avg4N(d0, d1, d2, d3);
+        rgb[1] = avg4N(h0, h1, v0, v1);
+        rgb[2] = c;
+        break;
+    }
+}
+
+// Bilinear RGBA_8888 of the 16 pixels from x, taken as eight 2 pixel
+// halves of quads, x being of site and x + 1 of the other site in its
+// row.  Columns x - 2 to x + 17 of the rows have to exist.
+static void bilinear16N(const ushort * const *rows, uint32_t x, uint32_t site,
+                        int16x8_t shift, uchar *out) {
+    const uint16x8x2_t u = vld2q_u16(rows[1] + x);
+    const uint16x8x2_t ul = vld2q_u16(rows[1] + x - 2);
+    const uint16x8x2_t ur = vld2q_u16(rows[1] + x + 2);
+    const uint16x8x2_t c = vld2q_u16(rows[2] + x);
+    const uint16x8x2_t cl = vld2q_u16(rows[2] + x - 2);
+    const uint16x8x2_t cr = vld2q_u16(rows[2] + x + 2);
+    const uint16x8x2_t d = vld2q_u16(rows[3] + x);
+    const uint16x8x2_t dl = vld2q_u16(rows[3] + x - 2);
+    const uint16x8x2_t dr = vld2q_u16(rows[3] + x + 2);
+
+    uint16x8_t even[3];
+    uint16x8_t odd[3];
+    bilinearSiteN(site, c.val[0], cl.val[1], c.val[1], u.val[0], d.val[0],
+                  ul.val[1], u.val[1], dl.val[1], d.val[1], even);
+    bilinearSiteN(site ^ 1, c.val[1], c.val[0], cr.val[0], u.val[1], d.val[1],
+                  u.val[0], ur.val[0], d.val[0], dr.val[0], odd);
+
+    uint8x16x4_t o;
+    for (uint32_t ch = 0; ch < 3; ch++) {
+        const uint8x8x2_t z = vzip_u8(vqmovn_u16(vshlq_u16(even[ch], shift)),
+                                      vqmovn_u16(vshlq_u16(odd[ch], shift)));
+        o.val[ch] = vcombine_u8(z.val[0], z.val[1]);
+    }
+    o.val[3] = vdupq_n_u8(255);
+    vst4q_u8(out, o);
+}
+#endif
+
+template <typename T>
+void RsdCpuScriptIntrinsicDemosaic::kernel(const RsForEachStubParamStruct *p,
+                                           uint32_t xstart, uint32_t xend,
+                                           uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicDemosaic *cp = (RsdCpuScriptIntrinsicDemosaic *)p->usr;
+    if (!cp->mAlloc.get()) {
+        ALOGE("Demosaic executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
+
+    const int32_t dimX = p->dimX;
+    const int32_t dimY = p->dimY;
+    const T *rows[5];
+    for (int32_t r = 0; r < 5; r++) {
+        rows[r] = (const T *)(pin + stride * reflectCFA((int32_t)p->y + r - 2, dimY));
+    }
+    if (p->prefetchRows) {
+        prefetchInputRow(p, pin, stride, p->y + 2 + p->prefetchRows,
+                         rsMax((int32_t)xstart - 2, 0) * sizeof(T),
+                         rsMin((int32_t)xend + 2, dimX) * sizeof(T));
+    }
+
+    const uint32_t typeBits = sizeof(T) * 8;
+    const uint32_t bits = ((cp->mParams[2] >= 8) && ((uint32_t)cp->mParams[2] < typeBits)) ?
+                          cp->mParams[2] : typeBits;
+    const int32_t max = (int32_t)((1u << bits) - 1);
+    const bool edgeAware = (cp->mParams[1] == RS_DEMOSAIC_EDGE_AWARE);
+    const uint32_t redSite = gRedSite[cp->mParams[0] & 3];
+    const uint32_t rowSite = ((p->y & 1) << 1) ^ redSite;
+    const size_t cellBytes = cp->mFloatOut ? sizeof(float4) : sizeof(uchar4);
+
+    uint8_t *out = p->out;
+    uint32_t x = xstart;
+    // The NEON path covers the plain bilinear 16 bit to RGBA_8888 case,
+    // in blocks of 16 from the third column to the second last but one.
+    uint32_t nx1 = xend;
+    uint32_t nx2 = xend;
+#if defined(RS_DEMOSAIC_NEON)
+    if (gArchUseSIMD && (sizeof(T) == 2) && !edgeAware && !cp->mFloatOut && (dimX >= 20)) {
+        nx1 = rsMin(rsMax(xstart, 2u), xend);
+        nx2 = rsMax(rsMin(xend, (uint32_t)dimX - 2), nx1);
+        nx2 = nx1 + ((nx2 - nx1) & ~15u);
+    }
+#endif
+
+    int32_t rgb[kChunk][3];
+    while (x < xend) {
+#if defined(RS_DEMOSAIC_NEON)
+        if ((x >= nx1) && (x < nx2)) {
+            const int16x8_t shift = vdupq_n_s16(8 - (int16_t)bits);
+            for (; x < nx2; x += 16) {
+                bilinear16N((const ushort * const *)rows, x, rowSite ^ (x & 1), shift, out);
+                out += 16 * sizeof(uchar4);
+            }
+            continue;
+        }
+#endif
+        const uint32_t end = (x < nx1) ? nx1 : xend;
+        const uint32_t n = rsMin(end - x, kChunk);
+        for (uint32_t i = 0; i < n; i++) {
+            const int32_t xx = x + i;
+            int32_t cx[5];
+            for (int32_t d = 0; d < 5; d++) {
+                cx[d] = reflectCFA(xx + d - 2, dimX);
+            }
+            const uint32_t site = rowSite ^ (xx & 1);
+            if (edgeAware) {
+                edgeAwarePixel(rows, cx, site, max, rgb[i]);
+            } else {
+                bilinearPixel(rows, cx, site, rgb[i]);
+            }
+        }
+        storeChunk(cp->mFloatOut, rgb, n, bits, out);
+        out += n * cellBytes;
+        x += n;
+    }
+}
+
+RsdCpuScriptIntrinsicDemosaic::RsdCpuScriptIntrinsicDemosaic(RsdCpuReferenceImpl *ctx,
+                                                             const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_DEMOSAIC) {
+
+    mParams[0] = RS_DEMOSAIC_RGGB;
+    mParams[1] = RS_DEMOSAIC_BILINEAR;
+    mParams[2] = 0;
+    mFloatOut = (e->getType() == RS_TYPE_FLOAT_32);
+    mRootPtr = &kernel<ushort>;
+}
+
+RsdCpuScriptIntrinsicDemosaic::~RsdCpuScriptIntrinsicDemosaic() {
+}
+
+void RsdCpuScriptIntrinsicDemosaic::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 2;
+}
+
+void RsdCpuScriptIntrinsicDemosaic::invokeFreeChildren() {
+    mAlloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Demosaic(RsdCpuReferenceImpl *ctx,
+                                         const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicDemosaic(ctx, s, e);
+}
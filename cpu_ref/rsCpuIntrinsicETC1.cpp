@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Encodes an RGBA image as ETC1.  The launch runs over the compressed
+// allocation, one cell per 4x4 block of the input, which is read with its
+// edges repeated when its size isn't a multiple of 4.  Alpha is dropped.
+class RsdCpuScriptIntrinsicETC1 : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual ~RsdCpuScriptIntrinsicETC1();
+    RsdCpuScriptIntrinsicETC1(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    ObjectBaseRef<const Allocation> mAlloc;
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicETC1::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    mAlloc.set(static_cast<Allocation *>(data));
+}
+
+// Intensity modifiers for pixel indices 0 to 3 of each table.
+static const int gETC1Modifiers[8][4] = {
+    {  2,   8,  -2,   -8 },
+    {  5,  17,  -5,  -17 },
+    {  9,  29,  -9,  -29 },
+    { 13,  42, -13,  -42 },
+    { 18,  60, -18,  -60 },
+    { 24,  80, -24,  -80 },
+    { 33, 106, -33, -106 },
+    { 47, 183, -47, -183 }
+};
+
+struct ETC1SubBlock {
+    int base[3];
+    uint32_t table;
+    uint32_t indices[8];
+    uint32_t error;
+};
+
+static inline int clamp255(int v) {
+    return rsMin(rsMax(v, 0), 255);
+}
+
+// Picks the table and per pixel modifiers for a sub-block of 8 pixels
+// around the already quantized base colour.
+static void fitSubBlock(const uchar4 *px, ETC1SubBlock *sb) {
+    sb->error = ~0u;
+    for (uint32_t t = 0; t < 8; t++) {
+        uint32_t error = 0;
+        uint32_t indices[8];
+        for (uint32_t i = 0; i < 8; i++) {
+            uint32_t best = ~0u;
+            for (uint32_t m = 0; m < 4; m++) {
+                const int mod = gETC1Modifiers[t][m];
+                const int dr = clamp255(sb->base[0] + mod) - px[i].x;
+                const int dg = clamp255(sb->base[1] + mod) - px[i].y;
+                const int db = clamp255(sb->base[2] + mod) - px[i].z;
+                const uint32_t e = dr * dr + dg * dg + db * db;
+                if (e < best) {
+                    best = e;
+                    indices[i] = m;
+                }
+            }
+            error += best;
+            if (error >= sb->error) {
+                break;
+            }
+        }
+        if (error < sb->error) {
+            sb->error = error;
+            sb->table = t;
+            memcpy(sb->indices, indices, sizeof(indices));
+        }
+    }
+}
+
+// Pixels of each half of the block in the order fitSubBlock sees them,
+// and their positions in the index bits, x * 4 + y.
+static void splitBlock(const uchar4 *block, bool flip, uchar4 *halves, uint32_t *positions) {
+    uint32_t n[2] = { 0, 0 };
+    for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++) {
+            const uint32_t h = flip ? (y >> 1) : (x >> 1);
+            halves[h * 8 + n[h]] = block[y * 4 + x];
+            positions[h * 8 + n[h]] = x * 4 + y;
+            n[h]++;
+        }
+    }
+}
+
+static void averageColor(const uchar4 *px, int *avg) {
+    int sum[3] = { 0, 0, 0 };
+    for (uint32_t i = 0; i < 8; i++) {
+        sum[0] += px[i].x;
+        sum[1] += px[i].y;
+        sum[2] += px[i].z;
+    }
+    for (uint32_t c = 0; c < 3; c++) {
+        avg[c] = (sum[c] + 4) >> 3;
+    }
+}
+
+// Tries both the individual and differential base colours for one split
+// of the block, returning the error and filling in the block bits.
+static uint32_t encodeSplit(const uchar4 *block, bool flip, uint64_t *bits) {
+    uchar4 halves[16];
+    uint32_t positions[16];
+    splitBlock(block, flip, halves, positions);
+    int avg[2][3];
+    averageColor(halves, avg[0]);
+    averageColor(halves + 8, avg[1]);
+
+    uint32_t bestError = ~0u;
+    for (uint32_t diff = 0; diff < 2; diff++) {
+        ETC1SubBlock sb[2];
+        int q[2][3];
+        bool fits = true;
+        for (uint32_t h = 0; h < 2; h++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                if (diff) {
+                    q[h][c] = (avg[h][c] * 31 + 127) / 255;
+                    sb[h].base[c] = (q[h][c] << 3) | (q[h][c] >> 2);
+                } else {
+                    q[h][c] = (avg[h][c] * 15 + 127) / 255;
+                    sb[h].base[c] = (q[h][c] << 4) | q[h][c];
+                }
+            }
+        }
+        if (diff) {
+            for (uint32_t c = 0; c < 3; c++) {
+                const int d = q[1][c] - q[0][c];
+                fits = fits && (d >= -4) && (d <= 3);
+            }
+        }
+        if (!fits) {
+            continue;
+        }
+        fitSubBlock(halves, &sb[0]);
+        fitSubBlock(halves + 8, &sb[1]);
+        const uint32_t error = sb[0].error + sb[1].error;
+        if (error >= bestError) {
+            continue;
+        }
+        bestError = error;
+
+        uint64_t b = 0;
+        for (uint32_t c = 0; c < 3; c++) {
+            const uint32_t shift = 56 - c * 8;
+            if (diff) {
+                b |= (uint64_t)q[0][c] << (shift + 3);
+                b |= (uint64_t)((q[1][c] - q[0][c]) & 7) << shift;
+            } else {
+                b |= (uint64_t)q[0][c] << (shift + 4);
+                b |= (uint64_t)q[1][c] << shift;
+            }
+        }
+        b |= (uint64_t)sb[0].table << 37;
+        b |= (uint64_t)sb[1].table << 34;
+        b |= (uint64_t)diff << 33;
+        b |= (uint64_t)flip << 32;
+        for (uint32_t i = 0; i < 16; i++) {
+            const uint32_t idx = sb[i >> 3].indices[i & 7];
+            b |= (uint64_t)(idx >> 1) << (positions[i] + 16);
+            b |= (uint64_t)(idx & 1) << positions[i];
+        }
+        *bits = b;
+    }
+    return bestError;
+}
+
+void RsdCpuScriptIntrinsicETC1::kernel(const RsForEachStubParamStruct *p,
+                                       uint32_t xstart, uint32_t xend,
+                                       uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicETC1 *cp = (RsdCpuScriptIntrinsicETC1 *)p->usr;
+    const Allocation *in = cp->mAlloc.get();
+    if (!in) {
+        ALOGE("ETC1 encode executed without input, skipping");
+        return;
+    }
+    const uchar *pin = (const uchar *)in->mHal.drvState.lod[0].mallocPtr;
+    const size_t stride = in->mHal.drvState.lod[0].stride;
+    const uint32_t inDimX = in->mHal.drvState.lod[0].dimX;
+    const uint32_t inDimY = rsMax(in->mHal.drvState.lod[0].dimY, 1u);
+
+    const uchar4 *rows[4];
+    for (uint32_t y = 0; y < 4; y++) {
+        rows[y] = (const uchar4 *)(pin + stride * rsMin(p->y * 4 + y, inDimY - 1));
+    }
+
+    uchar *out = (uchar *)p->out;
+    for (uint32_t x = xstart; x < xend; x++) {
+        uchar4 block[16];
+        for (uint32_t y = 0; y < 4; y++) {
+            for (uint32_t bx = 0; bx < 4; bx++) {
+                block[y * 4 + bx] = rows[y][rsMin(x * 4 + bx, inDimX - 1)];
+            }
+        }
+
+        uint64_t bits = 0;
+        uint64_t flipped = 0;
+        if (encodeSplit(block, true, &flipped) < encodeSplit(block, false, &bits)) {
+            bits = flipped;
+        }
+        // Blocks are stored most significant byte first.
+        for (uint32_t ct = 0; ct < 8; ct++) {
+            out[ct] = (uchar)(bits >> (56 - ct * 8));
+        }
+        out += outstep;
+    }
+}
+
+RsdCpuScriptIntrinsicETC1::RsdCpuScriptIntrinsicETC1(RsdCpuReferenceImpl *ctx,
+                                                     const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_ETC1_ENCODE) {
+
+    mRootPtr = &kernel;
+}
+
+RsdCpuScriptIntrinsicETC1::~RsdCpuScriptIntrinsicETC1() {
+}
+
+void RsdCpuScriptIntrinsicETC1::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 1;
+}
+
+void RsdCpuScriptIntrinsicETC1::invokeFreeChildren() {
+    mAlloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_ETC1(RsdCpuReferenceImpl *ctx,
+                                     const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicETC1(ctx, s, e);
+}
@@ -0,0 +1,545 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// C = alpha * op(A) * op(B) + beta * C on F32 matrices, or
+// C = (A - aOffset) * (B - bOffset) from U8 matrices into I32, the sums
+// wrapping at 2^32.  Matrices are 2D Allocations, a row of cells per Y.
+//
+// C is cut into tiles run in parallel.  Each tile walks K in blocks,
+// packing the A and B blocks it needs into panels of kMR rows and kNR
+// columns, and a microkernel multiplies a pair of panels into one kMR by
+// kNR block of C.  U8 panels are widened to int16 and interleave pairs
+// of K, and the offsets are applied afterwards from the row sums of A and
+// column sums of B.
+class RsdCpuScriptIntrinsicGemm : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                               const Allocation * ain,
+                               Allocation * aout,
+                               const void * usr,
+                               uint32_t usrLen,
+                               const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicGemm();
+    RsdCpuScriptIntrinsicGemm(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    static const uint32_t kMR = 4;
+    static const uint32_t kNR = 8;
+    // The largest tile and K block.  Tiles shrink until there are enough
+    // of them for every thread.
+    static const uint32_t kMC = 64;
+    static const uint32_t kNC = 128;
+    static const uint32_t kKC = 256;
+
+    ObjectBaseRef<const Allocation> mA;
+    ObjectBaseRef<const Allocation> mB;
+    bool mU8;
+    float mAlpha;
+    float mBeta;
+    bool mTransA;
+    bool mTransB;
+    int32_t mOffsetA;
+    int32_t mOffsetB;
+
+    // The launch being run.
+    uint32_t mM;
+    uint32_t mN;
+    uint32_t mK;
+    uint32_t mKC;
+    uint32_t mMC;
+    uint32_t mNC;
+    uint32_t mTilesN;
+    uchar *mC;
+    size_t mCStride;
+    // With offsets, the corrections for the rows and then the columns.
+    bool mUseSums;
+    int32_t *mSums;
+    size_t mSumsSize;
+    RsdCpuScratch mScratch;
+
+    void launch(uint32_t slot, Allocation *aout, const void *usr, uint32_t usrLen,
+                const RsScriptCall *sc, uint32_t cells);
+
+    template <typename T>
+    const T * cellA(uint32_t i, uint32_t k) const;
+    template <typename T>
+    const T * cellB(uint32_t k, uint32_t j) const;
+    void packF32(float *pa, float *pb, uint32_t i0, uint32_t j0, uint32_t k0,
+                 uint32_t mc, uint32_t nc, uint32_t kc) const;
+    void packU8(int16_t *pa, int16_t *pb, uint32_t i0, uint32_t j0, uint32_t k0,
+                uint32_t mc, uint32_t nc, uint32_t kc) const;
+    void computeSums();
+
+    static void kernelTile(const RsForEachStubParamStruct *p,
+                           uint32_t xstart, uint32_t xend,
+                           uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicGemm::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    switch (slot) {
+    case 3:
+        mA.set(static_cast<Allocation *>(data));
+        break;
+    case 4:
+        mB.set(static_cast<Allocation *>(data));
+        break;
+    default:
+        rsAssert(0);
+        break;
+    }
+}
+
+void RsdCpuScriptIntrinsicGemm::setGlobalVar(uint32_t slot, const void *data,
+                                             size_t dataLength) {
+    switch (slot) {
+    case 0:
+        rsAssert(dataLength == sizeof(float) * 2);
+        mAlpha = ((const float *)data)[0];
+        mBeta = ((const float *)data)[1];
+        break;
+    case 1:
+        rsAssert(dataLength == sizeof(int32_t) * 2);
+        mTransA = ((const int32_t *)data)[0] != 0;
+        mTransB = ((const int32_t *)data)[1] != 0;
+        break;
+    case 2:
+        rsAssert(dataLength == sizeof(int32_t) * 2);
+        mOffsetA = ((const int32_t *)data)[0];
+        mOffsetB = ((const int32_t *)data)[1];
+        break;
+    default:
+        rsAssert(0);
+        break;
+    }
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicGemmF32_K(float *acc, const float *a, const float *b, uint32_t kc);
+extern "C" void rsdIntrinsicGemmU8_K(int32_t *acc, const int16_t *a, const int16_t *b,
+                                     uint32_t kc2);
+#endif
+
+// The microkernels write the kMR by kNR product of a pair of panels to acc,
+// row by row.
+static void GemmF32(float *acc, const float *a, const float *b, uint32_t kc) {
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        rsdIntrinsicGemmF32_K(acc, a, b, kc);
+        return;
+    }
+#endif
+    memset(acc, 0, 4 * 8 * sizeof(float));
+    for (uint32_t k = 0; k < kc; k++) {
+        for (uint32_t i = 0; i < 4; i++) {
+            for (uint32_t j = 0; j < 8; j++) {
+                acc[i * 8 + j] += a[i] * b[j];
+            }
+        }
+        a += 4;
+        b += 8;
+    }
+}
+
+static void GemmU8(int32_t *acc, const int16_t *a, const int16_t *b, uint32_t kc2) {
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        rsdIntrinsicGemmU8_K(acc, a, b, kc2);
+        return;
+    }
+#endif
+    memset(acc, 0, 4 * 8 * sizeof(int32_t));
+    for (uint32_t k = 0; k < kc2; k++) {
+        for (uint32_t i = 0; i < 4; i++) {
+            for (uint32_t j = 0; j < 8; j++) {
+                acc[i * 8 + j] += a[i * 2] * b[j * 2] + a[i * 2 + 1] * b[j * 2 + 1];
+            }
+        }
+        a += 8;
+        b += 16;
+    }
+}
+
+// Element (i, k) of op(A) and (k, j) of op(B).
+template <typename T>
+const T * RsdCpuScriptIntrinsicGemm::cellA(uint32_t i, uint32_t k) const {
+    const Allocation *a = mA.get();
+    if (mTransA) {
+        return (const T *)((const uchar *)a->mHal.drvState.lod[0].mallocPtr +
+                           k * a->mHal.drvState.lod[0].stride) + i;
+    }
+    return (const T *)((const uchar *)a->mHal.drvState.lod[0].mallocPtr +
+                       i * a->mHal.drvState.lod[0].stride) + k;
+}
+
+template <typename T>
+const T * RsdCpuScriptIntrinsicGemm::cellB(uint32_t k, uint32_t j) const {
+    const Allocation *b = mB.get();
+    if (mTransB) {
+        return (const T *)((const uchar *)b->mHal.drvState.lod[0].mallocPtr +
+                           j * b->mHal.drvState.lod[0].stride) + k;
+    }
+    return (const T *)((const uchar *)b->mHal.drvState.lod[0].mallocPtr +
+                       k * b->mHal.drvState.lod[0].stride) + j;
+}
+
+// Packs rows i0 to i0 + mc of the K block into panels of kMR rows, each a
+// column of kMR per k, and columns j0 to j0 + nc into panels of kNR, a row
+// of kNR per k.  Cells past the edges of the matrices are zero.
+void RsdCpuScriptIntrinsicGemm::packF32(float *pa, float *pb, uint32_t i0, uint32_t j0,
+                                        uint32_t k0, uint32_t mc, uint32_t nc,
+                                        uint32_t kc) const {
+    for (uint32_t r = 0; r < mc; r += kMR) {
+        for (uint32_t ii = 0; ii < kMR; ii++) {
+            float *out = pa + r * kc + ii;
+            if (r + ii >= mc) {
+                for (uint32_t k = 0; k < kc; k++) {
+                    out[k * kMR] = 0.f;
+                }
+            } else if (mTransA) {
+                for (uint32_t k = 0; k < kc; k++) {
+                    out[k * kMR] = *cellA<float>(i0 + r + ii, k0 + k);
+                }
+            } else {
+                const float *in = cellA<float>(i0 + r + ii, k0);
+                for (uint32_t k = 0; k < kc; k++) {
+                    out[k * kMR] = in[k];
+                }
+            }
+        }
+    }
+    for (uint32_t c = 0; c < nc; c += kNR) {
+        const uint32_t w = rsMin(nc - c, kNR);
+        float *out = pb + c * kc;
+        for (uint32_t k = 0; k < kc; k++) {
+            if (mTransB) {
+                for (uint32_t jj = 0; jj < w; jj++) {
+                    out[jj] = *cellB<float>(k0 + k, j0 + c + jj);
+                }
+            } else {
+                memcpy(out, cellB<float>(k0 + k, j0 + c), w * sizeof(float));
+            }
+            for (uint32_t jj = w; jj < kNR; jj++) {
+                out[jj] = 0.f;
+            }
+            out += kNR;
+        }
+    }
+}
+
+// The same for U8, each k of a row followed by the next.
+void RsdCpuScriptIntrinsicGemm::packU8(int16_t *pa, int16_t *pb, uint32_t i0, uint32_t j0,
+                                       uint32_t k0, uint32_t mc, uint32_t nc,
+                                       uint32_t kc) const {
+    const uint32_t kc2 = (kc + 1) >> 1;
+    for (uint32_t r = 0; r < mc; r += kMR) {
+        for (uint32_t ii = 0; ii < kMR; ii++) {
+            int16_t *out = pa + r * kc2 * 2 + ii * 2;
+            for (uint32_t k = 0; k < kc2 * 2; k++) {
+                out[(k >> 1) * kMR * 2 + (k & 1)] = ((r + ii < mc) && (k < kc)) ?
+                        *cellA<uchar>(i0 + r + ii, k0 + k) : 0;
+            }
+        }
+    }
+    for (uint32_t c = 0; c < nc; c += kNR) {
+        for (uint32_t jj = 0; jj < kNR; jj++) {
+            int16_t *out = pb + c * kc2 * 2 + jj * 2;
+            for (uint32_t k = 0; k < kc2 * 2; k++) {
+                out[(k >> 1) * kNR * 2 + (k & 1)] = ((c + jj < nc) && (k < kc)) ?
+                        *cellB<uchar>(k0 + k, j0 + c + jj) : 0;
+            }
+        }
+    }
+}
+
+// (A - a)(B - b) is AB less b times the row sums of A and a times the
+// column sums of B, plus K a b.
+void RsdCpuScriptIntrinsicGemm::computeSums() {
+    int32_t *rows = mSums;
+    int32_t *cols = mSums + mM;
+    for (uint32_t i = 0; i < mM; i++) {
+        uint32_t s = 0;
+        for (uint32_t k = 0; k < mK; k++) {
+            s += *cellA<uchar>(i, k);
+        }
+        rows[i] = -mOffsetB * (int32_t)s;
+    }
+    for (uint32_t j = 0; j < mN; j++) {
+        uint32_t s = 0;
+        for (uint32_t k = 0; k < mK; k++) {
+            s += *cellB<uchar>(k, j);
+        }
+        cols[j] = -mOffsetA * (int32_t)s + (int32_t)mK * mOffsetA * mOffsetB;
+    }
+}
+
+void RsdCpuScriptIntrinsicGemm::kernelTile(const RsForEachStubParamStruct *p,
+                                           uint32_t xstart, uint32_t xend,
+                                           uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicGemm *cp = (RsdCpuScriptIntrinsicGemm *)p->usr;
+    const uint32_t i0 = (p->y / cp->mTilesN) * cp->mMC;
+    const uint32_t j0 = (p->y % cp->mTilesN) * cp->mNC;
+    const uint32_t mc = rsMin(cp->mMC, cp->mM - i0);
+    const uint32_t nc = rsMin(cp->mNC, cp->mN - j0);
+    const uint32_t mcPad = (mc + kMR - 1) & ~(kMR - 1);
+    const uint32_t ncPad = (nc + kNR - 1) & ~(kNR - 1);
+    const size_t cellBytes = cp->mU8 ? sizeof(int16_t) : sizeof(float);
+    // U8 blocks are padded to an even K.
+    const size_t kcPad = (cp->mKC + 1) & ~1;
+
+    uchar *pa = (uchar *)cp->mScratch.get(p->lid, (mcPad + ncPad) * kcPad * cellBytes);
+    if (!pa) {
+        ALOGE("Gemm out of memory for its panels, skipping a tile");
+        return;
+    }
+    uchar *pb = pa + mcPad * kcPad * cellBytes;
+
+    for (uint32_t k0 = 0; k0 < cp->mK; k0 += cp->mKC) {
+        const uint32_t kc = rsMin(cp->mKC, cp->mK - k0);
+        const bool first = k0 == 0;
+        if (cp->mU8) {
+            cp->packU8((int16_t *)pa, (int16_t *)pb, i0, j0, k0, mc, nc, kc);
+        } else {
+            cp->packF32((float *)pa, (float *)pb, i0, j0, k0, mc, nc, kc);
+        }
+        const uint32_t kc2 = (kc + 1) >> 1;
+
+        for (uint32_t c = 0; c < nc; c += kNR) {
+            const uint32_t w = rsMin(nc - c, kNR);
+            for (uint32_t r = 0; r < mc; r += kMR) {
+                const uint32_t h = rsMin(mc - r, kMR);
+                uchar *out = cp->mC + (i0 + r) * cp->mCStride;
+                if (cp->mU8) {
+                    int32_t acc[kMR * kNR] __attribute__((aligned(16)));
+                    GemmU8(acc, (const int16_t *)pa + r * kc2 * 2,
+                           (const int16_t *)pb + c * kc2 * 2, kc2);
+                    const int32_t *rows = cp->mSums;
+                    const int32_t *cols = cp->mSums + cp->mM;
+                    const bool sums = cp->mUseSums;
+                    for (uint32_t ii = 0; ii < h; ii++) {
+                        int32_t *o = (int32_t *)(out + ii * cp->mCStride) + j0 + c;
+                        for (uint32_t jj = 0; jj < w; jj++) {
+                            int32_t v = acc[ii * kNR + jj];
+                            if (!first) {
+                                v += o[jj];
+                            } else if (sums) {
+                                v += rows[i0 + r + ii] + cols[j0 + c + jj];
+                            }
+                            o[jj] = v;
+                        }
+                    }
+                } else {
+                    float acc[kMR * kNR] __attribute__((aligned(16)));
+                    GemmF32(acc, (const float *)pa + r * kc, (const float *)pb + c * kc, kc);
+                    const float alpha = cp->mAlpha;
+                    const float beta = cp->mBeta;
+                    for (uint32_t ii = 0; ii < h; ii++) {
+                        float *o = (float *)(out + ii * cp->mCStride) + j0 + c;
+                        for (uint32_t jj = 0; jj < w; jj++) {
+                            float v = alpha * acc[ii * kNR + jj];
+                            // A zero beta ignores C, even if it holds NaNs.
+                            if (!first) {
+                                v += o[jj];
+                            } else if (beta != 0.f) {
+                                v += beta * o[jj];
+                            }
+                            o[jj] = v;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicGemm::launch(uint32_t slot, Allocation *aout, const void *usr,
+                                       uint32_t usrLen, const RsScriptCall *sc,
+                                       uint32_t cells) {
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(NULL, aout, usr, usrLen, sc, &mtls);
+    mtls.script = this;
+    mtls.fep.slot = slot;
+    mtls.kernel = (void (*)())&kernelTile;
+    mtls.fep.usr = this;
+
+    // One cell per tile.
+    mtls.mTileBytes = 0;
+    mtls.fep.dimX = 1;
+    mtls.fep.dimY = cells;
+    mtls.xStart = 0;
+    mtls.xEnd = 1;
+    mtls.yStart = 0;
+    mtls.yEnd = cells;
+
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    mCtx->launchThreads(NULL, aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+}
+
+void RsdCpuScriptIntrinsicGemm::invokeForEach(uint32_t slot,
+                                              const Allocation * ain,
+                                              Allocation * aout,
+                                              const void * usr,
+                                              uint32_t usrLen,
+                                              const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    const Allocation *a = mA.get();
+    const Allocation *b = mB.get();
+    if (!a || !b || !aout || !a->mHal.drvState.lod[0].mallocPtr ||
+        !b->mHal.drvState.lod[0].mallocPtr || !aout->mHal.drvState.lod[0].mallocPtr) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT, "Gemm called without A, B or C");
+        return;
+    }
+    mM = rsMax(aout->mHal.drvState.lod[0].dimY, 1u);
+    mN = aout->mHal.drvState.lod[0].dimX;
+    const uint32_t ax = a->mHal.drvState.lod[0].dimX;
+    const uint32_t ay = rsMax(a->mHal.drvState.lod[0].dimY, 1u);
+    const uint32_t bx = b->mHal.drvState.lod[0].dimX;
+    const uint32_t by = rsMax(b->mHal.drvState.lod[0].dimY, 1u);
+    mK = mTransA ? ay : ax;
+    if (((mTransA ? ax : ay) != mM) || ((mTransB ? bx : by) != mK) ||
+        ((mTransB ? by : bx) != mN) ||
+        (aout->mHal.state.elementSizeBytes != (mU8 ? sizeof(int32_t) : sizeof(float)))) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Gemm matrix sizes do not match");
+        return;
+    }
+    mC = (uchar *)aout->mHal.drvState.lod[0].mallocPtr;
+    mCStride = aout->mHal.drvState.lod[0].stride;
+
+    if (!mK) {
+        for (uint32_t i = 0; i < mM; i++) {
+            uchar *row = mC + i * mCStride;
+            if (mU8 || (mBeta == 0.f)) {
+                memset(row, 0, mN * aout->mHal.state.elementSizeBytes);
+            } else {
+                for (uint32_t j = 0; j < mN; j++) {
+                    ((float *)row)[j] *= mBeta;
+                }
+            }
+        }
+        return;
+    }
+
+    mUseSums = mU8 && (mOffsetA || mOffsetB);
+    if (mUseSums) {
+        const size_t count = (size_t)mM + mN;
+        if (count > mSumsSize) {
+            int32_t *sums = (int32_t *)realloc(mSums, count * sizeof(int32_t));
+            if (!sums) {
+                mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY, "Out of memory for gemm");
+                return;
+            }
+            mSums = sums;
+            mSumsSize = count;
+        }
+        computeSums();
+    }
+
+    // Halve the tiles, the wider side first, until every thread has a few.
+    mMC = kMC;
+    mNC = kNC;
+    const uint32_t want = mCtx->getThreadCount() * 2;
+    for (;;) {
+        uint32_t tiles = ((mM + mMC - 1) / mMC) * ((mN + mNC - 1) / mNC);
+        if (tiles >= want) {
+            break;
+        }
+        if ((mNC >= mMC) && (mNC > kNR * 2)) {
+            mNC >>= 1;
+        } else if (mMC > kMR * 2) {
+            mMC >>= 1;
+        } else {
+            break;
+        }
+    }
+    mTilesN = (mN + mNC - 1) / mNC;
+    // The same bytes of panel either way.
+    mKC = mU8 ? kKC * 2 : kKC;
+
+    launch(slot, aout, usr, usrLen, sc, ((mM + mMC - 1) / mMC) * mTilesN);
+}
+
+RsdCpuScriptIntrinsicGemm::RsdCpuScriptIntrinsicGemm(RsdCpuReferenceImpl *ctx,
+                                                     const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_GEMM),
+              mScratch(ctx->getThreadCount()) {
+
+    mRootPtr = &kernelTile;
+    mU8 = e->getType() == RS_TYPE_UNSIGNED_8;
+    mAlpha = 1.f;
+    mBeta = 0.f;
+    mTransA = false;
+    mTransB = false;
+    mOffsetA = 0;
+    mOffsetB = 0;
+    mM = 0;
+    mN = 0;
+    mK = 0;
+    mKC = kKC;
+    mMC = kMC;
+    mNC = kNC;
+    mTilesN = 1;
+    mC = NULL;
+    mCStride = 0;
+    mUseSums = false;
+    mSums = NULL;
+    mSumsSize = 0;
+}
+
+RsdCpuScriptIntrinsicGemm::~RsdCpuScriptIntrinsicGemm() {
+    free(mSums);
+}
+
+void RsdCpuScriptIntrinsicGemm::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 5;
+}
+
+void RsdCpuScriptIntrinsicGemm::invokeFreeChildren() {
+    mA.clear();
+    mB.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Gemm(RsdCpuReferenceImpl *ctx,
+                                     const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicGemm(ctx, s, e);
+}
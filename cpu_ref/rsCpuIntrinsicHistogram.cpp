@@ -24,6 +24,11 @@ namespace android {
 namespace renderscript {
 
 
+// Counts the values of each channel of the input, or of the dot product of
+// its channels, into as many bins as the output has cells.  uchar input
+// into 256 bins indexes them by value; other inputs and bin counts divide
+// a range evenly between the bins, values outside it counting in the
+// first or last bin.
 class RsdCpuScriptIntrinsicHistogram : public RsdCpuScriptIntrinsic {
 public:
     virtual void populateScript(Script *);
@@ -31,6 +36,7 @@ public:
 
     virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual bool writesObjects() const { return true; }
 
     virtual ~RsdCpuScriptIntrinsicHistogram();
     RsdCpuScriptIntrinsicHistogram(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
@@ -46,8 +52,57 @@ protected:
 
     float mDot[4];
     int mDotI[4];
+    // The range of the bins, if set through slot 2.
+    float mRange[2];
+    bool mRangeSet;
+    // The SIMD luma path is exact only for non-negative weights summing to
+    // at most one.
+    bool mDotSIMD;
     int *mSums;
+    size_t mSumsSize;
     ObjectBaseRef<Allocation> mAllocOut;
+    // The table storage of a LUT intrinsic, equalized from each histogram
+    // when set.
+    ObjectBaseRef<Allocation> mAllocLut;
+
+    // Each thread counts into several copies of its bins, rotating between
+    // them pixel by pixel, so runs of equal pixels don't serialize on a
+    // single counter.  The copies are summed in postLaunch.
+    static const uint32_t kSubHistograms = 4;
+    // Large histograms use fewer copies to keep each thread's counters
+    // within this many ints.
+    static const uint32_t kSubHistogramInts = 4096;
+
+    // Layout of this launch's counters.  Each of the mBins bins holds
+    // mSlots channels, three padded to four, and each thread's mCopies
+    // copies of them take mThreadSums ints.
+    uint32_t mBins;
+    uint32_t mSlots;
+    uint32_t mCopies;
+    uint32_t mThreadSums;
+
+    // The input of the ranged kernels, and the min, scale and last bin
+    // they bin with.
+    RsDataType mInType;
+    uint32_t mInVecSize;
+    uint32_t mInSlots;
+    uint32_t mOutVecSize;
+    float mBinParam[3];
+
+    void updateDotI();
+    void mergeSums(unsigned int *o) const;
+    void equalize(const unsigned int *o, bool luma);
+    static int * getSums(const RsForEachStubParamStruct *p);
+    static void countLuma(int *sums, const uchar *bins, uint32_t count);
+    static const float * loadRun(float *buf, const uchar *in, RsDataType type, uint32_t count);
+    static void binRun(ushort *bins, const float *values, const float *param, uint32_t count);
+
+    static void kernelRanged(const RsForEachStubParamStruct *p,
+                             uint32_t xstart, uint32_t xend,
+                             uint32_t instep, uint32_t outstep);
+    static void kernelRangedDot(const RsForEachStubParamStruct *p,
+                                uint32_t xstart, uint32_t xend,
+                                uint32_t instep, uint32_t outstep);
 
     static void kernelP1U4(const RsForEachStubParamStruct *p,
                           uint32_t xstart, uint32_t xend,
@@ -81,18 +136,35 @@ protected:
 }
 
 void RsdCpuScriptIntrinsicHistogram::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    if (slot == 3) {
+        mAllocLut.set(static_cast<Allocation *>(data));
+        return;
+    }
     rsAssert(slot == 1);
     mAllocOut.set(static_cast<Allocation *>(data));
 }
 
 void RsdCpuScriptIntrinsicHistogram::setGlobalVar(uint32_t slot, const void *data, size_t dataLength) {
+    if (slot == 2) {
+        rsAssert(dataLength == sizeof(mRange));
+        memcpy(mRange, data, sizeof(mRange));
+        mRangeSet = true;
+        return;
+    }
     rsAssert(slot == 0);
     rsAssert(dataLength == 16);
     memcpy(mDot, data, 16);
+    updateDotI();
+}
+
+void RsdCpuScriptIntrinsicHistogram::updateDotI() {
     mDotI[0] = (int)((mDot[0] * 256.f) + 0.5f);
     mDotI[1] = (int)((mDot[1] * 256.f) + 0.5f);
     mDotI[2] = (int)((mDot[2] * 256.f) + 0.5f);
     mDotI[3] = (int)((mDot[3] * 256.f) + 0.5f);
+
+    mDotSIMD = (mDotI[0] >= 0) && (mDotI[1] >= 0) && (mDotI[2] >= 0) && (mDotI[3] >= 0) &&
+               ((mDotI[0] + mDotI[1] + mDotI[2] + mDotI[3]) <= 256);
 }
 
 
@@ -102,8 +174,32 @@ void RsdCpuScriptIntrinsicHistogram::preLaunch(uint32_t slot, const Allocation *
                                       uint32_t usrLen, const RsScriptCall *sc) {
 
     const uint32_t threads = mCtx->getThreadCount();
+    const Element *ein = ain->getType()->getElement();
     uint32_t vSize = mAllocOut->getType()->getElement()->getVectorSize();
 
+    mInType = ein->getType();
+    mInVecSize = ein->getVectorSize();
+    mInSlots = (mInVecSize == 3) ? 4 : mInVecSize;
+    mOutVecSize = (slot == 1) ? 1 : vSize;
+    mBins = rsMax(mAllocOut->getType()->getDimX(), 1u);
+    rsAssert(mBins <= 65536);
+
+    float lo = 0.f;
+    float hi = 1.f;
+    if (mRangeSet) {
+        lo = mRange[0];
+        hi = mRange[1];
+    } else if (mInType == RS_TYPE_UNSIGNED_8) {
+        hi = 256.f;
+    } else if (mInType == RS_TYPE_UNSIGNED_16) {
+        hi = 65536.f;
+    }
+    const bool ranged = (mInType != RS_TYPE_UNSIGNED_8) || (mBins != 256) ||
+                        (lo != 0.f) || (hi != 256.f);
+    mBinParam[0] = lo;
+    mBinParam[1] = (float)mBins / (hi - lo);
+    mBinParam[2] = (float)(mBins - 1);
+
     switch (slot) {
     case 0:
         switch(vSize) {
@@ -121,9 +217,12 @@ void RsdCpuScriptIntrinsicHistogram::preLaunch(uint32_t slot, const Allocation *
             mRootPtr = &kernelP1U4;
             break;
         }
+        if (ranged) {
+            mRootPtr = &kernelRanged;
+        }
         break;
     case 1:
-        switch(ain->getType()->getElement()->getVectorSize()) {
+        switch(mInVecSize) {
         case 1:
             mRootPtr = &kernelP1L1;
             break;
@@ -137,26 +236,255 @@ void RsdCpuScriptIntrinsicHistogram::preLaunch(uint32_t slot, const Allocation *
             mRootPtr = &kernelP1L4;
             break;
         }
+        if (ranged) {
+            mRootPtr = &kernelRangedDot;
+        }
+        vSize = 1;
         break;
     }
-    memset(mSums, 0, 256 * sizeof(int32_t) * threads * vSize);
+
+    mSlots = vSize;
+    mCopies = kSubHistograms;
+    if (ranged) {
+        while ((mCopies > 1) && (mBins * mSlots * mCopies > kSubHistogramInts)) {
+            mCopies >>= 1;
+        }
+    }
+    mThreadSums = mBins * mSlots * mCopies;
+
+    const size_t size = (size_t)mThreadSums * threads;
+    if (size > mSumsSize) {
+        delete []mSums;
+        mSums = new int[size];
+        mSumsSize = size;
+    }
+    memset(mSums, 0, size * sizeof(int32_t));
 }
 
+#if defined(ARCH_ARM_USE_INTRINSICS)
+extern "C" void rsdIntrinsicHistogramLuma_K(uchar *dst, const void *src, uint32_t count8,
+                                            const short *dot);
+extern "C" void rsdIntrinsicHistogramMerge_K(unsigned int *dst, const int *src,
+                                             uint32_t count8, uint32_t copies);
+#endif
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicHistogramBin_K(ushort *dst, const float *src, uint32_t count8,
+                                           const float *param);
+extern "C" void rsdIntrinsicConvertU8ToF32_K(float *dst, const uchar *src, const float *scale,
+                                             uint32_t count8);
+#endif
+
 void RsdCpuScriptIntrinsicHistogram::postLaunch(uint32_t slot, const Allocation * ain,
                                        Allocation * aout, const void * usr,
                                        uint32_t usrLen, const RsScriptCall *sc) {
 
     unsigned int *o = (unsigned int *)mAllocOut->mHal.drvState.lod[0].mallocPtr;
+    mergeSums(o);
+    if (mAllocLut.get()) {
+        equalize(o, slot == 1);
+    }
+}
+
+void RsdCpuScriptIntrinsicHistogram::mergeSums(unsigned int *o) const {
     uint32_t threads = mCtx->getThreadCount();
-    uint32_t vSize = mAllocOut->getType()->getElement()->getVectorSize();
 
-    if (vSize == 3) vSize = 4;
+    // Every thread's sub-histograms lie back to back, so the merge is a sum
+    // of threads * mCopies blocks of bins.
+    const uint32_t bins = mBins * mSlots;
+    const uint32_t copies = threads * mCopies;
+#if defined(ARCH_ARM_USE_INTRINSICS)
+    if (gArchUseSIMD && !(bins & 7)) {
+        rsdIntrinsicHistogramMerge_K(o, mSums, bins >> 3, copies);
+        return;
+    }
+#endif
+    memcpy(o, mSums, bins * sizeof(int));
+    for (uint32_t c = 1; c < copies; c++) {
+        const int *sums = &mSums[bins * c];
+        for (uint32_t ct = 0; ct < bins; ct++) {
+            o[ct] += sums[ct];
+        }
+    }
+}
+
+// Fills the four 256 entry tables of the LUT with the cumulative
+// distribution of each channel, stretched so the darkest value present
+// maps to 0 and the brightest to 255.  A luma histogram equalizes red,
+// green and blue alike; tables without a histogram are left as identity.
+void RsdCpuScriptIntrinsicHistogram::equalize(const unsigned int *o, bool luma) {
+    uchar *tables = (uchar *)mAllocLut->mHal.drvState.lod[0].mallocPtr;
+    if (!tables || (mBins != 256) || (mInType != RS_TYPE_UNSIGNED_8) ||
+        (mAllocLut->getType()->getPackedSizeBytes() < 1024)) {
+        ALOGE("Histogram equalization needs 256 bins of uchar input and a LUT table");
+        return;
+    }
+
+    for (uint32_t t = 0; t < 4; t++) {
+        uchar *table = &tables[t * 256];
+        const uint32_t c = luma ? 0 : t;
+        if ((luma && (t == 3)) || (c >= mOutVecSize)) {
+            for (uint32_t v = 0; v < 256; v++) {
+                table[v] = (uchar)v;
+            }
+            continue;
+        }
+
+        // The count of the darkest value present starts the stretch.
+        uint64_t total = 0;
+        uint64_t cdfMin = 0;
+        for (uint32_t v = 0; v < 256; v++) {
+            total += o[v * mSlots + c];
+            if (!cdfMin) {
+                cdfMin = total;
+            }
+        }
+        if (total == cdfMin) {
+            // A single value present, or none; nothing to stretch.
+            for (uint32_t v = 0; v < 256; v++) {
+                table[v] = (uchar)v;
+            }
+            continue;
+        }
+
+        const uint64_t range = total - cdfMin;
+        uint64_t cdf = 0;
+        for (uint32_t v = 0; v < 256; v++) {
+            cdf += o[v * mSlots + c];
+            table[v] = (cdf > cdfMin) ? (uchar)(((cdf - cdfMin) * 255 + (range >> 1)) / range) : 0;
+        }
+    }
+}
+
+int * RsdCpuScriptIntrinsicHistogram::getSums(const RsForEachStubParamStruct *p) {
+    RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
+    return &cp->mSums[cp->mThreadSums * p->lid];
+}
+
+// Count a run of precomputed luma bins.
+void RsdCpuScriptIntrinsicHistogram::countLuma(int *sums, const uchar *bins, uint32_t count) {
+    uint32_t x = 0;
+    for (; (x + 3) < count; x += 4) {
+        sums[bins[x]] ++;
+        sums[bins[x + 1] + 256] ++;
+        sums[bins[x + 2] + 512] ++;
+        sums[bins[x + 3] + 768] ++;
+    }
+    for (; x < count; x++) {
+        sums[bins[x]] ++;
+    }
+}
+
+// Returns count values of the input as floats, converted into buf unless
+// they are floats already.
+const float * RsdCpuScriptIntrinsicHistogram::loadRun(float *buf, const uchar *in,
+                                                      RsDataType type, uint32_t count) {
+    uint32_t i = 0;
+    switch (type) {
+    case RS_TYPE_FLOAT_32:
+        return (const float *)in;
+    case RS_TYPE_FLOAT_16:
+        rsHalfToFloatRow(buf, (const ushort *)in, count);
+        return buf;
+    case RS_TYPE_UNSIGNED_16:
+        for (; i < count; i++) {
+            buf[i] = ((const ushort *)in)[i];
+        }
+        return buf;
+    default:
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+        if (gArchUseSIMD && (count >= 8)) {
+            const float one = 1.f;
+            rsdIntrinsicConvertU8ToF32_K(buf, in, &one, count >> 3);
+            i = count & ~7;
+        }
+#endif
+        for (; i < count; i++) {
+            buf[i] = in[i];
+        }
+        return buf;
+    }
+}
+
+// Bins count values as the SIMD kernel does: the value's offset from the
+// bottom of the range scaled to bins, truncated and clamped, NaN going to
+// the first bin.
+void RsdCpuScriptIntrinsicHistogram::binRun(ushort *bins, const float *values,
+                                            const float *param, uint32_t count) {
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >= 8)) {
+        rsdIntrinsicHistogramBin_K(bins, values, count >> 3, param);
+        i = count & ~7;
+    }
+#endif
+    for (; i < count; i++) {
+        float t = (values[i] - param[0]) * param[1];
+        t = (t > 0.f) ? t : 0.f;
+        bins[i] = (ushort)((t < param[2]) ? t : param[2]);
+    }
+}
+
+void RsdCpuScriptIntrinsicHistogram::kernelRanged(const RsForEachStubParamStruct *p,
+                                                  uint32_t xstart, uint32_t xend,
+                                                  uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
+    const uchar *in = (const uchar *)p->in;
+    int * sums = getSums(p);
+    const uint32_t inSlots = cp->mInSlots;
+    const uint32_t slots = cp->mSlots;
+    const uint32_t channels = cp->mOutVecSize;
+    const uint32_t copyMask = cp->mCopies - 1;
+    const uint32_t copySize = cp->mBins * slots;
+
+    static const uint32_t kRun = 64;
+    float buf[kRun * 4];
+    ushort bins[kRun * 4];
+    while (xstart < xend) {
+        const uint32_t n = rsMin(xend - xstart, kRun);
+        const float *values = loadRun(buf, in, cp->mInType, n * inSlots);
+        binRun(bins, values, cp->mBinParam, n * inSlots);
+        for (uint32_t x = 0; x < n; x++) {
+            int *s = &sums[copySize * (x & copyMask)];
+            const ushort *b = &bins[x * inSlots];
+            for (uint32_t c = 0; c < channels; c++) {
+                s[b[c] * slots + c] ++;
+            }
+        }
+        xstart += n;
+        in += n * instep;
+    }
+}
 
-    for (uint32_t ct=0; ct < (256 * vSize); ct++) {
-        o[ct] = mSums[ct];
-        for (uint32_t t=1; t < threads; t++) {
-            o[ct] += mSums[ct + (256 * vSize * t)];
+void RsdCpuScriptIntrinsicHistogram::kernelRangedDot(const RsForEachStubParamStruct *p,
+                                                     uint32_t xstart, uint32_t xend,
+                                                     uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
+    const uchar *in = (const uchar *)p->in;
+    int * sums = getSums(p);
+    const uint32_t inSlots = cp->mInSlots;
+    const uint32_t inVecSize = cp->mInVecSize;
+    const uint32_t copyMask = cp->mCopies - 1;
+
+    static const uint32_t kRun = 64;
+    float buf[kRun * 4];
+    float luma[kRun];
+    ushort bins[kRun];
+    while (xstart < xend) {
+        const uint32_t n = rsMin(xend - xstart, kRun);
+        const float *values = loadRun(buf, in, cp->mInType, n * inSlots);
+        for (uint32_t x = 0; x < n; x++) {
+            float t = 0.f;
+            for (uint32_t c = 0; c < inVecSize; c++) {
+                t += cp->mDot[c] * values[x * inSlots + c];
+            }
+            luma[x] = t;
+        }
+        binRun(bins, luma, cp->mBinParam, n);
+        for (uint32_t x = 0; x < n; x++) {
+            sums[cp->mBins * (x & copyMask) + bins[x]] ++;
         }
+        xstart += n;
+        in += n * instep;
     }
 }
 
@@ -164,11 +492,21 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1U4(const RsForEachStubParamStruct *
                                                 uint32_t xstart, uint32_t xend,
                                                 uint32_t instep, uint32_t outstep) {
 
-    RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * 4 * p->lid];
-
-    for (uint32_t x = xstart; x < xend; x++) {
+    int * sums = getSums(p);
+
+    uint32_t x = xstart;
+    for (; (x + kSubHistograms) <= xend; x += kSubHistograms) {
+        for (uint32_t c = 0; c < kSubHistograms; c++) {
+            int * s = &sums[256 * 4 * c];
+            s[(in[0] << 2)    ] ++;
+            s[(in[1] << 2) + 1] ++;
+            s[(in[2] << 2) + 2] ++;
+            s[(in[3] << 2) + 3] ++;
+            in += instep;
+        }
+    }
+    for (; x < xend; x++) {
         sums[(in[0] << 2)    ] ++;
         sums[(in[1] << 2) + 1] ++;
         sums[(in[2] << 2) + 2] ++;
@@ -181,11 +519,20 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1U3(const RsForEachStubParamStruct *
                                                 uint32_t xstart, uint32_t xend,
                                                 uint32_t instep, uint32_t outstep) {
 
-    RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * 4 * p->lid];
-
-    for (uint32_t x = xstart; x < xend; x++) {
+    int * sums = getSums(p);
+
+    uint32_t x = xstart;
+    for (; (x + kSubHistograms) <= xend; x += kSubHistograms) {
+        for (uint32_t c = 0; c < kSubHistograms; c++) {
+            int * s = &sums[256 * 4 * c];
+            s[(in[0] << 2)    ] ++;
+            s[(in[1] << 2) + 1] ++;
+            s[(in[2] << 2) + 2] ++;
+            in += instep;
+        }
+    }
+    for (; x < xend; x++) {
         sums[(in[0] << 2)    ] ++;
         sums[(in[1] << 2) + 1] ++;
         sums[(in[2] << 2) + 2] ++;
@@ -197,11 +544,19 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1U2(const RsForEachStubParamStruct *
                                                 uint32_t xstart, uint32_t xend,
                                                 uint32_t instep, uint32_t outstep) {
 
-    RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * 2 * p->lid];
-
-    for (uint32_t x = xstart; x < xend; x++) {
+    int * sums = getSums(p);
+
+    uint32_t x = xstart;
+    for (; (x + kSubHistograms) <= xend; x += kSubHistograms) {
+        for (uint32_t c = 0; c < kSubHistograms; c++) {
+            int * s = &sums[256 * 2 * c];
+            s[(in[0] << 1)    ] ++;
+            s[(in[1] << 1) + 1] ++;
+            in += instep;
+        }
+    }
+    for (; x < xend; x++) {
         sums[(in[0] << 1)    ] ++;
         sums[(in[1] << 1) + 1] ++;
         in += instep;
@@ -214,7 +569,23 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1L4(const RsForEachStubParamStruct *
 
     RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * p->lid];
+    int * sums = getSums(p);
+
+#if defined(ARCH_ARM_USE_INTRINSICS)
+    if (gArchUseSIMD && cp->mDotSIMD && (instep == 4)) {
+        // Compute the bins of a run of pixels with NEON, then count them.
+        const short dot[4] = {(short)cp->mDotI[0], (short)cp->mDotI[1],
+                              (short)cp->mDotI[2], (short)cp->mDotI[3]};
+        uchar bins[256];
+        while ((xstart + 8) <= xend) {
+            uint32_t len = rsMin(xend - xstart, (uint32_t)sizeof(bins)) & ~7;
+            rsdIntrinsicHistogramLuma_K(bins, in, len >> 3, dot);
+            countLuma(sums, bins, len);
+            xstart += len;
+            in += len << 2;
+        }
+    }
+#endif
 
     for (uint32_t x = xstart; x < xend; x++) {
         int t = (cp->mDotI[0] * in[0]) +
@@ -232,7 +603,23 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1L3(const RsForEachStubParamStruct *
 
     RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * p->lid];
+    int * sums = getSums(p);
+
+#if defined(ARCH_ARM_USE_INTRINSICS)
+    if (gArchUseSIMD && cp->mDotSIMD && (instep == 4)) {
+        // uchar3 is padded to four bytes; a zero weight drops the padding.
+        const short dot[4] = {(short)cp->mDotI[0], (short)cp->mDotI[1],
+                              (short)cp->mDotI[2], 0};
+        uchar bins[256];
+        while ((xstart + 8) <= xend) {
+            uint32_t len = rsMin(xend - xstart, (uint32_t)sizeof(bins)) & ~7;
+            rsdIntrinsicHistogramLuma_K(bins, in, len >> 3, dot);
+            countLuma(sums, bins, len);
+            xstart += len;
+            in += len << 2;
+        }
+    }
+#endif
 
     for (uint32_t x = xstart; x < xend; x++) {
         int t = (cp->mDotI[0] * in[0]) +
@@ -249,9 +636,18 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1L2(const RsForEachStubParamStruct *
 
     RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * p->lid];
-
-    for (uint32_t x = xstart; x < xend; x++) {
+    int * sums = getSums(p);
+
+    uint32_t x = xstart;
+    for (; (x + kSubHistograms) <= xend; x += kSubHistograms) {
+        for (uint32_t c = 0; c < kSubHistograms; c++) {
+            int t = (cp->mDotI[0] * in[0]) +
+                    (cp->mDotI[1] * in[1]);
+            sums[((t + 0x7f) >> 8) + 256 * c] ++;
+            in += instep;
+        }
+    }
+    for (; x < xend; x++) {
         int t = (cp->mDotI[0] * in[0]) +
                 (cp->mDotI[1] * in[1]);
         sums[(t + 0x7f) >> 8] ++;
@@ -265,9 +661,17 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1L1(const RsForEachStubParamStruct *
 
     RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * p->lid];
-
-    for (uint32_t x = xstart; x < xend; x++) {
+    int * sums = getSums(p);
+
+    uint32_t x = xstart;
+    for (; (x + kSubHistograms) <= xend; x += kSubHistograms) {
+        for (uint32_t c = 0; c < kSubHistograms; c++) {
+            int t = (cp->mDotI[0] * in[0]);
+            sums[((t + 0x7f) >> 8) + 256 * c] ++;
+            in += instep;
+        }
+    }
+    for (; x < xend; x++) {
         int t = (cp->mDotI[0] * in[0]);
         sums[(t + 0x7f) >> 8] ++;
         in += instep;
@@ -278,11 +682,17 @@ void RsdCpuScriptIntrinsicHistogram::kernelP1U1(const RsForEachStubParamStruct *
                                                 uint32_t xstart, uint32_t xend,
                                                 uint32_t instep, uint32_t outstep) {
 
-    RsdCpuScriptIntrinsicHistogram *cp = (RsdCpuScriptIntrinsicHistogram *)p->usr;
     uchar *in = (uchar *)p->in;
-    int * sums = &cp->mSums[256 * p->lid];
+    int * sums = getSums(p);
 
-    for (uint32_t x = xstart; x < xend; x++) {
+    uint32_t x = xstart;
+    for (; (x + kSubHistograms) <= xend; x += kSubHistograms) {
+        for (uint32_t c = 0; c < kSubHistograms; c++) {
+            sums[in[0] + 256 * c] ++;
+            in += instep;
+        }
+    }
+    for (; x < xend; x++) {
         sums[in[0]] ++;
         in += instep;
     }
@@ -294,15 +704,20 @@ RsdCpuScriptIntrinsicHistogram::RsdCpuScriptIntrinsicHistogram(RsdCpuReferenceIm
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_HISTOGRAM) {
 
     mRootPtr = NULL;
-    mSums = new int[256 * 4 * mCtx->getThreadCount()];
+    mSumsSize = 256 * 4 * kSubHistograms * mCtx->getThreadCount();
+    mSums = new int[mSumsSize];
+    mRangeSet = false;
+    mRange[0] = 0.f;
+    mRange[1] = 1.f;
+    mBins = 256;
+    mSlots = 4;
+    mCopies = kSubHistograms;
+    mThreadSums = 256 * 4 * kSubHistograms;
     mDot[0] = 0.299f;
     mDot[1] = 0.587f;
     mDot[2] = 0.114f;
     mDot[3] = 0;
-    mDotI[0] = (int)((mDot[0] * 256.f) + 0.5f);
-    mDotI[1] = (int)((mDot[1] * 256.f) + 0.5f);
-    mDotI[2] = (int)((mDot[2] * 256.f) + 0.5f);
-    mDotI[3] = (int)((mDot[3] * 256.f) + 0.5f);
+    updateDotI();
 }
 
 RsdCpuScriptIntrinsicHistogram::~RsdCpuScriptIntrinsicHistogram() {
@@ -312,10 +727,11 @@ RsdCpuScriptIntrinsicHistogram::~RsdCpuScriptIntrinsicHistogram() {
 }
 
 void RsdCpuScriptIntrinsicHistogram::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 2;
+    s->mHal.info.exportedVariableCount = 4;
 }
 
 void RsdCpuScriptIntrinsicHistogram::invokeFreeChildren() {
+    mAllocLut.clear();
 }
 
 
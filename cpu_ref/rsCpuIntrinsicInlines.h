@@ -15,6 +15,17 @@
  */
 
 
+// Row conversions between half and single precision use the hardware
+// instructions when the compiler targets them.  Neither the fp16 NEON
+// extension on ARMv7 nor F16C on x86 can be assumed by the default build,
+// so otherwise they fall back to the bit exact scalar versions below.
+#if defined(__ARM_NEON) && defined(__ARM_FP16_FORMAT_IEEE) && defined(__ARM_FP) && (__ARM_FP & 2)
+#define RS_HALF_NEON 1
+#include <arm_neon.h>
+#elif defined(__F16C__)
+#define RS_HALF_F16C 1
+#include <immintrin.h>
+#endif
 
 typedef uint8_t uchar;
 typedef uint16_t ushort;
@@ -124,3 +135,115 @@ static inline float clamp(float amount, float low, float high) {
     return amount < low ? low : (amount > high ? high : amount);
 }
 
+
+// The scalar conversions are shared with the core.
+using android::renderscript::rsHalfToFloat;
+using android::renderscript::rsFloatToHalf;
+
+static inline void rsHalfToFloatRow(float *dst, const ushort *src, uint32_t count) {
+    uint32_t i = 0;
+#if defined(RS_HALF_NEON)
+    for (; (i + 4) <= count; i += 4) {
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+    }
+#elif defined(RS_HALF_F16C)
+    for (; (i + 4) <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(src + i))));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = rsHalfToFloat(src[i]);
+    }
+}
+
+static inline void rsFloatToHalfRow(ushort *dst, const float *src, uint32_t count) {
+    uint32_t i = 0;
+#if defined(RS_HALF_NEON)
+    for (; (i + 4) <= count; i += 4) {
+        vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+    }
+#elif defined(RS_HALF_F16C)
+    for (; (i + 4) <= count; i += 4) {
+        _mm_storel_epi64((__m128i *)(dst + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), 0));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = rsFloatToHalf(src[i]);
+    }
+}
+
+// Converts pixels [x - r, x + count + r) of a row of ch channel halves to
+// floats, repeating the edge pixels past either side of the row.
+static inline void rsHalfLoadRow(float *dst, const ushort *row, int x, int count, int r,
+                                 int ch, int dimX) {
+    int lo = x - r;
+    int hi = x + count + r;
+    int vlo = lo < 0 ? 0 : lo;
+    int vhi = hi > dimX ? dimX : hi;
+    for (int i = lo; i < vlo; i++) {
+        rsHalfToFloatRow(dst, row, ch);
+        dst += ch;
+    }
+    rsHalfToFloatRow(dst, row + vlo * ch, (vhi - vlo) * ch);
+    dst += (vhi - vlo) * ch;
+    for (int i = vhi; i < hi; i++) {
+        rsHalfToFloatRow(dst, row + (dimX - 1) * ch, ch);
+        dst += ch;
+    }
+}
+
+// Narrows [x1, x2) to [*ix1, *ix2), the columns whose taps up to r pixels
+// either side all fall inside a row of dimX pixels.  Only the columns
+// outside it need their taps clamped.
+static inline void rsInteriorRange(uint32_t x1, uint32_t x2, uint32_t dimX, uint32_t r,
+                                   uint32_t *ix1, uint32_t *ix2) {
+    uint32_t lo = (x1 > r) ? x1 : r;
+    uint32_t hi = (dimX > r) ? dimX - r : 0;
+    lo = (lo > x2) ? x2 : lo;
+    hi = (hi > x2) ? x2 : hi;
+    *ix1 = lo;
+    *ix2 = (hi < lo) ? lo : hi;
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicConvolveFlatU8_K(uchar *dst, const uchar * const *rows,
+                                             const short *coef, uint32_t size, uint32_t ch,
+                                             uint32_t count8);
+extern "C" void rsdIntrinsicConvolveFlatF32_K(float *dst, const float * const *rows,
+                                              const float *coef, uint32_t size, uint32_t ch,
+                                              uint32_t count8);
+
+// Convolves interior pixels from x1 on of size rows of ch channel elements
+// with a size x size kernel, eight channels at a time, the taps of each
+// pixel being ch values apart.  rows point at the start of each input
+// row.  Returns the pixels done; the rest of [x1, x2) is left to the
+// caller.  The uchar kernel takes coefficients in 8.8 fixed point and
+// truncates as the C path does.
+static inline uint32_t rsConvolveInteriorU8(uchar *out, const uchar * const *rows,
+                                            const short *coef, uint32_t size, uint32_t ch,
+                                            uint32_t x1, uint32_t x2) {
+    const uint32_t count8 = ((x2 - x1) * ch) >> 3;
+    if (count8) {
+        const uchar *py[5];
+        for (uint32_t r = 0; r < size; r++) {
+            py[r] = rows[r] + (x1 - (size >> 1)) * ch;
+        }
+        rsdIntrinsicConvolveFlatU8_K(out, py, coef, size, ch, count8);
+    }
+    return (count8 << 3) / ch;
+}
+
+static inline uint32_t rsConvolveInteriorF32(float *out, const float * const *rows,
+                                             const float *coef, uint32_t size, uint32_t ch,
+                                             uint32_t x1, uint32_t x2) {
+    const uint32_t count8 = ((x2 - x1) * ch) >> 3;
+    if (count8) {
+        const float *py[5];
+        for (uint32_t r = 0; r < size; r++) {
+            py[r] = rows[r] + (x1 - (size >> 1)) * ch;
+        }
+        rsdIntrinsicConvolveFlatF32_K(out, py, coef, size, ch, count8);
+    }
+    return (count8 << 3) / ch;
+}
+#endif
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// The summed-area table of a U8 image, each output being the sum of the
+// input above and to the left of it, inclusive, in 32 bits.  Sums past
+// 2^32 wrap, so only differences of nearby outputs stay meaningful on
+// very large images.
+//
+// The rows are cut into one slice per thread.  A first launch sums the
+// columns of every slice but the last and scans the sums along the row,
+// these are accumulated into the row above each slice, and a second
+// launch scans the slices from them.
+class RsdCpuScriptIntrinsicIntegral : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+
+    virtual void invokeForEach(uint32_t slot,
+                               const Allocation * ain,
+                               Allocation * aout,
+                               const void * usr,
+                               uint32_t usrLen,
+                               const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicIntegral();
+    RsdCpuScriptIntrinsicIntegral(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    uint32_t mCellSize;
+
+    // The launch being run.
+    uint32_t mDimX;
+    uint32_t mDimY;
+    uint32_t mSlices;
+    const uchar *mSrc;
+    size_t mSrcStride;
+    uchar *mDst;
+    size_t mDstStride;
+    // Row s holds the table of the row just above slice s.
+    uint32_t *mCarry;
+    size_t mCarrySize;
+
+    uint32_t sliceStart(uint32_t s) const {
+        return (uint32_t)(((uint64_t)mDimY * s) / mSlices);
+    }
+    void launch(uint32_t slot, const Allocation *in, Allocation *aout, const void *usr,
+                uint32_t usrLen, const RsScriptCall *sc, void (*kernel)(), uint32_t cells);
+
+    static void kernelSums(const RsForEachStubParamStruct *p,
+                           uint32_t xstart, uint32_t xend,
+                           uint32_t instep, uint32_t outstep);
+    static void kernelScan(const RsForEachStubParamStruct *p,
+                           uint32_t xstart, uint32_t xend,
+                           uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicIntegralU8_K(uint32_t *dst, const uchar *src,
+                                         const uint32_t *above, uint32_t count8);
+extern "C" void rsdIntrinsicIntegralU8_4_K(uint32_t *dst, const uchar *src,
+                                           const uint32_t *above, uint32_t count);
+#endif
+
+// Scans one row into out, adding the row above.  cs is both the bytes of
+// an input cell and the ints of an output one.
+static void IntegralRow(uint32_t *out, const uchar *in, const uint32_t *above,
+                        uint32_t dimX, uint32_t cs) {
+    uint32_t x = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        if (cs == 1) {
+            uint32_t len = dimX >> 3;
+            if (len > 0) {
+                rsdIntrinsicIntegralU8_K(out, in, above, len);
+                x = len << 3;
+            }
+        } else if ((cs == 4) && dimX) {
+            rsdIntrinsicIntegralU8_4_K(out, in, above, dimX);
+            x = dimX;
+        }
+    }
+#endif
+    uint32_t sum[4];
+    for (uint32_t c = 0; c < cs; c++) {
+        sum[c] = x ? out[(x - 1) * cs + c] - above[(x - 1) * cs + c] : 0;
+    }
+    for (; x < dimX; x++) {
+        for (uint32_t c = 0; c < cs; c++) {
+            sum[c] += in[x * cs + c];
+            out[x * cs + c] = sum[c] + above[x * cs + c];
+        }
+    }
+}
+
+// Sums the columns of slice p->y into the carry row of the next slice.
+void RsdCpuScriptIntrinsicIntegral::kernelSums(const RsForEachStubParamStruct *p,
+                                               uint32_t xstart, uint32_t xend,
+                                               uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicIntegral *cp = (RsdCpuScriptIntrinsicIntegral *)p->usr;
+    const uint32_t n = cp->mDimX * cp->mCellSize;
+    uint32_t *sums = cp->mCarry + (size_t)(p->y + 1) * n;
+
+    memset(sums, 0, n * sizeof(uint32_t));
+    for (uint32_t y = cp->sliceStart(p->y); y < cp->sliceStart(p->y + 1); y++) {
+        const uchar *in = cp->mSrc + y * cp->mSrcStride;
+        for (uint32_t i = 0; i < n; i++) {
+            sums[i] += in[i];
+        }
+    }
+    // Scanned along the row, so the sums can stand in for a row of output.
+    const uint32_t cs = cp->mCellSize;
+    for (uint32_t i = cs; i < n; i++) {
+        sums[i] += sums[i - cs];
+    }
+}
+
+void RsdCpuScriptIntrinsicIntegral::kernelScan(const RsForEachStubParamStruct *p,
+                                               uint32_t xstart, uint32_t xend,
+                                               uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicIntegral *cp = (RsdCpuScriptIntrinsicIntegral *)p->usr;
+    const uint32_t n = cp->mDimX * cp->mCellSize;
+    const uint32_t *above = cp->mCarry + (size_t)p->y * n;
+
+    for (uint32_t y = cp->sliceStart(p->y); y < cp->sliceStart(p->y + 1); y++) {
+        uint32_t *out = (uint32_t *)(cp->mDst + y * cp->mDstStride);
+        IntegralRow(out, cp->mSrc + y * cp->mSrcStride, above, cp->mDimX, cp->mCellSize);
+        above = out;
+    }
+}
+
+void RsdCpuScriptIntrinsicIntegral::launch(uint32_t slot, const Allocation *in,
+                                           Allocation *aout, const void *usr,
+                                           uint32_t usrLen, const RsScriptCall *sc,
+                                           void (*kernel)(), uint32_t cells) {
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(in, aout, usr, usrLen, sc, &mtls);
+    mtls.script = this;
+    mtls.fep.slot = slot;
+    mtls.kernel = kernel;
+    mtls.fep.usr = this;
+
+    // One cell per slice.
+    mtls.mTileBytes = 0;
+    mtls.fep.dimX = 1;
+    mtls.fep.dimY = cells;
+    mtls.xStart = 0;
+    mtls.xEnd = 1;
+    mtls.yStart = 0;
+    mtls.yEnd = cells;
+
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    mCtx->launchThreads(in, aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+}
+
+void RsdCpuScriptIntrinsicIntegral::invokeForEach(uint32_t slot,
+                                                  const Allocation * ain,
+                                                  Allocation * aout,
+                                                  const void * usr,
+                                                  uint32_t usrLen,
+                                                  const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    if (!ain || !aout || !ain->mHal.drvState.lod[0].mallocPtr ||
+        !aout->mHal.drvState.lod[0].mallocPtr) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Integral called without input or output");
+        return;
+    }
+    mDimX = aout->mHal.drvState.lod[0].dimX;
+    mDimY = rsMax(aout->mHal.drvState.lod[0].dimY, 1u);
+    if ((ain->mHal.drvState.lod[0].dimX != mDimX) ||
+        (rsMax(ain->mHal.drvState.lod[0].dimY, 1u) != mDimY) ||
+        (aout->mHal.state.elementSizeBytes != mCellSize * sizeof(uint32_t))) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Integral output does not match its input");
+        return;
+    }
+
+    mSlices = rsMin(mCtx->getThreadCount(), mDimY);
+    const size_t n = (size_t)mDimX * mCellSize;
+    if (n * mSlices > mCarrySize) {
+        uint32_t *c = (uint32_t *)realloc(mCarry, n * mSlices * sizeof(uint32_t));
+        if (!c) {
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                         "Out of memory for integral");
+            return;
+        }
+        mCarry = c;
+        mCarrySize = n * mSlices;
+    }
+    mSrc = (const uchar *)ain->mHal.drvState.lod[0].mallocPtr;
+    mSrcStride = ain->mHal.drvState.lod[0].stride;
+    mDst = (uchar *)aout->mHal.drvState.lod[0].mallocPtr;
+    mDstStride = aout->mHal.drvState.lod[0].stride;
+
+    memset(mCarry, 0, n * sizeof(uint32_t));
+    if (mSlices > 1) {
+        launch(slot, ain, aout, usr, usrLen, sc, (void (*)())&kernelSums, mSlices - 1);
+        for (uint32_t s = 2; s < mSlices; s++) {
+            uint32_t *c = mCarry + s * n;
+            const uint32_t *prev = c - n;
+            for (size_t i = 0; i < n; i++) {
+                c[i] += prev[i];
+            }
+        }
+    }
+    launch(slot, ain, aout, usr, usrLen, sc, (void (*)())&kernelScan, mSlices);
+}
+
+RsdCpuScriptIntrinsicIntegral::RsdCpuScriptIntrinsicIntegral(RsdCpuReferenceImpl *ctx,
+                                                             const Script *s,
+                                                             const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_INTEGRAL) {
+
+    mRootPtr = &kernelScan;
+    mCellSize = e->getSizeBytes();
+    mDimX = 0;
+    mDimY = 0;
+    mSlices = 1;
+    mSrc = NULL;
+    mSrcStride = 0;
+    mDst = NULL;
+    mDstStride = 0;
+    mCarry = NULL;
+    mCarrySize = 0;
+}
+
+RsdCpuScriptIntrinsicIntegral::~RsdCpuScriptIntrinsicIntegral() {
+    free(mCarry);
+}
+
+void RsdCpuScriptIntrinsicIntegral::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 0;
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Integral(RsdCpuReferenceImpl *ctx,
+                                         const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicIntegral(ctx, s, e);
+}
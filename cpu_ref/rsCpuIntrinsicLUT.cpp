@@ -53,6 +53,11 @@ void RsdCpuScriptIntrinsicLUT::setGlobalObj(uint32_t slot, ObjectBase *data) {
 }
 
 
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicLUT_K(void *dst, const void *src, uint32_t count4,
+                                  const uchar *tables);
+#endif
+
 void RsdCpuScriptIntrinsicLUT::kernel(const RsForEachStubParamStruct *p,
                                       uint32_t xstart, uint32_t xend,
                                       uint32_t instep, uint32_t outstep) {
@@ -68,6 +73,29 @@ void RsdCpuScriptIntrinsicLUT::kernel(const RsForEachStubParamStruct *p,
     const uchar *tb = &tg[256];
     const uchar *ta = &tb[256];
 
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && ((x1 + 3) < x2)) {
+        uint32_t len = (x2 - x1) >> 2;
+        rsdIntrinsicLUT_K(out, in, len, tr);
+        x1 += len << 2;
+        out += len << 2;
+        in += len << 2;
+    }
+#endif
+
+    // Unrolled so the lookups of several pixels can be in flight together.
+    while ((x1 + 1) < x2) {
+        uchar4 p0 = in[0];
+        uchar4 p1 = in[1];
+        uchar4 o0 = {tr[p0.x], tg[p0.y], tb[p0.z], ta[p0.w]};
+        uchar4 o1 = {tr[p1.x], tg[p1.y], tb[p1.z], ta[p1.w]};
+        out[0] = o0;
+        out[1] = o1;
+        in += 2;
+        out += 2;
+        x1 += 2;
+    }
+
     while (x1 < x2) {
         uchar4 p = *in;
         uchar4 o = {tr[p.x], tg[p.y], tb[p.z], ta[p.w]};
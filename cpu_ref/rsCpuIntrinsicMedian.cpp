@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// The median of each channel over a 3x3 or 5x5 window, the edges being
+// repeated.  Channels are independent, so the kernels treat a row as bytes
+// and find the median of 16 of them at a time with a sorting network.
+class RsdCpuScriptIntrinsicMedian : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const {
+        return (fieldSlot == 1) ? mRadius : -1;
+    }
+
+    virtual ~RsdCpuScriptIntrinsicMedian();
+    RsdCpuScriptIntrinsicMedian(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    ObjectBaseRef<const Allocation> mAlloc;
+    int mRadius;
+    uint32_t mCellSize;
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicMedian::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 1);
+    mAlloc.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicMedian::setGlobalVar(uint32_t slot, const void *data,
+                                               size_t dataLength) {
+    rsAssert(slot == 0);
+    rsAssert(dataLength == sizeof(int32_t));
+    mRadius = (((const int32_t *)data)[0] == 5) ? 2 : 1;
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicMedian3x3U8_K(void *dst, const void * const *rows, uint32_t step,
+                                          uint32_t count16);
+extern "C" void rsdIntrinsicMedian5x5U8_K(void *dst, const void * const *rows, uint32_t step,
+                                          uint32_t count16);
+#endif
+
+// Only the columns at either end of a row need clampX.
+static void MedianOne(uchar *out, const uchar * const *rows, uint32_t x, int r, uint32_t cs,
+                      uint32_t dimX, bool clampX) {
+    const int size = r * 2 + 1;
+    const int n = size * size;
+    uint32_t xs[5];
+    for (int k = 0; k < size; k++) {
+        xs[k] = x + k - r;
+        if (clampX) {
+            xs[k] = rsMin(rsMax((int32_t)x + k - r, 0), (int32_t)dimX - 1);
+        }
+        xs[k] *= cs;
+    }
+    for (uint32_t c = 0; c < cs; c++) {
+        uchar v[25];
+        for (int i = 0; i < n; i++) {
+            v[i] = rows[i / size][xs[i % size] + c];
+        }
+        // A partial selection sort, up to the middle.
+        for (int i = 0; i <= n / 2; i++) {
+            int m = i;
+            for (int j = i + 1; j < n; j++) {
+                if (v[j] < v[m]) {
+                    m = j;
+                }
+            }
+            uchar t = v[i];
+            v[i] = v[m];
+            v[m] = t;
+        }
+        out[c] = v[n / 2];
+    }
+}
+
+void RsdCpuScriptIntrinsicMedian::kernel(const RsForEachStubParamStruct *p,
+                                         uint32_t xstart, uint32_t xend,
+                                         uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicMedian *cp = (RsdCpuScriptIntrinsicMedian *)p->usr;
+    if (!cp->mAlloc.get()) {
+        ALOGE("Median executed without input, skipping");
+        return;
+    }
+    size_t stride;
+    const uchar *pin = cp->getFieldInput(p->lid, 1, cp->mAlloc.get(), &stride);
+    const int r = cp->mRadius;
+    const uint32_t cs = cp->mCellSize;
+
+    const uchar *rows[5];
+    for (int k = 0; k < r * 2 + 1; k++) {
+        rows[k] = pin + stride * rsMin(rsMax((int32_t)p->y + k - r, 0), (int32_t)p->dimY - 1);
+    }
+
+    uchar *out = (uchar *)p->out;
+    uint32_t x1 = xstart;
+    uint32_t ix1, ix2;
+    rsInteriorRange(xstart, xend, p->dimX, r, &ix1, &ix2);
+    while (x1 < ix1) {
+        MedianOne(out, rows, x1, r, cs, p->dimX, true);
+        out += cs;
+        x1++;
+    }
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        // Cells are 1, 2 or 4 bytes, so groups of 16 bytes are whole cells.
+        uint32_t len = ((ix2 - x1) * cs) >> 4;
+        if (len > 0) {
+            const uchar *centre[5];
+            for (int k = 0; k < r * 2 + 1; k++) {
+                centre[k] = rows[k] + x1 * cs;
+            }
+            if (r == 1) {
+                rsdIntrinsicMedian3x3U8_K(out, (const void * const *)centre, cs, len);
+            } else {
+                rsdIntrinsicMedian5x5U8_K(out, (const void * const *)centre, cs, len);
+            }
+            x1 += (len << 4) / cs;
+            out += len << 4;
+        }
+    }
+#endif
+    while (x1 < ix2) {
+        MedianOne(out, rows, x1, r, cs, p->dimX, false);
+        out += cs;
+        x1++;
+    }
+    while (x1 < xend) {
+        MedianOne(out, rows, x1, r, cs, p->dimX, true);
+        out += cs;
+        x1++;
+    }
+}
+
+RsdCpuScriptIntrinsicMedian::RsdCpuScriptIntrinsicMedian(RsdCpuReferenceImpl *ctx,
+                                                         const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_MEDIAN) {
+
+    mRootPtr = &kernel;
+    mRadius = 1;
+    mCellSize = e->getSizeBytes();
+}
+
+RsdCpuScriptIntrinsicMedian::~RsdCpuScriptIntrinsicMedian() {
+}
+
+void RsdCpuScriptIntrinsicMedian::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 2;
+}
+
+void RsdCpuScriptIntrinsicMedian::invokeFreeChildren() {
+    mAlloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Median(RsdCpuReferenceImpl *ctx,
+                                       const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicMedian(ctx, s, e);
+}
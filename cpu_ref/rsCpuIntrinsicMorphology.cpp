@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Erodes or dilates with a rectangle, the edges being repeated.  Each axis
+// is a van Herk/Gil-Werman pass: the padded line is cut into blocks the
+// size of the window, and every window is the minimum (or maximum) of a
+// suffix of one block and a prefix of the next, so the cost per pixel does
+// not depend on the radius.  Rows are filtered first, into a temporary
+// image, then the columns are filtered in strips a few cache lines wide.
+class RsdCpuScriptIntrinsicMorphology : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                               const Allocation * ain,
+                               Allocation * aout,
+                               const void * usr,
+                               uint32_t usrLen,
+                               const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicMorphology();
+    RsdCpuScriptIntrinsicMorphology(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    // Bytes across a strip of the column pass.
+    static const uint32_t kStripBytes = 64;
+
+    ObjectBaseRef<Allocation> mInput;
+    int32_t mRadiusX;
+    int32_t mRadiusY;
+    bool mDilate;
+    uint32_t mCellSize;
+
+    // The launch being run.  Each pass reads mSrc and writes mDst.
+    uint32_t mDimX;
+    uint32_t mDimY;
+    uint32_t mRx;
+    uint32_t mRy;
+    const uchar *mSrc;
+    size_t mSrcStride;
+    uchar *mDst;
+    size_t mDstStride;
+    uchar *mTmp;
+    size_t mTmpSize;
+    RsdCpuScratch mScratch;
+    // Set by cells that couldn't get scratch and were left unwritten.
+    volatile int32_t mScratchFailed;
+
+    // Returns false if some cells couldn't be run for lack of memory.
+    bool launch(uint32_t slot, const Allocation *in, Allocation *aout, const void *usr,
+                uint32_t usrLen, const RsScriptCall *sc, void (*kernel)(), uint32_t cells,
+                bool rows);
+
+    static void kernelH(const RsForEachStubParamStruct *p,
+                        uint32_t xstart, uint32_t xend,
+                        uint32_t instep, uint32_t outstep);
+    static void kernelV(const RsForEachStubParamStruct *p,
+                        uint32_t xstart, uint32_t xend,
+                        uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicMorphology::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    mInput.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicMorphology::setGlobalVar(uint32_t slot, const void *data,
+                                                   size_t dataLength) {
+    switch (slot) {
+    case 1:
+        rsAssert(dataLength == sizeof(int32_t) * 2);
+        mRadiusX = ((const int32_t *)data)[0];
+        mRadiusY = ((const int32_t *)data)[1];
+        break;
+    case 2:
+        rsAssert(dataLength == sizeof(int32_t));
+        mDilate = ((const int32_t *)data)[0] == RS_MORPHOLOGY_DILATE;
+        break;
+    default:
+        rsAssert(0);
+        break;
+    }
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicMorphologyMinU8_K(void *dst, const void *a, const void *b,
+                                              uint32_t count16);
+extern "C" void rsdIntrinsicMorphologyMaxU8_K(void *dst, const void *a, const void *b,
+                                              uint32_t count16);
+#endif
+
+static inline uchar Pick(uchar a, uchar b, bool dilate) {
+    return dilate ? rsMax(a, b) : rsMin(a, b);
+}
+
+// dst[i] = the min or max of a[i] and b[i]
+static void OnePick(uchar *dst, const uchar *a, const uchar *b, uint32_t count, bool dilate) {
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >= 16)) {
+        if (dilate) {
+            rsdIntrinsicMorphologyMaxU8_K(dst, a, b, count >> 4);
+        } else {
+            rsdIntrinsicMorphologyMinU8_K(dst, a, b, count >> 4);
+        }
+        i = count & ~15;
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = Pick(a[i], b[i], dilate);
+    }
+}
+
+// Filters row p->y.  The prefixes and suffixes run along the row a cell at
+// a time, so only the final pick is vectorised.
+void RsdCpuScriptIntrinsicMorphology::kernelH(const RsForEachStubParamStruct *p,
+                                              uint32_t xstart, uint32_t xend,
+                                              uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicMorphology *cp = (RsdCpuScriptIntrinsicMorphology *)p->usr;
+    const uint32_t cs = cp->mCellSize;
+    const uint32_t w = cp->mDimX;
+    const uint32_t k = cp->mRx * 2 + 1;
+    const uint32_t n = w + cp->mRx * 2;
+    const bool dilate = cp->mDilate;
+    const uchar *row = cp->mSrc + p->y * cp->mSrcStride;
+
+    uchar *g = (uchar *)cp->mScratch.get(p->lid, n * cs * 2);
+    if (!g) {
+        cp->mScratchFailed = 1;
+        return;
+    }
+    uchar *h = g + n * cs;
+    for (uint32_t i = 0; i < n; i++) {
+        const int32_t x = rsMin(rsMax((int32_t)i - (int32_t)cp->mRx, 0), (int32_t)w - 1);
+        const uchar *px = row + x * cs;
+        uchar *gi = g + i * cs;
+        if (i % k) {
+            const uchar *prev = gi - cs;
+            for (uint32_t c = 0; c < cs; c++) {
+                gi[c] = Pick(prev[c], px[c], dilate);
+            }
+        } else {
+            memcpy(gi, px, cs);
+        }
+    }
+    for (uint32_t i = n; i-- > 0; ) {
+        const int32_t x = rsMin(rsMax((int32_t)i - (int32_t)cp->mRx, 0), (int32_t)w - 1);
+        const uchar *px = row + x * cs;
+        uchar *hi = h + i * cs;
+        if (((i % k) != (k - 1)) && (i != (n - 1))) {
+            const uchar *next = hi + cs;
+            for (uint32_t c = 0; c < cs; c++) {
+                hi[c] = Pick(next[c], px[c], dilate);
+            }
+        } else {
+            memcpy(hi, px, cs);
+        }
+    }
+    OnePick(cp->mDst + p->y * cp->mDstStride, h, g + (k - 1) * cs, w * cs, dilate);
+}
+
+// Filters the columns of strips [xstart, xend).  Here every step works on
+// a whole strip of a row, so all of it is vectorised.
+void RsdCpuScriptIntrinsicMorphology::kernelV(const RsForEachStubParamStruct *p,
+                                              uint32_t xstart, uint32_t xend,
+                                              uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicMorphology *cp = (RsdCpuScriptIntrinsicMorphology *)p->usr;
+    const uint32_t rowBytes = cp->mDimX * cp->mCellSize;
+    const uint32_t hgt = cp->mDimY;
+    const uint32_t k = cp->mRy * 2 + 1;
+    const uint32_t n = hgt + cp->mRy * 2;
+    const bool dilate = cp->mDilate;
+
+    uchar *g = (uchar *)cp->mScratch.get(p->lid, n * kStripBytes * 2);
+    if (!g) {
+        cp->mScratchFailed = 1;
+        return;
+    }
+    uchar *h = g + n * kStripBytes;
+    for (uint32_t s = xstart; s < xend; s++) {
+        const uint32_t b1 = s * kStripBytes;
+        const uint32_t sw = rsMin(kStripBytes, rowBytes - b1);
+        const uchar *src = cp->mSrc + b1;
+        for (uint32_t i = 0; i < n; i++) {
+            const uchar *r = src + rsMin(rsMax((int32_t)i - (int32_t)cp->mRy, 0),
+                                         (int32_t)hgt - 1) * cp->mSrcStride;
+            uchar *gi = g + i * kStripBytes;
+            if (i % k) {
+                OnePick(gi, gi - kStripBytes, r, sw, dilate);
+            } else {
+                memcpy(gi, r, sw);
+            }
+        }
+        for (uint32_t i = n; i-- > 0; ) {
+            const uchar *r = src + rsMin(rsMax((int32_t)i - (int32_t)cp->mRy, 0),
+                                         (int32_t)hgt - 1) * cp->mSrcStride;
+            uchar *hi = h + i * kStripBytes;
+            if (((i % k) != (k - 1)) && (i != (n - 1))) {
+                OnePick(hi, hi + kStripBytes, r, sw, dilate);
+            } else {
+                memcpy(hi, r, sw);
+            }
+        }
+        uchar *out = cp->mDst + b1;
+        for (uint32_t y = 0; y < hgt; y++) {
+            OnePick(out + y * cp->mDstStride, h + y * kStripBytes,
+                    g + (y + k - 1) * kStripBytes, sw, dilate);
+        }
+    }
+}
+
+bool RsdCpuScriptIntrinsicMorphology::launch(uint32_t slot, const Allocation *in,
+                                             Allocation *aout, const void *usr,
+                                             uint32_t usrLen, const RsScriptCall *sc,
+                                             void (*kernel)(), uint32_t cells, bool rows) {
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(in, aout, usr, usrLen, sc, &mtls);
+    mtls.script = this;
+    mtls.fep.slot = slot;
+    mtls.kernel = kernel;
+    mtls.fep.usr = this;
+
+    // A cell is a row of the row pass, or a strip of the column pass.
+    mtls.mTileBytes = 0;
+    mtls.fep.dimX = rows ? 1 : cells;
+    mtls.fep.dimY = rows ? cells : 1;
+    mtls.xStart = 0;
+    mtls.xEnd = mtls.fep.dimX;
+    mtls.yStart = 0;
+    mtls.yEnd = mtls.fep.dimY;
+
+    mScratchFailed = 0;
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    mCtx->launchThreads(in, aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    if (mScratchFailed) {
+        mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY, "Out of memory for morphology");
+        return false;
+    }
+    return true;
+}
+
+void RsdCpuScriptIntrinsicMorphology::invokeForEach(uint32_t slot,
+                                                    const Allocation * ain,
+                                                    Allocation * aout,
+                                                    const void * usr,
+                                                    uint32_t usrLen,
+                                                    const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    const Allocation *in = mInput.get();
+    if (!in || !aout || !in->mHal.drvState.lod[0].mallocPtr ||
+        !aout->mHal.drvState.lod[0].mallocPtr) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Morphology called without input or output");
+        return;
+    }
+    mDimX = aout->mHal.drvState.lod[0].dimX;
+    mDimY = rsMax(aout->mHal.drvState.lod[0].dimY, 1u);
+    if ((in->mHal.drvState.lod[0].dimX != mDimX) ||
+        (rsMax(in->mHal.drvState.lod[0].dimY, 1u) != mDimY)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Morphology input and output sizes differ");
+        return;
+    }
+
+    // With the edges repeated, a window wider than the image picks the
+    // same as one just as wide.
+    mRx = rsMin((uint32_t)rsMax(mRadiusX, 0), mDimX - 1);
+    mRy = rsMin((uint32_t)rsMax(mRadiusY, 0), mDimY - 1);
+    const uchar *src = (const uchar *)in->mHal.drvState.lod[0].mallocPtr;
+    const size_t srcStride = in->mHal.drvState.lod[0].stride;
+    uchar *dst = (uchar *)aout->mHal.drvState.lod[0].mallocPtr;
+    const size_t dstStride = aout->mHal.drvState.lod[0].stride;
+    const uint32_t rowBytes = mDimX * mCellSize;
+
+    if (mRy == 0) {
+        mSrc = src;
+        mSrcStride = srcStride;
+        mDst = dst;
+        mDstStride = dstStride;
+        launch(slot, in, aout, usr, usrLen, sc, (void (*)())&kernelH, mDimY, true);
+        return;
+    }
+
+    mSrc = src;
+    mSrcStride = srcStride;
+    if (mRx) {
+        size_t bytes = (size_t)rowBytes * mDimY;
+        if (bytes > mTmpSize) {
+            uchar *t = (uchar *)realloc(mTmp, bytes);
+            if (!t) {
+                mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                             "Out of memory for morphology");
+                return;
+            }
+            mTmp = t;
+            mTmpSize = bytes;
+        }
+        mDst = mTmp;
+        mDstStride = rowBytes;
+        if (!launch(slot, in, aout, usr, usrLen, sc, (void (*)())&kernelH, mDimY, true)) {
+            return;
+        }
+        mSrc = mTmp;
+        mSrcStride = rowBytes;
+    }
+    mDst = dst;
+    mDstStride = dstStride;
+    launch(slot, in, aout, usr, usrLen, sc, (void (*)())&kernelV,
+           (rowBytes + kStripBytes - 1) / kStripBytes, false);
+}
+
+RsdCpuScriptIntrinsicMorphology::RsdCpuScriptIntrinsicMorphology(RsdCpuReferenceImpl *ctx,
+                                                                 const Script *s,
+                                                                 const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY),
+              mScratch(ctx->getThreadCount()) {
+
+    mRootPtr = &kernelH;
+    mRadiusX = 1;
+    mRadiusY = 1;
+    mDilate = false;
+    mCellSize = e->getSizeBytes();
+    mDimX = 0;
+    mDimY = 0;
+    mRx = 0;
+    mRy = 0;
+    mScratchFailed = 0;
+    mSrc = NULL;
+    mSrcStride = 0;
+    mDst = NULL;
+    mDstStride = 0;
+    mTmp = NULL;
+    mTmpSize = 0;
+}
+
+RsdCpuScriptIntrinsicMorphology::~RsdCpuScriptIntrinsicMorphology() {
+    free(mTmp);
+}
+
+void RsdCpuScriptIntrinsicMorphology::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 3;
+}
+
+void RsdCpuScriptIntrinsicMorphology::invokeFreeChildren() {
+    mInput.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Morphology(RsdCpuReferenceImpl *ctx,
+                                           const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicMorphology(ctx, s, e);
+}
@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Writes the levels of a Gaussian or Laplacian pyramid of the input into
+// the mipmap levels of the output.  Each level is the one below it
+// filtered with a 5 tap binomial kernel and decimated by two.  Laplacian
+// levels hold the difference between a Gaussian level and the next one
+// expanded by linear interpolation, the last level being Gaussian.
+//
+// Up to kFusedLevels downsamplings run in a single launch.  It is split
+// into bands of rows that are the same fraction of every level, and each
+// band computes all its levels from its own rows of the source plus the
+// few rows around them its filters reach.  Deeper pyramids take more
+// launches, each continuing from a float copy of the last level the
+// previous one made.
+class RsdCpuScriptIntrinsicPyramid : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                               const Allocation * ain,
+                               Allocation * aout,
+                               const void * usr,
+                               uint32_t usrLen,
+                               const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicPyramid();
+    RsdCpuScriptIntrinsicPyramid(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    static const uint32_t kFusedLevels = 4;
+    // Rows of the source level in a band, before the filters' reach.
+    static const uint32_t kBandRows = 64;
+
+    // The levels one launch makes, the first being its source.
+    struct Pass {
+        uint32_t firstLevel;
+        uint32_t levels;
+        bool last;
+        const uchar *src;
+        size_t srcStride;
+        bool srcFloat;
+        // Where the last level goes for the next launch, unless last.
+        float *carry;
+        uint32_t bandRows;
+        uint32_t dimX[kFusedLevels + 1];
+        uint32_t dimY[kFusedLevels + 1];
+    };
+
+    ObjectBaseRef<Allocation> mInput;
+    int32_t mMode;
+    uint32_t mLevels;
+    bool mFloat;
+    uint32_t mChannels;
+    Pass mPass;
+    Allocation *mOut;
+    float *mCarry[2];
+    size_t mCarrySize[2];
+    RsdCpuScratch mScratch;
+    // Set by bands that couldn't get scratch; the levels they left
+    // unwritten end the launch.
+    volatile int32_t mScratchFailed;
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicPyramid::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    mInput.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicPyramid::setGlobalVar(uint32_t slot, const void *data,
+                                                size_t dataLength) {
+    rsAssert(dataLength == 4);
+    switch (slot) {
+    case 1:
+        mMode = ((const int32_t *)data)[0];
+        break;
+    case 2:
+        mLevels = ((const uint32_t *)data)[0];
+        break;
+    default:
+        rsAssert(0);
+        break;
+    }
+}
+
+extern "C" void rsdIntrinsicConvolveAxpy_K(float *dst, const float *src, const float *w,
+                                           uint32_t count8);
+
+static const float kWeights[5] = {1.f / 16, 4.f / 16, 6.f / 16, 4.f / 16, 1.f / 16};
+
+// acc[i] += w * row[i] over a row of floats or bytes.
+static void OneAccumulate(float *acc, const uchar *row, bool isFloat, float w,
+                          uint32_t count) {
+    uint32_t i = 0;
+    if (isFloat) {
+        const float *src = (const float *)row;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+        if (gArchUseSIMD && (count >= 8)) {
+            rsdIntrinsicConvolveAxpy_K(acc, src, &w, count >> 3);
+            i = count & ~7;
+        }
+#endif
+        for (; i < count; i++) {
+            acc[i] += w * src[i];
+        }
+    } else {
+        for (; i < count; i++) {
+            acc[i] += w * (float)row[i];
+        }
+    }
+}
+
+// Filters and decimates the vertically filtered row acc of dimX cells.
+static void OneDecimateH(float *dst, const float *acc, uint32_t dimX, uint32_t outDimX,
+                         uint32_t ch) {
+    for (uint32_t i = 0; i < outDimX; i++) {
+        const int x = (int)i * 2;
+        int cols[5];
+        for (int t = 0; t < 5; t++) {
+            cols[t] = rsMin(rsMax(x + t - 2, 0), (int)dimX - 1) * ch;
+        }
+        for (uint32_t c = 0; c < ch; c++) {
+            dst[c] = acc[cols[0] + c] * kWeights[0] + acc[cols[1] + c] * kWeights[1] +
+                     acc[cols[2] + c] * kWeights[2] + acc[cols[3] + c] * kWeights[3] +
+                     acc[cols[4] + c] * kWeights[4];
+        }
+        dst += ch;
+    }
+}
+
+// dst = row - the cells of the next level's rows r0 and r1 expanded by
+// linear interpolation, wy being the weight of r1.
+static void OneSubtractExpanded(float *dst, const float *row, const float *r0,
+                                const float *r1, float wy, uint32_t dimX,
+                                uint32_t nextDimX, uint32_t ch) {
+    for (uint32_t x = 0; x < dimX; x++) {
+        const uint32_t x0 = rsMin(x >> 1, nextDimX - 1);
+        const uint32_t x1 = (x & 1) ? rsMin(x0 + 1, nextDimX - 1) : x0;
+        const float wx = (x & 1) ? 0.5f : 0.f;
+        for (uint32_t c = 0; c < ch; c++) {
+            float top = r0[x0 * ch + c] + (r0[x1 * ch + c] - r0[x0 * ch + c]) * wx;
+            float bot = r1[x0 * ch + c] + (r1[x1 * ch + c] - r1[x0 * ch + c]) * wx;
+            dst[x * ch + c] = row[x * ch + c] - (top + (bot - top) * wy);
+        }
+    }
+}
+
+static void OneStore(uchar *dst, const float *src, bool isFloat, uint32_t count) {
+    if (isFloat) {
+        memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        float f = src[i] + 0.5f;
+        dst[i] = (uchar)((f >= 255.f) ? 255.f : ((f > 0.f) ? f : 0.f));
+    }
+}
+
+void RsdCpuScriptIntrinsicPyramid::kernel(const RsForEachStubParamStruct *p,
+                                          uint32_t xstart, uint32_t xend,
+                                          uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicPyramid *cp = (RsdCpuScriptIntrinsicPyramid *)p->usr;
+    const Pass &pass = cp->mPass;
+    const uint32_t top = pass.levels - 1;
+    const uint32_t ch = cp->mChannels;
+    const Allocation *out = cp->mOut;
+
+    // The rows of each level the band writes, and the rows it computes to
+    // get there: the filters of the level above and the expansion of the
+    // level below each reach a couple of rows past them.
+    int ownStart[kFusedLevels + 1];
+    int ownEnd[kFusedLevels + 1];
+    int reqStart[kFusedLevels + 1];
+    int reqEnd[kFusedLevels + 1];
+    for (uint32_t j = 0; j <= top; j++) {
+        const int rows = pass.bandRows >> j;
+        ownStart[j] = rsMin((int)p->y * rows, (int)pass.dimY[j]);
+        ownEnd[j] = rsMin((int)(p->y + 1) * rows, (int)pass.dimY[j]);
+    }
+    reqStart[top] = ownStart[top];
+    reqEnd[top] = rsMin(ownEnd[top] + 1, (int)pass.dimY[top]);
+    for (int j = (int)top - 1; j >= 0; j--) {
+        reqStart[j] = rsMax(reqStart[j + 1] * 2 - 2, 0);
+        reqEnd[j] = rsMin(reqEnd[j + 1] * 2 + 1, (int)pass.dimY[j]);
+    }
+
+    const uint32_t cols0 = pass.dimX[0] * ch;
+    size_t floats = cols0 * 2;
+    for (uint32_t j = 1; j <= top; j++) {
+        floats += rsMax(reqEnd[j] - reqStart[j], 0) * pass.dimX[j] * ch;
+    }
+    float *acc = (float *)cp->mScratch.get(p->lid, floats * sizeof(float));
+    if (!acc) {
+        cp->mScratchFailed = 1;
+        return;
+    }
+    float *tmp = acc + cols0;
+    float *levels[kFusedLevels + 1];
+    levels[0] = NULL;
+    float *next = tmp + cols0;
+    for (uint32_t j = 1; j <= top; j++) {
+        levels[j] = next;
+        next += rsMax(reqEnd[j] - reqStart[j], 0) * pass.dimX[j] * ch;
+    }
+
+    // Every level from the one below, a vertical then a horizontal pass
+    // per row, only at the rows and columns that are kept.
+    for (uint32_t j = 0; j < top; j++) {
+        const uint32_t cols = pass.dimX[j] * ch;
+        for (int r = reqStart[j + 1]; r < reqEnd[j + 1]; r++) {
+            memset(acc, 0, cols * sizeof(float));
+            for (int t = 0; t < 5; t++) {
+                const int y = rsMin(rsMax(r * 2 + t - 2, 0), (int)pass.dimY[j] - 1);
+                if (j == 0) {
+                    OneAccumulate(acc, pass.src + y * pass.srcStride, pass.srcFloat,
+                                  kWeights[t], cols);
+                } else {
+                    OneAccumulate(acc, (const uchar *)(levels[j] + (y - reqStart[j]) * cols),
+                                  true, kWeights[t], cols);
+                }
+            }
+            OneDecimateH(levels[j + 1] + (r - reqStart[j + 1]) * pass.dimX[j + 1] * ch, acc,
+                         pass.dimX[j], pass.dimX[j + 1], ch);
+        }
+    }
+
+    const bool laplacian = cp->mMode == RS_PYRAMID_LAPLACIAN;
+    for (uint32_t j = 0; j <= top; j++) {
+        const uint32_t cols = pass.dimX[j] * ch;
+        if ((j == top) && !pass.last) {
+            // Made again as the source of the next launch.
+            for (int y = ownStart[j]; y < ownEnd[j]; y++) {
+                memcpy(pass.carry + y * cols, levels[j] + (y - reqStart[j]) * cols,
+                       cols * sizeof(float));
+            }
+            break;
+        }
+
+        const Allocation::Hal::DrvState::LodState &lod =
+                out->mHal.drvState.lod[pass.firstLevel + j];
+        for (int y = ownStart[j]; y < ownEnd[j]; y++) {
+            uchar *dst = (uchar *)lod.mallocPtr + y * lod.stride;
+            const float *row;
+            if (j) {
+                row = levels[j] + (y - reqStart[j]) * cols;
+            } else if (pass.srcFloat) {
+                row = (const float *)(pass.src + y * pass.srcStride);
+            } else if (!laplacian && !cp->mFloat) {
+                memcpy(dst, pass.src + y * pass.srcStride, cols);
+                continue;
+            } else {
+                for (uint32_t i = 0; i < cols; i++) {
+                    tmp[i] = (float)pass.src[y * pass.srcStride + i];
+                }
+                row = tmp;
+            }
+
+            if (laplacian && (j < top)) {
+                const uint32_t nextCols = pass.dimX[j + 1] * ch;
+                const int y0 = rsMin(y >> 1, (int)pass.dimY[j + 1] - 1);
+                const int y1 = (y & 1) ? rsMin(y0 + 1, (int)pass.dimY[j + 1] - 1) : y0;
+                OneSubtractExpanded(acc, row, levels[j + 1] + (y0 - reqStart[j + 1]) * nextCols,
+                                    levels[j + 1] + (y1 - reqStart[j + 1]) * nextCols,
+                                    (y & 1) ? 0.5f : 0.f, pass.dimX[j], pass.dimX[j + 1], ch);
+                row = acc;
+            }
+            OneStore(dst, row, cp->mFloat, cols);
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicPyramid::invokeForEach(uint32_t slot,
+                                                 const Allocation * ain,
+                                                 Allocation * aout,
+                                                 const void * usr,
+                                                 uint32_t usrLen,
+                                                 const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    const Allocation *in = mInput.get();
+    if (!in || !aout || !in->mHal.drvState.lod[0].mallocPtr ||
+        !aout->mHal.drvState.lod[0].mallocPtr) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Pyramid called without input or output");
+        return;
+    }
+    const Type *t = aout->mHal.state.type;
+    if ((in->mHal.drvState.lod[0].dimX != aout->mHal.drvState.lod[0].dimX) ||
+        (in->mHal.drvState.lod[0].dimY != aout->mHal.drvState.lod[0].dimY)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Pyramid input and output sizes differ");
+        return;
+    }
+    uint32_t levels = t->getLODCount();
+    if (mLevels && (mLevels < levels)) {
+        levels = mLevels;
+    }
+
+    mOut = aout;
+    mPass.src = (const uchar *)in->mHal.drvState.lod[0].mallocPtr;
+    mPass.srcStride = in->mHal.drvState.lod[0].stride;
+    mPass.srcFloat = in->mHal.state.type->getElement()->getType() == RS_TYPE_FLOAT_32;
+
+    uint32_t first = 0;
+    int carry = 0;
+    while (true) {
+        mPass.firstLevel = first;
+        mPass.levels = rsMin(levels - first, kFusedLevels + 1);
+        mPass.last = (first + mPass.levels) == levels;
+        const uint32_t top = mPass.levels - 1;
+        for (uint32_t j = 0; j <= top; j++) {
+            mPass.dimX[j] = aout->mHal.drvState.lod[first + j].dimX;
+            mPass.dimY[j] = rsMax(aout->mHal.drvState.lod[first + j].dimY, 1u);
+        }
+        mPass.bandRows = kBandRows;
+        mPass.carry = NULL;
+        if (!mPass.last) {
+            size_t bytes = mPass.dimX[top] * mPass.dimY[top] * mChannels * sizeof(float);
+            if (bytes > mCarrySize[carry]) {
+                float *c = (float *)realloc(mCarry[carry], bytes);
+                if (!c) {
+                    mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                                 "Out of memory for pyramid levels");
+                    return;
+                }
+                mCarry[carry] = c;
+                mCarrySize[carry] = bytes;
+            }
+            mPass.carry = mCarry[carry];
+        }
+
+        MTLaunchStruct mtls;
+        forEachMtlsSetup(in, aout, usr, usrLen, sc, &mtls);
+        mtls.script = this;
+        mtls.fep.slot = slot;
+        mtls.kernel = (void (*)())&kernel;
+        mtls.fep.usr = this;
+
+        // One cell per band, the bands being the tiles.
+        const uint32_t bands = (mPass.dimY[0] + kBandRows - 1) / kBandRows;
+        mtls.mTileBytes = 0;
+        mtls.fep.dimX = 1;
+        mtls.fep.dimY = bands;
+        mtls.xStart = 0;
+        mtls.xEnd = 1;
+        mtls.yStart = 0;
+        mtls.yEnd = bands;
+
+        mScratchFailed = 0;
+        RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+        RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+        mCtx->launchThreads(in, aout, sc, &mtls);
+        mCtx->setTLS(oldTLS);
+        mCtx->leaveLane(lane);
+        if (mScratchFailed) {
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                         "Out of memory for pyramid bands");
+            return;
+        }
+
+        if (mPass.last) {
+            break;
+        }
+        mPass.src = (const uchar *)mPass.carry;
+        mPass.srcStride = mPass.dimX[top] * mChannels * sizeof(float);
+        mPass.srcFloat = true;
+        first += top;
+        carry ^= 1;
+    }
+}
+
+RsdCpuScriptIntrinsicPyramid::RsdCpuScriptIntrinsicPyramid(RsdCpuReferenceImpl *ctx,
+                                                           const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_PYRAMID),
+              mScratch(ctx->getThreadCount()) {
+
+    mRootPtr = &kernel;
+    mMode = RS_PYRAMID_GAUSSIAN;
+    mLevels = 0;
+    mFloat = (e->getType() == RS_TYPE_FLOAT_32);
+    // Three component elements are padded to four.
+    mChannels = (e->getVectorSize() == 3) ? 4 : e->getVectorSize();
+    memset(&mPass, 0, sizeof(mPass));
+    mOut = NULL;
+    memset(mCarry, 0, sizeof(mCarry));
+    memset(mCarrySize, 0, sizeof(mCarrySize));
+    mScratchFailed = 0;
+}
+
+RsdCpuScriptIntrinsicPyramid::~RsdCpuScriptIntrinsicPyramid() {
+    free(mCarry[0]);
+    free(mCarry[1]);
+}
+
+void RsdCpuScriptIntrinsicPyramid::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 3;
+}
+
+void RsdCpuScriptIntrinsicPyramid::invokeFreeChildren() {
+    mInput.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Pyramid(RsdCpuReferenceImpl *ctx,
+                                        const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicPyramid(ctx, s, e);
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// The inverse of YuvToRGB.  The launch runs over the RGBA input and the
+// YUV allocation is bound as the output, so every plane layout the YUV
+// allocation can describe is written through its own plane pointers,
+// strides and chroma step.
+class RsdCpuScriptIntrinsicRGBToYuv : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual bool writesObjects() const { return true; }
+
+    virtual ~RsdCpuScriptIntrinsicRGBToYuv();
+    RsdCpuScriptIntrinsicRGBToYuv(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    ObjectBaseRef<Allocation> alloc;
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicRGBToYuv::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    alloc.set(static_cast<Allocation *>(data));
+}
+
+
+// BT.601 video range, matching the coefficients YuvToRGB inverts.
+static inline uchar rsRGBToY(int r, int g, int b) {
+    return (uchar)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline uchar rsRGBToU(int r, int g, int b) {
+    return (uchar)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline uchar rsRGBToV(int r, int g, int b) {
+    return (uchar)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+extern "C" void rsdIntrinsicRGBToLuma_K(uchar *dst, const uchar4 *src, uint32_t count8);
+
+void RsdCpuScriptIntrinsicRGBToYuv::kernel(const RsForEachStubParamStruct *p,
+                                           uint32_t xstart, uint32_t xend,
+                                           uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicRGBToYuv *cp = (RsdCpuScriptIntrinsicRGBToYuv *)p->usr;
+    if (!cp->alloc.get()) {
+        ALOGE("RGBToYuv executed without output, skipping");
+        return;
+    }
+    uchar *poutY = (uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
+    if (poutY == NULL) {
+        ALOGE("RGBToYuv executed without data, skipping");
+        return;
+    }
+
+    size_t strideY = cp->alloc->mHal.drvState.lod[0].stride;
+
+    // calculate correct stride in legacy case
+    if (cp->alloc->mHal.drvState.lod[0].dimY == 0) {
+        strideY = p->dimX;
+    }
+
+    // The row pointer of the input is for xstart; rin is indexed by x.
+    const uchar4 *rin = ((const uchar4 *)p->in) - xstart;
+    uchar *Y = poutY + (p->y * strideY);
+    uint32_t x1 = xstart;
+    uint32_t x2 = xend;
+
+#if defined(ARCH_ARM_USE_INTRINSICS)
+    if (gArchUseSIMD) {
+        uint32_t len = (x2 - x1) >> 3;
+        if (len > 0) {
+            rsdIntrinsicRGBToLuma_K(Y + x1, rin + x1, len);
+            x1 += len << 3;
+        }
+    }
+#endif
+
+    while (x1 < x2) {
+        uchar4 px = rin[x1];
+        Y[x1] = rsRGBToY(px.x, px.y, px.z);
+        x1++;
+    }
+
+    // Even rows also write the chroma of the 2x2 block below and to the
+    // right of each even pixel, averaged over the block.
+    if (p->y & 1) {
+        return;
+    }
+
+    size_t cstep = cp->alloc->mHal.drvState.yuv.step;
+    uchar *poutU = (uchar *)cp->alloc->mHal.drvState.lod[1].mallocPtr;
+    const size_t strideU = cp->alloc->mHal.drvState.lod[1].stride;
+    uchar *u = poutU + ((p->y >> 1) * strideU);
+
+    uchar *poutV = (uchar *)cp->alloc->mHal.drvState.lod[2].mallocPtr;
+    const size_t strideV = cp->alloc->mHal.drvState.lod[2].stride;
+    uchar *v = poutV + ((p->y >> 1) * strideV);
+
+    if (poutU == NULL) {
+        // Legacy yuv support didn't fill in uv
+        v = poutY + (strideY * p->dimY) + ((p->y >> 1) * strideY);
+        u = v + 1;
+        cstep = 2;
+    }
+
+    const uchar4 *rin2 = rin;
+    if ((p->y + 1) < p->dimY) {
+        rin2 = (const uchar4 *)(((const uchar *)rin) + p->yStrideIn);
+    }
+
+    // Each block belongs to the launch that owns its even pixel.
+    for (uint32_t x = (xstart + 1) & ~1; x < xend; x += 2) {
+        uint32_t xn = rsMin(x + 1, p->dimX - 1);
+        int4 sum = convert_int4(rin[x]) + convert_int4(rin[xn]) +
+                   convert_int4(rin2[x]) + convert_int4(rin2[xn]);
+        sum = (sum + 2) >> 2;
+        size_t cx = (x >> 1) * cstep;
+        u[cx] = rsRGBToU(sum.x, sum.y, sum.z);
+        v[cx] = rsRGBToV(sum.x, sum.y, sum.z);
+    }
+}
+
+RsdCpuScriptIntrinsicRGBToYuv::RsdCpuScriptIntrinsicRGBToYuv(
+            RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV) {
+
+    mRootPtr = &kernel;
+}
+
+RsdCpuScriptIntrinsicRGBToYuv::~RsdCpuScriptIntrinsicRGBToYuv() {
+}
+
+void RsdCpuScriptIntrinsicRGBToYuv::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 1;
+}
+
+void RsdCpuScriptIntrinsicRGBToYuv::invokeFreeChildren() {
+    alloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_RGBToYuv(RsdCpuReferenceImpl *ctx,
+                                         const Script *s, const Element *e) {
+    return new RsdCpuScriptIntrinsicRGBToYuv(ctx, s, e);
+}
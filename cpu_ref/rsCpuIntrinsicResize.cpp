@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Scales the input allocation to the size of the output allocation.  The
+// filter is separable: before each launch every output column and row gets
+// a list of source taps and weights, then each output row is a vertical
+// pass into a per-thread float row followed by a horizontal pass over it.
+class RsdCpuScriptIntrinsicResize : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void preLaunch(uint32_t slot, const Allocation * ain,
+                           Allocation * aout, const void * usr,
+                           uint32_t usrLen, const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicResize();
+    RsdCpuScriptIntrinsicResize(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    // The source taps of one output coordinate along one axis.
+    struct Taps {
+        int *mStart;
+        float *mWeights;
+        int mCount;
+        uint32_t mSize;
+    };
+
+    ObjectBaseRef<Allocation> alloc;
+    int32_t mMode;
+    bool mFloat;
+    int mChannels;
+    Taps mTapsX;
+    Taps mTapsY;
+    RsdCpuScratch mScratch;
+
+    bool buildTaps(Taps *t, uint32_t inSize, uint32_t outSize);
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicResize::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    alloc.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicResize::setGlobalVar(uint32_t slot, const void *data,
+                                               size_t dataLength) {
+    rsAssert(slot == 1);
+    rsAssert(dataLength == sizeof(int32_t));
+    mMode = ((const int32_t *)data)[0];
+}
+
+// Keys' cubic with a = -0.5, the usual choice for image scaling.
+static float cubicWeight(float t) {
+    t = fabsf(t);
+    if (t < 1.f) {
+        return (1.5f * t - 2.5f) * t * t + 1.f;
+    }
+    if (t < 2.f) {
+        return ((-0.5f * t + 2.5f) * t - 4.f) * t + 2.f;
+    }
+    return 0.f;
+}
+
+// Fills t with the taps of every output coordinate.  Bicubic widens its
+// kernel by the scale factor when shrinking so every source pixel still
+// contributes.  Area weights each source pixel by how much of it the
+// output pixel covers.
+bool RsdCpuScriptIntrinsicResize::buildTaps(Taps *t, uint32_t inSize, uint32_t outSize) {
+    const float scale = (float)inSize / (float)outSize;
+    const float support = rsMax(scale, 1.f);
+    int count;
+    switch (mMode) {
+    case RS_RESIZE_BICUBIC:
+        count = (int)ceilf(support * 4.f) + 1;
+        break;
+    case RS_RESIZE_AREA:
+        count = (int)ceilf(scale) + 1;
+        break;
+    default:
+        count = 2;
+        break;
+    }
+
+    if ((outSize > t->mSize) || (count > t->mCount)) {
+        // A failed realloc leaves the old block, so only successes are kept.
+        int *start = (int *)realloc(t->mStart, outSize * sizeof(int));
+        if (start) {
+            t->mStart = start;
+        }
+        float *weights = (float *)realloc(t->mWeights, outSize * count * sizeof(float));
+        if (weights) {
+            t->mWeights = weights;
+        }
+        if (!start || !weights) {
+            ALOGE("Resize could not allocate filter taps");
+            free(t->mStart);
+            free(t->mWeights);
+            t->mStart = NULL;
+            t->mWeights = NULL;
+            t->mSize = 0;
+            t->mCount = 0;
+            return false;
+        }
+        t->mSize = outSize;
+    }
+    t->mCount = count;
+
+    for (uint32_t o = 0; o < outSize; o++) {
+        float *w = &t->mWeights[o * count];
+        const float center = (o + 0.5f) * scale - 0.5f;
+        int start;
+        memset(w, 0, count * sizeof(float));
+
+        switch (mMode) {
+        case RS_RESIZE_BICUBIC:
+            start = (int)floorf(center - support * 2.f) + 1;
+            for (int k = 0; k < count; k++) {
+                w[k] = cubicWeight((start + k - center) / support);
+            }
+            break;
+        case RS_RESIZE_AREA: {
+            const float a = o * scale;
+            const float b = a + scale;
+            start = (int)floorf(a);
+            for (int k = 0; k < count; k++) {
+                float lo = rsMax(a, (float)(start + k));
+                float hi = rsMin(b, (float)(start + k + 1));
+                w[k] = rsMax(hi - lo, 0.f);
+            }
+            break;
+        }
+        default:
+            start = (int)floorf(center);
+            w[1] = center - start;
+            w[0] = 1.f - w[1];
+            break;
+        }
+
+        float sum = 0.f;
+        for (int k = 0; k < count; k++) {
+            sum += w[k];
+        }
+        for (int k = 0; k < count; k++) {
+            w[k] /= sum;
+        }
+        t->mStart[o] = start;
+    }
+    return true;
+}
+
+void RsdCpuScriptIntrinsicResize::preLaunch(uint32_t slot, const Allocation * ain,
+                                            Allocation * aout, const void * usr,
+                                            uint32_t usrLen, const RsScriptCall *sc) {
+    if (!alloc.get() || !aout) {
+        return;
+    }
+    const Type *tin = alloc->getType();
+    const Type *tout = aout->getType();
+    if (!buildTaps(&mTapsX, tin->getDimX(), tout->getDimX()) ||
+        !buildTaps(&mTapsY, rsMax(tin->getDimY(), 1u), rsMax(tout->getDimY(), 1u))) {
+        alloc.clear();
+    }
+}
+
+extern "C" void rsdIntrinsicConvolveAxpy_K(float *dst, const float *src, const float *w,
+                                           uint32_t count8);
+
+// dst[i] += w * src[i]
+static void OneAxpy(float *dst, const float *src, float w, uint32_t count) {
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >= 8)) {
+        rsdIntrinsicConvolveAxpy_K(dst, src, &w, count >> 3);
+        i = count & ~7;
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] += w * src[i];
+    }
+}
+
+static void OneH4(float4 *out, const float4 *in, const int *start, const float *weights,
+                  int count, int inX1, int inSize, uint32_t x1, uint32_t x2) {
+    for (uint32_t x = x1; x < x2; x++) {
+        const float *w = &weights[x * count];
+        float4 px = 0.f;
+        for (int k = 0; k < count; k++) {
+            int sx = rsMin(rsMax(start[x] + k, 0), inSize - 1);
+            px += in[sx - inX1] * w[k];
+        }
+        *out = px;
+        out++;
+    }
+}
+
+static void OneH(float *out, const float *in, const int *start, const float *weights,
+                 int count, int inX1, int inSize, int ch, uint32_t x1, uint32_t x2) {
+    for (uint32_t x = x1; x < x2; x++) {
+        const float *w = &weights[x * count];
+        for (int c = 0; c < ch; c++) {
+            out[c] = 0.f;
+        }
+        for (int k = 0; k < count; k++) {
+            int sx = rsMin(rsMax(start[x] + k, 0), inSize - 1);
+            const float *px = &in[(sx - inX1) * ch];
+            for (int c = 0; c < ch; c++) {
+                out[c] += px[c] * w[k];
+            }
+        }
+        out += ch;
+    }
+}
+
+void RsdCpuScriptIntrinsicResize::kernel(const RsForEachStubParamStruct *p,
+                                         uint32_t xstart, uint32_t xend,
+                                         uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicResize *cp = (RsdCpuScriptIntrinsicResize *)p->usr;
+    if (!cp->alloc.get()) {
+        ALOGE("Resize executed without input, skipping");
+        return;
+    }
+    const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
+    const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
+    const int inDimX = cp->alloc->mHal.drvState.lod[0].dimX;
+    const int inDimY = rsMax(cp->alloc->mHal.drvState.lod[0].dimY, 1u);
+    const int ch = cp->mChannels;
+    const Taps &tx = cp->mTapsX;
+    const Taps &ty = cp->mTapsY;
+
+    // Source columns reached by the taps of [xstart, xend).
+    int inX1 = rsMax(tx.mStart[xstart], 0);
+    int inX2 = rsMin(tx.mStart[xend - 1] + tx.mCount, inDimX);
+    const uint32_t cols = (inX2 - inX1) * ch;
+    const uint32_t outCols = (xend - xstart) * ch;
+
+    size_t colBytes = (cols * sizeof(float) + 15) & ~15;
+    uchar *scratch = (uchar *)cp->mScratch.get(p->lid, colBytes * 2 + outCols * sizeof(float));
+    if (!scratch) {
+        ALOGE("Resize out of memory for its rows, skipping a row");
+        return;
+    }
+    float *rowf = (float *)scratch;
+    float *tmp = (float *)(scratch + colBytes);
+    float *acc = (float *)(scratch + colBytes * 2);
+
+    memset(tmp, 0, cols * sizeof(float));
+    const float *wy = &ty.mWeights[p->y * ty.mCount];
+    for (int k = 0; k < ty.mCount; k++) {
+        if (wy[k] == 0.f) {
+            continue;
+        }
+        int sy = rsMin(rsMax(ty.mStart[p->y] + k, 0), inDimY - 1);
+        const uchar *row = pin + sy * stride;
+        const float *src;
+        if (cp->mFloat) {
+            src = ((const float *)row) + inX1 * ch;
+        } else {
+            const uchar *px = row + inX1 * ch;
+            for (uint32_t i = 0; i < cols; i++) {
+                rowf[i] = (float)px[i];
+            }
+            src = rowf;
+        }
+        OneAxpy(tmp, src, wy[k], cols);
+    }
+
+    float *hout = cp->mFloat ? (float *)p->out : acc;
+    if (ch == 4) {
+        OneH4((float4 *)hout, (const float4 *)tmp, tx.mStart, tx.mWeights, tx.mCount,
+              inX1, inDimX, xstart, xend);
+    } else {
+        OneH(hout, tmp, tx.mStart, tx.mWeights, tx.mCount, inX1, inDimX, ch, xstart, xend);
+    }
+
+    if (!cp->mFloat) {
+        uchar *out = (uchar *)p->out;
+        for (uint32_t i = 0; i < outCols; i++) {
+            out[i] = (uchar)(rsMin(rsMax(acc[i], 0.f), 255.f) + 0.5f);
+        }
+    }
+}
+
+RsdCpuScriptIntrinsicResize::RsdCpuScriptIntrinsicResize(
+            RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_RESIZE),
+              mScratch(ctx->getThreadCount()) {
+
+    mRootPtr = &kernel;
+    mMode = RS_RESIZE_BILINEAR;
+    mFloat = (e->getType() == RS_TYPE_FLOAT_32);
+    // Three component elements are padded to four.
+    mChannels = (e->getVectorSize() == 3) ? 4 : e->getVectorSize();
+    memset(&mTapsX, 0, sizeof(mTapsX));
+    memset(&mTapsY, 0, sizeof(mTapsY));
+}
+
+RsdCpuScriptIntrinsicResize::~RsdCpuScriptIntrinsicResize() {
+    free(mTapsX.mStart);
+    free(mTapsX.mWeights);
+    free(mTapsY.mStart);
+    free(mTapsY.mWeights);
+}
+
+void RsdCpuScriptIntrinsicResize::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 2;
+}
+
+void RsdCpuScriptIntrinsicResize::invokeFreeChildren() {
+    alloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Resize(RsdCpuReferenceImpl *ctx,
+                                       const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicResize(ctx, s, e);
+}
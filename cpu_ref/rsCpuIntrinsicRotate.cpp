@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Transposes, rotates by a multiple of 90 degrees or flips the input into
+// the output.  The launch is over square tiles of the output, so the
+// reads of a transposing mode stay within a tile's worth of input rows
+// rather than striding down whole columns.  Within a tile, blocks of one
+// and four byte cells are transposed in registers.
+class RsdCpuScriptIntrinsicRotate : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                               const Allocation * ain,
+                               Allocation * aout,
+                               const void * usr,
+                               uint32_t usrLen,
+                               const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicRotate();
+    RsdCpuScriptIntrinsicRotate(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    // Output cells along each side of a tile.
+    static const uint32_t kTile = 64;
+
+    ObjectBaseRef<Allocation> mInput;
+    int32_t mMode;
+    uint32_t mCellSize;
+
+    // The launch being run.  The input cell of output cell (x, y) is at
+    // mSrc + x * mSrcStepX + y * mSrcStepY.
+    const uchar *mSrc;
+    ptrdiff_t mSrcStepX;
+    ptrdiff_t mSrcStepY;
+    uchar *mDst;
+    size_t mDstStride;
+    uint32_t mDimX;
+    uint32_t mDimY;
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+    void tile(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2) const;
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicRotate::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    mInput.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicRotate::setGlobalVar(uint32_t slot, const void *data,
+                                               size_t dataLength) {
+    rsAssert(slot == 1);
+    rsAssert(dataLength == 4);
+    mMode = ((const int32_t *)data)[0];
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicTransposeU8_K(void *dst, ptrdiff_t dstStride,
+                                          const void *src, ptrdiff_t srcStride,
+                                          uint32_t count);
+extern "C" void rsdIntrinsicTransposeU32_K(void *dst, ptrdiff_t dstStride,
+                                           const void *src, ptrdiff_t srcStride,
+                                           uint32_t count);
+extern "C" void rsdIntrinsicReverseU8_K(void *dst, const void *srcEnd, uint32_t count16);
+extern "C" void rsdIntrinsicReverseU32_K(void *dst, const void *srcEnd, uint32_t count4);
+#endif
+
+template <typename T>
+static void OneRow(uchar *dst, const uchar *src, ptrdiff_t step, uint32_t count) {
+    T *d = (T *)dst;
+    for (uint32_t x = 0; x < count; x++) {
+        d[x] = *(const T *)src;
+        src += step;
+    }
+}
+
+// Copies count cells to dst from src, each next source cell step bytes
+// on from the last.
+static void OneRow(uchar *dst, const uchar *src, ptrdiff_t step, uint32_t count,
+                   uint32_t cellSize) {
+    switch (cellSize) {
+    case 1:
+        OneRow<uint8_t>(dst, src, step, count);
+        break;
+    case 2:
+        OneRow<uint16_t>(dst, src, step, count);
+        break;
+    case 4:
+        OneRow<uint32_t>(dst, src, step, count);
+        break;
+    case 8:
+        OneRow<uint64_t>(dst, src, step, count);
+        break;
+    default:
+        for (uint32_t x = 0; x < count; x++) {
+            memcpy(dst + x * cellSize, src, cellSize);
+            src += step;
+        }
+        break;
+    }
+}
+
+void RsdCpuScriptIntrinsicRotate::tile(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2) const {
+    const uint32_t cs = mCellSize;
+    uint32_t y = y1;
+
+    if (mSrcStepX == (ptrdiff_t)cs) {
+        // Rows run along input rows; only vertical flips get here.
+        for (; y < y2; y++) {
+            memcpy(mDst + y * mDstStride + x1 * cs, mSrc + x1 * mSrcStepX + y * mSrcStepY,
+                   (x2 - x1) * cs);
+        }
+        return;
+    }
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && ((cs == 1) || (cs == 4))) {
+        if (mSrcStepX == -(ptrdiff_t)cs) {
+            // Rows run backwards along input rows.
+            const uint32_t per = 16 / cs;
+            const uint32_t n = ((x2 - x1) / per) * per;
+            if (n) {
+                for (uint32_t r = y; r < y2; r++) {
+                    uchar *d = mDst + r * mDstStride + x1 * cs;
+                    const uchar *end = mSrc + x1 * mSrcStepX + r * mSrcStepY + cs;
+                    if (cs == 1) {
+                        rsdIntrinsicReverseU8_K(d, end, n / per);
+                    } else {
+                        rsdIntrinsicReverseU32_K(d, end, n / per);
+                    }
+                    OneRow(d + n * cs, end - (n + 1) * cs, mSrcStepX, x2 - x1 - n, cs);
+                }
+                return;
+            }
+        } else if ((mSrcStepY == (ptrdiff_t)cs) || (mSrcStepY == -(ptrdiff_t)cs)) {
+            // Rows run down input columns.  Blocks are transposed with the
+            // input rows read in their order in memory, a column running
+            // backwards being written from the last of the output rows.
+            const uint32_t b = (cs == 1) ? 8 : 4;
+            const uint32_t n = (x2 - x1) / b;
+            const bool up = mSrcStepY < 0;
+            for (; n && ((y + b) <= y2); y += b) {
+                const uint32_t by = up ? (y + b - 1) : y;
+                const ptrdiff_t dstStride = up ? -(ptrdiff_t)mDstStride : mDstStride;
+                uchar *d = mDst + (size_t)by * mDstStride + x1 * cs;
+                const uchar *s = mSrc + x1 * mSrcStepX + by * mSrcStepY;
+                if (cs == 1) {
+                    rsdIntrinsicTransposeU8_K(d, dstStride, s, mSrcStepX, n);
+                } else {
+                    rsdIntrinsicTransposeU32_K(d, dstStride, s, mSrcStepX, n);
+                }
+                const uint32_t xr = x1 + n * b;
+                for (uint32_t r = y; r < (y + b); r++) {
+                    OneRow(mDst + r * mDstStride + xr * cs, mSrc + xr * mSrcStepX + r * mSrcStepY,
+                           mSrcStepX, x2 - xr, cs);
+                }
+            }
+        }
+    }
+#endif
+
+    for (; y < y2; y++) {
+        OneRow(mDst + y * mDstStride + x1 * cs, mSrc + x1 * mSrcStepX + y * mSrcStepY,
+               mSrcStepX, x2 - x1, cs);
+    }
+}
+
+void RsdCpuScriptIntrinsicRotate::kernel(const RsForEachStubParamStruct *p,
+                                         uint32_t xstart, uint32_t xend,
+                                         uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicRotate *cp = (RsdCpuScriptIntrinsicRotate *)p->usr;
+    const uint32_t y1 = p->y * kTile;
+    const uint32_t y2 = rsMin(y1 + kTile, cp->mDimY);
+    for (uint32_t t = xstart; t < xend; t++) {
+        const uint32_t x1 = t * kTile;
+        cp->tile(x1, y1, rsMin(x1 + kTile, cp->mDimX), y2);
+    }
+}
+
+void RsdCpuScriptIntrinsicRotate::invokeForEach(uint32_t slot,
+                                                const Allocation * ain,
+                                                Allocation * aout,
+                                                const void * usr,
+                                                uint32_t usrLen,
+                                                const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    const Allocation *in = mInput.get();
+    if (!in || !aout || !in->mHal.drvState.lod[0].mallocPtr ||
+        !aout->mHal.drvState.lod[0].mallocPtr) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Rotate called without input or output");
+        return;
+    }
+
+    const uint32_t inX = in->mHal.drvState.lod[0].dimX;
+    const uint32_t inY = rsMax(in->mHal.drvState.lod[0].dimY, 1u);
+    mDimX = aout->mHal.drvState.lod[0].dimX;
+    mDimY = rsMax(aout->mHal.drvState.lod[0].dimY, 1u);
+    const bool swaps = (mMode == RS_ROTATE_TRANSPOSE) || (mMode == RS_ROTATE_90) ||
+                       (mMode == RS_ROTATE_270);
+    if ((swaps && ((mDimX != inY) || (mDimY != inX))) ||
+        (!swaps && ((mDimX != inX) || (mDimY != inY)))) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Rotate output size does not match the input");
+        return;
+    }
+
+    const ptrdiff_t cs = mCellSize;
+    const ptrdiff_t stride = in->mHal.drvState.lod[0].stride;
+    const uchar *base = (const uchar *)in->mHal.drvState.lod[0].mallocPtr;
+    const uchar *lastCol = base + (inX - 1) * cs;
+    const uchar *lastRow = base + (inY - 1) * stride;
+    switch (mMode) {
+    case RS_ROTATE_90:
+        // The first output row is the first input column, bottom up.
+        mSrc = lastRow;
+        mSrcStepX = -stride;
+        mSrcStepY = cs;
+        break;
+    case RS_ROTATE_180:
+        mSrc = lastRow + (inX - 1) * cs;
+        mSrcStepX = -cs;
+        mSrcStepY = -stride;
+        break;
+    case RS_ROTATE_270:
+        mSrc = lastCol;
+        mSrcStepX = stride;
+        mSrcStepY = -cs;
+        break;
+    case RS_ROTATE_FLIP_HORIZONTAL:
+        mSrc = lastCol;
+        mSrcStepX = -cs;
+        mSrcStepY = stride;
+        break;
+    case RS_ROTATE_FLIP_VERTICAL:
+        mSrc = lastRow;
+        mSrcStepX = cs;
+        mSrcStepY = -stride;
+        break;
+    default:
+        mSrc = base;
+        mSrcStepX = stride;
+        mSrcStepY = cs;
+        break;
+    }
+    mDst = (uchar *)aout->mHal.drvState.lod[0].mallocPtr;
+    mDstStride = aout->mHal.drvState.lod[0].stride;
+
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(in, aout, usr, usrLen, sc, &mtls);
+    mtls.script = this;
+    mtls.fep.slot = slot;
+    mtls.kernel = (void (*)())&kernel;
+    mtls.fep.usr = this;
+
+    // One cell per tile.
+    const uint32_t tilesX = (mDimX + kTile - 1) / kTile;
+    const uint32_t tilesY = (mDimY + kTile - 1) / kTile;
+    mtls.mTileBytes = 0;
+    mtls.fep.dimX = tilesX;
+    mtls.fep.dimY = tilesY;
+    mtls.xStart = 0;
+    mtls.xEnd = tilesX;
+    mtls.yStart = 0;
+    mtls.yEnd = tilesY;
+
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    mCtx->launchThreads(in, aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+}
+
+RsdCpuScriptIntrinsicRotate::RsdCpuScriptIntrinsicRotate(RsdCpuReferenceImpl *ctx,
+                                                         const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_ROTATE) {
+
+    mRootPtr = &kernel;
+    mMode = RS_ROTATE_TRANSPOSE;
+    mCellSize = e->getSizeBytes();
+    mSrc = NULL;
+    mSrcStepX = 0;
+    mSrcStepY = 0;
+    mDst = NULL;
+    mDstStride = 0;
+    mDimX = 0;
+    mDimY = 0;
+}
+
+RsdCpuScriptIntrinsicRotate::~RsdCpuScriptIntrinsicRotate() {
+}
+
+void RsdCpuScriptIntrinsicRotate::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 2;
+}
+
+void RsdCpuScriptIntrinsicRotate::invokeFreeChildren() {
+    mInput.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Rotate(RsdCpuReferenceImpl *ctx,
+                                       const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicRotate(ctx, s, e);
+}
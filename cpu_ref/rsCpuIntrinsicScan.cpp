@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Inclusive or exclusive prefix sums of a 1D I32, U32 or F32 Allocation.
+// Long ones are cut into one slice per thread: a first launch totals every
+// slice but the last, the totals are accumulated, and a second launch
+// scans each slice starting from the total before it.  With floats the
+// rounding depends on the slicing, as with any reordered sum.
+class RsdCpuScriptIntrinsicScan : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+
+    virtual void invokeForEach(uint32_t slot,
+                               const Allocation * ain,
+                               Allocation * aout,
+                               const void * usr,
+                               uint32_t usrLen,
+                               const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicScan();
+    RsdCpuScriptIntrinsicScan(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    // Slices shorter than this aren't worth a thread.
+    static const uint32_t kMinSliceCells = 16 * 1024;
+    static const uint32_t kMaxSlices = 32;
+
+    bool mFloat;
+    bool mExclusive;
+
+    // The launch being run.  mTotals[s] is the sum before slice s.
+    uint32_t mCount;
+    uint32_t mSlices;
+    const void *mSrc;
+    void *mDst;
+    union {
+        int32_t i;
+        float f;
+    } mTotals[kMaxSlices];
+
+    uint32_t sliceStart(uint32_t s) const {
+        return (uint32_t)(((uint64_t)mCount * s) / mSlices);
+    }
+    void launch(uint32_t slot, const Allocation *in, Allocation *aout, const void *usr,
+                uint32_t usrLen, const RsScriptCall *sc, void (*kernel)(), uint32_t cells);
+
+    static void kernelTotals(const RsForEachStubParamStruct *p,
+                             uint32_t xstart, uint32_t xend,
+                             uint32_t instep, uint32_t outstep);
+    static void kernelScan(const RsForEachStubParamStruct *p,
+                           uint32_t xstart, uint32_t xend,
+                           uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicScan::setGlobalVar(uint32_t slot, const void *data,
+                                             size_t dataLength) {
+    rsAssert(slot == 0);
+    rsAssert(dataLength == sizeof(int32_t));
+    mExclusive = ((const int32_t *)data)[0] == RS_SCAN_EXCLUSIVE;
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicScanI32_K(int32_t *dst, const int32_t *src, int32_t *carry,
+                                      uint32_t count4);
+extern "C" void rsdIntrinsicScanF32_K(float *dst, const float *src, float *carry,
+                                      uint32_t count4);
+#endif
+
+// Inclusive scans of count values, starting from and updating *carry.
+// Integers are summed unsigned so overflow wraps.
+static void ScanI32(int32_t *dst, const int32_t *src, int32_t *carry, uint32_t count) {
+    uint32_t x = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >> 2)) {
+        rsdIntrinsicScanI32_K(dst, src, carry, count >> 2);
+        x = count & ~3;
+    }
+#endif
+    uint32_t sum = *carry;
+    for (; x < count; x++) {
+        sum += (uint32_t)src[x];
+        dst[x] = sum;
+    }
+    *carry = sum;
+}
+
+static void ScanF32(float *dst, const float *src, float *carry, uint32_t count) {
+    uint32_t x = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (count >> 2)) {
+        rsdIntrinsicScanF32_K(dst, src, carry, count >> 2);
+        x = count & ~3;
+    }
+#endif
+    float sum = *carry;
+    for (; x < count; x++) {
+        sum += src[x];
+        dst[x] = sum;
+    }
+    *carry = sum;
+}
+
+// Totals slice p->y into mTotals[p->y + 1].
+void RsdCpuScriptIntrinsicScan::kernelTotals(const RsForEachStubParamStruct *p,
+                                             uint32_t xstart, uint32_t xend,
+                                             uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicScan *cp = (RsdCpuScriptIntrinsicScan *)p->usr;
+    const uint32_t x1 = cp->sliceStart(p->y);
+    const uint32_t x2 = cp->sliceStart(p->y + 1);
+
+    if (cp->mFloat) {
+        const float *src = (const float *)cp->mSrc;
+        float sum = 0.f;
+        for (uint32_t x = x1; x < x2; x++) {
+            sum += src[x];
+        }
+        cp->mTotals[p->y + 1].f = sum;
+    } else {
+        const uint32_t *src = (const uint32_t *)cp->mSrc;
+        uint32_t sum = 0;
+        for (uint32_t x = x1; x < x2; x++) {
+            sum += src[x];
+        }
+        cp->mTotals[p->y + 1].i = sum;
+    }
+}
+
+// Scans slice p->y.  An exclusive scan is the inclusive one of the values
+// before each, so it is written one place along.
+void RsdCpuScriptIntrinsicScan::kernelScan(const RsForEachStubParamStruct *p,
+                                           uint32_t xstart, uint32_t xend,
+                                           uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicScan *cp = (RsdCpuScriptIntrinsicScan *)p->usr;
+    uint32_t x1 = cp->sliceStart(p->y);
+    uint32_t x2 = cp->sliceStart(p->y + 1);
+    if (x1 == x2) {
+        return;
+    }
+
+    if (cp->mFloat) {
+        const float *src = (const float *)cp->mSrc + x1;
+        float *dst = (float *)cp->mDst + x1;
+        float carry = cp->mTotals[p->y].f;
+        if (cp->mExclusive) {
+            *(dst++) = carry;
+            x2--;
+        }
+        ScanF32(dst, src, &carry, x2 - x1);
+    } else {
+        const int32_t *src = (const int32_t *)cp->mSrc + x1;
+        int32_t *dst = (int32_t *)cp->mDst + x1;
+        int32_t carry = cp->mTotals[p->y].i;
+        if (cp->mExclusive) {
+            *(dst++) = carry;
+            x2--;
+        }
+        ScanI32(dst, src, &carry, x2 - x1);
+    }
+}
+
+void RsdCpuScriptIntrinsicScan::launch(uint32_t slot, const Allocation *in,
+                                       Allocation *aout, const void *usr,
+                                       uint32_t usrLen, const RsScriptCall *sc,
+                                       void (*kernel)(), uint32_t cells) {
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(in, aout, usr, usrLen, sc, &mtls);
+    mtls.script = this;
+    mtls.fep.slot = slot;
+    mtls.kernel = kernel;
+    mtls.fep.usr = this;
+
+    // One cell per slice.
+    mtls.mTileBytes = 0;
+    mtls.fep.dimX = 1;
+    mtls.fep.dimY = cells;
+    mtls.xStart = 0;
+    mtls.xEnd = 1;
+    mtls.yStart = 0;
+    mtls.yEnd = cells;
+
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    mCtx->launchThreads(in, aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+}
+
+void RsdCpuScriptIntrinsicScan::invokeForEach(uint32_t slot,
+                                              const Allocation * ain,
+                                              Allocation * aout,
+                                              const void * usr,
+                                              uint32_t usrLen,
+                                              const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    if (!ain || !aout || !ain->mHal.drvState.lod[0].mallocPtr ||
+        !aout->mHal.drvState.lod[0].mallocPtr) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT, "Scan called without input or output");
+        return;
+    }
+    mCount = ain->mHal.drvState.lod[0].dimX;
+    if ((aout->mHal.drvState.lod[0].dimX != mCount) ||
+        (rsMax(ain->mHal.drvState.lod[0].dimY, 1u) != 1) ||
+        (rsMax(aout->mHal.drvState.lod[0].dimY, 1u) != 1)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "Scan needs 1D input and output of the same size");
+        return;
+    }
+    if (!mCount) {
+        return;
+    }
+
+    mSlices = rsMin(rsMin(mCtx->getThreadCount(), kMaxSlices),
+                    rsMax(mCount / kMinSliceCells, 1u));
+    mSrc = ain->mHal.drvState.lod[0].mallocPtr;
+    mDst = aout->mHal.drvState.lod[0].mallocPtr;
+
+    mTotals[0].i = 0;
+    if (mSlices > 1) {
+        launch(slot, ain, aout, usr, usrLen, sc, (void (*)())&kernelTotals, mSlices - 1);
+        for (uint32_t s = 2; s < mSlices; s++) {
+            if (mFloat) {
+                mTotals[s].f += mTotals[s - 1].f;
+            } else {
+                mTotals[s].i = (uint32_t)mTotals[s].i + (uint32_t)mTotals[s - 1].i;
+            }
+        }
+    }
+    launch(slot, ain, aout, usr, usrLen, sc, (void (*)())&kernelScan, mSlices);
+}
+
+RsdCpuScriptIntrinsicScan::RsdCpuScriptIntrinsicScan(RsdCpuReferenceImpl *ctx,
+                                                     const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_SCAN) {
+
+    mRootPtr = &kernelScan;
+    mFloat = e->getType() == RS_TYPE_FLOAT_32;
+    mExclusive = false;
+    mCount = 0;
+    mSlices = 1;
+    mSrc = NULL;
+    mDst = NULL;
+}
+
+RsdCpuScriptIntrinsicScan::~RsdCpuScriptIntrinsicScan() {
+}
+
+void RsdCpuScriptIntrinsicScan::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 1;
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Scan(RsdCpuReferenceImpl *ctx,
+                                     const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicScan(ctx, s, e);
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsCpuIntrinsicTuning.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
+#include <cutils/properties.h>
+#endif
+
+using namespace android;
+using namespace android::renderscript;
+
+// Row slices with and without prefetching, then the tile sizes of the
+// L1 and shared-L2 launch strategies.
+const RsdCpuIntrinsicTuning::Variant
+RsdCpuIntrinsicTuning::kVariants[RsdCpuIntrinsicTuning::kVariantCount] = {
+    {0, 0},
+    {0, 2},
+    {0, 4},
+    {16 * 1024, 0},
+    {64 * 1024, 0},
+};
+
+// A saved profile is a TuningFileHeader followed by count records.  It is
+// thrown away when the number of threads launches use has changed, which
+// is what happens when a cache directory is restored onto another device.
+struct TuningFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t threadCount;
+    uint32_t count;
+};
+
+struct TuningFileRecord {
+    uint32_t iid;
+    uint32_t elementBytes;
+    uint32_t slot;
+    uint32_t tileBytes;
+    uint32_t prefetchRows;
+};
+
+static const uint32_t kTuningMagic = 0x50495352;  // "RSIP"
+static const uint32_t kTuningVersion = 1;
+static const uint32_t kTuningMaxRecords = 1024;
+
+RsdCpuIntrinsicTuning::RsdCpuIntrinsicTuning() {
+    pthread_mutex_init(&mLock, NULL);
+    mEnabled = false;
+    mThreadCount = 0;
+    mDirty = false;
+}
+
+RsdCpuIntrinsicTuning::~RsdCpuIntrinsicTuning() {
+    pthread_mutex_destroy(&mLock);
+}
+
+void RsdCpuIntrinsicTuning::init(uint32_t threadCount) {
+    mThreadCount = threadCount;
+    mEnabled = true;
+#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
+    char buf[PROPERTY_VALUE_MAX];
+    property_get("debug.rs.tune", buf, "1");
+    mEnabled = (atoi(buf) != 0);
+#endif
+}
+
+String8 RsdCpuIntrinsicTuning::path() const {
+    String8 path(mCacheDir);
+    path.append("/com.android.renderscript.intrinsic-tuning.bin");
+    return path;
+}
+
+void RsdCpuIntrinsicTuning::setCacheDir(const char *dir) {
+    if (!mEnabled || !dir || !dir[0]) {
+        return;
+    }
+    pthread_mutex_lock(&mLock);
+    if (!mCacheDir.length()) {
+        mCacheDir.setTo(dir);
+        if (!load()) {
+            // Nothing usable saved yet; kernels tuned so far go in now.
+            mDirty = mDirty || (mEntries.size() != 0);
+        }
+        if (mDirty) {
+            save();
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+RsdCpuIntrinsicTuning::Entry * RsdCpuIntrinsicTuning::findEntry(uint32_t iid,
+                                                                uint32_t elementBytes,
+                                                                uint32_t slot, bool create) {
+    for (size_t ct = 0; ct < mEntries.size(); ct++) {
+        Entry &e = mEntries.editItemAt(ct);
+        if ((e.iid == iid) && (e.elementBytes == elementBytes) && (e.slot == slot)) {
+            return &e;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    Entry e;
+    memset(&e, 0, sizeof(e));
+    e.iid = iid;
+    e.elementBytes = elementBytes;
+    e.slot = slot;
+    mEntries.push(e);
+    return &mEntries.editItemAt(mEntries.size() - 1);
+}
+
+bool RsdCpuIntrinsicTuning::load() {
+    FILE *f = fopen(path().string(), "rb");
+    if (!f) {
+        return false;
+    }
+
+    TuningFileHeader h;
+    bool loaded = false;
+    if ((fread(&h, sizeof(h), 1, f) == 1) && (h.magic == kTuningMagic) &&
+        (h.version == kTuningVersion) && (h.threadCount == mThreadCount) &&
+        (h.count <= kTuningMaxRecords)) {
+        loaded = true;
+        for (uint32_t ct = 0; ct < h.count; ct++) {
+            TuningFileRecord r;
+            if (fread(&r, sizeof(r), 1, f) != 1) {
+                loaded = false;
+                break;
+            }
+            Entry *e = findEntry(r.iid, r.elementBytes, r.slot, true);
+            if (!e->tuned && !e->trialRunning) {
+                e->variant.tileBytes = r.tileBytes;
+                e->variant.prefetchRows = r.prefetchRows;
+                e->tuned = true;
+            } else if (e->tuned) {
+                // Tuned here before the directory was known; keep ours.
+                mDirty = true;
+            }
+        }
+    }
+    fclose(f);
+    return loaded;
+}
+
+void RsdCpuIntrinsicTuning::save() {
+    mDirty = false;
+
+    TuningFileHeader h;
+    h.magic = kTuningMagic;
+    h.version = kTuningVersion;
+    h.threadCount = mThreadCount;
+    h.count = 0;
+    for (size_t ct = 0; ct < mEntries.size(); ct++) {
+        h.count += mEntries[ct].tuned ? 1 : 0;
+    }
+
+    // Written aside and renamed so other processes never load half a file.
+    String8 finalPath(path());
+    String8 tmpPath(finalPath);
+    tmpPath.appendFormat(".%d", getpid());
+    FILE *f = fopen(tmpPath.string(), "wb");
+    if (!f) {
+        return;
+    }
+    bool ok = (fwrite(&h, sizeof(h), 1, f) == 1);
+    for (size_t ct = 0; ok && (ct < mEntries.size()); ct++) {
+        const Entry &e = mEntries[ct];
+        if (!e.tuned) {
+            continue;
+        }
+        TuningFileRecord r;
+        r.iid = e.iid;
+        r.elementBytes = e.elementBytes;
+        r.slot = e.slot;
+        r.tileBytes = e.variant.tileBytes;
+        r.prefetchRows = e.variant.prefetchRows;
+        ok = (fwrite(&r, sizeof(r), 1, f) == 1);
+    }
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpPath.string(), finalPath.string())) {
+        unlink(tmpPath.string());
+    }
+}
+
+bool RsdCpuIntrinsicTuning::getVariant(RsScriptIntrinsicID iid, uint32_t elementBytes,
+                                       uint32_t slot, Variant *v, bool *timed) {
+    if (!mEnabled) {
+        return false;
+    }
+    bool found = false;
+    pthread_mutex_lock(&mLock);
+    Entry *e = findEntry(iid, elementBytes, slot, timed != NULL);
+    if (e && e->tuned) {
+        *v = e->variant;
+        found = true;
+    } else if (e && timed && !e->trialRunning) {
+        // The warm-up runs the first variant too.
+        uint32_t trial = e->trials ? (e->trials - 1) : 0;
+        *v = kVariants[trial % kVariantCount];
+        *timed = true;
+        e->trialRunning = true;
+        found = true;
+    }
+    pthread_mutex_unlock(&mLock);
+    return found;
+}
+
+void RsdCpuIntrinsicTuning::recordTrial(RsScriptIntrinsicID iid, uint32_t elementBytes,
+                                        uint32_t slot, uint64_t psPerCell) {
+    pthread_mutex_lock(&mLock);
+    Entry *e = findEntry(iid, elementBytes, slot, false);
+    if (e && e->trialRunning) {
+        e->trialRunning = false;
+        if (e->trials) {
+            uint32_t idx = (e->trials - 1) % kVariantCount;
+            if (!e->bestPs[idx] || (psPerCell < e->bestPs[idx])) {
+                e->bestPs[idx] = psPerCell;
+            }
+        }
+        e->trials++;
+
+        if (e->trials > kVariantCount * kTrialsPerVariant) {
+            uint32_t best = 0;
+            for (uint32_t ct = 1; ct < kVariantCount; ct++) {
+                if (e->bestPs[ct] < e->bestPs[best]) {
+                    best = ct;
+                }
+            }
+            e->variant = kVariants[best];
+            e->tuned = true;
+            ALOGV("Tuned intrinsic %u slot %u for %u byte cells: tiles %u, prefetch %u, "
+                  "%llu ps per cell", iid, slot, elementBytes, e->variant.tileBytes,
+                  e->variant.prefetchRows, (unsigned long long)e->bestPs[best]);
+            if (mCacheDir.length()) {
+                save();
+            } else {
+                mDirty = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
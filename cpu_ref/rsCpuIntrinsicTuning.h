@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RSD_CPU_INTRINSIC_TUNING_H
+#define RSD_CPU_INTRINSIC_TUNING_H
+
+#include "rsCpuCore.h"
+
+#include <utils/String8.h>
+
+namespace android {
+namespace renderscript {
+
+// How the launches of one intrinsic kernel are scheduled on this device.
+// Tuning times each candidate on the first large launches of the kernel
+// and keeps the fastest.  Decisions are saved in the cache directory of
+// the app's scripts, so a device only tunes a kernel once.
+class RsdCpuIntrinsicTuning {
+public:
+    struct Variant {
+        // As MTLaunchStruct::mTileBytes, 0 for row slices.
+        uint32_t tileBytes;
+        // Rows launches prefetch ahead, 0 for none.
+        uint32_t prefetchRows;
+    };
+
+    RsdCpuIntrinsicTuning();
+    ~RsdCpuIntrinsicTuning();
+
+    // debug.rs.tune set to 0 keeps intrinsics on the default schedule and
+    // leaves saved decisions alone.
+    void init(uint32_t threadCount);
+    // Loads the decisions saved in dir, the first one set being used.
+    void setCacheDir(const char *dir);
+
+    // The variant to run the next launch of the kernel with.  Callers that
+    // can time the launch pass timed, which is set when it is a trial.
+    // False when the kernel isn't tuned and no trial can run now, in which
+    // case the launch is scheduled as any other.
+    bool getVariant(RsScriptIntrinsicID iid, uint32_t elementBytes, uint32_t slot,
+                    Variant *v, bool *timed);
+    // The time a launch returned true with timed took, per cell.
+    void recordTrial(RsScriptIntrinsicID iid, uint32_t elementBytes, uint32_t slot,
+                     uint64_t psPerCell);
+
+    // Launches smaller than this many cells are too short to time.
+    static const uint32_t kMinTrialCells = 64 * 1024;
+
+private:
+    enum {
+        kVariantCount = 5,
+        // Timed launches of each variant; the fastest of them counts.
+        kTrialsPerVariant = 2
+    };
+    static const Variant kVariants[kVariantCount];
+
+    struct Entry {
+        uint32_t iid;
+        uint32_t elementBytes;
+        uint32_t slot;
+        Variant variant;
+        bool tuned;
+        // Trials so far, the first being a discarded warm-up.
+        uint32_t trials;
+        bool trialRunning;
+        uint64_t bestPs[kVariantCount];
+    };
+
+    Entry * findEntry(uint32_t iid, uint32_t elementBytes, uint32_t slot, bool create);
+    bool load();
+    void save();
+    String8 path() const;
+
+    pthread_mutex_t mLock;
+    bool mEnabled;
+    uint32_t mThreadCount;
+    String8 mCacheDir;
+    // Decisions made before the cache directory was known.
+    bool mDirty;
+    Vector<Entry> mEntries;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Samples the input at a position given for every output pixel, either by
+// a 3x3 matrix or by interpolating a coarse mesh of input positions.  The
+// positions are only worked out exactly at the ends of short spans of a
+// row and stepped linearly between them, which is exact for affine
+// matrices and within a mesh cell.  Sampling is in fixed point.
+class RsdCpuScriptIntrinsicWarp : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void preLaunch(uint32_t slot, const Allocation * ain,
+                           Allocation * aout, const void * usr,
+                           uint32_t usrLen, const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicWarp();
+    RsdCpuScriptIntrinsicWarp(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    // Output pixels a row is worked through in.
+    static const uint32_t kChunk = 64;
+    // Pixels between exact positions for perspective matrices and meshes.
+    static const uint32_t kSpan = 16;
+
+    ObjectBaseRef<Allocation> mInput;
+    ObjectBaseRef<Allocation> mMesh;
+    float mMatrix[9];
+    int32_t mFilter;
+    uint32_t mCellSize;
+    uint32_t mChannels;
+
+    // Set up by preLaunch.
+    bool mValid;
+    bool mAffine;
+    float mMaxU;
+    float mMaxV;
+    float mMeshScaleX;
+    float mMeshScaleY;
+    // {last x0, last y0, stride, dx, dy} of the bilinear taps.
+    int32_t mParam[5];
+    // Keys' cubic weights in Q12 for each 7 bit fraction.
+    int16_t mCubic[128][4];
+
+    void positionAt(float x, float y, float *u, float *v) const;
+    void fillCoords(int32_t *coords, uint32_t x1, uint32_t y, uint32_t count) const;
+    void bilinear(uchar *out, const int32_t *coords, uint32_t count) const;
+    void bicubic(uchar *out, const int32_t *coords, uint32_t count) const;
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicWarp::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert((slot == 0) || (slot == 2));
+    if (slot == 0) {
+        mInput.set(static_cast<Allocation *>(data));
+    } else {
+        mMesh.set(static_cast<Allocation *>(data));
+    }
+}
+
+void RsdCpuScriptIntrinsicWarp::setGlobalVar(uint32_t slot, const void *data,
+                                             size_t dataLength) {
+    rsAssert((slot == 1) || (slot == 3));
+    if (slot == 1) {
+        rsAssert(dataLength == sizeof(mMatrix));
+        memcpy(mMatrix, data, sizeof(mMatrix));
+    } else {
+        rsAssert(dataLength == sizeof(int32_t));
+        mFilter = ((const int32_t *)data)[0];
+    }
+}
+
+void RsdCpuScriptIntrinsicWarp::preLaunch(uint32_t slot, const Allocation * ain,
+                                          Allocation * aout, const void * usr,
+                                          uint32_t usrLen, const RsScriptCall *sc) {
+    mValid = false;
+    if (!mInput.get() || !aout) {
+        return;
+    }
+
+    const Allocation *mesh = mMesh.get();
+    const uint32_t outX = aout->mHal.drvState.lod[0].dimX;
+    const uint32_t outY = rsMax(aout->mHal.drvState.lod[0].dimY, 1u);
+    if (mesh) {
+        const uint32_t gx = mesh->mHal.drvState.lod[0].dimX;
+        const uint32_t gy = mesh->mHal.drvState.lod[0].dimY;
+        if ((mesh->getType()->getElementSizeBytes() != sizeof(float2)) || (gx < 2) || (gy < 2)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                         "Warp mesh needs at least 2x2 float2 nodes");
+            return;
+        }
+        mMeshScaleX = (outX > 1) ? (float)(gx - 1) / (outX - 1) : 0.f;
+        mMeshScaleY = (outY > 1) ? (float)(gy - 1) / (outY - 1) : 0.f;
+        mAffine = false;
+    } else {
+        mAffine = (mMatrix[6] == 0.f) && (mMatrix[7] == 0.f) && (mMatrix[8] == 1.f);
+    }
+
+    const uint32_t inX = mInput->mHal.drvState.lod[0].dimX;
+    const uint32_t inY = rsMax(mInput->mHal.drvState.lod[0].dimY, 1u);
+    const size_t stride = mInput->mHal.drvState.lod[0].stride;
+    mMaxU = (float)(inX - 1);
+    mMaxV = (float)(inY - 1);
+    mParam[0] = rsMax((int32_t)inX - 2, 0);
+    mParam[1] = rsMax((int32_t)inY - 2, 0);
+    mParam[2] = (int32_t)stride;
+    mParam[3] = (inX > 1) ? mCellSize : 0;
+    mParam[4] = (inY > 1) ? (int32_t)stride : 0;
+    mValid = true;
+}
+
+void RsdCpuScriptIntrinsicWarp::positionAt(float x, float y, float *u, float *v) const {
+    const Allocation *mesh = mMesh.get();
+    if (!mesh) {
+        const float *m = mMatrix;
+        float w = m[6] * x + m[7] * y + m[8];
+        float r = (w != 0.f) ? (1.f / w) : 0.f;
+        *u = (m[0] * x + m[1] * y + m[2]) * r;
+        *v = (m[3] * x + m[4] * y + m[5]) * r;
+        return;
+    }
+
+    const uint32_t gx = mesh->mHal.drvState.lod[0].dimX;
+    const uint32_t gy = mesh->mHal.drvState.lod[0].dimY;
+    const float mx = x * mMeshScaleX;
+    const float my = y * mMeshScaleY;
+    const uint32_t i = rsMin((uint32_t)mx, gx - 2);
+    const uint32_t j = rsMin((uint32_t)my, gy - 2);
+    const float tx = mx - i;
+    const float ty = my - j;
+    const uchar *base = (const uchar *)mesh->mHal.drvState.lod[0].mallocPtr;
+    const size_t stride = mesh->mHal.drvState.lod[0].stride;
+    const float2 *n0 = (const float2 *)(base + j * stride) + i;
+    const float2 *n1 = (const float2 *)(base + (j + 1) * stride) + i;
+    float2 top = n0[0] + (n0[1] - n0[0]) * tx;
+    float2 bot = n1[0] + (n1[1] - n1[0]) * tx;
+    float2 p = top + (bot - top) * ty;
+    *u = p.x;
+    *v = p.y;
+}
+
+// Writes the input position of count output pixels from (x1, y) to coords
+// as 16.16 fixed point u, v pairs, clamped to the input.
+void RsdCpuScriptIntrinsicWarp::fillCoords(int32_t *coords, uint32_t x1, uint32_t y,
+                                           uint32_t count) const {
+    const uint32_t span = mAffine ? count : kSpan;
+    for (uint32_t a = 0; a < count; a += span) {
+        const uint32_t len = rsMin(span, count - a);
+        float u, v, du = 0.f, dv = 0.f;
+        positionAt(x1 + a, y, &u, &v);
+        if (len > 1) {
+            float u2, v2;
+            positionAt(x1 + a + len - 1, y, &u2, &v2);
+            du = (u2 - u) / (len - 1);
+            dv = (v2 - v) / (len - 1);
+        }
+        for (uint32_t k = 0; k < len; k++) {
+            coords[0] = (int32_t)(rsMin(rsMax(u, 0.f), mMaxU) * 65536.f);
+            coords[1] = (int32_t)(rsMin(rsMax(v, 0.f), mMaxV) * 65536.f);
+            coords += 2;
+            u += du;
+            v += dv;
+        }
+    }
+}
+
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+extern "C" void rsdIntrinsicWarpBilinear4_K(void *dst, const void *src, const int32_t *coords,
+                                            const int32_t *param, uint32_t count4);
+#endif
+
+// Fractions are 7 bits, so each product of the two passes fits 16 bits.
+void RsdCpuScriptIntrinsicWarp::bilinear(uchar *out, const int32_t *coords,
+                                         uint32_t count) const {
+    const uchar *src = (const uchar *)mInput->mHal.drvState.lod[0].mallocPtr;
+    uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD && (mCellSize == 4) && (count >= 4)) {
+        rsdIntrinsicWarpBilinear4_K(out, src, coords, mParam, count >> 2);
+        i = count & ~3;
+    }
+#endif
+
+    const uint32_t cs = mCellSize;
+    const uint32_t ch = mChannels;
+    const ptrdiff_t stride = mParam[2];
+    const uint32_t dx = mParam[3];
+    const ptrdiff_t dy = mParam[4];
+    for (; i < count; i++) {
+        const int32_t u = coords[i * 2];
+        const int32_t v = coords[i * 2 + 1];
+        const int32_t x0 = rsMin(u >> 16, mParam[0]);
+        const int32_t y0 = rsMin(v >> 16, mParam[1]);
+        const uint32_t fx = (u >> 9) - (x0 << 7);
+        const uint32_t fy = (v >> 9) - (y0 << 7);
+        const uchar *p0 = src + y0 * stride + x0 * cs;
+        const uchar *p1 = p0 + dy;
+        uchar *o = out + i * cs;
+        for (uint32_t c = 0; c < ch; c++) {
+            uint32_t top = p0[c] * (128 - fx) + p0[dx + c] * fx;
+            uint32_t bot = p1[c] * (128 - fx) + p1[dx + c] * fx;
+            o[c] = (uchar)((top * (128 - fy) + bot * fy + (1 << 13)) >> 14);
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicWarp::bicubic(uchar *out, const int32_t *coords,
+                                        uint32_t count) const {
+    const uchar *src = (const uchar *)mInput->mHal.drvState.lod[0].mallocPtr;
+    const ptrdiff_t stride = mParam[2];
+    const int32_t lastX = (int32_t)mMaxU;
+    const int32_t lastY = (int32_t)mMaxV;
+    const uint32_t cs = mCellSize;
+    const uint32_t ch = mChannels;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const int32_t u = coords[i * 2];
+        const int32_t v = coords[i * 2 + 1];
+        const int16_t *wx = mCubic[(u >> 9) & 127];
+        const int16_t *wy = mCubic[(v >> 9) & 127];
+        int32_t xs[4];
+        const uchar *rows[4];
+        for (int k = 0; k < 4; k++) {
+            xs[k] = rsMin(rsMax((u >> 16) + k - 1, 0), lastX) * cs;
+            rows[k] = src + rsMin(rsMax((v >> 16) + k - 1, 0), lastY) * stride;
+        }
+        uchar *o = out + i * cs;
+        for (uint32_t c = 0; c < ch; c++) {
+            int32_t sum = 0;
+            for (int r = 0; r < 4; r++) {
+                const uchar *row = rows[r] + c;
+                int32_t h = row[xs[0]] * wx[0] + row[xs[1]] * wx[1] +
+                            row[xs[2]] * wx[2] + row[xs[3]] * wx[3];
+                // Q12 down to Q8 so the second pass fits 32 bits.
+                sum += ((h + 8) >> 4) * wy[r];
+            }
+            o[c] = (uchar)rsMin(rsMax((sum + (1 << 19)) >> 20, 0), 255);
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicWarp::kernel(const RsForEachStubParamStruct *p,
+                                       uint32_t xstart, uint32_t xend,
+                                       uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicWarp *cp = (RsdCpuScriptIntrinsicWarp *)p->usr;
+    if (!cp->mValid) {
+        ALOGE("Warp executed without input, skipping");
+        return;
+    }
+
+    int32_t coords[kChunk * 2];
+    uchar *out = (uchar *)p->out;
+    for (uint32_t x1 = xstart; x1 < xend; x1 += kChunk) {
+        const uint32_t count = rsMin(kChunk, xend - x1);
+        cp->fillCoords(coords, x1, p->y, count);
+        if (cp->mFilter == RS_WARP_BICUBIC) {
+            cp->bicubic(out, coords, count);
+        } else {
+            cp->bilinear(out, coords, count);
+        }
+        out += count * cp->mCellSize;
+    }
+}
+
+// Keys' cubic with a = -0.5, as Resize uses.
+static float cubicWeight(float t) {
+    t = fabsf(t);
+    if (t < 1.f) {
+        return (1.5f * t - 2.5f) * t * t + 1.f;
+    }
+    if (t < 2.f) {
+        return ((-0.5f * t + 2.5f) * t - 4.f) * t + 2.f;
+    }
+    return 0.f;
+}
+
+RsdCpuScriptIntrinsicWarp::RsdCpuScriptIntrinsicWarp(RsdCpuReferenceImpl *ctx,
+                                                     const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_WARP) {
+
+    mRootPtr = &kernel;
+    memset(mMatrix, 0, sizeof(mMatrix));
+    mMatrix[0] = 1.f;
+    mMatrix[4] = 1.f;
+    mMatrix[8] = 1.f;
+    mFilter = RS_WARP_BILINEAR;
+    mCellSize = e->getSizeBytes();
+    // Three component elements are padded to four.
+    mChannels = (e->getVectorSize() == 3) ? 4 : e->getVectorSize();
+    mValid = false;
+    mAffine = true;
+    mMaxU = 0.f;
+    mMaxV = 0.f;
+    mMeshScaleX = 0.f;
+    mMeshScaleY = 0.f;
+    memset(mParam, 0, sizeof(mParam));
+
+    // The weights of each phase are rounded to sum to exactly 1.
+    for (int f = 0; f < 128; f++) {
+        const float t = f / 128.f;
+        int sum = 0;
+        for (int k = 0; k < 4; k++) {
+            mCubic[f][k] = (int16_t)floorf(cubicWeight(t + 1.f - k) * 4096.f + 0.5f);
+            sum += mCubic[f][k];
+        }
+        mCubic[f][1] += 4096 - sum;
+    }
+}
+
+RsdCpuScriptIntrinsicWarp::~RsdCpuScriptIntrinsicWarp() {
+}
+
+void RsdCpuScriptIntrinsicWarp::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 4;
+}
+
+void RsdCpuScriptIntrinsicWarp::invokeFreeChildren() {
+    mInput.clear();
+    mMesh.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Warp(RsdCpuReferenceImpl *ctx,
+                                     const Script *s, const Element *e) {
+
+    return new RsdCpuScriptIntrinsicWarp(ctx, s, e);
+}
@@ -33,28 +33,105 @@ namespace android {
 namespace renderscript {
 
 
+// Converts a YUV allocation to RGBA.  An output transform set through
+// slot 1 crops the input, rotates it clockwise by a multiple of 90
+// degrees, mirrors it and scales it to the output dimensions as part of
+// the conversion, so no full size RGBA copy is written or read back.
+//
+// Only the crop keeps the input layout and runs the plain conversion.
+// Otherwise the source of every output row and column is worked out
+// before the launch, and each row gathers its luma and chroma into short
+// planar runs which go through the same SIMD conversion.
 class RsdCpuScriptIntrinsicYuvToRGB : public RsdCpuScriptIntrinsic {
 public:
     virtual void populateScript(Script *);
     virtual void invokeFreeChildren();
 
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
 
+    virtual void preLaunch(uint32_t slot, const Allocation * ain,
+                           Allocation * aout, const void * usr,
+                           uint32_t usrLen, const RsScriptCall *sc);
+
     virtual ~RsdCpuScriptIntrinsicYuvToRGB();
     RsdCpuScriptIntrinsicYuvToRGB(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
 
 protected:
+    enum {
+        kPathSkip,
+        kPathDirect,
+        kPathMapped
+    };
+
+    struct Planes {
+        const uchar *y;
+        const uchar *u;
+        const uchar *v;
+        size_t strideY;
+        size_t strideU;
+        size_t strideV;
+        size_t cstep;
+    };
+
+    // Where the samples of each output column, or row, start in the
+    // planes, as offsets along the one source axis it maps to.
+    struct Axis {
+        int32_t *mLuma;
+        int32_t *mChromaU;
+        int32_t *mChromaV;
+        // The bilinear weight of the second luma tap out of 256.
+        uint16_t *mFrac;
+        uint32_t mSize;
+        // The offset of the next luma sample along the axis.
+        int32_t mStep;
+    };
+
     ObjectBaseRef<Allocation> alloc;
+    // RsScriptIntrinsicYuvRotation, mirror, crop x, y, w, h and
+    // RsScriptIntrinsicYuvScale.
+    int32_t mTransform[7];
+    bool mHasTransform;
+    int mPath;
+    Planes mPlanes;
+    // The crop origin of the direct path.
+    uint32_t mCropX;
+    uint32_t mCropY;
+    Axis mCols;
+    Axis mRows;
+    // The box in the source each output pixel averages, and the multiplier
+    // of its sum giving the average in 16.16.
+    uint32_t mBoxW;
+    uint32_t mBoxH;
+    uint32_t mBoxMul;
+
+    bool setPlanes(uint32_t dimX, uint32_t dimY);
+    static void freeAxis(Axis *a);
+    bool buildAxis(Axis *a, bool alongV, bool reverse, uint32_t start, uint32_t extent,
+                   uint32_t srcSize, uint32_t outSize);
 
     static void kernel(const RsForEachStubParamStruct *p,
                        uint32_t xstart, uint32_t xend,
                        uint32_t instep, uint32_t outstep);
+    static void kernelMapped(const RsForEachStubParamStruct *p, uchar4 *out,
+                             uint32_t x1, uint32_t x2);
 };
 
 }
 }
 
 
+void RsdCpuScriptIntrinsicYuvToRGB::setGlobalVar(uint32_t slot, const void *data,
+                                                 size_t dataLength) {
+    rsAssert(slot == 1);
+    rsAssert(dataLength == sizeof(mTransform));
+    memcpy(mTransform, data, sizeof(mTransform));
+    mHasTransform = false;
+    for (uint32_t ct = 0; ct < 7; ct++) {
+        mHasTransform |= (mTransform[ct] != 0);
+    }
+}
+
 void RsdCpuScriptIntrinsicYuvToRGB::setGlobalObj(uint32_t slot, ObjectBase *data) {
     rsAssert(slot == 0);
     alloc.set(static_cast<Allocation *>(data));
@@ -110,6 +187,261 @@ extern "C" void rsdIntrinsicYuv_K(void *dst, const uchar *Y, const uchar *uv, ui
 extern "C" void rsdIntrinsicYuvR_K(void *dst, const uchar *Y, const uchar *uv, uint32_t count, const short *param);
 extern "C" void rsdIntrinsicYuv2_K(void *dst, const uchar *Y, const uchar *u, const uchar *v, uint32_t count, const short *param);
 
+bool RsdCpuScriptIntrinsicYuvToRGB::setPlanes(uint32_t dimX, uint32_t dimY) {
+    Planes &pl = mPlanes;
+    pl.y = (const uchar *)alloc->mHal.drvState.lod[0].mallocPtr;
+    if (pl.y == NULL) {
+        return false;
+    }
+
+    pl.strideY = alloc->mHal.drvState.lod[0].stride;
+    // calculate correct stride in legacy case
+    if (alloc->mHal.drvState.lod[0].dimY == 0) {
+        pl.strideY = dimX;
+    }
+
+    pl.cstep = alloc->mHal.drvState.yuv.step;
+    pl.u = (const uchar *)alloc->mHal.drvState.lod[1].mallocPtr;
+    pl.strideU = alloc->mHal.drvState.lod[1].stride;
+    pl.v = (const uchar *)alloc->mHal.drvState.lod[2].mallocPtr;
+    pl.strideV = alloc->mHal.drvState.lod[2].stride;
+
+    if (pl.u == NULL) {
+        // Legacy yuv support didn't fill in uv
+        pl.v = pl.y + (pl.strideY * dimY);
+        pl.u = pl.v + 1;
+        pl.strideU = pl.strideY;
+        pl.strideV = pl.strideY;
+        pl.cstep = 2;
+    }
+    return true;
+}
+
+// Leaves a empty, so preLaunch keeps off the mapped path until it is
+// built again.
+void RsdCpuScriptIntrinsicYuvToRGB::freeAxis(Axis *a) {
+    free(a->mLuma);
+    free(a->mChromaU);
+    free(a->mChromaV);
+    free(a->mFrac);
+    memset(a, 0, sizeof(*a));
+}
+
+// Fills a with the source of every output coordinate along one axis,
+// reverse running it backwards.  Box scaling starts each output pixel at
+// the corner of its box and takes chroma from the middle of it; bilinear
+// places output pixel centres evenly over the crop and takes the nearest
+// chroma.
+bool RsdCpuScriptIntrinsicYuvToRGB::buildAxis(Axis *a, bool alongV, bool reverse,
+                                              uint32_t start, uint32_t extent,
+                                              uint32_t srcSize, uint32_t outSize) {
+    if (outSize > a->mSize) {
+        // A failed realloc leaves the old block, so only successes are kept.
+        bool failed = false;
+        void *p = realloc(a->mLuma, outSize * sizeof(int32_t));
+        failed |= !p;
+        a->mLuma = p ? (int32_t *)p : a->mLuma;
+        p = realloc(a->mChromaU, outSize * sizeof(int32_t));
+        failed |= !p;
+        a->mChromaU = p ? (int32_t *)p : a->mChromaU;
+        p = realloc(a->mChromaV, outSize * sizeof(int32_t));
+        failed |= !p;
+        a->mChromaV = p ? (int32_t *)p : a->mChromaV;
+        p = realloc(a->mFrac, outSize * sizeof(uint16_t));
+        failed |= !p;
+        a->mFrac = p ? (uint16_t *)p : a->mFrac;
+        if (failed) {
+            ALOGE("YuvToRGB could not allocate its output transform");
+            freeAxis(a);
+            return false;
+        }
+        a->mSize = outSize;
+    }
+
+    const Planes &pl = mPlanes;
+    const int32_t lumaStep = alongV ? pl.strideY : 1;
+    const int32_t stepU = alongV ? pl.strideU : pl.cstep;
+    const int32_t stepV = alongV ? pl.strideV : pl.cstep;
+    const int32_t lastChroma = ((srcSize + 1) >> 1) - 1;
+    const bool box = mTransform[6] == RS_YUV_SCALE_BOX;
+    const float scale = (float)extent / (float)outSize;
+    const uint32_t n = extent / outSize;
+
+    // Bilinear reads a second tap, so needs two pixels along the axis.
+    a->mStep = (srcSize > 1) ? lumaStep : 0;
+    for (uint32_t o = 0; o < outSize; o++) {
+        const uint32_t t = reverse ? (outSize - 1 - o) : o;
+        int32_t i0;
+        int32_t c;
+        uint32_t frac = 0;
+        if (box) {
+            i0 = start + t * n;
+            c = (i0 + (n >> 1)) >> 1;
+        } else {
+            float pos = start + (t + 0.5f) * scale - 0.5f;
+            pos = rsMin(rsMax(pos, 0.f), (float)(srcSize - 1));
+            i0 = rsMin((int32_t)pos, rsMax((int32_t)srcSize - 2, 0));
+            frac = (uint32_t)((pos - i0) * 256.f + 0.5f);
+            c = (int32_t)(pos + 0.5f) >> 1;
+            if (srcSize < 2) {
+                frac = 0;
+            }
+        }
+        c = rsMin(c, lastChroma);
+        a->mLuma[o] = i0 * lumaStep;
+        a->mChromaU[o] = c * stepU;
+        a->mChromaV[o] = c * stepV;
+        a->mFrac[o] = (uint16_t)rsMin(frac, 256u);
+    }
+    return true;
+}
+
+void RsdCpuScriptIntrinsicYuvToRGB::preLaunch(uint32_t slot, const Allocation * ain,
+                                              Allocation * aout, const void * usr,
+                                              uint32_t usrLen, const RsScriptCall *sc) {
+    mPath = kPathSkip;
+    if (!alloc.get() || !aout) {
+        return;
+    }
+    const Type *tout = aout->getType();
+    const uint32_t outW = tout->getDimX();
+    const uint32_t outH = rsMax(tout->getDimY(), 1u);
+    if (!setPlanes(outW, outH)) {
+        return;
+    }
+    mCropX = 0;
+    mCropY = 0;
+    if (!mHasTransform) {
+        mPath = kPathDirect;
+        return;
+    }
+
+    if (alloc->mHal.drvState.lod[0].dimY == 0) {
+        ALOGE("YuvToRGB output transforms need a YUV typed input, skipping");
+        return;
+    }
+    const uint32_t srcW = alloc->mHal.drvState.lod[0].dimX;
+    const uint32_t srcH = alloc->mHal.drvState.lod[0].dimY;
+    const int32_t rotation = mTransform[0];
+    const bool mirror = mTransform[1] != 0;
+    const uint32_t cropX = mTransform[2];
+    const uint32_t cropY = mTransform[3];
+    const uint32_t cropW = mTransform[4] ? (uint32_t)mTransform[4] : srcW - rsMin(cropX, srcW);
+    const uint32_t cropH = mTransform[5] ? (uint32_t)mTransform[5] : srcH - rsMin(cropY, srcH);
+    if (!cropW || !cropH || (cropX + cropW > srcW) || (cropY + cropH > srcH)) {
+        ALOGE("YuvToRGB crop %u,%u %ux%u is outside the %ux%u input, skipping",
+              cropX, cropY, cropW, cropH, srcW, srcH);
+        return;
+    }
+
+    // Output columns run along the source rows unless the image is turned
+    // on its side.
+    const bool sideways = (rotation == RS_YUV_ROTATE_90) || (rotation == RS_YUV_ROTATE_270);
+    const uint32_t extentX = sideways ? cropH : cropW;
+    const uint32_t extentY = sideways ? cropW : cropH;
+    if ((extentX < outW) || (extentY < outH)) {
+        ALOGE("YuvToRGB can only scale down, skipping");
+        return;
+    }
+    if (!sideways && (rotation == RS_YUV_ROTATE_0) && !mirror &&
+        (extentX == outW) && (extentY == outH)) {
+        mCropX = cropX;
+        mCropY = cropY;
+        mPath = kPathDirect;
+        return;
+    }
+
+    if (mTransform[6] == RS_YUV_SCALE_BOX) {
+        if ((extentX % outW) || (extentY % outH)) {
+            ALOGE("YuvToRGB box scaling needs the crop to be a multiple of the output, skipping");
+            return;
+        }
+        mBoxW = (sideways ? extentY / outH : extentX / outW);
+        mBoxH = (sideways ? extentX / outW : extentY / outH);
+        mBoxMul = (65536 + (mBoxW * mBoxH >> 1)) / (mBoxW * mBoxH);
+    }
+
+    // 90 degrees clockwise puts the last source row in the first output
+    // column, and 270 the last source column in the first output row.
+    const bool reverseX = mirror != ((rotation == RS_YUV_ROTATE_90) ||
+                                     (rotation == RS_YUV_ROTATE_180));
+    const bool reverseY = (rotation == RS_YUV_ROTATE_180) || (rotation == RS_YUV_ROTATE_270);
+    const bool ok = sideways ?
+            (buildAxis(&mCols, true, reverseX, cropY, cropH, srcH, outW) &&
+             buildAxis(&mRows, false, reverseY, cropX, cropW, srcW, outH)) :
+            (buildAxis(&mCols, false, reverseX, cropX, cropW, srcW, outW) &&
+             buildAxis(&mRows, true, reverseY, cropY, cropH, srcH, outH));
+    if (ok) {
+        mPath = kPathMapped;
+    }
+}
+
+void RsdCpuScriptIntrinsicYuvToRGB::kernelMapped(const RsForEachStubParamStruct *p,
+                                                 uchar4 *out, uint32_t x1, uint32_t x2) {
+    RsdCpuScriptIntrinsicYuvToRGB *cp = (RsdCpuScriptIntrinsicYuvToRGB *)p->usr;
+    const Planes &pl = cp->mPlanes;
+    const Axis &cols = cp->mCols;
+    const Axis &rows = cp->mRows;
+    const uchar *Y = pl.y + rows.mLuma[p->y];
+    const uchar *u = pl.u + rows.mChromaU[p->y];
+    const uchar *v = pl.v + rows.mChromaV[p->y];
+    const bool box = cp->mTransform[6] == RS_YUV_SCALE_BOX;
+    const uint32_t fy = rows.mFrac[p->y];
+    const int32_t stepX = cols.mStep;
+    const int32_t stepY = rows.mStep;
+
+    // Runs of gathered samples, padded for the over-read of the SIMD
+    // conversion.  Chroma is shared by output pixel pairs, as in the
+    // input, and taken at the even pixel of each.
+    static const uint32_t kRun = 64;
+    uchar yb[kRun + 8];
+    uchar ub[kRun / 2 + 8];
+    uchar vb[kRun / 2 + 8];
+
+    while (x1 < x2) {
+        // A run starting on an odd pixel converts it alone to keep the
+        // pairs aligned.
+        const uint32_t n = (x1 & 1) ? 1 : rsMin(x2 - x1, kRun);
+        for (uint32_t i = 0; i < n; i++) {
+            const uint32_t x = x1 + i;
+            const uchar *py = Y + cols.mLuma[x];
+            if (box) {
+                uint32_t sum = 0;
+                for (uint32_t by = 0; by < cp->mBoxH; by++) {
+                    const uchar *r = py + by * pl.strideY;
+                    for (uint32_t bx = 0; bx < cp->mBoxW; bx++) {
+                        sum += r[bx];
+                    }
+                }
+                yb[i] = (uchar)((sum * cp->mBoxMul + 32768) >> 16);
+            } else {
+                const uint32_t fx = cols.mFrac[x];
+                const uint32_t top = py[0] * (256 - fx) + py[stepX] * fx;
+                const uint32_t bottom = py[stepY] * (256 - fx) + py[stepX + stepY] * fx;
+                yb[i] = (uchar)((top * (256 - fy) + bottom * fy + 32768) >> 16);
+            }
+        }
+        const uint32_t c0 = x1 & ~1;
+        for (uint32_t i = 0; i < n; i += 2) {
+            ub[i >> 1] = u[cols.mChromaU[c0 + i]];
+            vb[i >> 1] = v[cols.mChromaV[c0 + i]];
+        }
+
+        uint32_t i = 0;
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+        if (gArchUseSIMD && (n >= 8)) {
+            rsdIntrinsicYuv2_K(out, yb, ub, vb, n >> 3, YuvCoeff);
+            i = n & ~7;
+        }
+#endif
+        for (; i < n; i++) {
+            out[i] = rsYuvToRGBA_uchar4(yb[i], ub[i >> 1], vb[i >> 1]);
+        }
+        out += n;
+        x1 += n;
+    }
+}
+
 void RsdCpuScriptIntrinsicYuvToRGB::kernel(const RsForEachStubParamStruct *p,
                                            uint32_t xstart, uint32_t xend,
                                            uint32_t instep, uint32_t outstep) {
@@ -118,69 +450,62 @@ void RsdCpuScriptIntrinsicYuvToRGB::kernel(const RsForEachStubParamStruct *p,
         ALOGE("YuvToRGB executed without input, skipping");
         return;
     }
-    const uchar *pinY = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
-    if (pinY == NULL) {
+    if (cp->mPlanes.y == NULL) {
         ALOGE("YuvToRGB executed without data, skipping");
         return;
     }
 
-    size_t strideY = cp->alloc->mHal.drvState.lod[0].stride;
-
-    // calculate correct stride in legacy case
-    if (cp->alloc->mHal.drvState.lod[0].dimY == 0) {
-        strideY = p->dimX;
-    }
-    const uchar *Y = pinY + (p->y * strideY);
-
     uchar4 *out = (uchar4 *)p->out;
-    uint32_t x1 = xstart;
-    uint32_t x2 = xend;
-
-    size_t cstep = cp->alloc->mHal.drvState.yuv.step;
-
-    const uchar *pinU = (const uchar *)cp->alloc->mHal.drvState.lod[1].mallocPtr;
-    const size_t strideU = cp->alloc->mHal.drvState.lod[1].stride;
-    const uchar *u = pinU + ((p->y >> 1) * strideU);
-
-    const uchar *pinV = (const uchar *)cp->alloc->mHal.drvState.lod[2].mallocPtr;
-    const size_t strideV = cp->alloc->mHal.drvState.lod[2].stride;
-    const uchar *v = pinV + ((p->y >> 1) * strideV);
-
-    //ALOGE("pinY, %p, Y, %p, p->y, %d, strideY, %d", pinY, Y, p->y, strideY);
-    //ALOGE("pinU, %p, U, %p, p->y, %d, strideU, %d", pinU, u, p->y, strideU);
-    //ALOGE("pinV, %p, V, %p, p->y, %d, strideV, %d", pinV, v, p->y, strideV);
-    //ALOGE("dimX, %d, dimY, %d", cp->alloc->mHal.drvState.lod[0].dimX, cp->alloc->mHal.drvState.lod[0].dimY);
-    //ALOGE("p->dimX, %d, p->dimY, %d", p->dimX, p->dimY);
+    if (cp->mPath == kPathMapped) {
+        kernelMapped(p, out, xstart, xend);
+        return;
+    }
+    if (cp->mPath != kPathDirect) {
+        return;
+    }
 
-    if (pinU == NULL) {
-        // Legacy yuv support didn't fill in uv
-        v = ((uint8_t *)cp->alloc->mHal.drvState.lod[0].mallocPtr) +
-            (strideY * p->dimY) +
-            ((p->y >> 1) * strideY);
-        u = v + 1;
-        cstep = 2;
+    // The direct path addresses the source through the crop origin.
+    const Planes &pl = cp->mPlanes;
+    const uint32_t sy = p->y + cp->mCropY;
+    const uchar *Y = pl.y + (sy * pl.strideY);
+    const uchar *u = pl.u + ((sy >> 1) * pl.strideU);
+    const uchar *v = pl.v + ((sy >> 1) * pl.strideV);
+    const size_t cstep = pl.cstep;
+    uint32_t x1 = xstart + cp->mCropX;
+    uint32_t x2 = xend + cp->mCropX;
+
+    // Chroma is shared by pixel pairs.  Launches that start on an odd
+    // pixel convert it on its own so the pair loops below stay aligned.
+    if ((x1 & 1) && (x1 < x2)) {
+        int cx = (x1 >> 1) * cstep;
+        *out = rsYuvToRGBA_uchar4(Y[x1], u[cx], v[cx]);
+        out++;
+        x1++;
     }
 
-#if defined(ARCH_ARM_HAVE_VFP)
+#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
     if((x2 > x1) && gArchUseSIMD) {
-        // The neon paths may over-read by up to 8 bytes
+        // The neon paths may over-read by up to 8 bytes.  Each plane is
+        // addressed through its own row pointer, so any plane stride works.
         int32_t len = (x2 - x1 - 8) >> 3;
         if(len > 0) {
+            const uchar *cu = u + (x1 >> 1) * cstep;
+            const uchar *cv = v + (x1 >> 1) * cstep;
             if (cstep == 1) {
-                rsdIntrinsicYuv2_K(out, Y, u, v, len, YuvCoeff);
+                rsdIntrinsicYuv2_K(out, Y + x1, cu, cv, len, YuvCoeff);
                 x1 += len << 3;
                 out += len << 3;
             } else if (cstep == 2) {
                 // Check for proper interleave
-                intptr_t ipu = (intptr_t)u;
-                intptr_t ipv = (intptr_t)v;
+                intptr_t ipu = (intptr_t)cu;
+                intptr_t ipv = (intptr_t)cv;
 
                 if (ipu == (ipv + 1)) {
-                    rsdIntrinsicYuv_K(out, Y, v, len, YuvCoeff);
+                    rsdIntrinsicYuv_K(out, Y + x1, cv, len, YuvCoeff);
                     x1 += len << 3;
                     out += len << 3;
                 } else if (ipu == (ipv - 1)) {
-                    rsdIntrinsicYuvR_K(out, Y, u, len, YuvCoeff);
+                    rsdIntrinsicYuvR_K(out, Y + x1, cu, len, YuvCoeff);
                     x1 += len << 3;
                     out += len << 3;
                 }
@@ -190,17 +515,11 @@ void RsdCpuScriptIntrinsicYuvToRGB::kernel(const RsForEachStubParamStruct *p,
     }
 #endif
 
-    if(x2 > x1) {
-       // ALOGE("y %i  %i  %i", p->y, x1, x2);
-        while(x1 < x2) {
-            int cx = (x1 >> 1) * cstep;
-            *out = rsYuvToRGBA_uchar4(Y[x1], u[cx], v[cx]);
-            out++;
-            x1++;
-            *out = rsYuvToRGBA_uchar4(Y[x1], u[cx], v[cx]);
-            out++;
-            x1++;
-        }
+    while(x1 < x2) {
+        int cx = (x1 >> 1) * cstep;
+        *out = rsYuvToRGBA_uchar4(Y[x1], u[cx], v[cx]);
+        out++;
+        x1++;
     }
 
 }
@@ -210,13 +529,26 @@ RsdCpuScriptIntrinsicYuvToRGB::RsdCpuScriptIntrinsicYuvToRGB(
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB) {
 
     mRootPtr = &kernel;
+    memset(mTransform, 0, sizeof(mTransform));
+    mHasTransform = false;
+    mPath = kPathSkip;
+    memset(&mPlanes, 0, sizeof(mPlanes));
+    memset(&mCols, 0, sizeof(mCols));
+    memset(&mRows, 0, sizeof(mRows));
+    mCropX = 0;
+    mCropY = 0;
+    mBoxW = 1;
+    mBoxH = 1;
+    mBoxMul = 65536;
 }
 
 RsdCpuScriptIntrinsicYuvToRGB::~RsdCpuScriptIntrinsicYuvToRGB() {
+    freeAxis(&mCols);
+    freeAxis(&mRows);
 }
 
 void RsdCpuScriptIntrinsicYuvToRGB::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 1;
+    s->mHal.info.exportedVariableCount = 2;
 }
 
 void RsdCpuScriptIntrinsicYuvToRGB::invokeFreeChildren() {
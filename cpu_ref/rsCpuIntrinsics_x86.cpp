@@ -0,0 +1,1060 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// SSSE3 versions of the kernels in rsCpuIntrinsics_neon.S.  Each function
+// has the signature, the pixels per count and the fixed point rounding of
+// the neon routine of the same name, so the intrinsics call them from the
+// same places and produce the same results on both architectures.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tmmintrin.h>
+
+// Signed 16 bit a * b with all eight 32 bit products, split over lo and hi.
+static inline void mul16(__m128i a, __m128i b, __m128i *lo, __m128i *hi) {
+    __m128i l = _mm_mullo_epi16(a, b);
+    __m128i h = _mm_mulhi_epi16(a, b);
+    *lo = _mm_unpacklo_epi16(l, h);
+    *hi = _mm_unpackhi_epi16(l, h);
+}
+
+static inline void mac16(__m128i a, __m128i b, __m128i *lo, __m128i *hi) {
+    __m128i l, h;
+    mul16(a, b, &l, &h);
+    *lo = _mm_add_epi32(*lo, l);
+    *hi = _mm_add_epi32(*hi, h);
+}
+
+// Converts the four pixels of v to two vectors of two 16 bit pixels.
+static inline __m128i lo16(__m128i v) {
+    return _mm_unpacklo_epi8(v, _mm_setzero_si128());
+}
+
+static inline __m128i hi16(__m128i v) {
+    return _mm_unpackhi_epi8(v, _mm_setzero_si128());
+}
+
+// Packs two vectors of four signed 32 bit values to eight saturated bytes.
+static inline __m128i packUchar(__m128i lo, __m128i hi) {
+    __m128i s = _mm_packs_epi32(lo, hi);
+    return _mm_packus_epi16(s, s);
+}
+
+
+/* Convolve 3x3: two pixels per count, reading four from each row. */
+extern "C" void rsdIntrinsicConvolve3x3_K(void *dst, const void *y0, const void *y1,
+                                          const void *y2, const short *coef, uint32_t count) {
+    const uint8_t *py[3] = {(const uint8_t *)y0, (const uint8_t *)y1, (const uint8_t *)y2};
+    uint8_t *out = (uint8_t *)dst;
+    __m128i c[9];
+    for (int i = 0; i < 9; i++) {
+        c[i] = _mm_set1_epi16(coef[i]);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i s0 = _mm_setzero_si128();
+        __m128i s1 = _mm_setzero_si128();
+        for (int r = 0; r < 3; r++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(py[r] + i * 8));
+            // Pixel pairs (0, 1), (1, 2) and (2, 3) feed taps 0, 1 and 2.
+            mac16(lo16(v), c[r * 3 + 0], &s0, &s1);
+            mac16(lo16(_mm_srli_si128(v, 4)), c[r * 3 + 1], &s0, &s1);
+            mac16(hi16(v), c[r * 3 + 2], &s0, &s1);
+        }
+        s0 = _mm_srai_epi32(s0, 8);
+        s1 = _mm_srai_epi32(s1, 8);
+        _mm_storel_epi64((__m128i *)out, packUchar(s0, s1));
+        out += 8;
+    }
+}
+
+/* Convolve 5x5: two pixels per count, reading six from each row. */
+extern "C" void rsdIntrinsicConvolve5x5_K(void *dst, const void *y0, const void *y1,
+                                          const void *y2, const void *y3, const void *y4,
+                                          const short *coef, uint32_t count) {
+    const uint8_t *py[5] = {(const uint8_t *)y0, (const uint8_t *)y1, (const uint8_t *)y2,
+                            (const uint8_t *)y3, (const uint8_t *)y4};
+    uint8_t *out = (uint8_t *)dst;
+    const __m128i round = _mm_set1_epi32(0x7f + 0x80);
+    __m128i c[25];
+    for (int i = 0; i < 25; i++) {
+        c[i] = _mm_set1_epi16(coef[i]);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i s0 = round;
+        __m128i s1 = round;
+        for (int r = 0; r < 5; r++) {
+            __m128i v0 = _mm_loadu_si128((const __m128i *)(py[r] + i * 8));
+            __m128i v1 = _mm_loadu_si128((const __m128i *)(py[r] + i * 8 + 8));
+            const __m128i *cr = &c[r * 5];
+            mac16(lo16(v0), cr[0], &s0, &s1);
+            mac16(lo16(_mm_srli_si128(v0, 4)), cr[1], &s0, &s1);
+            mac16(hi16(v0), cr[2], &s0, &s1);
+            mac16(lo16(_mm_srli_si128(v1, 4)), cr[3], &s0, &s1);
+            mac16(hi16(v1), cr[4], &s0, &s1);
+        }
+        s0 = _mm_srai_epi32(s0, 8);
+        s1 = _mm_srai_epi32(s1, 8);
+        _mm_storel_epi64((__m128i *)out, packUchar(s0, s1));
+        out += 8;
+    }
+}
+
+/* Convolve with a size x size kernel over rows of ch channel elements,
+ * eight channels per count. */
+extern "C" void rsdIntrinsicConvolveFlatU8_K(uint8_t *dst, const uint8_t * const *rows,
+                                             const short *coef, uint32_t size, uint32_t ch,
+                                             uint32_t count8) {
+    const __m128i zero = _mm_setzero_si128();
+    for (uint32_t i = 0; i < count8; i++) {
+        __m128i s0 = zero;
+        __m128i s1 = zero;
+        const short *c = coef;
+        for (uint32_t r = 0; r < size; r++) {
+            const uint8_t *pi = rows[r] + i * 8;
+            for (uint32_t t = 0; t < size; t++) {
+                // (v, 0) pairs against (c, 0) give v * c in each lane.
+                __m128i v = lo16(_mm_loadl_epi64((const __m128i *)pi));
+                __m128i cv = _mm_set1_epi32((uint16_t)*c++);
+                s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi16(v, zero), cv));
+                s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi16(v, zero), cv));
+                pi += ch;
+            }
+        }
+        s0 = _mm_srai_epi32(s0, 8);
+        s1 = _mm_srai_epi32(s1, 8);
+        _mm_storel_epi64((__m128i *)dst, packUchar(s0, s1));
+        dst += 8;
+    }
+}
+
+extern "C" void rsdIntrinsicConvolveFlatF32_K(float *dst, const float * const *rows,
+                                              const float *coef, uint32_t size, uint32_t ch,
+                                              uint32_t count8) {
+    for (uint32_t i = 0; i < count8; i++) {
+        __m128 s0 = _mm_setzero_ps();
+        __m128 s1 = _mm_setzero_ps();
+        const float *c = coef;
+        for (uint32_t r = 0; r < size; r++) {
+            const float *pi = rows[r] + i * 8;
+            for (uint32_t t = 0; t < size; t++) {
+                __m128 cv = _mm_set1_ps(*c++);
+                s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(pi), cv));
+                s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(pi + 4), cv));
+                pi += ch;
+            }
+        }
+        _mm_storeu_ps(dst, s0);
+        _mm_storeu_ps(dst + 4, s1);
+        dst += 8;
+    }
+}
+
+/* dst[i] += w[0] * src[i], eight floats per count. */
+extern "C" void rsdIntrinsicConvolveAxpy_K(float *dst, const float *src, const float *w,
+                                           uint32_t count8) {
+    const __m128 wv = _mm_set1_ps(w[0]);
+    for (uint32_t i = 0; i < count8; i++) {
+        __m128 a = _mm_loadu_ps(dst);
+        __m128 b = _mm_loadu_ps(dst + 4);
+        a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(src), wv));
+        b = _mm_add_ps(b, _mm_mul_ps(_mm_loadu_ps(src + 4), wv));
+        _mm_storeu_ps(dst, a);
+        _mm_storeu_ps(dst + 4, b);
+        dst += 8;
+        src += 8;
+    }
+}
+
+/* dst[i] = src[i] * scale[0], eight bytes to floats per count. */
+extern "C" void rsdIntrinsicConvertU8ToF32_K(float *dst, const uint8_t *src, const float *scale,
+                                             uint32_t count8) {
+    const __m128 sv = _mm_set1_ps(scale[0]);
+    const __m128i zero = _mm_setzero_si128();
+    for (uint32_t i = 0; i < count8; i++) {
+        __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), zero);
+        __m128 a = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+        __m128 b = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+        _mm_storeu_ps(dst, _mm_mul_ps(a, sv));
+        _mm_storeu_ps(dst + 4, _mm_mul_ps(b, sv));
+        dst += 8;
+        src += 8;
+    }
+}
+
+/* dst[i] = saturate(src[i] * scale[0] + 0.5), eight floats to bytes per
+ * count.  maxps returns its second operand for NaN, which becomes 0. */
+extern "C" void rsdIntrinsicConvertF32ToU8_K(uint8_t *dst, const float *src, const float *scale,
+                                             uint32_t count8) {
+    const __m128 sv = _mm_set1_ps(scale[0]);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max = _mm_set1_ps(255.f);
+    for (uint32_t i = 0; i < count8; i++) {
+        __m128 a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src), sv), half);
+        __m128 b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + 4), sv), half);
+        a = _mm_min_ps(_mm_max_ps(a, zero), max);
+        b = _mm_min_ps(_mm_max_ps(b, zero), max);
+        __m128i w = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(w, w));
+        dst += 8;
+        src += 8;
+    }
+}
+
+
+/* Vertical blur pass, two uchar4 to two float4 per step from x1 to x2. */
+extern "C" void rsdIntrinsicBlurVFU4_K(void *dst, const void *pin, int stride, const void *gptr,
+                                       int rct, int x1, int x2) {
+    float *out = (float *)dst;
+    const float *g = (const float *)gptr;
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; x1 != x2; x1 += 2) {
+        const uint8_t *pi = (const uint8_t *)pin + x1 * 4;
+        __m128 s0 = _mm_setzero_ps();
+        __m128 s1 = _mm_setzero_ps();
+        for (int r = 0; r < rct; r++) {
+            __m128i v = lo16(_mm_loadl_epi64((const __m128i *)pi));
+            __m128 w = _mm_set1_ps(g[r]);
+            s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), w));
+            s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), w));
+            pi += stride;
+        }
+        _mm_storeu_ps(out, s0);
+        _mm_storeu_ps(out + 4, s1);
+        out += 8;
+    }
+}
+
+/* Horizontal blur pass, one float4 to uchar4 per step from x1 to x2. */
+extern "C" void rsdIntrinsicBlurHFU4_K(void *dst, const void *pin, const void *gptr,
+                                       int rct, int x1, int x2) {
+    uint8_t *out = (uint8_t *)dst;
+    const float *g = (const float *)gptr;
+
+    for (; x1 != x2; x1++) {
+        const float *pi = (const float *)pin + x1 * 4;
+        __m128 s = _mm_setzero_ps();
+        for (int r = 0; r < rct; r++) {
+            s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(pi + r * 4), _mm_set1_ps(g[r])));
+        }
+        __m128i v = _mm_cvttps_epi32(s);
+        *(int32_t *)out = _mm_cvtsi128_si32(packUchar(v, v));
+        out += 4;
+    }
+}
+
+/* Horizontal blur pass for one channel, four pixels per step from x1 to x2. */
+extern "C" void rsdIntrinsicBlurHFU1_K(void *dst, const void *pin, const void *gptr,
+                                       int rct, int x1, int x2) {
+    uint8_t *out = (uint8_t *)dst;
+    const float *g = (const float *)gptr;
+
+    for (; x1 != x2; x1 += 4) {
+        const float *pi = (const float *)pin + x1;
+        __m128 s = _mm_setzero_ps();
+        for (int r = 0; r < rct; r++) {
+            s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(pi + r), _mm_set1_ps(g[r])));
+        }
+        __m128i v = _mm_cvttps_epi32(s);
+        *(int32_t *)out = _mm_cvtsi128_si32(packUchar(v, v));
+        out += 4;
+    }
+}
+
+
+/*
+    YUV to RGBA, eight pixels per count.  u and v hold the chroma of each
+    pixel as 16 bit lanes, already repeated for both pixels of a pair.
+    param is the YuvCoeff table of rsCpuIntrinsicYuvToRGB.cpp.
+*/
+static inline void yuvToRGBA8(uint8_t *out, __m128i y, __m128i u, __m128i v,
+                              const short *param) {
+    const __m128i round = _mm_set1_epi32(128);
+    y = _mm_sub_epi16(lo16(y), _mm_set1_epi16(param[8]));
+    u = _mm_sub_epi16(u, _mm_set1_epi16(param[16]));
+    v = _mm_sub_epi16(v, _mm_set1_epi16(param[16]));
+
+    __m128i yl, yh;
+    mul16(y, _mm_set1_epi16(param[0]), &yl, &yh);
+    yl = _mm_add_epi32(yl, round);
+    yh = _mm_add_epi32(yh, round);
+
+    __m128i rl = yl, rh = yh;
+    mac16(v, _mm_set1_epi16(param[1]), &rl, &rh);
+    __m128i gl = yl, gh = yh;
+    mac16(u, _mm_set1_epi16(param[2]), &gl, &gh);
+    mac16(v, _mm_set1_epi16(param[4]), &gl, &gh);
+    __m128i bl = yl, bh = yh;
+    mac16(u, _mm_set1_epi16(param[3]), &bl, &bh);
+
+    __m128i r = packUchar(_mm_srai_epi32(rl, 8), _mm_srai_epi32(rh, 8));
+    __m128i g = packUchar(_mm_srai_epi32(gl, 8), _mm_srai_epi32(gh, 8));
+    __m128i b = packUchar(_mm_srai_epi32(bl, 8), _mm_srai_epi32(bh, 8));
+    __m128i a = _mm_set1_epi8((char)param[5]);
+
+    __m128i rg = _mm_unpacklo_epi8(r, g);
+    __m128i ba = _mm_unpacklo_epi8(b, a);
+    _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+// Zero extends the even or odd bytes of an interleaved chroma row to 16
+// bits, repeating each one for both pixels that share it.
+static inline __m128i chromaEven(__m128i c) {
+    return _mm_shuffle_epi8(c, _mm_setr_epi8(0, -1, 0, -1, 2, -1, 2, -1,
+                                             4, -1, 4, -1, 6, -1, 6, -1));
+}
+
+static inline __m128i chromaOdd(__m128i c) {
+    return _mm_shuffle_epi8(c, _mm_setr_epi8(1, -1, 1, -1, 3, -1, 3, -1,
+                                             5, -1, 5, -1, 7, -1, 7, -1));
+}
+
+static inline __m128i chromaPlanar(__m128i c) {
+    return _mm_shuffle_epi8(c, _mm_setr_epi8(0, -1, 0, -1, 1, -1, 1, -1,
+                                             2, -1, 2, -1, 3, -1, 3, -1));
+}
+
+/* Interleaved chroma, V first (NV21). */
+extern "C" void rsdIntrinsicYuv_K(void *dst, const uint8_t *Y, const uint8_t *uv,
+                                  uint32_t count, const short *param) {
+    uint8_t *out = (uint8_t *)dst;
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i y = _mm_loadl_epi64((const __m128i *)(Y + i * 8));
+        __m128i c = _mm_loadl_epi64((const __m128i *)(uv + i * 8));
+        yuvToRGBA8(out, y, chromaOdd(c), chromaEven(c), param);
+        out += 32;
+    }
+}
+
+/* Interleaved chroma, U first (NV12). */
+extern "C" void rsdIntrinsicYuvR_K(void *dst, const uint8_t *Y, const uint8_t *uv,
+                                   uint32_t count, const short *param) {
+    uint8_t *out = (uint8_t *)dst;
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i y = _mm_loadl_epi64((const __m128i *)(Y + i * 8));
+        __m128i c = _mm_loadl_epi64((const __m128i *)(uv + i * 8));
+        yuvToRGBA8(out, y, chromaEven(c), chromaOdd(c), param);
+        out += 32;
+    }
+}
+
+/* Planar chroma (YV12, I420). */
+extern "C" void rsdIntrinsicYuv2_K(void *dst, const uint8_t *Y, const uint8_t *u,
+                                   const uint8_t *v, uint32_t count, const short *param) {
+    uint8_t *out = (uint8_t *)dst;
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i y = _mm_loadl_epi64((const __m128i *)(Y + i * 8));
+        __m128i cu = _mm_cvtsi32_si128(*(const int32_t *)(u + i * 4));
+        __m128i cv = _mm_cvtsi32_si128(*(const int32_t *)(v + i * 4));
+        yuvToRGBA8(out, y, chromaPlanar(cu), chromaPlanar(cv), param);
+        out += 32;
+    }
+}
+
+
+/*
+    Blends, eight pixels per count.  The arithmetic is on two pixels of 16
+    bit lanes at a time and wraps and truncates like the neon versions.
+*/
+static inline __m128i alpha16(__m128i p) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0xff), 0xff);
+}
+
+static inline __m128i inv16(__m128i p) {
+    return _mm_sub_epi16(_mm_set1_epi16(255), p);
+}
+
+// Keeps the alpha lanes of d and the colour lanes of c.
+static inline __m128i keepAlpha16(__m128i c, __m128i d) {
+    const __m128i mask = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    return _mm_or_si128(_mm_andnot_si128(mask, c), _mm_and_si128(mask, d));
+}
+
+static inline __m128i opSrcOver(__m128i s, __m128i d) {
+    __m128i t = _mm_add_epi16(_mm_slli_epi16(s, 8), _mm_mullo_epi16(d, inv16(alpha16(s))));
+    return _mm_srli_epi16(t, 8);
+}
+
+static inline __m128i opDstOver(__m128i s, __m128i d) {
+    return opSrcOver(d, s);
+}
+
+static inline __m128i opSrcIn(__m128i s, __m128i d) {
+    return _mm_srli_epi16(_mm_mullo_epi16(s, alpha16(d)), 8);
+}
+
+static inline __m128i opDstIn(__m128i s, __m128i d) {
+    return opSrcIn(d, s);
+}
+
+static inline __m128i opSrcOut(__m128i s, __m128i d) {
+    return _mm_srli_epi16(_mm_mullo_epi16(s, inv16(alpha16(d))), 8);
+}
+
+static inline __m128i opDstOut(__m128i s, __m128i d) {
+    return opSrcOut(d, s);
+}
+
+static inline __m128i opSrcAtop(__m128i s, __m128i d) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, alpha16(d)),
+                              _mm_mullo_epi16(d, inv16(alpha16(s))));
+    return keepAlpha16(_mm_srli_epi16(t, 8), d);
+}
+
+static inline __m128i opDstAtop(__m128i s, __m128i d) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, alpha16(s)),
+                              _mm_mullo_epi16(s, inv16(alpha16(d))));
+    return keepAlpha16(_mm_srli_epi16(t, 8), d);
+}
+
+static inline __m128i opMultiply(__m128i s, __m128i d) {
+    return _mm_srli_epi16(_mm_mullo_epi16(s, d), 8);
+}
+
+static inline void blend16(void *dst, const void *src, uint32_t count8,
+                           __m128i (*op)(__m128i, __m128i)) {
+    __m128i *out = (__m128i *)dst;
+    const __m128i *in = (const __m128i *)src;
+    for (uint32_t i = 0; i < count8 * 2; i++) {
+        __m128i s = _mm_loadu_si128(in + i);
+        __m128i d = _mm_loadu_si128(out + i);
+        __m128i lo = op(lo16(s), lo16(d));
+        __m128i hi = op(hi16(s), hi16(d));
+        _mm_storeu_si128(out + i, _mm_packus_epi16(lo, hi));
+    }
+}
+
+extern "C" void rsdIntrinsicBlendSrcOver_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opSrcOver);
+}
+
+extern "C" void rsdIntrinsicBlendDstOver_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opDstOver);
+}
+
+extern "C" void rsdIntrinsicBlendSrcIn_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opSrcIn);
+}
+
+extern "C" void rsdIntrinsicBlendDstIn_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opDstIn);
+}
+
+extern "C" void rsdIntrinsicBlendSrcOut_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opSrcOut);
+}
+
+extern "C" void rsdIntrinsicBlendDstOut_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opDstOut);
+}
+
+extern "C" void rsdIntrinsicBlendSrcAtop_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opSrcAtop);
+}
+
+extern "C" void rsdIntrinsicBlendDstAtop_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opDstAtop);
+}
+
+extern "C" void rsdIntrinsicBlendMultiply_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, opMultiply);
+}
+
+// Xor, Add and Subtract need no widening.
+extern "C" void rsdIntrinsicBlendXor_K(void *dst, const void *src, uint32_t count8) {
+    __m128i *out = (__m128i *)dst;
+    const __m128i *in = (const __m128i *)src;
+    for (uint32_t i = 0; i < count8 * 2; i++) {
+        _mm_storeu_si128(out + i, _mm_xor_si128(_mm_loadu_si128(out + i),
+                                                _mm_loadu_si128(in + i)));
+    }
+}
+
+extern "C" void rsdIntrinsicBlendAdd_K(void *dst, const void *src, uint32_t count8) {
+    __m128i *out = (__m128i *)dst;
+    const __m128i *in = (const __m128i *)src;
+    for (uint32_t i = 0; i < count8 * 2; i++) {
+        _mm_storeu_si128(out + i, _mm_adds_epu8(_mm_loadu_si128(out + i),
+                                                _mm_loadu_si128(in + i)));
+    }
+}
+
+extern "C" void rsdIntrinsicBlendSub_K(void *dst, const void *src, uint32_t count8) {
+    __m128i *out = (__m128i *)dst;
+    const __m128i *in = (const __m128i *)src;
+    for (uint32_t i = 0; i < count8 * 2; i++) {
+        _mm_storeu_si128(out + i, _mm_subs_epu8(_mm_loadu_si128(out + i),
+                                                _mm_loadu_si128(in + i)));
+    }
+}
+
+
+/*
+    3D LUT, two pixels per count.  constants is {coordMul.xyz, 0, ...} as
+    built by rsCpuIntrinsic3DLUT.cpp.
+*/
+
+// a * w.lo + b * w.hi for four unsigned 16 bit a and b held in 32 bit
+// lanes, w being the two 16 bit weights repeated in every lane.
+static inline __m128i lerp16(__m128i a, __m128i b, __m128i w) {
+    __m128i t = _mm_or_si128(a, _mm_slli_epi32(b, 16));
+    __m128i l = _mm_mullo_epi16(t, w);
+    __m128i h = _mm_mulhi_epu16(t, w);
+    return _mm_hadd_epi32(_mm_unpacklo_epi16(l, h), _mm_unpackhi_epi16(l, h));
+}
+
+// The same for the two neighbouring uchar4 along x at p.
+static inline __m128i lerpX(const uint8_t *p, __m128i w) {
+    __m128i t = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)p),
+                                 _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1,
+                                               2, -1, 6, -1, 3, -1, 7, -1));
+    __m128i l = _mm_mullo_epi16(t, w);
+    __m128i h = _mm_mulhi_epu16(t, w);
+    return _mm_srli_epi32(_mm_hadd_epi32(_mm_unpacklo_epi16(l, h),
+                                         _mm_unpackhi_epi16(l, h)), 7);
+}
+
+static inline __m128i weights(int32_t base) {
+    int32_t w2 = base & 0x7fff;
+    int32_t w1 = 0x8000 - w2;
+    return _mm_set1_epi32((w2 << 16) | w1);
+}
+
+extern "C" void rsdIntrinsic3DLUT_K(void *dst, const void *src, const void *lut,
+                                    size_t lut_stride_y, size_t lut_stride_z,
+                                    uint32_t count, const void *constants) {
+    const uint8_t *in = (const uint8_t *)src;
+    uint8_t *out = (uint8_t *)dst;
+    const uint8_t *bp = (const uint8_t *)lut;
+    const short *c = (const short *)constants;
+    const uint32_t mulX = (uint16_t)c[0];
+    const uint32_t mulY = (uint16_t)c[1];
+    const uint32_t mulZ = (uint16_t)c[2];
+
+    for (uint32_t i = 0; i < count * 2; i++) {
+        int32_t bx = in[0] * mulX;
+        int32_t by = in[1] * mulY;
+        int32_t bz = in[2] * mulZ;
+        const uint8_t *p = bp + (bx >> 15) * 4 + (by >> 15) * lut_stride_y +
+                           (bz >> 15) * lut_stride_z;
+
+        __m128i wx = weights(bx);
+        __m128i wy = weights(by);
+        __m128i yz00 = lerpX(p, wx);
+        __m128i yz10 = lerpX(p + lut_stride_y, wx);
+        __m128i yz01 = lerpX(p + lut_stride_z, wx);
+        __m128i yz11 = lerpX(p + lut_stride_y + lut_stride_z, wx);
+
+        __m128i z0 = _mm_srli_epi32(lerp16(yz00, yz10, wy), 15);
+        __m128i z1 = _mm_srli_epi32(lerp16(yz01, yz11, wy), 15);
+        __m128i v = _mm_srli_epi32(lerp16(z0, z1, weights(bz)), 15);
+        v = _mm_srli_epi32(_mm_add_epi32(v, _mm_set1_epi32(0x80)), 8);
+
+        uint32_t px = (uint32_t)_mm_cvtsi128_si32(packUchar(v, v));
+        *(uint32_t *)out = (px & 0x00ffffff) | ((uint32_t)in[3] << 24);
+        in += 4;
+        out += 4;
+    }
+}
+
+
+/*
+    Color matrix for uchar4 in and out, four pixels per count.  coef points
+    at the 8.8 matrix ip[16] of the script, which is followed by the 16.16
+    adds ipa[16], each repeated four times.
+*/
+extern "C" void rsdIntrinsicColorMatrix4x4_K(void *dst, const void *src,
+                                             const short *coef, uint32_t count) {
+    const int32_t *add = (const int32_t *)(coef + 16);
+    // Row pairs (r, g) and (b, a) interleaved for madd, one output per lane.
+    const __m128i crg = _mm_setr_epi16(coef[0], coef[4], coef[1], coef[5],
+                                       coef[2], coef[6], coef[3], coef[7]);
+    const __m128i cba = _mm_setr_epi16(coef[8], coef[12], coef[9], coef[13],
+                                       coef[10], coef[14], coef[11], coef[15]);
+    const __m128i bias = _mm_add_epi32(_mm_setr_epi32(add[0], add[4], add[8], add[12]),
+                                       _mm_set1_epi32(128));
+    const __m128i *in = (const __m128i *)src;
+    __m128i *out = (__m128i *)dst;
+
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i v = _mm_loadu_si128(in + i);
+        __m128i p[2] = {lo16(v), hi16(v)};
+        __m128i s[4];
+        for (int j = 0; j < 2; j++) {
+            __m128i a = _mm_madd_epi16(_mm_shuffle_epi32(p[j], 0x00), crg);
+            __m128i b = _mm_madd_epi16(_mm_shuffle_epi32(p[j], 0x55), cba);
+            s[j * 2] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(a, b), bias), 8);
+            a = _mm_madd_epi16(_mm_shuffle_epi32(p[j], 0xaa), crg);
+            b = _mm_madd_epi16(_mm_shuffle_epi32(p[j], 0xff), cba);
+            s[j * 2 + 1] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(a, b), bias), 8);
+        }
+        __m128i lo = _mm_packs_epi32(s[0], s[1]);
+        __m128i hi = _mm_packs_epi32(s[2], s[3]);
+        _mm_storeu_si128(out + i, _mm_packus_epi16(lo, hi));
+    }
+}
+
+extern "C" void rsdIntrinsicHistogramBin_K(uint16_t *dst, const float *src, uint32_t count8,
+                                           const float *param) {
+    const __m128 lo = _mm_set1_ps(param[0]);
+    const __m128 scale = _mm_set1_ps(param[1]);
+    const __m128 last = _mm_set1_ps(param[2]);
+    const __m128 zero = _mm_setzero_ps();
+    // The low half of each 32 bit lane.
+    const __m128i narrow = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+
+    for (uint32_t i = 0; i < count8; i++) {
+        __m128i b[2];
+        for (int j = 0; j < 2; j++) {
+            __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i * 8 + j * 4), lo), scale);
+            // max returns its second operand for NaN, so NaN lands in bin 0.
+            t = _mm_min_ps(_mm_max_ps(t, zero), last);
+            b[j] = _mm_shuffle_epi8(_mm_cvttps_epi32(t), narrow);
+        }
+        _mm_storeu_si128((__m128i *)(dst + i * 8), _mm_unpacklo_epi64(b[0], b[1]));
+    }
+}
+
+extern "C" void rsdIntrinsicTransposeU8_K(void *dst, ptrdiff_t dstStride,
+                                          const void *src, ptrdiff_t srcStride,
+                                          uint32_t count) {
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i r[8];
+        for (int j = 0; j < 8; j++) {
+            r[j] = _mm_loadl_epi64((const __m128i *)s);
+            s += srcStride;
+        }
+        // Columns pair up, then gather four and eight rows.
+        __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+        __m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+        __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+        __m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+        __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+        __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+        __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+        __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+        __m128i c[4] = {_mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2),
+                        _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3)};
+
+        uint8_t *o = d;
+        for (int j = 0; j < 4; j++) {
+            _mm_storel_epi64((__m128i *)o, c[j]);
+            o += dstStride;
+            _mm_storel_epi64((__m128i *)o, _mm_unpackhi_epi64(c[j], c[j]));
+            o += dstStride;
+        }
+        d += 8;
+    }
+}
+
+extern "C" void rsdIntrinsicTransposeU32_K(void *dst, ptrdiff_t dstStride,
+                                           const void *src, ptrdiff_t srcStride,
+                                           uint32_t count) {
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    for (uint32_t i = 0; i < count; i++) {
+        __m128 r0 = _mm_loadu_ps((const float *)s);
+        __m128 r1 = _mm_loadu_ps((const float *)(s + srcStride));
+        __m128 r2 = _mm_loadu_ps((const float *)(s + srcStride * 2));
+        __m128 r3 = _mm_loadu_ps((const float *)(s + srcStride * 3));
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps((float *)d, r0);
+        _mm_storeu_ps((float *)(d + dstStride), r1);
+        _mm_storeu_ps((float *)(d + dstStride * 2), r2);
+        _mm_storeu_ps((float *)(d + dstStride * 3), r3);
+        s += srcStride * 4;
+        d += 16;
+    }
+}
+
+extern "C" void rsdIntrinsicReverseU8_K(void *dst, const void *srcEnd, uint32_t count16) {
+    const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i *d = (__m128i *)dst;
+    const __m128i *s = (const __m128i *)srcEnd;
+    for (uint32_t i = 0; i < count16; i++) {
+        s--;
+        _mm_storeu_si128(d++, _mm_shuffle_epi8(_mm_loadu_si128(s), rev));
+    }
+}
+
+extern "C" void rsdIntrinsicReverseU32_K(void *dst, const void *srcEnd, uint32_t count4) {
+    __m128i *d = (__m128i *)dst;
+    const __m128i *s = (const __m128i *)srcEnd;
+    for (uint32_t i = 0; i < count4; i++) {
+        s--;
+        _mm_storeu_si128(d++, _mm_shuffle_epi32(_mm_loadu_si128(s), 0x1b));
+    }
+}
+
+static inline __m128i min_epi32(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+extern "C" void rsdIntrinsicWarpBilinear4_K(void *dst, const void *src, const int32_t *coords,
+                                            const int32_t *param, uint32_t count4) {
+    const uint8_t *s = (const uint8_t *)src;
+    const ptrdiff_t stride = param[2];
+    const ptrdiff_t dx = param[3];
+    const ptrdiff_t dy = param[4];
+    const __m128i lastX = _mm_set1_epi32(param[0]);
+    const __m128i lastY = _mm_set1_epi32(param[1]);
+    const __m128i c128 = _mm_set1_epi32(128);
+    const __m128i round = _mm_set1_epi32(1 << 13);
+    const __m128i zero = _mm_setzero_si128();
+    // Repeats the low byte of each 32 bit lane across it.
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+    __m128i *d = (__m128i *)dst;
+
+    for (uint32_t i = 0; i < count4; i++) {
+        __m128 c0 = _mm_loadu_ps((const float *)coords);
+        __m128 c1 = _mm_loadu_ps((const float *)(coords + 4));
+        __m128i u = _mm_castps_si128(_mm_shuffle_ps(c0, c1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i v = _mm_castps_si128(_mm_shuffle_ps(c0, c1, _MM_SHUFFLE(3, 1, 3, 1)));
+        coords += 8;
+
+        __m128i x0 = min_epi32(_mm_srai_epi32(u, 16), lastX);
+        __m128i y0 = min_epi32(_mm_srai_epi32(v, 16), lastY);
+        __m128i fx = _mm_sub_epi32(_mm_srai_epi32(u, 9), _mm_slli_epi32(x0, 7));
+        __m128i fy = _mm_sub_epi32(_mm_srai_epi32(v, 9), _mm_slli_epi32(y0, 7));
+        __m128i fxc = _mm_shuffle_epi8(_mm_sub_epi32(c128, fx), spread);
+        __m128i fyc = _mm_shuffle_epi8(_mm_sub_epi32(c128, fy), spread);
+        fx = _mm_shuffle_epi8(fx, spread);
+        fy = _mm_shuffle_epi8(fy, spread);
+
+        int32_t xs[4], ys[4];
+        _mm_storeu_si128((__m128i *)xs, x0);
+        _mm_storeu_si128((__m128i *)ys, y0);
+        int32_t p[4][4];
+        for (int k = 0; k < 4; k++) {
+            const uint8_t *t = s + ys[k] * stride + xs[k] * 4;
+            p[0][k] = *(const int32_t *)t;
+            p[1][k] = *(const int32_t *)(t + dx);
+            p[2][k] = *(const int32_t *)(t + dy);
+            p[3][k] = *(const int32_t *)(t + dy + dx);
+        }
+        __m128i p00 = _mm_loadu_si128((const __m128i *)p[0]);
+        __m128i p01 = _mm_loadu_si128((const __m128i *)p[1]);
+        __m128i p10 = _mm_loadu_si128((const __m128i *)p[2]);
+        __m128i p11 = _mm_loadu_si128((const __m128i *)p[3]);
+
+        __m128i top0 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(p00, zero),
+                                                     _mm_unpacklo_epi8(fxc, zero)),
+                                     _mm_mullo_epi16(_mm_unpacklo_epi8(p01, zero),
+                                                     _mm_unpacklo_epi8(fx, zero)));
+        __m128i top1 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(p00, zero),
+                                                     _mm_unpackhi_epi8(fxc, zero)),
+                                     _mm_mullo_epi16(_mm_unpackhi_epi8(p01, zero),
+                                                     _mm_unpackhi_epi8(fx, zero)));
+        __m128i bot0 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(p10, zero),
+                                                     _mm_unpacklo_epi8(fxc, zero)),
+                                     _mm_mullo_epi16(_mm_unpacklo_epi8(p11, zero),
+                                                     _mm_unpacklo_epi8(fx, zero)));
+        __m128i bot1 = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(p10, zero),
+                                                     _mm_unpackhi_epi8(fxc, zero)),
+                                     _mm_mullo_epi16(_mm_unpackhi_epi8(p11, zero),
+                                                     _mm_unpackhi_epi8(fx, zero)));
+
+        // Each 32 bit sum is top * (128 - fy) + bottom * fy for one channel.
+        __m128i w0 = _mm_unpacklo_epi8(fyc, fy);
+        __m128i w1 = _mm_unpackhi_epi8(fyc, fy);
+        __m128i w00 = _mm_unpacklo_epi8(w0, zero);
+        __m128i w01 = _mm_unpackhi_epi8(w0, zero);
+        __m128i w10 = _mm_unpacklo_epi8(w1, zero);
+        __m128i w11 = _mm_unpackhi_epi8(w1, zero);
+        __m128i r0 = _mm_madd_epi16(_mm_unpacklo_epi16(top0, bot0), w00);
+        __m128i r1 = _mm_madd_epi16(_mm_unpackhi_epi16(top0, bot0), w01);
+        __m128i r2 = _mm_madd_epi16(_mm_unpacklo_epi16(top1, bot1), w10);
+        __m128i r3 = _mm_madd_epi16(_mm_unpackhi_epi16(top1, bot1), w11);
+        r0 = _mm_srli_epi32(_mm_add_epi32(r0, round), 14);
+        r1 = _mm_srli_epi32(_mm_add_epi32(r1, round), 14);
+        r2 = _mm_srli_epi32(_mm_add_epi32(r2, round), 14);
+        r3 = _mm_srli_epi32(_mm_add_epi32(r3, round), 14);
+        _mm_storeu_si128(d++, _mm_packus_epi16(_mm_packs_epi32(r0, r1),
+                                               _mm_packs_epi32(r2, r3)));
+    }
+}
+
+extern "C" void rsdIntrinsicMorphologyMinU8_K(void *dst, const void *a, const void *b,
+                                              uint32_t count16) {
+    __m128i *d = (__m128i *)dst;
+    const __m128i *pa = (const __m128i *)a;
+    const __m128i *pb = (const __m128i *)b;
+    for (uint32_t i = 0; i < count16; i++) {
+        _mm_storeu_si128(d++, _mm_min_epu8(_mm_loadu_si128(pa++), _mm_loadu_si128(pb++)));
+    }
+}
+
+extern "C" void rsdIntrinsicMorphologyMaxU8_K(void *dst, const void *a, const void *b,
+                                              uint32_t count16) {
+    __m128i *d = (__m128i *)dst;
+    const __m128i *pa = (const __m128i *)a;
+    const __m128i *pb = (const __m128i *)b;
+    for (uint32_t i = 0; i < count16; i++) {
+        _mm_storeu_si128(d++, _mm_max_epu8(_mm_loadu_si128(pa++), _mm_loadu_si128(pb++)));
+    }
+}
+
+// Leaves min(a, b) in a and max(a, b) in b.
+#define MEDIAN_SORT(a, b) { __m128i t = _mm_min_epu8(a, b); b = _mm_max_epu8(a, b); a = t; }
+
+extern "C" void rsdIntrinsicMedian3x3U8_K(void *dst, const void * const *rows, uint32_t step,
+                                          uint32_t count16) {
+    const uint8_t *r[3];
+    for (int k = 0; k < 3; k++) {
+        r[k] = (const uint8_t *)rows[k] - step;
+    }
+    __m128i *d = (__m128i *)dst;
+    for (uint32_t i = 0; i < count16; i++) {
+        __m128i p[9];
+        for (int k = 0; k < 9; k++) {
+            p[k] = _mm_loadu_si128((const __m128i *)(r[k / 3] + (k % 3) * step));
+        }
+        MEDIAN_SORT(p[1], p[2]); MEDIAN_SORT(p[4], p[5]); MEDIAN_SORT(p[7], p[8]);
+        MEDIAN_SORT(p[0], p[1]); MEDIAN_SORT(p[3], p[4]); MEDIAN_SORT(p[6], p[7]);
+        MEDIAN_SORT(p[1], p[2]); MEDIAN_SORT(p[4], p[5]); MEDIAN_SORT(p[7], p[8]);
+        MEDIAN_SORT(p[0], p[3]); MEDIAN_SORT(p[5], p[8]); MEDIAN_SORT(p[4], p[7]);
+        MEDIAN_SORT(p[3], p[6]); MEDIAN_SORT(p[1], p[4]); MEDIAN_SORT(p[2], p[5]);
+        MEDIAN_SORT(p[4], p[7]); MEDIAN_SORT(p[4], p[2]); MEDIAN_SORT(p[6], p[4]);
+        MEDIAN_SORT(p[4], p[2]);
+        _mm_storeu_si128(d++, p[4]);
+        for (int k = 0; k < 3; k++) {
+            r[k] += 16;
+        }
+    }
+}
+
+extern "C" void rsdIntrinsicMedian5x5U8_K(void *dst, const void * const *rows, uint32_t step,
+                                          uint32_t count16) {
+    const uint8_t *r[5];
+    for (int k = 0; k < 5; k++) {
+        r[k] = (const uint8_t *)rows[k] - step * 2;
+    }
+    __m128i *d = (__m128i *)dst;
+    for (uint32_t i = 0; i < count16; i++) {
+        __m128i p[25];
+        for (int k = 0; k < 25; k++) {
+            p[k] = _mm_loadu_si128((const __m128i *)(r[k / 5] + (k % 5) * step));
+        }
+        MEDIAN_SORT(p[0], p[1]); MEDIAN_SORT(p[3], p[4]); MEDIAN_SORT(p[2], p[4]);
+        MEDIAN_SORT(p[2], p[3]); MEDIAN_SORT(p[6], p[7]); MEDIAN_SORT(p[5], p[7]);
+        MEDIAN_SORT(p[5], p[6]); MEDIAN_SORT(p[9], p[10]); MEDIAN_SORT(p[8], p[10]);
+        MEDIAN_SORT(p[8], p[9]); MEDIAN_SORT(p[12], p[13]); MEDIAN_SORT(p[11], p[13]);
+        MEDIAN_SORT(p[11], p[12]); MEDIAN_SORT(p[15], p[16]); MEDIAN_SORT(p[14], p[16]);
+        MEDIAN_SORT(p[14], p[15]); MEDIAN_SORT(p[18], p[19]); MEDIAN_SORT(p[17], p[19]);
+        MEDIAN_SORT(p[17], p[18]); MEDIAN_SORT(p[21], p[22]); MEDIAN_SORT(p[20], p[22]);
+        MEDIAN_SORT(p[20], p[21]); MEDIAN_SORT(p[23], p[24]); MEDIAN_SORT(p[2], p[5]);
+        MEDIAN_SORT(p[3], p[6]); MEDIAN_SORT(p[0], p[6]); MEDIAN_SORT(p[0], p[3]);
+        MEDIAN_SORT(p[4], p[7]); MEDIAN_SORT(p[1], p[7]); MEDIAN_SORT(p[1], p[4]);
+        MEDIAN_SORT(p[11], p[14]); MEDIAN_SORT(p[8], p[14]); MEDIAN_SORT(p[8], p[11]);
+        MEDIAN_SORT(p[12], p[15]); MEDIAN_SORT(p[9], p[15]); MEDIAN_SORT(p[9], p[12]);
+        MEDIAN_SORT(p[13], p[16]); MEDIAN_SORT(p[10], p[16]); MEDIAN_SORT(p[10], p[13]);
+        MEDIAN_SORT(p[20], p[23]); MEDIAN_SORT(p[17], p[23]); MEDIAN_SORT(p[17], p[20]);
+        MEDIAN_SORT(p[21], p[24]); MEDIAN_SORT(p[18], p[24]); MEDIAN_SORT(p[18], p[21]);
+        MEDIAN_SORT(p[19], p[22]); MEDIAN_SORT(p[8], p[17]); MEDIAN_SORT(p[9], p[18]);
+        MEDIAN_SORT(p[0], p[18]); MEDIAN_SORT(p[0], p[9]); MEDIAN_SORT(p[10], p[19]);
+        MEDIAN_SORT(p[1], p[19]); MEDIAN_SORT(p[1], p[10]); MEDIAN_SORT(p[11], p[20]);
+        MEDIAN_SORT(p[2], p[20]); MEDIAN_SORT(p[2], p[11]); MEDIAN_SORT(p[12], p[21]);
+        MEDIAN_SORT(p[3], p[21]); MEDIAN_SORT(p[3], p[12]); MEDIAN_SORT(p[13], p[22]);
+        MEDIAN_SORT(p[4], p[22]); MEDIAN_SORT(p[4], p[13]); MEDIAN_SORT(p[14], p[23]);
+        MEDIAN_SORT(p[5], p[23]); MEDIAN_SORT(p[5], p[14]); MEDIAN_SORT(p[15], p[24]);
+        MEDIAN_SORT(p[6], p[24]); MEDIAN_SORT(p[6], p[15]); MEDIAN_SORT(p[7], p[16]);
+        MEDIAN_SORT(p[7], p[19]); MEDIAN_SORT(p[13], p[21]); MEDIAN_SORT(p[15], p[23]);
+        MEDIAN_SORT(p[7], p[13]); MEDIAN_SORT(p[7], p[15]); MEDIAN_SORT(p[1], p[9]);
+        MEDIAN_SORT(p[3], p[11]); MEDIAN_SORT(p[5], p[17]); MEDIAN_SORT(p[11], p[17]);
+        MEDIAN_SORT(p[9], p[17]); MEDIAN_SORT(p[4], p[10]); MEDIAN_SORT(p[6], p[12]);
+        MEDIAN_SORT(p[7], p[14]); MEDIAN_SORT(p[4], p[6]); MEDIAN_SORT(p[4], p[7]);
+        MEDIAN_SORT(p[12], p[14]); MEDIAN_SORT(p[10], p[14]); MEDIAN_SORT(p[6], p[7]);
+        MEDIAN_SORT(p[10], p[12]); MEDIAN_SORT(p[6], p[10]); MEDIAN_SORT(p[6], p[17]);
+        MEDIAN_SORT(p[12], p[17]); MEDIAN_SORT(p[7], p[17]); MEDIAN_SORT(p[7], p[10]);
+        MEDIAN_SORT(p[12], p[18]); MEDIAN_SORT(p[7], p[12]); MEDIAN_SORT(p[10], p[18]);
+        MEDIAN_SORT(p[12], p[20]); MEDIAN_SORT(p[10], p[20]); MEDIAN_SORT(p[10], p[12]);
+        _mm_storeu_si128(d++, p[12]);
+        for (int k = 0; k < 5; k++) {
+            r[k] += 16;
+        }
+    }
+}
+
+#undef MEDIAN_SORT
+
+extern "C" void rsdIntrinsicIntegralU8_K(uint32_t *dst, const uint8_t *src,
+                                         const uint32_t *above, uint32_t count8) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (uint32_t i = 0; i < count8; i++) {
+        // Eight sums of bytes fit in 16 bits.
+        __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), zero);
+        p = _mm_add_epi16(p, _mm_slli_si128(p, 2));
+        p = _mm_add_epi16(p, _mm_slli_si128(p, 4));
+        p = _mm_add_epi16(p, _mm_slli_si128(p, 8));
+        __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(p, zero), sum);
+        __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(p, zero), sum);
+        sum = _mm_shuffle_epi32(hi, 0xff);
+        _mm_storeu_si128((__m128i *)dst,
+                         _mm_add_epi32(lo, _mm_loadu_si128((const __m128i *)above)));
+        _mm_storeu_si128((__m128i *)(dst + 4),
+                         _mm_add_epi32(hi, _mm_loadu_si128((const __m128i *)(above + 4))));
+        src += 8;
+        above += 8;
+        dst += 8;
+    }
+}
+
+extern "C" void rsdIntrinsicIntegralU8_4_K(uint32_t *dst, const uint8_t *src,
+                                           const uint32_t *above, uint32_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (uint32_t i = 0; i < count; i++) {
+        __m128i p = _mm_cvtsi32_si128(*(const int32_t *)src);
+        sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero));
+        _mm_storeu_si128((__m128i *)dst,
+                         _mm_add_epi32(sum, _mm_loadu_si128((const __m128i *)above)));
+        src += 4;
+        above += 4;
+        dst += 4;
+    }
+}
+
+extern "C" void rsdIntrinsicScanI32_K(int32_t *dst, const int32_t *src, int32_t *carry,
+                                      uint32_t count4) {
+    __m128i sum = _mm_set1_epi32(*carry);
+    for (uint32_t i = 0; i < count4; i++) {
+        __m128i p = _mm_loadu_si128((const __m128i *)src);
+        p = _mm_add_epi32(p, _mm_slli_si128(p, 4));
+        p = _mm_add_epi32(p, _mm_slli_si128(p, 8));
+        p = _mm_add_epi32(p, sum);
+        sum = _mm_shuffle_epi32(p, 0xff);
+        _mm_storeu_si128((__m128i *)dst, p);
+        src += 4;
+        dst += 4;
+    }
+    *carry = _mm_cvtsi128_si32(sum);
+}
+
+extern "C" void rsdIntrinsicScanF32_K(float *dst, const float *src, float *carry,
+                                      uint32_t count4) {
+    __m128 sum = _mm_set1_ps(*carry);
+    for (uint32_t i = 0; i < count4; i++) {
+        __m128 p = _mm_loadu_ps(src);
+        p = _mm_add_ps(p, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(p), 4)));
+        p = _mm_add_ps(p, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(p), 8)));
+        p = _mm_add_ps(p, sum);
+        sum = _mm_shuffle_ps(p, p, 0xff);
+        _mm_storeu_ps(dst, p);
+        src += 4;
+        dst += 4;
+    }
+    *carry = _mm_cvtss_f32(sum);
+}
+
+extern "C" void rsdIntrinsicGemmF32_K(float *acc, const float *a, const float *b, uint32_t kc) {
+    __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+    __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+    __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+    __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+    for (uint32_t k = 0; k < kc; k++) {
+        __m128 b0 = _mm_loadu_ps(b);
+        __m128 b1 = _mm_loadu_ps(b + 4);
+        __m128 av = _mm_loadu_ps(a);
+        __m128 ai = _mm_shuffle_ps(av, av, 0x00);
+        c00 = _mm_add_ps(c00, _mm_mul_ps(ai, b0));
+        c01 = _mm_add_ps(c01, _mm_mul_ps(ai, b1));
+        ai = _mm_shuffle_ps(av, av, 0x55);
+        c10 = _mm_add_ps(c10, _mm_mul_ps(ai, b0));
+        c11 = _mm_add_ps(c11, _mm_mul_ps(ai, b1));
+        ai = _mm_shuffle_ps(av, av, 0xaa);
+        c20 = _mm_add_ps(c20, _mm_mul_ps(ai, b0));
+        c21 = _mm_add_ps(c21, _mm_mul_ps(ai, b1));
+        ai = _mm_shuffle_ps(av, av, 0xff);
+        c30 = _mm_add_ps(c30, _mm_mul_ps(ai, b0));
+        c31 = _mm_add_ps(c31, _mm_mul_ps(ai, b1));
+        a += 4;
+        b += 8;
+    }
+    _mm_storeu_ps(acc, c00);
+    _mm_storeu_ps(acc + 4, c01);
+    _mm_storeu_ps(acc + 8, c10);
+    _mm_storeu_ps(acc + 12, c11);
+    _mm_storeu_ps(acc + 16, c20);
+    _mm_storeu_ps(acc + 20, c21);
+    _mm_storeu_ps(acc + 24, c30);
+    _mm_storeu_ps(acc + 28, c31);
+}
+
+// Panels hold pairs of k, so one madd multiplies and sums both.
+extern "C" void rsdIntrinsicGemmU8_K(int32_t *acc, const int16_t *a, const int16_t *b,
+                                     uint32_t kc2) {
+    __m128i c00 = _mm_setzero_si128(), c01 = _mm_setzero_si128();
+    __m128i c10 = _mm_setzero_si128(), c11 = _mm_setzero_si128();
+    __m128i c20 = _mm_setzero_si128(), c21 = _mm_setzero_si128();
+    __m128i c30 = _mm_setzero_si128(), c31 = _mm_setzero_si128();
+    for (uint32_t k = 0; k < kc2; k++) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)b);
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(b + 8));
+        __m128i av = _mm_loadu_si128((const __m128i *)a);
+        __m128i ai = _mm_shuffle_epi32(av, 0x00);
+        c00 = _mm_add_epi32(c00, _mm_madd_epi16(ai, b0));
+        c01 = _mm_add_epi32(c01, _mm_madd_epi16(ai, b1));
+        ai = _mm_shuffle_epi32(av, 0x55);
+        c10 = _mm_add_epi32(c10, _mm_madd_epi16(ai, b0));
+        c11 = _mm_add_epi32(c11, _mm_madd_epi16(ai, b1));
+        ai = _mm_shuffle_epi32(av, 0xaa);
+        c20 = _mm_add_epi32(c20, _mm_madd_epi16(ai, b0));
+        c21 = _mm_add_epi32(c21, _mm_madd_epi16(ai, b1));
+        ai = _mm_shuffle_epi32(av, 0xff);
+        c30 = _mm_add_epi32(c30, _mm_madd_epi16(ai, b0));
+        c31 = _mm_add_epi32(c31, _mm_madd_epi16(ai, b1));
+        a += 8;
+        b += 16;
+    }
+    _mm_storeu_si128((__m128i *)acc, c00);
+    _mm_storeu_si128((__m128i *)(acc + 4), c01);
+    _mm_storeu_si128((__m128i *)(acc + 8), c10);
+    _mm_storeu_si128((__m128i *)(acc + 12), c11);
+    _mm_storeu_si128((__m128i *)(acc + 16), c20);
+    _mm_storeu_si128((__m128i *)(acc + 20), c21);
+    _mm_storeu_si128((__m128i *)(acc + 24), c30);
+    _mm_storeu_si128((__m128i *)(acc + 28), c31);
+}
+
+// There is no byte gather, so each pixel's four lookups are done from its
+// packed word, as on ARM, with the vector unit loading and storing four
+// pixels at a time.
+extern "C" void rsdIntrinsicLUT_K(void *dst, const void *src, uint32_t count4,
+                                  const uint8_t *tables) {
+    const uint8_t *tg = tables + 256;
+    const uint8_t *tb = tables + 512;
+    const uint8_t *ta = tables + 768;
+    for (uint32_t i = 0; i < count4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)src + i);
+        uint32_t o[4];
+        for (int j = 0; j < 4; j++) {
+            uint32_t p = _mm_cvtsi128_si32(v);
+            v = _mm_srli_si128(v, 4);
+            o[j] = tables[p & 0xff] | (tg[(p >> 8) & 0xff] << 8) |
+                   (tb[(p >> 16) & 0xff] << 16) | ((uint32_t)ta[p >> 24] << 24);
+        }
+        _mm_storeu_si128((__m128i *)dst + i, _mm_setr_epi32(o[0], o[1], o[2], o[3]));
+    }
+}
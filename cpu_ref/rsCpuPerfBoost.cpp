@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsCpuPerfBoost.h"
+#include "rsUtils.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
+#include <cutils/properties.h>
+#include <hardware/hardware.h>
+#include <hardware/power.h>
+#endif
+
+using namespace android;
+using namespace android::renderscript;
+
+RsdCpuPerfBoost::RsdCpuPerfBoost() {
+    pthread_mutex_init(&mLock, NULL);
+    mEnabled = false;
+    mMinWorkNs = (uint64_t)kDefaultMinWorkUs * 1000;
+    mLingerNs = (uint64_t)kDefaultLingerMs * 1000000;
+    mHeldUntilNs = 0;
+    mPower = NULL;
+    mQosFd = -1;
+}
+
+RsdCpuPerfBoost::~RsdCpuPerfBoost() {
+    release();
+    pthread_mutex_destroy(&mLock);
+}
+
+void RsdCpuPerfBoost::init(bool enabled) {
+#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
+    char buf[PROPERTY_VALUE_MAX];
+    mEnabled = enabled;
+    if (property_get("debug.rs.boost", buf, NULL) > 0) {
+        mEnabled = (atoi(buf) != 0);
+    }
+    property_get("debug.rs.boost-us", buf, "0");
+    if (atoi(buf) > 0) {
+        mMinWorkNs = (uint64_t)atoi(buf) * 1000;
+    }
+    property_get("debug.rs.boost-linger-ms", buf, "0");
+    if (atoi(buf) > 0) {
+        mLingerNs = (uint64_t)atoi(buf) * 1000000;
+    }
+
+    const hw_module_t *module = NULL;
+    if (mEnabled && !hw_get_module(POWER_HARDWARE_MODULE_ID, &module)) {
+        mPower = (power_module_t *)module;
+        if (!mPower->powerHint) {
+            mPower = NULL;
+        }
+    }
+#else
+    // Neither the power HAL nor PM QoS is open to these builds.
+    mEnabled = false;
+#endif
+}
+
+void RsdCpuPerfBoost::launch(uint64_t workNs, uint32_t workers, uint64_t now) {
+    if (!mEnabled) {
+        return;
+    }
+    pthread_mutex_lock(&mLock);
+    releaseExpired(now);
+    if (workNs >= mMinWorkNs) {
+        hint(workNs / (workers ? workers : 1), now);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+void RsdCpuPerfBoost::hint(uint64_t launchNs, uint64_t now) {
+    // The hint covers the launch and the linger after it, and is only
+    // renewed once half of that is gone, so a burst of launches sends a
+    // few hints rather than one each.
+    const uint64_t until = now + launchNs + mLingerNs;
+    if (mHeldUntilNs && (until < mHeldUntilNs + mLingerNs / 2)) {
+        return;
+    }
+    mHeldUntilNs = until;
+
+#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
+    if (mPower) {
+        // The HAL drops interaction hints once their duration is over.
+        int durationMs = (int)((until - now) / 1000000);
+        mPower->powerHint(mPower, POWER_HINT_INTERACTION, &durationMs);
+        return;
+    }
+    if (mQosFd < 0) {
+        // The request stands for as long as the file is open; asking for
+        // no wakeup latency keeps the cores out of deep idle between
+        // slices, which also keeps the governor from seeing them idle.
+        mQosFd = open("/dev/cpu_dma_latency", O_WRONLY | O_CLOEXEC);
+        int32_t latencyUs = 0;
+        if ((mQosFd < 0) || (write(mQosFd, &latencyUs, sizeof(latencyUs)) != sizeof(latencyUs))) {
+            ALOGV("No power HAL or PM QoS to hint large launches with");
+            release();
+            mEnabled = false;
+        }
+    }
+#endif
+}
+
+int32_t RsdCpuPerfBoost::idle(uint64_t now) {
+    if (!mEnabled) {
+        return -1;
+    }
+    pthread_mutex_lock(&mLock);
+    releaseExpired(now);
+    // Interaction hints run out by themselves.
+    int32_t wait = -1;
+    if (mHeldUntilNs && (mQosFd >= 0)) {
+        wait = (int32_t)((mHeldUntilNs - now) / 1000000) + 1;
+    }
+    pthread_mutex_unlock(&mLock);
+    return wait;
+}
+
+void RsdCpuPerfBoost::releaseExpired(uint64_t now) {
+    if (mHeldUntilNs && (now >= mHeldUntilNs)) {
+        release();
+    }
+}
+
+void RsdCpuPerfBoost::release() {
+    mHeldUntilNs = 0;
+    if (mQosFd >= 0) {
+        close(mQosFd);
+        mQosFd = -1;
+    }
+}
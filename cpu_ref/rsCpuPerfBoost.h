@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RSD_CPU_PERF_BOOST_H
+#define RSD_CPU_PERF_BOOST_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+struct power_module;
+
+namespace android {
+namespace renderscript {
+
+// Asks the platform to raise CPU clocks for the length of large launches,
+// which otherwise often finish before the governor has ramped up.  The
+// power HAL's interaction hint is used where there is one, and a PM QoS
+// latency request otherwise.  A hint is held for a linger period after
+// the last large launch so a stream of them is covered by one request.
+class RsdCpuPerfBoost {
+public:
+    RsdCpuPerfBoost();
+    ~RsdCpuPerfBoost();
+
+    // Contexts created with RS_CONTEXT_PERF_HINTS pass enabled.
+    // debug.rs.boost set to 0 or 1 overrides it for every context, and
+    // debug.rs.boost-us and debug.rs.boost-linger-ms set the work a launch
+    // needs to be boosted and how long the hint is held.
+    void init(bool enabled);
+    bool isEnabled() const { return mEnabled; }
+
+    // Called before a launch expected to keep the workers busy for workNs
+    // between them, workers of them running it.
+    void launch(uint64_t workNs, uint32_t workers, uint64_t now);
+    // Drops a hint whose linger period is over.  Returns the ms until it
+    // should be called again, or -1 when there is nothing to drop.
+    int32_t idle(uint64_t now);
+
+private:
+    static const uint32_t kDefaultMinWorkUs = 4000;
+    static const uint32_t kDefaultLingerMs = 100;
+
+    // Sends or renews the hint for a launch taking launchNs.
+    void hint(uint64_t launchNs, uint64_t now);
+    void releaseExpired(uint64_t now);
+    void release();
+
+    // Synchronous contexts launch from several threads at once.
+    pthread_mutex_t mLock;
+    bool mEnabled;
+    uint64_t mMinWorkNs;
+    uint64_t mLingerNs;
+    // When the hint now held runs out, 0 for none.
+    uint64_t mHeldUntilNs;
+
+    struct power_module *mPower;
+    // /dev/cpu_dma_latency, -1 until a hint needs it.
+    int mQosFd;
+};
+
+}
+}
+
+#endif
@@ -100,13 +100,63 @@ static void SC_MatrixTranspose_2x2(Matrix2x2 *m) {
     m->transpose();
 }
 
+// Every thread draws from its own xorshift64* generator, so kernels calling
+// rsRand from all the workers neither serialize on libc's rand() state nor
+// repeat each other's sequences.
+static pthread_key_t gRandKey;
+static pthread_once_t gRandKeyOnce = PTHREAD_ONCE_INIT;
+static volatile int32_t gRandThreads = 0;
+static uint64_t gRandFallback = 0x9e3779b97f4a7c15ULL;
+
+static void createRandKey() {
+    pthread_key_create(&gRandKey, free);
+}
+
+static uint64_t * getRandState() {
+    pthread_once(&gRandKeyOnce, createRandKey);
+    uint64_t *state = (uint64_t *)pthread_getspecific(gRandKey);
+    if (!state) {
+        state = (uint64_t *)malloc(sizeof(uint64_t));
+        if (!state) {
+            return &gRandFallback;
+        }
+        // Spread the thread's number and the time with a splitmix64 step.
+        uint64_t z = ((uint64_t)time(NULL) << 32) +
+                     (uint32_t)__sync_fetch_and_add(&gRandThreads, 1);
+        z = (z + 0x9e3779b97f4a7c15ULL) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        *state = z ? z : 1;
+        pthread_setspecific(gRandKey, state);
+    }
+    return state;
+}
+
+// Uniform in [0, 1).
+static inline float nextRandf(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (float)((x * 0x2545f4914f6cdd1dULL) >> 40) * (1.f / 16777216.f);
+}
+
 float SC_randf2(float min, float max) {
-    float r = (float)rand();
-    r /= RAND_MAX;
+    float r = nextRandf(getRandState());
     r = r * (max - min) + min;
     return r;
 }
 
+// Fills values with count uniform numbers in [0, 1), for the vector
+// rsRand variants.
+void SC_randFill(float *values, uint32_t count) {
+    uint64_t *state = getRandState();
+    for (uint32_t ct = 0; ct < count; ct++) {
+        values[ct] = nextRandf(state);
+    }
+}
+
 static float SC_frac(float v) {
     int i = (int)floor(v);
     return fmin(v - i, 0x1.fffffep-1f);
@@ -308,20 +358,21 @@ static RsdCpuReference::CpuSymbol gSyms[] = {
 
     // RS Math
     { "_Z6rsRandff", (void *)&SC_randf2, true },
+    { "_Z10rsRandFillPfj", (void *)&SC_randFill, true },
     { "_Z6rsFracf", (void *)&SC_frac, true },
 
     { NULL, NULL, false }
 };
 
-const RsdCpuReference::CpuSymbol * RsdCpuScriptImpl::lookupSymbolMath(const char *sym) {
-    const RsdCpuReference::CpuSymbol *syms = gSyms;
+static pthread_once_t gSymsOnce = PTHREAD_ONCE_INIT;
+static size_t gSymCount;
 
-    while (syms->fnPtr) {
-        if (!strcmp(syms->name, sym)) {
-            return syms;
-        }
-        syms++;
-    }
-    return NULL;
+static void sortSyms() {
+    gSymCount = RsdCpuReference::sortSymbols(gSyms);
+}
+
+const RsdCpuReference::CpuSymbol * RsdCpuScriptImpl::lookupSymbolMath(const char *sym) {
+    pthread_once(&gSymsOnce, sortSyms);
+    return RsdCpuReference::findSymbol(gSyms, gSymCount, sym);
 }
 
@@ -90,6 +90,10 @@ extern float SC_randf2(float min, float max);
 float __attribute__((overloadable)) rsRand(float min, float max) {
   return SC_randf2(min, max);
 }
+extern void SC_randFill(float *values, uint32_t count);
+void __attribute__((overloadable)) rsRandFill(float *values, uint32_t count) {
+  SC_randFill(values, count);
+}
 
 
 // !!! DANGER !!!
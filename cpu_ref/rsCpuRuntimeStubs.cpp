@@ -203,6 +203,83 @@ static void SC_debugP(const char *s, const void *p) {
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+// Accumulate
+//////////////////////////////////////////////////////////////////////////////
+
+// Finds cell x of the sums the calling worker keeps for a, or of a itself
+// when *shared is set, in which case other workers may be adding to it too.
+static void * getAccumulatorCell(Allocation *a, uint32_t x, RsDataType dt, bool *shared) {
+    const Type *t = a ? a->getType() : NULL;
+    if (!t || (t->getElement()->getType() != dt) ||
+        (t->getElement()->getVectorSize() != 1) || (x >= t->getDimX())) {
+        ALOGE("rsAccumulate: cell %u of allocation %p is unusable", x, a);
+        return NULL;
+    }
+
+    ScriptTLSStruct *tls =
+        (ScriptTLSStruct *)pthread_getspecific(RsdCpuReference::getThreadTLSKey());
+    uint8_t *sums = NULL;
+    if (tls && tls->mImpl) {
+        sums = (uint8_t *)tls->mImpl->getCpuRef()->getAccumulator(
+                a, t->getDimX() * sizeof(uint32_t));
+    }
+    *shared = !sums;
+    if (!sums) {
+        sums = (uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
+    }
+    return sums + x * sizeof(uint32_t);
+}
+
+static void SC_AccumulateI32(Allocation *a, uint32_t x, int32_t value) {
+    bool shared;
+    int32_t *cell = (int32_t *)getAccumulatorCell(a, x, RS_TYPE_SIGNED_32, &shared);
+    if (!cell) {
+        return;
+    }
+    if (shared) {
+        __sync_fetch_and_add(cell, value);
+    } else {
+        *cell += value;
+    }
+}
+
+static void SC_AccumulateU32(Allocation *a, uint32_t x, uint32_t value) {
+    bool shared;
+    uint32_t *cell = (uint32_t *)getAccumulatorCell(a, x, RS_TYPE_UNSIGNED_32, &shared);
+    if (!cell) {
+        return;
+    }
+    if (shared) {
+        __sync_fetch_and_add(cell, value);
+    } else {
+        *cell += value;
+    }
+}
+
+static void SC_AccumulateF32(Allocation *a, uint32_t x, float value) {
+    bool shared;
+    float *cell = (float *)getAccumulatorCell(a, x, RS_TYPE_FLOAT_32, &shared);
+    if (!cell) {
+        return;
+    }
+    if (!shared) {
+        *cell += value;
+        return;
+    }
+    // No atomic float add, so retry the sum until no other worker got in.
+    volatile int32_t *bits = (volatile int32_t *)cell;
+    int32_t prev, next;
+    do {
+        prev = *bits;
+        float sum;
+        memcpy(&sum, &prev, sizeof(sum));
+        sum += value;
+        memcpy(&next, &sum, sizeof(next));
+    } while (!__sync_bool_compare_and_swap(bits, prev, next));
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // Stub implementation
 //////////////////////////////////////////////////////////////////////////////
@@ -285,13 +362,24 @@ static RsdCpuReference::CpuSymbol gSyms[] = {
     { "_Z7rsDebugPKcPKDv4_y", (void *)&SC_debugUL4, true },
     { "_Z7rsDebugPKcPKv", (void *)&SC_debugP, true },
 
+    // Accumulate
+    { "_Z12rsAccumulate13rs_allocationji", (void *)&SC_AccumulateI32, true },
+    { "_Z12rsAccumulate13rs_allocationjj", (void *)&SC_AccumulateU32, true },
+    { "_Z12rsAccumulate13rs_allocationjf", (void *)&SC_AccumulateF32, true },
+
     { NULL, NULL, false }
 };
 
 
+static pthread_once_t gSymsOnce = PTHREAD_ONCE_INIT;
+static size_t gSymCount;
+
+static void sortSyms() {
+    gSymCount = RsdCpuReference::sortSymbols(gSyms);
+}
+
 void * RsdCpuScriptImpl::lookupRuntimeStub(void* pContext, char const* name) {
     RsdCpuScriptImpl *s = (RsdCpuScriptImpl *)pContext;
-    const RsdCpuReference::CpuSymbol *syms = gSyms;
     const RsdCpuReference::CpuSymbol *sym = NULL;
 
     sym = s->mCtx->symLookup(name);
@@ -299,12 +387,8 @@ void * RsdCpuScriptImpl::lookupRuntimeStub(void* pContext, char const* name) {
         sym = s->lookupSymbolMath(name);
     }
     if (!sym) {
-        while (syms->fnPtr) {
-            if (!strcmp(syms->name, name)) {
-                sym = syms;
-            }
-            syms++;
-        }
+        pthread_once(&gSymsOnce, sortSyms);
+        sym = RsdCpuReference::findSymbol(gSyms, gSymCount, name);
     }
 
     if (sym) {
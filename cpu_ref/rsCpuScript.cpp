@@ -17,10 +17,15 @@
 #include "rsCpuCore.h"
 #include "rsCpuScript.h"
 
+#include <malloc.h>
+
 #ifdef RS_COMPATIBILITY_LIB
+    #include <map>
     #include <set>
     #include <string>
+    #include <vector>
     #include <dlfcn.h>
+    #include <link.h>
     #include <stdio.h>
     #include <stdlib.h>
     #include <string.h>
@@ -34,6 +39,7 @@
     #include <bcinfo/MetadataExtractor.h>
     #include <cutils/properties.h>
 
+    #include <sys/stat.h>
     #include <sys/types.h>
     #include <sys/wait.h>
     #include <unistd.h>
@@ -136,6 +142,49 @@ static void *loadSOHelper(const char *origName, const char *cacheDir,
     return loaded;
 }
 
+// Suffixes of the prebuilt variants of a script this cpu can run, best
+// first, so librs.foo.neon.so is picked over librs.foo.so on cpus with
+// NEON.  The plain build always comes last.
+static void getLibraryVariants(std::vector<const char *> *variants) {
+    using android::renderscript::gArchUseSIMD;
+    using android::renderscript::gArchVersion;
+#if defined(ARCH_ARM_HAVE_VFP) || defined(ARCH_ARM64_HAVE_NEON)
+    if (gArchVersion >= 8) {
+        variants->push_back(".v8");
+    }
+    if (gArchUseSIMD) {
+        variants->push_back(".neon");
+    }
+#elif defined(ARCH_X86_HAVE_SSSE3)
+    if (gArchUseSIMD) {
+        variants->push_back(".ssse3");
+    }
+#endif
+    variants->push_back("");
+}
+
+// Loads the best variant of prefix + resName found, leaving the name of
+// the plain build in name.
+static void *loadLibraryVariant(const std::string &prefix, const char *cacheDir,
+                                const char *resName,
+                                const std::vector<const char *> &variants,
+                                std::string *name) {
+    for (size_t ct = 0; ct < variants.size(); ct++) {
+        *name = prefix;
+        name->append(resName);
+        name->append(variants[ct]);
+        name->append(".so");
+        void *loaded = loadSOHelper(name->c_str(), cacheDir, resName);
+        if (loaded) {
+            if (variants[ct][0]) {
+                ALOGV("Loaded script variant %s", name->c_str());
+            }
+            return loaded;
+        }
+    }
+    return NULL;
+}
+
 // Load the shared library referred to by cacheDir and resName. If we have
 // already loaded this library, we instead create a new symlink (in the
 // cache dir) and then load that. We then immediately destroy the symlink.
@@ -144,24 +193,26 @@ static void *loadSOHelper(const char *origName, const char *cacheDir,
 static void *loadSharedLibrary(const char *cacheDir, const char *resName) {
     void *loaded = NULL;
     //arc4random_stir();
+    std::vector<const char *> variants;
+    getLibraryVariants(&variants);
 #ifndef RS_SERVER
-    std::string scriptSOName(cacheDir);
-    size_t cutPos = scriptSOName.rfind("cache");
+    std::string scriptSOPrefix(cacheDir);
+    size_t cutPos = scriptSOPrefix.rfind("cache");
     if (cutPos != std::string::npos) {
-        scriptSOName.erase(cutPos);
+        scriptSOPrefix.erase(cutPos);
     } else {
         ALOGE("Found peculiar cacheDir (missing \"cache\"): %s", cacheDir);
     }
-    scriptSOName.append("/lib/librs.");
+    scriptSOPrefix.append("/lib/librs.");
 #else
-    std::string scriptSOName("lib");
+    std::string scriptSOPrefix("lib");
 #endif
-    scriptSOName.append(resName);
-    scriptSOName.append(".so");
 
     // We should check if we can load the library from the standard app
     // location for shared libraries first.
-    loaded = loadSOHelper(scriptSOName.c_str(), cacheDir, resName);
+    std::string scriptSOName;
+    loaded = loadLibraryVariant(scriptSOPrefix, cacheDir, resName, variants,
+                                &scriptSOName);
 
     if (loaded == NULL) {
         ALOGE("Unable to open shared library (%s): %s",
@@ -172,11 +223,9 @@ static void *loadSharedLibrary(const char *cacheDir, const char *resName) {
         // library fallback path. Those applications don't have a private
         // library path, so they need to install to the system directly.
         // Note that this is really just a testing path.
-        android::String8 scriptSONameSystem("/system/lib/librs.");
-        scriptSONameSystem.append(resName);
-        scriptSONameSystem.append(".so");
-        loaded = loadSOHelper(scriptSONameSystem.c_str(), cacheDir,
-                              resName);
+        std::string scriptSONameSystem;
+        loaded = loadLibraryVariant("/system/lib/librs.", cacheDir, resName,
+                                    variants, &scriptSONameSystem);
         if (loaded == NULL) {
             ALOGE("Unable to open system shared library (%s): %s",
                   scriptSONameSystem.c_str(), dlerror());
@@ -186,6 +235,105 @@ static void *loadSharedLibrary(const char *cacheDir, const char *resName) {
     return loaded;
 }
 
+struct ImageSizeQuery {
+    uintptr_t mAddr;
+    size_t mCode;
+    size_t mData;
+};
+
+// Adds up the loaded segments of the library holding mAddr.
+static int findImageSize(struct dl_phdr_info *info, size_t size, void *data) {
+    ImageSizeQuery *q = (ImageSizeQuery *)data;
+    bool ours = false;
+    size_t code = 0, writable = 0;
+
+    for (int ct = 0; ct < info->dlpi_phnum; ct++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[ct];
+        if (ph->p_type != PT_LOAD) {
+            continue;
+        }
+        uintptr_t segStart = info->dlpi_addr + ph->p_vaddr;
+        ours |= (q->mAddr >= segStart) && (q->mAddr < segStart + ph->p_memsz);
+        if (ph->p_flags & PF_W) {
+            writable += ph->p_memsz;
+        } else {
+            code += ph->p_memsz;
+        }
+    }
+    if (!ours) {
+        return 0;
+    }
+    q->mCode = code;
+    q->mData = writable;
+    return 1;
+}
+
+struct WritableDataQuery {
+    uintptr_t mAddr;
+    uintptr_t mStart;
+    uintptr_t mEnd;
+};
+
+static int findWritableData(struct dl_phdr_info *info, size_t size, void *data) {
+    WritableDataQuery *q = (WritableDataQuery *)data;
+    const uintptr_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+    bool ours = false;
+    uintptr_t start = 0, end = 0, relroStart = 0, relroEnd = 0;
+    int writable = 0;
+
+    for (int ct = 0; ct < info->dlpi_phnum; ct++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[ct];
+        uintptr_t segStart = info->dlpi_addr + ph->p_vaddr;
+        uintptr_t segEnd = segStart + ph->p_memsz;
+        if (ph->p_type == PT_LOAD) {
+            ours |= (q->mAddr >= segStart) && (q->mAddr < segEnd);
+            if (ph->p_flags & PF_W) {
+                writable++;
+                start = segStart;
+                end = segEnd;
+            }
+        } else if (ph->p_type == PT_GNU_RELRO) {
+            relroStart = segStart & ~pageMask;
+            relroEnd = (segEnd + pageMask) & ~pageMask;
+        }
+    }
+    if (!ours) {
+        return 0;
+    }
+
+    // The linker makes the relro part read-only once relocated, and it
+    // has to lead the segment for the rest to be one range.
+    if (relroEnd > start && relroStart < end) {
+        if (relroStart > start) {
+            return 1;
+        }
+        start = relroEnd;
+    }
+    if (writable == 1 && start < end) {
+        q->mStart = start;
+        q->mEnd = end;
+    }
+    return 1;
+}
+
+// Finds the data and bss of a loaded script library, which is all the
+// state its code keeps.  Returns false if it isn't a single range.
+static bool getWritableData(void *handle, uint8_t **data, size_t *size) {
+    WritableDataQuery q;
+    q.mAddr = (uintptr_t)dlsym(handle, ".rs.info");
+    q.mStart = 0;
+    q.mEnd = 0;
+    if (!q.mAddr) {
+        return false;
+    }
+    dl_iterate_phdr(findWritableData, &q);
+    if (q.mStart == q.mEnd) {
+        return false;
+    }
+    *data = (uint8_t *)q.mStart;
+    *size = q.mEnd - q.mStart;
+    return true;
+}
 
 #else
 static bool is_force_recompile() {
@@ -210,6 +358,145 @@ static bool is_force_recompile() {
 #endif  // RS_SERVER
 }
 
+// Scripts compile without the driver lock, so two contexts creating the
+// same script could rebuild its cache files underneath each other.  A
+// compile of a script already being compiled waits for that one to finish
+// and then finds the result in the cache.
+struct CompileEntry {
+    const char *mCacheDir;
+    const char *mResName;
+    CompileEntry *mNext;
+};
+static pthread_mutex_t gCompileMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gCompileCond = PTHREAD_COND_INITIALIZER;
+static CompileEntry *gCompiling = NULL;
+
+static bool isCompiling(const char *cacheDir, const char *resName) {
+    for (const CompileEntry *e = gCompiling; e; e = e->mNext) {
+        if (!strcmp(e->mResName, resName) &&
+            ((e->mCacheDir == cacheDir) ||
+             (e->mCacheDir && cacheDir && !strcmp(e->mCacheDir, cacheDir)))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void beginCompile(CompileEntry *entry, const char *cacheDir, const char *resName) {
+    entry->mCacheDir = cacheDir;
+    entry->mResName = resName;
+    pthread_mutex_lock(&gCompileMutex);
+    while (isCompiling(cacheDir, resName)) {
+        pthread_cond_wait(&gCompileCond, &gCompileMutex);
+    }
+    entry->mNext = gCompiling;
+    gCompiling = entry;
+    pthread_mutex_unlock(&gCompileMutex);
+}
+
+static void endCompile(CompileEntry *entry) {
+    pthread_mutex_lock(&gCompileMutex);
+    CompileEntry **e = &gCompiling;
+    while (*e != entry) {
+        e = &(*e)->mNext;
+    }
+    *e = entry->mNext;
+    pthread_cond_broadcast(&gCompileCond);
+    pthread_mutex_unlock(&gCompileMutex);
+}
+
+#ifndef EXTERNAL_BCC_COMPILER
+// A BCCContext is only needed while a script builds.  Idle ones are kept
+// for later builds in the process instead of every script creating its
+// own; each is used by one build at a time.
+#define MAX_IDLE_COMPILER_CONTEXTS 2
+static pthread_mutex_t gCompilerContextMutex = PTHREAD_MUTEX_INITIALIZER;
+static bcc::BCCContext *gIdleCompilerContexts[MAX_IDLE_COMPILER_CONTEXTS];
+static int gIdleCompilerContextCount = 0;
+
+static bcc::BCCContext *acquireCompilerContext() {
+    bcc::BCCContext *context = NULL;
+    pthread_mutex_lock(&gCompilerContextMutex);
+    if (gIdleCompilerContextCount) {
+        context = gIdleCompilerContexts[--gIdleCompilerContextCount];
+    }
+    pthread_mutex_unlock(&gCompilerContextMutex);
+    if (!context) {
+        context = new bcc::BCCContext();
+    }
+    return context;
+}
+
+static void releaseCompilerContext(bcc::BCCContext *context) {
+    pthread_mutex_lock(&gCompilerContextMutex);
+    if (gIdleCompilerContextCount < MAX_IDLE_COMPILER_CONTEXTS) {
+        gIdleCompilerContexts[gIdleCompilerContextCount++] = context;
+        context = NULL;
+    }
+    pthread_mutex_unlock(&gCompilerContextMutex);
+    delete context;
+}
+#endif  // !EXTERNAL_BCC_COMPILER
+
+#if defined(__i386__)
+static const char *kCoreLibPaths[] = {
+    bcc::RSInfo::LibCLCoreX86Path,
+    "/system/lib/libclcore_x86_relaxed.bc",
+    "/system/lib/libclcore_x86_imprecise.bc",
+};
+#elif defined(ARCH_ARM_HAVE_NEON)
+static const char *kCoreLibPaths[] = {
+    bcc::RSInfo::LibCLCorePath,
+    bcc::RSInfo::LibCLCoreNEONPath,
+    "/system/lib/libclcore_neon_imprecise.bc",
+};
+#else
+static const char *kCoreLibPaths[] = {
+    bcc::RSInfo::LibCLCorePath,
+    "/system/lib/libclcore_relaxed.bc",
+    "/system/lib/libclcore_imprecise.bc",
+};
+#endif
+
+// Picks the runtime library built for a script's precision: full, relaxed
+// (denormals may flush) or imprecise (native_ exp, log and powr).  A system
+// image without the reduced precision builds falls back to the next more
+// precise library, which is always correct for the script.
+static const char * selectCoreLib(enum bcinfo::RSFloatPrecision prec) {
+    int level = 0;
+    if (prec == bcinfo::RS_FP_Imprecise) {
+        level = 2;
+    } else if (prec == bcinfo::RS_FP_Relaxed) {
+        level = 1;
+    }
+    while (level > 0 && access(kCoreLibPaths[level], R_OK) != 0) {
+        level--;
+    }
+    return kCoreLibPaths[level];
+}
+
+// Names the cache entry after everything that goes into the build: the
+// bitcode, the runtime library it links against, the precision override
+// and the CPU features the runtime library picks code for.  The same
+// bitcode shipped under another resource name then finds the entry, and a
+// different runtime library can't load a stale one.
+static void getCacheName(char *name, size_t nameLen, const uint8_t *bitcode,
+                         size_t bitcodeSize, const char *core_lib, bool debug) {
+    using namespace android::renderscript;
+    uint32_t h1 = rsHashBytes(RS_HASH_SEED, bitcode, bitcodeSize);
+    uint32_t h2 = rsHashWord(rsHashBytes(rsHashWord(RS_HASH_SEED, 0x52530001), bitcode,
+                                         bitcodeSize), (uint32_t)bitcodeSize);
+    h2 = rsHashBytes(h2, core_lib, strlen(core_lib));
+    h2 = rsHashWord(h2, debug);
+    h2 = rsHashWord(h2, gArchUseSIMD);
+#ifndef RS_SERVER
+    char buf[PROPERTY_VALUE_MAX];
+    property_get("debug.rs.precision", buf, "");
+    h2 = rsHashBytes(h2, buf, strlen(buf));
+#endif
+    snprintf(name, nameLen, "rs-%08x%08x", h1, h2);
+}
+
 //#define EXTERNAL_BCC_COMPILER 1
 #ifdef EXTERNAL_BCC_COMPILER
 const static char *BCC_EXE_PATH = "/system/bin/bcc";
@@ -296,6 +583,8 @@ namespace renderscript {
 #define EXPORT_FOREACH_STR_LEN strlen(EXPORT_FOREACH_STR)
 #define OBJECT_SLOT_STR "objectSlotCount: "
 #define OBJECT_SLOT_STR_LEN strlen(OBJECT_SLOT_STR)
+#define PRAGMA_STR "pragmaCount: "
+#define PRAGMA_STR_LEN strlen(PRAGMA_STR)
 
 // Copy up to a newline or size chars from str -> s, updating str
 // Returns s when successful and NULL when '\0' is finally reached.
@@ -321,7 +610,277 @@ static char* strgets(char *s, int size, const char **ppstr) {
 
     return s;
 }
+
+// A script library dlopen()-ed once for all of its instances.  Its data
+// segment holds the globals of the resident instance; the others keep
+// theirs in mSavedGlobals and are swapped in before their code runs.
+struct RsdCpuScriptImpl::SharedLibrary {
+    std::string mName;
+    void *mHandle;
+    int mRefCount;
+
+    uint8_t *mData;
+    size_t mDataSize;
+    // The data as loaded, before any instance has run.
+    uint8_t *mInitialData;
+    // The data after the first init() of an rs_init_snapshot script, with
+    // its object slots as loaded, or NULL.
+    uint8_t *mInitSnapshot;
+
+    // Held while the resident instance runs; recursive for invokes that
+    // launch other instances.
+    pthread_mutex_t mMutex;
+    RsdCpuScriptImpl *mResident;
+    int mDepth;
+};
+
+static pthread_mutex_t gSharedLibMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, RsdCpuScriptImpl::SharedLibrary *> gSharedLibs;
+
+bool RsdCpuScriptImpl::loadLibrary(const char *cacheDir, const char *resName) {
+    std::string name(cacheDir);
+    name.append("/");
+    name.append(resName);
+
+    pthread_mutex_lock(&gSharedLibMutex);
+    SharedLibrary *lib = NULL;
+    std::map<std::string, SharedLibrary *>::iterator it = gSharedLibs.find(name);
+    if (it != gSharedLibs.end()) {
+        lib = it->second;
+    } else {
+        mScriptSO = loadSharedLibrary(cacheDir, resName);
+        uint8_t *data;
+        size_t size;
+        if (mScriptSO && getWritableData(mScriptSO, &data, &size)) {
+            lib = new SharedLibrary;
+            lib->mName = name;
+            lib->mHandle = mScriptSO;
+            lib->mRefCount = 0;
+            lib->mData = data;
+            lib->mDataSize = size;
+            lib->mInitialData = new uint8_t[size];
+            memcpy(lib->mInitialData, data, size);
+            lib->mInitSnapshot = NULL;
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+            pthread_mutex_init(&lib->mMutex, &attr);
+            pthread_mutexattr_destroy(&attr);
+            lib->mResident = NULL;
+            lib->mDepth = 0;
+            gSharedLibs[name] = lib;
+        }
+    }
+    if (lib) {
+        lib->mRefCount++;
+        mSharedLib = lib;
+        mScriptSO = lib->mHandle;
+        mSavedGlobals = new uint8_t[lib->mDataSize];
+        memcpy(mSavedGlobals, lib->mInitialData, lib->mDataSize);
+    }
+    pthread_mutex_unlock(&gSharedLibMutex);
+    return mScriptSO != NULL;
+}
+
+void RsdCpuScriptImpl::unloadLibrary() {
+    SharedLibrary *lib = mSharedLib;
+    if (!lib) {
+        if (mScriptSO) {
+            dlclose(mScriptSO);
+            mScriptSO = NULL;
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&lib->mMutex);
+    if (lib->mResident == this) {
+        lib->mResident = NULL;
+    }
+    pthread_mutex_unlock(&lib->mMutex);
+    delete[] mSavedGlobals;
+    mSavedGlobals = NULL;
+    mSharedLib = NULL;
+    mScriptSO = NULL;
+
+    pthread_mutex_lock(&gSharedLibMutex);
+    if (--lib->mRefCount == 0) {
+        gSharedLibs.erase(lib->mName);
+        dlclose(lib->mHandle);
+        pthread_mutex_destroy(&lib->mMutex);
+        delete[] lib->mInitialData;
+        delete[] lib->mInitSnapshot;
+        delete lib;
+    }
+    pthread_mutex_unlock(&gSharedLibMutex);
+}
+
+// Called with the library mutex held.
+void RsdCpuScriptImpl::swapInGlobals() {
+    SharedLibrary *lib = mSharedLib;
+    if (lib->mResident == this) {
+        return;
+    }
+    if (lib->mResident) {
+        memcpy(lib->mResident->mSavedGlobals, lib->mData, lib->mDataSize);
+    }
+    memcpy(lib->mData, mSavedGlobals, lib->mDataSize);
+    lib->mResident = this;
+}
+
+void RsdCpuScriptImpl::freePragmas() {
+    for (size_t ct = 0; ct < mPragmaCount; ct++) {
+        free(mPragmaKeys[ct]);
+        free(mPragmaValues[ct]);
+    }
+    delete[] mPragmaKeys;
+    delete[] mPragmaValues;
+    mPragmaKeys = NULL;
+    mPragmaValues = NULL;
+    mPragmaCount = 0;
+}
+
+bool RsdCpuScriptImpl::hasPragma(const char *key) const {
+    for (size_t ct = 0; ct < mPragmaCount; ct++) {
+        if (!strcmp(mPragmaKeys[ct], key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Kept next to the library as <cacheDir>/<resName>.init.  The data holds
+// absolute pointers wherever it was relocated, so a snapshot only goes to
+// a library whose data loaded with the same bytes, and so at the same
+// address as the one it was taken from.
+struct InitSnapshotHeader {
+    uint32_t magic;
+    uint32_t imageHash;
+    uint64_t dataSize;
+};
+#define INIT_SNAPSHOT_MAGIC 0x53495352
+
+uint8_t * RsdCpuScriptImpl::loadInitSnapshot() const {
+    const SharedLibrary *lib = mSharedLib;
+    std::string path(lib->mName);
+    path.append(".init");
+
+    // A library rebuilt since the snapshot was taken may init differently.
+    Dl_info info;
+    struct stat libStat, snapStat;
+    if (!dladdr(dlsym(lib->mHandle, ".rs.info"), &info) || stat(info.dli_fname, &libStat) ||
+        stat(path.c_str(), &snapStat) || (snapStat.st_mtime < libStat.st_mtime)) {
+        return NULL;
+    }
+
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return NULL;
+    }
+    uint8_t *snapshot = NULL;
+    InitSnapshotHeader h;
+    if ((fread(&h, sizeof(h), 1, f) == 1) && (h.magic == INIT_SNAPSHOT_MAGIC) &&
+        (h.dataSize == lib->mDataSize) &&
+        (h.imageHash == rsHashBytes(RS_HASH_SEED, lib->mInitialData, lib->mDataSize))) {
+        snapshot = new uint8_t[lib->mDataSize];
+        if (fread(snapshot, lib->mDataSize, 1, f) != 1) {
+            delete[] snapshot;
+            snapshot = NULL;
+        }
+    }
+    fclose(f);
+    return snapshot;
+}
+
+bool RsdCpuScriptImpl::restoreInitSnapshot() {
+    SharedLibrary *lib = mSharedLib;
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    if (!lib->mInitSnapshot) {
+        lib->mInitSnapshot = loadInitSnapshot();
+    }
+    const bool restored = lib->mInitSnapshot != NULL;
+    if (restored) {
+        memcpy(lib->mData, lib->mInitSnapshot, lib->mDataSize);
+    }
+    releaseGlobals(outer);
+    return restored;
+}
+
+// Called with the globals of this instance resident, right after init().
+void RsdCpuScriptImpl::saveInitSnapshot() {
+    SharedLibrary *lib = mSharedLib;
+    if (lib->mInitSnapshot) {
+        return;
+    }
+    uint8_t *snapshot = new uint8_t[lib->mDataSize];
+    memcpy(snapshot, lib->mData, lib->mDataSize);
+    // Objects init() set hold references of this instance alone.
+    for (size_t ct = 0; ct < mExportedVariableCount; ct++) {
+        const uint8_t *addr = (const uint8_t *)mFieldAddress[ct];
+        if (mFieldIsObject[ct] && (addr >= lib->mData) &&
+            (addr + sizeof(ObjectBase *) <= lib->mData + lib->mDataSize)) {
+            const size_t offset = addr - lib->mData;
+            memcpy(snapshot + offset, lib->mInitialData + offset, sizeof(ObjectBase *));
+        }
+    }
+    lib->mInitSnapshot = snapshot;
+
+    std::string path(lib->mName);
+    path.append(".init");
+    std::string tmpPath(path);
+    tmpPath.append(".tmp");
+    FILE *f = fopen(tmpPath.c_str(), "wb");
+    if (!f) {
+        return;
+    }
+    InitSnapshotHeader h;
+    h.magic = INIT_SNAPSHOT_MAGIC;
+    h.imageHash = rsHashBytes(RS_HASH_SEED, lib->mInitialData, lib->mDataSize);
+    h.dataSize = lib->mDataSize;
+    bool written = (fwrite(&h, sizeof(h), 1, f) == 1) &&
+                   (fwrite(snapshot, lib->mDataSize, 1, f) == 1);
+    written = !fclose(f) && written;
+    if (!written || rename(tmpPath.c_str(), path.c_str())) {
+        ALOGW("Failed to save init snapshot %s", path.c_str());
+        unlink(tmpPath.c_str());
+    }
+}
+#endif
+
+RsdCpuScriptImpl * RsdCpuScriptImpl::acquireGlobals() {
+#ifdef RS_COMPATIBILITY_LIB
+    SharedLibrary *lib = mSharedLib;
+    // Already resident means we are inside a call on this script: nested
+    // in it, or on a worker running its kernel.
+    if (!lib || (lib->mDepth && lib->mResident == this)) {
+        return this;
+    }
+    if (mCtx->onWorkerThread()) {
+        ALOGE("Kernel launched another instance of its own script, globals are not swapped");
+        return this;
+    }
+    pthread_mutex_lock(&lib->mMutex);
+    RsdCpuScriptImpl *outer = lib->mDepth ? lib->mResident : NULL;
+    lib->mDepth++;
+    swapInGlobals();
+    return outer;
+#else
+    return this;
+#endif
+}
+
+void RsdCpuScriptImpl::releaseGlobals(RsdCpuScriptImpl *outer) {
+#ifdef RS_COMPATIBILITY_LIB
+    if (outer == this) {
+        return;
+    }
+    SharedLibrary *lib = mSharedLib;
+    if (outer) {
+        outer->swapInGlobals();
+    }
+    lib->mDepth--;
+    pthread_mutex_unlock(&lib->mMutex);
 #endif
+}
 
 RsdCpuScriptImpl::RsdCpuScriptImpl(RsdCpuReferenceImpl *ctx, const Script *s) {
     mCtx = ctx;
@@ -334,8 +893,14 @@ RsdCpuScriptImpl::RsdCpuScriptImpl(RsdCpuReferenceImpl *ctx, const Script *s) {
     mFieldAddress = NULL;
     mFieldIsObject = NULL;
     mForEachSignatures = NULL;
+    mPragmaKeys = NULL;
+    mPragmaValues = NULL;
+    mPragmaCount = 0;
+    mSharedLib = NULL;
+    mSavedGlobals = NULL;
+    mLaunchOuter = NULL;
+    mLaunchDepth = 0;
 #else
-    mCompilerContext = NULL;
     mCompilerDriver = NULL;
     mExecutable = NULL;
 #endif
@@ -347,8 +912,27 @@ RsdCpuScriptImpl::RsdCpuScriptImpl(RsdCpuReferenceImpl *ctx, const Script *s) {
 
 
     mBoundAllocs = NULL;
+    mWideKernels = NULL;
+    mWideKernelCount = 0;
+    mAllocRanges = NULL;
+    mAllocRangeCount = 0;
     mIntrinsicData = NULL;
     mIsThreadable = true;
+    mKernelCosts = NULL;
+    mKernelCostCount = 0;
+    mStagedVars = NULL;
+    mStagedBytes = 0;
+    mStagedCapacity = 0;
+    mStagedCount = 0;
+    mCodeBytes = 0;
+    mDataBytes = 0;
+}
+
+void RsdCpuScriptImpl::trackMemory(ssize_t codeBytes, ssize_t dataBytes) {
+    mCodeBytes += codeBytes;
+    mDataBytes += dataBytes;
+    mCtx->getContext()->trackMemory(RS_MEMORY_SCRIPT_CODE, codeBytes);
+    mCtx->getContext()->trackMemory(RS_MEMORY_SCRIPT_DATA, dataBytes);
 }
 
 
@@ -358,26 +942,15 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
     //ALOGE("rsdScriptCreate %p %p %p %p %i %i %p", rsc, resName, cacheDir, bitcode, bitcodeSize, flags, lookupFunc);
     //ALOGE("rsdScriptInit %p %p", rsc, script);
 
-    mCtx->lockMutex();
-
 #ifndef RS_COMPATIBILITY_LIB
     bcc::RSExecutable *exec = NULL;
 
-    mCompilerContext = NULL;
     mCompilerDriver = NULL;
     mExecutable = NULL;
 
-    mCompilerContext = new bcc::BCCContext();
-    if (mCompilerContext == NULL) {
-        ALOGE("bcc: FAILS to create compiler context (out of memory)");
-        mCtx->unlockMutex();
-        return false;
-    }
-
     mCompilerDriver = new bcc::RSCompilerDriver();
     if (mCompilerDriver == NULL) {
         ALOGE("bcc: FAILS to create compiler driver (out of memory)");
-        mCtx->unlockMutex();
         return false;
     }
 
@@ -403,65 +976,91 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
     switch (prec) {
     case bcinfo::RS_FP_Imprecise:
     case bcinfo::RS_FP_Relaxed:
-#if defined(ARCH_ARM_HAVE_NEON)
-        // NEON-capable devices can use an accelerated math library for all
-        // reduced precision scripts.
-        core_lib = bcc::RSInfo::LibCLCoreNEONPath;
-#endif
-        break;
     case bcinfo::RS_FP_Full:
+        core_lib = selectCoreLib(prec);
         break;
     default:
         ALOGE("Unknown precision for bitcode");
         return false;
     }
 
-#if defined(__i386__)
-    // x86 devices will use an optimized library.
-    core_lib = bcc::RSInfo::LibCLCoreX86Path;
-#endif
-
     RSSelectRTCallback selectRTCallback = mCtx->getSelectRTCallback();
     if (selectRTCallback != NULL) {
         core_lib = selectRTCallback((const char *)bitcode, bitcodeSize);
     }
 
-    if (mCtx->getContext()->getContextType() == RS_CONTEXT_TYPE_DEBUG) {
+    const bool debug = mCtx->getContext()->getContextType() == RS_CONTEXT_TYPE_DEBUG;
+    if (debug) {
         // Use the libclcore_debug.bc instead of the default library.
         core_lib = bcc::RSInfo::LibCLCoreDebugPath;
         mCompilerDriver->setDebugContext(true);
-        // Skip the cache lookup
-    } else if (!is_force_recompile()) {
+    }
+
+    // Compiler callbacks may change the build in ways the name can't
+    // capture, so those scripts keep their resource name.
+    char cacheName[32];
+    const char *scriptName = resName;
+    if (!setupCompilerCallback && !mCtx->getLinkRuntimeCallback()) {
+        getCacheName(cacheName, sizeof(cacheName), bitcode, bitcodeSize, core_lib, debug);
+        scriptName = cacheName;
+    }
+
+    // Only loading an executable, which binds its symbols, needs the driver
+    // lock; the build itself runs alongside other compiles.
+    CompileEntry compile;
+    beginCompile(&compile, cacheDir, scriptName);
+
+    // Debug contexts skip the cache lookup.
+    if (!debug && !is_force_recompile()) {
         // Attempt to just load the script from cache first if we can.
-        exec = mCompilerDriver->loadScript(cacheDir, resName,
+        ATRACE_NAME("bcc loadScript");
+        mCtx->lockMutex();
+        exec = mCompilerDriver->loadScript(cacheDir, scriptName,
                                            (const char *)bitcode, bitcodeSize);
+        mCtx->unlockMutex();
     }
 
     if (exec == NULL) {
+        ATRACE_NAME("bcc build");
 #ifdef EXTERNAL_BCC_COMPILER
-        bool built = compileBitcode(cacheDir, resName, (const char *)bitcode,
+        bool built = compileBitcode(cacheDir, scriptName, (const char *)bitcode,
                                     bitcodeSize, core_lib);
 #else
-        bool built = mCompilerDriver->build(*mCompilerContext, cacheDir,
-                                            resName, (const char *)bitcode,
+        bcc::BCCContext *context = acquireCompilerContext();
+        bool built = mCompilerDriver->build(*context, cacheDir,
+                                            scriptName, (const char *)bitcode,
                                             bitcodeSize, core_lib,
                                             mCtx->getLinkRuntimeCallback());
+        releaseCompilerContext(context);
 #endif  // EXTERNAL_BCC_COMPILER
         if (built) {
-            exec = mCompilerDriver->loadScript(cacheDir, resName,
+            mCtx->lockMutex();
+            exec = mCompilerDriver->loadScript(cacheDir, scriptName,
                                                (const char *)bitcode,
                                                bitcodeSize);
+            mCtx->unlockMutex();
         }
     }
+    endCompile(&compile);
 
     if (exec == NULL) {
         ALOGE("bcc: FAILS to prepare executable for '%s'", resName);
-        mCtx->unlockMutex();
         return false;
     }
 
+    mCtx->lockMutex();
     mExecutable = exec;
 
+    // The executable is loaded from its object file, sections and all.
+    std::string objPath(cacheDir);
+    objPath.append("/");
+    objPath.append(scriptName);
+    objPath.append(".o");
+    struct stat objStat;
+    if (!stat(objPath.c_str(), &objStat)) {
+        trackMemory(objStat.st_size, 0);
+    }
+
     exec->setThreadable(mIsThreadable);
     if (!exec->syncInfo()) {
         ALOGW("bcc: FAILS to synchronize the RS info file to the disk");
@@ -476,6 +1075,16 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
 
 
     const bcc::RSInfo *info = &mExecutable->getInfo();
+    const size_t forEachCount = info->getExportForeachFuncs().size();
+    if (forEachCount) {
+        mWideKernels = new WideKernel[forEachCount];
+        mWideKernelCount = forEachCount;
+        for (size_t i = 0; i < forEachCount; i++) {
+            std::string expandName(info->getExportForeachFuncs()[i].first);
+            expandName.append(".expand");
+            findWideKernel(i, expandName.c_str());
+        }
+    }
     if (info->getExportVarNames().size()) {
         mBoundAllocs = new Allocation *[info->getExportVarNames().size()];
         memset(mBoundAllocs, 0, sizeof(void *) * info->getExportVarNames().size());
@@ -483,10 +1092,21 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
 
 #else
 
-    mScriptSO = loadSharedLibrary(cacheDir, resName);
-
-    if (mScriptSO) {
+    mCtx->lockMutex();
+    ATRACE_BEGIN("loadLibrary");
+    bool loaded = loadLibrary(cacheDir, resName);
+    ATRACE_END();
+    if (loaded) {
         char line[MAXLINE];
+        ImageSizeQuery image;
+        image.mAddr = (uintptr_t)dlsym(mScriptSO, ".rs.info");
+        image.mCode = 0;
+        image.mData = 0;
+        if (image.mAddr) {
+            dl_iterate_phdr(findImageSize, &image);
+        }
+        // Instances sharing the library each keep a copy of its globals.
+        trackMemory(image.mCode, mSharedLib ? mSharedLib->mDataSize : image.mData);
         mRoot = (RootFunc_t) dlsym(mScriptSO, "root");
         if (mRoot) {
             //ALOGE("Found root(): %p", mRoot);
@@ -599,6 +1219,7 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
             ALOGE("Invalid export forEach count!: %s", line);
             goto error;
         }
+        mExportedForEachCount = forEachCount;
 
         if (forEachCount > 0) {
 
@@ -610,6 +1231,8 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
             if (mForEachFunctions == NULL) {
                 goto error;
             }
+            mWideKernels = new WideKernel[forEachCount];
+            mWideKernelCount = forEachCount;
             for (size_t i = 0; i < forEachCount; ++i) {
                 unsigned int tmpSig = 0;
                 char tmpName[MAXLINE];
@@ -628,6 +1251,7 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
                 mForEachSignatures[i] = tmpSig;
                 mForEachFunctions[i] =
                         (ForEachFunc_t) dlsym(mScriptSO, tmpName);
+                findWideKernel(i, tmpName);
                 if (i != 0 && mForEachFunctions[i] == NULL) {
                     // Ignore missing root.expand functions.
                     // root() is always specified at location 0.
@@ -668,6 +1292,30 @@ bool RsdCpuScriptImpl::init(char const *resName, char const *cacheDir,
             }
         }
 
+        // Pragmas follow in .rs.info of newer compilers, as "key - value".
+        size_t pragmaCount = 0;
+        if ((strgets(line, MAXLINE, &rsInfo) != NULL) &&
+            (sscanf(line, PRAGMA_STR "%zu", &pragmaCount) == 1) && (pragmaCount > 0)) {
+            mPragmaKeys = new char *[pragmaCount];
+            mPragmaValues = new char *[pragmaCount];
+            for (size_t i = 0; i < pragmaCount; ++i) {
+                if (strgets(line, MAXLINE, &rsInfo) == NULL) {
+                    goto error;
+                }
+                char *sep = strstr(line, " - ");
+                if (sep == NULL) {
+                    ALOGE("Invalid pragma!: %s", line);
+                    goto error;
+                }
+                *sep = '\0';
+                char *value = sep + 3;
+                value[strcspn(value, "\n")] = '\0';
+                mPragmaKeys[i] = strdup(line);
+                mPragmaValues[i] = strdup(value);
+                mPragmaCount = i + 1;
+            }
+        }
+
         if (varCount > 0) {
             mBoundAllocs = new Allocation *[varCount];
             memset(mBoundAllocs, 0, varCount * sizeof(*mBoundAllocs));
@@ -693,14 +1341,23 @@ error:
     delete[] mFieldAddress;
     delete[] mFieldIsObject;
     delete[] mForEachSignatures;
+    delete[] mWideKernels;
     delete[] mBoundAllocs;
-    if (mScriptSO) {
-        dlclose(mScriptSO);
-    }
+    freePragmas();
+    unloadLibrary();
     return false;
 #endif
 }
 
+const char * RsdCpuScriptImpl::getKernelName(uint32_t slot) const {
+#ifndef RS_COMPATIBILITY_LIB
+    if (mExecutable && (slot < mExecutable->getInfo().getExportForeachFuncs().size())) {
+        return mExecutable->getInfo().getExportForeachFuncs()[slot].first;
+    }
+#endif
+    return NULL;
+}
+
 void RsdCpuScriptImpl::populateScript(Script *script) {
 #ifndef RS_COMPATIBILITY_LIB
     const bcc::RSInfo *info = &mExecutable->getInfo();
@@ -724,9 +1381,9 @@ void RsdCpuScriptImpl::populateScript(Script *script) {
     // Copy info over to runtime
     script->mHal.info.exportedFunctionCount = mExportedFunctionCount;
     script->mHal.info.exportedVariableCount = mExportedVariableCount;
-    script->mHal.info.exportedPragmaCount = 0;
-    script->mHal.info.exportedPragmaKeyList = 0;
-    script->mHal.info.exportedPragmaValueList = 0;
+    script->mHal.info.exportedPragmaCount = mPragmaCount;
+    script->mHal.info.exportedPragmaKeyList = const_cast<const char**>(mPragmaKeys);
+    script->mHal.info.exportedPragmaValueList = const_cast<const char**>(mPragmaValues);
 
     // Bug, need to stash in metadata
     if (mRootExpand) {
@@ -810,6 +1467,37 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
     mtls->zEnd = rsMax((uint32_t)1, mtls->zEnd);
     mtls->arrayEnd = rsMax((uint32_t)1, mtls->arrayEnd);
 
+    if (sc && sc->regionCount) {
+        const uint32_t dimX = rsMax((uint32_t)1, mtls->fep.dimX);
+        const uint32_t dimY = rsMax((uint32_t)1, mtls->fep.dimY);
+        const uint32_t layers = (mtls->zEnd - mtls->zStart) *
+                                (mtls->arrayEnd - mtls->arrayStart);
+        uint32_t xStart = dimX, xEnd = 0, yStart = dimY, yEnd = 0;
+        uint32_t rows = 0;
+        for (uint32_t ct = 0; ct < sc->regionCount; ct++) {
+            const RsScriptRect &r = sc->regions[ct];
+            if ((r.xStart >= r.xEnd) || (r.xEnd > dimX) ||
+                (r.yStart >= r.yEnd) || (r.yEnd > dimY)) {
+                mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                             "Launch region outside the allocation");
+                mtls->xEnd = 0;
+                return;
+            }
+            xStart = rsMin(xStart, r.xStart);
+            xEnd = rsMax(xEnd, r.xEnd);
+            yStart = rsMin(yStart, r.yStart);
+            yEnd = rsMax(yEnd, r.yEnd);
+            rows += (r.yEnd - r.yStart) * layers;
+        }
+        mtls->xStart = xStart;
+        mtls->xEnd = xEnd;
+        mtls->yStart = yStart;
+        mtls->yEnd = yEnd;
+        mtls->mRegions = sc->regions;
+        mtls->mRegionCount = sc->regionCount;
+        mtls->mRegionRows = rows;
+    }
+
     rsAssert(!ain || (ain->getType()->getDimZ() == 0));
 
     mtls->rsc = mCtx;
@@ -818,7 +1506,27 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
     mtls->fep.usr = usr;
     mtls->fep.usrLen = usrLen;
     mtls->mSliceSize = 1;
-    mtls->mSliceNum = 0;
+
+    // The tiled strategies opt in to 2D tile scheduling.  Sizes target an
+    // L1-resident, a shared-L2 and a full-L2 working set respectively.
+    if (sc) {
+        mtls->mMaxThreads = sc->maxThreads;
+        mtls->mBackground = (sc->priority == RS_FOR_EACH_PRIORITY_BACKGROUND);
+
+        switch (sc->strategy) {
+        case RS_FOR_EACH_STRATEGY_TILE_SMALL:
+            mtls->mTileBytes = 16 * 1024;
+            break;
+        case RS_FOR_EACH_STRATEGY_TILE_MEDIUM:
+            mtls->mTileBytes = 64 * 1024;
+            break;
+        case RS_FOR_EACH_STRATEGY_TILE_LARGE:
+            mtls->mTileBytes = 256 * 1024;
+            break;
+        default:
+            break;
+        }
+    }
 
     mtls->fep.ptrIn = NULL;
     mtls->fep.eStrideIn = 0;
@@ -828,6 +1536,12 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
         mtls->fep.ptrIn = (const uint8_t *)ain->mHal.drvState.lod[0].mallocPtr;
         mtls->fep.eStrideIn = ain->getType()->getElementSizeBytes();
         mtls->fep.yStrideIn = ain->mHal.drvState.lod[0].stride;
+
+        mtls->ains[0] = ain;
+        mtls->ptrIns[0] = mtls->fep.ptrIn;
+        mtls->eStrideIns[0] = mtls->fep.eStrideIn;
+        mtls->yStrideIns[0] = mtls->fep.yStrideIn;
+        mtls->fep.inLen = 1;
     }
 
     mtls->fep.ptrOut = NULL;
@@ -846,48 +1560,357 @@ void RsdCpuScriptImpl::invokeForEach(uint32_t slot,
                                      const void * usr,
                                      uint32_t usrLen,
                                      const RsScriptCall *sc) {
+    ATRACE_CALL();
 
     MTLaunchStruct mtls;
     forEachMtlsSetup(ain, aout, usr, usrLen, sc, &mtls);
     forEachKernelSetup(slot, &mtls);
+    foldRows(&mtls);
 
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
     RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    // Top-level launches may return before the kernel completes when the
+    // ordering against later commands can be tracked; launches from
+    // inside an invoke or root() have to finish before the caller resumes.
+    mtls.mAsync = !oldTLS && canLaunchAsync();
     mCtx->launchThreads(ain, aout, sc, &mtls);
     mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    releaseGlobals(outer);
+}
+
+// Launches a kernel over several inputs of the same shape, which it reads
+// through the ins of its RsForEachStubParamStruct.
+void RsdCpuScriptImpl::invokeForEachMulti(uint32_t slot,
+                                          const Allocation ** ains,
+                                          size_t inLen,
+                                          Allocation * aout,
+                                          const void * usr,
+                                          uint32_t usrLen,
+                                          const RsScriptCall *sc) {
+    Context *rsc = mCtx->getContext();
+    if (!inLen || (inLen > RS_KERNEL_INPUT_LIMIT)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Invalid number of kernel inputs");
+        return;
+    }
+    const Type *t0 = ains[0] ? ains[0]->getType() : NULL;
+    for (size_t ct = 0; ct < inLen; ct++) {
+        const Type *t = ains[ct] ? ains[ct]->getType() : NULL;
+        if (!t || (t->getDimX() != t0->getDimX()) || (t->getDimY() != t0->getDimY()) ||
+            (t->getDimZ() != t0->getDimZ()) || !ains[ct]->mHal.drvState.lod[0].mallocPtr) {
+            rsc->setError(RS_ERROR_BAD_VALUE, "Kernel inputs must share their dimensions");
+            return;
+        }
+    }
+
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(ains[0], aout, usr, usrLen, sc, &mtls);
+    for (size_t ct = 1; ct < inLen; ct++) {
+        mtls.ains[ct] = ains[ct];
+        mtls.ptrIns[ct] = (const uint8_t *)ains[ct]->mHal.drvState.lod[0].mallocPtr;
+        mtls.eStrideIns[ct] = ains[ct]->getType()->getElementSizeBytes();
+        mtls.yStrideIns[ct] = ains[ct]->mHal.drvState.lod[0].stride;
+    }
+    mtls.fep.inLen = inLen;
+    forEachKernelSetup(slot, &mtls);
+    foldRows(&mtls);
+
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    // Pending launches are only tracked against their first input.
+    mtls.mAsync = false;
+    mCtx->launchThreads(ains[0], aout, sc, &mtls);
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    releaseGlobals(outer);
+}
+
+// Foreach signature bits, as bcinfo encodes them.
+#define RS_KERNEL_SIG_IN 0x01
+#define RS_KERNEL_SIG_OUT 0x02
+#define RS_KERNEL_SIG_X 0x08
+#define RS_KERNEL_SIG_Y 0x10
+#define RS_KERNEL_SIG_KERNEL 0x20
+
+// A kernel taking neither x nor y only sees a run of cells.  When the rows
+// of its launch lie back to back in memory the launch can be run as one
+// long row, so each call of the expand function covers a whole slice
+// instead of a single row.
+void RsdCpuScriptImpl::foldRows(MTLaunchStruct *mtls) const {
+    const uint32_t dimX = mtls->fep.dimX;
+    const uint32_t rows = (mtls->yEnd - mtls->yStart) * (mtls->zEnd - mtls->zStart) *
+                          (mtls->arrayEnd - mtls->arrayStart);
+    if (!mtls->sig || (mtls->sig & (RS_KERNEL_SIG_X | RS_KERNEL_SIG_Y)) ||
+        mtls->mTileBytes || mtls->mRegionCount || (rows <= 1) || (mtls->xStart != 0) ||
+        (mtls->xEnd != dimX)) {
+        return;
+    }
+    if ((mtls->fep.ptrIn && (mtls->fep.yStrideIn != dimX * mtls->fep.eStrideIn)) ||
+        (mtls->fep.ptrOut && (mtls->fep.yStrideOut != dimX * mtls->fep.eStrideOut))) {
+        return;
+    }
+    for (uint32_t ct = 1; ct < mtls->fep.inLen; ct++) {
+        if (mtls->yStrideIns[ct] != dimX * mtls->eStrideIns[ct]) {
+            return;
+        }
+    }
+    // Later planes only follow on if each one is launched in full.
+    if ((mtls->arrayEnd - mtls->arrayStart) > 1 ||
+        (((mtls->zEnd - mtls->zStart) > 1) &&
+         ((mtls->yStart != 0) || (mtls->yEnd != mtls->fep.dimY)))) {
+        return;
+    }
+
+    uint32_t first = mtls->fep.dimY * mtls->fep.dimZ * mtls->arrayStart +
+                     mtls->fep.dimY * mtls->zStart + mtls->yStart;
+    mtls->xStart = first * dimX;
+    mtls->xEnd = mtls->xStart + rows * dimX;
+    mtls->yStart = 0;
+    mtls->yEnd = 1;
+    mtls->zStart = 0;
+    mtls->zEnd = 1;
+    mtls->arrayStart = 0;
+    mtls->arrayEnd = 1;
+}
+
+// Fold a new measurement into the running estimate for slot.  Single
+// samples are noisy (the first slice of a launch runs with cold caches), so
+// keep a moving average.
+void RsdCpuScriptImpl::updateKernelCost(uint32_t slot, uint32_t psPerElement) {
+    if (slot >= mKernelCostCount) {
+        KernelCost *costs = (KernelCost *)realloc(mKernelCosts, (slot + 1) * sizeof(KernelCost));
+        if (!costs) {
+            return;
+        }
+        memset(&costs[mKernelCostCount], 0, (slot + 1 - mKernelCostCount) * sizeof(KernelCost));
+        mKernelCosts = costs;
+        mKernelCostCount = slot + 1;
+    }
+    KernelCost *k = &mKernelCosts[slot];
+    uint32_t old = k->mCostPs;
+    k->mCostPs = old ? (uint32_t)(((uint64_t)old * 3 + psPerElement) / 4) : psPerElement;
+
+    // The first launch also pays for faulting in its allocations, so it
+    // isn't compared.  Prefetching has to win by a few percent to stay.
+    switch (k->mPrefetch) {
+    case kPrefetchWarmup:
+        k->mPrefetch = kPrefetchBaseline;
+        break;
+    case kPrefetchBaseline:
+        k->mBaselinePs = psPerElement;
+        k->mPrefetch = kPrefetchTrial;
+        break;
+    case kPrefetchTrial:
+        k->mPrefetch = ((uint64_t)psPerElement * 32 < (uint64_t)k->mBaselinePs * 31) ?
+                       kPrefetchOn : kPrefetchOff;
+        break;
+    default:
+        break;
+    }
+}
+
+// A kernel can only be left running after its launch returns if the only
+// allocations it can reach are its own input and output.  Bound pointers
+// and object globals would let it touch memory we don't track.  A shared
+// library can't keep our globals resident once the launch has returned.
+bool RsdCpuScriptImpl::canLaunchAsync() const {
+    if (mCtx->getContext()->isSynchronous() || mScript->hasObjectSlots()) {
+        return false;
+    }
+#ifdef RS_COMPATIBILITY_LIB
+    if (mSharedLib) {
+        return false;
+    }
+#endif
+    if (mBoundAllocs) {
+        for (uint32_t ct = 0; ct < mScript->mHal.info.exportedVariableCount; ct++) {
+            if (mBoundAllocs[ct]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+ForEachFunc_t RsdCpuScriptImpl::getKernel(uint32_t slot, uint32_t *sig) const {
+#ifndef RS_COMPATIBILITY_LIB
+    if (slot >= mExecutable->getExportForeachFuncAddrs().size()) {
+        return NULL;
+    }
+    *sig = mExecutable->getInfo().getExportForeachFuncs()[slot].second;
+    return reinterpret_cast<ForEachFunc_t>(mExecutable->getExportForeachFuncAddrs()[slot]);
+#else
+    if (slot >= mExportedForEachCount) {
+        return NULL;
+    }
+    *sig = mForEachSignatures[slot];
+    return reinterpret_cast<ForEachFunc_t>(mForEachFunctions[slot]);
+#endif
+}
+
+// Compilers may emit <kernel>.expand.v8 or .v4 next to <kernel>.expand,
+// taking the same arguments but running that many consecutive cells per
+// step with vector types.  The launch only hands them whole steps.
+void RsdCpuScriptImpl::findWideKernel(uint32_t slot, const char *expandName) {
+    static const uint32_t widths[] = { 8, 4 };
+    mWideKernels[slot].mFn = NULL;
+    mWideKernels[slot].mWidth = 0;
+    for (uint32_t ct = 0; ct < sizeof(widths) / sizeof(widths[0]); ct++) {
+        char name[256];
+        snprintf(name, sizeof(name), "%s.v%u", expandName, widths[ct]);
+#ifndef RS_COMPATIBILITY_LIB
+        void *fn = mExecutable->getSymbolAddress(name);
+#else
+        void *fn = dlsym(mScriptSO, name);
+#endif
+        if (fn) {
+            mWideKernels[slot].mFn = (ForEachFunc_t)fn;
+            mWideKernels[slot].mWidth = widths[ct];
+            return;
+        }
+    }
+}
+
+ForEachFunc_t RsdCpuScriptImpl::getWideKernel(uint32_t slot, uint32_t *width) const {
+    if (slot >= mWideKernelCount) {
+        *width = 0;
+        return NULL;
+    }
+    *width = mWideKernels[slot].mWidth;
+    return mWideKernels[slot].mFn;
 }
 
 void RsdCpuScriptImpl::forEachKernelSetup(uint32_t slot, MTLaunchStruct *mtls) {
     mtls->script = this;
     mtls->fep.slot = slot;
-#ifndef RS_COMPATIBILITY_LIB
-    rsAssert(slot < mExecutable->getExportForeachFuncAddrs().size());
-    mtls->kernel = reinterpret_cast<ForEachFunc_t>(
-                      mExecutable->getExportForeachFuncAddrs()[slot]);
+    mtls->kernel = getKernel(slot, &mtls->sig);
+    mtls->kernelWide = getWideKernel(slot, &mtls->kernelWidth);
     rsAssert(mtls->kernel != NULL);
-    mtls->sig = mExecutable->getInfo().getExportForeachFuncs()[slot].second;
-#else
-    mtls->kernel = reinterpret_cast<ForEachFunc_t>(mForEachFunctions[slot]);
-    rsAssert(mtls->kernel != NULL);
-    mtls->sig = mForEachSignatures[slot];
-#endif
+}
+
+// Reductions run the accumulate kernel as a launch whose out pointer is the
+// worker's own accumulator, with no step between cells, so the kernel adds
+// its whole share of ain into one place.  The accumulators are then paired
+// off in a tree by the combine kernel, which keeps float sums closer than
+// adding them up one after another.
+void RsdCpuScriptImpl::invokeReduce(uint32_t accumSlot, uint32_t combineSlot,
+                                    int32_t finalizeSlot, const Allocation * ain,
+                                    Allocation * aout, const RsScriptCall *sc) {
+    Context *rsc = mCtx->getContext();
+    const uint32_t inOut = RS_KERNEL_SIG_IN | RS_KERNEL_SIG_OUT;
+    uint32_t accumSig = 0, combineSig = 0, finalizeSig = 0;
+    ForEachFunc_t combine = getKernel(combineSlot, &combineSig);
+    ForEachFunc_t finalize = NULL;
+    if (finalizeSlot >= 0) {
+        finalize = getKernel((uint32_t)finalizeSlot, &finalizeSig);
+    }
+    // Kernels returning their result overwrite out instead of adding to it.
+    if (!getKernel(accumSlot, &accumSig) || ((accumSig & inOut) != inOut) ||
+        (accumSig & RS_KERNEL_SIG_KERNEL) || !combine || ((combineSig & inOut) != inOut) ||
+        (combineSig & RS_KERNEL_SIG_KERNEL) ||
+        ((finalizeSlot >= 0) && (!finalize || ((finalizeSig & inOut) != inOut)))) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "Invalid kernels for reduction");
+        return;
+    }
+
+    const size_t accumBytes = aout->getType()->getElementSizeBytes();
+    const size_t stride = (accumBytes + RS_CACHE_LINE_SIZE - 1) & ~(RS_CACHE_LINE_SIZE - 1);
+    const uint32_t count = mCtx->getThreadCount();
+    uint8_t *accum = (uint8_t *)memalign(RS_CACHE_LINE_SIZE, stride * count);
+    if (!accum) {
+        rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Failed to allocate reduction accumulators");
+        return;
+    }
+    // aout comes in holding the identity of the combine step.
+    const uint8_t *init = (const uint8_t *)aout->mHal.drvState.lod[0].mallocPtr;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        memcpy(accum + ct * stride, init, accumBytes);
+    }
+
+    MTLaunchStruct mtls;
+    forEachMtlsSetup(ain, aout, NULL, 0, sc, &mtls);
+    forEachKernelSetup(accumSlot, &mtls);
+    mtls.fep.ptrOut = accum;
+    mtls.fep.eStrideOut = 0;
+    mtls.fep.yStrideOut = 0;
+    mtls.mAccumStride = stride;
+    // The accumulator doesn't move with the cells as wide steps expect.
+    mtls.kernelWide = NULL;
+    foldRows(&mtls);
+
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    if (mtls.kernel) {
+        mCtx->launchThreads(ain, aout, sc, &mtls);
+    }
+
+    RsForEachStubParamStruct p;
+    memset(&p, 0, sizeof(p));
+    p.dimX = 1;
+    p.dimY = 1;
+    p.dimZ = 1;
+    outer_foreach_t fn = (outer_foreach_t)combine;
+    for (uint32_t step = 1; step < count; step <<= 1) {
+        for (uint32_t ct = 0; ct + step < count; ct += step * 2) {
+            p.in = accum + (ct + step) * stride;
+            p.out = accum + ct * stride;
+            fn(&p, 0, 1, 0, 0);
+        }
+    }
+    if (finalize) {
+        p.in = accum;
+        p.out = (uint8_t *)aout->mHal.drvState.lod[0].mallocPtr;
+        ((outer_foreach_t)finalize)(&p, 0, 1, 0, 0);
+    } else {
+        memcpy(aout->mHal.drvState.lod[0].mallocPtr, accum, accumBytes);
+    }
+
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    releaseGlobals(outer);
+    free(accum);
 }
 
 int RsdCpuScriptImpl::invokeRoot() {
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
     RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
     int ret = mRoot();
     mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    releaseGlobals(outer);
     return ret;
 }
 
 void RsdCpuScriptImpl::invokeInit() {
     if (mInit) {
+#ifdef RS_COMPATIBILITY_LIB
+        // rs_init_snapshot promises init() only fills in plain data, the
+        // same way every time.
+        const bool snapshot = mSharedLib && hasPragma("rs_init_snapshot");
+        if (snapshot && restoreInitSnapshot()) {
+            return;
+        }
+#endif
+        RsdCpuScriptImpl *outer = acquireGlobals();
         mInit();
+#ifdef RS_COMPATIBILITY_LIB
+        if (snapshot) {
+            saveInitSnapshot();
+        }
+#endif
+        releaseGlobals(outer);
     }
 }
 
 void RsdCpuScriptImpl::invokeFreeChildren() {
     if (mFreeChildren) {
+        RsdCpuScriptImpl *outer = acquireGlobals();
         mFreeChildren();
+        releaseGlobals(outer);
     }
 }
 
@@ -895,6 +1918,8 @@ void RsdCpuScriptImpl::invokeFunction(uint32_t slot, const void *params,
                                       size_t paramLength) {
     //ALOGE("invoke %p %p %i %p %i", dc, script, slot, params, paramLength);
 
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
     RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
     reinterpret_cast<void (*)(const void *, uint32_t)>(
 #ifndef RS_COMPATIBILITY_LIB
@@ -903,6 +1928,64 @@ void RsdCpuScriptImpl::invokeFunction(uint32_t slot, const void *params,
         mInvokeFunctions[slot])(params, paramLength);
 #endif
     mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    releaseGlobals(outer);
+}
+
+typedef void (*InvokeFunc)(const void *, uint32_t);
+
+// Invokes of a batch are claimed this many at a time.
+static const uint32_t kInvokeBatchChunk = 16;
+
+struct InvokeBatchWork {
+    InvokeFunc fn;
+    const uint8_t *params;
+    size_t paramLength;
+    uint32_t count;
+    volatile int32_t next;
+};
+
+static void wc_invokeBatch(void *usr, uint32_t idx) {
+    InvokeBatchWork *work = (InvokeBatchWork *)usr;
+    while (true) {
+        uint32_t start = (uint32_t)__sync_fetch_and_add(&work->next, kInvokeBatchChunk);
+        if (start >= work->count) {
+            return;
+        }
+        uint32_t end = rsMin(start + kInvokeBatchChunk, work->count);
+        for (uint32_t ct = start; ct < end; ct++) {
+            work->fn(work->params + ct * work->paramLength, work->paramLength);
+        }
+    }
+}
+
+// Threadable scripts run the invokes of a batch on the whole pool, in no
+// particular order; others run them in order here.
+void RsdCpuScriptImpl::invokeFunctionBatch(uint32_t slot, const void *params,
+                                           size_t paramLength, uint32_t count) {
+    InvokeBatchWork work;
+    work.fn = reinterpret_cast<InvokeFunc>(
+#ifndef RS_COMPATIBILITY_LIB
+        mExecutable->getExportFuncAddrs()[slot]);
+#else
+        mInvokeFunctions[slot]);
+#endif
+    work.params = (const uint8_t *)params;
+    work.paramLength = paramLength;
+    work.count = count;
+    work.next = 0;
+
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    RsdCpuReferenceImpl::LaunchLane *lane = mCtx->enterLane();
+    RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
+    if (mIsThreadable && (count > kInvokeBatchChunk)) {
+        mCtx->launchThreads(wc_invokeBatch, &work);
+    } else {
+        wc_invokeBatch(&work, 0);
+    }
+    mCtx->setTLS(oldTLS);
+    mCtx->leaveLane(lane);
+    releaseGlobals(outer);
 }
 
 void RsdCpuScriptImpl::setGlobalVar(uint32_t slot, const void *data, size_t dataLength) {
@@ -925,7 +2008,9 @@ void RsdCpuScriptImpl::setGlobalVar(uint32_t slot, const void *data, size_t data
         return;
     }
 
+    RsdCpuScriptImpl *outer = acquireGlobals();
     memcpy(destPtr, data, dataLength);
+    releaseGlobals(outer);
 }
 
 void RsdCpuScriptImpl::getGlobalVar(uint32_t slot, void *data, size_t dataLength) {
@@ -942,7 +2027,9 @@ void RsdCpuScriptImpl::getGlobalVar(uint32_t slot, void *data, size_t dataLength
         //ALOGV("Calling setVar on slot = %i which is null", slot);
         return;
     }
+    RsdCpuScriptImpl *outer = acquireGlobals();
     memcpy(data, srcPtr, dataLength);
+    releaseGlobals(outer);
 }
 
 
@@ -965,6 +2052,7 @@ void RsdCpuScriptImpl::setGlobalVarWithElemDims(uint32_t slot, const void *data,
     // but dimLength is given in terms of bytes.
     dimLength /= sizeof(int);
 
+    RsdCpuScriptImpl *outer = acquireGlobals();
     // Only a single dimension is currently supported.
     rsAssert(dimLength == 1);
     if (dimLength == 1) {
@@ -985,6 +2073,7 @@ void RsdCpuScriptImpl::setGlobalVarWithElemDims(uint32_t slot, const void *data,
     }
 
     memcpy(destPtr, data, dataLength);
+    releaseGlobals(outer);
 }
 
 void RsdCpuScriptImpl::setGlobalBind(uint32_t slot, Allocation *data) {
@@ -1008,7 +2097,10 @@ void RsdCpuScriptImpl::setGlobalBind(uint32_t slot, Allocation *data) {
     if(data) {
         ptr = data->mHal.drvState.lod[0].mallocPtr;
     }
+    updateAllocRange(slot, data);
+    RsdCpuScriptImpl *outer = acquireGlobals();
     memcpy(destPtr, &ptr, sizeof(void *));
+    releaseGlobals(outer);
 }
 
 void RsdCpuScriptImpl::setGlobalObj(uint32_t slot, ObjectBase *data) {
@@ -1032,10 +2124,143 @@ void RsdCpuScriptImpl::setGlobalObj(uint32_t slot, ObjectBase *data) {
         return;
     }
 
+    RsdCpuScriptImpl *outer = acquireGlobals();
     rsrSetObject(mCtx->getContext(), (ObjectBase **)destPtr, data);
+    releaseGlobals(outer);
+}
+
+void RsdCpuScriptImpl::setGlobalVars(const void *records, size_t sizeBytes, uint32_t count) {
+    const uint8_t *start = (const uint8_t *)records;
+    RsScriptVarRecord r;
+
+#ifndef RS_COMPATIBILITY_LIB
+    void * const *addrs = &mExecutable->getExportVarAddrs()[0];
+#else
+    void * const *addrs = mFieldAddress;
+#endif
+
+    RsdCpuScriptImpl *outer = acquireGlobals();
+
+    // Take every new object reference before dropping any old one, so
+    // objects moved between slots in the same list never reach zero.
+    const uint8_t *p = start;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        memcpy(&r, p, sizeof(r));
+        if (r.isObject && addrs[r.slot]) {
+            ObjectBase *o;
+            memcpy(&o, p + sizeof(r), sizeof(o));
+            if (o) {
+                o->incSysRef();
+            }
+        }
+        p += sizeof(r) + rsRound(r.sizeBytes, 4);
+    }
+
+    p = start;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        memcpy(&r, p, sizeof(r));
+        uint8_t *destPtr = (uint8_t *)addrs[r.slot];
+        if (destPtr) {
+            if (r.isObject) {
+                ObjectBase **dst = (ObjectBase **)destPtr;
+                if (dst[0]) {
+                    dst[0]->decSysRef();
+                }
+            }
+            memcpy(destPtr, p + sizeof(r), r.sizeBytes);
+        }
+        p += sizeof(r) + rsRound(r.sizeBytes, 4);
+    }
+
+    releaseGlobals(outer);
+}
+
+bool RsdCpuScriptImpl::reserveStagedVars(size_t bytes) {
+    if (mStagedBytes + bytes <= mStagedCapacity) {
+        return true;
+    }
+    size_t capacity = rsMax(mStagedCapacity * 2, mStagedBytes + bytes);
+    uint8_t *vars = (uint8_t *)realloc(mStagedVars, capacity);
+    if (!vars) {
+        return false;
+    }
+    mStagedVars = vars;
+    mStagedCapacity = capacity;
+    return true;
+}
+
+// A launch left running reads the globals in place, so while one might be
+// the new values queue up here rather than waiting for it.  They are set,
+// in order, when the context retires the launch, which it always does
+// before anything else can look at them.
+bool RsdCpuScriptImpl::stageGlobalVar(uint32_t slot, const void *data, size_t dataLength) {
+    if (!mStagedCount && !mCtx->hasPendingLaunch(this)) {
+        return false;
+    }
+
+    RsScriptVarRecord r;
+    const size_t recordSize = sizeof(r) + rsRound(dataLength, 4);
+    if (!reserveStagedVars(recordSize)) {
+        mCtx->finishLaunches();
+        return false;
+    }
+    r.slot = slot;
+    r.sizeBytes = dataLength;
+    r.isObject = 0;
+    memcpy(mStagedVars + mStagedBytes, &r, sizeof(r));
+    memcpy(mStagedVars + mStagedBytes + sizeof(r), data, dataLength);
+    mStagedBytes += recordSize;
+    mStagedCount++;
+    return true;
+}
+
+bool RsdCpuScriptImpl::stageGlobalVars(const void *records, size_t sizeBytes, uint32_t count) {
+    if (!mStagedCount && !mCtx->hasPendingLaunch(this)) {
+        return false;
+    }
+
+    // Object references are only moved with the launch finished.
+    const uint8_t *p = (const uint8_t *)records;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        RsScriptVarRecord r;
+        memcpy(&r, p, sizeof(r));
+        if (r.isObject) {
+            mCtx->finishLaunches();
+            return false;
+        }
+        p += sizeof(r) + rsRound(r.sizeBytes, 4);
+    }
+
+    if (!reserveStagedVars(sizeBytes)) {
+        mCtx->finishLaunches();
+        return false;
+    }
+    memcpy(mStagedVars + mStagedBytes, records, sizeBytes);
+    mStagedBytes += sizeBytes;
+    mStagedCount += count;
+    return true;
+}
+
+void RsdCpuScriptImpl::applyStagedGlobals() {
+    if (mStagedCount) {
+        uint32_t count = mStagedCount;
+        mStagedCount = 0;
+        setGlobalVars(mStagedVars, mStagedBytes, count);
+        mStagedBytes = 0;
+    }
 }
 
 RsdCpuScriptImpl::~RsdCpuScriptImpl() {
+    // A launch still running would record itself once done.
+    if (mCtx->hasPendingLaunch(this)) {
+        mCtx->finishLaunches();
+    }
+    mCtx->dropProfile(this);
+    free(mKernelCosts);
+    free(mStagedVars);
+    delete[] mAllocRanges;
+    trackMemory(-(ssize_t)mCodeBytes, -(ssize_t)mDataBytes);
+
 #ifndef RS_COMPATIBILITY_LIB
     if (mExecutable) {
         Vector<void *>::const_iterator var_addr_iter =
@@ -1064,9 +2289,6 @@ RsdCpuScriptImpl::~RsdCpuScriptImpl() {
         }
     }
 
-    if (mCompilerContext) {
-        delete mCompilerContext;
-    }
     if (mCompilerDriver) {
         delete mCompilerDriver;
     }
@@ -1078,6 +2300,7 @@ RsdCpuScriptImpl::~RsdCpuScriptImpl() {
     }
 #else
     if (mFieldIsObject) {
+        RsdCpuScriptImpl *outer = acquireGlobals();
         for (size_t i = 0; i < mExportedVariableCount; ++i) {
             if (mFieldIsObject[i]) {
                 if (mFieldAddress[i] != NULL) {
@@ -1087,6 +2310,7 @@ RsdCpuScriptImpl::~RsdCpuScriptImpl() {
                 }
             }
         }
+        releaseGlobals(outer);
     }
 
     if (mInvokeFunctions) delete[] mInvokeFunctions;
@@ -1095,10 +2319,68 @@ RsdCpuScriptImpl::~RsdCpuScriptImpl() {
     if (mFieldIsObject) delete[] mFieldIsObject;
     if (mForEachSignatures) delete[] mForEachSignatures;
     if (mBoundAllocs) delete[] mBoundAllocs;
-    if (mScriptSO) {
-        dlclose(mScriptSO);
-    }
+    freePragmas();
+    unloadLibrary();
 #endif
+    delete[] mWideKernels;
+}
+
+// Bytes from the start of lod 0 to the end of the last lod or face.
+static size_t getAllocationSpan(const Allocation *a) {
+    const uint8_t *base = (const uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
+    const uint32_t lodCount = rsMax(a->mHal.drvState.lodCount, 1u);
+    size_t span = 0;
+    for (uint32_t lod = 0; lod < lodCount; lod++) {
+        const Allocation::Hal::DrvState::LodState &l = a->mHal.drvState.lod[lod];
+        const uint8_t *p = (const uint8_t *)l.mallocPtr;
+        if (p < base) {
+            continue;
+        }
+        size_t end = (p - base) + l.stride * rsMax(l.dimY, 1u) * rsMax(l.dimZ, 1u);
+        span = rsMax(span, end);
+    }
+    if (a->mHal.drvState.faceCount > 1) {
+        span += a->mHal.drvState.faceOffset * (a->mHal.drvState.faceCount - 1);
+    }
+    return span;
+}
+
+// Moves slot's entry to where the allocation's memory now sorts, or drops
+// it.  Binding is rare next to lookups, so the sorted order is kept here.
+void RsdCpuScriptImpl::updateAllocRange(uint32_t slot, const Allocation *a) {
+    if (!mAllocRanges) {
+        mAllocRanges = new AllocRange[mScript->mHal.info.exportedVariableCount];
+    }
+    uint32_t count = 0;
+    for (uint32_t ct = 0; ct < mAllocRangeCount; ct++) {
+        if (mAllocRanges[ct].mSlot != slot) {
+            mAllocRanges[count++] = mAllocRanges[ct];
+        }
+    }
+
+    const void *ptr = a ? a->mHal.drvState.lod[0].mallocPtr : NULL;
+    if (ptr) {
+        AllocRange r;
+        r.mStart = (uintptr_t)ptr;
+        r.mSize = rsMax(getAllocationSpan(a), (size_t)1);
+        r.mSlot = slot;
+        uint32_t pos = count;
+        while ((pos > 0) && ((mAllocRanges[pos - 1].mStart > r.mStart) ||
+                             ((mAllocRanges[pos - 1].mStart == r.mStart) &&
+                              (mAllocRanges[pos - 1].mSlot > slot)))) {
+            mAllocRanges[pos] = mAllocRanges[pos - 1];
+            pos--;
+        }
+        mAllocRanges[pos] = r;
+        count++;
+    }
+
+    uintptr_t end = 0;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        end = rsMax(end, mAllocRanges[ct].mStart + mAllocRanges[ct].mSize);
+        mAllocRanges[ct].mEnd = end;
+    }
+    mAllocRangeCount = count;
 }
 
 Allocation * RsdCpuScriptImpl::getAllocationForPointer(const void *ptr) const {
@@ -1106,6 +2388,37 @@ Allocation * RsdCpuScriptImpl::getAllocationForPointer(const void *ptr) const {
         return NULL;
     }
 
+    // Find the last range starting at or below ptr, then walk back to the
+    // first one holding it; nested ranges only come from adapters.
+    const uintptr_t p = (uintptr_t)ptr;
+    uint32_t lo = 0;
+    uint32_t hi = mAllocRangeCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (mAllocRanges[mid].mStart <= p) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    Allocation *found = NULL;
+    for (uint32_t ct = lo; (ct > 0) && (mAllocRanges[ct - 1].mEnd > p); ct--) {
+        const AllocRange &r = mAllocRanges[ct - 1];
+        if (found && (r.mStart != (uintptr_t)found->mHal.drvState.lod[0].mallocPtr)) {
+            break;
+        }
+        Allocation *a = mBoundAllocs[r.mSlot];
+        // A range is stale once its allocation has been given new memory.
+        if ((p - r.mStart < r.mSize) &&
+            ((uintptr_t)a->mHal.drvState.lod[0].mallocPtr == r.mStart)) {
+            // Equal starts are sorted by slot; keep going for the lowest.
+            found = a;
+        }
+    }
+    if (found) {
+        return found;
+    }
+
     for (uint32_t ct=0; ct < mScript->mHal.info.exportedVariableCount; ct++) {
         Allocation *a = mBoundAllocs[ct];
         if (!a) continue;
@@ -1117,16 +2430,30 @@ Allocation * RsdCpuScriptImpl::getAllocationForPointer(const void *ptr) const {
     return NULL;
 }
 
+// Group launches run the kernel between these two, so the globals stay
+// resident for it.  Two instances of one library fused into one launch
+// can't both be, and the first one's kernel sees the second's globals.
 void RsdCpuScriptImpl::preLaunch(uint32_t slot, const Allocation * ain,
                        Allocation * aout, const void * usr,
                        uint32_t usrLen, const RsScriptCall *sc)
 {
+#ifdef RS_COMPATIBILITY_LIB
+    RsdCpuScriptImpl *outer = acquireGlobals();
+    if (mLaunchDepth++ == 0) {
+        mLaunchOuter = outer;
+    }
+#endif
 }
 
 void RsdCpuScriptImpl::postLaunch(uint32_t slot, const Allocation * ain,
                         Allocation * aout, const void * usr,
                         uint32_t usrLen, const RsScriptCall *sc)
 {
+#ifdef RS_COMPATIBILITY_LIB
+    if (--mLaunchDepth == 0) {
+        releaseGlobals(mLaunchOuter);
+    }
+#endif
 }
 
 
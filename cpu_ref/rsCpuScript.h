@@ -51,6 +51,8 @@ public:
     virtual void populateScript(Script *);
 
     virtual void invokeFunction(uint32_t slot, const void *params, size_t paramLength);
+    virtual void invokeFunctionBatch(uint32_t slot, const void *params, size_t paramLength,
+                                     uint32_t count);
     virtual int invokeRoot();
     virtual void preLaunch(uint32_t slot, const Allocation * ain,
                            Allocation * aout, const void * usr,
@@ -64,6 +66,16 @@ public:
                        const void * usr,
                        uint32_t usrLen,
                        const RsScriptCall *sc);
+    virtual void invokeForEachMulti(uint32_t slot,
+                                    const Allocation ** ains,
+                                    size_t inLen,
+                                    Allocation * aout,
+                                    const void * usr,
+                                    uint32_t usrLen,
+                                    const RsScriptCall *sc);
+    virtual void invokeReduce(uint32_t accumSlot, uint32_t combineSlot,
+                              int32_t finalizeSlot, const Allocation * ain,
+                              Allocation * aout, const RsScriptCall *sc);
     virtual void invokeInit();
     virtual void invokeFreeChildren();
 
@@ -73,17 +85,53 @@ public:
                                   const Element *e, const size_t *dims, size_t dimLength);
     virtual void setGlobalBind(uint32_t slot, Allocation *data);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual void setGlobalVars(const void *records, size_t sizeBytes, uint32_t count);
+    virtual bool stageGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual bool stageGlobalVars(const void *records, size_t sizeBytes, uint32_t count);
+    // Sets the globals held back while the last launch ran.
+    void applyStagedGlobals();
 
 
     virtual ~RsdCpuScriptImpl();
     RsdCpuScriptImpl(RsdCpuReferenceImpl *ctx, const Script *s);
 
     const Script * getScript() {return mScript;}
+    // Name of the kernel in slot, or NULL if the script doesn't know it.
+    virtual const char * getKernelName(uint32_t slot) const;
+    RsdCpuReferenceImpl * getCpuRef() const {return mCtx;}
 
     void forEachMtlsSetup(const Allocation * ain, Allocation * aout,
                           const void * usr, uint32_t usrLen,
                           const RsScriptCall *sc, MTLaunchStruct *mtls);
     virtual void forEachKernelSetup(uint32_t slot, MTLaunchStruct *mtls);
+    void foldRows(MTLaunchStruct *mtls) const;
+    bool canLaunchAsync() const;
+
+    // Measured cost of a kernel slot in picoseconds per element, 0 until
+    // the slot has been timed.
+    uint32_t getKernelCost(uint32_t slot) const {
+        return (slot < mKernelCostCount) ? mKernelCosts[slot].mCostPs : 0;
+    }
+    // Whether the next launch of slot should prefetch its input rows.
+    bool usePrefetch(uint32_t slot) const {
+        return (slot < mKernelCostCount) &&
+               ((mKernelCosts[slot].mPrefetch == kPrefetchTrial) ||
+                (mKernelCosts[slot].mPrefetch == kPrefetchOn));
+    }
+    void updateKernelCost(uint32_t slot, uint32_t psPerElement);
+
+    // How many rows and columns around an output cell kernel slot reads
+    // from the allocation bound to fieldSlot, or -1 if the script may read
+    // it anywhere.  ScriptGroup uses this to keep field links fused.
+    virtual int getFieldHalo(uint32_t slot, uint32_t fieldSlot) const { return -1; }
+    // Redirects reads of fieldSlot on thread lid to a tile laid out like
+    // the bound allocation, base being where its cell (0, 0) would be.  A
+    // NULL base restores the allocation.
+    virtual void setFieldTile(uint32_t lid, uint32_t fieldSlot,
+                              const uint8_t *base, size_t stride) {}
+    // False when launches never write through bound objects, so kernels
+    // can share a group launch with other kernels reading them.
+    virtual bool writesObjects() const { return true; }
 
 
     const RsdCpuReference::CpuSymbol * lookupSymbolMath(const char *sym);
@@ -91,6 +139,12 @@ public:
 
     virtual Allocation * getAllocationForPointer(const void *ptr) const;
 
+    // Makes this script's globals the ones its code sees until the matching
+    // releaseGlobals(), which is passed the return value.  Only scripts
+    // sharing a library with other instances ever need to move them.
+    RsdCpuScriptImpl * acquireGlobals();
+    void releaseGlobals(RsdCpuScriptImpl *outer);
+
 #ifndef RS_COMPATIBILITY_LIB
     virtual  void * getRSExecutable() { return mExecutable; }
 #endif
@@ -105,7 +159,6 @@ protected:
     void (*mInit)();
     void (*mFreeChildren)();
 
-    bcc::BCCContext *mCompilerContext;
     bcc::RSCompilerDriver *mCompilerDriver;
     bcc::RSExecutable *mExecutable;
 #else
@@ -126,12 +179,99 @@ protected:
     //int mVersionMinor;
     size_t mExportedVariableCount;
     size_t mExportedFunctionCount;
+    size_t mExportedForEachCount;
+
+    // Pragmas listed in .rs.info, the strings being owned by the script.
+    char **mPragmaKeys;
+    char **mPragmaValues;
+    size_t mPragmaCount;
+
+    // Set when mScriptSO is shared with other instances of the script, in
+    // which case mSavedGlobals holds our copy of its writable data while
+    // another instance is resident.
+    struct SharedLibrary;
+    SharedLibrary *mSharedLib;
+    uint8_t *mSavedGlobals;
+    // What preLaunch displaced, for postLaunch; a group can launch several
+    // kernels of one script together.
+    RsdCpuScriptImpl *mLaunchOuter;
+    int mLaunchDepth;
+
+    bool loadLibrary(const char *cacheDir, const char *resName);
+    void unloadLibrary();
+    void swapInGlobals();
+    void freePragmas();
+    bool hasPragma(const char *key) const;
+
+    // The globals of scripts with the rs_init_snapshot pragma are saved
+    // after their first init() and given to later instances instead of
+    // running it again.
+    bool restoreInitSnapshot();
+    void saveInitSnapshot();
+    uint8_t * loadInitSnapshot() const;
 #endif
 
+    // Expanded function of a kernel slot and its signature, or NULL for a
+    // slot the script doesn't have.
+    ForEachFunc_t getKernel(uint32_t slot, uint32_t *sig) const;
+    // Vector expansion of a kernel slot, taking width cells at a time, or
+    // NULL when the compiler didn't emit one.
+    ForEachFunc_t getWideKernel(uint32_t slot, uint32_t *width) const;
+    void findWideKernel(uint32_t slot, const char *expandName);
+
+    struct WideKernel {
+        ForEachFunc_t mFn;
+        uint32_t mWidth;
+    };
+    WideKernel *mWideKernels;
+    uint32_t mWideKernelCount;
+
     Allocation **mBoundAllocs;
+    // Memory of the bound allocations sorted by start address, for
+    // getAllocationForPointer.  mEnd is the largest end of any range up to
+    // and including this one, so a search can tell when to stop walking
+    // back past ranges that start lower.
+    struct AllocRange {
+        uintptr_t mStart;
+        uintptr_t mSize;
+        uintptr_t mEnd;
+        uint32_t mSlot;
+    };
+    AllocRange *mAllocRanges;
+    uint32_t mAllocRangeCount;
+    void updateAllocRange(uint32_t slot, const Allocation *a);
     void * mIntrinsicData;
     bool mIsThreadable;
 
+    // Prefetching is decided per slot by timing the launch after the
+    // warm-up without it and the one after with it.
+    enum {
+        kPrefetchWarmup,
+        kPrefetchBaseline,
+        kPrefetchTrial,
+        kPrefetchOn,
+        kPrefetchOff
+    };
+    struct KernelCost {
+        uint32_t mCostPs;
+        uint32_t mBaselinePs;
+        uint32_t mPrefetch;
+    };
+    KernelCost *mKernelCosts;
+    uint32_t mKernelCostCount;
+
+    // Staged updates as packed RsScriptVarRecords, never holding objects.
+    uint8_t *mStagedVars;
+    size_t mStagedBytes;
+    size_t mStagedCapacity;
+    uint32_t mStagedCount;
+    bool reserveStagedVars(size_t bytes);
+
+    // Code and globals counted against the context for this script.
+    size_t mCodeBytes;
+    size_t mDataBytes;
+    void trackMemory(ssize_t codeBytes, ssize_t dataBytes);
+
 };
 
 
@@ -24,23 +24,58 @@
 using namespace android;
 using namespace android::renderscript;
 
-CpuScriptGroupImpl::CpuScriptGroupImpl(RsdCpuReferenceImpl *ctx, const ScriptGroup *sg) {
+CpuScriptGroupImpl::CpuScriptGroupImpl(RsdCpuReferenceImpl *ctx, const ScriptGroup *sg)
+        : mScratch(ctx->getThreadCount()) {
     mCtx = ctx;
     mSG = sg;
+    mPlanValid = false;
+    mPlanFieldDep = false;
+    mBandValid = false;
+    mBandOk = false;
+    mPipeFrame = 0;
+    mFramePending[0] = false;
+    mFramePending[1] = false;
+    mFieldsBound = false;
 }
 
 CpuScriptGroupImpl::~CpuScriptGroupImpl() {
+    finishPipeline();
+}
 
+// Gives each thread bytes of scratch for the links, 64 byte aligned so
+// they start on cache lines.  Returns false if any thread couldn't get it.
+bool CpuScriptGroupImpl::getLinkScratch(size_t bytes) {
+    for (uint32_t ct=0; ct < mCtx->getThreadCount(); ct++) {
+        void *scratch = bytes ? mScratch.get(ct, bytes, 64) : NULL;
+        if (bytes && !scratch) {
+            return false;
+        }
+        mScratchPtrs.editItemAt(ct) = scratch;
+    }
+    return true;
 }
 
 bool CpuScriptGroupImpl::init() {
     return true;
 }
 
+// Pipelined groups usually get new inputs and outputs for every frame,
+// which only change the launches as long as the same kernels run.
 void CpuScriptGroupImpl::setInput(const ScriptKernelID *kid, Allocation *a) {
+    if (!mPlanValid || !mSG->isPipelined() || !patchFrames(kid, a, true)) {
+        mPlanValid = false;
+    }
 }
 
 void CpuScriptGroupImpl::setOutput(const ScriptKernelID *kid, Allocation *a) {
+    if (!mPlanValid || !mSG->isPipelined() || !patchFrames(kid, a, false)) {
+        mPlanValid = false;
+    }
+}
+
+void CpuScriptGroupImpl::setPipelined(bool pipelined) {
+    finishPipeline();
+    mPlanValid = false;
 }
 
 
@@ -56,81 +91,174 @@ void CpuScriptGroupImpl::scriptGroupRoot(const RsForEachStubParamStruct *p,
     const ScriptList *sl = (const ScriptList *)p->usr;
     RsForEachStubParamStruct *mp = (RsForEachStubParamStruct *)p;
     const void *oldUsr = p->usr;
+    // Group kernels take a single input, which is always in.
+    mp->inLen = 0;
+    uint8_t *scratch = (uint8_t *)sl->scratch[p->lid];
+
+    // Every kernel of the chain runs over one chunk before the next chunk
+    // starts, so the links between them never leave the cache.
+    for (uint32_t x1 = xstart; x1 < xend; ) {
+        uint32_t x2 = ((xend - x1) > sl->scratchWidth) ? x1 + sl->scratchWidth : xend;
+
+        for(size_t ct=0; ct < sl->count; ct++) {
+            ScriptGroupRootFunc_t func;
+            func = (ScriptGroupRootFunc_t)sl->fnPtrs[ct];
+            mp->usr = sl->usrPtrs[ct];
+
+            mp->ptrIn = NULL;
+            mp->in = NULL;
+            mp->ptrOut = NULL;
+            mp->out = NULL;
+
+            uint32_t istep = 0;
+            uint32_t ostep = 0;
+
+            if (sl->ins[ct]) {
+                istep = sl->ins[ct]->mHal.state.elementSizeBytes;
+                if (sl->inExts[ct]) {
+                    mp->ptrIn = (const uint8_t *)sl->ins[ct]->mHal.drvState.lod[0].mallocPtr;
+                    mp->in = mp->ptrIn + sl->ins[ct]->mHal.drvState.lod[0].stride * p->y +
+                             istep * x1;
+                } else {
+                    mp->ptrIn = scratch + sl->inOffsets[ct];
+                    mp->in = mp->ptrIn;
+                }
+            }
 
-    for(size_t ct=0; ct < sl->count; ct++) {
+            if (sl->outs[ct]) {
+                ostep = sl->outs[ct]->mHal.state.elementSizeBytes;
+                if (sl->outExts[ct]) {
+                    mp->ptrOut = (uint8_t *)sl->outs[ct]->mHal.drvState.lod[0].mallocPtr;
+                    mp->out = mp->ptrOut + sl->outs[ct]->mHal.drvState.lod[0].stride * p->y +
+                              ostep * x1;
+                } else {
+                    mp->ptrOut = scratch + sl->outOffsets[ct];
+                    mp->out = mp->ptrOut;
+                }
+            }
+
+            //ALOGE("kernel %i %p,%p  %p,%p", ct, mp->ptrIn, mp->in, mp->ptrOut, mp->out);
+            func(p, x1, x2, istep, ostep);
+        }
+        x1 = x2;
+    }
+    //ALOGE("script group root");
+
+    mp->usr = oldUsr;
+}
+
+// Runs every kernel of the group over band p->y.  Each kernel covers the
+// band widened by its margin, clipped to the launch, so the rows read by
+// the kernels after it are in its band buffer when they run.
+void CpuScriptGroupImpl::scriptGroupBandRoot(const RsForEachStubParamStruct *p,
+                                             uint32_t xstart, uint32_t xend,
+                                             uint32_t instep, uint32_t outstep) {
+
+    const BandList *bl = (const BandList *)p->usr;
+    const ScriptList *sl = bl->sl;
+    RsForEachStubParamStruct *mp = (RsForEachStubParamStruct *)p;
+    const void *oldUsr = p->usr;
+    // Group kernels take a single input, which is always in.
+    mp->inLen = 0;
+    const uint32_t oldY = p->y;
+    uint8_t *scratch = (uint8_t *)sl->scratch[p->lid];
+
+    const int32_t y0 = bl->yStart + oldY * bl->bandRows;
+    const int32_t y1 = rsMin(y0 + (int32_t)bl->bandRows, (int32_t)bl->yEnd);
+
+    // Band buffers are addressed like their allocations, with row y0 -
+    // margin at the start of the buffer.
+    for (size_t ct=0; ct < bl->fieldCount; ct++) {
+        const intptr_t origin = y0 - bl->fieldMargins[ct];
+        const uint8_t *base = scratch + bl->fieldOffsets[ct] -
+                              origin * (intptr_t)bl->fieldStrides[ct];
+        bl->fieldScripts[ct]->setFieldTile(p->lid, bl->fieldSlots[ct], base,
+                                           bl->fieldStrides[ct]);
+    }
+
+    for (size_t ct=0; ct < sl->count; ct++) {
         ScriptGroupRootFunc_t func;
         func = (ScriptGroupRootFunc_t)sl->fnPtrs[ct];
         mp->usr = sl->usrPtrs[ct];
 
-        mp->ptrIn = NULL;
-        mp->in = NULL;
-        mp->ptrOut = NULL;
-        mp->out = NULL;
-
+        const uint8_t *inBase = NULL;
+        uint8_t *outBase = NULL;
+        size_t inStride = 0;
+        size_t outStride = 0;
         uint32_t istep = 0;
         uint32_t ostep = 0;
 
         if (sl->ins[ct]) {
-            mp->ptrIn = (const uint8_t *)sl->ins[ct]->mHal.drvState.lod[0].mallocPtr;
             istep = sl->ins[ct]->mHal.state.elementSizeBytes;
-            mp->in = mp->ptrIn;
             if (sl->inExts[ct]) {
-                mp->in = mp->ptrIn + sl->ins[ct]->mHal.drvState.lod[0].stride * p->y;
+                inBase = (const uint8_t *)sl->ins[ct]->mHal.drvState.lod[0].mallocPtr;
+                inStride = sl->ins[ct]->mHal.drvState.lod[0].stride;
             } else {
-                if (sl->ins[ct]->mHal.drvState.lod[0].dimY > p->lid) {
-                    mp->in = mp->ptrIn + sl->ins[ct]->mHal.drvState.lod[0].stride * p->lid;
-                }
+                inStride = bl->inStrides[ct];
+                inBase = scratch + sl->inOffsets[ct] -
+                         (intptr_t)(y0 - bl->inMargins[ct]) * (intptr_t)inStride;
             }
         }
 
         if (sl->outs[ct]) {
-            mp->ptrOut = (uint8_t *)sl->outs[ct]->mHal.drvState.lod[0].mallocPtr;
-            mp->out = mp->ptrOut;
             ostep = sl->outs[ct]->mHal.state.elementSizeBytes;
             if (sl->outExts[ct]) {
-                mp->out = mp->ptrOut + sl->outs[ct]->mHal.drvState.lod[0].stride * p->y;
+                outBase = (uint8_t *)sl->outs[ct]->mHal.drvState.lod[0].mallocPtr;
+                outStride = sl->outs[ct]->mHal.drvState.lod[0].stride;
             } else {
-                if (sl->outs[ct]->mHal.drvState.lod[0].dimY > p->lid) {
-                    mp->out = mp->ptrOut + sl->outs[ct]->mHal.drvState.lod[0].stride * p->lid;
-                }
+                outStride = bl->outStrides[ct];
+                outBase = scratch + sl->outOffsets[ct] -
+                          (intptr_t)(y0 - bl->margins[ct]) * (intptr_t)outStride;
             }
         }
 
-        //ALOGE("kernel %i %p,%p  %p,%p", ct, mp->ptrIn, mp->in, mp->ptrOut, mp->out);
-        func(p, xstart, xend, istep, ostep);
-    }
-    //ALOGE("script group root");
+        mp->ptrIn = inBase;
+        mp->ptrOut = outBase;
+        mp->in = NULL;
+        mp->out = NULL;
 
-    //ConvolveParams *cp = (ConvolveParams *)p->usr;
+        const int32_t ry1 = rsMax(y0 - bl->margins[ct], (int32_t)bl->yStart);
+        const int32_t ry2 = rsMin(y1 + bl->margins[ct], (int32_t)bl->yEnd);
+        for (int32_t y = ry1; y < ry2; y++) {
+            mp->y = y;
+            if (inBase) {
+                mp->in = inBase + inStride * y + istep * xstart;
+            }
+            if (outBase) {
+                mp->out = outBase + outStride * y + ostep * xstart;
+            }
+            func(p, xstart, xend, istep, ostep);
+        }
+    }
 
     mp->usr = oldUsr;
+    mp->y = oldY;
 }
 
-
-
-void CpuScriptGroupImpl::execute() {
-    Vector<Allocation *> ins;
-    Vector<bool> inExts;
-    Vector<Allocation *> outs;
-    Vector<bool> outExts;
-    Vector<const ScriptKernelID *> kernels;
-    bool fieldDep = false;
+// Scans the nodes and links of the group for the kernels to run and where
+// their inputs and outputs go.  Only depends on the group and on the
+// allocations bound to its inputs and outputs.
+void CpuScriptGroupImpl::buildPlan() {
+    mIns.clear();
+    mInExts.clear();
+    mOuts.clear();
+    mOutExts.clear();
+    mKernels.clear();
+    mFieldInputs.clear();
+    mFieldLinks.clear();
+    mFieldProducers.clear();
+    mFieldConsumers.clear();
+    mPlanFieldDep = false;
 
     for (size_t ct=0; ct < mSG->mNodes.size(); ct++) {
         ScriptGroup::Node *n = mSG->mNodes[ct];
-        Script *s = n->mKernels[0]->mScript;
-        if (s->hasObjectSlots()) {
-            // Disable the ScriptGroup optimization if we have global RS
-            // objects that might interfere between kernels.
-            fieldDep = true;
-        }
 
         //ALOGE("node %i, order %i, in %i out %i", (int)ct, n->mOrder, (int)n->mInputs.size(), (int)n->mOutputs.size());
 
         for (size_t ct2=0; ct2 < n->mInputs.size(); ct2++) {
             if (n->mInputs[ct2]->mDstField.get() && n->mInputs[ct2]->mDstField->mScript) {
                 //ALOGE("field %p %zu", n->mInputs[ct2]->mDstField->mScript, n->mInputs[ct2]->mDstField->mSlot);
-                s->setVarObj(n->mInputs[ct2]->mDstField->mSlot, n->mInputs[ct2]->mAlloc.get());
+                mFieldInputs.add(n->mInputs[ct2]);
             }
         }
 
@@ -140,12 +268,7 @@ void CpuScriptGroupImpl::execute() {
             Allocation *aout = NULL;
             bool inExt = false;
             bool outExt = false;
-
-            if (k->mScript->hasObjectSlots()) {
-                // Disable the ScriptGroup optimization if we have global RS
-                // objects that might interfere between kernels.
-                fieldDep = true;
-            }
+            const ScriptGroup::Link *fieldLink = NULL;
 
             for (size_t ct3=0; ct3 < n->mInputs.size(); ct3++) {
                 if (n->mInputs[ct3]->mDstKernel.get() == k) {
@@ -165,7 +288,12 @@ void CpuScriptGroupImpl::execute() {
                 if (n->mOutputs[ct3]->mSource.get() == k) {
                     aout = n->mOutputs[ct3]->mAlloc.get();
                     if(n->mOutputs[ct3]->mDstField.get() != NULL) {
-                        fieldDep = true;
+                        // Resolved against the halo of the consumer once
+                        // all the kernels are known.
+                        if (fieldLink) {
+                            mPlanFieldDep = true;
+                        }
+                        fieldLink = n->mOutputs[ct3];
                     }
                     //ALOGE(" link out %p", aout);
                 }
@@ -180,70 +308,713 @@ void CpuScriptGroupImpl::execute() {
 
             if ((k->mHasKernelOutput == (aout != NULL)) &&
                 (k->mHasKernelInput == (ain != NULL))) {
-                ins.add(ain);
-                inExts.add(inExt);
-                outs.add(aout);
-                outExts.add(outExt);
-                kernels.add(k);
+                mIns.add(ain);
+                mInExts.add(inExt);
+                mOuts.add(aout);
+                mOutExts.add(outExt);
+                mKernels.add(k);
+                if (fieldLink) {
+                    mFieldLinks.add(fieldLink);
+                    mFieldProducers.add(mKernels.size() - 1);
+                }
+            } else if (fieldLink) {
+                mPlanFieldDep = true;
+            }
+        }
+
+    }
+
+    const size_t count = mKernels.size();
+    mUsrPtrs.clear();
+    mFnPtrs.clear();
+    mSigs.clear();
+    mFences.clear();
+    mAsyncs.clear();
+    for (size_t ct=0; ct < count; ct++) {
+        mUsrPtrs.add(NULL);
+        mFnPtrs.add(NULL);
+        mSigs.add(0);
+        mFences.add(0);
+        mAsyncs.add(false);
+    }
+    mScratchPtrs.clear();
+    for (uint32_t ct=0; ct < mCtx->getThreadCount(); ct++) {
+        mScratchPtrs.add(NULL);
+    }
+
+    // Each field has to be read by a single kernel running after the one
+    // writing it.  Links that don't qualify keep the group on the per
+    // kernel launches.
+    mBandHalos.clear();
+    for (size_t ct=0; ct < mFieldLinks.size(); ct++) {
+        const ScriptFieldID *f = mFieldLinks[ct]->mDstField.get();
+        const size_t producer = mFieldProducers[ct];
+        size_t consumer = count;
+        bool unique = true;
+        for (size_t ct2=0; ct2 < count; ct2++) {
+            if (mKernels[ct2]->mScript == f->mScript) {
+                unique &= (consumer == count) && (ct2 > producer);
+                consumer = ct2;
+            }
+        }
+        if (!unique || (consumer == count) || mOutExts[producer] ||
+            (mFieldLinks[ct]->mAlloc.get() != mOuts[producer])) {
+            mPlanFieldDep = true;
+        }
+        for (size_t ct2=0; ct2 < count; ct2++) {
+            if ((mIns[ct2] == mOuts[producer]) && mInExts[ct2]) {
+                mPlanFieldDep = true;
             }
         }
+        mFieldConsumers.add(consumer);
+        mBandHalos.add(-1);
+    }
+    mBandValid = false;
 
+    if (count) {
+        planChunks();
+    }
+    if (mSG->isPipelined()) {
+        planFrames();
+    }
+}
+
+// Odd frames of a pipelined group go through the second allocation of
+// each link.
+void CpuScriptGroupImpl::planFrames() {
+    const size_t count = mKernels.size();
+    for (uint32_t p = 0; p < 2; p++) {
+        mFrameIns[p] = mIns;
+        mFrameOuts[p] = mOuts;
+        mFrameFences[p].clear();
+        mFrameAsyncs[p].clear();
+        for (size_t ct=0; ct < count; ct++) {
+            mFrameFences[p].add(0);
+            mFrameAsyncs[p].add(false);
+        }
+    }
+    for (size_t ct=0; ct < count; ct++) {
+        for (size_t ct2=0; ct2 < mSG->mLinks.size(); ct2++) {
+            const ScriptGroup::Link *l = mSG->mLinks[ct2];
+            if (!l->mPipeAlloc.get()) {
+                continue;
+            }
+            if (!mInExts[ct] && (mIns[ct] == l->mAlloc.get())) {
+                mFrameIns[1].editItemAt(ct) = l->mPipeAlloc.get();
+            }
+            if (!mOutExts[ct] && (mOuts[ct] == l->mAlloc.get())) {
+                mFrameOuts[1].editItemAt(ct) = l->mPipeAlloc.get();
+            }
+        }
+    }
+}
+
+// Swaps a group input or output of a planned pipelined group in place.
+// Returns false if the kernels that run would change, which needs a new
+// plan.
+bool CpuScriptGroupImpl::patchFrames(const ScriptKernelID *kid, Allocation *a, bool input) {
+    Vector<Allocation *> &allocs = input ? mIns : mOuts;
+    const Vector<bool> &exts = input ? mInExts : mOutExts;
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        if ((mKernels[ct] != kid) || !exts[ct]) {
+            continue;
+        }
+        if (!a || !allocs[ct]) {
+            return false;
+        }
+        allocs.editItemAt(ct) = a;
+        for (uint32_t p = 0; p < 2; p++) {
+            Vector<Allocation *> &frame = input ? mFrameIns[p] : mFrameOuts[p];
+            frame.editItemAt(ct) = a;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Lays out the per-thread scratch of the fused path.  Each internal link
+// gets its own cache line aligned slot.  An allocation that is also bound
+// as a group input or output keeps using its memory.
+void CpuScriptGroupImpl::planChunks() {
+    const size_t count = mKernels.size();
+    mChunkInExts = mInExts;
+    mChunkOutExts = mOutExts;
+
+    Vector<Allocation *> links;
+    Vector<size_t> linkCellBytes;
+    for (size_t ct=0; ct < count; ct++) {
+        if (mOuts[ct] && !mOutExts[ct]) {
+            bool ext = false;
+            for (size_t ct2=0; ct2 < count; ct2++) {
+                ext |= (mIns[ct2] == mOuts[ct]) && mInExts[ct2];
+            }
+            if (ext) {
+                mChunkOutExts.editItemAt(ct) = true;
+            } else {
+                links.add(mOuts[ct]);
+                linkCellBytes.add(mOuts[ct]->mHal.state.elementSizeBytes);
+            }
+        }
+    }
+    for (size_t ct=0; ct < count; ct++) {
+        if (mIns[ct] && !mInExts[ct]) {
+            bool linked = false;
+            for (size_t ct2=0; ct2 < links.size(); ct2++) {
+                linked |= (links[ct2] == mIns[ct]);
+            }
+            if (!linked) {
+                mChunkInExts.editItemAt(ct) = true;
+            }
+        }
     }
 
     MTLaunchStruct mtls;
+    RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(mKernels[0]->mScript);
+    si->forEachMtlsSetup(mIns[0], mOuts[0], NULL, 0, NULL, &mtls);
 
-    if(fieldDep) {
-        for (size_t ct=0; ct < ins.size(); ct++) {
-            Script *s = kernels[ct]->mScript;
-            RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
-            uint32_t slot = kernels[ct]->mSlot;
+    const uint32_t width = mtls.xEnd - mtls.xStart;
+    size_t cellBytes = 0;
+    for (size_t ct=0; ct < links.size(); ct++) {
+        cellBytes += linkCellBytes[ct];
+    }
+    mChunkWidth = width;
+    if (cellBytes) {
+        mChunkWidth = rsMax((uint32_t)(kScratchBytes / cellBytes) & ~15, 16u);
+    }
+    Vector<size_t> linkOffsets;
+    mChunkScratchBytes = 0;
+    for (size_t ct=0; ct < links.size(); ct++) {
+        linkOffsets.add(mChunkScratchBytes);
+        mChunkScratchBytes += (linkCellBytes[ct] * mChunkWidth + 63) & ~63;
+    }
 
-            si->forEachMtlsSetup(ins[ct], outs[ct], NULL, 0, NULL, &mtls);
-            si->forEachKernelSetup(slot, &mtls);
-            si->preLaunch(slot, ins[ct], outs[ct], mtls.fep.usr, mtls.fep.usrLen, NULL);
-            mCtx->launchThreads(ins[ct], outs[ct], NULL, &mtls);
-            si->postLaunch(slot, ins[ct], outs[ct], NULL, 0, NULL);
+    mChunkInOffsets.clear();
+    mChunkOutOffsets.clear();
+    for (size_t ct=0; ct < count; ct++) {
+        size_t inOffset = 0;
+        size_t outOffset = 0;
+        for (size_t ct2=0; ct2 < links.size(); ct2++) {
+            if (!mChunkInExts[ct] && (mIns[ct] == links[ct2])) {
+                inOffset = linkOffsets[ct2];
+            }
+            if (!mChunkOutExts[ct] && (mOuts[ct] == links[ct2])) {
+                outOffset = linkOffsets[ct2];
+            }
+        }
+        mChunkInOffsets.add(inOffset);
+        mChunkOutOffsets.add(outOffset);
+    }
+}
+
+// Lays out the band buffers for the current halos of the field consumers.
+// Returns false if the group can't be run in bands.
+bool CpuScriptGroupImpl::planBands() {
+    const size_t count = mKernels.size();
+
+    // Margins are found walking back from the last kernel.  A kernel has
+    // to cover what any of its consumers cover, plus the halo of the ones
+    // reading it as a field.  Group outputs are only written for the band
+    // itself.
+    mMargins.clear();
+    for (size_t ct=0; ct < count; ct++) {
+        mMargins.add(0);
+    }
+    int maxMargin = 0;
+    for (size_t ct = count; ct-- > 0; ) {
+        int m = 0;
+        if (mOuts[ct] && !mOutExts[ct]) {
+            for (size_t ct2=ct + 1; ct2 < count; ct2++) {
+                if ((mIns[ct2] == mOuts[ct]) && !mInExts[ct2]) {
+                    m = rsMax(m, mMargins[ct2]);
+                }
+            }
+        }
+        for (size_t ct2=0; ct2 < mFieldLinks.size(); ct2++) {
+            if (mFieldProducers[ct2] == ct) {
+                m = rsMax(m, mMargins[mFieldConsumers[ct2]] + mBandHalos[ct2]);
+            }
+        }
+        if (m && mOutExts[ct]) {
+            return false;
+        }
+        mMargins.editItemAt(ct) = m;
+        maxMargin = rsMax(maxMargin, m);
+    }
+
+    MTLaunchStruct mtls;
+    RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(mKernels[0]->mScript);
+    si->forEachMtlsSetup(mIns[0], mOuts[0], NULL, 0, NULL, &mtls);
+    if ((mtls.zEnd - mtls.zStart) > 1 || (mtls.arrayEnd - mtls.arrayStart) > 1) {
+        return false;
+    }
+
+    // Every kernel output that isn't a group output gets a band buffer.
+    // Unlinked inputs read their allocations.
+    mBandInExts.clear();
+    mLinkOffsets.clear();
+    mLinkStrides.clear();
+    size_t rowBytes = 0;
+    for (size_t ct=0; ct < count; ct++) {
+        size_t stride = 0;
+        if (mOuts[ct] && !mOutExts[ct]) {
+            stride = mOuts[ct]->mHal.drvState.lod[0].stride;
+            rowBytes += stride;
+        }
+        mLinkStrides.add(stride);
+        bool inExt = mInExts[ct];
+        if (mIns[ct] && !inExt) {
+            bool linked = false;
+            for (size_t ct2=0; ct2 < ct; ct2++) {
+                linked |= (mOuts[ct2] == mIns[ct]) && !mOutExts[ct2];
+            }
+            inExt = !linked;
+        }
+        mBandInExts.add(inExt);
+    }
+
+    const uint32_t rowCount = mtls.yEnd - mtls.yStart;
+    uint32_t bandRows = rowCount;
+    if (rowBytes) {
+        bandRows = rsMax((uint32_t)(kBandBytes / rowBytes), (uint32_t)(maxMargin * 2 + 4)) -
+                   maxMargin * 2;
+    }
+    mBandRows = rsMin(bandRows, rsMax(rowCount / mCtx->getThreadCount(), 1u));
+
+    mBandScratchBytes = 0;
+    for (size_t ct=0; ct < count; ct++) {
+        mLinkOffsets.add(mBandScratchBytes);
+        mBandScratchBytes += (mLinkStrides[ct] * (mBandRows + mMargins[ct] * 2) + 63) & ~63;
+    }
+
+    mBandInOffsets.clear();
+    mBandInStrides.clear();
+    mBandInMargins.clear();
+    for (size_t ct=0; ct < count; ct++) {
+        size_t inOffset = 0;
+        size_t inStride = 0;
+        int inMargin = 0;
+        if (mIns[ct] && !mBandInExts[ct]) {
+            for (size_t ct2=0; ct2 < ct; ct2++) {
+                if ((mOuts[ct2] == mIns[ct]) && !mOutExts[ct2]) {
+                    inOffset = mLinkOffsets[ct2];
+                    inStride = mLinkStrides[ct2];
+                    inMargin = mMargins[ct2];
+                }
+            }
         }
+        mBandInOffsets.add(inOffset);
+        mBandInStrides.add(inStride);
+        mBandInMargins.add(inMargin);
+    }
+
+    mFieldScripts.clear();
+    mFieldSlots.clear();
+    mFieldOffsets.clear();
+    mFieldStrides.clear();
+    mFieldMargins.clear();
+    for (size_t ct=0; ct < mFieldLinks.size(); ct++) {
+        const size_t producer = mFieldProducers[ct];
+        mFieldScripts.add((RsdCpuScriptImpl *)mCtx->lookupScript(
+                mKernels[mFieldConsumers[ct]]->mScript));
+        mFieldSlots.add(mFieldLinks[ct]->mDstField->mSlot);
+        mFieldOffsets.add(mLinkOffsets[producer]);
+        mFieldStrides.add(mLinkStrides[producer]);
+        mFieldMargins.add(mMargins[producer]);
+    }
+    return true;
+}
+
+// Refreshes the kernel entry points and runs preLaunch for each kernel.
+// Both can change between executes, with the parameters of a script.
+void CpuScriptGroupImpl::setupKernels() {
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        MTLaunchStruct mtls;
+        RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(mKernels[ct]->mScript);
+
+        si->forEachKernelSetup(mKernels[ct]->mSlot, &mtls);
+        mFnPtrs.editItemAt(ct) = (void *)mtls.kernel;
+        mUsrPtrs.editItemAt(ct) = mtls.fep.usr;
+        mSigs.editItemAt(ct) = mtls.fep.usrLen;
+        si->preLaunch(mKernels[ct]->mSlot, mIns[ct], mOuts[ct], mtls.fep.usr, mtls.fep.usrLen,
+                      NULL);
+    }
+}
+
+void CpuScriptGroupImpl::postLaunchKernels() {
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(mKernels[ct]->mScript);
+        si->postLaunch(mKernels[ct]->mSlot, mIns[ct], mOuts[ct], NULL, 0, NULL);
+    }
+}
+
+// Runs a group whose field links all go to kernels with a known halo in
+// bands of rows.  Returns false without launching anything if the group
+// can't be run in bands.
+bool CpuScriptGroupImpl::executeBands() {
+    // The band layout only changes with the halos, for example when the
+    // radius of a Blur is set.
+    bool valid = mBandValid;
+    for (size_t ct=0; ct < mFieldLinks.size(); ct++) {
+        const ScriptKernelID *k = mKernels[mFieldConsumers[ct]];
+        RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(k->mScript);
+        int halo = si->getFieldHalo(k->mSlot, mFieldLinks[ct]->mDstField->mSlot);
+        if (halo < 0) {
+            return false;
+        }
+        if (halo != mBandHalos[ct]) {
+            mBandHalos.editItemAt(ct) = halo;
+            valid = false;
+        }
+    }
+    if (!valid) {
+        mBandOk = planBands();
+        mBandValid = true;
+    }
+    if (!mBandOk) {
+        return false;
+    }
+    if (!getLinkScratch(mBandScratchBytes)) {
+        ALOGE("ScriptGroup out of memory for its link bands, launching kernels one at a time");
+        return false;
+    }
+
+    const size_t count = mKernels.size();
+    MTLaunchStruct mtls;
+    RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(mKernels[0]->mScript);
+    si->forEachMtlsSetup(mIns[0], mOuts[0], NULL, 0, NULL, &mtls);
+    setupKernels();
+
+    ScriptList sl;
+    sl.ins = mIns.array();
+    sl.inExts = mBandInExts.array();
+    sl.outs = mOuts.array();
+    sl.outExts = mOutExts.array();
+    sl.kernels = mKernels.array();
+    sl.count = count;
+    sl.sigs = mSigs.array();
+    sl.usrPtrs = mUsrPtrs.array();
+    sl.fnPtrs = mFnPtrs.array();
+    sl.inOffsets = mBandInOffsets.array();
+    sl.outOffsets = mLinkOffsets.array();
+    sl.scratch = mScratchPtrs.array();
+    sl.scratchWidth = mtls.xEnd - mtls.xStart;
+
+    BandList bl;
+    bl.sl = &sl;
+    bl.yStart = mtls.yStart;
+    bl.yEnd = mtls.yEnd;
+    bl.bandRows = mBandRows;
+    bl.margins = mMargins.array();
+    bl.inStrides = mBandInStrides.array();
+    bl.inMargins = mBandInMargins.array();
+    bl.outStrides = mLinkStrides.array();
+    bl.fieldCount = mFieldLinks.size();
+    bl.fieldScripts = mFieldScripts.array();
+    bl.fieldSlots = mFieldSlots.array();
+    bl.fieldOffsets = mFieldOffsets.array();
+    bl.fieldStrides = mFieldStrides.array();
+    bl.fieldMargins = mFieldMargins.array();
+
+    // Each launch row is one band.
+    const uint32_t rowCount = mtls.yEnd - mtls.yStart;
+    mtls.script = NULL;
+    mtls.kernel = (void (*)())&scriptGroupBandRoot;
+    mtls.fep.usr = &bl;
+    mtls.yStart = 0;
+    mtls.yEnd = (rowCount + mBandRows - 1) / mBandRows;
+    mCtx->launchThreads(mIns[0], mOuts[0], NULL, &mtls);
+
+    for (size_t ct=0; ct < mFieldLinks.size(); ct++) {
+        for (uint32_t ct2=0; ct2 < mCtx->getThreadCount(); ct2++) {
+            mFieldScripts[ct]->setFieldTile(ct2, mFieldSlots[ct], NULL, 0);
+        }
+    }
+    postLaunchKernels();
+    return true;
+}
+
+// Runs every kernel of the group over each chunk of a row in turn, the
+// links between them going through per-thread scratch.  Returns false
+// without launching anything if the scratch can't be allocated.
+bool CpuScriptGroupImpl::executeChunks() {
+    if (!getLinkScratch(mChunkScratchBytes)) {
+        ALOGE("ScriptGroup out of memory for its link chunks, launching kernels one at a time");
+        return false;
+    }
+
+    MTLaunchStruct mtls;
+    RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(mKernels[0]->mScript);
+    setupKernels();
+    si->forEachMtlsSetup(mIns[0], mOuts[0], NULL, 0, NULL, &mtls);
+
+    ScriptList sl;
+    sl.ins = mIns.array();
+    sl.inExts = mChunkInExts.array();
+    sl.outs = mOuts.array();
+    sl.outExts = mChunkOutExts.array();
+    sl.kernels = mKernels.array();
+    sl.count = mKernels.size();
+    sl.sigs = mSigs.array();
+    sl.usrPtrs = mUsrPtrs.array();
+    sl.fnPtrs = mFnPtrs.array();
+    sl.inOffsets = mChunkInOffsets.array();
+    sl.outOffsets = mChunkOutOffsets.array();
+    sl.scratch = mScratchPtrs.array();
+    sl.scratchWidth = mChunkWidth;
+
+    mtls.script = NULL;
+    mtls.kernel = (void (*)())&scriptGroupRoot;
+    mtls.fep.usr = &sl;
+
+    // Every kernel walks the rows of the launch, so large files bound to
+    // the group are streamed through in strips.
+    RsdCpuStripSet strips;
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        strips.add(mIns[ct], false);
+        strips.add(mOuts[ct], true);
+    }
+    const uint32_t rows = ((mtls.zEnd - mtls.zStart) > 1 || (mtls.arrayEnd - mtls.arrayStart) > 1) ?
+                          0 : strips.getStripRows(mtls.yStart, mtls.yEnd, mCtx->getThreadCount());
+    if (rows) {
+        mCtx->launchStrips(mIns[0], mOuts[0], NULL, &mtls, strips, rows);
     } else {
-        ScriptList sl;
-        sl.ins = ins.array();
-        sl.outs = outs.array();
-        sl.kernels = kernels.array();
-        sl.count = kernels.size();
-
-        Vector<const void *> usrPtrs;
-        Vector<const void *> fnPtrs;
-        Vector<uint32_t> sigs;
-        for (size_t ct=0; ct < kernels.size(); ct++) {
-            Script *s = kernels[ct]->mScript;
-            RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
-
-            si->forEachKernelSetup(kernels[ct]->mSlot, &mtls);
-            fnPtrs.add((void *)mtls.kernel);
-            usrPtrs.add(mtls.fep.usr);
-            sigs.add(mtls.fep.usrLen);
-            si->preLaunch(kernels[ct]->mSlot, ins[ct], outs[ct], mtls.fep.usr, mtls.fep.usrLen, NULL);
-        }
-        sl.sigs = sigs.array();
-        sl.usrPtrs = usrPtrs.array();
-        sl.fnPtrs = fnPtrs.array();
-        sl.inExts = inExts.array();
-        sl.outExts = outExts.array();
-
-        Script *s = kernels[0]->mScript;
+        mCtx->launchThreads(mIns[0], mOuts[0], NULL, &mtls);
+    }
+
+    postLaunchKernels();
+    return true;
+}
+
+// True if a and b are different allocations with overlapping memory.
+static bool sharesStorage(const Allocation *a, const Allocation *b) {
+    if (!a || !b || (a == b)) {
+        return false;
+    }
+    const uint8_t *pa = (const uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
+    const uint8_t *pb = (const uint8_t *)b->mHal.drvState.lod[0].mallocPtr;
+    return (pa < pb + b->getType()->getPackedSizeBytes()) &&
+           (pb < pa + a->getType()->getPackedSizeBytes());
+}
+
+// Runs the kernels one launch each, in order.  Launches that can be left
+// running are made asynchronous, so a kernel that doesn't depend on the
+// ones before it starts while they finish and independent branches of the
+// group overlap.  The launcher orders launches sharing a script or an
+// input or output; reads through fields are waited for here.
+void CpuScriptGroupImpl::executeKernels() {
+    const bool sync = mCtx->getContext()->isSynchronous();
+
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        Script *s = mKernels[ct]->mScript;
+        RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
+        uint32_t slot = mKernels[ct]->mSlot;
+
+        // preLaunch may change state a running launch of the same script
+        // uses, so those are waited for too.
+        // Links sharing storage are different allocations to the launcher,
+        // so writing one also waits for the launches using the others.
+        for (size_t ct2=0; ct2 < ct; ct2++) {
+            bool dep = (mKernels[ct2]->mScript == s) ||
+                       sharesStorage(mOuts[ct], mOuts[ct2]) ||
+                       sharesStorage(mOuts[ct], mIns[ct2]);
+            for (size_t ct3=0; ct3 < mFieldInputs.size(); ct3++) {
+                const ScriptGroup::Link *l = mFieldInputs[ct3];
+                dep |= (l->mDstField->mScript == s) && (l->mAlloc.get() == mOuts[ct2]);
+                dep |= (l->mDstField->mScript == mKernels[ct2]->mScript) &&
+                       sharesStorage(mOuts[ct], l->mAlloc.get());
+            }
+            if (dep) {
+                mCtx->waitForFence(mFences[ct2]);
+            }
+        }
+
+        MTLaunchStruct mtls;
+        si->forEachMtlsSetup(mIns[ct], mOuts[ct], NULL, 0, NULL, &mtls);
+        si->forEachKernelSetup(slot, &mtls);
+        si->preLaunch(slot, mIns[ct], mOuts[ct], mtls.fep.usr, mtls.fep.usrLen, NULL);
+        mtls.mAsync = !sync && (si->canLaunchAsync() || !si->writesObjects());
+        mFences.editItemAt(ct) = mCtx->launchThreads(mIns[ct], mOuts[ct], NULL, &mtls);
+        mAsyncs.editItemAt(ct) = mtls.mAsync;
+        if (!mtls.mAsync) {
+            si->postLaunch(slot, mIns[ct], mOuts[ct], NULL, 0, NULL);
+        }
+    }
+
+    // The group as a whole still completes before execute returns.
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        mCtx->waitForFence(mFences[ct]);
+    }
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        Script *s = mKernels[ct]->mScript;
         RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
-        si->forEachMtlsSetup(ins[0], outs[0], NULL, 0, NULL, &mtls);
-        mtls.script = NULL;
-        mtls.kernel = (void (*)())&scriptGroupRoot;
-        mtls.fep.usr = &sl;
-        mCtx->launchThreads(ins[0], outs[0], NULL, &mtls);
+        if (mAsyncs[ct]) {
+            si->postLaunch(mKernels[ct]->mSlot, mIns[ct], mOuts[ct], NULL, 0, NULL);
+        }
+    }
+}
+
+static Allocation * frameAlloc(const ScriptGroup::Link *l, uint32_t parity) {
+    return (parity && l->mPipeAlloc.get()) ? l->mPipeAlloc.get() : l->mAlloc.get();
+}
 
-        for (size_t ct=0; ct < kernels.size(); ct++) {
-            Script *s = kernels[ct]->mScript;
-            RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
-            si->postLaunch(kernels[ct]->mSlot, ins[ct], outs[ct], NULL, 0, NULL);
+// Waits for the frame of the given parity and lets go of what it used.
+void CpuScriptGroupImpl::finishFrame(uint32_t parity) {
+    if (!mFramePending[parity]) {
+        return;
+    }
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        mCtx->waitForFence(mFrameFences[parity][ct]);
+        mFrameFences[parity].editItemAt(ct) = 0;
+    }
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        if (mFrameAsyncs[parity][ct]) {
+            RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(mKernels[ct]->mScript);
+            si->postLaunch(mKernels[ct]->mSlot, mFrameIns[parity][ct], mFrameOuts[parity][ct],
+                           NULL, 0, NULL);
+            mFrameAsyncs[parity].editItemAt(ct) = false;
         }
     }
+    mFrameRefs[parity].clear();
+    mFramePending[parity] = false;
 }
 
+void CpuScriptGroupImpl::finishPipeline() {
+    // The older frame first.
+    finishFrame(mPipeFrame & 1);
+    finishFrame((mPipeFrame + 1) & 1);
+    if (mFieldsBound) {
+        for (size_t ct=0; ct < mFieldInputs.size(); ct++) {
+            const ScriptGroup::Link *l = mFieldInputs[ct];
+            l->mDstField->mScript->setVarObj(l->mDstField->mSlot, NULL);
+        }
+        mFieldsBound = false;
+    }
+}
+
+// Queues one frame of a pipelined group, one launch per kernel as in
+// executeKernels, without waiting for it.  The launcher starts a kernel as
+// soon as the launches of the previous frame it conflicts with are done,
+// so stage k of this frame runs alongside stage k + 1 of the last one.
+// Fields are bound to the frame's links right before their reader runs.
+void CpuScriptGroupImpl::executePipelined() {
+    const uint32_t p = mPipeFrame++ & 1;
+    finishFrame(p);
+
+    const bool sync = mCtx->getContext()->isSynchronous();
+    const Vector<Allocation *> &ins = mFrameIns[p];
+    const Vector<Allocation *> &outs = mFrameOuts[p];
+    Vector<int> &fences = mFrameFences[p];
+    const Vector<int> &prevFences = mFrameFences[p ^ 1];
+
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        Script *s = mKernels[ct]->mScript;
+        RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
+        uint32_t slot = mKernels[ct]->mSlot;
+
+        for (size_t ct2=0; ct2 < ct; ct2++) {
+            bool dep = (mKernels[ct2]->mScript == s) ||
+                       sharesStorage(outs[ct], outs[ct2]) ||
+                       sharesStorage(outs[ct], ins[ct2]);
+            for (size_t ct3=0; ct3 < mFieldInputs.size(); ct3++) {
+                const ScriptGroup::Link *l = mFieldInputs[ct3];
+                dep |= (l->mDstField->mScript == s) && (frameAlloc(l, p) == outs[ct2]);
+                dep |= (l->mDstField->mScript == mKernels[ct2]->mScript) &&
+                       sharesStorage(outs[ct], frameAlloc(l, p));
+            }
+            if (dep) {
+                mCtx->waitForFence(fences[ct2]);
+            }
+        }
 
+        bool waited = false;
+        for (size_t ct2=0; ct2 < mFieldInputs.size(); ct2++) {
+            const ScriptGroup::Link *l = mFieldInputs[ct2];
+            if (l->mDstField->mScript != s) {
+                continue;
+            }
+            if (!waited) {
+                for (size_t ct3=0; ct3 < mKernels.size(); ct3++) {
+                    if (mKernels[ct3]->mScript == s) {
+                        mCtx->waitForFence(prevFences[ct3]);
+                    }
+                }
+                // A launch from outside the group may still read the field.
+                if (mCtx->hasPendingLaunch(si)) {
+                    mCtx->finishLaunches();
+                }
+                waited = true;
+            }
+            s->setVarObj(l->mDstField->mSlot, frameAlloc(l, p));
+            mFieldsBound = true;
+        }
+
+        if (mInExts[ct] && ins[ct]) {
+            mFrameRefs[p].add(ObjectBaseRef<Allocation>(ins[ct]));
+        }
+        if (mOutExts[ct] && outs[ct]) {
+            mFrameRefs[p].add(ObjectBaseRef<Allocation>(outs[ct]));
+        }
+
+        MTLaunchStruct mtls;
+        si->forEachMtlsSetup(ins[ct], outs[ct], NULL, 0, NULL, &mtls);
+        si->forEachKernelSetup(slot, &mtls);
+        si->preLaunch(slot, ins[ct], outs[ct], mtls.fep.usr, mtls.fep.usrLen, NULL);
+        mtls.mAsync = !sync && (si->canLaunchAsync() || !si->writesObjects());
+        fences.editItemAt(ct) = mCtx->launchThreads(ins[ct], outs[ct], NULL, &mtls);
+        mFrameAsyncs[p].editItemAt(ct) = mtls.mAsync;
+        if (!mtls.mAsync) {
+            si->postLaunch(slot, ins[ct], outs[ct], NULL, 0, NULL);
+        }
+    }
+    mFramePending[p] = true;
+}
+
+void CpuScriptGroupImpl::execute() {
+    ATRACE_CALL();
+    if (!mPlanValid) {
+        finishPipeline();
+        buildPlan();
+        mPlanValid = true;
+    }
+    if (!mKernels.size()) {
+        return;
+    }
+    if (mSG->isPipelined()) {
+        executePipelined();
+        return;
+    }
+
+    // Only pipelined frames overlap the launches queued before them, which
+    // may read the fields bound below.
+    mCtx->finishLaunches();
+
+    for (size_t ct=0; ct < mFieldInputs.size(); ct++) {
+        const ScriptGroup::Link *l = mFieldInputs[ct];
+        l->mDstField->mScript->setVarObj(l->mDstField->mSlot, l->mAlloc.get());
+    }
+
+    // Disable the ScriptGroup optimization if we have global RS objects
+    // that might interfere between kernels.
+    bool fieldDep = mPlanFieldDep;
+    for (size_t ct=0; ct < mKernels.size(); ct++) {
+        Script *s = mKernels[ct]->mScript;
+        if (s->hasObjectSlots() && ((RsdCpuScriptImpl *)mCtx->lookupScript(s))->writesObjects()) {
+            fieldDep = true;
+        }
+    }
+
+    bool fused = false;
+    if (!fieldDep) {
+        fused = mFieldLinks.size() ? executeBands() : executeChunks();
+    }
+    if (!fused) {
+        executeKernels();
+    }
+
+    // Link allocations share storage owned by the group, so scripts
+    // mustn't keep them bound once it is done.
+    for (size_t ct=0; ct < mFieldInputs.size(); ct++) {
+        const ScriptGroup::Link *l = mFieldInputs[ct];
+        l->mDstField->mScript->setVarObj(l->mDstField->mSlot, NULL);
+    }
+}
@@ -18,16 +18,20 @@
 #define RSD_SCRIPT_GROUP_H
 
 #include "rsd_cpu.h"
+#include "rsCpuCore.h"
+#include "rsScriptGroup.h"
 
 namespace android {
 namespace renderscript {
 
+class RsdCpuScriptImpl;
 
 class CpuScriptGroupImpl : public RsdCpuReference::CpuScriptGroup {
 public:
     virtual void setInput(const ScriptKernelID *kid, Allocation *);
     virtual void setOutput(const ScriptKernelID *kid, Allocation *);
     virtual void execute();
+    virtual void setPipelined(bool pipelined);
     virtual ~CpuScriptGroupImpl();
 
     CpuScriptGroupImpl(RsdCpuReferenceImpl *ctx, const ScriptGroup *sg);
@@ -36,6 +40,9 @@ public:
     static void scriptGroupRoot(const RsForEachStubParamStruct *p,
                                 uint32_t xstart, uint32_t xend,
                                 uint32_t instep, uint32_t outstep);
+    static void scriptGroupBandRoot(const RsForEachStubParamStruct *p,
+                                    uint32_t xstart, uint32_t xend,
+                                    uint32_t instep, uint32_t outstep);
 
 protected:
     struct ScriptList {
@@ -50,10 +57,137 @@ protected:
         const void *const* fnPtrs;
 
         const ScriptKernelID *const* kernels;
+
+        // Links between kernels of the group go through per-thread scratch
+        // rows instead of their allocations.  Each row is run in chunks of
+        // scratchWidth cells, and a link's cells for the chunk are at its
+        // offset into scratch[lid].
+        size_t const *inOffsets;
+        size_t const *outOffsets;
+        void *const *scratch;
+        uint32_t scratchWidth;
+    };
+
+    // Scratch for all the links of one chunk is kept within this many
+    // bytes so it stays in the L1 cache.
+    static const size_t kScratchBytes = 16 * 1024;
+
+    // Groups with field links to neighbourhood kernels run a band of rows
+    // per launch row instead.  Every link is kept in scratch for the band
+    // plus the margin of rows its consumers read around it, and bands
+    // recompute the margin rows they share.  inOffsets and outOffsets of
+    // the ScriptList are then offsets of those band buffers.
+    struct BandList {
+        const ScriptList *sl;
+        uint32_t yStart;
+        uint32_t yEnd;
+        uint32_t bandRows;
+
+        // Per kernel: rows computed on either side of the band, and the
+        // row stride and margin of the link buffers it reads and writes.
+        int const *margins;
+        size_t const *inStrides;
+        int const *inMargins;
+        size_t const *outStrides;
+
+        // Field links, each read through setFieldTile by its consumer.
+        size_t fieldCount;
+        RsdCpuScriptImpl *const *fieldScripts;
+        uint32_t const *fieldSlots;
+        size_t const *fieldOffsets;
+        size_t const *fieldStrides;
+        int const *fieldMargins;
     };
-    ScriptList mSl;
+
+    // Scratch for the band buffers of one thread is kept within this many
+    // bytes so it stays in the L2 cache.
+    static const size_t kBandBytes = 256 * 1024;
+
     const ScriptGroup *mSG;
     RsdCpuReferenceImpl *mCtx;
+    RsdCpuScratch mScratch;
+
+    // The kernels of the group and where their inputs and outputs go.
+    // Built on the first execute after an input or output of the group is
+    // set, so repeated executes neither rescan the nodes nor allocate.
+    bool mPlanValid;
+    bool mPlanFieldDep;
+    Vector<Allocation *> mIns;
+    Vector<bool> mInExts;
+    Vector<Allocation *> mOuts;
+    Vector<bool> mOutExts;
+    Vector<const ScriptKernelID *> mKernels;
+    Vector<const ScriptGroup::Link *> mFieldInputs;
+
+    // Per launch state, refreshed in place on each execute.
+    Vector<const void *> mUsrPtrs;
+    Vector<const void *> mFnPtrs;
+    Vector<uint32_t> mSigs;
+    Vector<int> mFences;
+    Vector<bool> mAsyncs;
+    Vector<void *> mScratchPtrs;
+
+    // Fused row chunk layout.
+    Vector<bool> mChunkInExts;
+    Vector<bool> mChunkOutExts;
+    Vector<size_t> mChunkInOffsets;
+    Vector<size_t> mChunkOutOffsets;
+    uint32_t mChunkWidth;
+    size_t mChunkScratchBytes;
+
+    // Field links between kernels of the group, with the producer and
+    // consumer kernel of each.
+    Vector<const ScriptGroup::Link *> mFieldLinks;
+    Vector<size_t> mFieldProducers;
+    Vector<size_t> mFieldConsumers;
+
+    // Band layout, valid for the halos it was planned with.
+    bool mBandValid;
+    bool mBandOk;
+    Vector<int> mBandHalos;
+    Vector<int> mMargins;
+    Vector<bool> mBandInExts;
+    Vector<size_t> mLinkOffsets;
+    Vector<size_t> mLinkStrides;
+    Vector<size_t> mBandInOffsets;
+    Vector<size_t> mBandInStrides;
+    Vector<int> mBandInMargins;
+    Vector<RsdCpuScriptImpl *> mFieldScripts;
+    Vector<uint32_t> mFieldSlots;
+    Vector<size_t> mFieldOffsets;
+    Vector<size_t> mFieldStrides;
+    Vector<int> mFieldMargins;
+    uint32_t mBandRows;
+    size_t mBandScratchBytes;
+
+    // Frames of a pipelined group alternate between the two allocations of
+    // each link, frame parity p launching on mFrameIns[p] and
+    // mFrameOuts[p].  A frame only has to wait for the one before last,
+    // which used the same links, and keeps the group inputs and outputs it
+    // launched on alive until it is done.
+    uint32_t mPipeFrame;
+    bool mFramePending[2];
+    bool mFieldsBound;
+    Vector<Allocation *> mFrameIns[2];
+    Vector<Allocation *> mFrameOuts[2];
+    Vector<int> mFrameFences[2];
+    Vector<bool> mFrameAsyncs[2];
+    Vector<ObjectBaseRef<Allocation> > mFrameRefs[2];
+
+    bool getLinkScratch(size_t bytes);
+    void buildPlan();
+    void planFrames();
+    bool patchFrames(const ScriptKernelID *kid, Allocation *a, bool input);
+    void planChunks();
+    bool planBands();
+    void setupKernels();
+    void postLaunchKernels();
+    bool executeBands();
+    bool executeChunks();
+    void executeKernels();
+    void finishFrame(uint32_t parity);
+    void finishPipeline();
+    void executePipelined();
 };
 
 }
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsCpuCore.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace {
+
+// Chunks shorter than this aren't worth a thread.
+const uint32_t kMinChunkCells = 16 * 1024;
+const uint32_t kMaxChunks = 64;
+
+const uint32_t kDigitBits = 8;
+const uint32_t kDigits = 1 << kDigitBits;
+
+// The work of a stage is cut into chunks the threads claim until none are
+// left, so it makes no difference how many of them the pool runs it on.
+struct ChunkedJob {
+    uint32_t count;
+    uint32_t chunks;
+    volatile int32_t next;
+    void (*stage)(ChunkedJob *job, uint32_t chunk);
+
+    uint32_t chunkStart(uint32_t c) const {
+        return (uint32_t)(((uint64_t)count * c) / chunks);
+    }
+};
+
+void RunChunks(void *usr, uint32_t idx) {
+    ChunkedJob *job = (ChunkedJob *)usr;
+    int32_t c;
+    while ((c = __sync_fetch_and_add(&job->next, 1)) < (int32_t)job->chunks) {
+        job->stage(job, c);
+    }
+}
+
+void RunStage(RsdCpuReferenceImpl *ctx, ChunkedJob *job,
+              void (*stage)(ChunkedJob *job, uint32_t chunk)) {
+    job->stage = stage;
+    job->next = 0;
+    if (job->chunks > 1) {
+        ctx->launchThreads(RunChunks, job);
+    } else {
+        RunChunks(job, 0);
+    }
+}
+
+uint32_t ChunkCount(RsdCpuReferenceImpl *ctx, uint32_t count) {
+    // A few per thread, as the chunks of a pass cost the same but threads
+    // don't all start at once.
+    return rsMin(rsMin(kMaxChunks, ctx->getThreadCount() * 4),
+                 rsMax(count / kMinChunkCells, 1u));
+}
+
+
+// An LSD radix sort of the keys, as unsigned integers ordered the same way:
+// signed ones with the sign bit flipped, floats with every bit flipped when
+// negative and the sign bit set otherwise.  Each pass counts the digits of
+// every chunk, and chunk c writes digit d after all smaller digits and the
+// digit d keys of the chunks before it, which keeps the sort stable.
+enum KeyKind {
+    KEY_UNSIGNED,
+    KEY_SIGNED,
+    KEY_FLOAT
+};
+
+template <typename K>
+struct SortJob : public ChunkedJob {
+    KeyKind kind;
+    // buf[0] is the keys themselves.
+    K *buf[2];
+    // The original position of each key in buf, without values NULL.
+    uint32_t *idx[2];
+    uint32_t cur;
+    uint32_t shift;
+    uint32_t (*hist)[kDigits];
+
+    uint8_t *values;
+    uint8_t *valueTmp;
+    size_t valueSize;
+};
+
+template <typename K>
+inline K EncodeKey(K k, KeyKind kind) {
+    const K sign = (K)1 << (sizeof(K) * 8 - 1);
+    if (kind == KEY_FLOAT) {
+        return (k & sign) ? ~k : (k | sign);
+    }
+    return (kind == KEY_SIGNED) ? (k ^ sign) : k;
+}
+
+template <typename K>
+inline K DecodeKey(K k, KeyKind kind) {
+    const K sign = (K)1 << (sizeof(K) * 8 - 1);
+    if (kind == KEY_FLOAT) {
+        return (k & sign) ? (k & ~sign) : ~k;
+    }
+    return (kind == KEY_SIGNED) ? (k ^ sign) : k;
+}
+
+// Encodes the keys in place and counts their lowest digits.
+template <typename K>
+void SortLoad(ChunkedJob *j, uint32_t c) {
+    SortJob<K> *job = (SortJob<K> *)j;
+    const uint32_t x1 = job->chunkStart(c);
+    const uint32_t x2 = job->chunkStart(c + 1);
+    uint32_t *h = job->hist[c];
+    memset(h, 0, kDigits * sizeof(uint32_t));
+    K *k = job->buf[0];
+    for (uint32_t x = x1; x < x2; x++) {
+        K e = EncodeKey(k[x], job->kind);
+        k[x] = e;
+        h[e & (kDigits - 1)]++;
+    }
+    if (job->idx[0]) {
+        for (uint32_t x = x1; x < x2; x++) {
+            job->idx[0][x] = x;
+        }
+    }
+}
+
+template <typename K>
+void SortCount(ChunkedJob *j, uint32_t c) {
+    SortJob<K> *job = (SortJob<K> *)j;
+    const uint32_t x2 = job->chunkStart(c + 1);
+    uint32_t *h = job->hist[c];
+    memset(h, 0, kDigits * sizeof(uint32_t));
+    const K *k = job->buf[job->cur];
+    for (uint32_t x = job->chunkStart(c); x < x2; x++) {
+        h[(k[x] >> job->shift) & (kDigits - 1)]++;
+    }
+}
+
+// Moves each key of the chunk to the next place of its digit, kept in the
+// chunk's histogram.
+template <typename K>
+void SortScatter(ChunkedJob *j, uint32_t c) {
+    SortJob<K> *job = (SortJob<K> *)j;
+    const uint32_t x2 = job->chunkStart(c + 1);
+    uint32_t *h = job->hist[c];
+    const K *src = job->buf[job->cur];
+    K *dst = job->buf[job->cur ^ 1];
+    const uint32_t shift = job->shift;
+    if (job->idx[0]) {
+        const uint32_t *isrc = job->idx[job->cur];
+        uint32_t *idst = job->idx[job->cur ^ 1];
+        for (uint32_t x = job->chunkStart(c); x < x2; x++) {
+            uint32_t o = h[(src[x] >> shift) & (kDigits - 1)]++;
+            dst[o] = src[x];
+            idst[o] = isrc[x];
+        }
+    } else {
+        for (uint32_t x = job->chunkStart(c); x < x2; x++) {
+            dst[h[(src[x] >> shift) & (kDigits - 1)]++] = src[x];
+        }
+    }
+}
+
+// Decodes the sorted keys back into place and gathers the values after
+// them into valueTmp.
+template <typename K>
+void SortStore(ChunkedJob *j, uint32_t c) {
+    SortJob<K> *job = (SortJob<K> *)j;
+    const uint32_t x1 = job->chunkStart(c);
+    const uint32_t x2 = job->chunkStart(c + 1);
+    const K *src = job->buf[job->cur];
+    K *dst = job->buf[0];
+    for (uint32_t x = x1; x < x2; x++) {
+        dst[x] = DecodeKey(src[x], job->kind);
+    }
+    if (job->values) {
+        const size_t vs = job->valueSize;
+        const uint32_t *idx = job->idx[job->cur];
+        for (uint32_t x = x1; x < x2; x++) {
+            memcpy(job->valueTmp + x * vs, job->values + idx[x] * vs, vs);
+        }
+    }
+}
+
+template <typename K>
+void SortCopyValues(ChunkedJob *j, uint32_t c) {
+    SortJob<K> *job = (SortJob<K> *)j;
+    const uint32_t x1 = job->chunkStart(c);
+    const size_t vs = job->valueSize;
+    memcpy(job->values + x1 * vs, job->valueTmp + x1 * vs, (job->chunkStart(c + 1) - x1) * vs);
+}
+
+template <typename K>
+bool RadixSort(RsdCpuReferenceImpl *ctx, SortJob<K> *job) {
+    const size_t n = job->count;
+    job->hist = (uint32_t (*)[kDigits])malloc(job->chunks * kDigits * sizeof(uint32_t));
+    job->buf[1] = (K *)malloc(n * sizeof(K));
+    job->idx[0] = NULL;
+    job->idx[1] = NULL;
+    job->valueTmp = NULL;
+    bool ok = job->hist && job->buf[1];
+    if (ok && job->values) {
+        job->idx[0] = (uint32_t *)malloc(n * sizeof(uint32_t));
+        job->idx[1] = (uint32_t *)malloc(n * sizeof(uint32_t));
+        job->valueTmp = (uint8_t *)malloc(n * job->valueSize);
+        ok = job->idx[0] && job->idx[1] && job->valueTmp;
+    }
+
+    if (ok) {
+        job->cur = 0;
+        RunStage(ctx, job, &SortLoad<K>);
+        for (job->shift = 0; job->shift < sizeof(K) * 8; job->shift += kDigitBits) {
+            if (job->shift) {
+                RunStage(ctx, job, &SortCount<K>);
+            }
+            // The offsets of each digit, then chunk.  A pass where every
+            // key has the same digit would leave them where they are.
+            uint32_t offset = 0;
+            bool skip = false;
+            for (uint32_t d = 0; d < kDigits; d++) {
+                for (uint32_t c = 0; c < job->chunks; c++) {
+                    uint32_t t = job->hist[c][d];
+                    job->hist[c][d] = offset;
+                    offset += t;
+                    skip |= (t == n);
+                }
+            }
+            if (!skip) {
+                RunStage(ctx, job, &SortScatter<K>);
+                job->cur ^= 1;
+            }
+        }
+        RunStage(ctx, job, &SortStore<K>);
+        if (job->values) {
+            RunStage(ctx, job, &SortCopyValues<K>);
+        }
+    }
+
+    free(job->hist);
+    free(job->buf[1]);
+    free(job->idx[0]);
+    free(job->idx[1]);
+    free(job->valueTmp);
+    return ok;
+}
+
+
+// Compaction counts the flagged cells of each chunk, which gives the chunks
+// their first output cell, and then copies them there.
+struct CompactJob : public ChunkedJob {
+    const uint8_t *src;
+    const uint8_t *flags;
+    uint8_t *dst;
+    size_t cellSize;
+    size_t flagSize;
+    uint32_t room;
+    uint32_t offsets[kMaxChunks + 1];
+};
+
+inline bool FlagSet(const CompactJob *job, uint32_t x) {
+    switch (job->flagSize) {
+    case 1: return job->flags[x] != 0;
+    case 2: return ((const uint16_t *)job->flags)[x] != 0;
+    default: return ((const uint32_t *)job->flags)[x] != 0;
+    }
+}
+
+void CompactCount(ChunkedJob *j, uint32_t c) {
+    CompactJob *job = (CompactJob *)j;
+    const uint32_t x2 = job->chunkStart(c + 1);
+    uint32_t n = 0;
+    for (uint32_t x = job->chunkStart(c); x < x2; x++) {
+        n += FlagSet(job, x);
+    }
+    job->offsets[c + 1] = n;
+}
+
+// Copies runs of flagged cells at once.  memmove, as a single chunk may
+// compact in place.
+void CompactCopy(ChunkedJob *j, uint32_t c) {
+    CompactJob *job = (CompactJob *)j;
+    const uint32_t x2 = job->chunkStart(c + 1);
+    const size_t cs = job->cellSize;
+    uint32_t o = job->offsets[c];
+    uint32_t x = job->chunkStart(c);
+    while ((x < x2) && (o < job->room)) {
+        if (!FlagSet(job, x)) {
+            x++;
+            continue;
+        }
+        uint32_t end = x + 1;
+        while ((end < x2) && FlagSet(job, end)) {
+            end++;
+        }
+        uint32_t len = rsMin(end - x, job->room - o);
+        memmove(job->dst + o * cs, job->src + x * cs, len * cs);
+        o += len;
+        x = end;
+    }
+    if (job->chunks == 1) {
+        job->offsets[1] = o;
+    }
+}
+
+}
+
+
+bool RsdCpuReferenceImpl::sort(const Allocation *keys, const Allocation *values) {
+    const uint32_t count = keys->mHal.drvState.lod[0].dimX;
+    if (count < 2) {
+        return true;
+    }
+
+    KeyKind kind = KEY_UNSIGNED;
+    switch (keys->mHal.state.type->getElement()->getType()) {
+    case RS_TYPE_FLOAT_32:
+    case RS_TYPE_FLOAT_64:
+        kind = KEY_FLOAT;
+        break;
+    case RS_TYPE_SIGNED_32:
+    case RS_TYPE_SIGNED_64:
+        kind = KEY_SIGNED;
+        break;
+    default:
+        break;
+    }
+    uint8_t *v = values ? (uint8_t *)values->mHal.drvState.lod[0].mallocPtr : NULL;
+    const size_t vs = values ? values->mHal.state.elementSizeBytes : 0;
+
+    if (keys->mHal.state.elementSizeBytes == sizeof(uint64_t)) {
+        SortJob<uint64_t> job;
+        job.count = count;
+        job.chunks = ChunkCount(this, count);
+        job.kind = kind;
+        job.buf[0] = (uint64_t *)keys->mHal.drvState.lod[0].mallocPtr;
+        job.values = v;
+        job.valueSize = vs;
+        return RadixSort(this, &job);
+    }
+    SortJob<uint32_t> job;
+    job.count = count;
+    job.chunks = ChunkCount(this, count);
+    job.kind = kind;
+    job.buf[0] = (uint32_t *)keys->mHal.drvState.lod[0].mallocPtr;
+    job.values = v;
+    job.valueSize = vs;
+    return RadixSort(this, &job);
+}
+
+uint32_t RsdCpuReferenceImpl::compact(const Allocation *dst, const Allocation *src,
+                                      const Allocation *flags) {
+    CompactJob job;
+    job.count = src->mHal.drvState.lod[0].dimX;
+    job.src = (const uint8_t *)src->mHal.drvState.lod[0].mallocPtr;
+    job.flags = (const uint8_t *)flags->mHal.drvState.lod[0].mallocPtr;
+    job.dst = (uint8_t *)dst->mHal.drvState.lod[0].mallocPtr;
+    job.cellSize = src->mHal.state.elementSizeBytes;
+    job.flagSize = flags->mHal.state.elementSizeBytes;
+    job.room = dst->mHal.drvState.lod[0].dimX;
+    if (!job.count || !job.room) {
+        return 0;
+    }
+
+    // Chunks copying in parallel could overwrite the cells of the next.
+    bool overlap = (job.dst < job.src + job.count * job.cellSize) &&
+                   (job.src < job.dst + job.room * job.cellSize);
+    job.chunks = overlap ? 1 : ChunkCount(this, job.count);
+    job.offsets[0] = 0;
+    if (job.chunks > 1) {
+        RunStage(this, &job, &CompactCount);
+        for (uint32_t c = 1; c <= job.chunks; c++) {
+            job.offsets[c] += job.offsets[c - 1];
+        }
+    }
+    RunStage(this, &job, &CompactCopy);
+    return rsMin(job.offsets[job.chunks], job.room);
+}
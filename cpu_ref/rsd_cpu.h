@@ -68,6 +68,13 @@ public:
     public:
         virtual void populateScript(Script *) = 0;
         virtual void invokeFunction(uint32_t slot, const void *params, size_t paramLength) = 0;
+        // Invokes slot once per block of paramLength bytes of params.
+        virtual void invokeFunctionBatch(uint32_t slot, const void *params, size_t paramLength,
+                                         uint32_t count) {
+            for (uint32_t ct = 0; ct < count; ct++) {
+                invokeFunction(slot, (const uint8_t *)params + ct * paramLength, paramLength);
+            }
+        }
         virtual int invokeRoot() = 0;
         virtual void invokeForEach(uint32_t slot,
                            const Allocation * ain,
@@ -75,6 +82,16 @@ public:
                            const void * usr,
                            uint32_t usrLen,
                            const RsScriptCall *sc) = 0;
+        virtual void invokeForEachMulti(uint32_t slot,
+                                        const Allocation ** ains,
+                                        size_t inLen,
+                                        Allocation * aout,
+                                        const void * usr,
+                                        uint32_t usrLen,
+                                        const RsScriptCall *sc) = 0;
+        virtual void invokeReduce(uint32_t accumSlot, uint32_t combineSlot,
+                                  int32_t finalizeSlot, const Allocation * ain,
+                                  Allocation * aout, const RsScriptCall *sc) = 0;
         virtual void invokeInit() = 0;
         virtual void invokeFreeChildren() = 0;
 
@@ -84,6 +101,12 @@ public:
                                       const Element *e, const size_t *dims, size_t dimLength) = 0;
         virtual void setGlobalBind(uint32_t slot, Allocation *data) = 0;
         virtual void setGlobalObj(uint32_t slot, ObjectBase *obj) = 0;
+        virtual void setGlobalVars(const void *records, size_t sizeBytes, uint32_t count) = 0;
+        // Hold back updates to globals an asynchronous launch of the script
+        // may still be reading, to be applied once it completes.  False
+        // when they can be set now.
+        virtual bool stageGlobalVar(uint32_t slot, const void *data, size_t dataLength) = 0;
+        virtual bool stageGlobalVars(const void *records, size_t sizeBytes, uint32_t count) = 0;
 
         virtual Allocation * getAllocationForPointer(const void *ptr) const = 0;
         virtual ~CpuScript() {}
@@ -99,6 +122,8 @@ public:
         virtual void setInput(const ScriptKernelID *kid, Allocation *) = 0;
         virtual void setOutput(const ScriptKernelID *kid, Allocation *) = 0;
         virtual void execute() = 0;
+        // Waits for any frame still running; the links change next.
+        virtual void setPipelined(bool pipelined) = 0;
         virtual ~CpuScriptGroup() {};
     };
 
@@ -106,6 +131,12 @@ public:
     static const Script * getTlsScript();
     static pthread_key_t getThreadTLSKey();
 
+    // Sorts a symbol table ending in a NULL entry by name, for findSymbol,
+    // and returns the number of symbols in it.
+    static size_t sortSymbols(CpuSymbol *syms);
+    static const CpuSymbol * findSymbol(const CpuSymbol *syms, size_t count,
+                                        const char *name);
+
     static RsdCpuReference * create(Context *c, uint32_t version_major,
                                     uint32_t version_minor, sym_lookup_t lfn, script_lookup_t slfn
 #ifndef RS_COMPATIBILITY_LIB
@@ -122,6 +153,29 @@ public:
     virtual CpuScript * createIntrinsic(const Script *s, RsScriptIntrinsicID iid, Element *e) = 0;
     virtual CpuScriptGroup * createScriptGroup(const ScriptGroup *sg) = 0;
     virtual bool getInForEach() = 0;
+    // Runs cbk(data, idx) on the calling thread and the pool workers, idx
+    // being unique to each, and waits for them all to return.  cbk has to
+    // share out the work itself: when called from a kernel or without
+    // workers only the calling thread runs it.
+    virtual void launchThreads(void (*cbk)(void *usr, uint32_t idx), void *data) = 0;
+    virtual uint32_t getThreadCount() const = 0;
+    // Wait for any kernel launches that are still running asynchronously.
+    virtual void finishLaunches() = 0;
+    // Copies up to count entries of launch statistics and returns how many
+    // there are.
+    virtual uint32_t getProfile(RsKernelProfile *profiles, uint32_t count) const = 0;
+    // Frees code and buffers kept around for reuse, returning the bytes.
+    virtual size_t trimMemory() = 0;
+    // Called while the context is idle.  Returns the ms until it should be
+    // called again, or -1 to wait for more commands.
+    virtual int32_t idle() = 0;
+    // Stably sorts the 1D scalar keys on the worker pool, moving values,
+    // if not NULL, along with them.  False if out of memory.
+    virtual bool sort(const Allocation *keys, const Allocation *values) = 0;
+    // Copies the src cells with nonzero flags to the start of dst, as far
+    // as it has room, and returns the number copied.
+    virtual uint32_t compact(const Allocation *dst, const Allocation *src,
+                             const Allocation *flags) = 0;
 
 #ifndef RS_COMPATIBILITY_LIB
     virtual void setSetupCompilerCallback(
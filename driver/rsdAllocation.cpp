@@ -23,12 +23,16 @@
 #include "system/window.h"
 #include "ui/Rect.h"
 #include "ui/GraphicBufferMapper.h"
+#include "ui/GraphicBuffer.h"
+#include "ui/Fence.h"
 #endif
 
 #ifdef RS_COMPATIBILITY_LIB
 #include "rsCompatibilityLib.h"
 #else
 #include "rsdFrameBufferObj.h"
+#include "rsdFrameBuffer.h"
+#include "rsdGLWorker.h"
 #include "gui/GLConsumer.h"
 #include "gui/CpuConsumer.h"
 #include "gui/Surface.h"
@@ -44,6 +48,21 @@
 #include <malloc.h>
 #endif
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef RS_SERVER
+#include <cutils/ashmem.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 using namespace android;
 using namespace android::renderscript;
 
@@ -75,6 +94,10 @@ GLenum rsdTypeToGLType(RsDataType t) {
     return 0;
 }
 
+#define RSD_GL_ETC1_RGB8_OES 0x8D64
+#define RSD_GL_COMPRESSED_RGB8_ETC2 0x9274
+#define RSD_GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+
 GLenum rsdKindToGLFormat(RsDataKind k) {
     switch (k) {
     case RS_KIND_PIXEL_L: return GL_LUMINANCE;
@@ -83,16 +106,42 @@ GLenum rsdKindToGLFormat(RsDataKind k) {
     case RS_KIND_PIXEL_RGB: return GL_RGB;
     case RS_KIND_PIXEL_RGBA: return GL_RGBA;
     case RS_KIND_PIXEL_DEPTH: return GL_DEPTH_COMPONENT16;
+    case RS_KIND_PIXEL_ETC1: return RSD_GL_ETC1_RGB8_OES;
+    case RS_KIND_PIXEL_ETC2_RGB: return RSD_GL_COMPRESSED_RGB8_ETC2;
+    case RS_KIND_PIXEL_ETC2_RGBA: return RSD_GL_COMPRESSED_RGBA8_ETC2_EAC;
     default: break;
     }
     return 0;
 }
+
+static bool IsCompressedFormat(GLenum format) {
+    return (format == RSD_GL_ETC1_RGB8_OES) || (format == RSD_GL_COMPRESSED_RGB8_ETC2) ||
+           (format == RSD_GL_COMPRESSED_RGBA8_ETC2_EAC);
+}
+
+// The format compressed data is handed to GL as, or 0 if the context
+// can't sample it.  ETC2 decoders read ETC1 blocks, so GLES 3 contexts
+// without the OES extension take ETC1 data as ETC2 RGB.
+static GLenum CompressedUploadFormat(const Context *rsc, GLenum format) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (format == RSD_GL_ETC1_RGB8_OES) {
+        if (strstr((const char *)dc->gl.gl.extensions, "GL_OES_compressed_ETC1_RGB8_texture")) {
+            return format;
+        }
+        return (dc->gl.gl.majorVersion >= 3) ? RSD_GL_COMPRESSED_RGB8_ETC2 : 0;
+    }
+    return (dc->gl.gl.majorVersion >= 3) ? format : 0;
+}
 #endif
 
 uint8_t *GetOffsetPtr(const android::renderscript::Allocation *alloc,
                       uint32_t xoff, uint32_t yoff, uint32_t zoff,
                       uint32_t lod, RsAllocationCubemapFace face) {
     uint8_t *ptr = (uint8_t *)alloc->mHal.drvState.lod[lod].mallocPtr;
+    if (alloc->mHal.drvState.tile.shiftX) {
+        // Tiled allocations have neither LODs nor faces.
+        return ptr + alloc->getCellOffset(xoff, yoff, zoff);
+    }
     ptr += face * alloc->mHal.drvState.faceOffset;
     ptr += zoff * alloc->mHal.drvState.lod[lod].dimY * alloc->mHal.drvState.lod[lod].stride;
     ptr += yoff * alloc->mHal.drvState.lod[lod].stride;
@@ -100,6 +149,265 @@ uint8_t *GetOffsetPtr(const android::renderscript::Allocation *alloc,
     return ptr;
 }
 
+// USAGE_FIELD_PLANES allocations keep lod[0] describing their cells as
+// packed structs, but store each field in a plane of its own, one after
+// the other, 16 byte aligned and with the cells in the order of the rows.
+// Moves count cells of row (y, z) from x on between the tiles and the
+// packed cells at packed, a run within a tile at a time.
+static void copyTiledRow(const Allocation *alloc, uint32_t x, uint32_t y, uint32_t z,
+                         size_t count, uint8_t *packed, bool toTiles) {
+    const uint32_t tileW = 1u << alloc->mHal.drvState.tile.shiftX;
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
+    uint8_t *base = (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
+    while (count) {
+        const size_t n = rsMin(count, (size_t)(tileW - (x & (tileW - 1))));
+        uint8_t *cells = base + alloc->getCellOffset(x, y, z);
+        if (toTiles) {
+            memcpy(cells, packed, n * eSize);
+        } else {
+            memcpy(packed, cells, n * eSize);
+        }
+        packed += n * eSize;
+        x += n;
+        count -= n;
+    }
+}
+
+// The same for count cells from cell on, numbered in row order.
+static void copyTiledCells(const Allocation *alloc, size_t cell, size_t count,
+                           uint8_t *packed, bool toTiles) {
+    const uint32_t dimX = alloc->mHal.drvState.lod[0].dimX;
+    const uint32_t dimY = rsMax(alloc->mHal.drvState.lod[0].dimY, 1u);
+    while (count) {
+        const uint32_t x = cell % dimX;
+        const size_t row = cell / dimX;
+        const size_t n = rsMin(count, (size_t)(dimX - x));
+        copyTiledRow(alloc, x, row % dimY, row / dimY, n, packed, toTiles);
+        packed += n * alloc->mHal.state.elementSizeBytes;
+        cell += n;
+        count -= n;
+    }
+}
+
+static size_t fieldPlaneCellBytes(const Element *e, uint32_t field) {
+    return e->getField(field)->getSizeBytes() * e->getFieldArraySize(field);
+}
+
+static size_t fieldPlaneOffset(const Type *type, uint32_t field) {
+    const Element *e = type->getElement();
+    size_t o = 0;
+    for (uint32_t ct = 0; ct < field; ct++) {
+        o += rsRound(type->getCellCount() * fieldPlaneCellBytes(e, ct), 16);
+    }
+    return o;
+}
+
+static size_t cellIndex(const Allocation *alloc, uint32_t x, uint32_t y, uint32_t z) {
+    const Allocation::Hal::DrvState::LodState &lod = alloc->mHal.drvState.lod[0];
+    return ((size_t)z * rsMax(lod.dimY, 1u) + y) * lod.dimX + x;
+}
+
+static uint8_t * fieldPlaneCell(const Allocation *alloc, uint32_t field, size_t cell) {
+    const Type *type = alloc->mHal.state.type;
+    return (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr + fieldPlaneOffset(type, field) +
+           cell * fieldPlaneCellBytes(type->getElement(), field);
+}
+
+// Moves count cells from cell on between the planes and the packed structs
+// at packed.
+static void copyFieldPlanes(const Allocation *alloc, size_t cell, size_t count,
+                            uint8_t *packed, bool toPlanes) {
+    const Element *e = alloc->mHal.state.type->getElement();
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
+    for (uint32_t f = 0; f < e->getFieldCount(); f++) {
+        const size_t fSize = fieldPlaneCellBytes(e, f);
+        uint8_t *plane = fieldPlaneCell(alloc, f, cell);
+        uint8_t *p = packed + e->getFieldOffsetBytes(f);
+        for (size_t ct = 0; ct < count; ct++) {
+            if (toPlanes) {
+                memcpy(plane, p, fSize);
+            } else {
+                memcpy(p, plane, fSize);
+            }
+            plane += fSize;
+            p += eSize;
+        }
+    }
+}
+
+// The context counts an allocation's backing store by where its cells
+// live, which doesn't change while it exists.
+static RsMemoryCategory allocCategory(const Allocation *alloc) {
+    const DrvAllocation *drv = (const DrvAllocation *)alloc->mHal.drv;
+    if (drv->shareFd >= 0) {
+        return RS_MEMORY_ALLOCATION_SHARED;
+    }
+    if (alloc->mHal.state.usageFlags & (RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE |
+                                        RS_ALLOCATION_USAGE_GRAPHICS_VERTEX |
+                                        RS_ALLOCATION_USAGE_GRAPHICS_CONSTANTS |
+                                        RS_ALLOCATION_USAGE_GRAPHICS_RENDER_TARGET)) {
+        return RS_MEMORY_ALLOCATION_GRAPHICS;
+    }
+    return RS_MEMORY_ALLOCATION_SCRIPT;
+}
+
+static void setAllocSize(const Context *rsc, const Allocation *alloc, size_t allocSize) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    rsc->trackMemory(allocCategory(alloc), (ssize_t)allocSize - (ssize_t)drv->allocSize);
+    drv->allocSize = allocSize;
+}
+
+static void trackGLBytes(const Context *rsc, DrvAllocation *drv, ssize_t bytes) {
+    drv->glBytes += bytes;
+    rsc->trackMemory(RS_MEMORY_GL_OBJECTS, bytes);
+}
+
+
+static void copyRows(const Context *rsc, uint8_t *dst, size_t dstStride,
+                     const uint8_t *src, size_t srcStride, size_t lineSize, uint32_t rows);
+
+static void markDirtyRect(const Allocation *alloc, uint32_t lod, uint32_t face,
+                          uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+static void markDirtyFull(const Allocation *alloc) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (alloc->mHal.state.baseAlloc) {
+        markDirtyRect(alloc->mHal.state.baseAlloc, alloc->mHal.state.originLOD,
+                      alloc->mHal.state.originFace, alloc->mHal.state.originX,
+                      alloc->mHal.state.originY, alloc->mHal.drvState.lod[0].dimX,
+                      rsMax(alloc->mHal.drvState.lod[0].dimY, 1u));
+    }
+    alloc->mHal.drvState.contentVersion++;
+    drv->dirtyFull = true;
+    drv->dirtyRectCount = 0;
+    drv->uploadDeferred = true;
+}
+
+static uint64_t rectArea(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2) {
+    return (uint64_t)(x2 - x1) * (y2 - y1);
+}
+
+// Records that a w x h region at (x, y) of lod and face was written.
+static void markDirtyRect(const Allocation *alloc, uint32_t lod, uint32_t face,
+                          uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    // Writes through an adapter land in its base.
+    const Allocation *base = alloc->mHal.state.baseAlloc;
+    if (base) {
+        markDirtyRect(base, alloc->mHal.state.originLOD, alloc->mHal.state.originFace,
+                      alloc->mHal.state.originX + x, alloc->mHal.state.originY + y, w, h);
+    }
+    alloc->mHal.drvState.contentVersion++;
+    drv->uploadDeferred = true;
+    if (drv->dirtyFull || !w || !h) {
+        return;
+    }
+
+    // Fold the region into whichever rect of the same level grows least,
+    // unless there's a free slot and it overlaps none of them.
+    int best = -1;
+    uint64_t bestGrowth = 0;
+    for (uint32_t ct = 0; ct < drv->dirtyRectCount; ct++) {
+        const DrvAllocation::DirtyRect *r = &drv->dirtyRects[ct];
+        if ((r->lod != lod) || (r->face != face)) {
+            continue;
+        }
+        uint64_t growth = rectArea(rsMin(r->x1, x), rsMin(r->y1, y),
+                                   rsMax(r->x2, x + w), rsMax(r->y2, y + h)) -
+                          rectArea(r->x1, r->y1, r->x2, r->y2);
+        const bool overlaps = (x < r->x2) && (x + w > r->x1) && (y < r->y2) && (y + h > r->y1);
+        if (overlaps) {
+            growth = 0;
+        }
+        if ((best < 0) || (growth < bestGrowth)) {
+            best = ct;
+            bestGrowth = growth;
+        }
+    }
+
+    if ((best < 0) || (bestGrowth && (drv->dirtyRectCount < RSD_DIRTY_RECT_COUNT))) {
+        if (drv->dirtyRectCount == RSD_DIRTY_RECT_COUNT) {
+            markDirtyFull(alloc);
+            return;
+        }
+        DrvAllocation::DirtyRect *r = &drv->dirtyRects[drv->dirtyRectCount++];
+        r->lod = lod;
+        r->face = face;
+        r->x1 = x;
+        r->y1 = y;
+        r->x2 = x + w;
+        r->y2 = y + h;
+        return;
+    }
+
+    DrvAllocation::DirtyRect *r = &drv->dirtyRects[best];
+    r->x1 = rsMin(r->x1, x);
+    r->y1 = rsMin(r->y1, y);
+    r->x2 = rsMax(r->x2, x + w);
+    r->y2 = rsMax(r->y2, y + h);
+}
+
+// Records a 1D write of count cells from xoff, which may run on into
+// the following rows.
+static void markDirtyRange(const Allocation *alloc, uint32_t lod, uint32_t xoff, size_t count) {
+    const uint32_t dimX = rsMax(alloc->mHal.drvState.lod[lod].dimX, 1u);
+    if (xoff + count <= dimX) {
+        markDirtyRect(alloc, lod, 0, xoff, 0, count, 1);
+    } else {
+        const uint32_t y1 = xoff / dimX;
+        const uint32_t y2 = (xoff + count - 1) / dimX + 1;
+        markDirtyRect(alloc, lod, 0, 0, y1, dimX, y2 - y1);
+    }
+}
+
+#ifndef RS_COMPATIBILITY_LIB
+// Stages a whole-level texture update through the next buffer of the
+// upload ring, so glTexSubImage2D returns without the GL driver copying
+// from our memory.  Returns false when the caller should upload from the
+// allocation directly.
+static bool UploadThroughPbo(const Context *rsc, const Allocation *alloc, GLenum target,
+                             uint32_t lod, uint32_t w, uint32_t h) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (!dc->gl.upload.enabled || !w || !h) {
+        return false;
+    }
+
+    const uint32_t idx = dc->gl.upload.next;
+    dc->gl.upload.next = (idx + 1) % RSD_UPLOAD_RING_SIZE;
+
+    // The buffer stays in use until the upload made from it completes.
+    if (dc->gl.upload.fences[idx]) {
+        dc->gl.upload.clientWaitSync(dc->gl.upload.fences[idx],
+                                     RSD_GL_SYNC_FLUSH_COMMANDS_BIT, RSD_GL_TIMEOUT_IGNORED);
+        dc->gl.upload.deleteSync(dc->gl.upload.fences[idx]);
+        dc->gl.upload.fences[idx] = NULL;
+    }
+
+    const size_t lineSize = w * alloc->mHal.state.elementSizeBytes;
+    const size_t size = lineSize * h;
+    RSD_CALL_GL(glBindBuffer, RSD_GL_PIXEL_UNPACK_BUFFER, dc->gl.upload.buffers[idx]);
+    if (dc->gl.upload.sizes[idx] < size) {
+        RSD_CALL_GL(glBufferData, RSD_GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        dc->gl.upload.sizes[idx] = size;
+    }
+    uint8_t *dst = (uint8_t *)dc->gl.upload.mapBufferRange(RSD_GL_PIXEL_UNPACK_BUFFER, 0, size,
+            RSD_GL_MAP_WRITE_BIT | RSD_GL_MAP_INVALIDATE_BUFFER_BIT |
+            RSD_GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!dst) {
+        RSD_CALL_GL(glBindBuffer, RSD_GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+    const uint8_t *src = GetOffsetPtr(alloc, 0, 0, 0, lod, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    copyRows(rsc, dst, lineSize, src, alloc->mHal.drvState.lod[lod].stride, lineSize, h);
+    dc->gl.upload.unmapBuffer(RSD_GL_PIXEL_UNPACK_BUFFER);
+
+    RSD_CALL_GL(glTexSubImage2D, target, lod, 0, 0, w, h, drv->glFormat, drv->glType, NULL);
+    RSD_CALL_GL(glBindBuffer, RSD_GL_PIXEL_UNPACK_BUFFER, 0);
+    dc->gl.upload.fences[idx] = dc->gl.upload.fenceSync(RSD_GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return true;
+}
+#endif
 
 static void Update2DTexture(const Context *rsc, const Allocation *alloc, const void *ptr,
                             uint32_t xoff, uint32_t yoff, uint32_t lod,
@@ -120,6 +428,61 @@ static void Update2DTexture(const Context *rsc, const Allocation *alloc, const v
 
 
 #ifndef RS_COMPATIBILITY_LIB
+// Compressed levels are always sent whole, GLES can't update part of an
+// ETC1 texture.  The Type counts blocks, so GL's sizes are four times its
+// dims, and the two levels below the last block-sized one reuse its block
+// to take the chain down to 1x1.
+static void UploadCompressedTexture(const Context *rsc, const Allocation *alloc) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    const Type *type = alloc->mHal.state.type;
+    const GLenum format = CompressedUploadFormat(rsc, drv->glFormat);
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
+    const uint32_t dimX = type->getDimX();
+    const uint32_t dimY = rsMax(type->getDimY(), 1u);
+
+    const uint32_t typeLods = type->getLODCount();
+    uint32_t glLods = 1;
+    if (typeLods > 1) {
+        for (uint32_t dim = rsMax(dimX, dimY) * 4; dim > 1; dim >>= 1) {
+            glLods++;
+        }
+    }
+    const uint32_t faceCount = alloc->mHal.state.hasFaces ? 6 : 1;
+
+    // Rows are padded to 16 bytes, which 8 byte blocks may not fill.
+    uint8_t *packed = NULL;
+    RSD_CALL_GL(glBindTexture, drv->glTarget, drv->textureID);
+    for (uint32_t face = 0; face < faceCount; face ++) {
+        const GLenum t = alloc->mHal.state.hasFaces ? gFaceOrder[face] : GL_TEXTURE_2D;
+        for (uint32_t lod = 0; lod < glLods; lod++) {
+            const uint32_t srcLod = rsMin(lod, typeLods - 1);
+            const uint32_t bx = type->getLODDimX(srcLod);
+            const uint32_t by = rsMax(type->getLODDimY(srcLod), 1u);
+            const size_t rowBytes = bx * eSize;
+            const size_t stride = alloc->mHal.drvState.lod[srcLod].stride;
+            const uint8_t *p = GetOffsetPtr(alloc, 0, 0, 0, srcLod, (RsAllocationCubemapFace)face);
+            if ((stride != rowBytes) && (by > 1)) {
+                if (!packed) {
+                    packed = (uint8_t *)malloc(dimX * eSize * dimY);
+                    if (!packed) {
+                        ALOGE("Failed to allocate compressed texture staging memory");
+                        return;
+                    }
+                }
+                for (uint32_t y = 0; y < by; y++) {
+                    memcpy(packed + y * rowBytes, p + y * stride, rowBytes);
+                }
+                p = packed;
+            }
+            RSD_CALL_GL(glCompressedTexImage2D, t, lod, format,
+                        rsMax((dimX * 4) >> lod, 1u), rsMax((dimY * 4) >> lod, 1u),
+                        0, rowBytes * by, p);
+        }
+    }
+    free(packed);
+    rsdGLCheckError(rsc, "UploadCompressedTexture");
+}
+
 static void Upload2DTexture(const Context *rsc, const Allocation *alloc, bool isFirstUpload) {
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
@@ -131,9 +494,13 @@ static void Upload2DTexture(const Context *rsc, const Allocation *alloc, bool is
         faceCount = 6;
     }
 
+    // Levels below the first are filled in by glGenerateMipmap when their
+    // generation was left to the GPU.
+    const uint32_t lodCount = drv->gpuMipmaps ? 1 : alloc->mHal.state.type->getLODCount();
+
     rsdGLCheckError(rsc, "Upload2DTexture 1 ");
     for (uint32_t face = 0; face < faceCount; face ++) {
-        for (uint32_t lod = 0; lod < alloc->mHal.state.type->getLODCount(); lod++) {
+        for (uint32_t lod = 0; lod < lodCount; lod++) {
             const uint8_t *p = GetOffsetPtr(alloc, 0, 0, 0, lod, (RsAllocationCubemapFace)face);
 
             GLenum t = GL_TEXTURE_2D;
@@ -146,7 +513,10 @@ static void Upload2DTexture(const Context *rsc, const Allocation *alloc, bool is
                              alloc->mHal.state.type->getLODDimX(lod),
                              alloc->mHal.state.type->getLODDimY(lod),
                              0, drv->glFormat, drv->glType, p);
-            } else {
+            } else if (alloc->mHal.state.hasFaces ||
+                       !UploadThroughPbo(rsc, alloc, t, lod,
+                                         alloc->mHal.state.type->getLODDimX(lod),
+                                         alloc->mHal.state.type->getLODDimY(lod))) {
                 RSD_CALL_GL(glTexSubImage2D, t, lod, 0, 0,
                                 alloc->mHal.state.type->getLODDimX(lod),
                                 alloc->mHal.state.type->getLODDimY(lod),
@@ -155,12 +525,254 @@ static void Upload2DTexture(const Context *rsc, const Allocation *alloc, bool is
         }
     }
 
-    if (alloc->mHal.state.mipmapControl == RS_ALLOCATION_MIPMAP_ON_SYNC_TO_TEXTURE) {
+    if ((alloc->mHal.state.mipmapControl == RS_ALLOCATION_MIPMAP_ON_SYNC_TO_TEXTURE) ||
+        drv->gpuMipmaps) {
         RSD_CALL_GL(glGenerateMipmap, drv->glTarget);
     }
     rsdGLCheckError(rsc, "Upload2DTexture");
 }
+
+// Upload2DTexture as run on the GL worker, into storage the render thread
+// has already defined.
+static void UploadTextureJob(void *usr) {
+    const Allocation *alloc = (const Allocation *)usr;
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+
+    glBindTexture(drv->glTarget, drv->textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const uint32_t faceCount = alloc->mHal.state.hasFaces ? 6 : 1;
+    const uint32_t lodCount = drv->gpuMipmaps ? 1 : alloc->mHal.state.type->getLODCount();
+    for (uint32_t face = 0; face < faceCount; face ++) {
+        const GLenum t = alloc->mHal.state.hasFaces ? gFaceOrder[face] : GL_TEXTURE_2D;
+        for (uint32_t lod = 0; lod < lodCount; lod++) {
+            glTexSubImage2D(t, lod, 0, 0, alloc->mHal.state.type->getLODDimX(lod),
+                            alloc->mHal.state.type->getLODDimY(lod), drv->glFormat, drv->glType,
+                            GetOffsetPtr(alloc, 0, 0, 0, lod, (RsAllocationCubemapFace)face));
+        }
+    }
+    if ((alloc->mHal.state.mipmapControl == RS_ALLOCATION_MIPMAP_ON_SYNC_TO_TEXTURE) ||
+        drv->gpuMipmaps) {
+        glGenerateMipmap(drv->glTarget);
+    }
+    glBindTexture(drv->glTarget, 0);
+}
+
+static void addPendingGL(const Context *rsc, const Allocation *alloc);
+
+// Hands a full texture upload to the GL worker.  Render targets stay on
+// the render thread, which attaches them without waiting for uploads.
+static bool QueueTextureUpload(const Context *rsc, const Allocation *alloc, bool isFirstUpload) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (!dc->gl.worker ||
+        (alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_GRAPHICS_RENDER_TARGET)) {
+        return false;
+    }
+
+    if (isFirstUpload) {
+        // Storage is defined here and flushed so the worker only fills it.
+        RSD_CALL_GL(glBindTexture, drv->glTarget, drv->textureID);
+        const uint32_t faceCount = alloc->mHal.state.hasFaces ? 6 : 1;
+        const uint32_t lodCount = drv->gpuMipmaps ? 1 : alloc->mHal.state.type->getLODCount();
+        for (uint32_t face = 0; face < faceCount; face ++) {
+            const GLenum t = alloc->mHal.state.hasFaces ? gFaceOrder[face] : GL_TEXTURE_2D;
+            for (uint32_t lod = 0; lod < lodCount; lod++) {
+                RSD_CALL_GL(glTexImage2D, t, lod, drv->glFormat,
+                            alloc->mHal.state.type->getLODDimX(lod),
+                            alloc->mHal.state.type->getLODDimY(lod),
+                            0, drv->glFormat, drv->glType, NULL);
+            }
+        }
+        RSD_CALL_GL(glFlush);
+    }
+
+    addPendingGL(rsc, alloc);
+    drv->uploadJob = rsdGLWorkerQueue(dc->gl.worker, UploadTextureJob, (void *)alloc);
+    return true;
+}
+#endif
+
+#ifndef RS_COMPATIBILITY_LIB
+// Dirty regions covering more than this percentage of the texture are
+// sent as one full upload instead.
+#define DIRTY_UPLOAD_MAX_COVERAGE 50
+#define RSD_GL_UNPACK_ROW_LENGTH 0x0CF2
+
+// Percentage of level 0 the dirty regions cover, over 100 when all of
+// the allocation has to be sent.
+static uint64_t UploadDirtyCoverage(const Allocation *alloc) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (drv->dirtyFull || !drv->dirtyRectCount) {
+        return 101;
+    }
+
+    uint64_t dirtyArea = 0;
+    for (uint32_t ct = 0; ct < drv->dirtyRectCount; ct++) {
+        const DrvAllocation::DirtyRect *r = &drv->dirtyRects[ct];
+        dirtyArea += rectArea(r->x1, r->y1, r->x2, r->y2);
+    }
+    const uint64_t area = rectArea(0, 0, alloc->mHal.drvState.lod[0].dimX,
+                                   rsMax(alloc->mHal.drvState.lod[0].dimY, 1u));
+    return dirtyArea * 100 / rsMax(area, (uint64_t)1);
+}
+
+// Uploads only the dirty regions of the texture.  Returns false when a
+// full upload should be made instead.
+static bool UploadDirtyRects(const Context *rsc, const Allocation *alloc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (UploadDirtyCoverage(alloc) > DIRTY_UPLOAD_MAX_COVERAGE) {
+        return false;
+    }
+
+    // GLES2 can only read packed rows, so there whole rows are sent.
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
+    const bool useRowLength = (dc->gl.gl.majorVersion >= 3);
+
+    RSD_CALL_GL(glBindTexture, drv->glTarget, drv->textureID);
+    RSD_CALL_GL(glPixelStorei, GL_UNPACK_ALIGNMENT, 1);
+    for (uint32_t ct = 0; ct < drv->dirtyRectCount; ct++) {
+        const DrvAllocation::DirtyRect *r = &drv->dirtyRects[ct];
+        const size_t stride = alloc->mHal.drvState.lod[r->lod].stride;
+        GLenum t = GL_TEXTURE_2D;
+        if (alloc->mHal.state.hasFaces) {
+            t = gFaceOrder[r->face];
+        }
+        const uint32_t h = r->y2 - r->y1;
+
+        if (useRowLength && !(stride % eSize)) {
+            RSD_CALL_GL(glPixelStorei, RSD_GL_UNPACK_ROW_LENGTH, stride / eSize);
+            const uint8_t *p = GetOffsetPtr(alloc, r->x1, r->y1, 0, r->lod,
+                                            (RsAllocationCubemapFace)r->face);
+            RSD_CALL_GL(glTexSubImage2D, t, r->lod, r->x1, r->y1, r->x2 - r->x1, h,
+                        drv->glFormat, drv->glType, p);
+        } else {
+            const uint8_t *p = GetOffsetPtr(alloc, 0, r->y1, 0, r->lod,
+                                            (RsAllocationCubemapFace)r->face);
+            RSD_CALL_GL(glTexSubImage2D, t, r->lod, 0, r->y1,
+                        alloc->mHal.drvState.lod[r->lod].dimX, h,
+                        drv->glFormat, drv->glType, p);
+        }
+    }
+    if (useRowLength) {
+        RSD_CALL_GL(glPixelStorei, RSD_GL_UNPACK_ROW_LENGTH, 0);
+    }
+
+    if ((alloc->mHal.state.mipmapControl == RS_ALLOCATION_MIPMAP_ON_SYNC_TO_TEXTURE) ||
+        drv->gpuMipmaps) {
+        RSD_CALL_GL(glGenerateMipmap, drv->glTarget);
+    }
+    rsdGLCheckError(rsc, "UploadDirtyRects");
+    return true;
+}
+#endif
+
+#ifndef RS_COMPATIBILITY_LIB
+#define GRALLOC_TEXTURE_CPU_USAGE (GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN)
+
+// The texture of a gralloc backed allocation is its memory, so syncing
+// only has to make the script writes visible to GL.  Unlocking flushes
+// them, and the buffer is locked again at once for the next launches.
+static void SyncGrallocTexture(const Context *rsc, const Allocation *alloc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+
+    drv->grallocBuffer->unlock();
+    if (!drv->textureID) {
+        RSD_CALL_GL(glGenTextures, 1, &drv->textureID);
+        RSD_CALL_GL(glBindTexture, GL_TEXTURE_2D, drv->textureID);
+        dc->gl.eglImage.imageTargetTexture2D(GL_TEXTURE_2D, drv->eglImage);
+    }
+
+    void *ptr = NULL;
+    if (drv->grallocBuffer->lock(GRALLOC_TEXTURE_CPU_USAGE, &ptr) || !ptr) {
+        rsc->setError(RS_ERROR_DRIVER, "Could not lock texture gralloc buffer");
+        return;
+    }
+    // Gralloc may map the buffer somewhere else each time it is locked.
+    alloc->mHal.drvState.lod[0].mallocPtr = ptr;
+    rsdGLCheckError(rsc, "SyncGrallocTexture");
+}
+#endif
+
+// Gralloc format for a script texture that can share its memory with GL
+// through an EGL image, or 0 if it has to be uploaded.
+static int GrallocTextureFormat(const Context *rsc, const Allocation *alloc) {
+#ifndef RS_COMPATIBILITY_LIB
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    const Type *type = alloc->mHal.state.type;
+    if (!dc->gl.eglImage.enabled ||
+        (alloc->mHal.state.usageFlags !=
+         (RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE)) ||
+        (alloc->mHal.state.userProvidedPtr != NULL) ||
+        !type->getDimY() || type->getDimZ() || type->getDimLOD() || type->getDimFaces() ||
+        (alloc->mHal.state.mipmapControl != RS_ALLOCATION_MIPMAP_NONE)) {
+        return 0;
+    }
+
+    const Element *e = type->getElement();
+    if ((e->getKind() == RS_KIND_PIXEL_RGBA) && (e->getType() == RS_TYPE_UNSIGNED_8) &&
+        (e->getVectorSize() == 4)) {
+        return HAL_PIXEL_FORMAT_RGBA_8888;
+    }
+    if ((e->getKind() == RS_KIND_PIXEL_RGB) && (e->getType() == RS_TYPE_UNSIGNED_5_6_5)) {
+        return HAL_PIXEL_FORMAT_RGB_565;
+    }
+#endif
+    return 0;
+}
+
+// Backs a script texture with a gralloc buffer and an EGL image of it.
+// Returns the buffer locked for the CPU, or NULL to use plain memory.
+static uint8_t * allocGrallocTexture(const Context *rsc, const Allocation *alloc, int format) {
+#ifndef RS_COMPATIBILITY_LIB
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+
+    GraphicBuffer *gb = new GraphicBuffer(alloc->mHal.state.type->getDimX(),
+                                          alloc->mHal.state.type->getDimY(), format,
+                                          GRALLOC_TEXTURE_CPU_USAGE | GRALLOC_USAGE_HW_TEXTURE);
+    gb->incStrong(NULL);
+    if (gb->initCheck() != NO_ERROR) {
+        gb->decStrong(NULL);
+        return NULL;
+    }
+
+    const EGLint attribs[] = {RSD_EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    void *image = dc->gl.eglImage.createImage(dc->gl.egl.display, EGL_NO_CONTEXT,
+                                              RSD_EGL_NATIVE_BUFFER_ANDROID,
+                                              (EGLClientBuffer)gb->getNativeBuffer(), attribs);
+    if (!image) {
+        ALOGV("Could not create an EGL image of a texture gralloc buffer");
+        gb->decStrong(NULL);
+        return NULL;
+    }
+
+    void *ptr = NULL;
+    if (gb->lock(GRALLOC_TEXTURE_CPU_USAGE, &ptr) || !ptr) {
+        dc->gl.eglImage.destroyImage(dc->gl.egl.display, image);
+        gb->decStrong(NULL);
+        return NULL;
+    }
+    drv->grallocBuffer = gb;
+    drv->eglImage = image;
+    return (uint8_t *)ptr;
+#else
+    return NULL;
 #endif
+}
+
+// Whether an upload taken at version and epoch may miss later writes.
+// Script code can write the allocations it reaches without marking them,
+// so for those any script having run since counts as a write.
+static bool UploadIsStale(const Context *rsc, const Allocation *alloc,
+                          uint32_t version, uint32_t epoch) {
+    if (alloc->mHal.drvState.contentVersion != version) {
+        return true;
+    }
+    return (alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SCRIPT) &&
+           (rsc->mScriptWriteEpoch != epoch);
+}
 
 static void UploadToTexture(const Context *rsc, const Allocation *alloc) {
 #ifndef RS_COMPATIBILITY_LIB
@@ -173,7 +785,13 @@ static void UploadToTexture(const Context *rsc, const Allocation *alloc) {
         return;
     }
 
-    if (!drv->glType || !drv->glFormat) {
+    if (drv->grallocBuffer) {
+        SyncGrallocTexture(rsc, alloc);
+        return;
+    }
+
+    const bool compressed = IsCompressedFormat(drv->glFormat);
+    if ((!drv->glType && !compressed) || !drv->glFormat) {
         return;
     }
 
@@ -181,19 +799,40 @@ static void UploadToTexture(const Context *rsc, const Allocation *alloc) {
         return;
     }
 
+    if (drv->textureID &&
+        !UploadIsStale(rsc, alloc, drv->textureVersion, drv->textureEpoch)) {
+        return;
+    }
+
     bool isFirstUpload = false;
 
     if (!drv->textureID) {
         RSD_CALL_GL(glGenTextures, 1, &drv->textureID);
         isFirstUpload = true;
     }
+    // Read before uploading, so writes racing with it leave the copy stale.
+    drv->textureVersion = alloc->mHal.drvState.contentVersion;
+    drv->textureEpoch = rsc->mScriptWriteEpoch;
 
-    Upload2DTexture(rsc, alloc, isFirstUpload);
+    if (compressed) {
+        UploadCompressedTexture(rsc, alloc);
+    } else if (isFirstUpload || !UploadDirtyRects(rsc, alloc)) {
+        if (!QueueTextureUpload(rsc, alloc, isFirstUpload)) {
+            Upload2DTexture(rsc, alloc, isFirstUpload);
+        }
+    }
+    if (isFirstUpload) {
+        trackGLBytes(rsc, drv, alloc->mHal.state.type->getPackedSizeBytes());
+    }
 
-    if (!(alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SCRIPT)) {
+    // Compressed textures keep their memory, as later writes to them can
+    // only be sent as whole levels.
+    if (!(alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SCRIPT) && !drv->uploadJob &&
+        !compressed) {
         if (alloc->mHal.drvState.lod[0].mallocPtr) {
-            free(alloc->mHal.drvState.lod[0].mallocPtr);
+            releaseMemory((uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr, drv->allocSize);
             alloc->mHal.drvState.lod[0].mallocPtr = NULL;
+            setAllocSize(rsc, alloc, 0);
         }
     }
     rsdGLCheckError(rsc, "UploadToTexture");
@@ -220,11 +859,44 @@ static void AllocateRenderTarget(const Context *rsc, const Allocation *alloc) {
         RSD_CALL_GL(glBindRenderbuffer, GL_RENDERBUFFER, drv->renderTargetID);
         RSD_CALL_GL(glRenderbufferStorage, GL_RENDERBUFFER, drv->glFormat,
                     alloc->mHal.drvState.lod[0].dimX, alloc->mHal.drvState.lod[0].dimY);
+        trackGLBytes(rsc, drv, (size_t)alloc->mHal.drvState.lod[0].dimX *
+                               rsMax(alloc->mHal.drvState.lod[0].dimY, 1u) *
+                               alloc->mHal.state.elementSizeBytes);
     }
     rsdGLCheckError(rsc, "AllocateRenderTarget");
 #endif
 }
 
+#ifndef RS_COMPATIBILITY_LIB
+// Moves a buffer uploaded in an earlier frame to the copy of the current
+// frame slot, which no frame in flight draws from, returning whether it
+// did.  The copy has yet to be filled.
+static bool UseFrameBuffer(const Context *rsc, DrvAllocation *drv) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    const uint32_t count = dc->gl.frames.count;
+    if (!count || !drv->bufferUploads || (drv->bufferFrame == dc->gl.frames.index)) {
+        return false;
+    }
+    const uint32_t last = drv->bufferFrame % count;
+    const uint32_t slot = dc->gl.frames.index % count;
+    drv->bufferFrame = dc->gl.frames.index;
+    if (slot == last) {
+        return false;
+    }
+    if (!drv->frameBuffers[slot]) {
+        RSD_CALL_GL(glGenBuffers, 1, &drv->frameBuffers[slot]);
+        if (!drv->frameBuffers[slot]) {
+            return false;
+        }
+    }
+    drv->frameBuffers[last] = drv->bufferID;
+    drv->frameBufferSizes[last] = drv->bufferSize;
+    drv->bufferID = drv->frameBuffers[slot];
+    drv->bufferSize = drv->frameBufferSizes[slot];
+    return true;
+}
+#endif
+
 static void UploadToBufferObject(const Context *rsc, const Allocation *alloc) {
 #ifndef RS_COMPATIBILITY_LIB
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
@@ -242,10 +914,46 @@ static void UploadToBufferObject(const Context *rsc, const Allocation *alloc) {
         drv->uploadDeferred = true;
         return;
     }
+    const size_t size = alloc->mHal.state.type->getPackedSizeBytes();
+    if ((drv->bufferSize == size) &&
+        !UploadIsStale(rsc, alloc, drv->bufferVersion, drv->bufferEpoch)) {
+        return;
+    }
+    drv->bufferVersion = alloc->mHal.drvState.contentVersion;
+    drv->bufferEpoch = rsc->mScriptWriteEpoch;
+
+    const bool frameCopy = UseFrameBuffer(rsc, drv);
+    const uint8_t *ptr = (const uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
     RSD_CALL_GL(glBindBuffer, drv->glTarget, drv->bufferID);
-    RSD_CALL_GL(glBufferData, drv->glTarget,
-                alloc->mHal.state.type->getPackedSizeBytes(),
-                alloc->mHal.drvState.lod[0].mallocPtr, GL_DYNAMIC_DRAW);
+
+    if (drv->bufferSize != size) {
+        RSD_CALL_GL(glBufferData, drv->glTarget, size, ptr,
+                    drv->bufferUploads ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+        trackGLBytes(rsc, drv, (ssize_t)size - (ssize_t)drv->bufferSize);
+        drv->bufferSize = size;
+    } else if (frameCopy) {
+        // Idle, but it missed the writes since the slot was last drawn.
+        RSD_CALL_GL(glBufferSubData, drv->glTarget, 0, size, ptr);
+    } else if (UploadDirtyCoverage(alloc) <= DIRTY_UPLOAD_MAX_COVERAGE) {
+        // Only the cells written since the last sync
+        for (uint32_t ct = 0; ct < drv->dirtyRectCount; ct++) {
+            const DrvAllocation::DirtyRect *r = &drv->dirtyRects[ct];
+            if (r->lod) {
+                continue;
+            }
+            const size_t offset = r->x1 * eSize;
+            const size_t bytes = rsMin((size_t)(r->x2 - r->x1) * eSize, size - offset);
+            RSD_CALL_GL(glBufferSubData, drv->glTarget, offset, bytes, ptr + offset);
+        }
+    } else {
+        // Orphan the storage draws in flight may still read rather than
+        // wait for them, then fill the replacement.
+        RSD_CALL_GL(glBufferData, drv->glTarget, size, NULL, GL_STREAM_DRAW);
+        RSD_CALL_GL(glBufferSubData, drv->glTarget, 0, size, ptr);
+    }
+    drv->bufferUploads++;
+
     RSD_CALL_GL(glBindBuffer, drv->glTarget, 0);
     rsdGLCheckError(rsc, "UploadToBufferObject");
 #endif
@@ -300,6 +1008,131 @@ static size_t DeriveYUVLayout(int yuv, Allocation::Hal::DrvState *state) {
 }
 
 
+// Backing stores this large are anonymous mappings rather than memalign'd.
+// The kernel hands them out as zero pages that only become resident when
+// touched, so creating one is O(1) and there's no need to memset it.
+#define MMAP_MIN_BYTES (1024 * 1024)
+
+// Mappings this large are aligned to and advised as transparent huge
+// pages, which cuts TLB misses for kernels walking them.
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+#define HUGE_MIN_BYTES (4 * 1024 * 1024)
+
+static uint8_t * mapMemory(size_t allocSize) {
+    size_t mapSize = allocSize;
+#ifdef MADV_HUGEPAGE
+    if (allocSize >= HUGE_MIN_BYTES) {
+        mapSize += HUGE_PAGE_BYTES;
+    }
+#endif
+    void *p = mmap(NULL, mapSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    uint8_t *ptr = (uint8_t *)p;
+
+#ifdef MADV_HUGEPAGE
+    if (mapSize != allocSize) {
+        // Trim the mapping down to allocSize starting on a huge page.
+        const uintptr_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+        uint8_t *aligned = (uint8_t *)(((uintptr_t)ptr + HUGE_PAGE_BYTES - 1) &
+                                       ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+        uint8_t *end = aligned + ((allocSize + pageMask) & ~pageMask);
+        if (aligned != ptr) {
+            munmap(ptr, aligned - ptr);
+        }
+        if (end != ptr + mapSize) {
+            munmap(end, ptr + mapSize - end);
+        }
+        madvise(aligned, allocSize, MADV_HUGEPAGE);
+        ptr = aligned;
+    }
+#endif
+    return ptr;
+}
+
+// Maps allocSize bytes other contexts can map too through *fd, a new
+// region when *fd is -1 and the region in *fd otherwise.  *fd may also be a
+// regular file opened for writing, which is grown to allocSize if it is
+// shorter; *file is then set.
+static uint8_t * mapSharedMemory(size_t allocSize, int *fd, bool *file) {
+#ifndef RS_SERVER
+    int mapFd;
+    struct stat st;
+    *file = false;
+    if (*fd < 0) {
+        mapFd = ashmem_create_region("RS allocation", allocSize);
+    } else if (!fstat(*fd, &st) && S_ISREG(st.st_mode)) {
+        if ((st.st_size < (off_t)allocSize) && ftruncate(*fd, allocSize)) {
+            ALOGE("Couldn't grow the file of a file backed allocation to %zu bytes", allocSize);
+            return NULL;
+        }
+        mapFd = dup(*fd);
+        *file = true;
+    } else {
+        if (ashmem_get_size_region(*fd) < (int)allocSize) {
+            ALOGE("Shared allocation memory is smaller than its type");
+            return NULL;
+        }
+        mapFd = dup(*fd);
+    }
+    if (mapFd < 0) {
+        return NULL;
+    }
+    void *p = mmap(NULL, allocSize, PROT_READ | PROT_WRITE, MAP_SHARED, mapFd, 0);
+    if (p == MAP_FAILED) {
+        close(mapFd);
+        return NULL;
+    }
+    *fd = mapFd;
+    return (uint8_t *)p;
+#else
+    return NULL;
+#endif
+}
+
+// Frees memory from allocAlignedMemory without going through the pool.
+static void releaseMemory(uint8_t *ptr, size_t allocSize) {
+    if (allocSize >= MMAP_MIN_BYTES) {
+        munmap(ptr, allocSize);
+    } else {
+        free(ptr);
+    }
+}
+
+// Rows of large script-only 2D Allocations start on a cache line, so
+// workers splitting an Allocation by rows never share a line, and strides
+// that are a multiple of 1KB get an extra line so walking down a column
+// doesn't keep landing in the same cache sets.  The Allocation has to be
+// big enough to be mapped, which keeps its base page aligned.
+#define ROW_ALIGN_BYTES 64
+
+static bool usePaddedRows(const Allocation *alloc, const Type *type) {
+    // Anything that may see the memory outside of scripts expects the
+    // default layout, as does the vec3 packing done through lock1D.
+    if ((alloc->mHal.state.usageFlags != RS_ALLOCATION_USAGE_SCRIPT) ||
+        alloc->mHal.state.userProvidedPtr || alloc->mHal.state.hasReferences ||
+        alloc->mHal.state.yuv || (type->getLODCount() > 1) || type->getDimFaces() ||
+        (type->getDimY() < 2)) {
+        return false;
+    }
+    const Element *e = type->getElement();
+    if (e->getSizeBytes() != e->getSizeBytesUnpadded()) {
+        return false;
+    }
+    size_t rows = type->getDimY() * rsMax(type->getDimZ(), 1u);
+    return rsRound(type->getDimX() * e->getSizeBytes(), 16) * rows >= MMAP_MIN_BYTES;
+}
+
+static size_t padRowStride(size_t stride) {
+    stride = rsRound(stride, ROW_ALIGN_BYTES);
+    if ((stride % 1024) == 0) {
+        stride += ROW_ALIGN_BYTES;
+    }
+    return stride;
+}
+
 static size_t AllocationBuildPointerTable(const Context *rsc, const Allocation *alloc,
         const Type *type, uint8_t *ptr) {
     alloc->mHal.drvState.lod[0].dimX = type->getDimX();
@@ -309,6 +1142,9 @@ static size_t AllocationBuildPointerTable(const Context *rsc, const Allocation *
     // Stride needs to be 16-byte aligned too!
     size_t stride = alloc->mHal.drvState.lod[0].dimX * type->getElementSizeBytes();
     alloc->mHal.drvState.lod[0].stride = rsRound(stride, 16);
+    if (usePaddedRows(alloc, type)) {
+        alloc->mHal.drvState.lod[0].stride = padRowStride(stride);
+    }
     alloc->mHal.drvState.lodCount = type->getLODCount();
     alloc->mHal.drvState.faceCount = type->getDimFaces();
 
@@ -341,6 +1177,21 @@ static size_t AllocationBuildPointerTable(const Context *rsc, const Allocation *
         }
     }
 
+    if (alloc->hasTiles()) {
+        // 8x8 tiles, or 4x4x4 bricks in 3D, with the edges padded out.
+        Allocation::Hal::DrvState::TileState &t = alloc->mHal.drvState.tile;
+        const bool is3D = type->getDimZ() > 1;
+        t.shiftX = is3D ? 2 : 3;
+        t.shiftY = is3D ? 2 : 3;
+        t.shiftZ = is3D ? 2 : 0;
+        const uint32_t tilesX = (type->getDimX() + (1u << t.shiftX) - 1) >> t.shiftX;
+        const uint32_t tilesZ = (rsMax(type->getDimZ(), 1u) + (1u << t.shiftZ) - 1) >> t.shiftZ;
+        t.tilesY = (type->getDimY() + (1u << t.shiftY) - 1) >> t.shiftY;
+        alloc->mHal.drvState.lod[0].stride =
+                tilesX * (type->getElementSizeBytes() << (t.shiftX + t.shiftY + t.shiftZ));
+        o = alloc->mHal.drvState.lod[0].stride * t.tilesY * tilesZ;
+    }
+
     alloc->mHal.drvState.faceOffset = o;
 
     alloc->mHal.drvState.lod[0].mallocPtr = ptr;
@@ -352,13 +1203,212 @@ static size_t AllocationBuildPointerTable(const Context *rsc, const Allocation *
     if(alloc->mHal.drvState.faceCount) {
         allocSize *= 6;
     }
+    if (alloc->hasFieldPlanes()) {
+        allocSize = rsMax(allocSize,
+                          fieldPlaneOffset(type, type->getElement()->getFieldCount()));
+    }
 
     return allocSize;
 }
 
-static uint8_t* allocAlignedMemory(size_t allocSize, bool forceZero) {
+// Destroyed Allocations hand their backing store to a per-context pool so
+// that apps recreating same-sized buffers every frame don't pay for
+// memalign and the page faults of fresh memory each time.  Buffers are
+// matched on their exact size, which covers the Type dims and element
+// size.
+#define POOL_ENTRIES 32
+#define POOL_MIN_BYTES 4096
+#define POOL_MAX_BYTES (32 * 1024 * 1024)
+// Buffers left unused this long are freed while the context is idle.
+#define POOL_IDLE_NS (2000ull * 1000 * 1000)
+
+struct RsdAllocationPool {
+    struct Entry {
+        uint8_t *ptr;
+        size_t size;
+        uint32_t stamp;
+        uint64_t freedNs;
+    };
+
+    Mutex lock;
+    Entry entries[POOL_ENTRIES];
+    uint32_t stamp;
+    RsdAllocationPoolStats stats;
+};
+
+RsdAllocationPool * rsdAllocationPoolCreate() {
+    RsdAllocationPool *pool = new RsdAllocationPool();
+    if (!pool->lock.init()) {
+        delete pool;
+        return NULL;
+    }
+    memset(pool->entries, 0, sizeof(pool->entries));
+    memset(&pool->stats, 0, sizeof(pool->stats));
+    pool->stamp = 0;
+    return pool;
+}
+
+static size_t poolTrim(RsdAllocationPool *pool) {
+    pool->lock.lock();
+    const size_t freed = pool->stats.residentBytes;
+    for (uint32_t ct = 0; ct < POOL_ENTRIES; ct++) {
+        if (pool->entries[ct].ptr) {
+            releaseMemory(pool->entries[ct].ptr, pool->entries[ct].size);
+        }
+        pool->entries[ct].ptr = NULL;
+        pool->entries[ct].size = 0;
+    }
+    pool->stats.residentBytes = 0;
+    pool->lock.unlock();
+    return freed;
+}
+
+void rsdAllocationPoolDestroy(RsdAllocationPool *pool) {
+    if (pool) {
+        poolTrim(pool);
+        delete pool;
+    }
+}
+
+static RsdAllocationPool * getPool(const Context *rsc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    return dc ? dc->mAllocPool : NULL;
+}
+
+size_t rsdAllocationPoolTrim(const Context *rsc) {
+    RsdAllocationPool *pool = getPool(rsc);
+    return pool ? poolTrim(pool) : 0;
+}
+
+int32_t rsdAllocationPoolIdle(const Context *rsc) {
+    RsdAllocationPool *pool = getPool(rsc);
+    if (!pool) {
+        return -1;
+    }
+    const uint64_t now = rsc->getTime();
+    bool freed = false;
+    int32_t wait = -1;
+    pool->lock.lock();
+    for (uint32_t ct = 0; ct < POOL_ENTRIES; ct++) {
+        RsdAllocationPool::Entry *e = &pool->entries[ct];
+        if (!e->ptr) {
+            continue;
+        }
+        const uint64_t age = now - e->freedNs;
+        if ((age >= POOL_IDLE_NS) && !freed) {
+            releaseMemory(e->ptr, e->size);
+            pool->stats.residentBytes -= e->size;
+            e->ptr = NULL;
+            e->size = 0;
+            freed = true;
+            continue;
+        }
+        int32_t ms = (age >= POOL_IDLE_NS) ? 0 : (int32_t)((POOL_IDLE_NS - age) / 1000000) + 1;
+        if ((wait < 0) || (ms < wait)) {
+            wait = ms;
+        }
+    }
+    pool->lock.unlock();
+    return wait;
+}
+
+void rsdAllocationPoolGetStats(const Context *rsc, RsdAllocationPoolStats *stats) {
+    RsdAllocationPool *pool = getPool(rsc);
+    if (!pool) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    pool->lock.lock();
+    *stats = pool->stats;
+    pool->lock.unlock();
+}
+
+static uint8_t * poolTake(RsdAllocationPool *pool, size_t allocSize) {
+    uint8_t *ptr = NULL;
+    pool->lock.lock();
+    for (uint32_t ct = 0; ct < POOL_ENTRIES; ct++) {
+        RsdAllocationPool::Entry *e = &pool->entries[ct];
+        if (e->ptr && (e->size == allocSize)) {
+            ptr = e->ptr;
+            e->ptr = NULL;
+            e->size = 0;
+            pool->stats.residentBytes -= allocSize;
+            break;
+        }
+    }
+    if (ptr) {
+        pool->stats.hits++;
+    } else {
+        pool->stats.misses++;
+    }
+    pool->lock.unlock();
+    return ptr;
+}
+
+// Returns false if the pool has no room for ptr, in which case the caller
+// still owns it.
+static bool poolGive(RsdAllocationPool *pool, uint8_t *ptr, size_t allocSize,
+                     uint64_t now) {
+    if (allocSize > POOL_MAX_BYTES) {
+        return false;
+    }
+
+    pool->lock.lock();
+    // Evict the oldest buffers until the new one fits under the cap and
+    // there is a free entry for it.
+    while (true) {
+        int freeSlot = -1;
+        int oldest = -1;
+        for (uint32_t ct = 0; ct < POOL_ENTRIES; ct++) {
+            const RsdAllocationPool::Entry *e = &pool->entries[ct];
+            if (!e->ptr) {
+                freeSlot = ct;
+            } else if ((oldest < 0) ||
+                       ((int32_t)(e->stamp - pool->entries[oldest].stamp) < 0)) {
+                oldest = ct;
+            }
+        }
+        if ((freeSlot >= 0) &&
+            (pool->stats.residentBytes + allocSize <= POOL_MAX_BYTES)) {
+            RsdAllocationPool::Entry *e = &pool->entries[freeSlot];
+            e->ptr = ptr;
+            e->size = allocSize;
+            e->stamp = pool->stamp++;
+            e->freedNs = now;
+            pool->stats.residentBytes += allocSize;
+            break;
+        }
+        RsdAllocationPool::Entry *e = &pool->entries[oldest];
+        releaseMemory(e->ptr, e->size);
+        pool->stats.residentBytes -= e->size;
+        e->ptr = NULL;
+        e->size = 0;
+    }
+    pool->lock.unlock();
+    return true;
+}
+
+static uint8_t* allocAlignedMemory(const Context *rsc, size_t allocSize, bool forceZero) {
+    const bool mapped = allocSize >= MMAP_MIN_BYTES;
+    RsdAllocationPool *pool = getPool(rsc);
+    uint8_t* ptr = NULL;
+    // A fresh mapping is already zero, which beats clearing a pooled one.
+    if (pool && (allocSize >= POOL_MIN_BYTES) && !(mapped && forceZero)) {
+        ptr = poolTake(pool, allocSize);
+        if (ptr) {
+            if (forceZero) {
+                memset(ptr, 0, allocSize);
+            }
+            return ptr;
+        }
+    }
+
+    if (mapped) {
+        return mapMemory(allocSize);
+    }
+
     // We align all allocations to a 16-byte boundary.
-    uint8_t* ptr = (uint8_t *)memalign(16, allocSize);
+    ptr = (uint8_t *)memalign(16, allocSize);
     if (!ptr) {
         return NULL;
     }
@@ -368,12 +1418,151 @@ static uint8_t* allocAlignedMemory(size_t allocSize, bool forceZero) {
     return ptr;
 }
 
+static void freeAlignedMemory(const Context *rsc, uint8_t *ptr, size_t allocSize) {
+    RsdAllocationPool *pool = getPool(rsc);
+    if (pool && (allocSize >= POOL_MIN_BYTES) &&
+        poolGive(pool, ptr, allocSize, rsc->getTime())) {
+        return;
+    }
+    releaseMemory(ptr, allocSize);
+}
+
+#ifndef RS_COMPATIBILITY_LIB
+static void removePendingGL(RsdHal *dc, const Allocation *alloc) {
+    for (uint32_t ct = 0; ct < dc->gl.pending.count; ct++) {
+        if (dc->gl.pending.allocs[ct] == alloc) {
+            dc->gl.pending.count--;
+            memmove(&dc->gl.pending.allocs[ct], &dc->gl.pending.allocs[ct + 1],
+                    (dc->gl.pending.count - ct) * sizeof(dc->gl.pending.allocs[0]));
+            return;
+        }
+    }
+}
+#endif
+
+// Waits for the GL work still using the allocation's memory: an upload
+// running on the worker, or a render target readback, which is then
+// copied out of its pixel pack buffer.  Everything that touches the
+// memory on the CPU calls this first.
+static void FinishPendingGL(const Context *rsc, const Allocation *alloc) {
+#ifndef RS_COMPATIBILITY_LIB
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (!drv->uploadJob && !drv->readBackPending) {
+        return;
+    }
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    removePendingGL(dc, alloc);
+
+    if (drv->uploadJob) {
+        rsdGLWorkerFinish(dc->gl.worker, drv->uploadJob);
+        drv->uploadJob = NULL;
+        // The memory of texture-only allocations was kept for the upload.
+        if (!(alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SCRIPT) &&
+            alloc->mHal.drvState.lod[0].mallocPtr) {
+            releaseMemory((uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr, drv->allocSize);
+            alloc->mHal.drvState.lod[0].mallocPtr = NULL;
+            setAllocSize(rsc, alloc, 0);
+        }
+    }
+
+    if (!drv->readBackPending) {
+        return;
+    }
+    drv->readBackPending = false;
+    if (drv->readBackFence) {
+        dc->gl.upload.clientWaitSync(drv->readBackFence, RSD_GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     RSD_GL_TIMEOUT_IGNORED);
+        dc->gl.upload.deleteSync(drv->readBackFence);
+        drv->readBackFence = NULL;
+    }
+
+    const size_t lineSize = alloc->mHal.drvState.lod[0].dimX * alloc->mHal.state.elementSizeBytes;
+    const uint32_t rows = rsMax(alloc->mHal.drvState.lod[0].dimY, 1u);
+    RSD_CALL_GL(glBindBuffer, RSD_GL_PIXEL_PACK_BUFFER, drv->readBackBuffer);
+    const uint8_t *src = (const uint8_t *)dc->gl.upload.mapBufferRange(
+            RSD_GL_PIXEL_PACK_BUFFER, 0, lineSize * rows, RSD_GL_MAP_READ_BIT);
+    if (src) {
+        copyRows(rsc, (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr,
+                 alloc->mHal.drvState.lod[0].stride, src, lineSize, lineSize, rows);
+        dc->gl.upload.unmapBuffer(RSD_GL_PIXEL_PACK_BUFFER);
+    } else {
+        ALOGE("Could not map the readback of allocation %p", alloc);
+    }
+    RSD_CALL_GL(glBindBuffer, RSD_GL_PIXEL_PACK_BUFFER, 0);
+#endif
+}
+
+#ifndef RS_COMPATIBILITY_LIB
+// Records GL work started on an allocation that isn't pending yet,
+// finishing the oldest pending one if there is no room.
+static void addPendingGL(const Context *rsc, const Allocation *alloc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->gl.pending.count == RSD_GL_MAX_PENDING) {
+        FinishPendingGL(rsc, dc->gl.pending.allocs[0]);
+    }
+    dc->gl.pending.allocs[dc->gl.pending.count++] = alloc;
+}
+#endif
+
+void rsdAllocationFinishGL(const Context *rsc, const Allocation *alloc) {
+    FinishPendingGL(rsc, alloc);
+}
+
+void rsdAllocationFinishPendingGL(const Context *rsc) {
+#ifndef RS_COMPATIBILITY_LIB
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    while (dc->gl.pending.count) {
+        FinishPendingGL(rsc, dc->gl.pending.allocs[0]);
+    }
+#endif
+}
+
+#ifndef RS_COMPATIBILITY_LIB
+// Compressed textures need a format the context can sample, and mipmapped
+// ones power of two sizes so the block chain matches GL's.
+static bool CompressedTextureSupported(const Context *rsc, const Allocation *alloc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    const Type *type = alloc->getType();
+    const GLenum format = rsdKindToGLFormat(type->getElement()->getComponent().getKind());
+    if (!IsCompressedFormat(format) || !dc->mHasGraphics ||
+        !(alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE)) {
+        return true;
+    }
+    if (!CompressedUploadFormat(rsc, format)) {
+        ALOGE("Compressed texture format %x isn't supported by this GL context", format);
+        return false;
+    }
+    const uint32_t dimX = type->getDimX();
+    const uint32_t dimY = rsMax(type->getDimY(), 1u);
+    if ((type->getLODCount() > 1) && ((dimX & (dimX - 1)) || (dimY & (dimY - 1)))) {
+        ALOGE("Mipmapped compressed textures must be a power of two blocks wide and high");
+        return false;
+    }
+    if (alloc->mHal.state.usageFlags & (RS_ALLOCATION_USAGE_GRAPHICS_RENDER_TARGET |
+                                        RS_ALLOCATION_USAGE_IO_INPUT |
+                                        RS_ALLOCATION_USAGE_IO_OUTPUT)) {
+        ALOGE("Compressed textures can only be sampled");
+        return false;
+    }
+    return true;
+}
+#endif
+
 bool rsdAllocationInit(const Context *rsc, Allocation *alloc, bool forceZero) {
     DrvAllocation *drv = (DrvAllocation *)calloc(1, sizeof(DrvAllocation));
     if (!drv) {
         return false;
     }
     alloc->mHal.drv = drv;
+    drv->shareFd = -1;
+
+#ifndef RS_COMPATIBILITY_LIB
+    if (!CompressedTextureSupported(rsc, alloc)) {
+        alloc->mHal.drv = NULL;
+        free(drv);
+        return false;
+    }
+#endif
 
     // Calculate the object size.
     size_t allocSize = AllocationBuildPointerTable(rsc, alloc, alloc->getType(), NULL);
@@ -403,24 +1592,50 @@ bool rsdAllocationInit(const Context *rsc, Allocation *alloc, bool forceZero) {
             ALOGV("User-backed allocation failed stride requirement, falling back to separate allocation");
             drv->useUserProvidedPtr = false;
 
-            ptr = allocAlignedMemory(allocSize, forceZero);
+            ptr = allocAlignedMemory(rsc, allocSize, forceZero);
             if (!ptr) {
                 alloc->mHal.drv = NULL;
                 free(drv);
                 return false;
             }
+            setAllocSize(rsc, alloc, allocSize);
 
         } else {
             drv->useUserProvidedPtr = true;
             ptr = (uint8_t*)alloc->mHal.state.userProvidedPtr;
         }
-    } else {
-        ptr = allocAlignedMemory(allocSize, forceZero);
+    } else if (alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SHARED) {
+        // Shared memory, either new or imported from another context.
+        // New ones fall back to private memory that can't be exported.
+        drv->shareFd = alloc->mHal.state.sharedFd;
+        bool file = false;
+        ptr = mapSharedMemory(allocSize, &drv->shareFd, &file);
+        alloc->mHal.drvState.fileBacked = ptr && file;
+        if (!ptr && (alloc->mHal.state.sharedFd < 0)) {
+            drv->shareFd = -1;
+            ptr = allocAlignedMemory(rsc, allocSize, forceZero);
+        }
         if (!ptr) {
+            ALOGE("Couldn't map %zu bytes of shared allocation memory", allocSize);
             alloc->mHal.drv = NULL;
             free(drv);
             return false;
         }
+        setAllocSize(rsc, alloc, allocSize);
+    } else {
+        const int grallocFormat = GrallocTextureFormat(rsc, alloc);
+        if (grallocFormat) {
+            ptr = allocGrallocTexture(rsc, alloc, grallocFormat);
+        }
+        if (!ptr) {
+            ptr = allocAlignedMemory(rsc, allocSize, forceZero);
+            if (!ptr) {
+                alloc->mHal.drv = NULL;
+                free(drv);
+                return false;
+            }
+            setAllocSize(rsc, alloc, allocSize);
+        }
     }
     // Build the pointer tables
     size_t verifySize = AllocationBuildPointerTable(rsc, alloc, alloc->getType(), ptr);
@@ -428,6 +1643,19 @@ bool rsdAllocationInit(const Context *rsc, Allocation *alloc, bool forceZero) {
         rsAssert(!"Size mismatch");
     }
 
+#ifndef RS_COMPATIBILITY_LIB
+    if (drv->grallocBuffer) {
+        // Rows are laid out the way gralloc chose.
+        const size_t stride = drv->grallocBuffer->getStride() * alloc->mHal.state.elementSizeBytes;
+        alloc->mHal.drvState.lod[0].stride = stride;
+        rsAssert((stride & 0xf) == 0);
+        if (forceZero) {
+            memset(ptr, 0, stride * alloc->mHal.drvState.lod[0].dimY);
+        }
+        trackGLBytes(rsc, drv, stride * alloc->mHal.drvState.lod[0].dimY);
+    }
+#endif
+
 #ifndef RS_SERVER
     drv->glTarget = GL_NONE;
     if (alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE) {
@@ -454,6 +1682,7 @@ bool rsdAllocationInit(const Context *rsc, Allocation *alloc, bool forceZero) {
     if (alloc->mHal.state.usageFlags & ~RS_ALLOCATION_USAGE_SCRIPT) {
         drv->uploadDeferred = true;
     }
+    drv->dirtyFull = true;
 
 
     drv->readBackFBO = NULL;
@@ -466,10 +1695,121 @@ bool rsdAllocationInit(const Context *rsc, Allocation *alloc, bool forceZero) {
     return true;
 }
 
+void rsdAllocationAdapterOffset(const Context *rsc, const Allocation *alloc) {
+    const Allocation *base = alloc->mHal.state.baseAlloc;
+    const Allocation::Hal::DrvState::LodState &lod =
+            base->mHal.drvState.lod[alloc->mHal.state.originLOD];
+
+    uint8_t *ptr = (uint8_t *)lod.mallocPtr;
+    size_t stride = lod.stride;
+    if (base->hasFieldPlanes()) {
+        // Rows of a plane are packed.
+        stride = lod.dimX * alloc->mHal.state.elementSizeBytes;
+        ptr = fieldPlaneCell(base, alloc->mHal.state.originField,
+                             cellIndex(base, alloc->mHal.state.originX,
+                                       alloc->mHal.state.originY, alloc->mHal.state.originZ));
+    } else {
+        ptr += alloc->mHal.state.originFace * base->mHal.drvState.faceOffset;
+        ptr += ((size_t)alloc->mHal.state.originZ * rsMax(lod.dimY, 1u) +
+                alloc->mHal.state.originY) * lod.stride;
+        ptr += (size_t)alloc->mHal.state.originX * alloc->mHal.state.elementSizeBytes;
+    }
+
+    // Kernels walk the view with the rows of the base.
+    const Type *type = alloc->getType();
+    alloc->mHal.drvState.fileBacked = base->mHal.drvState.fileBacked;
+    alloc->mHal.drvState.lod[0].mallocPtr = ptr;
+    alloc->mHal.drvState.lod[0].stride = stride;
+    alloc->mHal.drvState.lod[0].dimX = type->getDimX();
+    alloc->mHal.drvState.lod[0].dimY = type->getDimY();
+    alloc->mHal.drvState.lod[0].dimZ = type->getDimZ();
+    alloc->mHal.drvState.lodCount = 1;
+    alloc->mHal.drvState.faceCount = 0;
+    alloc->mHal.drvState.faceOffset = 0;
+    alloc->mHal.drvState.contentVersion++;
+}
+
+bool rsdAllocationInitAdapter(const Context *rsc, Allocation *alloc) {
+    DrvAllocation *drv = (DrvAllocation *)calloc(1, sizeof(DrvAllocation));
+    if (!drv) {
+        return false;
+    }
+    alloc->mHal.drv = drv;
+
+    // The memory belongs to the base, so destroy must leave it alone.
+    drv->useUserProvidedPtr = true;
+    drv->shareFd = -1;
+#ifndef RS_SERVER
+    drv->glTarget = GL_NONE;
+#endif
+#ifndef RS_COMPATIBILITY_LIB
+    drv->glType = rsdTypeToGLType(alloc->mHal.state.type->getElement()->getComponent().getType());
+    drv->glFormat = rsdKindToGLFormat(alloc->mHal.state.type->getElement()->getComponent().getKind());
+#endif
+    drv->dirtyFull = true;
+
+    rsdAllocationAdapterOffset(rsc, alloc);
+    return true;
+}
+
+int rsdAllocationExportShared(const Context *rsc, const Allocation *alloc) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (drv->shareFd < 0) {
+        return -1;
+    }
+    return dup(drv->shareFd);
+}
+
+// Both run on the CPU reference's worker pool.
+bool rsdAllocationSort(const Context *rsc, const Allocation *keys, const Allocation *values) {
+    FinishPendingGL(rsc, keys);
+    if (values) {
+        FinishPendingGL(rsc, values);
+    }
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    return dc->mCpuRef->sort(keys, values);
+}
+
+uint32_t rsdAllocationCompact(const Context *rsc, const Allocation *dst, const Allocation *src,
+                              const Allocation *flags) {
+    FinishPendingGL(rsc, dst);
+    FinishPendingGL(rsc, src);
+    FinishPendingGL(rsc, flags);
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    return dc->mCpuRef->compact(dst, src, flags);
+}
+
 void rsdAllocationDestroy(const Context *rsc, Allocation *alloc) {
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
 #ifndef RS_COMPATIBILITY_LIB
+    if (drv->uploadJob) {
+        RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+        rsdGLWorkerFinish(dc->gl.worker, drv->uploadJob);
+        drv->uploadJob = NULL;
+    }
+    if (drv->readBackPending) {
+        RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+        if (drv->readBackFence) {
+            dc->gl.upload.deleteSync(drv->readBackFence);
+            drv->readBackFence = NULL;
+        }
+        drv->readBackPending = false;
+    }
+    removePendingGL((RsdHal *)rsc->mHal.drv, alloc);
+    if (drv->readBackBuffer) {
+        RSD_CALL_GL(glDeleteBuffers, 1, &drv->readBackBuffer);
+        drv->readBackBuffer = 0;
+    }
+    if (drv->textureID || drv->renderTargetID) {
+        rsdFrameBufferReleaseTarget(rsc, drv);
+    }
+    for (uint32_t ct = 0; ct < RSD_GL_MAX_FRAMES; ct++) {
+        if (drv->frameBuffers[ct] && (drv->frameBuffers[ct] != drv->bufferID)) {
+            RSD_CALL_GL(glDeleteBuffers, 1, &drv->frameBuffers[ct]);
+        }
+        drv->frameBuffers[ct] = 0;
+    }
     if (drv->bufferID) {
         // Causes a SW crash....
         //ALOGV(" mBufferID %i", mBufferID);
@@ -484,14 +1824,32 @@ void rsdAllocationDestroy(const Context *rsc, Allocation *alloc) {
         RSD_CALL_GL(glDeleteRenderbuffers, 1, &drv->renderTargetID);
         drv->renderTargetID = 0;
     }
+    if (drv->grallocBuffer) {
+        RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+        drv->grallocBuffer->unlock();
+        dc->gl.eglImage.destroyImage(dc->gl.egl.display, drv->eglImage);
+        drv->grallocBuffer->decStrong(NULL);
+        drv->grallocBuffer = NULL;
+        drv->eglImage = NULL;
+        alloc->mHal.drvState.lod[0].mallocPtr = NULL;
+    }
 #endif
+    trackGLBytes(rsc, drv, -(ssize_t)drv->glBytes);
+    rsc->trackMemory(allocCategory(alloc), -(ssize_t)drv->allocSize);
 
+    if (drv->shareFd >= 0) {
+        munmap(alloc->mHal.drvState.lod[0].mallocPtr, drv->allocSize);
+        close(drv->shareFd);
+        drv->shareFd = -1;
+        alloc->mHal.drvState.lod[0].mallocPtr = NULL;
+    }
     if (alloc->mHal.drvState.lod[0].mallocPtr) {
         // don't free user-allocated ptrs or IO_OUTPUT buffers
         if (!(drv->useUserProvidedPtr) &&
             !(alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_IO_INPUT) &&
             !(alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_IO_OUTPUT)) {
-                free(alloc->mHal.drvState.lod[0].mallocPtr);
+                freeAlignedMemory(rsc, (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr,
+                                  drv->allocSize);
         }
         alloc->mHal.drvState.lod[0].mallocPtr = NULL;
     }
@@ -511,6 +1869,7 @@ void rsdAllocationDestroy(const Context *rsc, Allocation *alloc) {
             GraphicBufferMapper &mapper = GraphicBufferMapper::get();
             mapper.unlock(drv->wndBuffer->handle);
             int32_t r = nw->queueBuffer(nw, drv->wndBuffer, -1);
+            IoCancelAhead(alloc, nw);
         }
     }
 #endif
@@ -519,8 +1878,39 @@ void rsdAllocationDestroy(const Context *rsc, Allocation *alloc) {
     alloc->mHal.drv = NULL;
 }
 
+// Moves the backing store of a resizable allocation to one of exactly
+// capacity bytes, keeping its contents.
+static bool setCapacity(const Context *rsc, const Allocation *alloc, size_t capacity) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    void * oldPtr = alloc->mHal.drvState.lod[0].mallocPtr;
+    const size_t oldSize = drv->allocSize;
+    if (capacity == oldSize) {
+        return true;
+    }
+
+    uint8_t *ptr;
+    if ((oldSize >= MMAP_MIN_BYTES) || (capacity >= MMAP_MIN_BYTES)) {
+        // Mappings can't be realloc'd.
+        ptr = allocAlignedMemory(rsc, capacity, false);
+        if (ptr && oldPtr) {
+            memcpy(ptr, oldPtr, rsMin(oldSize, capacity));
+            freeAlignedMemory(rsc, (uint8_t *)oldPtr, oldSize);
+        }
+    } else {
+        ptr = (uint8_t *)realloc(oldPtr, capacity);
+    }
+    if (!ptr) {
+        ALOGE("Failed to resize allocation backing store to %zu bytes", capacity);
+        return false;
+    }
+    alloc->mHal.drvState.lod[0].mallocPtr = ptr;
+    setAllocSize(rsc, alloc, capacity);
+    return true;
+}
+
 void rsdAllocationResize(const Context *rsc, const Allocation *alloc,
                          const Type *newType, bool zeroNew) {
+    FinishPendingGL(rsc, alloc);
     const uint32_t oldDimX = alloc->mHal.drvState.lod[0].dimX;
     const uint32_t dimX = newType->getDimX();
 
@@ -529,10 +1919,21 @@ void rsdAllocationResize(const Context *rsc, const Allocation *alloc,
         ALOGE("Resize cannot be called on a USAGE_SHARED allocation");
         return;
     }
-    void * oldPtr = alloc->mHal.drvState.lod[0].mallocPtr;
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    uint8_t *ptr = (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
     // Calculate the object size
     size_t s = AllocationBuildPointerTable(rsc, alloc, newType, NULL);
-    uint8_t *ptr = (uint8_t *)realloc(oldPtr, s);
+    alloc->mHal.drvState.lod[0].mallocPtr = ptr;
+    if (s > drv->allocSize) {
+        // Grow by half again so that growing a few cells at a time doesn't
+        // copy the whole allocation each time.  Shrinking keeps the
+        // capacity until rsdAllocationReserve trims it.
+        if (!setCapacity(rsc, alloc, rsRound(rsMax(s, drv->allocSize + drv->allocSize / 2), 16))) {
+            AllocationBuildPointerTable(rsc, alloc, alloc->getType(), ptr);
+            return;
+        }
+        ptr = (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
+    }
     // Build the relative pointer tables.
     size_t verifySize = AllocationBuildPointerTable(rsc, alloc, newType, ptr);
     if(s != verifySize) {
@@ -547,6 +1948,25 @@ void rsdAllocationResize(const Context *rsc, const Allocation *alloc,
     }
 }
 
+void rsdAllocationReserve(const Context *rsc, const Allocation *alloc, uint32_t count) {
+    FinishPendingGL(rsc, alloc);
+    const Type *type = alloc->getType();
+    if ((alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SHARED) ||
+        type->getDimY() || type->getDimZ() || type->getDimLOD() || type->getDimFaces()) {
+        ALOGE("Reserve can only be called on 1D allocations without USAGE_SHARED");
+        return;
+    }
+    if (!alloc->mHal.drvState.lod[0].mallocPtr) {
+        return;
+    }
+
+    count = rsMax(count, alloc->mHal.drvState.lod[0].dimX);
+    if (setCapacity(rsc, alloc, rsRound(count * alloc->mHal.state.elementSizeBytes, 16))) {
+        AllocationBuildPointerTable(rsc, alloc, type,
+                                    (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr);
+    }
+}
+
 static void rsdAllocationSyncFromFBO(const Context *rsc, const Allocation *alloc) {
 #ifndef RS_COMPATIBILITY_LIB
     if (!alloc->getIsScript()) {
@@ -567,13 +1987,44 @@ static void rsdAllocationSyncFromFBO(const Context *rsc, const Allocation *alloc
                                         alloc->getType()->getDimY());
     }
 
+    // A readback still in flight is replaced, its pixels never wanted.
+    if (dc->gl.readback.enabled && !drv->readBackPending) {
+        addPendingGL(rsc, alloc);
+        drv->readBackPending = true;
+    }
+
     // Bind the framebuffer object so we can read back from it
     drv->readBackFBO->setActive(rsc);
 
-    // Do the readback
-    RSD_CALL_GL(glReadPixels, 0, 0, alloc->mHal.drvState.lod[0].dimX,
-                alloc->mHal.drvState.lod[0].dimY,
-                drv->glFormat, drv->glType, alloc->mHal.drvState.lod[0].mallocPtr);
+    if (dc->gl.readback.enabled) {
+        // Read into a pixel pack buffer and leave it to the GPU; the copy
+        // into the allocation waits until the CPU next needs it.
+        const size_t size = alloc->mHal.drvState.lod[0].dimX *
+                            alloc->mHal.state.elementSizeBytes *
+                            rsMax(alloc->mHal.drvState.lod[0].dimY, 1u);
+        if (!drv->readBackBuffer) {
+            RSD_CALL_GL(glGenBuffers, 1, &drv->readBackBuffer);
+        }
+        RSD_CALL_GL(glBindBuffer, RSD_GL_PIXEL_PACK_BUFFER, drv->readBackBuffer);
+        if (drv->readBackBufferSize < size) {
+            RSD_CALL_GL(glBufferData, RSD_GL_PIXEL_PACK_BUFFER, size, NULL, RSD_GL_STREAM_READ);
+            trackGLBytes(rsc, drv, size - drv->readBackBufferSize);
+            drv->readBackBufferSize = size;
+        }
+        RSD_CALL_GL(glReadPixels, 0, 0, alloc->mHal.drvState.lod[0].dimX,
+                    alloc->mHal.drvState.lod[0].dimY, drv->glFormat, drv->glType, NULL);
+        RSD_CALL_GL(glBindBuffer, RSD_GL_PIXEL_PACK_BUFFER, 0);
+
+        if (drv->readBackFence) {
+            dc->gl.upload.deleteSync(drv->readBackFence);
+        }
+        drv->readBackFence = dc->gl.upload.fenceSync(RSD_GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    } else {
+        // Do the readback
+        RSD_CALL_GL(glReadPixels, 0, 0, alloc->mHal.drvState.lod[0].dimX,
+                    alloc->mHal.drvState.lod[0].dimY,
+                    drv->glFormat, drv->glType, alloc->mHal.drvState.lod[0].mallocPtr);
+    }
 
     // Revert framebuffer to its original
     lastFbo->setActive(rsc);
@@ -583,6 +2034,7 @@ static void rsdAllocationSyncFromFBO(const Context *rsc, const Allocation *alloc
 
 void rsdAllocationSyncAll(const Context *rsc, const Allocation *alloc,
                          RsAllocationUsageType src) {
+    ATRACE_CALL();
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
     if (src == RS_ALLOCATION_USAGE_GRAPHICS_RENDER_TARGET) {
@@ -600,6 +2052,7 @@ void rsdAllocationSyncAll(const Context *rsc, const Allocation *alloc,
     }
 
     rsAssert(src == RS_ALLOCATION_USAGE_SCRIPT);
+    FinishPendingGL(rsc, alloc);
 
     if (alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE) {
         UploadToTexture(rsc, alloc);
@@ -618,21 +2071,70 @@ void rsdAllocationSyncAll(const Context *rsc, const Allocation *alloc,
     }
 
     drv->uploadDeferred = false;
+    drv->dirtyFull = false;
+    drv->dirtyRectCount = 0;
 }
 
 void rsdAllocationMarkDirty(const Context *rsc, const Allocation *alloc) {
-    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
-    drv->uploadDeferred = true;
+    markDirtyFull(alloc);
 }
 
 #ifndef RS_COMPATIBILITY_LIB
+// Tops up the buffers held ahead of the current one.  Their release
+// fences are left pending; by the time a buffer comes up for writing the
+// consumer has normally let go of it.
+static void IoDequeueAhead(Allocation *alloc, ANativeWindow *nw) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+
+    while (drv->wndAheadCount < RSD_IO_AHEAD_COUNT) {
+        ANativeWindowBuffer *buf = NULL;
+        int fenceFd = -1;
+        if (nw->dequeueBuffer(nw, &buf, &fenceFd)) {
+            // IoGetBuffer dequeues on demand instead.
+            return;
+        }
+        drv->wndAhead[drv->wndAheadCount] = buf;
+        drv->wndAheadFence[drv->wndAheadCount] = fenceFd;
+        drv->wndAheadCount++;
+    }
+}
+
+static void IoCancelAhead(Allocation *alloc, ANativeWindow *nw) {
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+
+    for (uint32_t ct = 0; ct < drv->wndAheadCount; ct++) {
+        nw->cancelBuffer(nw, drv->wndAhead[ct], drv->wndAheadFence[ct]);
+    }
+    drv->wndAheadCount = 0;
+}
+
 static bool IoGetBuffer(const Context *rsc, Allocation *alloc, ANativeWindow *nw) {
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    int fenceFd = -1;
+
+    if (drv->wndAheadCount) {
+        drv->wndBuffer = drv->wndAhead[0];
+        fenceFd = drv->wndAheadFence[0];
+        drv->wndAheadCount--;
+        memmove(drv->wndAhead, drv->wndAhead + 1,
+                drv->wndAheadCount * sizeof(drv->wndAhead[0]));
+        memmove(drv->wndAheadFence, drv->wndAheadFence + 1,
+                drv->wndAheadCount * sizeof(drv->wndAheadFence[0]));
+    } else {
+        int32_t r = nw->dequeueBuffer(nw, &drv->wndBuffer, &fenceFd);
+        if (r) {
+            rsc->setError(RS_ERROR_DRIVER, "Error getting next IO output buffer.");
+            return false;
+        }
+    }
 
-    int32_t r = native_window_dequeue_buffer_and_wait(nw, &drv->wndBuffer);
-    if (r) {
-        rsc->setError(RS_ERROR_DRIVER, "Error getting next IO output buffer.");
-        return false;
+    if (fenceFd >= 0) {
+        sp<Fence> fence = new Fence(fenceFd);
+        if (fence->waitForever("rsdAllocationIoSend") != OK) {
+            rsc->setError(RS_ERROR_DRIVER, "Error waiting for IO output buffer.");
+            nw->cancelBuffer(nw, drv->wndBuffer, -1);
+            return false;
+        }
     }
 
     // Must lock the whole surface
@@ -647,6 +2149,7 @@ static bool IoGetBuffer(const Context *rsc, Allocation *alloc, ANativeWindow *nw
     alloc->mHal.drvState.lod[0].stride = drv->wndBuffer->stride * alloc->mHal.state.elementSizeBytes;
     rsAssert((alloc->mHal.drvState.lod[0].stride & 0xf) == 0);
 
+    IoDequeueAhead(alloc, nw);
     return true;
 }
 #endif
@@ -672,6 +2175,7 @@ void rsdAllocationSetSurface(const Context *rsc, Allocation *alloc, ANativeWindo
         GraphicBufferMapper &mapper = GraphicBufferMapper::get();
         mapper.unlock(drv->wndBuffer->handle);
         old->cancelBuffer(old, drv->wndBuffer, -1);
+        IoCancelAhead(alloc, old);
         drv->wndSurface = NULL;
 
         native_window_api_disconnect(old, NATIVE_WINDOW_API_CPU);
@@ -721,6 +2225,18 @@ void rsdAllocationSetSurface(const Context *rsc, Allocation *alloc, ANativeWindo
             goto error;
         }
 
+        // Enough buffers for the one being written, the ones dequeued
+        // ahead of it and one on its way to the consumer.
+        int minUndequeued = 0;
+        r = nw->query(nw, NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS, &minUndequeued);
+        if (r == 0) {
+            r = native_window_set_buffer_count(nw, minUndequeued + RSD_IO_AHEAD_COUNT + 2);
+        }
+        if (r) {
+            rsc->setError(RS_ERROR_DRIVER, "Error setting IO output buffer count.");
+            goto error;
+        }
+
         IoGetBuffer(rsc, alloc, nw);
         drv->wndSurface = nw;
     }
@@ -738,6 +2254,7 @@ void rsdAllocationSetSurface(const Context *rsc, Allocation *alloc, ANativeWindo
 }
 
 void rsdAllocationIoSend(const Context *rsc, Allocation *alloc) {
+    FinishPendingGL(rsc, alloc);
 #ifndef RS_COMPATIBILITY_LIB
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
     ANativeWindow *nw = drv->wndSurface;
@@ -775,15 +2292,49 @@ void rsdAllocationIoReceive(const Context *rsc, Allocation *alloc) {
 }
 
 
+// 1D copies of padded 2D Allocations that run past the end of a row
+// continue at the start of the next one.
+static bool spansPaddedRows(const Allocation *alloc, uint32_t xoff, size_t count) {
+    const size_t rowBytes = alloc->mHal.drvState.lod[0].dimX * alloc->mHal.state.elementSizeBytes;
+    return (xoff + count > alloc->mHal.drvState.lod[0].dimX) &&
+           (alloc->mHal.drvState.lod[0].stride != rsRound(rowBytes, 16));
+}
+
+static void copyPaddedRows(const Allocation *alloc, uint32_t xoff, size_t count,
+                           uint8_t *data, bool toAlloc) {
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
+    const uint32_t dimX = alloc->mHal.drvState.lod[0].dimX;
+    while (count) {
+        const size_t len = rsMin(count, (size_t)(dimX - xoff % dimX));
+        uint8_t *ptr = GetOffsetPtr(alloc, xoff % dimX, xoff / dimX, 0, 0,
+                                    RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+        if (toAlloc) {
+            memcpy(ptr, data, len * eSize);
+        } else {
+            memcpy(data, ptr, len * eSize);
+        }
+        data += len * eSize;
+        xoff += len;
+        count -= len;
+    }
+}
+
 void rsdAllocationData1D(const Context *rsc, const Allocation *alloc,
                          uint32_t xoff, uint32_t lod, size_t count,
                          const void *data, size_t sizeBytes) {
+    FinishPendingGL(rsc, alloc);
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
     const size_t eSize = alloc->mHal.state.type->getElementSizeBytes();
     uint8_t * ptr = GetOffsetPtr(alloc, xoff, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
     size_t size = count * eSize;
-    if (ptr != data) {
+    if (alloc->hasFieldPlanes()) {
+        copyFieldPlanes(alloc, xoff, count, (uint8_t *)data, true);
+    } else if (alloc->hasTiles()) {
+        copyTiledCells(alloc, xoff, count, (uint8_t *)data, true);
+    } else if (spansPaddedRows(alloc, xoff, count)) {
+        copyPaddedRows(alloc, xoff, count, (uint8_t *)data, true);
+    } else if (ptr != data) {
         // Skip the copy if we are the same allocation. This can arise from
         // our Bitmap optimization, where we share the same storage.
         if (alloc->mHal.state.hasReferences) {
@@ -792,12 +2343,433 @@ void rsdAllocationData1D(const Context *rsc, const Allocation *alloc,
         }
         memcpy(ptr, data, size);
     }
-    drv->uploadDeferred = true;
+    markDirtyRange(alloc, lod, xoff, count);
+}
+
+// Row copies of at least this many bytes are split across the CPU workers,
+// and copies too large to stay in the cache write their destination with
+// non-temporal stores.
+#define MT_COPY_MIN_BYTES (1024 * 1024)
+#define STREAM_COPY_MIN_BYTES (4 * 1024 * 1024)
+#define COPY_BLOCK_BYTES (64 * 1024)
+// Components the generic conversion stages at a time.
+#define CONVERT_CHUNK 64
+
+struct RowConvert;
+typedef void (*RowConvertFn)(const RowConvert *cv, void *dst, const void *src, size_t count);
+
+// How each component of a converting copy is changed, count being in
+// components rather than cells.
+struct RowConvert {
+    RowConvertFn fn;
+    RsDataType srcType;
+    RsDataType dstType;
+    size_t srcSize;
+    size_t dstSize;
+    bool normalize;
+};
+
+struct RowCopy {
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t dstStride;
+    size_t srcStride;
+    // Rows of a 3D range go on in the next slice after sliceRows of them.
+    size_t dstSliceStride;
+    size_t srcSliceStride;
+    uint32_t sliceRows;
+    uint32_t rows;
+    // Rows are lineCells cells long; plain copies use cells of a byte.
+    size_t lineCells;
+    size_t dstCellSize;
+    size_t srcCellSize;
+    uint32_t cellComponents;
+    const RowConvert *convert;
+    // Work goes out blockRows rows at a time, or a chunkCells piece of a
+    // single row at a time when rows are longer than a block.
+    uint32_t blockRows;
+    size_t chunkCells;
+    uint32_t rowChunks;
+    uint32_t items;
+    bool stream;
+    volatile int32_t nextItem;
+};
+
+static void streamLine(uint8_t *dst, const uint8_t *src, size_t len) {
+#if defined(__SSE2__)
+    size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+    if (head > len) {
+        head = len;
+    }
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    len -= head;
+    for (; len >= 64; len -= 64, dst += 64, src += 64) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)src);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(src + 48));
+        _mm_stream_si128((__m128i *)dst, v0);
+        _mm_stream_si128((__m128i *)(dst + 16), v1);
+        _mm_stream_si128((__m128i *)(dst + 32), v2);
+        _mm_stream_si128((__m128i *)(dst + 48), v3);
+    }
+#elif defined(__aarch64__)
+    for (; len >= 32; len -= 32, dst += 32, src += 32) {
+        asm volatile("ldp q0, q1, [%0]\n"
+                     "stnp q0, q1, [%1]\n"
+                     : : "r"(src), "r"(dst) : "v0", "v1", "memory");
+    }
+#endif
+    memcpy(dst, src, len);
+}
+
+static void copySpan(const RowCopy *c, uint32_t y, size_t x1, size_t x2) {
+    const uint32_t z = y / c->sliceRows;
+    const uint32_t row = y % c->sliceRows;
+    uint8_t *dst = c->dst + z * c->dstSliceStride + row * c->dstStride + x1 * c->dstCellSize;
+    const uint8_t *src = c->src + z * c->srcSliceStride + row * c->srcStride +
+                         x1 * c->srcCellSize;
+    if (c->convert) {
+        c->convert->fn(c->convert, dst, src, (x2 - x1) * c->cellComponents);
+    } else if (c->stream) {
+        streamLine(dst, src, x2 - x1);
+    } else {
+        memcpy(dst, src, x2 - x1);
+    }
+}
+
+static void rowCopyWorker(void *usr, uint32_t idx) {
+    RowCopy *c = (RowCopy *)usr;
+    while (true) {
+        const uint32_t item = __sync_fetch_and_add(&c->nextItem, 1);
+        if (item >= c->items) {
+            break;
+        }
+        if (c->rowChunks > 1) {
+            const size_t x1 = (item % c->rowChunks) * c->chunkCells;
+            copySpan(c, item / c->rowChunks, x1, rsMin(x1 + c->chunkCells, c->lineCells));
+            continue;
+        }
+        const uint32_t y1 = item * c->blockRows;
+        const uint32_t y2 = rsMin(y1 + c->blockRows, c->rows);
+        for (uint32_t y = y1; y < y2; y++) {
+            copySpan(c, y, 0, c->lineCells);
+        }
+    }
+#if defined(__SSE2__)
+    if (c->stream) {
+        _mm_sfence();
+    }
+#endif
+}
+
+// Runs a copy set up in c, splitting large ones across the CPU workers.
+static void launchCopy(const Context *rsc, RowCopy *c) {
+    const size_t cellSize = rsMax(c->dstCellSize, c->srcCellSize);
+    const size_t bytes = c->lineCells * cellSize * c->rows;
+    c->chunkCells = rsMax((size_t)1, COPY_BLOCK_BYTES / cellSize);
+    if (c->lineCells > c->chunkCells) {
+        c->rowChunks = (c->lineCells + c->chunkCells - 1) / c->chunkCells;
+        c->blockRows = 1;
+        c->items = c->rows * c->rowChunks;
+    } else {
+        c->rowChunks = 1;
+        c->blockRows = rsMax((size_t)1, c->chunkCells / rsMax(c->lineCells, (size_t)1));
+        c->items = (c->rows + c->blockRows - 1) / c->blockRows;
+    }
+    c->stream = !c->convert && (bytes >= STREAM_COPY_MIN_BYTES);
+    c->nextItem = 0;
+    if (bytes < MT_COPY_MIN_BYTES) {
+        rowCopyWorker(c, 0);
+    } else {
+        rsdLaunchThreads((Context *)rsc, rowCopyWorker, c);
+    }
+}
+
+static void initCopy(RowCopy *c, uint8_t *dst, size_t dstStride,
+                     const uint8_t *src, size_t srcStride, size_t lineSize, uint32_t rows) {
+    memset(c, 0, sizeof(*c));
+    c->dst = dst;
+    c->src = src;
+    c->dstStride = dstStride;
+    c->srcStride = srcStride;
+    c->sliceRows = rsMax(rows, 1u);
+    c->rows = rows;
+    c->lineCells = lineSize;
+    c->dstCellSize = 1;
+    c->srcCellSize = 1;
+}
+
+// Copies rows of lineSize bytes, using the CPU workers for large copies.
+static void copyRows(const Context *rsc, uint8_t *dst, size_t dstStride,
+                     const uint8_t *src, size_t srcStride, size_t lineSize, uint32_t rows) {
+    RowCopy c;
+    initCopy(&c, dst, dstStride, src, srcStride, lineSize, rows);
+    launchCopy(rsc, &c);
+}
+
+// Integer component limits, and the values normalized 1.0 maps to.
+template <typename T> static double intMax() {
+    return ((T)-1 < (T)0) ? (double)((1ull << (sizeof(T) * 8 - 1)) - 1) : (double)(T)-1;
+}
+
+template <typename T> static double intMin() {
+    return ((T)-1 < (T)0) ? -intMax<T>() - 1 : 0.0;
+}
+
+template <typename T>
+static void decodeIntRow(double *out, const T *src, size_t n, bool normalize) {
+    // Signed values are normalized to [-1, 1], the lowest one included.
+    const double k = normalize ? 1.0 / intMax<T>() : 1.0;
+    const double lo = normalize ? -1.0 : intMin<T>();
+    for (size_t i = 0; i < n; i++) {
+        out[i] = rsMax(src[i] * k, lo);
+    }
+}
+
+template <typename T>
+static void encodeIntRow(T *dst, const double *in, size_t n, bool normalize) {
+    const double k = normalize ? intMax<T>() : 1.0;
+    const double lo = intMin<T>();
+    const double hi = intMax<T>();
+    for (size_t i = 0; i < n; i++) {
+        double v = in[i] * k;
+        if (normalize) {
+            v += (v < 0) ? -0.5 : 0.5;
+        }
+        // NaNs become 0; the cast then truncates toward 0.
+        if (!(v >= lo)) {
+            v = (v < lo) ? lo : 0.0;
+        } else if (v > hi) {
+            v = hi;
+        }
+        dst[i] = (T)v;
+    }
+}
+
+template <typename T> static void widenIntRow(int64_t *out, const T *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = src[i];
+    }
+}
+
+template <typename T> static void narrowIntRow(T *dst, const int64_t *in, size_t n) {
+    const int64_t lo = (int64_t)intMin<T>();
+    const int64_t hi = (int64_t)intMax<T>();
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (T)rsMin(rsMax(in[i], lo), hi);
+    }
+}
+
+static bool isFloatType(RsDataType dt) {
+    return (dt == RS_TYPE_FLOAT_16) || (dt == RS_TYPE_FLOAT_32) || (dt == RS_TYPE_FLOAT_64);
+}
+
+static void decodeRow(double *out, const void *src, RsDataType dt, size_t n, bool normalize) {
+    switch (dt) {
+    case RS_TYPE_FLOAT_16:
+        for (size_t i = 0; i < n; i++) {
+            out[i] = rsHalfToFloat(((const uint16_t *)src)[i]);
+        }
+        break;
+    case RS_TYPE_FLOAT_32:
+        for (size_t i = 0; i < n; i++) {
+            out[i] = ((const float *)src)[i];
+        }
+        break;
+    case RS_TYPE_FLOAT_64:
+        memcpy(out, src, n * sizeof(double));
+        break;
+    case RS_TYPE_SIGNED_8: decodeIntRow(out, (const int8_t *)src, n, normalize); break;
+    case RS_TYPE_SIGNED_16: decodeIntRow(out, (const int16_t *)src, n, normalize); break;
+    case RS_TYPE_SIGNED_32: decodeIntRow(out, (const int32_t *)src, n, normalize); break;
+    case RS_TYPE_UNSIGNED_8: decodeIntRow(out, (const uint8_t *)src, n, normalize); break;
+    case RS_TYPE_UNSIGNED_16: decodeIntRow(out, (const uint16_t *)src, n, normalize); break;
+    case RS_TYPE_UNSIGNED_32: decodeIntRow(out, (const uint32_t *)src, n, normalize); break;
+    default: break;
+    }
+}
+
+static void encodeRow(void *dst, const double *in, RsDataType dt, size_t n, bool normalize) {
+    switch (dt) {
+    case RS_TYPE_FLOAT_16:
+        for (size_t i = 0; i < n; i++) {
+            ((uint16_t *)dst)[i] = rsFloatToHalf((float)in[i]);
+        }
+        break;
+    case RS_TYPE_FLOAT_32:
+        for (size_t i = 0; i < n; i++) {
+            ((float *)dst)[i] = (float)in[i];
+        }
+        break;
+    case RS_TYPE_FLOAT_64:
+        memcpy(dst, in, n * sizeof(double));
+        break;
+    case RS_TYPE_SIGNED_8: encodeIntRow((int8_t *)dst, in, n, normalize); break;
+    case RS_TYPE_SIGNED_16: encodeIntRow((int16_t *)dst, in, n, normalize); break;
+    case RS_TYPE_SIGNED_32: encodeIntRow((int32_t *)dst, in, n, normalize); break;
+    case RS_TYPE_UNSIGNED_8: encodeIntRow((uint8_t *)dst, in, n, normalize); break;
+    case RS_TYPE_UNSIGNED_16: encodeIntRow((uint16_t *)dst, in, n, normalize); break;
+    case RS_TYPE_UNSIGNED_32: encodeIntRow((uint32_t *)dst, in, n, normalize); break;
+    default: break;
+    }
+}
+
+static void widenRow(int64_t *out, const void *src, RsDataType dt, size_t n) {
+    switch (dt) {
+    case RS_TYPE_SIGNED_8: widenIntRow(out, (const int8_t *)src, n); break;
+    case RS_TYPE_SIGNED_16: widenIntRow(out, (const int16_t *)src, n); break;
+    case RS_TYPE_SIGNED_32: widenIntRow(out, (const int32_t *)src, n); break;
+    case RS_TYPE_UNSIGNED_8: widenIntRow(out, (const uint8_t *)src, n); break;
+    case RS_TYPE_UNSIGNED_16: widenIntRow(out, (const uint16_t *)src, n); break;
+    case RS_TYPE_UNSIGNED_32: widenIntRow(out, (const uint32_t *)src, n); break;
+    default: break;
+    }
+}
+
+static void narrowRow(void *dst, const int64_t *in, RsDataType dt, size_t n) {
+    switch (dt) {
+    case RS_TYPE_SIGNED_8: narrowIntRow((int8_t *)dst, in, n); break;
+    case RS_TYPE_SIGNED_16: narrowIntRow((int16_t *)dst, in, n); break;
+    case RS_TYPE_SIGNED_32: narrowIntRow((int32_t *)dst, in, n); break;
+    case RS_TYPE_UNSIGNED_8: narrowIntRow((uint8_t *)dst, in, n); break;
+    case RS_TYPE_UNSIGNED_16: narrowIntRow((uint16_t *)dst, in, n); break;
+    case RS_TYPE_UNSIGNED_32: narrowIntRow((uint32_t *)dst, in, n); break;
+    default: break;
+    }
+}
+
+// Any pair of types, a chunk at a time through doubles, or through 64 bit
+// integers when both are integers and nothing is rescaled.
+static void convertGeneric(const RowConvert *cv, void *dst, const void *src, size_t count) {
+    const bool viaDouble = cv->normalize || isFloatType(cv->srcType) || isFloatType(cv->dstType);
+    union {
+        double f[CONVERT_CHUNK];
+        int64_t i[CONVERT_CHUNK];
+    } buf;
+    for (size_t off = 0; off < count; off += CONVERT_CHUNK) {
+        const size_t n = rsMin(count - off, (size_t)CONVERT_CHUNK);
+        const uint8_t *s = (const uint8_t *)src + off * cv->srcSize;
+        uint8_t *d = (uint8_t *)dst + off * cv->dstSize;
+        if (viaDouble) {
+            decodeRow(buf.f, s, cv->srcType, n, cv->normalize);
+            encodeRow(d, buf.f, cv->dstType, n, cv->normalize);
+        } else {
+            widenRow(buf.i, s, cv->srcType, n);
+            narrowRow(d, buf.i, cv->dstType, n);
+        }
+    }
+}
+
+static void convertU8ToF32(const RowConvert *cv, void *dst, const void *src, size_t count) {
+    const uint8_t *s = (const uint8_t *)src;
+    float *d = (float *)dst;
+    const float k = cv->normalize ? 1.f / 255.f : 1.f;
+    size_t i = 0;
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    const float32x4_t vk = vdupq_n_f32(k);
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t v = vld1q_u8(s + i);
+        const uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        const uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        vst1q_f32(d + i, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), vk));
+        vst1q_f32(d + i + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), vk));
+        vst1q_f32(d + i + 8, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), vk));
+        vst1q_f32(d + i + 12, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), vk));
+    }
+#endif
+    for (; i < count; i++) {
+        d[i] = s[i] * k;
+    }
+}
+
+static void convertF32ToU8(const RowConvert *cv, void *dst, const void *src, size_t count) {
+    const float *s = (const float *)src;
+    uint8_t *d = (uint8_t *)dst;
+    const float k = cv->normalize ? 255.f : 1.f;
+    const float bias = cv->normalize ? 0.5f : 0.f;
+    size_t i = 0;
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    // The float to integer conversion truncates and saturates, NaNs
+    // going to 0, so only the narrowing needs to clamp.
+    const float32x4_t vk = vdupq_n_f32(k);
+    const float32x4_t vb = vdupq_n_f32(bias);
+    for (; i + 16 <= count; i += 16) {
+        const uint32x4_t v0 = vcvtq_u32_f32(vmlaq_f32(vb, vld1q_f32(s + i), vk));
+        const uint32x4_t v1 = vcvtq_u32_f32(vmlaq_f32(vb, vld1q_f32(s + i + 4), vk));
+        const uint32x4_t v2 = vcvtq_u32_f32(vmlaq_f32(vb, vld1q_f32(s + i + 8), vk));
+        const uint32x4_t v3 = vcvtq_u32_f32(vmlaq_f32(vb, vld1q_f32(s + i + 12), vk));
+        const uint16x8_t lo = vcombine_u16(vqmovn_u32(v0), vqmovn_u32(v1));
+        const uint16x8_t hi = vcombine_u16(vqmovn_u32(v2), vqmovn_u32(v3));
+        vst1q_u8(d + i, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+    }
+#endif
+    for (; i < count; i++) {
+        const float v = s[i] * k + bias;
+        d[i] = !(v > 0.f) ? 0 : ((v >= 255.f) ? 255 : (uint8_t)v);
+    }
+}
+
+static void convertU8ToU16(const RowConvert *cv, void *dst, const void *src, size_t count) {
+    const uint8_t *s = (const uint8_t *)src;
+    uint16_t *d = (uint16_t *)dst;
+    size_t i = 0;
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t v = vld1q_u8(s + i);
+        vst1q_u16(d + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(d + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#endif
+    for (; i < count; i++) {
+        d[i] = s[i];
+    }
+}
+
+static void convertU16ToU8(const RowConvert *cv, void *dst, const void *src, size_t count) {
+    const uint16_t *s = (const uint16_t *)src;
+    uint8_t *d = (uint8_t *)dst;
+    size_t i = 0;
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u8(d + i, vcombine_u8(vqmovn_u16(vld1q_u16(s + i)),
+                                    vqmovn_u16(vld1q_u16(s + i + 8))));
+    }
+#endif
+    for (; i < count; i++) {
+        d[i] = rsMin(s[i], (uint16_t)255);
+    }
+}
+
+static void convertSame(const RowConvert *cv, void *dst, const void *src, size_t count) {
+    memcpy(dst, src, count * cv->dstSize);
+}
+
+static RowConvertFn selectConvert(RsDataType srcType, RsDataType dstType, bool normalize) {
+    if (srcType == dstType) {
+        return convertSame;
+    }
+    if ((srcType == RS_TYPE_UNSIGNED_8) && (dstType == RS_TYPE_FLOAT_32)) {
+        return convertU8ToF32;
+    }
+    if ((srcType == RS_TYPE_FLOAT_32) && (dstType == RS_TYPE_UNSIGNED_8)) {
+        return convertF32ToU8;
+    }
+    if (!normalize && (srcType == RS_TYPE_UNSIGNED_8) && (dstType == RS_TYPE_UNSIGNED_16)) {
+        return convertU8ToU16;
+    }
+    if (!normalize && (srcType == RS_TYPE_UNSIGNED_16) && (dstType == RS_TYPE_UNSIGNED_8)) {
+        return convertU16ToU8;
+    }
+    return convertGeneric;
 }
 
 void rsdAllocationData2D(const Context *rsc, const Allocation *alloc,
                          uint32_t xoff, uint32_t yoff, uint32_t lod, RsAllocationCubemapFace face,
                          uint32_t w, uint32_t h, const void *data, size_t sizeBytes, size_t stride) {
+    FinishPendingGL(rsc, alloc);
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
     size_t eSize = alloc->mHal.state.elementSizeBytes;
@@ -806,24 +2778,38 @@ void rsdAllocationData2D(const Context *rsc, const Allocation *alloc,
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->hasFieldPlanes()) {
+        for (uint32_t line = 0; line < h; line++) {
+            copyFieldPlanes(alloc, cellIndex(alloc, xoff, yoff + line, 0), w,
+                            (uint8_t *)data + line * stride, true);
+        }
+        markDirtyRect(alloc, lod, face, xoff, yoff, w, h);
+    } else if (alloc->hasTiles()) {
+        for (uint32_t line = 0; line < h; line++) {
+            copyTiledRow(alloc, xoff, yoff + line, 0, w, (uint8_t *)data + line * stride, true);
+        }
+        markDirtyRect(alloc, lod, face, xoff, yoff, w, h);
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         const uint8_t *src = static_cast<const uint8_t *>(data);
         uint8_t *dst = GetOffsetPtr(alloc, xoff, yoff, 0, lod, face);
         if (dst == src) {
             // Skip the copy if we are the same allocation. This can arise from
             // our Bitmap optimization, where we share the same storage.
-            drv->uploadDeferred = true;
+            markDirtyRect(alloc, lod, face, xoff, yoff, w, h);
             return;
         }
 
-        for (uint32_t line=yoff; line < (yoff+h); line++) {
-            if (alloc->mHal.state.hasReferences) {
+        if (alloc->mHal.state.hasReferences) {
+            for (uint32_t line=yoff; line < (yoff+h); line++) {
                 alloc->incRefs(src, w);
                 alloc->decRefs(dst, w);
+                memcpy(dst, src, lineSize);
+                src += stride;
+                dst += alloc->mHal.drvState.lod[lod].stride;
             }
-            memcpy(dst, src, lineSize);
-            src += stride;
-            dst += alloc->mHal.drvState.lod[lod].stride;
+        } else {
+            copyRows(rsc, dst, alloc->mHal.drvState.lod[lod].stride, src, stride, lineSize, h);
+            src += h * stride;
         }
         if (alloc->mHal.state.yuv) {
             size_t clineSize = lineSize;
@@ -849,7 +2835,7 @@ void rsdAllocationData2D(const Context *rsc, const Allocation *alloc,
             }
 
         }
-        drv->uploadDeferred = true;
+        markDirtyRect(alloc, lod, face, xoff, yoff, w, h);
     } else {
         Update2DTexture(rsc, alloc, data, xoff, yoff, lod, face, w, h);
     }
@@ -860,6 +2846,7 @@ void rsdAllocationData3D(const Context *rsc, const Allocation *alloc,
                          uint32_t lod,
                          uint32_t w, uint32_t h, uint32_t d, const void *data,
                          size_t sizeBytes, size_t stride) {
+    FinishPendingGL(rsc, alloc);
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
     uint32_t eSize = alloc->mHal.state.elementSizeBytes;
@@ -868,7 +2855,26 @@ void rsdAllocationData3D(const Context *rsc, const Allocation *alloc,
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->hasFieldPlanes()) {
+        const uint8_t *src = static_cast<const uint8_t *>(data);
+        for (uint32_t z = 0; z < d; z++) {
+            for (uint32_t line = 0; line < h; line++) {
+                copyFieldPlanes(alloc, cellIndex(alloc, xoff, yoff + line, zoff + z), w,
+                                (uint8_t *)src, true);
+                src += stride;
+            }
+        }
+        markDirtyFull(alloc);
+    } else if (alloc->hasTiles()) {
+        const uint8_t *src = static_cast<const uint8_t *>(data);
+        for (uint32_t z = 0; z < d; z++) {
+            for (uint32_t line = 0; line < h; line++) {
+                copyTiledRow(alloc, xoff, yoff + line, zoff + z, w, (uint8_t *)src, true);
+                src += stride;
+            }
+        }
+        markDirtyFull(alloc);
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         const uint8_t *src = static_cast<const uint8_t *>(data);
         for (uint32_t z = zoff; z < d; z++) {
             uint8_t *dst = GetOffsetPtr(alloc, xoff, yoff, z, lod,
@@ -876,7 +2882,7 @@ void rsdAllocationData3D(const Context *rsc, const Allocation *alloc,
             if (dst == src) {
                 // Skip the copy if we are the same allocation. This can arise from
                 // our Bitmap optimization, where we share the same storage.
-                drv->uploadDeferred = true;
+                markDirtyFull(alloc);
                 return;
             }
 
@@ -890,16 +2896,23 @@ void rsdAllocationData3D(const Context *rsc, const Allocation *alloc,
                 dst += alloc->mHal.drvState.lod[lod].stride;
             }
         }
-        drv->uploadDeferred = true;
+        markDirtyFull(alloc);
     }
 }
 
 void rsdAllocationRead1D(const Context *rsc, const Allocation *alloc,
                          uint32_t xoff, uint32_t lod, size_t count,
                          void *data, size_t sizeBytes) {
+    FinishPendingGL(rsc, alloc);
     const size_t eSize = alloc->mHal.state.type->getElementSizeBytes();
     const uint8_t * ptr = GetOffsetPtr(alloc, xoff, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
-    if (data != ptr) {
+    if (alloc->hasFieldPlanes()) {
+        copyFieldPlanes(alloc, xoff, count, (uint8_t *)data, false);
+    } else if (alloc->hasTiles()) {
+        copyTiledCells(alloc, xoff, count, (uint8_t *)data, false);
+    } else if (spansPaddedRows(alloc, xoff, count)) {
+        copyPaddedRows(alloc, xoff, count, (uint8_t *)data, false);
+    } else if (data != ptr) {
         // Skip the copy if we are the same allocation. This can arise from
         // our Bitmap optimization, where we share the same storage.
         memcpy(data, ptr, count * eSize);
@@ -909,13 +2922,23 @@ void rsdAllocationRead1D(const Context *rsc, const Allocation *alloc,
 void rsdAllocationRead2D(const Context *rsc, const Allocation *alloc,
                                 uint32_t xoff, uint32_t yoff, uint32_t lod, RsAllocationCubemapFace face,
                                 uint32_t w, uint32_t h, void *data, size_t sizeBytes, size_t stride) {
+    FinishPendingGL(rsc, alloc);
     size_t eSize = alloc->mHal.state.elementSizeBytes;
     size_t lineSize = eSize * w;
     if (!stride) {
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->hasFieldPlanes()) {
+        for (uint32_t line = 0; line < h; line++) {
+            copyFieldPlanes(alloc, cellIndex(alloc, xoff, yoff + line, 0), w,
+                            (uint8_t *)data + line * stride, false);
+        }
+    } else if (alloc->hasTiles()) {
+        for (uint32_t line = 0; line < h; line++) {
+            copyTiledRow(alloc, xoff, yoff + line, 0, w, (uint8_t *)data + line * stride, false);
+        }
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         uint8_t *dst = static_cast<uint8_t *>(data);
         const uint8_t *src = GetOffsetPtr(alloc, xoff, yoff, 0, lod, face);
         if (dst == src) {
@@ -924,11 +2947,7 @@ void rsdAllocationRead2D(const Context *rsc, const Allocation *alloc,
             return;
         }
 
-        for (uint32_t line=yoff; line < (yoff+h); line++) {
-            memcpy(dst, src, lineSize);
-            dst += stride;
-            src += alloc->mHal.drvState.lod[lod].stride;
-        }
+        copyRows(rsc, dst, stride, src, alloc->mHal.drvState.lod[lod].stride, lineSize, h);
     } else {
         ALOGE("Add code to readback from non-script memory");
     }
@@ -939,13 +2958,31 @@ void rsdAllocationRead3D(const Context *rsc, const Allocation *alloc,
                          uint32_t xoff, uint32_t yoff, uint32_t zoff,
                          uint32_t lod,
                          uint32_t w, uint32_t h, uint32_t d, void *data, size_t sizeBytes, size_t stride) {
+    FinishPendingGL(rsc, alloc);
     uint32_t eSize = alloc->mHal.state.elementSizeBytes;
     uint32_t lineSize = eSize * w;
     if (!stride) {
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->hasFieldPlanes()) {
+        uint8_t *dst = static_cast<uint8_t *>(data);
+        for (uint32_t z = 0; z < d; z++) {
+            for (uint32_t line = 0; line < h; line++) {
+                copyFieldPlanes(alloc, cellIndex(alloc, xoff, yoff + line, zoff + z), w,
+                                dst, false);
+                dst += stride;
+            }
+        }
+    } else if (alloc->hasTiles()) {
+        uint8_t *dst = static_cast<uint8_t *>(data);
+        for (uint32_t z = 0; z < d; z++) {
+            for (uint32_t line = 0; line < h; line++) {
+                copyTiledRow(alloc, xoff, yoff + line, zoff + z, w, dst, false);
+                dst += stride;
+            }
+        }
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         uint8_t *dst = static_cast<uint8_t *>(data);
         for (uint32_t z = zoff; z < d; z++) {
             const uint8_t *src = GetOffsetPtr(alloc, xoff, yoff, z, lod,
@@ -967,6 +3004,7 @@ void rsdAllocationRead3D(const Context *rsc, const Allocation *alloc,
 
 void * rsdAllocationLock1D(const android::renderscript::Context *rsc,
                           const android::renderscript::Allocation *alloc) {
+    FinishPendingGL(rsc, alloc);
     return alloc->mHal.drvState.lod[0].mallocPtr;
 }
 
@@ -980,6 +3018,15 @@ void rsdAllocationData1D_alloc(const android::renderscript::Context *rsc,
                                uint32_t dstXoff, uint32_t dstLod, size_t count,
                                const android::renderscript::Allocation *srcAlloc,
                                uint32_t srcXoff, uint32_t srcLod) {
+    FinishPendingGL(rsc, dstAlloc);
+    FinishPendingGL(rsc, srcAlloc);
+    const size_t eSize = dstAlloc->mHal.state.elementSizeBytes;
+    uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, 0, 0, dstLod,
+                                   RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    const uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, 0, 0, srcLod,
+                                         RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    copyRows(rsc, dstPtr, 0, srcPtr, 0, count * eSize, 1);
+    markDirtyRange(dstAlloc, dstLod, dstXoff, count);
 }
 
 
@@ -990,15 +3037,17 @@ void rsdAllocationData2D_alloc_script(const android::renderscript::Context *rsc,
                                       const android::renderscript::Allocation *srcAlloc,
                                       uint32_t srcXoff, uint32_t srcYoff, uint32_t srcLod,
                                       RsAllocationCubemapFace srcFace) {
+    FinishPendingGL(rsc, dstAlloc);
+    FinishPendingGL(rsc, srcAlloc);
     size_t elementSize = dstAlloc->getType()->getElementSizeBytes();
-    for (uint32_t i = 0; i < h; i ++) {
-        uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, dstYoff + i, 0, dstLod, dstFace);
-        uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, srcYoff + i, 0, srcLod, srcFace);
-        memcpy(dstPtr, srcPtr, w * elementSize);
-
-        //ALOGE("COPIED dstXoff(%u), dstYoff(%u), dstLod(%u), dstFace(%u), w(%u), h(%u), srcXoff(%u), srcYoff(%u), srcLod(%u), srcFace(%u)",
-        //     dstXoff, dstYoff, dstLod, dstFace, w, h, srcXoff, srcYoff, srcLod, srcFace);
-    }
+    uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, dstYoff, 0, dstLod, dstFace);
+    uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, srcYoff, 0, srcLod, srcFace);
+    copyRows(rsc, dstPtr, dstAlloc->mHal.drvState.lod[dstLod].stride,
+             srcPtr, srcAlloc->mHal.drvState.lod[srcLod].stride, w * elementSize, h);
+    markDirtyRect(dstAlloc, dstLod, dstFace, dstXoff, dstYoff, w, h);
+
+    //ALOGE("COPIED dstXoff(%u), dstYoff(%u), dstLod(%u), dstFace(%u), w(%u), h(%u), srcXoff(%u), srcYoff(%u), srcLod(%u), srcFace(%u)",
+    //     dstXoff, dstYoff, dstLod, dstFace, w, h, srcXoff, srcYoff, srcLod, srcFace);
 }
 
 void rsdAllocationData3D_alloc_script(const android::renderscript::Context *rsc,
@@ -1007,19 +3056,22 @@ void rsdAllocationData3D_alloc_script(const android::renderscript::Context *rsc,
                                       uint32_t w, uint32_t h, uint32_t d,
                                       const android::renderscript::Allocation *srcAlloc,
                                       uint32_t srcXoff, uint32_t srcYoff, uint32_t srcZoff, uint32_t srcLod) {
-    uint32_t elementSize = dstAlloc->getType()->getElementSizeBytes();
-    for (uint32_t j = 0; j < d; j++) {
-        for (uint32_t i = 0; i < h; i ++) {
-            uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, dstYoff + i, dstZoff + j,
-                                           dstLod, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
-            uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, srcYoff + i, srcZoff + j,
-                                           srcLod, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
-            memcpy(dstPtr, srcPtr, w * elementSize);
-
-            //ALOGE("COPIED dstXoff(%u), dstYoff(%u), dstLod(%u), dstFace(%u), w(%u), h(%u), srcXoff(%u), srcYoff(%u), srcLod(%u), srcFace(%u)",
-            //     dstXoff, dstYoff, dstLod, dstFace, w, h, srcXoff, srcYoff, srcLod, srcFace);
-        }
-    }
+    FinishPendingGL(rsc, dstAlloc);
+    FinishPendingGL(rsc, srcAlloc);
+    const Allocation::Hal::DrvState::LodState &dl = dstAlloc->mHal.drvState.lod[dstLod];
+    const Allocation::Hal::DrvState::LodState &sl = srcAlloc->mHal.drvState.lod[srcLod];
+    RowCopy c;
+    initCopy(&c, GetOffsetPtr(dstAlloc, dstXoff, dstYoff, dstZoff, dstLod,
+                              RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X),
+             dl.stride,
+             GetOffsetPtr(srcAlloc, srcXoff, srcYoff, srcZoff, srcLod,
+                          RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X),
+             sl.stride, w * dstAlloc->mHal.state.elementSizeBytes, h * d);
+    c.sliceRows = rsMax(h, 1u);
+    c.dstSliceStride = rsMax(dl.dimY, 1u) * dl.stride;
+    c.srcSliceStride = rsMax(sl.dimY, 1u) * sl.stride;
+    launchCopy(rsc, &c);
+    markDirtyFull(dstAlloc);
 }
 
 void rsdAllocationData2D_alloc(const android::renderscript::Context *rsc,
@@ -1057,9 +3109,55 @@ void rsdAllocationData3D_alloc(const android::renderscript::Context *rsc,
                                      srcXoff, srcYoff, srcZoff, srcLod);
 }
 
+void rsdAllocationConvert(const Context *rsc, const Allocation *dstAlloc,
+                          uint32_t dstXoff, uint32_t dstYoff, uint32_t dstZoff, uint32_t dstLod,
+                          RsAllocationCubemapFace dstFace,
+                          uint32_t w, uint32_t h, uint32_t d,
+                          const Allocation *srcAlloc,
+                          uint32_t srcXoff, uint32_t srcYoff, uint32_t srcZoff, uint32_t srcLod,
+                          RsAllocationCubemapFace srcFace, RsAllocationConversion conversion) {
+    FinishPendingGL(rsc, dstAlloc);
+    FinishPendingGL(rsc, srcAlloc);
+    const Element *dstElement = dstAlloc->mHal.state.type->getElement();
+    const Element *srcElement = srcAlloc->mHal.state.type->getElement();
+    // Vectors of 3 are padded to 4, and the padding is converted too.
+    const uint32_t vecSize = dstElement->getVectorSize();
+    const uint32_t components = (vecSize == 3) ? 4 : vecSize;
+
+    RowConvert cv;
+    cv.srcType = srcElement->getType();
+    cv.dstType = dstElement->getType();
+    cv.srcSize = srcAlloc->mHal.state.elementSizeBytes / components;
+    cv.dstSize = dstAlloc->mHal.state.elementSizeBytes / components;
+    cv.normalize = conversion == RS_ALLOCATION_CONVERSION_NORMALIZE;
+    cv.fn = selectConvert(cv.srcType, cv.dstType, cv.normalize);
+
+    const Allocation::Hal::DrvState::LodState &dl = dstAlloc->mHal.drvState.lod[dstLod];
+    const Allocation::Hal::DrvState::LodState &sl = srcAlloc->mHal.drvState.lod[srcLod];
+    RowCopy c;
+    initCopy(&c, GetOffsetPtr(dstAlloc, dstXoff, dstYoff, dstZoff, dstLod, dstFace), dl.stride,
+             GetOffsetPtr(srcAlloc, srcXoff, srcYoff, srcZoff, srcLod, srcFace), sl.stride,
+             w, h * d);
+    c.sliceRows = rsMax(h, 1u);
+    c.dstSliceStride = rsMax(dl.dimY, 1u) * dl.stride;
+    c.srcSliceStride = rsMax(sl.dimY, 1u) * sl.stride;
+    c.dstCellSize = dstAlloc->mHal.state.elementSizeBytes;
+    c.srcCellSize = srcAlloc->mHal.state.elementSizeBytes;
+    c.cellComponents = components;
+    c.convert = &cv;
+    launchCopy(rsc, &c);
+
+    if (dl.dimZ > 1) {
+        markDirtyFull(dstAlloc);
+    } else {
+        markDirtyRect(dstAlloc, dstLod, dstFace, dstXoff, dstYoff, w, rsMax(h, 1u));
+    }
+}
+
 void rsdAllocationElementData1D(const Context *rsc, const Allocation *alloc,
                                 uint32_t x,
                                 const void *data, uint32_t cIdx, size_t sizeBytes) {
+    FinishPendingGL(rsc, alloc);
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
     size_t eSize = alloc->mHal.state.elementSizeBytes;
@@ -1067,6 +3165,9 @@ void rsdAllocationElementData1D(const Context *rsc, const Allocation *alloc,
 
     const Element * e = alloc->mHal.state.type->getElement()->getField(cIdx);
     ptr += alloc->mHal.state.type->getElement()->getFieldOffsetBytes(cIdx);
+    if (alloc->hasFieldPlanes()) {
+        ptr = fieldPlaneCell(alloc, cIdx, cellIndex(alloc, x, 0, 0));
+    }
 
     if (alloc->mHal.state.hasReferences) {
         e->incRefs(data);
@@ -1074,12 +3175,13 @@ void rsdAllocationElementData1D(const Context *rsc, const Allocation *alloc,
     }
 
     memcpy(ptr, data, sizeBytes);
-    drv->uploadDeferred = true;
+    markDirtyRect(alloc, 0, 0, x, 0, 1, 1);
 }
 
 void rsdAllocationElementData2D(const Context *rsc, const Allocation *alloc,
                                 uint32_t x, uint32_t y,
                                 const void *data, uint32_t cIdx, size_t sizeBytes) {
+    FinishPendingGL(rsc, alloc);
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
     size_t eSize = alloc->mHal.state.elementSizeBytes;
@@ -1087,6 +3189,9 @@ void rsdAllocationElementData2D(const Context *rsc, const Allocation *alloc,
 
     const Element * e = alloc->mHal.state.type->getElement()->getField(cIdx);
     ptr += alloc->mHal.state.type->getElement()->getFieldOffsetBytes(cIdx);
+    if (alloc->hasFieldPlanes()) {
+        ptr = fieldPlaneCell(alloc, cIdx, cellIndex(alloc, x, y, 0));
+    }
 
     if (alloc->mHal.state.hasReferences) {
         e->incRefs(data);
@@ -1094,80 +3199,232 @@ void rsdAllocationElementData2D(const Context *rsc, const Allocation *alloc,
     }
 
     memcpy(ptr, data, sizeBytes);
-    drv->uploadDeferred = true;
+    markDirtyRect(alloc, 0, 0, x, y, 1, 1);
 }
 
-static void mip565(const Allocation *alloc, int lod, RsAllocationCubemapFace face) {
-    uint32_t w = alloc->mHal.drvState.lod[lod + 1].dimX;
-    uint32_t h = alloc->mHal.drvState.lod[lod + 1].dimY;
+void rsdAllocationElementDataBatch(const Context *rsc, const Allocation *alloc,
+                                   const void *records, size_t sizeBytes, uint32_t count) {
+    FinishPendingGL(rsc, alloc);
+    const Element *elem = alloc->mHal.state.type->getElement();
+    const uint8_t *start = (const uint8_t *)records;
+    RsElementDataRecord r;
+
+    // Take every new reference before dropping any old one, so objects
+    // moved between fields in the same batch never reach zero.
+    if (alloc->mHal.state.hasReferences) {
+        const uint8_t *p = start;
+        for (uint32_t ct = 0; ct < count; ct++) {
+            memcpy(&r, p, sizeof(r));
+            elem->getField(r.component)->incRefs(p + sizeof(r));
+            p += sizeof(r) + rsRound(r.sizeBytes, 4);
+        }
+    }
 
-    for (uint32_t y=0; y < h; y++) {
-        uint16_t *oPtr = (uint16_t *)GetOffsetPtr(alloc, 0, y, 0, lod + 1, face);
-        const uint16_t *i1 = (uint16_t *)GetOffsetPtr(alloc, 0, 0, y*2, lod, face);
-        const uint16_t *i2 = (uint16_t *)GetOffsetPtr(alloc, 0, 0, y*2+1, lod, face);
+    const uint8_t *p = start;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        memcpy(&r, p, sizeof(r));
+        uint8_t * ptr = GetOffsetPtr(alloc, r.x, r.y, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+        ptr += elem->getFieldOffsetBytes(r.component);
+        if (alloc->hasFieldPlanes()) {
+            ptr = fieldPlaneCell(alloc, r.component, cellIndex(alloc, r.x, r.y, 0));
+        }
 
-        for (uint32_t x=0; x < w; x++) {
-            *oPtr = rsBoxFilter565(i1[0], i1[1], i2[0], i2[1]);
-            oPtr ++;
-            i1 += 2;
-            i2 += 2;
+        if (alloc->mHal.state.hasReferences) {
+            elem->getField(r.component)->decRefs(ptr);
         }
+        memcpy(ptr, p + sizeof(r), r.sizeBytes);
+        markDirtyRect(alloc, 0, 0, r.x, r.y, 1, 1);
+        p += sizeof(r) + rsRound(r.sizeBytes, 4);
     }
 }
 
-static void mip8888(const Allocation *alloc, int lod, RsAllocationCubemapFace face) {
-    uint32_t w = alloc->mHal.drvState.lod[lod + 1].dimX;
-    uint32_t h = alloc->mHal.drvState.lod[lod + 1].dimY;
-
-    for (uint32_t y=0; y < h; y++) {
-        uint32_t *oPtr = (uint32_t *)GetOffsetPtr(alloc, 0, y, 0, lod + 1, face);
-        const uint32_t *i1 = (uint32_t *)GetOffsetPtr(alloc, 0, y*2, 0, lod, face);
-        const uint32_t *i2 = (uint32_t *)GetOffsetPtr(alloc, 0, y*2+1, 0, lod, face);
+// Each of these box filters one output row from source rows i1 and i2,
+// which are the same row when the source level is one high.  A source
+// level one wide repeats its single column.
+static void mipRow565(uint16_t *o, const uint16_t *i1, const uint16_t *i2,
+                      uint32_t w, uint32_t srcW) {
+    const uint32_t dx = (srcW > 1) ? 1 : 0;
+    for (uint32_t x=0; x < w; x++) {
+        *o = rsBoxFilter565(i1[0], i1[dx], i2[0], i2[dx]);
+        o ++;
+        i1 += 2;
+        i2 += 2;
+    }
+}
 
-        for (uint32_t x=0; x < w; x++) {
-            *oPtr = rsBoxFilter8888(i1[0], i1[1], i2[0], i2[1]);
-            oPtr ++;
-            i1 += 2;
-            i2 += 2;
+static void mipRow8888(uint32_t *o, const uint32_t *i1, const uint32_t *i2,
+                       uint32_t w, uint32_t srcW) {
+    uint32_t x = 0;
+    if (srcW > 1) {
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 4 <= w; x += 4, o += 4, i1 += 8, i2 += 8) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)i1);
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(i1 + 4));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)i2);
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(i2 + 4));
+            // Column sums of pixels 0,1 / 2,3 / 4,5 / 6,7 in 16 bit lanes.
+            __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+            s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+            s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+            s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+            s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+            __m128i lo = _mm_srli_epi16(_mm_unpacklo_epi64(s0, s1), 2);
+            __m128i hi = _mm_srli_epi16(_mm_unpacklo_epi64(s2, s3), 2);
+            _mm_storeu_si128((__m128i *)o, _mm_packus_epi16(lo, hi));
         }
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+        for (; x + 4 <= w; x += 4, o += 4, i1 += 8, i2 += 8) {
+            uint32x4x2_t a = vld2q_u32(i1);
+            uint32x4x2_t b = vld2q_u32(i2);
+            uint8x16_t ae = vreinterpretq_u8_u32(a.val[0]);
+            uint8x16_t ao = vreinterpretq_u8_u32(a.val[1]);
+            uint8x16_t be = vreinterpretq_u8_u32(b.val[0]);
+            uint8x16_t bo = vreinterpretq_u8_u32(b.val[1]);
+            uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(ae), vget_low_u8(ao)),
+                                      vaddl_u8(vget_low_u8(be), vget_low_u8(bo)));
+            uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(ae), vget_high_u8(ao)),
+                                      vaddl_u8(vget_high_u8(be), vget_high_u8(bo)));
+            vst1q_u8((uint8_t *)o, vcombine_u8(vshrn_n_u16(lo, 2), vshrn_n_u16(hi, 2)));
+        }
+#endif
+    }
+
+    const uint32_t dx = (srcW > 1) ? 1 : 0;
+    for (; x < w; x++) {
+        *o = rsBoxFilter8888(i1[0], i1[dx], i2[0], i2[dx]);
+        o ++;
+        i1 += 2;
+        i2 += 2;
     }
 }
 
-static void mip8(const Allocation *alloc, int lod, RsAllocationCubemapFace face) {
-    uint32_t w = alloc->mHal.drvState.lod[lod + 1].dimX;
-    uint32_t h = alloc->mHal.drvState.lod[lod + 1].dimY;
+static void mipRow8(uint8_t *o, const uint8_t *i1, const uint8_t *i2,
+                    uint32_t w, uint32_t srcW) {
+    uint32_t x = 0;
+    if (srcW > 1) {
+#if defined(__SSE2__)
+        const __m128i mask = _mm_set1_epi16(0xff);
+        for (; x + 8 <= w; x += 8, o += 8, i1 += 16, i2 += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)i1);
+            __m128i b = _mm_loadu_si128((const __m128i *)i2);
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8)),
+                                        _mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8)));
+            sum = _mm_srli_epi16(sum, 2);
+            _mm_storel_epi64((__m128i *)o, _mm_packus_epi16(sum, sum));
+        }
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+        for (; x + 8 <= w; x += 8, o += 8, i1 += 16, i2 += 16) {
+            uint8x8x2_t a = vld2_u8(i1);
+            uint8x8x2_t b = vld2_u8(i2);
+            uint16x8_t sum = vaddq_u16(vaddl_u8(a.val[0], a.val[1]), vaddl_u8(b.val[0], b.val[1]));
+            vst1_u8(o, vshrn_n_u16(sum, 2));
+        }
+#endif
+    }
+
+    const uint32_t dx = (srcW > 1) ? 1 : 0;
+    for (; x < w; x++) {
+        *o = (uint8_t)(((uint32_t)i1[0] + i1[dx] + i2[0] + i2[dx]) >> 2);
+        o ++;
+        i1 += 2;
+        i2 += 2;
+    }
+}
 
-    for (uint32_t y=0; y < h; y++) {
-        uint8_t *oPtr = GetOffsetPtr(alloc, 0, y, 0, lod + 1, face);
-        const uint8_t *i1 = GetOffsetPtr(alloc, 0, y*2, 0, lod, face);
-        const uint8_t *i2 = GetOffsetPtr(alloc, 0, y*2+1, 0, lod, face);
+// Levels at least this large are filtered by all the CPU workers, each
+// taking blocks of rows.
+#define MT_MIP_MIN_BYTES (64 * 1024)
+#define MIP_BLOCK_ROWS 16
+
+struct MipLaunch {
+    const Allocation *alloc;
+    uint32_t lod;
+    RsAllocationCubemapFace face;
+    uint32_t bits;
+    volatile int32_t nextRow;
+};
 
-        for (uint32_t x=0; x < w; x++) {
-            *oPtr = (uint8_t)(((uint32_t)i1[0] + i1[1] + i2[0] + i2[1]) * 0.25f);
-            oPtr ++;
-            i1 += 2;
-            i2 += 2;
+static void mipWorker(void *usr, uint32_t idx) {
+    MipLaunch *m = (MipLaunch *)usr;
+    const Allocation *alloc = m->alloc;
+    const uint32_t lod = m->lod;
+    const uint32_t w = alloc->mHal.drvState.lod[lod + 1].dimX;
+    const uint32_t h = rsMax(alloc->mHal.drvState.lod[lod + 1].dimY, 1u);
+    const uint32_t srcW = alloc->mHal.drvState.lod[lod].dimX;
+    const uint32_t dy = (alloc->mHal.drvState.lod[lod].dimY > 1) ? 1 : 0;
+
+    while (true) {
+        const uint32_t y1 = __sync_fetch_and_add(&m->nextRow, MIP_BLOCK_ROWS);
+        if (y1 >= h) {
+            break;
+        }
+        const uint32_t y2 = rsMin(y1 + MIP_BLOCK_ROWS, h);
+        for (uint32_t y = y1; y < y2; y++) {
+            uint8_t *o = GetOffsetPtr(alloc, 0, y, 0, lod + 1, m->face);
+            const uint8_t *i1 = GetOffsetPtr(alloc, 0, y*2, 0, lod, m->face);
+            const uint8_t *i2 = GetOffsetPtr(alloc, 0, y*2+dy, 0, lod, m->face);
+            switch (m->bits) {
+            case 32:
+                mipRow8888((uint32_t *)o, (const uint32_t *)i1, (const uint32_t *)i2, w, srcW);
+                break;
+            case 16:
+                mipRow565((uint16_t *)o, (const uint16_t *)i1, (const uint16_t *)i2, w, srcW);
+                break;
+            case 8:
+                mipRow8(o, i1, i2, w, srcW);
+                break;
+            }
         }
     }
 }
 
 void rsdAllocationGenerateMipmaps(const Context *rsc, const Allocation *alloc) {
+    FinishPendingGL(rsc, alloc);
     if(!alloc->mHal.drvState.lod[0].mallocPtr) {
         return;
     }
+
+#ifndef RS_COMPATIBILITY_LIB
+    DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
+    if (IsCompressedFormat(drv->glFormat)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Mipmaps of compressed allocations must be provided");
+        return;
+    }
+
+    // Nothing on the CPU reads the lower levels of texture-only
+    // allocations, so leave them to the GPU when the texture is uploaded.
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->mHasGraphics && alloc->getIsTexture() && !alloc->getIsScript()) {
+        drv->gpuMipmaps = true;
+        markDirtyFull(alloc);
+        return;
+    }
+#endif
+
+    const uint32_t bits = alloc->getType()->getElement()->getSizeBits();
+    if ((bits != 32) && (bits != 16) && (bits != 8)) {
+        return;
+    }
     uint32_t numFaces = alloc->getType()->getDimFaces() ? 6 : 1;
     for (uint32_t face = 0; face < numFaces; face ++) {
         for (uint32_t lod=0; lod < (alloc->getType()->getLODCount() -1); lod++) {
-            switch (alloc->getType()->getElement()->getSizeBits()) {
-            case 32:
-                mip8888(alloc, lod, (RsAllocationCubemapFace)face);
-                break;
-            case 16:
-                mip565(alloc, lod, (RsAllocationCubemapFace)face);
-                break;
-            case 8:
-                mip8(alloc, lod, (RsAllocationCubemapFace)face);
-                break;
+            MipLaunch m;
+            m.alloc = alloc;
+            m.lod = lod;
+            m.face = (RsAllocationCubemapFace)face;
+            m.bits = bits;
+            m.nextRow = 0;
+
+            const size_t bytes = alloc->mHal.drvState.lod[lod + 1].stride *
+                                 rsMax(alloc->mHal.drvState.lod[lod + 1].dimY, 1u);
+            if (bytes >= MT_MIP_MIN_BYTES) {
+                rsdLaunchThreads((Context *)rsc, mipWorker, &m);
+            } else {
+                mipWorker(&m, 0);
             }
         }
     }
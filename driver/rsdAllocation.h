@@ -30,12 +30,20 @@
 
 #if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
 #include "gui/GLConsumer.h"
+#include "ui/GraphicBuffer.h"
+#include "rsdGL.h"
 #endif
 
 class RsdFrameBufferObj;
+struct RsdGLJob;
 struct ANativeWindow;
 struct ANativeWindowBuffer;
 
+// Number of regions tracked per allocation before they get merged.
+#define RSD_DIRTY_RECT_COUNT 8
+// IO output buffers dequeued ahead of the one scripts write to.
+#define RSD_IO_AHEAD_COUNT 2
+
 struct DrvAllocation {
     // Is this a legal structure to be used as a texture source.
     // Initially this will require 1D or 2D and color data
@@ -56,6 +64,11 @@ struct DrvAllocation {
 
     ANativeWindow *wndSurface;
     android::GLConsumer *surfaceTexture;
+
+    // Gralloc buffer backing a script texture in place of lod[0].mallocPtr,
+    // kept locked for the CPU, and the EGL image the texture samples.
+    android::GraphicBuffer *grallocBuffer;
+    void *eglImage;
 #else
     int glTarget;
     int glType;
@@ -65,9 +78,67 @@ struct DrvAllocation {
     bool useUserProvidedPtr;
     bool uploadDeferred;
 
+    // Regions written since the last sync.  Texture updates upload just
+    // these unless dirtyFull is set.
+    struct DirtyRect {
+        uint32_t lod;
+        uint32_t face;
+        uint32_t x1, y1;
+        uint32_t x2, y2;
+    } dirtyRects[RSD_DIRTY_RECT_COUNT];
+    uint32_t dirtyRectCount;
+    bool dirtyFull;
+    // Lower mip levels are generated by GL rather than on the CPU.
+    bool gpuMipmaps;
+
+    // Size the buffer object was last specified with, and how many times
+    // it has been uploaded to; buffers synced repeatedly are streamed.
+    size_t bufferSize;
+    uint32_t bufferUploads;
+#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
+    // With pipelined frames, buffers uploaded again in a later frame get a
+    // copy per frame slot, with the size each was specified with; bufferID
+    // is the copy of bufferFrame, the frame of the last upload.
+    uint32_t frameBuffers[RSD_GL_MAX_FRAMES];
+    size_t frameBufferSizes[RSD_GL_MAX_FRAMES];
+    uint32_t bufferFrame;
+#endif
+
+    // Content version and script write epoch the texture and buffer
+    // object were last uploaded at.  Syncs that find both current skip
+    // the upload.
+    uint32_t textureVersion;
+    uint32_t textureEpoch;
+    uint32_t bufferVersion;
+    uint32_t bufferEpoch;
+
+    // Size of the backing store at lod[0].mallocPtr when it came from
+    // allocAlignedMemory, 0 otherwise.  Resized 1D allocations may keep
+    // spare capacity past the end of their cells.
+    size_t allocSize;
+    // Shared memory lod[0].mallocPtr maps, for USAGE_SHARED allocations
+    // other contexts can import, or -1.  The mapping is allocSize bytes.
+    int shareFd;
+    // Estimated size of the texture, render buffer and buffer object the
+    // allocation has in GL.
+    size_t glBytes;
+
     RsdFrameBufferObj * readBackFBO;
+    // Pixel pack buffer render target readbacks are made into, and whether
+    // one is in flight, with the fence that signals its completion.
+    uint32_t readBackBuffer;
+    size_t readBackBufferSize;
+    bool readBackPending;
+    void *readBackFence;
+    // Upload of the texture running on the GL worker; lod[0].mallocPtr
+    // has to stay as it is until the job is finished.
+    RsdGLJob *uploadJob;
     ANativeWindow *wnd;
     ANativeWindowBuffer *wndBuffer;
+    // Oldest first, each with the fence to wait on before writing it.
+    ANativeWindowBuffer *wndAhead[RSD_IO_AHEAD_COUNT];
+    int wndAheadFence[RSD_IO_AHEAD_COUNT];
+    uint32_t wndAheadCount;
 };
 
 #ifndef RS_COMPATIBILITY_LIB
@@ -76,17 +147,63 @@ GLenum rsdKindToGLFormat(RsDataKind k);
 #endif
 
 
+// Counters for the per-context pool of Allocation backing stores.
+struct RsdAllocationPoolStats {
+    uint32_t hits;
+    uint32_t misses;
+    size_t residentBytes;
+};
+
+struct RsdAllocationPool;
+
+RsdAllocationPool * rsdAllocationPoolCreate();
+void rsdAllocationPoolDestroy(RsdAllocationPool *pool);
+// Frees every backing store held by the pool, returning the bytes freed.
+size_t rsdAllocationPoolTrim(const android::renderscript::Context *rsc);
+// Frees one backing store that has gone unused for a while.  Returns the
+// ms until the next one is due, 0 if one already is, or -1 if the pool is
+// empty.
+int32_t rsdAllocationPoolIdle(const android::renderscript::Context *rsc);
+void rsdAllocationPoolGetStats(const android::renderscript::Context *rsc,
+                               RsdAllocationPoolStats *stats);
+
+// Waits for the GL work still using an allocation's memory, or that of
+// every allocation before scripts can see them.  Readbacks in flight are
+// copied into their allocations.
+void rsdAllocationFinishGL(const android::renderscript::Context *rsc,
+                           const android::renderscript::Allocation *alloc);
+void rsdAllocationFinishPendingGL(const android::renderscript::Context *rsc);
+
 uint32_t rsdAllocationGrallocBits(const android::renderscript::Context *rsc,
                                   android::renderscript::Allocation *alloc);
 bool rsdAllocationInit(const android::renderscript::Context *rsc,
                        android::renderscript::Allocation *alloc,
                        bool forceZero);
+bool rsdAllocationInitAdapter(const android::renderscript::Context *rsc,
+                              android::renderscript::Allocation *alloc);
+void rsdAllocationAdapterOffset(const android::renderscript::Context *rsc,
+                                const android::renderscript::Allocation *alloc);
+// Returns a new descriptor for the memory of a sharable allocation, or -1.
+int rsdAllocationExportShared(const android::renderscript::Context *rsc,
+                              const android::renderscript::Allocation *alloc);
+bool rsdAllocationSort(const android::renderscript::Context *rsc,
+                       const android::renderscript::Allocation *keys,
+                       const android::renderscript::Allocation *values);
+uint32_t rsdAllocationCompact(const android::renderscript::Context *rsc,
+                              const android::renderscript::Allocation *dst,
+                              const android::renderscript::Allocation *src,
+                              const android::renderscript::Allocation *flags);
 void rsdAllocationDestroy(const android::renderscript::Context *rsc,
                           android::renderscript::Allocation *alloc);
 
 void rsdAllocationResize(const android::renderscript::Context *rsc,
                          const android::renderscript::Allocation *alloc,
                          const android::renderscript::Type *newType, bool zeroNew);
+void rsdAllocationReserve(const android::renderscript::Context *rsc,
+                          const android::renderscript::Allocation *alloc, uint32_t count);
+void rsdAllocationElementDataBatch(const android::renderscript::Context *rsc,
+                                   const android::renderscript::Allocation *alloc,
+                                   const void *records, size_t sizeBytes, uint32_t count);
 void rsdAllocationSyncAll(const android::renderscript::Context *rsc,
                           const android::renderscript::Allocation *alloc,
                           RsAllocationUsageType src);
@@ -155,6 +272,16 @@ void rsdAllocationData3D_alloc(const android::renderscript::Context *rsc,
                                const android::renderscript::Allocation *srcAlloc,
                                uint32_t srcXoff, uint32_t srcYoff, uint32_t srcZoff,
                                uint32_t srcLod);
+// Copies a range between allocations whose elements may have different
+// component types, converting each component.
+void rsdAllocationConvert(const android::renderscript::Context *rsc,
+                          const android::renderscript::Allocation *dstAlloc,
+                          uint32_t dstXoff, uint32_t dstYoff, uint32_t dstZoff, uint32_t dstLod,
+                          RsAllocationCubemapFace dstFace,
+                          uint32_t w, uint32_t h, uint32_t d,
+                          const android::renderscript::Allocation *srcAlloc,
+                          uint32_t srcXoff, uint32_t srcYoff, uint32_t srcZoff, uint32_t srcLod,
+                          RsAllocationCubemapFace srcFace, RsAllocationConversion conversion);
 
 void rsdAllocationElementData1D(const android::renderscript::Context *rsc,
                                 const android::renderscript::Allocation *alloc,
@@ -20,10 +20,16 @@
 
 #include "rsdBcc.h"
 #include "rsdAllocation.h"
+#ifndef RS_COMPATIBILITY_LIB
+#include "rsdQuadBatch.h"
+#include "rsdShaderCache.h"
+#include "rsdGLTimer.h"
+#endif
 
 #include "rsContext.h"
 #include "rsElement.h"
 #include "rsScriptC.h"
+#include "rsdPlacement.h"
 
 #if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
 #include "utils/Vector.h"
@@ -34,6 +40,21 @@
 using namespace android;
 using namespace android::renderscript;
 
+// The accelerator's instance of s, which is given the same globals as the
+// CPU one, or NULL.
+static RsdCpuReference::CpuScript * accelScript(const Context *rsc, const Script *s) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    return dc->mPlacement ? dc->mPlacement->getScript(s) : NULL;
+}
+
+// Only the CPU instance sees what invokables do to the globals.
+static void pinScript(const Context *rsc, const Script *s) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->mPlacement) {
+        dc->mPlacement->pin(s);
+    }
+}
+
 
 bool rsdScriptInit(const Context *rsc,
                      ScriptC *script,
@@ -48,8 +69,17 @@ bool rsdScriptInit(const Context *rsc,
     if (cs == NULL) {
         return false;
     }
+#ifndef RS_COMPATIBILITY_LIB
+    // Graphics programs are saved next to the first script's code cache.
+    if (dc->mHasGraphics) {
+        dc->gl.shaderCache->setBinaryDir(cacheDir);
+    }
+#endif
     script->mHal.drv = cs;
     cs->populateScript(script);
+    if (dc->mPlacement) {
+        dc->mPlacement->addScript(script, resName, cacheDir, bitcode, bitcodeSize, flags);
+    }
     return true;
 }
 
@@ -61,6 +91,9 @@ bool rsdInitIntrinsic(const Context *rsc, Script *s, RsScriptIntrinsicID iid, El
     }
     s->mHal.drv = cs;
     cs->populateScript(s);
+    if (dc->mPlacement) {
+        dc->mPlacement->addIntrinsic(s, iid, e);
+    }
     return true;
 }
 
@@ -73,24 +106,79 @@ void rsdScriptInvokeForEach(const Context *rsc,
                             size_t usrLen,
                             const RsScriptCall *sc) {
 
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
+    rsdAllocationFinishPendingGL(rsc);
+    if (dc->mPlacement) {
+        dc->mPlacement->forEach(cs, s, slot, false, &ain, 1, aout, usr, usrLen, sc);
+        return;
+    }
     cs->invokeForEach(slot, ain, aout, usr, usrLen, sc);
 }
 
+void rsdScriptInvokeForEachMulti(const Context *rsc,
+                                 Script *s,
+                                 uint32_t slot,
+                                 const Allocation ** ains,
+                                 size_t inLen,
+                                 Allocation * aout,
+                                 const void * usr,
+                                 size_t usrLen,
+                                 const RsScriptCall *sc) {
+
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
+    rsdAllocationFinishPendingGL(rsc);
+    if (dc->mPlacement) {
+        dc->mPlacement->forEach(cs, s, slot, true, ains, inLen, aout, usr, usrLen, sc);
+        return;
+    }
+    cs->invokeForEachMulti(slot, ains, inLen, aout, usr, usrLen, sc);
+}
+
+void rsdScriptInvokeReduce(const Context *rsc,
+                           Script *s,
+                           uint32_t accumSlot,
+                           uint32_t combineSlot,
+                           int32_t finalizeSlot,
+                           const Allocation * ain,
+                           Allocation * aout,
+                           const RsScriptCall *sc) {
+
+    RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
+    rsdAllocationFinishPendingGL(rsc);
+    cs->invokeReduce(accumSlot, combineSlot, finalizeSlot, ain, aout, sc);
+}
+
 
 int rsdScriptInvokeRoot(const Context *dc, Script *s) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
-    return cs->invokeRoot();
+    pinScript(dc, s);
+    rsdAllocationFinishPendingGL(dc);
+    int ret = cs->invokeRoot();
+#ifndef RS_COMPATIBILITY_LIB
+    // Draw the quads the frame left queued.
+    rsdQuadBatchFlush((Context *)dc);
+#endif
+    return ret;
 }
 
 void rsdScriptInvokeInit(const Context *dc, Script *s) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
     cs->invokeInit();
+    RsdCpuReference::CpuScript *accel = accelScript(dc, s);
+    if (accel) {
+        accel->invokeInit();
+    }
 }
 
 void rsdScriptInvokeFreeChildren(const Context *dc, Script *s) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
     cs->invokeFreeChildren();
+    RsdCpuReference::CpuScript *accel = accelScript(dc, s);
+    if (accel) {
+        accel->invokeFreeChildren();
+    }
 }
 
 void rsdScriptInvokeFunction(const Context *dc, Script *s,
@@ -98,13 +186,32 @@ void rsdScriptInvokeFunction(const Context *dc, Script *s,
                             const void *params,
                             size_t paramLength) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
+    pinScript(dc, s);
+    rsdAllocationFinishPendingGL(dc);
     cs->invokeFunction(slot, params, paramLength);
 }
 
+void rsdScriptInvokeFunctionBatch(const Context *dc, Script *s,
+                                  uint32_t slot,
+                                  const void *params,
+                                  size_t paramLength,
+                                  uint32_t count) {
+    RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
+    pinScript(dc, s);
+    rsdAllocationFinishPendingGL(dc);
+    cs->invokeFunctionBatch(slot, params, paramLength, count);
+}
+
 void rsdScriptSetGlobalVar(const Context *dc, const Script *s,
                            uint32_t slot, void *data, size_t dataLength) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
-    cs->setGlobalVar(slot, data, dataLength);
+    if (!cs->stageGlobalVar(slot, data, dataLength)) {
+        cs->setGlobalVar(slot, data, dataLength);
+    }
+    RsdCpuReference::CpuScript *accel = accelScript(dc, s);
+    if (accel) {
+        accel->setGlobalVar(slot, data, dataLength);
+    }
 }
 
 void rsdScriptGetGlobalVar(const Context *dc, const Script *s,
@@ -120,19 +227,52 @@ void rsdScriptSetGlobalVarWithElemDims(const Context *dc, const Script *s,
                                        const size_t *dims, size_t dimLength) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
     cs->setGlobalVarWithElemDims(slot, data, dataLength, elem, dims, dimLength);
+    RsdCpuReference::CpuScript *accel = accelScript(dc, s);
+    if (accel) {
+        accel->setGlobalVarWithElemDims(slot, data, dataLength, elem, dims, dimLength);
+    }
 }
 
 void rsdScriptSetGlobalBind(const Context *dc, const Script *s, uint32_t slot, Allocation *data) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
     cs->setGlobalBind(slot, data);
+    RsdCpuReference::CpuScript *accel = accelScript(dc, s);
+    if (accel) {
+        accel->setGlobalBind(slot, data);
+    }
 }
 
 void rsdScriptSetGlobalObj(const Context *dc, const Script *s, uint32_t slot, ObjectBase *data) {
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
     cs->setGlobalObj(slot, data);
+    RsdCpuReference::CpuScript *accel = accelScript(dc, s);
+    if (accel) {
+        accel->setGlobalObj(slot, data);
+    }
+}
+
+void rsdScriptSetGlobalVars(const Context *dc, const Script *s,
+                            const void *records, size_t sizeBytes, uint32_t count) {
+    RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
+    if (!cs->stageGlobalVars(records, sizeBytes, count)) {
+        cs->setGlobalVars(records, sizeBytes, count);
+    }
+    RsdCpuReference::CpuScript *accel = accelScript(dc, s);
+    if (accel) {
+        accel->setGlobalVars(records, sizeBytes, count);
+    }
 }
 
 void rsdScriptDestroy(const Context *dc, Script *s) {
+    RsdHal *hal = (RsdHal *)dc->mHal.drv;
+    if (hal->mPlacement) {
+        hal->mPlacement->removeScript(s);
+    }
+#ifndef RS_COMPATIBILITY_LIB
+    if (hal->mHasGraphics && hal->gl.timer) {
+        rsdGLTimerDropScript(hal->gl.timer, s);
+    }
+#endif
     RsdCpuReference::CpuScript *cs = (RsdCpuReference::CpuScript *)s->mHal.drv;
     delete cs;
     s->mHal.drv = NULL;
@@ -34,6 +34,13 @@ void rsdScriptInvokeFunction(const android::renderscript::Context *dc,
                              const void *params,
                              size_t paramLength);
 
+void rsdScriptInvokeFunctionBatch(const android::renderscript::Context *dc,
+                                  android::renderscript::Script *script,
+                                  uint32_t slot,
+                                  const void *params,
+                                  size_t paramLength,
+                                  uint32_t count);
+
 void rsdScriptInvokeForEach(const android::renderscript::Context *rsc,
                             android::renderscript::Script *s,
                             uint32_t slot,
@@ -43,6 +50,25 @@ void rsdScriptInvokeForEach(const android::renderscript::Context *rsc,
                             size_t usrLen,
                             const RsScriptCall *sc);
 
+void rsdScriptInvokeForEachMulti(const android::renderscript::Context *rsc,
+                                 android::renderscript::Script *s,
+                                 uint32_t slot,
+                                 const android::renderscript::Allocation ** ains,
+                                 size_t inLen,
+                                 android::renderscript::Allocation * aout,
+                                 const void * usr,
+                                 size_t usrLen,
+                                 const RsScriptCall *sc);
+
+void rsdScriptInvokeReduce(const android::renderscript::Context *rsc,
+                           android::renderscript::Script *s,
+                           uint32_t accumSlot,
+                           uint32_t combineSlot,
+                           int32_t finalizeSlot,
+                           const android::renderscript::Allocation * ain,
+                           android::renderscript::Allocation * aout,
+                           const RsScriptCall *sc);
+
 int rsdScriptInvokeRoot(const android::renderscript::Context *dc,
                         android::renderscript::Script *script);
 void rsdScriptInvokeInit(const android::renderscript::Context *dc,
@@ -70,6 +96,10 @@ void rsdScriptSetGlobalObj(const android::renderscript::Context *,
                            const android::renderscript::Script *,
                            uint32_t slot, android::renderscript::ObjectBase *data);
 
+void rsdScriptSetGlobalVars(const android::renderscript::Context *,
+                            const android::renderscript::Script *,
+                            const void *records, size_t sizeBytes, uint32_t count);
+
 void rsdScriptSetGlobal(const android::renderscript::Context *dc,
                         const android::renderscript::Script *script,
                         uint32_t slot,
@@ -22,6 +22,7 @@
 #ifndef RS_COMPATIBILITY_LIB
     #include "MemChunk.h"
     #include "rsdGL.h"
+    #include "rsdGLTimer.h"
     #include "rsdPath.h"
     #include "rsdProgramStore.h"
     #include "rsdProgramRaster.h"
@@ -31,6 +32,7 @@
     #include "rsdFrameBuffer.h"
 #endif
 #include "rsdSampler.h"
+#include "rsdPlacement.h"
 #include "rsdScriptGroup.h"
 
 #include <malloc.h>
@@ -47,6 +49,11 @@ using namespace android::renderscript;
 
 static void Shutdown(Context *rsc);
 static void SetPriority(const Context *rsc, int32_t priority);
+static void Finish(const Context *rsc);
+static size_t TrimMemory(const Context *rsc, int32_t level);
+static void LaunchThreads(const Context *rsc, WorkerCallback_t cbk, void *data);
+static uint32_t GetProfile(const Context *rsc, RsKernelProfile *profiles, uint32_t count);
+static int32_t Idle(const Context *rsc);
 
 #ifndef RS_COMPATIBILITY_LIB
     #define NATIVE_FUNC(a) a
@@ -79,7 +86,11 @@ static RsdHalFunctions FunctionTable = {
         rsdScriptSetGlobalVarWithElemDims,
         rsdScriptSetGlobalBind,
         rsdScriptSetGlobalObj,
-        rsdScriptDestroy
+        rsdScriptDestroy,
+        rsdScriptSetGlobalVars,
+        rsdScriptInvokeForEachMulti,
+        rsdScriptInvokeReduce,
+        rsdScriptInvokeFunctionBatch
     },
 
     {
@@ -105,7 +116,15 @@ static RsdHalFunctions FunctionTable = {
         rsdAllocationData3D_alloc,
         rsdAllocationElementData1D,
         rsdAllocationElementData2D,
-        rsdAllocationGenerateMipmaps
+        rsdAllocationGenerateMipmaps,
+        rsdAllocationReserve,
+        rsdAllocationElementDataBatch,
+        rsdAllocationInitAdapter,
+        rsdAllocationAdapterOffset,
+        rsdAllocationExportShared,
+        rsdAllocationSort,
+        rsdAllocationCompact,
+        rsdAllocationConvert
     },
 
 
@@ -136,7 +155,8 @@ static RsdHalFunctions FunctionTable = {
     {
         NATIVE_FUNC(rsdMeshInit),
         NATIVE_FUNC(rsdMeshDraw),
-        NATIVE_FUNC(rsdMeshDestroy)
+        NATIVE_FUNC(rsdMeshDestroy),
+        NATIVE_FUNC(rsdMeshDrawInstanced)
     },
 
     {
@@ -162,10 +182,15 @@ static RsdHalFunctions FunctionTable = {
         rsdScriptGroupSetInput,
         rsdScriptGroupSetOutput,
         rsdScriptGroupExecute,
-        rsdScriptGroupDestroy
+        rsdScriptGroupDestroy,
+        rsdScriptGroupSetPipelined
     },
 
-    NULL // finish
+    Finish,
+    TrimMemory,
+    LaunchThreads,
+    GetProfile,
+    Idle
 };
 
 extern const RsdCpuReference::CpuSymbol * rsdLookupRuntimeStub(Context * pContext, char const* name);
@@ -194,6 +219,9 @@ extern "C" bool rsdHalInit(RsContext c, uint32_t version_major,
         return false;
     }
 
+    dc->mAllocPool = rsdAllocationPoolCreate();
+    dc->mPlacement = RsdPlacement::create(rsc);
+
 #ifndef RS_COMPATIBILITY_LIB
     // Set a callback for compiler setup here.
     if (false) {
@@ -227,12 +255,75 @@ void SetPriority(const Context *rsc, int32_t priority) {
 #endif
 }
 
+void Finish(const Context *rsc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+
+    dc->mCpuRef->finishLaunches();
+}
+
+size_t TrimMemory(const Context *rsc, int32_t level) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+
+    size_t freed = rsdAllocationPoolTrim(rsc);
+    if (level >= RS_TRIM_MEMORY_RUNNING_LOW) {
+        freed += dc->mCpuRef->trimMemory();
+    }
+#ifndef RS_COMPATIBILITY_LIB
+    // Linked programs are largely kept in binary form on disk, but
+    // relinking them still costs a frame.
+    if (dc->mHasGraphics && dc->gl.shaderCache && (level >= RS_TRIM_MEMORY_RUNNING_CRITICAL)) {
+        dc->gl.shaderCache->trim();
+    }
+#endif
+    return freed;
+}
+
+int32_t Idle(const Context *rsc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+
+    int32_t wait = rsdAllocationPoolIdle(rsc);
+    int32_t cpuWait = dc->mCpuRef->idle();
+    if ((wait < 0) || ((cpuWait >= 0) && (cpuWait < wait))) {
+        wait = cpuWait;
+    }
+    return wait;
+}
+
+void LaunchThreads(const Context *rsc, WorkerCallback_t cbk, void *data) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+
+    dc->mCpuRef->launchThreads(cbk, data);
+}
+
+uint32_t GetProfile(const Context *rsc, RsKernelProfile *profiles, uint32_t count) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+
+    uint32_t total = dc->mCpuRef->getProfile(profiles, count);
+#ifndef RS_COMPATIBILITY_LIB
+    if (dc->mHasGraphics && dc->gl.timer) {
+        const uint32_t copied = rsMin(total, count);
+        total += rsdGLTimerGetProfile(dc->gl.timer, profiles ? profiles + copied : NULL,
+                                      count - copied);
+    }
+#endif
+    return total;
+}
+
 void Shutdown(Context *rsc) {
     RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    delete dc->mPlacement;
     delete dc->mCpuRef;
+    rsdAllocationPoolDestroy(dc->mAllocPool);
+    dc->mAllocPool = NULL;
     rsc->mHal.drv = NULL;
 }
 
+void rsdLaunchThreads(Context *rsc, WorkerCallback_t cbk, void *data) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+
+    dc->mCpuRef->launchThreads(cbk, data);
+}
+
 void* rsdAllocRuntimeMem(size_t size, uint32_t flags) {
     void* buffer = calloc(size, sizeof(char));
     return buffer;
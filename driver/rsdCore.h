@@ -45,6 +45,9 @@ typedef struct RsdHalRec {
 
     ScriptTLSStruct mTlsStruct;
     android::renderscript::RsdCpuReference *mCpuRef;
+    struct RsdAllocationPool *mAllocPool;
+    // Routes kernels to an accelerator, NULL without one.
+    class RsdPlacement *mPlacement;
 
 #ifndef RS_COMPATIBILITY_LIB
     RsdGL gl;
@@ -29,44 +29,49 @@
 using namespace android;
 using namespace android::renderscript;
 
-void setDepthAttachment(const Context *rsc, const FBOCache *fb) {
-    RsdFrameBufferObj *fbo = (RsdFrameBufferObj*)fb->mHal.drv;
-
-    DrvAllocation *depth = NULL;
-    if (fb->mHal.state.depthTarget != NULL) {
-        depth = (DrvAllocation *)fb->mHal.state.depthTarget->mHal.drv;
-
-        if (depth->uploadDeferred) {
-            rsdAllocationSyncAll(rsc, fb->mHal.state.depthTarget,
-                                 RS_ALLOCATION_USAGE_SCRIPT);
-        }
+// One framebuffer object per set of targets bound lately, most recently
+// used last, so switching back to a set only rebinds its object.
+struct RsdFrameBufferSet {
+    enum {
+        MAX_FBOS = 8,
+        MAX_COLOR_TARGETS = 8
+    };
+    Vector<RsdFrameBufferObj *> fbos;
+};
+
+static DrvAllocation * getTarget(const Context *rsc, Allocation *a) {
+    if (a == NULL) {
+        return NULL;
     }
-    fbo->setDepthTarget(depth);
+    DrvAllocation *drv = (DrvAllocation *)a->mHal.drv;
+    if (drv->uploadDeferred) {
+        rsdAllocationSyncAll(rsc, a, RS_ALLOCATION_USAGE_SCRIPT);
+    }
+    return drv;
 }
 
-void setColorAttachment(const Context *rsc, const FBOCache *fb) {
-    RsdFrameBufferObj *fbo = (RsdFrameBufferObj*)fb->mHal.drv;
-    // Now attach color targets
-    for (uint32_t i = 0; i < fb->mHal.state.colorTargetsCount; i ++) {
-        DrvAllocation *color = NULL;
-        if (fb->mHal.state.colorTargets[i] != NULL) {
-            color = (DrvAllocation *)fb->mHal.state.colorTargets[i]->mHal.drv;
-
-            if (color->uploadDeferred) {
-                rsdAllocationSyncAll(rsc, fb->mHal.state.colorTargets[i],
-                                     RS_ALLOCATION_USAGE_SCRIPT);
-            }
+static bool hasTargets(const RsdFrameBufferObj *fbo, DrvAllocation *depth,
+                       DrvAllocation **colors, uint32_t colorCount) {
+    if (fbo->getDepthTarget() != depth) {
+        return false;
+    }
+    for (uint32_t i = 0; i < colorCount; i ++) {
+        if (fbo->getColorTarget(i) != colors[i]) {
+            return false;
         }
-        fbo->setColorTarget(color, i);
     }
+    return true;
 }
 
 bool rsdFrameBufferInit(const Context *rsc, const FBOCache *fb) {
-    RsdFrameBufferObj *fbo = new RsdFrameBufferObj();
-    if (fbo == NULL) {
+    RsdFrameBufferSet *set = new RsdFrameBufferSet();
+    if (set == NULL) {
         return false;
     }
-    fb->mHal.drv = fbo;
+    // Starts out drawing to the window
+    RsdFrameBufferObj *fbo = new RsdFrameBufferObj();
+    set->fbos.push(fbo);
+    fb->mHal.drv = set;
 
     RsdHal *dc = (RsdHal *)rsc->mHal.drv;
     dc->gl.currentFrameBuffer = fbo;
@@ -75,10 +80,43 @@ bool rsdFrameBufferInit(const Context *rsc, const FBOCache *fb) {
 }
 
 void rsdFrameBufferSetActive(const Context *rsc, const FBOCache *fb) {
-    setDepthAttachment(rsc, fb);
-    setColorAttachment(rsc, fb);
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    RsdFrameBufferSet *set = (RsdFrameBufferSet *)fb->mHal.drv;
+
+    DrvAllocation *depth = getTarget(rsc, fb->mHal.state.depthTarget);
+    uint32_t colorCount = fb->mHal.state.colorTargetsCount;
+    if (colorCount > dc->gl.currentFrameBuffer->getColorTargetsCount()) {
+        colorCount = dc->gl.currentFrameBuffer->getColorTargetsCount();
+    }
+    if (colorCount > RsdFrameBufferSet::MAX_COLOR_TARGETS) {
+        colorCount = RsdFrameBufferSet::MAX_COLOR_TARGETS;
+    }
+    DrvAllocation *colors[RsdFrameBufferSet::MAX_COLOR_TARGETS];
+    for (uint32_t i = 0; i < colorCount; i ++) {
+        colors[i] = getTarget(rsc, fb->mHal.state.colorTargets[i]);
+    }
+
+    RsdFrameBufferObj *fbo = NULL;
+    for (uint32_t i = 0; i < set->fbos.size(); i ++) {
+        if (hasTargets(set->fbos[i], depth, colors, colorCount)) {
+            fbo = set->fbos[i];
+            set->fbos.removeAt(i);
+            break;
+        }
+    }
+    if (fbo == NULL) {
+        if (set->fbos.size() >= RsdFrameBufferSet::MAX_FBOS) {
+            delete set->fbos[0];
+            set->fbos.removeAt(0);
+        }
+        fbo = new RsdFrameBufferObj();
+        fbo->setDepthTarget(depth);
+        for (uint32_t i = 0; i < colorCount; i ++) {
+            fbo->setColorTarget(colors[i], i);
+        }
+    }
+    set->fbos.push(fbo);
 
-    RsdFrameBufferObj *fbo = (RsdFrameBufferObj *)fb->mHal.drv;
     if (fb->mHal.state.colorTargets[0]) {
         fbo->setDimensions(fb->mHal.state.colorTargets[0]->getType()->getDimX(),
                            fb->mHal.state.colorTargets[0]->getType()->getDimY());
@@ -87,13 +125,45 @@ void rsdFrameBufferSetActive(const Context *rsc, const FBOCache *fb) {
                            fb->mHal.state.depthTarget->getType()->getDimY());
     }
 
+    dc->gl.currentFrameBuffer = fbo;
     fbo->setActive(rsc);
 }
 
 void rsdFrameBufferDestroy(const Context *rsc, const FBOCache *fb) {
-    RsdFrameBufferObj *fbo = (RsdFrameBufferObj *)fb->mHal.drv;
-    delete fbo;
+    RsdFrameBufferSet *set = (RsdFrameBufferSet *)fb->mHal.drv;
+    if (set == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < set->fbos.size(); i ++) {
+        delete set->fbos[i];
+    }
+    delete set;
     fb->mHal.drv = NULL;
-}
 
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    dc->gl.currentFrameBuffer = NULL;
+}
 
+void rsdFrameBufferReleaseTarget(const Context *rsc, const DrvAllocation *target) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    RsdFrameBufferSet *set = (RsdFrameBufferSet *)rsc->mFBOCache.mHal.drv;
+    if (set == NULL) {
+        return;
+    }
+    for (int32_t i = (int32_t)set->fbos.size() - 1; i >= 0; i --) {
+        RsdFrameBufferObj *fbo = set->fbos[i];
+        if (!fbo->usesTarget(target)) {
+            continue;
+        }
+        if (fbo == dc->gl.currentFrameBuffer) {
+            // Still bound until the next setup, so only let go of the target
+            fbo->setDepthTarget(NULL);
+            for (uint32_t ct = 0; ct < fbo->getColorTargetsCount(); ct ++) {
+                fbo->setColorTarget(NULL, ct);
+            }
+        } else {
+            delete fbo;
+            set->fbos.removeAt(i);
+        }
+    }
+}
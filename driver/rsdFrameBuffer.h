@@ -19,12 +19,17 @@
 
 #include <rs_hal.h>
 
+struct DrvAllocation;
+
 bool rsdFrameBufferInit(const android::renderscript::Context *rsc,
                          const android::renderscript::FBOCache *fb);
 void rsdFrameBufferSetActive(const android::renderscript::Context *rsc,
                               const android::renderscript::FBOCache *fb);
 void rsdFrameBufferDestroy(const android::renderscript::Context *rsc,
                             const android::renderscript::FBOCache *fb);
+// Drops the framebuffer objects attached to a target about to be freed.
+void rsdFrameBufferReleaseTarget(const android::renderscript::Context *rsc,
+                                 const DrvAllocation *target);
 
 
 #endif // RSD_FRAME_BUFFER_H
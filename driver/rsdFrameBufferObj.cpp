@@ -37,6 +37,7 @@ RsdFrameBufferObj::RsdFrameBufferObj() {
     }
     mDepthTarget = NULL;
     mDirty = true;
+    mValidated = false;
 }
 
 RsdFrameBufferObj::~RsdFrameBufferObj() {
@@ -46,12 +47,12 @@ RsdFrameBufferObj::~RsdFrameBufferObj() {
     delete [] mColorTargets;
 }
 
-void RsdFrameBufferObj::checkError(const Context *rsc) {
+bool RsdFrameBufferObj::checkError(const Context *rsc) {
     GLenum status;
     status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     switch (status) {
     case GL_FRAMEBUFFER_COMPLETE:
-        break;
+        return true;
     case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT:
         rsc->setError(RS_ERROR_BAD_VALUE,
                       "Unable to set up render Target: RFRAMEBUFFER_INCOMPLETE_ATTACHMENT");
@@ -69,6 +70,7 @@ void RsdFrameBufferObj::checkError(const Context *rsc) {
                       "Unable to set up render Target: GL_FRAMEBUFFER_UNSUPPORTED");
         break;
     }
+    return false;
 }
 
 
@@ -109,6 +111,18 @@ void RsdFrameBufferObj::setColorAttachment() {
     }
 }
 
+bool RsdFrameBufferObj::usesTarget(const DrvAllocation *target) const {
+    if (mDepthTarget == target) {
+        return true;
+    }
+    for (uint32_t i = 0; i < mColorTargetsCount; i ++) {
+        if (mColorTargets[i] == target) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool RsdFrameBufferObj::renderToFramebuffer() {
     if (mDepthTarget != NULL) {
         return false;
@@ -143,10 +157,14 @@ void RsdFrameBufferObj::setActive(const Context *rsc) {
                 setDepthAttachment();
                 setColorAttachment();
                 mDirty = false;
+                mValidated = false;
             }
 
             RSD_CALL_GL(glViewport, 0, 0, mWidth, mHeight);
-            checkError(rsc);
+            // Attachments don't change once complete, so neither does that
+            if (!mValidated) {
+                mValidated = checkError(rsc);
+            }
         } else {
             if(dc->gl.wndSurface != dc->gl.currentWndSurface) {
                 rsdGLSetInternalSurface(rsc, dc->gl.wndSurface);
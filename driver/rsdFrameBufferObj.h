@@ -39,6 +39,16 @@ public:
         mWidth = width;
         mHeight = height;
     }
+    DrvAllocation * getColorTarget(uint32_t index) const {
+        return mColorTargets[index];
+    }
+    uint32_t getColorTargetsCount() const {
+        return mColorTargetsCount;
+    }
+    DrvAllocation * getDepthTarget() const {
+        return mDepthTarget;
+    }
+    bool usesTarget(const DrvAllocation *target) const;
 protected:
     uint32_t mFBOId;
     DrvAllocation **mColorTargets;
@@ -49,9 +59,11 @@ protected:
     uint32_t mHeight;
 
     bool mDirty;
+    // Set once the attachments have been found complete
+    bool mValidated;
 
     bool renderToFramebuffer();
-    void checkError(const android::renderscript::Context *rsc);
+    bool checkError(const android::renderscript::Context *rsc);
     void setColorAttachment();
     void setDepthAttachment();
 };
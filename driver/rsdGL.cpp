@@ -38,9 +38,13 @@
 #include <malloc.h>
 #include "rsContext.h"
 #include "rsDevice.h"
+#include "rsdQuadBatch.h"
 #include "rsdShaderCache.h"
 #include "rsdVertexArray.h"
 #include "rsdFrameBufferObj.h"
+#include "rsdAllocation.h"
+#include "rsdGLWorker.h"
+#include "rsdGLTimer.h"
 
 #include <gui/Surface.h>
 
@@ -49,6 +53,137 @@ using namespace android::renderscript;
 
 static int32_t gGLContextCount = 0;
 
+static void initUploadRing(const Context *rsc, RsdHal *dc) {
+    memset(&dc->gl.upload, 0, sizeof(dc->gl.upload));
+    memset(&dc->gl.readback, 0, sizeof(dc->gl.readback));
+    memset(&dc->gl.pending, 0, sizeof(dc->gl.pending));
+    memset(&dc->gl.frames, 0, sizeof(dc->gl.frames));
+    const bool pipelined = rsc->props.mDebugPipelineFrames > 1;
+    if (!(rsc->props.mDebugTexturePbo || rsc->props.mDebugReadbackPbo || pipelined) ||
+        (dc->gl.gl.majorVersion < 3)) {
+        return;
+    }
+
+    dc->gl.upload.mapBufferRange = (void * (*)(uint32_t, intptr_t, intptr_t, uint32_t))
+            eglGetProcAddress("glMapBufferRange");
+    dc->gl.upload.unmapBuffer = (uint8_t (*)(uint32_t))eglGetProcAddress("glUnmapBuffer");
+    dc->gl.upload.fenceSync = (void * (*)(uint32_t, uint32_t))eglGetProcAddress("glFenceSync");
+    dc->gl.upload.clientWaitSync = (uint32_t (*)(void *, uint32_t, uint64_t))
+            eglGetProcAddress("glClientWaitSync");
+    dc->gl.upload.deleteSync = (void (*)(void *))eglGetProcAddress("glDeleteSync");
+    if (!dc->gl.upload.mapBufferRange || !dc->gl.upload.unmapBuffer ||
+        !dc->gl.upload.fenceSync || !dc->gl.upload.clientWaitSync ||
+        !dc->gl.upload.deleteSync) {
+        ALOGV("GLES3 sync entry points missing, texture uploads and readbacks won't use PBOs");
+        return;
+    }
+
+    if (pipelined) {
+        dc->gl.frames.count = rsMin(rsc->props.mDebugPipelineFrames,
+                                    (uint32_t)RSD_GL_MAX_FRAMES);
+    }
+
+    if (rsc->props.mDebugTexturePbo) {
+        glGenBuffers(RSD_UPLOAD_RING_SIZE, dc->gl.upload.buffers);
+        dc->gl.upload.enabled = true;
+    }
+    dc->gl.readback.enabled = rsc->props.mDebugReadbackPbo;
+}
+
+static void shutdownUploadRing(const Context *rsc, RsdHal *dc) {
+    rsdAllocationFinishPendingGL(rsc);
+    dc->gl.readback.enabled = false;
+    for (uint32_t ct = 0; ct < dc->gl.frames.count; ct++) {
+        if (dc->gl.frames.fences[ct]) {
+            dc->gl.upload.deleteSync(dc->gl.frames.fences[ct]);
+            dc->gl.frames.fences[ct] = NULL;
+        }
+    }
+    dc->gl.frames.count = 0;
+    if (!dc->gl.upload.enabled) {
+        return;
+    }
+    for (uint32_t ct = 0; ct < RSD_UPLOAD_RING_SIZE; ct++) {
+        if (dc->gl.upload.fences[ct]) {
+            dc->gl.upload.deleteSync(dc->gl.upload.fences[ct]);
+            dc->gl.upload.fences[ct] = NULL;
+        }
+    }
+    RSD_CALL_GL(glDeleteBuffers, RSD_UPLOAD_RING_SIZE, dc->gl.upload.buffers);
+    dc->gl.upload.enabled = false;
+}
+
+static void initProgramBinary(RsdHal *dc) {
+    memset(&dc->gl.programBinary, 0, sizeof(dc->gl.programBinary));
+    if (!strstr((const char *)dc->gl.gl.extensions, "GL_OES_get_program_binary")) {
+        return;
+    }
+    GLint formatCount = 0;
+    glGetIntegerv(RSD_GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0) {
+        return;
+    }
+
+    dc->gl.programBinary.getProgramBinary =
+            (void (*)(uint32_t, int32_t, int32_t *, uint32_t *, void *))
+            eglGetProcAddress("glGetProgramBinaryOES");
+    dc->gl.programBinary.programBinary =
+            (void (*)(uint32_t, uint32_t, const void *, int32_t))
+            eglGetProcAddress("glProgramBinaryOES");
+    if (!dc->gl.programBinary.getProgramBinary || !dc->gl.programBinary.programBinary) {
+        return;
+    }
+
+    uint32_t h = RS_HASH_SEED;
+    const uint8_t *ids[] = {dc->gl.gl.vendor, dc->gl.gl.renderer, dc->gl.gl.version};
+    for (size_t ct = 0; ct < sizeof(ids) / sizeof(ids[0]); ct++) {
+        h = rsHashBytes(h, ids[ct], strlen((const char *)ids[ct]));
+    }
+    dc->gl.programBinary.driverHash = h;
+    dc->gl.programBinary.enabled = true;
+}
+
+static void initInstancing(RsdHal *dc) {
+    memset(&dc->gl.instancing, 0, sizeof(dc->gl.instancing));
+    if (dc->gl.gl.majorVersion < 3) {
+        return;
+    }
+
+    dc->gl.instancing.drawArraysInstanced = (void (*)(uint32_t, int32_t, int32_t, int32_t))
+            eglGetProcAddress("glDrawArraysInstanced");
+    dc->gl.instancing.drawElementsInstanced =
+            (void (*)(uint32_t, int32_t, uint32_t, const void *, int32_t))
+            eglGetProcAddress("glDrawElementsInstanced");
+    dc->gl.instancing.vertexAttribDivisor = (void (*)(uint32_t, uint32_t))
+            eglGetProcAddress("glVertexAttribDivisor");
+    dc->gl.instancing.enabled = dc->gl.instancing.drawArraysInstanced &&
+                                dc->gl.instancing.drawElementsInstanced &&
+                                dc->gl.instancing.vertexAttribDivisor;
+}
+
+static void initEglImage(const Context *rsc, RsdHal *dc) {
+    memset(&dc->gl.eglImage, 0, sizeof(dc->gl.eglImage));
+    if (!rsc->props.mDebugTextureEglImage) {
+        return;
+    }
+    const char *eglExtensions = eglQueryString(dc->gl.egl.display, EGL_EXTENSIONS);
+    if (!eglExtensions || !strstr(eglExtensions, "EGL_ANDROID_image_native_buffer") ||
+        !strstr((const char *)dc->gl.gl.extensions, "GL_OES_EGL_image")) {
+        ALOGV("EGL images of native buffers missing, script textures will be uploaded");
+        return;
+    }
+
+    dc->gl.eglImage.createImage =
+            (void * (*)(EGLDisplay, EGLContext, EGLenum, EGLClientBuffer, const EGLint *))
+            eglGetProcAddress("eglCreateImageKHR");
+    dc->gl.eglImage.destroyImage = (EGLBoolean (*)(EGLDisplay, void *))
+            eglGetProcAddress("eglDestroyImageKHR");
+    dc->gl.eglImage.imageTargetTexture2D = (void (*)(uint32_t, void *))
+            eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    dc->gl.eglImage.enabled = dc->gl.eglImage.createImage && dc->gl.eglImage.destroyImage &&
+                              dc->gl.eglImage.imageTargetTexture2D;
+}
+
 static void checkEglError(const char* op, EGLBoolean returnVal = EGL_TRUE) {
     struct EGLUtils {
         static const char *strerror(EGLint err) {
@@ -154,9 +289,26 @@ void rsdGLShutdown(const Context *rsc) {
     RsdHal *dc = (RsdHal *)rsc->mHal.drv;
 
     rsdGLSetSurface(rsc, 0, 0, NULL);
+    shutdownUploadRing(rsc, dc);
+    if (rsc->props.mLogShaders) {
+        RsdShaderCache::Stats stats;
+        dc->gl.shaderCache->getStats(&stats);
+        ALOGV("Program cache: %u hits, %u misses, %u evictions, %u programs",
+              stats.hits, stats.misses, stats.evictions, stats.programs);
+        ALOGV("Redundant GL state calls skipped: %u", dc->gl.stateCallsSkipped);
+    }
+    rsdQuadBatchDestroy(dc->gl.quadBatch);
     dc->gl.shaderCache->cleanupAll();
     delete dc->gl.shaderCache;
     delete dc->gl.vertexArrayState;
+    if (dc->gl.worker) {
+        rsdGLWorkerDestroy(dc->gl.worker);
+        dc->gl.worker = NULL;
+    }
+    if (dc->gl.timer) {
+        rsdGLTimerDestroy(dc->gl.timer);
+        dc->gl.timer = NULL;
+    }
 
     if (dc->gl.egl.context != EGL_NO_CONTEXT) {
         RSD_CALL_GL(eglMakeCurrent, dc->gl.egl.display,
@@ -394,6 +546,12 @@ bool rsdGLInit(const Context *rsc) {
                                                    "GL_IMG_texture_npot");
     dc->gl.gl.NV_texture_npot_2D_mipmap = NULL != strstr((const char *)dc->gl.gl.extensions,
                                                             "GL_NV_texture_npot_2D_mipmap");
+    dc->gl.gl.halfFloatVertexType = 0;
+    if (strstr((const char *)dc->gl.gl.extensions, "GL_OES_vertex_half_float")) {
+        dc->gl.gl.halfFloatVertexType = RSD_GL_HALF_FLOAT_OES;
+    } else if (dc->gl.gl.majorVersion >= 3) {
+        dc->gl.gl.halfFloatVertexType = RSD_GL_HALF_FLOAT;
+    }
     dc->gl.gl.EXT_texture_max_aniso = 1.0f;
     bool hasAniso = NULL != strstr((const char *)dc->gl.gl.extensions,
                                    "GL_EXT_texture_filter_anisotropic");
@@ -405,7 +563,20 @@ bool rsdGLInit(const Context *rsc) {
         DumpDebug(dc);
     }
 
+    initUploadRing(rsc, dc);
+    initProgramBinary(dc);
+    initInstancing(dc);
+    initEglImage(rsc, dc);
+    dc->gl.worker = rsc->props.mDebugGLWorker ? rsdGLWorkerCreate(rsc) : NULL;
+    dc->gl.timer = NULL;
+    if (rsc->props.mDebugGpuTimer) {
+        dc->gl.timer = rsdGLTimerCreate(rsc, rsc->props.mDebugGpuTimer > 1);
+    }
+    rsdGLInvalidateState(rsc);
+    dc->gl.stateCallsSkipped = 0;
+
     dc->gl.shaderCache = new RsdShaderCache();
+    dc->gl.quadBatch = rsdQuadBatchCreate();
     dc->gl.vertexArrayState = new RsdVertexArrayState();
     dc->gl.vertexArrayState->init(dc->gl.gl.maxVertexAttribs);
     dc->gl.currentFrameBuffer = NULL;
@@ -480,7 +651,26 @@ bool rsdGLSetSurface(const Context *rsc, uint32_t w, uint32_t h, RsNativeWindow
 
 void rsdGLSwap(const android::renderscript::Context *rsc) {
     RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->gl.timer) {
+        rsdGLTimerFrame(rsc, dc->gl.timer);
+    }
+    const uint32_t count = dc->gl.frames.count;
+    if (count) {
+        dc->gl.frames.fences[dc->gl.frames.index % count] =
+                dc->gl.upload.fenceSync(RSD_GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
     RSD_CALL_GL(eglSwapBuffers, dc->gl.egl.display, dc->gl.egl.surface);
+    if (count) {
+        dc->gl.frames.index++;
+        void **fence = &dc->gl.frames.fences[dc->gl.frames.index % count];
+        if (*fence) {
+            ATRACE_NAME("rsdGLSwap wait frame");
+            dc->gl.upload.clientWaitSync(*fence, RSD_GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         RSD_GL_TIMEOUT_IGNORED);
+            dc->gl.upload.deleteSync(*fence);
+            *fence = NULL;
+        }
+    }
 }
 
 void rsdGLSetPriority(const Context *rsc, int32_t priority) {
@@ -532,6 +722,81 @@ void rsdGLFinish(const android::renderscript::Context *rsc) {
     RSD_CALL_GL(glFinish);
 }
 
+void rsdGLInvalidateState(const android::renderscript::Context *rsc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    memset(&dc->gl.state, 0xff, sizeof(dc->gl.state));
+}
+
+void rsdGLSetCap(const android::renderscript::Context *rsc, uint32_t cap, bool enable) {
+    static const GLenum glCaps[RSD_GL_CAP_COUNT] = {
+        GL_BLEND, GL_DEPTH_TEST, GL_DITHER, GL_CULL_FACE
+    };
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->gl.state.caps[cap] == (uint8_t)enable) {
+        dc->gl.stateCallsSkipped++;
+        return;
+    }
+    dc->gl.state.caps[cap] = enable;
+    if (enable) {
+        RSD_CALL_GL(glEnable, glCaps[cap]);
+    } else {
+        RSD_CALL_GL(glDisable, glCaps[cap]);
+    }
+}
+
+void rsdGLSetBlendFunc(const android::renderscript::Context *rsc, uint32_t src, uint32_t dst) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if ((dc->gl.state.blendSrc == src) && (dc->gl.state.blendDst == dst)) {
+        dc->gl.stateCallsSkipped++;
+        return;
+    }
+    dc->gl.state.blendSrc = src;
+    dc->gl.state.blendDst = dst;
+    RSD_CALL_GL(glBlendFunc, src, dst);
+}
+
+void rsdGLSetDepthFunc(const android::renderscript::Context *rsc, uint32_t func) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->gl.state.depthFunc == func) {
+        dc->gl.stateCallsSkipped++;
+        return;
+    }
+    dc->gl.state.depthFunc = func;
+    RSD_CALL_GL(glDepthFunc, func);
+}
+
+void rsdGLSetDepthMask(const android::renderscript::Context *rsc, bool enable) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->gl.state.depthMask == (uint8_t)enable) {
+        dc->gl.stateCallsSkipped++;
+        return;
+    }
+    dc->gl.state.depthMask = enable;
+    RSD_CALL_GL(glDepthMask, enable);
+}
+
+void rsdGLSetColorMask(const android::renderscript::Context *rsc,
+                       bool r, bool g, bool b, bool a) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    uint32_t mask = (r ? 1 : 0) | (g ? 2 : 0) | (b ? 4 : 0) | (a ? 8 : 0);
+    if (dc->gl.state.colorMask == mask) {
+        dc->gl.stateCallsSkipped++;
+        return;
+    }
+    dc->gl.state.colorMask = mask;
+    RSD_CALL_GL(glColorMask, r, g, b, a);
+}
+
+void rsdGLSetCullFace(const android::renderscript::Context *rsc, uint32_t face) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->gl.state.cullFace == face) {
+        dc->gl.stateCallsSkipped++;
+        return;
+    }
+    dc->gl.state.cullFace = face;
+    RSD_CALL_GL(glCullFace, face);
+}
+
 void rsdGLDrawQuadTexCoords(const android::renderscript::Context *rsc,
                             float x1, float y1, float z1, float u1, float v1,
                             float x2, float y2, float z2, float u2, float v2,
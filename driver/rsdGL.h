@@ -23,12 +23,59 @@
 #define RSD_CALL_GL(x, ...) rsc->setWatchdogGL(#x, __LINE__, __FILE__); x(__VA_ARGS__); rsc->setWatchdogGL(NULL, 0, NULL)
 
 class RsdShaderCache;
+struct RsdQuadBatch;
 class RsdVertexArrayState;
 class RsdFrameBufferObj;
+struct RsdGLWorker;
+struct RsdGLTimer;
 
 typedef void (* InvokeFunc_t)(void);
 typedef void (*WorkerCallback_t)(void *usr, uint32_t idx);
 
+// Number of pixel buffers texture uploads are staged through.
+#define RSD_UPLOAD_RING_SIZE 3
+
+// GLES3 enums used by the upload ring; the driver builds against GLES2
+// headers and looks the GLES3 entry points up at init.
+#define RSD_GL_PIXEL_UNPACK_BUFFER 0x88EC
+#define RSD_GL_MAP_WRITE_BIT 0x0002
+#define RSD_GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#define RSD_GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#define RSD_GL_SYNC_FLUSH_COMMANDS_BIT 0x0001
+#define RSD_GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define RSD_GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#define RSD_GL_PIXEL_PACK_BUFFER 0x88EB
+#define RSD_GL_STREAM_READ 0x88E1
+#define RSD_GL_MAP_READ_BIT 0x0001
+
+// Allocations GL may still be reading or filling before the oldest is
+// waited on.
+#define RSD_GL_MAX_PENDING 8
+
+// Most frames debug.rs.pipeline-frames can have in flight.
+#define RSD_GL_MAX_FRAMES 3
+
+// EGL_KHR_image_base and EGL_ANDROID_image_native_buffer enums.
+#define RSD_EGL_IMAGE_PRESERVED_KHR 0x30D2
+#define RSD_EGL_NATIVE_BUFFER_ANDROID 0x3140
+
+// GL_OES_get_program_binary enums.
+#define RSD_GL_PROGRAM_BINARY_LENGTH 0x8741
+#define RSD_GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+// GL_OES_vertex_half_float and GLES3 half float types.
+#define RSD_GL_HALF_FLOAT_OES 0x8D61
+#define RSD_GL_HALF_FLOAT 0x140B
+
+// Capabilities whose enable state the driver shadows.
+enum {
+    RSD_GL_CAP_BLEND,
+    RSD_GL_CAP_DEPTH_TEST,
+    RSD_GL_CAP_DITHER,
+    RSD_GL_CAP_CULL_FACE,
+    RSD_GL_CAP_COUNT
+};
+
 typedef struct RsdGLRec {
     struct {
         EGLint numConfigs;
@@ -64,12 +111,118 @@ typedef struct RsdGLRec {
         bool IMG_texture_npot;
         bool NV_texture_npot_2D_mipmap;
         float EXT_texture_max_aniso;
+        // Type half float vertex attributes are passed with, or 0 when
+        // neither GL_OES_vertex_half_float nor GLES3 is there.
+        uint32_t halfFloatVertexType;
     } gl;
 
+    // Ring of pixel unpack buffers used to stream texture updates when
+    // debug.rs.texture-pbo is set and the context is GLES3 capable.  Each
+    // buffer carries the fence of the last upload made from it.
+    struct {
+        bool enabled;
+        uint32_t next;
+        uint32_t buffers[RSD_UPLOAD_RING_SIZE];
+        size_t sizes[RSD_UPLOAD_RING_SIZE];
+        void *fences[RSD_UPLOAD_RING_SIZE];
+
+        void * (*mapBufferRange)(uint32_t target, intptr_t offset, intptr_t length,
+                                 uint32_t access);
+        uint8_t (*unmapBuffer)(uint32_t target);
+        void * (*fenceSync)(uint32_t condition, uint32_t flags);
+        uint32_t (*clientWaitSync)(void *sync, uint32_t flags, uint64_t timeout);
+        void (*deleteSync)(void *sync);
+    } upload;
+
+    // Render target readbacks are made into pixel pack buffers when
+    // debug.rs.readback-pbo is set, using the entry points above.
+    struct {
+        bool enabled;
+    } readback;
+
+    // Allocations with a readback or a worker upload in flight, which
+    // the CPU has to wait for before it next uses their memory.
+    struct {
+        uint32_t count;
+        const android::renderscript::Allocation *allocs[RSD_GL_MAX_PENDING];
+    } pending;
+
+    // Frames drawn pipelined, when debug.rs.pipeline-frames is set and the
+    // context has GLES3 fences: up to count of them are in flight, the one
+    // being drawn included, using the upload entry points.  Each swap
+    // fences the frame it ends in slot index % count, then waits for the
+    // frame last drawn in the next slot, so what is kept per slot can be
+    // rewritten by the frame after it.
+    struct {
+        uint32_t count;
+        uint32_t index;
+        void *fences[RSD_GL_MAX_FRAMES];
+    } frames;
+
+    // Thread texture uploads and shader compiles are handed to when
+    // debug.rs.gl-worker is set, or NULL.
+    RsdGLWorker *worker;
+
+    // Times draw groups on the GPU when debug.rs.gpu-timer is set, 2
+    // timing each rsgDrawMesh on its own, or NULL.
+    RsdGLTimer *timer;
+
+    // GL_OES_get_program_binary entry points, set when the driver offers at
+    // least one binary format.  driverHash identifies the vendor, renderer
+    // and version strings so binaries are never handed to another driver.
+    struct {
+        bool enabled;
+        uint32_t driverHash;
+
+        void (*getProgramBinary)(uint32_t program, int32_t bufSize, int32_t *length,
+                                 uint32_t *binaryFormat, void *binary);
+        void (*programBinary)(uint32_t program, uint32_t binaryFormat,
+                              const void *binary, int32_t length);
+    } programBinary;
+
+    // EGL images of gralloc buffers, through which script and texture
+    // allocations share their memory with GL when
+    // debug.rs.texture-eglimage is set.
+    struct {
+        bool enabled;
+
+        void * (*createImage)(EGLDisplay dpy, EGLContext ctx, EGLenum target,
+                              EGLClientBuffer buffer, const EGLint *attribs);
+        EGLBoolean (*destroyImage)(EGLDisplay dpy, void *image);
+        void (*imageTargetTexture2D)(uint32_t target, void *image);
+    } eglImage;
+
+    // GLES3 instanced drawing, so vertex programs reading per-instance
+    // attributes can draw every instance of a mesh in one call.
+    struct {
+        bool enabled;
+
+        void (*drawArraysInstanced)(uint32_t mode, int32_t first, int32_t count,
+                                    int32_t instances);
+        void (*drawElementsInstanced)(uint32_t mode, int32_t count, uint32_t type,
+                                      const void *indices, int32_t instances);
+        void (*vertexAttribDivisor)(uint32_t index, uint32_t divisor);
+    } instancing;
+
+    // What the driver last set of the state program binds change, so a bind
+    // only makes the calls that change something.  All ones means unknown;
+    // stateCallsSkipped counts the calls and uniform uploads left out.
+    struct {
+        uint8_t caps[RSD_GL_CAP_COUNT];
+        uint32_t blendSrc;
+        uint32_t blendDst;
+        uint32_t depthFunc;
+        uint8_t depthMask;
+        uint32_t colorMask;
+        uint32_t cullFace;
+    } state;
+    uint32_t stateCallsSkipped;
+
     ANativeWindow *wndSurface;
     ANativeWindow *currentWndSurface;
 
     RsdShaderCache *shaderCache;
+    RsdQuadBatch *quadBatch;
     RsdVertexArrayState *vertexArrayState;
     RsdFrameBufferObj *currentFrameBuffer;
 } RsdGL;
@@ -89,6 +242,16 @@ void rsdGLClearColor(const android::renderscript::Context *rsc,
                      float r, float g, float b, float a);
 void rsdGLClearDepth(const android::renderscript::Context *rsc, float v);
 void rsdGLFinish(const android::renderscript::Context *rsc);
+
+// Forgets the shadowed state, for when GL state may have changed behind it.
+void rsdGLInvalidateState(const android::renderscript::Context *rsc);
+void rsdGLSetCap(const android::renderscript::Context *rsc, uint32_t cap, bool enable);
+void rsdGLSetBlendFunc(const android::renderscript::Context *rsc, uint32_t src, uint32_t dst);
+void rsdGLSetDepthFunc(const android::renderscript::Context *rsc, uint32_t func);
+void rsdGLSetDepthMask(const android::renderscript::Context *rsc, bool enable);
+void rsdGLSetColorMask(const android::renderscript::Context *rsc,
+                       bool r, bool g, bool b, bool a);
+void rsdGLSetCullFace(const android::renderscript::Context *rsc, uint32_t face);
 void rsdGLDrawQuadTexCoords(const android::renderscript::Context *rsc,
                             float x1, float y1, float z1, float u1, float v1,
                             float x2, float y2, float z2, float u2, float v2,
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsContext.h"
+
+#include "rsdCore.h"
+#include "rsdGLTimer.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+// GL_EXT_disjoint_timer_query enums.
+#define RSD_GL_QUERY_RESULT_EXT 0x8866
+#define RSD_GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#define RSD_GL_TIME_ELAPSED_EXT 0x88BF
+#define RSD_GL_GPU_DISJOINT_EXT 0x8FBB
+
+// Queries in flight.  Groups started while all of them are waiting on
+// the GPU go untimed rather than stall the frame.
+#define RSD_GL_TIMER_QUERIES 64
+// Groups GPU time is kept for; later ones are left out of the profile.
+#define RSD_GL_TIMER_ENTRIES 64
+
+struct RsdGLTimer {
+    bool perDraw;
+
+    // A ring of queries, oldest first, the newest being open while active.
+    uint32_t queries[RSD_GL_TIMER_QUERIES];
+    struct {
+        const Script *script;
+        uint32_t group;
+        uint32_t frame;
+    } info[RSD_GL_TIMER_QUERIES];
+    uint32_t head;
+    uint32_t count;
+    bool active;
+
+    // The frame being drawn and the groups it has started so far.
+    uint32_t frame;
+    uint32_t group;
+
+    // GPU time of the oldest frame results are still coming in for, which
+    // goes to systrace once the results for a later one show up.
+    uint32_t traceFrame;
+    uint64_t traceFrameNs;
+
+    RsKernelProfile entries[RSD_GL_TIMER_ENTRIES];
+    uint32_t entryCount;
+
+    void (*genQueries)(int32_t n, uint32_t *ids);
+    void (*deleteQueries)(int32_t n, const uint32_t *ids);
+    void (*beginQuery)(uint32_t target, uint32_t id);
+    void (*endQuery)(uint32_t target);
+    void (*getQueryObjectuiv)(uint32_t id, uint32_t pname, uint32_t *params);
+    void (*getQueryObjectui64v)(uint32_t id, uint32_t pname, uint64_t *params);
+};
+
+RsdGLTimer * rsdGLTimerCreate(const Context *rsc, bool perDraw) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (!strstr((const char *)dc->gl.gl.extensions, "GL_EXT_disjoint_timer_query")) {
+        ALOGV("GL_EXT_disjoint_timer_query missing, draws won't be timed on the GPU");
+        return NULL;
+    }
+
+    RsdGLTimer *t = (RsdGLTimer *)calloc(1, sizeof(RsdGLTimer));
+    if (!t) {
+        return NULL;
+    }
+    t->genQueries = (void (*)(int32_t, uint32_t *))eglGetProcAddress("glGenQueriesEXT");
+    t->deleteQueries = (void (*)(int32_t, const uint32_t *))
+            eglGetProcAddress("glDeleteQueriesEXT");
+    t->beginQuery = (void (*)(uint32_t, uint32_t))eglGetProcAddress("glBeginQueryEXT");
+    t->endQuery = (void (*)(uint32_t))eglGetProcAddress("glEndQueryEXT");
+    t->getQueryObjectuiv = (void (*)(uint32_t, uint32_t, uint32_t *))
+            eglGetProcAddress("glGetQueryObjectuivEXT");
+    t->getQueryObjectui64v = (void (*)(uint32_t, uint32_t, uint64_t *))
+            eglGetProcAddress("glGetQueryObjectui64vEXT");
+    if (!t->genQueries || !t->deleteQueries || !t->beginQuery || !t->endQuery ||
+        !t->getQueryObjectuiv || !t->getQueryObjectui64v) {
+        ALOGV("Timer query entry points missing, draws won't be timed on the GPU");
+        free(t);
+        return NULL;
+    }
+
+    t->perDraw = perDraw;
+    t->genQueries(RSD_GL_TIMER_QUERIES, t->queries);
+    // Reading the flag clears it, so only what happens from now counts.
+    GLint disjoint = 0;
+    glGetIntegerv(RSD_GL_GPU_DISJOINT_EXT, &disjoint);
+    return t;
+}
+
+void rsdGLTimerDestroy(RsdGLTimer *t) {
+    if (t->active) {
+        t->endQuery(RSD_GL_TIME_ELAPSED_EXT);
+    }
+    t->deleteQueries(RSD_GL_TIMER_QUERIES, t->queries);
+    free(t);
+}
+
+void rsdGLTimerGroup(const Context *rsc, RsdGLTimer *t, bool draw) {
+    if (draw && !t->perDraw) {
+        return;
+    }
+    if (t->active) {
+        t->endQuery(RSD_GL_TIME_ELAPSED_EXT);
+        t->active = false;
+    }
+
+    const uint32_t group = t->group++;
+    if (t->count == RSD_GL_TIMER_QUERIES) {
+        return;
+    }
+    const uint32_t idx = (t->head + t->count) % RSD_GL_TIMER_QUERIES;
+    t->info[idx].script = rsc->getRootScript();
+    t->info[idx].group = group;
+    t->info[idx].frame = t->frame;
+    t->beginQuery(RSD_GL_TIME_ELAPSED_EXT, t->queries[idx]);
+    t->count++;
+    t->active = true;
+}
+
+static void addResult(RsdGLTimer *t, uint32_t idx, uint64_t ns) {
+    if (t->info[idx].frame != t->traceFrame) {
+        ATRACE_INT("RS GPU us", (int32_t)(t->traceFrameNs / 1000));
+        t->traceFrame = t->info[idx].frame;
+        t->traceFrameNs = 0;
+    }
+    t->traceFrameNs += ns;
+
+    const Script *script = t->info[idx].script;
+    if (!script) {
+        return;
+    }
+    RsKernelProfile *p = NULL;
+    for (uint32_t ct = 0; ct < t->entryCount; ct++) {
+        if ((t->entries[ct].script == script) && (t->entries[ct].dimX == t->info[idx].group)) {
+            p = &t->entries[ct];
+            break;
+        }
+    }
+    if (!p) {
+        if (t->entryCount == RSD_GL_TIMER_ENTRIES) {
+            return;
+        }
+        p = &t->entries[t->entryCount++];
+        memset(p, 0, sizeof(*p));
+        p->script = (RsScript)script;
+        p->slot = RS_KERNEL_PROFILE_SLOT_GPU;
+        p->dimX = t->info[idx].group;
+    }
+    p->launches++;
+    p->wallNs += ns;
+}
+
+void rsdGLTimerFrame(const Context *rsc, RsdGLTimer *t) {
+    if (t->active) {
+        t->endQuery(RSD_GL_TIME_ELAPSED_EXT);
+        t->active = false;
+    }
+
+    // Results overlapping a disjoint operation, like a frequency change,
+    // are meaningless; those finished so far are dropped.
+    GLint disjoint = 0;
+    glGetIntegerv(RSD_GL_GPU_DISJOINT_EXT, &disjoint);
+    while (t->count) {
+        const uint32_t idx = t->head;
+        uint32_t available = 0;
+        t->getQueryObjectuiv(t->queries[idx], RSD_GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available) {
+            break;
+        }
+        uint64_t ns = 0;
+        t->getQueryObjectui64v(t->queries[idx], RSD_GL_QUERY_RESULT_EXT, &ns);
+        if (!disjoint) {
+            addResult(t, idx, ns);
+        }
+        t->head = (t->head + 1) % RSD_GL_TIMER_QUERIES;
+        t->count--;
+    }
+
+    t->frame++;
+    t->group = 0;
+}
+
+uint32_t rsdGLTimerGetProfile(const RsdGLTimer *t, RsKernelProfile *profiles, uint32_t count) {
+    const uint32_t copied = rsMin(count, t->entryCount);
+    if (copied) {
+        memcpy(profiles, t->entries, copied * sizeof(RsKernelProfile));
+    }
+    return t->entryCount;
+}
+
+void rsdGLTimerDropScript(RsdGLTimer *t, const Script *script) {
+    for (uint32_t ct = 0; ct < RSD_GL_TIMER_QUERIES; ct++) {
+        if (t->info[ct].script == script) {
+            t->info[ct].script = NULL;
+        }
+    }
+    uint32_t kept = 0;
+    for (uint32_t ct = 0; ct < t->entryCount; ct++) {
+        if (t->entries[ct].script != (RsScript)script) {
+            t->entries[kept++] = t->entries[ct];
+        }
+    }
+    t->entryCount = kept;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RSD_GL_TIMER_H
+#define RSD_GL_TIMER_H
+
+#include <rs_hal.h>
+
+struct RsdGLTimer;
+
+// Times the root script's draws on the GPU in groups, each starting at a
+// program binding, and at every rsgDrawMesh too when perDraw is set.
+// Returns NULL without GL_EXT_disjoint_timer_query.
+RsdGLTimer * rsdGLTimerCreate(const android::renderscript::Context *rsc, bool perDraw);
+void rsdGLTimerDestroy(RsdGLTimer *timer);
+
+// Ends the group being timed and starts the next one.  Draw groups are
+// only started when the timer was created perDraw.
+void rsdGLTimerGroup(const android::renderscript::Context *rsc, RsdGLTimer *timer, bool draw);
+// Ends the frame's last group and takes in the results the GPU has
+// finished, usually those of a few frames back.
+void rsdGLTimerFrame(const android::renderscript::Context *rsc, RsdGLTimer *timer);
+
+// Copies the GPU time of each group, as RS_KERNEL_PROFILE_SLOT_GPU
+// entries, into profiles, at most count of them.  Returns how many there are.
+uint32_t rsdGLTimerGetProfile(const RsdGLTimer *timer, RsKernelProfile *profiles,
+                              uint32_t count);
+void rsdGLTimerDropScript(RsdGLTimer *timer, const android::renderscript::Script *script);
+
+#endif
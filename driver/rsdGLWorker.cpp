@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <pthread.h>
+#include <string.h>
+
+#include "rsContext.h"
+
+#include "rsdCore.h"
+#include "rsdGLWorker.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+// EGL_KHR_fence_sync and EGL_KHR_wait_sync enums.
+#define RSD_EGL_SYNC_FENCE_KHR 0x30F9
+#define RSD_EGL_FOREVER_KHR 0xFFFFFFFFFFFFFFFFull
+
+struct RsdGLJob {
+    RsdGLJobFunc_t func;
+    void *usr;
+    RsdGLJob *next;
+
+    // Set by the worker once func has run.
+    bool done;
+    void *sync;
+};
+
+struct RsdGLWorker {
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+
+    pthread_t thread;
+    // Guards everything below.  queued is signalled when a job is queued
+    // or the worker is told to exit, done when a job has run.
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t done;
+    RsdGLJob *head;
+    RsdGLJob *tail;
+    bool exit;
+    // Set when the thread has made its context current, or failed to.
+    bool started;
+    bool running;
+
+    void * (*createSync)(EGLDisplay dpy, EGLenum type, const EGLint *attribs);
+    EGLBoolean (*destroySync)(EGLDisplay dpy, void *sync);
+    EGLint (*clientWaitSync)(EGLDisplay dpy, void *sync, EGLint flags, uint64_t timeout);
+    // NULL without EGL_KHR_wait_sync, when finishing waits on the CPU.
+    EGLint (*waitSync)(EGLDisplay dpy, void *sync, EGLint flags);
+};
+
+static void * workerThread(void *arg) {
+    RsdGLWorker *w = (RsdGLWorker *)arg;
+
+    const bool current = eglMakeCurrent(w->display, w->surface, w->surface, w->context);
+    pthread_mutex_lock(&w->lock);
+    w->started = true;
+    w->running = current;
+    pthread_cond_broadcast(&w->done);
+    if (!current) {
+        pthread_mutex_unlock(&w->lock);
+        return NULL;
+    }
+
+    for (;;) {
+        while (!w->head && !w->exit) {
+            pthread_cond_wait(&w->queued, &w->lock);
+        }
+        RsdGLJob *job = w->head;
+        if (!job) {
+            break;
+        }
+        w->head = job->next;
+        if (!w->head) {
+            w->tail = NULL;
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        job->func(job->usr);
+        // The fence has to be flushed for anyone else to see it signal.
+        void *sync = w->createSync(w->display, RSD_EGL_SYNC_FENCE_KHR, NULL);
+        if (sync) {
+            glFlush();
+        } else {
+            glFinish();
+        }
+
+        pthread_mutex_lock(&w->lock);
+        job->sync = sync;
+        job->done = true;
+        pthread_cond_broadcast(&w->done);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    eglMakeCurrent(w->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+    return NULL;
+}
+
+RsdGLWorker * rsdGLWorkerCreate(const Context *rsc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    const char *extensions = eglQueryString(dc->gl.egl.display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_fence_sync")) {
+        ALOGV("EGL fence syncs missing, GL work stays on the render thread");
+        return NULL;
+    }
+
+    RsdGLWorker *w = new RsdGLWorker();
+    memset(w, 0, sizeof(*w));
+    w->display = dc->gl.egl.display;
+    w->createSync = (void * (*)(EGLDisplay, EGLenum, const EGLint *))
+            eglGetProcAddress("eglCreateSyncKHR");
+    w->destroySync = (EGLBoolean (*)(EGLDisplay, void *))eglGetProcAddress("eglDestroySyncKHR");
+    w->clientWaitSync = (EGLint (*)(EGLDisplay, void *, EGLint, uint64_t))
+            eglGetProcAddress("eglClientWaitSyncKHR");
+    if (strstr(extensions, "EGL_KHR_wait_sync")) {
+        w->waitSync = (EGLint (*)(EGLDisplay, void *, EGLint))eglGetProcAddress("eglWaitSyncKHR");
+    }
+    if (!w->createSync || !w->destroySync || !w->clientWaitSync) {
+        delete w;
+        return NULL;
+    }
+
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    w->context = eglCreateContext(w->display, dc->gl.egl.config, dc->gl.egl.context,
+                                  contextAttribs);
+    if (w->context == EGL_NO_CONTEXT) {
+        ALOGE("Could not create a shared context for the GL worker");
+        delete w;
+        return NULL;
+    }
+    EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    w->surface = eglCreatePbufferSurface(w->display, dc->gl.egl.config, pbufferAttribs);
+    if (w->surface == EGL_NO_SURFACE) {
+        ALOGE("Could not create a surface for the GL worker");
+        eglDestroyContext(w->display, w->context);
+        delete w;
+        return NULL;
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->queued, NULL);
+    pthread_cond_init(&w->done, NULL);
+    if (pthread_create(&w->thread, NULL, workerThread, w)) {
+        ALOGE("Could not start the GL worker thread");
+    } else {
+        pthread_mutex_lock(&w->lock);
+        while (!w->started) {
+            pthread_cond_wait(&w->done, &w->lock);
+        }
+        pthread_mutex_unlock(&w->lock);
+        if (w->running) {
+            return w;
+        }
+        ALOGE("Could not make the GL worker context current");
+        pthread_join(w->thread, NULL);
+    }
+
+    pthread_cond_destroy(&w->done);
+    pthread_cond_destroy(&w->queued);
+    pthread_mutex_destroy(&w->lock);
+    eglDestroySurface(w->display, w->surface);
+    eglDestroyContext(w->display, w->context);
+    delete w;
+    return NULL;
+}
+
+void rsdGLWorkerDestroy(RsdGLWorker *w) {
+    pthread_mutex_lock(&w->lock);
+    w->exit = true;
+    pthread_cond_signal(&w->queued);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    pthread_cond_destroy(&w->done);
+    pthread_cond_destroy(&w->queued);
+    pthread_mutex_destroy(&w->lock);
+    eglDestroySurface(w->display, w->surface);
+    eglDestroyContext(w->display, w->context);
+    delete w;
+}
+
+RsdGLJob * rsdGLWorkerQueue(RsdGLWorker *w, RsdGLJobFunc_t func, void *usr) {
+    RsdGLJob *job = new RsdGLJob();
+    job->func = func;
+    job->usr = usr;
+    job->next = NULL;
+    job->done = false;
+    job->sync = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->tail) {
+        w->tail->next = job;
+    } else {
+        w->head = job;
+    }
+    w->tail = job;
+    pthread_cond_signal(&w->queued);
+    pthread_mutex_unlock(&w->lock);
+    return job;
+}
+
+void rsdGLWorkerFinish(RsdGLWorker *w, RsdGLJob *job) {
+    pthread_mutex_lock(&w->lock);
+    while (!job->done) {
+        pthread_cond_wait(&w->done, &w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (job->sync) {
+        // A server wait lets the render thread carry on queueing commands.
+        if (!w->waitSync || (w->waitSync(w->display, job->sync, 0) != EGL_TRUE)) {
+            w->clientWaitSync(w->display, job->sync, 0, RSD_EGL_FOREVER_KHR);
+        }
+        w->destroySync(w->display, job->sync);
+    }
+    delete job;
+}
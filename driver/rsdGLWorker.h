@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RSD_GL_WORKER_H
+#define RSD_GL_WORKER_H
+
+#include <rs_hal.h>
+
+struct RsdGLWorker;
+struct RsdGLJob;
+
+typedef void (*RsdGLJobFunc_t)(void *usr);
+
+// Starts a thread with a context sharing objects with the context's own,
+// for GL work that shouldn't hold up drawing.  Returns NULL when EGL fence
+// syncs or the second context are unavailable.
+RsdGLWorker * rsdGLWorkerCreate(const android::renderscript::Context *rsc);
+// Runs the jobs still queued and stops the thread.
+void rsdGLWorkerDestroy(RsdGLWorker *worker);
+
+// Queues func to run on the worker with its context current.  It may only
+// make GL calls, on objects the render thread leaves alone and memory
+// nothing changes until rsdGLWorkerFinish is called for the job.
+RsdGLJob * rsdGLWorkerQueue(RsdGLWorker *worker, RsdGLJobFunc_t func, void *usr);
+// Returns once the job has run, leaving the calling context to wait on
+// the fence the worker put after it, and frees the job.  Every job queued
+// has to be finished exactly once.
+void rsdGLWorkerFinish(RsdGLWorker *worker, RsdGLJob *job);
+
+#endif
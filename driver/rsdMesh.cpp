@@ -50,6 +50,19 @@ void rsdMeshDraw(const Context *rsc, const Mesh *m, uint32_t primIndex, uint32_t
     }
 }
 
+void rsdMeshDrawInstanced(const Context *rsc, const Mesh *m, uint32_t primIndex,
+                          uint32_t start, uint32_t len, const Allocation *transforms) {
+    if(m->mHal.drv) {
+        RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+        if (!dc->gl.shaderCache->setup(rsc)) {
+            return;
+        }
+
+        RsdMeshObj *drv = (RsdMeshObj*)m->mHal.drv;
+        drv->renderPrimitiveInstanced(rsc, primIndex, start, len, transforms);
+    }
+}
+
 void rsdMeshDestroy(const Context *rsc, const Mesh *m) {
     if(m->mHal.drv) {
         RsdMeshObj *drv = (RsdMeshObj*)m->mHal.drv;
@@ -27,6 +27,10 @@ void rsdMeshDraw(const android::renderscript::Context *rsc,
                  uint32_t primIndex, uint32_t start, uint32_t len);
 void rsdMeshDestroy(const android::renderscript::Context *rsc,
                     const android::renderscript::Mesh *m);
+void rsdMeshDrawInstanced(const android::renderscript::Context *rsc,
+                          const android::renderscript::Mesh *m,
+                          uint32_t primIndex, uint32_t start, uint32_t len,
+                          const android::renderscript::Allocation *transforms);
 
 
 #endif
@@ -23,8 +23,10 @@
 #include <rsMesh.h>
 
 #include "rsdAllocation.h"
+#include "rsdCore.h"
 #include "rsdMeshObj.h"
 #include "rsdGL.h"
+#include "rsdShaderCache.h"
 
 using namespace android;
 using namespace android::renderscript;
@@ -37,9 +39,18 @@ RsdMeshObj::RsdMeshObj(const Context *rsc, const Mesh *rsMesh) {
     mGLPrimitives = NULL;
 
     mAttribCount = 0;
+    mPositionAttrib = -1;
+    mNormalAttrib = -1;
+
+    mBatchVerts = NULL;
+    mBatchVertsSize = 0;
+    mBatchIndices = NULL;
+    mBatchIndicesSize = 0;
 }
 
 RsdMeshObj::~RsdMeshObj() {
+    delete[] mBatchVerts;
+    delete[] mBatchIndices;
     if (mAttribs) {
         delete[] mAttribs;
         delete[] mAttribAllocationIndex;
@@ -49,11 +60,16 @@ RsdMeshObj::~RsdMeshObj() {
     }
 }
 
-bool RsdMeshObj::isValidGLComponent(const Element *elem, uint32_t fieldIdx) {
-    // Only GL_BYTE, GL_UNSIGNED_BYTE, GL_SHORT, GL_UNSIGNED_SHORT, GL_FIXED, GL_FLOAT are accepted.
-    // Filter rs types accordingly
+bool RsdMeshObj::isValidGLComponent(const Context *rsc, const Element *elem, uint32_t fieldIdx) {
+    // Only GL_BYTE, GL_UNSIGNED_BYTE, GL_SHORT, GL_UNSIGNED_SHORT, GL_FIXED, GL_FLOAT are accepted,
+    // along with half floats where the GL has them.  Filter rs types accordingly
     RsDataType dt = elem->mHal.state.fields[fieldIdx]->mHal.state.dataType;
-    if (dt != RS_TYPE_FLOAT_32 && dt != RS_TYPE_UNSIGNED_8 &&
+    if (dt == RS_TYPE_FLOAT_16) {
+        RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+        if (!dc->gl.gl.halfFloatVertexType) {
+            return false;
+        }
+    } else if (dt != RS_TYPE_FLOAT_32 && dt != RS_TYPE_UNSIGNED_8 &&
         dt != RS_TYPE_UNSIGNED_16 && dt != RS_TYPE_SIGNED_8 &&
         dt != RS_TYPE_SIGNED_16) {
         return false;
@@ -77,7 +93,7 @@ bool RsdMeshObj::init(const Context *rsc) {
     for (uint32_t ct=0; ct < mRSMesh->mHal.state.vertexBuffersCount; ct++) {
         const Element *elem = mRSMesh->mHal.state.vertexBuffers[ct]->getType()->getElement();
         for (uint32_t ct=0; ct < elem->mHal.state.fieldsCount; ct++) {
-            if (isValidGLComponent(elem, ct)) {
+            if (isValidGLComponent(rsc, elem, ct)) {
                 mAttribCount ++;
             }
         }
@@ -96,6 +112,8 @@ bool RsdMeshObj::init(const Context *rsc) {
     mAttribs = new RsdVertexArray::Attrib[mAttribCount];
     mAttribAllocationIndex = new uint32_t[mAttribCount];
 
+    mPositionAttrib = -1;
+    mNormalAttrib = -1;
     uint32_t userNum = 0;
     for (uint32_t ct=0; ct < mRSMesh->mHal.state.vertexBuffersCount; ct++) {
         const Element *elem = mRSMesh->mHal.state.vertexBuffers[ct]->getType()->getElement();
@@ -103,14 +121,20 @@ bool RsdMeshObj::init(const Context *rsc) {
         for (uint32_t fieldI=0; fieldI < elem->mHal.state.fieldsCount; fieldI++) {
             const Element *f = elem->mHal.state.fields[fieldI];
 
-            if (!isValidGLComponent(elem, fieldI)) {
+            if (!isValidGLComponent(rsc, elem, fieldI)) {
                 continue;
             }
 
             mAttribs[userNum].size = f->mHal.state.vectorSize;
             mAttribs[userNum].offset = elem->mHal.state.fieldOffsetBytes[fieldI];
-            mAttribs[userNum].type = rsdTypeToGLType(f->mHal.state.dataType);
-            mAttribs[userNum].normalized = f->mHal.state.dataType != RS_TYPE_FLOAT_32;
+            if (f->mHal.state.dataType == RS_TYPE_FLOAT_16) {
+                RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+                mAttribs[userNum].type = dc->gl.gl.halfFloatVertexType;
+                mAttribs[userNum].normalized = false;
+            } else {
+                mAttribs[userNum].type = rsdTypeToGLType(f->mHal.state.dataType);
+                mAttribs[userNum].normalized = f->mHal.state.dataType != RS_TYPE_FLOAT_32;
+            }
             mAttribs[userNum].stride = stride;
             String8 tmp(RS_SHADER_ATTR);
             tmp.append(elem->mHal.state.fieldNames[fieldI]);
@@ -118,6 +142,16 @@ bool RsdMeshObj::init(const Context *rsc) {
 
             // Remember which allocation this attribute came from
             mAttribAllocationIndex[userNum] = ct;
+
+            if (f->mHal.state.dataType == RS_TYPE_FLOAT_32) {
+                if ((mAttribs[userNum].name == RS_SHADER_ATTR "position") &&
+                    (mAttribs[userNum].size >= 2)) {
+                    mPositionAttrib = userNum;
+                } else if ((mAttribs[userNum].name == RS_SHADER_ATTR "normal") &&
+                           (mAttribs[userNum].size == 3)) {
+                    mNormalAttrib = userNum;
+                }
+            }
             userNum ++;
         }
     }
@@ -132,6 +166,24 @@ void RsdMeshObj::renderPrimitiveRange(const Context *rsc, uint32_t primIndex,
         return;
     }
 
+    updateAttribs(rsc);
+
+    RsdVertexArray va(mAttribs, mAttribCount);
+    va.setup(rsc);
+
+    const Allocation *idxAlloc = mRSMesh->mHal.state.indexBuffers[primIndex];
+    if (idxAlloc) {
+        const uint8_t *indices = bindIndices(rsc, idxAlloc);
+        RSD_CALL_GL(glDrawElements, mGLPrimitives[primIndex], len, GL_UNSIGNED_SHORT,
+                    indices + start * 2);
+    } else {
+        RSD_CALL_GL(glDrawArrays, mGLPrimitives[primIndex], start, len);
+    }
+
+    rsdGLCheckError(rsc, "Mesh::renderPrimitiveRange");
+}
+
+void RsdMeshObj::updateAttribs(const Context *rsc) const {
     for (uint32_t ct=0; ct < mRSMesh->mHal.state.vertexBuffersCount; ct++) {
         const Allocation *alloc = mRSMesh->mHal.state.vertexBuffers[ct];
         DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
@@ -154,31 +206,256 @@ void RsdMeshObj::renderPrimitiveRange(const Context *rsc, uint32_t primIndex,
             mAttribs[ct].ptr = (const uint8_t*)alloc->mHal.drvState.lod[0].mallocPtr;
         }
     }
+}
+
+// Binds the index buffer and returns what glDrawElements takes for its
+// first index.
+const uint8_t * RsdMeshObj::bindIndices(const Context *rsc, const Allocation *idxAlloc) const {
+    DrvAllocation *drvAlloc = (DrvAllocation *)idxAlloc->mHal.drv;
+    if (drvAlloc->uploadDeferred) {
+        rsdAllocationSyncAll(rsc, idxAlloc, RS_ALLOCATION_USAGE_SCRIPT);
+    }
+
+    if (drvAlloc->bufferID) {
+        RSD_CALL_GL(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, drvAlloc->bufferID);
+        return NULL;
+    }
+    RSD_CALL_GL(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
+    return (const uint8_t *)idxAlloc->mHal.drvState.lod[0].mallocPtr;
+}
+
+static const char *gInstanceAttribs[4] = {
+    RS_SHADER_ATTR "instance0",
+    RS_SHADER_ATTR "instance1",
+    RS_SHADER_ATTR "instance2",
+    RS_SHADER_ATTR "instance3"
+};
+
+void RsdMeshObj::renderPrimitiveInstanced(const Context *rsc, uint32_t primIndex,
+                                          uint32_t start, uint32_t len,
+                                          const Allocation *transforms) const {
+    if (len < 1 || primIndex >= mRSMesh->mHal.state.primitivesCount || mAttribCount == 0) {
+        rsc->setError(RS_ERROR_FATAL_DRIVER, "Invalid mesh or parameters");
+        return;
+    }
+
+    DrvAllocation *drv = (DrvAllocation *)transforms->mHal.drv;
+    if (drv->uploadDeferred) {
+        rsdAllocationSyncAll(rsc, transforms, RS_ALLOCATION_USAGE_SCRIPT);
+    }
+
+    if (!renderInstancedGL(rsc, primIndex, start, len, transforms)) {
+        renderInstancedBatched(rsc, primIndex, start, len, transforms);
+    }
+    rsdGLCheckError(rsc, "Mesh::renderPrimitiveInstanced");
+}
+
+// Feeds the columns of each instance's matrix to the vertex program, when
+// it reads them and GLES3 can step attributes per instance.
+bool RsdMeshObj::renderInstancedGL(const Context *rsc, uint32_t primIndex,
+                                   uint32_t start, uint32_t len,
+                                   const Allocation *transforms) const {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (!dc->gl.instancing.enabled) {
+        return false;
+    }
+
+    RsdVertexArrayState *state = dc->gl.vertexArrayState;
+    int32_t slots[4];
+    for (uint32_t ct = 0; ct < 4; ct++) {
+        slots[ct] = dc->gl.shaderCache->vtxAttribSlot(String8(gInstanceAttribs[ct]));
+        if (slots[ct] < 0 || slots[ct] >= (int32_t)state->mAttrsEnabledSize) {
+            return false;
+        }
+    }
 
+    updateAttribs(rsc);
     RsdVertexArray va(mAttribs, mAttribCount);
     va.setup(rsc);
 
+    // Left enabled, the next setup disables them if it doesn't use them
+    DrvAllocation *drv = (DrvAllocation *)transforms->mHal.drv;
+    const uint8_t *matrices = NULL;
+    if (!drv->bufferID) {
+        matrices = (const uint8_t *)transforms->mHal.drvState.lod[0].mallocPtr;
+    }
+    RSD_CALL_GL(glBindBuffer, GL_ARRAY_BUFFER, drv->bufferID);
+    for (uint32_t ct = 0; ct < 4; ct++) {
+        if (!state->mAttrsEnabled[slots[ct]]) {
+            RSD_CALL_GL(glEnableVertexAttribArray, slots[ct]);
+            state->mAttrsEnabled[slots[ct]] = true;
+        }
+        RSD_CALL_GL(glVertexAttribPointer, slots[ct], 4, GL_FLOAT, GL_FALSE,
+                    16 * sizeof(float), matrices + ct * 4 * sizeof(float));
+        dc->gl.instancing.vertexAttribDivisor(slots[ct], 1);
+    }
+
+    int32_t instances = transforms->getType()->getDimX();
     const Allocation *idxAlloc = mRSMesh->mHal.state.indexBuffers[primIndex];
     if (idxAlloc) {
-        DrvAllocation *drvAlloc = (DrvAllocation *)idxAlloc->mHal.drv;
-        if (drvAlloc->uploadDeferred) {
-            rsdAllocationSyncAll(rsc, idxAlloc, RS_ALLOCATION_USAGE_SCRIPT);
+        const uint8_t *indices = bindIndices(rsc, idxAlloc);
+        dc->gl.instancing.drawElementsInstanced(mGLPrimitives[primIndex], len,
+                                                GL_UNSIGNED_SHORT, indices + start * 2,
+                                                instances);
+    } else {
+        dc->gl.instancing.drawArraysInstanced(mGLPrimitives[primIndex], start, len, instances);
+    }
+
+    for (uint32_t ct = 0; ct < 4; ct++) {
+        dc->gl.instancing.vertexAttribDivisor(slots[ct], 0);
+    }
+    return true;
+}
+
+// Where the copies of a vertex buffer start in a batch
+static size_t batchOffset(const Mesh::Hal::State &ms, uint32_t buffer, uint32_t perBatch) {
+    size_t offset = 0;
+    for (uint32_t ct = 0; ct < buffer; ct++) {
+        const Type *t = ms.vertexBuffers[ct]->getType();
+        offset += t->getDimX() * t->getElementSizeBytes() * perBatch;
+    }
+    return offset;
+}
+
+// Draws transformed copies of the mesh from client memory, as many per
+// call as 16 bit indices can address.  Strips and fans can't be joined,
+// so their copies are drawn one call each.
+void RsdMeshObj::renderInstancedBatched(const Context *rsc, uint32_t primIndex,
+                                        uint32_t start, uint32_t len,
+                                        const Allocation *transforms) const {
+    if (mPositionAttrib < 0) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Instancing without GLES3 needs a float position attribute");
+        return;
+    }
+
+    const Mesh::Hal::State &ms = mRSMesh->mHal.state;
+    uint32_t vtxCount = ms.vertexBuffers[0]->getType()->getDimX();
+    if (vtxCount > 0x10000) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Mesh too large to instance without GLES3");
+        return;
+    }
+
+    for (uint32_t ct = 0; ct < ms.vertexBuffersCount; ct++) {
+        DrvAllocation *drv = (DrvAllocation *)ms.vertexBuffers[ct]->mHal.drv;
+        if (drv->uploadDeferred) {
+            rsdAllocationSyncAll(rsc, ms.vertexBuffers[ct], RS_ALLOCATION_USAGE_SCRIPT);
         }
+    }
+    const uint16_t *srcIndices = NULL;
+    const Allocation *idxAlloc = ms.indexBuffers[primIndex];
+    if (idxAlloc) {
+        srcIndices = (const uint16_t *)idxAlloc->mHal.drvState.lod[0].mallocPtr + start;
+    }
 
-        if (drvAlloc->bufferID) {
-            RSD_CALL_GL(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, drvAlloc->bufferID);
-            RSD_CALL_GL(glDrawElements, mGLPrimitives[primIndex], len, GL_UNSIGNED_SHORT,
-                        (uint16_t *)(start * 2));
-        } else {
-            RSD_CALL_GL(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
-            RSD_CALL_GL(glDrawElements, mGLPrimitives[primIndex], len, GL_UNSIGNED_SHORT,
-                        idxAlloc->mHal.drvState.lod[0].mallocPtr);
+    uint32_t prim = mGLPrimitives[primIndex];
+    bool joinable = (prim == GL_POINTS) || (prim == GL_LINES) || (prim == GL_TRIANGLES);
+    uint32_t instances = transforms->getType()->getDimX();
+    uint32_t perBatch = 0x10000 / vtxCount;
+    if (perBatch > instances) {
+        perBatch = instances;
+    }
+
+    size_t instanceBytes = 0;
+    for (uint32_t ct = 0; ct < ms.vertexBuffersCount; ct++) {
+        const Type *t = ms.vertexBuffers[ct]->getType();
+        instanceBytes += t->getDimX() * t->getElementSizeBytes();
+    }
+    if (mBatchVertsSize < instanceBytes * perBatch) {
+        delete[] mBatchVerts;
+        mBatchVertsSize = instanceBytes * perBatch;
+        mBatchVerts = new uint8_t[mBatchVertsSize];
+    }
+    if (mBatchIndicesSize < len * perBatch) {
+        delete[] mBatchIndices;
+        mBatchIndicesSize = len * perBatch;
+        mBatchIndices = new uint16_t[mBatchIndicesSize];
+    }
+
+    for (uint32_t ct = 0; ct < mAttribCount; ct++) {
+        mAttribs[ct].buffer = 0;
+        mAttribs[ct].ptr = mBatchVerts + batchOffset(ms, mAttribAllocationIndex[ct], perBatch);
+    }
+
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    RsdVertexArray va(mAttribs, mAttribCount);
+    va.setup(rsc);
+    // A program reading the instance columns sees the identity
+    for (uint32_t ct = 0; ct < 4; ct++) {
+        int32_t slot = dc->gl.shaderCache->vtxAttribSlot(String8(gInstanceAttribs[ct]));
+        if (slot >= 0) {
+            float column[4] = {0.f, 0.f, 0.f, 0.f};
+            column[ct] = 1.f;
+            RSD_CALL_GL(glVertexAttrib4fv, slot, column);
         }
-    } else {
-        RSD_CALL_GL(glDrawArrays, mGLPrimitives[primIndex], start, len);
     }
+    RSD_CALL_GL(glBindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    rsdGLCheckError(rsc, "Mesh::renderPrimitiveRange");
+    const RsdVertexArray::Attrib &pa = mAttribs[mPositionAttrib];
+    const float *matrices = (const float *)transforms->mHal.drvState.lod[0].mallocPtr;
+    for (uint32_t first = 0; first < instances; first += perBatch) {
+        uint32_t count = instances - first;
+        if (count > perBatch) {
+            count = perBatch;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            const float *m = matrices + (first + i) * 16;
+            for (uint32_t ct = 0; ct < ms.vertexBuffersCount; ct++) {
+                const Type *t = ms.vertexBuffers[ct]->getType();
+                size_t bytes = t->getDimX() * t->getElementSizeBytes();
+                memcpy(mBatchVerts + batchOffset(ms, ct, perBatch) + i * bytes,
+                       ms.vertexBuffers[ct]->mHal.drvState.lod[0].mallocPtr, bytes);
+            }
+
+            uint8_t *base = mBatchVerts +
+                            batchOffset(ms, mAttribAllocationIndex[mPositionAttrib], perBatch) +
+                            i * vtxCount * pa.stride + pa.offset;
+            for (uint32_t v = 0; v < vtxCount; v++) {
+                float *p = (float *)(base + v * pa.stride);
+                float z = (pa.size > 2) ? p[2] : 0.f;
+                float w = (pa.size > 3) ? p[3] : 1.f;
+                float x = p[0], y = p[1];
+                for (uint32_t c = 0; c < pa.size; c++) {
+                    p[c] = m[c] * x + m[4 + c] * y + m[8 + c] * z + m[12 + c] * w;
+                }
+            }
+
+            if (mNormalAttrib >= 0) {
+                const RsdVertexArray::Attrib &na = mAttribs[mNormalAttrib];
+                base = mBatchVerts +
+                       batchOffset(ms, mAttribAllocationIndex[mNormalAttrib], perBatch) +
+                       i * vtxCount * na.stride + na.offset;
+                for (uint32_t v = 0; v < vtxCount; v++) {
+                    float *n = (float *)(base + v * na.stride);
+                    float x = n[0], y = n[1], z = n[2];
+                    for (uint32_t c = 0; c < 3; c++) {
+                        n[c] = m[c] * x + m[4 + c] * y + m[8 + c] * z;
+                    }
+                    float l = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (l > 0.f) {
+                        n[0] /= l;
+                        n[1] /= l;
+                        n[2] /= l;
+                    }
+                }
+            }
+
+            uint16_t *indices = mBatchIndices + i * len;
+            uint32_t rebase = i * vtxCount;
+            for (uint32_t ct = 0; ct < len; ct++) {
+                indices[ct] = (srcIndices ? srcIndices[ct] : start + ct) + rebase;
+            }
+        }
+
+        if (joinable) {
+            RSD_CALL_GL(glDrawElements, prim, count * len, GL_UNSIGNED_SHORT, mBatchIndices);
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                RSD_CALL_GL(glDrawElements, prim, len, GL_UNSIGNED_SHORT, mBatchIndices + i * len);
+            }
+        }
+    }
 }
 
 void RsdMeshObj::updateGLPrimitives(const Context *rsc) {
@@ -24,6 +24,7 @@ namespace renderscript {
     class Context;
     class Mesh;
     class Element;
+    class Allocation;
 
 }
 }
@@ -39,6 +40,9 @@ public:
 
     void renderPrimitiveRange(const android::renderscript::Context *,
                               uint32_t primIndex, uint32_t start, uint32_t len) const;
+    void renderPrimitiveInstanced(const android::renderscript::Context *,
+                                  uint32_t primIndex, uint32_t start, uint32_t len,
+                                  const android::renderscript::Allocation *transforms) const;
 
     bool init(const android::renderscript::Context *rsc);
 
@@ -48,7 +52,8 @@ protected:
     uint32_t *mGLPrimitives;
     void updateGLPrimitives(const android::renderscript::Context *rsc);
 
-    bool isValidGLComponent(const android::renderscript::Element *elem, uint32_t fieldIdx);
+    bool isValidGLComponent(const android::renderscript::Context *rsc,
+                            const android::renderscript::Element *elem, uint32_t fieldIdx);
     // Attribues that allow us to map to GL
     RsdVertexArray::Attrib *mAttribs;
     // This allows us to figure out which allocation the attribute
@@ -56,6 +61,25 @@ protected:
     // buffer, it lets us properly map it
     uint32_t *mAttribAllocationIndex;
     uint32_t mAttribCount;
+
+    // Float position and normal attributes, or -1, for instancing on the CPU
+    int32_t mPositionAttrib;
+    int32_t mNormalAttrib;
+    // Transformed copies of the mesh drawn by a batched instanced draw
+    mutable uint8_t *mBatchVerts;
+    mutable size_t mBatchVertsSize;
+    mutable uint16_t *mBatchIndices;
+    mutable size_t mBatchIndicesSize;
+
+    void updateAttribs(const android::renderscript::Context *rsc) const;
+    const uint8_t * bindIndices(const android::renderscript::Context *rsc,
+                                const android::renderscript::Allocation *idxAlloc) const;
+    bool renderInstancedGL(const android::renderscript::Context *rsc,
+                           uint32_t primIndex, uint32_t start, uint32_t len,
+                           const android::renderscript::Allocation *transforms) const;
+    void renderInstancedBatched(const android::renderscript::Context *rsc,
+                                uint32_t primIndex, uint32_t start, uint32_t len,
+                                const android::renderscript::Allocation *transforms) const;
 };
 
 #endif //ANDROID_RSD_MESH_OBJ_H
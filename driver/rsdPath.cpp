@@ -40,20 +40,42 @@ public:
     virtual void draw(Context *) = 0;
 };
 
+// Tessellated once into line segments in a buffer object, and again only
+// when the control points change or the path's size on screen calls for
+// a different level of subdivision.
 class DrvPathStatic : public DrvPath {
 public:
-    typedef struct {
-        float x1, xc, x2;
-        float y1, yc, y2;
-    } segment_t;
-
-    segment_t *mSegments;
-    uint32_t mSegmentCount;
-
-    DrvPathStatic(const Allocation *vtx, const Allocation *loops);
+    DrvPathStatic(const Path *p);
     virtual ~DrvPathStatic();
 
     virtual void draw(Context *);
+
+protected:
+    enum {
+        MIN_LEVEL = 1,
+        MAX_LEVEL = 7
+    };
+
+    const Path *mPath;
+    uint32_t mPointsPerSegment;
+
+    // Subdivision the buffer holds, each curve being split into 2^mLevel
+    // lines, 0 before the first tessellation.
+    uint32_t mLevel;
+    uint32_t mVertexVersion;
+    uint32_t mLoopsVersion;
+    GLuint mBuffer;
+    uint32_t mVertexCount;
+
+    // Object space bounds of the control points and the longest control
+    // polygon of a segment, from the last tessellation.
+    float mBounds[4];
+    float mMaxSegmentLength;
+
+    bool isStale() const;
+    void measure();
+    uint32_t pickLevel(Context *rsc) const;
+    void tessellate(uint32_t level);
 };
 
 class DrvPathDynamic : public DrvPath {
@@ -71,11 +93,13 @@ static void cleanup(const Context *rsc, const Path *m) {
 
 bool rsdPathInitStatic(const Context *rsc, const Path *m,
                        const Allocation *vtx, const Allocation *loops) {
-    DrvPathStatic *drv = NULL;
     cleanup(rsc, m);
+    m->mHal.drv = NULL;
+    if (!vtx || !vtx->mHal.drvState.lod[0].mallocPtr) {
+        return false;
+    }
 
-    DrvPathStatic *dps = new DrvPathStatic(vtx, loops);
-    //LOGE("init path m %p,  %p", m, dps);
+    DrvPathStatic *dps = new DrvPathStatic(m);
     m->mHal.drv = dps;
     return dps != NULL;
 }
@@ -86,11 +110,8 @@ bool rsdPathInitDynamic(const Context *rsc, const Path *m) {
 
 
 void rsdPathDraw(const Context *rsc, const Path *m) {
-    //LOGE("render m=%p", m);
-
     DrvPath *drv = (DrvPath *)m->mHal.drv;
     if(drv) {
-        //LOGE("render 2 drv=%p", drv);
         drv->draw((Context *)rsc);
     }
 }
@@ -109,74 +130,184 @@ DrvPath::DrvPath() {
 DrvPath::~DrvPath() {
 }
 
-DrvPathStatic::DrvPathStatic(const Allocation *vtx, const Allocation *loops) {
-    mSegmentCount = vtx->getType()->getDimX() / 3;
-    mSegments = new segment_t[mSegmentCount];
-/*
-    const float *fin = (const float *)vtx->getPtr();
-    for (uint32_t ct=0; ct < mSegmentCount; ct++) {
-        segment_t *s = &mSegments[ct];
-        s->x1 = fin[0];
-        s->y1 = fin[1];
+static uint32_t allocationVersion(const Allocation *a) {
+    if (!a) {
+        return 0;
+    }
+    return a->mHal.drvState.contentVersion;
+}
 
-        s->xc = fin[2];
-        s->yc = fin[3];
+DrvPathStatic::DrvPathStatic(const Path *p) {
+    mPath = p;
+    mPointsPerSegment = (p->mHal.state.primitive == RS_PATH_PRIMITIVE_CUBIC_BEZIER) ? 4 : 3;
+    mLevel = 0;
+    mVertexVersion = 0;
+    mLoopsVersion = 0;
+    mBuffer = 0;
+    mVertexCount = 0;
+    mMaxSegmentLength = 0.f;
+    memset(mBounds, 0, sizeof(mBounds));
+}
 
-        s->x2 = fin[4];
-        s->y2 = fin[5];
-        fin += 6;
+DrvPathStatic::~DrvPathStatic() {
+    if (mBuffer) {
+        glDeleteBuffers(1, &mBuffer);
     }
-    */
 }
 
-DrvPathStatic::~DrvPathStatic() {
+bool DrvPathStatic::isStale() const {
+    return (mVertexVersion != allocationVersion(mPath->mHal.state.vertices)) ||
+           (mLoopsVersion != allocationVersion(mPath->mHal.state.loops));
 }
 
-void DrvPathStatic::draw(Context *rsc) {
-    const static float color[24] = {
-        1.f, 0.f, 0.f, 1.f,  0.5f, 0.f, 0.f, 1.f,
-        1.f, 0.f, 0.f, 1.f,  0.5f, 0.f, 0.f, 1.f,
-        1.f, 1.f, 1.f, 1.f,  1.f, 1.f, 1.f, 1.f};
-    float vtx[12];
+void DrvPathStatic::measure() {
+    const Allocation *vtx = mPath->mHal.state.vertices;
+    const float *pts = (const float *)vtx->mHal.drvState.lod[0].mallocPtr;
+    uint32_t count = vtx->getType()->getDimX();
 
-    //LOGE("draw");
-    if (!rsc->setupCheck()) {
+    mMaxSegmentLength = 0.f;
+    if (!count) {
+        memset(mBounds, 0, sizeof(mBounds));
         return;
     }
+    mBounds[0] = mBounds[2] = pts[0];
+    mBounds[1] = mBounds[3] = pts[1];
+    for (uint32_t ct = 0; ct < count; ct++) {
+        mBounds[0] = rsMin(mBounds[0], pts[ct * 2]);
+        mBounds[1] = rsMin(mBounds[1], pts[ct * 2 + 1]);
+        mBounds[2] = rsMax(mBounds[2], pts[ct * 2]);
+        mBounds[3] = rsMax(mBounds[3], pts[ct * 2 + 1]);
+    }
 
-    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
-    if (!dc->gl.shaderCache->setup(rsc)) {
-        return;
+    uint32_t pps = mPointsPerSegment;
+    for (uint32_t s = 0; s + pps <= count; s += pps) {
+        float len = 0.f;
+        for (uint32_t ct = 1; ct < pps; ct++) {
+            float dx = pts[(s + ct) * 2] - pts[(s + ct - 1) * 2];
+            float dy = pts[(s + ct) * 2 + 1] - pts[(s + ct - 1) * 2 + 1];
+            len += sqrtf(dx * dx + dy * dy);
+        }
+        mMaxSegmentLength = rsMax(mMaxSegmentLength, len);
     }
+}
 
-    RsdVertexArray::Attrib attribs[2];
-    attribs[0].set(GL_FLOAT, 2, 8, false, (uint32_t)vtx, "ATTRIB_position");
-    attribs[1].set(GL_FLOAT, 4, 16, false, (uint32_t)color, "ATTRIB_color");
-    RsdVertexArray va(attribs, 2);
-    va.setup(rsc);
+// Scales the longest segment by how large the bounds come out on screen
+// under the fixed function vertex program, aiming for lines of about
+// 8 / quality pixels.  User programs keep the level tessellated first.
+uint32_t DrvPathStatic::pickLevel(Context *rsc) const {
+    ProgramVertex *pv = rsc->getProgramVertex();
+    float extent = rsMax(mBounds[2] - mBounds[0], mBounds[3] - mBounds[1]);
+    if (!pv || pv->isUserProgram() || (extent <= 0.f) || !rsc->getWidth()) {
+        return mLevel ? mLevel : 4;
+    }
 
-    //LOGE("mSegmentCount %i", mSegmentCount);
-    for (uint32_t ct=0; ct < mSegmentCount; ct++) {
-        segment_t *s = &mSegments[ct];
+    float sx1 = 0.f, sy1 = 0.f, sx2 = 0.f, sy2 = 0.f;
+    for (uint32_t ct = 0; ct < 4; ct++) {
+        float in[3] = {mBounds[(ct & 1) ? 2 : 0], mBounds[(ct & 2) ? 3 : 1], 0.f};
+        float out[4];
+        pv->transformToScreen(rsc, out, in);
+        if (out[3] <= 0.f) {
+            return MAX_LEVEL;
+        }
+        float x = (out[0] / out[3] + 1.f) * 0.5f * rsc->getWidth();
+        float y = (out[1] / out[3] + 1.f) * 0.5f * rsc->getHeight();
+        if (!ct) {
+            sx1 = sx2 = x;
+            sy1 = sy2 = y;
+        }
+        sx1 = rsMin(sx1, x);
+        sy1 = rsMin(sy1, y);
+        sx2 = rsMax(sx2, x);
+        sy2 = rsMax(sy2, y);
+    }
+    float pixelsPerUnit = rsMax(sx2 - sx1, sy2 - sy1) / extent;
 
-        vtx[0] = s->x1;
-        vtx[1] = s->y1;
-        vtx[2] = s->xc;
-        vtx[3] = s->yc;
+    float quality = rsMax(mPath->mHal.state.quality, 0.01f);
+    float lines = mMaxSegmentLength * pixelsPerUnit * quality / 8.f;
+    uint32_t level = MIN_LEVEL;
+    while ((level < MAX_LEVEL) && ((float)(1 << level) < lines)) {
+        level++;
+    }
+    return level;
+}
 
-        vtx[4] = s->x2;
-        vtx[5] = s->y2;
-        vtx[6] = s->xc;
-        vtx[7] = s->yc;
+void DrvPathStatic::tessellate(uint32_t level) {
+    const Allocation *vtx = mPath->mHal.state.vertices;
+    const float *pts = (const float *)vtx->mHal.drvState.lod[0].mallocPtr;
+    uint32_t segments = vtx->getType()->getDimX() / mPointsPerSegment;
+    uint32_t steps = 1 << level;
+
+    mVertexCount = segments * steps * 2;
+    float *out = new float[mVertexCount * 2 + 2];
+    float *o = out;
+    for (uint32_t s = 0; s < segments; s++) {
+        const float *p = &pts[s * mPointsPerSegment * 2];
+        float px = p[0];
+        float py = p[1];
+        for (uint32_t ct = 1; ct <= steps; ct++) {
+            float t = (float)ct / steps;
+            float u = 1.f - t;
+            float x, y;
+            if (mPointsPerSegment == 4) {
+                float b0 = u * u * u, b1 = 3.f * u * u * t, b2 = 3.f * u * t * t, b3 = t * t * t;
+                x = b0 * p[0] + b1 * p[2] + b2 * p[4] + b3 * p[6];
+                y = b0 * p[1] + b1 * p[3] + b2 * p[5] + b3 * p[7];
+            } else {
+                float b0 = u * u, b1 = 2.f * u * t, b2 = t * t;
+                x = b0 * p[0] + b1 * p[2] + b2 * p[4];
+                y = b0 * p[1] + b1 * p[3] + b2 * p[5];
+            }
+            o[0] = px;
+            o[1] = py;
+            o[2] = x;
+            o[3] = y;
+            o += 4;
+            px = x;
+            py = y;
+        }
+    }
 
-        vtx[8] = s->x1;
-        vtx[9] = s->y1;
-        vtx[10] = s->x2;
-        vtx[11] = s->y2;
+    if (!mBuffer) {
+        glGenBuffers(1, &mBuffer);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    glBufferData(GL_ARRAY_BUFFER, mVertexCount * 2 * sizeof(float), out, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    delete[] out;
+    mLevel = level;
+}
 
-        RSD_CALL_GL(glDrawArrays, GL_LINES, 0, 6);
+void DrvPathStatic::draw(Context *rsc) {
+    if (!rsc->setupCheck()) {
+        return;
     }
 
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (!dc->gl.shaderCache->setup(rsc)) {
+        return;
+    }
+
+    bool stale = isStale() || !mLevel;
+    if (stale) {
+        measure();
+        mVertexVersion = allocationVersion(mPath->mHal.state.vertices);
+        mLoopsVersion = allocationVersion(mPath->mHal.state.loops);
+    }
+    uint32_t level = pickLevel(rsc);
+    if (stale || (level != mLevel)) {
+        tessellate(level);
+    }
+    if (!mVertexCount) {
+        return;
+    }
+
+    RsdVertexArray::Attrib attribs[1];
+    attribs[0].set(GL_FLOAT, 2, 8, false, 0, "ATTRIB_position");
+    attribs[0].buffer = mBuffer;
+    RsdVertexArray va(attribs, 1);
+    va.setup(rsc);
+
+    RSD_CALL_GL(glDrawArrays, GL_LINES, 0, mVertexCount);
 }
 
 DrvPathDynamic::DrvPathDynamic() {
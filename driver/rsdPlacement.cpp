@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsdCore.h"
+#include "rsdPlacement.h"
+
+#include "rsContext.h"
+#include "rsScriptC.h"
+
+#include <dlfcn.h>
+#include <time.h>
+
+#ifndef RS_SERVER
+#include <cutils/properties.h>
+#endif
+
+using namespace android;
+using namespace android::renderscript;
+
+static int64_t nowNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static uint32_t hashBytes(uint32_t h, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t ct = 0; ct < len; ct++) {
+        h = (h ^ p[ct]) * 16777619;
+    }
+    return h;
+}
+
+static const uint32_t kHashSeed = 2166136261u;
+
+RsdPlacement * RsdPlacement::create(Context *rsc) {
+    const char *name = "libRSAccel.so";
+    Backend forced = BACKEND_AUTO;
+#ifndef RS_SERVER
+    char path[PROPERTY_VALUE_MAX];
+    if (property_get("debug.rs.accel", path, NULL) > 0) {
+        name = path;
+    }
+    char buf[PROPERTY_VALUE_MAX];
+    property_get("debug.rs.placement", buf, "");
+    if (!strcmp(buf, "cpu")) {
+        return NULL;
+    } else if (!strcmp(buf, "accel")) {
+        forced = BACKEND_ACCEL;
+    }
+#endif
+
+    void *lib = dlopen(name, RTLD_LAZY);
+    if (!lib) {
+        // Most devices have no accelerator.
+        return NULL;
+    }
+    RsdAcceleratorCreateFunc createFunc =
+            (RsdAcceleratorCreateFunc)dlsym(lib, "rsdAcceleratorCreate");
+    RsdAccelerator *accel = createFunc ? createFunc(rsc) : NULL;
+    if (!accel) {
+        ALOGE("Failed to set up accelerator %s", name);
+        dlclose(lib);
+        return NULL;
+    }
+
+    RsdPlacement *p = new RsdPlacement(rsc, lib, accel);
+    p->mForced = forced;
+    return p;
+}
+
+RsdPlacement::RsdPlacement(Context *rsc, void *lib, RsdAccelerator *accel) {
+    mRSC = rsc;
+    mLibrary = lib;
+    mAccel = accel;
+    mForced = BACKEND_AUTO;
+    pthread_mutex_init(&mLock, NULL);
+}
+
+RsdPlacement::~RsdPlacement() {
+    for (size_t ct = 0; ct < mEntries.size(); ct++) {
+        delete mEntries[ct].accel;
+    }
+    delete mAccel;
+    dlclose(mLibrary);
+    pthread_mutex_destroy(&mLock);
+}
+
+void RsdPlacement::addEntry(const Script *s, RsdCpuReference::CpuScript *accel,
+                            uint32_t codeHash) {
+    Entry e;
+    e.script = s;
+    e.accel = accel;
+    e.codeHash = codeHash;
+    e.pinned = false;
+    pthread_mutex_lock(&mLock);
+    mEntries.push(e);
+    pthread_mutex_unlock(&mLock);
+}
+
+void RsdPlacement::addScript(const ScriptC *s, char const *resName, char const *cacheDir,
+                             uint8_t const *bitcode, size_t bitcodeSize, uint32_t flags) {
+    RsdCpuReference::CpuScript *accel = mAccel->createScript(s, resName, cacheDir,
+                                                             bitcode, bitcodeSize, flags);
+    if (accel) {
+        addEntry(s, accel, hashBytes(kHashSeed, bitcode, bitcodeSize));
+    }
+}
+
+void RsdPlacement::addIntrinsic(const Script *s, RsScriptIntrinsicID iid, Element *e) {
+    RsdCpuReference::CpuScript *accel = mAccel->createIntrinsic(s, iid, e);
+    if (accel) {
+        uint32_t key[2] = {(uint32_t)iid, (uint32_t)e->getSizeBytes()};
+        addEntry(s, accel, hashBytes(kHashSeed, key, sizeof(key)));
+    }
+}
+
+RsdPlacement::Entry * RsdPlacement::findEntry(const Script *s) const {
+    for (size_t ct = 0; ct < mEntries.size(); ct++) {
+        if (mEntries[ct].script == s) {
+            return (Entry *)&mEntries[ct];
+        }
+    }
+    return NULL;
+}
+
+void RsdPlacement::removeScript(const Script *s) {
+    RsdCpuReference::CpuScript *accel = NULL;
+    pthread_mutex_lock(&mLock);
+    for (size_t ct = 0; ct < mEntries.size(); ct++) {
+        if (mEntries[ct].script == s) {
+            accel = mEntries[ct].accel;
+            mEntries.removeAt(ct);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    delete accel;
+}
+
+RsdCpuReference::CpuScript * RsdPlacement::getScript(const Script *s) const {
+    pthread_mutex_lock(&mLock);
+    Entry *e = findEntry(s);
+    RsdCpuReference::CpuScript *accel = e ? e->accel : NULL;
+    pthread_mutex_unlock(&mLock);
+    return accel;
+}
+
+void RsdPlacement::pin(const Script *s) {
+    pthread_mutex_lock(&mLock);
+    Entry *e = findEntry(s);
+    if (e) {
+        e->pinned = true;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+RsdPlacement::Decision * RsdPlacement::findDecision(uint32_t codeHash, uint32_t slot,
+                                                    const Allocation *shape) {
+    const Type *t = shape->getType();
+    for (size_t ct = 0; ct < mDecisions.size(); ct++) {
+        Decision &d = mDecisions.editItemAt(ct);
+        if ((d.codeHash == codeHash) && (d.slot == slot) && (d.dimX == t->getDimX()) &&
+            (d.dimY == t->getDimY()) && (d.dimZ == t->getDimZ())) {
+            return &d;
+        }
+    }
+    Decision d;
+    memset(&d, 0, sizeof(d));
+    d.codeHash = codeHash;
+    d.slot = slot;
+    d.dimX = t->getDimX();
+    d.dimY = t->getDimY();
+    d.dimZ = t->getDimZ();
+    d.backend = BACKEND_AUTO;
+    mDecisions.push(d);
+    return &mDecisions.editItemAt(mDecisions.size() - 1);
+}
+
+static void launch(RsdCpuReference::CpuScript *cs, bool multi, uint32_t slot,
+                   const Allocation ** ains, size_t inLen, Allocation * aout,
+                   const void * usr, uint32_t usrLen, const RsScriptCall *sc) {
+    if (multi) {
+        cs->invokeForEachMulti(slot, ains, inLen, aout, usr, usrLen, sc);
+    } else {
+        cs->invokeForEach(slot, ains[0], aout, usr, usrLen, sc);
+    }
+}
+
+void RsdPlacement::forEach(RsdCpuReference::CpuScript *cs, const Script *s, uint32_t slot,
+                           bool multi, const Allocation ** ains, size_t inLen,
+                           Allocation * aout, const void * usr, uint32_t usrLen,
+                           const RsScriptCall *sc) {
+    RsdHal *dc = (RsdHal *)mRSC->mHal.drv;
+    const Allocation *shape = aout ? aout : (inLen ? ains[0] : NULL);
+
+    // Copied out, as other threads may grow or shrink the vectors while
+    // this one launches.
+    pthread_mutex_lock(&mLock);
+    Entry *found = findEntry(s);
+    Entry e;
+    memset(&e, 0, sizeof(e));
+    if (found) {
+        e = *found;
+    }
+
+    // Launches from inside kernels stay with the backend running them, and
+    // accelerators have no notion of launch regions.
+    bool timed = false;
+    Backend backend = BACKEND_CPU;
+    if (found && !e.pinned && shape && !dc->mCpuRef->getInForEach() &&
+        !(sc && sc->regionCount)) {
+        if (mForced == BACKEND_ACCEL) {
+            backend = BACKEND_ACCEL;
+        } else {
+            Decision *d = findDecision(e.codeHash, slot, shape);
+            if (d->backend != BACKEND_AUTO) {
+                backend = d->backend;
+            } else {
+                // Alternate until both have their trial launches.
+                backend = (d->runs[0] <= d->runs[1]) ? BACKEND_CPU : BACKEND_ACCEL;
+                timed = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (found && aout) {
+        aout->mHal.drvState.contentVersion++;
+    }
+    if (backend == BACKEND_CPU && !timed) {
+        launch(cs, multi, slot, ains, inLen, aout, usr, usrLen, sc);
+        return;
+    }
+
+    // The accelerator reads host memory, and timing needs the CPU idle.
+    dc->mCpuRef->finishLaunches();
+    int64_t start = nowNs();
+    if (backend == BACKEND_CPU) {
+        launch(cs, multi, slot, ains, inLen, aout, usr, usrLen, sc);
+        dc->mCpuRef->finishLaunches();
+    } else {
+        launch(e.accel, multi, slot, ains, inLen, aout, usr, usrLen, sc);
+    }
+    if (!timed) {
+        return;
+    }
+    int64_t ns = nowNs() - start;
+
+    pthread_mutex_lock(&mLock);
+    Decision *d = findDecision(e.codeHash, slot, shape);
+    uint32_t b = (backend == BACKEND_CPU) ? 0 : 1;
+    d->ns[b] += ns;
+    d->runs[b]++;
+    // Another thread's trials may have placed it meanwhile.
+    if ((d->backend == BACKEND_AUTO) &&
+        (d->runs[0] >= TRIAL_LAUNCHES) && (d->runs[1] >= TRIAL_LAUNCHES)) {
+        d->backend = (d->ns[1] < d->ns[0]) ? BACKEND_ACCEL : BACKEND_CPU;
+        if (mRSC->props.mLogScripts) {
+            ALOGV("Placing slot %u of script %p at %ux%ux%u on the %s, "
+                  "%llu us on the CPU, %llu us accelerated", slot, s, d->dimX, d->dimY, d->dimZ,
+                  (d->backend == BACKEND_ACCEL) ? "accelerator" : "CPU",
+                  (unsigned long long)(d->ns[0] / (1000 * d->runs[0])),
+                  (unsigned long long)(d->ns[1] / (1000 * d->runs[1])));
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RSD_PLACEMENT_H
+#define RSD_PLACEMENT_H
+
+#include "rsdCore.h"
+
+// A second backend, typically a GPU, that kernels of the reference driver
+// can be placed on.  It is loaded from libRSAccel.so, or the library named
+// by debug.rs.accel, through its rsdAcceleratorCreate entry point.
+//
+// Its scripts work on the host memory of the allocations they are given
+// and must have left their results there when a launch returns.  Before a
+// launch writes an allocation its drvState.contentVersion is advanced, so
+// a backend keeping a copy of its own can tell whether the host memory
+// changed since it last ran.  Accelerated kernels must not write globals.
+class RsdAccelerator {
+public:
+    virtual ~RsdAccelerator() {}
+
+    // NULL for scripts and intrinsics it doesn't run.
+    virtual android::renderscript::RsdCpuReference::CpuScript * createScript(
+            const android::renderscript::ScriptC *s, char const *resName, char const *cacheDir,
+            uint8_t const *bitcode, size_t bitcodeSize, uint32_t flags) = 0;
+    virtual android::renderscript::RsdCpuReference::CpuScript * createIntrinsic(
+            const android::renderscript::Script *s, RsScriptIntrinsicID iid,
+            android::renderscript::Element *e) = 0;
+};
+
+typedef RsdAccelerator * (* RsdAcceleratorCreateFunc)(android::renderscript::Context *rsc);
+
+// Places the kernels of scripts the accelerator also has on whichever
+// backend runs them faster.  Each kernel slot at each launch shape is timed
+// on both for a few launches and then stays on the quicker one.
+class RsdPlacement {
+public:
+    // NULL when there is no accelerator.
+    static RsdPlacement * create(android::renderscript::Context *rsc);
+    ~RsdPlacement();
+
+    void addScript(const android::renderscript::ScriptC *s, char const *resName,
+                   char const *cacheDir, uint8_t const *bitcode, size_t bitcodeSize,
+                   uint32_t flags);
+    void addIntrinsic(const android::renderscript::Script *s, RsScriptIntrinsicID iid,
+                      android::renderscript::Element *e);
+    void removeScript(const android::renderscript::Script *s);
+
+    // The accelerator's instance of s, NULL if it has none.
+    android::renderscript::RsdCpuReference::CpuScript * getScript(
+            const android::renderscript::Script *s) const;
+    // Keeps the kernels of s on the CPU from now on; for scripts whose
+    // globals only the CPU instance has seen change.
+    void pin(const android::renderscript::Script *s);
+
+    // Launches s on one of the backends, cs being its CPU instance.  Only
+    // multi launches take more than the one input in ains, which may be
+    // NULL.
+    void forEach(android::renderscript::RsdCpuReference::CpuScript *cs,
+                 const android::renderscript::Script *s, uint32_t slot, bool multi,
+                 const android::renderscript::Allocation ** ains, size_t inLen,
+                 android::renderscript::Allocation * aout,
+                 const void * usr, uint32_t usrLen,
+                 const RsScriptCall *sc);
+
+private:
+    enum Backend {
+        BACKEND_AUTO,
+        BACKEND_CPU,
+        BACKEND_ACCEL
+    };
+    enum {
+        // Timed launches on each backend before a kernel is placed.
+        TRIAL_LAUNCHES = 3
+    };
+
+    struct Entry {
+        const android::renderscript::Script *script;
+        android::renderscript::RsdCpuReference::CpuScript *accel;
+        // Identifies the script's code, so placements carry over to other
+        // instances of it.
+        uint32_t codeHash;
+        bool pinned;
+    };
+    struct Decision {
+        uint32_t codeHash;
+        uint32_t slot;
+        uint32_t dimX;
+        uint32_t dimY;
+        uint32_t dimZ;
+        uint32_t runs[2];
+        uint64_t ns[2];
+        Backend backend;
+    };
+
+    RsdPlacement(android::renderscript::Context *rsc, void *lib, RsdAccelerator *accel);
+
+    void addEntry(const android::renderscript::Script *s,
+                  android::renderscript::RsdCpuReference::CpuScript *accel,
+                  uint32_t codeHash);
+
+    // Both called with mLock held; what they return is only valid until it
+    // is released.
+    Entry * findEntry(const android::renderscript::Script *s) const;
+    Decision * findDecision(uint32_t codeHash, uint32_t slot,
+                            const android::renderscript::Allocation *shape);
+
+    android::renderscript::Context *mRSC;
+    void *mLibrary;
+    RsdAccelerator *mAccel;
+    // BACKEND_ACCEL when debug.rs.placement puts every kernel it can on
+    // the accelerator; "cpu" leaves it unloaded.
+    Backend mForced;
+
+    // Scripts are created and launched from several threads of synchronous
+    // contexts, so mEntries and mDecisions are only used under mLock.
+    mutable pthread_mutex_t mLock;
+    android::Vector<Entry> mEntries;
+    android::Vector<Decision> mDecisions;
+};
+
+#endif
@@ -40,6 +40,7 @@ bool rsdProgramVertexInit(const Context *rsc, const ProgramVertex *pv,
     RsdShader *drv = new RsdShader(pv, GL_VERTEX_SHADER, shader, shaderLen,
                                    textureNames, textureNamesCount, textureNamesLength);
     pv->mHal.drv = drv;
+    drv->precompile(rsc);
 
     return true;
 }
@@ -87,6 +88,7 @@ bool rsdProgramFragmentInit(const Context *rsc, const ProgramFragment *pf,
     RsdShader *drv = new RsdShader(pf, GL_FRAGMENT_SHADER, shader, shaderLen,
                                    textureNames, textureNamesCount, textureNamesLength);
     pf->mHal.drv = drv;
+    drv->precompile(rsc);
 
     return true;
 }
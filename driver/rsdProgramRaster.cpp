@@ -35,15 +35,15 @@ bool rsdProgramRasterInit(const Context *, const ProgramRaster *) {
 void rsdProgramRasterSetActive(const Context *rsc, const ProgramRaster *pr) {
     switch (pr->mHal.state.cull) {
         case RS_CULL_BACK:
-            RSD_CALL_GL(glEnable, GL_CULL_FACE);
-            RSD_CALL_GL(glCullFace, GL_BACK);
+            rsdGLSetCap(rsc, RSD_GL_CAP_CULL_FACE, true);
+            rsdGLSetCullFace(rsc, GL_BACK);
             break;
         case RS_CULL_FRONT:
-            RSD_CALL_GL(glEnable, GL_CULL_FACE);
-            RSD_CALL_GL(glCullFace, GL_FRONT);
+            rsdGLSetCap(rsc, RSD_GL_CAP_CULL_FACE, true);
+            rsdGLSetCullFace(rsc, GL_FRONT);
             break;
         case RS_CULL_NONE:
-            RSD_CALL_GL(glDisable, GL_CULL_FACE);
+            rsdGLSetCap(rsc, RSD_GL_CAP_CULL_FACE, false);
             break;
         default:
             rsc->setError(RS_ERROR_FATAL_DRIVER, "Invalid cull type");
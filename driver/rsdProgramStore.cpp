@@ -156,29 +156,29 @@ error:
 void rsdProgramStoreSetActive(const Context *rsc, const ProgramStore *ps) {
     DrvProgramStore *drv = (DrvProgramStore *)ps->mHal.drv;
 
-    RSD_CALL_GL(glColorMask, ps->mHal.state.colorRWriteEnable,
-                ps->mHal.state.colorGWriteEnable,
-                ps->mHal.state.colorBWriteEnable,
-                ps->mHal.state.colorAWriteEnable);
+    rsdGLSetColorMask(rsc, ps->mHal.state.colorRWriteEnable,
+                      ps->mHal.state.colorGWriteEnable,
+                      ps->mHal.state.colorBWriteEnable,
+                      ps->mHal.state.colorAWriteEnable);
 
     if (drv->blendEnable) {
-        RSD_CALL_GL(glEnable, GL_BLEND);
-        RSD_CALL_GL(glBlendFunc, drv->blendSrc, drv->blendDst);
+        rsdGLSetCap(rsc, RSD_GL_CAP_BLEND, true);
+        rsdGLSetBlendFunc(rsc, drv->blendSrc, drv->blendDst);
     } else {
-        RSD_CALL_GL(glDisable, GL_BLEND);
+        rsdGLSetCap(rsc, RSD_GL_CAP_BLEND, false);
     }
 
     if (rsc->mUserSurfaceConfig.depthMin > 0) {
-        RSD_CALL_GL(glDepthMask, ps->mHal.state.depthWriteEnable);
+        rsdGLSetDepthMask(rsc, ps->mHal.state.depthWriteEnable);
         if (drv->depthTestEnable || ps->mHal.state.depthWriteEnable) {
-            RSD_CALL_GL(glEnable, GL_DEPTH_TEST);
-            RSD_CALL_GL(glDepthFunc, drv->depthFunc);
+            rsdGLSetCap(rsc, RSD_GL_CAP_DEPTH_TEST, true);
+            rsdGLSetDepthFunc(rsc, drv->depthFunc);
         } else {
-            RSD_CALL_GL(glDisable, GL_DEPTH_TEST);
+            rsdGLSetCap(rsc, RSD_GL_CAP_DEPTH_TEST, false);
         }
     } else {
-        RSD_CALL_GL(glDepthMask, false);
-        RSD_CALL_GL(glDisable, GL_DEPTH_TEST);
+        rsdGLSetDepthMask(rsc, false);
+        rsdGLSetCap(rsc, RSD_GL_CAP_DEPTH_TEST, false);
     }
 
     /*
@@ -189,11 +189,7 @@ void rsdProgramStoreSetActive(const Context *rsc, const ProgramStore *ps) {
     }
     */
 
-    if (ps->mHal.state.ditherEnable) {
-        RSD_CALL_GL(glEnable, GL_DITHER);
-    } else {
-        RSD_CALL_GL(glDisable, GL_DITHER);
-    }
+    rsdGLSetCap(rsc, RSD_GL_CAP_DITHER, ps->mHal.state.ditherEnable);
 }
 
 void rsdProgramStoreDestroy(const Context *rsc, const ProgramStore *ps) {
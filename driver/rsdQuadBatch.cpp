@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <GLES/gl.h>
+#include <GLES2/gl2.h>
+
+#include "rsContext.h"
+#include "rsProgramVertex.h"
+
+#include "rsdCore.h"
+#include "rsdQuadBatch.h"
+#include "rsdShaderCache.h"
+#include "rsdVertexArray.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+// Up to MAX_QUADS quads as indexed triangles with interleaved position and
+// texture coordinates.  Only the vertex program is kept, as sprites draw
+// with the default one; the rest of the state can't change before a flush.
+struct RsdQuadBatch {
+    enum {
+        MAX_QUADS = 1024,
+        FLOATS_PER_VERT = 5
+    };
+
+    uint32_t count;
+    ObjectBaseRef<ProgramVertex> vertex;
+    float verts[MAX_QUADS * 4 * FLOATS_PER_VERT];
+    uint16_t indices[MAX_QUADS * 6];
+};
+
+RsdQuadBatch * rsdQuadBatchCreate() {
+    RsdQuadBatch *batch = new RsdQuadBatch();
+    batch->count = 0;
+    for (uint32_t ct = 0; ct < RsdQuadBatch::MAX_QUADS; ct++) {
+        uint16_t *i = &batch->indices[ct * 6];
+        uint16_t v = ct * 4;
+        // The triangles of the fan the quads used to be drawn as.
+        i[0] = v;
+        i[1] = v + 1;
+        i[2] = v + 2;
+        i[3] = v;
+        i[4] = v + 2;
+        i[5] = v + 3;
+    }
+    return batch;
+}
+
+void rsdQuadBatchDestroy(RsdQuadBatch *batch) {
+    delete batch;
+}
+
+void rsdQuadBatchFlush(Context *rsc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (!dc->mHasGraphics) {
+        return;
+    }
+    RsdQuadBatch *batch = dc->gl.quadBatch;
+    if (!batch->count) {
+        return;
+    }
+    uint32_t count = batch->count;
+    batch->count = 0;
+
+    ObjectBaseRef<ProgramVertex> current(rsc->getProgramVertex());
+    bool swapVertex = current.get() != batch->vertex.get();
+    if (swapVertex) {
+        rsc->setProgramVertex(batch->vertex.get());
+    }
+
+    if (rsc->setupCheck() && dc->gl.shaderCache->setup(rsc)) {
+        const uint32_t stride = RsdQuadBatch::FLOATS_PER_VERT * sizeof(float);
+        RsdVertexArray::Attrib attribs[2];
+        attribs[0].set(GL_FLOAT, 3, stride, false, 0, "ATTRIB_position");
+        attribs[0].ptr = (const uint8_t *)batch->verts;
+        attribs[1].set(GL_FLOAT, 2, stride, false, 3 * sizeof(float), "ATTRIB_texture0");
+        attribs[1].ptr = (const uint8_t *)batch->verts;
+
+        RsdVertexArray va(attribs, 2);
+        va.setup(rsc);
+
+        RSD_CALL_GL(glDrawElements, GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT,
+                    batch->indices);
+    }
+
+    if (swapVertex) {
+        rsc->setProgramVertex(current.get());
+    }
+    batch->vertex.clear();
+}
+
+void rsdQuadBatchAppend(Context *rsc,
+                        float x1, float y1, float z1, float u1, float v1,
+                        float x2, float y2, float z2, float u2, float v2,
+                        float x3, float y3, float z3, float u3, float v3,
+                        float x4, float y4, float z4, float u4, float v4) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    RsdQuadBatch *batch = dc->gl.quadBatch;
+
+    if (batch->count && (batch->vertex.get() != rsc->getProgramVertex())) {
+        rsdQuadBatchFlush(rsc);
+    }
+    if (!batch->count) {
+        batch->vertex.set(rsc->getProgramVertex());
+    }
+
+    float *v = &batch->verts[batch->count * 4 * RsdQuadBatch::FLOATS_PER_VERT];
+    v[0] = x1;  v[1] = y1;  v[2] = z1;  v[3] = u1;  v[4] = v1;
+    v[5] = x2;  v[6] = y2;  v[7] = z2;  v[8] = u2;  v[9] = v2;
+    v[10] = x3; v[11] = y3; v[12] = z3; v[13] = u3; v[14] = v3;
+    v[15] = x4; v[16] = y4; v[17] = z4; v[18] = u4; v[19] = v4;
+
+    batch->count++;
+    if (batch->count == RsdQuadBatch::MAX_QUADS) {
+        rsdQuadBatchFlush(rsc);
+    }
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RSD_QUAD_BATCH_H
+#define RSD_QUAD_BATCH_H
+
+#include <rs_hal.h>
+
+struct RsdQuadBatch;
+
+RsdQuadBatch * rsdQuadBatchCreate();
+void rsdQuadBatchDestroy(RsdQuadBatch *batch);
+
+// Queues a quad to be drawn with the state current when it is queued.
+// Anything that changes that state, or reads what was drawn, has to call
+// rsdQuadBatchFlush first.
+void rsdQuadBatchAppend(android::renderscript::Context *rsc,
+                        float x1, float y1, float z1, float u1, float v1,
+                        float x2, float y2, float z2, float u2, float v2,
+                        float x3, float y3, float z3, float u3, float v3,
+                        float x4, float y4, float z4, float u4, float v4);
+void rsdQuadBatchFlush(android::renderscript::Context *rsc);
+
+
+#endif
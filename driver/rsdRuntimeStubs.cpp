@@ -25,9 +25,11 @@
 #include "rsdBcc.h"
 
 #include "rsdPath.h"
+#include "rsdQuadBatch.h"
 #include "rsdAllocation.h"
 #include "rsdShaderCache.h"
 #include "rsdVertexArray.h"
+#include "rsdGLTimer.h"
 
 #include <time.h>
 
@@ -108,11 +110,17 @@ typedef struct {
 
 static void SC_AllocationSyncAll2(Allocation *a, RsAllocationUsageType source) {
     Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
     rsrAllocationSyncAll(rsc, a, source);
 }
 
 static void SC_AllocationSyncAll(Allocation *a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
     rsrAllocationSyncAll(rsc, a, RS_ALLOCATION_USAGE_SCRIPT);
 }
 
@@ -123,6 +131,9 @@ static void SC_AllocationCopy1DRange(Allocation *dstAlloc,
                                      Allocation *srcAlloc,
                                      uint32_t srcOff, uint32_t srcMip) {
     Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
     rsrAllocationCopy1DRange(rsc, dstAlloc, dstOff, dstMip, count,
                              srcAlloc, srcOff, srcMip);
 }
@@ -135,6 +146,9 @@ static void SC_AllocationCopy2DRange(Allocation *dstAlloc,
                                      uint32_t srcXoff, uint32_t srcYoff,
                                      uint32_t srcMip, uint32_t srcFace) {
     Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
     rsrAllocationCopy2DRange(rsc, dstAlloc,
                              dstXoff, dstYoff, dstMip, dstFace,
                              width, height,
@@ -142,14 +156,44 @@ static void SC_AllocationCopy2DRange(Allocation *dstAlloc,
                              srcXoff, srcYoff, srcMip, srcFace);
 }
 
+static void SC_AllocationSort(Allocation *keys) {
+    Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
+    rsrAllocationSort(rsc, keys, NULL);
+}
+
+static void SC_AllocationSortByKey(Allocation *keys, Allocation *values) {
+    Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
+    rsrAllocationSort(rsc, keys, values);
+}
+
+static uint32_t SC_AllocationCompact(Allocation *dst, Allocation *src, Allocation *flags) {
+    Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
+    return rsrAllocationCompact(rsc, dst, src, flags);
+}
+
 static void SC_AllocationIoSend(Allocation *alloc) {
     Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
     rsrAllocationIoSend(rsc, alloc);
 }
 
 
 static void SC_AllocationIoReceive(Allocation *alloc) {
     Context *rsc = RsdCpuReference::getTlsContext();
+#ifndef RS_COMPATIBILITY_LIB
+    rsdQuadBatchFlush(rsc);
+#endif
     rsrAllocationIoReceive(rsc, alloc);
 }
 
@@ -161,66 +205,79 @@ static void SC_AllocationIoReceive(Allocation *alloc) {
 
 static void SC_BindTexture(ProgramFragment *pf, uint32_t slot, Allocation *a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindTexture(rsc, pf, slot, a);
 }
 
 static void SC_BindVertexConstant(ProgramVertex *pv, uint32_t slot, Allocation *a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindConstant(rsc, pv, slot, a);
 }
 
 static void SC_BindFragmentConstant(ProgramFragment *pf, uint32_t slot, Allocation *a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindConstant(rsc, pf, slot, a);
 }
 
 static void SC_BindSampler(ProgramFragment *pf, uint32_t slot, Sampler *s) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindSampler(rsc, pf, slot, s);
 }
 
 static void SC_BindProgramStore(ProgramStore *ps) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindProgramStore(rsc, ps);
 }
 
 static void SC_BindProgramFragment(ProgramFragment *pf) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindProgramFragment(rsc, pf);
 }
 
 static void SC_BindProgramVertex(ProgramVertex *pv) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindProgramVertex(rsc, pv);
 }
 
 static void SC_BindProgramRaster(ProgramRaster *pr) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindProgramRaster(rsc, pr);
 }
 
 static void SC_BindFrameBufferObjectColorTarget(Allocation *a, uint32_t slot) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindFrameBufferObjectColorTarget(rsc, a, slot);
 }
 
 static void SC_BindFrameBufferObjectDepthTarget(Allocation *a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindFrameBufferObjectDepthTarget(rsc, a);
 }
 
 static void SC_ClearFrameBufferObjectColorTarget(uint32_t slot) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrClearFrameBufferObjectColorTarget(rsc, slot);
 }
 
 static void SC_ClearFrameBufferObjectDepthTarget(Context *, Script *) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrClearFrameBufferObjectDepthTarget(rsc);
 }
 
 static void SC_ClearFrameBufferObjectTargets(Context *, Script *) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrClearFrameBufferObjectTargets(rsc);
 }
 
@@ -231,21 +288,25 @@ static void SC_ClearFrameBufferObjectTargets(Context *, Script *) {
 
 static void SC_VpLoadProjectionMatrix(const rsc_Matrix *m) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrVpLoadProjectionMatrix(rsc, m);
 }
 
 static void SC_VpLoadModelMatrix(const rsc_Matrix *m) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrVpLoadModelMatrix(rsc, m);
 }
 
 static void SC_VpLoadTextureMatrix(const rsc_Matrix *m) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrVpLoadTextureMatrix(rsc, m);
 }
 
 static void SC_PfConstantColor(ProgramFragment *pf, float r, float g, float b, float a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrPfConstantColor(rsc, pf, r, g, b, a);
 }
 
@@ -265,32 +326,16 @@ static void SC_DrawQuadTexCoords(float x1, float y1, float z1, float u1, float v
                                  float x4, float y4, float z4, float u4, float v4) {
     Context *rsc = RsdCpuReference::getTlsContext();
 
-    if (!rsc->setupCheck()) {
-        return;
-    }
-
-    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
-    if (!dc->gl.shaderCache->setup(rsc)) {
-        return;
-    }
-
     //ALOGE("Quad");
     //ALOGE("%4.2f, %4.2f, %4.2f", x1, y1, z1);
     //ALOGE("%4.2f, %4.2f, %4.2f", x2, y2, z2);
     //ALOGE("%4.2f, %4.2f, %4.2f", x3, y3, z3);
     //ALOGE("%4.2f, %4.2f, %4.2f", x4, y4, z4);
 
-    float vtx[] = {x1,y1,z1, x2,y2,z2, x3,y3,z3, x4,y4,z4};
-    const float tex[] = {u1,v1, u2,v2, u3,v3, u4,v4};
-
-    RsdVertexArray::Attrib attribs[2];
-    attribs[0].set(GL_FLOAT, 3, 12, false, (uint32_t)vtx, "ATTRIB_position");
-    attribs[1].set(GL_FLOAT, 2, 8, false, (uint32_t)tex, "ATTRIB_texture0");
-
-    RsdVertexArray va(attribs, 2);
-    va.setup(rsc);
-
-    RSD_CALL_GL(glDrawArrays, GL_TRIANGLE_FAN, 0, 4);
+    rsdQuadBatchAppend(rsc, x1, y1, z1, u1, v1,
+                       x2, y2, z2, u2, v2,
+                       x3, y3, z3, u3, v3,
+                       x4, y4, z4, u4, v4);
 }
 
 static void SC_DrawQuad(float x1, float y1, float z1,
@@ -327,24 +372,41 @@ static void SC_DrawRect(float x1, float y1, float x2, float y2, float z) {
 
 static void SC_DrawPath(Path *p) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsdPathDraw(rsc, p);
 }
 
 static void SC_DrawMesh(Mesh *m) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    rsdQuadBatchFlush(rsc);
+    if (dc->gl.timer) {
+        rsdGLTimerGroup(rsc, dc->gl.timer, true);
+    }
     rsrDrawMesh(rsc, m);
+    if (dc->gl.timer) {
+        rsdGLTimerGroup(rsc, dc->gl.timer, true);
+    }
 }
 
 static void SC_DrawMeshPrimitive(Mesh *m, uint32_t primIndex) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrDrawMeshPrimitive(rsc, m, primIndex);
 }
 
 static void SC_DrawMeshPrimitiveRange(Mesh *m, uint32_t primIndex, uint32_t start, uint32_t len) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrDrawMeshPrimitiveRange(rsc, m, primIndex, start, len);
 }
 
+static void SC_DrawMeshInstanced(Mesh *m, uint32_t primIndex, Allocation *transforms) {
+    Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
+    rsrDrawMeshInstanced(rsc, m, primIndex, transforms);
+}
+
 static void SC_MeshComputeBoundingBox(Mesh *m,
                                float *minX, float *minY, float *minZ,
                                float *maxX, float *maxY, float *maxZ) {
@@ -352,6 +414,12 @@ static void SC_MeshComputeBoundingBox(Mesh *m,
     rsrMeshComputeBoundingBox(rsc, m, minX, minY, minZ, maxX, maxY, maxZ);
 }
 
+static uint32_t SC_MeshCull(const rsc_Matrix *m, Mesh * const *meshes,
+                            uint8_t *visible, uint32_t count) {
+    Context *rsc = RsdCpuReference::getTlsContext();
+    return rsrMeshCull(rsc, m, meshes, visible, count);
+}
+
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -361,22 +429,26 @@ static void SC_MeshComputeBoundingBox(Mesh *m,
 
 static void SC_Color(float r, float g, float b, float a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrColor(rsc, r, g, b, a);
 }
 
 static void SC_Finish() {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsdGLFinish(rsc);
 }
 
 static void SC_ClearColor(float r, float g, float b, float a) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrPrepareClear(rsc);
     rsdGLClearColor(rsc, r, g, b, a);
 }
 
 static void SC_ClearDepth(float v) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrPrepareClear(rsc);
     rsdGLClearDepth(rsc, v);
 }
@@ -393,11 +465,13 @@ static uint32_t SC_GetHeight() {
 
 static void SC_DrawTextAlloc(Allocation *a, int x, int y) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrDrawTextAlloc(rsc, a, x, y);
 }
 
 static void SC_DrawText(const char *text, int x, int y) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrDrawText(rsc, text, x, y);
 }
 
@@ -415,6 +489,7 @@ static void SC_MeasureText(const char *text,
 
 static void SC_BindFont(Font *f) {
     Context *rsc = RsdCpuReference::getTlsContext();
+    rsdQuadBatchFlush(rsc);
     rsrBindFont(rsc, f);
 }
 
@@ -624,9 +699,7 @@ static void * ElementAt2D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
     }
 
     uint8_t *p = (uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
-    const uint32_t eSize = e->getSizeBytes();
-    const uint32_t stride = a->mHal.drvState.lod[0].stride;
-    return &p[(eSize * x) + (y * stride)];
+    return &p[a->getCellOffset(x, y, 0)];
 }
 
 static void * ElementAt3D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32_t x, uint32_t y, uint32_t z) {
@@ -668,9 +741,7 @@ static void * ElementAt3D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
     }
 
     uint8_t *p = (uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
-    const uint32_t eSize = e->getSizeBytes();
-    const uint32_t stride = a->mHal.drvState.lod[0].stride;
-    return &p[(eSize * x) + (y * stride)];
+    return &p[a->getCellOffset(x, y, z)];
 }
 
 static const void * SC_GetElementAt1D(Allocation *a, uint32_t x) {
@@ -1138,6 +1209,9 @@ static RsdCpuReference::CpuSymbol gSyms[] = {
 #endif
     { "_Z23rsAllocationCopy1DRange13rs_allocationjjjS_jj", (void *)&SC_AllocationCopy1DRange, false },
     { "_Z23rsAllocationCopy2DRange13rs_allocationjjj26rs_allocation_cubemap_facejjS_jjjS0_", (void *)&SC_AllocationCopy2DRange, false },
+    { "_Z6rsSort13rs_allocation", (void *)&SC_AllocationSort, false },
+    { "_Z11rsSortByKey13rs_allocationS_", (void *)&SC_AllocationSortByKey, false },
+    { "_Z9rsCompact13rs_allocationS_S_", (void *)&SC_AllocationCompact, false },
 
     // Messaging
 
@@ -1175,7 +1249,9 @@ static RsdCpuReference::CpuSymbol gSyms[] = {
     { "_Z11rsgDrawMesh7rs_mesh", (void *)&SC_DrawMesh, false },
     { "_Z11rsgDrawMesh7rs_meshj", (void *)&SC_DrawMeshPrimitive, false },
     { "_Z11rsgDrawMesh7rs_meshjjj", (void *)&SC_DrawMeshPrimitiveRange, false },
+    { "_Z20rsgDrawMeshInstanced7rs_meshj13rs_allocation", (void *)&SC_DrawMeshInstanced, false },
     { "_Z25rsgMeshComputeBoundingBox7rs_meshPfS0_S0_S0_S0_S0_", (void *)&SC_MeshComputeBoundingBox, false },
+    { "_Z11rsgMeshCullPK12rs_matrix4x4PK7rs_meshPhj", (void *)&SC_MeshCull, false },
 
     { "_Z11rsgDrawPath7rs_path", (void *)&SC_DrawPath, false },
 
@@ -1279,6 +1355,20 @@ void __attribute__((overloadable)) rsAllocationCopy2DRange(
                              srcMip, srcFace);
 }
 
+void __attribute__((overloadable)) rsSort(rs_allocation keys) {
+    SC_AllocationSort((Allocation *)keys.p);
+}
+
+void __attribute__((overloadable)) rsSortByKey(rs_allocation keys, rs_allocation values) {
+    SC_AllocationSortByKey((Allocation *)keys.p, (Allocation *)values.p);
+}
+
+uint32_t __attribute__((overloadable)) rsCompact(rs_allocation dst, rs_allocation src,
+                                                 rs_allocation flags) {
+    return SC_AllocationCompact((Allocation *)dst.p, (Allocation *)src.p,
+                                (Allocation *)flags.p);
+}
+
 void __attribute__((overloadable)) rsForEach(rs_script script,
                                              rs_allocation in,
                                              rs_allocation out,
@@ -1708,21 +1798,16 @@ void rsDebug(const char *s, const void *p) {
 }
 #endif // RS_COMPATIBILITY_LIB
 
-extern const RsdCpuReference::CpuSymbol * rsdLookupRuntimeStub(Context * pContext, char const* name) {
-    ScriptC *s = (ScriptC *)pContext;
-    const RsdCpuReference::CpuSymbol *syms = gSyms;
-    const RsdCpuReference::CpuSymbol *sym = NULL;
-
-    if (!sym) {
-        while (syms->fnPtr) {
-            if (!strcmp(syms->name, name)) {
-                return syms;
-            }
-            syms++;
-        }
-    }
+static pthread_once_t gSymsOnce = PTHREAD_ONCE_INIT;
+static size_t gSymCount;
 
-    return NULL;
+static void sortSyms() {
+    gSymCount = RsdCpuReference::sortSymbols(gSyms);
+}
+
+extern const RsdCpuReference::CpuSymbol * rsdLookupRuntimeStub(Context * pContext, char const* name) {
+    pthread_once(&gSymsOnce, sortSyms);
+    return RsdCpuReference::findSymbol(gSyms, gSymCount, name);
 }
 
 
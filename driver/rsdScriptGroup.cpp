@@ -36,15 +36,20 @@ bool rsdScriptGroupInit(const Context *rsc, ScriptGroup *sg) {
 }
 
 void rsdScriptGroupSetInput(const Context *rsc, const ScriptGroup *sg,
-                            const ScriptKernelID *kid, Allocation *) {
+                            const ScriptKernelID *kid, Allocation *a) {
+    RsdCpuReference::CpuScriptGroup *sgi = (RsdCpuReference::CpuScriptGroup *)sg->mHal.drv;
+    sgi->setInput(kid, a);
 }
 
 void rsdScriptGroupSetOutput(const Context *rsc, const ScriptGroup *sg,
-                             const ScriptKernelID *kid, Allocation *) {
+                             const ScriptKernelID *kid, Allocation *a) {
+    RsdCpuReference::CpuScriptGroup *sgi = (RsdCpuReference::CpuScriptGroup *)sg->mHal.drv;
+    sgi->setOutput(kid, a);
 }
 
 void rsdScriptGroupExecute(const Context *rsc, const ScriptGroup *sg) {
     RsdCpuReference::CpuScriptGroup *sgi = (RsdCpuReference::CpuScriptGroup *)sg->mHal.drv;
+    rsdAllocationFinishPendingGL(rsc);
     sgi->execute();
 }
 
@@ -53,4 +58,9 @@ void rsdScriptGroupDestroy(const Context *rsc, const ScriptGroup *sg) {
     delete sgi;
 }
 
+void rsdScriptGroupSetPipelined(const Context *rsc, const ScriptGroup *sg, bool pipelined) {
+    RsdCpuReference::CpuScriptGroup *sgi = (RsdCpuReference::CpuScriptGroup *)sg->mHal.drv;
+    sgi->setPipelined(pipelined);
+}
+
 
@@ -33,6 +33,8 @@ void rsdScriptGroupExecute(const android::renderscript::Context *rsc,
                            const android::renderscript::ScriptGroup *sg);
 void rsdScriptGroupDestroy(const android::renderscript::Context *rsc,
                            const android::renderscript::ScriptGroup *sg);
+void rsdScriptGroupSetPipelined(const android::renderscript::Context *rsc,
+                                const android::renderscript::ScriptGroup *sg, bool pipelined);
 
 
 #endif // RSD_SCRIPT_GROUP_H
@@ -23,6 +23,7 @@
 
 #include "rsdCore.h"
 #include "rsdAllocation.h"
+#include "rsdGLWorker.h"
 #include "rsdShader.h"
 #include "rsdShaderCache.h"
 
@@ -48,6 +49,7 @@ RsdShader::RsdShader(const Program *p, uint32_t type,
 RsdShader::~RsdShader() {
     for (uint32_t i = 0; i < mStateBasedShaders.size(); i ++) {
         StateBasedKey *state = mStateBasedShaders.itemAt(i);
+        finishCompile(state);
         if (state->mShaderID) {
             glDeleteShader(state->mShaderID);
         }
@@ -68,6 +70,7 @@ void RsdShader::initMemberVars() {
     mUniformNames = NULL;
     mUniformArraySizes = NULL;
     mCurrentState = NULL;
+    mWorker = NULL;
 
     mIsValid = false;
 }
@@ -103,6 +106,10 @@ uint32_t RsdShader::getStateBasedShaderID(const Context *rsc) {
     StateBasedKey *state = getExistingState();
     if (state != NULL) {
         mCurrentState = state;
+        if (state->mCompileJob) {
+            finishCompile(state);
+            checkCompiled(rsc);
+        }
         return mCurrentState->mShaderID;
     }
     // We have not created a shader for this particular state yet
@@ -242,9 +249,15 @@ bool RsdShader::loadShader(const Context *rsc) {
 
     if (mCurrentState->mShaderID) {
         const char * ss = mShader.string();
+        mCurrentState->mSourceHash = rsHashBytes(RS_HASH_SEED, ss, mShader.length());
         RSD_CALL_GL(glShaderSource, mCurrentState->mShaderID, 1, &ss, NULL);
         RSD_CALL_GL(glCompileShader, mCurrentState->mShaderID);
+    }
+    return checkCompiled(rsc);
+}
 
+bool RsdShader::checkCompiled(const Context *rsc) {
+    if (mCurrentState->mShaderID) {
         GLint compiled = 0;
         RSD_CALL_GL(glGetShaderiv, mCurrentState->mShaderID, GL_COMPILE_STATUS, &compiled);
         if (!compiled) {
@@ -271,6 +284,57 @@ bool RsdShader::loadShader(const Context *rsc) {
     return true;
 }
 
+struct RsdShaderCompile {
+    uint32_t shaderID;
+    String8 source;
+};
+
+static void compileShaderJob(void *usr) {
+    RsdShaderCompile *c = (RsdShaderCompile *)usr;
+    const char * ss = c->source.string();
+    glShaderSource(c->shaderID, 1, &ss, NULL);
+    glCompileShader(c->shaderID);
+}
+
+void RsdShader::precompile(const Context *rsc) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (!dc->gl.worker || mStateBasedShaders.size()) {
+        return;
+    }
+    mWorker = dc->gl.worker;
+
+    StateBasedKey *state = new StateBasedKey(mTextureCount);
+    mCurrentState = state;
+    mStateBasedShaders.add(state);
+    createShader();
+
+    state->mShaderID = glCreateShader(mType);
+    rsAssert(state->mShaderID);
+    if (!state->mShaderID) {
+        return;
+    }
+    if (rsc->props.mLogShaders) {
+        ALOGV("Precompiling shader type %x, ID %i", mType, state->mShaderID);
+        ALOGV("%s", mShader.string());
+    }
+    state->mSourceHash = rsHashBytes(RS_HASH_SEED, mShader.string(), mShader.length());
+    state->mCompile = new RsdShaderCompile();
+    state->mCompile->shaderID = state->mShaderID;
+    state->mCompile->source = mShader;
+    // The worker's context only sees the new name once it is flushed.
+    RSD_CALL_GL(glFlush);
+    state->mCompileJob = rsdGLWorkerQueue(mWorker, compileShaderJob, state->mCompile);
+}
+
+void RsdShader::finishCompile(StateBasedKey *state) {
+    if (state->mCompileJob) {
+        rsdGLWorkerFinish(mWorker, state->mCompileJob);
+        state->mCompileJob = NULL;
+    }
+    delete state->mCompile;
+    state->mCompile = NULL;
+}
+
 void RsdShader::appendUserConstants() {
     for (uint32_t ct=0; ct < mRSProgram->mHal.state.constantsCount; ct++) {
         const Element *e = mRSProgram->mHal.state.constantTypes[ct]->getElement();
@@ -485,6 +549,7 @@ void RsdShader::setupTextures(const Context *rsc, RsdShaderCache *sc) {
         }
 
         DrvAllocation *drvTex = (DrvAllocation *)mRSProgram->mHal.state.textures[ct]->mHal.drv;
+        rsdAllocationFinishGL(rsc, mRSProgram->mHal.state.textures[ct]);
 
         if (mCurrentState->mTextureTargets[ct] != GL_TEXTURE_2D &&
             mCurrentState->mTextureTargets[ct] != GL_TEXTURE_CUBE_MAP &&
@@ -518,6 +583,14 @@ void RsdShader::setupTextures(const Context *rsc, RsdShaderCache *sc) {
 }
 
 void RsdShader::setupUserConstants(const Context *rsc, RsdShaderCache *sc, bool isFragment) {
+    // Uniforms are program state, so they only need uploading again once
+    // the constants changed.
+    if (sc->constantsCurrent(isFragment, mRSProgram->getVersion())) {
+        RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+        dc->gl.stateCallsSkipped += mUniformCount - mTextureCount;
+        return;
+    }
+
     uint32_t uidx = 0;
     for (uint32_t ct=0; ct < mRSProgram->mHal.state.constantsCount; ct++) {
         Allocation *alloc = mRSProgram->mHal.state.constants[ct];
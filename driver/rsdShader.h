@@ -31,6 +31,9 @@ class Program;
 }
 
 class RsdShaderCache;
+struct RsdGLWorker;
+struct RsdGLJob;
+struct RsdShaderCompile;
 
 #define RS_SHADER_ATTR "ATTRIB_"
 #define RS_SHADER_UNI "UNI_"
@@ -51,6 +54,9 @@ public:
     uint32_t getStateBasedID(uint32_t index) const {
         return mStateBasedShaders.itemAt(index)->mShaderID;
     }
+    // Hash of the source the last getStateBasedShaderID() shader was
+    // compiled from, which keys the program binary cache.
+    uint32_t getStateBasedSourceHash() const { return mCurrentState->mSourceHash; }
 
     uint32_t getAttribCount() const {return mAttribCount;}
     uint32_t getUniformCount() const {return mUniformCount;}
@@ -64,23 +70,34 @@ public:
     void forceDirty() const {mDirty = true;}
 
     bool loadShader(const android::renderscript::Context *);
+    // Starts compiling the shader for the default texture state on the GL
+    // worker, if there is one, so the first draw only waits for it.
+    void precompile(const android::renderscript::Context *);
     void setup(const android::renderscript::Context *, RsdShaderCache *sc);
 
 protected:
 
     class StateBasedKey {
     public:
-        StateBasedKey(uint32_t texCount) : mShaderID(0) {
+        StateBasedKey(uint32_t texCount) : mShaderID(0), mSourceHash(0),
+                                           mCompileJob(NULL), mCompile(NULL) {
             mTextureTargets = new uint32_t[texCount];
         }
         ~StateBasedKey() {
             delete[] mTextureTargets;
         }
         uint32_t mShaderID;
+        uint32_t mSourceHash;
         uint32_t *mTextureTargets;
+        // Compile queued on the GL worker, and the source it was given,
+        // until the shader is first used.
+        RsdGLJob *mCompileJob;
+        RsdShaderCompile *mCompile;
     };
 
     bool createShader();
+    bool checkCompiled(const android::renderscript::Context *);
+    void finishCompile(StateBasedKey *state);
     StateBasedKey *getExistingState();
 
     const android::renderscript::Program *mRSProgram;
@@ -119,6 +136,7 @@ protected:
     android::Vector<android::String8> mTextureNames;
 
     android::Vector<StateBasedKey*> mStateBasedShaders;
+    RsdGLWorker *mWorker;
 
     int32_t mTextureUniformIndexStart;
 
@@ -17,19 +17,30 @@
 #include <rs_hal.h>
 #include <rsContext.h>
 
+#include "rsdCore.h"
 #include "rsdShader.h"
 #include "rsdShaderCache.h"
 #include "rsdGL.h"
+#include "rsdGLTimer.h"
 
 #include <GLES/gl.h>
 #include <GLES2/gl2.h>
 
+#include <stdio.h>
+#include <unistd.h>
+
 using namespace android;
 using namespace android::renderscript;
 
 
 RsdShaderCache::RsdShaderCache() {
-    mEntries.setCapacity(16);
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mLruHead = NULL;
+    mLruTail = NULL;
+    mEntryCount = 0;
+    mCurrent = NULL;
+    memset(&mStats, 0, sizeof(mStats));
+    mRSC = NULL;
     mVertexDirty = true;
     mFragmentDirty = true;
 }
@@ -38,6 +49,124 @@ RsdShaderCache::~RsdShaderCache() {
     cleanupAll();
 }
 
+// Header of a saved program binary.  The hashes of both shader sources and
+// of the driver strings are checked again on load, past the file name.
+struct ProgramBinaryHeader {
+    uint32_t magic;
+    uint32_t vtxHash;
+    uint32_t fragHash;
+    uint32_t driverHash;
+    uint32_t format;
+    uint32_t length;
+};
+
+static const uint32_t kProgramBinaryMagic = 0x42505352;  // "RSPB"
+static const uint32_t kProgramBinaryMaxLength = 4 * 1024 * 1024;
+
+static uint32_t programBinaryKey(const RsdHal *dc, uint32_t vtxHash, uint32_t fragHash) {
+    return rsHashWord(rsHashWord(rsHashWord(RS_HASH_SEED, vtxHash), fragHash),
+                      dc->gl.programBinary.driverHash);
+}
+
+void RsdShaderCache::setBinaryDir(const char *dir) {
+    if (dir && dir[0] && !mBinaryDir.length()) {
+        mBinaryDir.setTo(dir);
+    }
+}
+
+String8 RsdShaderCache::binaryPath(uint32_t key) const {
+    String8 path(mBinaryDir);
+    path.appendFormat("/com.android.renderscript.program-%08x.bin", key);
+    return path;
+}
+
+bool RsdShaderCache::loadBinary(const Context *rsc, uint32_t program,
+                                uint32_t vtxHash, uint32_t fragHash) {
+    const RsdHal *dc = (const RsdHal *)rsc->mHal.drv;
+    if (!dc->gl.programBinary.enabled || !mBinaryDir.length()) {
+        return false;
+    }
+
+    String8 path(binaryPath(programBinaryKey(dc, vtxHash, fragHash)));
+    FILE *f = fopen(path.string(), "rb");
+    if (!f) {
+        return false;
+    }
+
+    ProgramBinaryHeader h;
+    void *binary = NULL;
+    bool loaded = false;
+    if ((fread(&h, sizeof(h), 1, f) == 1) && (h.magic == kProgramBinaryMagic) &&
+        (h.vtxHash == vtxHash) && (h.fragHash == fragHash) &&
+        (h.driverHash == dc->gl.programBinary.driverHash) &&
+        h.length && (h.length <= kProgramBinaryMaxLength)) {
+        binary = malloc(h.length);
+        if (binary && (fread(binary, h.length, 1, f) == 1)) {
+            dc->gl.programBinary.programBinary(program, h.format, binary, h.length);
+            GLint linkStatus = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+            loaded = (linkStatus == GL_TRUE);
+        }
+    }
+    free(binary);
+    fclose(f);
+
+    if (!loaded) {
+        // Stale or rejected, typically after a driver update; the program
+        // gets linked from source and saved over it.
+        ALOGV("Discarding program binary %s", path.string());
+        unlink(path.string());
+    } else if (rsc->props.mLogShaders) {
+        ALOGV("Loaded program binary %s", path.string());
+    }
+    return loaded;
+}
+
+void RsdShaderCache::saveBinary(const Context *rsc, uint32_t program,
+                                uint32_t vtxHash, uint32_t fragHash) {
+    const RsdHal *dc = (const RsdHal *)rsc->mHal.drv;
+    if (!dc->gl.programBinary.enabled || !mBinaryDir.length()) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, RSD_GL_PROGRAM_BINARY_LENGTH, &length);
+    if ((length <= 0) || ((uint32_t)length > kProgramBinaryMaxLength)) {
+        return;
+    }
+    void *binary = malloc(length);
+    if (!binary) {
+        return;
+    }
+
+    ProgramBinaryHeader h;
+    h.magic = kProgramBinaryMagic;
+    h.vtxHash = vtxHash;
+    h.fragHash = fragHash;
+    h.driverHash = dc->gl.programBinary.driverHash;
+    h.format = 0;
+    int32_t written = 0;
+    dc->gl.programBinary.getProgramBinary(program, length, &written, &h.format, binary);
+    h.length = written;
+
+    if (written > 0) {
+        // Written aside and renamed so other contexts never load half a file.
+        String8 path(binaryPath(programBinaryKey(dc, vtxHash, fragHash)));
+        String8 tmpPath(path);
+        tmpPath.appendFormat(".%d", getpid());
+        FILE *f = fopen(tmpPath.string(), "wb");
+        if (f) {
+            bool ok = (fwrite(&h, sizeof(h), 1, f) == 1) &&
+                      (fwrite(binary, written, 1, f) == 1);
+            ok = (fclose(f) == 0) && ok;
+            if (!ok || rename(tmpPath.string(), path.string())) {
+                unlink(tmpPath.string());
+            }
+        }
+    }
+    free(binary);
+}
+
 void RsdShaderCache::updateUniformArrayData(const Context *rsc, RsdShader *prog, uint32_t linkedID,
                                          UniformData *data, const char* logTag,
                                          UniformQueryData **uniformList, uint32_t uniListSize) {
@@ -83,14 +212,104 @@ bool RsdShaderCache::hasArrayUniforms(RsdShader *vtx, RsdShader *frag) {
     return false;
 }
 
+uint32_t RsdShaderCache::bucketOf(uint32_t vtx, uint32_t frag) {
+    return rsHashWord(rsHashWord(RS_HASH_SEED, vtx), frag) & (BUCKET_COUNT - 1);
+}
+
+RsdShaderCache::ProgramEntry * RsdShaderCache::findEntry(uint32_t vtx, uint32_t frag) const {
+    for (ProgramEntry *e = mBuckets[bucketOf(vtx, frag)]; e; e = e->hashNext) {
+        if ((e->vtx == vtx) && (e->frag == frag)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+void RsdShaderCache::insertEntry(ProgramEntry *e) {
+    if (mEntryCount >= MAX_PROGRAMS) {
+        // The tail can't be mCurrent, which is about to become e.
+        removeEntry(mLruTail);
+        mStats.evictions++;
+    }
+
+    uint32_t b = bucketOf(e->vtx, e->frag);
+    e->hashNext = mBuckets[b];
+    mBuckets[b] = e;
+
+    e->lruPrev = NULL;
+    e->lruNext = mLruHead;
+    if (mLruHead) {
+        mLruHead->lruPrev = e;
+    } else {
+        mLruTail = e;
+    }
+    mLruHead = e;
+    mEntryCount++;
+}
+
+void RsdShaderCache::touchEntry(ProgramEntry *e) {
+    if (e == mLruHead) {
+        return;
+    }
+    e->lruPrev->lruNext = e->lruNext;
+    if (e->lruNext) {
+        e->lruNext->lruPrev = e->lruPrev;
+    } else {
+        mLruTail = e->lruPrev;
+    }
+    e->lruPrev = NULL;
+    e->lruNext = mLruHead;
+    mLruHead->lruPrev = e;
+    mLruHead = e;
+}
+
+void RsdShaderCache::removeEntry(ProgramEntry *e) {
+    ProgramEntry **link = &mBuckets[bucketOf(e->vtx, e->frag)];
+    while (*link != e) {
+        link = &(*link)->hashNext;
+    }
+    *link = e->hashNext;
+
+    if (e->lruPrev) {
+        e->lruPrev->lruNext = e->lruNext;
+    } else {
+        mLruHead = e->lruNext;
+    }
+    if (e->lruNext) {
+        e->lruNext->lruPrev = e->lruPrev;
+    } else {
+        mLruTail = e->lruPrev;
+    }
+    mEntryCount--;
+
+    if (e == mCurrent) {
+        mCurrent = NULL;
+    }
+    glDeleteProgram(e->program);
+    if (mRSC) {
+        mRSC->trackMemory(RS_MEMORY_GL_OBJECTS, -(ssize_t)e->programBytes);
+    }
+    delete e;
+}
+
+void RsdShaderCache::getStats(Stats *stats) const {
+    *stats = mStats;
+    stats->programs = mEntryCount;
+}
+
 bool RsdShaderCache::setup(const Context *rsc) {
     if (!mVertexDirty && !mFragmentDirty) {
         return true;
     }
 
+    const ProgramEntry *prev = mCurrent;
     if (!link(rsc)) {
         return false;
     }
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if (dc->gl.timer && (mCurrent != prev)) {
+        rsdGLTimerGroup(rsc, dc->gl.timer, false);
+    }
 
     if (mFragmentDirty) {
         mFragment->setup(rsc, this);
@@ -105,6 +324,7 @@ bool RsdShaderCache::setup(const Context *rsc) {
 }
 
 bool RsdShaderCache::link(const Context *rsc) {
+    mRSC = rsc;
 
     RsdShader *vtx = mVertex;
     RsdShader *frag = mFragment;
@@ -116,56 +336,62 @@ bool RsdShaderCache::link(const Context *rsc) {
     if (!vID || !fID) {
         return false;
     }
-    uint32_t entryCount = mEntries.size();
-    for (uint32_t ct = 0; ct < entryCount; ct ++) {
-        if ((mEntries[ct]->vtx == vID) && (mEntries[ct]->frag == fID)) {
-
-            //ALOGV("SC using program %i", mEntries[ct]->program);
-            glUseProgram(mEntries[ct]->program);
-            mCurrent = mEntries[ct];
-            //ALOGV("RsdShaderCache hit, using %i", ct);
-            rsdGLCheckError(rsc, "RsdShaderCache::link (hit)");
-            return true;
-        }
+    ProgramEntry *hit = findEntry(vID, fID);
+    if (hit) {
+        //ALOGV("SC using program %i", hit->program);
+        glUseProgram(hit->program);
+        touchEntry(hit);
+        mCurrent = hit;
+        mStats.hits++;
+        rsdGLCheckError(rsc, "RsdShaderCache::link (hit)");
+        return true;
     }
 
     ProgramEntry *e = new ProgramEntry(vtx->getAttribCount(),
                                        vtx->getUniformCount(),
                                        frag->getUniformCount());
-    mEntries.push(e);
-    mCurrent = e;
     e->vtx = vID;
     e->frag = fID;
+    insertEntry(e);
+    mCurrent = e;
+    mStats.misses++;
     e->program = glCreateProgram();
     if (e->program) {
         GLuint pgm = e->program;
-        glAttachShader(pgm, vID);
-        //ALOGE("e1 %x", glGetError());
-        glAttachShader(pgm, fID);
-
-        glBindAttribLocation(pgm, 0, "ATTRIB_position");
-        glBindAttribLocation(pgm, 1, "ATTRIB_color");
-        glBindAttribLocation(pgm, 2, "ATTRIB_normal");
-        glBindAttribLocation(pgm, 3, "ATTRIB_texture0");
-
-        //ALOGE("e2 %x", glGetError());
-        glLinkProgram(pgm);
-        //ALOGE("e3 %x", glGetError());
-        GLint linkStatus = GL_FALSE;
-        glGetProgramiv(pgm, GL_LINK_STATUS, &linkStatus);
-        if (linkStatus != GL_TRUE) {
-            GLint bufLength = 0;
-            glGetProgramiv(pgm, GL_INFO_LOG_LENGTH, &bufLength);
-            if (bufLength) {
-                char* buf = (char*) malloc(bufLength);
-                if (buf) {
-                    glGetProgramInfoLog(pgm, bufLength, NULL, buf);
-                    rsc->setError(RS_ERROR_FATAL_PROGRAM_LINK, buf);
-                    free(buf);
+        uint32_t vHash = vtx->getStateBasedSourceHash();
+        uint32_t fHash = frag->getStateBasedSourceHash();
+
+        // A saved binary already carries the attribute bindings below.
+        if (!loadBinary(rsc, pgm, vHash, fHash)) {
+            glAttachShader(pgm, vID);
+            //ALOGE("e1 %x", glGetError());
+            glAttachShader(pgm, fID);
+
+            glBindAttribLocation(pgm, 0, "ATTRIB_position");
+            glBindAttribLocation(pgm, 1, "ATTRIB_color");
+            glBindAttribLocation(pgm, 2, "ATTRIB_normal");
+            glBindAttribLocation(pgm, 3, "ATTRIB_texture0");
+
+            //ALOGE("e2 %x", glGetError());
+            glLinkProgram(pgm);
+            //ALOGE("e3 %x", glGetError());
+            GLint linkStatus = GL_FALSE;
+            glGetProgramiv(pgm, GL_LINK_STATUS, &linkStatus);
+            if (linkStatus != GL_TRUE) {
+                GLint bufLength = 0;
+                glGetProgramiv(pgm, GL_INFO_LOG_LENGTH, &bufLength);
+                if (bufLength) {
+                    char* buf = (char*) malloc(bufLength);
+                    if (buf) {
+                        glGetProgramInfoLog(pgm, bufLength, NULL, buf);
+                        rsc->setError(RS_ERROR_FATAL_PROGRAM_LINK, buf);
+                        free(buf);
+                    }
                 }
+                removeEntry(e);
+                return false;
             }
-            glDeleteProgram(pgm);
-            return false;
+            saveBinary(rsc, pgm, vHash, fHash);
         }
 
         for (uint32_t ct=0; ct < e->vtxAttrCount; ct++) {
@@ -221,6 +447,17 @@ bool RsdShaderCache::link(const Context *rsc) {
         }
     }
 
+    // Only drivers handing out program binaries say how big a program is.
+    const RsdHal *dc = (const RsdHal *)rsc->mHal.drv;
+    if (e->program && dc->gl.programBinary.enabled) {
+        GLint length = 0;
+        glGetProgramiv(e->program, RSD_GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length > 0) {
+            e->programBytes = length;
+            rsc->trackMemory(RS_MEMORY_GL_OBJECTS, length);
+        }
+    }
+
     //ALOGV("SC made program %i", e->program);
     glUseProgram(e->program);
     rsdGLCheckError(rsc, "RsdShaderCache::link (miss)");
@@ -238,46 +475,48 @@ int32_t RsdShaderCache::vtxAttribSlot(const String8 &attrName) const {
 }
 
 void RsdShaderCache::cleanupVertex(RsdShader *s) {
-    int32_t numEntries = (int32_t)mEntries.size();
     uint32_t numShaderIDs = s->getStateBasedIDCount();
     for (uint32_t sId = 0; sId < numShaderIDs; sId ++) {
         uint32_t id = s->getStateBasedID(sId);
-        for (int32_t ct = 0; ct < numEntries; ct ++) {
-            if (mEntries[ct]->vtx == id) {
-                glDeleteProgram(mEntries[ct]->program);
-
-                delete mEntries[ct];
-                mEntries.removeAt(ct);
-                numEntries = (int32_t)mEntries.size();
-                ct --;
+        ProgramEntry *e = mLruHead;
+        while (e) {
+            ProgramEntry *next = e->lruNext;
+            if (e->vtx == id) {
+                removeEntry(e);
             }
+            e = next;
         }
     }
 }
 
 void RsdShaderCache::cleanupFragment(RsdShader *s) {
-    int32_t numEntries = (int32_t)mEntries.size();
     uint32_t numShaderIDs = s->getStateBasedIDCount();
     for (uint32_t sId = 0; sId < numShaderIDs; sId ++) {
         uint32_t id = s->getStateBasedID(sId);
-        for (int32_t ct = 0; ct < numEntries; ct ++) {
-            if (mEntries[ct]->frag == id) {
-                glDeleteProgram(mEntries[ct]->program);
-
-                delete mEntries[ct];
-                mEntries.removeAt(ct);
-                numEntries = (int32_t)mEntries.size();
-                ct --;
+        ProgramEntry *e = mLruHead;
+        while (e) {
+            ProgramEntry *next = e->lruNext;
+            if (e->frag == id) {
+                removeEntry(e);
             }
+            e = next;
         }
     }
 }
 
 void RsdShaderCache::cleanupAll() {
-    for (uint32_t ct=0; ct < mEntries.size(); ct++) {
-        glDeleteProgram(mEntries[ct]->program);
-        free(mEntries[ct]);
+    while (mLruHead) {
+        removeEntry(mLruHead);
     }
-    mEntries.clear();
 }
 
+void RsdShaderCache::trim() {
+    ProgramEntry *e = mLruHead;
+    while (e) {
+        ProgramEntry *next = e->lruNext;
+        if (e != mCurrent) {
+            removeEntry(e);
+        }
+        e = next;
+    }
+}
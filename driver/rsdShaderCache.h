@@ -57,6 +57,34 @@ public:
     void cleanupFragment(RsdShader *s);
 
     void cleanupAll();
+    // Deletes every linked program but the current one.
+    void trim();
+
+    struct Stats {
+        uint32_t hits;
+        uint32_t misses;
+        // Programs deleted to stay within MAX_PROGRAMS.
+        uint32_t evictions;
+        uint32_t programs;
+    };
+    void getStats(Stats *stats) const;
+
+    // Directory linked program binaries are kept in across runs.  Only the
+    // first one set is used; without one programs are always linked.
+    void setBinaryDir(const char *dir);
+
+    // Whether the current program already holds the constants of the
+    // vertex or fragment program at version; otherwise records that it is
+    // about to be given them.
+    bool constantsCurrent(bool isFragment, uint32_t version) {
+        uint32_t i = isFragment ? 1 : 0;
+        if (mCurrent->constantsSet[i] && (mCurrent->constantsVersion[i] == version)) {
+            return true;
+        }
+        mCurrent->constantsSet[i] = true;
+        mCurrent->constantsVersion[i] = version;
+        return false;
+    }
 
     int32_t vtxAttribSlot(const android::String8 &attrName) const;
     int32_t vtxUniformSlot(uint32_t a) const {return mCurrent->vtxUniforms[a].slot;}
@@ -66,6 +94,12 @@ public:
 
 protected:
     bool link(const android::renderscript::Context *rsc);
+    android::String8 binaryPath(uint32_t key) const;
+    bool loadBinary(const android::renderscript::Context *rsc, uint32_t program,
+                    uint32_t vtxHash, uint32_t fragHash);
+    void saveBinary(const android::renderscript::Context *rsc, uint32_t program,
+                    uint32_t vtxHash, uint32_t fragHash);
+    android::String8 mBinaryDir;
     bool mFragmentDirty;
     bool mVertexDirty;
     RsdShader *mVertex;
@@ -103,7 +137,10 @@ protected:
         ProgramEntry(uint32_t numVtxAttr, uint32_t numVtxUnis,
                      uint32_t numFragUnis) : vtx(0), frag(0), program(0), vtxAttrCount(0),
                                              vtxAttrs(0), vtxUniforms(0), fragUniforms(0),
-                                             fragUniformIsSTO(0) {
+                                             fragUniformIsSTO(0), programBytes(0), hashNext(0),
+                                             lruPrev(0), lruNext(0) {
+            constantsSet[0] = constantsSet[1] = false;
+            constantsVersion[0] = constantsVersion[1] = 0;
             vtxAttrCount = numVtxAttr;
             if (numVtxAttr) {
                 vtxAttrs = new AttrData[numVtxAttr];
@@ -142,9 +179,39 @@ protected:
         UniformData *vtxUniforms;
         UniformData *fragUniforms;
         bool *fragUniformIsSTO;
+        // Versions of the vertex and fragment programs whose constants
+        // the GL program's uniforms were last given.
+        bool constantsSet[2];
+        uint32_t constantsVersion[2];
+        // Size of the linked program as counted by the context.
+        size_t programBytes;
+        ProgramEntry *hashNext;
+        ProgramEntry *lruPrev;
+        ProgramEntry *lruNext;
     };
-    android::Vector<ProgramEntry*> mEntries;
+
+    enum {
+        MAX_PROGRAMS = 64,
+        BUCKET_COUNT = 128
+    };
+
+    // Entries are chained per bucket of their (vtx, frag) pair and kept on
+    // a list from most to least recently linked or used.
+    ProgramEntry *mBuckets[BUCKET_COUNT];
+    ProgramEntry *mLruHead;
+    ProgramEntry *mLruTail;
+    uint32_t mEntryCount;
     ProgramEntry *mCurrent;
+    Stats mStats;
+    // Context the programs' memory is counted against, from the first link.
+    const android::renderscript::Context *mRSC;
+
+    static uint32_t bucketOf(uint32_t vtx, uint32_t frag);
+    ProgramEntry * findEntry(uint32_t vtx, uint32_t frag) const;
+    void insertEntry(ProgramEntry *e);
+    void touchEntry(ProgramEntry *e);
+    // Unlinks e, deleting its program and the entry itself.
+    void removeEntry(ProgramEntry *e);
 
     bool hasArrayUniforms(RsdShader *vtx, RsdShader *frag);
     void populateUniformData(RsdShader *prog, uint32_t linkedID, UniformData *data);
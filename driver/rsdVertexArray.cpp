@@ -88,8 +88,23 @@ void RsdVertexArray::setup(const Context *rsc) const {
     rsdGLCheckError(rsc, "RsdVertexArray::setup start");
     uint32_t maxAttrs = state->mAttrsEnabledSize;
 
+    for (uint32_t ct=0; ct < maxAttrs; ct++) {
+        state->mAttrsWanted[ct] = false;
+    }
+    for (uint32_t ct=0; ct < mCount; ct++) {
+        int32_t slot = sc->vtxAttribSlot(mAttribs[ct].name);
+        if (rsc->props.mLogShadersAttr) {
+            logAttrib(ct, slot);
+        }
+        if (slot >= 0 && slot < (int32_t)maxAttrs) {
+            state->mAttrsWanted[slot] = true;
+        }
+    }
+
+    // Only arrays the previous draw used and this one doesn't are disabled,
+    // and only newly used ones enabled.
     for (uint32_t ct=1; ct < maxAttrs; ct++) {
-        if(state->mAttrsEnabled[ct]) {
+        if(state->mAttrsEnabled[ct] && !state->mAttrsWanted[ct]) {
             glDisableVertexAttribArray(ct);
             state->mAttrsEnabled[ct] = false;
         }
@@ -98,14 +113,15 @@ void RsdVertexArray::setup(const Context *rsc) const {
     rsdGLCheckError(rsc, "RsdVertexArray::setup disabled");
     for (uint32_t ct=0; ct < mCount; ct++) {
         int32_t slot = sc->vtxAttribSlot(mAttribs[ct].name);
-        if (rsc->props.mLogShadersAttr) {
-            logAttrib(ct, slot);
-        }
         if (slot < 0 || slot >= (int32_t)maxAttrs) {
             continue;
         }
-        glEnableVertexAttribArray(slot);
-        state->mAttrsEnabled[slot] = true;
+        if (!state->mAttrsEnabled[slot]) {
+            glEnableVertexAttribArray(slot);
+            state->mAttrsEnabled[slot] = true;
+        } else {
+            dc->gl.stateCallsSkipped++;
+        }
         glBindBuffer(GL_ARRAY_BUFFER, mAttribs[ct].buffer);
         glVertexAttribPointer(slot,
                               mAttribs[ct].size,
@@ -119,6 +135,7 @@ void RsdVertexArray::setup(const Context *rsc) const {
 ////////////////////////////////////////////
 RsdVertexArrayState::RsdVertexArrayState() {
     mAttrsEnabled = NULL;
+    mAttrsWanted = NULL;
     mAttrsEnabledSize = 0;
 }
 
@@ -127,10 +144,12 @@ RsdVertexArrayState::~RsdVertexArrayState() {
         delete[] mAttrsEnabled;
         mAttrsEnabled = NULL;
     }
+    delete[] mAttrsWanted;
 }
 void RsdVertexArrayState::init(uint32_t maxAttrs) {
     mAttrsEnabledSize = maxAttrs;
     mAttrsEnabled = new bool[mAttrsEnabledSize];
+    mAttrsWanted = new bool[mAttrsEnabledSize];
     for (uint32_t ct = 0; ct < mAttrsEnabledSize; ct++) {
         mAttrsEnabled[ct] = false;
     }
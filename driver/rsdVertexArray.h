@@ -69,6 +69,8 @@ public:
     void init(uint32_t maxAttrs);
 
     bool *mAttrsEnabled;
+    // Scratch for setup(), the slots the array being set up uses.
+    bool *mAttrsWanted;
     uint32_t mAttrsEnabledSize;
 };
 
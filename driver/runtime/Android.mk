@@ -78,6 +78,27 @@ LOCAL_SRC_FILES := $(clcore_files)
 
 include $(LOCAL_PATH)/build_bc_lib.mk
 
+# Build the versions of the library for reduced precision scripts.  Relaxed
+# math may flush denormals; imprecise math also uses the native_
+# approximations for exp, log and powr.
+include $(CLEAR_VARS)
+LOCAL_MODULE := libclcore_relaxed.bc
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := SHARED_LIBRARIES
+LOCAL_SRC_FILES := $(clcore_files)
+LOCAL_CFLAGS += -DRS_RELAXED_MATH
+
+include $(LOCAL_PATH)/build_bc_lib.mk
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libclcore_imprecise.bc
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := SHARED_LIBRARIES
+LOCAL_SRC_FILES := $(clcore_files)
+LOCAL_CFLAGS += -DRS_RELAXED_MATH -DRS_IMPRECISE_MATH
+
+include $(LOCAL_PATH)/build_bc_lib.mk
+
 # Build an optimized version of the library for x86 platforms (all have SSE2/3).
 ifeq ($(TARGET_ARCH),$(filter $(TARGET_ARCH),x86 x86_64))
 include $(CLEAR_VARS)
@@ -86,17 +107,45 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE_CLASS := SHARED_LIBRARIES
 LOCAL_SRC_FILES := $(clcore_x86_files)
 
+include $(LOCAL_PATH)/build_bc_lib.mk
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libclcore_x86_relaxed.bc
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := SHARED_LIBRARIES
+LOCAL_SRC_FILES := $(clcore_x86_files)
+LOCAL_CFLAGS += -DRS_RELAXED_MATH
+
+include $(LOCAL_PATH)/build_bc_lib.mk
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libclcore_x86_imprecise.bc
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := SHARED_LIBRARIES
+LOCAL_SRC_FILES := $(clcore_x86_files)
+LOCAL_CFLAGS += -DRS_RELAXED_MATH -DRS_IMPRECISE_MATH
+
 include $(LOCAL_PATH)/build_bc_lib.mk
 endif
 
-# Build a NEON-enabled version of the library (if possible)
+# Build a NEON-enabled version of the library (if possible).  It is only
+# used by reduced precision scripts, and NEON flushes denormals anyway.
 ifeq ($(ARCH_ARM_HAVE_NEON),true)
   include $(CLEAR_VARS)
   LOCAL_MODULE := libclcore_neon.bc
   LOCAL_MODULE_TAGS := optional
   LOCAL_MODULE_CLASS := SHARED_LIBRARIES
   LOCAL_SRC_FILES := $(clcore_neon_files)
-  LOCAL_CFLAGS += -DARCH_ARM_HAVE_NEON
+  LOCAL_CFLAGS += -DARCH_ARM_HAVE_NEON -DRS_RELAXED_MATH
+
+  include $(LOCAL_PATH)/build_bc_lib.mk
+
+  include $(CLEAR_VARS)
+  LOCAL_MODULE := libclcore_neon_imprecise.bc
+  LOCAL_MODULE_TAGS := optional
+  LOCAL_MODULE_CLASS := SHARED_LIBRARIES
+  LOCAL_SRC_FILES := $(clcore_neon_files)
+  LOCAL_CFLAGS += -DARCH_ARM_HAVE_NEON -DRS_RELAXED_MATH -DRS_IMPRECISE_MATH
 
   include $(LOCAL_PATH)/build_bc_lib.mk
 endif
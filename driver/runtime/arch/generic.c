@@ -872,33 +872,38 @@ extern float4 __attribute__((overloadable)) half_rsqrt(float4 v) {
  * matrix ops
  */
 
+// The 4x4 products scale whole columns, which lowers to vector multiplies
+// on any target with 128 bit registers.
+static inline float4 __attribute__((always_inline))
+getColumn4(const rs_matrix4x4 *m, int col) {
+    const float *c = &m->m[col * 4];
+    float4 r = {c[0], c[1], c[2], c[3]};
+    return r;
+}
+
 extern float4 __attribute__((overloadable))
 rsMatrixMultiply(const rs_matrix4x4 *m, float4 in) {
-    float4 ret;
-    ret.x = (m->m[0] * in.x) + (m->m[4] * in.y) + (m->m[8] * in.z) + (m->m[12] * in.w);
-    ret.y = (m->m[1] * in.x) + (m->m[5] * in.y) + (m->m[9] * in.z) + (m->m[13] * in.w);
-    ret.z = (m->m[2] * in.x) + (m->m[6] * in.y) + (m->m[10] * in.z) + (m->m[14] * in.w);
-    ret.w = (m->m[3] * in.x) + (m->m[7] * in.y) + (m->m[11] * in.z) + (m->m[15] * in.w);
+    float4 ret = getColumn4(m, 0) * in.x;
+    ret += getColumn4(m, 1) * in.y;
+    ret += getColumn4(m, 2) * in.z;
+    ret += getColumn4(m, 3) * in.w;
     return ret;
 }
 
 extern float4 __attribute__((overloadable))
 rsMatrixMultiply(const rs_matrix4x4 *m, float3 in) {
-    float4 ret;
-    ret.x = (m->m[0] * in.x) + (m->m[4] * in.y) + (m->m[8] * in.z) + m->m[12];
-    ret.y = (m->m[1] * in.x) + (m->m[5] * in.y) + (m->m[9] * in.z) + m->m[13];
-    ret.z = (m->m[2] * in.x) + (m->m[6] * in.y) + (m->m[10] * in.z) + m->m[14];
-    ret.w = (m->m[3] * in.x) + (m->m[7] * in.y) + (m->m[11] * in.z) + m->m[15];
+    float4 ret = getColumn4(m, 0) * in.x;
+    ret += getColumn4(m, 1) * in.y;
+    ret += getColumn4(m, 2) * in.z;
+    ret += getColumn4(m, 3);
     return ret;
 }
 
 extern float4 __attribute__((overloadable))
 rsMatrixMultiply(const rs_matrix4x4 *m, float2 in) {
-    float4 ret;
-    ret.x = (m->m[0] * in.x) + (m->m[4] * in.y) + m->m[12];
-    ret.y = (m->m[1] * in.x) + (m->m[5] * in.y) + m->m[13];
-    ret.z = (m->m[2] * in.x) + (m->m[6] * in.y) + m->m[14];
-    ret.w = (m->m[3] * in.x) + (m->m[7] * in.y) + m->m[15];
+    float4 ret = getColumn4(m, 0) * in.x;
+    ret += getColumn4(m, 1) * in.y;
+    ret += getColumn4(m, 3);
     return ret;
 }
 
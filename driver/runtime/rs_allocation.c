@@ -102,15 +102,51 @@ static void memcpy(void* dst, void* src, size_t size) {
 
 #else
 
-uint8_t*
-rsOffset(rs_allocation a, uint32_t sizeOf, uint32_t x, uint32_t y,
-         uint32_t z) {
-    Allocation_t *alloc = (Allocation_t *)a.p;
+// Address of cell (x, y) of the base level.  The helpers below are forced
+// inline, as are the typed accessors in allocation.ll, so a 1D or 2D
+// rsGetElementAt_T call reduces to a multiply-add per dimension in the
+// script: the y and z terms it passes as 0 fold away together with the
+// loads they would have needed.  Out of range coordinates are only caught
+// by the debug runtime.
+// Tiled allocations take the out of line path; see
+// Allocation::getCellOffset.
+static uint8_t *
+rsOffsetTiled(const Allocation_t *alloc, uint32_t sizeOf, uint32_t x, uint32_t y, uint32_t z) {
+    uint8_t *p = (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
+    const uint32_t sx = alloc->mHal.drvState.tile.shiftX;
+    const uint32_t sy = alloc->mHal.drvState.tile.shiftY;
+    const uint32_t sz = alloc->mHal.drvState.tile.shiftZ;
+    const size_t tile = ((size_t)(z >> sz) * alloc->mHal.drvState.tile.tilesY + (y >> sy)) *
+                        alloc->mHal.drvState.lod[0].stride +
+                        (size_t)(x >> sx) * (sizeOf << (sx + sy + sz));
+    const uint32_t cell = ((((z & ((1u << sz) - 1)) << sy) | (y & ((1u << sy) - 1))) << sx) |
+                          (x & ((1u << sx) - 1));
+    return &p[tile + cell * sizeOf];
+}
+
+static inline uint8_t * __attribute__((always_inline))
+rsOffset2D(const Allocation_t *alloc, uint32_t sizeOf, uint32_t x, uint32_t y) {
+    if (alloc->mHal.drvState.tile.shiftX) {
+        return rsOffsetTiled(alloc, sizeOf, x, y, 0);
+    }
     uint8_t *p = (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
     const uint32_t stride = alloc->mHal.drvState.lod[0].stride;
-    const uint32_t dimY = alloc->mHal.drvState.lod[0].dimY;
-    uint8_t *dp = &p[(sizeOf * x) + (y * stride) +
-                     (z * stride * dimY)];
+    return &p[(sizeOf * x) + (y * stride)];
+}
+
+uint8_t * __attribute__((always_inline))
+rsOffset(rs_allocation a, uint32_t sizeOf, uint32_t x, uint32_t y,
+         uint32_t z) {
+    const Allocation_t *alloc = (const Allocation_t *)a.p;
+    if (z && alloc->mHal.drvState.tile.shiftX) {
+        return rsOffsetTiled(alloc, sizeOf, x, y, z);
+    }
+    uint8_t *dp = rsOffset2D(alloc, sizeOf, x, y);
+    if (z) {
+        const uint32_t stride = alloc->mHal.drvState.lod[0].stride;
+        const uint32_t dimY = alloc->mHal.drvState.lod[0].dimY;
+        dp += z * stride * dimY;
+    }
     return dp;
 }
 
@@ -170,20 +206,15 @@ extern const void * __attribute__((overloadable))
 extern const void * __attribute__((overloadable))
         rsGetElementAt(rs_allocation a, uint32_t x, uint32_t y) {
     Allocation_t *alloc = (Allocation_t *)a.p;
-    const uint8_t *p = (const uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
     const uint32_t eSize = alloc->mHal.state.elementSizeBytes;
-    const uint32_t stride = alloc->mHal.drvState.lod[0].stride;
-    return &p[(eSize * x) + (y * stride)];
+    return rsOffset2D(alloc, eSize, x, y);
 }
 
 extern const void * __attribute__((overloadable))
         rsGetElementAt(rs_allocation a, uint32_t x, uint32_t y, uint32_t z) {
     Allocation_t *alloc = (Allocation_t *)a.p;
-    const uint8_t *p = (const uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
     const uint32_t eSize = alloc->mHal.state.elementSizeBytes;
-    const uint32_t stride = alloc->mHal.drvState.lod[0].stride;
-    const uint32_t dimY = alloc->mHal.drvState.lod[0].dimY;
-    return &p[(eSize * x) + (y * stride) + (z * stride * dimY)];
+    return rsOffset(a, eSize, x, y, z);
 }
 extern void __attribute__((overloadable))
         rsSetElementAt(rs_allocation a, void* ptr, uint32_t x) {
@@ -196,20 +227,15 @@ extern void __attribute__((overloadable))
 extern void __attribute__((overloadable))
         rsSetElementAt(rs_allocation a, void* ptr, uint32_t x, uint32_t y) {
     Allocation_t *alloc = (Allocation_t *)a.p;
-    const uint8_t *p = (const uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
     const uint32_t eSize = alloc->mHal.state.elementSizeBytes;
-    const uint32_t stride = alloc->mHal.drvState.lod[0].stride;
-    memcpy((void*)&p[(eSize * x) + (y * stride)], ptr, eSize);
+    memcpy(rsOffset2D(alloc, eSize, x, y), ptr, eSize);
 }
 
 extern void __attribute__((overloadable))
         rsSetElementAt(rs_allocation a, void* ptr, uint32_t x, uint32_t y, uint32_t z) {
     Allocation_t *alloc = (Allocation_t *)a.p;
-    const uint8_t *p = (const uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
     const uint32_t eSize = alloc->mHal.state.elementSizeBytes;
-    const uint32_t stride = alloc->mHal.drvState.lod[0].stride;
-    const uint32_t dimY = alloc->mHal.drvState.lod[0].dimY;
-    memcpy((void*)&p[(eSize * x) + (y * stride) + (z * stride * dimY)], ptr, eSize);
+    memcpy(rsOffset(a, eSize, x, y, z), ptr, eSize);
 }
 #endif
 
@@ -333,6 +333,81 @@ static bool iszero(float f) {
     return isposzero(f) || isnegzero(f);
 }
 
+// The float4 versions of the common functions evaluate all four lanes at
+// once.  When any lane is outside the range they are accurate for, the
+// whole vector goes through the scalar function instead.  The float2 and
+// float3 versions pad out to a float4 with a value inside that range.
+
+static bool all4(int4 m) {
+    return (m.x & m.y & m.z & m.w) != 0;
+}
+
+// Lanes of a where m is set, of b elsewhere.
+static float4 pick4(int4 m, float4 a, float4 b) {
+    return (float4)(((int4)a & m) | ((int4)b & ~m));
+}
+
+#define FN_LANES4(fnc, v)                                       \
+    do {                                                        \
+        float4 r_;                                              \
+        r_.x = fnc(v.x);                                        \
+        r_.y = fnc(v.y);                                        \
+        r_.z = fnc(v.z);                                        \
+        r_.w = fnc(v.w);                                        \
+        return r_;                                              \
+    } while (0)
+
+#define FN_FUNC_FN_BY4(fnc, pad)                                \
+extern float2 __attribute__((overloadable)) fnc(float2 v) {     \
+    float4 t = pad;                                             \
+    t.xy = v;                                                   \
+    return fnc(t).xy;                                           \
+}                                                               \
+extern float3 __attribute__((overloadable)) fnc(float3 v) {     \
+    float4 t = pad;                                             \
+    t.xyz = v;                                                  \
+    return fnc(t).xyz;                                          \
+}
+
+#define FN_FUNC_FN_FN_BY4(fnc, pad)                                         \
+extern float2 __attribute__((overloadable)) fnc(float2 v1, float2 v2) {     \
+    float4 t1 = pad;                                                        \
+    float4 t2 = pad;                                                        \
+    t1.xy = v1;                                                             \
+    t2.xy = v2;                                                             \
+    return fnc(t1, t2).xy;                                                  \
+}                                                                           \
+extern float3 __attribute__((overloadable)) fnc(float3 v1, float3 v2) {     \
+    float4 t1 = pad;                                                        \
+    float4 t2 = pad;                                                        \
+    t1.xyz = v1;                                                            \
+    t2.xyz = v2;                                                            \
+    return fnc(t1, t2).xyz;                                                 \
+}
+
+// Coefficients below are the single precision ones from Cephes.
+
+// Reduces |v| to [-pi/4, pi/4], returning in *j the number of pi/4 steps
+// taken, rounded to even.  pi/4 is split so every product but the last is
+// exact for |v| up to 8192.
+static float4 reducePio4(float4 av, int4 *j) {
+    int4 q = convert_int4(av * 1.27323954473516f);
+    q = (q + 1) & ~1;
+    float4 y = convert_float4(q);
+    *j = q;
+    return (((av - y * 0.78515625f) - y * 2.4175643920898438e-4f) -
+            y * 1.5692785382270813e-7f) - y * 3.0385503141383552e-11f;
+}
+
+static float4 sinPoly4(float4 x, float4 z) {
+    return ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * x + x;
+}
+
+static float4 cosPoly4(float4 z) {
+    return ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z +
+            4.166664568298827e-2f) * z * z - 0.5f * z + 1.f;
+}
+
 
 extern float __attribute__((overloadable)) acos(float);
 FN_FUNC_FN(acos)
@@ -358,10 +433,37 @@ extern float __attribute__((overloadable)) asinpi(float v) {
 FN_FUNC_FN(asinpi)
 
 extern float __attribute__((overloadable)) atan(float);
-FN_FUNC_FN(atan)
+extern float4 __attribute__((overloadable)) atan(float4 v) {
+    float4 av = (float4)((int4)v & 0x7fffffff);
+    int4 big = av > 2.414213562373095f;
+    int4 mid = (av > 0.4142135623730950f) & ~big;
+    float4 x = pick4(big, -1.f / av, pick4(mid, (av - 1.f) / (av + 1.f), av));
+    float4 base = pick4(big, (float4)1.5707963267948966f,
+                        pick4(mid, (float4)0.7853981633974483f, (float4)0.f));
+    float4 z = x * x;
+    float4 r = base + ((((8.05374449538e-2f * z - 1.38776856032e-1f) * z +
+                         1.99777106478e-1f) * z - 3.33329491539e-1f) * z * x + x);
+    return (float4)((int4)r | ((int4)v & (int)0x80000000));
+}
+FN_FUNC_FN_BY4(atan, 0.f)
 
 extern float __attribute__((overloadable)) atan2(float, float);
-FN_FUNC_FN_FN(atan2)
+extern float4 __attribute__((overloadable)) atan2(float4 v1, float4 v2) {
+    // Zeros, infinities and NaNs each have their own answer.
+    int4 ay = (int4)v1 & 0x7fffffff;
+    int4 ax = (int4)v2 & 0x7fffffff;
+    if (!all4((ay > 0) & (ay < 0x7f800000) & (ax > 0) & (ax < 0x7f800000))) {
+        float4 r;
+        r.x = atan2(v1.x, v2.x);
+        r.y = atan2(v1.y, v2.y);
+        r.z = atan2(v1.z, v2.z);
+        r.w = atan2(v1.w, v2.w);
+        return r;
+    }
+    float4 pi = (float4)(((int4)v1 & (int)0x80000000) | (int4)(float4)3.14159265358979f);
+    return atan(v1 / v2) + pick4(v2 < 0.f, pi, (float4)0.f);
+}
+FN_FUNC_FN_FN_BY4(atan2, 1.f)
 
 extern float __attribute__((overloadable)) atanh(float);
 FN_FUNC_FN(atanh)
@@ -387,7 +489,18 @@ extern float __attribute__((overloadable)) copysign(float, float);
 FN_FUNC_FN_FN(copysign)
 
 extern float __attribute__((overloadable)) cos(float);
-FN_FUNC_FN(cos)
+extern float4 __attribute__((overloadable)) cos(float4 v) {
+    float4 av = (float4)((int4)v & 0x7fffffff);
+    if (!all4(av <= 8192.f)) {
+        FN_LANES4(cos, v);
+    }
+    int4 j;
+    float4 x = reducePio4(av, &j);
+    float4 z = x * x;
+    float4 r = pick4((j & 2) != 0, sinPoly4(x, z), cosPoly4(z));
+    return (float4)((int4)r ^ ((j & 4) << 29) ^ ((j & 2) << 30));
+}
+FN_FUNC_FN_BY4(cos, 0.f)
 
 extern float __attribute__((overloadable)) cosh(float);
 FN_FUNC_FN(cosh)
@@ -404,17 +517,55 @@ extern float __attribute__((overloadable)) erf(float);
 FN_FUNC_FN(erf)
 
 extern float __attribute__((overloadable)) exp(float);
-FN_FUNC_FN(exp)
+#if !defined(RS_IMPRECISE_MATH)
+extern float4 __attribute__((overloadable)) exp(float4 v) {
+#if defined(RS_RELAXED_MATH)
+    // Denormal results may flush to zero; only overflow needs libm.
+    if (!all4(v < 88.f)) {
+        FN_LANES4(exp, v);
+    }
+    int4 tiny = v <= -87.f;
+    v = pick4(tiny, (float4)0.f, v);
+#else
+    // Past these the result is denormal or overflows.
+    if (!all4((v > -87.f) & (v < 88.f))) {
+        FN_LANES4(exp, v);
+    }
+#endif
+    float4 t = v * 1.44269504088896341f + 0.5f;
+    int4 n = convert_int4(t);
+    n += convert_float4(n) > t;
+    float4 fn = convert_float4(n);
+    float4 x = (v - fn * 0.693359375f) + fn * 2.12194440e-4f;
+    float4 z = x * x;
+    float4 p = 1.9875691500e-4f * x + 1.3981999507e-3f;
+    p = p * x + 8.3334519073e-3f;
+    p = p * x + 4.1665795894e-2f;
+    p = p * x + 1.6666665459e-1f;
+    p = p * x + 5.0000001201e-1f;
+    p = p * z + x + 1.f;
+    p *= (float4)((n + 127) << 23);
+#if defined(RS_RELAXED_MATH)
+    p = pick4(tiny, (float4)0.f, p);
+#endif
+    return p;
+}
+FN_FUNC_FN_BY4(exp, 0.f)
+#endif // !defined(RS_IMPRECISE_MATH)
 
 extern float __attribute__((overloadable)) exp2(float);
+#if !defined(RS_IMPRECISE_MATH)
 FN_FUNC_FN(exp2)
+#endif
 
 extern float __attribute__((overloadable)) pow(float, float);
 
+#if !defined(RS_IMPRECISE_MATH)
 extern float __attribute__((overloadable)) exp10(float v) {
     return exp2(v * 3.321928095f);
 }
 FN_FUNC_FN(exp10)
+#endif
 
 extern float __attribute__((overloadable)) expm1(float);
 FN_FUNC_FN(expm1)
@@ -467,9 +618,36 @@ extern float __attribute__((overloadable)) lgamma(float, int*);
 FN_FUNC_FN_PIN(lgamma)
 
 extern float __attribute__((overloadable)) log(float);
-FN_FUNC_FN(log)
+#if !defined(RS_IMPRECISE_MATH)
+extern float4 __attribute__((overloadable)) log(float4 v) {
+    // Only positive, normal, finite lanes.
+    int4 iv = (int4)v;
+    if (!all4((iv >= 0x00800000) & (iv < 0x7f800000))) {
+        FN_LANES4(log, v);
+    }
+    int4 e = (iv >> 23) - 126;
+    float4 m = (float4)((iv & 0x007fffff) | 0x3f000000);
+    int4 small = m < 0.707106781186547524f;
+    e += small;
+    m = m + (float4)((int4)m & small) - 1.f;
+    float4 z = m * m;
+    float4 p = 7.0376836292e-2f * m - 1.1514610310e-1f;
+    p = p * m + 1.1676998740e-1f;
+    p = p * m - 1.2420140846e-1f;
+    p = p * m + 1.4249322787e-1f;
+    p = p * m - 1.6668057665e-1f;
+    p = p * m + 2.0000714765e-1f;
+    p = p * m - 2.4999993993e-1f;
+    p = p * m + 3.3333331174e-1f;
+    float4 fe = convert_float4(e);
+    float4 y = p * m * z - fe * 2.12194440e-4f - 0.5f * z;
+    return (m + y) + fe * 0.693359375f;
+}
+FN_FUNC_FN_BY4(log, 1.f)
+#endif // !defined(RS_IMPRECISE_MATH)
 
 extern float __attribute__((overloadable)) log10(float);
+#if !defined(RS_IMPRECISE_MATH)
 FN_FUNC_FN(log10)
 
 
@@ -477,6 +655,7 @@ extern float __attribute__((overloadable)) log2(float v) {
     return log10(v) * 3.321928095f;
 }
 FN_FUNC_FN(log2)
+#endif // !defined(RS_IMPRECISE_MATH)
 
 extern float __attribute__((overloadable)) log1p(float);
 FN_FUNC_FN(log1p)
@@ -528,6 +707,7 @@ extern float4 __attribute__((overloadable)) pown(float4 v, int4 p) {
     return pow(v, f4);
 }
 
+#if !defined(RS_IMPRECISE_MATH)
 extern float __attribute__((overloadable)) powr(float v, float p) {
     return pow(v, p);
 }
@@ -540,6 +720,7 @@ extern float3 __attribute__((overloadable)) powr(float3 v, float3 p) {
 extern float4 __attribute__((overloadable)) powr(float4 v, float4 p) {
     return pow(v, p);
 }
+#endif
 
 extern float __attribute__((overloadable)) remainder(float, float);
 FN_FUNC_FN_FN(remainder)
@@ -592,14 +773,34 @@ extern float __attribute__((overloadable)) rsqrt(float v) {
     return 1.f / sqrt(v);
 }
 
-#if !defined(__i386__)
-FN_FUNC_FN(sqrt)
-#endif // !defined(__i386__)
+// The vector sqrt comes from math.ll or the x86 library.
+extern float2 __attribute__((overloadable)) sqrt(float2);
+extern float3 __attribute__((overloadable)) sqrt(float3);
+extern float4 __attribute__((overloadable)) sqrt(float4);
 
-FN_FUNC_FN(rsqrt)
+extern float2 __attribute__((overloadable)) rsqrt(float2 v) {
+    return 1.f / sqrt(v);
+}
+extern float3 __attribute__((overloadable)) rsqrt(float3 v) {
+    return 1.f / sqrt(v);
+}
+extern float4 __attribute__((overloadable)) rsqrt(float4 v) {
+    return 1.f / sqrt(v);
+}
 
 extern float __attribute__((overloadable)) sin(float);
-FN_FUNC_FN(sin)
+extern float4 __attribute__((overloadable)) sin(float4 v) {
+    float4 av = (float4)((int4)v & 0x7fffffff);
+    if (!all4(av <= 8192.f)) {
+        FN_LANES4(sin, v);
+    }
+    int4 j;
+    float4 x = reducePio4(av, &j);
+    float4 z = x * x;
+    float4 r = pick4((j & 2) != 0, cosPoly4(z), sinPoly4(x, z));
+    return (float4)((int4)r ^ ((j & 4) << 29) ^ ((int4)v & (int)0x80000000));
+}
+FN_FUNC_FN_BY4(sin, 0.f)
 
 extern float __attribute__((overloadable)) sincos(float v, float *cosptr) {
     *cosptr = cos(v);
@@ -1213,8 +1414,51 @@ extern float4 __attribute__((overloadable)) native_powr(float4 v, float4 y) {
     return native_exp2(v2 * y);
 }
 
+#if defined(RS_IMPRECISE_MATH)
+// Imprecise scripts don't need these to be any better than the native_
+// approximations.
+#define FN_FUNC_NATIVE(fnc)                                         \
+extern float __attribute__((overloadable)) fnc(float v) {           \
+    return native_##fnc(v);                                         \
+}                                                                   \
+extern float2 __attribute__((overloadable)) fnc(float2 v) {         \
+    return native_##fnc(v);                                         \
+}                                                                   \
+extern float3 __attribute__((overloadable)) fnc(float3 v) {         \
+    return native_##fnc(v);                                         \
+}                                                                   \
+extern float4 __attribute__((overloadable)) fnc(float4 v) {         \
+    return native_##fnc(v);                                         \
+}
+
+FN_FUNC_NATIVE(exp)
+FN_FUNC_NATIVE(exp2)
+FN_FUNC_NATIVE(exp10)
+FN_FUNC_NATIVE(log)
+FN_FUNC_NATIVE(log2)
+FN_FUNC_NATIVE(log10)
+
+extern float __attribute__((overloadable)) powr(float v, float y) {
+    return native_powr(v, y);
+}
+extern float2 __attribute__((overloadable)) powr(float2 v, float2 y) {
+    return native_powr(v, y);
+}
+extern float3 __attribute__((overloadable)) powr(float3 v, float3 y) {
+    return native_powr(v, y);
+}
+extern float4 __attribute__((overloadable)) powr(float4 v, float4 y) {
+    return native_powr(v, y);
+}
+
+#undef FN_FUNC_NATIVE
+#endif // defined(RS_IMPRECISE_MATH)
+
 
 #undef FN_FUNC_FN
+#undef FN_LANES4
+#undef FN_FUNC_FN_BY4
+#undef FN_FUNC_FN_FN_BY4
 #undef IN_FUNC_FN
 #undef FN_FUNC_FN_FN
 #undef FN_FUNC_FN_F
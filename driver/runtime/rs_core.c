@@ -125,6 +125,19 @@ extern int __attribute__((overloadable)) rsRand(int min, int max) {
     return (int)rsRand((float)min, (float)max);
 }
 
+// Fills values with count uniform numbers in [0, 1).
+extern void __attribute__((overloadable)) rsRandFill(float *values, uint32_t count);
+
+extern float4 __attribute__((overloadable)) rsRand(float4 min, float4 max) {
+    float4 r;
+    rsRandFill((float *)&r, 4);
+    return r * (max - min) + min;
+}
+
+extern float4 __attribute__((overloadable)) rsRand(float4 max) {
+    return rsRand((float4)0.f, max);
+}
+
 #define PRIM_DEBUG(T)                               \
 extern void __attribute__((overloadable)) rsDebug(const char *, const T *);     \
 void __attribute__((overloadable)) rsDebug(const char *txt, T val) {            \
@@ -237,32 +237,63 @@ rsMatrixMultiply(rs_matrix3x3 *m, float2 in) {
     return rsMatrixMultiply((const rs_matrix3x3 *)m, in);
 }
 
+// Column i of the product is lhs applied to column i of rhs, which the
+// architecture's rsMatrixMultiply does with vector operations.  All four
+// are computed before any is stored, so ret may be lhs or rhs.
 extern void __attribute__((overloadable))
 rsMatrixLoadMultiply(rs_matrix4x4 *ret, const rs_matrix4x4 *lhs, const rs_matrix4x4 *rhs) {
+    float4 c[4];
     for (int i=0 ; i<4 ; i++) {
-        float ri0 = 0;
-        float ri1 = 0;
-        float ri2 = 0;
-        float ri3 = 0;
-        for (int j=0 ; j<4 ; j++) {
-            const float rhs_ij = rsMatrixGet(rhs, i, j);
-            ri0 += rsMatrixGet(lhs, j, 0) * rhs_ij;
-            ri1 += rsMatrixGet(lhs, j, 1) * rhs_ij;
-            ri2 += rsMatrixGet(lhs, j, 2) * rhs_ij;
-            ri3 += rsMatrixGet(lhs, j, 3) * rhs_ij;
-        }
-        rsMatrixSet(ret, i, 0, ri0);
-        rsMatrixSet(ret, i, 1, ri1);
-        rsMatrixSet(ret, i, 2, ri2);
-        rsMatrixSet(ret, i, 3, ri3);
+        const float *r = &rhs->m[i * 4];
+        float4 v = {r[0], r[1], r[2], r[3]};
+        c[i] = rsMatrixMultiply(lhs, v);
+    }
+    for (int i=0 ; i<4 ; i++) {
+        ret->m[i * 4 + 0] = c[i].x;
+        ret->m[i * 4 + 1] = c[i].y;
+        ret->m[i * 4 + 2] = c[i].z;
+        ret->m[i * 4 + 3] = c[i].w;
     }
 }
 
 extern void __attribute__((overloadable))
 rsMatrixMultiply(rs_matrix4x4 *lhs, const rs_matrix4x4 *rhs) {
-    rs_matrix4x4 r;
-    rsMatrixLoadMultiply(&r, lhs, rhs);
-    rsMatrixLoad(lhs, &r);
+    rsMatrixLoadMultiply(lhs, lhs, rhs);
+}
+
+extern void __attribute__((overloadable))
+rsMatrixTransform(const rs_matrix4x4 *m, rs_allocation out, rs_allocation in) {
+    const Allocation_t *ain = (const Allocation_t *)in.p;
+    const Allocation_t *aout = (const Allocation_t *)out.p;
+    if (ain->mHal.state.elementSizeBytes != sizeof(float4) ||
+        aout->mHal.state.elementSizeBytes != sizeof(float4)) {
+        return;
+    }
+
+    const Type_t *type = (const Type_t *)ain->mHal.state.type;
+    const Element_t *elem = (const Element_t *)type->mHal.state.element;
+    const bool isFloat3 = elem->mHal.state.vectorSize == 3;
+
+    const uint32_t dimX = min(ain->mHal.drvState.lod[0].dimX,
+                              aout->mHal.drvState.lod[0].dimX);
+    const uint32_t dimY = min(max(ain->mHal.drvState.lod[0].dimY, 1u),
+                              max(aout->mHal.drvState.lod[0].dimY, 1u));
+    const uint8_t *pin = (const uint8_t *)ain->mHal.drvState.lod[0].mallocPtr;
+    uint8_t *pout = (uint8_t *)aout->mHal.drvState.lod[0].mallocPtr;
+
+    for (uint32_t y = 0; y < dimY; y++) {
+        const float4 *vin = (const float4 *)&pin[y * ain->mHal.drvState.lod[0].stride];
+        float4 *vout = (float4 *)&pout[y * aout->mHal.drvState.lod[0].stride];
+        if (isFloat3) {
+            for (uint32_t x = 0; x < dimX; x++) {
+                vout[x] = rsMatrixMultiply(m, vin[x].xyz);
+            }
+        } else {
+            for (uint32_t x = 0; x < dimX; x++) {
+                vout[x] = rsMatrixMultiply(m, vin[x]);
+            }
+        }
+    }
 }
 
 extern void __attribute__((overloadable))
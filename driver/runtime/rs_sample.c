@@ -296,7 +296,8 @@ static float4 __attribute__((overloadable))
      return 0.f;
 }
 
-static uint32_t wrapI(rs_sampler_value wrap, int32_t coord, int32_t size) {
+static inline uint32_t __attribute__((always_inline))
+        wrapI(rs_sampler_value wrap, int32_t coord, int32_t size) {
     if (wrap == RS_SAMPLER_WRAP) {
         coord = coord % size;
         if (coord < 0) {
@@ -463,6 +464,55 @@ static float4 __attribute__((overloadable))
     return getNearestSample(alloc, location, dk, dt, lod);
 }
 
+// Finds the four texels a linear sample at uv blends and the weights of
+// the second texel along each axis.
+static inline void __attribute__((always_inline))
+        getLinearTexels(const Allocation_t *alloc, rs_sampler_value wrapS,
+                        rs_sampler_value wrapT, float2 uv, uint32_t lod,
+                        int *lx, int *ly, int *nx, int *ny,
+                        float *fracU, float *fracV) {
+    int sourceW = alloc->mHal.drvState.lod[lod].dimX;
+    int sourceH = alloc->mHal.drvState.lod[lod].dimY;
+
+    float pixelU = uv.x * sourceW - 0.5f;
+    float pixelV = uv.y * sourceH - 0.5f;
+    int iPixelU = (int)floor(pixelU);
+    int iPixelV = (int)floor(pixelV);
+    *fracU = pixelU - iPixelU;
+    *fracV = pixelV - iPixelV;
+
+    *nx = wrapI(wrapS, iPixelU + 1, sourceW);
+    *ny = wrapI(wrapT, iPixelV + 1, sourceH);
+    *lx = wrapI(wrapS, iPixelU, sourceW);
+    *ly = wrapI(wrapT, iPixelV, sourceH);
+}
+
+// uchar4 textures are blended with 8 bit weights in integer arithmetic,
+// the subtexel precision GL asks of texture units, and converted to float
+// once at the end.
+static inline float4 __attribute__((always_inline))
+        sample_RGBA8888_LinearPixel(const Allocation_t *alloc,
+                                    rs_sampler_value wrapS,
+                                    rs_sampler_value wrapT,
+                                    float2 uv, uint32_t lod) {
+    const uint8_t *p = (const uint8_t *)alloc->mHal.drvState.lod[lod].mallocPtr;
+    size_t stride = alloc->mHal.drvState.lod[lod].stride;
+
+    int lx, ly, nx, ny;
+    float fracU, fracV;
+    getLinearTexels(alloc, wrapS, wrapT, uv, lod, &lx, &ly, &nx, &ny, &fracU, &fracV);
+
+    const uint32_t wu = (uint32_t)(fracU * 256.f + 0.5f);
+    const uint32_t wv = (uint32_t)(fracV * 256.f + 0.5f);
+    const uchar4 *row0 = (const uchar4 *)&p[ly * stride];
+    const uchar4 *row1 = (const uchar4 *)&p[ny * stride];
+
+    uint4 top = convert_uint4(row0[lx]) * (256 - wu) + convert_uint4(row0[nx]) * wu;
+    uint4 bottom = convert_uint4(row1[lx]) * (256 - wu) + convert_uint4(row1[nx]) * wu;
+    uint4 r = top * (256 - wv) + bottom * wv;
+    return convert_float4(r) * (1.f / (255.f * 65536.f));
+}
+
 static float4 __attribute__((overloadable))
         sample_LOD_LinearPixel(const Allocation_t *alloc,
                                rs_data_kind dk, rs_data_type dt,
@@ -470,30 +520,14 @@ static float4 __attribute__((overloadable))
                                rs_sampler_value wrapT,
                                float2 uv, uint32_t lod) {
 
-    const uint8_t *p = (const uint8_t *)alloc->mHal.drvState.lod[lod].mallocPtr;
-
-    int sourceW = alloc->mHal.drvState.lod[lod].dimX;
-    int sourceH = alloc->mHal.drvState.lod[lod].dimY;
+    if (dk == RS_KIND_PIXEL_RGBA && dt == RS_TYPE_UNSIGNED_8) {
+        return sample_RGBA8888_LinearPixel(alloc, wrapS, wrapT, uv, lod);
+    }
 
-    float pixelU = uv.x * sourceW;
-    float pixelV = uv.y * sourceH;
-    int iPixelU = pixelU;
-    int iPixelV = pixelV;
-    float fracU = pixelU - iPixelU;
-    float fracV = pixelV - iPixelV;
+    int lx, ly, nx, ny;
+    float fracU, fracV;
+    getLinearTexels(alloc, wrapS, wrapT, uv, lod, &lx, &ly, &nx, &ny, &fracU, &fracV);
 
-    if (fracU < 0.5f) {
-        iPixelU -= 1;
-        fracU += 0.5f;
-    } else {
-        fracU -= 0.5f;
-    }
-    if (fracV < 0.5f) {
-        iPixelV -= 1;
-        fracV += 0.5f;
-    } else {
-        fracV -= 0.5f;
-    }
     float oneMinusFracU = 1.0f - fracU;
     float oneMinusFracV = 1.0f - fracV;
 
@@ -502,11 +536,6 @@ static float4 __attribute__((overloadable))
     float w2 = oneMinusFracU * fracV;
     float w3 = fracU * fracV;
 
-    int nx = wrapI(wrapS, iPixelU + 1, sourceW);
-    int ny = wrapI(wrapT, iPixelV + 1, sourceH);
-    int lx = wrapI(wrapS, iPixelU, sourceW);
-    int ly = wrapI(wrapT, iPixelV, sourceH);
-
     return getBilinearSample2D(alloc, w0, w1, w2, w3, lx, ly, nx, ny, dk, dt, lod);
 
 }
@@ -531,6 +560,14 @@ static float4 __attribute__((overloadable))
     return getNearestSample(alloc, location, dk, dt, lod);
 }
 
+// Clamped uchar4 textures are what most resampling scripts read, so they
+// get a copy of the linear path with the wrap modes fixed at compile time.
+static inline bool isClampedRGBA8888(rs_data_kind dk, rs_data_type dt,
+                                     rs_sampler_value wrapS, rs_sampler_value wrapT) {
+    return dk == RS_KIND_PIXEL_RGBA && dt == RS_TYPE_UNSIGNED_8 &&
+           wrapS == RS_SAMPLER_CLAMP && wrapT == RS_SAMPLER_CLAMP;
+}
+
 extern const float4 __attribute__((overloadable))
         rsSample(rs_allocation a, rs_sampler s, float uv, float lod) {
 
@@ -605,6 +642,10 @@ extern const float4 __attribute__((overloadable))
         if (sampleMag == RS_SAMPLER_NEAREST) {
             return sample_LOD_NearestPixel(alloc, dk, dt, wrapS, wrapT, uv, 0);
         }
+        if (isClampedRGBA8888(dk, dt, wrapS, wrapT)) {
+            return sample_RGBA8888_LinearPixel(alloc, RS_SAMPLER_CLAMP, RS_SAMPLER_CLAMP,
+                                               uv, 0);
+        }
         return sample_LOD_LinearPixel(alloc, dk, dt, wrapS, wrapT, uv, 0);
     }
 
@@ -649,6 +690,51 @@ extern const float4 __attribute__((overloadable))
     if (prog->mHal.state.magFilter == RS_SAMPLER_NEAREST) {
         return sample_LOD_NearestPixel(alloc, dk, dt, wrapS, wrapT, uv, 0);
     }
+    if (isClampedRGBA8888(dk, dt, wrapS, wrapT)) {
+        return sample_RGBA8888_LinearPixel(alloc, RS_SAMPLER_CLAMP, RS_SAMPLER_CLAMP, uv, 0);
+    }
     return sample_LOD_LinearPixel(alloc, dk, dt, wrapS, wrapT, uv, 0);
 }
 
+extern void __attribute__((overloadable))
+        rsSampleRow(rs_allocation a, rs_sampler s, float2 uv, float2 step,
+                    float4 *out, uint32_t count) {
+
+    const Allocation_t *alloc = (const Allocation_t *)a.p;
+    const Sampler_t *prog = (Sampler_t *)s.p;
+    const Type_t *type = (Type_t *)alloc->mHal.state.type;
+    const Element_t *elem = type->mHal.state.element;
+    rs_data_kind dk = elem->mHal.state.dataKind;
+    rs_data_type dt = elem->mHal.state.dataType;
+    rs_sampler_value wrapS = prog->mHal.state.wrapS;
+    rs_sampler_value wrapT = prog->mHal.state.wrapT;
+    uint32_t i;
+
+    if (!(alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE)) {
+        for (i = 0; i < count; i++) {
+            out[i] = 0.f;
+        }
+        return;
+    }
+
+    // Each path gets its own loop so the sampler state is only looked at
+    // once per row.  Positions are computed from the start rather than
+    // accumulated, so they match what rsSample would be passed.
+    if (prog->mHal.state.magFilter == RS_SAMPLER_NEAREST) {
+        for (i = 0; i < count; i++) {
+            out[i] = sample_LOD_NearestPixel(alloc, dk, dt, wrapS, wrapT,
+                                             uv + step * (float)i, 0);
+        }
+    } else if (isClampedRGBA8888(dk, dt, wrapS, wrapT)) {
+        for (i = 0; i < count; i++) {
+            out[i] = sample_RGBA8888_LinearPixel(alloc, RS_SAMPLER_CLAMP, RS_SAMPLER_CLAMP,
+                                                 uv + step * (float)i, 0);
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            out[i] = sample_LOD_LinearPixel(alloc, dk, dt, wrapS, wrapT,
+                                            uv + step * (float)i, 0);
+        }
+    }
+}
+
@@ -41,6 +41,15 @@ typedef struct Allocation {
             int32_t surfaceTextureID;
             void * nativeBuffer;
             int64_t timestamp;
+
+            const void *baseAlloc;
+            uint32_t originX;
+            uint32_t originY;
+            uint32_t originZ;
+            uint32_t originLOD;
+            uint32_t originFace;
+            uint32_t originField;
+            int sharedFd;
         } state;
 
         struct DrvState {
@@ -59,6 +68,16 @@ typedef struct Allocation {
                 uint32_t shift;
                 uint32_t step;
             } yuv;
+
+            uint32_t contentVersion;
+            bool fileBacked;
+
+            struct TileState {
+                uint32_t shiftX;
+                uint32_t shiftY;
+                uint32_t shiftZ;
+                uint32_t tilesY;
+            } tile;
         } drvState;
     } mHal;
 } Allocation_t;
@@ -46,6 +46,16 @@ public class Blend extends TestBase {
     private Allocation image1;
     private Allocation image2;
     private int currentIntrinsic = 0;
+    private boolean mFixedIntrinsic = false;
+
+    public Blend() {
+    }
+
+    // Benchmarks the single mode at index intrinsic of mIntrinsicNames.
+    public Blend(int intrinsic) {
+        currentIntrinsic = intrinsic;
+        mFixedIntrinsic = true;
+    }
 
     private AdapterView.OnItemSelectedListener mIntrinsicSpinnerListener =
             new AdapterView.OnItemSelectedListener() {
@@ -88,6 +98,9 @@ public class Blend extends TestBase {
     }
 
     public boolean onSpinner1Setup(Spinner s) {
+        if (mFixedIntrinsic) {
+            return super.onSpinner1Setup(s);
+        }
         s.setAdapter(new ArrayAdapter<String>(
             act, R.layout.spinner_layout, mIntrinsicNames));
         s.setOnItemSelectedListener(mIntrinsicSpinnerListener);
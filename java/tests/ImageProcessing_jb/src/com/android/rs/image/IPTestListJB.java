@@ -62,6 +62,19 @@ public class IPTestListJB {
         MANDELBROT_FLOAT ("Mandelbrot (fp32)", FULL_FP, 108.1f),
         MANDELBROT_DOUBLE ("Mandelbrot (fp64)", FULL_FP, 108.1f),
         INTRINSICS_BLEND ("Intrinsics Blend", INTRINSIC, 94.2f),
+        INTRINSICS_BLEND_SRC ("Intrinsics Blend Source", INTRINSIC),
+        INTRINSICS_BLEND_SRC_OVER ("Intrinsics Blend Source Over", INTRINSIC),
+        INTRINSICS_BLEND_DST_OVER ("Intrinsics Blend Destination Over", INTRINSIC),
+        INTRINSICS_BLEND_SRC_IN ("Intrinsics Blend Source In", INTRINSIC),
+        INTRINSICS_BLEND_DST_IN ("Intrinsics Blend Destination In", INTRINSIC),
+        INTRINSICS_BLEND_SRC_OUT ("Intrinsics Blend Source Out", INTRINSIC),
+        INTRINSICS_BLEND_DST_OUT ("Intrinsics Blend Destination Out", INTRINSIC),
+        INTRINSICS_BLEND_SRC_ATOP ("Intrinsics Blend Source Atop", INTRINSIC),
+        INTRINSICS_BLEND_DST_ATOP ("Intrinsics Blend Destination Atop", INTRINSIC),
+        INTRINSICS_BLEND_XOR ("Intrinsics Blend XOR", INTRINSIC),
+        INTRINSICS_BLEND_ADD ("Intrinsics Blend Add", INTRINSIC),
+        INTRINSICS_BLEND_SUBTRACT ("Intrinsics Blend Subtract", INTRINSIC),
+        INTRINSICS_BLEND_MULTIPLY ("Intrinsics Blend Multiply", INTRINSIC),
         INTRINSICS_BLUR_25G ("Intrinsics Blur 25 uchar", INTRINSIC, 173.3f),
         VIBRANCE ("Vibrance", RELAXED_FP, 88.3f),
         BW_FILTER ("BW Filter", RELAXED_FP, 69.7f),
@@ -157,6 +170,32 @@ public class IPTestListJB {
             return new Mandelbrot(true);
         case INTRINSICS_BLEND:
             return new Blend();
+        case INTRINSICS_BLEND_SRC:
+            return new Blend(0);
+        case INTRINSICS_BLEND_SRC_OVER:
+            return new Blend(2);
+        case INTRINSICS_BLEND_DST_OVER:
+            return new Blend(3);
+        case INTRINSICS_BLEND_SRC_IN:
+            return new Blend(4);
+        case INTRINSICS_BLEND_DST_IN:
+            return new Blend(5);
+        case INTRINSICS_BLEND_SRC_OUT:
+            return new Blend(6);
+        case INTRINSICS_BLEND_DST_OUT:
+            return new Blend(7);
+        case INTRINSICS_BLEND_SRC_ATOP:
+            return new Blend(8);
+        case INTRINSICS_BLEND_DST_ATOP:
+            return new Blend(9);
+        case INTRINSICS_BLEND_XOR:
+            return new Blend(10);
+        case INTRINSICS_BLEND_ADD:
+            return new Blend(11);
+        case INTRINSICS_BLEND_SUBTRACT:
+            return new Blend(12);
+        case INTRINSICS_BLEND_MULTIPLY:
+            return new Blend(13);
         case INTRINSICS_BLUR_25G:
             return new Blur25G();
         case VIBRANCE:
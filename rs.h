@@ -25,6 +25,7 @@
 // Legacy graphics functions
 // Not extern C because not used from C++ API
 RsObjectBase rsaFileA3DGetEntryByIndex(RsContext, uint32_t idx, RsFile);
+RsObjectBase rsaFileA3DGetEntryByName(RsContext, const char *name, RsFile);
 RsFile rsaFileA3DCreateFromMemory(RsContext, const void *data, uint32_t len);
 RsFile rsaFileA3DCreateFromAsset(RsContext, void *asset);
 RsFile rsaFileA3DCreateFromFile(RsContext, const char *path);
@@ -56,6 +57,12 @@ extern "C" {
     void rsDeviceSetConfig(RsDevice dev, RsDeviceParam p, int32_t value);
     RsContext rsContextCreate(RsDevice dev, uint32_t version, uint32_t sdkVersion,
                               RsContextType ct, uint32_t flags);
+    // Fills in libRScpp's dispatchTable of tableSize bytes.
+    bool rsGetDispatchTable(void *table, size_t tableSize);
+    // Runs the commands recorded in a debug.rs.trace file on a new context,
+    // writing how long they took to reportFd unless it is -1.  Paced replays
+    // keep the recorded gaps between commands.
+    bool rsTraceReplay(RsDevice dev, const char *path, bool paced, int reportFd);
 }
 #include "rsgApiFuncDecl.h"
 
@@ -1,10 +1,12 @@
 
 ContextDestroy {
     direct
+    notrace
 }
 
 ContextGetMessage {
     direct
+    notrace
     param void *data
     param size_t *receiveLen
     param uint32_t *usrID
@@ -13,6 +15,7 @@ ContextGetMessage {
 
 ContextPeekMessage {
     direct
+    notrace
     param size_t *receiveLen
     param uint32_t *usrID
     ret RsMessageToClientType
@@ -25,10 +28,12 @@ ContextSendMessage {
 
 ContextInitToClient {
     direct
+    notrace
 }
 
 ContextDeinitToClient {
     direct
+    notrace
 }
 
 TypeCreate {
@@ -71,12 +76,14 @@ AllocationCubeCreateFromBitmap {
 }
 
 AllocationGetSurface {
+    notrace
     param RsAllocation alloc
     sync
     ret RsNativeWindow
 }
 
 AllocationSetSurface {
+    notrace
     param RsAllocation alloc
     param RsNativeWindow sur
     sync
@@ -86,16 +93,43 @@ ContextFinish {
     sync
     }
 
+ContextFence {
+    param uint32_t id
+}
+
+ContextFlush {
+    direct
+}
+
 ContextDump {
     param int32_t bits
 }
 
+ContextGetProfile {
+    param RsKernelProfile *profiles
+    sync
+    ret uint32_t
+}
+
+ContextGetMemoryUsage {
+    direct
+    param RsMemoryUsage *usage
+    ret uint32_t
+}
+
 ContextSetPriority {
     param int32_t priority
     }
 
+ContextTrimMemory {
+    param int32_t level
+    sync
+    ret uint64_t
+    }
+
 ContextDestroyWorker {
     sync
+    notrace
 }
 
 AssignName {
@@ -107,6 +141,11 @@ ObjDestroy {
     param RsAsyncVoidPtr objPtr
     }
 
+ObjDestroyBatch {
+    param const RsObjectBase * objs
+    param bool deferred
+    }
+
 ElementCreate {
         direct
     param RsDataType mType
@@ -146,6 +185,11 @@ Allocation1DElementData {
     param size_t comp_offset
     }
 
+AllocationElementDataBatch {
+    param RsAllocation va
+    param const void *records
+    }
+
 Allocation2DData {
     param RsAllocation va
     param uint32_t xoff
@@ -200,17 +244,93 @@ Allocation2DRead {
     param size_t stride
 }
 
+Allocation1DReadAsync {
+    notrace
+    param RsAllocation va
+    param uint32_t xoff
+    param uint32_t lod
+    param uint32_t count
+    param uintptr_t data
+    param size_t sizeBytes
+}
+
+Allocation2DReadAsync {
+    notrace
+    param RsAllocation va
+    param uint32_t xoff
+    param uint32_t yoff
+    param uint32_t lod
+    param RsAllocationCubemapFace face
+    param uint32_t w
+    param uint32_t h
+    param uintptr_t data
+    param size_t sizeBytes
+    param size_t stride
+}
+
+AllocationAdapterCreate {
+    param RsType vtype
+    param RsAllocation baseAlloc
+    ret RsAllocation
+}
+
+AllocationAdapterOffset {
+    param RsAllocation alloc
+    param const uint32_t *offsets
+}
+
+AllocationExport {
+    notrace
+    param RsAllocation va
+    ret int32_t
+}
+
+AllocationImport {
+    notrace
+    param RsType vtype
+    param uint32_t usages
+    param int32_t fd
+    ret RsAllocation
+}
+
 
 AllocationSyncAll {
     param RsAllocation va
     param RsAllocationUsageType src
 }
 
+AllocationGetPointer {
+    param RsAllocation va
+    param uint32_t lod
+    param RsAllocationCubemapFace face
+    param uint32_t z
+    param size_t *stride
+    sync
+    ret void *
+}
+
 AllocationResize1D {
     param RsAllocation va
     param uint32_t dimX
     }
 
+AllocationReserve1D {
+    param RsAllocation va
+    param uint32_t dimX
+    }
+
+AllocationSort {
+    param RsAllocation keys
+    param RsAllocation values
+    }
+
+AllocationCompact {
+    param RsAllocation dst
+    param RsAllocation src
+    param RsAllocation flags
+    ret uint32_t
+    }
+
 AllocationCopy2DRange {
     param RsAllocation dest
     param uint32_t destXoff
@@ -242,6 +362,25 @@ AllocationCopy3DRange {
     param uint32_t srcMip
     }
 
+AllocationCopyConvert {
+    param RsAllocation dest
+    param uint32_t destXoff
+    param uint32_t destYoff
+    param uint32_t destZoff
+    param uint32_t destMip
+    param uint32_t destFace
+    param uint32_t width
+    param uint32_t height
+    param uint32_t depth
+    param RsAllocation src
+    param uint32_t srcXoff
+    param uint32_t srcYoff
+    param uint32_t srcZoff
+    param uint32_t srcMip
+    param uint32_t srcFace
+    param RsAllocationConversion conversion
+    }
+
 
 SamplerCreate {
     direct
@@ -276,6 +415,12 @@ ScriptInvokeV {
     param const void * data
     }
 
+ScriptInvokeBatch {
+    param RsScript s
+    param uint32_t slot
+    param RsAllocation params
+    }
+
 ScriptForEach {
     param RsScript s
     param uint32_t slot
@@ -285,6 +430,35 @@ ScriptForEach {
     param const RsScriptCall * sc
 }
 
+ScriptForEachMulti {
+    param RsScript s
+    param uint32_t slot
+    param RsAllocation * ains
+    param RsAllocation aout
+    param const void * usr
+    param const RsScriptCall * sc
+}
+
+ScriptForEachRegions {
+    param RsScript s
+    param uint32_t slot
+    param RsAllocation ain
+    param RsAllocation aout
+    param const void * usr
+    param const RsScriptCall * sc
+    param const RsScriptRect * regions
+}
+
+ScriptReduce {
+    param RsScript s
+    param uint32_t accumSlot
+    param uint32_t combineSlot
+    param int32_t finalizeSlot
+    param RsAllocation ain
+    param RsAllocation aout
+    param const RsScriptCall * sc
+}
+
 ScriptSetVarI {
     param RsScript s
     param uint32_t slot
@@ -321,6 +495,11 @@ ScriptSetVarV {
     param const void * data
     }
 
+ScriptSetVars {
+    param RsScript s
+    param const void * records
+    }
+
 ScriptGetVarV {
     param RsScript s
     param uint32_t slot
@@ -391,6 +570,33 @@ ScriptGroupExecute {
     param RsScriptGroup group
 }
 
+ScriptGroupSetPipelined {
+    param RsScriptGroup group
+    param bool pipelined
+}
+
+CommandBufferCreate {
+    direct
+    ret RsCommandBuffer
+}
+
+CommandBufferBegin {
+    param RsCommandBuffer cb
+}
+
+CommandBufferMarkParam {
+    param RsCommandBuffer cb
+}
+
+CommandBufferEnd {
+    param RsCommandBuffer cb
+}
+
+CommandBufferSubmit {
+    param RsCommandBuffer cb
+    param const void * params
+}
+
 AllocationIoSend {
     param RsAllocation alloc
     }
@@ -399,3 +605,9 @@ AllocationIoReceive {
     param RsAllocation alloc
     }
 
+AllocationSetIoInputQueue {
+    param RsAllocation alloc
+    param uint32_t depth
+    param bool latest
+    }
+
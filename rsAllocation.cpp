@@ -24,6 +24,13 @@
 #include "gui/GLConsumer.h"
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 using namespace android;
 using namespace android::renderscript;
 
@@ -36,6 +43,13 @@ Allocation::Allocation(Context *rsc, const Type *type, uint32_t usages,
     mHal.state.usageFlags = usages;
     mHal.state.mipmapControl = mc;
     mHal.state.userProvidedPtr = ptr;
+    mHal.state.sharedFd = -1;
+#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
+    mIoQueueDepth = 1;
+    mIoSkipToLatest = false;
+#endif
+    mAdapterCount = 0;
+    mClientMapped = false;
 
     setType(type);
     updateCache();
@@ -50,6 +64,28 @@ void Allocation::operator delete(void* ptr) {
 
 Allocation * Allocation::createAllocation(Context *rsc, const Type *type, uint32_t usages,
                               RsAllocationMipmapControl mc, void * ptr) {
+    if (usages & RS_ALLOCATION_USAGE_FIELD_PLANES) {
+        const Element *e = type->getElement();
+        if (!e->getFieldCount() || e->getHasReferences() || ptr ||
+            (usages & ~(RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_FIELD_PLANES)) ||
+            type->getDimLOD() || type->getDimFaces() || type->getDimYuv()) {
+            rsc->setError(RS_ERROR_BAD_VALUE,
+                          "Field planes need a struct Element without objects, script usage only "
+                          "and no LODs, faces or YUV layout.");
+            return NULL;
+        }
+    }
+    if (usages & RS_ALLOCATION_USAGE_TILED) {
+        if ((type->getDimY() < 2) || type->getElement()->getHasReferences() || ptr ||
+            (usages & ~(RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_TILED)) ||
+            type->getDimLOD() || type->getDimFaces() || type->getDimYuv()) {
+            rsc->setError(RS_ERROR_BAD_VALUE,
+                          "Tiles need a 2D or 3D Type without objects, script usage only "
+                          "and no LODs, faces or YUV layout.");
+            return NULL;
+        }
+    }
+
     // Allocation objects must use allocator specified by the driver
     void* allocMem = rsc->mHal.funcs.allocRuntimeMem(sizeof(Allocation), 0);
 
@@ -69,6 +105,187 @@ Allocation * Allocation::createAllocation(Context *rsc, const Type *type, uint32
     return a;
 }
 
+// The first field of e a view of element can cover, or -1.
+static int32_t findPlaneField(const Element *e, const Element *element, uint32_t from) {
+    for (uint32_t ct = from; ct < e->getFieldCount(); ct++) {
+        if ((e->getField(ct) == element) && (e->getFieldArraySize(ct) == 1)) {
+            return ct;
+        }
+    }
+    return -1;
+}
+
+Allocation * Allocation::createAdapter(Context *rsc, const Allocation *base, const Type *type) {
+    const Type *baseType = base->getType();
+    // Views of field planes cover one field, starting with the first of
+    // the view's Element.
+    int32_t field = 0;
+    if (base->hasFieldPlanes()) {
+        field = findPlaneField(baseType->getElement(), type->getElement(), 0);
+        if (field < 0) {
+            rsc->setError(RS_ERROR_BAD_VALUE, "Adapter element must match a field of its base.");
+            return NULL;
+        }
+    } else if (type->getElement() != baseType->getElement()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Adapter element must match its base allocation.");
+        return NULL;
+    }
+    if (type->getDimLOD() || type->getDimFaces() || type->getDimYuv()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Adapters can't have LODs, faces or YUV layouts.");
+        return NULL;
+    }
+    // Objects would be released twice, and IO buffers move under the view.
+    if (base->mHal.state.hasReferences || baseType->getDimYuv() || base->hasTiles() ||
+        !(base->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SCRIPT) ||
+        (base->mHal.state.usageFlags & (RS_ALLOCATION_USAGE_IO_INPUT |
+                                        RS_ALLOCATION_USAGE_IO_OUTPUT))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Allocation can't be adapted.");
+        return NULL;
+    }
+    if ((type->getDimX() > baseType->getDimX()) ||
+        (rsMax(type->getDimY(), 1u) > rsMax(baseType->getDimY(), 1u)) ||
+        (rsMax(type->getDimZ(), 1u) > rsMax(baseType->getDimZ(), 1u))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Adapter is larger than its base allocation.");
+        return NULL;
+    }
+    if (!rsc->mHal.funcs.allocation.initAdapter) {
+        rsc->setError(RS_ERROR_FATAL_DRIVER, "Driver doesn't support allocation adapters");
+        return NULL;
+    }
+
+    void* allocMem = rsc->mHal.funcs.allocRuntimeMem(sizeof(Allocation), 0);
+    if (!allocMem) {
+        rsc->setError(RS_ERROR_FATAL_DRIVER, "Couldn't allocate memory for Allocation");
+        return NULL;
+    }
+
+    Allocation *a = new (allocMem) Allocation(rsc, type, RS_ALLOCATION_USAGE_SCRIPT,
+                                              RS_ALLOCATION_MIPMAP_NONE, NULL);
+    a->mHal.state.baseAlloc = base;
+    a->mHal.state.originFace = RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X;
+    a->mHal.state.originField = field;
+    a->mBaseAlloc.set(base);
+    base->mAdapterCount++;
+
+    if (!rsc->mHal.funcs.allocation.initAdapter(rsc, a)) {
+        rsc->setError(RS_ERROR_FATAL_DRIVER, "Allocation::createAdapter, init failure");
+        delete a;
+        return NULL;
+    }
+    return a;
+}
+
+Allocation * Allocation::createFromShared(Context *rsc, const Type *type, uint32_t usages,
+                                         int fd) {
+    // Importers need the same layout as the exporter, which the driver
+    // only promises for plain script memory.
+    if ((fd < 0) || !(usages & RS_ALLOCATION_USAGE_SHARED) ||
+        (usages & ~(RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED)) ||
+        type->getDimLOD() || type->getDimFaces() || type->getDimYuv() ||
+        type->getElement()->getHasReferences()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Invalid shared allocation import.");
+        return NULL;
+    }
+
+    void* allocMem = rsc->mHal.funcs.allocRuntimeMem(sizeof(Allocation), 0);
+    if (!allocMem) {
+        rsc->setError(RS_ERROR_FATAL_DRIVER, "Couldn't allocate memory for Allocation");
+        return NULL;
+    }
+
+    Allocation *a = new (allocMem) Allocation(rsc, type, usages, RS_ALLOCATION_MIPMAP_NONE, NULL);
+    a->mHal.state.sharedFd = fd;
+    if (!rsc->mHal.funcs.allocation.init(rsc, a, false)) {
+        rsc->setError(RS_ERROR_FATAL_DRIVER, "Allocation::createFromShared, import failure");
+        delete a;
+        return NULL;
+    }
+    a->mHal.state.sharedFd = -1;
+    return a;
+}
+
+int Allocation::exportShared(Context *rsc) const {
+    if (!(mHal.state.usageFlags & RS_ALLOCATION_USAGE_SHARED) ||
+        (mHal.state.usageFlags & ~(RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED)) ||
+        mHal.state.userProvidedPtr || isAdapter() || !rsc->mHal.funcs.allocation.exportShared) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Only script USAGE_SHARED allocations can be exported.");
+        return -1;
+    }
+    int fd = rsc->mHal.funcs.allocation.exportShared(rsc, this);
+    if (fd < 0) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Allocation isn't backed by sharable memory.");
+    }
+    return fd;
+}
+
+void * Allocation::getPointer(Context *rsc, uint32_t lod, RsAllocationCubemapFace face,
+                              uint32_t z, size_t *stride) {
+    const uint32_t unmappable = RS_ALLOCATION_USAGE_IO_INPUT | RS_ALLOCATION_USAGE_IO_OUTPUT |
+                                RS_ALLOCATION_USAGE_TILED | RS_ALLOCATION_USAGE_FIELD_PLANES;
+    if (!getIsScript() || (mHal.state.usageFlags & unmappable) || isAdapter() ||
+        mHal.state.hasReferences) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Only plain script allocations can be mapped.");
+        return NULL;
+    }
+    const Hal::DrvState &d = mHal.drvState;
+    if ((lod >= rsMax(d.lodCount, 1u)) || ((uint32_t)face >= rsMax(d.faceCount, 1u)) ||
+        (z >= rsMax(d.lod[lod].dimZ, 1u)) || !d.lod[lod].mallocPtr) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Invalid allocation region to map.");
+        return NULL;
+    }
+
+    // Everything launched before writes through the pointer is done with
+    // the memory; what is launched later is for the client to wait on.
+    if (rsc->mPendingAsyncWork) {
+        rsc->finish();
+    }
+    mClientMapped = true;
+    *stride = d.lod[lod].stride;
+    return (uint8_t *)d.lod[lod].mallocPtr + face * d.faceOffset +
+           (size_t)z * rsMax(d.lod[lod].dimY, 1u) * d.lod[lod].stride;
+}
+
+void Allocation::adapterOffset(Context *rsc, const uint32_t *offsets, size_t count) {
+    if (!isAdapter()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Only adapters can be offset.");
+        return;
+    }
+    uint32_t o[6] = {0, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X, mHal.state.originField};
+    for (size_t ct = 0; ct < rsMin(count, (size_t)6); ct++) {
+        o[ct] = offsets[ct];
+    }
+
+    const Allocation *base = mHal.state.baseAlloc;
+    const Type *type = getType();
+    if (base->hasFieldPlanes() ?
+        (findPlaneField(base->getType()->getElement(), type->getElement(), o[5]) != (int32_t)o[5]) :
+        (o[5] != 0)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Adapter field doesn't match its element.");
+        return;
+    }
+    if ((o[3] >= rsMax(base->mHal.drvState.lodCount, 1u)) ||
+        ((o[4] != RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X) &&
+         (!base->mHal.state.hasFaces || (o[4] > RS_ALLOCATION_CUBEMAP_FACE_NEGATIVE_Z)))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Adapter LOD or face out of range.");
+        return;
+    }
+    const Allocation::Hal::DrvState::LodState &lod = base->mHal.drvState.lod[o[3]];
+    if (((o[0] + type->getDimX()) > lod.dimX) ||
+        ((o[1] + rsMax(type->getDimY(), 1u)) > rsMax(lod.dimY, 1u)) ||
+        ((o[2] + rsMax(type->getDimZ(), 1u)) > rsMax(lod.dimZ, 1u))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Adapter offset out of range.");
+        return;
+    }
+
+    mHal.state.originX = o[0];
+    mHal.state.originY = o[1];
+    mHal.state.originZ = o[2];
+    mHal.state.originLOD = o[3];
+    mHal.state.originFace = (RsAllocationCubemapFace)o[4];
+    mHal.state.originField = o[5];
+    rsc->mHal.funcs.allocation.adapterOffset(rsc, this);
+}
+
 void Allocation::updateCache() {
     const Type *type = mHal.state.type;
     mHal.state.yuv = type->getDimYuv();
@@ -88,10 +305,14 @@ Allocation::~Allocation() {
 
     freeChildrenUnlocked();
     mRSC->mHal.funcs.allocation.destroy(mRSC, this);
+    if (mBaseAlloc.get()) {
+        mBaseAlloc->mAdapterCount--;
+    }
 }
 
 void Allocation::syncAll(Context *rsc, RsAllocationUsageType src) {
     rsc->mHal.funcs.allocation.syncAll(rsc, this, src);
+    sendDirtyToPrograms();
 }
 
 void Allocation::data(Context *rsc, uint32_t xoff, uint32_t lod,
@@ -106,20 +327,20 @@ void Allocation::data(Context *rsc, uint32_t xoff, uint32_t lod,
     }
 
     rsc->mHal.funcs.allocation.data1D(rsc, this, xoff, lod, count, data, sizeBytes);
-    sendDirty(rsc);
+    sendDirtyToPrograms();
 }
 
 void Allocation::data(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t lod, RsAllocationCubemapFace face,
                       uint32_t w, uint32_t h, const void *data, size_t sizeBytes, size_t stride) {
     rsc->mHal.funcs.allocation.data2D(rsc, this, xoff, yoff, lod, face, w, h, data, sizeBytes, stride);
-    sendDirty(rsc);
+    sendDirtyToPrograms();
 }
 
 void Allocation::data(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t zoff,
                       uint32_t lod,
                       uint32_t w, uint32_t h, uint32_t d, const void *data, size_t sizeBytes, size_t stride) {
     rsc->mHal.funcs.allocation.data3D(rsc, this, xoff, yoff, zoff, lod, w, h, d, data, sizeBytes, stride);
-    sendDirty(rsc);
+    sendDirtyToPrograms();
 }
 
 void Allocation::read(Context *rsc, uint32_t xoff, uint32_t lod,
@@ -190,7 +411,7 @@ void Allocation::elementData(Context *rsc, uint32_t x, const void *data,
     }
 
     rsc->mHal.funcs.allocation.elementData1D(rsc, this, x, data, cIdx, sizeBytes);
-    sendDirty(rsc);
+    sendDirtyToPrograms();
 }
 
 void Allocation::elementData(Context *rsc, uint32_t x, uint32_t y,
@@ -224,7 +445,54 @@ void Allocation::elementData(Context *rsc, uint32_t x, uint32_t y,
     }
 
     rsc->mHal.funcs.allocation.elementData2D(rsc, this, x, y, data, cIdx, sizeBytes);
-    sendDirty(rsc);
+    sendDirtyToPrograms();
+}
+
+void Allocation::elementDataBatch(Context *rsc, const void *records, size_t sizeBytes) {
+    const Element *elem = mHal.state.type->getElement();
+    const uint8_t *p = (const uint8_t *)records;
+    const uint8_t *end = p + sizeBytes;
+    uint32_t count = 0;
+
+    while (p < end) {
+        RsElementDataRecord r;
+        if ((size_t)(end - p) < sizeof(r)) {
+            ALOGE("Error Allocation::elementDataBatch truncated record %u.", count);
+            rsc->setError(RS_ERROR_BAD_VALUE, "elementDataBatch truncated record.");
+            return;
+        }
+        memcpy(&r, p, sizeof(r));
+
+        if ((r.x >= mHal.drvState.lod[0].dimX) ||
+            (r.y >= rsMax(mHal.drvState.lod[0].dimY, 1u))) {
+            ALOGE("Error Allocation::elementDataBatch record %u offset out of range.", count);
+            rsc->setError(RS_ERROR_BAD_VALUE, "elementDataBatch offset out of range.");
+            return;
+        }
+        if (r.component >= elem->getFieldCount()) {
+            ALOGE("Error Allocation::elementDataBatch record %u component %u out of range.",
+                  count, r.component);
+            rsc->setError(RS_ERROR_BAD_VALUE, "elementDataBatch component out of range.");
+            return;
+        }
+        const size_t fieldSize = elem->getField(r.component)->getSizeBytes() *
+                                 elem->getFieldArraySize(r.component);
+        const size_t recordSize = sizeof(r) + rsRound(r.sizeBytes, 4);
+        if ((r.sizeBytes != fieldSize) || ((size_t)(end - p) < recordSize)) {
+            ALOGE("Error Allocation::elementDataBatch record %u size %u does not match field size %zu.",
+                  count, r.sizeBytes, fieldSize);
+            rsc->setError(RS_ERROR_BAD_VALUE, "elementDataBatch bad size.");
+            return;
+        }
+
+        p += recordSize;
+        count++;
+    }
+
+    if (count) {
+        rsc->mHal.funcs.allocation.elementDataBatch(rsc, this, records, sizeBytes, count);
+        sendDirtyToPrograms();
+    }
 }
 
 void Allocation::addProgramToDirty(const Program *p) {
@@ -260,6 +528,160 @@ uint32_t Allocation::getPackedSize() const {
     return numItems * mHal.state.type->getElement()->getSizeBytesUnpadded();
 }
 
+// Copies count 3 component vectors with components of C bytes between
+// cells padded to 4 components and packed ones.  Padding is zeroed.
+template <size_t C>
+static void copyVec3Cells(uint8_t *dst, const uint8_t *src, size_t count, bool dstPadded) {
+    const size_t srcInc = dstPadded ? (3 * C) : (4 * C);
+    const size_t dstInc = dstPadded ? (4 * C) : (3 * C);
+    for (size_t i = 0; i < count; i ++) {
+        memcpy(dst, src, 3 * C);
+        if (dstPadded) {
+            memset(dst + 3 * C, 0, C);
+        }
+        src += srcInc;
+        dst += dstInc;
+    }
+}
+
+#if defined(__SSE2__)
+// 4 vectors of 32 bit components per step: three loads of packed data
+// against four padded cells.
+static size_t copyVec3Cells32SSE(uint8_t *dst, const uint8_t *src, size_t count, bool dstPadded) {
+    const __m128i m0 = _mm_set_epi32(0, 0, 0, -1);
+    const __m128i m01 = _mm_set_epi32(0, 0, -1, -1);
+    const __m128i m012 = _mm_set_epi32(0, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        if (dstPadded) {
+            const __m128i *s = (const __m128i *)(src + i * 12);
+            __m128i a = _mm_loadu_si128(s);
+            __m128i b = _mm_loadu_si128(s + 1);
+            __m128i c = _mm_loadu_si128(s + 2);
+            __m128i *d = (__m128i *)(dst + i * 16);
+            _mm_storeu_si128(d, _mm_and_si128(a, m012));
+            _mm_storeu_si128(d + 1, _mm_and_si128(_mm_or_si128(_mm_srli_si128(a, 12),
+                                                              _mm_slli_si128(b, 4)), m012));
+            _mm_storeu_si128(d + 2, _mm_and_si128(_mm_or_si128(_mm_srli_si128(b, 8),
+                                                              _mm_slli_si128(c, 8)), m012));
+            _mm_storeu_si128(d + 3, _mm_srli_si128(c, 4));
+        } else {
+            const __m128i *s = (const __m128i *)(src + i * 16);
+            __m128i e0 = _mm_loadu_si128(s);
+            __m128i e1 = _mm_loadu_si128(s + 1);
+            __m128i e2 = _mm_loadu_si128(s + 2);
+            __m128i e3 = _mm_loadu_si128(s + 3);
+            __m128i *d = (__m128i *)(dst + i * 12);
+            _mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(e0, m012), _mm_slli_si128(e1, 12)));
+            _mm_storeu_si128(d + 1, _mm_or_si128(_mm_and_si128(_mm_srli_si128(e1, 4), m01),
+                                                 _mm_slli_si128(e2, 8)));
+            _mm_storeu_si128(d + 2, _mm_or_si128(_mm_and_si128(_mm_srli_si128(e2, 8), m0),
+                                                 _mm_slli_si128(e3, 4)));
+        }
+    }
+    return i;
+}
+#endif
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+// vld3/vst4 and vld4/vst3 do the (de)interleaving, a register per component.
+#define RS_VEC3_NEON_KERNEL(name, E, T, N, suffix)                               \
+static size_t name(uint8_t *dst, const uint8_t *src, size_t count, bool dstPadded) { \
+    size_t i = 0;                                                                   \
+    for (; i + N <= count; i += N) {                                                \
+        if (dstPadded) {                                                            \
+            T##x3_t v = vld3q_##suffix((const E *)(src + i * 3 * sizeof(E)));       \
+            T##x4_t o;                                                              \
+            o.val[0] = v.val[0];                                                    \
+            o.val[1] = v.val[1];                                                    \
+            o.val[2] = v.val[2];                                                    \
+            o.val[3] = vdupq_n_##suffix(0);                                         \
+            vst4q_##suffix((E *)(dst + i * 4 * sizeof(E)), o);                      \
+        } else {                                                                    \
+            T##x4_t v = vld4q_##suffix((const E *)(src + i * 4 * sizeof(E)));       \
+            T##x3_t o;                                                              \
+            o.val[0] = v.val[0];                                                    \
+            o.val[1] = v.val[1];                                                    \
+            o.val[2] = v.val[2];                                                    \
+            vst3q_##suffix((E *)(dst + i * 3 * sizeof(E)), o);                      \
+        }                                                                           \
+    }                                                                               \
+    return i;                                                                       \
+}
+RS_VEC3_NEON_KERNEL(copyVec3Cells8NEON, uint8_t, uint8x16, 16, u8)
+RS_VEC3_NEON_KERNEL(copyVec3Cells16NEON, uint16_t, uint16x8, 8, u16)
+RS_VEC3_NEON_KERNEL(copyVec3Cells32NEON, uint32_t, uint32x4, 4, u32)
+#undef RS_VEC3_NEON_KERNEL
+#endif
+
+// Converts count vec3 cells between padded and packed layouts for any
+// component size, with vector kernels doing the bulk where available.
+static void copyVec3(uint8_t *dst, const uint8_t *src, size_t count, uint32_t compBytes,
+                     bool dstPadded) {
+    size_t done = 0;
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    if (compBytes == 1) {
+        done = copyVec3Cells8NEON(dst, src, count, dstPadded);
+    } else if (compBytes == 2) {
+        done = copyVec3Cells16NEON(dst, src, count, dstPadded);
+    } else if (compBytes == 4) {
+        done = copyVec3Cells32NEON(dst, src, count, dstPadded);
+    }
+#elif defined(__SSE2__)
+    if (compBytes == 4) {
+        done = copyVec3Cells32SSE(dst, src, count, dstPadded);
+    }
+#endif
+    const size_t srcOffset = done * compBytes * (dstPadded ? 3 : 4);
+    const size_t dstOffset = done * compBytes * (dstPadded ? 4 : 3);
+    dst += dstOffset;
+    src += srcOffset;
+    count -= done;
+    switch (compBytes) {
+    case 1: copyVec3Cells<1>(dst, src, count, dstPadded); break;
+    case 2: copyVec3Cells<2>(dst, src, count, dstPadded); break;
+    case 4: copyVec3Cells<4>(dst, src, count, dstPadded); break;
+    case 8: copyVec3Cells<8>(dst, src, count, dstPadded); break;
+    }
+}
+
+namespace {
+
+struct Vec3CopyWork {
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t count;
+    uint32_t compBytes;
+    bool dstPadded;
+    volatile int32_t next;
+};
+
+}
+
+enum {
+    // Cells per worker step, and the size from which copies are split
+    kVec3SliceCells = 16 * 1024,
+    kVec3ThreadedBytes = 1024 * 1024
+};
+
+static void copyVec3Slices(void *usr, uint32_t idx) {
+    Vec3CopyWork *work = (Vec3CopyWork *)usr;
+    const size_t srcCell = work->compBytes * (work->dstPadded ? 3 : 4);
+    const size_t dstCell = work->compBytes * (work->dstPadded ? 4 : 3);
+    while (1) {
+        size_t start = (size_t)__sync_fetch_and_add(&work->next, 1) * kVec3SliceCells;
+        if (start >= work->count) {
+            return;
+        }
+        size_t count = work->count - start;
+        if (count > kVec3SliceCells) {
+            count = kVec3SliceCells;
+        }
+        copyVec3(work->dst + start * dstCell, work->src + start * srcCell, count,
+                 work->compBytes, work->dstPadded);
+    }
+}
+
 void Allocation::writePackedData(Context *rsc, const Type *type,
                                  uint8_t *dst, const uint8_t *src, bool dstPadded) {
     const Element *elem = type->getElement();
@@ -272,6 +694,23 @@ void Allocation::writePackedData(Context *rsc, const Type *type,
 
     // no sub-elements
     uint32_t fieldCount = elem->getFieldCount();
+    if ((fieldCount == 0) && (elem->getVectorSize() == 3) &&
+        (unpaddedBytes * 4 == paddedBytes * 3)) {
+        Vec3CopyWork work;
+        work.dst = dst;
+        work.src = src;
+        work.count = numItems;
+        work.compBytes = paddedBytes / 4;
+        work.dstPadded = dstPadded;
+        work.next = 0;
+        if (rsc && ((size_t)numItems * paddedBytes >= kVec3ThreadedBytes) &&
+            rsc->mHal.funcs.launchThreads && rsc->canLaunchThreads()) {
+            rsc->mHal.funcs.launchThreads(rsc, copyVec3Slices, &work);
+        } else {
+            copyVec3Slices(&work, 0);
+        }
+        return;
+    }
     if (fieldCount == 0) {
         for (uint32_t i = 0; i < numItems; i ++) {
             memcpy(dst, src, unpaddedBytes);
@@ -372,11 +811,31 @@ Allocation *Allocation::createFromStream(Context *rsc, IStream *stream) {
     }
     type->compute();
 
-    Allocation *alloc = Allocation::createAllocation(rsc, type, RS_ALLOCATION_USAGE_SCRIPT);
-    type->decUserRef();
-
     // Number of bytes we wrote out for this allocation
     uint32_t dataSize = stream->loadU32();
+    const uint8_t *data = stream->getPtr() + stream->getPos();
+
+    // Data the stream's backing keeps alive can be used in place when it
+    // is laid out the way the allocation would hold it.
+    const ObjectBase *backing = stream->getBacking();
+    bool inPlace = backing && (dataSize == type->getPackedSizeBytes()) &&
+                   !type->getDimLOD() && !type->getDimFaces() &&
+                   ((((uintptr_t)data) & 15) == 0);
+
+    Allocation *alloc = NULL;
+    if (inPlace) {
+        alloc = Allocation::createAllocation(rsc, type,
+                                             RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED,
+                                             RS_ALLOCATION_MIPMAP_NONE, (void *)data);
+    } else {
+        alloc = Allocation::createAllocation(rsc, type, RS_ALLOCATION_USAGE_SCRIPT);
+    }
+    type->decUserRef();
+    if (!alloc) {
+        ObjectBase::checkDelete(type);
+        return NULL;
+    }
+
     // 3 element vectors are padded to 4 in memory, but padding isn't serialized
     uint32_t packedSize = alloc->getPackedSize();
     if (dataSize != type->getPackedSizeBytes() &&
@@ -388,12 +847,14 @@ Allocation *Allocation::createFromStream(Context *rsc, IStream *stream) {
     }
 
     alloc->assignName(name);
-    if (dataSize == type->getPackedSizeBytes()) {
+    if (inPlace) {
+        alloc->mBacking.set(backing);
+    } else if (dataSize == type->getPackedSizeBytes()) {
         uint32_t count = dataSize / type->getElementSizeBytes();
         // Read in all of our allocation data
-        alloc->data(rsc, 0, 0, count, stream->getPtr() + stream->getPos(), dataSize);
+        alloc->data(rsc, 0, 0, count, data, dataSize);
     } else {
-        alloc->unpackVec3Allocation(rsc, stream->getPtr() + stream->getPos(), dataSize);
+        alloc->unpackVec3Allocation(rsc, data, dataSize);
     }
     stream->reset(stream->getPos() + dataSize);
 
@@ -401,12 +862,16 @@ Allocation *Allocation::createFromStream(Context *rsc, IStream *stream) {
 }
 
 void Allocation::sendDirty(const Context *rsc) const {
+    sendDirtyToPrograms();
+    mRSC->mHal.funcs.allocation.markDirty(rsc, this);
+}
+
+void Allocation::sendDirtyToPrograms() const {
 #ifndef RS_COMPATIBILITY_LIB
     for (size_t ct=0; ct < mToDirtyList.size(); ct++) {
         mToDirtyList[ct]->forceDirty();
     }
 #endif
-    mRSC->mHal.funcs.allocation.markDirty(rsc, this);
 }
 
 void Allocation::incRefs(const void *ptr, size_t ct, size_t startOff) const {
@@ -443,6 +908,10 @@ void Allocation::resize1D(Context *rsc, uint32_t dimX) {
     if (dimX == oldDimX) {
         return;
     }
+    if (isAdapter() || mAdapterCount || hasFieldPlanes() || mClientMapped) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can't resize adapters, allocations being adapted or mapped, or field planes.");
+        return;
+    }
 
     ObjectBaseRef<Type> t = mHal.state.type->cloneAndResize1D(rsc, dimX);
     if (dimX < oldDimX) {
@@ -454,6 +923,169 @@ void Allocation::resize1D(Context *rsc, uint32_t dimX) {
     updateCache();
 }
 
+void Allocation::reserve1D(Context *rsc, uint32_t dimX) {
+    if (mHal.state.type->getDimY() || mHal.state.type->getDimZ()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can only reserve space for 1D allocations.");
+        return;
+    }
+    if (isAdapter() || mAdapterCount || hasFieldPlanes() || mClientMapped) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can't reserve space in adapters, allocations being adapted or mapped, or field planes.");
+        return;
+    }
+    if (rsc->mHal.funcs.allocation.reserve) {
+        rsc->mHal.funcs.allocation.reserve(rsc, this, dimX);
+    }
+}
+
+static bool is1D(const Type *t) {
+    return !t->getDimY() && !t->getDimZ() && !t->getDimLOD() && !t->getDimFaces();
+}
+
+void Allocation::sort(Context *rsc, Allocation *values) {
+    const Element *e = mHal.state.type->getElement();
+    if (!is1D(mHal.state.type)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can only sort 1D allocations.");
+        return;
+    }
+    bool keyType = false;
+    switch (e->getType()) {
+    case RS_TYPE_FLOAT_32:
+    case RS_TYPE_FLOAT_64:
+    case RS_TYPE_SIGNED_32:
+    case RS_TYPE_SIGNED_64:
+    case RS_TYPE_UNSIGNED_32:
+    case RS_TYPE_UNSIGNED_64:
+        keyType = e->getVectorSize() == 1;
+        break;
+    default:
+        break;
+    }
+    if (!keyType) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Sort keys must be 32 or 64 bit scalars.");
+        return;
+    }
+    if (values && ((values == this) || !is1D(values->mHal.state.type) ||
+                   (values->mHal.state.type->getDimX() != mHal.state.type->getDimX()))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Sort values must be a 1D allocation the size of its keys.");
+        return;
+    }
+    if (!rsc->mHal.funcs.allocation.sort) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Sorting isn't supported by this driver.");
+        return;
+    }
+    if (!rsc->mHal.funcs.allocation.sort(rsc, this, values)) {
+        rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Out of memory for sort.");
+        return;
+    }
+    sendDirty(rsc);
+    if (values) {
+        values->sendDirty(rsc);
+    }
+}
+
+uint32_t Allocation::compact(Context *rsc, const Allocation *src, const Allocation *flags) {
+    if (!is1D(mHal.state.type) || !is1D(src->mHal.state.type) || !is1D(flags->mHal.state.type)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can only compact 1D allocations.");
+        return 0;
+    }
+    if (flags == this) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Compaction can't overwrite its flags.");
+        return 0;
+    }
+    if (src->mHal.state.elementSizeBytes != mHal.state.elementSizeBytes) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Compaction source and destination cells differ.");
+        return 0;
+    }
+    const size_t flagSize = flags->mHal.state.elementSizeBytes;
+    if ((flags->mHal.state.type->getDimX() != src->mHal.state.type->getDimX()) ||
+        (flags->mHal.state.type->getElement()->getVectorSize() != 1) ||
+        ((flagSize != 1) && (flagSize != 2) && (flagSize != 4))) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Compaction flags must be 8, 16 or 32 bit scalars, one per source cell.");
+        return 0;
+    }
+    if (!rsc->mHal.funcs.allocation.compact) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Compaction isn't supported by this driver.");
+        return 0;
+    }
+    uint32_t count = rsc->mHal.funcs.allocation.compact(rsc, this, src, flags);
+    sendDirty(rsc);
+    return count;
+}
+
+static bool isConvertibleType(RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_FLOAT_16:
+    case RS_TYPE_FLOAT_32:
+    case RS_TYPE_FLOAT_64:
+    case RS_TYPE_SIGNED_8:
+    case RS_TYPE_SIGNED_16:
+    case RS_TYPE_SIGNED_32:
+    case RS_TYPE_UNSIGNED_8:
+    case RS_TYPE_UNSIGNED_16:
+    case RS_TYPE_UNSIGNED_32:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool rangeInside(const Allocation *a, uint32_t x, uint32_t y, uint32_t z, uint32_t lod,
+                        RsAllocationCubemapFace face, uint32_t w, uint32_t h, uint32_t d) {
+    const Allocation::Hal::DrvState &s = a->mHal.drvState;
+    if ((lod >= rsMax(s.lodCount, 1u)) || ((uint32_t)face >= rsMax(s.faceCount, 1u))) {
+        return false;
+    }
+    return ((uint64_t)x + w <= rsMax(s.lod[lod].dimX, 1u)) &&
+           ((uint64_t)y + h <= rsMax(s.lod[lod].dimY, 1u)) &&
+           ((uint64_t)z + d <= rsMax(s.lod[lod].dimZ, 1u));
+}
+
+void Allocation::copyConvert(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                             uint32_t lod, RsAllocationCubemapFace face,
+                             uint32_t w, uint32_t h, uint32_t d,
+                             const Allocation *src, uint32_t srcXoff, uint32_t srcYoff,
+                             uint32_t srcZoff, uint32_t srcLod, RsAllocationCubemapFace srcFace,
+                             RsAllocationConversion conversion) {
+    if (!getIsScript() || !src->getIsScript() || hasFieldPlanes() || src->hasFieldPlanes() ||
+        hasTiles() || src->hasTiles()) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Converting copies need script allocations without field planes or tiles.");
+        return;
+    }
+    if (src == this) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can't convert an allocation in place.");
+        return;
+    }
+    const Element *e = mHal.state.type->getElement();
+    const Element *srcE = src->mHal.state.type->getElement();
+    if (e->getFieldCount() || srcE->getFieldCount() ||
+        (e->getVectorSize() != srcE->getVectorSize()) ||
+        !isConvertibleType(e->getType()) || !isConvertibleType(srcE->getType())) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Can only convert between float and 8 to 32 bit integer vectors "
+                      "of the same size.");
+        return;
+    }
+    if ((uint32_t)conversion > RS_ALLOCATION_CONVERSION_NORMALIZE) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Unknown allocation conversion.");
+        return;
+    }
+    if (!w || !h || !d || !rangeInside(this, xoff, yoff, zoff, lod, face, w, h, d) ||
+        !rangeInside(src, srcXoff, srcYoff, srcZoff, srcLod, srcFace, w, h, d)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Converting copy out of range.");
+        return;
+    }
+    if (!rsc->mHal.funcs.allocation.allocConvert) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Converting copies aren't supported by this driver.");
+        return;
+    }
+    rsc->mHal.funcs.allocation.allocConvert(rsc, this, xoff, yoff, zoff, lod, face, w, h, d,
+                                            src, srcXoff, srcYoff, srcZoff, srcLod, srcFace,
+                                            conversion);
+    sendDirty(rsc);
+}
+
 void Allocation::resize2D(Context *rsc, uint32_t dimX, uint32_t dimY) {
     ALOGE("not implemented");
 }
@@ -469,7 +1101,7 @@ void * Allocation::getSurface(const Context *rsc) {
 #ifndef RS_COMPATIBILITY_LIB
     // Configure GrallocConsumer to be in asynchronous mode
     sp<BufferQueue> bq = new BufferQueue();
-    mGrallocConsumer = new GrallocConsumer(this, bq);
+    mGrallocConsumer = new GrallocConsumer(this, bq, mIoQueueDepth);
     sp<IGraphicBufferProducer> bp = bq;
     bp->incStrong(NULL);
 
@@ -490,6 +1122,26 @@ void Allocation::setSurface(const Context *rsc, RsNativeWindow sur) {
     rsc->mHal.funcs.allocation.setSurface(rsc, this, nw);
 }
 
+void Allocation::setIoInputQueue(const Context *rsc, uint32_t depth, bool latest) {
+#ifndef RS_COMPATIBILITY_LIB
+    if (!(mHal.state.usageFlags & RS_ALLOCATION_USAGE_IO_INPUT)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Allocation has no IO input usage.");
+        return;
+    }
+    if (mGrallocConsumer.get() && (depth != mIoQueueDepth)) {
+        // The BufferQueue fixes its acquire limit once a producer connects.
+        rsc->setError(RS_ERROR_BAD_VALUE, "IO input queue depth must be set before getSurface.");
+        return;
+    }
+    if (depth < 1 || depth > GrallocConsumer::MAX_QUEUE_DEPTH) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Invalid IO input queue depth.");
+        return;
+    }
+    mIoQueueDepth = depth;
+    mIoSkipToLatest = latest;
+#endif
+}
+
 void Allocation::ioSend(const Context *rsc) {
     rsc->mHal.funcs.allocation.ioSend(rsc, this);
 }
@@ -499,7 +1151,7 @@ void Allocation::ioReceive(const Context *rsc) {
     size_t stride = 0;
 #ifndef RS_COMPATIBILITY_LIB
     if (mHal.state.usageFlags & RS_ALLOCATION_USAGE_SCRIPT) {
-        status_t ret = mGrallocConsumer->lockNextBuffer();
+        status_t ret = mGrallocConsumer->lockNextBuffer(mIoSkipToLatest);
 
         if (ret == OK) {
             rsc->mHal.funcs.allocation.ioReceive(rsc, this);
@@ -522,7 +1174,16 @@ namespace renderscript {
 
 void rsi_AllocationSyncAll(Context *rsc, RsAllocation va, RsAllocationUsageType src) {
     Allocation *a = static_cast<Allocation *>(va);
-    a->sendDirty(rsc);
+    // Other writes from the client came through data commands, which
+    // marked what they wrote, so the sync can skip what is current.  Only
+    // memory the client or other contexts map themselves can't be known.
+    if ((src != RS_ALLOCATION_USAGE_SCRIPT) || a->mHal.state.userProvidedPtr ||
+        (a->mHal.state.usageFlags & RS_ALLOCATION_USAGE_SHARED) ||
+        (a->mHal.state.sharedFd >= 0) || a->mHal.drvState.fileBacked || a->isClientMapped()) {
+        a->sendDirty(rsc);
+    } else {
+        a->sendDirtyToPrograms();
+    }
     a->syncAll(rsc, src);
 }
 
@@ -556,6 +1217,12 @@ void rsi_Allocation1DElementData(Context *rsc, RsAllocation va, uint32_t x, uint
     a->elementData(rsc, x, data, eoff, sizeBytes);
 }
 
+void rsi_AllocationElementDataBatch(Context *rsc, RsAllocation va,
+                                    const void *records, size_t sizeBytes) {
+    Allocation *a = static_cast<Allocation *>(va);
+    a->elementDataBatch(rsc, records, sizeBytes);
+}
+
 void rsi_Allocation2DData(Context *rsc, RsAllocation va, uint32_t xoff, uint32_t yoff, uint32_t lod, RsAllocationCubemapFace face,
                           uint32_t w, uint32_t h, const void *data, size_t sizeBytes, size_t stride) {
     Allocation *a = static_cast<Allocation *>(va);
@@ -586,6 +1253,23 @@ void rsi_AllocationResize1D(Context *rsc, RsAllocation va, uint32_t dimX) {
     a->resize1D(rsc, dimX);
 }
 
+void rsi_AllocationReserve1D(Context *rsc, RsAllocation va, uint32_t dimX) {
+    Allocation *a = static_cast<Allocation *>(va);
+    a->reserve1D(rsc, dimX);
+}
+
+void rsi_AllocationSort(Context *rsc, RsAllocation keys, RsAllocation values) {
+    Allocation *a = static_cast<Allocation *>(keys);
+    a->sort(rsc, static_cast<Allocation *>(values));
+}
+
+uint32_t rsi_AllocationCompact(Context *rsc, RsAllocation dst, RsAllocation src,
+                               RsAllocation flags) {
+    Allocation *a = static_cast<Allocation *>(dst);
+    return a->compact(rsc, static_cast<const Allocation *>(src),
+                      static_cast<const Allocation *>(flags));
+}
+
 void rsi_AllocationResize2D(Context *rsc, RsAllocation va, uint32_t dimX, uint32_t dimY) {
     Allocation *a = static_cast<Allocation *>(va);
     a->resize2D(rsc, dimX, dimY);
@@ -602,6 +1286,48 @@ RsAllocation rsi_AllocationCreateTyped(Context *rsc, RsType vtype,
     return alloc;
 }
 
+RsAllocation rsi_AllocationAdapterCreate(Context *rsc, RsType vtype, RsAllocation baseAlloc) {
+    Allocation * alloc = Allocation::createAdapter(rsc, static_cast<Allocation *>(baseAlloc),
+                                                   static_cast<Type *>(vtype));
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
+RsAllocation rsi_AllocationImport(Context *rsc, RsType vtype, uint32_t usages, int32_t fd) {
+    Allocation * alloc = Allocation::createFromShared(rsc, static_cast<Type *>(vtype), usages, fd);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
+int32_t rsi_AllocationExport(Context *rsc, RsAllocation va) {
+    Allocation *a = static_cast<Allocation *>(va);
+    return a->exportShared(rsc);
+}
+
+void * rsi_AllocationGetPointer(Context *rsc, RsAllocation va, uint32_t lod,
+                                RsAllocationCubemapFace face, uint32_t z, size_t *stride,
+                                size_t strideLen) {
+    Allocation *a = static_cast<Allocation *>(va);
+    if (strideLen != sizeof(size_t)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Allocation stride must be a size_t.");
+        return NULL;
+    }
+    return a->getPointer(rsc, lod, face, z, stride);
+}
+
+void rsi_AllocationAdapterOffset(Context *rsc, RsAllocation va, const uint32_t *offsets,
+                                 size_t len) {
+    Allocation *a = static_cast<Allocation *>(va);
+    // The spec passes the size of the array in bytes.
+    a->adapterOffset(rsc, offsets, len / sizeof(uint32_t));
+}
+
 RsAllocation rsi_AllocationCreateFromBitmap(Context *rsc, RsType vtype,
                                             RsAllocationMipmapControl mips,
                                             const void *data, size_t sizeBytes, uint32_t usages) {
@@ -672,11 +1398,16 @@ void rsi_AllocationCopy2DRange(Context *rsc,
                                uint32_t srcMip, uint32_t srcFace) {
     Allocation *dst = static_cast<Allocation *>(dstAlloc);
     Allocation *src= static_cast<Allocation *>(srcAlloc);
+    if (dst->hasFieldPlanes() || src->hasFieldPlanes() || dst->hasTiles() || src->hasTiles()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can't copy ranges of field planes or tiles.");
+        return;
+    }
     rsc->mHal.funcs.allocation.allocData2D(rsc, dst, dstXoff, dstYoff, dstMip,
                                            (RsAllocationCubemapFace)dstFace,
                                            width, height,
                                            src, srcXoff, srcYoff,srcMip,
                                            (RsAllocationCubemapFace)srcFace);
+    dst->sendDirty(rsc);
 }
 
 void rsi_AllocationCopy3DRange(Context *rsc,
@@ -689,11 +1420,31 @@ void rsi_AllocationCopy3DRange(Context *rsc,
                                uint32_t srcMip) {
     Allocation *dst = static_cast<Allocation *>(dstAlloc);
     Allocation *src= static_cast<Allocation *>(srcAlloc);
+    if (dst->hasFieldPlanes() || src->hasFieldPlanes() || dst->hasTiles() || src->hasTiles()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Can't copy ranges of field planes or tiles.");
+        return;
+    }
     rsc->mHal.funcs.allocation.allocData3D(rsc, dst, dstXoff, dstYoff, dstZoff, dstMip,
                                            width, height, depth,
                                            src, srcXoff, srcYoff, srcZoff, srcMip);
+    dst->sendDirty(rsc);
 }
 
+void rsi_AllocationCopyConvert(Context *rsc,
+                               RsAllocation dstAlloc,
+                               uint32_t dstXoff, uint32_t dstYoff, uint32_t dstZoff,
+                               uint32_t dstMip, uint32_t dstFace,
+                               uint32_t width, uint32_t height, uint32_t depth,
+                               RsAllocation srcAlloc,
+                               uint32_t srcXoff, uint32_t srcYoff, uint32_t srcZoff,
+                               uint32_t srcMip, uint32_t srcFace,
+                               RsAllocationConversion conversion) {
+    Allocation *dst = static_cast<Allocation *>(dstAlloc);
+    dst->copyConvert(rsc, dstXoff, dstYoff, dstZoff, dstMip, (RsAllocationCubemapFace)dstFace,
+                     width, height, depth, static_cast<const Allocation *>(srcAlloc),
+                     srcXoff, srcYoff, srcZoff, srcMip, (RsAllocationCubemapFace)srcFace,
+                     conversion);
+}
 
 void * rsi_AllocationGetSurface(Context *rsc, RsAllocation valloc) {
     Allocation *alloc = static_cast<Allocation *>(valloc);
@@ -716,6 +1467,12 @@ void rsi_AllocationIoReceive(Context *rsc, RsAllocation valloc) {
     alloc->ioReceive(rsc);
 }
 
+void rsi_AllocationSetIoInputQueue(Context *rsc, RsAllocation valloc, uint32_t depth,
+                                   bool latest) {
+    Allocation *alloc = static_cast<Allocation *>(valloc);
+    alloc->setIoInputQueue(rsc, depth, latest);
+}
+
 void rsi_Allocation1DRead(Context *rsc, RsAllocation va, uint32_t xoff, uint32_t lod,
                           uint32_t count, void *data, size_t sizeBytes) {
     Allocation *a = static_cast<Allocation *>(va);
@@ -729,6 +1486,19 @@ void rsi_Allocation2DRead(Context *rsc, RsAllocation va, uint32_t xoff, uint32_t
     a->read(rsc, xoff, yoff, lod, face, w, h, data, sizeBytes, stride);
 }
 
+// The async reads take the destination as an integer so the client isn't
+// held until the command runs; it must keep the memory until a later fence.
+void rsi_Allocation1DReadAsync(Context *rsc, RsAllocation va, uint32_t xoff, uint32_t lod,
+                               uint32_t count, uintptr_t data, size_t sizeBytes) {
+    rsi_Allocation1DRead(rsc, va, xoff, lod, count, (void *)data, sizeBytes);
+}
+
+void rsi_Allocation2DReadAsync(Context *rsc, RsAllocation va, uint32_t xoff, uint32_t yoff,
+                               uint32_t lod, RsAllocationCubemapFace face, uint32_t w,
+                               uint32_t h, uintptr_t data, size_t sizeBytes, size_t stride) {
+    rsi_Allocation2DRead(rsc, va, xoff, yoff, lod, face, w, h, (void *)data, sizeBytes, stride);
+}
+
 }
 }
 
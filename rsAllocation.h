@@ -69,6 +69,21 @@ public:
             int32_t surfaceTextureID;
             ANativeWindowBuffer *nativeBuffer;
             int64_t timestamp;
+
+            // For adapters, the allocation whose memory they view and
+            // the cell of it the view starts at.
+            const Allocation *baseAlloc;
+            uint32_t originX;
+            uint32_t originY;
+            uint32_t originZ;
+            uint32_t originLOD;
+            RsAllocationCubemapFace originFace;
+            // The plane viewed when the base has USAGE_FIELD_PLANES.
+            uint32_t originField;
+
+            // Memory exported by another context for this allocation to
+            // map instead of allocating its own, or -1.
+            int sharedFd;
         };
         State state;
 
@@ -88,6 +103,26 @@ public:
                 uint32_t shift;
                 uint32_t step;
             } yuv;
+
+            // Bumped by every write the driver is told about, so anything
+            // built from the contents can tell when to rebuild.
+            uint32_t contentVersion;
+
+            // The memory is a shared mapping of a file.  Its pages can be
+            // dropped from memory at any time, which launches do behind
+            // them to keep large files from becoming resident.
+            bool fileBacked;
+
+            // For USAGE_TILED, cells are stored in tiles of 1 << shift cells
+            // along each dimension, the tiles and the cells inside each in
+            // row order.  lod[0].stride is then the size of a row of tiles.
+            // The shifts are 0 for other allocations.
+            struct TileState {
+                uint32_t shiftX;
+                uint32_t shiftY;
+                uint32_t shiftZ;
+                uint32_t tilesY;
+            } tile;
         };
         mutable DrvState drvState;
 
@@ -99,9 +134,52 @@ public:
     static Allocation * createAllocation(Context *rsc, const Type *, uint32_t usages,
                                          RsAllocationMipmapControl mc = RS_ALLOCATION_MIPMAP_NONE,
                                          void *ptr = 0);
+    // Creates a view of type's dimensions onto the memory of base, starting
+    // at its first cell until adapterOffset() moves it.
+    static Allocation * createAdapter(Context *rsc, const Allocation *base, const Type *type);
+    // Creates a USAGE_SHARED allocation on the memory another context
+    // exported through fd, which stays owned by the caller.
+    static Allocation * createFromShared(Context *rsc, const Type *type, uint32_t usages, int fd);
     virtual ~Allocation();
     void updateCache();
 
+    // Moves an adapter to start at offsets, packed as x, y, z, lod, face,
+    // field; entries past count are 0 except the field, which is kept.
+    void adapterOffset(Context *rsc, const uint32_t *offsets, size_t count);
+    bool isAdapter() const {return mHal.state.baseAlloc != NULL;}
+    bool hasFieldPlanes() const {
+        return (mHal.state.usageFlags & RS_ALLOCATION_USAGE_FIELD_PLANES) != 0;
+    }
+    bool hasTiles() const {
+        return (mHal.state.usageFlags & RS_ALLOCATION_USAGE_TILED) != 0;
+    }
+    // Offset of cell (x, y, z) of lod 0 from its mallocPtr.
+    size_t getCellOffset(uint32_t x, uint32_t y, uint32_t z) const {
+        const Hal::DrvState &d = mHal.drvState;
+        const size_t eSize = mHal.state.elementSizeBytes;
+        if (!d.tile.shiftX) {
+            return ((size_t)z * d.lod[0].dimY + y) * d.lod[0].stride + x * eSize;
+        }
+        const uint32_t sx = d.tile.shiftX;
+        const uint32_t sy = d.tile.shiftY;
+        const uint32_t sz = d.tile.shiftZ;
+        const size_t tile = ((size_t)(z >> sz) * d.tile.tilesY + (y >> sy)) * d.lod[0].stride +
+                            (size_t)(x >> sx) * (eSize << (sx + sy + sz));
+        const uint32_t cell = ((((z & ((1u << sz) - 1)) << sy) | (y & ((1u << sy) - 1))) << sx) |
+                              (x & ((1u << sx) - 1));
+        return tile + cell * eSize;
+    }
+    // Returns a new descriptor for the memory of a USAGE_SHARED allocation,
+    // to be imported by createFromShared, or -1.
+    int exportShared(Context *rsc) const;
+    // Returns the memory of z slice of face of lod for the client to access
+    // directly, with its row stride, once launches still running have
+    // finished.  NULL for allocations whose memory or layout may change
+    // under the client.  Mapped allocations can't be resized.
+    void * getPointer(Context *rsc, uint32_t lod, RsAllocationCubemapFace face, uint32_t z,
+                      size_t *stride);
+    bool isClientMapped() const {return mClientMapped;}
+
     const Type * getType() const {return mHal.state.type;}
 
     void syncAll(Context *rsc, RsAllocationUsageType src);
@@ -109,6 +187,22 @@ public:
     void copyRange1D(Context *rsc, const Allocation *src, int32_t srcOff, int32_t destOff, int32_t len);
 
     void resize1D(Context *rsc, uint32_t dimX);
+    // Sets the capacity kept for later resize1D calls to at least dimX
+    // cells; a dimX at or below the current size trims it to fit.
+    void reserve1D(Context *rsc, uint32_t dimX);
+    // Sorts the 32 or 64 bit scalars of a 1D allocation ascending, stably,
+    // moving the cells of values, if given, along with their keys.
+    void sort(Context *rsc, Allocation *values);
+    // Copies the cells of src whose flag is nonzero, in order, to the start
+    // of this allocation and returns how many were copied.
+    uint32_t compact(Context *rsc, const Allocation *src, const Allocation *flags);
+    // Copies a w x h x d range of src, whose elements may differ from ours
+    // in component type but not vector size, converting each component.
+    void copyConvert(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t zoff, uint32_t lod,
+                     RsAllocationCubemapFace face, uint32_t w, uint32_t h, uint32_t d,
+                     const Allocation *src, uint32_t srcXoff, uint32_t srcYoff,
+                     uint32_t srcZoff, uint32_t srcLod, RsAllocationCubemapFace srcFace,
+                     RsAllocationConversion conversion);
     void resize2D(Context *rsc, uint32_t dimX, uint32_t dimY);
 
     void data(Context *rsc, uint32_t xoff, uint32_t lod, uint32_t count, const void *data, size_t sizeBytes);
@@ -125,6 +219,8 @@ public:
 
     void elementData(Context *rsc, uint32_t x,
                      const void *data, uint32_t elementOff, size_t sizeBytes);
+    // Applies a packed list of RsElementDataRecord field updates at once.
+    void elementDataBatch(Context *rsc, const void *records, size_t sizeBytes);
     void elementData(Context *rsc, uint32_t x, uint32_t y,
                      const void *data, uint32_t elementOff, size_t sizeBytes);
 
@@ -154,6 +250,9 @@ public:
     virtual bool freeChildren();
 
     void sendDirty(const Context *rsc) const;
+    // Only tells the programs using this allocation that it changed; for
+    // writes the driver already knows about.
+    void sendDirtyToPrograms() const;
     bool getHasGraphicsMipmaps() const {
         return mHal.state.mipmapControl != RS_ALLOCATION_MIPMAP_NONE;
     }
@@ -162,10 +261,21 @@ public:
     void setSurface(const Context *rsc, RsNativeWindow sur);
     void ioSend(const Context *rsc);
     void ioReceive(const Context *rsc);
+    // How many USAGE_IO_INPUT frames may wait behind the one being
+    // processed, and whether ioReceive skips straight to the newest.
+    void setIoInputQueue(const Context *rsc, uint32_t depth, bool latest);
 
 protected:
     Vector<const Program *> mToDirtyList;
     ObjectBaseRef<const Type> mType;
+    // Owner of the memory a user-provided pointer points into, if any.
+    ObjectBaseRef<const ObjectBase> mBacking;
+    // Keeps the base of an adapter alive, and counts the adapters of a base,
+    // which must not move its memory while they exist.
+    ObjectBaseRef<const Allocation> mBaseAlloc;
+    mutable uint32_t mAdapterCount;
+    // Set once getPointer() has handed the memory to the client.
+    bool mClientMapped;
     void setType(const Type *t) {
         mType.set(t);
         mHal.state.type = t;
@@ -182,6 +292,8 @@ protected:
 
     sp<NewBufferListener> mBufferListener;
     sp< GrallocConsumer > mGrallocConsumer;
+    uint32_t mIoQueueDepth;
+    bool mIoSkipToLatest;
 #endif
 
 
@@ -17,6 +17,15 @@
 #include "rsContext.h"
 #include "rsAnimation.h"
 
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 
 using namespace android;
 using namespace android::renderscript;
@@ -28,27 +37,29 @@ Animation *Animation::createFromStream(Context *rsc, IStream *stream) {
     return NULL;
 }
 
-/*
-Animation::Animation(Context *rsc) : ObjectBase(rsc)
-{
-    mAllocFile = __FILE__;
-    mAllocLine = __LINE__;
-
+Animation::Animation(Context *rsc) : ObjectBase(rsc) {
     mValuesInput = NULL;
     mValuesOutput = NULL;
+    mSlopes = NULL;
     mValueCount = 0;
     mInterpolation = RS_ANIMATION_INTERPOLATION_STEP;
     mEdgePre = RS_ANIMATION_EDGE_UNDEFINED;
     mEdgePost = RS_ANIMATION_EDGE_UNDEFINED;
     mInputMin = 0;
     mInputMax = 0;
+    mCursor = 0;
+}
+
+Animation::~Animation() {
+    free(mValuesInput);
+    free(mValuesOutput);
+    free(mSlopes);
 }
 
 Animation * Animation::create(Context *rsc,
                               const float *inValues, const float *outValues,
                               uint32_t valueCount, RsAnimationInterpolation interp,
-                              RsAnimationEdge pre, RsAnimationEdge post)
-{
+                              RsAnimationEdge pre, RsAnimationEdge post) {
     if (valueCount < 2) {
         rsc->setError(RS_ERROR_BAD_VALUE, "Animations require more than 2 values.");
         return NULL;
@@ -63,7 +74,8 @@ Animation * Animation::create(Context *rsc,
     float *vout = (float *)malloc(valueCount * sizeof(float));
     a->mValuesInput = vin;
     a->mValuesOutput = vout;
-    if (a->mValuesInput == NULL || a->mValuesOutput == NULL) {
+    a->mSlopes = (float *)malloc((valueCount - 1) * sizeof(float));
+    if (a->mValuesInput == NULL || a->mValuesOutput == NULL || a->mSlopes == NULL) {
         delete a;
         rsc->setError(RS_ERROR_OUT_OF_MEMORY);
         return NULL;
@@ -81,18 +93,18 @@ Animation * Animation::create(Context *rsc,
 
     bool needSort = false;
     for (uint32_t ct=1; ct < valueCount; ct++) {
-        if (a->mInputMin > vin[ct]) {
+        if (vin[ct - 1] > vin[ct]) {
             needSort = true;
+        }
+        if (a->mInputMin > vin[ct]) {
             a->mInputMin = vin[ct];
         }
         if (a->mInputMax < vin[ct]) {
             a->mInputMax = vin[ct];
-        } else {
-            needSort = true;
         }
     }
 
-    while (1) {
+    while (needSort) {
         bool changed = false;
         for (uint32_t ct=1; ct < valueCount; ct++) {
             if (vin[ct-1] > vin[ct]) {
@@ -108,9 +120,174 @@ Animation * Animation::create(Context *rsc,
         if (!changed) break;
     }
 
+    for (uint32_t ct=0; ct < valueCount - 1; ct++) {
+        float dt = vin[ct + 1] - vin[ct];
+        a->mSlopes[ct] = (dt > 0.f) ? (vout[ct + 1] - vout[ct]) / dt : 0.f;
+    }
     return a;
 }
-*/
+
+uint32_t Animation::findKey(float t) const {
+    const float *in = mValuesInput;
+    const uint32_t last = mValueCount - 2;
+
+    uint32_t key = mCursor;
+    if ((key <= last) && (in[key] <= t)) {
+        if ((key == last) || (t < in[key + 1])) {
+            return key;
+        }
+        // Time moving forward mostly lands in the next interval.
+        if ((key + 1 == last) || (t < in[key + 2])) {
+            mCursor = key + 1;
+            return key + 1;
+        }
+    }
+
+    // Last key at or below t.
+    uint32_t lo = 0;
+    uint32_t hi = last;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) >> 1;
+        if (in[mid] <= t) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    mCursor = lo;
+    return lo;
+}
+
+void Animation::evalInRange(float t, float offset, Term *term) const {
+    uint32_t key = findKey(t);
+    term->t = t;
+    term->t0 = mValuesInput[key];
+    term->base = mValuesOutput[key] + offset;
+
+    if (mInterpolation == RS_ANIMATION_INTERPOLATION_STEP) {
+        if (t >= mInputMax) {
+            term->base = mValuesOutput[mValueCount - 1] + offset;
+        }
+        term->slope = 0.f;
+    } else {
+        // The curved modes have no tangents to work from yet, so they
+        // are evaluated as linear.
+        term->slope = mSlopes[key];
+    }
+}
+
+void Animation::evalTerm(float t, Term *term) const {
+    const uint32_t last = mValueCount - 1;
+    const bool pre = t < mInputMin;
+    if (!pre && !(t > mInputMax)) {
+        evalInRange(t, 0.f, term);
+        return;
+    }
+
+    const float range = mInputMax - mInputMin;
+    RsAnimationEdge edge = pre ? mEdgePre : mEdgePost;
+    if (!(range > 0.f)) {
+        edge = RS_ANIMATION_EDGE_CONSTANT;
+    }
+
+    switch (edge) {
+    case RS_ANIMATION_EDGE_GRADIENT:
+        term->t = t;
+        if (pre) {
+            term->t0 = mInputMin;
+            term->base = mValuesOutput[0];
+            term->slope = mSlopes[0];
+        } else {
+            term->t0 = mInputMax;
+            term->base = mValuesOutput[last];
+            term->slope = mSlopes[last - 1];
+        }
+        return;
+    case RS_ANIMATION_EDGE_CYCLE:
+    case RS_ANIMATION_EDGE_CYLE_RELATIVE: {
+        float cycles = floorf((t - mInputMin) / range);
+        float wrapped = rsMax(rsMin(t - cycles * range, mInputMax), mInputMin);
+        float offset = 0.f;
+        if (edge == RS_ANIMATION_EDGE_CYLE_RELATIVE) {
+            offset = cycles * (mValuesOutput[last] - mValuesOutput[0]);
+        }
+        evalInRange(wrapped, offset, term);
+        return;
+    }
+    case RS_ANIMATION_EDGE_OSCILLATE: {
+        float p = fmodf(t - mInputMin, 2.f * range);
+        if (p < 0.f) {
+            p += 2.f * range;
+        }
+        if (p > range) {
+            p = 2.f * range - p;
+        }
+        evalInRange(mInputMin + p, 0.f, term);
+        return;
+    }
+    default:
+        // Undefined edges hold the end value like constant ones.
+        term->t = t;
+        term->t0 = t;
+        term->base = pre ? mValuesOutput[0] : mValuesOutput[last];
+        term->slope = 0.f;
+        return;
+    }
+}
+
+void Animation::combineTerms(const Term *terms, float *out, uint32_t count) {
+    uint32_t i = 0;
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        float32x4x4_t v = vld4q_f32(&terms[i].t);
+        vst1q_f32(out + i, vmlaq_f32(v.val[2], vsubq_f32(v.val[0], v.val[1]), v.val[3]));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 t = _mm_loadu_ps(&terms[i].t);
+        __m128 t0 = _mm_loadu_ps(&terms[i + 1].t);
+        __m128 base = _mm_loadu_ps(&terms[i + 2].t);
+        __m128 slope = _mm_loadu_ps(&terms[i + 3].t);
+        _MM_TRANSPOSE4_PS(t, t0, base, slope);
+        _mm_storeu_ps(out + i, _mm_add_ps(base, _mm_mul_ps(_mm_sub_ps(t, t0), slope)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = terms[i].base + (terms[i].t - terms[i].t0) * terms[i].slope;
+    }
+}
+
+float Animation::eval(float t) const {
+    Term term;
+    evalTerm(t, &term);
+    return term.base + (term.t - term.t0) * term.slope;
+}
+
+// Terms gathered before each vector pass of a batch.
+static const uint32_t kAnimationBatch = 64;
+
+void Animation::evalMany(const float *t, float *out, uint32_t count) const {
+    Term terms[kAnimationBatch];
+    for (uint32_t i = 0; i < count; i += kAnimationBatch) {
+        uint32_t n = rsMin(count - i, kAnimationBatch);
+        for (uint32_t ct = 0; ct < n; ct++) {
+            evalTerm(t[i + ct], &terms[ct]);
+        }
+        combineTerms(terms, out + i, n);
+    }
+}
+
+void Animation::evalBatch(const Animation * const *anims, uint32_t count,
+                          float t, float *out) {
+    Term terms[kAnimationBatch];
+    for (uint32_t i = 0; i < count; i += kAnimationBatch) {
+        uint32_t n = rsMin(count - i, kAnimationBatch);
+        for (uint32_t ct = 0; ct < n; ct++) {
+            anims[i + ct]->evalTerm(t, &terms[ct]);
+        }
+        combineTerms(terms, out + i, n);
+    }
+}
 
 
 /////////////////////////////////////////
@@ -119,21 +296,87 @@ Animation * Animation::create(Context *rsc,
 namespace android {
 namespace renderscript {
 
+// Float outputs for count cells, or NULL after raising an error.
+static Allocation * getFloatOutput(Context *rsc, RsAllocation va, uint32_t count) {
+    Allocation *a = static_cast<Allocation *>(va);
+    if (a == NULL) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Animation outputs need an allocation.");
+        return NULL;
+    }
+    const Element *e = a->getType()->getElement();
+    if ((e->getType() != RS_TYPE_FLOAT_32) || (e->getVectorSize() != 1) ||
+        (a->getType()->getDimX() < count)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Animation outputs must be count floats.");
+        return NULL;
+    }
+    return a;
+}
+
 RsAnimation rsi_AnimationCreate(Context *rsc,
-                                const float *inValues,
-                                const float *outValues,
-                                uint32_t valueCount,
+                                const float *inValues, size_t inLength,
+                                const float *outValues, size_t outLength,
                                 RsAnimationInterpolation interp,
                                 RsAnimationEdge pre,
                                 RsAnimationEdge post) {
-    //ALOGE("rsi_ElementCreate %i %i %i %i", dt, dk, norm, vecSize);
-    Animation *a = NULL;//Animation::create(rsc, inValues, outValues, valueCount, interp, pre, post);
+    if (inLength != outLength) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Animation keys need one output per input.");
+        return NULL;
+    }
+    Animation *a = Animation::create(rsc, inValues, outValues, inLength / sizeof(float),
+                                     interp, pre, post);
     if (a != NULL) {
         a->incUserRef();
     }
     return (RsAnimation)a;
 }
 
+void rsi_AnimationEvaluate(Context *rsc, RsAnimation *vanims, size_t animsLength,
+                           float time, RsAllocation vout) {
+    // The spec passes the size of the array in bytes.
+    const uint32_t count = animsLength / sizeof(RsAnimation);
+    Allocation *out = getFloatOutput(rsc, vout, count);
+    if (out == NULL || count == 0) {
+        return;
+    }
+    float *values = (float *)malloc(count * sizeof(float));
+    if (values == NULL) {
+        rsc->setError(RS_ERROR_OUT_OF_MEMORY);
+        return;
+    }
+    Animation::evalBatch((const Animation * const *)vanims, count, time, values);
+    out->data(rsc, 0, 0, count, values, count * sizeof(float));
+    free(values);
+}
+
+void rsi_AnimationEvaluateTimes(Context *rsc, RsAnimation va, RsAllocation vtimes,
+                                RsAllocation vout) {
+    const Animation *anim = static_cast<const Animation *>(va);
+    const Allocation *times = static_cast<const Allocation *>(vtimes);
+    if (times == NULL) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Animation times need an allocation.");
+        return;
+    }
+    const Element *e = times->getType()->getElement();
+    const float *t = (const float *)times->mHal.drvState.lod[0].mallocPtr;
+    if ((e->getType() != RS_TYPE_FLOAT_32) || (e->getVectorSize() != 1) || (t == NULL)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Animation times must be script floats.");
+        return;
+    }
+    const uint32_t count = times->getType()->getDimX();
+    Allocation *out = getFloatOutput(rsc, vout, count);
+    if (out == NULL || count == 0) {
+        return;
+    }
+    float *values = (float *)malloc(count * sizeof(float));
+    if (values == NULL) {
+        rsc->setError(RS_ERROR_OUT_OF_MEMORY);
+        return;
+    }
+    anim->evalMany(t, values, count);
+    out->data(rsc, 0, 0, count, values, count * sizeof(float));
+    free(values);
+}
+
 
 }
 }
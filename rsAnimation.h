@@ -35,6 +35,12 @@ public:
                               RsAnimationEdge pre, RsAnimationEdge post);
 
     float eval(float) const;
+    // Evaluates the curve at each of count times.  Runs of increasing
+    // times reuse the key found for the previous one.
+    void evalMany(const float *t, float *out, uint32_t count) const;
+    // Evaluates each of count animations at time t.
+    static void evalBatch(const Animation * const *anims, uint32_t count,
+                          float t, float *out);
 
     virtual void serialize(Context *rsc, OStream *stream) const;
     virtual RsA3DClassID getClassId() const { return RS_A3D_CLASS_ID_ANIMATION; }
@@ -45,12 +51,25 @@ protected:
 
 
 
-    float evalInRange(float) const;
-
-
-
-    const float *mValuesInput;
-    const float *mValuesOutput;
+    // Every case reduces to base + (t - t0) * slope once t has been moved
+    // into range by the edge modes, which is what lets the batches run the
+    // final step four lanes at a time.
+    struct Term {
+        float t;
+        float t0;
+        float base;
+        float slope;
+    };
+    void evalTerm(float, Term *) const;
+    void evalInRange(float, float offset, Term *) const;
+    uint32_t findKey(float) const;
+    static void combineTerms(const Term *terms, float *out, uint32_t count);
+
+    float *mValuesInput;
+    float *mValuesOutput;
+    // (out[n+1] - out[n]) / (in[n+1] - in[n]) for each of the keys after
+    // the first, 0 across coincident keys.
+    float *mSlopes;
     uint32_t mValueCount;
     RsAnimationInterpolation mInterpolation;
     RsAnimationEdge mEdgePre;
@@ -59,6 +78,9 @@ protected:
     // derived
     float mInputMin;
     float mInputMax;
+    // Key the last lookup landed on.  Only a hint at where the next one
+    // starts, checked before it is used.
+    mutable uint32_t mCursor;
 };
 
 }
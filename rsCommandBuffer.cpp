@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsContext.h"
+#include "rsCommandBuffer.h"
+#include "rsgApiStructs.h"
+
+#include <stddef.h>
+
+using namespace android;
+using namespace android::renderscript;
+
+CommandBuffer::CommandBuffer(Context *rsc) : ObjectBase(rsc) {
+    mData = NULL;
+    mDataSize = 0;
+    mDataCapacity = 0;
+    mParamBytes = 0;
+    mRecording = false;
+    mValid = false;
+    mMarkNext = false;
+}
+
+CommandBuffer::~CommandBuffer() {
+    free(mData);
+}
+
+CommandBuffer * CommandBuffer::create(Context *rsc) {
+    CommandBuffer *cb = new CommandBuffer(rsc);
+    cb->incUserRef();
+    return cb;
+}
+
+void CommandBuffer::serialize(Context *rsc, OStream *stream) const {
+}
+
+RsA3DClassID CommandBuffer::getClassId() const {
+    return RS_A3D_CLASS_ID_COMMAND_BUFFER;
+}
+
+void CommandBuffer::reset() {
+    mDataSize = 0;
+    mParams.clear();
+    mParamBytes = 0;
+    mObjects.clear();
+    mMarkNext = false;
+}
+
+void CommandBuffer::fail(Context *rsc, const char *msg, uint32_t cmdID) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "Command buffer: %s %s", gPlaybackNames[cmdID], msg);
+    ALOGE("%s", buf);
+    rsc->setError(RS_ERROR_BAD_VALUE, buf);
+    mValid = false;
+}
+
+void CommandBuffer::addObject(const void *obj) {
+    if (obj) {
+        mObjects.push(ObjectBaseRef<ObjectBase>((ObjectBase *)obj));
+    }
+}
+
+void CommandBuffer::begin(Context *rsc) {
+    // Synchronous contexts call straight into the core, and remote
+    // ones never hold a whole command, so neither can be recorded.
+    if (rsc->isSynchronous() || rsc->mIO.isPureFifo()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Command buffers need a local command fifo");
+        return;
+    }
+    if (rsc->mRecordingCommands) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "A command buffer is already recording");
+        return;
+    }
+    reset();
+    mRecording = true;
+    mValid = true;
+    incSysRef();
+    rsc->mRecordingCommands = this;
+}
+
+void CommandBuffer::markParam(Context *rsc) {
+    if (!mRecording) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Command buffer parameter marked while not recording");
+        return;
+    }
+    mMarkNext = true;
+}
+
+void CommandBuffer::end(Context *rsc) {
+    if (!mRecording) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Command buffer ended while not recording");
+        return;
+    }
+    if (mMarkNext) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Command buffer parameter marked with no command after it");
+        mValid = false;
+    }
+    mRecording = false;
+    rsc->mRecordingCommands = NULL;
+    decSysRef();
+}
+
+void CommandBuffer::record(Context *rsc, uint32_t cmdID, const void *data, size_t bytes) {
+    if (!mValid) {
+        return;
+    }
+
+    // The value a parameter replaces, as an offset into the command, and
+    // whether the command's data is inline and so could be copied.
+    size_t valueOffset = 0;
+    size_t valueBytes = 0;
+    bool inlined = true;
+    switch (cmdID) {
+    case RS_CMD_ID_CommandBufferBegin:
+    case RS_CMD_ID_CommandBufferMarkParam:
+    case RS_CMD_ID_ContextFinish:
+    case RS_CMD_ID_AssignName:
+    case RS_CMD_ID_ObjDestroy:
+    case RS_CMD_ID_ObjDestroyBatch:
+        // Nothing a replay has to repeat.
+        return;
+    case RS_CMD_ID_ScriptSetVarI: {
+        const RS_CMD_ScriptSetVarI *cmd = (const RS_CMD_ScriptSetVarI *)data;
+        addObject(cmd->s);
+        valueOffset = offsetof(RS_CMD_ScriptSetVarI, value);
+        valueBytes = sizeof(cmd->value);
+        break;
+    }
+    case RS_CMD_ID_ScriptSetVarJ: {
+        const RS_CMD_ScriptSetVarJ *cmd = (const RS_CMD_ScriptSetVarJ *)data;
+        addObject(cmd->s);
+        valueOffset = offsetof(RS_CMD_ScriptSetVarJ, value);
+        valueBytes = sizeof(cmd->value);
+        break;
+    }
+    case RS_CMD_ID_ScriptSetVarF: {
+        const RS_CMD_ScriptSetVarF *cmd = (const RS_CMD_ScriptSetVarF *)data;
+        addObject(cmd->s);
+        valueOffset = offsetof(RS_CMD_ScriptSetVarF, value);
+        valueBytes = sizeof(cmd->value);
+        break;
+    }
+    case RS_CMD_ID_ScriptSetVarD: {
+        const RS_CMD_ScriptSetVarD *cmd = (const RS_CMD_ScriptSetVarD *)data;
+        addObject(cmd->s);
+        valueOffset = offsetof(RS_CMD_ScriptSetVarD, value);
+        valueBytes = sizeof(cmd->value);
+        break;
+    }
+    case RS_CMD_ID_ScriptSetVarV: {
+        const RS_CMD_ScriptSetVarV *cmd = (const RS_CMD_ScriptSetVarV *)data;
+        addObject(cmd->s);
+        inlined = (bytes != sizeof(*cmd)) || !cmd->data_length;
+        valueOffset = sizeof(*cmd) + (intptr_t)cmd->data;
+        valueBytes = cmd->data_length;
+        break;
+    }
+    case RS_CMD_ID_ScriptSetVarObj: {
+        const RS_CMD_ScriptSetVarObj *cmd = (const RS_CMD_ScriptSetVarObj *)data;
+        addObject(cmd->s);
+        addObject(cmd->value);
+        break;
+    }
+    case RS_CMD_ID_ScriptInvoke: {
+        const RS_CMD_ScriptInvoke *cmd = (const RS_CMD_ScriptInvoke *)data;
+        addObject(cmd->s);
+        break;
+    }
+    case RS_CMD_ID_ScriptInvokeV: {
+        const RS_CMD_ScriptInvokeV *cmd = (const RS_CMD_ScriptInvokeV *)data;
+        addObject(cmd->s);
+        inlined = (bytes != sizeof(*cmd)) || !cmd->data_length;
+        valueOffset = sizeof(*cmd) + (intptr_t)cmd->data;
+        valueBytes = cmd->data_length;
+        break;
+    }
+    case RS_CMD_ID_ScriptForEach: {
+        const RS_CMD_ScriptForEach *cmd = (const RS_CMD_ScriptForEach *)data;
+        addObject(cmd->s);
+        addObject(cmd->ain);
+        addObject(cmd->aout);
+        inlined = (bytes != sizeof(*cmd)) || !(cmd->usr_length + cmd->sc_length);
+        valueOffset = sizeof(*cmd) + (intptr_t)cmd->usr;
+        valueBytes = cmd->usr_length;
+        break;
+    }
+    case RS_CMD_ID_ScriptGroupExecute: {
+        const RS_CMD_ScriptGroupExecute *cmd = (const RS_CMD_ScriptGroupExecute *)data;
+        addObject(cmd->group);
+        break;
+    }
+    case RS_CMD_ID_AllocationCopy2DRange: {
+        const RS_CMD_AllocationCopy2DRange *cmd = (const RS_CMD_AllocationCopy2DRange *)data;
+        addObject(cmd->dest);
+        addObject(cmd->src);
+        break;
+    }
+    case RS_CMD_ID_AllocationCopy3DRange: {
+        const RS_CMD_AllocationCopy3DRange *cmd = (const RS_CMD_AllocationCopy3DRange *)data;
+        addObject(cmd->dest);
+        addObject(cmd->src);
+        break;
+    }
+    case RS_CMD_ID_AllocationSyncAll: {
+        const RS_CMD_AllocationSyncAll *cmd = (const RS_CMD_AllocationSyncAll *)data;
+        addObject(cmd->va);
+        break;
+    }
+    case RS_CMD_ID_AllocationIoSend: {
+        const RS_CMD_AllocationIoSend *cmd = (const RS_CMD_AllocationIoSend *)data;
+        addObject(cmd->alloc);
+        break;
+    }
+    case RS_CMD_ID_AllocationIoReceive: {
+        const RS_CMD_AllocationIoReceive *cmd = (const RS_CMD_AllocationIoReceive *)data;
+        addObject(cmd->alloc);
+        break;
+    }
+    default:
+        fail(rsc, "cannot be recorded", cmdID);
+        return;
+    }
+
+    if (!inlined) {
+        fail(rsc, "data is too large to record", cmdID);
+        return;
+    }
+    if (mMarkNext && !valueBytes) {
+        fail(rsc, "has no value to use as a parameter", cmdID);
+        return;
+    }
+
+    const size_t recordBytes = sizeof(Record) + ((bytes + 7) & ~7);
+    if (mDataSize + recordBytes > mDataCapacity) {
+        size_t capacity = rsMax(mDataCapacity * 2, mDataSize + recordBytes);
+        uint8_t *d = (uint8_t *)realloc(mData, capacity);
+        if (!d) {
+            fail(rsc, "ran out of memory recording", cmdID);
+            return;
+        }
+        mData = d;
+        mDataCapacity = capacity;
+    }
+    Record *r = (Record *)&mData[mDataSize];
+    r->cmdID = cmdID;
+    r->bytes = bytes;
+    memcpy(&r[1], data, bytes);
+
+    if (mMarkNext) {
+        Param p;
+        p.offset = mDataSize + sizeof(Record) + valueOffset;
+        p.bytes = valueBytes;
+        mParams.push(p);
+        mParamBytes += valueBytes;
+        mMarkNext = false;
+    }
+    mDataSize += recordBytes;
+}
+
+void CommandBuffer::submit(Context *rsc, const void *params, size_t paramsBytes) {
+    if (mRecording) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Command buffer submitted while recording");
+        return;
+    }
+    if (!mValid) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Command buffer submitted without a valid recording");
+        return;
+    }
+
+    // Without new values the last ones submitted are used again.
+    if (paramsBytes) {
+        if (paramsBytes != mParamBytes) {
+            ALOGE("Command buffer takes %zu bytes of parameters, not %zu", mParamBytes, paramsBytes);
+            rsc->setError(RS_ERROR_BAD_VALUE, "Command buffer parameter size mismatch");
+            return;
+        }
+        const uint8_t *p = (const uint8_t *)params;
+        for (size_t ct = 0; ct < mParams.size(); ct++) {
+            memcpy(&mData[mParams[ct].offset], p, mParams[ct].bytes);
+            p += mParams[ct].bytes;
+        }
+    }
+
+    size_t offset = 0;
+    while (offset < mDataSize) {
+        const Record *r = (const Record *)&mData[offset];
+        rsc->mIO.playRecordedCommand(rsc, r->cmdID, &r[1], r->bytes);
+        offset += sizeof(Record) + ((r->bytes + 7) & ~7);
+    }
+}
+
+namespace android {
+namespace renderscript {
+
+RsCommandBuffer rsi_CommandBufferCreate(Context *rsc) {
+    return CommandBuffer::create(rsc);
+}
+
+void rsi_CommandBufferBegin(Context *rsc, RsCommandBuffer vcb) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    cb->begin(rsc);
+}
+
+void rsi_CommandBufferMarkParam(Context *rsc, RsCommandBuffer vcb) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    cb->markParam(rsc);
+}
+
+void rsi_CommandBufferEnd(Context *rsc, RsCommandBuffer vcb) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    cb->end(rsc);
+}
+
+void rsi_CommandBufferSubmit(Context *rsc, RsCommandBuffer vcb,
+                             const void *params, size_t paramsBytes) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    cb->submit(rsc, params, paramsBytes);
+}
+
+}
+}
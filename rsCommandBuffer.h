@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RS_COMMAND_BUFFER_H
+#define ANDROID_RS_COMMAND_BUFFER_H
+
+#include "rsObjectBase.h"
+
+
+// ---------------------------------------------------------------------------
+namespace android {
+namespace renderscript {
+
+// A sequence of commands captured from the command fifo between Begin and
+// End, as they were played, and replayed by a single Submit.  Commands
+// marked as parameters have their value replaced by the data of the
+// submit, in the order they were recorded.
+class CommandBuffer : public ObjectBase {
+public:
+    static CommandBuffer * create(Context *rsc);
+
+    virtual void serialize(Context *rsc, OStream *stream) const;
+    virtual RsA3DClassID getClassId() const;
+
+    void begin(Context *rsc);
+    void markParam(Context *rsc);
+    void end(Context *rsc);
+    void submit(Context *rsc, const void *params, size_t paramsBytes);
+
+    // Called by ThreadIO with each command played while recording.
+    void record(Context *rsc, uint32_t cmdID, const void *data, size_t bytes);
+
+protected:
+    virtual ~CommandBuffer();
+
+    struct Record {
+        uint32_t cmdID;
+        uint32_t bytes;
+    };
+    // Where in mData the value of a marked command lives.
+    struct Param {
+        size_t offset;
+        size_t bytes;
+    };
+
+    // Records, each followed by its command padded to 8 bytes.
+    uint8_t *mData;
+    size_t mDataSize;
+    size_t mDataCapacity;
+
+    Vector<Param> mParams;
+    size_t mParamBytes;
+    // Everything the recorded commands refer to stays alive with them.
+    Vector<ObjectBaseRef<ObjectBase> > mObjects;
+
+    bool mRecording;
+    bool mValid;
+    bool mMarkNext;
+
+private:
+    void reset();
+    void fail(Context *rsc, const char *msg, uint32_t cmdID);
+    void addObject(const void *obj);
+
+    CommandBuffer(Context *);
+};
+
+
+}
+}
+#endif
+
@@ -66,6 +66,17 @@ void Component::set(RsDataType dt, RsDataKind dk, bool norm, uint32_t vecSize) {
         rsAssert(mVectorSize == 1);
         rsAssert(mNormalized == true);
         break;
+    case RS_KIND_PIXEL_ETC1:
+    case RS_KIND_PIXEL_ETC2_RGB:
+        mIsPixel = true;
+        rsAssert(mVectorSize == 2);
+        rsAssert(mType == RS_TYPE_UNSIGNED_32);
+        break;
+    case RS_KIND_PIXEL_ETC2_RGBA:
+        mIsPixel = true;
+        rsAssert(mVectorSize == 4);
+        rsAssert(mType == RS_TYPE_UNSIGNED_32);
+        break;
 
     default:
         rsAssert(mKind != RS_KIND_INVALID);
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsCompress.h"
+
+#include <string.h>
+
+using namespace android;
+using namespace android::renderscript;
+
+enum {
+    kHashBits = 12,
+    kMinMatch = 4,
+    kMaxOffset = 65535,
+    // The format ends every block with at least this many literals, and
+    // the last match starts at least kMatchLimit bytes from the end.
+    kLastLiterals = 5,
+    kMatchLimit = 12
+};
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hashSequence(uint32_t seq) {
+    return (seq * 2654435761U) >> (32 - kHashBits);
+}
+
+// Bytes needed to code a length of len in a token nibble and the
+// continuation bytes after it.
+static inline size_t lengthBytes(size_t len) {
+    return (len < 15) ? 0 : ((len - 15) / 255 + 1);
+}
+
+static uint8_t * writeLength(uint8_t *op, size_t len) {
+    len -= 15;
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+size_t android::renderscript::rsuBlockCompressBound(size_t srcLen) {
+    return srcLen + srcLen / 255 + 16;
+}
+
+size_t android::renderscript::rsuBlockCompress(const uint8_t *src, size_t srcLen,
+                                               uint8_t *dst, size_t dstLen) {
+    uint32_t table[1 << kHashBits];
+    memset(table, 0xff, sizeof(table));
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + srcLen;
+    const uint8_t *matchLimit = (srcLen > kMatchLimit) ? (end - kMatchLimit) : src;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstLen;
+
+    while (ip < matchLimit) {
+        uint32_t seq = read32(ip);
+        uint32_t h = hashSequence(seq);
+        uint32_t pos = (uint32_t)(ip - src);
+        uint32_t cand = table[h];
+        table[h] = pos;
+        if ((cand == 0xffffffff) || ((pos - cand) > kMaxOffset) || (read32(src + cand) != seq)) {
+            ip ++;
+            continue;
+        }
+
+        const uint8_t *match = src + cand;
+        const uint8_t *matchEnd = ip + kMinMatch;
+        const uint8_t *mp = match + kMinMatch;
+        while ((matchEnd < (end - kLastLiterals)) && (*matchEnd == *mp)) {
+            matchEnd ++;
+            mp ++;
+        }
+
+        size_t litLen = ip - anchor;
+        size_t matchLen = matchEnd - ip - kMinMatch;
+        size_t needed = 1 + lengthBytes(litLen) + litLen + 2 + lengthBytes(matchLen);
+        if (needed > (size_t)(oend - op)) {
+            return 0;
+        }
+
+        uint8_t *token = op++;
+        *token = (uint8_t)(((litLen < 15) ? litLen : 15) << 4);
+        if (litLen >= 15) {
+            op = writeLength(op, litLen);
+        }
+        memcpy(op, anchor, litLen);
+        op += litLen;
+
+        uint32_t offset = (uint32_t)(ip - match);
+        *op++ = (uint8_t)(offset & 0xff);
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)((matchLen < 15) ? matchLen : 15);
+        if (matchLen >= 15) {
+            op = writeLength(op, matchLen);
+        }
+
+        ip = matchEnd;
+        anchor = ip;
+    }
+
+    // Whatever is left goes out as the final run of literals
+    size_t litLen = end - anchor;
+    if ((1 + lengthBytes(litLen) + litLen) > (size_t)(oend - op)) {
+        return 0;
+    }
+    *op++ = (uint8_t)(((litLen < 15) ? litLen : 15) << 4);
+    if (litLen >= 15) {
+        op = writeLength(op, litLen);
+    }
+    memcpy(op, anchor, litLen);
+    op += litLen;
+
+    return op - dst;
+}
+
+// Reads the continuation bytes of a length whose nibble was 15.
+static bool readLength(const uint8_t **ip, const uint8_t *iend, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool android::renderscript::rsuBlockDecompress(const uint8_t *src, size_t srcLen,
+                                               uint8_t *dst, size_t dstLen) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + srcLen;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstLen;
+
+    while (ip < iend) {
+        uint32_t token = *ip++;
+
+        size_t litLen = token >> 4;
+        if ((litLen == 15) && !readLength(&ip, iend, &litLen)) {
+            return false;
+        }
+        if ((litLen > (size_t)(iend - ip)) || (litLen > (size_t)(oend - op))) {
+            return false;
+        }
+        memcpy(op, ip, litLen);
+        op += litLen;
+        ip += litLen;
+        if (ip == iend) {
+            // The last sequence has no match
+            break;
+        }
+
+        if ((iend - ip) < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if ((offset == 0) || (offset > (size_t)(op - dst))) {
+            return false;
+        }
+
+        size_t matchLen = token & 15;
+        if ((matchLen == 15) && !readLength(&ip, iend, &matchLen)) {
+            return false;
+        }
+        matchLen += kMinMatch;
+        if (matchLen > (size_t)(oend - op)) {
+            return false;
+        }
+
+        const uint8_t *match = op - offset;
+        if (offset >= matchLen) {
+            memcpy(op, match, matchLen);
+            op += matchLen;
+        } else {
+            // Overlapping matches repeat the bytes just written
+            while (matchLen--) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == oend;
+}
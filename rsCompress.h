@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RS_COMPRESS_H
+#define ANDROID_RS_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace renderscript {
+
+// Block compression in the LZ4 block format: literal runs and matches of
+// at least four bytes up to 64KB back, with no framing around the block.
+
+// Largest compressed size of srcLen bytes.
+size_t rsuBlockCompressBound(size_t srcLen);
+
+// Compresses src into dst, returning the compressed size, or 0 if it
+// doesn't fit in dstLen bytes.
+size_t rsuBlockCompress(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstLen);
+
+// Decompresses a block into exactly dstLen bytes, returning false if the
+// block is malformed or doesn't decompress to that size.
+bool rsuBlockDecompress(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstLen);
+
+}
+}
+
+#endif //ANDROID_RS_COMPRESS_H
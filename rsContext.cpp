@@ -18,6 +18,8 @@
 #include "rsDevice.h"
 #include "rsContext.h"
 #include "rsThreadIO.h"
+#include "rsFileA3D.h"
+#include "cpp/rsDispatch.h"
 
 #ifndef RS_COMPATIBILITY_LIB
 #include "rsMesh.h"
@@ -114,6 +116,9 @@ uint32_t Context::runRootScript() {
 #ifndef RS_COMPATIBILITY_LIB
     mStateFragmentStore.mLast.clear();
 #endif
+    if (mPendingAsyncWork) {
+        finish();
+    }
     watchdog.inRoot = true;
     uint32_t ret = runScript(mRootScript.get());
     watchdog.inRoot = false;
@@ -303,11 +308,23 @@ void * Context::threadProc(void *vrsc) {
     rsc->props.mLogTimes = getProp("debug.rs.profile") != 0;
     rsc->props.mLogScripts = getProp("debug.rs.script") != 0;
     rsc->props.mLogObjects = getProp("debug.rs.object") != 0;
-    rsc->props.mLogShaders = getProp("debug.rs.shader") != 0;
-    rsc->props.mLogShadersAttr = getProp("debug.rs.shader.attributes") != 0;
-    rsc->props.mLogShadersUniforms = getProp("debug.rs.shader.uniforms") != 0;
-    rsc->props.mLogVisual = getProp("debug.rs.visual") != 0;
     rsc->props.mDebugMaxThreads = getProp("debug.rs.max-threads");
+    rsc->props.mDebugSpinWait = getProp("debug.rs.spin-wait");
+    rsc->props.mDebugPrefetchRows = getProp("debug.rs.prefetch-rows");
+    // Compute contexts never look at the graphics switches; each lookup
+    // is a trip to the property service.
+    if (rsc->mIsGraphicsContext) {
+        rsc->props.mLogShaders = getProp("debug.rs.shader") != 0;
+        rsc->props.mLogShadersAttr = getProp("debug.rs.shader.attributes") != 0;
+        rsc->props.mLogShadersUniforms = getProp("debug.rs.shader.uniforms") != 0;
+        rsc->props.mLogVisual = getProp("debug.rs.visual") != 0;
+        rsc->props.mDebugTexturePbo = getProp("debug.rs.texture-pbo") != 0;
+        rsc->props.mDebugReadbackPbo = getProp("debug.rs.readback-pbo") != 0;
+        rsc->props.mDebugTextureEglImage = getProp("debug.rs.texture-eglimage") != 0;
+        rsc->props.mDebugGLWorker = getProp("debug.rs.gl-worker") != 0;
+        rsc->props.mDebugGpuTimer = getProp("debug.rs.gpu-timer");
+        rsc->props.mDebugPipelineFrames = getProp("debug.rs.pipeline-frames");
+    }
 
     bool loadDefault = true;
 
@@ -393,6 +410,11 @@ void * Context::threadProc(void *vrsc) {
 #endif
         int vsyncRate = 0;
         int targetRate = 0;
+        // With debug.rs.pipeline-frames the next frame starts as soon as the
+        // last one is queued rather than at the next vsync; the driver
+        // keeps the GPU at most that many frames behind.
+        const bool pipelined = rsc->props.mDebugPipelineFrames > 1;
+        bool frameQueued = false;
 
         bool drawOnce = false;
         while (!rsc->mExit) {
@@ -407,7 +429,11 @@ void * Context::threadProc(void *vrsc) {
                 displayEvent.setVsyncRate(targetRate);
                 vsyncRate = targetRate;
             }
-            if (targetRate) {
+            if (targetRate && frameQueued) {
+                drawOnce |= rsc->mIO.playCoreCommands(rsc, displayEvent.getFd(), false);
+                while (displayEvent.getEvents(eventBuffer, 1) != 0) {
+                }
+            } else if (targetRate) {
                 drawOnce |= rsc->mIO.playCoreCommands(rsc, displayEvent.getFd());
                 while (displayEvent.getEvents(eventBuffer, 1) != 0) {
                     //ALOGE("vs2 time past %lld", (rsc->getTime() - eventBuffer[0].header.timestamp) / 1000000);
@@ -418,11 +444,17 @@ void * Context::threadProc(void *vrsc) {
                 drawOnce |= rsc->mIO.playCoreCommands(rsc, -1);
             }
 
+            frameQueued = false;
             if ((rsc->mRootScript.get() != NULL) && rsc->mHasSurface &&
                 (targetRate || drawOnce) && !rsc->mPaused) {
 
                 drawOnce = false;
+                rsc->mStateFont.placeRasterizedGlyphs();
                 targetRate = ((rsc->runRootScript() + 15) / 16);
+                // Keep drawing until background glyphs have shown up
+                if (!targetRate && rsc->mStateFont.hasPendingGlyphs()) {
+                    targetRate = 1;
+                }
 
                 if (rsc->props.mLogVisual) {
                     rsc->displayDebugStats();
@@ -430,6 +462,7 @@ void * Context::threadProc(void *vrsc) {
 
                 rsc->timerSet(RS_TIMER_CLEAR_SWAP);
                 rsc->mHal.funcs.swap(rsc);
+                frameQueued = pipelined;
                 rsc->timerFrame();
                 rsc->timerSet(RS_TIMER_INTERNAL);
                 rsc->timerPrint();
@@ -455,6 +488,7 @@ void * Context::threadProc(void *vrsc) {
 
 void Context::destroyWorkerThreadResources() {
     //ALOGV("destroyWorkerThreadResources 1");
+    releaseDeferredDestroys(mDeferredDestroys.size());
     ObjectBase::zeroAllUserRef(this);
 #ifndef RS_COMPATIBILITY_LIB
     if (mIsGraphicsContext) {
@@ -505,15 +539,30 @@ Context::Context() {
     mExit = false;
     mPaused = false;
     mObjHead = NULL;
+    mScriptWriteEpoch = 0;
+    // Not destroyed: member caches may still release objects once the
+    // destructor body has run.
+    pthread_mutex_init(&mObjectMutex, NULL);
+    mNameBucketCount = 64;
+    mNameBuckets = new Vector<ObjectBase *>[mNameBucketCount];
+    mNameCount = 0;
     mError = RS_ERROR_NONE;
+    memset(mMemory, 0, sizeof(mMemory));
     mTargetSdkVersion = 14;
     mDPI = 96;
     mIsContextLite = false;
     memset(&watchdog, 0, sizeof(watchdog));
+    memset(&props, 0, sizeof(props));
     memset(&mHal, 0, sizeof(mHal));
     mForceCpu = false;
     mContextType = RS_CONTEXT_TYPE_NORMAL;
     mSynchronous = false;
+    mBigCoresOnly = false;
+    mPerfHints = false;
+    mPendingAsyncWork = false;
+    mDeferDestroy = false;
+    mTrace = NULL;
+    mRecordingCommands = NULL;
 }
 
 Context * Context::createContext(Device *dev, const RsSurfaceConfig *sc,
@@ -526,6 +575,18 @@ Context * Context::createContext(Device *dev, const RsSurfaceConfig *sc,
     if (flags & RS_CONTEXT_SYNCHRONOUS) {
         rsc->mSynchronous = true;
     }
+    if (flags & RS_CONTEXT_BIG_CORES) {
+        rsc->mBigCoresOnly = true;
+    }
+    if (flags & RS_CONTEXT_BATCH_COMMANDS) {
+        rsc->mIO.setBatching(true);
+    }
+    if (flags & RS_CONTEXT_DEFER_DESTROY) {
+        rsc->mDeferDestroy = true;
+    }
+    if (flags & RS_CONTEXT_PERF_HINTS) {
+        rsc->mPerfHints = true;
+    }
     rsc->mContextType = ct;
 
     if (!rsc->initContext(dev, sc)) {
@@ -541,11 +602,26 @@ Context * Context::createContextLite() {
     return rsc;
 }
 
+// Idle work starts once the thread has gone kIdleMs without a command,
+// and checks for commands again after each task or kIdleQuantumNs.
+static const int kIdleMs = 16;
+static const uint64_t kIdleQuantumNs = 2 * 1000 * 1000;
+// The due time of tasks waiting for commands to be played.
+static const uint64_t kIdleAfterCommands = ~(uint64_t)0;
+
 bool Context::initContext(Device *dev, const RsSurfaceConfig *sc) {
     pthread_mutex_lock(&gInitMutex);
 
     mIO.init();
     mIO.setTimeoutCallback(printWatchdogInfo, this, 2e9);
+    mIO.setIdleCallback(idleCallback, this, kIdleMs);
+    addIdleTask(deferredDestroyTask, NULL);
+    addIdleTask(halIdleTask, NULL);
+#ifndef RS_COMPATIBILITY_LIB
+    if (sc) {
+        addIdleTask(fontIdleTask, NULL);
+    }
+#endif
 
     dev->addContext(this);
     mDev = dev;
@@ -619,6 +695,8 @@ Context::~Context() {
         }
         pthread_mutex_unlock(&gInitMutex);
     }
+    delete [] mNameBuckets;
+    delete mTrace;
     //ALOGV("%p Context::~Context done", this);
 }
 
@@ -728,21 +806,207 @@ void Context::finish() {
     }
 }
 
+uint64_t Context::trimMemory(int32_t level) {
+    // Most caches count their memory; the rest report what they free.
+    const size_t tracked = mMemory[RS_MEMORY_TOTAL].current;
+    uint64_t freed = 0;
+
+    releaseDeferredDestroys(mDeferredDestroys.size());
+    if (level >= RS_TRIM_MEMORY_RUNNING_LOW) {
+        FileA3D::trimAll(this);
+        ObjectBase::asyncLock(this);
+        freed += mStateType.trim() + mStateElement.trim();
+        ObjectBase::asyncUnlock(this);
+    }
+#ifndef RS_COMPATIBILITY_LIB
+    if (mIsGraphicsContext && (level >= RS_TRIM_MEMORY_RUNNING_LOW)) {
+        // The atlas is rebuilt as text is drawn, so it goes once the app
+        // is in trouble or out of sight.
+        freed += mStateFont.trim(level >= RS_TRIM_MEMORY_RUNNING_CRITICAL);
+    }
+#endif
+    if (mHal.funcs.trimMemory) {
+        freed += mHal.funcs.trimMemory(this, level);
+    }
+
+    const size_t now = mMemory[RS_MEMORY_TOTAL].current;
+    if (now < tracked) {
+        freed += tracked - now;
+    }
+    if (props.mLogScripts) {
+        ALOGV("Trimmed %llu bytes at level %i", (unsigned long long)freed, level);
+    }
+    return freed;
+}
+
+// Deferred destroys go a chunk at a time; past the limit they are
+// released right away.
+static const size_t kDeferredDestroyChunk = 64;
+static const size_t kMaxDeferredDestroys = 4096;
+
+void Context::destroyObjects(const RsObjectBase *objs, size_t count, bool deferred) {
+    // Synchronous contexts never go idle.
+    deferred = deferred && !isSynchronous();
+    for (size_t ct = 0; ct < count; ct++) {
+        ObjectBase *ob = static_cast<ObjectBase *>(objs[ct]);
+        if (!ob) {
+            continue;
+        }
+        removeName(ob);
+        if (deferred) {
+            mDeferredDestroys.push(ob);
+        } else {
+            ob->decUserRef();
+        }
+    }
+
+    if (mDeferredDestroys.size() > kMaxDeferredDestroys) {
+        releaseDeferredDestroys(mDeferredDestroys.size());
+    }
+}
+
+void Context::releaseDeferredDestroys(size_t count) {
+    if (!mDeferredDestroys.size()) {
+        return;
+    }
+    // Launches still running may be using the objects.
+    if (mPendingAsyncWork) {
+        finish();
+    }
+    while (count-- && mDeferredDestroys.size()) {
+        const size_t last = mDeferredDestroys.size() - 1;
+        ObjectBase *ob = mDeferredDestroys[last];
+        mDeferredDestroys.removeAt(last);
+        ob->decUserRef();
+    }
+}
+
+void Context::addIdleTask(IdleTaskFunc func, void *usr) {
+    IdleTask t;
+    t.func = func;
+    t.usr = usr;
+    t.dueNs = kIdleAfterCommands;
+    mIdleTasks.push(t);
+}
+
+void Context::removeIdleTask(IdleTaskFunc func, void *usr) {
+    for (size_t ct = 0; ct < mIdleTasks.size(); ct++) {
+        if ((mIdleTasks[ct].func == func) && (mIdleTasks[ct].usr == usr)) {
+            mIdleTasks.removeAt(ct);
+            return;
+        }
+    }
+}
+
+int Context::runIdleTasks(bool resumed) {
+    uint64_t now = getTime();
+    const uint64_t end = now + kIdleQuantumNs;
+    if (resumed) {
+        for (size_t ct = 0; ct < mIdleTasks.size(); ct++) {
+            IdleTask &t = mIdleTasks.editItemAt(ct);
+            if (t.dueNs == kIdleAfterCommands) {
+                t.dueNs = 0;
+            }
+        }
+    }
+
+    bool ran = true;
+    bool yielded = false;
+    while (ran && !yielded) {
+        ran = false;
+        for (size_t ct = 0; ct < mIdleTasks.size(); ct++) {
+            if (mIdleTasks[ct].dueNs > now) {
+                continue;
+            }
+            int32_t ms = mIdleTasks[ct].func(this, mIdleTasks[ct].usr);
+            now = getTime();
+            mIdleTasks.editItemAt(ct).dueNs = (ms < 0) ? kIdleAfterCommands :
+                                              now + (uint64_t)ms * 1000000;
+            ran = true;
+            if ((now >= end) || mIO.hasCoreCommand()) {
+                yielded = true;
+                break;
+            }
+        }
+    }
+
+    int wait = -1;
+    for (size_t ct = 0; ct < mIdleTasks.size(); ct++) {
+        const uint64_t due = mIdleTasks[ct].dueNs;
+        if (due == kIdleAfterCommands) {
+            continue;
+        }
+        int ms = (due <= now) ? 0 : (int)((due - now + 999999) / 1000000);
+        if ((wait < 0) || (ms < wait)) {
+            wait = ms;
+        }
+    }
+    return wait;
+}
+
+int Context::idleCallback(void *ctx, bool resumed) {
+    return ((Context *)ctx)->runIdleTasks(resumed);
+}
+
+int32_t Context::deferredDestroyTask(Context *rsc, void *) {
+    rsc->releaseDeferredDestroys(kDeferredDestroyChunk);
+    return rsc->mDeferredDestroys.size() ? 0 : -1;
+}
+
+int32_t Context::halIdleTask(Context *rsc, void *) {
+    return rsc->mHal.funcs.idle ? rsc->mHal.funcs.idle(rsc) : -1;
+}
+
+#ifndef RS_COMPATIBILITY_LIB
+int32_t Context::fontIdleTask(Context *rsc, void *) {
+    return rsc->mIsGraphicsContext ? rsc->mStateFont.idle() : -1;
+}
+#endif
+
+static uint32_t hashName(const char *name) {
+    return rsHashBytes(RS_HASH_SEED, name, strlen(name));
+}
+
 void Context::assignName(ObjectBase *obj, const char *name, uint32_t len) {
     rsAssert(!obj->getName());
     obj->setName(name, len);
-    mNames.add(obj);
+    if (mNameCount >= mNameBucketCount * 2) {
+        growNames();
+    }
+    mNameBuckets[hashName(obj->getName()) & (mNameBucketCount - 1)].add(obj);
+    mNameCount++;
 }
 
 void Context::removeName(ObjectBase *obj) {
-    for (size_t ct=0; ct < mNames.size(); ct++) {
-        if (obj == mNames[ct]) {
-            mNames.removeAt(ct);
+    // Called for every destroyed object, named or not.
+    if (!obj->getName()) {
+        return;
+    }
+    Vector<ObjectBase *> &bucket =
+            mNameBuckets[hashName(obj->getName()) & (mNameBucketCount - 1)];
+    for (size_t ct=0; ct < bucket.size(); ct++) {
+        if (obj == bucket[ct]) {
+            bucket.removeAt(ct);
+            mNameCount--;
             return;
         }
     }
 }
 
+void Context::growNames() {
+    const uint32_t count = mNameBucketCount * 2;
+    Vector<ObjectBase *> *buckets = new Vector<ObjectBase *>[count];
+    for (uint32_t ct = 0; ct < mNameBucketCount; ct++) {
+        for (size_t i = 0; i < mNameBuckets[ct].size(); i++) {
+            ObjectBase *obj = mNameBuckets[ct][i];
+            buckets[hashName(obj->getName()) & (count - 1)].add(obj);
+        }
+    }
+    delete [] mNameBuckets;
+    mNameBuckets = buckets;
+    mNameBucketCount = count;
+}
+
 RsMessageToClientType Context::peekMessageToClient(size_t *receiveLen, uint32_t *subID) {
     return (RsMessageToClientType)mIO.getClientHeader(receiveLen, subID);
 }
@@ -783,6 +1047,88 @@ void Context::dumpDebug() const {
     ALOGE(" RS width %i, height %i", mWidth, mHeight);
     ALOGE(" RS running %i, exit %i, paused %i", mRunning, mExit, mPaused);
     ALOGE(" RS pThreadID %li, nativeThreadID %i", (long int)mThreadId, mNativeThreadId);
+
+    ObjectSlab::Stats slab;
+    mObjectSlab.getStats(&slab);
+    ALOGE(" RS object slabs: %u live, %u recycled, %u pages, %u large",
+          slab.live, slab.recycled, slab.pages, slab.large);
+}
+
+uint32_t Context::getProfile(RsKernelProfile *profiles, uint32_t count) const {
+    if (!mHal.funcs.getProfile) {
+        return 0;
+    }
+    return mHal.funcs.getProfile(this, profiles, count);
+}
+
+void Context::dumpProfile() const {
+    uint32_t count = getProfile(NULL, 0);
+    if (!count) {
+        return;
+    }
+    RsKernelProfile *profiles = (RsKernelProfile *)malloc(count * sizeof(RsKernelProfile));
+    if (!profiles) {
+        return;
+    }
+    count = rsMin(count, getProfile(profiles, count));
+
+    ALOGE("RS kernel profile, %u entries", count);
+    for (uint32_t ct = 0; ct < count; ct++) {
+        const RsKernelProfile *p = &profiles[ct];
+        uint64_t busy = 0;
+        uint64_t busiest = 0;
+        for (uint32_t w = 0; w < RS_KERNEL_PROFILE_WORKERS; w++) {
+            busy += p->busyNs[w];
+            busiest = rsMax(busiest, p->busyNs[w]);
+        }
+        ALOGE(" RS script %p slot %u %ux%ux%u: %llu launches, %llu us wall, "
+              "%llu us busy (%llu us busiest worker), %llu slices, %llu stolen",
+              p->script, p->slot, p->dimX, p->dimY, p->dimZ,
+              (unsigned long long)p->launches, (unsigned long long)(p->wallNs / 1000),
+              (unsigned long long)(busy / 1000), (unsigned long long)(busiest / 1000),
+              (unsigned long long)p->slices, (unsigned long long)p->steals);
+    }
+    free(profiles);
+}
+
+static void addMemory(size_t *current, size_t *peak, ssize_t bytes) {
+    size_t now = __sync_add_and_fetch(current, (size_t)bytes);
+    size_t seen = *peak;
+    while (now > seen) {
+        size_t prev = __sync_val_compare_and_swap(peak, seen, now);
+        if (prev == seen) {
+            break;
+        }
+        seen = prev;
+    }
+}
+
+void Context::trackMemory(RsMemoryCategory category, ssize_t bytes) const {
+    if (!bytes || (category >= RS_MEMORY_TOTAL)) {
+        return;
+    }
+    addMemory(&mMemory[category].current, &mMemory[category].peak, bytes);
+    addMemory(&mMemory[RS_MEMORY_TOTAL].current, &mMemory[RS_MEMORY_TOTAL].peak, bytes);
+}
+
+void Context::getMemoryUsage(RsMemoryUsage *usage, uint32_t count) const {
+    count = rsMin(count, (uint32_t)RS_MEMORY_CATEGORY_COUNT);
+    for (uint32_t ct = 0; ct < count; ct++) {
+        usage[ct].currentBytes = mMemory[ct].current;
+        usage[ct].peakBytes = mMemory[ct].peak;
+    }
+}
+
+void Context::dumpMemory() const {
+    static const char * const names[RS_MEMORY_CATEGORY_COUNT] = {
+        "script allocations", "graphics allocations", "shared allocations",
+        "script code", "script data", "GL objects", "font cache", "total"
+    };
+    ALOGE("RS memory, current / peak KiB");
+    for (uint32_t ct = 0; ct < RS_MEMORY_CATEGORY_COUNT; ct++) {
+        ALOGE(" RS %s: %zu / %zu", names[ct], mMemory[ct].current / 1024,
+              mMemory[ct].peak / 1024);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -795,6 +1141,17 @@ void rsi_ContextFinish(Context *rsc) {
     rsc->finish();
 }
 
+// Runs after every command sent before it, so once the launches those left
+// running are done the client can be told they are all complete.
+void rsi_ContextFence(Context *rsc, uint32_t id) {
+    rsc->finish();
+    rsc->sendMessageToClient(NULL, RS_MESSAGE_TO_CLIENT_FENCE, id, 0, true);
+}
+
+void rsi_ContextFlush(Context *rsc) {
+    rsc->mIO.coreFlush();
+}
+
 void rsi_ContextBindRootScript(Context *rsc, RsScript vs) {
 #ifndef RS_COMPATIBILITY_LIB
     Script *s = static_cast<Script *>(vs);
@@ -846,9 +1203,13 @@ void rsi_AssignName(Context *rsc, RsObjectBase obj, const char *name, size_t nam
 }
 
 void rsi_ObjDestroy(Context *rsc, void *optr) {
-    ObjectBase *ob = static_cast<ObjectBase *>(optr);
-    rsc->removeName(ob);
-    ob->decUserRef();
+    rsc->destroyObjects(&optr, 1, rsc->mDeferDestroy);
+}
+
+void rsi_ObjDestroyBatch(Context *rsc, const RsObjectBase *objs, size_t objs_length,
+                         bool deferred) {
+    rsc->destroyObjects(objs, objs_length / sizeof(RsObjectBase),
+                        deferred || rsc->mDeferDestroy);
 }
 
 #ifndef RS_COMPATIBILITY_LIB
@@ -869,8 +1230,24 @@ void rsi_ContextSetPriority(Context *rsc, int32_t p) {
     rsc->setPriority(p);
 }
 
+uint64_t rsi_ContextTrimMemory(Context *rsc, int32_t level) {
+    return rsc->trimMemory(level);
+}
+
 void rsi_ContextDump(Context *rsc, int32_t bits) {
     ObjectBase::dumpAll(rsc);
+    rsc->dumpProfile();
+    rsc->dumpMemory();
+}
+
+uint32_t rsi_ContextGetProfile(Context *rsc, RsKernelProfile *profiles, size_t profilesLength) {
+    // The spec passes the size of the array in bytes.
+    return rsc->getProfile(profiles, profilesLength / sizeof(RsKernelProfile));
+}
+
+uint32_t rsi_ContextGetMemoryUsage(Context *rsc, RsMemoryUsage *usage, size_t usageLength) {
+    rsc->getMemoryUsage(usage, usageLength / sizeof(RsMemoryUsage));
+    return RS_MEMORY_CATEGORY_COUNT;
 }
 
 void rsi_ContextDestroyWorker(Context *rsc) {
@@ -920,6 +1297,7 @@ extern "C" RsContext rsContextCreate(RsDevice vdev, uint32_t version, uint32_t s
     Context *rsc = Context::createContext(dev, NULL, ct, flags);
     if (rsc) {
         rsc->setTargetSdkVersion(sdkVersion);
+        rsc->mTrace = TraceWriter::createFromProperty(ct, flags, sdkVersion);
     }
     return rsc;
 }
@@ -946,3 +1324,107 @@ void rsaGetName(RsContext con, void * obj, const char **name) {
     ObjectBase *ob = static_cast<ObjectBase *>(obj);
     (*name) = ob->getName();
 }
+
+// Fills in the table libRScpp would otherwise assemble with one dlsym per
+// entry.  The table only ever grows at the end, so a caller built against a
+// different layout is told so through its size and falls back to dlsym.
+extern "C" bool rsGetDispatchTable(void *table, size_t tableSize) {
+    if (tableSize != sizeof(dispatchTable)) {
+        return false;
+    }
+    dispatchTable *t = (dispatchTable *)table;
+    t->AllocationGetType = (AllocationGetTypeFnPtr)rsaAllocationGetType;
+    t->TypeGetNativeData = (TypeGetNativeDataFnPtr)rsaTypeGetNativeData;
+    t->ElementGetNativeData = (ElementGetNativeDataFnPtr)rsaElementGetNativeData;
+    t->ElementGetSubElements = (ElementGetSubElementsFnPtr)rsaElementGetSubElements;
+    t->DeviceCreate = (DeviceCreateFnPtr)rsDeviceCreate;
+    t->DeviceDestroy = (DeviceDestroyFnPtr)rsDeviceDestroy;
+    t->DeviceSetConfig = (DeviceSetConfigFnPtr)rsDeviceSetConfig;
+    t->ContextCreate = (ContextCreateFnPtr)rsContextCreate;
+    t->GetName = (GetNameFnPtr)rsaGetName;
+    t->ContextDestroy = (ContextDestroyFnPtr)rsContextDestroy;
+    t->ContextGetMessage = (ContextGetMessageFnPtr)rsContextGetMessage;
+    t->ContextPeekMessage = (ContextPeekMessageFnPtr)rsContextPeekMessage;
+    t->ContextSendMessage = (ContextSendMessageFnPtr)rsContextSendMessage;
+    t->ContextInitToClient = (ContextInitToClientFnPtr)rsContextInitToClient;
+    t->ContextDeinitToClient = (ContextDeinitToClientFnPtr)rsContextDeinitToClient;
+    t->TypeCreate = (TypeCreateFnPtr)rsTypeCreate;
+    t->AllocationCreateTyped = (AllocationCreateTypedFnPtr)rsAllocationCreateTyped;
+    t->AllocationCreateFromBitmap = (AllocationCreateFromBitmapFnPtr)rsAllocationCreateFromBitmap;
+    t->AllocationCubeCreateFromBitmap = (AllocationCubeCreateFromBitmapFnPtr)rsAllocationCubeCreateFromBitmap;
+    t->AllocationGetSurface = (AllocationGetSurfaceFnPtr)rsAllocationGetSurface;
+    t->AllocationSetSurface = (AllocationSetSurfaceFnPtr)rsAllocationSetSurface;
+    t->ContextFinish = (ContextFinishFnPtr)rsContextFinish;
+    t->ContextFlush = (ContextFlushFnPtr)rsContextFlush;
+    t->ContextDump = (ContextDumpFnPtr)rsContextDump;
+    t->ContextSetPriority = (ContextSetPriorityFnPtr)rsContextSetPriority;
+    t->AssignName = (AssignNameFnPtr)rsAssignName;
+    t->ObjDestroy = (ObjDestroyFnPtr)rsObjDestroy;
+    t->ElementCreate = (ElementCreateFnPtr)rsElementCreate;
+    t->ElementCreate2 = (ElementCreate2FnPtr)rsElementCreate2;
+    t->AllocationCopyToBitmap = (AllocationCopyToBitmapFnPtr)rsAllocationCopyToBitmap;
+    t->Allocation1DData = (Allocation1DDataFnPtr)rsAllocation1DData;
+    t->Allocation1DElementData = (Allocation1DElementDataFnPtr)rsAllocation1DElementData;
+    t->AllocationElementDataBatch = (AllocationElementDataBatchFnPtr)rsAllocationElementDataBatch;
+    t->Allocation2DData = (Allocation2DDataFnPtr)rsAllocation2DData;
+    t->Allocation3DData = (Allocation3DDataFnPtr)rsAllocation3DData;
+    t->AllocationGenerateMipmaps = (AllocationGenerateMipmapsFnPtr)rsAllocationGenerateMipmaps;
+    t->AllocationRead = (AllocationReadFnPtr)rsAllocationRead;
+    t->Allocation1DRead = (Allocation1DReadFnPtr)rsAllocation1DRead;
+    t->Allocation2DRead = (Allocation2DReadFnPtr)rsAllocation2DRead;
+    t->AllocationSyncAll = (AllocationSyncAllFnPtr)rsAllocationSyncAll;
+    t->AllocationResize1D = (AllocationResize1DFnPtr)rsAllocationResize1D;
+    t->AllocationReserve1D = (AllocationReserve1DFnPtr)rsAllocationReserve1D;
+    t->AllocationCopy2DRange = (AllocationCopy2DRangeFnPtr)rsAllocationCopy2DRange;
+    t->AllocationCopy3DRange = (AllocationCopy3DRangeFnPtr)rsAllocationCopy3DRange;
+    t->AllocationCopyConvert = (AllocationCopyConvertFnPtr)rsAllocationCopyConvert;
+    t->SamplerCreate = (SamplerCreateFnPtr)rsSamplerCreate;
+    t->ScriptBindAllocation = (ScriptBindAllocationFnPtr)rsScriptBindAllocation;
+    t->ScriptSetTimeZone = (ScriptSetTimeZoneFnPtr)rsScriptSetTimeZone;
+    t->ScriptInvoke = (ScriptInvokeFnPtr)rsScriptInvoke;
+    t->ScriptInvokeV = (ScriptInvokeVFnPtr)rsScriptInvokeV;
+    t->ScriptForEach = (ScriptForEachFnPtr)rsScriptForEach;
+    t->ScriptForEachMulti = (ScriptForEachMultiFnPtr)rsScriptForEachMulti;
+    t->ScriptReduce = (ScriptReduceFnPtr)rsScriptReduce;
+    t->ScriptSetVarI = (ScriptSetVarIFnPtr)rsScriptSetVarI;
+    t->ScriptSetVarObj = (ScriptSetVarObjFnPtr)rsScriptSetVarObj;
+    t->ScriptSetVarJ = (ScriptSetVarJFnPtr)rsScriptSetVarJ;
+    t->ScriptSetVarF = (ScriptSetVarFFnPtr)rsScriptSetVarF;
+    t->ScriptSetVarD = (ScriptSetVarDFnPtr)rsScriptSetVarD;
+    t->ScriptSetVarV = (ScriptSetVarVFnPtr)rsScriptSetVarV;
+    t->ScriptSetVars = (ScriptSetVarsFnPtr)rsScriptSetVars;
+    t->ScriptGetVarV = (ScriptGetVarVFnPtr)rsScriptGetVarV;
+    t->ScriptSetVarVE = (ScriptSetVarVEFnPtr)rsScriptSetVarVE;
+    t->ScriptCCreate = (ScriptCCreateFnPtr)rsScriptCCreate;
+    t->ScriptIntrinsicCreate = (ScriptIntrinsicCreateFnPtr)rsScriptIntrinsicCreate;
+    t->ScriptKernelIDCreate = (ScriptKernelIDCreateFnPtr)rsScriptKernelIDCreate;
+    t->ScriptFieldIDCreate = (ScriptFieldIDCreateFnPtr)rsScriptFieldIDCreate;
+    t->ScriptGroupCreate = (ScriptGroupCreateFnPtr)rsScriptGroupCreate;
+    t->ScriptGroupSetOutput = (ScriptGroupSetOutputFnPtr)rsScriptGroupSetOutput;
+    t->ScriptGroupSetInput = (ScriptGroupSetInputFnPtr)rsScriptGroupSetInput;
+    t->ScriptGroupExecute = (ScriptGroupExecuteFnPtr)rsScriptGroupExecute;
+    t->AllocationIoSend = (AllocationIoSendFnPtr)rsAllocationIoSend;
+    t->AllocationIoReceive = (AllocationIoReceiveFnPtr)rsAllocationIoReceive;
+    t->AllocationSetIoInputQueue = (AllocationSetIoInputQueueFnPtr)rsAllocationSetIoInputQueue;
+    t->ContextFence = (ContextFenceFnPtr)rsContextFence;
+    t->Allocation1DReadAsync = (Allocation1DReadAsyncFnPtr)rsAllocation1DReadAsync;
+    t->Allocation2DReadAsync = (Allocation2DReadAsyncFnPtr)rsAllocation2DReadAsync;
+    t->AllocationAdapterCreate = (AllocationAdapterCreateFnPtr)rsAllocationAdapterCreate;
+    t->AllocationAdapterOffset = (AllocationAdapterOffsetFnPtr)rsAllocationAdapterOffset;
+    t->AllocationExport = (AllocationExportFnPtr)rsAllocationExport;
+    t->AllocationImport = (AllocationImportFnPtr)rsAllocationImport;
+    t->AllocationGetPointer = (AllocationGetPointerFnPtr)rsAllocationGetPointer;
+    t->AllocationSort = (AllocationSortFnPtr)rsAllocationSort;
+    t->AllocationCompact = (AllocationCompactFnPtr)rsAllocationCompact;
+    t->ContextGetMemoryUsage = (ContextGetMemoryUsageFnPtr)rsContextGetMemoryUsage;
+    t->ScriptForEachRegions = (ScriptForEachRegionsFnPtr)rsScriptForEachRegions;
+    t->ScriptInvokeBatch = (ScriptInvokeBatchFnPtr)rsScriptInvokeBatch;
+    t->ContextTrimMemory = (ContextTrimMemoryFnPtr)rsContextTrimMemory;
+    t->CommandBufferCreate = (CommandBufferCreateFnPtr)rsCommandBufferCreate;
+    t->CommandBufferBegin = (CommandBufferBeginFnPtr)rsCommandBufferBegin;
+    t->CommandBufferMarkParam = (CommandBufferMarkParamFnPtr)rsCommandBufferMarkParam;
+    t->CommandBufferEnd = (CommandBufferEndFnPtr)rsCommandBufferEnd;
+    t->CommandBufferSubmit = (CommandBufferSubmitFnPtr)rsCommandBufferSubmit;
+    t->ScriptGroupSetPipelined = (ScriptGroupSetPipelinedFnPtr)rsScriptGroupSetPipelined;
+    return true;
+}
@@ -22,8 +22,10 @@
 #include <string.h>
 
 #include "rsThreadIO.h"
+#include "rsTrace.h"
 #include "rsScriptC.h"
 #include "rsScriptGroup.h"
+#include "rsCommandBuffer.h"
 #include "rsSampler.h"
 
 #if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
@@ -33,6 +35,8 @@
 #define ATRACE_ENABLED(...) false
 #define ATRACE_NAME(...)
 #define ATRACE_CALL(...)
+#define ATRACE_BEGIN(...)
+#define ATRACE_END(...)
 #endif
 
 #ifndef RS_COMPATIBILITY_LIB
@@ -53,6 +57,7 @@ namespace android {
 namespace renderscript {
 
 class Device;
+class FileA3D;
 
 #if 0
 #define CHECK_OBJ(o) { \
@@ -83,6 +88,9 @@ public:
     };
     Hal mHal;
 
+    // Declared ahead of the state caches so it outlives their objects.
+    ObjectSlab mObjectSlab;
+
     static Context * createContext(Device *, const RsSurfaceConfig *sc,
             RsContextType ct = RS_CONTEXT_TYPE_NORMAL,
             uint32_t flags = 0);
@@ -118,6 +126,13 @@ public:
 
     ScriptCState mScriptC;
     bool isSynchronous() {return mSynchronous;}
+    // Whether the calling thread may use mHal.funcs.launchThreads: any
+    // thread of a synchronous context, otherwise only the context's own.
+    bool canLaunchThreads() const {
+        return mSynchronous || pthread_equal(pthread_self(), mThreadId);
+    }
+    bool getBigCoresOnly() const {return mBigCoresOnly;}
+    bool getPerfHints() const {return mPerfHints;}
     bool setupCheck();
 
 #ifndef RS_COMPATIBILITY_LIB
@@ -131,6 +146,7 @@ public:
 
     void swapBuffers();
     void setRootScript(Script *);
+    Script * getRootScript() const {return mRootScript.get();}
     void setProgramRaster(ProgramRaster *);
     void setProgramVertex(ProgramVertex *);
     void setProgramFragment(ProgramFragment *);
@@ -152,6 +168,9 @@ public:
     void setSurface(uint32_t w, uint32_t h, RsNativeWindow sur);
 #endif
     void finish();
+    // Releases what the caches hold that is not in use, more of it at
+    // higher RsTrimMemoryLevel levels, and returns the bytes freed.
+    uint64_t trimMemory(int32_t level);
 
     void setPriority(int32_t p);
     void destroyWorkerThreadResources();
@@ -159,6 +178,20 @@ public:
     void assignName(ObjectBase *obj, const char *name, uint32_t len);
     void removeName(ObjectBase *obj);
 
+    // Drops the user references to objs.  Deferred objects lose their
+    // names now but are only released once the thread is idle.
+    void destroyObjects(const RsObjectBase *objs, size_t count, bool deferred);
+    void releaseDeferredDestroys(size_t count);
+
+    // Low priority work the context thread does a little at a time while
+    // no command is waiting.  A task returns the ms until it has more to
+    // do, 0 to run again as soon as the others have had their turn, or -1
+    // to wait until more commands have been played.  Tasks must not add
+    // or remove tasks.
+    typedef int32_t (*IdleTaskFunc)(Context *rsc, void *usr);
+    void addIdleTask(IdleTaskFunc func, void *usr);
+    void removeIdleTask(IdleTaskFunc func, void *usr);
+
     RsMessageToClientType peekMessageToClient(size_t *receiveLen, uint32_t *subID);
     RsMessageToClientType getMessageToClient(void *data, size_t *receiveLen, uint32_t *subID, size_t bufferLen);
     bool sendMessageToClient(const void *data, RsMessageToClientType cmdID, uint32_t subID, size_t len, bool waitForSpace) const;
@@ -199,6 +232,19 @@ public:
 
     mutable ThreadIO mIO;
 
+    // Records the commands sent to the context when debug.rs.trace is set.
+    TraceWriter *mTrace;
+
+    // The command buffer commands played are captured into, if any.
+    CommandBuffer *mRecordingCommands;
+
+    // Set by the driver while kernel launches that have already returned
+    // may still be running; finish() waits for them and clears it.
+    volatile bool mPendingAsyncWork;
+
+    // Set by RS_CONTEXT_DEFER_DESTROY; every destroy is deferred.
+    bool mDeferDestroy;
+
     // Timers
     enum Timers {
         RS_TIMER_IDLE,
@@ -223,6 +269,14 @@ public:
         bool mLogShadersUniforms;
         bool mLogVisual;
         uint32_t mDebugMaxThreads;
+        uint32_t mDebugSpinWait;
+        uint32_t mDebugPrefetchRows;
+        bool mDebugTexturePbo;
+        bool mDebugReadbackPbo;
+        bool mDebugTextureEglImage;
+        bool mDebugGLWorker;
+        uint32_t mDebugGpuTimer;
+        uint32_t mDebugPipelineFrames;
     } props;
 
     mutable struct {
@@ -234,9 +288,27 @@ public:
     static void printWatchdogInfo(void *ctx);
 
     void dumpDebug() const;
+    // Kernel launch statistics kept by the driver; see rsContextGetProfile.
+    uint32_t getProfile(RsKernelProfile *profiles, uint32_t count) const;
+    void dumpProfile() const;
+    // Called by the runtime and drivers, from any thread, as they take and
+    // give back memory for the context; see rsContextGetMemoryUsage.
+    void trackMemory(RsMemoryCategory category, ssize_t bytes) const;
+    void getMemoryUsage(RsMemoryUsage *usage, uint32_t count) const;
+    void dumpMemory() const;
     void setError(RsError e, const char *msg = NULL) const;
 
+    // Bumped whenever script code may have written allocations it wasn't
+    // handed as its output; see Script::markWrites.
+    volatile uint32_t mScriptWriteEpoch;
+
     mutable const ObjectBase * mObjHead;
+    // Guards mObjHead, the object caches and reference count checks on
+    // delete; see ObjectBase::asyncLock.
+    mutable pthread_mutex_t mObjectMutex;
+    // Open A3D files, for trimming their decoded objects; guarded by
+    // mObjectMutex.
+    Vector<FileA3D *> mFileA3Ds;
 
     uint32_t getDPI() const {return mDPI;}
     void setDPI(uint32_t dpi) {mDPI = dpi;}
@@ -266,6 +338,12 @@ protected:
     bool mPaused;
     mutable RsError mError;
 
+    struct MemoryCounter {
+        size_t current;
+        size_t peak;
+    };
+    mutable MemoryCounter mMemory[RS_MEMORY_CATEGORY_COUNT];
+
     pthread_t mThreadId;
     pid_t mNativeThreadId;
 
@@ -285,6 +363,8 @@ private:
     bool initContext(Device *, const RsSurfaceConfig *sc);
 
     bool mSynchronous;
+    bool mBigCoresOnly;
+    bool mPerfHints;
     bool initGLThread();
     void deinitEGL();
 
@@ -297,7 +377,29 @@ private:
     bool mHasSurface;
     bool mIsContextLite;
 
-    Vector<ObjectBase *> mNames;
+    // Objects named through assignName, bucketed by a hash of the name.
+    void growNames();
+    Vector<ObjectBase *> *mNameBuckets;
+    // Always a power of two.
+    uint32_t mNameBucketCount;
+    uint32_t mNameCount;
+
+    // Destroyed objects waiting for idle time, see destroyObjects.
+    Vector<ObjectBase *> mDeferredDestroys;
+
+    struct IdleTask {
+        IdleTaskFunc func;
+        void *usr;
+        uint64_t dueNs;
+    };
+    Vector<IdleTask> mIdleTasks;
+    int runIdleTasks(bool resumed);
+    static int idleCallback(void *ctx, bool resumed);
+    static int32_t deferredDestroyTask(Context *rsc, void *);
+    static int32_t halIdleTask(Context *rsc, void *);
+#ifndef RS_COMPATIBILITY_LIB
+    static int32_t fontIdleTask(Context *rsc, void *);
+#endif
 
     uint64_t mTimers[_RS_TIMER_TOTAL];
     Timers mTimerActive;
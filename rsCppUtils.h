@@ -259,6 +259,26 @@ T rsRound(T v, unsigned int r) {
     return res;
 }
 
+// FNV-1a steps for hashing object signatures, starting from RS_HASH_SEED.
+#define RS_HASH_SEED 2166136261u
+
+static inline uint32_t rsHashWord(uint32_t h, uint32_t v) {
+    return (h ^ v) * 16777619u;
+}
+
+static inline uint32_t rsHashPointer(uint32_t h, const void *p) {
+    const uint64_t v = (uintptr_t)p;
+    return rsHashWord(rsHashWord(h, (uint32_t)v), (uint32_t)(v >> 32));
+}
+
+static inline uint32_t rsHashBytes(uint32_t h, const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    for (size_t ct = 0; ct < len; ct++) {
+        h = rsHashWord(h, p[ct]);
+    }
+    return h;
+}
+
 static inline uint16_t rs888to565(uint32_t r, uint32_t g, uint32_t b) {
     uint16_t t = 0;
     t |= b >> 3;
@@ -282,6 +302,58 @@ static inline uint32_t rsBoxFilter8888(uint32_t i1, uint32_t i2, uint32_t i3, ui
     return (r >> 2) | ((g >> 2) << 8) | ((b >> 2) << 16) | ((a >> 2) << 24);
 }
 
+// IEEE 754 binary16 values are carried as their uint16_t bit patterns.
+static inline float rsHalfToFloat(uint16_t h) {
+    union { uint32_t u; float f; } v;
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    if (exp == 0x1f) {
+        // Inf and NaN, keeping the NaN payload.
+        v.u = sign | 0x7f800000 | (mant << 13);
+    } else if (exp) {
+        v.u = sign | ((exp + (127 - 15)) << 23) | (mant << 13);
+    } else if (!mant) {
+        v.u = sign;
+    } else {
+        // Denormal halves are normal floats.
+        exp = 127 - 15 + 1;
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+        }
+        v.u = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+    return v.f;
+}
+
+// Rounds to nearest even like the hardware conversions.  Values too large
+// for a half become infinities.
+static inline uint16_t rsFloatToHalf(float f) {
+    union { uint32_t u; float f; } v;
+    v.f = f;
+    uint32_t sign = (v.u >> 16) & 0x8000;
+    uint32_t abs = v.u & 0x7fffffff;
+    if (abs >= 0x7f800000) {
+        // Inf stays Inf and NaN stays quiet NaN.
+        return sign | 0x7c00 | ((abs > 0x7f800000) ? (0x200 | ((abs >> 13) & 0x3ff)) : 0);
+    }
+    if (abs >= 0x477ff000) {
+        return sign | 0x7c00;
+    }
+    if (abs < 0x38800000) {
+        // Below the smallest normal half: adding 0.5 lines the denormal
+        // mantissa up with the float one and lets the FPU do the rounding.
+        union { uint32_t u; float f; } d;
+        d.u = abs;
+        d.f += 0.5f;
+        return sign | (d.u - 0x3f000000);
+    }
+    uint32_t odd = (abs >> 13) & 1;
+    abs += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+    return sign | (abs >> 13);
+}
+
 }
 }
 
@@ -44,6 +44,7 @@ typedef void * RsScriptKernelID;
 typedef void * RsScriptFieldID;
 typedef void * RsScriptMethodID;
 typedef void * RsScriptGroup;
+typedef void * RsCommandBuffer;
 typedef void * RsMesh;
 typedef void * RsPath;
 typedef void * RsType;
@@ -82,6 +83,24 @@ enum RsContextType {
     RS_CONTEXT_TYPE_PROFILE
 };
 
+// Header of one field update in an AllocationElementDataBatch list.  The
+// field's sizeBytes of data follow it, padded to a multiple of 4 bytes.
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t component;
+    uint32_t sizeBytes;
+} RsElementDataRecord;
+
+// Header of one global update in a ScriptSetVars list.  The sizeBytes of
+// data follow it, padded to a multiple of 4 bytes; when isObject is set
+// they hold the RsObjectBase to store in the slot.
+typedef struct {
+    uint32_t slot;
+    uint32_t sizeBytes;
+    uint32_t isObject;
+} RsScriptVarRecord;
+
 typedef struct {
     uint32_t colorMin;
     uint32_t colorPref;
@@ -102,7 +121,8 @@ enum RsMessageToClientType {
     RS_MESSAGE_TO_CLIENT_RESIZE = 2,
     RS_MESSAGE_TO_CLIENT_ERROR = 3,
     RS_MESSAGE_TO_CLIENT_USER = 4,
-    RS_MESSAGE_TO_CLIENT_NEW_BUFFER = 5
+    RS_MESSAGE_TO_CLIENT_NEW_BUFFER = 5,
+    RS_MESSAGE_TO_CLIENT_FENCE = 6
 };
 
 enum RsAllocationUsageType {
@@ -115,7 +135,17 @@ enum RsAllocationUsageType {
     RS_ALLOCATION_USAGE_IO_OUTPUT = 0x0040,
     RS_ALLOCATION_USAGE_SHARED = 0x0080,
 
-    RS_ALLOCATION_USAGE_ALL = 0x00FF
+    RS_ALLOCATION_USAGE_ALL = 0x00FF,
+
+    // Stores each field of a struct Element in its own plane, one after
+    // the other, instead of whole structs cell by cell.  Kernels reach the
+    // fields through adapters of the field's Element.
+    RS_ALLOCATION_USAGE_FIELD_PLANES = 0x0100,
+    // Stores 2D allocations in 8x8 cell tiles and 3D ones in 4x4x4 cell
+    // bricks, so cells next to each other in any direction share pages
+    // and cache lines.  Scripts reach the cells through rsGetElementAt and
+    // rsSetElementAt only.
+    RS_ALLOCATION_USAGE_TILED = 0x0200
 };
 
 enum RsAllocationMipmapControl {
@@ -133,6 +163,15 @@ enum RsAllocationCubemapFace {
     RS_ALLOCATION_CUBEMAP_FACE_NEGATIVE_Z = 5
 };
 
+enum RsAllocationConversion {
+    // Components keep their value, as with a C cast, except that integers
+    // out of the destination's range are clamped to it and NaNs become 0.
+    RS_ALLOCATION_CONVERSION_CLAMP = 0,
+    // Unsigned integers map to [0, 1] and signed ones to [-1, 1], so 0xff
+    // becomes 1.0f or 0xffff, and floats scale back, rounding to nearest.
+    RS_ALLOCATION_CONVERSION_NORMALIZE = 1
+};
+
 enum RsDataType {
     RS_TYPE_NONE,
     RS_TYPE_FLOAT_16,
@@ -182,6 +221,12 @@ enum RsDataKind {
     RS_KIND_PIXEL_RGBA,
     RS_KIND_PIXEL_DEPTH,
     RS_KIND_PIXEL_YUV,
+    // Compressed textures.  Each cell holds one 4x4 block, so the Type is
+    // sized in blocks; the elements are unsigned 32 bit, 2 wide for ETC1
+    // and ETC2 RGB, 4 wide for ETC2 RGBA with EAC alpha.
+    RS_KIND_PIXEL_ETC1,
+    RS_KIND_PIXEL_ETC2_RGB,
+    RS_KIND_PIXEL_ETC2_RGBA,
 
     RS_KIND_INVALID = 100,
 };
@@ -287,6 +332,16 @@ enum RsPrimitive {
     RS_PRIMITIVE_INVALID = 100,
 };
 
+// Float vertex attributes MeshCompact converts to smaller types, picked
+// by field name.  Normals and colors become normalized integers.
+enum RsMeshCompactFlags {
+    RS_MESH_COMPACT_NONE = 0,
+    RS_MESH_COMPACT_POSITION_F16 = 0x0001,
+    RS_MESH_COMPACT_NORMAL_I16 = 0x0002,
+    RS_MESH_COMPACT_TEXTURE_F16 = 0x0004,
+    RS_MESH_COMPACT_COLOR_U8 = 0x0008,
+};
+
 enum RsPathPrimitive {
     RS_PATH_PRIMITIVE_QUADRATIC_BEZIER,
     RS_PATH_PRIMITIVE_CUBIC_BEZIER
@@ -344,7 +399,8 @@ enum RsA3DClassID {
     RS_A3D_CLASS_ID_SCRIPT_KERNEL_ID,
     RS_A3D_CLASS_ID_SCRIPT_FIELD_ID,
     RS_A3D_CLASS_ID_SCRIPT_METHOD_ID,
-    RS_A3D_CLASS_ID_SCRIPT_GROUP
+    RS_A3D_CLASS_ID_SCRIPT_GROUP,
+    RS_A3D_CLASS_ID_COMMAND_BUFFER
 };
 
 enum RsCullMode {
@@ -364,7 +420,94 @@ enum RsScriptIntrinsicID {
     RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB = 6,
     RS_SCRIPT_INTRINSIC_ID_BLEND = 7,
     RS_SCRIPT_INTRINSIC_ID_3DLUT = 8,
-    RS_SCRIPT_INTRINSIC_ID_HISTOGRAM = 9
+    RS_SCRIPT_INTRINSIC_ID_HISTOGRAM = 9,
+    RS_SCRIPT_INTRINSIC_ID_CONVOLVE = 10,
+    RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV = 11,
+    RS_SCRIPT_INTRINSIC_ID_RESIZE = 12,
+    RS_SCRIPT_INTRINSIC_ID_CONVERT = 13,
+    RS_SCRIPT_INTRINSIC_ID_PYRAMID = 14,
+    RS_SCRIPT_INTRINSIC_ID_ROTATE = 15,
+    RS_SCRIPT_INTRINSIC_ID_WARP = 16,
+    RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY = 17,
+    RS_SCRIPT_INTRINSIC_ID_MEDIAN = 18,
+    RS_SCRIPT_INTRINSIC_ID_BILATERAL = 19,
+    RS_SCRIPT_INTRINSIC_ID_INTEGRAL = 20,
+    RS_SCRIPT_INTRINSIC_ID_SCAN = 21,
+    RS_SCRIPT_INTRINSIC_ID_GEMM = 22,
+    RS_SCRIPT_INTRINSIC_ID_ETC1_ENCODE = 23,
+    RS_SCRIPT_INTRINSIC_ID_DEMOSAIC = 24,
+    RS_SCRIPT_INTRINSIC_ID_CONVOLVE_Q8 = 25
+};
+
+enum RsScriptIntrinsic3DLUTInterpolation {
+    RS_3DLUT_INTERPOLATION_TRILINEAR = 0,
+    RS_3DLUT_INTERPOLATION_TETRAHEDRAL = 1
+};
+
+enum RsScriptIntrinsicResizeMode {
+    RS_RESIZE_BILINEAR = 0,
+    RS_RESIZE_BICUBIC = 1,
+    RS_RESIZE_AREA = 2
+};
+
+enum RsScriptIntrinsicYuvRotation {
+    RS_YUV_ROTATE_0 = 0,
+    RS_YUV_ROTATE_90 = 1,
+    RS_YUV_ROTATE_180 = 2,
+    RS_YUV_ROTATE_270 = 3
+};
+
+enum RsScriptIntrinsicYuvScale {
+    RS_YUV_SCALE_BOX = 0,
+    RS_YUV_SCALE_BILINEAR = 1
+};
+
+enum RsScriptIntrinsicPyramidMode {
+    RS_PYRAMID_GAUSSIAN = 0,
+    RS_PYRAMID_LAPLACIAN = 1
+};
+
+enum RsScriptIntrinsicRotateMode {
+    RS_ROTATE_TRANSPOSE = 0,
+    RS_ROTATE_90 = 1,
+    RS_ROTATE_180 = 2,
+    RS_ROTATE_270 = 3,
+    RS_ROTATE_FLIP_HORIZONTAL = 4,
+    RS_ROTATE_FLIP_VERTICAL = 5
+};
+
+enum RsScriptIntrinsicWarpFilter {
+    RS_WARP_BILINEAR = 0,
+    RS_WARP_BICUBIC = 1
+};
+
+enum RsScriptIntrinsicMorphologyOp {
+    RS_MORPHOLOGY_ERODE = 0,
+    RS_MORPHOLOGY_DILATE = 1
+};
+
+enum RsScriptIntrinsicBilateralMode {
+    RS_BILATERAL_AUTO = 0,
+    RS_BILATERAL_DIRECT = 1,
+    RS_BILATERAL_GRID = 2
+};
+
+enum RsScriptIntrinsicScanMode {
+    RS_SCAN_INCLUSIVE = 0,
+    RS_SCAN_EXCLUSIVE = 1
+};
+
+// Colours of the top left 2x2 quad of a Bayer mosaic, in reading order.
+enum RsScriptIntrinsicDemosaicPattern {
+    RS_DEMOSAIC_RGGB = 0,
+    RS_DEMOSAIC_BGGR = 1,
+    RS_DEMOSAIC_GRBG = 2,
+    RS_DEMOSAIC_GBRG = 3
+};
+
+enum RsScriptIntrinsicDemosaicInterpolation {
+    RS_DEMOSAIC_BILINEAR = 0,
+    RS_DEMOSAIC_EDGE_AWARE = 1
 };
 
 typedef struct {
@@ -381,6 +524,22 @@ enum RsForEachStrategy {
     RS_FOR_EACH_STRATEGY_TILE_LARGE = 5
 };
 
+enum RsForEachPriority {
+    RS_FOR_EACH_PRIORITY_DEFAULT = 0,
+    // Background work; uses at most half of the workers, and the slowest
+    // ones on heterogeneous CPUs.
+    RS_FOR_EACH_PRIORITY_BACKGROUND = 1
+};
+
+// One rectangle of cells a launch covers, as passed to
+// rsScriptForEachRegions.
+typedef struct {
+    uint32_t xStart;
+    uint32_t xEnd;
+    uint32_t yStart;
+    uint32_t yEnd;
+} RsScriptRect;
+
 // Script to Script
 typedef struct {
     enum RsForEachStrategy strategy;
@@ -393,12 +552,83 @@ typedef struct {
     uint32_t arrayStart;
     uint32_t arrayEnd;
 
+    // Launch hints.  Callers built against the original layout stop at
+    // arrayEnd and get the defaults.
+    uint32_t maxThreads;    // 0 for no limit
+    enum RsForEachPriority priority;
+
+    // Rectangles covered instead of the x and y ranges.  Only set by the
+    // runtime for rsScriptForEachRegions; what callers pass is ignored.
+    const RsScriptRect *regions;
+    uint32_t regionCount;
 } RsScriptCall;
 
+// Workers broken out in RsKernelProfile::busyNs; any others are added to
+// the last entry.
+#define RS_KERNEL_PROFILE_WORKERS 8
+
+// Slot of the entries timing a graphics script's draws on the GPU, with
+// debug.rs.gpu-timer set.  dimX is the draw group's place in the frame,
+// launches the frames it was timed in and wallNs its GPU time.
+#define RS_KERNEL_PROFILE_SLOT_GPU 0xffffffff
+
+// Launch statistics for one kernel slot of a script at one launch shape, as
+// returned by rsContextGetProfile.  Times are in nanoseconds.
+typedef struct {
+    RsScript script;
+    uint32_t slot;
+    uint32_t dimX;
+    uint32_t dimY;
+    uint32_t dimZ;
+    uint64_t launches;
+    uint64_t wallNs;
+    uint64_t slices;
+    uint64_t steals;
+    // Time each worker spent in the launches, worker 0 being the thread
+    // submitting them.
+    uint64_t busyNs[RS_KERNEL_PROFILE_WORKERS];
+} RsKernelProfile;
+
+// What a context's memory is held for, as reported by
+// rsContextGetMemoryUsage.  Allocations are counted by where their cells
+// live; GL objects are estimated from their formats and sizes.
+enum RsMemoryCategory {
+    RS_MEMORY_ALLOCATION_SCRIPT,
+    RS_MEMORY_ALLOCATION_GRAPHICS,
+    RS_MEMORY_ALLOCATION_SHARED,
+    RS_MEMORY_SCRIPT_CODE,
+    RS_MEMORY_SCRIPT_DATA,
+    RS_MEMORY_GL_OBJECTS,
+    RS_MEMORY_FONT_CACHE,
+    // All of the above, with its own peak.
+    RS_MEMORY_TOTAL,
+    RS_MEMORY_CATEGORY_COUNT
+};
+
+typedef struct {
+    uint64_t currentBytes;
+    uint64_t peakBytes;
+} RsMemoryUsage;
+
+// Levels of rsContextTrimMemory, matching Android's onTrimMemory levels.
+enum RsTrimMemoryLevel {
+    RS_TRIM_MEMORY_RUNNING_MODERATE = 5,
+    RS_TRIM_MEMORY_RUNNING_LOW = 10,
+    RS_TRIM_MEMORY_RUNNING_CRITICAL = 15,
+    RS_TRIM_MEMORY_UI_HIDDEN = 20,
+    RS_TRIM_MEMORY_BACKGROUND = 40,
+    RS_TRIM_MEMORY_MODERATE = 60,
+    RS_TRIM_MEMORY_COMPLETE = 80
+};
+
 enum RsContextFlags {
     RS_CONTEXT_SYNCHRONOUS = 1,
     RS_CONTEXT_LOW_LATENCY = 2,
-    RS_CONTEXT_MAX = 4
+    RS_CONTEXT_BIG_CORES = 4,
+    RS_CONTEXT_BATCH_COMMANDS = 8,
+    RS_CONTEXT_DEFER_DESTROY = 16,
+    RS_CONTEXT_PERF_HINTS = 32,
+    RS_CONTEXT_MAX = 64
 };
 
 
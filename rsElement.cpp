@@ -28,6 +28,8 @@ Element::Element(Context *rsc) : ObjectBase(rsc) {
     mFieldCount = 0;
     mHasReference = false;
     memset(&mHal, 0, sizeof(mHal));
+    mHashNext = NULL;
+    mHashKey = 0;
 }
 
 Element::~Element() {
@@ -35,12 +37,7 @@ Element::~Element() {
 }
 
 void Element::preDestroy() const {
-    for (uint32_t ct = 0; ct < mRSC->mStateElement.mElements.size(); ct++) {
-        if (mRSC->mStateElement.mElements[ct] == this) {
-            mRSC->mStateElement.mElements.removeAt(ct);
-            break;
-        }
-    }
+    mRSC->mStateElement.remove(this);
 }
 
 void Element::clear() {
@@ -218,47 +215,71 @@ void Element::compute() {
     mHal.state.elementSizeBytes = getSizeBytes();
 }
 
+static uint32_t hashSimpleElement(RsDataType dt, RsDataKind dk, bool isNorm,
+                                  uint32_t vecSize) {
+    uint32_t h = rsHashWord(RS_HASH_SEED, dt);
+    h = rsHashWord(h, dk);
+    h = rsHashWord(h, isNorm);
+    h = rsHashWord(h, vecSize);
+    return h ^ (h >> 15);
+}
+
 ObjectBaseRef<const Element> Element::createRef(Context *rsc, RsDataType dt, RsDataKind dk,
                                 bool isNorm, uint32_t vecSize) {
     ObjectBaseRef<const Element> returnRef;
+    const uint32_t key = hashSimpleElement(dt, dk, isNorm, vecSize);
     // Look for an existing match.
-    ObjectBase::asyncLock();
-    for (uint32_t ct=0; ct < rsc->mStateElement.mElements.size(); ct++) {
-        const Element *ee = rsc->mStateElement.mElements[ct];
-        if (!ee->getFieldCount() &&
+    ObjectBase::asyncLock(rsc);
+    for (const Element *ee = rsc->mStateElement.getChain(key); ee; ee = ee->mHashNext) {
+        if ((ee->mHashKey == key) &&
+            !ee->getFieldCount() &&
             (ee->getComponent().getType() == dt) &&
             (ee->getComponent().getKind() == dk) &&
             (ee->getComponent().getIsNormalized() == isNorm) &&
             (ee->getComponent().getVectorSize() == vecSize)) {
             // Match
             returnRef.set(ee);
-            ObjectBase::asyncUnlock();
+            ObjectBase::asyncUnlock(rsc);
             return ee;
         }
     }
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncUnlock(rsc);
 
-    Element *e = new Element(rsc);
+    Element *e = new (rsc) Element(rsc);
     returnRef.set(e);
     e->mComponent.set(dt, dk, isNorm, vecSize);
     e->compute();
 
-    ObjectBase::asyncLock();
-    rsc->mStateElement.mElements.push(e);
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncLock(rsc);
+    rsc->mStateElement.add(e, key);
+    ObjectBase::asyncUnlock(rsc);
 
     return returnRef;
 }
 
+// Hashes the identity, name and array size of every field, which is what
+// makes two struct elements the same.
+static uint32_t hashStructElement(size_t count, const Element **ein, const char **nin,
+                                  const size_t * lengths, const uint32_t *asin) {
+    uint32_t h = rsHashWord(RS_HASH_SEED, count);
+    for (size_t ct = 0; ct < count; ct++) {
+        const size_t len = lengths ? lengths[ct] : strlen(nin[ct]);
+        h = rsHashPointer(h, ein[ct]);
+        h = rsHashBytes(h, nin[ct], len);
+        h = rsHashWord(h, asin ? asin[ct] : 1);
+    }
+    return h ^ (h >> 15);
+}
+
 ObjectBaseRef<const Element> Element::createRef(Context *rsc, size_t count, const Element **ein,
                             const char **nin, const size_t * lengths, const uint32_t *asin) {
 
     ObjectBaseRef<const Element> returnRef;
+    const uint32_t key = hashStructElement(count, ein, nin, lengths, asin);
     // Look for an existing match.
-    ObjectBase::asyncLock();
-    for (uint32_t ct=0; ct < rsc->mStateElement.mElements.size(); ct++) {
-        const Element *ee = rsc->mStateElement.mElements[ct];
-        if (ee->getFieldCount() == count) {
+    ObjectBase::asyncLock(rsc);
+    for (const Element *ee = rsc->mStateElement.getChain(key); ee; ee = ee->mHashNext) {
+        if ((ee->mHashKey == key) && (ee->getFieldCount() == count)) {
             bool match = true;
             for (uint32_t i=0; i < count; i++) {
                 size_t len;
@@ -282,14 +303,14 @@ ObjectBaseRef<const Element> Element::createRef(Context *rsc, size_t count, cons
             }
             if (match) {
                 returnRef.set(ee);
-                ObjectBase::asyncUnlock();
+                ObjectBase::asyncUnlock(rsc);
                 return returnRef;
             }
         }
     }
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncUnlock(rsc);
 
-    Element *e = new Element(rsc);
+    Element *e = new (rsc) Element(rsc);
     returnRef.set(e);
     e->mFields = new ElementField_t [count];
     e->mFieldCount = count;
@@ -311,9 +332,9 @@ ObjectBaseRef<const Element> Element::createRef(Context *rsc, size_t count, cons
     }
     e->compute();
 
-    ObjectBase::asyncLock();
-    rsc->mStateElement.mElements.push(e);
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncLock(rsc);
+    rsc->mStateElement.add(e, key);
+    ObjectBase::asyncUnlock(rsc);
 
     return returnRef;
 }
@@ -363,10 +384,66 @@ void Element::decRefs(const void *ptr) const {
 }
 
 ElementState::ElementState() {
+    mBucketCount = kMinBuckets;
+    mBuckets = new Element *[mBucketCount]();
+    mCount = 0;
 }
 
 ElementState::~ElementState() {
-    rsAssert(!mElements.size());
+    rsAssert(!mCount);
+    delete [] mBuckets;
+}
+
+size_t ElementState::trim() {
+    uint32_t count = kMinBuckets;
+    while (count < mCount) {
+        count *= 2;
+    }
+    if (count >= mBucketCount) {
+        return 0;
+    }
+    const size_t freed = (mBucketCount - count) * sizeof(Element *);
+    resize(count);
+    return freed;
+}
+
+void ElementState::add(Element *e, uint32_t key) {
+    if (mCount >= mBucketCount) {
+        resize(mBucketCount * 2);
+    }
+    e->mHashKey = key;
+    Element **bucket = &mBuckets[key & (mBucketCount - 1)];
+    e->mHashNext = *bucket;
+    *bucket = e;
+    mCount++;
+}
+
+void ElementState::remove(const Element *e) {
+    for (Element **link = &mBuckets[e->mHashKey & (mBucketCount - 1)]; *link;
+         link = &(*link)->mHashNext) {
+        if (*link == e) {
+            *link = e->mHashNext;
+            mCount--;
+            return;
+        }
+    }
+}
+
+void ElementState::resize(uint32_t count) {
+    Element **buckets = new Element *[count]();
+    for (uint32_t ct = 0; ct < mBucketCount; ct++) {
+        Element *e = mBuckets[ct];
+        while (e) {
+            Element *next = e->mHashNext;
+            Element **bucket = &buckets[e->mHashKey & (count - 1)];
+            e->mHashNext = *bucket;
+            *bucket = e;
+            e = next;
+        }
+    }
+    delete [] mBuckets;
+    mBuckets = buckets;
+    mBucketCount = count;
 }
 
 /////////////////////////////////////////
@@ -132,6 +132,12 @@ public:
     void decRefs(const void *) const;
     bool getHasReferences() const {return mHasReference;}
 
+    void * operator new(size_t size, Context *rsc) {
+        return ObjectBase::slabAlloc(rsc, size);
+    }
+    void operator delete(void *ptr) { ObjectSlab::release(ptr); }
+    void operator delete(void *ptr, Context *) { ObjectSlab::release(ptr); }
+
 protected:
     // deallocate any components that are part of this element.
     void clear();
@@ -158,6 +164,13 @@ protected:
     void compute();
 
     virtual void preDestroy() const;
+
+private:
+    friend class ElementState;
+
+    // Chaining and structure hash for the ElementState cache.
+    Element *mHashNext;
+    uint32_t mHashKey;
 };
 
 
@@ -166,8 +179,26 @@ public:
     ElementState();
     ~ElementState();
 
-    // Cache of all existing elements.
-    Vector<Element *> mElements;
+    // Cache of all existing elements, hashed on their structure.  All
+    // three must be called with the context's ObjectBase::asyncLock held.
+    // Returns the chain holding the elements with hash key, which may
+    // also hold elements with other keys.
+    Element * getChain(uint32_t key) const {
+        return mBuckets[key & (mBucketCount - 1)];
+    }
+    void add(Element *e, uint32_t key);
+    void remove(const Element *e);
+    // Shrinks the table to fit the entries left, returning the bytes freed.
+    size_t trim();
+
+private:
+    static const uint32_t kMinBuckets = 64;
+    void resize(uint32_t count);
+
+    Element **mBuckets;
+    // Always a power of two.
+    uint32_t mBucketCount;
+    uint32_t mCount;
 };
 
 
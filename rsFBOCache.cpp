@@ -24,6 +24,7 @@ using namespace android::renderscript;
 
 
 FBOCache::FBOCache() {
+    mHal.drv = NULL;
     mDirty = true;
     mHal.state.colorTargetsCount = 1;
     mHal.state.colorTargets = new Allocation*[mHal.state.colorTargetsCount];
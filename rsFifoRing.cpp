@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsFifoRing.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+using namespace android;
+using namespace android::renderscript;
+
+// Marks the unused tail of the buffer when a record didn't fit before the
+// end and was placed at the start instead.
+static const uint32_t RECORD_WRAP = 0xffffffff;
+
+FifoRing::FifoRing() {
+    mBuffer = NULL;
+    mSize = 0;
+    mWriteLocal = 0;
+    mWritePos = 0;
+    mReadPos = 0;
+    mPendingBytes = 0;
+    mPeekBytes = 0;
+    mReaderWaiting = 0;
+    mWriterWaiting = 0;
+    mDataFd = -1;
+    mSpaceFd = -1;
+    mShutdown = false;
+}
+
+FifoRing::~FifoRing() {
+    free(mBuffer);
+    if (mDataFd >= 0) {
+        close(mDataFd);
+    }
+    if (mSpaceFd >= 0) {
+        close(mSpaceFd);
+    }
+}
+
+bool FifoRing::init(size_t size) {
+    rsAssert(rsIsPow2(size));
+    mDataFd = eventfd(0, EFD_NONBLOCK);
+    mSpaceFd = eventfd(0, EFD_NONBLOCK);
+    if ((mDataFd < 0) || (mSpaceFd < 0)) {
+        ALOGE("FifoRing eventfd failed");
+        return false;
+    }
+    if (posix_memalign((void **)&mBuffer, sizeof(RecordHeader), size)) {
+        mBuffer = NULL;
+        return false;
+    }
+    mSize = size;
+    return true;
+}
+
+void FifoRing::shutdown() {
+    mShutdown = true;
+    __sync_synchronize();
+    ring(mDataFd);
+    ring(mSpaceFd);
+}
+
+void FifoRing::ring(int fd) {
+    uint64_t one = 1;
+    ssize_t r = ::write(fd, &one, sizeof(one));
+    rsAssert(r == sizeof(one));
+}
+
+void FifoRing::drain(int fd) {
+    // Non-blocking; an unrung doorbell has nothing to read.
+    uint64_t count;
+    ssize_t r = ::read(fd, &count, sizeof(count));
+    (void)r;
+}
+
+void * FifoRing::reserve(size_t bytes) {
+    const uint32_t need = sizeof(RecordHeader) + rsRound((uint32_t)bytes, sizeof(RecordHeader));
+    rsAssert(need <= mSize / 2);
+
+    const uint32_t off = mWriteLocal & (mSize - 1);
+    const uint32_t skip = (off + need > mSize) ? (mSize - off) : 0;
+
+    // The space is free once the reader is past where the record ends,
+    // one lap back.
+    waitForRelease(mWriteLocal + skip + need - mSize);
+
+    if (skip) {
+        ((RecordHeader *)&mBuffer[off])->bytes = RECORD_WRAP;
+    }
+    RecordHeader *hdr = (RecordHeader *)&mBuffer[(off + skip) & (mSize - 1)];
+    hdr->bytes = bytes;
+    mPendingBytes = skip + need;
+    return &hdr[1];
+}
+
+void FifoRing::commit(bool publish) {
+    mWriteLocal += mPendingBytes;
+    mPendingBytes = 0;
+    if (publish) {
+        flush();
+    }
+}
+
+void FifoRing::flush() {
+    if (mWritePos == mWriteLocal) {
+        return;
+    }
+    __sync_synchronize();
+    mWritePos = mWriteLocal;
+    __sync_synchronize();
+    if (mReaderWaiting) {
+        ring(mDataFd);
+    }
+}
+
+void FifoRing::waitForRelease(uint32_t pos) {
+    // The writer only sleeps once it has said so and seen the reader
+    // still short of pos, so a release made in between can't go
+    // unnoticed.  Anything held back in a batch goes first, or the reader
+    // might never get there.
+    while (!mShutdown && !readerReached(pos)) {
+        flush();
+        mWriterWaiting = 1;
+        __sync_synchronize();
+        if (!readerReached(pos)) {
+            struct pollfd p;
+            p.fd = mSpaceFd;
+            p.events = POLLIN;
+            p.revents = 0;
+            poll(&p, 1, -1);
+        }
+        mWriterWaiting = 0;
+        drain(mSpaceFd);
+    }
+}
+
+const void * FifoRing::peek(size_t *bytes) {
+    if (isEmpty()) {
+        return NULL;
+    }
+    __sync_synchronize();
+
+    uint32_t off = mReadPos & (mSize - 1);
+    const RecordHeader *hdr = (const RecordHeader *)&mBuffer[off];
+    mPeekBytes = 0;
+    if (hdr->bytes == RECORD_WRAP) {
+        mPeekBytes = mSize - off;
+        hdr = (const RecordHeader *)&mBuffer[0];
+    }
+    mPeekBytes += sizeof(RecordHeader) + rsRound(hdr->bytes, sizeof(RecordHeader));
+    *bytes = hdr->bytes;
+    return &hdr[1];
+}
+
+void FifoRing::release() {
+    __sync_synchronize();
+    mReadPos += mPeekBytes;
+    mPeekBytes = 0;
+    __sync_synchronize();
+    if (mWriterWaiting) {
+        ring(mSpaceFd);
+    }
+}
+
+bool FifoRing::prepareWait() {
+    mReaderWaiting = 1;
+    __sync_synchronize();
+    return isEmpty() && !mShutdown;
+}
+
+void FifoRing::finishWait() {
+    mReaderWaiting = 0;
+    drain(mDataFd);
+}
+
+void FifoRing::waitForData() {
+    while (isEmpty() && !mShutdown) {
+        if (prepareWait()) {
+            struct pollfd p;
+            p.fd = mDataFd;
+            p.events = POLLIN;
+            p.revents = 0;
+            poll(&p, 1, -1);
+        }
+        finishWait();
+    }
+}
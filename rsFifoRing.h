@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RS_FIFO_RING_H
+#define ANDROID_RS_FIFO_RING_H
+
+
+#include "rsUtils.h"
+
+namespace android {
+namespace renderscript {
+
+
+// A single producer, single consumer ring of variable sized records in
+// memory shared by both threads.  Neither side makes a system call while
+// the other is awake; an eventfd doorbell is only rung when the reader is
+// waiting for records or the writer for space.
+class FifoRing {
+public:
+    FifoRing();
+    ~FifoRing();
+
+    // size must be a power of two.
+    bool init(size_t size);
+    void shutdown();
+
+    // Writer side.  Returns space for a record of bytes, waiting for the
+    // reader to free some if the ring is full.  The record is only seen
+    // by the reader once committed with publish set, or once flushed;
+    // records committed without it build up into a single batch.
+    void * reserve(size_t bytes);
+    size_t getMaxRecordBytes() const {
+        return mSize / 2 - sizeof(RecordHeader);
+    }
+    void commit(bool publish = true);
+    void flush();
+
+    // Identifies everything committed so far.  waitForRelease publishes
+    // it and returns once the reader has released all of it, so memory
+    // those records point to is no longer in use.
+    uint32_t getWriteToken() const {return mWriteLocal;}
+    void waitForRelease(uint32_t token);
+
+    // Reader side.  Returns the oldest committed record, or NULL when the
+    // ring is empty.  It stays valid until release.
+    const void * peek(size_t *bytes);
+    void release();
+    bool isEmpty() const {
+        return mReadPos == mWritePos;
+    }
+
+    // Readers about to poll getWaitFd call prepareWait, and only poll if
+    // it returns true, meaning the ring is still empty.  finishWait must
+    // follow either way.
+    bool prepareWait();
+    void finishWait();
+    int getWaitFd() const {return mDataFd;}
+    // Waits until there is a record to peek or the ring is shut down.
+    void waitForData();
+
+protected:
+    struct RecordHeader {
+        uint32_t bytes;
+        uint32_t pad;
+    };
+
+    static void ring(int fd);
+    static void drain(int fd);
+    bool readerReached(uint32_t pos) const {
+        return (int32_t)(mReadPos - pos) >= 0;
+    }
+
+    uint8_t *mBuffer;
+    uint32_t mSize;
+
+    // Free running, masked by mSize - 1 to index mBuffer.  mWriteLocal
+    // is the writer's end of the records committed so far, mWritePos the
+    // end of those published to the reader.
+    uint32_t mWriteLocal;
+    volatile uint32_t mWritePos;
+    volatile uint32_t mReadPos;
+    uint32_t mPendingBytes;
+    uint32_t mPeekBytes;
+
+    volatile int32_t mReaderWaiting;
+    volatile int32_t mWriterWaiting;
+    int mDataFd;
+    int mSpaceFd;
+    bool mShutdown;
+};
+
+}
+}
+
+#endif
@@ -21,6 +21,10 @@
 #include "rsMesh.h"
 #include "rsAnimation.h"
 #include "rs.h"
+#include "rsCompress.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #if !defined(__RS_PDK__)
     #include <androidfw/Asset.h>
@@ -29,16 +33,42 @@
 using namespace android;
 using namespace android::renderscript;
 
+FileA3DMapping::FileA3DMapping(Context *rsc, void *base, size_t size) : ObjectBase(rsc) {
+    mBase = base;
+    mSize = size;
+}
+
+FileA3DMapping::~FileA3DMapping() {
+    munmap(mBase, mSize);
+}
+
 FileA3D::FileA3D(Context *rsc) : ObjectBase(rsc) {
     mAlloc = NULL;
     mData = NULL;
-    mWriteStream = NULL;
     mReadStream = NULL;
     mAsset = NULL;
+    mNameTable = NULL;
+    mNameTableMask = 0;
+    pthread_mutex_init(&mEntryMutex, NULL);
 
     mMajorVersion = 0;
     mMinorVersion = 1;
+    mUse64BitOffsets = false;
+    mCompressed = false;
     mDataSize = 0;
+
+    ObjectBase::asyncLock(rsc);
+    rsc->mFileA3Ds.push(this);
+    ObjectBase::asyncUnlock(rsc);
+}
+
+void FileA3D::preDestroy() const {
+    for (uint32_t ct = 0; ct < mRSC->mFileA3Ds.size(); ct++) {
+        if (mRSC->mFileA3Ds[ct] == this) {
+            mRSC->mFileA3Ds.removeAt(ct);
+            break;
+        }
+    }
 }
 
 FileA3D::~FileA3D() {
@@ -48,11 +78,8 @@ FileA3D::~FileA3D() {
     for (size_t i = 0; i < mWriteIndex.size(); i ++) {
         delete mWriteIndex[i];
     }
-    if (mWriteStream) {
-        delete mWriteStream;
-    }
     if (mReadStream) {
-        delete mWriteStream;
+        delete mReadStream;
     }
     if (mAlloc) {
         free(mAlloc);
@@ -62,13 +89,16 @@ FileA3D::~FileA3D() {
         delete mAsset;
 #endif
     }
+    delete[] mNameTable;
+    pthread_mutex_destroy(&mEntryMutex);
 }
 
 void FileA3D::parseHeader(IStream *headerStream) {
     mMajorVersion = headerStream->loadU32();
     mMinorVersion = headerStream->loadU32();
     uint32_t flags = headerStream->loadU32();
-    mUse64BitOffsets = (flags & 1) != 0;
+    mUse64BitOffsets = (flags & A3D_FLAG_64BIT_OFFSETS) != 0;
+    mCompressed = (flags & A3D_FLAG_COMPRESSED) != 0;
 
     uint32_t numIndexEntries = headerStream->loadU32();
     for (uint32_t i = 0; i < numIndexEntries; i ++) {
@@ -84,9 +114,60 @@ void FileA3D::parseHeader(IStream *headerStream) {
             entry->mOffset = headerStream->loadU32();
             entry->mLength = headerStream->loadU32();
         }
-        entry->mRsObj = NULL;
+        entry->mRawLength = entry->mLength;
+        if (mCompressed) {
+            entry->mRawLength = mUse64BitOffsets ? headerStream->loadOffset() :
+                                                   headerStream->loadU32();
+        }
         mIndex.push(entry);
     }
+    buildNameTable();
+}
+
+static uint32_t hashEntryName(const char *name) {
+    return rsHashBytes(RS_HASH_SEED, name, strlen(name));
+}
+
+void FileA3D::buildNameTable() {
+    uint32_t size = 4;
+    while (size < mIndex.size() * 2) {
+        size <<= 1;
+    }
+    delete[] mNameTable;
+    mNameTable = new int32_t[size];
+    mNameTableMask = size - 1;
+    for (uint32_t i = 0; i < size; i ++) {
+        mNameTable[i] = -1;
+    }
+
+    for (uint32_t i = 0; i < mIndex.size(); i ++) {
+        const char *name = mIndex[i]->mObjectName;
+        uint32_t slot = hashEntryName(name) & mNameTableMask;
+        while (mNameTable[slot] >= 0) {
+            // Keep the first of entries sharing a name
+            if (!strcmp(mIndex[mNameTable[slot]]->mObjectName, name)) {
+                break;
+            }
+            slot = (slot + 1) & mNameTableMask;
+        }
+        if (mNameTable[slot] < 0) {
+            mNameTable[slot] = i;
+        }
+    }
+}
+
+int32_t FileA3D::findIndexEntry(const char *name) const {
+    if (!mNameTable || !name) {
+        return -1;
+    }
+    uint32_t slot = hashEntryName(name) & mNameTableMask;
+    while (mNameTable[slot] >= 0) {
+        if (!strcmp(mIndex[mNameTable[slot]]->mObjectName, name)) {
+            return mNameTable[slot];
+        }
+        slot = (slot + 1) & mNameTableMask;
+    }
+    return -1;
 }
 
 bool FileA3D::load(Asset *asset) {
@@ -147,8 +228,132 @@ bool FileA3D::load(const void *data, size_t length) {
 
     // We should know enough to read the file in at this point.
     mData = (uint8_t *)localData;
+    return openReadStream();
+}
+
+namespace {
+
+struct DecompressBlock {
+    const uint8_t *src;
+    size_t srcLen;
+    uint8_t *dst;
+    size_t dstLen;
+};
+
+struct DecompressWork {
+    DecompressBlock *blocks;
+    uint32_t count;
+    volatile int32_t next;
+    volatile int32_t failed;
+};
+
+}
+
+// Worker callback taking blocks until none are left
+static void decompressBlocks(void *usr, uint32_t idx) {
+    DecompressWork *work = (DecompressWork *)usr;
+    while (1) {
+        uint32_t i = (uint32_t)__sync_fetch_and_add(&work->next, 1);
+        if (i >= work->count) {
+            return;
+        }
+        const DecompressBlock *b = &work->blocks[i];
+        if (!rsuBlockDecompress(b->src, b->srcLen, b->dst, b->dstLen)) {
+            work->failed = 1;
+        }
+    }
+}
+
+// Replaces the compressed data with all entries decompressed, each on a
+// 16 byte boundary, spreading the blocks over the driver's workers when
+// this thread may use them.
+bool FileA3D::decompressEntries() {
+    uint32_t count = mIndex.size();
+    DecompressBlock *blocks = new DecompressBlock[count ? count : 1];
+    uint64_t rawSize = 0;
+    for (uint32_t i = 0; i < count; i ++) {
+        A3DIndexEntry *entry = mIndex[i];
+        if ((entry->mOffset > mDataSize) || (entry->mLength > mDataSize - entry->mOffset)) {
+            ALOGE("A3D entry %s lies outside the file data", entry->mObjectName);
+            delete[] blocks;
+            return false;
+        }
+        rawSize = (rawSize + 15) & ~15;
+        blocks[i].src = mData + entry->mOffset;
+        blocks[i].srcLen = entry->mLength;
+        blocks[i].dstLen = entry->mRawLength;
+        entry->mOffset = rawSize;
+        entry->mLength = entry->mRawLength;
+        rawSize += entry->mRawLength;
+    }
+
+    uint8_t *raw = (uint8_t *)malloc(rawSize ? rawSize : 1);
+    if (!raw) {
+        delete[] blocks;
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i ++) {
+        blocks[i].dst = raw + mIndex[i]->mOffset;
+    }
+
+    DecompressWork work;
+    work.blocks = blocks;
+    work.count = count;
+    work.next = 0;
+    work.failed = 0;
+    if ((count > 1) && mRSC->mHal.funcs.launchThreads && mRSC->canLaunchThreads()) {
+        mRSC->mHal.funcs.launchThreads(mRSC, decompressBlocks, &work);
+    } else {
+        decompressBlocks(&work, 0);
+    }
+    delete[] blocks;
+
+    if (work.failed) {
+        ALOGE("Couldn't decompress A3D file entries");
+        free(raw);
+        return false;
+    }
+    if (mAlloc) {
+        free(mAlloc);
+    }
+    mAlloc = raw;
+    mData = raw;
+    mDataSize = rawSize;
+    return true;
+}
+
+bool FileA3D::openReadStream() {
+    if (mCompressed && !decompressEntries()) {
+        return false;
+    }
     mReadStream = new IStream(mData, mUse64BitOffsets);
+    return true;
+}
+
+// Maps the file from its start, so objects read from it and allocations
+// holding their data in place need no copy.  The mapping is private and
+// writable, so scripts changing such allocations never touch the file.
+// Returns false if the file couldn't be mapped, otherwise whether it loaded.
+bool FileA3D::loadMapped(FILE *f, bool *loaded) {
+    long start = ftell(f);
+    struct stat st;
+    if ((start < 0) || fstat(fileno(f), &st) || (st.st_size <= start)) {
+        return false;
+    }
+    size_t mapSize = (size_t)st.st_size;
+    void *map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
 
+    *loaded = load((const uint8_t *)map + start, mapSize - start);
+    if (!*loaded || mCompressed) {
+        // Compressed files were decompressed out of the mapping
+        munmap(map, mapSize);
+        return true;
+    }
+    mMapping.set(new FileA3DMapping(mRSC, map, mapSize));
+    mReadStream->setBacking(mMapping.get());
     return true;
 }
 
@@ -156,6 +361,11 @@ bool FileA3D::load(FILE *f) {
     char magicString[12];
     size_t len;
 
+    bool loaded = false;
+    if (loadMapped(f, &loaded)) {
+        return loaded;
+    }
+
     ALOGV("file open 1");
     len = fread(magicString, 1, 12, f);
     if ((len != 12) ||
@@ -205,7 +415,9 @@ bool FileA3D::load(FILE *f) {
         return false;
     }
 
-    mReadStream = new IStream(mData, mUse64BitOffsets);
+    if (!openReadStream()) {
+        return false;
+    }
 
     ALOGV("Header is read an stream initialized");
     return true;
@@ -236,51 +448,56 @@ ObjectBase *FileA3D::initializeFromEntry(size_t index) {
         return NULL;
     }
 
-    if (entry->mRsObj) {
-        entry->mRsObj->incUserRef();
-        return entry->mRsObj;
+    pthread_mutex_lock(&mEntryMutex);
+    ObjectBase *obj = entry->mRsObj.get();
+    if (obj || !mReadStream) {
+        if (obj) {
+            obj->incUserRef();
+        }
+        pthread_mutex_unlock(&mEntryMutex);
+        return obj;
     }
 
     // Seek to the beginning of object
     mReadStream->reset(entry->mOffset);
     switch (entry->mType) {
         case RS_A3D_CLASS_ID_UNKNOWN:
-            return NULL;
+            break;
         case RS_A3D_CLASS_ID_MESH:
-            entry->mRsObj = Mesh::createFromStream(mRSC, mReadStream);
+            obj = Mesh::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_TYPE:
-            entry->mRsObj = Type::createFromStream(mRSC, mReadStream);
+            obj = Type::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_ELEMENT:
-            entry->mRsObj = Element::createFromStream(mRSC, mReadStream);
+            obj = Element::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_ALLOCATION:
-            entry->mRsObj = Allocation::createFromStream(mRSC, mReadStream);
+            obj = Allocation::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_PROGRAM_VERTEX:
-            //entry->mRsObj = ProgramVertex::createFromStream(mRSC, mReadStream);
+            //obj = ProgramVertex::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_PROGRAM_RASTER:
-            //entry->mRsObj = ProgramRaster::createFromStream(mRSC, mReadStream);
+            //obj = ProgramRaster::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_PROGRAM_FRAGMENT:
-            //entry->mRsObj = ProgramFragment::createFromStream(mRSC, mReadStream);
+            //obj = ProgramFragment::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_PROGRAM_STORE:
-            //entry->mRsObj = ProgramStore::createFromStream(mRSC, mReadStream);
+            //obj = ProgramStore::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_SAMPLER:
-            //entry->mRsObj = Sampler::createFromStream(mRSC, mReadStream);
+            //obj = Sampler::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_ANIMATION:
-            //entry->mRsObj = Animation::createFromStream(mRSC, mReadStream);
+            //obj = Animation::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_ADAPTER_1D:
-            //entry->mRsObj = Adapter1D::createFromStream(mRSC, mReadStream);
+            //obj = Adapter1D::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_ADAPTER_2D:
-            //entry->mRsObj = Adapter2D::createFromStream(mRSC, mReadStream);
+            //obj = Adapter2D::createFromStream(mRSC, mReadStream);
             break;
         case RS_A3D_CLASS_ID_SCRIPT_C:
             break;
@@ -292,19 +509,76 @@ ObjectBase *FileA3D::initializeFromEntry(size_t index) {
             break;
         case RS_A3D_CLASS_ID_SCRIPT_GROUP:
             break;
+        case RS_A3D_CLASS_ID_COMMAND_BUFFER:
+            break;
     }
-    if (entry->mRsObj) {
-        entry->mRsObj->incUserRef();
+    if (obj) {
+        obj->incUserRef();
+        entry->mRsObj.set(obj);
     }
-    return entry->mRsObj;
+    pthread_mutex_unlock(&mEntryMutex);
+    return obj;
 }
 
-bool FileA3D::writeFile(const char *filename) {
-    if (!mWriteStream) {
-        ALOGE("No objects to write\n");
-        return false;
+void FileA3D::trim() {
+    pthread_mutex_lock(&mEntryMutex);
+    for (size_t i = 0; i < mIndex.size(); i ++) {
+        A3DIndexEntry *entry = mIndex[i];
+        if (!entry->mRsObj.get()) {
+            continue;
+        }
+        ObjectBase::asyncLock(mRSC);
+        bool inUse = entry->mRsObj->hasOtherRefs();
+        ObjectBase::asyncUnlock(mRSC);
+        if (!inUse) {
+            entry->mRsObj.clear();
+        }
+    }
+    pthread_mutex_unlock(&mEntryMutex);
+}
+
+void FileA3D::trimAll(Context *rsc) {
+    // Hold the files so none goes away while the others are trimmed
+    Vector<FileA3D *> files;
+    ObjectBase::asyncLock(rsc);
+    for (size_t i = 0; i < rsc->mFileA3Ds.size(); i ++) {
+        rsc->mFileA3Ds[i]->incSysRef();
+        files.push(rsc->mFileA3Ds[i]);
     }
-    if (mWriteStream->getPos() == 0) {
+    ObjectBase::asyncUnlock(rsc);
+
+    for (size_t i = 0; i < files.size(); i ++) {
+        files[i]->trim();
+        files[i]->decSysRef();
+    }
+}
+
+
+// The header only stores 32 bit offsets and lengths, so its size is known
+// before any entry has been written.
+void FileA3D::writeHeader(OStream *headerStream) const {
+    headerStream->addU32(mMajorVersion);
+    headerStream->addU32(mMinorVersion);
+    uint32_t flags = mCompressed ? A3D_FLAG_COMPRESSED : 0;
+    headerStream->addU32(flags);
+
+    uint32_t writeIndexSize = mWriteIndex.size();
+    headerStream->addU32(writeIndexSize);
+    for (uint32_t i = 0; i < writeIndexSize; i ++) {
+        headerStream->addString(mWriteIndex[i]->mObjectName);
+        headerStream->addU32((uint32_t)mWriteIndex[i]->mType);
+        headerStream->addU32((uint32_t)mWriteIndex[i]->mOffset);
+        headerStream->addU32((uint32_t)mWriteIndex[i]->mLength);
+        if (mCompressed) {
+            headerStream->addU32((uint32_t)mWriteIndex[i]->mRawLength);
+        }
+    }
+}
+
+// Entries are serialized straight into the file a segment at a time, then
+// the header and data size written ahead of them are patched in.
+bool FileA3D::writeFile(const char *filename) {
+    if (!mWriteIndex.size()) {
         ALOGE("No objects to write\n");
         return false;
     }
@@ -317,42 +591,71 @@ bool FileA3D::writeFile(const char *filename) {
 
     // Open a new stream to make writing the header easier
     OStream headerStream(5*1024, false);
-    headerStream.addU32(mMajorVersion);
-    headerStream.addU32(mMinorVersion);
-    uint32_t is64Bit = 0;
-    headerStream.addU32(is64Bit);
-
-    uint32_t writeIndexSize = mWriteIndex.size();
-    headerStream.addU32(writeIndexSize);
-    for (uint32_t i = 0; i < writeIndexSize; i ++) {
-        headerStream.addString(mWriteIndex[i]->mObjectName);
-        headerStream.addU32((uint32_t)mWriteIndex[i]->mType);
-        if (mUse64BitOffsets){
-            headerStream.addOffset(mWriteIndex[i]->mOffset);
-            headerStream.addOffset(mWriteIndex[i]->mLength);
-        } else {
-            uint32_t offset = (uint32_t)mWriteIndex[i]->mOffset;
-            headerStream.addU32(offset);
-            offset = (uint32_t)mWriteIndex[i]->mLength;
-            headerStream.addU32(offset);
-        }
-    }
+    writeHeader(&headerStream);
+    uint64_t headerSize = headerStream.getPos();
 
     // Write our magic string so we know we are reading the right file
     fwrite(A3D_MAGIC_KEY, sizeof(char), strlen(A3D_MAGIC_KEY), writeHandle);
 
     // Store the size of the header to make it easier to parse when we read it
-    uint64_t headerSize = headerStream.getPos();
     fwrite(&headerSize, sizeof(headerSize), 1, writeHandle);
 
-    // Now write our header
-    fwrite(headerStream.getPtr(), sizeof(uint8_t), headerStream.getPos(), writeHandle);
-
-    // Now write the size of the data part of the file for easier parsing later
-    uint64_t fileDataSize = mWriteStream->getPos();
+    // Space for the header and the size of the data part, filled in below
+    long headerPos = ftell(writeHandle);
+    fwrite(headerStream.getPtr(), sizeof(uint8_t), headerSize, writeHandle);
+    uint64_t fileDataSize = 0;
     fwrite(&fileDataSize, sizeof(fileDataSize), 1, writeHandle);
 
-    fwrite(mWriteStream->getPtr(), sizeof(uint8_t), mWriteStream->getPos(), writeHandle);
+    bool ok = true;
+    OStream dataStream(writeHandle, 256*1024, false);
+    // Compressed entries are serialized in memory one at a time
+    OStream *entryStream = mCompressed ? new OStream(64*1024, false) : NULL;
+    uint8_t *block = NULL;
+    size_t blockCapacity = 0;
+    for (uint32_t i = 0; ok && (i < mWriteIndex.size()); i ++) {
+        A3DIndexEntry *entry = mWriteIndex[i];
+        dataStream.align(4);
+        entry->mOffset = dataStream.getPos();
+        if (!entryStream) {
+            entry->mRsObj->serialize(mRSC, &dataStream);
+            entry->mLength = dataStream.getPos() - entry->mOffset;
+            entry->mRawLength = entry->mLength;
+            continue;
+        }
+
+        entryStream->reset();
+        entry->mRsObj->serialize(mRSC, entryStream);
+        entry->mRawLength = entryStream->getPos();
+        size_t bound = rsuBlockCompressBound(entry->mRawLength);
+        if (bound > blockCapacity) {
+            free(block);
+            block = (uint8_t *)malloc(bound);
+            blockCapacity = block ? bound : 0;
+        }
+        entry->mLength = block ? rsuBlockCompress(entryStream->getPtr(), entry->mRawLength,
+                                                  block, bound) : 0;
+        if (!entry->mLength) {
+            ALOGE("Couldn't compress entry %s\n", entry->mObjectName);
+            ok = false;
+            break;
+        }
+        dataStream.addByteArray(block, entry->mLength);
+    }
+    free(block);
+    delete entryStream;
+    ok = dataStream.finish() && ok;
+
+    if (ok) {
+        headerStream.reset();
+        writeHeader(&headerStream);
+        fileDataSize = dataStream.getPos();
+        ok = !fseek(writeHandle, headerPos, SEEK_SET) &&
+             (fwrite(headerStream.getPtr(), sizeof(uint8_t), headerSize, writeHandle) == headerSize) &&
+             (fwrite(&fileDataSize, sizeof(fileDataSize), 1, writeHandle) == 1);
+        if (!ok) {
+            ALOGE("Couldn't write the file\n");
+        }
+    }
 
     int status = fclose(writeHandle);
 
@@ -361,26 +664,22 @@ bool FileA3D::writeFile(const char *filename) {
         return false;
     }
 
-    return true;
+    return ok;
 }
 
+// Objects are held until writeFile serializes them into the file.
 void FileA3D::appendToFile(Context *con, ObjectBase *obj) {
     if (!obj) {
         return;
     }
-    if (!mWriteStream) {
-        const uint64_t initialStreamSize = 256*1024;
-        mWriteStream = new OStream(initialStreamSize, false);
-    }
     A3DIndexEntry *indexEntry = new A3DIndexEntry();
     indexEntry->mObjectName = rsuCopyString(obj->getName());
     indexEntry->mType = obj->getClassId();
-    indexEntry->mOffset = mWriteStream->getPos();
-    indexEntry->mRsObj = obj;
+    indexEntry->mOffset = 0;
+    indexEntry->mLength = 0;
+    indexEntry->mRawLength = 0;
+    indexEntry->mRsObj.set(obj);
     mWriteIndex.push(indexEntry);
-    obj->serialize(con, mWriteStream);
-    indexEntry->mLength = mWriteStream->getPos() - indexEntry->mOffset;
-    mWriteStream->align(4);
 }
 
 RsObjectBase rsaFileA3DGetEntryByIndex(RsContext con, uint32_t index, RsFile file) {
@@ -396,6 +695,19 @@ RsObjectBase rsaFileA3DGetEntryByIndex(RsContext con, uint32_t index, RsFile fil
     return obj;
 }
 
+RsObjectBase rsaFileA3DGetEntryByName(RsContext con, const char *name, RsFile file) {
+    FileA3D *fa3d = static_cast<FileA3D *>(file);
+    if (!fa3d) {
+        ALOGE("Can't load entry. No valid file");
+        return NULL;
+    }
+
+    int32_t index = fa3d->findIndexEntry(name);
+    if (index < 0) {
+        return NULL;
+    }
+    return fa3d->initializeFromEntry(index);
+}
 
 void rsaFileA3DGetNumIndexEntries(RsContext con, int32_t *numEntries, RsFile file) {
     FileA3D *fa3d = static_cast<FileA3D *>(file);
@@ -21,15 +21,40 @@
 
 #include "rsStream.h"
 #include <stdio.h>
+#include <pthread.h>
 
 #define A3D_MAGIC_KEY "Android3D_ff"
 
+// Header flags
+#define A3D_FLAG_64BIT_OFFSETS 1
+// Entries are compressed blocks (see rsCompress.h), each header entry
+// giving the decompressed length after its offset and length.
+#define A3D_FLAG_COMPRESSED 2
+
 // ---------------------------------------------------------------------------
 namespace android {
     class Asset;
 
 namespace renderscript {
 
+// Private writable mapping of a file, kept alive by the FileA3D loaded
+// from it and by allocations holding their data in place inside it.
+class FileA3DMapping : public ObjectBase {
+public:
+    FileA3DMapping(Context *rsc, void *base, size_t size);
+    ~FileA3DMapping();
+
+    virtual void serialize(Context *rsc, OStream *stream) const {
+    }
+    virtual RsA3DClassID getClassId() const {
+        return RS_A3D_CLASS_ID_UNKNOWN;
+    }
+
+protected:
+    void *mBase;
+    size_t mSize;
+};
+
 class FileA3D : public ObjectBase {
 public:
     FileA3D(Context *rsc);
@@ -40,13 +65,16 @@ public:
     uint64_t mIndexOffset;
     uint64_t mStringTableOffset;
     bool mUse64BitOffsets;
+    bool mCompressed;
 
     class A3DIndexEntry {
         const char *mObjectName;
         RsA3DClassID mType;
         uint64_t mOffset;
         uint64_t mLength;
-        ObjectBase *mRsObj;
+        uint64_t mRawLength;
+        // Decoded object, dropped again by trim() once nothing else uses it
+        ObjectBaseRef<ObjectBase> mRsObj;
     public:
         friend class FileA3D;
         const char *getObjectName() const {
@@ -65,9 +93,20 @@ public:
 
     size_t getNumIndexEntries() const;
     const A3DIndexEntry* getIndexEntry(size_t index) const;
+    // Index of the entry named name, or -1
+    int32_t findIndexEntry(const char *name) const;
     ObjectBase *initializeFromEntry(size_t index);
 
+    // Releases decoded objects only this file still holds; they are
+    // decoded again when next requested.
+    void trim();
+    static void trimAll(Context *rsc);
+
     void appendToFile(Context *rsc, ObjectBase *obj);
+    // Whether writeFile compresses each entry
+    void setCompressed(bool compressed) {
+        mCompressed = compressed;
+    }
     bool writeFile(const char *filename);
 
     // Currently files do not get serialized,
@@ -79,19 +118,33 @@ public:
     }
 
 protected:
+    virtual void preDestroy() const;
 
     void parseHeader(IStream *headerStream);
+    void buildNameTable();
+    bool openReadStream();
+    void writeHeader(OStream *headerStream) const;
+    bool decompressEntries();
+    bool loadMapped(FILE *f, bool *loaded);
 
     const uint8_t * mData;
     void * mAlloc;
+    // Whole file mapped by load(FILE *)
+    ObjectBaseRef<FileA3DMapping> mMapping;
     uint64_t mDataSize;
     Asset *mAsset;
 
-    OStream *mWriteStream;
     Vector<A3DIndexEntry*> mWriteIndex;
 
     IStream *mReadStream;
     Vector<A3DIndexEntry*> mIndex;
+    // Open addressed table of indices into mIndex by object name, -1
+    // marking free slots
+    int32_t *mNameTable;
+    uint32_t mNameTableMask;
+    // Guards decoding and releasing entries, which the app and the
+    // context thread can do at the same time
+    pthread_mutex_t mEntryMutex;
 };
 
 
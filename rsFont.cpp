@@ -34,6 +34,7 @@ using namespace android;
 using namespace android::renderscript;
 
 Font::Font(Context *rsc) : ObjectBase(rsc), mCachedGlyphs(NULL) {
+    mLayoutStamp = 0;
     mInitialized = false;
     mHasKerning = false;
     mFace = NULL;
@@ -46,6 +47,8 @@ bool Font::init(const char *name, float fontSize, uint32_t dpi, const void *data
         return false;
     }
 
+    FontState *state = &mRSC->mStateFont;
+    state->lockFreeType();
     FT_Error error = 0;
     if (data != NULL && dataLen > 0) {
         error = FT_New_Memory_Face(mRSC->mStateFont.getLib(), (const FT_Byte*)data, dataLen, 0, &mFace);
@@ -54,6 +57,7 @@ bool Font::init(const char *name, float fontSize, uint32_t dpi, const void *data
     }
 
     if (error) {
+        state->unlockFreeType();
         ALOGE("Unable to initialize font %s", name);
         return false;
     }
@@ -64,11 +68,13 @@ bool Font::init(const char *name, float fontSize, uint32_t dpi, const void *data
 
     error = FT_Set_Char_Size(mFace, (FT_F26Dot6)(fontSize * 64.0f), 0, dpi, 0);
     if (error) {
+        state->unlockFreeType();
         ALOGE("Unable to set font size on %s", name);
         return false;
     }
 
     mHasKerning = FT_HAS_KERNING(mFace);
+    state->unlockFreeType();
 
     mInitialized = true;
 #endif //ANDROID_RS_SERIALIZE
@@ -84,12 +90,6 @@ void Font::preDestroy() const {
     }
 }
 
-void Font::invalidateTextureCache() {
-    for (uint32_t i = 0; i < mCachedGlyphs.size(); i ++) {
-        mCachedGlyphs.valueAt(i)->mIsValid = false;
-    }
-}
-
 void Font::drawCachedGlyph(CachedGlyphInfo *glyph, int32_t x, int32_t y) {
     FontState *state = &mRSC->mStateFont;
 
@@ -104,7 +104,8 @@ void Font::drawCachedGlyph(CachedGlyphInfo *glyph, int32_t x, int32_t y) {
     int32_t width = (int32_t) glyph->mBitmapWidth;
     int32_t height = (int32_t) glyph->mBitmapHeight;
 
-    state->appendMeshQuad(nPenX, nPenY, 0, u1, v2,
+    state->appendMeshQuad(glyph->mPage,
+                          nPenX, nPenY, 0, u1, v2,
                           nPenX + width, nPenY, 0, u2, v2,
                           nPenX + width, nPenY - height, 0, u2, v1,
                           nPenX, nPenY - height, 0, u1, v1);
@@ -119,8 +120,8 @@ void Font::drawCachedGlyph(CachedGlyphInfo* glyph, int32_t x, int32_t y,
     uint32_t endY = glyph->mBitmapMinY + glyph->mBitmapHeight;
 
     FontState *state = &mRSC->mStateFont;
-    uint32_t cacheWidth = state->getCacheTextureType()->getDimX();
-    const uint8_t* cacheBuffer = state->mCacheBuffer;
+    uint32_t cacheWidth = state->mCacheWidth;
+    const uint8_t* cacheBuffer = state->mCachePages[glyph->mPage]->mBuffer;
 
     uint32_t cacheX = 0, cacheY = 0;
     int32_t bX = 0, bY = 0;
@@ -175,6 +176,23 @@ void Font::renderUTF(const char *text, uint32_t len, int32_t x, int32_t y,
         bounds->set(1e6, -1e6, 1e6, -1e6);
     }
 
+    uint32_t hash = 0;
+    bool cacheLayout = len <= kMaxLayoutText;
+    if (cacheLayout) {
+        hash = rsHashBytes(rsHashWord(rsHashWord(RS_HASH_SEED, start), numGlyphs), text, len);
+        TextLayout *layout = findLayout(hash, text, len, start, numGlyphs);
+        if (layout) {
+            for (uint32_t ct = 0; ct < layout->mGlyphs.size(); ct++) {
+                const LayoutGlyph &g = layout->mGlyphs[ct];
+                // The atlas may have dropped the glyph since
+                validateGlyph(g.mGlyph, mode == FRAMEBUFFER);
+                g.mGlyph->mLastUse = ++mRSC->mStateFont.mGlyphStamp;
+                renderGlyph(g.mGlyph, x + g.mPenX, y, mode, bounds, bitmap, bitmapW, bitmapH);
+            }
+            return;
+        }
+    }
+
     int32_t penX = x, penY = y;
     int32_t glyphsLeft = 1;
     if (numGlyphs > 0) {
@@ -183,6 +201,7 @@ void Font::renderUTF(const char *text, uint32_t len, int32_t x, int32_t y,
 
     size_t index = start;
     size_t nextIndex = 0;
+    Vector<LayoutGlyph> laidOut;
 
     while (glyphsLeft > 0) {
 
@@ -196,21 +215,13 @@ void Font::renderUTF(const char *text, uint32_t len, int32_t x, int32_t y,
         // Move to the next character in the array
         index = nextIndex;
 
-        CachedGlyphInfo *cachedGlyph = getCachedUTFChar(utfChar);
-
-        // If it's still not valid, we couldn't cache it, so we shouldn't draw garbage
-        if (cachedGlyph->mIsValid) {
-            switch (mode) {
-            case FRAMEBUFFER:
-                drawCachedGlyph(cachedGlyph, penX, penY);
-                break;
-            case BITMAP:
-                drawCachedGlyph(cachedGlyph, penX, penY, bitmap, bitmapW, bitmapH);
-                break;
-            case MEASURE:
-                measureCachedGlyph(cachedGlyph, penX, penY, bounds);
-                break;
-            }
+        CachedGlyphInfo *cachedGlyph = getCachedUTFChar(utfChar, mode == FRAMEBUFFER);
+        renderGlyph(cachedGlyph, penX, penY, mode, bounds, bitmap, bitmapW, bitmapH);
+        if (cacheLayout) {
+            LayoutGlyph g;
+            g.mGlyph = cachedGlyph;
+            g.mPenX = penX - x;
+            laidOut.push(g);
         }
 
         penX += (cachedGlyph->mAdvanceX >> 6);
@@ -220,26 +231,114 @@ void Font::renderUTF(const char *text, uint32_t len, int32_t x, int32_t y,
             glyphsLeft --;
         }
     }
+
+    if (cacheLayout) {
+        addLayout(hash, text, len, start, numGlyphs, laidOut);
+    }
+}
+
+void Font::renderGlyph(CachedGlyphInfo *glyph, int32_t x, int32_t y, RenderMode mode,
+                       Rect *bounds, uint8_t *bitmap, uint32_t bitmapW, uint32_t bitmapH) {
+    // If it's still not valid, we couldn't cache it, so we shouldn't draw garbage
+    if (!glyph->mIsValid) {
+        return;
+    }
+    switch (mode) {
+    case FRAMEBUFFER:
+        drawCachedGlyph(glyph, x, y);
+        break;
+    case BITMAP:
+        drawCachedGlyph(glyph, x, y, bitmap, bitmapW, bitmapH);
+        break;
+    case MEASURE:
+        measureCachedGlyph(glyph, x, y, bounds);
+        break;
+    }
+}
+
+Font::TextLayout * Font::findLayout(uint32_t hash, const char *text, uint32_t len,
+                                    uint32_t start, int32_t numGlyphs) {
+    for (uint32_t ct = 0; ct < mLayouts.size(); ct++) {
+        TextLayout *l = mLayouts[ct];
+        if ((l->mHash == hash) && (l->mLen == len) && (l->mStart == start) &&
+            (l->mNumGlyphs == numGlyphs) && !memcmp(l->mText, text, len)) {
+            l->mLastUse = ++mLayoutStamp;
+            return l;
+        }
+    }
+    return NULL;
+}
+
+void Font::addLayout(uint32_t hash, const char *text, uint32_t len,
+                     uint32_t start, int32_t numGlyphs, const Vector<LayoutGlyph> &glyphs) {
+    TextLayout *l = NULL;
+    if (mLayouts.size() < kMaxLayouts) {
+        l = new TextLayout();
+        l->mText = NULL;
+        mLayouts.push(l);
+    } else {
+        // Replace the string drawn least recently
+        l = mLayouts[0];
+        for (uint32_t ct = 1; ct < mLayouts.size(); ct++) {
+            if ((mLayoutStamp - mLayouts[ct]->mLastUse) > (mLayoutStamp - l->mLastUse)) {
+                l = mLayouts[ct];
+            }
+        }
+        delete[] l->mText;
+    }
+
+    l->mHash = hash;
+    l->mText = new char[len];
+    memcpy(l->mText, text, len);
+    l->mLen = len;
+    l->mStart = start;
+    l->mNumGlyphs = numGlyphs;
+    l->mLastUse = ++mLayoutStamp;
+    l->mGlyphs = glyphs;
 }
 
-Font::CachedGlyphInfo* Font::getCachedUTFChar(int32_t utfChar) {
+Font::CachedGlyphInfo* Font::getCachedUTFChar(int32_t utfChar, bool async) {
 
     CachedGlyphInfo *cachedGlyph = mCachedGlyphs.valueFor((uint32_t)utfChar);
     if (cachedGlyph == NULL) {
         cachedGlyph = cacheGlyph((uint32_t)utfChar);
     }
+    validateGlyph(cachedGlyph, async);
+    cachedGlyph->mLastUse = ++mRSC->mStateFont.mGlyphStamp;
+
+    return cachedGlyph;
+}
+
+void Font::validateGlyph(CachedGlyphInfo *glyph, bool async) {
     // Is the glyph still in texture cache?
-    if (!cachedGlyph->mIsValid) {
-        updateGlyphCache(cachedGlyph);
+    if (glyph->mIsValid) {
+        return;
     }
 
-    return cachedGlyph;
+    FontState *state = &mRSC->mStateFont;
+    if (!async || !state->mRasterRunning) {
+        updateGlyphCache(glyph);
+        return;
+    }
+#ifndef ANDROID_RS_SERIALIZE
+    // The text around the glyph needs its advance now, only the pixels
+    // can wait
+    if (!glyph->mHasMetrics) {
+        loadGlyphMetrics(glyph);
+    }
+#endif //ANDROID_RS_SERIALIZE
+    if (!glyph->mPending) {
+        state->requestGlyph(this, glyph, false);
+    }
 }
 
 void Font::updateGlyphCache(CachedGlyphInfo *glyph) {
 #ifndef ANDROID_RS_SERIALIZE
+    FontState *state = &mRSC->mStateFont;
+    state->lockFreeType();
     FT_Error error = FT_Load_Glyph( mFace, glyph->mGlyphIndex, FT_LOAD_RENDER );
     if (error) {
+        state->unlockFreeType();
         ALOGE("Couldn't load glyph.");
         return;
     }
@@ -248,16 +347,34 @@ void Font::updateGlyphCache(CachedGlyphInfo *glyph) {
     glyph->mAdvanceY = mFace->glyph->advance.y;
     glyph->mBitmapLeft = mFace->glyph->bitmap_left;
     glyph->mBitmapTop = mFace->glyph->bitmap_top;
+    glyph->mHasMetrics = true;
+
+    placeGlyph(glyph, &mFace->glyph->bitmap);
+    state->unlockFreeType();
+#endif //ANDROID_RS_SERIALIZE
+}
 
-    FT_Bitmap *bitmap = &mFace->glyph->bitmap;
+#ifndef ANDROID_RS_SERIALIZE
+void Font::loadGlyphMetrics(CachedGlyphInfo *glyph) {
+    FontState *state = &mRSC->mStateFont;
+    state->lockFreeType();
+    FT_Error error = FT_Load_Glyph( mFace, glyph->mGlyphIndex, FT_LOAD_DEFAULT );
+    if (!error) {
+        glyph->mAdvanceX = mFace->glyph->advance.x;
+        glyph->mAdvanceY = mFace->glyph->advance.y;
+        glyph->mHasMetrics = true;
+    }
+    state->unlockFreeType();
+}
 
+void Font::placeGlyph(CachedGlyphInfo *glyph, FT_Bitmap *bitmap) {
     // Now copy the bitmap into the cache texture
     uint32_t startX = 0;
     uint32_t startY = 0;
 
     // Let the font state figure out where to put the bitmap
     FontState *state = &mRSC->mStateFont;
-    glyph->mIsValid = state->cacheBitmap(bitmap, &startX, &startY);
+    glyph->mIsValid = state->cacheBitmap(bitmap, glyph, &startX, &startY);
 
     if (!glyph->mIsValid) {
         return;
@@ -271,24 +388,33 @@ void Font::updateGlyphCache(CachedGlyphInfo *glyph) {
     glyph->mBitmapWidth = bitmap->width;
     glyph->mBitmapHeight = bitmap->rows;
 
-    uint32_t cacheWidth = state->getCacheTextureType()->getDimX();
-    uint32_t cacheHeight = state->getCacheTextureType()->getDimY();
+    uint32_t cacheWidth = state->mCacheWidth;
+    uint32_t cacheHeight = state->mCacheHeight;
 
     glyph->mBitmapMinU = (float)startX / (float)cacheWidth;
     glyph->mBitmapMinV = (float)startY / (float)cacheHeight;
     glyph->mBitmapMaxU = (float)endX / (float)cacheWidth;
     glyph->mBitmapMaxV = (float)endY / (float)cacheHeight;
-#endif //ANDROID_RS_SERIALIZE
 }
+#endif //ANDROID_RS_SERIALIZE
 
 Font::CachedGlyphInfo *Font::cacheGlyph(uint32_t glyph) {
     CachedGlyphInfo *newGlyph = new CachedGlyphInfo();
     mCachedGlyphs.add(glyph, newGlyph);
+    mRSC->trackMemory(RS_MEMORY_FONT_CACHE, sizeof(CachedGlyphInfo));
 #ifndef ANDROID_RS_SERIALIZE
+    mRSC->mStateFont.lockFreeType();
     newGlyph->mGlyphIndex = FT_Get_Char_Index(mFace, glyph);
+    mRSC->mStateFont.unlockFreeType();
     newGlyph->mIsValid = false;
+    newGlyph->mAdvanceX = 0;
+    newGlyph->mAdvanceY = 0;
+    newGlyph->mPage = 0;
+    newGlyph->mSlot = NULL;
+    newGlyph->mLastUse = 0;
+    newGlyph->mPending = false;
+    newGlyph->mHasMetrics = false;
 #endif //ANDROID_RS_SERIALIZE
-    updateGlyphCache(newGlyph);
 
     return newGlyph;
 }
@@ -319,26 +445,69 @@ Font * Font::create(Context *rsc, const char *name, float fontSize, uint32_t dpi
 
 Font::~Font() {
 #ifndef ANDROID_RS_SERIALIZE
+    // Holding the FreeType lock also keeps the rasterizer off the face
+    FontState *state = &mRSC->mStateFont;
+    state->lockFreeType();
+    state->cancelGlyphs(this);
     if (mFace) {
         FT_Done_Face(mFace);
     }
+    state->unlockFreeType();
 #endif
 
+    Vector<Font*> &idlePrecache = mRSC->mStateFont.mIdlePrecache;
+    for (int32_t ct = (int32_t)idlePrecache.size() - 1; ct >= 0; ct--) {
+        if (idlePrecache[ct] == this) {
+            idlePrecache.removeAt(ct);
+            if (!ct) {
+                mRSC->mStateFont.mIdlePrecacheNext = 0;
+            }
+        }
+    }
+
     for (uint32_t i = 0; i < mCachedGlyphs.size(); i ++) {
         CachedGlyphInfo *glyph = mCachedGlyphs.valueAt(i);
+        mRSC->mStateFont.releaseGlyph(glyph);
         delete glyph;
     }
+    mRSC->trackMemory(RS_MEMORY_FONT_CACHE,
+                      -(ssize_t)(mCachedGlyphs.size() * sizeof(CachedGlyphInfo)));
+
+    clearLayouts();
+}
+
+size_t Font::clearLayouts() {
+    size_t freed = 0;
+    for (uint32_t i = 0; i < mLayouts.size(); i ++) {
+        freed += sizeof(TextLayout) + mLayouts[i]->mLen +
+                 mLayouts[i]->mGlyphs.size() * sizeof(LayoutGlyph);
+        delete[] mLayouts[i]->mText;
+        delete mLayouts[i];
+    }
+    mLayouts.clear();
+    return freed;
 }
 
 FontState::FontState() {
     mInitialized = false;
     mMaxNumberOfQuads = 1024;
     mCurrentQuadIndex = 0;
+    mGlyphStamp = 0;
+    mEvictions = 0;
+    mDrawPage = 0;
+    mIdlePrecacheNext = 0;
     mRSC = NULL;
 #ifndef ANDROID_RS_SERIALIZE
     mLibrary = NULL;
 #endif //ANDROID_RS_SERIALIZE
 
+    pthread_mutex_init(&mFreeTypeMutex, NULL);
+    pthread_mutex_init(&mRasterMutex, NULL);
+    pthread_cond_init(&mRasterCond, NULL);
+    mRasterRunning = false;
+    mRasterExit = false;
+    mRasterBusy = false;
+
     float gamma = DEFAULT_TEXT_GAMMA;
     int32_t blackThreshold = DEFAULT_TEXT_BLACK_GAMMA_THRESHOLD;
     int32_t whiteThreshold = DEFAULT_TEXT_WHITE_GAMMA_THRESHOLD;
@@ -374,9 +543,11 @@ FontState::FontState() {
 }
 
 FontState::~FontState() {
-    for (uint32_t i = 0; i < mCacheLines.size(); i ++) {
-        delete mCacheLines[i];
-    }
+    stopRasterizer();
+    deleteCachePages();
+    pthread_cond_destroy(&mRasterCond);
+    pthread_mutex_destroy(&mRasterMutex);
+    pthread_mutex_destroy(&mFreeTypeMutex);
 
     rsAssert(!mActiveFonts.size());
 }
@@ -399,67 +570,224 @@ void FontState::init(Context *rsc) {
     mRSC = rsc;
 }
 
-void FontState::flushAllAndInvalidate() {
-    if (mCurrentQuadIndex != 0) {
-        issueDrawCommand();
-        mCurrentQuadIndex = 0;
+bool FontState::addCachePage() {
+    if (mCachePages.size() >= kMaxCachePages) {
+        return false;
     }
-    for (uint32_t i = 0; i < mActiveFonts.size(); i ++) {
-        mActiveFonts[i]->invalidateTextureCache();
+
+    ObjectBaseRef<const Element> alphaElem = Element::createRef(mRSC, RS_TYPE_UNSIGNED_8,
+                                                                RS_KIND_PIXEL_A, true, 1);
+    ObjectBaseRef<Type> texType = Type::getTypeRef(mRSC, alphaElem.get(),
+                                                   mCacheWidth, mCacheHeight, 0, false, false, 0);
+    Allocation *cacheAlloc = Allocation::createAllocation(mRSC, texType.get(),
+                                RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE);
+    if (!cacheAlloc) {
+        return false;
     }
-    for (uint32_t i = 0; i < mCacheLines.size(); i ++) {
-        mCacheLines[i]->mCurrentCol = 0;
+
+    CachePage *page = new CachePage();
+    page->mTexture.set(cacheAlloc);
+    page->mBuffer = new uint8_t[mCacheWidth * mCacheHeight];
+    memset(page->mBuffer, 0, mCacheWidth * mCacheHeight);
+    page->mNextShelfY = 0;
+    mCachePages.push(page);
+    mRSC->trackMemory(RS_MEMORY_FONT_CACHE, mCacheWidth * mCacheHeight);
+    return true;
+}
+
+void FontState::clearCachePage(CachePage *page) {
+    for (uint32_t s = 0; s < page->mShelves.size(); s++) {
+        CacheShelf *shelf = page->mShelves[s];
+        for (uint32_t i = 0; i < shelf->mSlots.size(); i++) {
+            FontCacheSlot *slot = shelf->mSlots[i];
+            if (slot->mGlyph) {
+                slot->mGlyph->mIsValid = false;
+                slot->mGlyph->mSlot = NULL;
+            }
+            delete slot;
+        }
+        delete shelf;
     }
+    page->mShelves.clear();
+    page->mNextShelfY = 0;
 }
 
-#ifndef ANDROID_RS_SERIALIZE
-bool FontState::cacheBitmap(FT_Bitmap *bitmap, uint32_t *retOriginX, uint32_t *retOriginY) {
-    // If the glyph is too tall, don't cache it
-    if ((uint32_t)bitmap->rows > mCacheLines[mCacheLines.size()-1]->mMaxHeight) {
-        ALOGE("Font size to large to fit in cache. width, height = %i, %i", (int)bitmap->width, (int)bitmap->rows);
-        return false;
+void FontState::deleteCachePages() {
+    if (!mCachePages.size()) {
+        return;
+    }
+    for (uint32_t p = 0; p < mCachePages.size(); p++) {
+        clearCachePage(mCachePages[p]);
+        delete[] mCachePages[p]->mBuffer;
+        delete mCachePages[p];
     }
+    mRSC->trackMemory(RS_MEMORY_FONT_CACHE,
+                      -(ssize_t)(mCachePages.size() * mCacheWidth * mCacheHeight));
+    mCachePages.clear();
+}
 
-    // Now copy the bitmap into the cache texture
-    uint32_t startX = 0;
-    uint32_t startY = 0;
+FontCacheSlot * FontState::addShelfSlot(uint32_t page, CacheShelf *shelf, uint32_t width) {
+    FontCacheSlot *slot = new FontCacheSlot();
+    slot->mPage = page;
+    slot->mX = shelf->mCurrentCol;
+    slot->mY = shelf->mY;
+    slot->mWidth = width;
+    slot->mHeight = shelf->mHeight;
+    slot->mGlyph = NULL;
+    shelf->mSlots.push(slot);
+    shelf->mCurrentCol += width;
+    return slot;
+}
+
+FontCacheSlot * FontState::findCacheSlot(uint32_t width, uint32_t height) {
+    // Shelves are a multiple of 4 rows high and take glyphs at most 4 rows
+    // shorter than they could, so similar sizes share them.
+    uint32_t shelfHeight = (height + 3) & ~3;
+
+    for (uint32_t p = 0; p < mCachePages.size(); p++) {
+        CachePage *page = mCachePages[p];
+        for (uint32_t s = 0; s < page->mShelves.size(); s++) {
+            CacheShelf *shelf = page->mShelves[s];
+            if ((shelf->mHeight >= height) && (shelf->mHeight <= shelfHeight + 4) &&
+                (shelf->mCurrentCol + width <= mCacheWidth)) {
+                return addShelfSlot(p, shelf, width);
+            }
+        }
+    }
 
-    bool bitmapFit = false;
-    for (uint32_t i = 0; i < mCacheLines.size(); i ++) {
-        bitmapFit = mCacheLines[i]->fitBitmap(bitmap, &startX, &startY);
-        if (bitmapFit) {
+    for (uint32_t p = 0; ; p++) {
+        if ((p == mCachePages.size()) && !addCachePage()) {
             break;
         }
+        CachePage *page = mCachePages[p];
+        if (page->mNextShelfY + shelfHeight <= mCacheHeight) {
+            CacheShelf *shelf = new CacheShelf();
+            shelf->mY = page->mNextShelfY;
+            shelf->mHeight = shelfHeight;
+            shelf->mCurrentCol = 0;
+            page->mShelves.push(shelf);
+            page->mNextShelfY += shelfHeight;
+            return addShelfSlot(p, shelf, width);
+        }
     }
 
-    // If the new glyph didn't fit, flush the state so far and invalidate everything
-    if (!bitmapFit) {
-        flushAllAndInvalidate();
+    // The atlas is full, and queued quads may sample whatever gets
+    // replaced in it.
+    if (mCurrentQuadIndex != 0) {
+        issueDrawCommand();
+        mCurrentQuadIndex = 0;
+    }
 
-        // Try to fit it again
-        for (uint32_t i = 0; i < mCacheLines.size(); i ++) {
-            bitmapFit = mCacheLines[i]->fitBitmap(bitmap, &startX, &startY);
-            if (bitmapFit) {
-                break;
+    // Take over the slot of the least recently used glyph that has room,
+    // slots freed by destroyed fonts first.
+    FontCacheSlot *lru = NULL;
+    uint32_t lruAge = 0;
+    for (uint32_t p = 0; p < mCachePages.size(); p++) {
+        CachePage *page = mCachePages[p];
+        for (uint32_t s = 0; s < page->mShelves.size(); s++) {
+            CacheShelf *shelf = page->mShelves[s];
+            if (shelf->mHeight < height) {
+                continue;
+            }
+            for (uint32_t i = 0; i < shelf->mSlots.size(); i++) {
+                FontCacheSlot *slot = shelf->mSlots[i];
+                if (slot->mWidth < width) {
+                    continue;
+                }
+                uint32_t age = slot->mGlyph ? mGlyphStamp - slot->mGlyph->mLastUse : 0xffffffff;
+                if (!lru || (age > lruAge)) {
+                    lru = slot;
+                    lruAge = age;
+                }
             }
         }
+    }
+    if (lru) {
+        if (lru->mGlyph) {
+            lru->mGlyph->mIsValid = false;
+            lru->mGlyph->mSlot = NULL;
+            lru->mGlyph = NULL;
+            mEvictions++;
+        }
+        return lru;
+    }
 
-        // if we still don't fit, something is wrong and we shouldn't draw
-        if (!bitmapFit) {
-            ALOGE("Bitmap doesn't fit in cache. width, height = %i, %i", (int)bitmap->width, (int)bitmap->rows);
-            return false;
+    // No glyph is big enough to make room, so start over on the page whose
+    // most recently used glyph is the oldest.
+    if (!mCachePages.size()) {
+        return NULL;
+    }
+    uint32_t lruPage = 0;
+    for (uint32_t p = 0; p < mCachePages.size(); p++) {
+        CachePage *page = mCachePages[p];
+        uint32_t pageAge = 0xffffffff;
+        for (uint32_t s = 0; s < page->mShelves.size(); s++) {
+            CacheShelf *shelf = page->mShelves[s];
+            for (uint32_t i = 0; i < shelf->mSlots.size(); i++) {
+                FontCacheSlot *slot = shelf->mSlots[i];
+                if (slot->mGlyph && (mGlyphStamp - slot->mGlyph->mLastUse < pageAge)) {
+                    pageAge = mGlyphStamp - slot->mGlyph->mLastUse;
+                }
+            }
+        }
+        if (!p || (pageAge > lruAge)) {
+            lruPage = p;
+            lruAge = pageAge;
         }
     }
+    clearCachePage(mCachePages[lruPage]);
+    mEvictions++;
+    return findCacheSlot(width, height);
+}
+
+void FontState::releaseGlyph(Font::CachedGlyphInfo *glyph) {
+    if (glyph->mSlot) {
+        glyph->mSlot->mGlyph = NULL;
+        glyph->mSlot = NULL;
+    }
+}
+
+#ifndef ANDROID_RS_SERIALIZE
+bool FontState::cacheBitmap(FT_Bitmap *bitmap, Font::CachedGlyphInfo *glyph,
+                            uint32_t *retOriginX, uint32_t *retOriginY) {
+    uint32_t width = bitmap->width;
+    uint32_t height = bitmap->rows;
+
+    // If the glyph is too big, don't cache it
+    if ((height > mCacheHeight) || (width > mCacheWidth)) {
+        ALOGE("Font size to large to fit in cache. width, height = %i, %i", (int)bitmap->width, (int)bitmap->rows);
+        return false;
+    }
 
+    // Blank glyphs such as spaces draw nothing and need no space
+    if (!width || !height) {
+        glyph->mPage = 0;
+        *retOriginX = 0;
+        *retOriginY = 0;
+        return true;
+    }
+
+    FontCacheSlot *slot = findCacheSlot(width, height);
+    if (!slot) {
+        ALOGE("Bitmap doesn't fit in cache. width, height = %i, %i", (int)bitmap->width, (int)bitmap->rows);
+        return false;
+    }
+    slot->mGlyph = glyph;
+    glyph->mSlot = slot;
+    glyph->mPage = slot->mPage;
+
+    uint32_t startX = slot->mX;
+    uint32_t startY = slot->mY;
     *retOriginX = startX;
     *retOriginY = startY;
 
-    uint32_t endX = startX + bitmap->width;
-    uint32_t endY = startY + bitmap->rows;
+    uint32_t endX = startX + width;
+    uint32_t endY = startY + height;
 
-    uint32_t cacheWidth = getCacheTextureType()->getDimX();
+    uint32_t cacheWidth = mCacheWidth;
 
-    uint8_t *cacheBuffer = mCacheBuffer;
+    CachePage *page = mCachePages[slot->mPage];
+    uint8_t *cacheBuffer = page->mBuffer;
     uint8_t *bitmapBuffer = bitmap->buffer;
 
     uint32_t cacheX = 0, bX = 0, cacheY = 0, bY = 0;
@@ -470,22 +798,10 @@ bool FontState::cacheBitmap(FT_Bitmap *bitmap, uint32_t *retOriginX, uint32_t *r
         }
     }
 
-    // This will dirty the texture and the shader so next time
-    // we draw it will upload the data
-
-    mRSC->mHal.funcs.allocation.data2D(mRSC, mTextTexture.get(), 0, 0, 0,
-        RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X, mCacheWidth, mCacheHeight,
-        mCacheBuffer, mCacheWidth*mCacheHeight, mCacheWidth);
-
-    mFontShaderF->bindTexture(mRSC, 0, mTextTexture.get());
-
-    // Some debug code
-    /*for (uint32_t i = 0; i < mCacheLines.size(); i ++) {
-        ALOGE("Cache Line: H: %u Empty Space: %f",
-             mCacheLines[i]->mMaxHeight,
-              (1.0f - (float)mCacheLines[i]->mCurrentCol/(float)mCacheLines[i]->mMaxWidth)*100.0f);
-
-    }*/
+    // Only the rows holding the glyph go to the texture
+    mRSC->mHal.funcs.allocation.data2D(mRSC, page->mTexture.get(), 0, startY, 0,
+        RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X, mCacheWidth, height,
+        cacheBuffer + startY * mCacheWidth, mCacheWidth * height, mCacheWidth);
 
     return true;
 }
@@ -544,36 +860,11 @@ void FontState::initRenderState() {
 }
 
 void FontState::initTextTexture() {
-    ObjectBaseRef<const Element> alphaElem = Element::createRef(mRSC, RS_TYPE_UNSIGNED_8,
-                                                                RS_KIND_PIXEL_A, true, 1);
-
-    // We will allocate a texture to initially hold 32 character bitmaps
+    // Each page holds about 32 character bitmaps; more pages are added
+    // as glyphs stop fitting.
     mCacheHeight = 256;
     mCacheWidth = 1024;
-    ObjectBaseRef<Type> texType = Type::getTypeRef(mRSC, alphaElem.get(),
-                                                   mCacheWidth, mCacheHeight, 0, false, false, 0);
-    mCacheBuffer = new uint8_t[mCacheWidth * mCacheHeight];
-
-
-    Allocation *cacheAlloc = Allocation::createAllocation(mRSC, texType.get(),
-                                RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE);
-    mTextTexture.set(cacheAlloc);
-
-    // Split up our cache texture into lines of certain widths
-    int32_t nextLine = 0;
-    mCacheLines.push(new CacheTextureLine(16, texType->getDimX(), nextLine, 0));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(24, texType->getDimX(), nextLine, 0));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(24, texType->getDimX(), nextLine, 0));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(32, texType->getDimX(), nextLine, 0));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(32, texType->getDimX(), nextLine, 0));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(40, texType->getDimX(), nextLine, 0));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(texType->getDimY() - nextLine, texType->getDimX(), nextLine, 0));
+    addCachePage();
 }
 
 // Avoid having to reallocate memory and render quad by quad
@@ -637,6 +928,7 @@ void FontState::checkInit() {
     initRenderState();
 
     initVertexArrayBuffers();
+    startRasterizer();
 
     // We store a string with letters in a rough frequency of occurrence
     mLatinPrecache = " eisarntolcdugpmhbyfvkwzxjq"
@@ -652,6 +944,7 @@ void FontState::issueDrawCommand() {
     mRSC->setProgramRaster(mRSC->getDefaultProgramRaster());
     mRSC->setProgramFragment(mFontShaderF.get());
     mRSC->setProgramStore(mFontProgramStore.get());
+    mFontShaderF->bindTexture(mRSC, 0, mCachePages[mDrawPage]->mTexture.get());
 
     if (mConstantsDirty) {
         mFontShaderFConstant->data(mRSC, 0, 0, 1, &mConstants, sizeof(mConstants));
@@ -665,7 +958,8 @@ void FontState::issueDrawCommand() {
     mMesh->renderPrimitiveRange(mRSC, 0, 0, mCurrentQuadIndex * 6);
 }
 
-void FontState::appendMeshQuad(float x1, float y1, float z1,
+void FontState::appendMeshQuad(uint32_t page,
+                               float x1, float y1, float z1,
                                float u1, float v1,
                                float x2, float y2, float z2,
                                float u2, float v2,
@@ -673,6 +967,13 @@ void FontState::appendMeshQuad(float x1, float y1, float z1,
                                float u3, float v3,
                                float x4, float y4, float z4,
                                float u4, float v4) {
+    // Quads are drawn a page at a time
+    if ((mCurrentQuadIndex != 0) && (page != mDrawPage)) {
+        issueDrawCommand();
+        mCurrentQuadIndex = 0;
+    }
+    mDrawPage = page;
+
     const uint32_t vertsPerQuad = 4;
     const uint32_t floatsPerVert = 6;
     float *currentPos = mTextMeshPtr + mCurrentQuadIndex * vertsPerQuad * floatsPerVert;
@@ -723,28 +1024,312 @@ void FontState::appendMeshQuad(float x1, float y1, float z1,
 }
 
 uint32_t FontState::getRemainingCacheCapacity() {
-    uint32_t remainingCapacity = 0;
-    uint32_t totalPixels = 0;
-    for (uint32_t i = 0; i < mCacheLines.size(); i ++) {
-         remainingCapacity += (mCacheLines[i]->mMaxWidth - mCacheLines[i]->mCurrentCol);
-         totalPixels += mCacheLines[i]->mMaxWidth;
+    if (!mCachePages.size()) {
+        return 0;
+    }
+    uint64_t remainingPixels = 0;
+    for (uint32_t p = 0; p < mCachePages.size(); p++) {
+        CachePage *page = mCachePages[p];
+        remainingPixels += (uint64_t)(mCacheHeight - page->mNextShelfY) * mCacheWidth;
+        for (uint32_t s = 0; s < page->mShelves.size(); s++) {
+            CacheShelf *shelf = page->mShelves[s];
+            remainingPixels += (uint64_t)(mCacheWidth - shelf->mCurrentCol) * shelf->mHeight;
+        }
+    }
+    uint64_t totalPixels = (uint64_t)mCachePages.size() * mCacheWidth * mCacheHeight;
+    return (uint32_t)((remainingPixels * 100) / totalPixels);
+}
+
+void FontState::getCacheStats(CacheStats *stats) {
+    stats->pages = mCachePages.size();
+    stats->glyphs = 0;
+    for (uint32_t p = 0; p < mCachePages.size(); p++) {
+        CachePage *page = mCachePages[p];
+        for (uint32_t s = 0; s < page->mShelves.size(); s++) {
+            CacheShelf *shelf = page->mShelves[s];
+            for (uint32_t i = 0; i < shelf->mSlots.size(); i++) {
+                if (shelf->mSlots[i]->mGlyph) {
+                    stats->glyphs++;
+                }
+            }
+        }
+    }
+    stats->evictions = mEvictions;
+    stats->remaining = getRemainingCacheCapacity();
+}
+
+void FontState::precacheGlyph(Font *font, uint32_t utfChar) {
+    Font::CachedGlyphInfo *glyph = font->mCachedGlyphs.valueFor(utfChar);
+    if (glyph == NULL) {
+        glyph = font->cacheGlyph(utfChar);
+    }
+    // Code points the font lacks would all rasterize the missing glyph
+    if (glyph->mIsValid || glyph->mPending || !glyph->mGlyphIndex) {
+        return;
+    }
+    if (mRasterRunning) {
+        requestGlyph(font, glyph, true);
+    } else if (getRemainingCacheCapacity() > 25) {
+        // Remaining capacity is measured in %
+        font->updateGlyphCache(glyph);
     }
-    remainingCapacity = (remainingCapacity * 100) / totalPixels;
-    return remainingCapacity;
 }
 
 void FontState::precacheLatin(Font *font) {
-    // Remaining capacity is measured in %
-    uint32_t remainingCapacity = getRemainingCacheCapacity();
-    uint32_t precacheIdx = 0;
+    if (!mRasterRunning) {
+        // Rasterizing inline would hold up the command creating the font.
+        mIdlePrecache.push(font);
+        return;
+    }
+    const size_t l = strlen(mLatinPrecache);
+    for (uint32_t ct = 0; ct < l; ct++) {
+        precacheGlyph(font, (uint32_t)mLatinPrecache[ct]);
+    }
+}
+
+int32_t FontState::idle() {
+    // Finished glyphs are in the atlas by the next frame.
+    placeRasterizedGlyphs();
+
     const size_t l = strlen(mLatinPrecache);
-    while ((remainingCapacity > 25) && (precacheIdx < l)) {
-        font->getCachedUTFChar((int32_t)mLatinPrecache[precacheIdx]);
-        remainingCapacity = getRemainingCacheCapacity();
-        precacheIdx ++;
+    for (uint32_t ct = 0; (ct < kIdlePrecacheGlyphs) && mIdlePrecache.size(); ct++) {
+        if (mIdlePrecacheNext >= l) {
+            mIdlePrecache.removeAt(0);
+            mIdlePrecacheNext = 0;
+            continue;
+        }
+        precacheGlyph(mIdlePrecache[0], (uint32_t)mLatinPrecache[mIdlePrecacheNext++]);
+    }
+    if (mIdlePrecache.size()) {
+        return 0;
+    }
+    // The rasterizer takes a few ms a glyph.
+    return hasPendingGlyphs() ? 4 : -1;
+}
+
+size_t FontState::trim(bool pages) {
+    size_t freed = 0;
+    for (uint32_t ct = 0; ct < mActiveFonts.size(); ct++) {
+        freed += mActiveFonts[ct]->clearLayouts();
+    }
+    if (!pages || (mCachePages.size() <= 1)) {
+        return freed;
+    }
+
+    // The first page stays for the text shader to sample.
+    if (mCurrentQuadIndex != 0) {
+        issueDrawCommand();
+        mCurrentQuadIndex = 0;
+    }
+    for (uint32_t p = mCachePages.size() - 1; p > 0; p--) {
+        clearCachePage(mCachePages[p]);
+        delete[] mCachePages[p]->mBuffer;
+        delete mCachePages[p];
+        mCachePages.removeAt(p);
+        mRSC->trackMemory(RS_MEMORY_FONT_CACHE, -(ssize_t)(mCacheWidth * mCacheHeight));
     }
+    mDrawPage = 0;
+    return freed;
 }
 
+void FontState::precache(Font *font, uint32_t first, uint32_t last) {
+    checkInit();
+    if (last < first) {
+        return;
+    }
+    if ((last - first) >= kMaxPrecacheGlyphs) {
+        last = first + kMaxPrecacheGlyphs - 1;
+    }
+    for (uint32_t c = first; c <= last; c++) {
+        precacheGlyph(font, c);
+    }
+}
+
+void FontState::startRasterizer() {
+#ifndef ANDROID_RS_SERIALIZE
+    if (mRasterRunning) {
+        return;
+    }
+    mRasterExit = false;
+    int status = pthread_create(&mRasterThread, NULL, rasterizerProc, this);
+    if (status) {
+        ALOGE("Failed to start the glyph rasterizer, glyphs will be rasterized inline.");
+        return;
+    }
+    mRasterRunning = true;
+#endif //ANDROID_RS_SERIALIZE
+}
+
+void FontState::stopRasterizer() {
+    if (!mRasterRunning) {
+        return;
+    }
+    pthread_mutex_lock(&mRasterMutex);
+    mRasterExit = true;
+    pthread_cond_signal(&mRasterCond);
+    pthread_mutex_unlock(&mRasterMutex);
+    pthread_join(mRasterThread, NULL);
+    mRasterRunning = false;
+
+    for (uint32_t ct = 0; ct < mRasterRequests.size(); ct++) {
+        mRasterRequests[ct].mGlyph->mPending = false;
+    }
+    for (uint32_t ct = 0; ct < mRasterResults.size(); ct++) {
+        mRasterResults[ct].mGlyph->mPending = false;
+        delete[] mRasterResults[ct].mBuffer;
+    }
+    mRasterRequests.clear();
+    mRasterResults.clear();
+}
+
+void * FontState::rasterizerProc(void *vstate) {
+    FontState *state = (FontState *)vstate;
+
+    pthread_mutex_lock(&state->mRasterMutex);
+    while (true) {
+        while (!state->mRasterExit && !state->mRasterRequests.size()) {
+            pthread_cond_wait(&state->mRasterCond, &state->mRasterMutex);
+        }
+        if (state->mRasterExit) {
+            break;
+        }
+        pthread_mutex_unlock(&state->mRasterMutex);
+
+        state->lockFreeType();
+        pthread_mutex_lock(&state->mRasterMutex);
+        if (!state->mRasterRequests.size()) {
+            // Cancelled while we waited for FreeType
+            state->unlockFreeType();
+            continue;
+        }
+        GlyphRequest r = state->mRasterRequests[0];
+        state->mRasterRequests.removeAt(0);
+        state->mRasterBusy = true;
+        pthread_mutex_unlock(&state->mRasterMutex);
+
+#ifndef ANDROID_RS_SERIALIZE
+        state->rasterizeGlyph(&r);
+#endif //ANDROID_RS_SERIALIZE
+
+        pthread_mutex_lock(&state->mRasterMutex);
+        state->mRasterResults.push(r);
+        state->mRasterBusy = false;
+        state->unlockFreeType();
+    }
+    pthread_mutex_unlock(&state->mRasterMutex);
+    return NULL;
+}
+
+#ifndef ANDROID_RS_SERIALIZE
+void FontState::rasterizeGlyph(GlyphRequest *r) {
+    FT_Face face = r->mFont->mFace;
+    FT_Error error = FT_Load_Glyph(face, r->mGlyphIndex, FT_LOAD_RENDER);
+    if (error) {
+        ALOGE("Couldn't load glyph.");
+        return;
+    }
+
+    r->mAdvanceX = face->glyph->advance.x;
+    r->mAdvanceY = face->glyph->advance.y;
+    r->mBitmapLeft = face->glyph->bitmap_left;
+    r->mBitmapTop = face->glyph->bitmap_top;
+
+    // cacheBitmap takes rows packed at the bitmap width
+    FT_Bitmap *bitmap = &face->glyph->bitmap;
+    r->mWidth = bitmap->width;
+    r->mRows = bitmap->rows;
+    if (r->mWidth && r->mRows) {
+        r->mBuffer = new uint8_t[r->mWidth * r->mRows];
+        for (uint32_t y = 0; y < r->mRows; y++) {
+            memcpy(r->mBuffer + y * r->mWidth, bitmap->buffer + y * bitmap->pitch, r->mWidth);
+        }
+    }
+    r->mLoaded = true;
+}
+#endif //ANDROID_RS_SERIALIZE
+
+void FontState::requestGlyph(Font *font, Font::CachedGlyphInfo *glyph, bool precache) {
+    GlyphRequest r;
+    memset(&r, 0, sizeof(r));
+    r.mFont = font;
+    r.mGlyph = glyph;
+    r.mGlyphIndex = glyph->mGlyphIndex;
+    r.mPrecache = precache;
+    glyph->mPending = true;
+
+    pthread_mutex_lock(&mRasterMutex);
+    mRasterRequests.push(r);
+    pthread_cond_signal(&mRasterCond);
+    pthread_mutex_unlock(&mRasterMutex);
+}
+
+void FontState::cancelGlyphs(Font *font) {
+    pthread_mutex_lock(&mRasterMutex);
+    for (int32_t ct = (int32_t)mRasterRequests.size() - 1; ct >= 0; ct--) {
+        if (mRasterRequests[ct].mFont == font) {
+            mRasterRequests.removeAt(ct);
+        }
+    }
+    for (int32_t ct = (int32_t)mRasterResults.size() - 1; ct >= 0; ct--) {
+        if (mRasterResults[ct].mFont == font) {
+            delete[] mRasterResults[ct].mBuffer;
+            mRasterResults.removeAt(ct);
+        }
+    }
+    pthread_mutex_unlock(&mRasterMutex);
+}
+
+void FontState::placeRasterizedGlyphs() {
+#ifndef ANDROID_RS_SERIALIZE
+    if (!mRasterRunning) {
+        return;
+    }
+
+    pthread_mutex_lock(&mRasterMutex);
+    if (!mRasterResults.size()) {
+        pthread_mutex_unlock(&mRasterMutex);
+        return;
+    }
+    Vector<GlyphRequest> results(mRasterResults);
+    mRasterResults.clear();
+    pthread_mutex_unlock(&mRasterMutex);
+
+    for (uint32_t ct = 0; ct < results.size(); ct++) {
+        const GlyphRequest &r = results[ct];
+        Font::CachedGlyphInfo *glyph = r.mGlyph;
+        glyph->mPending = false;
+
+        // Precached glyphs stop short of crowding out the ones in use
+        if (r.mLoaded && !glyph->mIsValid &&
+            (!r.mPrecache || (getRemainingCacheCapacity() > 25))) {
+            glyph->mAdvanceX = r.mAdvanceX;
+            glyph->mAdvanceY = r.mAdvanceY;
+            glyph->mBitmapLeft = r.mBitmapLeft;
+            glyph->mBitmapTop = r.mBitmapTop;
+            glyph->mHasMetrics = true;
+
+            FT_Bitmap bitmap;
+            memset(&bitmap, 0, sizeof(bitmap));
+            bitmap.width = r.mWidth;
+            bitmap.rows = r.mRows;
+            bitmap.pitch = r.mWidth;
+            bitmap.buffer = r.mBuffer;
+            r.mFont->placeGlyph(glyph, &bitmap);
+        }
+        delete[] r.mBuffer;
+    }
+#endif //ANDROID_RS_SERIALIZE
+}
+
+bool FontState::hasPendingGlyphs() {
+    if (!mRasterRunning) {
+        return false;
+    }
+    pthread_mutex_lock(&mRasterMutex);
+    bool pending = mRasterRequests.size() || mRasterResults.size() || mRasterBusy;
+    pthread_mutex_unlock(&mRasterMutex);
+    return pending;
+}
 
 void FontState::renderText(const char *text, uint32_t len, int32_t x, int32_t y,
                            uint32_t startIndex, int32_t numGlyphs,
@@ -752,6 +1337,7 @@ void FontState::renderText(const char *text, uint32_t len, int32_t x, int32_t y,
                            Font::Rect *bounds,
                            uint8_t *bitmap, uint32_t bitmapW, uint32_t bitmapH) {
     checkInit();
+    placeRasterizedGlyphs();
 
     // Render code here
     Font *currentFont = mRSC->getFont();
@@ -816,6 +1402,9 @@ void FontState::getFontColor(float *r, float *g, float *b, float *a) const {
 
 void FontState::deinit(Context *rsc) {
     mInitialized = false;
+    stopRasterizer();
+    mIdlePrecache.clear();
+    mIdlePrecacheNext = 0;
 
     mFontShaderFConstant.clear();
 
@@ -825,11 +1414,8 @@ void FontState::deinit(Context *rsc) {
     mFontSampler.clear();
     mFontProgramStore.clear();
 
-    mTextTexture.clear();
-    for (uint32_t i = 0; i < mCacheLines.size(); i ++) {
-        delete mCacheLines[i];
-    }
-    mCacheLines.clear();
+    deleteCachePages();
+    mDrawPage = 0;
 
     mDefault.clear();
 #ifndef ANDROID_RS_SERIALIZE
@@ -840,24 +1426,6 @@ void FontState::deinit(Context *rsc) {
 #endif //ANDROID_RS_SERIALIZE
 }
 
-#ifndef ANDROID_RS_SERIALIZE
-bool FontState::CacheTextureLine::fitBitmap(FT_Bitmap_ *bitmap, uint32_t *retOriginX, uint32_t *retOriginY) {
-    if ((uint32_t)bitmap->rows > mMaxHeight) {
-        return false;
-    }
-
-    if (mCurrentCol + (uint32_t)bitmap->width < mMaxWidth) {
-        *retOriginX = mCurrentCol;
-        *retOriginY = mCurrentRow;
-        mCurrentCol += bitmap->width;
-        mDirty = true;
-       return true;
-    }
-
-    return false;
-}
-#endif //ANDROID_RS_SERIALIZE
-
 namespace android {
 namespace renderscript {
 
@@ -882,5 +1450,10 @@ RsFont rsi_FontCreateFromMemory(Context *rsc,
     return newFont;
 }
 
+void rsi_FontPrecache(Context *rsc, RsFont vfont, uint32_t firstChar, uint32_t lastChar) {
+    Font *font = static_cast<Font *>(vfont);
+    rsc->mStateFont.precache(font, firstChar, lastChar);
+}
+
 } // renderscript
 } // android
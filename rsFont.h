@@ -40,6 +40,7 @@ namespace renderscript {
 #define DEFAULT_TEXT_WHITE_GAMMA_THRESHOLD 192
 
 class FontState;
+struct FontCacheSlot;
 
 class Font : public ObjectBase {
 public:
@@ -78,6 +79,7 @@ public:
 protected:
 
     friend class FontState;
+    friend struct FontCacheSlot;
 
     // Pointer to the utf data, length of data, where to start, number of glyphs ot read
     // (each glyph may be longer than a char because we are dealing with utf data)
@@ -87,7 +89,6 @@ protected:
                    RenderMode mode = FRAMEBUFFER, Rect *bounds = NULL,
                    uint8_t *bitmap = NULL, uint32_t bitmapW = 0, uint32_t bitmapH = 0);
 
-    void invalidateTextureCache();
     struct CachedGlyphInfo
     {
         // Has the cache been invalidated?
@@ -110,6 +111,16 @@ protected:
         // Values below contain a glyph's origin in the bitmap
         int32_t mBitmapLeft;
         int32_t mBitmapTop;
+        // Page of the glyph atlas holding the bitmap, and the space there
+        // it owns, NULL for glyphs without pixels.
+        uint32_t mPage;
+        FontCacheSlot *mSlot;
+        // Stamp of the last lookup, for evicting the least recently used.
+        uint32_t mLastUse;
+        // Set while the rasterizer thread is drawing the glyph, and once
+        // the advance and kerning are known.
+        bool mPending;
+        bool mHasMetrics;
     };
 
     const char *mFontName;
@@ -125,10 +136,47 @@ protected:
     bool mHasKerning;
 
     DefaultKeyedVector<uint32_t, CachedGlyphInfo* > mCachedGlyphs;
-    CachedGlyphInfo* getCachedUTFChar(int32_t utfChar);
+    // With async set, glyphs missing from the atlas are handed to the
+    // rasterizer thread and skipped until they arrive.
+    CachedGlyphInfo* getCachedUTFChar(int32_t utfChar, bool async = false);
+    void validateGlyph(CachedGlyphInfo *glyph, bool async);
+
+    // Glyphs and pen offsets of recently rendered strings, so drawing or
+    // measuring one again skips decoding it and looking its glyphs up.
+    enum {
+        kMaxLayouts = 64,
+        kMaxLayoutText = 256
+    };
+    struct LayoutGlyph {
+        CachedGlyphInfo *mGlyph;
+        int32_t mPenX;
+    };
+    struct TextLayout {
+        uint32_t mHash;
+        char *mText;
+        uint32_t mLen;
+        uint32_t mStart;
+        int32_t mNumGlyphs;
+        uint32_t mLastUse;
+        Vector<LayoutGlyph> mGlyphs;
+    };
+    Vector<TextLayout*> mLayouts;
+    uint32_t mLayoutStamp;
+    TextLayout * findLayout(uint32_t hash, const char *text, uint32_t len,
+                            uint32_t start, int32_t numGlyphs);
+    void addLayout(uint32_t hash, const char *text, uint32_t len,
+                   uint32_t start, int32_t numGlyphs, const Vector<LayoutGlyph> &glyphs);
+    // Returns the bytes freed.
+    size_t clearLayouts();
+    void renderGlyph(CachedGlyphInfo *glyph, int32_t x, int32_t y, RenderMode mode,
+                     Rect *bounds, uint8_t *bitmap, uint32_t bitmapW, uint32_t bitmapH);
 
     CachedGlyphInfo *cacheGlyph(uint32_t glyph);
     void updateGlyphCache(CachedGlyphInfo *glyph);
+#ifndef ANDROID_RS_SERIALIZE
+    void loadGlyphMetrics(CachedGlyphInfo *glyph);
+    void placeGlyph(CachedGlyphInfo *glyph, FT_Bitmap_ *bitmap);
+#endif //ANDROID_RS_SERIALIZE
     void measureCachedGlyph(CachedGlyphInfo *glyph, int32_t x, int32_t y, Rect *bounds);
     void drawCachedGlyph(CachedGlyphInfo *glyph, int32_t x, int32_t y);
     void drawCachedGlyph(CachedGlyphInfo *glyph, int32_t x, int32_t y,
@@ -156,6 +204,29 @@ public:
     void setFontColor(float r, float g, float b, float a);
     void getFontColor(float *r, float *g, float *b, float *a) const;
 
+    struct CacheStats {
+        uint32_t pages;
+        uint32_t glyphs;
+        // Glyphs and pages dropped to make room.
+        uint32_t evictions;
+        // Free space left in the allocated pages, in percent.
+        uint32_t remaining;
+    };
+    void getCacheStats(CacheStats *stats);
+
+    // Queues rasterization of the code points [first, last] of font.
+    void precache(Font *font, uint32_t first, uint32_t last);
+    // Puts glyphs the rasterizer thread has finished into the atlas.
+    void placeRasterizedGlyphs();
+    // Whether glyphs are still on their way, needing another frame.
+    bool hasPendingGlyphs();
+    // Glyph work for the context to do while idle; returns as the tasks
+    // of Context::addIdleTask do.
+    int32_t idle();
+    // Drops the layouts of every font and, with pages, the atlas pages
+    // past the first.  Returns the bytes freed that aren't tracked.
+    size_t trim(bool pages);
+
 protected:
 
     float mSurfaceWidth;
@@ -163,26 +234,96 @@ protected:
 
     friend class Font;
 
-    struct CacheTextureLine {
-        uint32_t mMaxHeight;
-        uint32_t mMaxWidth;
-        uint32_t mCurrentRow;
-        uint32_t mCurrentCol;
-        bool mDirty;
+    // The glyph atlas is made of up to kMaxCachePages textures, each packed
+    // with shelves: rows of glyphs of about the same height, filled left to
+    // right.  Once nothing fits, the least recently used glyph with room
+    // for the new one gives up its slot, or failing that the least
+    // recently used page is cleared.
+    enum {
+        kMaxCachePages = 4
+    };
 
-        CacheTextureLine(uint32_t maxHeight, uint32_t maxWidth, uint32_t currentRow, uint32_t currentCol)
-            : mMaxHeight(maxHeight), mMaxWidth(maxWidth), mCurrentRow(currentRow),
-              mCurrentCol(currentCol), mDirty(false)  {
-        }
+    struct CacheShelf {
+        uint32_t mY;
+        uint32_t mHeight;
+        uint32_t mCurrentCol;
+        Vector<FontCacheSlot*> mSlots;
+    };
 
-        bool fitBitmap(FT_Bitmap_ *bitmap, uint32_t *retOriginX, uint32_t *retOriginY);
+    struct CachePage {
+        ObjectBaseRef<Allocation> mTexture;
+        uint8_t *mBuffer;
+        Vector<CacheShelf*> mShelves;
+        uint32_t mNextShelfY;
     };
 
-    Vector<CacheTextureLine*> mCacheLines;
-    uint32_t getRemainingCacheCapacity();
+    Vector<CachePage*> mCachePages;
+    uint32_t mGlyphStamp;
+    uint32_t mEvictions;
+    // Page the queued quads sample.
+    uint32_t mDrawPage;
 
+    uint32_t getRemainingCacheCapacity();
+    bool addCachePage();
+    void clearCachePage(CachePage *page);
+    void deleteCachePages();
+    FontCacheSlot * addShelfSlot(uint32_t page, CacheShelf *shelf, uint32_t width);
+    FontCacheSlot * findCacheSlot(uint32_t width, uint32_t height);
+    void releaseGlyph(Font::CachedGlyphInfo *glyph);
+
+    enum {
+        kMaxPrecacheGlyphs = 512
+    };
+    void precacheGlyph(Font *font, uint32_t utfChar);
     void precacheLatin(Font *font);
     const char *mLatinPrecache;
+    // Without the rasterizer thread, fonts get their Latin glyphs at idle
+    // time, the first font being up to mIdlePrecacheNext.
+    enum {
+        kIdlePrecacheGlyphs = 8
+    };
+    Vector<Font*> mIdlePrecache;
+    uint32_t mIdlePrecacheNext;
+
+    // Glyphs are rasterized by FreeType on a thread of their own and
+    // placed in the atlas on the context thread.  Every FreeType call
+    // holds mFreeTypeMutex, taken before mRasterMutex when both are.
+    struct GlyphRequest {
+        Font *mFont;
+        Font::CachedGlyphInfo *mGlyph;
+        int32_t mGlyphIndex;
+        bool mPrecache;
+        // Written by the rasterizer
+        bool mLoaded;
+        int32_t mAdvanceX;
+        int32_t mAdvanceY;
+        int32_t mBitmapLeft;
+        int32_t mBitmapTop;
+        uint32_t mWidth;
+        uint32_t mRows;
+        uint8_t *mBuffer;
+    };
+    Vector<GlyphRequest> mRasterRequests;
+    Vector<GlyphRequest> mRasterResults;
+    pthread_mutex_t mFreeTypeMutex;
+    pthread_mutex_t mRasterMutex;
+    pthread_cond_t mRasterCond;
+    pthread_t mRasterThread;
+    bool mRasterRunning;
+    bool mRasterExit;
+    bool mRasterBusy;
+
+    void lockFreeType() { pthread_mutex_lock(&mFreeTypeMutex); }
+    void unlockFreeType() { pthread_mutex_unlock(&mFreeTypeMutex); }
+    void startRasterizer();
+    void stopRasterizer();
+    static void * rasterizerProc(void *vstate);
+#ifndef ANDROID_RS_SERIALIZE
+    void rasterizeGlyph(GlyphRequest *r);
+#endif //ANDROID_RS_SERIALIZE
+    void requestGlyph(Font *font, Font::CachedGlyphInfo *glyph, bool precache);
+    // Drops the requests of a font; called holding mFreeTypeMutex.
+    void cancelGlyphs(Font *font);
 
     Context *mRSC;
 
@@ -212,22 +353,16 @@ protected:
     ObjectBaseRef<ProgramStore> mFontProgramStore;
     void initRenderState();
 
-    // Texture to cache glyph bitmaps
-    ObjectBaseRef<Allocation> mTextTexture;
-    uint8_t *mCacheBuffer;
+    // Size of each glyph atlas page
     uint32_t mCacheWidth;
     uint32_t mCacheHeight;
 
     void initTextTexture();
 
 #ifndef ANDROID_RS_SERIALIZE
-    bool cacheBitmap(FT_Bitmap_ *bitmap, uint32_t *retOriginX, uint32_t *retOriginY);
+    bool cacheBitmap(FT_Bitmap_ *bitmap, Font::CachedGlyphInfo *glyph,
+                     uint32_t *retOriginX, uint32_t *retOriginY);
 #endif //ANDROID_RS_SERIALIZE
-    const Type* getCacheTextureType() {
-        return mTextTexture->getType();
-    }
-
-    void flushAllAndInvalidate();
 
     // Pointer to vertex data to speed up frame to frame work
     float *mTextMeshPtr;
@@ -243,7 +378,8 @@ protected:
 
     void issueDrawCommand();
 
-    void appendMeshQuad(float x1, float y1, float z1,
+    void appendMeshQuad(uint32_t page,
+                        float x1, float y1, float z1,
                         float u1, float v1,
                         float x2, float y2, float z2,
                         float u2, float v2,
@@ -253,6 +389,16 @@ protected:
                         float u4, float v4);
 };
 
+// Space in a glyph atlas page owned by one glyph at a time.
+struct FontCacheSlot {
+    uint32_t mPage;
+    uint32_t mX;
+    uint32_t mY;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    Font::CachedGlyphInfo *mGlyph;
+};
+
 }
 }
 
@@ -30,12 +30,18 @@
 namespace android {
 namespace renderscript {
 
-GrallocConsumer::GrallocConsumer(Allocation *a, const sp<IGraphicBufferConsumer>& bq) :
+GrallocConsumer::GrallocConsumer(Allocation *a, const sp<IGraphicBufferConsumer>& bq,
+                                 uint32_t depth) :
     ConsumerBase(bq, true)
 {
     mAlloc = a;
+    mPendingHead = 0;
+    mPendingCount = 0;
+    mDepth = rsMax(1u, rsMin(depth, MAX_QUEUE_DEPTH));
+
     mConsumer->setConsumerUsageBits(GRALLOC_USAGE_SW_READ_OFTEN);
-    mConsumer->setMaxAcquiredBufferCount(2);
+    // The current frame plus the ones queued behind it.
+    mConsumer->setMaxAcquiredBufferCount(mDepth + 1);
 
     uint32_t y = a->mHal.drvState.lod[0].dimY;
     if (y < 1) y = 1;
@@ -53,17 +59,64 @@ GrallocConsumer::~GrallocConsumer() {
 
 
 
-status_t GrallocConsumer::lockNextBuffer() {
+status_t GrallocConsumer::lockNextBuffer(bool latest) {
     Mutex::Autolock _l(mMutex);
     status_t err;
 
     if (mAcquiredBuffer.mSlot != BufferQueue::INVALID_BUFFER_SLOT) {
-        err = releaseAcquiredBufferLocked();
+        err = releaseAcquiredBufferLocked(&mAcquiredBuffer);
+        if (err) {
+            return err;
+        }
+    }
+
+    // Take every frame the producer has queued while there is room, so
+    // its buffers are back in flight while the script works on this one.
+    // When only the newest frame matters, older ones make room for it.
+    for (;;) {
+        if (mPendingCount == mDepth) {
+            if (!latest) {
+                break;
+            }
+            AcquiredBuffer old;
+            popPendingLocked(&old);
+            err = releaseAcquiredBufferLocked(&old);
+            if (err) {
+                return err;
+            }
+        }
+
+        AcquiredBuffer *ab = &mPending[(mPendingHead + mPendingCount) % MAX_QUEUE_DEPTH];
+        err = lockBufferLocked(ab);
+        if (err == BAD_VALUE) {
+            break;
+        }
+        if (err != OK) {
+            return err;
+        }
+        mPendingCount++;
+    }
+
+    while (latest && (mPendingCount > 1)) {
+        AcquiredBuffer old;
+        popPendingLocked(&old);
+        err = releaseAcquiredBufferLocked(&old);
         if (err) {
             return err;
         }
     }
 
+    if (!mPendingCount) {
+        return BAD_VALUE;
+    }
+
+    popPendingLocked(&mAcquiredBuffer);
+    publishLocked();
+    return OK;
+}
+
+status_t GrallocConsumer::lockBufferLocked(AcquiredBuffer *ab) {
+    status_t err;
     BufferQueue::BufferItem b;
 
     err = acquireBufferLocked(&b, 0);
@@ -116,24 +169,36 @@ status_t GrallocConsumer::lockNextBuffer() {
         }
     }
 
-    size_t lockedIdx = 0;
-    assert(mAcquiredBuffer.mSlot == BufferQueue::INVALID_BUFFER_SLOT);
-
-    mAcquiredBuffer.mSlot = buf;
-    mAcquiredBuffer.mBufferPointer = bufferPointer;
-    mAcquiredBuffer.mGraphicBuffer = mSlots[buf].mGraphicBuffer;
-
-    mAlloc->mHal.drvState.lod[0].mallocPtr = reinterpret_cast<uint8_t*>(bufferPointer);
-    mAlloc->mHal.drvState.lod[0].stride = mSlots[buf].mGraphicBuffer->getStride() *
-            mAlloc->mHal.state.type->getElementSizeBytes();
-    mAlloc->mHal.state.nativeBuffer = mAcquiredBuffer.mGraphicBuffer->getNativeBuffer();
-    mAlloc->mHal.state.timestamp = b.mTimestamp;
-
     assert(mAlloc->mHal.drvState.lod[0].dimX ==
            mSlots[buf].mGraphicBuffer->getWidth());
     assert(mAlloc->mHal.drvState.lod[0].dimY ==
            mSlots[buf].mGraphicBuffer->getHeight());
 
+    ab->mSlot = buf;
+    ab->mBufferPointer = bufferPointer;
+    ab->mGraphicBuffer = mSlots[buf].mGraphicBuffer;
+    ab->mYcbcr = ycbcr;
+    ab->mTimestamp = b.mTimestamp;
+    return OK;
+}
+
+void GrallocConsumer::popPendingLocked(AcquiredBuffer *ab) {
+    AcquiredBuffer *front = &mPending[mPendingHead];
+    *ab = *front;
+    *front = AcquiredBuffer();
+    mPendingHead = (mPendingHead + 1) % MAX_QUEUE_DEPTH;
+    mPendingCount--;
+}
+
+void GrallocConsumer::publishLocked() {
+    const AcquiredBuffer &ab = mAcquiredBuffer;
+
+    mAlloc->mHal.drvState.lod[0].mallocPtr = reinterpret_cast<uint8_t*>(ab.mBufferPointer);
+    mAlloc->mHal.drvState.lod[0].stride = ab.mGraphicBuffer->getStride() *
+            mAlloc->mHal.state.type->getElementSizeBytes();
+    mAlloc->mHal.state.nativeBuffer = ab.mGraphicBuffer->getNativeBuffer();
+    mAlloc->mHal.state.timestamp = ab.mTimestamp;
+
     //mAlloc->format = mSlots[buf].mGraphicBuffer->getPixelFormat();
 
     //mAlloc->crop        = b.mCrop;
@@ -142,48 +207,59 @@ status_t GrallocConsumer::lockNextBuffer() {
     //mAlloc->frameNumber = b.mFrameNumber;
 
     if (mAlloc->mHal.state.yuv) {
-        mAlloc->mHal.drvState.lod[1].mallocPtr = ycbcr.cr;
-        mAlloc->mHal.drvState.lod[2].mallocPtr = ycbcr.cb;
+        mAlloc->mHal.drvState.lod[1].mallocPtr = ab.mYcbcr.cr;
+        mAlloc->mHal.drvState.lod[2].mallocPtr = ab.mYcbcr.cb;
 
-        mAlloc->mHal.drvState.lod[0].stride = ycbcr.ystride;
-        mAlloc->mHal.drvState.lod[1].stride = ycbcr.cstride;
-        mAlloc->mHal.drvState.lod[2].stride = ycbcr.cstride;
+        mAlloc->mHal.drvState.lod[0].stride = ab.mYcbcr.ystride;
+        mAlloc->mHal.drvState.lod[1].stride = ab.mYcbcr.cstride;
+        mAlloc->mHal.drvState.lod[2].stride = ab.mYcbcr.cstride;
 
         mAlloc->mHal.drvState.yuv.shift = 1;
-        mAlloc->mHal.drvState.yuv.step = ycbcr.chroma_step;
+        mAlloc->mHal.drvState.yuv.step = ab.mYcbcr.chroma_step;
     }
-
-    return OK;
 }
 
 status_t GrallocConsumer::unlockBuffer() {
     Mutex::Autolock _l(mMutex);
-    return releaseAcquiredBufferLocked();
+    status_t err = OK;
+
+    if (mAcquiredBuffer.mSlot != BufferQueue::INVALID_BUFFER_SLOT) {
+        err = releaseAcquiredBufferLocked(&mAcquiredBuffer);
+    }
+    while (mPendingCount) {
+        AcquiredBuffer old;
+        popPendingLocked(&old);
+        status_t e = releaseAcquiredBufferLocked(&old);
+        if (e != OK) {
+            err = e;
+        }
+    }
+    return err;
 }
 
-status_t GrallocConsumer::releaseAcquiredBufferLocked() {
+status_t GrallocConsumer::releaseAcquiredBufferLocked(AcquiredBuffer *ab) {
     status_t err;
 
-    err = mAcquiredBuffer.mGraphicBuffer->unlock();
+    err = ab->mGraphicBuffer->unlock();
     if (err != OK) {
         ALOGE("%s: Unable to unlock graphic buffer", __FUNCTION__);
         return err;
     }
-    int buf = mAcquiredBuffer.mSlot;
+    int buf = ab->mSlot;
 
     // release the buffer if it hasn't already been freed by the BufferQueue.
     // This can happen, for example, when the producer of this buffer
     // disconnected after this buffer was acquired.
-    if (CC_LIKELY(mAcquiredBuffer.mGraphicBuffer ==
+    if (CC_LIKELY(ab->mGraphicBuffer ==
             mSlots[buf].mGraphicBuffer)) {
         releaseBufferLocked(
-                buf, mAcquiredBuffer.mGraphicBuffer,
+                buf, ab->mGraphicBuffer,
                 EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
     }
 
-    mAcquiredBuffer.mSlot = BufferQueue::INVALID_BUFFER_SLOT;
-    mAcquiredBuffer.mBufferPointer = NULL;
-    mAcquiredBuffer.mGraphicBuffer.clear();
+    ab->mSlot = BufferQueue::INVALID_BUFFER_SLOT;
+    ab->mBufferPointer = NULL;
+    ab->mGraphicBuffer.clear();
     return OK;
 }
 
@@ -44,14 +44,19 @@ class GrallocConsumer : public ConsumerBase
   public:
     typedef ConsumerBase::FrameAvailableListener FrameAvailableListener;
 
-    GrallocConsumer(Allocation *, const sp<IGraphicBufferConsumer>& bq);
+    // Most frames that can wait behind the one being processed.
+    static const uint32_t MAX_QUEUE_DEPTH = 8;
+
+    GrallocConsumer(Allocation *, const sp<IGraphicBufferConsumer>& bq, uint32_t depth);
 
     virtual ~GrallocConsumer();
-    status_t lockNextBuffer();
+    // Moves the allocation to the next queued frame, or to the newest one
+    // when latest is set.  Returns BAD_VALUE when no frame is waiting.
+    status_t lockNextBuffer(bool latest);
+    // Releases the current frame and every frame queued behind it.
     status_t unlockBuffer();
 
   private:
-    status_t releaseAcquiredBufferLocked();
     Allocation *mAlloc;
 
     // Tracking for buffers acquired by the user
@@ -62,13 +67,30 @@ class GrallocConsumer : public ConsumerBase
         int mSlot;
         sp<GraphicBuffer> mGraphicBuffer;
         void *mBufferPointer;
+        android_ycbcr mYcbcr;
+        int64_t mTimestamp;
 
         AcquiredBuffer() :
                 mSlot(BufferQueue::INVALID_BUFFER_SLOT),
-                mBufferPointer(NULL) {
+                mBufferPointer(NULL),
+                mYcbcr(android_ycbcr()),
+                mTimestamp(0) {
         }
     };
+
+    status_t lockBufferLocked(AcquiredBuffer *ab);
+    status_t releaseAcquiredBufferLocked(AcquiredBuffer *ab);
+    void popPendingLocked(AcquiredBuffer *ab);
+    void publishLocked();
+
+    // The frame the allocation currently points at.
     AcquiredBuffer mAcquiredBuffer;
+
+    // Frames acquired and locked ahead of lockNextBuffer, oldest first.
+    AcquiredBuffer mPending[MAX_QUEUE_DEPTH];
+    uint32_t mPendingHead;
+    uint32_t mPendingCount;
+    uint32_t mDepth;
 };
 
 } // namespace renderscript
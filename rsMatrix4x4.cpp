@@ -22,6 +22,13 @@
 #include "string.h"
 #include "math.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 using namespace android;
 using namespace android::renderscript;
 
@@ -33,42 +40,58 @@ using namespace android::renderscript;
 
 
 
+// Writes the adjugate of m to adj and returns the determinant.  The
+// cofactors are built from the 2x2 minors of the first two and last two
+// columns, which each cofactor would otherwise recompute.
+static float getAdjugate(const float *m, float *adj) {
+    const float s0 = m[0] * m[5] - m[4] * m[1];
+    const float s1 = m[0] * m[6] - m[4] * m[2];
+    const float s2 = m[0] * m[7] - m[4] * m[3];
+    const float s3 = m[1] * m[6] - m[5] * m[2];
+    const float s4 = m[1] * m[7] - m[5] * m[3];
+    const float s5 = m[2] * m[7] - m[6] * m[3];
+
+    const float c5 = m[10] * m[15] - m[14] * m[11];
+    const float c4 = m[9] * m[15] - m[13] * m[11];
+    const float c3 = m[9] * m[14] - m[13] * m[10];
+    const float c2 = m[8] * m[15] - m[12] * m[11];
+    const float c1 = m[8] * m[14] - m[12] * m[10];
+    const float c0 = m[8] * m[13] - m[12] * m[9];
+
+    adj[0] = m[5] * c5 - m[6] * c4 + m[7] * c3;
+    adj[1] = -m[1] * c5 + m[2] * c4 - m[3] * c3;
+    adj[2] = m[13] * s5 - m[14] * s4 + m[15] * s3;
+    adj[3] = -m[9] * s5 + m[10] * s4 - m[11] * s3;
+
+    adj[4] = -m[4] * c5 + m[6] * c2 - m[7] * c1;
+    adj[5] = m[0] * c5 - m[2] * c2 + m[3] * c1;
+    adj[6] = -m[12] * s5 + m[14] * s2 - m[15] * s1;
+    adj[7] = m[8] * s5 - m[10] * s2 + m[11] * s1;
+
+    adj[8] = m[4] * c4 - m[5] * c2 + m[7] * c0;
+    adj[9] = -m[0] * c4 + m[1] * c2 - m[3] * c0;
+    adj[10] = m[12] * s4 - m[13] * s2 + m[15] * s0;
+    adj[11] = -m[8] * s4 + m[9] * s2 - m[11] * s0;
+
+    adj[12] = -m[4] * c3 + m[5] * c1 - m[6] * c0;
+    adj[13] = m[0] * c3 - m[1] * c1 + m[2] * c0;
+    adj[14] = -m[12] * s3 + m[13] * s1 - m[14] * s0;
+    adj[15] = m[8] * s3 - m[9] * s1 + m[10] * s0;
+
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
 // Returns true if the matrix was successfully inversed
 bool Matrix4x4::inverse() {
     rs_matrix4x4 result;
-
-    int i, j;
-    for (i = 0; i < 4; ++i) {
-        for (j = 0; j < 4; ++j) {
-            // computeCofactor for int i, int j
-            int c0 = (i+1) % 4;
-            int c1 = (i+2) % 4;
-            int c2 = (i+3) % 4;
-            int r0 = (j+1) % 4;
-            int r1 = (j+2) % 4;
-            int r2 = (j+3) % 4;
-
-            float minor =
-                (m[c0 + 4*r0] * (m[c1 + 4*r1] * m[c2 + 4*r2] - m[c1 + 4*r2] * m[c2 + 4*r1]))
-                - (m[c0 + 4*r1] * (m[c1 + 4*r0] * m[c2 + 4*r2] - m[c1 + 4*r2] * m[c2 + 4*r0]))
-                + (m[c0 + 4*r2] * (m[c1 + 4*r0] * m[c2 + 4*r1] - m[c1 + 4*r1] * m[c2 + 4*r0]));
-
-            float cofactor = (i+j) & 1 ? -minor : minor;
-
-            result.m[4*i + j] = cofactor;
-        }
-    }
-
-    // Dot product of 0th column of source and 0th row of result
-    float det = m[0]*result.m[0] + m[4]*result.m[1] +
-                 m[8]*result.m[2] + m[12]*result.m[3];
+    float det = getAdjugate(m, result.m);
 
     if (fabs(det) < 1e-6) {
         return false;
     }
 
     det = 1.0f / det;
-    for (i = 0; i < 16; ++i) {
+    for (int i = 0; i < 16; ++i) {
         m[i] = result.m[i] * det;
     }
 
@@ -78,39 +101,17 @@ bool Matrix4x4::inverse() {
 // Returns true if the matrix was successfully inversed
 bool Matrix4x4::inverseTranspose() {
     rs_matrix4x4 result;
-
-    int i, j;
-    for (i = 0; i < 4; ++i) {
-        for (j = 0; j < 4; ++j) {
-            // computeCofactor for int i, int j
-            int c0 = (i+1) % 4;
-            int c1 = (i+2) % 4;
-            int c2 = (i+3) % 4;
-            int r0 = (j+1) % 4;
-            int r1 = (j+2) % 4;
-            int r2 = (j+3) % 4;
-
-            float minor = (m[c0 + 4*r0] * (m[c1 + 4*r1] * m[c2 + 4*r2] - m[c1 + 4*r2] * m[c2 + 4*r1]))
-                         - (m[c0 + 4*r1] * (m[c1 + 4*r0] * m[c2 + 4*r2] - m[c1 + 4*r2] * m[c2 + 4*r0]))
-                         + (m[c0 + 4*r2] * (m[c1 + 4*r0] * m[c2 + 4*r1] - m[c1 + 4*r1] * m[c2 + 4*r0]));
-
-            float cofactor = (i+j) & 1 ? -minor : minor;
-
-            result.m[4*j + i] = cofactor;
-        }
-    }
-
-    // Dot product of 0th column of source and 0th column of result
-    float det = m[0]*result.m[0] + m[4]*result.m[4] +
-                 m[8]*result.m[8] + m[12]*result.m[12];
+    float det = getAdjugate(m, result.m);
 
     if (fabs(det) < 1e-6) {
         return false;
     }
 
     det = 1.0f / det;
-    for (i = 0; i < 16; ++i) {
-        m[i] = result.m[i] * det;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            m[4*i + j] = result.m[4*j + i] * det;
+        }
     }
 
     return true;
@@ -250,6 +251,42 @@ void Matrix4x4::loadTranslate(float x, float y, float z) {
 }
 
 void Matrix4x4::loadMultiply(const rs_matrix4x4 *lhs, const rs_matrix4x4 *rhs) {
+    // Column i of the product is lhs applied to column i of rhs.  The
+    // vector versions add the terms in the same order as the loop below,
+    // so every build gives the same result.
+#if defined(__SSE2__)
+    const __m128 l0 = _mm_loadu_ps(&lhs->m[0]);
+    const __m128 l1 = _mm_loadu_ps(&lhs->m[4]);
+    const __m128 l2 = _mm_loadu_ps(&lhs->m[8]);
+    const __m128 l3 = _mm_loadu_ps(&lhs->m[12]);
+    __m128 r[4];
+    for (int i = 0; i < 4; i++) {
+        const float *c = &rhs->m[i * 4];
+        r[i] = _mm_mul_ps(l0, _mm_set1_ps(c[0]));
+        r[i] = _mm_add_ps(r[i], _mm_mul_ps(l1, _mm_set1_ps(c[1])));
+        r[i] = _mm_add_ps(r[i], _mm_mul_ps(l2, _mm_set1_ps(c[2])));
+        r[i] = _mm_add_ps(r[i], _mm_mul_ps(l3, _mm_set1_ps(c[3])));
+    }
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_ps(&m[i * 4], r[i]);
+    }
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+    const float32x4_t l0 = vld1q_f32(&lhs->m[0]);
+    const float32x4_t l1 = vld1q_f32(&lhs->m[4]);
+    const float32x4_t l2 = vld1q_f32(&lhs->m[8]);
+    const float32x4_t l3 = vld1q_f32(&lhs->m[12]);
+    float32x4_t r[4];
+    for (int i = 0; i < 4; i++) {
+        const float *c = &rhs->m[i * 4];
+        r[i] = vmulq_n_f32(l0, c[0]);
+        r[i] = vaddq_f32(r[i], vmulq_n_f32(l1, c[1]));
+        r[i] = vaddq_f32(r[i], vmulq_n_f32(l2, c[2]));
+        r[i] = vaddq_f32(r[i], vmulq_n_f32(l3, c[3]));
+    }
+    for (int i = 0; i < 4; i++) {
+        vst1q_f32(&m[i * 4], r[i]);
+    }
+#else
     for (int i=0 ; i<4 ; i++) {
         float ri0 = 0;
         float ri1 = 0;
@@ -267,6 +304,7 @@ void Matrix4x4::loadMultiply(const rs_matrix4x4 *lhs, const rs_matrix4x4 *rhs) {
         set(i,2, ri2);
         set(i,3, ri3);
     }
+#endif
 }
 
 void Matrix4x4::loadOrtho(float left, float right, float bottom, float top, float near, float far) {
@@ -300,10 +338,22 @@ void Matrix4x4::loadPerspective(float fovy, float aspect, float near, float far)
 }
 
 void Matrix4x4::vectorMultiply(float *out, const float *in) const {
+#if defined(__SSE2__)
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(&m[0]), _mm_set1_ps(in[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&m[4]), _mm_set1_ps(in[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&m[8]), _mm_set1_ps(in[2])));
+    _mm_storeu_ps(out, _mm_add_ps(r, _mm_loadu_ps(&m[12])));
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+    float32x4_t r = vmulq_n_f32(vld1q_f32(&m[0]), in[0]);
+    r = vaddq_f32(r, vmulq_n_f32(vld1q_f32(&m[4]), in[1]));
+    r = vaddq_f32(r, vmulq_n_f32(vld1q_f32(&m[8]), in[2]));
+    vst1q_f32(out, vaddq_f32(r, vld1q_f32(&m[12])));
+#else
     out[0] = (m[0] * in[0]) + (m[4] * in[1]) + (m[8] * in[2]) + m[12];
     out[1] = (m[1] * in[0]) + (m[5] * in[1]) + (m[9] * in[2]) + m[13];
     out[2] = (m[2] * in[0]) + (m[6] * in[1]) + (m[10] * in[2]) + m[14];
     out[3] = (m[3] * in[0]) + (m[7] * in[1]) + (m[11] * in[2]) + m[15];
+#endif
 }
 
 void Matrix4x4::logv(const char *s) const {
@@ -18,6 +18,16 @@
 #include "rsMesh.h"
 #include "rs.h"
 
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 using namespace android;
 using namespace android::renderscript;
 
@@ -33,6 +43,12 @@ Mesh::Mesh(Context *rsc) : ObjectBase(rsc) {
 
     mVertexBuffers = NULL;
     mIndexBuffers = NULL;
+
+    memset(mBBoxMin, 0, sizeof(mBBoxMin));
+    memset(mBBoxMax, 0, sizeof(mBBoxMax));
+    mBBoxSource = NULL;
+    mBBoxVersion = 0;
+    mBBoxCount = 0;
 }
 
 Mesh::Mesh(Context *rsc,
@@ -57,6 +73,12 @@ Mesh::Mesh(Context *rsc,
 
     mVertexBuffers = new ObjectBaseRef<Allocation>[mHal.state.vertexBuffersCount];
     mIndexBuffers = new ObjectBaseRef<Allocation>[mHal.state.primitivesCount];
+
+    memset(mBBoxMin, 0, sizeof(mBBoxMin));
+    memset(mBBoxMax, 0, sizeof(mBBoxMax));
+    mBBoxSource = NULL;
+    mBBoxVersion = 0;
+    mBBoxCount = 0;
 }
 
 Mesh::~Mesh() {
@@ -198,6 +220,26 @@ void Mesh::renderPrimitiveRange(Context *rsc, uint32_t primIndex, uint32_t start
     mRSC->mHal.funcs.mesh.draw(mRSC, this, primIndex, start, len);
 }
 
+void Mesh::renderPrimitiveInstanced(Context *rsc, uint32_t primIndex,
+                                    const Allocation *transforms) const {
+    if (primIndex >= mHal.state.primitivesCount) {
+        ALOGE("Invalid primitive index");
+        return;
+    }
+
+    uint32_t len;
+    if (mHal.state.indexBuffers[primIndex]) {
+        len = mHal.state.indexBuffers[primIndex]->getType()->getDimX();
+    } else {
+        len = mHal.state.vertexBuffers[0]->getType()->getDimX();
+    }
+    if (len < 1 || !transforms->getType()->getDimX()) {
+        return;
+    }
+
+    mRSC->mHal.funcs.mesh.drawInstanced(mRSC, this, primIndex, 0, len, transforms);
+}
+
 void Mesh::uploadAll(Context *rsc) {
     for (uint32_t ct = 0; ct < mHal.state.vertexBuffersCount; ct ++) {
         if (mHal.state.vertexBuffers[ct]) {
@@ -212,55 +254,327 @@ void Mesh::uploadAll(Context *rsc) {
     }
 }
 
+// The type a float vertex field is stored as once compacted, or
+// RS_TYPE_NONE to leave it as it is.
+static RsDataType compactFieldType(const char *name, const Element *field,
+                                   uint32_t arraySize, uint32_t flags) {
+    if (field->getFieldCount() || (arraySize != 1) ||
+        (field->getComponent().getType() != RS_TYPE_FLOAT_32)) {
+        return RS_TYPE_NONE;
+    }
+    if ((flags & RS_MESH_COMPACT_POSITION_F16) && !strcmp(name, "position")) {
+        return RS_TYPE_FLOAT_16;
+    }
+    if ((flags & RS_MESH_COMPACT_NORMAL_I16) && !strcmp(name, "normal")) {
+        return RS_TYPE_SIGNED_16;
+    }
+    if ((flags & RS_MESH_COMPACT_TEXTURE_F16) && !strncmp(name, "texture", 7)) {
+        return RS_TYPE_FLOAT_16;
+    }
+    if ((flags & RS_MESH_COMPACT_COLOR_U8) && !strcmp(name, "color")) {
+        return RS_TYPE_UNSIGNED_8;
+    }
+    return RS_TYPE_NONE;
+}
+
+static void compactField(uint8_t *dst, const float *src, RsDataType dt, uint32_t vectorSize) {
+    for (uint32_t v = 0; v < vectorSize; v++) {
+        switch (dt) {
+        case RS_TYPE_FLOAT_16:
+            ((uint16_t *)dst)[v] = rsFloatToHalf(src[v]);
+            break;
+        case RS_TYPE_SIGNED_16:
+            ((int16_t *)dst)[v] = (int16_t)floorf(rsMin(rsMax(src[v], -1.f), 1.f) * 32767.f + 0.5f);
+            break;
+        default:
+            dst[v] = (uint8_t)(rsMin(rsMax(src[v], 0.f), 1.f) * 255.f + 0.5f);
+            break;
+        }
+    }
+}
+
+Allocation * Mesh::compactVertexBuffer(Context *rsc, const Allocation *alloc, uint32_t flags) {
+    const Type *type = alloc->getType();
+    const Element *elem = type->getElement();
+    const uint32_t fieldCount = elem->getFieldCount();
+    // Buffers other contexts or surfaces see keep their layout.
+    const uint32_t fixedUsage = RS_ALLOCATION_USAGE_IO_INPUT | RS_ALLOCATION_USAGE_IO_OUTPUT |
+                                RS_ALLOCATION_USAGE_SHARED;
+    if (!fieldCount || type->getDimY() || (alloc->mHal.state.usageFlags & fixedUsage)) {
+        return NULL;
+    }
+
+    ObjectBaseRef<const Element> *fields = new ObjectBaseRef<const Element>[fieldCount];
+    const Element **ein = new const Element *[fieldCount];
+    const char **nin = new const char *[fieldCount];
+    uint32_t *asin = new uint32_t[fieldCount];
+    RsDataType *types = new RsDataType[fieldCount];
+    bool changed = false;
+    for (uint32_t f = 0; f < fieldCount; f++) {
+        const Element *field = elem->getField(f);
+        nin[f] = elem->getFieldName(f);
+        asin[f] = elem->getFieldArraySize(f);
+        types[f] = compactFieldType(nin[f], field, asin[f], flags);
+        if (types[f] != RS_TYPE_NONE) {
+            fields[f] = Element::createRef(rsc, types[f], RS_KIND_USER,
+                                           types[f] != RS_TYPE_FLOAT_16,
+                                           field->getComponent().getVectorSize());
+            changed = true;
+        } else {
+            fields[f].set(field);
+        }
+        ein[f] = fields[f].get();
+    }
+
+    Allocation *out = NULL;
+    if (changed) {
+        ObjectBaseRef<const Element> outElem = Element::createRef(rsc, fieldCount, ein, nin,
+                                                                  NULL, asin);
+        ObjectBaseRef<Type> outType = Type::getTypeRef(rsc, outElem.get(), type->getDimX(),
+                                                       0, 0, false, false, 0);
+        out = Allocation::createAllocation(rsc, outType.get(), alloc->mHal.state.usageFlags);
+    }
+
+    if (out) {
+        const uint8_t *src = (const uint8_t *)rsc->mHal.funcs.allocation.lock1D(rsc, alloc);
+        uint8_t *dst = (uint8_t *)rsc->mHal.funcs.allocation.lock1D(rsc, out);
+        const Element *outElem = out->getType()->getElement();
+        const size_t srcStride = elem->getSizeBytes();
+        const size_t dstStride = outElem->getSizeBytes();
+        for (uint32_t i = 0; i < type->getDimX(); i++) {
+            for (uint32_t f = 0; f < fieldCount; f++) {
+                const uint8_t *s = src + i * srcStride + elem->getFieldOffsetBytes(f);
+                uint8_t *d = dst + i * dstStride + outElem->getFieldOffsetBytes(f);
+                if (types[f] != RS_TYPE_NONE) {
+                    compactField(d, (const float *)s, types[f],
+                                 ein[f]->getComponent().getVectorSize());
+                } else {
+                    memcpy(d, s, ein[f]->getSizeBytes() * asin[f]);
+                }
+            }
+        }
+        rsc->mHal.funcs.allocation.unlock1D(rsc, out);
+        rsc->mHal.funcs.allocation.unlock1D(rsc, alloc);
+    }
+
+    delete[] fields;
+    delete[] ein;
+    delete[] nin;
+    delete[] asin;
+    delete[] types;
+    return out;
+}
+
+void Mesh::compact(Context *rsc, uint32_t flags) {
+    bool changed = false;
+    for (uint32_t ct = 0; ct < mHal.state.vertexBuffersCount; ct++) {
+        const Allocation *vb = mHal.state.vertexBuffers[ct];
+        Allocation *compacted = vb ? compactVertexBuffer(rsc, vb, flags) : NULL;
+        if (compacted) {
+            setVertexBuffer(compacted, ct);
+            changed = true;
+        }
+    }
+    if (changed) {
+        init();
+        uploadAll(rsc);
+    }
+}
+
+void Mesh::scanBBox(const uint8_t *ptr, size_t stride, uint32_t vectorSize,
+                    bool half, bool wideLoads, uint32_t count) {
+    float lo[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+    float hi[4] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    uint32_t i = 0;
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    if (wideLoads) {
+        float32x4_t vlo = vld1q_f32(lo);
+        float32x4_t vhi = vld1q_f32(hi);
+        for (; i < count; i++) {
+            float32x4_t v = vld1q_f32((const float *)(ptr + i * stride));
+            vlo = vminq_f32(vlo, v);
+            vhi = vmaxq_f32(vhi, v);
+        }
+        vst1q_f32(lo, vlo);
+        vst1q_f32(hi, vhi);
+    }
+#elif defined(__SSE2__)
+    if (wideLoads) {
+        __m128 vlo = _mm_loadu_ps(lo);
+        __m128 vhi = _mm_loadu_ps(hi);
+        for (; i < count; i++) {
+            __m128 v = _mm_loadu_ps((const float *)(ptr + i * stride));
+            vlo = _mm_min_ps(vlo, v);
+            vhi = _mm_max_ps(vhi, v);
+        }
+        _mm_storeu_ps(lo, vlo);
+        _mm_storeu_ps(hi, vhi);
+    }
+#endif
+
+    for (; i < count; i++) {
+        float pos[4];
+        if (half) {
+            const uint16_t *h = (const uint16_t *)(ptr + i * stride);
+            for (uint32_t v = 0; v < vectorSize; v++) {
+                pos[v] = rsHalfToFloat(h[v]);
+            }
+        } else {
+            memcpy(pos, ptr + i * stride, vectorSize * sizeof(float));
+        }
+        for (uint32_t v = 0; v < vectorSize; v++) {
+            lo[v] = rsMin(lo[v], pos[v]);
+            hi[v] = rsMax(hi[v], pos[v]);
+        }
+    }
+
+    for (uint32_t v = 0; v < 3; v++) {
+        bool valid = count && (v < vectorSize);
+        mBBoxMin[v] = valid ? lo[v] : 0.0f;
+        mBBoxMax[v] = valid ? hi[v] : 0.0f;
+    }
+}
+
 void Mesh::computeBBox(Context *rsc) {
-    float *posPtr = NULL;
-    uint32_t vectorSize = 0;
-    uint32_t stride = 0;
-    uint32_t numVerts = 0;
     Allocation *posAlloc = NULL;
+    uint32_t vectorSize = 0;
+    uint32_t offset = 0;
+    bool half = false;
     // First we need to find the position ptr and stride
     for (uint32_t ct=0; ct < mHal.state.vertexBuffersCount; ct++) {
-        const Type *bufferType = mHal.state.vertexBuffers[ct]->getType();
-        const Element *bufferElem = bufferType->getElement();
-
-        for (uint32_t ct=0; ct < bufferElem->getFieldCount(); ct++) {
-            if (strcmp(bufferElem->getFieldName(ct), "position") == 0) {
-                vectorSize = bufferElem->getField(ct)->getComponent().getVectorSize();
-                stride = bufferElem->getSizeBytes() / sizeof(float);
-                uint32_t offset = bufferElem->getFieldOffsetBytes(ct);
+        const Element *bufferElem = mHal.state.vertexBuffers[ct]->getType()->getElement();
+
+        for (uint32_t f=0; f < bufferElem->getFieldCount(); f++) {
+            const RsDataType dt = bufferElem->getField(f)->getComponent().getType();
+            if (strcmp(bufferElem->getFieldName(f), "position") == 0 &&
+                (dt == RS_TYPE_FLOAT_32 || dt == RS_TYPE_FLOAT_16)) {
+                half = dt == RS_TYPE_FLOAT_16;
+                vectorSize = rsMin(bufferElem->getField(f)->getComponent().getVectorSize(), 3u);
+                offset = bufferElem->getFieldOffsetBytes(f);
                 posAlloc = mHal.state.vertexBuffers[ct];
-                const uint8_t *bp = (const uint8_t *)rsc->mHal.funcs.allocation.lock1D(
-                        rsc, posAlloc);
-                posPtr = (float*)(bp + offset);
-                numVerts = bufferType->getDimX();
                 break;
             }
         }
-        if (posPtr) {
+        if (posAlloc) {
             break;
         }
     }
 
-    mBBoxMin[0] = mBBoxMin[1] = mBBoxMin[2] = 1e6;
-    mBBoxMax[0] = mBBoxMax[1] = mBBoxMax[2] = -1e6;
-    if (!posPtr) {
+    if (!posAlloc) {
         ALOGE("Unable to compute bounding box");
-        mBBoxMin[0] = mBBoxMin[1] = mBBoxMin[2] = 0.0f;
-        mBBoxMax[0] = mBBoxMax[1] = mBBoxMax[2] = 0.0f;
+        memset(mBBoxMin, 0, sizeof(mBBoxMin));
+        memset(mBBoxMax, 0, sizeof(mBBoxMax));
+        mBBoxSource = NULL;
         return;
     }
 
-    for (uint32_t i = 0; i < numVerts; i ++) {
-        for (uint32_t v = 0; v < vectorSize; v ++) {
-            mBBoxMin[v] = rsMin(mBBoxMin[v], posPtr[v]);
-            mBBoxMax[v] = rsMax(mBBoxMax[v], posPtr[v]);
+    const uint32_t numVerts = posAlloc->getType()->getDimX();
+    const uint32_t version = posAlloc->mHal.drvState.contentVersion;
+    if ((posAlloc == mBBoxSource) && (version == mBBoxVersion) && (numVerts == mBBoxCount)) {
+        return;
+    }
+
+    const size_t stride = posAlloc->getType()->getElementSizeBytes();
+    // Whole float4 loads are fine as long as they stay inside the element.
+    const bool wideLoads = !half && (vectorSize == 3) && (offset + 4 * sizeof(float) <= stride);
+    const uint8_t *bp = (const uint8_t *)rsc->mHal.funcs.allocation.lock1D(rsc, posAlloc);
+    scanBBox(bp + offset, stride, vectorSize, half, wideLoads, numVerts);
+    rsc->mHal.funcs.allocation.unlock1D(rsc, posAlloc);
+
+    mBBoxSource = posAlloc;
+    mBBoxVersion = version;
+    mBBoxCount = numVerts;
+}
+
+// Returns a bit for each lane whose box lies wholly behind one of the
+// planes.  Boxes are given as centers and half extents, four lanes per row.
+static uint32_t boxesOutside(const float planes[6][4], const float box[6][4]) {
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    uint32x4_t out = vdupq_n_u32(0);
+    for (uint32_t p = 0; p < 6; p++) {
+        float32x4_t d = vdupq_n_f32(planes[p][3]);
+        float32x4_t r = vdupq_n_f32(0.f);
+        for (uint32_t c = 0; c < 3; c++) {
+            d = vmlaq_n_f32(d, vld1q_f32(box[c]), planes[p][c]);
+            r = vmlaq_n_f32(r, vld1q_f32(box[c + 3]), fabsf(planes[p][c]));
+        }
+        out = vorrq_u32(out, vcltq_f32(vaddq_f32(d, r), vdupq_n_f32(0.f)));
+    }
+    uint32_t lanes[4];
+    vst1q_u32(lanes, out);
+    return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+#elif defined(__SSE2__)
+    __m128 out = _mm_setzero_ps();
+    for (uint32_t p = 0; p < 6; p++) {
+        __m128 d = _mm_set1_ps(planes[p][3]);
+        __m128 r = _mm_setzero_ps();
+        for (uint32_t c = 0; c < 3; c++) {
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(box[c]), _mm_set1_ps(planes[p][c])));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(box[c + 3]),
+                                         _mm_set1_ps(fabsf(planes[p][c]))));
         }
-        posPtr += stride;
+        out = _mm_or_ps(out, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
     }
+    return _mm_movemask_ps(out);
+#else
+    uint32_t out = 0;
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        for (uint32_t p = 0; p < 6; p++) {
+            float d = planes[p][3];
+            float r = 0.f;
+            for (uint32_t c = 0; c < 3; c++) {
+                d += box[c][lane] * planes[p][c];
+                r += box[c + 3][lane] * fabsf(planes[p][c]);
+            }
+            if (d + r < 0.f) {
+                out |= 1 << lane;
+                break;
+            }
+        }
+    }
+    return out;
+#endif
+}
 
-    if (posAlloc) {
-        rsc->mHal.funcs.allocation.unlock1D(rsc, posAlloc);
+uint32_t Mesh::cull(Context *rsc, const rs_matrix4x4 *m, Mesh * const *meshes,
+                    uint8_t *visible, uint32_t count) {
+    // A point is inside when -w <= x, y, z <= w in clip space, so the planes
+    // are the last row of the matrix plus or minus each of the others.
+    float planes[6][4];
+    for (uint32_t p = 0; p < 6; p++) {
+        const uint32_t row = p >> 1;
+        const float sign = (p & 1) ? -1.f : 1.f;
+        for (uint32_t c = 0; c < 4; c++) {
+            planes[p][c] = m->m[c * 4 + 3] + sign * m->m[c * 4 + row];
+        }
     }
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < count; i += 4) {
+        const uint32_t lanes = rsMin(count - i, 4u);
+        float box[6][4];
+        memset(box, 0, sizeof(box));
+        for (uint32_t lane = 0; lane < lanes; lane++) {
+            Mesh *mesh = meshes[i + lane];
+            if (!mesh) {
+                continue;
+            }
+            mesh->computeBBox(rsc);
+            for (uint32_t c = 0; c < 3; c++) {
+                box[c][lane] = (mesh->mBBoxMax[c] + mesh->mBBoxMin[c]) * 0.5f;
+                box[c + 3][lane] = (mesh->mBBoxMax[c] - mesh->mBBoxMin[c]) * 0.5f;
+            }
+        }
+
+        const uint32_t outside = boxesOutside(planes, box);
+        for (uint32_t lane = 0; lane < lanes; lane++) {
+            bool in = meshes[i + lane] && !(outside & (1 << lane));
+            visible[i + lane] = in;
+            visibleCount += in;
+        }
+    }
+    return visibleCount;
 }
 
 namespace android {
@@ -287,6 +601,11 @@ RsMesh rsi_MeshCreate(Context *rsc,
     return sm;
 }
 
+void rsi_MeshCompact(Context *rsc, RsMesh mesh, uint32_t flags) {
+    Mesh *sm = static_cast<Mesh *>(mesh);
+    sm->compact(rsc, flags);
+}
+
 }}
 
 void rsaMeshGetVertexBufferCount(RsContext con, RsMesh mv, int32_t *numVtx) {
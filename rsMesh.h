@@ -67,6 +67,7 @@ public:
     void setVertexBuffer(Allocation *vb, uint32_t index) {
         mVertexBuffers[index].set(vb);
         mHal.state.vertexBuffers[index] = vb;
+        mBBoxSource = NULL;
     }
 
     void setPrimitive(Allocation *idx, RsPrimitive prim, uint32_t index) {
@@ -78,13 +79,34 @@ public:
     void render(Context *) const;
     void renderPrimitive(Context *, uint32_t primIndex) const;
     void renderPrimitiveRange(Context *, uint32_t primIndex, uint32_t start, uint32_t len) const;
+    // Draws a primitive group once per 4x4 float matrix in transforms.
+    void renderPrimitiveInstanced(Context *, uint32_t primIndex, const Allocation *transforms) const;
     void uploadAll(Context *);
+    // Replaces the vertex buffers holding float attributes the
+    // RsMeshCompactFlags pick with copies using the smaller types.
+    void compact(Context *rsc, uint32_t flags);
 
     // Bounding volumes
     float mBBoxMin[3];
     float mBBoxMax[3];
+    // Brings mBBoxMin and mBBoxMax up to date, only rescanning the
+    // positions after they have been written.
     void computeBBox(Context *rsc);
+
+    // Sets visible[i] to whether meshes[i] may be seen through the
+    // clip-space matrix m, and returns how many may.
+    static uint32_t cull(Context *rsc, const rs_matrix4x4 *m, Mesh * const *meshes,
+                         uint8_t *visible, uint32_t count);
 protected:
+    // The allocation and its contents the bounds were last computed from.
+    const Allocation *mBBoxSource;
+    uint32_t mBBoxVersion;
+    uint32_t mBBoxCount;
+
+    void scanBBox(const uint8_t *ptr, size_t stride, uint32_t vectorSize,
+                  bool half, bool wideLoads, uint32_t count);
+    Allocation * compactVertexBuffer(Context *rsc, const Allocation *alloc, uint32_t flags);
+
     ObjectBaseRef<Allocation> *mVertexBuffers;
     ObjectBaseRef<Allocation> *mIndexBuffers;
     bool mInitialized;
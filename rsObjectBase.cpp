@@ -20,8 +20,6 @@
 using namespace android;
 using namespace android::renderscript;
 
-pthread_mutex_t ObjectBase::gObjectInitMutex = PTHREAD_MUTEX_INITIALIZER;
-
 ObjectBase::ObjectBase(Context *rsc) {
     mUserRefCount = 0;
     mSysRefCount = 0;
@@ -55,9 +53,9 @@ ObjectBase::~ObjectBase() {
         // delete.  Its possible for objects without a re-use list
         // for avoiding duplication to be created on the stack.  In those
         // cases we need to remove ourself here.
-        asyncLock();
+        asyncLock(mRSC);
         remove();
-        asyncUnlock();
+        asyncUnlock(mRSC);
     }
 
     rsAssert(!mUserRefCount);
@@ -96,12 +94,13 @@ bool ObjectBase::checkDelete(const ObjectBase *ref) {
         return false;
     }
 
-    asyncLock();
+    Context *rsc = ref->mRSC;
+    asyncLock(rsc);
     // This lock protects us against the non-RS threads changing
     // the ref counts.  At this point we should be the only thread
     // working on them.
     if (ref->mUserRefCount || ref->mSysRefCount) {
-        asyncUnlock();
+        asyncUnlock(rsc);
         return false;
     }
 
@@ -109,7 +108,7 @@ bool ObjectBase::checkDelete(const ObjectBase *ref) {
     // At this point we can unlock because there should be no possible way
     // for another thread to reference this object.
     ref->preDestroy();
-    asyncUnlock();
+    asyncUnlock(rsc);
     delete ref;
     return true;
 }
@@ -165,16 +164,20 @@ void ObjectBase::setName(const char *name, uint32_t len) {
     mName = c;
 }
 
-void ObjectBase::asyncLock() {
-    pthread_mutex_lock(&gObjectInitMutex);
+void ObjectBase::asyncLock(const Context *rsc) {
+    pthread_mutex_lock(&rsc->mObjectMutex);
+}
+
+void ObjectBase::asyncUnlock(const Context *rsc) {
+    pthread_mutex_unlock(&rsc->mObjectMutex);
 }
 
-void ObjectBase::asyncUnlock() {
-    pthread_mutex_unlock(&gObjectInitMutex);
+void * ObjectBase::slabAlloc(Context *rsc, size_t size) {
+    return rsc->mObjectSlab.alloc(size);
 }
 
 void ObjectBase::add() const {
-    asyncLock();
+    asyncLock(mRSC);
 
     rsAssert(!mNext);
     rsAssert(!mPrev);
@@ -185,7 +188,7 @@ void ObjectBase::add() const {
     }
     mRSC->mObjHead = this;
 
-    asyncUnlock();
+    asyncUnlock(mRSC);
 }
 
 void ObjectBase::remove() const {
@@ -257,7 +260,7 @@ void ObjectBase::freeAllChildren(Context *rsc) {
 }
 
 void ObjectBase::dumpAll(Context *rsc) {
-    asyncLock();
+    asyncLock(rsc);
 
     ALOGV("Dumping all objects");
     const ObjectBase * o = rsc->mObjHead;
@@ -267,20 +270,20 @@ void ObjectBase::dumpAll(Context *rsc) {
         o = o->mNext;
     }
 
-    asyncUnlock();
+    asyncUnlock(rsc);
 }
 
 bool ObjectBase::isValid(const Context *rsc, const ObjectBase *obj) {
-    asyncLock();
+    asyncLock(rsc);
 
     const ObjectBase * o = rsc->mObjHead;
     while (o) {
         if (o == obj) {
-            asyncUnlock();
+            asyncUnlock(rsc);
             return true;
         }
         o = o->mNext;
     }
-    asyncUnlock();
+    asyncUnlock(rsc);
     return false;
 }
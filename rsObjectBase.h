@@ -20,6 +20,7 @@
 #include "rsUtils.h"
 #include "rsDefines.h"
 #include "rsDebugHelper.h"
+#include "rsObjectSlab.h"
 
 namespace android {
 namespace renderscript {
@@ -41,6 +42,12 @@ public:
 
     static bool checkDelete(const ObjectBase *);
 
+    // Whether anything besides the caller's one system reference holds
+    // the object; only meaningful inside the async lock.
+    bool hasOtherRefs() const {
+        return mUserRefCount || (mSysRefCount > 1);
+    }
+
     const char * getName() const {
         return mName;
     }
@@ -62,9 +69,15 @@ public:
     static bool isValid(const Context *rsc, const ObjectBase *obj);
 
     // The async lock is taken during object creation in non-rs threads
-    // and object deletion in the rs thread.
-    static void asyncLock();
-    static void asyncUnlock();
+    // and object deletion in the rs thread.  Each context has its own, so
+    // contexts on different threads don't contend.
+    static void asyncLock(const Context *rsc);
+    static void asyncUnlock(const Context *rsc);
+
+    // Memory for small object classes from their context's slabs, for
+    // use in class specific operator new; operator delete goes straight
+    // to ObjectSlab::release.
+    static void * slabAlloc(Context *rsc, size_t size);
 
 protected:
     // Called inside the async lock for any object list management that is
@@ -75,8 +88,6 @@ protected:
     virtual ~ObjectBase();
 
 private:
-    static pthread_mutex_t gObjectInitMutex;
-
     void add() const;
     void remove() const;
 
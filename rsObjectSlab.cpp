@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsObjectSlab.h"
+#include "rsUtils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace android;
+using namespace android::renderscript;
+
+ObjectSlab::ObjectSlab() {
+    pthread_mutex_init(&mMutex, NULL);
+    memset(mFree, 0, sizeof(mFree));
+    mPages = NULL;
+    mBump = NULL;
+    mBumpEnd = NULL;
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+ObjectSlab::~ObjectSlab() {
+    // Objects still alive would be left pointing at freed pages.
+    if (mStats.live) {
+        ALOGE("ObjectSlab %p destroyed with %u live objects", this, mStats.live);
+        return;
+    }
+    while (mPages) {
+        Page *next = mPages->next;
+        free(mPages);
+        mPages = next;
+    }
+    pthread_mutex_destroy(&mMutex);
+}
+
+void * ObjectSlab::alloc(size_t size) {
+    const uint32_t sizeClass = (size + sizeof(Header) + CLASS_BYTES - 1) / CLASS_BYTES - 1;
+    Header *h = NULL;
+
+    if (sizeClass >= CLASS_COUNT) {
+        h = (Header *)malloc(sizeof(Header) + size);
+        if (!h) {
+            return NULL;
+        }
+        h->slab = NULL;
+        h->sizeClass = sizeClass;
+        pthread_mutex_lock(&mMutex);
+        mStats.large++;
+        pthread_mutex_unlock(&mMutex);
+        return h + 1;
+    }
+
+    const size_t blockBytes = (sizeClass + 1) * CLASS_BYTES;
+    pthread_mutex_lock(&mMutex);
+    if (mFree[sizeClass]) {
+        h = (Header *)mFree[sizeClass];
+        mFree[sizeClass] = mFree[sizeClass]->next;
+        mStats.recycled++;
+    } else {
+        if ((size_t)(mBumpEnd - mBump) < blockBytes) {
+            // The tail of the old page is too small for this class and
+            // is left unused.
+            Page *p = (Page *)malloc(PAGE_BYTES);
+            if (!p) {
+                pthread_mutex_unlock(&mMutex);
+                return NULL;
+            }
+            p->next = mPages;
+            mPages = p;
+            mBump = (uint8_t *)p + sizeof(Header);
+            mBumpEnd = (uint8_t *)p + PAGE_BYTES;
+            mStats.pages++;
+        }
+        h = (Header *)mBump;
+        mBump += blockBytes;
+    }
+    mStats.live++;
+    pthread_mutex_unlock(&mMutex);
+
+    h->slab = this;
+    h->sizeClass = sizeClass;
+    return h + 1;
+}
+
+void ObjectSlab::release(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    Header *h = ((Header *)ptr) - 1;
+    ObjectSlab *s = h->slab;
+    if (!s) {
+        free(h);
+        return;
+    }
+
+    const uint32_t sizeClass = h->sizeClass;
+    FreeBlock *b = (FreeBlock *)h;
+    pthread_mutex_lock(&s->mMutex);
+    b->next = s->mFree[sizeClass];
+    s->mFree[sizeClass] = b;
+    s->mStats.live--;
+    pthread_mutex_unlock(&s->mMutex);
+}
+
+void ObjectSlab::getStats(Stats *stats) const {
+    pthread_mutex_lock(&mMutex);
+    *stats = mStats;
+    pthread_mutex_unlock(&mMutex);
+}
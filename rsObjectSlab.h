@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RS_OBJECT_SLAB_H
+#define ANDROID_RS_OBJECT_SLAB_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace renderscript {
+
+// Per-context slabs for small, frequently created objects.  Blocks are
+// carved from pages in fixed size classes and freed blocks are kept on a
+// list per class for the next object of that size.  Larger requests fall
+// back to malloc.
+class ObjectSlab {
+public:
+    ObjectSlab();
+    ~ObjectSlab();
+
+    void * alloc(size_t size);
+    // Returns a block from alloc to the slab it came from.
+    static void release(void *ptr);
+
+    struct Stats {
+        // Blocks handed out and not released yet.
+        uint32_t live;
+        // Allocations served from a free list.
+        uint32_t recycled;
+        uint32_t pages;
+        // Allocations too large for any class, served by malloc.
+        uint32_t large;
+    };
+    void getStats(Stats *stats) const;
+
+private:
+    enum {
+        CLASS_BYTES = 64,
+        CLASS_COUNT = 8,
+        PAGE_BYTES = 16384
+    };
+
+    // Precedes every block, padded so objects stay 16 byte aligned.
+    struct Header {
+        ObjectSlab *slab;
+        uint32_t sizeClass;
+        uint32_t pad;
+    } __attribute__((aligned(16)));
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct Page {
+        Page *next;
+    };
+
+    mutable pthread_mutex_t mMutex;
+    FreeBlock *mFree[CLASS_COUNT];
+    Page *mPages;
+    uint8_t *mBump;
+    uint8_t *mBumpEnd;
+    Stats mStats;
+};
+
+}
+}
+#endif //ANDROID_RS_OBJECT_SLAB_H
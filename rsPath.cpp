@@ -22,6 +22,7 @@ using namespace android::renderscript;
 
 
 Path::Path(Context *rsc) : ObjectBase(rsc) {
+    memset(&mHal, 0, sizeof(mHal));
 }
 
 Path::Path(Context *rsc, RsPathPrimitive pp, bool isStatic,
@@ -31,6 +32,10 @@ Path::Path(Context *rsc, RsPathPrimitive pp, bool isStatic,
     memset(&mHal, 0, sizeof(mHal));
     mHal.state.quality = quality;
     mHal.state.primitive = pp;
+    mVertices.set(vtx);
+    mLoops.set(loops);
+    mHal.state.vertices = vtx;
+    mHal.state.loops = loops;
 
     //LOGE("i1");
     rsc->mHal.funcs.path.initStatic(rsc, this, vtx, loops);
@@ -40,11 +45,13 @@ Path::Path(Context *rsc, RsPathPrimitive pp, bool isStatic,
 
 Path::Path(Context *rsc, uint32_t vertexBuffersCount, uint32_t primitivesCount)
 : ObjectBase(rsc) {
-
+    memset(&mHal, 0, sizeof(mHal));
 }
 
 Path::~Path() {
-
+    if (mHal.drv) {
+        mRSC->mHal.funcs.path.destroy(mRSC, this);
+    }
 }
 
 
@@ -57,6 +64,7 @@ void Path::rasterize(const BezierSegment_t *s, uint32_t num, Allocation *alloc)
 }
 
 void Path::render(Context *rsc) {
+    rsc->mHal.funcs.path.draw(rsc, this);
 }
 
 void Path::serialize(Context *rsc, OStream *stream) const {
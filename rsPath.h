@@ -19,6 +19,7 @@
 
 
 #include "rsObjectBase.h"
+#include "rsAllocation.h"
 
 // ---------------------------------------------------------------------------
 namespace android {
@@ -32,6 +33,10 @@ public:
         struct State {
             RsPathPrimitive primitive;
             float quality;
+            // Control points as float2, 3 per quadratic and 4 per cubic
+            // segment
+            const Allocation *vertices;
+            const Allocation *loops;
         };
         State state;
     } mHal;
@@ -47,7 +52,8 @@ public:
     virtual RsA3DClassID getClassId() const;
 
 private:
-
+    ObjectBaseRef<Allocation> mVertices;
+    ObjectBaseRef<Allocation> mLoops;
 
     typedef struct {
         float x[4];
@@ -173,7 +173,7 @@ void Program::bindAllocation(Context *rsc, Allocation *alloc, uint32_t slot) {
     if (alloc) {
         alloc->addProgramToDirty(this);
     }
-    mDirty = true;
+    forceDirty();
 }
 
 void Program::bindTexture(Context *rsc, uint32_t slot, Allocation *a) {
@@ -28,12 +28,16 @@ class ProgramBase : public ObjectBase {
 public:
     ProgramBase(Context *rsc) : ObjectBase(rsc) {
         mDirty = true;
+        mVersion = 0;
     }
 
-    void forceDirty() const {mDirty = true;}
+    // For changes to the data a program reads, which also bump its version.
+    void forceDirty() const {mDirty = true; mVersion++;}
+    uint32_t getVersion() const {return mVersion;}
 
 protected:
     mutable bool mDirty;
+    mutable uint32_t mVersion;
 };
 
 }
@@ -55,7 +55,7 @@ void ProgramFragment::setConstantColor(Context *rsc, float r, float g, float b,
     mConstantColor[3] = a;
     void *p = rsc->mHal.funcs.allocation.lock1D(rsc, mHal.state.constants[0]);
     memcpy(p, mConstantColor, 4*sizeof(float));
-    mDirty = true;
+    forceDirty();
     rsc->mHal.funcs.allocation.unlock1D(rsc, mHal.state.constants[0]);
 }
 
@@ -79,23 +79,23 @@ ObjectBaseRef<ProgramRaster> ProgramRaster::getProgramRaster(Context *rsc,
                                                              bool pointSprite,
                                                              RsCullMode cull) {
     ObjectBaseRef<ProgramRaster> returnRef;
-    ObjectBase::asyncLock();
+    ObjectBase::asyncLock(rsc);
     for (uint32_t ct = 0; ct < rsc->mStateRaster.mRasterPrograms.size(); ct++) {
         ProgramRaster *existing = rsc->mStateRaster.mRasterPrograms[ct];
         if (existing->mHal.state.pointSprite != pointSprite) continue;
         if (existing->mHal.state.cull != cull) continue;
         returnRef.set(existing);
-        ObjectBase::asyncUnlock();
+        ObjectBase::asyncUnlock(rsc);
         return returnRef;
     }
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncUnlock(rsc);
 
     ProgramRaster *pr = new ProgramRaster(rsc, pointSprite, cull);
     returnRef.set(pr);
 
-    ObjectBase::asyncLock();
+    ObjectBase::asyncLock(rsc);
     rsc->mStateRaster.mRasterPrograms.push(pr);
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncUnlock(rsc);
 
     return returnRef;
 }
@@ -78,7 +78,7 @@ void ProgramVertex::setProjectionMatrix(Context *rsc, const rsc_Matrix *m) const
     float *f = static_cast<float *>(rsc->mHal.funcs.allocation.lock1D(
                 rsc, mHal.state.constants[0]));
     memcpy(&f[RS_PROGRAM_VERTEX_PROJECTION_OFFSET], m, sizeof(rsc_Matrix));
-    mDirty = true;
+    forceDirty();
     rsc->mHal.funcs.allocation.unlock1D(rsc, mHal.state.constants[0]);
 }
 
@@ -96,7 +96,7 @@ void ProgramVertex::setModelviewMatrix(Context *rsc, const rsc_Matrix *m) const
     float *f = static_cast<float *>(rsc->mHal.funcs.allocation.lock1D(
                 rsc, mHal.state.constants[0]));
     memcpy(&f[RS_PROGRAM_VERTEX_MODELVIEW_OFFSET], m, sizeof(rsc_Matrix));
-    mDirty = true;
+    forceDirty();
     rsc->mHal.funcs.allocation.unlock1D(rsc, mHal.state.constants[0]);
 }
 
@@ -114,7 +114,7 @@ void ProgramVertex::setTextureMatrix(Context *rsc, const rsc_Matrix *m) const {
     float *f = static_cast<float *>(rsc->mHal.funcs.allocation.lock1D(
             rsc, mHal.state.constants[0]));
     memcpy(&f[RS_PROGRAM_VERTEX_TEXTURE_OFFSET], m, sizeof(rsc_Matrix));
-    mDirty = true;
+    forceDirty();
     rsc->mHal.funcs.allocation.unlock1D(rsc, mHal.state.constants[0]);
 }
 
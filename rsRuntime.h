@@ -67,9 +67,12 @@ void rsrDrawMesh(Context *, Mesh *);
 void rsrDrawMeshPrimitive(Context *, Mesh *, uint32_t primIndex);
 void rsrDrawMeshPrimitiveRange(Context *, Mesh *,
                                uint32_t primIndex, uint32_t start, uint32_t len);
+void rsrDrawMeshInstanced(Context *, Mesh *, uint32_t primIndex, Allocation *transforms);
 void rsrMeshComputeBoundingBox(Context *, Mesh *,
                                float *minX, float *minY, float *minZ,
                                float *maxX, float *maxY, float *maxZ);
+uint32_t rsrMeshCull(Context *, const rsc_Matrix *m, Mesh * const *meshes,
+                     uint8_t *visible, uint32_t count);
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -113,6 +116,8 @@ void rsrFontColor(Context *, float r, float g, float b, float a);
 
 void rsrAllocationIoSend(Context *, Allocation *);
 void rsrAllocationIoReceive(Context *, Allocation *);
+void rsrAllocationSort(Context *, Allocation *keys, Allocation *values);
+uint32_t rsrAllocationCompact(Context *, Allocation *dst, Allocation *src, Allocation *flags);
 
 //////////////////////////////////////////////////////////////////////////////
 // Time routines
@@ -28,9 +28,11 @@ Script::Script(Context *rsc) : ObjectBase(rsc) {
     mTypes = NULL;
     mInitialized = false;
     mHasObjectSlots = false;
+    pthread_mutex_init(&mCallMutex, NULL);
 }
 
 Script::~Script() {
+    pthread_mutex_destroy(&mCallMutex);
     if (mSlots) {
         delete [] mSlots;
         mSlots = NULL;
@@ -41,6 +43,18 @@ Script::~Script() {
     }
 }
 
+void Script::callLock(Context *rsc) {
+    if (rsc->isSynchronous()) {
+        pthread_mutex_lock(&mCallMutex);
+    }
+}
+
+void Script::callUnlock(Context *rsc) {
+    if (rsc->isSynchronous()) {
+        pthread_mutex_unlock(&mCallMutex);
+    }
+}
+
 void Script::setSlot(uint32_t slot, Allocation *a) {
     //ALOGE("setSlot %i %p", slot, a);
     if (slot >= mHal.info.exportedVariableCount) {
@@ -95,6 +109,80 @@ void Script::setVarObj(uint32_t slot, ObjectBase *val) {
     mRSC->mHal.funcs.script.setGlobalObj(mRSC, this, slot, val);
 }
 
+void Script::setVars(Context *rsc, const void *records, size_t sizeBytes) {
+    const uint8_t *p = (const uint8_t *)records;
+    const uint8_t *end = p + sizeBytes;
+    uint32_t count = 0;
+    bool hasObjects = false;
+
+    while (p < end) {
+        RsScriptVarRecord r;
+        if ((size_t)(end - p) < sizeof(r)) {
+            ALOGE("Error Script::setVars truncated record %u.", count);
+            rsc->setError(RS_ERROR_BAD_VALUE, "setVars truncated record.");
+            return;
+        }
+        memcpy(&r, p, sizeof(r));
+
+        if (r.slot >= mHal.info.exportedVariableCount) {
+            ALOGE("Error Script::setVars record %u invalid slot index: %u >= %zu",
+                  count, r.slot, mHal.info.exportedVariableCount);
+            rsc->setError(RS_ERROR_BAD_VALUE, "setVars invalid slot index.");
+            return;
+        }
+        const size_t recordSize = sizeof(r) + rsRound(r.sizeBytes, 4);
+        if ((r.isObject && (r.sizeBytes != sizeof(RsObjectBase))) ||
+            ((size_t)(end - p) < recordSize)) {
+            ALOGE("Error Script::setVars record %u bad size %u.", count, r.sizeBytes);
+            rsc->setError(RS_ERROR_BAD_VALUE, "setVars bad size.");
+            return;
+        }
+
+        hasObjects |= (r.isObject != 0);
+        p += recordSize;
+        count++;
+    }
+
+    if (count) {
+        if (hasObjects) {
+            mHasObjectSlots = true;
+        }
+        mRSC->mHal.funcs.script.setGlobalVars(mRSC, this, records, sizeBytes, count);
+    }
+}
+
+void Script::runForEachMulti(Context *rsc, uint32_t slot, const Allocation **ains,
+                             size_t inLen, Allocation *aout, const void *usr,
+                             size_t usrBytes, const RsScriptCall *sc) {
+    if (inLen == 1) {
+        runForEach(rsc, slot, ains[0], aout, usr, usrBytes, sc);
+        return;
+    }
+    rsc->setError(RS_ERROR_BAD_SCRIPT, "Script does not support multiple kernel inputs");
+}
+
+void Script::InvokeBatch(Context *rsc, uint32_t slot, const void *data, size_t len,
+                         uint32_t count) {
+    for (uint32_t ct = 0; ct < count; ct++) {
+        Invoke(rsc, slot, (const uint8_t *)data + ct * len, len);
+    }
+}
+
+void Script::runReduce(Context *rsc, uint32_t accumSlot, uint32_t combineSlot,
+                       int32_t finalizeSlot, const Allocation *ain, Allocation *aout,
+                       const RsScriptCall *sc) {
+    rsc->setError(RS_ERROR_BAD_SCRIPT, "Script does not support reductions");
+}
+
+void Script::markWrites(Context *rsc, const Allocation *aout) const {
+    if (mHasObjectSlots) {
+        __sync_fetch_and_add(&rsc->mScriptWriteEpoch, 1);
+    }
+    if (aout) {
+        aout->sendDirty(rsc);
+    }
+}
+
 bool Script::freeChildren() {
     incSysRef();
     mRSC->mHal.funcs.script.invokeFreeChildren(mRSC, this);
@@ -143,14 +231,34 @@ RsA3DClassID ScriptFieldID::getClassId() const {
 namespace android {
 namespace renderscript {
 
+// Scripts see the cells of an allocation as whole structs in rows, which
+// field planes and tiles don't have.  Kernels take adapters of the planes,
+// and script code reaches tiles through rsGetElementAt, so only globals of
+// script code, boundTo, may hold tiles.
+static bool scriptVisible(Context *rsc, const ObjectBase *o, const Script *boundTo = NULL) {
+    if (!o || (o->getClassId() != RS_A3D_CLASS_ID_ALLOCATION)) {
+        return true;
+    }
+    const Allocation *a = static_cast<const Allocation *>(o);
+    if (a->hasFieldPlanes()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Field planes can only be used through adapters.");
+        return false;
+    }
+    if (a->hasTiles() && (!boundTo || (boundTo->getClassId() != RS_A3D_CLASS_ID_SCRIPT_C))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Tiled allocations can only be bound to script globals.");
+        return false;
+    }
+    return true;
+}
+
 RsScriptKernelID rsi_ScriptKernelIDCreate(Context *rsc, RsScript vs, int slot, int sig) {
-    ScriptKernelID *kid = new ScriptKernelID(rsc, (Script *)vs, slot, sig);
+    ScriptKernelID *kid = new (rsc) ScriptKernelID(rsc, (Script *)vs, slot, sig);
     kid->incUserRef();
     return kid;
 }
 
 RsScriptFieldID rsi_ScriptFieldIDCreate(Context *rsc, RsScript vs, int slot) {
-    ScriptFieldID *fid = new ScriptFieldID(rsc, (Script *)vs, slot);
+    ScriptFieldID *fid = new (rsc) ScriptFieldID(rsc, (Script *)vs, slot);
     fid->incUserRef();
     return fid;
 }
@@ -158,7 +266,12 @@ RsScriptFieldID rsi_ScriptFieldIDCreate(Context *rsc, RsScript vs, int slot) {
 void rsi_ScriptBindAllocation(Context * rsc, RsScript vs, RsAllocation va, uint32_t slot) {
     Script *s = static_cast<Script *>(vs);
     Allocation *a = static_cast<Allocation *>(va);
+    if (!scriptVisible(rsc, a, s)) {
+        return;
+    }
+    s->callLock(rsc);
     s->setSlot(slot, a);
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetTimeZone(Context * rsc, RsScript vs, const char * timeZone, size_t length) {
@@ -180,6 +293,38 @@ void rsi_ScriptSetTimeZone(Context * rsc, RsScript vs, const char * timeZone, si
     free(tz);
 }
 
+// Callers built against older headers pass a shorter RsScriptCall; the
+// fields they don't know of get their defaults.  Regions are never taken
+// from callers, only set by rsi_ScriptForEachRegions.
+static const RsScriptCall * copyScriptCall(RsScriptCall *call, const RsScriptCall *sc,
+                                           size_t scLen) {
+    if (scLen == 0) {
+        return NULL;
+    }
+    memset(call, 0, sizeof(*call));
+    memcpy(call, sc, rsMin(scLen, offsetof(RsScriptCall, regions)));
+    return call;
+}
+
+void rsi_ScriptInvokeBatch(Context *rsc, RsScript vs, uint32_t slot, RsAllocation vparams) {
+    Script *s = static_cast<Script *>(vs);
+    Allocation *a = static_cast<Allocation *>(vparams);
+    if (!a || !a->mHal.drvState.lod[0].mallocPtr) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Batched invoke needs parameters");
+        return;
+    }
+    // Each cell is one parameter block; 1D allocations keep them contiguous.
+    const Type *t = a->getType();
+    if (t->getDimY() || t->getDimZ() || t->getDimFaces() || t->getDimLOD()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Batched invoke parameters must be 1D");
+        return;
+    }
+    s->callLock(rsc);
+    s->InvokeBatch(rsc, slot, a->mHal.drvState.lod[0].mallocPtr, t->getElementSizeBytes(),
+                   t->getDimX());
+    s->callUnlock(rsc);
+}
+
 void rsi_ScriptForEach(Context *rsc, RsScript vs, uint32_t slot,
                        RsAllocation vain, RsAllocation vaout,
                        const void *params, size_t paramLen,
@@ -189,65 +334,169 @@ void rsi_ScriptForEach(Context *rsc, RsScript vs, uint32_t slot,
     // input for sc. Instead, it retains an existing pointer value (the prior
     // field in the packed data object). This can cause confusion because
     // drivers might now inspect bogus sc data.
-    if (scLen == 0) {
-        sc = NULL;
+    if (!scriptVisible(rsc, static_cast<Allocation *>(vain)) ||
+        !scriptVisible(rsc, static_cast<Allocation *>(vaout))) {
+        return;
     }
+    RsScriptCall call;
+    sc = copyScriptCall(&call, sc, scLen);
+    s->callLock(rsc);
     s->runForEach(rsc, slot,
                   static_cast<const Allocation *>(vain), static_cast<Allocation *>(vaout),
                   params, paramLen, sc);
+    s->callUnlock(rsc);
+}
+
+void rsi_ScriptForEachMulti(Context *rsc, RsScript vs, uint32_t slot,
+                            RsAllocation *vains, size_t inLen,
+                            RsAllocation vaout, const void *params,
+                            size_t paramLen, const RsScriptCall *sc,
+                            size_t scLen) {
+    Script *s = static_cast<Script *>(vs);
+    RsScriptCall call;
+    sc = copyScriptCall(&call, sc, scLen);
+    // The spec passes the size of the array in bytes.
+    const size_t count = inLen / sizeof(RsAllocation);
+    for (size_t ct = 0; ct < count; ct++) {
+        if (!scriptVisible(rsc, static_cast<Allocation *>(vains[ct]))) {
+            return;
+        }
+    }
+    if (!scriptVisible(rsc, static_cast<Allocation *>(vaout))) {
+        return;
+    }
+    s->callLock(rsc);
+    s->runForEachMulti(rsc, slot, (const Allocation **)vains, count,
+                       static_cast<Allocation *>(vaout), params, paramLen, sc);
+    s->callUnlock(rsc);
+}
+
+void rsi_ScriptForEachRegions(Context *rsc, RsScript vs, uint32_t slot,
+                              RsAllocation vain, RsAllocation vaout,
+                              const void *params, size_t paramLen,
+                              const RsScriptCall *sc, size_t scLen,
+                              const RsScriptRect *regions, size_t regionsLen) {
+    Script *s = static_cast<Script *>(vs);
+    RsScriptCall call;
+    if (!copyScriptCall(&call, sc, scLen)) {
+        memset(&call, 0, sizeof(call));
+        call.strategy = RS_FOR_EACH_STRATEGY_DONT_CARE;
+    }
+    // The spec passes the size of the array in bytes.
+    call.regions = regions;
+    call.regionCount = regionsLen / sizeof(RsScriptRect);
+    if (!call.regionCount) {
+        // Nothing to cover.
+        return;
+    }
+    if (!scriptVisible(rsc, static_cast<Allocation *>(vain)) ||
+        !scriptVisible(rsc, static_cast<Allocation *>(vaout))) {
+        return;
+    }
+    s->callLock(rsc);
+    s->runForEach(rsc, slot,
+                  static_cast<const Allocation *>(vain), static_cast<Allocation *>(vaout),
+                  params, paramLen, &call);
+    s->callUnlock(rsc);
+}
 
+void rsi_ScriptReduce(Context *rsc, RsScript vs, uint32_t accumSlot,
+                      uint32_t combineSlot, int32_t finalizeSlot,
+                      RsAllocation vain, RsAllocation vaout,
+                      const RsScriptCall *sc, size_t scLen) {
+    Script *s = static_cast<Script *>(vs);
+    if (!scriptVisible(rsc, static_cast<Allocation *>(vain)) ||
+        !scriptVisible(rsc, static_cast<Allocation *>(vaout))) {
+        return;
+    }
+    RsScriptCall call;
+    sc = copyScriptCall(&call, sc, scLen);
+    s->callLock(rsc);
+    s->runReduce(rsc, accumSlot, combineSlot, finalizeSlot,
+                 static_cast<const Allocation *>(vain), static_cast<Allocation *>(vaout), sc);
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptInvoke(Context *rsc, RsScript vs, uint32_t slot) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->Invoke(rsc, slot, NULL, 0);
+    s->callUnlock(rsc);
 }
 
 
 void rsi_ScriptInvokeData(Context *rsc, RsScript vs, uint32_t slot, void *data) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->Invoke(rsc, slot, NULL, 0);
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptInvokeV(Context *rsc, RsScript vs, uint32_t slot, const void *data, size_t len) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->Invoke(rsc, slot, data, len);
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetVarI(Context *rsc, RsScript vs, uint32_t slot, int value) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->setVar(slot, &value, sizeof(value));
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetVarObj(Context *rsc, RsScript vs, uint32_t slot, RsObjectBase value) {
     Script *s = static_cast<Script *>(vs);
     ObjectBase *o = static_cast<ObjectBase *>(value);
+    if (!scriptVisible(rsc, o, s)) {
+        return;
+    }
+    s->callLock(rsc);
     s->setVarObj(slot, o);
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetVarJ(Context *rsc, RsScript vs, uint32_t slot, int64_t value) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->setVar(slot, &value, sizeof(value));
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetVarF(Context *rsc, RsScript vs, uint32_t slot, float value) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->setVar(slot, &value, sizeof(value));
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetVarD(Context *rsc, RsScript vs, uint32_t slot, double value) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->setVar(slot, &value, sizeof(value));
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetVarV(Context *rsc, RsScript vs, uint32_t slot, const void *data, size_t len) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->setVar(slot, data, len);
+    s->callUnlock(rsc);
+}
+
+void rsi_ScriptSetVars(Context *rsc, RsScript vs, const void *records, size_t sizeBytes) {
+    Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
+    s->setVars(rsc, records, sizeBytes);
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptGetVarV(Context *rsc, RsScript vs, uint32_t slot, void *data, size_t len) {
     Script *s = static_cast<Script *>(vs);
+    s->callLock(rsc);
     s->getVar(slot, data, len);
+    s->callUnlock(rsc);
 }
 
 void rsi_ScriptSetVarVE(Context *rsc, RsScript vs, uint32_t slot,
@@ -255,7 +504,9 @@ void rsi_ScriptSetVarVE(Context *rsc, RsScript vs, uint32_t slot,
                         const size_t *dims, size_t dimLen) {
     Script *s = static_cast<Script *>(vs);
     Element *e = static_cast<Element *>(ve);
+    s->callLock(rsc);
     s->setVar(slot, data, len, e, dims, dimLen);
+    s->callUnlock(rsc);
 }
 
 }
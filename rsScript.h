@@ -37,6 +37,12 @@ public:
     ScriptKernelID(Context *rsc, Script *s, int slot, int sig);
     virtual ~ScriptKernelID();
 
+    void * operator new(size_t size, Context *rsc) {
+        return ObjectBase::slabAlloc(rsc, size);
+    }
+    void operator delete(void *ptr) { ObjectSlab::release(ptr); }
+    void operator delete(void *ptr, Context *) { ObjectSlab::release(ptr); }
+
     virtual void serialize(Context *rsc, OStream *stream) const;
     virtual RsA3DClassID getClassId() const;
 
@@ -51,6 +57,12 @@ public:
     ScriptFieldID(Context *rsc, Script *s, int slot);
     virtual ~ScriptFieldID();
 
+    void * operator new(size_t size, Context *rsc) {
+        return ObjectBase::slabAlloc(rsc, size);
+    }
+    void operator delete(void *ptr) { ObjectSlab::release(ptr); }
+    void operator delete(void *ptr, Context *) { ObjectSlab::release(ptr); }
+
     virtual void serialize(Context *rsc, OStream *stream) const;
     virtual RsA3DClassID getClassId() const;
 
@@ -105,6 +117,8 @@ public:
     void setVar(uint32_t slot, const void *val, size_t len, Element *e,
                 const size_t *dims, size_t dimLen);
     void setVarObj(uint32_t slot, ObjectBase *val);
+    // Applies a packed list of RsScriptVarRecord updates at once.
+    void setVars(Context *rsc, const void *records, size_t sizeBytes);
 
     virtual bool freeChildren();
 
@@ -116,16 +130,43 @@ public:
                             size_t usrBytes,
                             const RsScriptCall *sc = NULL) = 0;
 
+    // Launches slot over inLen inputs of the same dimensions at once.
+    virtual void runForEachMulti(Context *rsc, uint32_t slot, const Allocation **ains,
+                                 size_t inLen, Allocation *aout, const void *usr,
+                                 size_t usrBytes, const RsScriptCall *sc);
+
+    // Reduces ain to the single cell of aout.  accumSlot adds each input
+    // cell into an accumulator that starts as a copy of aout, combineSlot
+    // adds one accumulator into another, and finalizeSlot, unless it is -1,
+    // turns the total into the value stored in aout.
+    virtual void runReduce(Context *rsc, uint32_t accumSlot, uint32_t combineSlot,
+                           int32_t finalizeSlot, const Allocation *ain, Allocation *aout,
+                           const RsScriptCall *sc);
+
     virtual void Invoke(Context *rsc, uint32_t slot, const void *data, size_t len) = 0;
+    // Invokes slot count times, each with the next len bytes of data.
+    virtual void InvokeBatch(Context *rsc, uint32_t slot, const void *data, size_t len,
+                             uint32_t count);
     virtual void setupScript(Context *rsc) = 0;
     virtual uint32_t run(Context *) = 0;
 
     bool hasObjectSlots() const {
         return mHasObjectSlots;
     }
+
+    // Records what a launch or invoke that just ran may have written.
+    // Without object slots that is only aout; otherwise it is anything
+    // scripts can reach.
+    void markWrites(Context *rsc, const Allocation *aout) const;
+
+    // Synchronous contexts may be called from several application threads
+    // at once.  Calls into one script take turns; other scripts go ahead.
+    void callLock(Context *rsc);
+    void callUnlock(Context *rsc);
 protected:
     bool mInitialized;
     bool mHasObjectSlots;
+    pthread_mutex_t mCallMutex;
     ObjectBaseRef<Allocation> *mSlots;
     ObjectBaseRef<const Type> *mTypes;
 
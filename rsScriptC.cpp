@@ -151,6 +151,7 @@ uint32_t ScriptC::run(Context *rsc) {
     }
 
     ret = rsc->mHal.funcs.script.invokeRoot(rsc, this);
+    markWrites(rsc, NULL);
 
     if (rsc->props.mLogScripts) {
         ALOGV("%p ScriptC::run invoking complete, ret=%i", rsc, ret);
@@ -185,11 +186,58 @@ void ScriptC::runForEach(Context *rsc,
     setupGLState(rsc);
     setupScript(rsc);
     rsc->mHal.funcs.script.invokeForEach(rsc, this, slot, ain, aout, usr, usrBytes, sc);
+    markWrites(rsc, aout);
 
     if (AString)
         delete AString;
 }
 
+void ScriptC::runForEachMulti(Context *rsc, uint32_t slot, const Allocation **ains,
+                              size_t inLen, Allocation *aout, const void *usr,
+                              size_t usrBytes, const RsScriptCall *sc) {
+    if (inLen == 1) {
+        runForEach(rsc, slot, ains[0], aout, usr, usrBytes, sc);
+        return;
+    }
+    ATRACE_CALL();
+
+    if (!inLen || !rsc->mHal.funcs.script.invokeForEachMulti) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "Driver does not support multiple kernel inputs");
+        return;
+    }
+
+    Context::PushState ps(rsc);
+
+    setupGLState(rsc);
+    setupScript(rsc);
+    rsc->mHal.funcs.script.invokeForEachMulti(rsc, this, slot, ains, inLen, aout,
+                                              usr, usrBytes, sc);
+    markWrites(rsc, aout);
+}
+
+void ScriptC::runReduce(Context *rsc, uint32_t accumSlot, uint32_t combineSlot,
+                        int32_t finalizeSlot, const Allocation *ain, Allocation *aout,
+                        const RsScriptCall *sc) {
+    ATRACE_CALL();
+
+    if (!ain || !aout || (aout->getType()->getCellCount() != 1)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Reductions need an input and a single cell output");
+        return;
+    }
+    if (!rsc->mHal.funcs.script.invokeReduce) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "Driver does not support reductions");
+        return;
+    }
+
+    Context::PushState ps(rsc);
+
+    setupGLState(rsc);
+    setupScript(rsc);
+    rsc->mHal.funcs.script.invokeReduce(rsc, this, accumSlot, combineSlot, finalizeSlot,
+                                        ain, aout, sc);
+    markWrites(rsc, aout);
+}
+
 void ScriptC::Invoke(Context *rsc, uint32_t slot, const void *data, size_t len) {
     ATRACE_CALL();
 
@@ -203,6 +251,29 @@ void ScriptC::Invoke(Context *rsc, uint32_t slot, const void *data, size_t len)
         ALOGV("%p ScriptC::Invoke invoking slot %i,  ptr %p", rsc, slot, this);
     }
     rsc->mHal.funcs.script.invokeFunction(rsc, this, slot, data, len);
+    markWrites(rsc, NULL);
+}
+
+void ScriptC::InvokeBatch(Context *rsc, uint32_t slot, const void *data, size_t len,
+                          uint32_t count) {
+    ATRACE_CALL();
+
+    if (slot >= mHal.info.exportedFunctionCount) {
+        rsc->setError(RS_ERROR_BAD_SCRIPT, "Calling invoke on bad script");
+        return;
+    }
+    if (!rsc->mHal.funcs.script.invokeFunctionBatch) {
+        Script::InvokeBatch(rsc, slot, data, len, count);
+        return;
+    }
+    setupScript(rsc);
+
+    if (rsc->props.mLogScripts) {
+        ALOGV("%p ScriptC::InvokeBatch invoking slot %i %u times, ptr %p", rsc, slot, count,
+              this);
+    }
+    rsc->mHal.funcs.script.invokeFunctionBatch(rsc, this, slot, data, len, count);
+    markWrites(rsc, NULL);
 }
 
 ScriptCState::ScriptCState() {
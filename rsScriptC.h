@@ -41,6 +41,8 @@ public:
     virtual ~ScriptC();
 
     virtual void Invoke(Context *rsc, uint32_t slot, const void *data, size_t len);
+    virtual void InvokeBatch(Context *rsc, uint32_t slot, const void *data, size_t len,
+                             uint32_t count);
 
     virtual uint32_t run(Context *);
 
@@ -52,6 +54,14 @@ public:
                             size_t usrBytes,
                             const RsScriptCall *sc = NULL);
 
+    virtual void runForEachMulti(Context *rsc, uint32_t slot, const Allocation **ains,
+                                 size_t inLen, Allocation *aout, const void *usr,
+                                 size_t usrBytes, const RsScriptCall *sc);
+
+    virtual void runReduce(Context *rsc, uint32_t accumSlot, uint32_t combineSlot,
+                           int32_t finalizeSlot, const Allocation *ain, Allocation *aout,
+                           const RsScriptCall *sc);
+
     virtual void serialize(Context *rsc, OStream *stream) const {    }
     virtual RsA3DClassID getClassId() const { return RS_A3D_CLASS_ID_SCRIPT_C; }
     static Type *createFromStream(Context *rsc, IStream *stream) { return NULL; }
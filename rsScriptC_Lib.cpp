@@ -26,6 +26,7 @@
 #endif
 
 #include <time.h>
+#include <stddef.h>
 
 using namespace android;
 using namespace android::renderscript;
@@ -189,15 +190,32 @@ void rsrAllocationIoReceive(Context *rsc, Allocation *src) {
     src->ioReceive(rsc);
 }
 
+void rsrAllocationSort(Context *rsc, Allocation *keys, Allocation *values) {
+    rsi_AllocationSort(rsc, keys, values);
+}
+
+uint32_t rsrAllocationCompact(Context *rsc, Allocation *dst, Allocation *src, Allocation *flags) {
+    return rsi_AllocationCompact(rsc, dst, src, flags);
+}
+
 void rsrForEach(Context *rsc,
                 Script *target,
                 Allocation *in, Allocation *out,
                 const void *usr, uint32_t usrBytes,
                 const RsScriptCall *call) {
+    // Scripts use rs_script_call_t, which has no launch hints.
+    RsScriptCall sc;
+    if (call) {
+        memset(&sc, 0, sizeof(sc));
+        memcpy(&sc, call, offsetof(RsScriptCall, maxThreads));
+        call = &sc;
+    }
     target->runForEach(rsc, /* root slot */ 0, in, out, usr, usrBytes, call);
 }
 
 void rsrAllocationSyncAll(Context *rsc, Allocation *a, RsAllocationUsageType usage) {
+    // The calling script may have written anything it can reach so far.
+    __sync_fetch_and_add(&rsc->mScriptWriteEpoch, 1);
     a->syncAll(rsc, usage);
 }
 
@@ -181,6 +181,19 @@ void rsrDrawMeshPrimitiveRange(Context *rsc, Mesh *sm, uint32_t primIndex,
     sm->renderPrimitiveRange(rsc, primIndex, start, len);
 }
 
+void rsrDrawMeshInstanced(Context *rsc, Mesh *sm, uint32_t primIndex, Allocation *transforms) {
+    CHECK_OBJ(sm);
+    CHECK_OBJ(transforms);
+    if (!transforms || (transforms->getType()->getElementSizeBytes() != sizeof(rsc_Matrix))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "rsgDrawMeshInstanced needs an allocation of rs_matrix4x4");
+        return;
+    }
+    if (!rsc->setupCheck()) {
+        return;
+    }
+    sm->renderPrimitiveInstanced(rsc, primIndex, transforms);
+}
+
 void rsrMeshComputeBoundingBox(Context *rsc, Mesh *sm,
                                float *minX, float *minY, float *minZ,
                                float *maxX, float *maxY, float *maxZ) {
@@ -194,6 +207,14 @@ void rsrMeshComputeBoundingBox(Context *rsc, Mesh *sm,
     *maxZ = sm->mBBoxMax[2];
 }
 
+uint32_t rsrMeshCull(Context *rsc, const rsc_Matrix *m, Mesh * const *meshes,
+                     uint8_t *visible, uint32_t count) {
+    for (uint32_t i = 0; i < count; i ++) {
+        CHECK_OBJ_OR_NULL(meshes[i]);
+    }
+    return Mesh::cull(rsc, (const rs_matrix4x4 *)m, meshes, visible, count);
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
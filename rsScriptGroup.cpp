@@ -15,12 +15,16 @@
  */
 
 #include "rsContext.h"
+#include <sys/mman.h>
 #include <time.h>
 
 using namespace android;
 using namespace android::renderscript;
 
 ScriptGroup::ScriptGroup(Context *rsc) : ObjectBase(rsc) {
+    mLinkStorage = NULL;
+    mLinkStorageSize = 0;
+    mPipelined = false;
 }
 
 ScriptGroup::~ScriptGroup() {
@@ -31,6 +35,9 @@ ScriptGroup::~ScriptGroup() {
     for (size_t ct=0; ct < mLinks.size(); ct++) {
         delete mLinks[ct];
     }
+    if (mLinkStorage) {
+        munmap(mLinkStorage, mLinkStorageSize);
+    }
 }
 
 ScriptGroup::IO::IO(const ScriptKernelID *kid) {
@@ -190,6 +197,152 @@ bool ScriptGroup::calcOrder() {
     return ret;
 }
 
+// Returns the index in mNodes of the node running script s.
+size_t ScriptGroup::findNodeIndex(const Script *s) const {
+    for (size_t ct=0; ct < mNodes.size(); ct++) {
+        if (mNodes[ct]->mScript == s) {
+            return ct;
+        }
+    }
+    return mNodes.size();
+}
+
+// Link allocations are only used inside the group, so the ones whose live
+// ranges in node order don't overlap share storage.  The storage is mapped
+// rather than allocated: the pages of links the driver keeps fused are
+// never touched and so never get backed.  Frames of a pipelined group
+// overlap, so each of its links gets two allocations of its own instead.
+void ScriptGroup::allocateLinks(Context *rsc) {
+    void *oldStorage = mLinkStorage;
+    const size_t oldStorageSize = mLinkStorageSize;
+    mLinkStorage = NULL;
+    mLinkStorageSize = 0;
+
+    // Each source kernel gets one allocation for all of its links, live
+    // from its node to the last node reading it.
+    Vector<Link *> sources;
+    Vector<size_t> firstUse;
+    Vector<size_t> lastUse;
+    for (size_t ct=0; ct < mNodes.size(); ct++) {
+        const Node *n = mNodes[ct];
+        for (size_t ct2=0; ct2 < n->mOutputs.size(); ct2++) {
+            Link *l = n->mOutputs[ct2];
+            size_t dst = ct;
+            if (l->mDstKernel.get()) {
+                dst = findNodeIndex(l->mDstKernel->mScript);
+            } else if (l->mDstField.get()) {
+                dst = findNodeIndex(l->mDstField->mScript);
+            }
+
+            size_t src = sources.size();
+            for (size_t ct3=0; ct3 < sources.size(); ct3++) {
+                if (sources[ct3]->mSource.get() == l->mSource.get()) {
+                    src = ct3;
+                }
+            }
+            if (src == sources.size()) {
+                sources.add(l);
+                firstUse.add(ct);
+                lastUse.add(ct);
+            }
+            lastUse.editItemAt(src) = rsMax(lastUse[src], rsMin(dst, mNodes.size() - 1));
+        }
+    }
+
+    // Assign storage slots in node order, reusing the best fitting slot
+    // whose last reader runs before the new link is written.  Types the
+    // driver can't place in user memory, and ones holding object
+    // references, get their own allocations.
+    Vector<size_t> slotSizes;
+    Vector<size_t> slotLastUse;
+    Vector<int> sourceSlots;
+    for (size_t ct=0; ct < sources.size(); ct++) {
+        const Type *t = sources[ct]->mType.get();
+        if (mPipelined || t->getDimLOD() || t->getDimFaces() || t->getDimYuv() ||
+            t->getElement()->getHasReferences() ||
+            ((t->getDimX() * t->getElementSizeBytes()) % 16)) {
+            sourceSlots.add(-1);
+            continue;
+        }
+        const size_t bytes = (t->getPackedSizeBytes() + 63) & ~63;
+
+        // Prefer the smallest free slot that is big enough, then the
+        // largest one, which has to grow the least.
+        int fit = -1;
+        int grow = -1;
+        for (size_t ct2=0; ct2 < slotSizes.size(); ct2++) {
+            if (slotLastUse[ct2] >= firstUse[ct]) {
+                continue;
+            }
+            if (slotSizes[ct2] >= bytes) {
+                if ((fit < 0) || (slotSizes[ct2] < slotSizes[fit])) {
+                    fit = ct2;
+                }
+            } else if ((grow < 0) || (slotSizes[ct2] > slotSizes[grow])) {
+                grow = ct2;
+            }
+        }
+        int slot = (fit >= 0) ? fit : grow;
+        if (slot < 0) {
+            slot = slotSizes.size();
+            slotSizes.add(bytes);
+            slotLastUse.add(lastUse[ct]);
+        } else {
+            slotSizes.editItemAt(slot) = rsMax(slotSizes[slot], bytes);
+            slotLastUse.editItemAt(slot) = lastUse[ct];
+        }
+        sourceSlots.add(slot);
+    }
+
+    Vector<size_t> slotOffsets;
+    mLinkStorageSize = 0;
+    for (size_t ct=0; ct < slotSizes.size(); ct++) {
+        slotOffsets.add(mLinkStorageSize);
+        mLinkStorageSize += slotSizes[ct];
+    }
+    if (mLinkStorageSize) {
+        mLinkStorage = mmap(NULL, mLinkStorageSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mLinkStorage == MAP_FAILED) {
+            ALOGE("ScriptGroup couldn't map %zu bytes of link storage", mLinkStorageSize);
+            mLinkStorage = NULL;
+            mLinkStorageSize = 0;
+        }
+    }
+
+    for (size_t ct=0; ct < sources.size(); ct++) {
+        Link *l = sources[ct];
+        Allocation *alloc;
+        if (mLinkStorage && (sourceSlots[ct] >= 0)) {
+            alloc = Allocation::createAllocation(rsc, l->mType.get(),
+                    RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED,
+                    RS_ALLOCATION_MIPMAP_NONE,
+                    (uint8_t *)mLinkStorage + slotOffsets[sourceSlots[ct]]);
+        } else {
+            alloc = Allocation::createAllocation(rsc, l->mType.get(),
+                    RS_ALLOCATION_USAGE_SCRIPT);
+        }
+
+        Allocation *pipeAlloc = NULL;
+        if (mPipelined) {
+            pipeAlloc = Allocation::createAllocation(rsc, l->mType.get(),
+                    RS_ALLOCATION_USAGE_SCRIPT);
+        }
+
+        for (size_t ct2=0; ct2 < mLinks.size(); ct2++) {
+            if (mLinks[ct2]->mSource.get() == l->mSource.get()) {
+                mLinks[ct2]->mAlloc = alloc;
+                mLinks[ct2]->mPipeAlloc = pipeAlloc;
+            }
+        }
+    }
+
+    // The allocations placed in the old storage went with their links.
+    if (oldStorage) {
+        munmap(oldStorage, oldStorageSize);
+    }
+}
+
 ScriptGroup * ScriptGroup::create(Context *rsc,
                            ScriptKernelID ** kernels, size_t kernelsSize,
                            ScriptKernelID ** src, size_t srcSize,
@@ -224,27 +377,7 @@ ScriptGroup * ScriptGroup::create(Context *rsc,
 
     sg->calcOrder();
 
-    // allocate links
-    for (size_t ct=0; ct < sg->mNodes.size(); ct++) {
-        const Node *n = sg->mNodes[ct];
-        for (size_t ct2=0; ct2 < n->mOutputs.size(); ct2++) {
-            Link *l = n->mOutputs[ct2];
-            if (l->mAlloc.get()) {
-                continue;
-            }
-            const ScriptKernelID *k = l->mSource.get();
-
-            Allocation * alloc = Allocation::createAllocation(rsc,
-                    l->mType.get(), RS_ALLOCATION_USAGE_SCRIPT);
-            l->mAlloc = alloc;
-
-            for (size_t ct3=ct2+1; ct3 < n->mOutputs.size(); ct3++) {
-                if (n->mOutputs[ct3]->mSource.get() == l->mSource.get()) {
-                    n->mOutputs[ct3]->mAlloc = alloc;
-                }
-            }
-        }
-    }
+    sg->allocateLinks(rsc);
 
     if (rsc->mHal.funcs.scriptgroup.init) {
         rsc->mHal.funcs.scriptgroup.init(rsc, sg);
@@ -254,6 +387,10 @@ ScriptGroup * ScriptGroup::create(Context *rsc,
 }
 
 void ScriptGroup::setInput(Context *rsc, ScriptKernelID *kid, Allocation *a) {
+    if (a && (a->hasFieldPlanes() || a->hasTiles())) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Kernels can't walk field planes or tiles.");
+        return;
+    }
     for (size_t ct=0; ct < mInputs.size(); ct++) {
         if (mInputs[ct]->mKernel == kid) {
             mInputs[ct]->mAlloc = a;
@@ -268,6 +405,10 @@ void ScriptGroup::setInput(Context *rsc, ScriptKernelID *kid, Allocation *a) {
 }
 
 void ScriptGroup::setOutput(Context *rsc, ScriptKernelID *kid, Allocation *a) {
+    if (a && (a->hasFieldPlanes() || a->hasTiles())) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Kernels can't walk field planes or tiles.");
+        return;
+    }
     for (size_t ct=0; ct < mOutputs.size(); ct++) {
         if (mOutputs[ct]->mKernel == kid) {
             mOutputs[ct]->mAlloc = a;
@@ -281,10 +422,36 @@ void ScriptGroup::setOutput(Context *rsc, ScriptKernelID *kid, Allocation *a) {
     rsAssert(!"ScriptGroup:setOutput kid not found");
 }
 
+// The driver waits for the frames in flight before the links are
+// reallocated for the new mode.
+void ScriptGroup::setPipelined(Context *rsc, bool pipelined) {
+    if (pipelined == mPipelined) {
+        return;
+    }
+    if (rsc->mHal.funcs.scriptgroup.setPipelined) {
+        rsc->mHal.funcs.scriptgroup.setPipelined(rsc, this, pipelined);
+    }
+    mPipelined = pipelined;
+    allocateLinks(rsc);
+}
+
 void ScriptGroup::execute(Context *rsc) {
     //ALOGE("ScriptGroup::execute");
     if (rsc->mHal.funcs.scriptgroup.execute) {
         rsc->mHal.funcs.scriptgroup.execute(rsc, this);
+        for (size_t ct=0; ct < mNodes.size(); ct++) {
+            mNodes[ct]->mScript->markWrites(rsc, NULL);
+            for (size_t ct2=0; ct2 < mNodes[ct]->mOutputs.size(); ct2++) {
+                if (mNodes[ct]->mOutputs[ct2]->mAlloc.get()) {
+                    mNodes[ct]->mOutputs[ct2]->mAlloc->sendDirty(rsc);
+                }
+            }
+        }
+        for (size_t ct=0; ct < mOutputs.size(); ct++) {
+            if (mOutputs[ct]->mAlloc.get()) {
+                mOutputs[ct]->mAlloc->sendDirty(rsc);
+            }
+        }
         return;
     }
 
@@ -384,6 +551,11 @@ void rsi_ScriptGroupExecute(Context *rsc, RsScriptGroup sg) {
     s->execute(rsc);
 }
 
+void rsi_ScriptGroupSetPipelined(Context *rsc, RsScriptGroup sg, bool pipelined) {
+    ScriptGroup *s = (ScriptGroup *)sg;
+    s->setPipelined(rsc, pipelined);
+}
+
 }
 }
 
@@ -41,6 +41,8 @@ public:
         ObjectBaseRef<const ScriptFieldID> mDstField;
         ObjectBaseRef<const Type> mType;
         ObjectBaseRef<Allocation> mAlloc;
+        // The allocation odd frames of a pipelined group use.
+        ObjectBaseRef<Allocation> mPipeAlloc;
         Link();
         ~Link();
     };
@@ -92,17 +94,26 @@ public:
     void execute(Context *rsc);
     void setInput(Context *rsc, ScriptKernelID *kid, Allocation *a);
     void setOutput(Context *rsc, ScriptKernelID *kid, Allocation *a);
+    void setPipelined(Context *rsc, bool pipelined);
+    bool isPipelined() const {return mPipelined;}
 
 
 protected:
     virtual ~ScriptGroup();
     bool mInitialized;
+    bool mPipelined;
+
+    // Storage shared by the link allocations.
+    void *mLinkStorage;
+    size_t mLinkStorageSize;
 
 
 private:
     bool calcOrderRecurse(Node *n, int depth);
     bool calcOrder();
     Node * findNode(Script *s) const;
+    size_t findNodeIndex(const Script *s) const;
+    void allocateLinks(Context *rsc);
 
     ScriptGroup(Context *);
 };
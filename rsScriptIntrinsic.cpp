@@ -65,6 +65,7 @@ void ScriptIntrinsic::runForEach(Context *rsc,
                          const RsScriptCall *sc) {
 
     rsc->mHal.funcs.script.invokeForEach(rsc, this, slot, ain, aout, usr, usrBytes, sc);
+    markWrites(rsc, aout);
 }
 
 void ScriptIntrinsic::Invoke(Context *rsc, uint32_t slot, const void *data, size_t len) {
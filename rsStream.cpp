@@ -25,6 +25,7 @@ IStream::IStream(const uint8_t *buf, bool use64) {
     mData = buf;
     mPos = 0;
     mUse64 = use64;
+    mBacking = NULL;
 }
 
 void IStream::loadByteArray(void *dest, size_t numBytes) {
@@ -56,6 +57,21 @@ OStream::OStream(uint64_t len, bool use64) {
     mLength = len;
     mPos = 0;
     mUse64 = use64;
+    mSink = NULL;
+    mBase = 0;
+    mSinkError = false;
+}
+
+OStream::OStream(FILE *sink, uint64_t len, bool use64) {
+    // Segments hold whole multiples of the largest alignment used, so
+    // aligning never runs past the end of one
+    mLength = (len < 4096) ? 4096 : ((len + 15) & ~15);
+    mData = (uint8_t*)malloc(mLength);
+    mPos = 0;
+    mUse64 = use64;
+    mSink = sink;
+    mBase = 0;
+    mSinkError = false;
 }
 
 OStream::~OStream() {
@@ -63,6 +79,21 @@ OStream::~OStream() {
 }
 
 void OStream::addByteArray(const void *src, size_t numBytes) {
+    if (mSink) {
+        // Fill and write out segments until the rest fits
+        const uint8_t *s = (const uint8_t *)src;
+        while (mPos + numBytes >= mLength) {
+            size_t room = mLength - mPos;
+            memcpy(mData + mPos, s, room);
+            mPos += room;
+            s += room;
+            numBytes -= room;
+            growSize();
+        }
+        memcpy(mData + mPos, s, numBytes);
+        mPos += numBytes;
+        return;
+    }
     // We need to potentially grow more than once if the number of byes we write is substantial
     while (mPos + numBytes >= mLength) {
         growSize();
@@ -92,12 +123,7 @@ void OStream::addOffset(uint64_t v) {
 
 void OStream::addString(const char *s, size_t len) {
     addU32(len);
-    if (mPos + len*sizeof(char) >= mLength) {
-        growSize();
-    }
-    char *stringData = reinterpret_cast<char *>(&mData[mPos]);
-    memcpy(stringData, s, len);
-    mPos += len*sizeof(char);
+    addByteArray(s, len*sizeof(char));
 }
 
 void OStream::addString(const char *s) {
@@ -105,11 +131,35 @@ void OStream::addString(const char *s) {
 }
 
 void OStream::growSize() {
-    uint8_t *newData = (uint8_t*)malloc(mLength*2);
-    memcpy(newData, mData, mLength*sizeof(uint8_t));
+    if (mSink) {
+        // Write out the segment, keeping the bytes past its last 8 byte
+        // boundary at the front of the next one
+        size_t keep = mPos & 7;
+        size_t out = mPos - keep;
+        if (fwrite(mData, 1, out, mSink) != out) {
+            mSinkError = true;
+        }
+        memmove(mData, mData + out, keep);
+        mBase += out;
+        mPos = keep;
+        return;
+    }
+    // realloc can often extend in place instead of copying the stream
+    uint8_t *newData = (uint8_t*)realloc(mData, mLength*2);
+    rsAssert(newData);
     mLength = mLength * 2;
-    free(mData);
     mData = newData;
 }
 
+bool OStream::finish() {
+    if (mSink) {
+        if (mPos && (fwrite(mData, 1, mPos, mSink) != mPos)) {
+            mSinkError = true;
+        }
+        mBase += mPos;
+        mPos = 0;
+    }
+    return !mSinkError;
+}
+
 
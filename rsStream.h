@@ -24,6 +24,8 @@
 namespace android {
 namespace renderscript {
 
+class ObjectBase;
+
 class IStream {
 public:
     IStream(const uint8_t *, bool use64);
@@ -73,15 +75,29 @@ public:
     const uint8_t * getPtr() const {
         return mData;
     }
+
+    // Object keeping the stream's memory valid and writable for as long as
+    // it lives, so objects loaded from it may use that memory in place.
+    void setBacking(const ObjectBase *owner) {
+        mBacking = owner;
+    }
+    const ObjectBase * getBacking() const {
+        return mBacking;
+    }
 protected:
     const uint8_t * mData;
     uint64_t mPos;
     bool mUse64;
+    const ObjectBase * mBacking;
 };
 
 class OStream {
 public:
     OStream(uint64_t length, bool use64);
+    // Writes into sink, from its current position, each time a segment of
+    // length bytes fills, so only that segment is held in memory.  The
+    // data is only complete in sink after finish().
+    OStream(FILE *sink, uint64_t length, bool use64);
     ~OStream();
 
     void align(uint32_t bytes) {
@@ -135,8 +151,9 @@ public:
     void addString(const char *name);
     void addString(const char *name, size_t len);
     uint64_t getPos() const {
-        return mPos;
+        return mBase + mPos;
     }
+    // Repositioning and getPtr() are only for streams held in memory.
     void reset(uint64_t pos) {
         mPos = pos;
     }
@@ -146,12 +163,21 @@ public:
     const uint8_t * getPtr() const {
         return mData;
     }
+    // Writes out what is still buffered, returning false if any write to
+    // the sink failed.
+    bool finish();
 protected:
     void growSize();
     uint8_t * mData;
     uint64_t mLength;
     uint64_t mPos;
     bool mUse64;
+
+    FILE * mSink;
+    // Stream position of mData[0], a multiple of 8 so alignment within
+    // the segment is alignment within the stream
+    uint64_t mBase;
+    bool mSinkError;
 };
 
 
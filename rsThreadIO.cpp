@@ -33,6 +33,15 @@ ThreadIO::ThreadIO() {
     mRunning = true;
     mPureFifo = false;
     mMaxInlineSize = 1024;
+    mUseRing = false;
+    mBatching = false;
+    mUseClientRing = false;
+    mPeekedClient = NULL;
+    mIdleCallback = NULL;
+    mIdleData = NULL;
+    mIdleMs = 0;
+    mIdleWaitMs = -1;
+    mIdleResumed = false;
 }
 
 ThreadIO::~ThreadIO() {
@@ -41,15 +50,26 @@ ThreadIO::~ThreadIO() {
 void ThreadIO::init() {
     mToClient.init();
     mToCore.init();
+    mUseRing = !mPureFifo && mToCoreRing.init(256 * 1024);
+    mUseClientRing = !mPureFifo && mToClientRing.init(256 * 1024);
 }
 
 void ThreadIO::shutdown() {
     mRunning = false;
+    if (mUseRing) {
+        mToCoreRing.shutdown();
+    }
     mToCore.shutdown();
 }
 
 void * ThreadIO::coreHeader(uint32_t cmdID, size_t dataLen) {
     //ALOGE("coreHeader %i %i", cmdID, dataLen);
+    if (mUseRing) {
+        CoreCmdHeader *hdr = (CoreCmdHeader *)mToCoreRing.reserve(sizeof(CoreCmdHeader) + dataLen);
+        hdr->bytes = dataLen;
+        hdr->cmdID = cmdID;
+        return &hdr[1];
+    }
     CoreCmdHeader *hdr = (CoreCmdHeader *)&mSendBuffer[0];
     hdr->bytes = dataLen;
     hdr->cmdID = cmdID;
@@ -60,15 +80,44 @@ void * ThreadIO::coreHeader(uint32_t cmdID, size_t dataLen) {
 }
 
 void ThreadIO::coreCommit() {
+    if (mUseRing) {
+        mToCoreRing.commit(!mBatching);
+        return;
+    }
     mToCore.writeAsync(&mSendBuffer, mSendLen);
 }
 
+void ThreadIO::coreFlush() {
+    if (mUseRing) {
+        mToCoreRing.flush();
+    }
+}
+
+void ThreadIO::coreWaitPayload() {
+    if (mUseRing) {
+        // Commands are released once played, so no reply is needed.
+        mToCoreRing.waitForRelease(mToCoreRing.getWriteToken());
+        return;
+    }
+    coreGetReturn(NULL, 0);
+}
+
+void ThreadIO::corePayloadDone() {
+    if (!mUseRing) {
+        coreSetReturn(NULL, 0);
+    }
+}
+
 void ThreadIO::clientShutdown() {
+    if (mUseClientRing) {
+        mToClientRing.shutdown();
+    }
     mToClient.shutdown();
 }
 
 void ThreadIO::coreWrite(const void *data, size_t len) {
     //ALOGV("core write %p %i", data, (int)len);
+    coreFlush();
     mToCore.writeAsync(data, len, true);
 }
 
@@ -94,6 +143,7 @@ void ThreadIO::coreGetReturn(void *data, size_t dataLen) {
         dataLen = sizeof(buf);
     }
 
+    coreFlush();
     mToCore.writeWaitReturn(data, dataLen);
 }
 
@@ -101,7 +151,93 @@ void ThreadIO::setTimeoutCallback(void (*cb)(void *), void *dat, uint64_t timeou
     //mToCore.setTimeoutCallback(cb, dat, timeout);
 }
 
-bool ThreadIO::playCoreCommands(Context *con, int waitFd) {
+void ThreadIO::setIdleCallback(int (*cb)(void *, bool), void *dat, int idleMs) {
+    mIdleCallback = cb;
+    mIdleData = dat;
+    mIdleMs = idleMs;
+    mIdleWaitMs = -1;
+    mIdleResumed = false;
+}
+
+bool ThreadIO::hasCoreCommand() {
+    if (mUseRing) {
+        return !mToCoreRing.isEmpty();
+    }
+    struct pollfd p;
+    p.fd = mToCore.getReadFd();
+    p.events = POLLIN;
+    p.revents = 0;
+    return poll(&p, 1, 0) > 0;
+}
+
+// Commands that may run while asynchronous launches are still in flight.
+static bool canOverlapLaunches(uint32_t cmdID) {
+    switch (cmdID) {
+    case RS_CMD_ID_ScriptForEach:
+    case RS_CMD_ID_ScriptSetVarI:
+    case RS_CMD_ID_ScriptSetVarJ:
+    case RS_CMD_ID_ScriptSetVarF:
+    case RS_CMD_ID_ScriptSetVarD:
+    case RS_CMD_ID_ScriptSetVarV:
+    case RS_CMD_ID_ScriptSetVars:
+    case RS_CMD_ID_ScriptGroupSetInput:
+    case RS_CMD_ID_ScriptGroupSetOutput:
+    case RS_CMD_ID_ScriptGroupExecute:
+        // Groups keep what their own launches use alive and wait for the
+        // rest themselves.
+    case RS_CMD_ID_CommandBufferSubmit:
+        // Submits check each command they replay.
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void finishLaunchesBefore(Context *con, uint32_t cmdID) {
+    // Kernel launches may still be running on the driver's threads.
+    // Only further launches know how to order themselves against
+    // them, and the driver holds back plain globals they may be reading,
+    // so everything else waits for them first.
+    if (con->mPendingAsyncWork && !canOverlapLaunches(cmdID)) {
+        con->finish();
+    }
+}
+
+void ThreadIO::playRecordedCommand(Context *con, uint32_t cmdID, const void *data,
+                                   size_t bytes) {
+    ATRACE_NAME(gPlaybackNames[cmdID]);
+    finishLaunchesBefore(con, cmdID);
+    gPlaybackFuncs[cmdID](con, data, bytes);
+}
+
+void ThreadIO::playCoreCommand(Context *con, const CoreCmdHeader *cmd, const void *data) {
+    if (con->props.mLogTimes) {
+        con->timerSet(Context::RS_TIMER_INTERNAL);
+    }
+    //ALOGV("playCoreCommands 3 %i %i", cmd->cmdID, cmd->bytes);
+
+    if (cmd->cmdID >= (sizeof(gPlaybackFuncs) / sizeof(void *))) {
+        rsAssert(cmd->cmdID < (sizeof(gPlaybackFuncs) / sizeof(void *)));
+        ALOGE("playCoreCommands error con %p, cmd %i", con, cmd->cmdID);
+    }
+
+    if (!isPureFifo()) {
+        playRecordedCommand(con, cmd->cmdID, data, cmd->bytes);
+        if (con->mRecordingCommands) {
+            con->mRecordingCommands->record(con, cmd->cmdID, data, cmd->bytes);
+        }
+    } else {
+        ATRACE_NAME(gPlaybackNames[cmd->cmdID]);
+        finishLaunchesBefore(con, cmd->cmdID);
+        gPlaybackRemoteFuncs[cmd->cmdID](con, this);
+    }
+
+    if (con->props.mLogTimes) {
+        con->timerSet(Context::RS_TIMER_IDLE);
+    }
+}
+
+bool ThreadIO::playCoreCommands(Context *con, int waitFd, bool wait) {
     bool ret = false;
     const bool isLocal = !isPureFifo();
 
@@ -110,7 +246,7 @@ bool ThreadIO::playCoreCommands(Context *con, int waitFd) {
     const void * data = (const void *)&buf[sizeof(CoreCmdHeader)];
 
     struct pollfd p[2];
-    p[0].fd = mToCore.getReadFd();
+    p[0].fd = mUseRing ? mToCoreRing.getWaitFd() : mToCore.getReadFd();
     p[0].events = POLLIN;
     p[0].revents = 0;
     p[1].fd = waitFd;
@@ -125,10 +261,42 @@ bool ThreadIO::playCoreCommands(Context *con, int waitFd) {
         con->timerSet(Context::RS_TIMER_IDLE);
     }
 
-    int waitTime = -1;
-    while (mRunning) {
+    int waitTime = wait ? mIdleWaitMs : 0;
+    bool timedOut = false;
+    while (mRunning && mUseRing) {
+        size_t bytes = 0;
+        const CoreCmdHeader *rc = (const CoreCmdHeader *)mToCoreRing.peek(&bytes);
+        if (rc) {
+            // Played in place; the slot is only reused once released.
+            ret = true;
+            playCoreCommand(con, rc, &rc[1]);
+            mToCoreRing.release();
+            if (waitFd < 0) {
+                waitTime = 0;
+            }
+            continue;
+        }
+
+        int pr = 1;
+        p[1].revents = 0;
+        if (mToCoreRing.prepareWait()) {
+            pr = poll(p, pollCount, waitTime);
+        }
+        mToCoreRing.finishWait();
+        if (pr <= 0) {
+            timedOut = (pr == 0);
+            break;
+        }
+        if (p[1].revents && mToCoreRing.isEmpty()) {
+            // Finish the commands before handling the vsync.
+            break;
+        }
+    }
+
+    while (mRunning && !mUseRing) {
         int pr = poll(p, pollCount, waitTime);
         if (pr <= 0) {
+            timedOut = (pr == 0);
             break;
         }
 
@@ -147,25 +315,7 @@ bool ThreadIO::playCoreCommands(Context *con, int waitFd) {
 
 
             ret = true;
-            if (con->props.mLogTimes) {
-                con->timerSet(Context::RS_TIMER_INTERNAL);
-            }
-            //ALOGV("playCoreCommands 3 %i %i", cmd->cmdID, cmd->bytes);
-
-            if (cmd->cmdID >= (sizeof(gPlaybackFuncs) / sizeof(void *))) {
-                rsAssert(cmd->cmdID < (sizeof(gPlaybackFuncs) / sizeof(void *)));
-                ALOGE("playCoreCommands error con %p, cmd %i", con, cmd->cmdID);
-            }
-
-            if (isLocal) {
-                gPlaybackFuncs[cmd->cmdID](con, data, cmd->bytes);
-            } else {
-                gPlaybackRemoteFuncs[cmd->cmdID](con, this);
-            }
-
-            if (con->props.mLogTimes) {
-                con->timerSet(Context::RS_TIMER_IDLE);
-            }
+            playCoreCommand(con, cmd, data);
 
             if (waitFd < 0) {
                 // If we don't have a secondary wait object we should stop blocking now
@@ -180,12 +330,38 @@ bool ThreadIO::playCoreCommands(Context *con, int waitFd) {
             break;
         }
     }
+
+    if (!mIdleCallback) {
+        return ret;
+    }
+    if (ret) {
+        mIdleWaitMs = mIdleMs;
+        mIdleResumed = true;
+    } else if (timedOut && mRunning && wait) {
+        mIdleWaitMs = mIdleCallback(mIdleData, mIdleResumed);
+        mIdleResumed = false;
+    }
     return ret;
 }
 
 RsMessageToClientType ThreadIO::getClientHeader(size_t *receiveLen, uint32_t *usrID) {
     //ALOGE("getClientHeader");
-    mToClient.read(&mLastClientHeader, sizeof(mLastClientHeader));
+    if (mUseClientRing) {
+        if (!mPeekedClient) {
+            size_t bytes = 0;
+            mToClientRing.waitForData();
+            mPeekedClient = (const ClientCmdHeader *)mToClientRing.peek(&bytes);
+        }
+        if (!mPeekedClient) {
+            // Shut down.
+            receiveLen[0] = 0;
+            usrID[0] = 0;
+            return RS_MESSAGE_TO_CLIENT_NONE;
+        }
+        mLastClientHeader = *mPeekedClient;
+    } else {
+        mToClient.read(&mLastClientHeader, sizeof(mLastClientHeader));
+    }
 
     receiveLen[0] = mLastClientHeader.bytes;
     usrID[0] = mLastClientHeader.userID;
@@ -201,7 +377,13 @@ RsMessageToClientType ThreadIO::getClientPayload(void *data, size_t *receiveLen,
     if (bufferLen < mLastClientHeader.bytes) {
         return RS_MESSAGE_TO_CLIENT_RESIZE;
     }
-    if (receiveLen[0]) {
+    if (mUseClientRing) {
+        if (mPeekedClient) {
+            memcpy(data, &mPeekedClient[1], receiveLen[0]);
+            mToClientRing.release();
+            mPeekedClient = NULL;
+        }
+    } else if (receiveLen[0]) {
         mToClient.read(data, receiveLen[0]);
     }
     //ALOGE("getClientPayload x");
@@ -212,6 +394,23 @@ bool ThreadIO::sendToClient(RsMessageToClientType cmdID, uint32_t usrID, const v
                             size_t dataLen, bool waitForSpace) {
 
     //ALOGE("sendToClient %i %i %i", cmdID, usrID, (int)dataLen);
+    if (mUseClientRing) {
+        if (dataLen > mToClientRing.getMaxRecordBytes() - sizeof(ClientCmdHeader)) {
+            ALOGE("sendToClient message of %zu bytes is too large", dataLen);
+            return false;
+        }
+        ClientCmdHeader *hdr = (ClientCmdHeader *)mToClientRing.reserve(
+                sizeof(ClientCmdHeader) + dataLen);
+        hdr->bytes = dataLen;
+        hdr->cmdID = cmdID;
+        hdr->userID = usrID;
+        if (dataLen) {
+            memcpy(&hdr[1], data, dataLen);
+        }
+        mToClientRing.commit();
+        return true;
+    }
+
     ClientCmdHeader hdr;
     hdr.bytes = dataLen;
     hdr.cmdID = cmdID;
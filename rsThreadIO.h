@@ -19,6 +19,7 @@
 
 #include "rsUtils.h"
 #include "rsFifoSocket.h"
+#include "rsFifoRing.h"
 
 // ---------------------------------------------------------------------------
 namespace android {
@@ -43,13 +44,38 @@ public:
 
     // Plays back commands from the client.
     // Returns true if any commands were processed.
-    bool playCoreCommands(Context *con, int waitFd);
+    // Without wait only the commands already sent are played.
+    bool playCoreCommands(Context *con, int waitFd, bool wait = true);
+
+    // Plays a command captured by a CommandBuffer, outside the fifo.
+    void playRecordedCommand(Context *con, uint32_t cmdID, const void *data, size_t bytes);
 
     void setTimeoutCallback(void (*)(void *), void *, uint64_t timeout);
 
+    // The callback runs on the core thread once idleMs have gone by
+    // without a command, resumed being set on the first call after
+    // commands were played.  It returns the ms to wait before calling it
+    // again, or -1 to wait for the next command.
+    void setIdleCallback(int (*)(void *, bool resumed), void *, int idleMs);
+    // Whether a command is waiting, for idle work to yield to it.
+    bool hasCoreCommand();
+
     void * coreHeader(uint32_t, size_t dataLen);
     void coreCommit();
 
+    // While batching, committed commands are held back until flushed or
+    // a call has to wait on the core.  Only the shared ring can batch.
+    void setBatching(bool batching) {
+        mBatching = batching;
+    }
+    void coreFlush();
+
+    // Commands too big to inline carry pointers to the client's memory.
+    // The client waits in coreWaitPayload until the core has called
+    // corePayloadDone after playing the command.
+    void coreWaitPayload();
+    void corePayloadDone();
+
     void coreSetReturn(const void *data, size_t dataLen);
     void coreGetReturn(void *data, size_t dataLen);
     void coreWrite(const void *data, size_t len);
@@ -79,6 +105,8 @@ protected:
     } ClientCmdHeader;
     ClientCmdHeader mLastClientHeader;
 
+    void playCoreCommand(Context *con, const CoreCmdHeader *cmd, const void *data);
+
     bool mRunning;
     bool mPureFifo;
     size_t mMaxInlineSize;
@@ -86,8 +114,28 @@ protected:
     FifoSocket mToClient;
     FifoSocket mToCore;
 
+    // Carries commands to the core when it could be set up; mToCore then
+    // only carries return values.
+    FifoRing mToCoreRing;
+    bool mUseRing;
+    bool mBatching;
+
+    // Likewise for messages to the client.  Senders are serialized by the
+    // context, so the ring still has a single writer.  The message last
+    // returned by getClientHeader stays in it until its payload is read.
+    FifoRing mToClientRing;
+    bool mUseClientRing;
+    const ClientCmdHeader *mPeekedClient;
+
     intptr_t mToCoreRet;
 
+    int (*mIdleCallback)(void *, bool);
+    void *mIdleData;
+    int mIdleMs;
+    // The wait before the next call, -1 for none.
+    int mIdleWaitMs;
+    bool mIdleResumed;
+
     size_t mSendLen;
     uint8_t mSendBuffer[2 * 1024] __attribute__((aligned(sizeof(double))));
 
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsContext.h"
+#include "rsTrace.h"
+#include "rsgApiStructs.h"
+#include "rsgApiFuncDecl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#if !defined(RS_SERVER) && defined(HAVE_ANDROID_OS)
+#include <cutils/properties.h>
+#endif
+
+using namespace android;
+using namespace android::renderscript;
+
+static const uint32_t gCommandCount = sizeof(gPlaybackNames) / sizeof(gPlaybackNames[0]);
+
+static bool writeAll(int fd, const void *data, size_t bytes) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (bytes) {
+        ssize_t r = ::write(fd, p, bytes);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += r;
+        bytes -= r;
+    }
+    return true;
+}
+
+static void report(int fd, const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > 0) {
+        writeAll(fd, buf, ((size_t)len < sizeof(buf)) ? len : sizeof(buf) - 1);
+    }
+}
+
+// Returns the number of bytes read, short only at the end of the file.
+static size_t readAll(int fd, void *data, size_t bytes) {
+    uint8_t *p = (uint8_t *)data;
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t r = ::read(fd, p + done, bytes - done);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            break;
+        }
+        done += r;
+    }
+    return done;
+}
+
+TraceWriter::TraceWriter() {
+    mLock.init();
+    mFd = -1;
+    mFailed = false;
+    mBaseNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    mBuffer = NULL;
+    mBufferSize = 0;
+    mBufferCapacity = 0;
+}
+
+TraceWriter::~TraceWriter() {
+    if (mFd >= 0) {
+        close(mFd);
+    }
+    free(mBuffer);
+}
+
+TraceWriter * TraceWriter::createFromProperty(uint32_t contextType, uint32_t contextFlags,
+                                              uint32_t sdkVersion) {
+#if !defined(RS_SERVER) && defined(HAVE_ANDROID_OS)
+    char prefix[PROPERTY_VALUE_MAX];
+    property_get("debug.rs.trace", prefix, "");
+    if (!prefix[0]) {
+        return NULL;
+    }
+
+    // One file per context, since each replays on a context of its own.
+    static int32_t gTraceCount = 0;
+    char path[PROPERTY_VALUE_MAX + 32];
+    snprintf(path, sizeof(path), "%s.%d.%d", prefix, getpid(),
+             __sync_fetch_and_add(&gTraceCount, 1));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ALOGE("Couldn't open RS trace %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    TraceFileHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = RS_TRACE_MAGIC;
+    h.version = RS_TRACE_VERSION;
+    h.commandCount = gCommandCount;
+    h.pointerSize = sizeof(void *);
+    h.contextType = contextType;
+    h.contextFlags = contextFlags;
+    h.sdkVersion = sdkVersion;
+    if (!writeAll(fd, &h, sizeof(h))) {
+        ALOGE("Couldn't write RS trace %s", path);
+        close(fd);
+        return NULL;
+    }
+
+    TraceWriter *t = new TraceWriter();
+    t->mFd = fd;
+    ALOGD("Recording RS commands to %s", path);
+    return t;
+#else
+    return NULL;
+#endif
+}
+
+int64_t TraceWriter::now() const {
+    return systemTime(SYSTEM_TIME_MONOTONIC) - mBaseNs;
+}
+
+void TraceWriter::begin() {
+    mLock.lock();
+    mBufferSize = 0;
+}
+
+void TraceWriter::write(const void *data, size_t bytes) {
+    if (mBufferSize + bytes > mBufferCapacity) {
+        size_t cap = mBufferCapacity ? mBufferCapacity : 256;
+        while (cap < mBufferSize + bytes) {
+            cap *= 2;
+        }
+        uint8_t *b = (uint8_t *)realloc(mBuffer, cap);
+        if (!b) {
+            if (!mFailed) {
+                ALOGE("Out of memory for RS trace record, stopping trace");
+            }
+            mFailed = true;
+            return;
+        }
+        mBuffer = b;
+        mBufferCapacity = cap;
+    }
+    if (bytes) {
+        memcpy(mBuffer + mBufferSize, data, bytes);
+    }
+    mBufferSize += bytes;
+}
+
+void TraceWriter::end(uint32_t cmdID, int64_t startNs) {
+    if (!mFailed) {
+        TraceRecordHeader rec;
+        rec.cmdID = cmdID;
+        rec.bytes = mBufferSize;
+        rec.startNs = startNs;
+        rec.durationNs = now() - startNs;
+        if (!writeAll(mFd, &rec, sizeof(rec)) || !writeAll(mFd, mBuffer, mBufferSize)) {
+            ALOGE("Couldn't write RS trace record, stopping trace");
+            mFailed = true;
+        }
+    }
+    mLock.unlock();
+}
+
+TraceReader::TraceReader() {
+    mFd = -1;
+    mFailed = false;
+    memset(&mHeader, 0, sizeof(mHeader));
+    mRecord = NULL;
+    mRecordSize = 0;
+    mRecordCapacity = 0;
+    mOffset = 0;
+    mMissingObjects = 0;
+}
+
+TraceReader::~TraceReader() {
+    for (size_t i = 0; i < mScratch.size(); i++) {
+        free(mScratch[i]);
+    }
+    free(mRecord);
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool TraceReader::open(const char *path) {
+    mFd = ::open(path, O_RDONLY);
+    if (mFd < 0) {
+        ALOGE("Couldn't open RS trace %s: %s", path, strerror(errno));
+        return false;
+    }
+    if (readAll(mFd, &mHeader, sizeof(mHeader)) != sizeof(mHeader) ||
+        mHeader.magic != RS_TRACE_MAGIC || mHeader.version != RS_TRACE_VERSION) {
+        ALOGE("%s isn't an RS trace", path);
+        return false;
+    }
+    if (mHeader.commandCount != gCommandCount || mHeader.pointerSize != sizeof(void *)) {
+        ALOGE("RS trace %s was recorded by a different build", path);
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::next(TraceRecordHeader *rec) {
+    for (size_t i = 0; i < mScratch.size(); i++) {
+        free(mScratch[i]);
+    }
+    mScratch.clear();
+    mOffset = 0;
+    mRecordSize = 0;
+
+    size_t r = readAll(mFd, rec, sizeof(*rec));
+    if (r != sizeof(*rec)) {
+        if (r) {
+            ALOGE("RS trace ends in a partial record");
+            mFailed = true;
+        }
+        return false;
+    }
+    if (rec->bytes > mRecordCapacity) {
+        uint8_t *b = (uint8_t *)realloc(mRecord, rec->bytes);
+        if (!b) {
+            mFailed = true;
+            return false;
+        }
+        mRecord = b;
+        mRecordCapacity = rec->bytes;
+    }
+    if (readAll(mFd, mRecord, rec->bytes) != rec->bytes) {
+        ALOGE("RS trace ends in a partial record");
+        mFailed = true;
+        return false;
+    }
+    mRecordSize = rec->bytes;
+    return true;
+}
+
+void TraceReader::read(void *dst, size_t bytes) {
+    if (mOffset + bytes > mRecordSize) {
+        mFailed = true;
+        memset(dst, 0, bytes);
+        return;
+    }
+    memcpy(dst, mRecord + mOffset, bytes);
+    mOffset += bytes;
+}
+
+void * TraceReader::readData(size_t bytes) {
+    // Copied out so the data is aligned for the command's use.
+    void *p = scratch(bytes);
+    if (p) {
+        read(p, bytes);
+    }
+    return p;
+}
+
+void * TraceReader::scratch(size_t bytes) {
+    void *p = calloc(1, bytes ? bytes : 1);
+    if (!p) {
+        mFailed = true;
+        return NULL;
+    }
+    mScratch.push(p);
+    return p;
+}
+
+void TraceReader::map(const void *recorded, void *replayed) {
+    if (recorded) {
+        mObjects.add(recorded, replayed);
+    }
+}
+
+void * TraceReader::lookup(const void *recorded) {
+    if (!recorded) {
+        return NULL;
+    }
+    ssize_t i = mObjects.indexOfKey(recorded);
+    if (i < 0) {
+        // Made outside the traced commands; the command will see NULL.
+        mMissingObjects++;
+        return NULL;
+    }
+    return mObjects.valueAt(i);
+}
+
+
+namespace android {
+namespace renderscript {
+
+struct ReplayMessages {
+    RsContext rsc;
+    volatile bool run;
+};
+
+// The replayed commands may send messages, which have to be taken off the
+// context's queue for it to keep going.
+static void * drainMessages(void *vp) {
+    ReplayMessages *m = (ReplayMessages *)vp;
+    size_t bufSize = 256;
+    void *buf = malloc(bufSize);
+
+    rsContextInitToClient(m->rsc);
+    while (m->run) {
+        size_t receiveLen = 0;
+        uint32_t usrID = 0;
+        RsMessageToClientType r = rsContextPeekMessage(m->rsc, &receiveLen, sizeof(receiveLen),
+                                                       &usrID, sizeof(usrID));
+        if (receiveLen >= bufSize) {
+            bufSize = receiveLen + 32;
+            buf = realloc(buf, bufSize);
+            if (!buf) {
+                break;
+            }
+        }
+        rsContextGetMessage(m->rsc, buf, bufSize, &receiveLen, sizeof(receiveLen),
+                            &usrID, sizeof(usrID));
+        if (r == RS_MESSAGE_TO_CLIENT_ERROR) {
+            ALOGE("RS trace replay error: %s", (const char *)buf);
+        } else if (r == RS_MESSAGE_TO_CLIENT_NONE) {
+            usleep(1000);
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+}
+}
+
+extern "C" bool rsTraceReplay(RsDevice dev, const char *path, bool paced, int reportFd) {
+    TraceReader r;
+    if (!r.open(path)) {
+        return false;
+    }
+    const TraceFileHeader &h = r.getHeader();
+    // Made directly so the replay isn't traced in turn.
+    Context *con = Context::createContext(static_cast<Device *>(dev), NULL,
+                                          (RsContextType)h.contextType, h.contextFlags);
+    if (!con) {
+        ALOGE("Couldn't create a context to replay %s", path);
+        return false;
+    }
+    con->setTargetSdkVersion(h.sdkVersion);
+    RsContext rsc = con;
+
+    ReplayMessages m;
+    m.rsc = rsc;
+    m.run = true;
+    pthread_t messageThread;
+    bool haveMessageThread = pthread_create(&messageThread, NULL, drainMessages, &m) == 0;
+
+    struct CommandStats {
+        uint32_t count;
+        int64_t recordedNs;
+        int64_t replayedNs;
+    };
+    CommandStats *stats = (CommandStats *)calloc(gCommandCount, sizeof(CommandStats));
+
+    bool ok = stats != NULL;
+    TraceRecordHeader rec;
+    int64_t firstNs = -1;
+    int64_t lastNs = 0;
+    const int64_t replayStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    while (ok && r.next(&rec)) {
+        if (!rec.cmdID || rec.cmdID >= gCommandCount || !gTraceReplayFuncs[rec.cmdID]) {
+            ALOGE("RS trace has a command %u that can't be replayed", rec.cmdID);
+            ok = false;
+            break;
+        }
+        if (firstNs < 0) {
+            firstNs = rec.startNs;
+        }
+        if (paced) {
+            // Keep the gaps between calls, which matter to power and to
+            // how warm the driver's threads are.
+            int64_t wait = (rec.startNs - firstNs) -
+                           (systemTime(SYSTEM_TIME_MONOTONIC) - replayStart);
+            if (wait > 0) {
+                usleep(wait / 1000);
+            }
+        }
+
+        int64_t t = systemTime(SYSTEM_TIME_MONOTONIC);
+        gTraceReplayFuncs[rec.cmdID](rsc, &r);
+        stats[rec.cmdID].replayedNs += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+        stats[rec.cmdID].recordedNs += rec.durationNs;
+        stats[rec.cmdID].count++;
+        lastNs = rec.startNs + rec.durationNs;
+        if (r.hasFailed()) {
+            ALOGE("RS trace record for %s is malformed", gPlaybackNames[rec.cmdID]);
+            ok = false;
+        }
+    }
+    rsContextFinish(rsc);
+    const int64_t replayNs = systemTime(SYSTEM_TIME_MONOTONIC) - replayStart;
+    ok = ok && !r.hasFailed();
+
+    if (reportFd >= 0 && stats) {
+        report(reportFd, "%s: recorded %.3f ms, replayed %.3f ms%s\n", path,
+                (firstNs < 0) ? 0.0 : (lastNs - firstNs) / 1e6, replayNs / 1e6,
+                paced ? " (paced)" : "");
+        if (r.getMissingObjects()) {
+            report(reportFd, "%u references to objects made outside the trace\n",
+                    r.getMissingObjects());
+        }
+        report(reportFd, "%-32s %8s %14s %14s\n", "command", "count", "recorded us",
+                "replayed us");
+        for (uint32_t i = 1; i < gCommandCount; i++) {
+            if (stats[i].count) {
+                report(reportFd, "%-32s %8u %14.1f %14.1f\n", gPlaybackNames[i],
+                        stats[i].count, stats[i].recordedNs / 1e3, stats[i].replayedNs / 1e3);
+            }
+        }
+    }
+    free(stats);
+
+    m.run = false;
+    rsContextDeinitToClient(rsc);
+    if (haveMessageThread) {
+        pthread_join(messageThread, NULL);
+    }
+    rsContextDestroy(rsc);
+    return ok;
+}
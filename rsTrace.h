@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RS_TRACE_H
+#define ANDROID_RS_TRACE_H
+
+#include "rsUtils.h"
+#include "rsMutex.h"
+
+#include <utils/KeyedVector.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+namespace renderscript {
+
+// A trace file holds a TraceFileHeader followed by one record per command
+// a context was sent.  A record's data is laid out like the remote FIFO
+// stream: the scalar parameters in order, then the data of each const
+// pointer parameter, then the return value.  Object handles are stored as
+// the recording process saw them and are remapped when replayed.
+enum {
+    RS_TRACE_MAGIC = 0x52535452,       // "RSTR"
+    RS_TRACE_VERSION = 1
+};
+
+struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Number of commands in the API the trace was recorded with.
+    uint32_t commandCount;
+    uint32_t pointerSize;
+    uint32_t contextType;
+    uint32_t contextFlags;
+    uint32_t sdkVersion;
+    uint32_t reserved;
+};
+
+struct TraceRecordHeader {
+    uint32_t cmdID;
+    uint32_t bytes;
+    // Start of the call since the trace was opened, and its length, as
+    // seen by the calling thread.
+    int64_t startNs;
+    int64_t durationNs;
+};
+
+class TraceWriter {
+public:
+    // Opens a trace for the context if debug.rs.trace names a path prefix.
+    static TraceWriter * createFromProperty(uint32_t contextType, uint32_t contextFlags,
+                                            uint32_t sdkVersion);
+    ~TraceWriter();
+
+    int64_t now() const;
+
+    // A record is built between begin() and end(), with other threads'
+    // records held back until it has been written.
+    void begin();
+    void write(const void *data, size_t bytes);
+    void end(uint32_t cmdID, int64_t startNs);
+
+private:
+    TraceWriter();
+
+    Mutex mLock;
+    int mFd;
+    bool mFailed;
+    int64_t mBaseNs;
+    uint8_t *mBuffer;
+    size_t mBufferSize;
+    size_t mBufferCapacity;
+};
+
+class TraceReader {
+public:
+    TraceReader();
+    ~TraceReader();
+
+    bool open(const char *path);
+    const TraceFileHeader & getHeader() const {return mHeader;}
+
+    // Loads the next record, false at the end of the trace.
+    bool next(TraceRecordHeader *rec);
+
+    // Sequential reads from the current record.  readData returns memory
+    // owned by the reader that is valid until the next record.
+    void read(void *dst, size_t bytes);
+    void * readData(size_t bytes);
+    // Memory for a command to write into, valid until the next record.
+    void * scratch(size_t bytes);
+
+    // Object handles from the trace to those made while replaying it.
+    void map(const void *recorded, void *replayed);
+    void * lookup(const void *recorded);
+
+    uint32_t getMissingObjects() const {return mMissingObjects;}
+    bool hasFailed() const {return mFailed;}
+
+private:
+    int mFd;
+    bool mFailed;
+    TraceFileHeader mHeader;
+
+    uint8_t *mRecord;
+    size_t mRecordSize;
+    size_t mRecordCapacity;
+    size_t mOffset;
+
+    Vector<void *> mScratch;
+
+    DefaultKeyedVector<const void *, void *> mObjects;
+    uint32_t mMissingObjects;
+};
+
+typedef void (*RsTraceReplayFunc)(RsContext, TraceReader *);
+
+}
+}
+
+#endif //ANDROID_RS_TRACE_H
@@ -30,15 +30,12 @@ using namespace android::renderscript;
 Type::Type(Context *rsc) : ObjectBase(rsc) {
     memset(&mHal, 0, sizeof(mHal));
     mDimLOD = false;
+    mHashNext = NULL;
+    mHashKey = 0;
 }
 
 void Type::preDestroy() const {
-    for (uint32_t ct = 0; ct < mRSC->mStateType.mTypes.size(); ct++) {
-        if (mRSC->mStateType.mTypes[ct] == this) {
-            mRSC->mStateType.mTypes.removeAt(ct);
-            break;
-        }
-    }
+    mRSC->mStateType.remove(this);
 }
 
 Type::~Type() {
@@ -55,11 +52,98 @@ void Type::clear() {
     memset(&mHal, 0, sizeof(mHal));
 }
 
+static uint32_t hashTypeSignature(const Element *e, uint32_t dimX, uint32_t dimY,
+                                  uint32_t dimZ, bool dimLOD, bool dimFaces,
+                                  uint32_t dimYuv) {
+    uint32_t h = rsHashPointer(RS_HASH_SEED, e);
+    h = rsHashWord(h, dimX);
+    h = rsHashWord(h, dimY);
+    h = rsHashWord(h, dimZ);
+    h = rsHashWord(h, (dimLOD ? 1u : 0u) | (dimFaces ? 2u : 0u));
+    h = rsHashWord(h, dimYuv);
+    return h ^ (h >> 15);
+}
+
 TypeState::TypeState() {
+    mBucketCount = kMinBuckets;
+    mBuckets = new Type *[mBucketCount]();
+    mCount = 0;
 }
 
 TypeState::~TypeState() {
-    rsAssert(!mTypes.size());
+    rsAssert(!mCount);
+    delete [] mBuckets;
+}
+
+size_t TypeState::trim() {
+    uint32_t count = kMinBuckets;
+    while (count < mCount) {
+        count *= 2;
+    }
+    if (count >= mBucketCount) {
+        return 0;
+    }
+    const size_t freed = (mBucketCount - count) * sizeof(Type *);
+    resize(count);
+    return freed;
+}
+
+Type * TypeState::find(const Element *e, uint32_t dimX, uint32_t dimY, uint32_t dimZ,
+                       bool dimLOD, bool dimFaces, uint32_t dimYuv) const {
+    const uint32_t key = hashTypeSignature(e, dimX, dimY, dimZ, dimLOD, dimFaces, dimYuv);
+    for (Type *t = mBuckets[key & (mBucketCount - 1)]; t; t = t->mHashNext) {
+        if (t->mHashKey != key) continue;
+        if (t->getElement() != e) continue;
+        if (t->getDimX() != dimX) continue;
+        if (t->getDimY() != dimY) continue;
+        if (t->getDimZ() != dimZ) continue;
+        if (t->getDimLOD() != dimLOD) continue;
+        if (t->getDimFaces() != dimFaces) continue;
+        if (t->getDimYuv() != dimYuv) continue;
+        return t;
+    }
+    return NULL;
+}
+
+void TypeState::add(Type *t) {
+    if (mCount >= mBucketCount) {
+        resize(mBucketCount * 2);
+    }
+    t->mHashKey = hashTypeSignature(t->getElement(), t->getDimX(), t->getDimY(),
+                                    t->getDimZ(), t->getDimLOD(), t->getDimFaces(),
+                                    t->getDimYuv());
+    Type **bucket = &mBuckets[t->mHashKey & (mBucketCount - 1)];
+    t->mHashNext = *bucket;
+    *bucket = t;
+    mCount++;
+}
+
+void TypeState::remove(const Type *t) {
+    for (Type **link = &mBuckets[t->mHashKey & (mBucketCount - 1)]; *link;
+         link = &(*link)->mHashNext) {
+        if (*link == t) {
+            *link = t->mHashNext;
+            mCount--;
+            return;
+        }
+    }
+}
+
+void TypeState::resize(uint32_t count) {
+    Type **buckets = new Type *[count]();
+    for (uint32_t ct = 0; ct < mBucketCount; ct++) {
+        Type *t = mBuckets[ct];
+        while (t) {
+            Type *next = t->mHashNext;
+            Type **bucket = &buckets[t->mHashKey & (count - 1)];
+            t->mHashNext = *bucket;
+            *bucket = t;
+            t = next;
+        }
+    }
+    delete [] mBuckets;
+    mBuckets = buckets;
+    mBucketCount = count;
 }
 
 void Type::compute() {
@@ -210,24 +294,17 @@ ObjectBaseRef<Type> Type::getTypeRef(Context *rsc, const Element *e,
 
     TypeState * stc = &rsc->mStateType;
 
-    ObjectBase::asyncLock();
-    for (uint32_t ct=0; ct < stc->mTypes.size(); ct++) {
-        Type *t = stc->mTypes[ct];
-        if (t->getElement() != e) continue;
-        if (t->getDimX() != dimX) continue;
-        if (t->getDimY() != dimY) continue;
-        if (t->getDimZ() != dimZ) continue;
-        if (t->getDimLOD() != dimLOD) continue;
-        if (t->getDimFaces() != dimFaces) continue;
-        if (t->getDimYuv() != dimYuv) continue;
+    ObjectBase::asyncLock(rsc);
+    Type *t = stc->find(e, dimX, dimY, dimZ, dimLOD, dimFaces, dimYuv);
+    if (t) {
         returnRef.set(t);
-        ObjectBase::asyncUnlock();
+        ObjectBase::asyncUnlock(rsc);
         return returnRef;
     }
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncUnlock(rsc);
 
 
-    Type *nt = new Type(rsc);
+    Type *nt = new (rsc) Type(rsc);
     nt->mDimLOD = dimLOD;
     returnRef.set(nt);
     nt->mElement.set(e);
@@ -238,9 +315,9 @@ ObjectBaseRef<Type> Type::getTypeRef(Context *rsc, const Element *e,
     nt->mHal.state.dimYuv = dimYuv;
     nt->compute();
 
-    ObjectBase::asyncLock();
-    stc->mTypes.push(nt);
-    ObjectBase::asyncUnlock();
+    ObjectBase::asyncLock(rsc);
+    stc->add(nt);
+    ObjectBase::asyncUnlock(rsc);
 
     return returnRef;
 }
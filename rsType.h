@@ -112,6 +112,12 @@ public:
     void incRefs(const void *ptr, size_t ct, size_t startOff = 0) const;
     void decRefs(const void *ptr, size_t ct, size_t startOff = 0) const;
 
+    void * operator new(size_t size, Context *rsc) {
+        return ObjectBase::slabAlloc(rsc, size);
+    }
+    void operator delete(void *ptr) { ObjectSlab::release(ptr); }
+    void operator delete(void *ptr, Context *) { ObjectSlab::release(ptr); }
+
 protected:
     void makeLODTable();
     bool mDimLOD;
@@ -132,8 +138,14 @@ protected:
     virtual ~Type();
 
 private:
+    friend class TypeState;
+
     Type(Context *);
     Type(const Type &);
+
+    // Chaining and signature hash for the TypeState cache.
+    Type *mHashNext;
+    uint32_t mHashKey;
 };
 
 
@@ -142,8 +154,23 @@ public:
     TypeState();
     ~TypeState();
 
-    // Cache of all existing types.
-    Vector<Type *> mTypes;
+    // Cache of all existing types, hashed on their full signature.  All
+    // three must be called with the context's ObjectBase::asyncLock held.
+    Type * find(const Element *e, uint32_t dimX, uint32_t dimY, uint32_t dimZ,
+                bool dimLOD, bool dimFaces, uint32_t dimYuv) const;
+    void add(Type *t);
+    void remove(const Type *t);
+    // Shrinks the table to fit the entries left, returning the bytes freed.
+    size_t trim();
+
+private:
+    static const uint32_t kMinBuckets = 64;
+    void resize(uint32_t count);
+
+    Type **mBuckets;
+    // Always a power of two.
+    uint32_t mBucketCount;
+    uint32_t mCount;
 };
 
 
@@ -72,6 +72,16 @@ typedef struct {
     uint32_t yStrideIn;
     uint32_t yStrideOut;
     uint32_t slot;
+
+    // Every input of the launch, ins[0] being in, each to be advanced by
+    // eStrideIns[i] per cell.  inLen is 0 when only in is set.
+    const void **ins;
+    const uint32_t *eStrideIns;
+    uint32_t inLen;
+
+    // Rows ahead of the current one that kernels reading several rows
+    // should start loading, or 0 when the launch doesn't prefetch.
+    uint32_t prefetchRows;
 } RsForEachStubParamStruct;
 
 /**
@@ -140,6 +150,35 @@ typedef struct {
                              ObjectBase *data);
 
         void (*destroy)(const Context *rsc, Script *s);
+
+        // Applies count packed RsScriptVarRecord updates, already
+        // validated against the script.
+        void (*setGlobalVars)(const Context *rsc, const Script *s,
+                              const void *records, size_t sizeBytes, uint32_t count);
+        void (*invokeForEachMulti)(const Context *rsc,
+                                   Script *s,
+                                   uint32_t slot,
+                                   const Allocation ** ains,
+                                   size_t inLen,
+                                   Allocation * aout,
+                                   const void * usr,
+                                   size_t usrLen,
+                                   const RsScriptCall *sc);
+        void (*invokeReduce)(const Context *rsc,
+                             Script *s,
+                             uint32_t accumSlot,
+                             uint32_t combineSlot,
+                             int32_t finalizeSlot,
+                             const Allocation * ain,
+                             Allocation * aout,
+                             const RsScriptCall *sc);
+        // Invokes slot count times, with consecutive blocks of paramLength
+        // bytes of params.
+        void (*invokeFunctionBatch)(const Context *rsc, Script *s,
+                                    uint32_t slot,
+                                    const void *params,
+                                    size_t paramLength,
+                                    uint32_t count);
     } script;
 
     struct {
@@ -221,6 +260,44 @@ typedef struct {
                               const void *data, uint32_t elementOff, size_t sizeBytes);
 
         void (*generateMipmaps)(const Context *rsc, const Allocation *alloc);
+
+        // Sets the capacity of a 1D allocation to at least count cells,
+        // trimming any spare capacity beyond that.
+        void (*reserve)(const Context *rsc, const Allocation *alloc, uint32_t count);
+
+        // Applies count packed RsElementDataRecord updates, already
+        // validated against the allocation.
+        void (*elementDataBatch)(const Context *rsc, const Allocation *alloc,
+                                 const void *records, size_t sizeBytes, uint32_t count);
+
+        // Sets up alloc as a view of mHal.state.baseAlloc with no memory of
+        // its own, and adapterOffset moves it to the origin in mHal.state.
+        bool (*initAdapter)(const Context *rsc, Allocation *alloc);
+        void (*adapterOffset)(const Context *rsc, const Allocation *alloc);
+
+        // Returns a new descriptor other contexts can map the memory of a
+        // USAGE_SHARED allocation through, or -1.
+        int (*exportShared)(const Context *rsc, const Allocation *alloc);
+
+        // Sorts the 1D scalar keys, with values, if not NULL, moved along
+        // with them.  Returns false if it couldn't get working memory.
+        bool (*sort)(const Context *rsc, const Allocation *keys, const Allocation *values);
+        // Copies the src cells with nonzero flags to dst, stopping when it
+        // is full, and returns the number copied.
+        uint32_t (*compact)(const Context *rsc, const Allocation *dst, const Allocation *src,
+                            const Allocation *flags);
+        // Copies a w x h x d range between script allocations of elements
+        // with the same vector size, converting each component from the
+        // source type to the destination one.
+        void (*allocConvert)(const Context *rsc,
+                             const Allocation *dstAlloc,
+                             uint32_t dstXoff, uint32_t dstYoff, uint32_t dstZoff,
+                             uint32_t dstLod, RsAllocationCubemapFace dstFace,
+                             uint32_t w, uint32_t h, uint32_t d,
+                             const Allocation *srcAlloc,
+                             uint32_t srcXoff, uint32_t srcYoff, uint32_t srcZoff,
+                             uint32_t srcLod, RsAllocationCubemapFace srcFace,
+                             RsAllocationConversion conversion);
     } allocation;
 
     struct {
@@ -257,6 +334,8 @@ typedef struct {
         bool (*init)(const Context *rsc, const Mesh *m);
         void (*draw)(const Context *rsc, const Mesh *m, uint32_t primIndex, uint32_t start, uint32_t len);
         void (*destroy)(const Context *rsc, const Mesh *m);
+        void (*drawInstanced)(const Context *rsc, const Mesh *m, uint32_t primIndex,
+                              uint32_t start, uint32_t len, const Allocation *transforms);
     } mesh;
 
     struct {
@@ -285,9 +364,26 @@ typedef struct {
                           const ScriptKernelID *kid, Allocation *);
         void (*execute)(const Context *rsc, const ScriptGroup *sg);
         void (*destroy)(const Context *rsc, const ScriptGroup *sg);
+        // Called before the group's links are reallocated for the mode;
+        // any frame still running has to be waited for.
+        void (*setPipelined)(const Context *rsc, const ScriptGroup *sg, bool pipelined);
     } scriptgroup;
 
     void (*finish)(const Context *rsc);
+    // Releases memory the driver keeps cached for reuse, more of it at
+    // higher RsTrimMemoryLevel levels.  Returns the bytes freed that
+    // Context::trackMemory doesn't count.
+    size_t (*trimMemory)(const Context *rsc, int32_t level);
+    // Runs cbk(data, idx) once on each driver worker and the caller, idx
+    // numbering the threads; see Context::canLaunchThreads.
+    void (*launchThreads)(const Context *rsc, void (*cbk)(void *data, uint32_t idx),
+                          void *data);
+    // Copies the kernel launch statistics into profiles, at most count of
+    // them, and returns how many the driver has.
+    uint32_t (*getProfile)(const Context *rsc, RsKernelProfile *profiles, uint32_t count);
+    // Does a little of the driver's low priority work while the context
+    // is idle; returns as the tasks of Context::addIdleTask do.
+    int32_t (*idle)(const Context *rsc);
 } RsdHalFunctions;
 
 
@@ -69,6 +69,12 @@ FontCreateFromMemory {
     ret RsFont
     }
 
+FontPrecache {
+    param RsFont font
+    param uint32_t firstChar
+    param uint32_t lastChar
+    }
+
 MeshCreate {
     param RsAllocation *vtx
     param RsAllocation *idx
@@ -76,6 +82,32 @@ MeshCreate {
     ret RsMesh
     }
 
+MeshCompact {
+    param RsMesh mesh
+    param uint32_t flags
+    }
+
+AnimationCreate {
+    param const float *inValues
+    param const float *outValues
+    param RsAnimationInterpolation interp
+    param RsAnimationEdge pre
+    param RsAnimationEdge post
+    ret RsAnimation
+    }
+
+AnimationEvaluate {
+    param RsAnimation *anims
+    param float time
+    param RsAllocation out
+    }
+
+AnimationEvaluateTimes {
+    param RsAnimation anim
+    param RsAllocation times
+    param RsAllocation out
+    }
+
 PathCreate {
     param RsPathPrimitive pp
     param bool isStatic
@@ -106,6 +138,7 @@ ContextBindFont {
     }
 
 ContextSetSurface {
+    notrace
     param uint32_t width
     param uint32_t height
     param RsNativeWindow sur
@@ -184,6 +184,89 @@ static int hasInlineDataPointers(const ApiEntry * api) {
     return ret;
 }
 
+// Commands with no context, or whose effect can't be reproduced from the
+// trace, are left out of debug.rs.trace captures.
+static int isTraced(const ApiEntry * api) {
+    return !api->nocontext && !api->notrace;
+}
+
+// Handles to objects, which differ between a trace and its replay.
+static int isObjectType(const VarType *vt) {
+    static const char * const objectTypes[] = {
+        "RsAsyncVoidPtr", "RsAdapter1D", "RsAdapter2D", "RsAllocation", "RsAnimation",
+        "RsElement", "RsFile", "RsFont", "RsSampler", "RsScript", "RsScriptKernelID",
+        "RsScriptFieldID", "RsScriptMethodID", "RsScriptGroup", "RsMesh", "RsPath",
+        "RsType", "RsObjectBase", "RsProgram", "RsProgramVertex", "RsProgramFragment",
+        "RsProgramStore", "RsProgramRaster", "RsCommandBuffer"
+    };
+    size_t ct;
+    for (ct = 0; ct < sizeof(objectTypes) / sizeof(objectTypes[0]); ct++) {
+        if (!strcmp(vt->typeName, objectTypes[ct])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void printTraceFuncs(FILE *f) {
+    int ct;
+    int ct2;
+
+    for (ct=0; ct < apiCount; ct++) {
+        const ApiEntry * api = &apis[ct];
+        if (!isTraced(api)) {
+            continue;
+        }
+
+        fprintf(f, "static ");
+        printFuncDecl(f, api, "TF_", 0, 0);
+        fprintf(f, "\n{\n");
+        fprintf(f, "    TraceWriter *t = ((Context *)rsc)->mTrace;\n");
+        fprintf(f, "    const int64_t start = t->now();\n");
+        fprintf(f, "    ");
+        if (api->ret.typeName[0]) {
+            printVarType(f, &api->ret);
+            fprintf(f, " ret = ");
+        }
+        fprintf(f, "s_CurrentTable->%s((Context *)rsc", api->name);
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            fprintf(f, ", %s", api->params[ct2].name);
+        }
+        fprintf(f, ");\n\n");
+
+        fprintf(f, "    t->begin();\n");
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            const VarType *vt = &api->params[ct2];
+            if (vt->ptrLevel == 0) {
+                fprintf(f, "    t->write(&%s, sizeof(%s));\n", vt->name, vt->name);
+            }
+        }
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            const VarType *vt = &api->params[ct2];
+            // Some spec entries take arrays of objects as non-const.
+            if ((vt->ptrLevel == 1) && (vt->isConst || isObjectType(vt))) {
+                fprintf(f, "    t->write(%s, %s_length);\n", vt->name, vt->name);
+            }
+        }
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            const VarType *vt = &api->params[ct2];
+            if ((vt->ptrLevel == 2) && vt->isConst) {
+                fprintf(f, "    for (size_t ct = 0; ct < (%s_length_length / sizeof(%s_length)); ct++) {\n", vt->name, vt->name);
+                fprintf(f, "        t->write(%s[ct], %s_length[ct]);\n", vt->name, vt->name);
+                fprintf(f, "    }\n");
+            }
+        }
+        if (api->ret.typeName[0]) {
+            fprintf(f, "    t->write(&ret, sizeof(ret));\n");
+        }
+        fprintf(f, "    t->end(RS_CMD_ID_%s, start);\n", api->name);
+        if (api->ret.typeName[0]) {
+            fprintf(f, "    return ret;\n");
+        }
+        fprintf(f, "}\n\n");
+    }
+}
+
 void printApiCpp(FILE *f) {
     int ct;
     int ct2;
@@ -300,7 +383,7 @@ void printApiCpp(FILE *f) {
             fprintf(f, "    io->coreCommit();\n");
             if (hasInlineDataPointers(api)) {
                 fprintf(f, "    if (dataSize >= io->getMaxInlineSize()) {\n");
-                fprintf(f, "        io->coreGetReturn(NULL, 0);\n");
+                fprintf(f, "        io->coreWaitPayload();\n");
                 fprintf(f, "    }\n");
             } else if (api->ret.typeName[0]) {
                 fprintf(f, "\n    ");
@@ -399,6 +482,8 @@ void printApiCpp(FILE *f) {
     fprintf(f, "};\n");
 
     fprintf(f, "static RsApiEntrypoints_t *s_CurrentTable = &s_LocalTable;\n\n");
+    printTraceFuncs(f);
+
     for (ct=0; ct < apiCount; ct++) {
         int needFlush = 0;
         const ApiEntry * api = &apis[ct];
@@ -407,6 +492,22 @@ void printApiCpp(FILE *f) {
 
         printFuncDecl(f, api, "rs", 0, 0);
         fprintf(f, "\n{\n");
+        if (isTraced(api)) {
+            fprintf(f, "    if (((Context *)rsc)->mTrace) {\n");
+            fprintf(f, "        ");
+            if (api->ret.typeName[0]) {
+                fprintf(f, "return ");
+            }
+            fprintf(f, "TF_%s(rsc", api->name);
+            for (ct2=0; ct2 < api->paramCount; ct2++) {
+                fprintf(f, ", %s", api->params[ct2].name);
+            }
+            fprintf(f, ");\n");
+            if (!api->ret.typeName[0]) {
+                fprintf(f, "        return;\n");
+            }
+            fprintf(f, "    }\n");
+        }
         fprintf(f, "    ");
         if (api->ret.typeName[0]) {
             fprintf(f, "return ");
@@ -490,7 +591,7 @@ void printPlaybackCpp(FILE *f) {
             }
 
             fprintf(f, "    if ((totalSize != 0) && (cmdSizeBytes == sizeof(RS_CMD_%s))) {\n", api->name);
-            fprintf(f, "        con->mIO.coreSetReturn(NULL, 0);\n");
+            fprintf(f, "        con->mIO.corePayloadDone();\n");
             fprintf(f, "    }\n");
         } else if (api->ret.typeName[0]) {
             fprintf(f, "    con->mIO.coreSetReturn(&ret, sizeof(ret));\n");
@@ -603,6 +704,95 @@ void printPlaybackCpp(FILE *f) {
         fprintf(f, "};\n\n");
     }
 
+    for (ct=0; ct < apiCount; ct++) {
+        const ApiEntry * api = &apis[ct];
+        if (!isTraced(api)) {
+            continue;
+        }
+
+        fprintf(f, "static void rstr_%s(RsContext rsc, TraceReader *r) {\n", api->name);
+        fprintf(f, "    RS_CMD_%s cmd;\n", api->name);
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            const VarType *vt = &api->params[ct2];
+            if (vt->ptrLevel == 0) {
+                fprintf(f, "    r->read(&cmd.%s, sizeof(cmd.%s));\n", vt->name, vt->name);
+                if (isObjectType(vt)) {
+                    fprintf(f, "    cmd.%s = (%s)r->lookup(cmd.%s);\n", vt->name, vt->typeName, vt->name);
+                } else if (!strcmp(vt->typeName, "uintptr_t")) {
+                    // User memory isn't part of the trace.
+                    fprintf(f, "    cmd.%s = 0;\n", vt->name);
+                }
+            }
+        }
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            const VarType *vt = &api->params[ct2];
+            if (vt->ptrLevel != 1) {
+                continue;
+            }
+            if (isObjectType(vt)) {
+                fprintf(f, "    %s *%s = (%s *)r->readData(cmd.%s_length);\n", vt->typeName, vt->name, vt->typeName, vt->name);
+                fprintf(f, "    for (size_t ct = 0; %s && (ct < cmd.%s_length / sizeof(%s)); ct++) {\n", vt->name, vt->name, vt->typeName);
+                fprintf(f, "        %s[ct] = (%s)r->lookup(%s[ct]);\n", vt->name, vt->typeName, vt->name);
+                fprintf(f, "    }\n");
+                fprintf(f, "    cmd.%s = %s;\n", vt->name, vt->name);
+            } else {
+                fprintf(f, "    cmd.%s = (", vt->name);
+                printVarType(f, vt);
+                fprintf(f, ")r->%s(cmd.%s_length);\n", vt->isConst ? "readData" : "scratch", vt->name);
+            }
+        }
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            const VarType *vt = &api->params[ct2];
+            if (vt->ptrLevel != 2) {
+                continue;
+            }
+            fprintf(f, "    const size_t %s_count = cmd.%s_length_length / sizeof(size_t);\n", vt->name, vt->name);
+            fprintf(f, "    %s%s **%s = (%s%s **)r->scratch(%s_count * sizeof(void *));\n",
+                    vt->isConst ? "const " : "", vt->typeName, vt->name,
+                    vt->isConst ? "const " : "", vt->typeName, vt->name);
+            fprintf(f, "    for (size_t ct = 0; %s && cmd.%s_length && (ct < %s_count); ct++) {\n", vt->name, vt->name, vt->name);
+            fprintf(f, "        %s[ct] = (%s%s *)r->%s(cmd.%s_length[ct]);\n", vt->name,
+                    vt->isConst ? "const " : "", vt->typeName,
+                    vt->isConst ? "readData" : "scratch", vt->name);
+            fprintf(f, "    }\n");
+            fprintf(f, "    cmd.%s = %s;\n", vt->name, vt->name);
+        }
+
+        fprintf(f, "    ");
+        if (api->ret.typeName[0]) {
+            printVarType(f, &api->ret);
+            fprintf(f, " ret = ");
+        }
+        fprintf(f, "rs%s(rsc", api->name);
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            fprintf(f, ", cmd.%s", api->params[ct2].name);
+        }
+        fprintf(f, ");\n");
+        if (api->ret.typeName[0]) {
+            fprintf(f, "    ");
+            printVarType(f, &api->ret);
+            fprintf(f, " recorded;\n");
+            fprintf(f, "    r->read(&recorded, sizeof(recorded));\n");
+            if (isObjectType(&api->ret)) {
+                fprintf(f, "    r->map(recorded, ret);\n");
+            } else {
+                fprintf(f, "    (void)ret;\n");
+            }
+        }
+        fprintf(f, "}\n\n");
+    }
+
+    fprintf(f, "RsTraceReplayFunc gTraceReplayFuncs[%i] = {\n", apiCount + 1);
+    fprintf(f, "    NULL,\n");
+    for (ct=0; ct < apiCount; ct++) {
+        if (isTraced(&apis[ct])) {
+            fprintf(f, "    rstr_%s,\n", apis[ct].name);
+        } else {
+            fprintf(f, "    NULL,\n");
+        }
+    }
+    fprintf(f, "};\n");
+
     fprintf(f, "RsPlaybackLocalFunc gPlaybackFuncs[%i] = {\n", apiCount + 1);
     fprintf(f, "    NULL,\n");
     for (ct=0; ct < apiCount; ct++) {
@@ -621,6 +811,13 @@ void printPlaybackCpp(FILE *f) {
     }
     fprintf(f, "};\n");
 
+    fprintf(f, "const char * gPlaybackNames[%i] = {\n", apiCount + 1);
+    fprintf(f, "    \"\",\n");
+    for (ct=0; ct < apiCount; ct++) {
+        fprintf(f, "    \"%s\",\n", apis[ct].name);
+    }
+    fprintf(f, "};\n");
+
     fprintf(f, "};\n");
     fprintf(f, "};\n");
 }
@@ -670,6 +867,10 @@ int main(int argc, char **argv) {
             fprintf(f, "typedef void (*RsPlaybackRemoteFunc)(Context *, ThreadIO *);\n");
             fprintf(f, "extern RsPlaybackLocalFunc gPlaybackFuncs[%i];\n", apiCount + 1);
             fprintf(f, "extern RsPlaybackRemoteFunc gPlaybackRemoteFuncs[%i];\n", apiCount + 1);
+            fprintf(f, "// Command names, for tracing.\n");
+            fprintf(f, "extern const char * gPlaybackNames[%i];\n", apiCount + 1);
+            fprintf(f, "// Replays a debug.rs.trace record of each command, NULL for those not traced.\n");
+            fprintf(f, "extern RsTraceReplayFunc gTraceReplayFuncs[%i];\n", apiCount + 1);
 
             fprintf(f, "}\n");
             fprintf(f, "}\n");
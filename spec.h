@@ -27,6 +27,7 @@ typedef struct {
   int handcodeApi;
   int direct;
   int nocontext;
+  int notrace;
   int paramCount;
   VarType ret;
   VarType params[16];
@@ -0,0 +1,477 @@
+#include "RenderScript.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace android;
+using namespace RSC;
+
+// Sweeps the intrinsics over image sizes and element types. Each run is
+// printed as one comma separated line on stdout, after a header naming the
+// columns, so results can be collected and compared between builds:
+//
+//   rstest-benchmark [iters] [forceCpu] [filter]
+//
+// where filter, if given, limits the run to intrinsics whose name starts
+// with it. Throughput is measured over iters back to back launches with a
+// single finish; latency percentiles time each of another iters launches
+// on its own, finish included, so small sizes show the launch overhead.
+
+static const uint32_t kSizes[][2] = {
+    {64, 64},
+    {640, 480},
+    {1920, 1080},
+    {3840, 2160},
+};
+
+static int64_t nowNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+class Bench {
+public:
+    Bench(sp<RS> rs) : mRS(rs) {}
+    virtual ~Bench() {}
+    // Prepares the intrinsic and allocations for a w by h image.
+    virtual bool setup(uint32_t w, uint32_t h) = 0;
+    virtual void run() = 0;
+
+protected:
+    sp<RS> mRS;
+
+    sp<Allocation> createImage(sp<const Element> e, uint32_t w, uint32_t h) {
+        Type::Builder tb(mRS, e);
+        tb.setX(w);
+        tb.setY(h);
+        sp<Allocation> a = Allocation::createTyped(mRS, tb.create());
+        if (a != NULL) {
+            fill(a);
+        }
+        return a;
+    }
+
+    // Noise rather than zeroes, so data dependent paths see real work.
+    void fill(sp<Allocation> a) {
+        sp<const Type> t = a->getType();
+        uint32_t w = t->getX();
+        uint32_t h = t->getY() ? t->getY() : 1;
+        uint32_t d = t->getZ() ? t->getZ() : 1;
+        size_t bytes = t->getElement()->getSizeBytes() * w * h * d;
+        std::vector<uint8_t> data(bytes);
+        uint32_t seed = 0x12345678;
+        for (size_t i = 0; i < bytes; i++) {
+            seed = seed * 1103515245 + 12345;
+            data[i] = (uint8_t)(seed >> 16);
+        }
+        if (a->getType()->getElement()->getDataType() == RS_TYPE_FLOAT_32) {
+            float *f = (float *)&data[0];
+            for (size_t i = 0; i < bytes / sizeof(float); i++) {
+                f[i] = (float)(data[i * sizeof(float)]) / 255.f;
+            }
+        }
+        if (t->getZ()) {
+            a->copy3DRangeFrom(0, 0, 0, w, h, d, &data[0]);
+        } else {
+            a->copy2DRangeFrom(0, 0, w, h, &data[0]);
+        }
+    }
+};
+
+class BlurBench : public Bench {
+public:
+    BlurBench(sp<RS> rs, sp<const Element> e, float radius)
+        : Bench(rs), mElement(e), mRadius(radius) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        mScript = ScriptIntrinsicBlur::create(mRS, mElement);
+        mIn = createImage(mElement, w, h);
+        mOut = createImage(mElement, w, h);
+        if (mScript == NULL || mIn == NULL || mOut == NULL) {
+            return false;
+        }
+        mScript->setRadius(mRadius);
+        mScript->setInput(mIn);
+        return true;
+    }
+    virtual void run() { mScript->forEach(mOut); }
+
+private:
+    sp<const Element> mElement;
+    float mRadius;
+    sp<ScriptIntrinsicBlur> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+class Convolve3x3Bench : public Bench {
+public:
+    Convolve3x3Bench(sp<RS> rs, sp<const Element> e) : Bench(rs), mElement(e) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        mScript = ScriptIntrinsicConvolve3x3::create(mRS, mElement);
+        mIn = createImage(mElement, w, h);
+        mOut = createImage(mElement, w, h);
+        if (mScript == NULL || mIn == NULL || mOut == NULL) {
+            return false;
+        }
+        float coeffs[9] = {-1.f, -1.f, -1.f, -1.f, 9.f, -1.f, -1.f, -1.f, -1.f};
+        mScript->setCoefficients(coeffs);
+        mScript->setInput(mIn);
+        return true;
+    }
+    virtual void run() { mScript->forEach(mOut); }
+
+private:
+    sp<const Element> mElement;
+    sp<ScriptIntrinsicConvolve3x3> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+class Convolve5x5Bench : public Bench {
+public:
+    Convolve5x5Bench(sp<RS> rs, sp<const Element> e) : Bench(rs), mElement(e) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        mScript = ScriptIntrinsicConvolve5x5::create(mRS, mElement);
+        mIn = createImage(mElement, w, h);
+        mOut = createImage(mElement, w, h);
+        if (mScript == NULL || mIn == NULL || mOut == NULL) {
+            return false;
+        }
+        float coeffs[25];
+        for (int i = 0; i < 25; i++) {
+            coeffs[i] = 1.f / 25.f;
+        }
+        mScript->setCoefficients(coeffs);
+        mScript->setInput(mIn);
+        return true;
+    }
+    virtual void run() { mScript->forEach(mOut); }
+
+private:
+    sp<const Element> mElement;
+    sp<ScriptIntrinsicConvolve5x5> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+class ColorMatrixBench : public Bench {
+public:
+    enum Config {
+        GREYSCALE,
+        RGB_TO_YUV,
+        MATRIX4_ADD
+    };
+    ColorMatrixBench(sp<RS> rs, sp<const Element> e, Config config)
+        : Bench(rs), mElement(e), mConfig(config) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        mScript = ScriptIntrinsicColorMatrix::create(mRS);
+        mIn = createImage(mElement, w, h);
+        mOut = createImage(mElement, w, h);
+        if (mScript == NULL || mIn == NULL || mOut == NULL) {
+            return false;
+        }
+        if (mConfig == GREYSCALE) {
+            mScript->setGreyscale();
+        } else if (mConfig == RGB_TO_YUV) {
+            mScript->setRGBtoYUV();
+        } else {
+            float m[16] = {0.9f, 0.1f, 0.f, 0.f,
+                           0.1f, 0.8f, 0.1f, 0.f,
+                           0.f, 0.1f, 0.9f, 0.f,
+                           0.f, 0.f, 0.f, 1.f};
+            float add[4] = {0.05f, 0.05f, 0.05f, 0.f};
+            mScript->setColorMatrix4(m);
+            mScript->setAdd(add);
+        }
+        return true;
+    }
+    virtual void run() { mScript->forEach(mIn, mOut); }
+
+private:
+    sp<const Element> mElement;
+    Config mConfig;
+    sp<ScriptIntrinsicColorMatrix> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+typedef void (ScriptIntrinsicBlend::*BlendFunc_t)(sp<Allocation>, sp<Allocation>);
+
+class BlendBench : public Bench {
+public:
+    BlendBench(sp<RS> rs, BlendFunc_t func) : Bench(rs), mFunc(func) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        sp<const Element> e = Element::U8_4(mRS);
+        mScript = ScriptIntrinsicBlend::create(mRS, e);
+        mIn = createImage(e, w, h);
+        mOut = createImage(e, w, h);
+        return mScript != NULL && mIn != NULL && mOut != NULL;
+    }
+    virtual void run() { (mScript.get()->*mFunc)(mIn, mOut); }
+
+private:
+    BlendFunc_t mFunc;
+    sp<ScriptIntrinsicBlend> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+class LUTBench : public Bench {
+public:
+    LUTBench(sp<RS> rs) : Bench(rs) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        sp<const Element> e = Element::U8_4(mRS);
+        mScript = ScriptIntrinsicLUT::create(mRS, e);
+        mIn = createImage(e, w, h);
+        mOut = createImage(e, w, h);
+        if (mScript == NULL || mIn == NULL || mOut == NULL) {
+            return false;
+        }
+        unsigned char table[256];
+        for (int i = 0; i < 256; i++) {
+            table[i] = 255 - i;
+        }
+        mScript->setRed(0, 256, table);
+        mScript->setBlue(0, 256, table);
+        return true;
+    }
+    virtual void run() { mScript->forEach(mIn, mOut); }
+
+private:
+    sp<ScriptIntrinsicLUT> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+class LUT3DBench : public Bench {
+public:
+    LUT3DBench(sp<RS> rs, uint32_t lutDim, RsScriptIntrinsic3DLUTInterpolation mode)
+        : Bench(rs), mLutDim(lutDim), mMode(mode) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        sp<const Element> e = Element::U8_4(mRS);
+        mScript = ScriptIntrinsic3DLUT::create(mRS, e);
+        mIn = createImage(e, w, h);
+        mOut = createImage(e, w, h);
+        mLut = Allocation::createTyped(mRS, Type::create(mRS, e, mLutDim, mLutDim, mLutDim));
+        if (mScript == NULL || mIn == NULL || mOut == NULL || mLut == NULL) {
+            return false;
+        }
+        fill(mLut);
+        mScript->setLUT(mLut);
+        mScript->setInterpolation(mMode);
+        return true;
+    }
+    virtual void run() { mScript->forEach(mIn, mOut); }
+
+private:
+    uint32_t mLutDim;
+    RsScriptIntrinsic3DLUTInterpolation mMode;
+    sp<ScriptIntrinsic3DLUT> mScript;
+    sp<Allocation> mIn, mOut, mLut;
+};
+
+class YuvToRGBBench : public Bench {
+public:
+    YuvToRGBBench(sp<RS> rs) : Bench(rs) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        sp<const Element> e = Element::U8_4(mRS);
+        mScript = ScriptIntrinsicYuvToRGB::create(mRS, e);
+        Type::Builder tb(mRS, Element::YUV(mRS));
+        tb.setX(w);
+        tb.setY(h);
+        tb.setYuvFormat(RS_YUV_NV21);
+        mIn = Allocation::createTyped(mRS, tb.create());
+        mOut = createImage(e, w, h);
+        if (mScript == NULL || mIn == NULL || mOut == NULL) {
+            return false;
+        }
+        mScript->setInput(mIn);
+        return true;
+    }
+    virtual void run() { mScript->forEach(mOut); }
+
+private:
+    sp<ScriptIntrinsicYuvToRGB> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+class HistogramBench : public Bench {
+public:
+    HistogramBench(sp<RS> rs, sp<const Element> e, bool dot)
+        : Bench(rs), mElement(e), mDot(dot) {}
+    virtual bool setup(uint32_t w, uint32_t h) {
+        mScript = ScriptIntrinsicHistogram::create(mRS);
+        mIn = createImage(mElement, w, h);
+        sp<const Element> oe = (mDot || mElement->getVectorSize() == 1) ?
+                Element::I32(mRS) : Element::I32_4(mRS);
+        mOut = Allocation::createSized(mRS, oe, 256);
+        if (mScript == NULL || mIn == NULL || mOut == NULL) {
+            return false;
+        }
+        mScript->setOutput(mOut);
+        return true;
+    }
+    virtual void run() {
+        if (mDot) {
+            mScript->forEach_dot(mIn);
+        } else {
+            mScript->forEach(mIn);
+        }
+    }
+
+private:
+    sp<const Element> mElement;
+    bool mDot;
+    sp<ScriptIntrinsicHistogram> mScript;
+    sp<Allocation> mIn, mOut;
+};
+
+static int iters = 50;
+static const char *filter = NULL;
+static int failures = 0;
+
+static void measure(sp<RS> rs, Bench *b, const char *name, const char *config,
+                    const char *elem) {
+    if (filter && strncmp(name, filter, strlen(filter))) {
+        delete b;
+        return;
+    }
+    for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+        uint32_t w = kSizes[s][0];
+        uint32_t h = kSizes[s][1];
+        if (!b->setup(w, h) || rs->getError() != RS_SUCCESS) {
+            fprintf(stderr, "%s %s %s %ux%u: setup failed\n", name, config, elem, w, h);
+            failures++;
+            break;
+        }
+
+        // Warm up so the driver has timed the launch before we measure.
+        b->run();
+        rs->finish();
+
+        int64_t start = nowNs();
+        for (int i = 0; i < iters; i++) {
+            b->run();
+        }
+        rs->finish();
+        int64_t elapsed = nowNs() - start;
+
+        std::vector<int64_t> lat(iters);
+        for (int i = 0; i < iters; i++) {
+            int64_t t = nowNs();
+            b->run();
+            rs->finish();
+            lat[i] = nowNs() - t;
+        }
+        std::sort(lat.begin(), lat.end());
+
+        if (rs->getError() != RS_SUCCESS) {
+            fprintf(stderr, "%s %s %s %ux%u: launch failed\n", name, config, elem, w, h);
+            failures++;
+            break;
+        }
+
+        double mpixs = (double)w * h * iters / ((double)elapsed / 1000.0);
+        printf("%s,%s,%s,%u,%u,%.2f,%.1f,%.1f,%.1f\n", name, config, elem, w, h, mpixs,
+               lat[iters / 2] / 1000.0, lat[iters * 9 / 10] / 1000.0,
+               lat[iters * 99 / 100] / 1000.0);
+        fflush(stdout);
+    }
+    delete b;
+}
+
+int main(int argc, char** argv)
+{
+    bool forceCpu = false;
+
+    if (argc >= 2) {
+        iters = atoi(argv[1]);
+        if (iters <= 0) {
+            printf("iters must be positive\n");
+            return 1;
+        }
+    }
+    if (argc >= 3 && atoi(argv[2]) != 0) {
+        forceCpu = true;
+    }
+    if (argc >= 4) {
+        filter = argv[3];
+    }
+
+    sp<RS> rs = new RS();
+    if (!rs->init("/system/bin", forceCpu ? RS_INIT_LOW_LATENCY : 0)) {
+        printf("Could not initialize RenderScript\n");
+        return 1;
+    }
+
+    printf("# intrinsic,config,element,width,height,mpix_per_s,p50_us,p90_us,p99_us\n");
+
+    sp<const Element> u8 = Element::U8(rs);
+    sp<const Element> u8_4 = Element::U8_4(rs);
+    sp<const Element> f32_4 = Element::F32_4(rs);
+
+    static const float radii[] = {1.f, 5.f, 10.f, 25.f};
+    for (size_t i = 0; i < sizeof(radii) / sizeof(radii[0]); i++) {
+        char config[16];
+        snprintf(config, sizeof(config), "r%g", radii[i]);
+        measure(rs, new BlurBench(rs, u8, radii[i]), "Blur", config, "U8");
+        measure(rs, new BlurBench(rs, u8_4, radii[i]), "Blur", config, "U8_4");
+    }
+
+    measure(rs, new Convolve3x3Bench(rs, u8), "Convolve3x3", "sharpen", "U8");
+    measure(rs, new Convolve3x3Bench(rs, u8_4), "Convolve3x3", "sharpen", "U8_4");
+    measure(rs, new Convolve3x3Bench(rs, f32_4), "Convolve3x3", "sharpen", "F32_4");
+    measure(rs, new Convolve5x5Bench(rs, u8), "Convolve5x5", "box", "U8");
+    measure(rs, new Convolve5x5Bench(rs, u8_4), "Convolve5x5", "box", "U8_4");
+    measure(rs, new Convolve5x5Bench(rs, f32_4), "Convolve5x5", "box", "F32_4");
+
+    measure(rs, new ColorMatrixBench(rs, u8_4, ColorMatrixBench::GREYSCALE),
+            "ColorMatrix", "greyscale", "U8_4");
+    measure(rs, new ColorMatrixBench(rs, u8_4, ColorMatrixBench::RGB_TO_YUV),
+            "ColorMatrix", "rgb2yuv", "U8_4");
+    measure(rs, new ColorMatrixBench(rs, u8_4, ColorMatrixBench::MATRIX4_ADD),
+            "ColorMatrix", "matrix4_add", "U8_4");
+    measure(rs, new ColorMatrixBench(rs, f32_4, ColorMatrixBench::MATRIX4_ADD),
+            "ColorMatrix", "matrix4_add", "F32_4");
+
+    static const struct {
+        const char *name;
+        BlendFunc_t func;
+    } blends[] = {
+        {"clear", &ScriptIntrinsicBlend::forEachClear},
+        {"src", &ScriptIntrinsicBlend::forEachSrc},
+        {"dst", &ScriptIntrinsicBlend::forEachDst},
+        {"src_over", &ScriptIntrinsicBlend::forEachSrcOver},
+        {"dst_over", &ScriptIntrinsicBlend::forEachDstOver},
+        {"src_in", &ScriptIntrinsicBlend::forEachSrcIn},
+        {"dst_in", &ScriptIntrinsicBlend::forEachDstIn},
+        {"src_out", &ScriptIntrinsicBlend::forEachSrcOut},
+        {"dst_out", &ScriptIntrinsicBlend::forEachDstOut},
+        {"src_atop", &ScriptIntrinsicBlend::forEachSrcAtop},
+        {"dst_atop", &ScriptIntrinsicBlend::forEachDstAtop},
+        {"xor", &ScriptIntrinsicBlend::forEachXor},
+        {"multiply", &ScriptIntrinsicBlend::forEachMultiply},
+        {"add", &ScriptIntrinsicBlend::forEachAdd},
+        {"subtract", &ScriptIntrinsicBlend::forEachSubtract},
+    };
+    for (size_t i = 0; i < sizeof(blends) / sizeof(blends[0]); i++) {
+        measure(rs, new BlendBench(rs, blends[i].func), "Blend", blends[i].name, "U8_4");
+    }
+
+    measure(rs, new LUTBench(rs), "LUT", "invert_rb", "U8_4");
+    measure(rs, new LUT3DBench(rs, 17, RS_3DLUT_INTERPOLATION_TRILINEAR),
+            "3DLUT", "17_trilinear", "U8_4");
+    measure(rs, new LUT3DBench(rs, 17, RS_3DLUT_INTERPOLATION_TETRAHEDRAL),
+            "3DLUT", "17_tetrahedral", "U8_4");
+    measure(rs, new LUT3DBench(rs, 33, RS_3DLUT_INTERPOLATION_TRILINEAR),
+            "3DLUT", "33_trilinear", "U8_4");
+
+    measure(rs, new YuvToRGBBench(rs), "YuvToRGB", "nv21", "U8_4");
+
+    measure(rs, new HistogramBench(rs, u8, false), "Histogram", "plain", "U8");
+    measure(rs, new HistogramBench(rs, u8_4, false), "Histogram", "plain", "U8_4");
+    measure(rs, new HistogramBench(rs, u8_4, true), "Histogram", "dot", "U8_4");
+
+    rs->finish();
+    return failures ? 1 : 0;
+}
@@ -1,14 +1,56 @@
 #include "RenderScript.h"
 #include <sys/time.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "ScriptC_latency.h"
 
 using namespace android;
 using namespace RSC;
 
+static long long nowUs() {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (long long)t.tv_sec * 1000000 + t.tv_usec;
+}
+
+// Latency samples in microseconds.
+class Stats {
+public:
+    Stats() : mSorted(true) {}
+
+    void add(long long us) {
+        mSamples.push_back(us);
+        mSorted = false;
+    }
+
+    long long percentile(int p) {
+        if (mSamples.empty()) {
+            return 0;
+        }
+        if (!mSorted) {
+            std::sort(mSamples.begin(), mSamples.end());
+            mSorted = true;
+        }
+        size_t i = mSamples.size() * p / 100;
+        return mSamples[i < mSamples.size() ? i : mSamples.size() - 1];
+    }
+
+    void print() {
+        printf("%lld us p50, %lld us p90, %lld us p99, %lld us max",
+               percentile(50), percentile(90), percentile(99), percentile(100));
+    }
+
+private:
+    std::vector<long long> mSamples;
+    bool mSorted;
+};
+
 int main(int argc, char** argv)
 {
     int iters = 100;
+    int warmup = 10;
     int numElems = 1000;
     bool forceCpu = false;
     bool synchronous = false;
@@ -43,6 +85,14 @@ int main(int argc, char** argv)
             synchronous = true;
     }
 
+    if (argc >= 6) {
+        warmup = atoi(argv[5]);
+        if (warmup < 0) {
+            printf("warmup must not be negative\n");
+            return 1;
+        }
+    }
+
     if (forceCpu)
         printf("forcing CPU\n");
 
@@ -103,6 +153,80 @@ int main(int argc, char** argv)
     printf("elapsed time with copy : %lld microseconds\n", elapsed);
     printf("time per iter with copy: %f microseconds\n", (double)elapsed / iters);
 
+    // Distributions rather than averages, since scheduler changes show up
+    // in the tail first.  For each thread limit and element count:
+    //   fifo   time for an asynchronous launch to return, which is the cost
+    //          of writing the command
+    //   total  a launch followed by finish()
+    //   launch total for the empty kernel less an idle finish(), the cost of
+    //          dispatching the launch and waking and joining the workers
+    //   kernel total for the busy kernel less that of the empty one
+    // Each point is preceded by warmup launches so the driver has timed the
+    // kernels and picked how to split them before samples are taken.
+    Stats idle;
+    for (int i = 0; i < warmup; i++) {
+        rs->finish();
+    }
+    for (int i = 0; i < iters; i++) {
+        long long t = nowUs();
+        rs->finish();
+        idle.add(nowUs() - t);
+    }
+    printf("idle finish: ");
+    idle.print();
+    printf("\n");
+
+    static const uint32_t threadLimits[] = {1, 2, 4, 0};
+    for (size_t l = 0; l < sizeof(threadLimits) / sizeof(threadLimits[0]); l++) {
+        sc->setLaunchHints(threadLimits[l]);
+        if (threadLimits[l]) {
+            printf("at most %u threads:\n", threadLimits[l]);
+        } else {
+            printf("all threads:\n");
+        }
+
+        for (int elems = 1; elems <= 4 * 1024 * 1024; elems *= 16) {
+            Type::Builder otb(rs, e);
+            otb.setX(elems);
+            sp<const Type> ot = otb.create();
+            sp<Allocation> oin = Allocation::createTyped(rs, ot);
+            sp<Allocation> oout = Allocation::createTyped(rs, ot);
+
+            for (int i = 0; i < warmup; i++) {
+                sc->forEach_root(oin, oout);
+                sc->forEach_busy(oin, oout);
+            }
+            rs->finish();
+
+            Stats fifo, empty, busy;
+            for (int i = 0; i < iters; i++) {
+                long long t = nowUs();
+                sc->forEach_root(oin, oout);
+                long long queued = nowUs();
+                rs->finish();
+                fifo.add(queued - t);
+                empty.add(nowUs() - t);
+
+                t = nowUs();
+                sc->forEach_busy(oin, oout);
+                rs->finish();
+                busy.add(nowUs() - t);
+            }
+
+            printf("  %8d elements\n", elems);
+            printf("    fifo:   ");
+            fifo.print();
+            printf("\n    total:  ");
+            empty.print();
+            printf("\n    launch: %lld us p50, %lld us p99\n",
+                   empty.percentile(50) - idle.percentile(50),
+                   empty.percentile(99) - idle.percentile(50));
+            printf("    kernel: %lld us p50, %lld us p99\n",
+                   busy.percentile(50) - empty.percentile(50),
+                   busy.percentile(99) - empty.percentile(99));
+        }
+    }
+
     sc.clear();
     t.clear();
     e.clear();
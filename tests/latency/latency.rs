@@ -22,4 +22,12 @@ void root(const uint32_t *v_in, uint32_t *v_out) {
 
 }
 
-
+// Enough arithmetic per element for the launch to be dominated by the
+// kernel once it is spread across the worker threads.
+uint32_t __attribute__((kernel)) busy(uint32_t in) {
+    uint32_t v = in;
+    for (int i = 0; i < 64; i++) {
+        v = v * 1664525 + 1013904223;
+    }
+    return v;
+}
@@ -0,0 +1,56 @@
+#include "rs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Replays command traces recorded by setting debug.rs.trace to a path
+// prefix, which gives one file per context created while it is set:
+//
+//   rstest-replay [-p] [-n count] trace...
+//
+// -p keeps the recorded gaps between commands, -n replays each trace count
+// times so the later runs show it with the driver warmed up.
+int main(int argc, char** argv)
+{
+    bool paced = false;
+    int count = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "pn:")) != -1) {
+        switch (c) {
+        case 'p':
+            paced = true;
+            break;
+        case 'n':
+            count = atoi(optarg);
+            if (count <= 0) {
+                printf("count must be positive\n");
+                return 1;
+            }
+            break;
+        default:
+            printf("usage: %s [-p] [-n count] trace...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        printf("usage: %s [-p] [-n count] trace...\n", argv[0]);
+        return 1;
+    }
+
+    RsDevice dev = rsDeviceCreate();
+    int failures = 0;
+    for (int i = optind; i < argc; i++) {
+        for (int run = 0; run < count; run++) {
+            if (!rsTraceReplay(dev, argv[i], paced, STDOUT_FILENO)) {
+                printf("%s: replay failed\n", argv[i]);
+                failures++;
+                break;
+            }
+        }
+    }
+    rsDeviceDestroy(dev);
+    return failures ? 1 : 0;
+}